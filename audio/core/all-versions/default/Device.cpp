@@ -73,6 +73,19 @@ int Device::halSetParameters(const char* keysAndValues) {
     return mDevice->set_parameters(mDevice, keysAndValues);
 }
 
+bool Device::isIdempotentParam(const String8& key) const {
+    // Plain state settings that are re-applied on call setup and screen changes.
+    // Connection and routing keys are commands and always go to the HAL, as are
+    // the HFP and SCO keys: HALs reset those at call teardown and rely on them
+    // being sent again to start the next session.
+    static const char* const kIdempotentKeys[] = {
+        AudioParameter::keyScreenState, AudioParameter::keyBtNrec,
+        AUDIO_PARAMETER_KEY_TTY_MODE,   AUDIO_PARAMETER_KEY_HAC,
+        AUDIO_PARAMETER_KEY_ROTATION};
+    return std::any_of(std::begin(kIdempotentKeys), std::end(kIdempotentKeys),
+                       [&key](const char* k) { return key == k; });
+}
+
 // Methods from ::android::hardware::audio::CPP_VERSION::IDevice follow.
 Return<Result> Device::initCheck() {
     return analyzeStatus("init_check", mDevice->init_check(mDevice));
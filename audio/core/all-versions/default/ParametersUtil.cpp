@@ -103,6 +103,15 @@ void ParametersUtil::getParametersImpl(
 }
 
 std::unique_ptr<AudioParameter> ParametersUtil::getParams(const AudioParameter& keys) {
+    const bool isStatic = areStaticParams(keys);
+    const std::string query = keys.toString().string();
+    if (isStatic) {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        auto it = mStaticParams.find(query);
+        if (it != mStaticParams.end()) {
+            return std::unique_ptr<AudioParameter>(new AudioParameter(String8(it->second.c_str())));
+        }
+    }
     String8 paramsAndValues;
     char* halValues = halGetParameters(keys.keysToString().string());
     if (halValues != NULL) {
@@ -111,7 +120,40 @@ std::unique_ptr<AudioParameter> ParametersUtil::getParams(const AudioParameter&
     } else {
         paramsAndValues.clear();
     }
-    return std::unique_ptr<AudioParameter>(new AudioParameter(paramsAndValues));
+    std::unique_ptr<AudioParameter> params(new AudioParameter(paramsAndValues));
+    if (isStatic && params->size() != 0) {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        mStaticParams[query] = paramsAndValues.string();
+    }
+    // The HAL may have changed these on its own, keep track of what it reports.
+    updateIdempotentParams(*params, true /*isSet*/);
+    return params;
+}
+
+bool ParametersUtil::areStaticParams(const AudioParameter& keys) const {
+    // Entries with a value are the query context, every queried key must be static.
+    bool hasKey = false;
+    String8 key, value;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys.getAt(i, key, value) != OK) return false;
+        if (!value.empty()) continue;
+        if (!isStaticParam(key)) return false;
+        hasKey = true;
+    }
+    return hasKey;
+}
+
+void ParametersUtil::updateIdempotentParams(const AudioParameter& params, bool isSet) {
+    std::lock_guard<std::mutex> lock(mCacheLock);
+    String8 key, value;
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params.getAt(i, key, value) != OK || !isIdempotentParam(key)) continue;
+        if (isSet) {
+            mIdempotentParams[key.string()] = value.string();
+        } else {
+            mIdempotentParams.erase(key.string());
+        }
+    }
 }
 
 Result ParametersUtil::setParam(const char* name, const char* value) {
@@ -156,8 +198,29 @@ Result ParametersUtil::setParam(const char* name, const DeviceAddress& address)
 }
 
 Result ParametersUtil::setParams(const AudioParameter& param) {
+    {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        bool unchanged = param.size() != 0;
+        String8 key, value;
+        for (size_t i = 0; unchanged && i < param.size(); ++i) {
+            if (param.getAt(i, key, value) != OK || !isIdempotentParam(key)) {
+                unchanged = false;
+                break;
+            }
+            auto it = mIdempotentParams.find(key.string());
+            unchanged = it != mIdempotentParams.end() && it->second == value.string();
+        }
+        if (unchanged) return Result::OK;
+    }
     int halStatus = halSetParameters(param.toString().string());
-    return util::analyzeStatus(halStatus);
+    Result retval = util::analyzeStatus(halStatus);
+    if (retval == Result::OK) {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        mStaticParams.clear();
+    }
+    // On failure the HAL state is unknown, forget the values so the next set goes through.
+    updateIdempotentParams(param, retval == Result::OK /*isSet*/);
+    return retval;
 }
 
 }  // namespace implementation
@@ -60,6 +60,14 @@ int Stream::halSetParameters(const char* keysAndValues) {
     return mStream->set_parameters(mStream, keysAndValues);
 }
 
+bool Stream::isStaticParam(const String8& key) const {
+    // The stream capabilities only change with its configuration or routing,
+    // which is changed by setting parameters and thus drops the cached replies.
+    return key == AudioParameter::keyStreamSupportedFormats ||
+           key == AudioParameter::keyStreamSupportedSamplingRates ||
+           key == AudioParameter::keyStreamSupportedChannels;
+}
+
 // Methods from ::android::hardware::audio::CPP_VERSION::IStream follow.
 Return<uint64_t> Stream::getFrameSize() {
     // Needs to be implemented by interface subclasses. But can't be declared as pure virtual,
@@ -42,7 +42,8 @@ class ReadThread : public Thread {
    public:
     // ReadThread's lifespan never exceeds StreamIn's lifespan.
     ReadThread(std::atomic<bool>* stop, audio_stream_in_t* stream, StreamIn::CommandMQ* commandMQ,
-               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup)
+               StreamIn::DataMQ* dataMQ, StreamIn::StatusMQ* statusMQ, EventFlag* efGroup,
+               ThreadTimingStats* stats)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -50,11 +51,7 @@ class ReadThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mStats(stats) {}
     virtual ~ReadThread() {}
 
    private:
@@ -64,7 +61,8 @@ class ReadThread : public Thread {
     StreamIn::DataMQ* mDataMQ;
     StreamIn::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
+    ThreadTimingStats* mStats;
+    nsecs_t mLastTransferTime = 0;
     IStreamIn::ReadParameters mParameters;
     IStreamIn::ReadStatus mStatus;
 
@@ -84,16 +82,40 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
-    ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
     mStatus.retval = Result::OK;
-    if (readResult >= 0) {
-        mStatus.reply.read = readResult;
-        if (!mDataMQ->write(&mBuffer[0], readResult)) {
-            ALOGW("data message queue write failed");
+    mStatus.reply.read = 0;
+    // Let the HAL read straight into the FMQ memory instead of copying it in
+    // afterwards. When the free space wraps around the end of the queue it
+    // takes two reads.
+    StreamIn::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginWrite(requestedToRead, &tx)) {
+        ALOGW("data message queue write failed");
+        return;
+    }
+    const StreamIn::DataMQ::MemRegion regions[] = {tx.getFirstRegion(), tx.getSecondRegion()};
+    size_t totalRead = 0;
+    for (const auto& region : regions) {
+        if (region.getLength() == 0) {
+            break;
+        }
+        ssize_t readResult = mStream->read(mStream, region.getAddress(), region.getLength());
+        if (readResult < 0) {
+            // Only fail the command if nothing has been captured yet.
+            if (totalRead == 0) {
+                mStatus.retval = Stream::analyzeStatus("read", readResult);
+            }
+            break;
         }
-    } else {
-        mStatus.retval = Stream::analyzeStatus("read", readResult);
+        totalRead += readResult;
+        if (static_cast<size_t>(readResult) < region.getLength()) {
+            break;  // Short read, the rest of the space stays free.
+        }
+    }
+    if (!mDataMQ->commitWrite(totalRead)) {
+        ALOGW("data message queue write failed");
+        return;
     }
+    mStatus.reply.read = totalRead;
 }
 
 void ReadThread::doGetCapturePosition() {
@@ -107,7 +129,9 @@ bool ReadThread::threadLoop() {
     // as the Thread uses mutexes, and this can lead to priority inversion.
     while (!std::atomic_load_explicit(mStop, std::memory_order_acquire)) {
         uint32_t efState = 0;
+        const nsecs_t waitStartTime = systemTime();
         mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
+        const nsecs_t wakeTime = systemTime();
         if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL))) {
             continue;  // Nothing to do.
         }
@@ -117,7 +141,11 @@ bool ReadThread::threadLoop() {
         mStatus.replyTo = mParameters.command;
         switch (mParameters.command) {
             case IStreamIn::ReadCommand::READ:
+                mStats->wait.record(wakeTime - waitStartTime);
+                if (mLastTransferTime != 0) mStats->cycle.record(wakeTime - mLastTransferTime);
+                mLastTransferTime = wakeTime;
                 doRead();
+                mStats->work.record(systemTime() - wakeTime);
                 break;
             case IStreamIn::ReadCommand::GET_CAPTURE_POSITION:
                 doGetCapturePosition();
@@ -265,7 +293,7 @@ Return<Result> StreamIn::setParameters(const hidl_vec<ParameterValue>& parameter
 }
 
 Return<void> StreamIn::debugDump(const hidl_handle& fd) {
-    return mStreamCommon->debugDump(fd);
+    return debug(fd, {} /* options */);
 }
 #elif MAJOR_VERSION >= 4
 Return<void> StreamIn::getDevices(getDevices_cb _hidl_cb) {
@@ -392,12 +420,7 @@ Return<void> StreamIn::prepareForReading(uint32_t frameSize, uint32_t framesCoun
     // Create and launch the thread.
     sp<ReadThread> tempReadThread =
             new ReadThread(&mStopReadThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
-                           tempStatusMQ.get(), tempElfGroup.get());
-    if (!tempReadThread->init()) {
-        ALOGW("failed to start reader thread: %s", strerror(-status));
-        sendError(Result::INVALID_ARGUMENTS);
-        return Void();
-    }
+                           tempStatusMQ.get(), tempElfGroup.get(), &mReadThreadStats);
     status = tempReadThread->run("reader", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start reader thread: %s", strerror(-status));
@@ -448,6 +471,9 @@ Return<void> StreamIn::getCapturePosition(getCapturePosition_cb _hidl_cb) {
 }
 
 Return<void> StreamIn::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        mReadThreadStats.dump(fd->data[0], "Read", "legacy read");
+    }
     return mStreamCommon->debug(fd, options);
 }
 
@@ -27,6 +27,7 @@
 #include <memory>
 
 #include <android/log.h>
+#include <halmetrics/Metrics.h>
 #include <hardware/audio.h>
 #include <utils/Trace.h>
 
@@ -43,7 +44,7 @@ class WriteThread : public Thread {
     // WriteThread's lifespan never exceeds StreamOut's lifespan.
     WriteThread(std::atomic<bool>* stop, audio_stream_out_t* stream,
                 StreamOut::CommandMQ* commandMQ, StreamOut::DataMQ* dataMQ,
-                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup)
+                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup, ThreadTimingStats* stats)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -51,11 +52,7 @@ class WriteThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mStats(stats) {}
     virtual ~WriteThread() {}
 
    private:
@@ -65,7 +62,8 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
+    ThreadTimingStats* mStats;
+    nsecs_t mLastTransferTime = 0;
     IStreamOut::WriteStatus mStatus;
 
     bool threadLoop() override;
@@ -79,14 +77,30 @@ void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
+    // Hand the FMQ memory straight to the HAL instead of copying it out first.
+    // When the data wraps around the end of the queue it takes two writes.
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    const StreamOut::DataMQ::MemRegion regions[] = {tx.getFirstRegion(), tx.getSecondRegion()};
+    for (const auto& region : regions) {
+        if (region.getLength() == 0) {
+            break;
+        }
+        ssize_t writeResult = mStream->write(mStream, region.getAddress(), region.getLength());
+        if (writeResult < 0) {
             mStatus.retval = Stream::analyzeStatus("write", writeResult);
+            break;
+        }
+        mStatus.reply.written += writeResult;
+        if (static_cast<size_t>(writeResult) < region.getLength()) {
+            break;  // Short write, the HAL can't take the rest right now.
         }
     }
+    // As with a plain read, the whole transaction is consumed regardless of
+    // how much the HAL accepted.
+    mDataMQ->commitRead(availToRead);
 }
 
 void WriteThread::doGetPresentationPosition() {
@@ -106,7 +120,9 @@ bool WriteThread::threadLoop() {
     // as the Thread uses mutexes, and this can lead to priority inversion.
     while (!std::atomic_load_explicit(mStop, std::memory_order_acquire)) {
         uint32_t efState = 0;
+        const nsecs_t waitStartTime = systemTime();
         mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY), &efState);
+        const nsecs_t wakeTime = systemTime();
         if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY))) {
             continue;  // Nothing to do.
         }
@@ -115,7 +131,16 @@ bool WriteThread::threadLoop() {
         }
         switch (mStatus.replyTo) {
             case IStreamOut::WriteCommand::WRITE:
+                mStats->wait.record(wakeTime - waitStartTime);
+                if (mLastTransferTime != 0) mStats->cycle.record(wakeTime - mLastTransferTime);
+                mLastTransferTime = wakeTime;
                 doWrite();
+                {
+                    const nsecs_t workTime = systemTime() - wakeTime;
+                    mStats->work.record(workTime);
+                    HAL_METRICS_RECORD_NS("audio.StreamOut.write", workTime);
+                }
+                HAL_METRICS_ADD("audio.StreamOut.write.bytes", mStatus.reply.written);
                 break;
             case IStreamOut::WriteCommand::GET_PRESENTATION_POSITION:
                 doGetPresentationPosition();
@@ -271,7 +296,7 @@ Return<Result> StreamOut::setParameters(const hidl_vec<ParameterValue>& paramete
 }
 
 Return<void> StreamOut::debugDump(const hidl_handle& fd) {
-    return mStreamCommon->debugDump(fd);
+    return debug(fd, {} /* options */);
 }
 #elif MAJOR_VERSION >= 4
 Return<void> StreamOut::getDevices(getDevices_cb _hidl_cb) {
@@ -378,12 +403,7 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     // Create and launch the thread.
     sp<WriteThread> tempWriteThread =
             new WriteThread(&mStopWriteThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
-                            tempStatusMQ.get(), tempElfGroup.get());
-    if (!tempWriteThread->init()) {
-        ALOGW("failed to start writer thread: %s", strerror(-status));
-        sendError(Result::INVALID_ARGUMENTS);
-        return Void();
-    }
+                            tempStatusMQ.get(), tempElfGroup.get(), &mWriteThreadStats);
     status = tempWriteThread->run("writer", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
@@ -557,6 +577,10 @@ Return<void> StreamOut::getMmapPosition(getMmapPosition_cb _hidl_cb) {
 }
 
 Return<void> StreamOut::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        if (metrics::dumpIfRequested(fd->data[0], options)) return Void();
+        mWriteThreadStats.dump(fd->data[0], "Write", "legacy write");
+    }
     return mStreamCommon->debug(fd, options);
 }
 
@@ -146,6 +146,7 @@ struct Device : public IDevice, public ParametersUtil {
     // Methods from ParametersUtil.
     char* halGetParameters(const char* keys) override;
     int halSetParameters(const char* keysAndValues) override;
+    bool isIdempotentParam(const String8& key) const override;
 
     uint32_t version() const { return mDevice->common.version; }
 };
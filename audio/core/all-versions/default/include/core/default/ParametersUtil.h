@@ -20,7 +20,10 @@
 #include PATH(android/hardware/audio/FILE_VERSION/types.h)
 
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 
 #include <hidl/HidlSupport.h>
 #include <media/AudioParameter.h>
@@ -59,6 +62,25 @@ class ParametersUtil {
 
     virtual char* halGetParameters(const char* keys) = 0;
     virtual int halSetParameters(const char* keysAndValues) = 0;
+
+    /** Static parameters are only queried from the HAL once per context. The cached
+     * replies are dropped as soon as any parameter is successfully set.
+     */
+    virtual bool isStaticParam(const String8& /*key*/) const { return false; }
+    /** Setting an idempotent parameter to the value it already has is not
+     * forwarded to the HAL.
+     */
+    virtual bool isIdempotentParam(const String8& /*key*/) const { return false; }
+
+   private:
+    bool areStaticParams(const AudioParameter& keys) const;
+    void updateIdempotentParams(const AudioParameter& params, bool isSet);
+
+    std::mutex mCacheLock;
+    // Replies to static parameter queries, keyed by the query string.
+    std::map<std::string, std::string> mStaticParams;
+    // Last known values of idempotent parameters.
+    std::map<std::string, std::string> mIdempotentParams;
 };
 
 }  // namespace implementation
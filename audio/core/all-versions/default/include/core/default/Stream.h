@@ -117,6 +117,7 @@ struct Stream : public IStream, public ParametersUtil {
     // Methods from ParametersUtil.
     char* halGetParameters(const char* keys) override;
     int halSetParameters(const char* keysAndValues) override;
+    bool isStaticParam(const String8& key) const override;
 };
 
 template <typename T>
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUDIO_THREAD_TIMING_STATS_H
+#define ANDROID_HARDWARE_AUDIO_THREAD_TIMING_STATS_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <halmetrics/Metrics.h>
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace CPP_VERSION {
+namespace implementation {
+
+/** Timing of the cycles of a stream's I/O thread, for underrun forensics.
+ * It is recorded by the I/O thread and can be dumped concurrently from a binder thread.
+ */
+struct ThreadTimingStats {
+    metrics::Histogram wait;   // Time blocked on the FMQ event flag before a transfer.
+    metrics::Histogram work;   // Duration of the legacy HAL read or write call.
+    metrics::Histogram cycle;  // Interval between consecutive transfers.
+
+    void dump(int fd, const char* threadName, const char* workName) const {
+        dprintf(fd, "%s thread timing:\n", threadName);
+        dump(fd, "FMQ wait", wait);
+        dump(fd, workName, work);
+        dump(fd, "cycle", cycle);
+    }
+
+   private:
+    static void dump(int fd, const char* name, const metrics::Histogram& histogram) {
+        dprintf(fd, "  %s: count=%" PRIu64 " p50=%" PRIu64 "us p99=%" PRIu64 "us max=%" PRIu64
+                "us\n", name, histogram.count(), histogram.percentile(50) / 1000,
+                histogram.percentile(99) / 1000, histogram.max() / 1000);
+    }
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_AUDIO_THREAD_TIMING_STATS_H
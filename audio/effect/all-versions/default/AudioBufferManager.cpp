@@ -25,29 +25,45 @@ namespace android {
 ANDROID_SINGLETON_STATIC_INSTANCE(AudioBufferManager);
 
 bool AudioBufferManager::wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper) {
+    Shard& shard = getShard(buffer.id);
     // Check if we have this buffer already
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(buffer.id);
-    if (idx >= 0) {
-        *wrapper = mBuffers[idx].promote();
-        if (*wrapper != nullptr) {
-            (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
-            return true;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.lock);
+        auto it = shard.buffers.find(buffer.id);
+        if (it != shard.buffers.end()) {
+            *wrapper = it->second.promote();
+            if (*wrapper != nullptr) {
+                (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
+                return true;
+            }
         }
-        mBuffers.removeItemsAt(idx);
     }
-    // Need to create and init a new AudioBufferWrapper.
+    // Need to create and init a new AudioBufferWrapper. Mapping the memory is slow,
+    // so it is done without holding the shard lock.
     sp<AudioBufferWrapper> tempBuffer(new AudioBufferWrapper(buffer));
     if (!tempBuffer->init()) return false;
+    std::unique_lock<std::shared_mutex> lock(shard.lock);
+    auto& entry = shard.buffers[buffer.id];
+    // Another thread may have mapped the same buffer in the meantime, reuse its mapping.
+    *wrapper = entry.promote();
+    if (*wrapper != nullptr) {
+        (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
+        lock.unlock();  // 'tempBuffer' removes its own entry on destruction.
+        return true;
+    }
+    entry = tempBuffer;
     *wrapper = tempBuffer;
-    mBuffers.add(buffer.id, *wrapper);
     return true;
 }
 
-void AudioBufferManager::removeEntry(uint64_t id) {
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(id);
-    if (idx >= 0) mBuffers.removeItemsAt(idx);
+void AudioBufferManager::removeEntry(uint64_t id, AudioBufferWrapper* wrapper) {
+    Shard& shard = getShard(id);
+    std::unique_lock<std::shared_mutex> lock(shard.lock);
+    auto it = shard.buffers.find(id);
+    // The entry may already refer to a newer wrapper of the same buffer.
+    if (it != shard.buffers.end() && it->second.unsafe_get() == wrapper) {
+        shard.buffers.erase(it);
+    }
 }
 
 namespace hardware {
@@ -60,7 +76,7 @@ AudioBufferWrapper::AudioBufferWrapper(const AudioBuffer& buffer)
     : mHidlBuffer(buffer), mHalBuffer{0, {nullptr}} {}
 
 AudioBufferWrapper::~AudioBufferWrapper() {
-    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id);
+    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id, this);
 }
 
 bool AudioBufferWrapper::init() {
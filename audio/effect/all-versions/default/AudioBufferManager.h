@@ -19,11 +19,13 @@
 
 #include PATH(android/hardware/audio/effect/FILE_VERSION/types.h)
 
+#include <array>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include <android/hidl/memory/1.0/IMemory.h>
 #include <system/audio_effect.h>
-#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 
@@ -73,10 +75,20 @@ class AudioBufferManager : public Singleton<AudioBufferManager> {
     friend class hardware::audio::effect::CPP_VERSION::implementation::AudioBufferWrapper;
 
     // Called by AudioBufferWrapper.
-    void removeEntry(uint64_t id);
+    void removeEntry(uint64_t id, AudioBufferWrapper* wrapper);
 
-    std::mutex mLock;
-    KeyedVector<uint64_t, wp<AudioBufferWrapper>> mBuffers;
+    // Buffers are spread over shards by id so that effects of different sessions
+    // setting their buffers don't contend on a single lock. Lookups of already
+    // mapped buffers, by far the most common case, only take the shard lock shared.
+    struct Shard {
+        std::shared_mutex lock;
+        std::unordered_map<uint64_t, wp<AudioBufferWrapper>> buffers;
+    };
+    static constexpr size_t kShardCount = 16;
+
+    Shard& getShard(uint64_t id) { return mShards[id % kShardCount]; }
+
+    std::array<Shard, kShardCount> mShards;
 };
 
 }  // namespace android
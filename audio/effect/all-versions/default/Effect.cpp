@@ -23,7 +23,10 @@
 #include "Effect.h"
 #include "common/all-versions/default/EffectMap.h"
 
+#include <inttypes.h>
 #include <memory.h>
+#include <stdio.h>
+#include <time.h>
 
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
@@ -44,12 +47,18 @@ using ::android::hardware::audio::common::CPP_VERSION::implementation::AudioChan
 
 namespace {
 
+uint64_t threadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 class ProcessThread : public Thread {
    public:
     // ProcessThread's lifespan never exceeds Effect's lifespan.
     ProcessThread(std::atomic<bool>* stop, effect_handle_t effect,
                   std::atomic<audio_buffer_t*>* inBuffer, std::atomic<audio_buffer_t*>* outBuffer,
-                  Effect::StatusMQ* statusMQ, EventFlag* efGroup)
+                  Effect::StatusMQ* statusMQ, EventFlag* efGroup, Effect::ProcessStats* stats)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mEffect(effect),
@@ -57,7 +66,8 @@ class ProcessThread : public Thread {
           mInBuffer(inBuffer),
           mOutBuffer(outBuffer),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup) {}
+          mEfGroup(efGroup),
+          mStats(stats) {}
     virtual ~ProcessThread() {}
 
    private:
@@ -68,10 +78,28 @@ class ProcessThread : public Thread {
     std::atomic<audio_buffer_t*>* mOutBuffer;
     Effect::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    Effect::ProcessStats* mStats;
 
     bool threadLoop() override;
+    void updateStats(uint64_t cpuTimeNs, bool inPlace);
 };
 
+void ProcessThread::updateStats(uint64_t cpuTimeNs, bool inPlace) {
+    // This thread is the only writer, so plain load/store pairs are enough.
+    mStats->count.store(mStats->count.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    if (inPlace) {
+        mStats->inPlaceCount.store(mStats->inPlaceCount.load(std::memory_order_relaxed) + 1,
+                                   std::memory_order_relaxed);
+    }
+    mStats->totalCpuTimeNs.store(
+        mStats->totalCpuTimeNs.load(std::memory_order_relaxed) + cpuTimeNs,
+        std::memory_order_relaxed);
+    if (cpuTimeNs > mStats->maxCpuTimeNs.load(std::memory_order_relaxed)) {
+        mStats->maxCpuTimeNs.store(cpuTimeNs, std::memory_order_relaxed);
+    }
+}
+
 bool ProcessThread::threadLoop() {
     // This implementation doesn't return control back to the Thread until it decides to stop,
     // as the Thread uses mutexes, and this can lead to priority inversion.
@@ -97,12 +125,14 @@ bool ProcessThread::threadLoop() {
             audio_buffer_t* outBuffer =
                 std::atomic_load_explicit(mOutBuffer, std::memory_order_relaxed);
             if (inBuffer != nullptr && outBuffer != nullptr) {
+                const uint64_t startCpuTimeNs = threadCpuTimeNs();
                 if (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS)) {
                     processResult = (*mEffect)->process(mEffect, inBuffer, outBuffer);
                 } else {
                     processResult = (*mEffect)->process_reverse(mEffect, inBuffer, outBuffer);
                 }
                 std::atomic_thread_fence(std::memory_order_release);
+                updateStats(threadCpuTimeNs() - startCpuTimeNs, inBuffer->raw == outBuffer->raw);
             } else {
                 ALOGE("processing buffers were not set before calling 'process'");
                 processResult = -ENODEV;
@@ -372,7 +402,8 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
 
     // Create and launch the thread.
     mProcessThread = new ProcessThread(&mStopProcessThread, mHandle, &mHalInBufferPtr,
-                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup);
+                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup,
+                                       &mProcessStats);
     status = mProcessThread->run("effect", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start effect processing thread: %s", strerror(-status));
@@ -718,6 +749,15 @@ Return<Result> Effect::close() {
 
 Return<void> Effect::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
     if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        const uint64_t count = mProcessStats.count.load(std::memory_order_relaxed);
+        const uint64_t totalCpuTimeNs =
+            mProcessStats.totalCpuTimeNs.load(std::memory_order_relaxed);
+        dprintf(fd->data[0],
+                "Processed %" PRIu64 " buffers (%" PRIu64 " in place), CPU time per buffer: "
+                "avg %.1f us, max %.1f us\n",
+                count, mProcessStats.inPlaceCount.load(std::memory_order_relaxed),
+                count ? totalCpuTimeNs / 1000.0 / count : 0.0,
+                mProcessStats.maxCpuTimeNs.load(std::memory_order_relaxed) / 1000.0);
         uint32_t cmdData = fd->data[0];
         (void)sendCommand(EFFECT_CMD_DUMP, "DUMP", sizeof(cmdData), &cmdData);
     }
@@ -53,6 +53,13 @@ using namespace ::android::hardware::audio::effect::CPP_VERSION;
 
 struct Effect : public IEffect {
     typedef MessageQueue<Result, kSynchronizedReadWrite> StatusMQ;
+    // Written by the processing thread only, read by 'debug'.
+    struct ProcessStats {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> inPlaceCount{0};
+        std::atomic<uint64_t> totalCpuTimeNs{0};
+        std::atomic<uint64_t> maxCpuTimeNs{0};
+    };
     using GetParameterSuccessCallback =
         std::function<void(uint32_t valueSize, const void* valueData)>;
 
@@ -179,6 +186,7 @@ struct Effect : public IEffect {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopProcessThread;
     sp<Thread> mProcessThread;
+    ProcessStats mProcessStats;
 
     virtual ~Effect();
 
@@ -16,8 +16,11 @@
 
 #include "AudioControl.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
@@ -37,19 +40,36 @@ using ::android::hardware::hidl_string;
 static const float kLowerBound = -1.0f;
 static const float kUpperBound = 1.0f;
 
-AudioControl::AudioControl() {}
+static void recordLatency(metrics::Histogram* histogram, std::chrono::nanoseconds latency) {
+    histogram->record(latency.count());
+}
+
+AudioControl::AudioControl() : mDispatcherThread(&AudioControl::dispatchFocusEvents, this) {}
+
+AudioControl::~AudioControl() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mFocusEventsChanged.notify_one();
+    mDispatcherThread.join();
+}
 
 Return<sp<ICloseHandle>> AudioControl::registerFocusListener(const sp<IFocusListener>& listener) {
     LOG(DEBUG) << "registering focus listener";
     sp<ICloseHandle> closeHandle(nullptr);
 
     if (listener) {
-        mFocusListener = listener;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mFocusListeners.push_back(listener);
+        }
 
         closeHandle = new CloseHandle([this, listener]() {
-            if (mFocusListener == listener) {
-                mFocusListener = nullptr;
-            }
+            std::lock_guard<std::mutex> lock(mLock);
+            mFocusListeners.erase(
+                    std::remove(mFocusListeners.begin(), mFocusListeners.end(), listener),
+                    mFocusListeners.end());
         });
     } else {
         LOG(ERROR) << "Unexpected nullptr for listener resulting in no-op.";
@@ -86,9 +106,86 @@ Return<void> AudioControl::onAudioFocusChange(hidl_bitfield<AudioUsage> usage, i
                                               hidl_bitfield<AudioFocusChange> focusChange) {
     LOG(INFO) << "Focus changed: " << static_cast<int>(focusChange) << " for usage "
               << static_cast<int>(usage) << " in zone " << zoneId;
+    std::lock_guard<std::mutex> lock(mLock);
+    const auto it = mPendingFocusRequests.find({usage, zoneId});
+    if (it != mPendingFocusRequests.end()) {
+        recordLatency(&mZoneStats[zoneId].focusChange, Clock::now() - it->second);
+        mPendingFocusRequests.erase(it);
+    }
     return Void();
 }
 
+void AudioControl::requestAudioFocus(hidl_bitfield<AudioUsage> usage, int zoneId,
+                                     hidl_bitfield<AudioFocusChange> focusGain) {
+    queueFocusEvent({.isRequest = true,
+                     .usage = usage,
+                     .zoneId = zoneId,
+                     .focusGain = focusGain,
+                     .queuedTime = Clock::now()});
+}
+
+void AudioControl::abandonAudioFocus(hidl_bitfield<AudioUsage> usage, int zoneId) {
+    queueFocusEvent({.isRequest = false,
+                     .usage = usage,
+                     .zoneId = zoneId,
+                     .focusGain = 0,
+                     .queuedTime = Clock::now()});
+}
+
+void AudioControl::queueFocusEvent(const FocusEvent& event) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFocusEvents.push_back(event);
+        mMaxQueuedFocusEvents = std::max(mMaxQueuedFocusEvents, mFocusEvents.size());
+        ZoneStats& stats = mZoneStats[event.zoneId];
+        if (event.isRequest) {
+            ++stats.requests;
+            mPendingFocusRequests[{event.usage, event.zoneId}] = event.queuedTime;
+        } else {
+            ++stats.abandons;
+            // A request abandoned before its answer is never answered, drop it so that it
+            // neither lingers in the dump nor times a later answer to the same usage.
+            mPendingFocusRequests.erase({event.usage, event.zoneId});
+        }
+    }
+    mFocusEventsChanged.notify_one();
+}
+
+// Sends the focus events to the listeners in the order they were queued, which keeps the events of
+// each zone in order.
+void AudioControl::dispatchFocusEvents() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mFocusEventsChanged.wait(lock, [this] { return mExiting || !mFocusEvents.empty(); });
+        if (mExiting) return;
+
+        const FocusEvent event = mFocusEvents.front();
+        mFocusEvents.pop_front();
+        const std::vector<sp<IFocusListener>> listeners = mFocusListeners;
+        if (listeners.empty()) {
+            LOG(WARNING) << "Dropping focus event for usage " << event.usage << " in zone "
+                         << event.zoneId << " - no focus listener registered";
+            mPendingFocusRequests.erase({event.usage, event.zoneId});
+            continue;
+        }
+
+        lock.unlock();
+        for (const sp<IFocusListener>& listener : listeners) {
+            const Return<void> ret =
+                    event.isRequest
+                            ? listener->requestAudioFocus(event.usage, event.zoneId,
+                                                          event.focusGain)
+                            : listener->abandonAudioFocus(event.usage, event.zoneId);
+            if (!ret.isOk()) {
+                LOG(ERROR) << "Failed to dispatch focus event: " << ret.description();
+            }
+        }
+        const Clock::time_point dispatchedTime = Clock::now();
+        lock.lock();
+        recordLatency(&mZoneStats[event.zoneId].dispatch, dispatchedTime - event.queuedTime);
+    }
+}
+
 Return<void> AudioControl::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
     if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
         LOG(ERROR) << "Invalid parameters passed to debug()";
@@ -118,16 +215,38 @@ void AudioControl::cmdDump(int fd, const hidl_vec<hidl_string>& options) {
 }
 
 void AudioControl::dump(int fd) {
-    if (mFocusListener == nullptr) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mFocusListeners.empty()) {
         dprintf(fd, "No focus listener registered\n");
     } else {
-        dprintf(fd, "Focus listener registered\n");
+        dprintf(fd, "%zu focus listener(s) registered\n", mFocusListeners.size());
+    }
+    dprintf(fd, "Focus events queued: %zu (max %zu)\n", mFocusEvents.size(),
+            mMaxQueuedFocusEvents);
+    dprintf(fd, "Focus requests awaiting onAudioFocusChange: %zu\n", mPendingFocusRequests.size());
+    const auto dumpLatency = [fd](const char* name, const metrics::Histogram& latency) {
+        const uint64_t count = latency.count();
+        if (count == 0) {
+            dprintf(fd, "    %s latency: none\n", name);
+            return;
+        }
+        dprintf(fd,
+                "    %s latency: %" PRIu64 " samples, avg %" PRIu64 "us, p99 %" PRIu64
+                "us, max %" PRIu64 "us\n",
+                name, count, latency.sum() / count / 1000, latency.percentile(99) / 1000,
+                latency.max() / 1000);
+    };
+    for (const auto& [zoneId, stats] : mZoneStats) {
+        dprintf(fd, "Zone %d: %" PRIu64 " requests, %" PRIu64 " abandons\n", zoneId,
+                stats.requests, stats.abandons);
+        dumpLatency("Dispatch", stats.dispatch);
+        dumpLatency("Focus change", stats.focusChange);
     }
 }
 
 void AudioControl::cmdHelp(int fd) const {
     dprintf(fd, "Usage: \n\n");
-    dprintf(fd, "[no args]: dumps focus listener status\n");
+    dprintf(fd, "[no args]: dumps focus listener status and focus latencies per zone\n");
     dprintf(fd, "--help: shows this help\n");
     dprintf(fd,
             "--request <USAGE> <ZONE_ID> <FOCUS_GAIN>: requests audio focus for specified "
@@ -156,12 +275,7 @@ void AudioControl::cmdRequestFocus(int fd, const hidl_vec<hidl_string>& options)
         return;
     }
 
-    if (mFocusListener == nullptr) {
-        dprintf(fd, "Unable to request focus - no focus listener registered\n");
-        return;
-    }
-
-    mFocusListener->requestAudioFocus(usage, zoneId, focusGain);
+    requestAudioFocus(usage, zoneId, focusGain);
     dprintf(fd, "Requested focus for usage %d, zoneId %d, and focusGain %d\n", usage, zoneId,
             focusGain);
 }
@@ -180,12 +294,7 @@ void AudioControl::cmdAbandonFocus(int fd, const hidl_vec<hidl_string>& options)
         return;
     }
 
-    if (mFocusListener == nullptr) {
-        dprintf(fd, "Unable to abandon focus - no focus listener registered\n");
-        return;
-    }
-
-    mFocusListener->abandonAudioFocus(usage, zoneId);
+    abandonAudioFocus(usage, zoneId);
     dprintf(fd, "Abandoned focus for usage %d and zoneId %d\n", usage, zoneId);
 }
 
@@ -20,9 +20,19 @@
 #include <android/hardware/audio/common/6.0/types.h>
 #include <android/hardware/automotive/audiocontrol/2.0/IAudioControl.h>
 #include <android/hardware/automotive/audiocontrol/2.0/ICloseHandle.h>
+#include <halmetrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
 using android::hardware::audio::common::V6_0::AudioUsage;
 
 namespace android::hardware::automotive::audiocontrol::V2_0::implementation {
@@ -39,9 +49,50 @@ class AudioControl : public IAudioControl {
 
     // Implementation details
     AudioControl();
+    ~AudioControl();
+
+    /**
+     * Focus requests of the vendor audio stack. They are queued and sent to the focus listeners
+     * from a dispatcher thread, in order, so that the caller never waits on the car service.
+     */
+    void requestAudioFocus(hidl_bitfield<AudioUsage> usage, int zoneId,
+                           hidl_bitfield<AudioFocusChange> focusGain);
+    void abandonAudioFocus(hidl_bitfield<AudioUsage> usage, int zoneId);
 
   private:
-    sp<IFocusListener> mFocusListener;
+    using Clock = std::chrono::steady_clock;
+
+    struct FocusEvent {
+        bool isRequest;
+        hidl_bitfield<AudioUsage> usage;
+        int zoneId;
+        hidl_bitfield<AudioFocusChange> focusGain;
+        Clock::time_point queuedTime;
+    };
+
+    struct ZoneStats {
+        uint64_t requests = 0;
+        uint64_t abandons = 0;
+        // From queuing a focus event to the end of its dispatch to the listeners.
+        metrics::Histogram dispatch;
+        // From queuing a focus request to the onAudioFocusChange answering it.
+        metrics::Histogram focusChange;
+    };
+
+    void queueFocusEvent(const FocusEvent& event);
+    void dispatchFocusEvents();
+
+    // Guards all the members below but the thread.
+    std::mutex mLock;
+    std::condition_variable mFocusEventsChanged;
+    std::deque<FocusEvent> mFocusEvents;
+    size_t mMaxQueuedFocusEvents = 0;
+    bool mExiting = false;
+    std::vector<sp<IFocusListener>> mFocusListeners;
+    std::map<int, ZoneStats> mZoneStats;
+    // Queuing time of the focus requests waiting for onAudioFocusChange, by usage and zone.
+    std::map<std::pair<hidl_bitfield<AudioUsage>, int>, Clock::time_point> mPendingFocusRequests;
+    std::thread mDispatcherThread;
 
     static bool checkArgumentsSize(int fd, const hidl_vec<hidl_string>& options, size_t minSize);
     static bool checkCallerHasWritePermissions(int fd);
@@ -25,11 +25,21 @@
 #include <linux/can/error.h>
 #include <linux/can/raw.h>
 
+#include <cinttypes>
+#include <fstream>
+#include <thread>
+
 namespace android::hardware::automotive::can::V1_0::implementation {
 
 /** Whether to log sent/received packets. */
 static constexpr bool kSuperVerbose = false;
 
+/** Matches every frame, the kernel default for new sockets. */
+static constexpr struct can_filter kPassAllFilter = {.can_id = 0, .can_mask = 0};
+
+/** How often a closing listener checks whether the batch being dispatched is done. */
+static constexpr auto kDispatchWaitPeriod = std::chrono::milliseconds(1);
+
 Return<Result> CanBus::send(const CanMessage& message) {
     std::lock_guard<std::mutex> lck(mIsUpGuard);
     if (!mIsUp) return Result::INTERFACE_DOWN;
@@ -54,34 +64,112 @@ Return<Result> CanBus::send(const CanMessage& message) {
 
 Return<void> CanBus::listen(const hidl_vec<CanMessageFilter>& filter,
                             const sp<ICanMessageListener>& listenerCb, listen_cb _hidl_cb) {
-    std::lock_guard<std::mutex> lck(mIsUpGuard);
-
     if (listenerCb == nullptr) {
         _hidl_cb(Result::INVALID_ARGUMENTS, nullptr);
         return {};
     }
-    if (!mIsUp) {
-        _hidl_cb(Result::INTERFACE_DOWN, nullptr);
+
+    auto listener = std::make_shared<CanMessageListener>();
+    listener->callback = listenerCb;
+    listener->filter = filter;
+
+    sp<ICloseHandle> closeHandle;
+    const auto result = addMsgListener(std::move(listener), &closeHandle);
+    _hidl_cb(result, closeHandle);
+    return {};
+}
+
+Return<void> CanBus::listenForBatches(const hidl_vec<CanMessageFilter>& filter,
+                                      uint32_t maxBatchSize, uint32_t maxLatencyMs,
+                                      const sp<V1_1::ICanMessageBatchListener>& listenerCb,
+                                      listenForBatches_cb _hidl_cb) {
+    if (listenerCb == nullptr || maxBatchSize == 0) {
+        _hidl_cb(Result::INVALID_ARGUMENTS, nullptr);
         return {};
     }
 
+    auto listener = std::make_shared<CanMessageListener>();
+    listener->batcher = std::make_unique<MessageBatcher>(
+            listenerCb, maxBatchSize, std::chrono::milliseconds(maxLatencyMs));
+    listener->filter = filter;
+
+    sp<ICloseHandle> closeHandle;
+    const auto result = addMsgListener(std::move(listener), &closeHandle);
+    _hidl_cb(result, closeHandle);
+    return {};
+}
+
+Result CanBus::addMsgListener(std::shared_ptr<CanMessageListener> listener,
+                              sp<ICloseHandle>* closeHandle) {
+    std::lock_guard<std::mutex> lck(mIsUpGuard);
+    if (!mIsUp) return Result::INTERFACE_DOWN;
+
     std::lock_guard<std::mutex> lckListeners(mMsgListenersGuard);
 
-    sp<CloseHandle> closeHandle = new CloseHandle([this, listenerCb]() {
-        std::lock_guard<std::mutex> lck(mMsgListenersGuard);
-        std::erase_if(mMsgListeners, [&](const auto& e) { return e.callback == listenerCb; });
+    *closeHandle = new CloseHandle([this, entry = listener.get()]() {
+        {
+            std::lock_guard<std::mutex> lck(mMsgListenersGuard);
+            std::erase_if(mMsgListeners, [&](const auto& e) { return e.get() == entry; });
+            updateKernelFilters();
+            updateDispatch();
+        }
+        // Once closed, the listener must not be called anymore.
+        waitForDispatch();
     });
-    mMsgListeners.emplace_back(CanMessageListener{listenerCb, filter, closeHandle});
-    auto& listener = mMsgListeners.back();
+    listener->closeHandle = *closeHandle;
 
     // fix message IDs to have all zeros on bits not covered by mask
-    std::for_each(listener.filter.begin(), listener.filter.end(),
+    std::for_each(listener->filter.begin(), listener->filter.end(),
                   [](auto& rule) { rule.id &= rule.mask; });
+    mMsgListeners.push_back(std::move(listener));
+    updateKernelFilters();
+    updateDispatch();
+
+    return Result::OK;
+}
 
-    _hidl_cb(Result::OK, closeHandle);
+Return<void> CanBus::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        LOG(ERROR) << "Invalid parameters passed to debug()";
+        return {};
+    }
+    dump(fd->data[0]);
     return {};
 }
 
+/* Reads a counter the kernel keeps for a network interface, such as rx_dropped. */
+static std::optional<uint64_t> readNetdevStat(const std::string& ifname, const std::string& stat) {
+    std::ifstream file("/sys/class/net/" + ifname + "/statistics/" + stat);
+    uint64_t value;
+    if (!(file >> value)) return std::nullopt;
+    return value;
+}
+
+void CanBus::dump(int fd) {
+    std::lock_guard<std::mutex> lck(mIsUpGuard);
+    dprintf(fd, "Interface: %s\n", mIfname.c_str());
+    if (!mIsUp) {
+        dprintf(fd, "Interface is down\n");
+        return;
+    }
+
+    const auto stats = mSocket->getTxStats();
+    dprintf(fd, "TX queue depth: %zu\n", stats.queueDepth);
+    dprintf(fd, "TX frames sent: %" PRIu64 "\n", stats.sent);
+    dprintf(fd, "TX frames dropped: %" PRIu64 "\n", stats.dropped);
+    dprintf(fd, "TX writes retried: %" PRIu64 "\n", stats.retried);
+
+    // Frames the driver of the interface lost, kept by the kernel for the interface.
+    for (const auto stat : {"rx_dropped", "rx_over_errors", "rx_fifo_errors", "tx_dropped"}) {
+        const auto value = readNetdevStat(mIfname, stat);
+        if (value.has_value()) dprintf(fd, "Interface %s: %" PRIu64 "\n", stat, *value);
+    }
+
+    dumpInterface(fd);
+}
+
+void CanBus::dumpInterface(int /* fd */) {}
+
 CanBus::CanBus() {}
 
 CanBus::CanBus(const std::string& ifname) : mIfname(ifname) {}
@@ -101,6 +189,12 @@ void CanBus::setErrorCallback(ErrorCallback errcb) {
     CHECK(!mIsUp) << "Can't set error callback while interface is up";
 }
 
+void CanBus::setCapture(std::shared_ptr<CaptureWriter> writer, uint8_t bus) {
+    std::shared_ptr<const CaptureTarget> capture;
+    if (writer != nullptr) capture.reset(new CaptureTarget{std::move(writer), bus});
+    std::atomic_store(&mCapture, std::move(capture));
+}
+
 ICanController::Result CanBus::preUp() {
     return ICanController::Result::OK;
 }
@@ -136,12 +230,16 @@ ICanController::Result CanBus::up() {
     using namespace std::placeholders;
     CanSocket::ReadCallback rdcb = std::bind(&CanBus::onRead, this, _1, _2);
     CanSocket::ErrorCallback errcb = std::bind(&CanBus::onError, this, _1);
-    mSocket = CanSocket::open(mIfname, rdcb, errcb);
-    if (!mSocket) {
+    auto socket = CanSocket::open(mIfname, rdcb, errcb);
+    if (!socket) {
         if (mDownAfterUse) netdevice::down(mIfname);
         return ICanController::Result::UNKNOWN_ERROR;
     }
 
+    std::lock_guard<std::mutex> lckListeners(mMsgListenersGuard);
+    mSocket = std::move(socket);
+    updateKernelFilters();
+
     mIsUp = true;
     return ICanController::Result::OK;
 }
@@ -152,7 +250,7 @@ void CanBus::clearMsgListeners() {
         std::lock_guard<std::mutex> lck(mMsgListenersGuard);
         std::transform(mMsgListeners.begin(), mMsgListeners.end(),
                        std::back_inserter(listenersToClose),
-                       [](const auto& e) { return e.closeHandle; });
+                       [](const auto& e) { return e->closeHandle; });
     }
 
     for (auto& weakListener : listenersToClose) {
@@ -203,7 +301,15 @@ bool CanBus::down() {
 
     clearMsgListeners();
     clearErrListeners();
-    mSocket.reset();
+
+    /* The socket is destroyed without holding mMsgListenersGuard, as its destructor waits for the
+     * reader thread, which may be waiting for the guard in onRead. */
+    std::unique_ptr<CanSocket> socket;
+    {
+        std::lock_guard<std::mutex> lckListeners(mMsgListenersGuard);
+        socket = std::move(mSocket);
+    }
+    socket.reset();
 
     bool success = true;
 
@@ -219,49 +325,82 @@ bool CanBus::down() {
 }
 
 /**
- * Helper function to determine if a flag meets the requirements of a
- * FilterFlag. See definition of FilterFlag in types.hal
+ * Append kernel filter rules covering every message a listener's filter set may accept.
  *
- * \param filterFlag FilterFlag object to match flag against
- * \param flag bool object from CanMessage object
- */
-static bool satisfiesFilterFlag(FilterFlag filterFlag, bool flag) {
-    if (filterFlag == FilterFlag::DONT_CARE) return true;
-    if (filterFlag == FilterFlag::SET) return flag;
-    if (filterFlag == FilterFlag::NOT_SET) return !flag;
-    return false;
-}
-
-/**
- * Match the filter set against message id.
+ * CAN_RAW_FILTER rules can only be combined with OR, so exclude rules can't be expressed and are
+ * left to match(). The appended rules therefore accept a superset of the filter set.
  *
- * For details on the filters syntax, please see CanMessageFilter at
- * the HAL definition (types.hal).
- *
- * \param filter Filter to match against
- * \param id Message id to filter
- * \return true if the message id matches the filter, false otherwise
+ * \param filter Filter set of a single listener
+ * \param kernelFilters Rules to append to
+ * \return false if the filter set may accept any message, i.e. it has no non-exclude rule
  */
-static bool match(const hidl_vec<CanMessageFilter>& filter, CanMessageId id, bool isRtr,
-                  bool isExtendedId) {
-    if (filter.size() == 0) return true;
+static bool appendKernelFilters(const hidl_vec<CanMessageFilter>& filter,
+                                std::vector<struct can_filter>* kernelFilters) {
+    auto applyFlag = [](FilterFlag flag, canid_t bit, struct can_filter* kernelFilter) {
+        if (flag == FilterFlag::DONT_CARE) return;
+        kernelFilter->can_mask |= bit;
+        if (flag == FilterFlag::SET) kernelFilter->can_id |= bit;
+    };
 
     bool anyNonExcludeRulePresent = false;
-    bool anyNonExcludeRuleSatisfied = false;
     for (auto& rule : filter) {
-        const bool satisfied = ((id & rule.mask) == rule.id) &&
-                               satisfiesFilterFlag(rule.rtr, isRtr) &&
-                               satisfiesFilterFlag(rule.extendedFormat, isExtendedId);
-
-        if (rule.exclude) {
-            // Any excluded (blacklist) rule not being satisfied invalidates the whole filter set.
-            if (satisfied) return false;
-        } else {
-            anyNonExcludeRulePresent = true;
-            if (satisfied) anyNonExcludeRuleSatisfied = true;
+        if (rule.exclude) continue;
+        anyNonExcludeRulePresent = true;
+
+        struct can_filter kernelFilter = {
+                .can_id = rule.id & CAN_EFF_MASK,
+                .can_mask = rule.mask & CAN_EFF_MASK,
+        };
+        applyFlag(rule.rtr, CAN_RTR_FLAG, &kernelFilter);
+        applyFlag(rule.extendedFormat, CAN_EFF_FLAG, &kernelFilter);
+        kernelFilters->push_back(kernelFilter);
+    }
+    return anyNonExcludeRulePresent;
+}
+
+void CanBus::updateKernelFilters() {
+    if (!mSocket) return;
+
+    std::vector<struct can_filter> kernelFilters;
+    for (auto& listener : mMsgListeners) {
+        if (!appendKernelFilters(listener->filter, &kernelFilters)) {
+            kernelFilters = {kPassAllFilter};
+            break;
         }
     }
-    return !anyNonExcludeRulePresent || anyNonExcludeRuleSatisfied;
+
+    auto lessThan = [](const auto& a, const auto& b) {
+        return a.can_id != b.can_id ? a.can_id < b.can_id : a.can_mask < b.can_mask;
+    };
+    auto equal = [](const auto& a, const auto& b) {
+        return a.can_id == b.can_id && a.can_mask == b.can_mask;
+    };
+    std::sort(kernelFilters.begin(), kernelFilters.end(), lessThan);
+    kernelFilters.erase(std::unique(kernelFilters.begin(), kernelFilters.end(), equal),
+                        kernelFilters.end());
+    if (kernelFilters.size() > CAN_RAW_FILTER_MAX) kernelFilters = {kPassAllFilter};
+
+    // If the kernel rejects the rules, keep receiving everything, match() still applies.
+    if (!mSocket->setFilters(kernelFilters)) mSocket->setFilters({kPassAllFilter});
+}
+
+void CanBus::updateDispatch() {
+    std::vector<hidl_vec<CanMessageFilter>> filters;
+    filters.reserve(mMsgListeners.size());
+    for (auto& listener : mMsgListeners) filters.push_back(listener->filter);
+
+    std::shared_ptr<const Dispatch> dispatch(
+            new Dispatch{mMsgListeners, FilterIndex(std::move(filters))});
+    std::atomic_store(&mDispatch, std::move(dispatch));
+}
+
+void CanBus::waitForDispatch() {
+    /* Pairs with the fence in onRead: either the reader thread sees the new snapshot when starting
+     * the next batch, or the odd epoch of the batch it already started is seen here. */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto epoch = mDispatchEpoch.load();
+    if (epoch % 2 == 0) return;
+    while (mDispatchEpoch.load() == epoch) std::this_thread::sleep_for(kDispatchWaitPeriod);
 }
 
 void CanBus::notifyErrorListeners(ErrorEvent err, bool isFatal) {
@@ -297,35 +436,52 @@ static ErrorEvent parseErrorFrame(const struct canfd_frame& frame) {
     return ErrorEvent::UNKNOWN_ERROR;
 }
 
-void CanBus::onRead(const struct canfd_frame& frame, std::chrono::nanoseconds timestamp) {
-    if ((frame.can_id & CAN_ERR_FLAG) != 0) {
-        // error bit is set
-        LOG(WARNING) << "CAN Error frame received";
-        notifyErrorListeners(parseErrorFrame(frame), false);
-        return;
-    }
-
-    CanMessage message = {};
-    message.id = frame.can_id & CAN_EFF_MASK;  // mask out eff/rtr/err flags
-    message.payload = hidl_vec<uint8_t>(frame.data, frame.data + frame.len);
-    message.timestamp = timestamp.count();
-    message.isExtendedId = (frame.can_id & CAN_EFF_FLAG) != 0;
-    message.remoteTransmissionRequest = (frame.can_id & CAN_RTR_FLAG) != 0;
+void CanBus::onRead(const CanSocket::ReadFrame* frames, size_t count) {
+    mDispatchEpoch++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto dispatch = std::atomic_load(&mDispatch);
 
-    if (UNLIKELY(kSuperVerbose)) {
-        LOG(VERBOSE) << "Got message " << toString(message);
+    if (const auto capture = std::atomic_load(&mCapture); capture != nullptr) {
+        capture->writer->append(capture->bus, frames, count);
     }
 
-    std::lock_guard<std::mutex> lck(mMsgListenersGuard);
-    for (auto& listener : mMsgListeners) {
-        if (!match(listener.filter, message.id, message.remoteTransmissionRequest,
-                   message.isExtendedId))
+    for (size_t i = 0; i < count; i++) {
+        const auto& frame = frames[i].frame;
+        if ((frame.can_id & CAN_ERR_FLAG) != 0) {
+            // error bit is set
+            LOG(WARNING) << "CAN Error frame received";
+            notifyErrorListeners(parseErrorFrame(frame), false);
             continue;
-        if (!listener.callback->onReceive(message).isOk() && !listener.failedOnce) {
-            listener.failedOnce = true;
-            LOG(WARNING) << "Failed to notify listener about message";
+        }
+
+        CanMessage message = {};
+        message.id = frame.can_id & CAN_EFF_MASK;  // mask out eff/rtr/err flags
+        message.payload = hidl_vec<uint8_t>(frame.data, frame.data + frame.len);
+        message.timestamp = frames[i].timestamp.count();
+        message.isExtendedId = (frame.can_id & CAN_EFF_FLAG) != 0;
+        message.remoteTransmissionRequest = (frame.can_id & CAN_RTR_FLAG) != 0;
+
+        if (UNLIKELY(kSuperVerbose)) {
+            LOG(VERBOSE) << "Got message " << toString(message);
+        }
+
+        if (dispatch == nullptr) continue;
+        dispatch->index.match(message.id, message.remoteTransmissionRequest,
+                              message.isExtendedId, &mMatchedListeners);
+        for (const auto index : mMatchedListeners) {
+            auto& listener = *dispatch->listeners[index];
+            if (listener.batcher != nullptr) {
+                listener.batcher->push(message);
+                continue;
+            }
+            if (!listener.callback->onReceive(message).isOk() &&
+                !listener.failedOnce.exchange(true)) {
+                LOG(WARNING) << "Failed to notify listener about message";
+            }
         }
     }
+
+    mDispatchEpoch++;
 }
 
 void CanBus::onError(int errnoVal) {
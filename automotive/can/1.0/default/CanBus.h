@@ -17,10 +17,13 @@
 #pragma once
 
 #include "CanSocket.h"
+#include "CaptureLog.h"
+#include "FilterIndex.h"
+#include "MessageBatcher.h"
 
 #include <android-base/unique_fd.h>
-#include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
+#include <android/hardware/automotive/can/1.1/ICanBus.h>
 #include <utils/Mutex.h>
 
 #include <atomic>
@@ -28,7 +31,7 @@
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
-struct CanBus : public ICanBus {
+struct CanBus : public V1_1::ICanBus {
     using ErrorCallback = std::function<void()>;
 
     virtual ~CanBus();
@@ -37,8 +40,28 @@ struct CanBus : public ICanBus {
     Return<void> listen(const hidl_vec<CanMessageFilter>& filter,
                         const sp<ICanMessageListener>& listener, listen_cb _hidl_cb) override;
     Return<sp<ICloseHandle>> listenForErrors(const sp<ICanErrorListener>& listener) override;
+    Return<void> listenForBatches(const hidl_vec<CanMessageFilter>& filter, uint32_t maxBatchSize,
+                                  uint32_t maxLatencyMs,
+                                  const sp<V1_1::ICanMessageBatchListener>& listener,
+                                  listenForBatches_cb _hidl_cb) override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
     void setErrorCallback(ErrorCallback errcb);
+
+    /**
+     * Print the state and counters of the bus.
+     *
+     * \param fd File descriptor to print to
+     */
+    void dump(int fd);
+
+    /**
+     * Start or stop capturing received frames.
+     *
+     * \param writer Log to append received frames to, nullptr to stop capturing
+     * \param bus Index of this bus in the log
+     */
+    void setCapture(std::shared_ptr<CaptureWriter> writer, uint8_t bus);
     ICanController::Result up();
     bool down();
 
@@ -71,30 +94,76 @@ struct CanBus : public ICanBus {
      */
     virtual bool postDown();
 
+    /**
+     * Print counters specific to the interface type, called by dump() while the bus is up.
+     *
+     * \param fd File descriptor to print to
+     */
+    virtual void dumpInterface(int fd);
+
     /** Network interface name. */
     std::string mIfname;
 
   private:
+    /** Message listener, called either for every message or, with a batcher, for batches. */
     struct CanMessageListener {
         sp<ICanMessageListener> callback;
+        std::unique_ptr<MessageBatcher> batcher;
         hidl_vec<CanMessageFilter> filter;
         wp<ICloseHandle> closeHandle;
-        bool failedOnce = false;
+        std::atomic<bool> failedOnce = false;
     };
+
+    /** Immutable set of listeners with an index of their filters, published for onRead. */
+    struct Dispatch {
+        std::vector<std::shared_ptr<CanMessageListener>> listeners;
+        FilterIndex index;
+    };
+
+    Result addMsgListener(std::shared_ptr<CanMessageListener> listener,
+                          sp<ICloseHandle>* closeHandle);
     void clearMsgListeners();
+    void updateKernelFilters() REQUIRES(mMsgListenersGuard);
+    void updateDispatch() REQUIRES(mMsgListenersGuard);
+
+    /** Wait until onRead is done with the batch it may be dispatching with an older snapshot. */
+    void waitForDispatch();
     void clearErrListeners();
 
     void notifyErrorListeners(ErrorEvent err, bool isFatal);
 
-    void onRead(const struct canfd_frame& frame, std::chrono::nanoseconds timestamp);
+    void onRead(const CanSocket::ReadFrame* frames, size_t count);
     void onError(int errnoVal);
 
     std::mutex mMsgListenersGuard;
-    std::vector<CanMessageListener> mMsgListeners GUARDED_BY(mMsgListenersGuard);
+    std::vector<std::shared_ptr<CanMessageListener>> mMsgListeners GUARDED_BY(mMsgListenersGuard);
+
+    /**
+     * Snapshot of mMsgListeners used by onRead, so the read path doesn't take mMsgListenersGuard.
+     * Only accessed with std::atomic_load and std::atomic_store.
+     */
+    std::shared_ptr<const Dispatch> mDispatch;
+
+    /** Incremented before and after onRead dispatches a batch, i.e. odd while it's at it. */
+    std::atomic<uint64_t> mDispatchEpoch = 0;
+
+    struct CaptureTarget {
+        std::shared_ptr<CaptureWriter> writer;
+        uint8_t bus;
+    };
+    /** Log received frames go to, if any. Only accessed with std::atomic_load/store. */
+    std::shared_ptr<const CaptureTarget> mCapture;
+
+    /** Scratch space for FilterIndex::match results, only used by the reader thread. */
+    std::vector<size_t> mMatchedListeners;
 
     std::mutex mErrListenersGuard;
     std::vector<sp<ICanErrorListener>> mErrListeners GUARDED_BY(mErrListenersGuard);
 
+    /**
+     * Only changed with both mIsUpGuard and mMsgListenersGuard held, so listener close handles
+     * (which only hold the latter) can update its kernel filters.
+     */
     std::unique_ptr<CanSocket> mSocket;
     bool mDownAfterUse;
 
@@ -36,11 +36,7 @@ ICanController::Result CanBusNative::preUp() {
         return ICanController::Result::OK;
     }
 
-    if (!netdevice::down(mIfname)) {
-        LOG(ERROR) << "Can't bring " << mIfname << " down (to configure it)";
-        return ICanController::Result::UNKNOWN_ERROR;
-    }
-
+    // Brings the interface down too, CanBus::up() brings it back up.
     if (!netdevice::can::setBitrate(mIfname, mBitrate)) {
         LOG(ERROR) << "Can't set bitrate " << mBitrate << " for " << mIfname;
         return ICanController::Result::BAD_BITRATE;
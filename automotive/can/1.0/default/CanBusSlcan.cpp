@@ -39,13 +39,23 @@ static const std::map<uint32_t, std::string> kBitrateCommands = {
         {500000, "C\rS6\r"}, {800000, "C\rS7\r"}, {1000000, "C\rS8\r"}};
 }  // namespace slcanprotocol
 
+/* UART baud rates termios has constants for, USB serial adapters commonly run at up to 3Mbaud. */
+static const std::map<uint32_t, speed_t> kBaudrates = {
+        {9600, B9600},       {19200, B19200},     {38400, B38400},     {57600, B57600},
+        {115200, B115200},   {230400, B230400},   {460800, B460800},   {500000, B500000},
+        {576000, B576000},   {921600, B921600},   {1000000, B1000000}, {1152000, B1152000},
+        {1500000, B1500000}, {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000},
+        {3500000, B3500000}, {4000000, B4000000}};
+
 /**
  * Serial Line CAN constructor
  * \param string uartName - name of slcan device (e.x. /dev/ttyUSB0)
  * \param uint32_t bitrate - speed of the CAN bus (125k = MSCAN, 500k = HSCAN)
+ * \param SlcanSettings settings - serial line settings, used if bitrate isn't 0
  */
-CanBusSlcan::CanBusSlcan(const std::string& uartName, uint32_t bitrate)
-    : CanBus(), mUartName(uartName), kBitrate(bitrate) {}
+CanBusSlcan::CanBusSlcan(const std::string& uartName, uint32_t bitrate,
+                         const V1_1::ICanController::SlcanSettings& settings)
+    : CanBus(), mUartName(uartName), kBitrate(bitrate), mSettings(settings) {}
 
 /** helper function to update CanBusSlcan object's iface name */
 ICanController::Result CanBusSlcan::updateIfaceName(base::unique_fd& uartFd) {
@@ -76,6 +86,16 @@ ICanController::Result CanBusSlcan::preUp() {
         canBitrateCommand = lookupIt->second;
     }
 
+    std::optional<speed_t> baudrate;
+    if (kBitrate != 0 && mSettings.baudrate != 0) {
+        const auto lookupIt = kBaudrates.find(mSettings.baudrate);
+        if (lookupIt == kBaudrates.end()) {
+            LOG(ERROR) << "Unsupported UART baud rate " << mSettings.baudrate;
+            return ICanController::Result::BAD_BITRATE;
+        }
+        baudrate = lookupIt->second;
+    }
+
     /* Attempt to open the uart in r/w without blocking or becoming the
      * controlling terminal */
     mFd = base::unique_fd(open(mUartName.c_str(), O_RDWR | O_NONBLOCK | O_NOCTTY));
@@ -104,14 +124,23 @@ ICanController::Result CanBusSlcan::preUp() {
     // enable hardware flow control
     terminalSettings.c_cflag |= CRTSCTS;
 
+    if (baudrate.has_value() && cfsetspeed(&terminalSettings, *baudrate) < 0) {
+        PLOG(ERROR) << "Failed to set baud rate of " << mUartName;
+        return ICanController::Result::UNKNOWN_ERROR;
+    }
+
     struct serial_struct serialSettings;
     // get serial settings
     if (ioctl(mFd.get(), TIOCGSERIAL, &serialSettings) < 0) {
         PLOG(ERROR) << "Failed to read serial settings from " << mUartName;
         return ICanController::Result::UNKNOWN_ERROR;
     }
-    // set low latency mode
-    serialSettings.flags |= ASYNC_LOW_LATENCY;
+    // set low latency mode, which hands received bytes over without waiting for a timer
+    if (mSettings.lowLatency) {
+        serialSettings.flags |= ASYNC_LOW_LATENCY;
+    } else {
+        serialSettings.flags &= ~ASYNC_LOW_LATENCY;
+    }
     // apply serial settings
     if (ioctl(mFd.get(), TIOCSSERIAL, &serialSettings) < 0) {
         PLOG(ERROR) << "Failed to set low latency mode on " << mUartName;
@@ -145,7 +174,17 @@ ICanController::Result CanBusSlcan::preUp() {
     }
 
     // Update the CanBus object with name that was assigned to it
-    return updateIfaceName(mFd);
+    const auto result = updateIfaceName(mFd);
+    if (result != ICanController::Result::OK) return result;
+
+    // the kernel default of 10 frames overflows on bursts the serial line can't keep up with
+    if (mSettings.txQueueLength != 0 &&
+        !netdevice::setTxQueueLength(mIfname, mSettings.txQueueLength)) {
+        LOG(ERROR) << "Failed to set transmit queue length of " << mIfname;
+        return ICanController::Result::UNKNOWN_ERROR;
+    }
+
+    return ICanController::Result::OK;
 }
 
 bool CanBusSlcan::postDown() {
@@ -168,4 +207,21 @@ bool CanBusSlcan::postDown() {
     return true;
 }
 
+void CanBusSlcan::dumpInterface(int fd) {
+    dprintf(fd, "UART: %s\n", mUartName.c_str());
+
+    // Counters of the serial driver, frames lost before reaching the slcan line discipline.
+    struct serial_icounter_struct icount = {};
+    if (ioctl(mFd.get(), TIOCGICOUNT, &icount) < 0) {
+        dprintf(fd, "UART counters: not supported by the driver\n");
+        return;
+    }
+    dprintf(fd, "UART bytes received: %d\n", icount.rx);
+    dprintf(fd, "UART bytes sent: %d\n", icount.tx);
+    dprintf(fd, "UART overruns: %d\n", icount.overrun);
+    dprintf(fd, "UART buffer overruns: %d\n", icount.buf_overrun);
+    dprintf(fd, "UART framing errors: %d\n", icount.frame);
+    dprintf(fd, "UART parity errors: %d\n", icount.parity);
+}
+
 }  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -22,20 +22,25 @@
 #include <termios.h>
 #include "CanBus.h"
 
+#include <android/hardware/automotive/can/1.1/ICanController.h>
+
 namespace android::hardware::automotive::can::V1_0::implementation {
 
 struct CanBusSlcan : public CanBus {
-    CanBusSlcan(const std::string& uartName, uint32_t bitrate);
+    CanBusSlcan(const std::string& uartName, uint32_t bitrate,
+                const V1_1::ICanController::SlcanSettings& settings);
 
   protected:
     virtual ICanController::Result preUp() override;
     virtual bool postDown() override;
+    virtual void dumpInterface(int fd) override;
 
   private:
     ICanController::Result updateIfaceName(base::unique_fd& uartFd);
 
     const std::string mUartName;
     const uint32_t kBitrate;
+    const V1_1::ICanController::SlcanSettings mSettings;
     base::unique_fd mFd;
 };
 
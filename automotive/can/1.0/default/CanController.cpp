@@ -21,9 +21,12 @@
 #include "CanBusVirtual.h"
 
 #include <android-base/logging.h>
+#include <android-base/parsedouble.h>
+#include <android-base/scopeguard.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
 
 #include <automotive/filesystem>
+#include <cinttypes>
 #include <fstream>
 #include <regex>
 
@@ -213,22 +216,46 @@ static std::optional<UsbCanIface> findUsbDevice(const hidl_vec<hidl_string>& con
     return std::nullopt;
 }
 
-Return<ICanController::Result> CanController::upInterface(const ICanController::BusConfig& config) {
-    LOG(VERBOSE) << "Attempting to bring interface up: " << toString(config);
+/* The serial line setup of @1.0::ICanController::upInterface, which keeps the UART's baud rate. */
+static const V1_1::ICanController::SlcanSettings kDefaultSlcanSettings = {
+        .baudrate = 0,
+        .lowLatency = true,
+        .txQueueLength = 0,
+};
 
-    std::lock_guard<std::mutex> lck(mCanBusesGuard);
+Return<ICanController::Result> CanController::upInterface(
+        const V1_0::ICanController::BusConfig& config) {
+    return upInterface_1_1({.v1_0 = config, .slcan = kDefaultSlcanSettings});
+}
+
+Return<ICanController::Result> CanController::upInterface_1_1(
+        const V1_1::ICanController::BusConfig& configV1_1) {
+    const auto& config = configV1_1.v1_0;
+    LOG(VERBOSE) << "Attempting to bring interface up: " << toString(configV1_1);
 
     if (!isValidName(config.name)) {
         LOG(ERROR) << "Bus name " << config.name << " is invalid";
         return ICanController::Result::BAD_SERVICE_NAME;
     }
 
-    if (mCanBuses.find(config.name) != mCanBuses.end()) {
-        LOG(ERROR) << "Bus " << config.name << " is already up";
-        return ICanController::Result::INVALID_STATE;
+    /* Bringing a bus up takes a few round trips to the kernel (and the serial adapter, for SLCAN).
+     * The name is reserved upfront, so independent buses can be brought up in parallel from the
+     * binder thread pool without holding mCanBusesGuard. */
+    {
+        std::lock_guard<std::mutex> lck(mCanBusesGuard);
+        if (mCanBuses.count(config.name) > 0 || mPendingBuses.count(config.name) > 0) {
+            LOG(ERROR) << "Bus " << config.name << " is already up";
+            return ICanController::Result::INVALID_STATE;
+        }
+        mPendingBuses.insert(config.name);
     }
+    auto pendingGuard = base::make_scope_guard([this, &config]() {
+        std::lock_guard<std::mutex> lck(mCanBusesGuard);
+        mPendingBuses.erase(config.name);
+    });
 
     sp<CanBus> busService;
+    std::optional<std::string> virtualIfname;
 
     // SocketCAN native type interface.
     if (config.interfaceId.getDiscriminator() == IfIdDisc::socketcan) {
@@ -251,7 +278,8 @@ Return<ICanController::Result> CanController::upInterface(const ICanController::
     }
     // Virtual interface.
     else if (config.interfaceId.getDiscriminator() == IfIdDisc::virtualif) {
-        busService = new CanBusVirtual(config.interfaceId.virtualif().ifname);
+        virtualIfname = config.interfaceId.virtualif().ifname;
+        busService = new CanBusVirtual(*virtualIfname);
     }
     // SLCAN interface.
     else if (config.interfaceId.getDiscriminator() == IfIdDisc::slcan) {
@@ -269,7 +297,7 @@ Return<ICanController::Result> CanController::upInterface(const ICanController::
             // Configure by tty name.
             ttyName = slcan.ttyname();
         }
-        busService = new CanBusSlcan(ttyName, config.bitrate);
+        busService = new CanBusSlcan(ttyName, config.bitrate, configV1_1.slcan);
     } else {
         return ICanController::Result::NOT_SUPPORTED;
     }
@@ -287,7 +315,14 @@ Return<ICanController::Result> CanController::upInterface(const ICanController::
         return ICanController::Result::BAD_SERVICE_NAME;
     }
 
+    std::lock_guard<std::mutex> lck(mCanBusesGuard);
     mCanBuses[config.name] = busService;
+    if (virtualIfname.has_value()) mVirtualIfnames[config.name] = *virtualIfname;
+
+    if (mCapture != nullptr) {
+        const auto bus = mCapture->addBus(config.name);
+        if (bus.has_value()) busService->setCapture(mCapture, *bus);
+    }
 
     return ICanController::Result::OK;
 }
@@ -295,9 +330,12 @@ Return<ICanController::Result> CanController::upInterface(const ICanController::
 static bool unregisterCanBusService(const hidl_string& name, sp<CanBus> busService) {
     auto manager = hidl::manager::V1_2::IServiceManager::getService();
     if (!manager) return false;
-    const auto res = manager->tryUnregister(ICanBus::descriptor, name, busService);
-    if (!res.isOk()) return false;
-    return res;
+    // registerAsService() registered the bus under every interface in its inheritance chain.
+    for (const auto descriptor : {V1_1::ICanBus::descriptor, ICanBus::descriptor}) {
+        const auto res = manager->tryUnregister(descriptor, name, busService);
+        if (!res.isOk() || !res) return false;
+    }
+    return true;
 }
 
 Return<bool> CanController::downInterface(const hidl_string& name) {
@@ -310,6 +348,7 @@ Return<bool> CanController::downInterface(const hidl_string& name) {
         LOG(WARNING) << "Interface " << name << " is not up";
         return false;
     }
+    mVirtualIfnames.erase(name);
 
     auto success = true;
 
@@ -327,4 +366,133 @@ Return<bool> CanController::downInterface(const hidl_string& name) {
     return success;
 }
 
+Return<void> CanController::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        LOG(ERROR) << "Invalid parameters passed to debug()";
+        return {};
+    }
+    const auto out = fd->data[0];
+
+    std::lock_guard<std::mutex> lck(mCanBusesGuard);
+    if (options.size() == 0) {
+        cmdStatus(out);
+        return {};
+    }
+
+    const std::string option = options[0];
+    if (option == "--help") {
+        cmdHelp(out);
+    } else if (option == "--capture" && options.size() == 2) {
+        cmdCapture(out, options[1]);
+    } else if (option == "--capture-stop" && options.size() == 1) {
+        cmdCaptureStop(out);
+    } else if (option == "--replay" && (options.size() == 2 || options.size() == 3)) {
+        double speed = 1.0;
+        if (options.size() == 3 && !base::ParseDouble(options[2].c_str(), &speed, 0.0)) {
+            dprintf(out, "Invalid replay speed: %s\n", options[2].c_str());
+            return {};
+        }
+        if (speed <= 0) {
+            dprintf(out, "Replay speed must be positive\n");
+            return {};
+        }
+        cmdReplay(out, options[1], speed);
+    } else if (option == "--replay-stop" && options.size() == 1) {
+        cmdReplayStop(out);
+    } else {
+        dprintf(out, "Invalid option: %s\n", option.c_str());
+        cmdHelp(out);
+    }
+    return {};
+}
+
+void CanController::cmdHelp(int fd) {
+    dprintf(fd, "Options:\n");
+    dprintf(fd, "  (none): print capture and replay status, and the counters of all buses\n");
+    dprintf(fd, "  --capture <log name>: capture frames received on all buses into a log in %s\n",
+            capture_log::kDirectory);
+    dprintf(fd, "  --capture-stop: stop capturing and close the log\n");
+    dprintf(fd, "  --replay <log name> [speed]: replay a log onto the virtual buses of the same\n");
+    dprintf(fd, "      names, at the original timing multiplied by speed (defaults to 1)\n");
+    dprintf(fd, "  --replay-stop: stop replaying\n");
+}
+
+void CanController::cmdStatus(int fd) {
+    if (mCapture == nullptr) {
+        dprintf(fd, "Capture: off\n");
+    } else {
+        dprintf(fd, "Capture: %s, %" PRIu64 " frames dropped\n", mCapturePath.c_str(),
+                mCapture->getDroppedCount());
+    }
+    const auto replaying = mReplay != nullptr && mReplay->isRunning();
+    dprintf(fd, "Replay: %s\n", replaying ? "running" : "off");
+
+    for (auto& [name, bus] : mCanBuses) {
+        dprintf(fd, "\nBus %s:\n", name.c_str());
+        bus->dump(fd);
+    }
+}
+
+void CanController::cmdCapture(int fd, const std::string& path) {
+    if (mCapture != nullptr) {
+        dprintf(fd, "Already capturing to %s\n", mCapturePath.c_str());
+        return;
+    }
+
+    std::shared_ptr<CaptureWriter> capture = CaptureWriter::create(path);
+    if (capture == nullptr) {
+        dprintf(fd, "Can't create capture log %s\n", path.c_str());
+        return;
+    }
+    for (auto& [name, bus] : mCanBuses) {
+        const auto index = capture->addBus(name);
+        if (index.has_value()) bus->setCapture(capture, *index);
+    }
+
+    mCapture = std::move(capture);
+    mCapturePath = path;
+    dprintf(fd, "Capturing to %s\n", path.c_str());
+}
+
+void CanController::cmdCaptureStop(int fd) {
+    if (mCapture == nullptr) {
+        dprintf(fd, "Not capturing\n");
+        return;
+    }
+
+    // Frames being appended keep the log open, it gets closed once the last of them is done.
+    for (auto& [name, bus] : mCanBuses) bus->setCapture(nullptr, 0);
+    const auto dropped = mCapture->getDroppedCount();
+    mCapture.reset();
+    dprintf(fd, "Stopped capturing to %s, %" PRIu64 " frames dropped\n", mCapturePath.c_str(),
+            dropped);
+    mCapturePath.clear();
+}
+
+void CanController::cmdReplay(int fd, const std::string& path, double speed) {
+    if (mReplay != nullptr && mReplay->isRunning()) {
+        dprintf(fd, "Already replaying\n");
+        return;
+    }
+
+    auto reader = CaptureReader::open(path);
+    if (reader == nullptr) {
+        dprintf(fd, "Can't open capture log %s\n", path.c_str());
+        return;
+    }
+
+    mReplay = std::make_unique<CaptureReplay>(std::move(reader), mVirtualIfnames, speed);
+    dprintf(fd, "Replaying %s\n", path.c_str());
+}
+
+void CanController::cmdReplayStop(int fd) {
+    if (mReplay == nullptr || !mReplay->isRunning()) {
+        dprintf(fd, "Not replaying\n");
+        return;
+    }
+
+    mReplay.reset();
+    dprintf(fd, "Stopped replaying\n");
+}
+
 }  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -17,20 +17,49 @@
 #pragma once
 
 #include "CanBus.h"
+#include "CaptureLog.h"
+#include "CaptureReplay.h"
 
-#include <android/hardware/automotive/can/1.0/ICanController.h>
+#include <android/hardware/automotive/can/1.1/ICanController.h>
+
+#include <set>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
-struct CanController : public ICanController {
+struct CanController : public V1_1::ICanController {
     Return<void> getSupportedInterfaceTypes(getSupportedInterfaceTypes_cb _hidl_cb) override;
 
-    Return<ICanController::Result> upInterface(const ICanController::BusConfig& config) override;
+    Return<ICanController::Result> upInterface(
+            const V1_0::ICanController::BusConfig& config) override;
+    Return<ICanController::Result> upInterface_1_1(
+            const V1_1::ICanController::BusConfig& config) override;
     Return<bool> downInterface(const hidl_string& name) override;
 
+    /**
+     * Bus counters, capture and replay of bus traffic, see cmdHelp() for the options.
+     */
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
   private:
+    void cmdHelp(int fd);
+    void cmdStatus(int fd) REQUIRES(mCanBusesGuard);
+    void cmdCapture(int fd, const std::string& path) REQUIRES(mCanBusesGuard);
+    void cmdCaptureStop(int fd) REQUIRES(mCanBusesGuard);
+    void cmdReplay(int fd, const std::string& path, double speed) REQUIRES(mCanBusesGuard);
+    void cmdReplayStop(int fd) REQUIRES(mCanBusesGuard);
+
     std::mutex mCanBusesGuard;
     std::map<std::string, sp<CanBus>> mCanBuses GUARDED_BY(mCanBusesGuard);
+
+    /** Buses being brought up by upInterface_1_1(), not yet in mCanBuses. */
+    std::set<std::string> mPendingBuses GUARDED_BY(mCanBusesGuard);
+
+    /** Network interface names of the virtual buses, the only ones that can be replayed on. */
+    std::map<std::string, std::string> mVirtualIfnames GUARDED_BY(mCanBusesGuard);
+
+    std::shared_ptr<CaptureWriter> mCapture GUARDED_BY(mCanBusesGuard);
+    std::string mCapturePath GUARDED_BY(mCanBusesGuard);
+    std::unique_ptr<CaptureReplay> mReplay GUARDED_BY(mCanBusesGuard);
 };
 
 }  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -20,9 +20,15 @@
 #include <libnetdevice/can.h>
 #include <libnetdevice/libnetdevice.h>
 #include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sys/socket.h>
 #include <utils/SystemClock.h>
 
+#include <array>
 #include <chrono>
+#include <cstring>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
@@ -34,6 +40,30 @@ using namespace std::chrono_literals;
  *       down the interface. */
 static constexpr auto kReadPooling = 100ms;
 
+/* Maximum number of frames read with a single recvmmsg(2) call. */
+static constexpr size_t kReadBatchSize = 32;
+
+/* Maximum number of frames waiting in the transmit queue. */
+static constexpr size_t kTxQueueSize = 256;
+
+/* How long a sender waits for room in a full transmit queue before the frame is dropped. */
+static constexpr auto kTxQueueFullTimeout = 100ms;
+
+/* Maximum number of frames written with a single sendmmsg(2) call. */
+static constexpr size_t kWriteBatchSize = 32;
+
+/* How long to wait before retrying a write the kernel rejected because its queue was full. */
+static constexpr auto kTxRetryPeriod = 1ms;
+
+/* Number of retries after which a frame the kernel keeps rejecting is dropped. */
+static constexpr unsigned kMaxTxRetries = 100;
+
+/* Hardware timestamps are preferred, software ones (taken by the kernel on receive) are used for
+ * interfaces that don't provide them. */
+static constexpr int kTimestampingFlags = SOF_TIMESTAMPING_RX_HARDWARE |
+                                          SOF_TIMESTAMPING_RAW_HARDWARE |
+                                          SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
 std::unique_ptr<CanSocket> CanSocket::open(const std::string& ifname, ReadCallback rdcb,
                                            ErrorCallback errcb) {
     auto sock = netdevice::can::socket(ifname);
@@ -42,6 +72,11 @@ std::unique_ptr<CanSocket> CanSocket::open(const std::string& ifname, ReadCallba
         return nullptr;
     }
 
+    if (setsockopt(sock.get(), SOL_SOCKET, SO_TIMESTAMPING, &kTimestampingFlags,
+                   sizeof(kTimestampingFlags)) < 0) {
+        PLOG(WARNING) << "Can't enable kernel timestamps on " << ifname << ", using read time";
+    }
+
     // Can't use std::make_unique due to private CanSocket constructor.
     return std::unique_ptr<CanSocket>(new CanSocket(std::move(sock), rdcb, errcb));
 }
@@ -50,9 +85,18 @@ CanSocket::CanSocket(base::unique_fd socket, ReadCallback rdcb, ErrorCallback er
     : mReadCallback(rdcb),
       mErrorCallback(errcb),
       mSocket(std::move(socket)),
-      mReaderThread(&CanSocket::readerThread, this) {}
+      mReaderThread(&CanSocket::readerThread, this),
+      mWriterThread(&CanSocket::writerThread, this) {}
 
 CanSocket::~CanSocket() {
+    {
+        std::lock_guard<std::mutex> lck(mTxGuard);
+        mStopWriterThread = true;
+    }
+    mTxQueueChanged.notify_all();
+    mTxSpaceAvailable.notify_all();
+    mWriterThread.join();
+
     mStopReaderThread = true;
 
     /* CanSocket can be brought down as a result of read failure, from the same thread,
@@ -64,14 +108,45 @@ CanSocket::~CanSocket() {
     }
 }
 
+/* Lower values win bus arbitration. The 11 bit base ID is transmitted first, bit by bit, then a
+ * standard frame wins over an extended frame with the same base ID, which is followed by its 18 bit
+ * ID extension. */
+static uint32_t arbitrationPriority(canid_t canId) {
+    if ((canId & CAN_EFF_FLAG) == 0) return (canId & CAN_SFF_MASK) << 19;
+
+    const auto id = canId & CAN_EFF_MASK;
+    return (id >> 18) << 19 | 1 << 18 | (id & 0x3FFFF);
+}
+
 bool CanSocket::send(const struct canfd_frame& frame) {
-    const auto res = write(mSocket.get(), &frame, CAN_MTU);
-    if (res < 0) {
-        PLOG(DEBUG) << "CanSocket send failed";
+    std::unique_lock<std::mutex> lck(mTxGuard);
+    const auto hasRoom = mTxSpaceAvailable.wait_for(lck, kTxQueueFullTimeout, [this] {
+        return mStopWriterThread || mTxQueue.size() < kTxQueueSize;
+    });
+    if (!hasRoom || mStopWriterThread) {
+        mTxStats.dropped++;
+        LOG(DEBUG) << "CanSocket transmit queue is full";
         return false;
     }
-    if (res != CAN_MTU) {
-        LOG(DEBUG) << "CanSocket sent wrong number of bytes: " << res;
+
+    mTxQueue.push({arbitrationPriority(frame.can_id), mTxSequence++, 0, frame});
+    lck.unlock();
+    mTxQueueChanged.notify_one();
+    return true;
+}
+
+CanSocket::TxStats CanSocket::getTxStats() {
+    std::lock_guard<std::mutex> lck(mTxGuard);
+    auto stats = mTxStats;
+    stats.queueDepth = mTxQueue.size();
+    return stats;
+}
+
+bool CanSocket::setFilters(const std::vector<struct can_filter>& filters) {
+    const auto res = setsockopt(mSocket.get(), SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                                filters.size() * sizeof(struct can_filter));
+    if (res < 0) {
+        PLOG(WARNING) << "CanSocket failed to set " << filters.size() << " filters";
         return false;
     }
     return true;
@@ -92,49 +167,109 @@ static int selectRead(const base::unique_fd& fd, std::chrono::microseconds timeo
     return select(fd.get() + 1, &readfds, nullptr, nullptr, &timeouttv);
 }
 
+static std::chrono::nanoseconds toNanoseconds(const struct timespec& ts) {
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+/* Kernel timestamps are CLOCK_REALTIME, while CanMessage timestamps are times since boot.
+ * SocketCAN drivers that provide hardware timestamps synchronize them to CLOCK_REALTIME as well,
+ * so both kinds are converted with the same offset between the clocks.
+ *
+ * The offset is sampled once per batch, right after the batch was read. This keeps frames
+ * consistent with the boot clock even if the wall clock gets adjusted, without the added system
+ * calls of a continuously synchronized clock mapping. */
+static std::chrono::nanoseconds realtimeToBoottimeOffset() {
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    return std::chrono::nanoseconds(elapsedRealtimeNano()) - toNanoseconds(realtime);
+}
+
+/* Returns the time since boot a frame was received at, or fallback if the kernel didn't attach a
+ * timestamp to it. */
+static std::chrono::nanoseconds getTimestamp(const struct msghdr& msg,
+                                             std::chrono::nanoseconds realtimeToBoottime,
+                                             std::chrono::nanoseconds fallback) {
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING) continue;
+
+        struct scm_timestamping tss;
+        memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+        // ts[2] holds the raw hardware timestamp, ts[0] the software one, unset ones are zero.
+        for (const auto& ts : {tss.ts[2], tss.ts[0]}) {
+            if (ts.tv_sec == 0 && ts.tv_nsec == 0) continue;
+            return toNanoseconds(ts) + realtimeToBoottime;
+        }
+    }
+    return fallback;
+}
+
 void CanSocket::readerThread() {
     LOG(VERBOSE) << "Reader thread started";
     int errnoCopy = 0;
 
+    /* Every message of the batch reads directly into its ReadFrame, so a batch is handed to the
+     * callback without copying. */
+    union ControlBuffer {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    };
+    std::array<ReadFrame, kReadBatchSize> frames;
+    std::array<struct iovec, kReadBatchSize> iovecs;
+    std::array<ControlBuffer, kReadBatchSize> controls;
+    std::array<struct mmsghdr, kReadBatchSize> msgs = {};
+    for (size_t i = 0; i < kReadBatchSize; i++) {
+        iovecs[i] = {.iov_base = &frames[i].frame, .iov_len = CAN_MTU};
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = controls[i].buf;
+    }
+
+    bool batchWasFull = false;
     while (!mStopReaderThread) {
         /* The ideal would be to have a blocking read(3) call and interrupt it with shutdown(3).
-         * This is unfortunately not supported for SocketCAN, so we need to rely on select(3). */
-        const auto sel = selectRead(mSocket, kReadPooling);
-        if (sel == 0) continue;  // timeout
-        if (sel == -1) {
-            PLOG(ERROR) << "Select failed";
-            break;
-        }
-
-        struct canfd_frame frame;
-        const auto nbytes = read(mSocket.get(), &frame, CAN_MTU);
-
-        /* We could use SIOCGSTAMP to get a precise UNIX timestamp for a given packet, but what
-         * we really need is a time since boot. There is no direct way to convert between these
-         * clocks. We could implement a class to calculate the difference between the clocks
-         * (querying both several times and picking the smallest difference); apply the difference
-         * to a SIOCGSTAMP returned value; re-synchronize if the elapsed time is too much in the
-         * past (indicating the UNIX timestamp might have been adjusted).
+         * This is unfortunately not supported for SocketCAN, so we need to rely on select(3).
          *
-         * Apart from the added complexity, it's possible the added calculations and system calls
-         * would add so much time to the processing pipeline so the precision of the reported time
-         * was buried under the subsystem latency. Let's just use a local time since boot here and
-         * leave precise hardware timestamps for custom proprietary implementations (if needed). */
-        const std::chrono::nanoseconds ts(elapsedRealtimeNano());
-
-        if (nbytes != CAN_MTU) {
-            if (nbytes >= 0) {
-                LOG(ERROR) << "Failed to read CAN packet, got " << nbytes << " bytes";
+         * A full batch means more frames are likely queued already, so under load the socket is
+         * drained with back to back recvmmsg(2) calls instead of a select(3) per batch. */
+        if (!batchWasFull) {
+            const auto sel = selectRead(mSocket, kReadPooling);
+            if (sel == 0) continue;  // timeout
+            if (sel == -1) {
+                PLOG(ERROR) << "Select failed";
                 break;
             }
+        }
+
+        // The kernel overwrites msg_controllen with the length of the received control data.
+        for (auto& msg : msgs) msg.msg_hdr.msg_controllen = sizeof(ControlBuffer);
+        const auto count = recvmmsg(mSocket.get(), msgs.data(), kReadBatchSize, MSG_DONTWAIT,
+                                    nullptr);
+        if (count < 0) {
+            batchWasFull = false;
             if (errno == EAGAIN) continue;
 
             errnoCopy = errno;
-            PLOG(ERROR) << "Failed to read CAN packet";
+            PLOG(ERROR) << "Failed to read CAN packets";
             break;
         }
 
-        mReadCallback(frame, ts);
+        const auto realtimeToBoottime = realtimeToBoottimeOffset();
+        const std::chrono::nanoseconds readTime(elapsedRealtimeNano());
+        size_t validCount = 0;
+        for (; validCount < static_cast<size_t>(count); validCount++) {
+            const auto& msg = msgs[validCount];
+            if (msg.msg_len != CAN_MTU) break;
+            frames[validCount].timestamp = getTimestamp(msg.msg_hdr, realtimeToBoottime, readTime);
+        }
+
+        if (validCount > 0) mReadCallback(frames.data(), validCount);
+        if (validCount < static_cast<size_t>(count)) {
+            LOG(ERROR) << "Failed to read CAN packet, got " << msgs[validCount].msg_len
+                       << " bytes";
+            break;
+        }
+        batchWasFull = static_cast<size_t>(count) == kReadBatchSize;
     }
 
     bool failed = !mStopReaderThread;
@@ -147,4 +282,70 @@ void CanSocket::readerThread() {
     LOG(VERBOSE) << "Reader thread stopped";
 }
 
+void CanSocket::writerThread() {
+    LOG(VERBOSE) << "Writer thread started";
+
+    std::array<TxFrame, kWriteBatchSize> batch;
+    std::array<struct iovec, kWriteBatchSize> iovecs;
+    std::array<struct mmsghdr, kWriteBatchSize> msgs = {};
+    for (size_t i = 0; i < kWriteBatchSize; i++) {
+        iovecs[i] = {.iov_base = &batch[i].frame, .iov_len = CAN_MTU};
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    std::unique_lock<std::mutex> lck(mTxGuard);
+    while (true) {
+        mTxQueueChanged.wait(lck, [this] { return mStopWriterThread || !mTxQueue.empty(); });
+        if (mStopWriterThread) break;
+
+        size_t count = 0;
+        for (; count < kWriteBatchSize && !mTxQueue.empty(); count++) {
+            batch[count] = mTxQueue.top();
+            mTxQueue.pop();
+        }
+        lck.unlock();
+        mTxSpaceAvailable.notify_all();
+
+        // A full kernel queue is retried below instead of blocking, so shutdown is never delayed.
+        const auto res = sendmmsg(mSocket.get(), msgs.data(), count, MSG_DONTWAIT);
+        const auto errnoCopy = errno;
+        const size_t sent = res < 0 ? 0 : res;
+
+        lck.lock();
+        mTxStats.sent += sent;
+        if (sent == count) continue;
+
+        /* sendmmsg(2) only reports an error if no frame was sent, the next call reports it for
+         * the first frame that wasn't. */
+        bool retryLater = false;
+        auto first = sent;
+        if (res < 0) {
+            if (errnoCopy == ENOBUFS || errnoCopy == EAGAIN) {
+                mTxStats.retried++;
+                retryLater = true;
+                if (++batch[first].retries > kMaxTxRetries) {
+                    LOG(WARNING) << "CanSocket kernel transmit queue stays full, dropping frame";
+                    mTxStats.dropped++;
+                    first++;
+                }
+            } else {
+                errno = errnoCopy;
+                PLOG(DEBUG) << "CanSocket send failed";
+                mTxStats.dropped++;
+                first++;
+            }
+        }
+
+        // Frames that weren't sent keep their priority and sequence number, so their order.
+        for (auto i = first; i < count; i++) mTxQueue.push(batch[i]);
+
+        if (retryLater) {
+            mTxQueueChanged.wait_for(lck, kTxRetryPeriod, [this] { return mStopWriterThread; });
+        }
+    }
+
+    LOG(VERBOSE) << "Writer thread stopped";
+}
+
 }  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -19,16 +19,28 @@
 #include <android-base/macros.h>
 #include <android-base/unique_fd.h>
 #include <linux/can.h>
+#include <utils/Mutex.h>
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
 #include <thread>
+#include <vector>
 
 namespace android::hardware::automotive::can::V1_0::implementation {
 
 /** Wrapper around SocketCAN socket. */
 struct CanSocket {
-    using ReadCallback = std::function<void(const struct canfd_frame&, std::chrono::nanoseconds)>;
+    /** Received frame, along with its receive time since boot. */
+    struct ReadFrame {
+        struct canfd_frame frame;
+        std::chrono::nanoseconds timestamp;
+    };
+
+    /** Called from the reader thread with every batch of frames drained from the socket. */
+    using ReadCallback = std::function<void(const ReadFrame* frames, size_t count)>;
     using ErrorCallback = std::function<void(int errnoVal)>;
 
     /**
@@ -43,17 +55,58 @@ struct CanSocket {
                                            ErrorCallback errcb);
     virtual ~CanSocket();
 
+    /** Transmit queue counters. */
+    struct TxStats {
+        /** Frames waiting to be written to the socket. */
+        size_t queueDepth;
+        uint64_t sent;
+        /** Frames that didn't fit into the queue or that the kernel failed to send. */
+        uint64_t dropped;
+        /** Writes retried because the kernel transmit queue was full. */
+        uint64_t retried;
+    };
+
     /**
-     * Send CAN frame.
+     * Queue CAN frame for sending.
+     *
+     * Queued frames are written by a dedicated thread, in batches and in arbitration order (lower
+     * IDs first). Frames with the same ID are sent in the order they were queued. If the queue is
+     * full, the caller is blocked until there is room or the wait times out.
      *
      * \param frame Frame to send
-     * \return true in case of success, false otherwise
+     * \return true if the frame was queued, false if the queue stayed full
      */
     bool send(const struct canfd_frame& frame);
 
+    /** Current transmit queue counters. */
+    TxStats getTxStats();
+
+    /**
+     * Replace the CAN_RAW_FILTER rules the kernel applies to received frames.
+     *
+     * Error frames are not affected by these rules.
+     *
+     * \param filters Rules, a frame is received if it matches any of them (none: no frames)
+     * \return true in case of success, false otherwise
+     */
+    bool setFilters(const std::vector<struct can_filter>& filters);
+
   private:
+    struct TxFrame {
+        uint32_t priority;
+        uint64_t sequence;
+        unsigned retries;
+        struct canfd_frame frame;
+
+        bool operator>(const TxFrame& other) const {
+            if (priority != other.priority) return priority > other.priority;
+            return sequence > other.sequence;
+        }
+    };
+
     CanSocket(base::unique_fd socket, ReadCallback rdcb, ErrorCallback errcb);
     void readerThread();
+    void writerThread();
 
     ReadCallback mReadCallback;
     ErrorCallback mErrorCallback;
@@ -63,6 +116,16 @@ struct CanSocket {
     std::atomic<bool> mStopReaderThread = false;
     std::atomic<bool> mReaderThreadFinished = false;
 
+    std::mutex mTxGuard;
+    std::condition_variable mTxQueueChanged;
+    std::condition_variable mTxSpaceAvailable;
+    std::priority_queue<TxFrame, std::vector<TxFrame>, std::greater<TxFrame>> mTxQueue
+            GUARDED_BY(mTxGuard);
+    uint64_t mTxSequence GUARDED_BY(mTxGuard) = 0;
+    TxStats mTxStats GUARDED_BY(mTxGuard) = {};
+    bool mStopWriterThread GUARDED_BY(mTxGuard) = false;
+    std::thread mWriterThread;
+
     DISALLOW_COPY_AND_ASSIGN(CanSocket);
 };
 
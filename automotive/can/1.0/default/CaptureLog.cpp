@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CaptureLog.h"
+
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+using namespace capture_log;
+
+static_assert(sizeof(LogHeader) % 8 == 0, "LogHeader must keep records aligned");
+static_assert(sizeof(RecordHeader) % 8 == 0, "RecordHeader must keep records aligned");
+
+/* The log is mapped in chunks of this size, growing the file one chunk at a time. */
+static constexpr size_t kChunkSize = 4 << 20;
+
+/* Chunks are mapped with this much room past their end, so a record starting at the end of a chunk
+ * doesn't need to be split across two mappings. */
+static constexpr size_t kMaxRecordSize = sizeof(RecordHeader) + UINT8_MAX + 1;
+
+/* Maximum number of buses, as limited by RecordHeader::bus. */
+static constexpr unsigned kMaxBusCount = UINT8_MAX + 1;
+
+static constexpr size_t alignUp(size_t size) {
+    return (size + 7) & ~size_t{7};
+}
+
+/* Returns the path of the log of the given name in kDirectory, or nullopt if the name could refer
+ * to anything outside of it. The debug interface passes the name straight from the caller. */
+static std::optional<std::string> getLogPath(const std::string& name) {
+    if (name.empty() || name[0] == '.' || name.find('/') != std::string::npos) {
+        LOG(ERROR) << "Invalid capture log name " << name << ", expected a file name in "
+                   << kDirectory;
+        return std::nullopt;
+    }
+    return std::string(kDirectory) + "/" + name;
+}
+
+std::unique_ptr<CaptureWriter> CaptureWriter::create(const std::string& name) {
+    const auto path = getLogPath(name);
+    if (!path.has_value()) return nullptr;
+
+    base::unique_fd fd(
+            ::open(path->c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0640));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Can't create capture log " << *path;
+        return nullptr;
+    }
+
+    // Can't use std::make_unique due to private CaptureWriter constructor.
+    std::unique_ptr<CaptureWriter> writer(new CaptureWriter(std::move(fd)));
+    std::lock_guard<std::mutex> lck(writer->mLock);
+    if (!writer->mapChunk(0)) return nullptr;
+
+    const LogHeader header = {.magic = kMagic, .version = kVersion, .reserved = 0};
+    memcpy(writer->mChunk, &header, sizeof(header));
+    writer->mOffset = sizeof(header);
+    return writer;
+}
+
+CaptureWriter::CaptureWriter(base::unique_fd fd) : mFd(std::move(fd)) {}
+
+CaptureWriter::~CaptureWriter() {
+    std::lock_guard<std::mutex> lck(mLock);
+    unmapChunk();
+    if (ftruncate(mFd.get(), mOffset) < 0) {
+        PLOG(WARNING) << "Can't truncate capture log to its records";
+    }
+}
+
+std::optional<uint8_t> CaptureWriter::addBus(const std::string& name) {
+    std::lock_guard<std::mutex> lck(mLock);
+    if (mBusCount == kMaxBusCount) {
+        LOG(ERROR) << "Too many buses to capture " << name;
+        return std::nullopt;
+    }
+
+    const RecordHeader header = {
+            .timestamp = 0,
+            .canId = 0,
+            .type = RecordType::BUS,
+            .bus = static_cast<uint8_t>(mBusCount),
+            .flags = 0,
+            .length = static_cast<uint8_t>(std::min<size_t>(name.size(), UINT8_MAX)),
+    };
+    if (!appendRecord(header, name.data())) return std::nullopt;
+    return static_cast<uint8_t>(mBusCount++);
+}
+
+void CaptureWriter::append(uint8_t bus, const CanSocket::ReadFrame* frames, size_t count) {
+    std::lock_guard<std::mutex> lck(mLock);
+    for (size_t i = 0; i < count; i++) {
+        const auto& frame = frames[i].frame;
+        const RecordHeader header = {
+                .timestamp = static_cast<uint64_t>(frames[i].timestamp.count()),
+                .canId = frame.can_id,
+                .type = RecordType::FRAME,
+                .bus = bus,
+                .flags = frame.flags,
+                .length = std::min<uint8_t>(frame.len, CANFD_MAX_DLEN),
+        };
+        if (!appendRecord(header, frame.data)) mDroppedCount++;
+    }
+}
+
+uint64_t CaptureWriter::getDroppedCount() {
+    std::lock_guard<std::mutex> lck(mLock);
+    return mDroppedCount;
+}
+
+bool CaptureWriter::appendRecord(const RecordHeader& header, const void* payload) {
+    if (mChunk == nullptr || mOffset >= mChunkOffset + kChunkSize) {
+        if (!mapChunk(mOffset - mOffset % kChunkSize)) return false;
+    }
+
+    /* The header goes in last. If the service dies while writing, a partially written record
+     * still reads as the end of the log. */
+    auto record = mChunk + (mOffset - mChunkOffset);
+    memcpy(record + sizeof(header), payload, header.length);
+    memcpy(record, &header, sizeof(header));
+    mOffset += sizeof(header) + alignUp(header.length);
+    return true;
+}
+
+bool CaptureWriter::mapChunk(size_t offset) {
+    unmapChunk();
+
+    const auto mapSize = kChunkSize + kMaxRecordSize;
+    if (ftruncate(mFd.get(), offset + mapSize) < 0) {
+        PLOG(ERROR) << "Can't grow capture log";
+        return false;
+    }
+    // Populating the chunk upfront keeps page faults out of the reader threads appending frames.
+    const auto chunk = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            mFd.get(), offset);
+    if (chunk == MAP_FAILED) {
+        PLOG(ERROR) << "Can't map capture log";
+        return false;
+    }
+
+    mChunk = static_cast<uint8_t*>(chunk);
+    mChunkOffset = offset;
+    return true;
+}
+
+void CaptureWriter::unmapChunk() {
+    if (mChunk == nullptr) return;
+    munmap(mChunk, kChunkSize + kMaxRecordSize);
+    mChunk = nullptr;
+}
+
+std::unique_ptr<CaptureReader> CaptureReader::open(const std::string& name) {
+    const auto logPath = getLogPath(name);
+    if (!logPath.has_value()) return nullptr;
+    const std::string& path = *logPath;
+
+    base::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Can't open capture log " << path;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd.get(), &st) < 0) {
+        PLOG(ERROR) << "Can't stat capture log " << path;
+        return nullptr;
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(LogHeader)) {
+        LOG(ERROR) << path << " is not a capture log";
+        return nullptr;
+    }
+
+    const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (data == MAP_FAILED) {
+        PLOG(ERROR) << "Can't map capture log " << path;
+        return nullptr;
+    }
+    // Can't use std::make_unique due to private CaptureReader constructor.
+    std::unique_ptr<CaptureReader> reader(new CaptureReader(static_cast<uint8_t*>(data), size));
+
+    LogHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion) {
+        LOG(ERROR) << path << " is not a capture log of version " << kVersion;
+        return nullptr;
+    }
+    return reader;
+}
+
+CaptureReader::CaptureReader(const uint8_t* data, size_t size)
+    : mData(data), mSize(size), mOffset(sizeof(LogHeader)) {}
+
+CaptureReader::~CaptureReader() {
+    munmap(const_cast<uint8_t*>(mData), mSize);
+}
+
+bool CaptureReader::next(Frame* frame) {
+    while (mSize - mOffset >= sizeof(RecordHeader)) {
+        RecordHeader header;
+        memcpy(&header, mData + mOffset, sizeof(header));
+        if (header.type == RecordType::END) return false;
+
+        const auto recordSize = sizeof(header) + alignUp(header.length);
+        if (mSize - mOffset < recordSize) {
+            LOG(WARNING) << "Capture log ends with a truncated record";
+            return false;
+        }
+        const auto payload = mData + mOffset + sizeof(header);
+        mOffset += recordSize;
+
+        if (header.type == RecordType::BUS) {
+            if (mBusNames.size() <= header.bus) mBusNames.resize(header.bus + 1);
+            mBusNames[header.bus].assign(reinterpret_cast<const char*>(payload), header.length);
+        } else if (header.type == RecordType::FRAME) {
+            if (header.length > CANFD_MAX_DLEN) {
+                LOG(WARNING) << "Capture log has a malformed frame record";
+                return false;
+            }
+            frame->bus = header.bus;
+            frame->timestamp = std::chrono::nanoseconds(header.timestamp);
+            frame->frame = {};
+            frame->frame.can_id = header.canId;
+            frame->frame.len = header.length;
+            frame->frame.flags = header.flags;
+            memcpy(frame->frame.data, payload, header.length);
+            return true;
+        }
+        // Records of unknown types are skipped, they may be added by newer versions.
+    }
+    return false;
+}
+
+const std::string& CaptureReader::getBusName(uint8_t bus) const {
+    static const std::string kUnknownBus;
+    if (bus >= mBusNames.size()) return kUnknownBus;
+    return mBusNames[bus];
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
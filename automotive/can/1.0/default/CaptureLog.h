@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CanSocket.h"
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <utils/Mutex.h>
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Append-only log of received CAN frames, for capturing bus traffic and replaying it later.
+ *
+ * A log starts with a LogHeader, followed by records. Every record is a RecordHeader and length
+ * bytes of payload, padded to the next multiple of 8 bytes. A record of type END (all zeros, as in
+ * the unwritten part of a log that wasn't closed cleanly) ends the log. All fields are in host
+ * byte order.
+ */
+namespace capture_log {
+
+constexpr uint32_t kMagic = 0x4C4E4143;  // "CANL"
+constexpr uint16_t kVersion = 1;
+
+struct LogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+};
+
+enum class RecordType : uint8_t {
+    END = 0,
+    /** Assigns the bus index of the record to the bus name in its payload. */
+    BUS = 1,
+    /** Frame received on the bus of the record's index, the payload is the frame data. */
+    FRAME = 2,
+};
+
+struct RecordHeader {
+    /** Receive time since boot, in nanoseconds. */
+    uint64_t timestamp;
+    /** canfd_frame::can_id, including the EFF/RTR/ERR flags. */
+    uint32_t canId;
+    RecordType type;
+    uint8_t bus;
+    /** canfd_frame::flags. */
+    uint8_t flags;
+    uint8_t length;
+};
+
+/** Directory holding the capture logs, logs are only ever created in or read from it. */
+constexpr char kDirectory[] = "/data/vendor/can";
+
+}  // namespace capture_log
+
+/** Writes a capture log through a shared memory mapping, safe to use from several buses. */
+struct CaptureWriter {
+    /**
+     * Create a log file in capture_log::kDirectory, replacing an existing one.
+     *
+     * \param name Name of the log file, without any directory
+     * \return Writer instance, or nullptr if the name isn't a plain file name or the file couldn't
+     *         be created
+     */
+    static std::unique_ptr<CaptureWriter> create(const std::string& name);
+
+    /** Truncate the log to the written records and close it. */
+    ~CaptureWriter();
+
+    /**
+     * Add a bus to the log.
+     *
+     * \param name Bus name, as published by ICanController
+     * \return Bus index to append its frames with, or nullopt if no more buses fit into the log
+     */
+    std::optional<uint8_t> addBus(const std::string& name);
+
+    /**
+     * Append received frames to the log.
+     *
+     * \param bus Bus index, as returned by addBus
+     * \param frames Frames to append
+     * \param count Number of frames
+     */
+    void append(uint8_t bus, const CanSocket::ReadFrame* frames, size_t count);
+
+    /** Number of frames that couldn't be written because the log couldn't grow. */
+    uint64_t getDroppedCount();
+
+  private:
+    CaptureWriter(base::unique_fd fd);
+
+    bool appendRecord(const capture_log::RecordHeader& header, const void* payload)
+            REQUIRES(mLock);
+    bool mapChunk(size_t offset) REQUIRES(mLock);
+    void unmapChunk() REQUIRES(mLock);
+
+    const base::unique_fd mFd;
+
+    std::mutex mLock;
+    /** Currently mapped part of the file, starting at file offset mChunkOffset. */
+    uint8_t* mChunk GUARDED_BY(mLock) = nullptr;
+    size_t mChunkOffset GUARDED_BY(mLock) = 0;
+    /** File offset of the next record. */
+    size_t mOffset GUARDED_BY(mLock) = 0;
+    unsigned mBusCount GUARDED_BY(mLock) = 0;
+    uint64_t mDroppedCount GUARDED_BY(mLock) = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(CaptureWriter);
+};
+
+/** Reads a capture log, mapped into memory as a whole. */
+struct CaptureReader {
+    /** Frame read from the log. */
+    struct Frame {
+        uint8_t bus;
+        std::chrono::nanoseconds timestamp;
+        struct canfd_frame frame;
+    };
+
+    /**
+     * Open a log file in capture_log::kDirectory.
+     *
+     * \param name Name of the log file, without any directory
+     * \return Reader instance, or nullptr if the name isn't a plain file name, the file couldn't be
+     *         opened or it isn't a capture log
+     */
+    static std::unique_ptr<CaptureReader> open(const std::string& name);
+    ~CaptureReader();
+
+    /**
+     * Read the next frame.
+     *
+     * \param frame Frame to populate
+     * \return true if a frame was read, false at the end of the log or on a malformed record
+     */
+    bool next(Frame* frame);
+
+    /**
+     * Name of a bus.
+     *
+     * \param bus Bus index, as in Frame::bus
+     * \return Name of the bus, empty if it wasn't defined (yet)
+     */
+    const std::string& getBusName(uint8_t bus) const;
+
+  private:
+    CaptureReader(const uint8_t* data, size_t size);
+
+    const uint8_t* const mData;
+    const size_t mSize;
+    size_t mOffset;
+    std::vector<std::string> mBusNames;
+
+    DISALLOW_COPY_AND_ASSIGN(CaptureReader);
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
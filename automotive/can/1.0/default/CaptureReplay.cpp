@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CaptureReplay.h"
+
+#include <android-base/logging.h>
+#include <libnetdevice/can.h>
+#include <linux/can/raw.h>
+#include <sys/socket.h>
+
+#include <array>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+using namespace std::chrono_literals;
+
+/* Maximum number of frames written with a single sendmmsg(2) call. */
+static constexpr size_t kWriteBatchSize = 32;
+
+/* How long to wait before retrying a write the kernel rejected because its queue was full. */
+static constexpr auto kRetryPeriod = 1ms;
+
+CaptureReplay::CaptureReplay(std::unique_ptr<CaptureReader> reader,
+                             std::map<std::string, std::string> ifnames, double speed)
+    : mReader(std::move(reader)),
+      mIfnames(std::move(ifnames)),
+      mSpeed(speed),
+      mReplayThread(&CaptureReplay::replayThread, this) {}
+
+CaptureReplay::~CaptureReplay() {
+    {
+        std::lock_guard<std::mutex> lck(mStopGuard);
+        mStop = true;
+    }
+    mStopRequested.notify_all();
+    mReplayThread.join();
+}
+
+bool CaptureReplay::isRunning() const {
+    return mIsRunning;
+}
+
+bool CaptureReplay::waitUntil(std::chrono::steady_clock::time_point time) {
+    std::unique_lock<std::mutex> lck(mStopGuard);
+    return !mStopRequested.wait_until(lck, time, [this] { return mStop; });
+}
+
+CaptureReplay::Bus* CaptureReplay::getBus(uint8_t index) {
+    auto it = mBuses.find(index);
+    if (it == mBuses.end()) {
+        auto& bus = mBuses[index];
+        const auto& name = mReader->getBusName(index);
+        const auto ifname = mIfnames.find(name);
+        if (ifname == mIfnames.end()) {
+            LOG(WARNING) << "Bus " << name << " is not a virtual bus that's up, not replaying it";
+            bus.failed = true;
+            return nullptr;
+        }
+
+        bus.socket = netdevice::can::socket(ifname->second);
+        if (!bus.socket.ok()) {
+            LOG(ERROR) << "Can't open " << ifname->second << " to replay bus " << name;
+            bus.failed = true;
+            return nullptr;
+        }
+        const int enable = 1;
+        if (setsockopt(bus.socket.get(), SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable,
+                       sizeof(enable)) < 0) {
+            PLOG(WARNING) << "Can't replay CAN FD frames on " << ifname->second;
+        }
+        return &bus;
+    }
+    return it->second.failed ? nullptr : &it->second;
+}
+
+void CaptureReplay::sendFrames(Bus* bus, const struct canfd_frame* frames, size_t count) {
+    std::array<struct iovec, kWriteBatchSize> iovecs;
+    std::array<struct mmsghdr, kWriteBatchSize> msgs = {};
+    for (size_t i = 0; i < count; i++) {
+        const auto mtu = frames[i].len > CAN_MAX_DLEN ? CANFD_MTU : CAN_MTU;
+        iovecs[i] = {.iov_base = const_cast<struct canfd_frame*>(&frames[i]), .iov_len = mtu};
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Frames are never dropped for a full queue, the replay is slowed down instead.
+    size_t sent = 0;
+    while (sent < count) {
+        const auto res = sendmmsg(bus->socket.get(), msgs.data() + sent, count - sent, 0);
+        if (res >= 0) {
+            sent += res;
+            continue;
+        }
+        if (errno == ENOBUFS || errno == EAGAIN) {
+            if (!waitUntil(std::chrono::steady_clock::now() + kRetryPeriod)) return;
+            continue;
+        }
+        PLOG(ERROR) << "Replaying frames failed, skipping the rest of the bus";
+        bus->failed = true;
+        return;
+    }
+}
+
+void CaptureReplay::replayThread() {
+    LOG(VERBOSE) << "Replay thread started";
+
+    std::array<struct canfd_frame, kWriteBatchSize> batch;
+    size_t batchSize = 0;
+    Bus* batchBus = nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::nanoseconds> firstTimestamp;
+    bool stopped = false;
+
+    CaptureReader::Frame frame;
+    while (mReader->next(&frame)) {
+        // Error frames are captured for reference, but they are reported by drivers, not sent.
+        if ((frame.frame.can_id & CAN_ERR_FLAG) != 0) continue;
+
+        const auto bus = getBus(frame.bus);
+        if (bus == nullptr) continue;
+
+        if (!firstTimestamp) firstTimestamp = frame.timestamp;
+        const auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         (frame.timestamp - *firstTimestamp) / mSpeed);
+
+        /* Frames that are due already (because they were received back to back, or because the
+         * replay fell behind) are written together. */
+        if (bus != batchBus || batchSize == kWriteBatchSize ||
+            due > std::chrono::steady_clock::now()) {
+            if (batchSize > 0) sendFrames(batchBus, batch.data(), batchSize);
+            batchSize = 0;
+            if (!waitUntil(due)) {
+                stopped = true;
+                break;
+            }
+        }
+        batchBus = bus;
+        batch[batchSize++] = frame.frame;
+    }
+    if (!stopped && batchSize > 0) sendFrames(batchBus, batch.data(), batchSize);
+
+    mIsRunning = false;
+    LOG(VERBOSE) << "Replay thread stopped";
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
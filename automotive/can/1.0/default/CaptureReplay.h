@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CaptureLog.h"
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Replays a capture log onto virtual CAN interfaces.
+ *
+ * Frames are written to the interfaces from a dedicated thread, in log order, at the pace they
+ * were captured at (scaled by the replay speed). vcan loops them back to every socket bound to the
+ * interface, so HAL clients receive them as if they came from the bus.
+ */
+struct CaptureReplay {
+    /**
+     * Start replaying a log.
+     *
+     * \param reader Log to replay
+     * \param ifnames Network interface to replay each bus on, by bus name. Frames of buses that
+     *        aren't listed are skipped.
+     * \param speed Replay speed relative to the original timing, must be positive
+     */
+    CaptureReplay(std::unique_ptr<CaptureReader> reader,
+                  std::map<std::string, std::string> ifnames, double speed);
+
+    /** Stop the replay, if it's still running. */
+    ~CaptureReplay();
+
+    /** Whether there are frames left to replay. */
+    bool isRunning() const;
+
+  private:
+    struct Bus {
+        base::unique_fd socket;
+        bool failed = false;
+    };
+
+    void replayThread();
+    Bus* getBus(uint8_t index);
+    void sendFrames(Bus* bus, const struct canfd_frame* frames, size_t count);
+
+    /** Wait until the given time, returns false if the replay was stopped in the meantime. */
+    bool waitUntil(std::chrono::steady_clock::time_point time);
+
+    const std::unique_ptr<CaptureReader> mReader;
+    const std::map<std::string, std::string> mIfnames;
+    const double mSpeed;
+
+    /** Buses by log bus index, opened upon their first frame. */
+    std::map<uint8_t, Bus> mBuses;
+
+    std::mutex mStopGuard;
+    std::condition_variable mStopRequested;
+    bool mStop GUARDED_BY(mStopGuard) = false;
+
+    std::atomic<bool> mIsRunning = true;
+    std::thread mReplayThread;
+
+    DISALLOW_COPY_AND_ASSIGN(CaptureReplay);
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
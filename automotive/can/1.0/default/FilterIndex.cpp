@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FilterIndex.h"
+
+#include <algorithm>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Helper function to determine if a flag meets the requirements of a
+ * FilterFlag. See definition of FilterFlag in types.hal
+ *
+ * \param filterFlag FilterFlag object to match flag against
+ * \param flag bool object from CanMessage object
+ */
+static bool satisfiesFilterFlag(FilterFlag filterFlag, bool flag) {
+    if (filterFlag == FilterFlag::DONT_CARE) return true;
+    if (filterFlag == FilterFlag::SET) return flag;
+    if (filterFlag == FilterFlag::NOT_SET) return !flag;
+    return false;
+}
+
+/**
+ * Match the filter set against message id.
+ *
+ * For details on the filters syntax, please see CanMessageFilter at
+ * the HAL definition (types.hal).
+ *
+ * \param filter Filter to match against
+ * \param id Message id to filter
+ * \return true if the message id matches the filter, false otherwise
+ */
+static bool match(const hidl_vec<CanMessageFilter>& filter, CanMessageId id, bool isRtr,
+                  bool isExtendedId) {
+    if (filter.size() == 0) return true;
+
+    bool anyNonExcludeRulePresent = false;
+    bool anyNonExcludeRuleSatisfied = false;
+    for (auto& rule : filter) {
+        const bool satisfied = ((id & rule.mask) == rule.id) &&
+                               satisfiesFilterFlag(rule.rtr, isRtr) &&
+                               satisfiesFilterFlag(rule.extendedFormat, isExtendedId);
+
+        if (rule.exclude) {
+            // Any excluded (blacklist) rule not being satisfied invalidates the whole filter set.
+            if (satisfied) return false;
+        } else {
+            anyNonExcludeRulePresent = true;
+            if (satisfied) anyNonExcludeRuleSatisfied = true;
+        }
+    }
+    return !anyNonExcludeRulePresent || anyNonExcludeRuleSatisfied;
+}
+
+FilterIndex::FilterIndex(std::vector<hidl_vec<CanMessageFilter>> filters)
+    : mFilters(std::move(filters)) {
+    for (size_t i = 0; i < mFilters.size(); i++) {
+        bool anyNonExcludeRulePresent = false;
+        for (auto& rule : mFilters[i]) {
+            /* Only non-exclude rules can make a listener accept a message, exclude rules are
+             * evaluated by match() on the candidates. */
+            if (rule.exclude) continue;
+            anyNonExcludeRulePresent = true;
+
+            auto group = std::find_if(mMaskGroups.begin(), mMaskGroups.end(),
+                                      [&rule](const auto& g) { return g.mask == rule.mask; });
+            if (group == mMaskGroups.end()) {
+                group = mMaskGroups.insert(mMaskGroups.end(), MaskGroup{rule.mask, {}});
+            }
+            auto& listeners = group->listenersById[rule.id];
+            // Several rules of a listener may share a mask and ID.
+            if (listeners.empty() || listeners.back() != i) listeners.push_back(i);
+        }
+        if (!anyNonExcludeRulePresent) mMatchAll.push_back(i);
+    }
+}
+
+void FilterIndex::match(CanMessageId id, bool isRtr, bool isExtendedId,
+                        std::vector<size_t>* listeners) const {
+    listeners->assign(mMatchAll.begin(), mMatchAll.end());
+    for (auto& group : mMaskGroups) {
+        const auto it = group.listenersById.find(id & group.mask);
+        if (it == group.listenersById.end()) continue;
+        listeners->insert(listeners->end(), it->second.begin(), it->second.end());
+    }
+
+    // Candidates can come from several groups, and still have to pass flags and exclude rules.
+    std::sort(listeners->begin(), listeners->end());
+    listeners->erase(std::unique(listeners->begin(), listeners->end()), listeners->end());
+    listeners->erase(std::remove_if(listeners->begin(), listeners->end(),
+                                    [&](size_t i) {
+                                        return !implementation::match(mFilters[i], id, isRtr,
+                                                                      isExtendedId);
+                                    }),
+                     listeners->end());
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
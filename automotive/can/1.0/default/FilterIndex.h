@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/automotive/can/1.0/types.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Index over the filter sets of message listeners, used to find the listeners accepting a message
+ * without evaluating every rule of every listener.
+ *
+ * Rules are grouped by mask, each group maps the masked ID to the listeners with such a rule. A
+ * lookup costs one hash lookup per distinct mask in use, plus full filter set evaluation of the
+ * listeners that have a rule with a matching ID. Listeners usually share a handful of masks (most
+ * often the full 11 or 29 bit ones), so this is close to the number of actual matches.
+ *
+ * The index is immutable after construction, so it can be used from multiple threads.
+ */
+class FilterIndex {
+  public:
+    /**
+     * Build the index.
+     *
+     * \param filters Filter set of every listener, a listener is identified by its position here.
+     *                Rule IDs must already have all bits not covered by their mask cleared.
+     */
+    explicit FilterIndex(std::vector<hidl_vec<CanMessageFilter>> filters);
+
+    /**
+     * Find listeners accepting a message.
+     *
+     * For details on the filters syntax, please see CanMessageFilter at the HAL definition
+     * (types.hal).
+     *
+     * \param id Message id to filter
+     * \param isRtr Whether the message is a remote transmission request
+     * \param isExtendedId Whether the message uses a 29 bit ID
+     * \param listeners Replaced with the indices of accepting listeners, in ascending order
+     */
+    void match(CanMessageId id, bool isRtr, bool isExtendedId,
+               std::vector<size_t>* listeners) const;
+
+    /** Number of listeners the index was built for. */
+    size_t size() const { return mFilters.size(); }
+
+  private:
+    struct MaskGroup {
+        uint32_t mask;
+        std::unordered_map<CanMessageId, std::vector<size_t>> listenersById;
+    };
+
+    const std::vector<hidl_vec<CanMessageFilter>> mFilters;
+
+    /** Listeners without any non-exclude rule, they are candidates for every message. */
+    std::vector<size_t> mMatchAll;
+    std::vector<MaskGroup> mMaskGroups;
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MessageBatcher.h"
+
+#include <android-base/logging.h>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/** Largest batch delivered, keeps the transactions well below the binder buffer size. */
+static constexpr size_t kMaxBatchSize = 1024;
+
+/** Number of full batches that may wait for delivery before messages get dropped. */
+static constexpr size_t kMaxPendingBatches = 16;
+
+MessageBatcher::MessageBatcher(sp<V1_1::ICanMessageBatchListener> listener, size_t maxBatchSize,
+                               std::chrono::milliseconds maxLatency)
+    : mListener(listener),
+      mMaxBatchSize(std::min(maxBatchSize, kMaxBatchSize)),
+      mMaxLatency(maxLatency),
+      mDeliveryThread(&MessageBatcher::deliveryThread, this) {}
+
+MessageBatcher::~MessageBatcher() {
+    {
+        std::lock_guard<std::mutex> lck(mLock);
+        mStop = true;
+    }
+    mPendingChanged.notify_one();
+    mDeliveryThread.join();
+}
+
+void MessageBatcher::push(const CanMessage& message) {
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lck(mLock);
+        if (mPending.size() >= mMaxBatchSize * kMaxPendingBatches) {
+            if (mDroppedCount++ == 0) {
+                LOG(WARNING) << "Batched listener can't keep up, dropping messages";
+            }
+            return;
+        }
+        mPending.push_back({std::chrono::steady_clock::now(), message});
+
+        // The delivery thread needs to know about the first message's deadline and full batches.
+        notify = mPending.size() == 1 || mPending.size() == mMaxBatchSize;
+    }
+    if (notify) mPendingChanged.notify_one();
+}
+
+void MessageBatcher::deliveryThread() {
+    std::vector<CanMessage> batch;
+    batch.reserve(mMaxBatchSize);
+    bool failedOnce = false;
+
+    std::unique_lock<std::mutex> lck(mLock);
+    while (true) {
+        mPendingChanged.wait(lck, [this] { return mStop || !mPending.empty(); });
+        if (mStop) break;
+
+        if (mPending.size() < mMaxBatchSize) {
+            const auto deadline = mPending.front().received + mMaxLatency;
+            mPendingChanged.wait_until(
+                    lck, deadline, [this] { return mStop || mPending.size() >= mMaxBatchSize; });
+            if (mStop) break;
+        }
+
+        const auto count = std::min(mPending.size(), mMaxBatchSize);
+        batch.clear();
+        for (size_t i = 0; i < count; i++) {
+            batch.push_back(std::move(mPending.front().message));
+            mPending.pop_front();
+        }
+        if (mDroppedCount > 0) {
+            LOG(WARNING) << "Dropped " << mDroppedCount << " messages for a batched listener";
+            mDroppedCount = 0;
+        }
+        lck.unlock();
+
+        hidl_vec<CanMessage> messages;
+        messages.setToExternal(batch.data(), batch.size());
+        if (!mListener->onReceiveBatch(messages).isOk() && !failedOnce) {
+            failedOnce = true;
+            LOG(WARNING) << "Failed to notify batched listener about messages";
+        }
+
+        lck.lock();
+    }
+}
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
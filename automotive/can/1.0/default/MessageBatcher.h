@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <android/hardware/automotive/can/1.1/ICanMessageBatchListener.h>
+#include <utils/Mutex.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace android::hardware::automotive::can::V1_0::implementation {
+
+/**
+ * Collects received messages for a batched listener and delivers them from a dedicated thread.
+ *
+ * The reader thread only queues messages, so neither binder transactions nor a slow listener
+ * delay the reception of frames.
+ */
+struct MessageBatcher {
+    /**
+     * Create a batcher and start its delivery thread.
+     *
+     * \param listener Listener to deliver batches to
+     * \param maxBatchSize Maximum number of messages per batch, must not be 0
+     * \param maxLatency Maximum time a message may wait for its batch to be delivered
+     */
+    MessageBatcher(sp<V1_1::ICanMessageBatchListener> listener, size_t maxBatchSize,
+                   std::chrono::milliseconds maxLatency);
+
+    /** Stop the delivery thread, messages that weren't delivered yet are dropped. */
+    ~MessageBatcher();
+
+    /**
+     * Queue a message for delivery, never waits for the listener.
+     *
+     * If too many messages are already waiting, the message is dropped.
+     *
+     * \param message Message to queue
+     */
+    void push(const CanMessage& message);
+
+  private:
+    struct PendingMessage {
+        std::chrono::steady_clock::time_point received;
+        CanMessage message;
+    };
+
+    void deliveryThread();
+
+    const sp<V1_1::ICanMessageBatchListener> mListener;
+    const size_t mMaxBatchSize;
+    const std::chrono::milliseconds mMaxLatency;
+
+    std::mutex mLock;
+    std::condition_variable mPendingChanged;
+    std::deque<PendingMessage> mPending GUARDED_BY(mLock);
+    uint64_t mDroppedCount GUARDED_BY(mLock) = 0;
+    bool mStop GUARDED_BY(mLock) = false;
+
+    std::thread mDeliveryThread;
+
+    DISALLOW_COPY_AND_ASSIGN(MessageBatcher);
+};
+
+}  // namespace android::hardware::automotive::can::V1_0::implementation
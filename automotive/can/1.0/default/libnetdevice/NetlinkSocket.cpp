@@ -38,14 +38,17 @@ NetlinkSocket::NetlinkSocket(int protocol) {
     }
 }
 
-bool NetlinkSocket::send(struct nlmsghdr* nlmsg) {
+bool NetlinkSocket::send(struct nlmsghdr* const* msgs, size_t count) {
     if (mFailed) return false;
 
-    nlmsg->nlmsg_pid = 0;  // kernel
-    nlmsg->nlmsg_seq = mSeq++;
-    nlmsg->nlmsg_flags |= NLM_F_ACK;
-
-    struct iovec iov = {nlmsg, nlmsg->nlmsg_len};
+    struct iovec iov[kMaxBatchSize];
+    for (size_t i = 0; i < count; i++) {
+        auto nlmsg = msgs[i];
+        nlmsg->nlmsg_pid = 0;  // kernel
+        nlmsg->nlmsg_seq = mSeq++;
+        nlmsg->nlmsg_flags |= NLM_F_ACK;
+        iov[i] = {nlmsg, nlmsg->nlmsg_len};
+    }
 
     struct sockaddr_nl sa = {};
     sa.nl_family = AF_NETLINK;
@@ -53,13 +56,14 @@ bool NetlinkSocket::send(struct nlmsghdr* nlmsg) {
     struct msghdr msg = {};
     msg.msg_name = &sa;
     msg.msg_namelen = sizeof(sa);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
 
     if (sendmsg(mFd.get(), &msg, 0) < 0) {
         PLOG(ERROR) << "Can't send Netlink message";
         return false;
     }
+    mPendingAcks += count;
     return true;
 }
 
@@ -67,46 +71,57 @@ bool NetlinkSocket::receiveAck() {
     if (mFailed) return false;
 
     char buf[8192];
-
-    struct sockaddr_nl sa;
-    struct iovec iov = {buf, sizeof(buf)};
-
-    struct msghdr msg = {};
-    msg.msg_name = &sa;
-    msg.msg_namelen = sizeof(sa);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-
-    const ssize_t status = recvmsg(mFd.get(), &msg, 0);
-    if (status < 0) {
-        PLOG(ERROR) << "Failed to receive Netlink message";
-        return false;
-    }
-    size_t remainingLen = status;
-
-    if (msg.msg_flags & MSG_TRUNC) {
-        LOG(ERROR) << "Failed to receive Netlink message: truncated";
-        return false;
-    }
-
-    for (auto nlmsg = reinterpret_cast<struct nlmsghdr*>(buf); NLMSG_OK(nlmsg, remainingLen);
-         nlmsg = NLMSG_NEXT(nlmsg, remainingLen)) {
-        // We're looking for error/ack message only, ignoring others.
-        if (nlmsg->nlmsg_type != NLMSG_ERROR) {
-            LOG(WARNING) << "Received unexpected Netlink message (ignored): " << nlmsg->nlmsg_type;
-            continue;
+    bool success = true;
+
+    while (mPendingAcks > 0) {
+        struct sockaddr_nl sa;
+        struct iovec iov = {buf, sizeof(buf)};
+
+        struct msghdr msg = {};
+        msg.msg_name = &sa;
+        msg.msg_namelen = sizeof(sa);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        const ssize_t status = recvmsg(mFd.get(), &msg, 0);
+        if (status < 0) {
+            PLOG(ERROR) << "Failed to receive Netlink message";
+            mPendingAcks = 0;
+            return false;
         }
+        size_t remainingLen = status;
 
-        // Found error/ack message, return status.
-        auto nlerr = reinterpret_cast<struct nlmsgerr*>(NLMSG_DATA(nlmsg));
-        if (nlerr->error != 0) {
-            LOG(ERROR) << "Received Netlink error message: " << nlerr->error;
+        if (msg.msg_flags & MSG_TRUNC) {
+            LOG(ERROR) << "Failed to receive Netlink message: truncated";
+            mPendingAcks = 0;
             return false;
         }
-        return true;
+
+        for (auto nlmsg = reinterpret_cast<struct nlmsghdr*>(buf); NLMSG_OK(nlmsg, remainingLen);
+             nlmsg = NLMSG_NEXT(nlmsg, remainingLen)) {
+            // We're looking for error/ack message only, ignoring others.
+            if (nlmsg->nlmsg_type != NLMSG_ERROR) {
+                LOG(WARNING) << "Received unexpected Netlink message (ignored): "
+                             << nlmsg->nlmsg_type;
+                continue;
+            }
+
+            // Sequence numbers wrap around, compare their distance from the next one instead.
+            if (mSeq - 1 - nlmsg->nlmsg_seq >= mPendingAcks) {
+                LOG(WARNING) << "Received stale Netlink ACK (ignored): " << nlmsg->nlmsg_seq;
+                continue;
+            }
+            mPendingAcks--;
+
+            // Found error/ack message, keep collecting the remaining ones.
+            auto nlerr = reinterpret_cast<struct nlmsgerr*>(NLMSG_DATA(nlmsg));
+            if (nlerr->error != 0) {
+                LOG(ERROR) << "Received Netlink error message: " << nlerr->error;
+                success = false;
+            }
+        }
     }
-    // Couldn't find any error/ack messages.
-    return false;
+    return success;
 }
 
 }  // namespace android::netdevice
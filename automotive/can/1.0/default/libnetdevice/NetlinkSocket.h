@@ -23,6 +23,8 @@
 
 #include <linux/netlink.h>
 
+#include <array>
+
 namespace android::netdevice {
 
 /**
@@ -42,23 +44,45 @@ struct NetlinkSocket {
      */
     template <class T, unsigned int BUFSIZE>
     bool send(NetlinkRequest<T, BUFSIZE>& req) {
-        if (!req.isGood()) return false;
-        return send(req.header());
+        return sendBatch(req);
+    }
+
+    /**
+     * Send multiple Netlink messages to Kernel with a single system call.
+     *
+     * Kernel processes the messages in order, each one is acknowledged separately.
+     *
+     * \param reqs Messages to send, nlmsg_seq will be set to consecutive sequence numbers
+     * \return true, if succeeded
+     */
+    template <class... Requests>
+    bool sendBatch(Requests&... reqs) {
+        static_assert(sizeof...(reqs) <= kMaxBatchSize, "Netlink batch too big");
+        if (!(reqs.isGood() && ...)) return false;
+        std::array<struct nlmsghdr*, sizeof...(reqs)> msgs = {reqs.header()...};
+        return send(msgs.data(), msgs.size());
     }
 
     /**
-     * Receive Netlink ACK message from Kernel.
+     * Receive Netlink ACK messages from Kernel.
      *
-     * \return true if received ACK message, false in case of error
+     * Waits for the ACKs of all messages sent since the last call, so requests can be pipelined
+     * instead of waiting for each of them.
+     *
+     * \return true if all messages were ACKed, false in case of error
      */
     bool receiveAck();
 
   private:
+    /** Batches are small and known at compile time, so iovecs live on the stack. */
+    static constexpr size_t kMaxBatchSize = 16;
+
     uint32_t mSeq = 0;
+    uint32_t mPendingAcks = 0;
     base::unique_fd mFd;
     bool mFailed = false;
 
-    bool send(struct nlmsghdr* msg);
+    bool send(struct nlmsghdr* const* msgs, size_t count);
 
     DISALLOW_COPY_AND_ASSIGN(NetlinkSocket);
 };
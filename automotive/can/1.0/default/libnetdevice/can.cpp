@@ -27,6 +27,7 @@
 #include <linux/can/error.h>
 #include <linux/can/netlink.h>
 #include <linux/can/raw.h>
+#include <net/if.h>
 
 namespace android::netdevice::can {
 
@@ -69,13 +70,19 @@ bool setBitrate(std::string ifname, uint32_t bitrate) {
     struct can_bittiming bt = {};
     bt.bitrate = bitrate;
 
-    NetlinkRequest<struct ifinfomsg> req(RTM_NEWLINK, NLM_F_REQUEST);
-
     const auto ifidx = nametoindex(ifname);
     if (ifidx == 0) {
         LOG(ERROR) << "Can't find interface " << ifname;
         return false;
     }
+
+    // The kernel refuses to change the bit timing of a running interface.
+    NetlinkRequest<struct ifinfomsg> downReq(RTM_NEWLINK, NLM_F_REQUEST);
+    downReq.data().ifi_index = ifidx;
+    downReq.data().ifi_change = IFF_UP;
+    downReq.data().ifi_flags = 0;
+
+    NetlinkRequest<struct ifinfomsg> req(RTM_NEWLINK, NLM_F_REQUEST);
     req.data().ifi_index = ifidx;
 
     {
@@ -90,7 +97,7 @@ bool setBitrate(std::string ifname, uint32_t bitrate) {
     }
 
     NetlinkSocket sock(NETLINK_ROUTE);
-    return sock.send(req) && sock.receiveAck();
+    return sock.sendBatch(downReq, req) && sock.receiveAck();
 }
 
 }  // namespace android::netdevice::can
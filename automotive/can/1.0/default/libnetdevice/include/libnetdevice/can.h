@@ -33,7 +33,10 @@ base::unique_fd socket(const std::string& ifname);
 /**
  * Sets CAN interface bitrate.
  *
+ * The interface is brought down first, within the same Netlink batch.
+ *
  * \param ifname Interface for which the bitrate is to be set
+ * \param bitrate Bitrate to set
  * \return true on success, false on failure
  */
 bool setBitrate(std::string ifname, uint32_t bitrate);
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
 
@@ -53,6 +54,15 @@ bool up(std::string ifname);
  */
 bool down(std::string ifname);
 
+/**
+ * Sets the transmit queue length of a network interface.
+ *
+ * \param ifname Interface to configure
+ * \param length Queue length, in packets
+ * \return true in case of success, false otherwise
+ */
+bool setTxQueueLength(std::string ifname, uint32_t length);
+
 /**
  * Adds virtual link.
  *
@@ -74,6 +74,12 @@ bool down(std::string ifname) {
     return sendIfreq(SIOCSIFFLAGS, ifr);
 }
 
+bool setTxQueueLength(std::string ifname, uint32_t length) {
+    struct ifreq ifr = ifreqFromName(ifname);
+    ifr.ifr_qlen = length;
+    return sendIfreq(SIOCSIFTXQLEN, ifr);
+}
+
 bool add(std::string dev, std::string type) {
     NetlinkRequest<struct ifinfomsg> req(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
     req.addattr(IFLA_IFNAME, dev);
@@ -16,16 +16,21 @@
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
 #include <hidl-utils/hidl-utils.h>
 #include <libcanhaltools/libcanhaltools.h>
 
+#include <cutils/native_handle.h>
+#include <unistd.h>
+
 #include <iostream>
 #include <string>
 
 namespace android::hardware::automotive::can {
 
+using ICanBus = V1_0::ICanBus;
 using ICanController = V1_0::ICanController;
 
 static void usage() {
@@ -41,6 +46,22 @@ static void usage() {
     std::cerr << "canhalctrl down <bus name>" << std::endl;
     std::cerr << "where:" << std::endl;
     std::cerr << " bus name - name under which ICanBus will be published" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "canhalctrl stats <bus name>" << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " bus name - name under which ICanBus is published" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "canhalctrl capture <log path>|stop" << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " log path - file the HAL service writes frames received on all buses to"
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "canhalctrl replay <log path> [speed]|stop" << std::endl;
+    std::cerr << "where:" << std::endl;
+    std::cerr << " log path - capture log to replay onto the virtual buses of the same names"
+              << std::endl;
+    std::cerr << " speed - replay speed relative to the captured timing, such as 0.5, 1, 10"
+              << std::endl;
 }
 
 static int up(const std::string& busName, ICanController::InterfaceType type,
@@ -108,6 +129,46 @@ static int down(const std::string& busName) {
     return -1;
 }
 
+/* Runs debug() of a HAL service, with its output going to stdout. */
+static bool debug(const sp<hidl::base::V1_0::IBase>& service,
+                  const hidl_vec<hidl_string>& options) {
+    auto handle = native_handle_create(1, 0);
+    handle->data[0] = STDOUT_FILENO;
+    const auto ret = service->debug(hidl_handle(handle), options);
+    native_handle_delete(handle);
+    return ret.isOk();
+}
+
+static int stats(const std::string& busName) {
+    auto bus = ICanBus::getService(busName);
+    if (bus == nullptr) {
+        std::cerr << "Bus " << busName << " is not available" << std::endl;
+        return -1;
+    }
+
+    // The bus prints its transmit queue depth and counters.
+    if (!debug(bus, {})) {
+        std::cerr << "Failed to get stats of bus " << busName << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+/* Capture and replay are handled by the first controller service. */
+static int controllerDebug(const hidl_vec<hidl_string>& options) {
+    for (auto&& service : libcanhaltools::getControlServices()) {
+        auto ctrl = ICanController::getService(service);
+        if (ctrl == nullptr) continue;
+
+        if (debug(ctrl, options)) return 0;
+        std::cerr << "Failed to run command on ICanController/" << service << std::endl;
+        return -1;
+    }
+
+    std::cerr << "No controller available" << std::endl;
+    return -1;
+}
+
 static std::optional<ICanController::InterfaceType> parseInterfaceType(const std::string& str) {
     if (str == "virtual") return ICanController::InterfaceType::VIRTUAL;
     if (str == "socketcan") return ICanController::InterfaceType::SOCKETCAN;
@@ -163,6 +224,35 @@ static int main(int argc, char* argv[]) {
         }
 
         return down(argv[0]);
+    } else if (cmd == "stats") {
+        if (argc != 1) {
+            std::cerr << "Invalid number of arguments to stats command: " << argc << std::endl;
+            usage();
+            return -1;
+        }
+
+        return stats(argv[0]);
+    } else if (cmd == "capture") {
+        if (argc != 1) {
+            std::cerr << "Invalid number of arguments to capture command: " << argc << std::endl;
+            usage();
+            return -1;
+        }
+
+        const std::string arg(argv[0]);
+        if (arg == "stop") return controllerDebug({"--capture-stop"});
+        return controllerDebug({"--capture", arg});
+    } else if (cmd == "replay") {
+        if (argc < 1 || argc > 2) {
+            std::cerr << "Invalid number of arguments to replay command: " << argc << std::endl;
+            usage();
+            return -1;
+        }
+
+        const std::string arg(argv[0]);
+        if (arg == "stop" && argc == 1) return controllerDebug({"--replay-stop"});
+        if (argc == 2) return controllerDebug({"--replay", arg, argv[1]});
+        return controllerDebug({"--replay", arg});
     } else {
         std::cerr << "Invalid command: " << cmd << std::endl;
         usage();
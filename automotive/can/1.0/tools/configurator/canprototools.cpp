@@ -78,9 +78,11 @@ std::optional<CanBusConfig> parseConfigFile(const std::string& filepath) {
     return config;
 }
 
-std::optional<ICanController::BusConfig> fromPbBus(const Bus& pb_bus) {
-    ICanController::BusConfig bus_cfg = {};
+std::optional<V1_1::ICanController::BusConfig> fromPbBus(const Bus& pb_bus) {
+    V1_1::ICanController::BusConfig bus_cfg_1_1 = {};
+    auto& bus_cfg = bus_cfg_1_1.v1_0;
     bus_cfg.name = pb_bus.name();
+    bus_cfg_1_1.slcan.lowLatency = true;
 
     switch (pb_bus.iface_type_case()) {
         case Bus::kNative: {
@@ -110,6 +112,9 @@ std::optional<ICanController::BusConfig> fromPbBus(const Bus& pb_bus) {
             if (!ttyname.empty()) slcan.ttyname(ttyname);
             if (!serialno.empty()) slcan.serialno({serialno.begin(), serialno.end()});
             bus_cfg.interfaceId.slcan(slcan);
+            bus_cfg_1_1.slcan.baudrate = pb_bus.slcan().baudrate();
+            bus_cfg_1_1.slcan.lowLatency = !pb_bus.slcan().disable_low_latency();
+            bus_cfg_1_1.slcan.txQueueLength = pb_bus.slcan().tx_queue_length();
             break;
         }
         case Bus::kVirtual: {
@@ -135,7 +140,7 @@ std::optional<ICanController::BusConfig> fromPbBus(const Bus& pb_bus) {
             LOG(ERROR) << "Invalid config: bad interface type for " << bus_cfg.name;
             return std::nullopt;
     }
-    return bus_cfg;
+    return bus_cfg_1_1;
 }
 
 std::optional<ICanController::InterfaceType> getHalIftype(const Bus& pb_bus) {
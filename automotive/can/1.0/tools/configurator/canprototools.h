@@ -18,6 +18,7 @@
 #include "canbus_config.pb.h"
 
 #include <android/hardware/automotive/can/1.0/ICanController.h>
+#include <android/hardware/automotive/can/1.1/ICanController.h>
 
 namespace android::hardware::automotive::can::config {
 
@@ -36,7 +37,7 @@ std::optional<CanBusConfig> parseConfigFile(const std::string& filepath);
  * \param pb_bus is the protobuf object representing a the configuration of one CAN bus.
  * \return a converted HAL bus config object.
  */
-std::optional<V1_0::ICanController::BusConfig> fromPbBus(const Bus& pb_bus);
+std::optional<V1_1::ICanController::BusConfig> fromPbBus(const Bus& pb_bus);
 
 /**
  * Get the CAN HAL interface type specified by a given protobuf config object.
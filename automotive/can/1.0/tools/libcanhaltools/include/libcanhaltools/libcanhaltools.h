@@ -18,6 +18,7 @@
 
 #include <android/hardware/automotive/can/1.0/ICanBus.h>
 #include <android/hardware/automotive/can/1.0/ICanController.h>
+#include <android/hardware/automotive/can/1.1/ICanController.h>
 
 namespace android::hardware::automotive::can::libcanhaltools {
 
@@ -45,4 +46,14 @@ bool isSupported(sp<V1_0::ICanController> ctrl, V1_0::ICanController::InterfaceT
  */
 V1_0::ICanController::Result configureIface(V1_0::ICanController::BusConfig can_config);
 
+/**
+ * Configures a CAN interface through the CAN HAL and brings it up, with @1.1 settings.
+ *
+ * Controllers that only implement @1.0 bring the interface up without the @1.1 settings.
+ *
+ * \param can_config this holds the parameters for configuring a CAN bus.
+ * \return status passed back from the CAN HAL, should be OK on success.
+ */
+V1_0::ICanController::Result configureIface(V1_1::ICanController::BusConfig can_config);
+
 }  // namespace android::hardware::automotive::can::libcanhaltools
@@ -82,4 +82,34 @@ ICanController::Result configureIface(ICanController::BusConfig can_config) {
     return ICanController::Result::NOT_SUPPORTED;
 }
 
+ICanController::Result configureIface(V1_1::ICanController::BusConfig can_config) {
+    auto iftype = getIftype(can_config.v1_0);
+    auto can_controller_list = getControlServices();
+    for (auto const& service : can_controller_list) {
+        auto ctrl = ICanController::getService(service);
+        if (ctrl == nullptr) {
+            LOG(ERROR) << "Couldn't open ICanController/" << service;
+            continue;
+        }
+
+        if (!libcanhaltools::isSupported(ctrl, iftype)) continue;
+
+        auto up_result = ICanController::Result::UNKNOWN_ERROR;
+        sp<V1_1::ICanController> ctrl_1_1 = V1_1::ICanController::castFrom(ctrl);
+        if (ctrl_1_1 != nullptr) {
+            up_result = ctrl_1_1->upInterface_1_1(can_config);
+        } else {
+            LOG(WARNING) << "ICanController/" << service << " doesn't support @1.1 settings, "
+                         << "bringing " << can_config.v1_0.name << " up without them";
+            up_result = ctrl->upInterface(can_config.v1_0);
+        }
+        if (up_result != ICanController::Result::OK) {
+            LOG(ERROR) << "Failed to bring " << can_config.v1_0.name
+                       << " up: " << toString(up_result) << std::endl;
+        }
+        return up_result;
+    }
+    return ICanController::Result::NOT_SUPPORTED;
+}
+
 }  // namespace android::hardware::automotive::can::libcanhaltools
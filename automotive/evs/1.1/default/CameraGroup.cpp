@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.1-service"
+
+#include "CameraGroup.h"
+
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// How many frames of each member camera may be waiting to be paired up, on top of those the
+// clients hold
+const unsigned kPairingSlack = 2;
+
+
+// Describes a frame without duplicating its buffer handle, which the group keeps owning
+static BufferDesc_1_1 describeFrame(const BufferDesc_1_1& frame) {
+    BufferDesc_1_1 desc = {};
+    desc.buffer.description = frame.buffer.description;
+    desc.buffer.nativeHandle = frame.buffer.nativeHandle.getNativeHandle();
+    desc.pixelSize = frame.pixelSize;
+    desc.bufferId = frame.bufferId;
+    desc.deviceId = frame.deviceId;
+    desc.timestamp = frame.timestamp;
+    desc.metadata = frame.metadata;
+    return desc;
+}
+
+
+Return<void> CameraGroup::MemberStream::deliverFrame(const BufferDesc_1_0& /* buffer */) {
+    ALOGE("A member camera delivered a v1.0 frame, which a group can't use");
+    return Void();
+}
+
+
+Return<void> CameraGroup::MemberStream::deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers) {
+    for (auto&& buffer : buffers) {
+        mGroup->queueFrame(mIndex, buffer);
+    }
+    return Void();
+}
+
+
+Return<void> CameraGroup::MemberStream::notify(const EvsEventDesc& event) {
+    // The group tells its own clients when their streams stop
+    ALOGD("Member camera %s sent event %d", event.deviceId.c_str(),
+          static_cast<int32_t>(event.aType));
+    return Void();
+}
+
+
+CameraGroup::CameraGroup(
+        const std::string& groupId,
+        const std::vector<std::pair<std::string, std::shared_ptr<FrameSource>>>& members,
+        nsecs_t syncTolerance) :
+        mGroupId(groupId),
+        mSyncTolerance(syncTolerance) {
+    ALOGD("CameraGroup instantiated with %zu cameras", members.size());
+
+    mMembers.resize(members.size());
+    for (unsigned i = 0; i < members.size(); i++) {
+        auto& member = mMembers[i];
+        member.id = members[i].first;
+        member.source = members[i].second;
+        member.clientId = member.source->addClient();
+        member.stream = new MemberStream(this, i);
+    }
+}
+
+
+CameraGroup::~CameraGroup() {
+    ALOGD("CameraGroup being destroyed");
+
+    // Every client stops its stream before letting go of us, so this is just a safety net
+    std::unique_lock<std::mutex> lock(mAccessLock);
+    if (mStreamState == RUNNING) {
+        ALOGE("Error - destroying the camera group while it is streaming");
+        mStreamState = STOPPING;
+        lock.unlock();
+        mFrameQueued.notify_all();
+        for (auto& member : mMembers) {
+            member.source->stopStream(member.clientId);
+        }
+        mDeliveryThread.join();
+        lock.lock();
+    }
+    dropPendingFrames_Locked();
+    lock.unlock();
+
+    // The member cameras reclaim the frames our clients still hold
+    for (auto& member : mMembers) {
+        member.source->removeClient(member.clientId);
+        member.delivered.clear();
+    }
+}
+
+
+CameraGroup::ClientId CameraGroup::addClient() {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    const ClientId id = mNextClientId++;
+    mClients[id] = {};
+    return id;
+}
+
+
+void CameraGroup::removeClient(ClientId id) {
+    stopStream(id);
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    if (it == mClients.end()) {
+        return;
+    }
+
+    // Reclaim the frames the client never returned
+    auto& client = it->second;
+    if (!client.framesHeld.empty()) {
+        ALOGW("Reclaiming %zu frames from a closed camera group client", client.framesHeld.size());
+    }
+    client.framesAllowed = 0;
+    const auto framesHeld = client.framesHeld;
+    for (auto& [index, bufferId] : framesHeld) {
+        releaseFrame_Locked(client, index, bufferId);
+    }
+    mClients.erase(it);
+
+    updateMemberFrames_Locked();
+}
+
+
+bool CameraGroup::setFramesAllowed(ClientId id, unsigned bufferCount) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    if (it == mClients.end()) {
+        ALOGE("Ignoring buffer request from an unknown client");
+        return false;
+    }
+
+    const unsigned previousCount = it->second.framesAllowed;
+    it->second.framesAllowed = bufferCount;
+    if (!updateMemberFrames_Locked()) {
+        // Some member cameras might have got their new count already
+        it->second.framesAllowed = previousCount;
+        updateMemberFrames_Locked();
+        return false;
+    }
+
+    return true;
+}
+
+
+unsigned CameraGroup::getFramesAllowed(ClientId id) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    return it == mClients.end() ? 0 : it->second.framesAllowed;
+}
+
+
+bool CameraGroup::startStream(ClientId id, const sp<IEvsCameraStream_1_1>& stream) {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
+
+    auto it = mClients.find(id);
+    if (it == mClients.end() || it->second.stream != nullptr) {
+        ALOGE("Can't start a stream for this client");
+        return false;
+    }
+    it->second.stream = stream;
+
+    // Start streaming from the member cameras, unless another client got it running already
+    if (mStreamState == STOPPED) {
+        mStreamState = RUNNING;
+        mDeliveryThread = std::thread([this](){ deliverFrames(); });
+
+        // The member cameras deliver their first frames right away, which takes mAccessLock
+        lock.unlock();
+        bool started = true;
+        for (auto& member : mMembers) {
+            if (!member.source->startStream(member.clientId, member.stream)) {
+                ALOGE("Failed to start streaming from %s", member.id.c_str());
+                started = false;
+                break;
+            }
+        }
+        lock.lock();
+
+        if (!started) {
+            // Undo everything, the way stopStream() does
+            it->second.stream = nullptr;
+            mStreamState = STOPPING;
+            lock.unlock();
+            mFrameQueued.notify_all();
+            for (auto& member : mMembers) {
+                member.source->stopStream(member.clientId);
+            }
+            mDeliveryThread.join();
+            lock.lock();
+            dropPendingFrames_Locked();
+            mStreamState = STOPPED;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void CameraGroup::stopStream(ClientId id) {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
+
+    sp<IEvsCameraStream_1_1> stream;
+    auto it = mClients.find(id);
+    if (it != mClients.end()) {
+        stream = it->second.stream;
+        it->second.stream = nullptr;
+    }
+
+    // A frame group might be on its way to this client, and the end of stream event must come
+    // last
+    mDeliveryDone.wait(lock, [this](){ return !mDelivering; });
+
+    if (mStreamState == RUNNING && !isStreaming_Locked()) {
+        // Tell the deliverFrames loop we want it to stop
+        mStreamState = STOPPING;
+
+        // Stop the member cameras first, so no more frames get queued.  All of this blocks, so
+        // it must be done outside the mutex.
+        ALOGD("Waiting for the member streams and the delivery thread to end...");
+        lock.unlock();
+        mFrameQueued.notify_all();
+        for (auto& member : mMembers) {
+            member.source->stopStream(member.clientId);
+        }
+        mDeliveryThread.join();
+        lock.lock();
+
+        // The frames we couldn't pair up go back to their cameras
+        dropPendingFrames_Locked();
+
+        mStreamState = STOPPED;
+        ALOGD("Stream marked STOPPED.");
+    }
+    lock.unlock();
+
+    // Send an event to signal the actual end of stream
+    if (stream != nullptr) {
+        EvsEventDesc event;
+        event.aType = EvsEventType::STREAM_STOPPED;
+        event.deviceId = mGroupId;
+        auto result = stream->notify(event);
+        if (!result.isOk()) {
+            ALOGE("Error delivering end of stream marker");
+        }
+    }
+}
+
+
+void CameraGroup::returnFrame(ClientId id, const std::string& deviceId, uint32_t bufferId,
+                              buffer_handle_t memHandle) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    auto it = mClients.find(id);
+    unsigned index = 0;
+    while (index < mMembers.size() && mMembers[index].id != deviceId) {
+        index++;
+    }
+
+    if (memHandle == nullptr) {
+        ALOGE("ignoring doneWithFrame called with null handle");
+    } else if (it == mClients.end()) {
+        ALOGE("ignoring doneWithFrame called by an unknown client");
+    } else if (index == mMembers.size()) {
+        ALOGE("ignoring doneWithFrame called with a frame of %s, which is not in group %s",
+              deviceId.c_str(), mGroupId.c_str());
+    } else if (it->second.framesHeld.count({index, bufferId}) == 0) {
+        ALOGE("ignoring doneWithFrame called on frame %d of %s which is already free",
+              bufferId, deviceId.c_str());
+    } else {
+        releaseFrame_Locked(it->second, index, bufferId);
+    }
+}
+
+
+bool CameraGroup::updateMemberFrames_Locked() {
+    unsigned bufferCount = 0;
+    for (auto& [id, client] : mClients) {
+        bufferCount += client.framesAllowed;
+    }
+
+    // Each member camera has to fill the frame groups of all the clients, and then some more
+    // frames can be waiting to be paired up
+    if (bufferCount > 0) {
+        bufferCount += kPairingSlack;
+    }
+
+    for (auto& member : mMembers) {
+        if (!member.source->setFramesAllowed(member.clientId, bufferCount)) {
+            ALOGE("Failed to get %u buffers from %s", bufferCount, member.id.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool CameraGroup::isStreaming_Locked() const {
+    for (auto& [id, client] : mClients) {
+        if (client.stream != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool CameraGroup::hasPendingFrames_Locked() const {
+    for (auto& member : mMembers) {
+        if (member.pending.empty()) {
+            return false;
+        }
+    }
+    return !mMembers.empty();
+}
+
+
+void CameraGroup::releaseFrame_Locked(Client& client, unsigned index, uint32_t bufferId) {
+    client.framesHeld.erase({index, bufferId});
+
+    auto& member = mMembers[index];
+    auto it = member.delivered.find(bufferId);
+    if (it == member.delivered.end() || --it->second.refCount > 0) {
+        // Other clients are still using this frame
+        return;
+    }
+
+    returnToMember_Locked(member, it->second.desc);
+    member.delivered.erase(it);
+}
+
+
+void CameraGroup::returnToMember_Locked(Member& member, const BufferDesc_1_1& buffer) {
+    member.source->returnFrame(member.clientId, member.id, buffer.bufferId,
+                               buffer.buffer.nativeHandle);
+}
+
+
+void CameraGroup::dropPendingFrames_Locked() {
+    for (auto& member : mMembers) {
+        for (auto&& buffer : member.pending) {
+            returnToMember_Locked(member, buffer);
+        }
+        member.pending.clear();
+    }
+}
+
+
+// Runs on the delivery threads of the member cameras
+void CameraGroup::queueFrame(unsigned index, const BufferDesc_1_1& buffer) {
+    std::unique_lock<std::mutex> lock(mAccessLock);
+
+    auto& member = mMembers[index];
+    if (mStreamState != RUNNING) {
+        // The group is stopping, nobody is going to take this frame
+        returnToMember_Locked(member, buffer);
+        return;
+    }
+
+    member.pending.push_back(buffer);
+    lock.unlock();
+
+    mFrameQueued.notify_one();
+}
+
+
+// This is the frame group delivery thread, which runs in parallel with the threads of the member
+// cameras and the main serving thread.
+void CameraGroup::deliverFrames() {
+    ALOGD("Frame group delivery loop started");
+
+    std::unique_lock<std::mutex> lock(mAccessLock);
+    while (true) {
+        // Wait until every member camera has a frame to pair up
+        mFrameQueued.wait(lock, [this](){
+            return mStreamState != RUNNING || hasPendingFrames_Locked();
+        });
+        if (mStreamState != RUNNING) {
+            // Break out of our main thread loop
+            break;
+        }
+
+        // Find the oldest and the newest of the first frames queued for each member
+        unsigned oldest = 0;
+        unsigned newest = 0;
+        for (unsigned i = 1; i < mMembers.size(); i++) {
+            const int64_t timestamp = mMembers[i].pending.front().timestamp;
+            if (timestamp < mMembers[oldest].pending.front().timestamp) {
+                oldest = i;
+            }
+            if (timestamp > mMembers[newest].pending.front().timestamp) {
+                newest = i;
+            }
+        }
+
+        // No frame still to come from the other members can be closer to the oldest frame than
+        // the ones already queued, so it can't be part of any group anymore
+        if (mMembers[newest].pending.front().timestamp -
+                mMembers[oldest].pending.front().timestamp > mSyncTolerance) {
+            auto& member = mMembers[oldest];
+            returnToMember_Locked(member, member.pending.front());
+            member.pending.pop_front();
+            continue;
+        }
+
+        // Clients holding all the frame groups they are allowed to just skip this one
+        std::vector<std::pair<ClientId, sp<IEvsCameraStream_1_1>>> receivers;
+        for (auto& [id, client] : mClients) {
+            if (client.stream != nullptr &&
+                client.framesHeld.size() < client.framesAllowed * mMembers.size()) {
+                receivers.emplace_back(id, client.stream);
+            }
+        }
+
+        if (receivers.empty()) {
+            // Can't do anything right now -- skip this frame group
+            ALOGW("Skipped a frame group because too many are in flight\n");
+            for (auto& member : mMembers) {
+                returnToMember_Locked(member, member.pending.front());
+                member.pending.pop_front();
+            }
+            continue;
+        }
+
+        // The frames are busy until every receiver returns them
+        hidl_vec<BufferDesc_1_1> frames;
+        frames.resize(mMembers.size());
+        for (unsigned i = 0; i < mMembers.size(); i++) {
+            auto& member = mMembers[i];
+            const uint32_t bufferId = member.pending.front().bufferId;
+            auto& frame = member.delivered[bufferId];
+            frame.desc = std::move(member.pending.front());
+            frame.refCount = receivers.size();
+            member.pending.pop_front();
+
+            frames[i] = describeFrame(frame.desc);
+            for (auto& [id, stream] : receivers) {
+                mClients[id].framesHeld.emplace(i, bufferId);
+            }
+        }
+        mDelivering = true;
+
+        // Issue the (asynchronous) callbacks to the clients -- can't be holding the lock
+        lock.unlock();
+        std::vector<ClientId> undelivered;
+        for (auto& [id, stream] : receivers) {
+            auto result = stream->deliverFrame_1_1(frames);
+            if (!result.isOk()) {
+                // This can happen if the client dies and is likely unrecoverable.
+                // To avoid consuming resources generating failing calls, we stop sending
+                // frames to it.
+                ALOGE("Frame group delivery call failed in the transport layer.");
+                undelivered.push_back(id);
+            }
+        }
+        lock.lock();
+
+        // Since we didn't actually deliver them, mark the frames as available
+        for (auto id : undelivered) {
+            auto it = mClients.find(id);
+            if (it == mClients.end()) {
+                continue;
+            }
+            it->second.stream = nullptr;
+            for (unsigned i = 0; i < mMembers.size(); i++) {
+                releaseFrame_Locked(it->second, i, frames[i].bufferId);
+            }
+        }
+        mDelivering = false;
+        mDeliveryDone.notify_all();
+    }
+
+    ALOGD("Frame group delivery loop ended");
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CAMERAGROUP_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CAMERAGROUP_H
+
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "FrameSource.h"
+
+using BufferDesc_1_0 = ::android::hardware::automotive::evs::V1_0::BufferDesc;
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// A logical camera, made of several physical cameras whose frames are delivered together.
+//
+// The group streams from each of its member cameras as one more client of theirs.  Their frames
+// are queued as they arrive, and a delivery thread of the group pairs them up: it waits for a
+// frame from every member, drops the oldest frames until all those left were captured within the
+// sync tolerance of each other, then delivers them to the group's clients in a single
+// deliverFrame_1_1() call, ordered like the members.
+//
+// A frame goes back to its camera once every client of the group returned it.  Like for a single
+// camera, a client holding all the frame groups it is allowed to just misses the ones delivered
+// meanwhile.
+class CameraGroup : public FrameSource {
+public:
+    // Default sync tolerance.  This is the frame time of the cameras of this implementation,
+    // which run at 12 fps, so the frames of free running cameras always pair up.
+    static constexpr nsecs_t kDefaultSyncTolerance = 1000 * 1000 * 1000 / 12;
+
+    CameraGroup(const std::string& groupId,
+                const std::vector<std::pair<std::string, std::shared_ptr<FrameSource>>>& members,
+                nsecs_t syncTolerance);
+    ~CameraGroup() override;
+    CameraGroup(const CameraGroup&) = delete;
+    CameraGroup& operator=(const CameraGroup&) = delete;
+
+    // Methods from FrameSource follow.
+    ClientId addClient() override;
+    void removeClient(ClientId id) override;
+    bool setFramesAllowed(ClientId id, unsigned bufferCount) override;
+    unsigned getFramesAllowed(ClientId id) override;
+    bool startStream(ClientId id, const sp<IEvsCameraStream_1_1>& stream) override;
+    void stopStream(ClientId id) override;
+    void returnFrame(ClientId id, const std::string& deviceId, uint32_t bufferId,
+                     buffer_handle_t memHandle) override;
+
+private:
+    // Receives the frames of a member camera on behalf of the group
+    class MemberStream : public IEvsCameraStream_1_1 {
+    public:
+        MemberStream(CameraGroup* group, unsigned index) : mGroup(group), mIndex(index) {};
+
+        // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCameraStream follow.
+        Return<void> deliverFrame(const BufferDesc_1_0& buffer) override;
+
+        // Methods from ::android::hardware::automotive::evs::V1_1::IEvsCameraStream follow.
+        Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers) override;
+        Return<void> notify(const EvsEventDesc& event) override;
+
+    private:
+        // The group stops the member streams before it goes away
+        CameraGroup* mGroup;
+        const unsigned mIndex;  // Index of the member in mMembers
+    };
+
+    struct DeliveredFrame {
+        BufferDesc_1_1 desc;        // Owns the buffer handle the clients were given
+        unsigned refCount = 0;      // How many clients hold this frame
+    };
+
+    struct Member {
+        std::string id;                     // Camera id, as in the frame descriptors
+        std::shared_ptr<FrameSource> source;
+        ClientId clientId;                  // Our registration with the source
+        sp<MemberStream> stream;
+        std::deque<BufferDesc_1_1> pending; // Frames waiting to be paired up, oldest first
+        std::map<uint32_t, DeliveredFrame> delivered;  // Frames the clients hold, by bufferId
+    };
+
+    struct Client {
+        sp<IEvsCameraStream_1_1> stream;  // Null while the client doesn't stream
+        unsigned framesAllowed = 0;       // How many frame groups the client may hold
+        std::set<std::pair<unsigned, uint32_t>> framesHeld;  // Member index and buffer id
+    };
+
+    // These functions are expected to be called while mAccessLock is held
+    //
+    bool updateMemberFrames_Locked();
+    bool isStreaming_Locked() const;
+    bool hasPendingFrames_Locked() const;
+    void releaseFrame_Locked(Client& client, unsigned index, uint32_t bufferId);
+    void returnToMember_Locked(Member& member, const BufferDesc_1_1& buffer);
+    void dropPendingFrames_Locked();
+
+    void queueFrame(unsigned index, const BufferDesc_1_1& buffer);
+    void deliverFrames();
+
+    const std::string mGroupId;
+    const nsecs_t mSyncTolerance;   // Largest timestamp difference within a frame group
+
+    std::vector<Member> mMembers;
+
+    std::map<ClientId, Client> mClients;
+    ClientId mNextClientId = 0;
+
+    enum StreamStateValues {
+        STOPPED,
+        RUNNING,
+        STOPPING,
+    };
+    StreamStateValues mStreamState = STOPPED;
+
+    std::thread mDeliveryThread;    // Pairs up the member frames and delivers them
+    std::condition_variable mFrameQueued;
+
+    // Whether mDeliveryThread is delivering a frame group, without holding mAccessLock
+    bool mDelivering = false;
+    std::condition_variable mDeliveryDone;
+
+    // Serializes starting and stopping the streams
+    std::mutex mStreamLock;
+
+    // Synchronization necessary to deconflict the member camera threads, mDeliveryThread and the
+    // main service thread
+    std::mutex mAccessLock;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CAMERAGROUP_H
@@ -16,8 +16,11 @@
 
 #include <sstream>
 #include <fstream>
+#include <iterator>
 #include <thread>
 
+#include <stdio.h>
+
 #include <hardware/gralloc.h>
 #include <utils/SystemClock.h>
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
@@ -26,6 +29,198 @@
 
 using ::android::hardware::camera::device::V3_2::StreamRotation;
 
+namespace {
+
+/*
+ * Binary cache of the configuration
+ *
+ * The cache starts with kBinaryMagic, kBinaryVersion and a hash of the XML
+ * file it was made from; the parsed configuration follows in host byte order.
+ * Bump kBinaryVersion whenever the layout below or the way XML is interpreted
+ * changes.
+ */
+const uint32_t kBinaryMagic = 0x47464345;   // "ECFG"
+const uint32_t kBinaryVersion = 2;
+
+/* FNV-1a; this only needs to tell whether the XML file has been changed */
+uint64_t hashData(const vector<char> &data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+bool readFile(const char *path, vector<char> &data) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+class BinaryWriter {
+public:
+    template <typename T>
+    void write(const T &value) {
+        static_assert(is_trivially_copyable<T>::value, "Only plain values can be written");
+        const char *p = reinterpret_cast<const char *>(&value);
+        mData.insert(mData.end(), p, p + sizeof(T));
+    }
+
+    void writeBytes(const void *data, uint32_t size) {
+        write(size);
+        const char *p = static_cast<const char *>(data);
+        mData.insert(mData.end(), p, p + size);
+    }
+
+    void writeString(const string &str) {
+        writeBytes(str.data(), str.size());
+    }
+
+    const vector<char> &data() const {
+        return mData;
+    }
+
+private:
+    vector<char> mData;
+};
+
+class BinaryReader {
+public:
+    BinaryReader(const vector<char> &data) :
+        mData(data),
+        mOffset(0) {
+    }
+
+    template <typename T>
+    bool read(T &value) {
+        static_assert(is_trivially_copyable<T>::value, "Only plain values can be read");
+        if (mData.size() - mOffset < sizeof(T)) {
+            return false;
+        }
+
+        memcpy(&value, mData.data() + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    template <typename C>
+    bool readBytes(C &container) {
+        uint32_t size;
+        if (!read(size) || mData.size() - mOffset < size) {
+            return false;
+        }
+
+        const char *p = mData.data() + mOffset;
+        container.assign(p, p + size);
+        mOffset += size;
+        return true;
+    }
+
+    bool readString(string &str) {
+        return readBytes(str);
+    }
+
+    bool done() const {
+        return mOffset == mData.size();
+    }
+
+private:
+    const vector<char> &mData;
+    size_t mOffset;
+};
+
+void writeStreamConfigurations(BinaryWriter &writer,
+                               const unordered_map<int32_t, RawStreamConfiguration> &configs) {
+    writer.write<uint32_t>(configs.size());
+    for (auto &[id, cfg] : configs) {
+        writer.write(id);
+        writer.write(cfg);
+    }
+}
+
+bool readStreamConfigurations(BinaryReader &reader,
+                              unordered_map<int32_t, RawStreamConfiguration> &configs) {
+    uint32_t count;
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t id;
+        RawStreamConfiguration cfg;
+        if (!reader.read(id) || !reader.read(cfg)) {
+            return false;
+        }
+
+        configs.insert_or_assign(id, cfg);
+    }
+
+    return true;
+}
+
+void serializeCameraInfo(BinaryWriter &writer, const ConfigManager::CameraInfo &info) {
+    writer.write<uint32_t>(info.controls.size());
+    for (auto &[param, range] : info.controls) {
+        writer.write(param);
+        writer.write(get<0>(range));
+        writer.write(get<1>(range));
+        writer.write(get<2>(range));
+    }
+
+    writeStreamConfigurations(writer, info.streamConfigurations);
+
+    writer.write<uint32_t>(info.cameraMetadata.size());
+    for (auto &[tag, entry] : info.cameraMetadata) {
+        writer.write(tag);
+        writer.write<uint32_t>(entry.second);
+        writer.writeBytes(entry.first.data(), entry.first.size());
+    }
+}
+
+bool deserializeCameraInfo(BinaryReader &reader, ConfigManager::CameraInfo &info) {
+    uint32_t count;
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        CameraParam param;
+        int32_t minVal, maxVal, stepVal;
+        if (!reader.read(param) ||
+            !reader.read(minVal) || !reader.read(maxVal) || !reader.read(stepVal)) {
+            return false;
+        }
+
+        info.controls.emplace(param, make_tuple(minVal, maxVal, stepVal));
+    }
+
+    if (!readStreamConfigurations(reader, info.streamConfigurations) ||
+        !reader.read(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        camera_metadata_tag_t tag;
+        uint32_t numElements;
+        vector<uint8_t> data;
+        if (!reader.read(tag) || !reader.read(numElements) || !reader.readBytes(data)) {
+            return false;
+        }
+
+        info.cameraMetadata.insert_or_assign(tag, make_pair(std::move(data), numElements));
+    }
+
+    return true;
+}
+
+} // namespace
+
 
 ConfigManager::~ConfigManager() {
     /* Nothing to do */
@@ -66,6 +261,27 @@ void ConfigManager::readCameraInfo(const XMLElement * const aCameraElem) {
                 aCamera->synchronized = 0; // Not synchronized
             }
 
+            /* how far apart frames delivered together may have been captured */
+            const XMLAttribute *toleranceAttr = curElem->FindAttribute("sync_tolerance_us");
+            if (toleranceAttr != nullptr) {
+                aCamera->syncToleranceUs = stoi(toleranceAttr->Value());
+            }
+
+            /* member camera devices, from the list of physical camera ids */
+            auto ids = aCamera->cameraMetadata.find(ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS);
+            if (ids != aCamera->cameraMetadata.end()) {
+                const vector<uint8_t> &data = ids->second.first;
+                auto start = data.begin();
+                for (auto it = data.begin(); it != data.end(); ++it) {
+                    if (*it == '\0') {
+                        if (it != start) {
+                            aCamera->devices.emplace(start, it);
+                        }
+                        start = it + 1;
+                    }
+                }
+            }
+
             /* add a group to hash map */
             mCameraGroupInfos.insert_or_assign(id, unique_ptr<CameraGroupInfo>(aCamera));
         } else if (!strcmp(curElem->Name(), "device")) {
@@ -107,39 +323,24 @@ ConfigManager::readCameraDeviceInfo(CameraInfo *aCamera,
         return false;
     }
 
-    /* size information to allocate camera_metadata_t */
-    size_t totalEntries = 0;
-    size_t totalDataSize = 0;
-
     /* read device capabilities */
-    totalEntries +=
-        readCameraCapabilities(aDeviceElem->FirstChildElement("caps"),
-                               aCamera,
-                               totalDataSize);
-
+    readCameraCapabilities(aDeviceElem->FirstChildElement("caps"), aCamera);
 
-    /* read camera metadata */
-    totalEntries +=
-        readCameraMetadata(aDeviceElem->FirstChildElement("characteristics"),
-                           aCamera,
-                           totalDataSize);
-
-    /* construct camera_metadata_t */
-    if (!constructCameraMetadata(aCamera, totalEntries, totalDataSize)) {
-        ALOGW("Either failed to allocate memory or "
-              "allocated memory was not large enough");
-    }
+    /*
+     * read camera metadata; camera_metadata_t is constructed from these when
+     * the camera is opened for the first time
+     */
+    readCameraMetadata(aDeviceElem->FirstChildElement("characteristics"), aCamera);
 
     return true;
 }
 
 
-size_t
+void
 ConfigManager::readCameraCapabilities(const XMLElement * const aCapElem,
-                                      CameraInfo *aCamera,
-                                      size_t &dataSize) {
+                                      CameraInfo *aCamera) {
     if (aCapElem == nullptr || aCamera == nullptr) {
-        return 0;
+        return;
     }
 
     string token;
@@ -205,29 +406,17 @@ ConfigManager::readCameraCapabilities(const XMLElement * const aCapElem,
 
         curElem = curElem->NextSiblingElement("stream");
     }
-
-    dataSize = calculate_camera_metadata_entry_data_size(
-                   get_camera_metadata_tag_type(
-                       ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS
-                   ),
-                   aCamera->streamConfigurations.size() * kStreamCfgSz
-               );
-
-    /* a single camera metadata entry contains multiple stream configurations */
-    return dataSize > 0 ? 1 : 0;
 }
 
 
-size_t
+void
 ConfigManager::readCameraMetadata(const XMLElement * const aParamElem,
-                                  CameraInfo *aCamera,
-                                  size_t &dataSize) {
+                                  CameraInfo *aCamera) {
     if (aParamElem == nullptr || aCamera == nullptr) {
-        return 0;
+        return;
     }
 
     const XMLElement *curElem = aParamElem->FirstChildElement("parameter");
-    size_t numEntries = 0;
     camera_metadata_tag_t tag;
     while (curElem != nullptr) {
         if (!ConfigManagerUtil::convertToMetadataTag(curElem->FindAttribute("name")->Value(),
@@ -239,67 +428,50 @@ ConfigManager::readCameraMetadata(const XMLElement * const aParamElem,
                 case ANDROID_LENS_INTRINSIC_CALIBRATION: {
                     /* float[] */
                     size_t count = 0;
-                    void   *data = ConfigManagerUtil::convertFloatArray(
-                                        curElem->FindAttribute("size")->Value(),
-                                        curElem->FindAttribute("value")->Value(),
-                                        count
-                                   );
+                    unique_ptr<float[]> data(ConfigManagerUtil::convertFloatArray(
+                                                 curElem->FindAttribute("size")->Value(),
+                                                 curElem->FindAttribute("value")->Value(),
+                                                 count));
 
+                    const uint8_t *begin = reinterpret_cast<const uint8_t *>(data.get());
                     aCamera->cameraMetadata.insert_or_assign(
-                        tag, make_pair(make_unique<void *>(data), count)
+                        tag, make_pair(vector<uint8_t>(begin, begin + count * sizeof(float)),
+                                       count)
                     );
-
-                    ++numEntries;
-                    dataSize += calculate_camera_metadata_entry_data_size(
-                                    get_camera_metadata_tag_type(tag), count
-                                );
-
                     break;
                 }
 
                 case ANDROID_REQUEST_AVAILABLE_CAPABILITIES: {
-                    camera_metadata_enum_android_request_available_capabilities_t *data =
-                        new camera_metadata_enum_android_request_available_capabilities_t[1];
+                    camera_metadata_enum_android_request_available_capabilities_t cap;
                     if (ConfigManagerUtil::convertToCameraCapability(
-                            curElem->FindAttribute("value")->Value(), *data)) {
-                                        curElem->FindAttribute("value")->Value(),
+                            curElem->FindAttribute("value")->Value(), cap)) {
+                        /* this is a byte entry */
                         aCamera->cameraMetadata.insert_or_assign(
-                            tag, make_pair(make_unique<void *>(data), 1)
+                            tag, make_pair(vector<uint8_t>(1, static_cast<uint8_t>(cap)), 1)
                         );
-
-                        ++numEntries;
-                        dataSize += calculate_camera_metadata_entry_data_size(
-                                        get_camera_metadata_tag_type(tag), 1
-                                    );
                     }
                     break;
                 }
 
                 case ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS: {
-                    /* a comma-separated list of physical camera devices */
-                    size_t len = strlen(curElem->FindAttribute("value")->Value());
-                    char *data = new char[len + 1];
-                    memcpy(data,
-                           curElem->FindAttribute("value")->Value(),
-                           len * sizeof(char));
+                    /*
+                     * a comma-separated list of physical camera devices; this
+                     * is stored as a list of null-terminated strings
+                     */
+                    const char *value = curElem->FindAttribute("value")->Value();
+                    vector<uint8_t> data(value, value + strlen(value) + 1);
 
                     /* replace commas with null char */
-                    char *p = data;
-                    while (*p != '\0') {
-                        if (*p == ',') {
-                            *p = '\0';
+                    for (auto &c : data) {
+                        if (c == ',') {
+                            c = '\0';
                         }
-                        ++p;
                     }
 
+                    const size_t len = data.size();
                     aCamera->cameraMetadata.insert_or_assign(
-                        tag, make_pair(make_unique<void *>(data), len)
+                        tag, make_pair(std::move(data), len)
                     );
-
-                    ++numEntries;
-                    dataSize += calculate_camera_metadata_entry_data_size(
-                                    get_camera_metadata_tag_type(tag), len
-                                );
                     break;
                 }
 
@@ -312,8 +484,6 @@ ConfigManager::readCameraMetadata(const XMLElement * const aParamElem,
 
         curElem = curElem->NextSiblingElement("parameter");
     }
-
-    return numEntries;
 }
 
 
@@ -349,7 +519,7 @@ ConfigManager::constructCameraMetadata(CameraInfo *aCamera,
         /* try to add new camera metadata entry */
         int32_t err = add_camera_metadata_entry(aCamera->characteristics,
                                                 tag,
-                                                entry.first.get(),
+                                                entry.first.data(),
                                                 entry.second);
         if (err) {
             ALOGE("Failed to add an entry with a tag 0x%X", tag);
@@ -377,6 +547,39 @@ ConfigManager::constructCameraMetadata(CameraInfo *aCamera,
 }
 
 
+camera_metadata_t *ConfigManager::CameraInfo::getCharacteristics() {
+    call_once(characteristicsOnce, [this]() {
+        /* size information to allocate camera_metadata_t */
+        size_t totalEntries = 0;
+        size_t totalDataSize = calculate_camera_metadata_entry_data_size(
+                                   get_camera_metadata_tag_type(
+                                       ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS
+                                   ),
+                                   streamConfigurations.size() * kStreamCfgSz
+                               );
+
+        /* a single camera metadata entry contains multiple stream configurations */
+        if (totalDataSize > 0) {
+            ++totalEntries;
+        }
+
+        for (auto &[tag, entry] : cameraMetadata) {
+            ++totalEntries;
+            totalDataSize += calculate_camera_metadata_entry_data_size(
+                                 get_camera_metadata_tag_type(tag), entry.second
+                             );
+        }
+
+        if (!constructCameraMetadata(this, totalEntries, totalDataSize)) {
+            ALOGW("Either failed to allocate memory or "
+                  "allocated memory was not large enough");
+        }
+    });
+
+    return characteristics;
+}
+
+
 void ConfigManager::readSystemInfo(const XMLElement * const aSysElem) {
     if (aSysElem == nullptr) {
         return;
@@ -394,6 +597,13 @@ void ConfigManager::readSystemInfo(const XMLElement * const aSysElem) {
         mSystemInfo.numCameras =
             stoi(xmlElem->FindAttribute("value")->Value());
     }
+
+    /* read whether cameras are shared, instead of taken over by their last client */
+    xmlElem = aSysElem->FirstChildElement("share_cameras");
+    if (xmlElem != nullptr) {
+        mSystemInfo.shareCameras =
+            strcmp(xmlElem->FindAttribute("value")->Value(), "true") == 0;
+    }
 }
 
 
@@ -492,21 +702,249 @@ bool ConfigManager::readConfigDataFromXML() noexcept {
 }
 
 
-std::unique_ptr<ConfigManager> ConfigManager::Create(const char *path) {
-    unique_ptr<ConfigManager> cfgMgr(new ConfigManager(path));
+bool ConfigManager::readConfigDataFromBinary(uint64_t xmlHash) noexcept {
+    const int64_t readStart = android::elapsedRealtimeNano();
+
+    vector<char> data;
+    if (!readFile(mBinaryFilePath, data)) {
+        ALOGD("No binary configuration found at %s", mBinaryFilePath);
+        return false;
+    }
+
+    BinaryReader reader(data);
+    uint32_t magic, version;
+    uint64_t hash;
+    if (!reader.read(magic) || !reader.read(version) || !reader.read(hash) ||
+        magic != kBinaryMagic || version != kBinaryVersion) {
+        ALOGW("%s is not a binary configuration this can read", mBinaryFilePath);
+        return false;
+    }
+
+    if (hash != xmlHash) {
+        ALOGI("Binary configuration is outdated");
+        return false;
+    }
+
+    /* system information */
+    SystemInfo sysInfo;
+    if (!reader.read(sysInfo.numCameras) || !reader.read(sysInfo.shareCameras)) {
+        return false;
+    }
+
+    /* camera devices */
+    uint32_t count;
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    unordered_map<string, unique_ptr<CameraInfo>> cameraInfos;
+    for (uint32_t i = 0; i < count; ++i) {
+        string id;
+        unique_ptr<CameraInfo> info(new CameraInfo());
+        if (!reader.readString(id) || !deserializeCameraInfo(reader, *info)) {
+            return false;
+        }
+
+        cameraInfos.insert_or_assign(id, std::move(info));
+    }
+
+    /* camera groups */
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    unordered_map<string, unique_ptr<CameraGroupInfo>> groupInfos;
+    for (uint32_t i = 0; i < count; ++i) {
+        string id;
+        unique_ptr<CameraGroupInfo> info(new CameraGroupInfo());
+        uint32_t numDevices;
+        if (!reader.readString(id) || !deserializeCameraInfo(reader, *info) ||
+            !reader.read(numDevices)) {
+            return false;
+        }
+
+        for (uint32_t j = 0; j < numDevices; ++j) {
+            string device;
+            if (!reader.readString(device)) {
+                return false;
+            }
+            info->devices.emplace(device);
+        }
+
+        if (!reader.read(info->synchronized) || !reader.read(info->syncToleranceUs)) {
+            return false;
+        }
+
+        groupInfos.insert_or_assign(id, std::move(info));
+    }
+
+    /* displays */
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    unordered_map<string, unique_ptr<DisplayInfo>> displayInfos;
+    for (uint32_t i = 0; i < count; ++i) {
+        string id;
+        unique_ptr<DisplayInfo> info(new DisplayInfo());
+        if (!reader.readString(id) ||
+            !readStreamConfigurations(reader, info->streamConfigurations)) {
+            return false;
+        }
+
+        displayInfos.insert_or_assign(id, std::move(info));
+    }
+
+    /* camera positions */
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    unordered_map<string, unordered_set<string>> cameraPositions;
+    for (uint32_t i = 0; i < count; ++i) {
+        string pos;
+        uint32_t numCameras;
+        if (!reader.readString(pos) || !reader.read(numCameras)) {
+            return false;
+        }
+
+        for (uint32_t j = 0; j < numCameras; ++j) {
+            string id;
+            if (!reader.readString(id)) {
+                return false;
+            }
+            cameraPositions[pos].emplace(id);
+        }
+    }
+
+    if (!reader.done()) {
+        ALOGW("%s has trailing data", mBinaryFilePath);
+        return false;
+    }
+
+    /* nothing is applied unless the whole file is valid */
+    mSystemInfo = sysInfo;
+    mCameraInfo = std::move(cameraInfos);
+    mCameraGroupInfos = std::move(groupInfos);
+    mDisplayInfo = std::move(displayInfos);
+    mCameraPosition = std::move(cameraPositions);
+
+    const int64_t readEnd = android::elapsedRealtimeNano();
+    ALOGI("Reading binary configuration takes %lf (ms)",
+          (double)(readEnd - readStart) / 1000000.0);
+
+    return true;
+}
+
+
+bool ConfigManager::writeConfigDataToBinary(uint64_t xmlHash) noexcept {
+    BinaryWriter writer;
+
+    writer.write(kBinaryMagic);
+    writer.write(kBinaryVersion);
+    writer.write(xmlHash);
+
+    /* system information */
+    writer.write(mSystemInfo.numCameras);
+    writer.write(mSystemInfo.shareCameras);
+
+    /* camera devices */
+    writer.write<uint32_t>(mCameraInfo.size());
+    for (auto &[id, info] : mCameraInfo) {
+        writer.writeString(id);
+        serializeCameraInfo(writer, *info);
+    }
+
+    /* camera groups */
+    writer.write<uint32_t>(mCameraGroupInfos.size());
+    for (auto &[id, info] : mCameraGroupInfos) {
+        writer.writeString(id);
+        serializeCameraInfo(writer, *info);
+        writer.write<uint32_t>(info->devices.size());
+        for (auto &device : info->devices) {
+            writer.writeString(device);
+        }
+        writer.write(info->synchronized);
+        writer.write(info->syncToleranceUs);
+    }
+
+    /* displays */
+    writer.write<uint32_t>(mDisplayInfo.size());
+    for (auto &[id, info] : mDisplayInfo) {
+        writer.writeString(id);
+        writeStreamConfigurations(writer, info->streamConfigurations);
+    }
+
+    /* camera positions */
+    writer.write<uint32_t>(mCameraPosition.size());
+    for (auto &[pos, ids] : mCameraPosition) {
+        writer.writeString(pos);
+        writer.write<uint32_t>(ids.size());
+        for (auto &id : ids) {
+            writer.writeString(id);
+        }
+    }
+
+    /* write a new file and replace the old one so a reader never sees a partial cache */
+    const string tmpPath = string(mBinaryFilePath) + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        file.write(writer.data().data(), writer.data().size());
+        file.close();
+        if (!file) {
+            ALOGW("Failed to write a binary configuration to %s", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmpPath.c_str(), mBinaryFilePath) != 0) {
+        ALOGW("Failed to move a binary configuration to %s", mBinaryFilePath);
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+std::unique_ptr<ConfigManager> ConfigManager::Create(const char *path,
+                                                     const char *binaryPath) {
+    unique_ptr<ConfigManager> cfgMgr(new ConfigManager(path, binaryPath));
+    if (binaryPath == nullptr) {
+        if (!cfgMgr->readConfigDataFromXML()) {
+            return nullptr;
+        } else {
+            return cfgMgr;
+        }
+    }
 
     /*
-     * Read a configuration from XML file
-     *
-     * If this is too slow, ConfigManager::readConfigDataFromBinary() and
-     * ConfigManager::writeConfigDataToBinary()can serialize CameraInfo object
-     * to the filesystem and construct CameraInfo instead; this was
-     * evaluated as 10x faster.
+     * A hash of the XML file tells whether the binary cache is still good;
+     * modification time is not reliable on read-only partitions.  Hashing is
+     * still much cheaper than parsing the XML file.
      */
-    if (!cfgMgr->readConfigDataFromXML()) {
+    vector<char> xmlData;
+    if (!readFile(path, xmlData)) {
+        ALOGE("Failed to read a configuration file %s", path);
         return nullptr;
-    } else {
+    }
+    const uint64_t xmlHash = hashData(xmlData);
+
+    /* a failed read may leave nothing behind as it applies a valid cache only */
+    if (cfgMgr->readConfigDataFromBinary(xmlHash)) {
         return cfgMgr;
     }
+
+    /* read a configuration from XML file and cache it for the next time */
+    if (!cfgMgr->readConfigDataFromXML()) {
+        return nullptr;
+    }
+
+    if (!cfgMgr->writeConfigDataToBinary(xmlHash)) {
+        ALOGW("Failed to cache the configuration, XML will be parsed again next time");
+    }
+
+    return cfgMgr;
 }
 
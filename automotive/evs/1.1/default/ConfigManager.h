@@ -16,6 +16,7 @@
 #ifndef CONFIG_MANAGER_H
 #define CONFIG_MANAGER_H
 
+#include <mutex>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -46,7 +47,18 @@ typedef std::array<int32_t, kStreamCfgSz> RawStreamConfiguration;
 
 class ConfigManager {
 public:
-    static std::unique_ptr<ConfigManager> Create(const char *path = "");
+    /*
+     * Create a ConfigManager
+     *
+     * @param  path
+     *         A path to XML configuration file
+     * @param  binaryPath
+     *         A path to the binary cache of the configuration, or null not to
+     *         use any.  The cache is only used if it was made from the same
+     *         XML file, and it gets rewritten otherwise.
+     */
+    static std::unique_ptr<ConfigManager> Create(const char *path = "",
+                                                 const char *binaryPath = nullptr);
     ConfigManager(const ConfigManager&) = delete;
     ConfigManager& operator=(const ConfigManager&) = delete;
 
@@ -89,14 +101,25 @@ public:
         unordered_map<int32_t, RawStreamConfiguration> streamConfigurations;
 
         /*
-         * Internal storage for camera metadata.  Each entry holds a pointer to
-         * data and number of elements
+         * Internal storage for camera metadata.  Each entry holds raw data and
+         * number of elements
          */
         unordered_map<camera_metadata_tag_t,
-                      pair<unique_ptr<void *>, size_t>> cameraMetadata;
+                      pair<vector<uint8_t>, size_t>> cameraMetadata;
+
+        /*
+         * Camera module characteristics
+         *
+         * This is constructed from streamConfigurations and cameraMetadata
+         * upon the first call, so cameras never opened don't pay for it.
+         */
+        camera_metadata_t *getCharacteristics();
+
+    private:
+        friend class ConfigManager;
 
-        /* Camera module characteristics */
         camera_metadata_t *characteristics;
+        once_flag characteristicsOnce;
     };
 
     class CameraGroupInfo : public CameraInfo {
@@ -108,12 +131,21 @@ public:
 
         /* The capture operation of member camera devices are synchronized */
         bool synchronized = false;
+
+        /*
+         * Largest difference between the timestamps of the frames delivered
+         * together, in microseconds, or -1 to use the default
+         */
+        int32_t syncToleranceUs = -1;
     };
 
     class SystemInfo {
     public:
         /* number of available cameras */
         int32_t numCameras = 0;
+
+        /* whether clients opening the same camera share its frames */
+        bool shareCameras = false;
     };
 
     class DisplayInfo {
@@ -153,6 +185,24 @@ public:
     }
 
 
+    /*
+     * Return a list of camera groups
+     *
+     * @return vector<string>
+     *         A vector that contains unique camera group identifiers.
+     */
+    vector<string> getCameraGroupIdList() {
+        vector<string> aList;
+        for (auto &v : mCameraGroupInfos) {
+            if (v.second != nullptr) {
+                aList.emplace_back(v.first);
+            }
+        }
+
+        return aList;
+    }
+
+
     /*
      * Return a list of cameras
      *
@@ -181,8 +231,9 @@ public:
 
 private:
     /* Constructors */
-    ConfigManager(const char *xmlPath) :
-        mConfigFilePath(xmlPath) {
+    ConfigManager(const char *xmlPath, const char *binaryPath) :
+        mConfigFilePath(xmlPath),
+        mBinaryFilePath(binaryPath) {
     }
 
     /* System configuration */
@@ -206,6 +257,9 @@ private:
     /* A path to XML configuration file */
     const char *mConfigFilePath;
 
+    /* A path to the binary cache of the configuration, may be null */
+    const char *mBinaryFilePath;
+
     /*
      * Parse a given EVS configuration file and store the information
      * internally.
@@ -215,6 +269,30 @@ private:
      */
     bool readConfigDataFromXML() noexcept;
 
+    /*
+     * Read the configuration from the binary cache
+     *
+     * @param  xmlHash
+     *         Hash of XML configuration file the cache must have been made
+     *         from.
+     *
+     * @return bool
+     *         True if the cache exists, is valid and was made from the same
+     *         XML configuration file.
+     */
+    bool readConfigDataFromBinary(uint64_t xmlHash) noexcept;
+
+    /*
+     * Write the configuration to the binary cache
+     *
+     * @param  xmlHash
+     *         Hash of XML configuration file the configuration was read from.
+     *
+     * @return bool
+     *         True if the cache was written successfully.
+     */
+    bool writeConfigDataToBinary(uint64_t xmlHash) noexcept;
+
     /*
      * read the information of the vehicle
      *
@@ -265,17 +343,9 @@ private:
      *         A pointer to "cap" XML element.
      * @param  aCamera
      *         A pointer to CameraInfo that is being filled by this method.
-     * @param  dataSize
-     *         Required size of memory to store camera metadata found in this
-     *         method.  This is calculated in this method and returned to the
-     *         caller for camera_metadata allocation.
-     *
-     * @return size_t
-     *         Number of camera metadata entries
      */
-    size_t readCameraCapabilities(const XMLElement * const aCapElem,
-                                  CameraInfo *aCamera,
-                                  size_t &dataSize);
+    void readCameraCapabilities(const XMLElement * const aCapElem,
+                                CameraInfo *aCamera);
 
     /*
      * read camera metadata
@@ -284,16 +354,9 @@ private:
      *         A pointer to "characteristics" XML element.
      * @param  aCamera
      *         A pointer to CameraInfo that is being filled by this method.
-     * @param  dataSize
-     *         Required size of memory to store camera metadata found in this
-     *         method.
-     *
-     * @return size_t
-     *         Number of camera metadata entries
      */
-    size_t readCameraMetadata(const XMLElement * const aParamElem,
-                              CameraInfo *aCamera,
-                              size_t &dataSize);
+    void readCameraMetadata(const XMLElement * const aParamElem,
+                            CameraInfo *aCamera);
 
     /*
      * construct camera_metadata_t from camera capabilities and metadata
@@ -310,9 +373,9 @@ private:
      *         or its size is not large enough to add all found camera metadata
      *         entries.
      */
-    bool constructCameraMetadata(CameraInfo *aCamera,
-                                 const size_t totalEntries,
-                                 const size_t totalDataSize);
+    static bool constructCameraMetadata(CameraInfo *aCamera,
+                                        const size_t totalEntries,
+                                        const size_t totalDataSize);
 };
 #endif // CONFIG_MANAGER_H
 
@@ -18,10 +18,8 @@
 
 #include "EvsCamera.h"
 #include "EvsEnumerator.h"
+#include "SharedCamera.h"
 
-#include <ui/GraphicBufferAllocator.h>
-#include <ui/GraphicBufferMapper.h>
-#include <utils/SystemClock.h>
 
 namespace android {
 namespace hardware {
@@ -35,15 +33,11 @@ namespace implementation {
 const char EvsCamera::kCameraName_Backup[] = "backup";
 
 
-// Arbitrary limit on number of graphics buffers allowed to be allocated
-// Safeguards against unreasonable resource consumption and provides a testable limit
-const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
-
-
 EvsCamera::EvsCamera(const char *id,
-                     unique_ptr<ConfigManager::CameraInfo> &camInfo) :
-        mFramesAllowed(0),
-        mFramesInUse(0),
+                     ConfigManager::CameraInfo *camInfo,
+                     std::shared_ptr<FrameSource> frameSource) :
+        mFrameSource(frameSource),
+        mClientId(frameSource->addClient()),
         mStreamState(STOPPED),
         mCameraInfo(camInfo) {
 
@@ -52,9 +46,10 @@ EvsCamera::EvsCamera(const char *id,
     /* set a camera id */
     mDescription.v1.cameraId = id;
 
-    /* set camera metadata */
-    mDescription.metadata.setToExternal((uint8_t *)camInfo->characteristics,
-                                        get_camera_metadata_size(camInfo->characteristics));
+    /* set camera metadata; this is constructed when a camera is opened first time */
+    camera_metadata_t *characteristics = camInfo->getCharacteristics();
+    mDescription.metadata.setToExternal((uint8_t *)characteristics,
+                                        get_camera_metadata_size(characteristics));
 }
 
 
@@ -65,7 +60,7 @@ EvsCamera::~EvsCamera() {
 
 
 //
-// This gets called if another caller "steals" ownership of the camera
+// This gets called when the client closes the camera
 //
 void EvsCamera::forceShutdown()
 {
@@ -78,21 +73,12 @@ void EvsCamera::forceShutdown()
     // Claim the lock while we work on internal state
     std::lock_guard <std::mutex> lock(mAccessLock);
 
-    // Drop all the graphics buffers we've been using
-    if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
-                ALOGE("Error - releasing buffer despite remote ownership");
-            }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
-        }
-        mBuffers.clear();
+    // Let the other clients keep the camera, returning any frame we still hold
+    if (mStreamState != DEAD) {
+        mFrameSource->removeClient(mClientId);
     }
 
-    // Put this object into an unrecoverable error state since somebody else
-    // is going to own the underlying camera now
+    // Put this object into an unrecoverable error state since the client is gone
     mStreamState = DEAD;
 }
 
@@ -124,7 +110,7 @@ Return<EvsResult> EvsCamera::setMaxFramesInFlight(uint32_t bufferCount) {
     }
 
     // Update our internal state
-    if (setAvailableFrames_Locked(bufferCount)) {
+    if (mFrameSource->setFramesAllowed(mClientId, bufferCount)) {
         return EvsResult::OK;
     } else {
         return EvsResult::BUFFER_NOT_AVAILABLE;
@@ -147,23 +133,26 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
     }
 
     // If the client never indicated otherwise, configure ourselves for a single streaming buffer
-    if (mFramesAllowed < 1) {
-        if (!setAvailableFrames_Locked(1)) {
+    if (mFrameSource->getFramesAllowed(mClientId) < 1) {
+        if (!mFrameSource->setFramesAllowed(mClientId, 1)) {
             ALOGE("Failed to start stream because we couldn't get a graphics buffer");
             return EvsResult::BUFFER_NOT_AVAILABLE;
         }
     }
 
     // Record the user's callback for use when we have a frame ready
-    mStream = IEvsCameraStream_1_1::castFrom(stream).withDefault(nullptr);
-    if (mStream == nullptr) {
+    sp<IEvsCameraStream_1_1> stream_1_1 =
+        IEvsCameraStream_1_1::castFrom(stream).withDefault(nullptr);
+    if (stream_1_1 == nullptr) {
         ALOGE("Default implementation does not support v1.0 IEvsCameraStream");
         return EvsResult::INVALID_ARG;
     }
 
-    // Start the frame generation thread
+    // Join the frames the camera delivers to its other clients
+    if (!mFrameSource->startStream(mClientId, stream_1_1)) {
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
     mStreamState = RUNNING;
-    mCaptureThread = std::thread([this](){ generateFrames(); });
 
     return EvsResult::OK;
 }
@@ -171,7 +160,8 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
 
 Return<void> EvsCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
     std::lock_guard <std::mutex> lock(mAccessLock);
-    returnBuffer(buffer.bufferId, buffer.memHandle);
+    mFrameSource->returnFrame(mClientId, mDescription.v1.cameraId, buffer.bufferId,
+                              buffer.memHandle);
 
     return Void();
 }
@@ -179,21 +169,14 @@ Return<void> EvsCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
 
 Return<void> EvsCamera::stopVideoStream()  {
     ALOGD("stopVideoStream");
-    std::unique_lock <std::mutex> lock(mAccessLock);
+    std::lock_guard <std::mutex> lock(mAccessLock);
 
     if (mStreamState == RUNNING) {
-        // Tell the GenerateFrames loop we want it to stop
-        mStreamState = STOPPING;
-
-        // Block outside the mutex until the "stop" flag has been acknowledged
         // We won't send any more frames, but the client might still get some already in flight
-        ALOGD("Waiting for stream thread to end...");
-        lock.unlock();
-        mCaptureThread.join();
-        lock.lock();
+        // The other clients of this camera keep streaming
+        mFrameSource->stopStream(mClientId);
 
         mStreamState = STOPPED;
-        mStream = nullptr;
         ALOGD("Stream marked STOPPED.");
     }
 
@@ -244,8 +227,14 @@ Return<void> EvsCamera::getPhysicalCameraInfo(const hidl_string& id,
                                               getCameraInfo_1_1_cb _hidl_cb) {
     ALOGD("%s", __FUNCTION__);
 
-    // This works exactly same as getCameraInfo_1_1() in default implementation.
-    (void)id;
+    // A physical camera describes itself, like getCameraInfo_1_1() does
+    for (auto&& desc : mPhysicalCameras) {
+        if (desc.v1.cameraId == id) {
+            _hidl_cb(desc);
+            return Void();
+        }
+    }
+
     _hidl_cb(mDescription);
     return Void();
 }
@@ -255,7 +244,8 @@ Return<EvsResult> EvsCamera::doneWithFrame_1_1(const hidl_vec<BufferDesc_1_1>& b
     std::lock_guard <std::mutex> lock(mAccessLock);
 
     for (auto&& buffer : buffers) {
-        returnBuffer(buffer.bufferId, buffer.buffer.nativeHandle);
+        mFrameSource->returnFrame(mClientId, buffer.deviceId, buffer.bufferId,
+                                  buffer.buffer.nativeHandle);
     }
 
     return EvsResult::OK;
@@ -363,354 +353,44 @@ EvsCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& /* buffers */,
 }
 
 
-bool EvsCamera::setAvailableFrames_Locked(unsigned bufferCount) {
-    if (bufferCount < 1) {
-        ALOGE("Ignoring request to set buffer count to zero");
-        return false;
-    }
-    if (bufferCount > MAX_BUFFERS_IN_FLIGHT) {
-        ALOGE("Rejecting buffer request in excess of internal limit");
-        return false;
-    }
-
-    // Is an increase required?
-    if (mFramesAllowed < bufferCount) {
-        // An increase is required
-        unsigned needed = bufferCount - mFramesAllowed;
-        ALOGI("Allocating %d buffers for camera frames", needed);
-
-        unsigned added = increaseAvailableFrames_Locked(needed);
-        if (added != needed) {
-            // If we didn't add all the frames we needed, then roll back to the previous state
-            ALOGE("Rolling back to previous frame queue size");
-            decreaseAvailableFrames_Locked(added);
-            return false;
-        }
-    } else if (mFramesAllowed > bufferCount) {
-        // A decrease is required
-        unsigned framesToRelease = mFramesAllowed - bufferCount;
-        ALOGI("Returning %d camera frame buffers", framesToRelease);
-
-        unsigned released = decreaseAvailableFrames_Locked(framesToRelease);
-        if (released != framesToRelease) {
-            // This shouldn't happen with a properly behaving client because the client
-            // should only make this call after returning sufficient outstanding buffers
-            // to allow a clean resize.
-            ALOGE("Buffer queue shrink failed -- too many buffers currently in use?");
-        }
-    }
-
-    return true;
-}
-
-
-unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
-    unsigned added = 0;
-
-    while (added < numToAdd) {
-        buffer_handle_t memHandle = nullptr;
-        status_t result = alloc.allocate(mWidth, mHeight, mFormat, 1, mUsage,
-                                         &memHandle, &mStride, 0, "EvsCamera");
-        if (result != NO_ERROR) {
-            ALOGE("Error %d allocating %d x %d graphics buffer", result, mWidth, mHeight);
-            break;
-        }
-        if (!memHandle) {
-            ALOGE("We didn't get a buffer handle back from the allocator");
-            break;
-        }
-
-        // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
-        }
-
-        mFramesAllowed++;
-        added++;
-    }
-
-    return added;
-}
-
-
-unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
-    unsigned removed = 0;
-
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
-
-            mFramesAllowed--;
-            removed++;
-
-            if (removed == numToRemove) {
-                break;
-            }
-        }
-    }
-
-    return removed;
-}
-
-
-// This is the asynchronous frame generation thread that runs in parallel with the
-// main serving thread.  There is one for each active camera instance.
-void EvsCamera::generateFrames() {
-    ALOGD("Frame generation loop started");
-
-    unsigned idx;
-
-    while (true) {
-        bool timeForFrame = false;
-        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
-
-        // Lock scope for updating shared state
-        {
-            std::lock_guard<std::mutex> lock(mAccessLock);
-
-            if (mStreamState != RUNNING) {
-                // Break out of our main thread loop
-                break;
-            }
-
-            // Are we allowed to issue another buffer?
-            if (mFramesInUse >= mFramesAllowed) {
-                // Can't do anything right now -- skip this frame
-                ALOGW("Skipped a frame because too many are in flight\n");
-            } else {
-                // Identify an available buffer to fill
-                for (idx = 0; idx < mBuffers.size(); idx++) {
-                    if (!mBuffers[idx].inUse) {
-                        if (mBuffers[idx].handle != nullptr) {
-                            // Found an available record, so stop looking
-                            break;
-                        }
-                    }
-                }
-                if (idx >= mBuffers.size()) {
-                    // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                    ALOGE("Failed to find an available buffer slot\n");
-                } else {
-                    // We're going to make the frame busy
-                    mBuffers[idx].inUse = true;
-                    mFramesInUse++;
-                    timeForFrame = true;
-                }
-            }
-        }
-
-        if (timeForFrame) {
-            // Assemble the buffer description we'll transmit below
-            BufferDesc_1_1 newBuffer = {};
-            AHardwareBuffer_Desc* pDesc =
-                reinterpret_cast<AHardwareBuffer_Desc *>(&newBuffer.buffer.description);
-            pDesc->width = mWidth;
-            pDesc->height = mHeight;
-            pDesc->layers = 1;
-            pDesc->format = mFormat;
-            pDesc->usage = mUsage;
-            pDesc->stride = mStride;
-            newBuffer.buffer.nativeHandle = mBuffers[idx].handle;
-            newBuffer.pixelSize = sizeof(uint32_t);
-            newBuffer.bufferId = idx;
-            newBuffer.deviceId = mDescription.v1.cameraId;
-            newBuffer.timestamp = elapsedRealtimeNano();
-
-            // Write test data into the image buffer
-            fillTestFrame(newBuffer);
-
-            // Issue the (asynchronous) callback to the client -- can't be holding the lock
-            hidl_vec<BufferDesc_1_1> frames;
-            frames.resize(1);
-            frames[0] = newBuffer;
-            auto result = mStream->deliverFrame_1_1(frames);
-            if (result.isOk()) {
-                ALOGD("Delivered %p as id %d",
-                      newBuffer.buffer.nativeHandle.getNativeHandle(), newBuffer.bufferId);
-            } else {
-                // This can happen if the client dies and is likely unrecoverable.
-                // To avoid consuming resources generating failing calls, we stop sending
-                // frames.  Note, however, that the stream remains in the "STREAMING" state
-                // until cleaned up on the main thread.
-                ALOGE("Frame delivery call failed in the transport layer.");
-
-                // Since we didn't actually deliver it, mark the frame as available
-                std::lock_guard<std::mutex> lock(mAccessLock);
-                mBuffers[idx].inUse = false;
-                mFramesInUse--;
-
-                break;
-            }
-        }
-
-        // We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
-        static const int kTargetFrameRate = 12;
-        static const nsecs_t kTargetFrameTimeUs = 1000*1000 / kTargetFrameRate;
-        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const nsecs_t workTimeUs = (now - startTime) / 1000;
-        const nsecs_t sleepDurationUs = kTargetFrameTimeUs - workTimeUs;
-        if (sleepDurationUs > 0) {
-            usleep(sleepDurationUs);
-        }
-    }
-
-    // If we've been asked to stop, send an event to signal the actual end of stream
-    EvsEventDesc event;
-    event.aType = EvsEventType::STREAM_STOPPED;
-    auto result = mStream->notify(event);
-    if (!result.isOk()) {
-        ALOGE("Error delivering end of stream marker");
-    }
+sp<EvsCamera> EvsCamera::Create(const char *deviceName) {
+    unique_ptr<ConfigManager::CameraInfo> nullCamInfo = nullptr;
 
-    return;
+    return Create(deviceName, nullCamInfo);
 }
 
 
-void EvsCamera::fillTestFrame(const BufferDesc_1_1& buff) {
-    // Lock our output buffer for writing
-    uint32_t *pixels = nullptr;
-    const AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<const AHardwareBuffer_Desc *>(&buff.buffer.description);
-    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-    mapper.lock(buff.buffer.nativeHandle,
-                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                android::Rect(pDesc->width, pDesc->height),
-                (void **) &pixels);
-
-    // If we failed to lock the pixel buffer, we're about to crash, but log it first
-    if (!pixels) {
-        ALOGE("Camera failed to gain access to image buffer for writing");
-    }
+sp<EvsCamera> EvsCamera::Create(const char *deviceName,
+                                unique_ptr<ConfigManager::CameraInfo> &camInfo,
+                                const Stream *streamCfg,
+                                std::shared_ptr<FrameSource> frameSource) {
+    /* default implementation does not use a given configuration */
+    (void)streamCfg;
 
-    // Fill in the test pixels
-    for (unsigned row = 0; row < pDesc->height; row++) {
-        for (unsigned col = 0; col < pDesc->width; col++) {
-            // Index into the row to check the pixel at this column.
-            // We expect 0xFF in the LSB channel, a vertical gradient in the
-            // second channel, a horitzontal gradient in the third channel, and
-            // 0xFF in the MSB.
-            // The exception is the very first 32 bits which is used for the
-            // time varying frame signature to avoid getting fooled by a static image.
-            uint32_t expectedPixel = 0xFF0000FF           | // MSB and LSB
-                                     ((row & 0xFF) <<  8) | // vertical gradient
-                                     ((col & 0xFF) << 16);  // horizontal gradient
-            if ((row | col) == 0) {
-                static uint32_t sFrameTicker = 0;
-                expectedPixel = (sFrameTicker) & 0xFF;
-                sFrameTicker++;
-            }
-            pixels[col] = expectedPixel;
-        }
-        // Point to the next row
-        // NOTE:  stride retrieved from gralloc is in units of pixels
-        pixels = pixels + pDesc->stride;
+    if (frameSource == nullptr) {
+        frameSource = SharedCamera::Create(deviceName, *camInfo);
     }
 
-    // Release our output buffer
-    mapper.unlock(buff.buffer.nativeHandle);
-}
-
-
-void EvsCamera::fillTestFrame(const BufferDesc_1_0& buff) {
-    BufferDesc_1_1 newBufDesc = {};
-    AHardwareBuffer_Desc desc = {
-        buff.width,   // width
-        buff.height,  // height
-        1,            // layers, always 1 for EVS
-        buff.format,  // One of AHardwareBuffer_Format
-        buff.usage,   // Combination of AHardwareBuffer_UsageFlags
-        buff.stride,  // Row stride in pixels
-        0,            // Reserved
-        0             // Reserved
-    };
-    memcpy(&desc, &newBufDesc.buffer.description, sizeof(desc));
-    newBufDesc.buffer.nativeHandle = buff.memHandle;
-    newBufDesc.pixelSize = buff.pixelSize;
-    newBufDesc.bufferId = buff.bufferId;
-
-    return fillTestFrame(newBufDesc);
-}
-
-
-void EvsCamera::returnBuffer(const uint32_t bufferId, const buffer_handle_t memHandle) {
-    std::lock_guard <std::mutex> lock(mAccessLock);
-
-    if (memHandle == nullptr) {
-        ALOGE("ignoring doneWithFrame called with null handle");
-    } else if (bufferId >= mBuffers.size()) {
-        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
-              bufferId, mBuffers.size()-1);
-    } else if (!mBuffers[bufferId].inUse) {
-        ALOGE("ignoring doneWithFrame called on frame %d which is already free",
-              bufferId);
-    } else {
-        // Mark the frame as available
-        mBuffers[bufferId].inUse = false;
-        mFramesInUse--;
-
-        // If this frame's index is high in the array, try to move it down
-        // to improve locality after mFramesAllowed has been reduced.
-        if (bufferId >= mFramesAllowed) {
-            // Find an empty slot lower in the array (which should always exist in this case)
-            for (auto&& rec : mBuffers) {
-                if (rec.handle == nullptr) {
-                    rec.handle = mBuffers[bufferId].handle;
-                    mBuffers[bufferId].handle = nullptr;
-                    break;
-                }
-            }
-        }
+    sp<EvsCamera> evsCamera = new EvsCamera(deviceName, camInfo.get(), frameSource);
+    if (evsCamera == nullptr) {
+        return nullptr;
     }
-}
-
-
-sp<EvsCamera> EvsCamera::Create(const char *deviceName) {
-    unique_ptr<ConfigManager::CameraInfo> nullCamInfo = nullptr;
+    evsCamera->mDescription.v1.vendorFlags = 0xFFFFFFFF; // Arbitrary test value
 
-    return Create(deviceName, nullCamInfo);
+    return evsCamera;
 }
 
 
-sp<EvsCamera> EvsCamera::Create(const char *deviceName,
-                                unique_ptr<ConfigManager::CameraInfo> &camInfo,
-                                const Stream *streamCfg) {
-    sp<EvsCamera> evsCamera = new EvsCamera(deviceName, camInfo);
+sp<EvsCamera> EvsCamera::CreateGroup(const char *groupName,
+                                     ConfigManager::CameraInfo *groupInfo,
+                                     std::shared_ptr<FrameSource> group,
+                                     const std::vector<CameraDesc> &physicalCameras) {
+    sp<EvsCamera> evsCamera = new EvsCamera(groupName, groupInfo, group);
     if (evsCamera == nullptr) {
         return nullptr;
     }
-
-    /* default implementation does not use a given configuration */
-    (void)streamCfg;
-
-    /* Use the first resolution from the list for the testing */
-    auto it = camInfo->streamConfigurations.begin();
-    evsCamera->mWidth = it->second[1];
-    evsCamera->mHeight = it->second[2];
     evsCamera->mDescription.v1.vendorFlags = 0xFFFFFFFF; // Arbitrary test value
-
-    evsCamera->mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
-    evsCamera->mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
-                         GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY;
+    evsCamera->mPhysicalCameras = physicalCameras;
 
     return evsCamera;
 }
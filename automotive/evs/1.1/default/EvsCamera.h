@@ -23,9 +23,11 @@
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
 #include <ui/GraphicBuffer.h>
 
-#include <thread>
+#include <memory>
+#include <vector>
 
 #include "ConfigManager.h"
+#include "FrameSource.h"
 
 using BufferDesc_1_0 = ::android::hardware::automotive::evs::V1_0::BufferDesc;
 using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
@@ -86,71 +88,55 @@ public:
                                             importExternalBuffers_cb _hidl_cb) override;
 
     static sp<EvsCamera> Create(const char *deviceName);
+    // Clients opening the same camera share their SharedCamera, a new one is created if null
     static sp<EvsCamera> Create(const char *deviceName,
                                 unique_ptr<ConfigManager::CameraInfo> &camInfo,
-                                const Stream *streamCfg = nullptr);
+                                const Stream *streamCfg = nullptr,
+                                std::shared_ptr<FrameSource> frameSource = nullptr);
+    // A logical camera, streaming from a CameraGroup of the given physical cameras
+    static sp<EvsCamera> CreateGroup(const char *groupName,
+                                     ConfigManager::CameraInfo *groupInfo,
+                                     std::shared_ptr<FrameSource> group,
+                                     const std::vector<CameraDesc> &physicalCameras);
     EvsCamera(const EvsCamera&) = delete;
     EvsCamera& operator=(const EvsCamera&) = delete;
 
     virtual ~EvsCamera() override;
-    void forceShutdown();   // This gets called if another caller "steals" ownership of the camera
+    void forceShutdown();   // This gets called when the client closes the camera
 
     const CameraDesc& getDesc() { return mDescription; };
+    const std::shared_ptr<FrameSource>& getFrameSource() { return mFrameSource; };
 
     static const char kCameraName_Backup[];
 
 private:
     EvsCamera(const char *id,
-              unique_ptr<ConfigManager::CameraInfo> &camInfo);
-    // These three functions are expected to be called while mAccessLock is held
-    //
-    bool setAvailableFrames_Locked(unsigned bufferCount);
-    unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
-    unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
-
-    void generateFrames();
-    void fillTestFrame(const BufferDesc_1_0& buff);
-    void fillTestFrame(const BufferDesc_1_1& buff);
-    void returnBuffer(const uint32_t bufferId, const buffer_handle_t memHandle);
+              ConfigManager::CameraInfo *camInfo,
+              std::shared_ptr<FrameSource> frameSource);
 
     sp<EvsEnumerator> mEnumerator;  // The enumerator object that created this camera
 
     CameraDesc mDescription = {};   // The properties of this camera
 
-    std::thread mCaptureThread;     // The thread we'll use to synthesize frames
+    // The physical camera or camera group, streaming to all its clients
+    std::shared_ptr<FrameSource> mFrameSource;
+    FrameSource::ClientId mClientId;
 
-    uint32_t mWidth  = 0;           // Horizontal pixel count in the buffers
-    uint32_t mHeight = 0;           // Vertical pixel count in the buffers
-    uint32_t mFormat = 0;           // Values from android_pixel_format_t
-    uint64_t mUsage  = 0;           // Values from from Gralloc.h
-    uint32_t mStride = 0;           // Bytes per line in the buffers
-
-    sp<IEvsCameraStream_1_1> mStream = nullptr;  // The callback used to deliver each frame
-
-    struct BufferRecord {
-        buffer_handle_t handle;
-        bool inUse;
-
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
-    };
-
-    std::vector <BufferRecord> mBuffers;  // Graphics buffers to transfer images
-    unsigned mFramesAllowed;              // How many buffers are we currently using
-    unsigned mFramesInUse;                // How many buffers are currently outstanding
+    // The physical cameras of a logical camera, empty otherwise
+    std::vector<CameraDesc> mPhysicalCameras;
 
     enum StreamStateValues {
         STOPPED,
         RUNNING,
-        STOPPING,
         DEAD,
     };
     StreamStateValues mStreamState;
 
-    // Synchronization necessary to deconflict mCaptureThread from the main service thread
+    // Synchronization necessary to deconflict the HIDL calls of this client
     std::mutex mAccessLock;
 
     // Static camera module information
-    unique_ptr<ConfigManager::CameraInfo> &mCameraInfo;
+    ConfigManager::CameraInfo *mCameraInfo;
 };
 
 } // namespace implementation
@@ -17,9 +17,13 @@
 #define LOG_TAG "android.hardware.automotive.evs@1.1-service"
 
 #include "EvsEnumerator.h"
+#include "CameraGroup.h"
 #include "EvsCamera.h"
 #include "EvsDisplay.h"
 #include "EvsUltrasonicsArray.h"
+#include "SharedCamera.h"
+
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -44,14 +48,27 @@ EvsEnumerator::EvsEnumerator(sp<IAutomotiveDisplayProxyService> windowService) {
 
     // Add sample camera data to our list of cameras
     // In a real driver, this would be expected to can the available hardware
+    // The parsed configuration is cached in /data so later starts skip XML parsing
     sConfigManager =
-        ConfigManager::Create("/vendor/etc/automotive/evs/evs_default_configuration.xml");
+        ConfigManager::Create("/vendor/etc/automotive/evs/evs_default_configuration.xml",
+                              "/data/vendor/automotive/evs/evs_default_configuration.bin");
 
     // Add available cameras
     for (auto v : sConfigManager->getCameraList()) {
         sCameraList.emplace_back(v.c_str());
     }
 
+    // Add available camera groups, their metadata tells clients they are logical cameras
+    for (auto v : sConfigManager->getCameraGroupIdList()) {
+        CameraRecord& rec = sCameraList.emplace_back(v.c_str());
+        rec.isGroup = true;
+
+        camera_metadata_t *characteristics =
+            sConfigManager->getCameraGroupInfo(v)->getCharacteristics();
+        rec.desc.metadata.setToExternal((uint8_t *)characteristics,
+                                        get_camera_metadata_size(characteristics));
+    }
+
     if (sDisplayProxyService == nullptr) {
         /* sets a car-window service handle */
         sDisplayProxyService = windowService;
@@ -119,23 +136,33 @@ Return<sp<IEvsCamera_1_0>> EvsEnumerator::openCamera(const hidl_string& cameraId
         return nullptr;
     }
 
+    if (pRecord->isGroup) {
+        return openCameraGroup(pRecord);
+    }
+
     // Has this camera already been instantiated by another caller?
-    sp<EvsCamera> pActiveCamera = pRecord->activeInstance.promote();
-    if (pActiveCamera != nullptr) {
-        ALOGW("Killing previous camera because of new caller");
-        closeCamera(pActiveCamera);
+    std::shared_ptr<FrameSource> frameSource;
+    if (sConfigManager != nullptr && sConfigManager->getSystemInfo().shareCameras) {
+        // Share the frames of the cameras other callers already opened
+        frameSource = pRecord->frameSource.lock();
+    } else {
+        killActiveInstances(pRecord);
     }
 
     // Construct a camera instance for the caller
+    sp<EvsCamera> pActiveCamera;
     if (sConfigManager == nullptr) {
         pActiveCamera = EvsCamera::Create(cameraId.c_str());
     } else {
         pActiveCamera = EvsCamera::Create(cameraId.c_str(),
-                                          sConfigManager->getCameraInfo(cameraId));
+                                          sConfigManager->getCameraInfo(cameraId),
+                                          nullptr,
+                                          frameSource);
     }
-    pRecord->activeInstance = pActiveCamera;
     if (pActiveCamera == nullptr) {
         ALOGE("Failed to allocate new EvsCamera object for %s\n", cameraId.c_str());
+    } else {
+        addActiveInstance(pRecord, pActiveCamera);
     }
 
     return pActiveCamera;
@@ -168,21 +195,26 @@ Return<void> EvsEnumerator::closeCamera(const ::android::sp<IEvsCamera_1_0>& pCa
         }
     }
 
-    // Is the display being destroyed actually the one we think is active?
+    // Is the camera being destroyed actually one we think is active?
     if (!pRecord) {
         ALOGE("Asked to close a camera who's name isn't recognized");
     } else {
-        sp<EvsCamera> pActiveCamera = pRecord->activeInstance.promote();
-
-        if (pActiveCamera == nullptr) {
-            ALOGE("Somehow a camera is being destroyed when the enumerator didn't know one existed");
-        } else if (pActiveCamera != pCamera_1_1) {
-            // This can happen if the camera was aggressively reopened, orphaning this previous instance
-            ALOGW("Ignoring close of previously orphaned camera - why did a client steal?");
-        } else {
-            // Drop the active camera
-            pActiveCamera->forceShutdown();
-            pRecord->activeInstance = nullptr;
+        bool found = false;
+        for (auto it = pRecord->activeInstances.begin(); it != pRecord->activeInstances.end();) {
+            sp<EvsCamera> pActiveCamera = it->promote();
+            if (pActiveCamera == nullptr || pActiveCamera == pCamera_1_1) {
+                if (pActiveCamera != nullptr) {
+                    // Drop this client, the other ones keep streaming
+                    pActiveCamera->forceShutdown();
+                    found = true;
+                }
+                it = pRecord->activeInstances.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!found) {
+            ALOGE("Somehow a camera is being destroyed when the enumerator didn't know it existed");
         }
     }
 
@@ -321,25 +353,128 @@ EvsEnumerator::openCamera_1_1(const hidl_string& cameraId,
         return nullptr;
     }
 
+    if (pRecord->isGroup) {
+        return openCameraGroup(pRecord);
+    }
+
     // Has this camera already been instantiated by another caller?
-    sp<EvsCamera> pActiveCamera = pRecord->activeInstance.promote();
-    if (pActiveCamera != nullptr) {
-        ALOGW("Killing previous camera because of new caller");
-        closeCamera(pActiveCamera);
+    std::shared_ptr<FrameSource> frameSource;
+    if (sConfigManager != nullptr && sConfigManager->getSystemInfo().shareCameras) {
+        // Share the frames of the cameras other callers already opened
+        frameSource = pRecord->frameSource.lock();
+    } else {
+        killActiveInstances(pRecord);
     }
 
     // Construct a camera instance for the caller
+    sp<EvsCamera> pActiveCamera;
     if (sConfigManager == nullptr) {
         pActiveCamera = EvsCamera::Create(cameraId.c_str());
     } else {
         pActiveCamera = EvsCamera::Create(cameraId.c_str(),
                                           sConfigManager->getCameraInfo(cameraId),
-                                          &streamCfg);
+                                          &streamCfg,
+                                          frameSource);
     }
 
-    pRecord->activeInstance = pActiveCamera;
     if (pActiveCamera == nullptr) {
         ALOGE("Failed to allocate new EvsCamera object for %s\n", cameraId.c_str());
+    } else {
+        addActiveInstance(pRecord, pActiveCamera);
+    }
+
+    return pActiveCamera;
+}
+
+
+void EvsEnumerator::killActiveInstances(CameraRecord* pRecord) {
+    std::vector<sp<EvsCamera>> activeCameras;
+    for (auto&& instance : pRecord->activeInstances) {
+        sp<EvsCamera> pActiveCamera = instance.promote();
+        if (pActiveCamera != nullptr) {
+            activeCameras.push_back(pActiveCamera);
+        }
+    }
+
+    for (auto&& pActiveCamera : activeCameras) {
+        ALOGW("Killing previous camera because of new caller");
+        closeCamera(pActiveCamera);
+    }
+}
+
+
+void EvsEnumerator::addActiveInstance(CameraRecord* pRecord, const sp<EvsCamera>& pCamera) {
+    // Forget the clients which are gone
+    pRecord->activeInstances.remove_if([](const wp<EvsCamera>& instance) {
+        return instance.promote() == nullptr;
+    });
+
+    pRecord->activeInstances.emplace_back(pCamera);
+    pRecord->frameSource = pCamera->getFrameSource();
+}
+
+
+sp<EvsCamera> EvsEnumerator::openCameraGroup(CameraRecord* pRecord) {
+    const std::string groupId = pRecord->desc.v1.cameraId;
+    auto& groupInfo = sConfigManager->getCameraGroupInfo(groupId);
+
+    // Has this group already been instantiated by another caller?
+    std::shared_ptr<FrameSource> group;
+    if (sConfigManager->getSystemInfo().shareCameras) {
+        group = pRecord->frameSource.lock();
+    } else {
+        killActiveInstances(pRecord);
+    }
+
+    // Frames are delivered in the order of the camera ids
+    std::vector<std::string> deviceIds(groupInfo->devices.begin(), groupInfo->devices.end());
+    std::sort(deviceIds.begin(), deviceIds.end());
+    if (deviceIds.empty()) {
+        ALOGE("Camera group %s has no camera", groupId.c_str());
+        return nullptr;
+    }
+
+    std::vector<CameraDesc> physicalCameras;
+    std::vector<std::pair<std::string, std::shared_ptr<FrameSource>>> members;
+    for (auto&& id : deviceIds) {
+        CameraRecord* pMember = findCameraById(id);
+        auto& memberInfo = sConfigManager->getCameraInfo(id);
+        if (pMember == nullptr || pMember->isGroup || memberInfo == nullptr) {
+            ALOGE("Camera group %s has an unknown camera %s", groupId.c_str(), id.c_str());
+            return nullptr;
+        }
+
+        CameraDesc desc = {};
+        desc.v1.cameraId = id;
+        camera_metadata_t *characteristics = memberInfo->getCharacteristics();
+        desc.metadata.setToExternal((uint8_t *)characteristics,
+                                    get_camera_metadata_size(characteristics));
+        physicalCameras.push_back(desc);
+
+        if (group == nullptr) {
+            // The group streams from the camera along with its other clients, if any
+            std::shared_ptr<FrameSource> source = pMember->frameSource.lock();
+            if (source == nullptr) {
+                source = SharedCamera::Create(id.c_str(), *memberInfo);
+                pMember->frameSource = source;
+            }
+            members.emplace_back(id, source);
+        }
+    }
+
+    if (group == nullptr) {
+        const nsecs_t syncTolerance = groupInfo->syncToleranceUs < 0 ?
+                                      CameraGroup::kDefaultSyncTolerance :
+                                      us2ns(groupInfo->syncToleranceUs);
+        group = std::make_shared<CameraGroup>(groupId, members, syncTolerance);
+    }
+
+    sp<EvsCamera> pActiveCamera =
+        EvsCamera::CreateGroup(groupId.c_str(), groupInfo.get(), group, physicalCameras);
+    if (pActiveCamera == nullptr) {
+        ALOGE("Failed to allocate new EvsCamera object for %s\n", groupId.c_str());
+    } else {
+        addActiveInstance(pRecord, pActiveCamera);
     }
 
     return pActiveCamera;
@@ -24,6 +24,7 @@
 #include <android/hardware/automotive/evs/1.1/IEvsUltrasonicsArray.h>
 
 #include <list>
+#include <memory>
 
 #include "ConfigManager.h"
 
@@ -46,6 +47,7 @@ namespace implementation {
 
 
 class EvsCamera;    // from EvsCamera.h
+class FrameSource;  // from FrameSource.h
 class EvsDisplay;   // from EvsDisplay.h
 class EvsUltrasonicsArray;  // from EvsUltrasonicsArray.h
 
@@ -81,8 +83,10 @@ private:
     //        That is to say, this is effectively a singleton despite the fact that HIDL
     //        constructs a new instance for each client.
     struct CameraRecord {
-        CameraDesc_1_1      desc;
-        wp<EvsCamera>       activeInstance;
+        CameraDesc_1_1                  desc;
+        std::list<wp<EvsCamera>>        activeInstances;  // One per client
+        std::weak_ptr<FrameSource>      frameSource;      // Streams to all of them
+        bool                            isGroup = false;  // A logical camera
 
         CameraRecord(const char *cameraId) : desc() { desc.v1.cameraId = cameraId; }
     };
@@ -95,6 +99,9 @@ private:
     };
 
     static CameraRecord* findCameraById(const std::string& cameraId);
+    static void addActiveInstance(CameraRecord* pRecord, const sp<EvsCamera>& pCamera);
+    void killActiveInstances(CameraRecord* pRecord);
+    sp<EvsCamera> openCameraGroup(CameraRecord* pRecord);
 
     static std::list<CameraRecord>   sCameraList;
 
@@ -99,10 +99,10 @@ void SerializeWaveformData(const std::vector<WaveformData>& waveformDataList, ui
     }
 }
 
-// Fills dataFrameDesc with dummy data.
+// Fills dataFrameDesc and the shared memory of a data frame with dummy data.
+// This is done once when the data frame memory is set up; each delivered frame
+// then only needs a new timestamp.
 bool fillDummyDataFrame(UltrasonicsDataFrameDesc& dataFrameDesc, sp<IMemory> pIMemory) {
-    dataFrameDesc.timestampNs = elapsedRealtimeNano();
-
     const std::vector<uint8_t> transmittersIdList = {0};
     dataFrameDesc.transmittersIdList = transmittersIdList;
 
@@ -137,6 +137,12 @@ EvsUltrasonicsArray::EvsUltrasonicsArray(const char* deviceName)
     : mFramesAllowed(0), mFramesInUse(0), mStreamState(STOPPED) {
     LOG(DEBUG) << "EvsUltrasonicsArray instantiated";
 
+    // The records are never moved, so that the capture thread can deliver a
+    // data frame descriptor without holding the lock or copying it.
+    mDataFrames.reserve(kMaximumDataFramesInFlight);
+    mFreeDataFrames.reserve(kMaximumDataFramesInFlight);
+    mEmptySlots.reserve(kMaximumDataFramesInFlight);
+
     // Set up dummy data for description.
     mArrayDesc.ultrasonicsArrayId = deviceName;
     fillDummyArrayDesc(mArrayDesc);
@@ -176,6 +182,8 @@ void EvsUltrasonicsArray::forceShutdown() {
         dataFrame.sharedMemory.clear();
     }
     mDataFrames.clear();
+    mFreeDataFrames.clear();
+    mEmptySlots.clear();
 
     // Put this object into an unrecoverable error state since somebody else
     // is going to own the underlying ultrasonic array now
@@ -239,21 +247,9 @@ Return<void> EvsUltrasonicsArray::doneWithDataFrame(const UltrasonicsDataFrameDe
 
     // Mark the frame as available
     mDataFrames[dataFrameDesc.dataFrameId].inUse = false;
+    mFreeDataFrames.push_back(dataFrameDesc.dataFrameId);
     mFramesInUse--;
 
-    // If this frame's index is high in the array, try to move it down
-    // to improve locality after mFramesAllowed has been reduced.
-    if (dataFrameDesc.dataFrameId >= mFramesAllowed) {
-        // Find an empty slot lower in the array (which should always exist in this case)
-        for (auto&& dataFrame : mDataFrames) {
-            if (!dataFrame.sharedMemory.IsValid()) {
-                dataFrame.sharedMemory = mDataFrames[dataFrameDesc.dataFrameId].sharedMemory;
-                mDataFrames[dataFrameDesc.dataFrameId].sharedMemory.clear();
-                return Void();
-            }
-        }
-    }
-
     return Void();
 }
 
@@ -406,22 +402,26 @@ unsigned EvsUltrasonicsArray::increaseAvailableFrames_Locked(unsigned numToAdd)
         }
 
         // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& dataFrame : mDataFrames) {
-            if (!dataFrame.sharedMemory.IsValid()) {
-                // Use this existing entry
-                dataFrame.sharedMemory = sharedMemory;
-                dataFrame.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-
-        if (!stored) {
+        uint32_t id;
+        if (!mEmptySlots.empty()) {
+            // Use this existing entry
+            id = mEmptySlots.back();
+            mEmptySlots.pop_back();
+            mDataFrames[id].sharedMemory = sharedMemory;
+            mDataFrames[id].inUse = false;
+        } else {
             // Add a BufferRecord wrapping this handle to our set of available buffers
+            id = mDataFrames.size();
             mDataFrames.emplace_back(sharedMemory);
         }
 
+        // Everything but the timestamp stays the same from one frame to the next
+        UltrasonicsDataFrameDesc& dataFrameDesc = mDataFrames[id].desc;
+        dataFrameDesc.dataFrameId = id;
+        dataFrameDesc.waveformsData = sharedMemory.hidlMemory;
+        fillDummyDataFrame(dataFrameDesc, sharedMemory.pIMemory);
+
+        mFreeDataFrames.push_back(id);
         mFramesAllowed++;
         added++;
     }
@@ -432,19 +432,18 @@ unsigned EvsUltrasonicsArray::increaseAvailableFrames_Locked(unsigned numToAdd)
 unsigned EvsUltrasonicsArray::decreaseAvailableFrames_Locked(unsigned numToRemove) {
     unsigned removed = 0;
 
-    for (auto&& dataFrame : mDataFrames) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if (!dataFrame.inUse && dataFrame.sharedMemory.IsValid()) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            dataFrame.sharedMemory.clear();
+    // Only the idle data frames can be freed
+    while (removed < numToRemove && !mFreeDataFrames.empty()) {
+        const uint32_t id = mFreeDataFrames.back();
+        mFreeDataFrames.pop_back();
 
-            mFramesAllowed--;
-            removed++;
+        // Release buffer and update the record so we can recognize it as "empty"
+        mDataFrames[id].sharedMemory.clear();
+        mDataFrames[id].desc.waveformsData = hidl_memory();
+        mEmptySlots.push_back(id);
 
-            if (removed == numToRemove) {
-                break;
-            }
-        }
+        mFramesAllowed--;
+        removed++;
     }
 
     return removed;
@@ -476,33 +475,21 @@ void EvsUltrasonicsArray::generateDataFrames() {
                 // Can't do anything right now -- skip this frame
                 LOG(WARNING) << "Skipped a frame because too many are in flight";
             } else {
-                // Identify an available buffer to fill
-                for (idx = 0; idx < mDataFrames.size(); idx++) {
-                    if (!mDataFrames[idx].inUse && mDataFrames[idx].sharedMemory.IsValid()) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
-                if (idx >= mDataFrames.size()) {
-                    // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                    LOG(ERROR) << "Failed to find an available buffer slot";
-                } else {
-                    // We're going to make the frame busy
-                    mDataFrames[idx].inUse = true;
-                    mFramesInUse++;
-                    timeForFrame = true;
-                }
+                // Take an available buffer to fill
+                idx = mFreeDataFrames.back();
+                mFreeDataFrames.pop_back();
+
+                // We're going to make the frame busy
+                mDataFrames[idx].inUse = true;
+                mFramesInUse++;
+                timeForFrame = true;
             }
         }
 
         if (timeForFrame) {
-            // Assemble the buffer description we'll transmit below
-            UltrasonicsDataFrameDesc dummyDataFrameDesc;
-            dummyDataFrameDesc.dataFrameId = idx;
-            dummyDataFrameDesc.waveformsData = mDataFrames[idx].sharedMemory.hidlMemory;
-
-            // Fill dummy waveform data.
-            fillDummyDataFrame(dummyDataFrameDesc, mDataFrames[idx].sharedMemory.pIMemory);
+            // The record of a busy frame is left alone by the other threads
+            UltrasonicsDataFrameDesc& dummyDataFrameDesc = mDataFrames[idx].desc;
+            dummyDataFrameDesc.timestampNs = elapsedRealtimeNano();
 
             // Issue the (asynchronous) callback to the client -- can't be holding the lock
             auto result = mStream->deliverDataFrame(dummyDataFrameDesc);
@@ -518,6 +505,7 @@ void EvsUltrasonicsArray::generateDataFrames() {
                 // Since we didn't actually deliver it, mark the frame as available
                 std::lock_guard<std::mutex> lock(mAccessLock);
                 mDataFrames[idx].inUse = false;
+                mFreeDataFrames.push_back(idx);
                 mFramesInUse--;
 
                 break;
@@ -86,6 +86,7 @@ class EvsUltrasonicsArray : public IEvsUltrasonicsArray {
     // Struct for a data frame record.
     struct DataFrameRecord {
         SharedMemory sharedMemory;
+        UltrasonicsDataFrameDesc desc;  // Descriptor delivering the shared memory
         bool inUse;
         explicit DataFrameRecord(SharedMemory shMem) : sharedMemory(shMem), inUse(false){};
     };
@@ -118,6 +119,10 @@ class EvsUltrasonicsArray : public IEvsUltrasonicsArray {
 
     std::mutex mAccessLock;
     std::vector<DataFrameRecord> mDataFrames GUARDED_BY(mAccessLock);  // Shared memory buffers.
+    // Ids of the idle data frames, ready to be filled.
+    std::vector<uint32_t> mFreeDataFrames GUARDED_BY(mAccessLock);
+    // Ids of the records which hold no shared memory.
+    std::vector<uint32_t> mEmptySlots GUARDED_BY(mAccessLock);
     unsigned mFramesAllowed GUARDED_BY(mAccessLock);  // How many buffers are we currently using.
     unsigned mFramesInUse GUARDED_BY(mAccessLock);  // How many buffers are currently outstanding.
 
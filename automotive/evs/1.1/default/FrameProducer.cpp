@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.1-service"
+
+#include "FrameProducer.h"
+
+#include <log/log.h>
+#include <ui/GraphicBufferMapper.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+bool TestPatternProducer::importBuffer(uint32_t /* id */, buffer_handle_t handle,
+                                       const AHardwareBuffer_Desc& desc) {
+    // Lock our output buffer for writing
+    uint32_t *pixels = nullptr;
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    mapper.lock(handle,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(desc.width, desc.height),
+                (void **) &pixels);
+    if (!pixels) {
+        ALOGE("Camera failed to gain access to image buffer for writing");
+        return false;
+    }
+
+    // Fill in the test pixels
+    for (unsigned row = 0; row < desc.height; row++) {
+        for (unsigned col = 0; col < desc.width; col++) {
+            // Index into the row to check the pixel at this column.
+            // We expect 0xFF in the LSB channel, a vertical gradient in the
+            // second channel, a horitzontal gradient in the third channel, and
+            // 0xFF in the MSB.
+            // The exception is the very first 32 bits which is used for the
+            // time varying frame signature to avoid getting fooled by a static image,
+            // produceFrame() updates it.
+            pixels[col] = 0xFF0000FF           | // MSB and LSB
+                          ((row & 0xFF) <<  8) | // vertical gradient
+                          ((col & 0xFF) << 16);  // horizontal gradient
+        }
+        // Point to the next row
+        // NOTE:  stride retrieved from gralloc is in units of pixels
+        pixels = pixels + desc.stride;
+    }
+
+    // Release our output buffer
+    mapper.unlock(handle);
+    return true;
+}
+
+
+void TestPatternProducer::releaseBuffer(uint32_t /* id */) {
+    // Nothing to release, buffers are only tracked by EvsCamera
+}
+
+
+bool TestPatternProducer::produceFrame(uint32_t /* id */, buffer_handle_t handle) {
+    // Only the signature changes between frames, so only its pixel gets locked and written
+    uint32_t *pixels = nullptr;
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    mapper.lock(handle,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(1, 1),
+                (void **) &pixels);
+    if (!pixels) {
+        ALOGE("Camera failed to gain access to image buffer for writing");
+        return false;
+    }
+
+    pixels[0] = mFrameTicker++ & 0xFF;
+
+    mapper.unlock(handle);
+    return true;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMEPRODUCER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMEPRODUCER_H
+
+#include <android/hardware_buffer.h>
+#include <cutils/native_handle.h>
+
+#include <atomic>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Source of the image data EvsCamera streams to its clients.
+//
+// Producers write straight into the graphics buffers EvsCamera allocates and hands over to its
+// clients, so no frame is ever copied on the CPU.  A hardware producer, such as a V4L2 device
+// importing the buffers as dmabufs, gets every buffer once through importBuffer() and then only
+// needs to be told which one to capture the next frame into.
+//
+// importBuffer() and releaseBuffer() are called with the camera's lock held, produceFrame() is
+// called from its frame generation thread without it.
+class FrameProducer {
+public:
+    virtual ~FrameProducer() = default;
+
+    // Makes a newly allocated buffer available to the producer under the given id.
+    // Returns false if the producer can't write into this buffer.
+    virtual bool importBuffer(uint32_t id, buffer_handle_t handle,
+                              const AHardwareBuffer_Desc& desc) = 0;
+
+    // Tells the producer a buffer is about to be freed.  It is not in flight.
+    virtual void releaseBuffer(uint32_t id) = 0;
+
+    // Writes the next frame into a previously imported buffer, blocking until it is complete.
+    virtual bool produceFrame(uint32_t id, buffer_handle_t handle) = 0;
+};
+
+
+// Producer of the test pattern the VTS tests validate.
+//
+// The pattern is static except for its first pixel, the frame signature.  So the whole buffer is
+// only drawn when it gets imported and each frame just updates the signature.
+class TestPatternProducer : public FrameProducer {
+public:
+    bool importBuffer(uint32_t id, buffer_handle_t handle,
+                      const AHardwareBuffer_Desc& desc) override;
+    void releaseBuffer(uint32_t id) override;
+    bool produceFrame(uint32_t id, buffer_handle_t handle) override;
+
+private:
+    std::atomic<uint32_t> mFrameTicker = 0;  // Time varying frame signature
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMEPRODUCER_H
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMESOURCE_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMESOURCE_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+#include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
+
+#include <string>
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+using IEvsCameraStream_1_1 = ::android::hardware::automotive::evs::V1_1::IEvsCameraStream;
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// What an EvsCamera streams from: either a physical camera, or a group of them delivering their
+// frames together.  Any number of clients may be registered, each streaming independently.
+class FrameSource {
+public:
+    using ClientId = uint32_t;
+
+    virtual ~FrameSource() = default;
+
+    // Registers a new client, which doesn't stream until startStream() is called.
+    virtual ClientId addClient() = 0;
+
+    // Stops the client's stream, if any, and drops its registration.  Frames it still holds are
+    // reclaimed, so this is only meant for clients which are going away.
+    virtual void removeClient(ClientId id) = 0;
+
+    // Sets how many frames the client may hold at once, allocating buffers as needed.
+    virtual bool setFramesAllowed(ClientId id, unsigned bufferCount) = 0;
+    virtual unsigned getFramesAllowed(ClientId id) = 0;
+
+    // Starts delivering frames to the stream.
+    virtual bool startStream(ClientId id, const sp<IEvsCameraStream_1_1>& stream) = 0;
+
+    // Stops delivering frames to the client's stream and sends it the end of stream event.
+    // Returns only once no frame delivery to this stream is in progress anymore.
+    virtual void stopStream(ClientId id) = 0;
+
+    // Takes back a frame from a client.  deviceId tells which camera of a group the frame
+    // came from.
+    virtual void returnFrame(ClientId id, const std::string& deviceId, uint32_t bufferId,
+                             buffer_handle_t memHandle) = 0;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMESOURCE_H
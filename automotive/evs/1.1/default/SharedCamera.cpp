@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.1-service"
+
+#include "SharedCamera.h"
+
+#include <log/log.h>
+#include <system/graphics.h>
+#include <hardware/gralloc.h>
+#include <ui/GraphicBufferAllocator.h>
+#include <utils/SystemClock.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Arbitrary limit on number of graphics buffers allowed to be allocated for a client
+// Safeguards against unreasonable resource consumption and provides a testable limit
+const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
+
+
+SharedCamera::SharedCamera(const std::string& cameraId, uint32_t width, uint32_t height,
+                           uint32_t format, uint64_t usage) :
+        mCameraId(cameraId),
+        mWidth(width),
+        mHeight(height),
+        mFormat(format),
+        mUsage(usage),
+        mProducer(std::make_unique<TestPatternProducer>()) {
+    ALOGD("SharedCamera instantiated");
+}
+
+
+std::shared_ptr<SharedCamera> SharedCamera::Create(const char *cameraId,
+                                                   const ConfigManager::CameraInfo &camInfo) {
+    /* Use the first resolution from the list for the testing */
+    auto it = camInfo.streamConfigurations.begin();
+    return std::make_shared<SharedCamera>(
+            cameraId, it->second[1], it->second[2], HAL_PIXEL_FORMAT_RGBA_8888,
+            GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
+            GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY);
+}
+
+
+SharedCamera::~SharedCamera() {
+    ALOGD("SharedCamera being destroyed");
+
+    // Every client stops its stream before letting go of us, so this is just a safety net
+    std::unique_lock<std::mutex> lock(mAccessLock);
+    if (mStreamState == RUNNING) {
+        ALOGE("Error - destroying the camera while it is streaming");
+        mStreamState = STOPPING;
+        lock.unlock();
+        mCaptureThread.join();
+        lock.lock();
+    }
+
+    // Drop all the graphics buffers we've been using
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (uint32_t id = 0; id < mBuffers.size(); id++) {
+        auto& rec = mBuffers[id];
+        if (rec.handle == nullptr) {
+            continue;
+        }
+        if (rec.refCount > 0) {
+            ALOGE("Error - releasing buffer despite remote ownership");
+        }
+        mProducer->releaseBuffer(id);
+        alloc.free(rec.handle);
+        rec.handle = nullptr;
+    }
+}
+
+
+SharedCamera::ClientId SharedCamera::addClient() {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    const ClientId id = mNextClientId++;
+    mClients[id] = {};
+    return id;
+}
+
+
+void SharedCamera::removeClient(ClientId id) {
+    stopStream(id);
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    if (it == mClients.end()) {
+        return;
+    }
+
+    // Reclaim the frames the client never returned
+    auto& client = it->second;
+    if (!client.framesHeld.empty()) {
+        ALOGW("Reclaiming %zu frames from a closed camera client", client.framesHeld.size());
+    }
+    client.framesAllowed = 0;
+    const std::set<uint32_t> framesHeld = client.framesHeld;
+    for (auto bufferId : framesHeld) {
+        releaseFrame_Locked(client, bufferId);
+    }
+    mClients.erase(it);
+
+    updateAvailableFrames_Locked();
+}
+
+
+bool SharedCamera::setFramesAllowed(ClientId id, unsigned bufferCount) {
+    if (bufferCount > MAX_BUFFERS_IN_FLIGHT) {
+        ALOGE("Rejecting buffer request in excess of internal limit");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    if (it == mClients.end()) {
+        ALOGE("Ignoring buffer request from an unknown client");
+        return false;
+    }
+
+    const unsigned previousCount = it->second.framesAllowed;
+    it->second.framesAllowed = bufferCount;
+    if (!updateAvailableFrames_Locked()) {
+        it->second.framesAllowed = previousCount;
+        return false;
+    }
+
+    return true;
+}
+
+
+unsigned SharedCamera::getFramesAllowed(ClientId id) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    auto it = mClients.find(id);
+    return it == mClients.end() ? 0 : it->second.framesAllowed;
+}
+
+
+bool SharedCamera::startStream(ClientId id, const sp<IEvsCameraStream_1_1>& stream) {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    auto it = mClients.find(id);
+    if (it == mClients.end() || it->second.stream != nullptr) {
+        ALOGE("Can't start a stream for this client");
+        return false;
+    }
+    it->second.stream = stream;
+
+    // Start the frame generation thread, unless another client got it running already
+    if (mStreamState == STOPPED) {
+        mStreamState = RUNNING;
+        mCaptureThread = std::thread([this](){ generateFrames(); });
+    }
+
+    return true;
+}
+
+
+void SharedCamera::stopStream(ClientId id) {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
+
+    sp<IEvsCameraStream_1_1> stream;
+    auto it = mClients.find(id);
+    if (it != mClients.end()) {
+        stream = it->second.stream;
+        it->second.stream = nullptr;
+    }
+
+    // A frame might be on its way to this client, and the end of stream event must come last
+    mDeliveryDone.wait(lock, [this](){ return !mDelivering; });
+
+    if (mStreamState == RUNNING && !isStreaming_Locked()) {
+        // Tell the generateFrames loop we want it to stop
+        mStreamState = STOPPING;
+
+        // Block outside the mutex until the "stop" flag has been acknowledged
+        ALOGD("Waiting for stream thread to end...");
+        lock.unlock();
+        mCaptureThread.join();
+        lock.lock();
+
+        mStreamState = STOPPED;
+        ALOGD("Stream marked STOPPED.");
+    }
+    lock.unlock();
+
+    // Send an event to signal the actual end of stream
+    if (stream != nullptr) {
+        EvsEventDesc event;
+        event.aType = EvsEventType::STREAM_STOPPED;
+        auto result = stream->notify(event);
+        if (!result.isOk()) {
+            ALOGE("Error delivering end of stream marker");
+        }
+    }
+}
+
+
+void SharedCamera::returnFrame(ClientId id, const std::string& /* deviceId */, uint32_t bufferId,
+                               buffer_handle_t memHandle) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    auto it = mClients.find(id);
+    if (memHandle == nullptr) {
+        ALOGE("ignoring doneWithFrame called with null handle");
+    } else if (it == mClients.end()) {
+        ALOGE("ignoring doneWithFrame called by an unknown client");
+    } else if (bufferId >= mBuffers.size()) {
+        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
+              bufferId, mBuffers.size()-1);
+    } else if (it->second.framesHeld.count(bufferId) == 0) {
+        ALOGE("ignoring doneWithFrame called on frame %d which is already free",
+              bufferId);
+    } else {
+        releaseFrame_Locked(it->second, bufferId);
+    }
+}
+
+
+bool SharedCamera::updateAvailableFrames_Locked() {
+    const unsigned bufferCount = totalFramesAllowed_Locked();
+
+    // Is an increase required?
+    if (mFramesAllowed < bufferCount) {
+        // An increase is required
+        unsigned needed = bufferCount - mFramesAllowed;
+        ALOGI("Allocating %d buffers for camera frames", needed);
+
+        unsigned added = increaseAvailableFrames_Locked(needed);
+        if (added != needed) {
+            // If we didn't add all the frames we needed, then roll back to the previous state
+            ALOGE("Rolling back to previous frame queue size");
+            decreaseAvailableFrames_Locked(added);
+            return false;
+        }
+    } else if (mFramesAllowed > bufferCount) {
+        // A decrease is required
+        unsigned framesToRelease = mFramesAllowed - bufferCount;
+        ALOGI("Returning %d camera frame buffers", framesToRelease);
+
+        // Buffers other clients still hold get released when they return them
+        decreaseAvailableFrames_Locked(framesToRelease);
+    }
+
+    return true;
+}
+
+
+unsigned SharedCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
+    // Acquire the graphics buffer allocator
+    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+
+    unsigned added = 0;
+
+    while (added < numToAdd) {
+        buffer_handle_t memHandle = nullptr;
+        status_t result = alloc.allocate(mWidth, mHeight, mFormat, 1, mUsage,
+                                         &memHandle, &mStride, 0, "EvsCamera");
+        if (result != NO_ERROR) {
+            ALOGE("Error %d allocating %d x %d graphics buffer", result, mWidth, mHeight);
+            break;
+        }
+        if (!memHandle) {
+            ALOGE("We didn't get a buffer handle back from the allocator");
+            break;
+        }
+
+        // Find a place to store the new buffer
+        uint32_t id;
+        if (!mEmptySlots.empty()) {
+            // Use this existing entry
+            id = mEmptySlots.back();
+            mEmptySlots.pop_back();
+            mBuffers[id].handle = memHandle;
+            mBuffers[id].refCount = 0;
+        } else {
+            // Add a BufferRecord wrapping this handle to our set of available buffers
+            id = mBuffers.size();
+            mBuffers.emplace_back(memHandle);
+        }
+
+        // Let the producer set itself up to write into this buffer
+        AHardwareBuffer_Desc desc = {
+            mWidth,   // width
+            mHeight,  // height
+            1,        // layers, always 1 for EVS
+            mFormat,  // One of AHardwareBuffer_Format
+            mUsage,   // Combination of AHardwareBuffer_UsageFlags
+            mStride,  // Row stride in pixels
+            0,        // Reserved
+            0         // Reserved
+        };
+        if (!mProducer->importBuffer(id, memHandle, desc)) {
+            ALOGE("Frame producer can't use the %d x %d graphics buffer", mWidth, mHeight);
+            alloc.free(memHandle);
+            mBuffers[id].handle = nullptr;
+            mEmptySlots.push_back(id);
+            break;
+        }
+
+        mFreeBuffers.push_back(id);
+        mFramesAllowed++;
+        added++;
+    }
+
+    return added;
+}
+
+
+unsigned SharedCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
+    // Acquire the graphics buffer allocator
+    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+
+    unsigned removed = 0;
+
+    // Only the idle buffers can be freed
+    while (removed < numToRemove && !mFreeBuffers.empty()) {
+        const uint32_t id = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
+
+        // Release buffer and update the record so we can recognize it as "empty"
+        mProducer->releaseBuffer(id);
+        alloc.free(mBuffers[id].handle);
+        mBuffers[id].handle = nullptr;
+        mEmptySlots.push_back(id);
+
+        mFramesAllowed--;
+        removed++;
+    }
+
+    return removed;
+}
+
+
+void SharedCamera::releaseFrame_Locked(Client& client, uint32_t bufferId) {
+    client.framesHeld.erase(bufferId);
+    if (--mBuffers[bufferId].refCount > 0) {
+        // Other clients are still using this frame
+        return;
+    }
+
+    // Mark the frame as available, then free it if the buffer queue is due to shrink
+    mFreeBuffers.push_back(bufferId);
+    const unsigned bufferCount = totalFramesAllowed_Locked();
+    if (mFramesAllowed > bufferCount) {
+        decreaseAvailableFrames_Locked(mFramesAllowed - bufferCount);
+    }
+}
+
+
+unsigned SharedCamera::totalFramesAllowed_Locked() const {
+    unsigned bufferCount = 0;
+    for (auto& [id, client] : mClients) {
+        bufferCount += client.framesAllowed;
+    }
+    return bufferCount;
+}
+
+
+bool SharedCamera::isStreaming_Locked() const {
+    for (auto& [id, client] : mClients) {
+        if (client.stream != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// This is the asynchronous frame generation thread that runs in parallel with the
+// main serving thread.  There is one for each physical camera, whatever its number of clients.
+void SharedCamera::generateFrames() {
+    ALOGD("Frame generation loop started");
+
+    while (true) {
+        bool timeForFrame = false;
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        uint32_t idx = 0;
+        buffer_handle_t memHandle = nullptr;
+        std::vector<std::pair<ClientId, sp<IEvsCameraStream_1_1>>> receivers;
+
+        // Lock scope for updating shared state
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+
+            if (mStreamState != RUNNING) {
+                // Break out of our main thread loop
+                break;
+            }
+
+            // Clients holding all the frames they are allowed to just skip this one
+            for (auto& [id, client] : mClients) {
+                if (client.stream != nullptr && client.framesHeld.size() < client.framesAllowed) {
+                    receivers.emplace_back(id, client.stream);
+                }
+            }
+
+            if (receivers.empty()) {
+                // Can't do anything right now -- skip this frame
+                if (isStreaming_Locked()) {
+                    ALOGW("Skipped a frame because too many are in flight\n");
+                }
+            } else if (mFreeBuffers.empty()) {
+                // Only happens when the buffer queue didn't shrink yet
+                ALOGE("Failed to find an available buffer slot\n");
+            } else {
+                // We're going to make the frame busy, until every receiver returns it
+                idx = mFreeBuffers.back();
+                mFreeBuffers.pop_back();
+                mBuffers[idx].refCount = receivers.size();
+                memHandle = mBuffers[idx].handle;
+                for (auto& [id, stream] : receivers) {
+                    mClients[id].framesHeld.insert(idx);
+                }
+                mDelivering = true;
+                timeForFrame = true;
+            }
+        }
+
+        if (timeForFrame) {
+            // Write the image data into the buffer, in place
+            const bool produced = mProducer->produceFrame(idx, memHandle);
+            if (!produced) {
+                ALOGE("Failed to produce a frame, skipping it");
+            }
+
+            // Assemble the buffer description we'll transmit below
+            BufferDesc_1_1 newBuffer = {};
+            AHardwareBuffer_Desc* pDesc =
+                reinterpret_cast<AHardwareBuffer_Desc *>(&newBuffer.buffer.description);
+            pDesc->width = mWidth;
+            pDesc->height = mHeight;
+            pDesc->layers = 1;
+            pDesc->format = mFormat;
+            pDesc->usage = mUsage;
+            pDesc->stride = mStride;
+            newBuffer.buffer.nativeHandle = memHandle;
+            newBuffer.pixelSize = sizeof(uint32_t);
+            newBuffer.bufferId = idx;
+            newBuffer.deviceId = mCameraId;
+            newBuffer.timestamp = elapsedRealtimeNano();
+
+            // Issue the (asynchronous) callbacks to the clients -- can't be holding the lock
+            hidl_vec<BufferDesc_1_1> frames;
+            frames.resize(1);
+            frames[0] = newBuffer;
+            std::vector<ClientId> undelivered;
+            for (auto& [id, stream] : receivers) {
+                if (!produced) {
+                    undelivered.push_back(id);
+                    continue;
+                }
+
+                auto result = stream->deliverFrame_1_1(frames);
+                if (result.isOk()) {
+                    ALOGD("Delivered %p as id %d",
+                          newBuffer.buffer.nativeHandle.getNativeHandle(), newBuffer.bufferId);
+                } else {
+                    // This can happen if the client dies and is likely unrecoverable.
+                    // To avoid consuming resources generating failing calls, we stop sending
+                    // frames to it.  Note, however, that its EvsCamera remains in the
+                    // "STREAMING" state until cleaned up on the main thread.
+                    ALOGE("Frame delivery call failed in the transport layer.");
+                    undelivered.push_back(id);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mAccessLock);
+
+                // Since we didn't actually deliver it, mark the frame as available
+                for (auto id : undelivered) {
+                    auto it = mClients.find(id);
+                    if (it == mClients.end()) {
+                        continue;
+                    }
+                    if (produced) {
+                        it->second.stream = nullptr;
+                    }
+                    releaseFrame_Locked(it->second, idx);
+                }
+                mDelivering = false;
+            }
+            mDeliveryDone.notify_all();
+        }
+
+        // We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
+        static const int kTargetFrameRate = 12;
+        static const nsecs_t kTargetFrameTimeUs = 1000*1000 / kTargetFrameRate;
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        const nsecs_t workTimeUs = (now - startTime) / 1000;
+        const nsecs_t sleepDurationUs = kTargetFrameTimeUs - workTimeUs;
+        if (sleepDurationUs > 0) {
+            usleep(sleepDurationUs);
+        }
+    }
+
+    return;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
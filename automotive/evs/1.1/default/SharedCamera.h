@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_SHAREDCAMERA_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_SHAREDCAMERA_H
+
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ConfigManager.h"
+#include "FrameProducer.h"
+#include "FrameSource.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// The physical camera behind every EvsCamera opened on the same camera id.
+//
+// It owns the graphics buffers and the frame generation thread, and fans out each frame it
+// produces to all streaming clients: they receive the very same buffer handles, and a buffer
+// only becomes available again once every client it was delivered to has returned it.
+//
+// Each client gets at most as many frames in flight as it asked for with setFramesAllowed().
+// A client holding all of them simply misses the frames produced meanwhile, so a slow consumer
+// throttles itself instead of stalling the camera for everybody else.
+class SharedCamera : public FrameSource {
+public:
+    SharedCamera(const std::string& cameraId, uint32_t width, uint32_t height, uint32_t format,
+                 uint64_t usage);
+    ~SharedCamera() override;
+    SharedCamera(const SharedCamera&) = delete;
+    SharedCamera& operator=(const SharedCamera&) = delete;
+
+    // Creates a camera streaming in its first configured resolution
+    static std::shared_ptr<SharedCamera> Create(const char *cameraId,
+                                                const ConfigManager::CameraInfo &camInfo);
+
+    // Methods from FrameSource follow.
+    ClientId addClient() override;
+    void removeClient(ClientId id) override;
+    bool setFramesAllowed(ClientId id, unsigned bufferCount) override;
+    unsigned getFramesAllowed(ClientId id) override;
+    bool startStream(ClientId id, const sp<IEvsCameraStream_1_1>& stream) override;
+    void stopStream(ClientId id) override;
+    void returnFrame(ClientId id, const std::string& deviceId, uint32_t bufferId,
+                     buffer_handle_t memHandle) override;
+
+private:
+    struct BufferRecord {
+        buffer_handle_t handle;
+        unsigned        refCount;  // How many clients hold this buffer
+
+        explicit BufferRecord(buffer_handle_t h) : handle(h), refCount(0) {};
+    };
+
+    struct Client {
+        sp<IEvsCameraStream_1_1> stream;  // Null while the client doesn't stream
+        unsigned framesAllowed = 0;       // How many buffers the client may hold
+        std::set<uint32_t> framesHeld;    // Ids of the buffers the client holds
+    };
+
+    // These functions are expected to be called while mAccessLock is held
+    //
+    bool updateAvailableFrames_Locked();
+    unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
+    unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
+    void releaseFrame_Locked(Client& client, uint32_t bufferId);
+    unsigned totalFramesAllowed_Locked() const;
+    bool isStreaming_Locked() const;
+
+    void generateFrames();
+
+    const std::string mCameraId;    // Id of the camera, reported in the frame descriptors
+
+    uint32_t mWidth  = 0;           // Horizontal pixel count in the buffers
+    uint32_t mHeight = 0;           // Vertical pixel count in the buffers
+    uint32_t mFormat = 0;           // Values from android_pixel_format_t
+    uint64_t mUsage  = 0;           // Values from from Gralloc.h
+    uint32_t mStride = 0;           // Bytes per line in the buffers
+
+    std::vector <BufferRecord> mBuffers;  // Graphics buffers to transfer images, by bufferId
+    std::vector <uint32_t> mFreeBuffers;  // Ids of the idle buffers, ready to be filled
+    std::vector <uint32_t> mEmptySlots;   // Ids of the records which hold no buffer
+    unsigned mFramesAllowed = 0;          // How many buffers are we currently using
+
+    std::map<ClientId, Client> mClients;
+    ClientId mNextClientId = 0;
+
+    enum StreamStateValues {
+        STOPPED,
+        RUNNING,
+        STOPPING,
+    };
+    StreamStateValues mStreamState = STOPPED;
+
+    std::thread mCaptureThread;     // The thread we'll use to synthesize frames
+
+    // Whether mCaptureThread is delivering a frame, without holding mAccessLock
+    bool mDelivering = false;
+    std::condition_variable mDeliveryDone;
+
+    // Serializes starting and stopping mCaptureThread
+    std::mutex mStreamLock;
+
+    // Synchronization necessary to deconflict mCaptureThread from the main service thread
+    std::mutex mAccessLock;
+
+    // Writes the image data into the buffers
+    std::unique_ptr<FrameProducer> mProducer;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_SHAREDCAMERA_H
@@ -14,7 +14,7 @@
  * limitations under the License.
  */
 
-#include <utils/SystemClock.h>
+#include <algorithm>
 
 #include "OccupantAwareness.h"
 
@@ -31,15 +31,18 @@ static const int32_t kAllCapabilities = OccupantAwareness::CAP_PRESENCE_DETECTIO
                                         OccupantAwareness::CAP_GAZE_DETECTION |
                                         OccupantAwareness::CAP_DRIVER_MONITORING_DETECTION;
 
-constexpr int64_t kNanoSecondsPerMilliSecond = 1000 * 1000;
+OccupantAwareness::OccupantAwareness(std::chrono::milliseconds detectionPeriod)
+    : mDetectionPeriod(detectionPeriod) {}
 
 ScopedAStatus OccupantAwareness::startDetection(OccupantAwarenessStatus* status) {
+    std::lock_guard<std::mutex> startStopLock(mStartStopMutex);
     std::lock_guard<std::mutex> lock(mMutex);
     if (mStatus != OccupantAwarenessStatus::NOT_INITIALIZED) {
         return ScopedAStatus::fromExceptionCode(EX_TRANSACTION_FAILED);
     }
 
     mStatus = OccupantAwarenessStatus::READY;
+    std::atomic_store(&mLatestDetections, std::make_shared<const OccupantDetections>());
     mWorkerThread = std::thread(startWorkerThread, this);
     if (mCallback) {
         mCallback->onSystemStatusChanged(kAllCapabilities, mStatus);
@@ -50,13 +53,22 @@ ScopedAStatus OccupantAwareness::startDetection(OccupantAwarenessStatus* status)
 }
 
 ScopedAStatus OccupantAwareness::stopDetection(OccupantAwarenessStatus* status) {
-    std::lock_guard<std::mutex> lock(mMutex);
+    // Held until the worker thread is joined, so that detection can't be started again while
+    // the worker of this run is still exiting.
+    std::lock_guard<std::mutex> startStopLock(mStartStopMutex);
+    std::unique_lock<std::mutex> lock(mMutex);
     if (mStatus != OccupantAwarenessStatus::READY) {
         return ScopedAStatus::fromExceptionCode(EX_TRANSACTION_FAILED);
     }
 
     mStatus = OccupantAwarenessStatus::NOT_INITIALIZED;
-    mWorkerThread.join();
+    mWorkerCondition.notify_all();
+    std::thread workerThread = std::move(mWorkerThread);
+    // The worker thread needs the lock to notice that detection stopped.
+    lock.unlock();
+    workerThread.join();
+    lock.lock();
+    std::atomic_store(&mLatestDetections, std::shared_ptr<const OccupantDetections>());
     if (mCallback) {
         mCallback->onSystemStatusChanged(kAllCapabilities, mStatus);
     }
@@ -121,13 +133,13 @@ ScopedAStatus OccupantAwareness::setCallback(
 }
 
 ScopedAStatus OccupantAwareness::getLatestDetection(OccupantDetections* detections) {
-    std::lock_guard<std::mutex> lock(mMutex);
-
-    if (mStatus != OccupantAwarenessStatus::READY) {
+    std::shared_ptr<const OccupantDetections> latestDetections =
+            std::atomic_load(&mLatestDetections);
+    if (latestDetections == nullptr) {
         return ScopedAStatus::fromExceptionCode(EX_TRANSACTION_FAILED);
     }
 
-    *detections = mLatestDetections;
+    *detections = *latestDetections;
     return ScopedAStatus::ok();
 }
 
@@ -152,19 +164,26 @@ void OccupantAwareness::startWorkerThread(OccupantAwareness* occupantAwareness)
 }
 
 void OccupantAwareness::workerThreadFunction() {
-    bool isFirstDetection = true;
-    int64_t prevDetectionTimeMs;
-    while (mStatus == OccupantAwarenessStatus::READY) {
-        int64_t currentTimeMs = android::elapsedRealtimeNano() / kNanoSecondsPerMilliSecond;
-        if ((isFirstDetection) || (currentTimeMs - prevDetectionTimeMs > mDetectionDurationMs)) {
-            std::lock_guard<std::mutex> lock(mMutex);
-            mLatestDetections = mGenerator.GetNextDetections();
-            if (mCallback != nullptr) {
-                mCallback->onDetectionEvent(mLatestDetections);
-            }
-            isFirstDetection = false;
-            prevDetectionTimeMs = currentTimeMs;
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto nextDetectionTime = std::chrono::steady_clock::now();
+    while (!mWorkerCondition.wait_until(lock, nextDetectionTime, [this] {
+        return mStatus != OccupantAwarenessStatus::READY;
+    })) {
+        // Skip the detections a slow callback made us miss, rather than catching up with stale
+        // ones.
+        nextDetectionTime = std::max(nextDetectionTime + mDetectionPeriod,
+                                     std::chrono::steady_clock::now());
+        std::shared_ptr<IOccupantAwarenessClientCallback> callback = mCallback;
+        lock.unlock();
+
+        auto detections =
+                std::make_shared<const OccupantDetections>(mGenerator.GetNextDetections());
+        std::atomic_store(&mLatestDetections, detections);
+        if (callback != nullptr) {
+            callback->onDetectionEvent(*detections);
         }
+
+        lock.lock();
     }
 }
 
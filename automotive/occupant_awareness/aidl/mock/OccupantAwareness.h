@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
 
 #include <aidl/android/hardware/automotive/occupant_awareness/BnOccupantAwareness.h>
@@ -43,6 +47,12 @@ using ::aidl::android::hardware::automotive::occupant_awareness::Role;
  **/
 class OccupantAwareness : public BnOccupantAwareness {
   public:
+    // Generate detections at 30Hz by default, about the rate of an in-cabin camera.
+    static constexpr std::chrono::milliseconds kDefaultDetectionPeriod{33};
+
+    explicit OccupantAwareness(
+            std::chrono::milliseconds detectionPeriod = kDefaultDetectionPeriod);
+
     // Methods from ::android::hardware::automotive::occupant_awareness::IOccupantAwareness
     // follow.
     ndk::ScopedAStatus startDetection(OccupantAwarenessStatus* status) override;
@@ -62,17 +72,22 @@ class OccupantAwareness : public BnOccupantAwareness {
     void workerThreadFunction();
     static void startWorkerThread(OccupantAwareness* occupantAwareness);
 
+    // Serializes startDetection and stopDetection. Taken before mMutex.
+    std::mutex mStartStopMutex;
     std::mutex mMutex;
+    // Wakes the worker thread when detection stops.
+    std::condition_variable mWorkerCondition;
     std::shared_ptr<IOccupantAwarenessClientCallback> mCallback = nullptr;
     OccupantAwarenessStatus mStatus = OccupantAwarenessStatus::NOT_INITIALIZED;
 
-    OccupantDetections mLatestDetections;
+    // Null unless detection is running. Replaced as a whole, and only accessed through
+    // std::atomic_load and std::atomic_store, so that getLatestDetection needs no lock.
+    std::shared_ptr<const OccupantDetections> mLatestDetections;
     std::thread mWorkerThread;
 
     DetectionGenerator mGenerator;
 
-    // Generate a new detection every 1ms.
-    const int64_t mDetectionDurationMs = 1;
+    const std::chrono::milliseconds mDetectionPeriod;
 };
 
 }  // namespace implementation
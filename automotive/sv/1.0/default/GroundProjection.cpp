@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GroundProjection.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// Iterations of the lens undistortion, enough to converge for the mild barrel
+// distortion of the cameras below
+const int kUndistortIterations = 10;
+
+// Rays flatter than this never meet the ground close enough to be of use
+const float kMinRayDip = 1e-3f;
+
+constexpr float kPi = 3.14159265358979f;
+
+}  // namespace
+
+const std::vector<CameraCalibration>& getCameraCalibrations() {
+    // Front, right, rear and left cameras, looking down at the ground around
+    // the car.
+    static const std::vector<CameraCalibration> kCalibrations = {
+        {"0", 640, 480, 300, 300, 319.5f, 239.5f, -0.05f, 0.002f,
+         {0, 2300, 700}, 0, kPi * 55 / 180},
+        {"1", 640, 480, 300, 300, 319.5f, 239.5f, -0.05f, 0.002f,
+         {1000, 0, 1000}, -kPi / 2, kPi * 55 / 180},
+        {"2", 640, 480, 300, 300, 319.5f, 239.5f, -0.05f, 0.002f,
+         {0, -2300, 900}, kPi, kPi * 55 / 180},
+        {"3", 640, 480, 300, 300, 319.5f, 239.5f, -0.05f, 0.002f,
+         {-1000, 0, 1000}, kPi / 2, kPi * 55 / 180},
+    };
+    return kCalibrations;
+}
+
+GroundProjection::GroundProjection(const CameraCalibration& calibration) :
+    mCalibration(calibration) {
+    const float sinYaw = std::sin(calibration.yaw);
+    const float cosYaw = std::cos(calibration.yaw);
+    const float sinPitch = std::sin(calibration.pitch);
+    const float cosPitch = std::cos(calibration.pitch);
+
+    mForward[0] = -sinYaw * cosPitch;
+    mForward[1] = cosYaw * cosPitch;
+    mForward[2] = -sinPitch;
+
+    mRight[0] = cosYaw;
+    mRight[1] = sinYaw;
+    mRight[2] = 0;
+
+    // Forward x right, so that right, down and forward are right-handed
+    mDown[0] = sinPitch * sinYaw;
+    mDown[1] = -sinPitch * cosYaw;
+    mDown[2] = -cosPitch;
+
+    mGridWidth = (calibration.width - 1 + kGridStep - 1) / kGridStep + 1;
+    mGridHeight = (calibration.height - 1 + kGridStep - 1) / kGridStep + 1;
+    mGrid.resize(mGridWidth * mGridHeight);
+    for (int row = 0; row < mGridHeight; row++) {
+        for (int col = 0; col < mGridWidth; col++) {
+            solve(gridCoordinate(col, calibration.width),
+                  gridCoordinate(row, calibration.height),
+                  &mGrid[row * mGridWidth + col]);
+        }
+    }
+}
+
+const GroundProjection* GroundProjection::get(const std::string& cameraId) {
+    static const std::vector<GroundProjection> projections = [] {
+        std::vector<GroundProjection> result;
+        for (const auto& calibration : getCameraCalibrations()) {
+            result.emplace_back(calibration);
+        }
+        return result;
+    }();
+
+    for (const auto& projection : projections) {
+        if (projection.mCalibration.cameraId == cameraId) {
+            return &projection;
+        }
+    }
+    return nullptr;
+}
+
+bool GroundProjection::project(float x, float y, float* groundX, float* groundY) const {
+    if (x < 0 || x > mCalibration.width - 1 || y < 0 || y > mCalibration.height - 1) {
+        return false;
+    }
+
+    const int col = std::min(static_cast<int>(x) / kGridStep, mGridWidth - 2);
+    const int row = std::min(static_cast<int>(y) / kGridStep, mGridHeight - 2);
+    const GridPoint& topLeft = mGrid[row * mGridWidth + col];
+    const GridPoint& topRight = mGrid[row * mGridWidth + col + 1];
+    const GridPoint& bottomLeft = mGrid[(row + 1) * mGridWidth + col];
+    const GridPoint& bottomRight = mGrid[(row + 1) * mGridWidth + col + 1];
+
+    if (!topLeft.valid || !topRight.valid || !bottomLeft.valid || !bottomRight.valid) {
+        // Part of the cell is above the horizon, where interpolating makes no sense
+        GridPoint point;
+        if (!solve(x, y, &point)) {
+            return false;
+        }
+        *groundX = point.x;
+        *groundY = point.y;
+        return true;
+    }
+
+    const float x0 = gridCoordinate(col, mCalibration.width);
+    const float x1 = gridCoordinate(col + 1, mCalibration.width);
+    const float y0 = gridCoordinate(row, mCalibration.height);
+    const float y1 = gridCoordinate(row + 1, mCalibration.height);
+    const float u = (x - x0) / (x1 - x0);
+    const float v = (y - y0) / (y1 - y0);
+
+    *groundX = (1 - v) * ((1 - u) * topLeft.x + u * topRight.x) +
+               v * ((1 - u) * bottomLeft.x + u * bottomRight.x);
+    *groundY = (1 - v) * ((1 - u) * topLeft.y + u * topRight.y) +
+               v * ((1 - u) * bottomLeft.y + u * bottomRight.y);
+    return true;
+}
+
+bool GroundProjection::solve(float x, float y, GridPoint* point) const {
+    point->valid = false;
+
+    // Undo the radial distortion: find the undistorted normalized coordinates
+    // which the lens moves to the ones of the pixel.
+    const float distortedX = (x - mCalibration.cx) / mCalibration.fx;
+    const float distortedY = (y - mCalibration.cy) / mCalibration.fy;
+    float normalX = distortedX;
+    float normalY = distortedY;
+    for (int i = 0; i < kUndistortIterations; i++) {
+        const float r2 = normalX * normalX + normalY * normalY;
+        const float factor = 1 + mCalibration.k1 * r2 + mCalibration.k2 * r2 * r2;
+        normalX = distortedX / factor;
+        normalY = distortedY / factor;
+    }
+
+    float ray[3];
+    for (int i = 0; i < 3; i++) {
+        ray[i] = normalX * mRight[i] + normalY * mDown[i] + mForward[i];
+    }
+    if (ray[2] > -kMinRayDip) {
+        return false;
+    }
+
+    const float distance = -mCalibration.position[2] / ray[2];
+    point->x = mCalibration.position[0] + distance * ray[0];
+    point->y = mCalibration.position[1] + distance * ray[1];
+    point->valid = true;
+    return true;
+}
+
+float GroundProjection::gridCoordinate(int index, int size) {
+    return std::min(index * kGridStep, size - 1);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
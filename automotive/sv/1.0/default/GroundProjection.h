@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Intrinsics, lens distortion and pose of a surround view camera.
+// Positions are in millimeters, in the android automotive axes: X to the right,
+// Y forward, Z up, origin on the ground at the center of the car.
+struct CameraCalibration {
+    std::string cameraId;
+    int width;          // Frame size in pixels
+    int height;
+    float fx, fy;       // Focal lengths in pixels
+    float cx, cy;       // Principal point in pixels
+    float k1, k2;       // Radial distortion coefficients
+    float position[3];  // Optical center
+    float yaw;          // Heading of the optical axis, radians counterclockwise from +Y
+    float pitch;        // Tilt of the optical axis below the horizon, radians
+};
+
+// Calibration of the cameras of this implementation, in the order of their ids.
+const std::vector<CameraCalibration>& getCameraCalibrations();
+
+// Maps the pixels of a camera to the ground plane.
+//
+// Undistorting a pixel takes an iterative solve, so it is done once at
+// construction for a grid of pixels, and points in between are interpolated.
+// Only the cells where the grid crosses the horizon are solved again per
+// point.
+class GroundProjection {
+public:
+    explicit GroundProjection(const CameraCalibration& calibration);
+
+    // Returns the projection of the camera with the given id, built on first
+    // use, or nullptr if there is no such camera.
+    static const GroundProjection* get(const std::string& cameraId);
+
+    // Projects the camera pixel (x, y) to the ground plane, in millimeters.
+    // Returns false if the pixel is outside of the camera frame, or sees above
+    // the horizon.
+    bool project(float x, float y, float* groundX, float* groundY) const;
+
+private:
+    struct GridPoint {
+        float x;
+        float y;
+        bool valid;
+    };
+
+    // Distance between the grid points, in pixels
+    static constexpr int kGridStep = 8;
+
+    bool solve(float x, float y, GridPoint* point) const;
+    static float gridCoordinate(int index, int size);
+
+    const CameraCalibration mCalibration;
+
+    // Camera axes in the car coordinates
+    float mRight[3];
+    float mDown[3];
+    float mForward[3];
+
+    int mGridWidth;
+    int mGridHeight;
+    std::vector<GridPoint> mGrid;  // Row major
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
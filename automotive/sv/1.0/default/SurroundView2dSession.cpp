@@ -16,9 +16,13 @@
 
 #include "SurroundView2dSession.h"
 
+#include "GroundProjection.h"
+
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
 
+#include <chrono>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -26,9 +30,16 @@ namespace sv {
 namespace V1_0 {
 namespace implementation {
 
+static const int kFramesPerSecond = 30;
+
 SurroundView2dSession::SurroundView2dSession() :
     mStreamState(STOPPED) {
-    mEvsCameraIds = {"0" , "1", "2", "3"};
+    // 8m x 6m of ground around the center of the car, keeping 4:3 ratio
+    mMappingInfo.width = 8000;
+    mMappingInfo.height = 6000;
+    mMappingInfo.center.isValid = true;
+    mMappingInfo.center.x = 0;
+    mMappingInfo.center.y = 0;
 
     mConfig.width = 640;
     mConfig.blending = SvQuality::HIGH;
@@ -108,13 +119,7 @@ Return<void> SurroundView2dSession::get2dMappingInfo(
     ALOGD("SurroundView2dSession::get2dMappingInfo");
     std::unique_lock <std::mutex> lock(mAccessLock);
 
-    Sv2dMappingInfo info;
-    info.width = 8; // keeps ratio to 4:3
-    info.height = 6;
-    info.center.isValid = true;
-    info.center.x = 0;
-    info.center.y = 0;
-    _hidl_cb(info);
+    _hidl_cb(mMappingInfo);
     return android::hardware::Void();
 }
 
@@ -146,16 +151,8 @@ Return<void> SurroundView2dSession::projectCameraPoints(
     ALOGD("SurroundView2dSession::projectCameraPoints");
     std::unique_lock <std::mutex> lock(mAccessLock);
 
-    bool cameraIdFound = false;
-    for (auto evsCameraId : mEvsCameraIds) {
-      if (cameraId == evsCameraId) {
-          cameraIdFound = true;
-          ALOGI("Camera id found.");
-          break;
-      }
-    }
-
-    if (!cameraIdFound) {
+    const GroundProjection* projection = GroundProjection::get(cameraId);
+    if (projection == nullptr) {
         ALOGE("Camera id not found.");
         _hidl_cb(hidl_vec<Point2dFloat>());
         return android::hardware::Void();
@@ -164,13 +161,14 @@ Return<void> SurroundView2dSession::projectCameraPoints(
     hidl_vec<Point2dFloat> outPoints;
     outPoints.resize(points2dCamera.size());
 
-    int width = mConfig.width;
-    int height = mConfig.width * 3 / 4;
+    // Ground plane to surround view pixels, with Y forward pointing up
+    const float left = mMappingInfo.center.x - mMappingInfo.width / 2;
+    const float top = mMappingInfo.center.y + mMappingInfo.height / 2;
+    const float scale = mConfig.width / mMappingInfo.width;
     for (int i=0; i<points2dCamera.size(); i++) {
-        // Assuming all the points in the image frame can be projected into 2d
-        // Surround View space. Otherwise cannot.
-        if (points2dCamera[i].x < 0 || points2dCamera[i].y > width-1 ||
-            points2dCamera[i].x < 0 || points2dCamera[i].y > height-1) {
+        float groundX, groundY;
+        if (!projection->project(points2dCamera[i].x, points2dCamera[i].y,
+                                 &groundX, &groundY)) {
             ALOGW("SurroundView2dSession::projectCameraPoints "
                   "gets invalid 2d camera points. Ignored");
             outPoints[i].isValid = false;
@@ -178,8 +176,8 @@ Return<void> SurroundView2dSession::projectCameraPoints(
             outPoints[i].y = 10000;
         } else {
             outPoints[i].isValid = true;
-            outPoints[i].x = 0;
-            outPoints[i].y = 0;
+            outPoints[i].x = (groundX - left) * scale;
+            outPoints[i].y = (top - groundY) * scale;
         }
     }
 
@@ -192,6 +190,11 @@ void SurroundView2dSession::generateFrames() {
 
     int sequenceId = 0;
 
+    // Frames are due on a fixed schedule, so the time spent producing and
+    // delivering them doesn't lower the frame rate.
+    const std::chrono::nanoseconds framePeriod(1000 * 1000 * 1000 / kFramesPerSecond);
+    auto nextFrameTime = std::chrono::steady_clock::now();
+
     while(true) {
         {
             std::lock_guard<std::mutex> lock(mAccessLock);
@@ -207,7 +210,13 @@ void SurroundView2dSession::generateFrames() {
                 mConfig.width * 3 / 4;
         }
 
-        usleep(100 * 1000);
+        nextFrameTime += framePeriod;
+        const auto now = std::chrono::steady_clock::now();
+        if (nextFrameTime < now) {
+            // Running late: deliver right away, but don't burst to catch up
+            nextFrameTime = now;
+        }
+        std::this_thread::sleep_until(nextFrameTime);
 
         framesRecord.frames.timestampNs = elapsedRealtimeNano();
         framesRecord.frames.sequenceId = sequenceId++;
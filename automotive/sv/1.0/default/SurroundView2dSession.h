@@ -72,6 +72,7 @@ private:
     };
     StreamStateValues mStreamState;
 
+    Sv2dMappingInfo mMappingInfo;
     Sv2dConfig mConfig;
 
     std::thread mCaptureThread; // The thread we'll use to synthesize frames
@@ -85,8 +86,6 @@ private:
 
     // Synchronization necessary to deconflict mCaptureThread from the main service thread
     std::mutex mAccessLock;
-
-    std::vector<std::string> mEvsCameraIds;
 };
 
 }  // namespace implementation
@@ -16,17 +16,17 @@
 
 #include "SurroundView3dSession.h"
 
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstring>
 #include <set>
 
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
 
-#include <android/hidl/memory/1.0/IMemory.h>
 #include <hidlmemory/mapping.h>
 
-using ::android::hidl::memory::V1_0::IMemory;
-using ::android::hardware::hidl_memory;
-
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -34,6 +34,8 @@ namespace sv {
 namespace V1_0 {
 namespace implementation {
 
+static const int kFramesPerSecond = 30;
+
 SurroundView3dSession::SurroundView3dSession() :
     mStreamState(STOPPED){
 
@@ -147,73 +149,125 @@ Return<void> SurroundView3dSession::get3dConfig(get3dConfig_cb _hidl_cb) {
     return android::hardware::Void();
 }
 
-bool VerifyOverlayData(const OverlaysData& overlaysData) {
-    // Check size of shared memory matches overlaysMemoryDesc.
-    const int kVertexSize = 16;
-    const int kIdSize = 2;
-    int memDescSize = 0;
-    for (auto overlayMemDesc : overlaysData.overlaysMemoryDesc) {
-        memDescSize += kIdSize + kVertexSize * overlayMemDesc.verticesCount;
-    }
-    if (memDescSize != overlaysData.overlaysMemory.size()) {
-        ALOGE("shared memory and overlaysMemoryDesc size mismatch.");
+// Identifies the shared memory region behind hidlMemory. Every call receives
+// its own file descriptor for the memory, but they all refer to the same file.
+static bool GetMemoryRegion(const hidl_memory& hidlMemory, dev_t* dev, ino_t* ino) {
+    const native_handle_t* handle = hidlMemory.handle();
+    if (handle == nullptr || handle->numFds < 1) {
         return false;
     }
 
-    // Map memory.
-    sp<IMemory> pSharedMemory = mapMemory(overlaysData.overlaysMemory);
-    if(pSharedMemory.get() == nullptr) {
-        ALOGE("mapMemory failed.");
+    struct stat st;
+    if (fstat(handle->data[0], &st) != 0) {
         return false;
     }
+    *dev = st.st_dev;
+    *ino = st.st_ino;
+    return true;
+}
 
-    // Get Data pointer.
-    uint8_t* pData = (uint8_t*)((void*)pSharedMemory->getPointer());
-    if (pData == nullptr) {
-        ALOGE("Shared memory getPointer() failed.");
-        return false;
+sp<IMemory> SurroundView3dSession::mapOverlaysMemory_Locked(const hidl_memory& hidlMemory) {
+    // Clients animating overlays update them from the same shared memory over
+    // and over, so keep it mapped rather than mapping it again at every update.
+    dev_t dev;
+    ino_t ino;
+    const bool hasRegion = GetMemoryRegion(hidlMemory, &dev, &ino);
+    if (hasRegion && mOverlaysMemory.get() != nullptr &&
+            dev == mOverlaysMemoryDev && ino == mOverlaysMemoryIno &&
+            mOverlaysMemory->getSize() == hidlMemory.size()) {
+        return mOverlaysMemory;
     }
 
-    int idOffset = 0;
-    std::set<uint16_t> overlayIdSet;
-    for (auto overlayMemDesc : overlaysData.overlaysMemoryDesc) {
+    sp<IMemory> pSharedMemory = mapMemory(hidlMemory);
+    if (hasRegion && pSharedMemory.get() != nullptr) {
+        mOverlaysMemory = pSharedMemory;
+        mOverlaysMemoryDev = dev;
+        mOverlaysMemoryIno = ino;
+    } else {
+        mOverlaysMemory = nullptr;
+    }
+    return pSharedMemory;
+}
 
-        if (overlayIdSet.find(overlayMemDesc.id) != overlayIdSet.end()) {
+Return<SvResult>  SurroundView3dSession::updateOverlays(
+        const OverlaysData& overlaysData) {
+    ALOGD("SurroundView3dSession::updateOverlays");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // Validate the descriptors first, which doesn't need the memory.
+    const int kVertexSize = 16;
+    const int kIdSize = 2;
+    int memDescSize = 0;
+    std::set<uint16_t> overlayIdSet;
+    for (const auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
+        if (!overlayIdSet.insert(overlayMemDesc.id).second) {
             ALOGE("Duplicate id within memory descriptor.");
-            return false;
+            return SvResult::INVALID_ARG;
         }
-        overlayIdSet.insert(overlayMemDesc.id);
 
-        if(overlayMemDesc.verticesCount < 3) {
+        if (overlayMemDesc.verticesCount < 3) {
             ALOGE("Less than 3 vertices.");
-            return false;
+            return SvResult::INVALID_ARG;
         }
 
         if (overlayMemDesc.overlayPrimitive == OverlayPrimitive::TRIANGLES &&
                 overlayMemDesc.verticesCount % 3 != 0) {
             ALOGE("Triangles primitive does not have vertices multiple of 3.");
-            return false;
+            return SvResult::INVALID_ARG;
         }
 
-        uint16_t overlayId = *((uint16_t*)(pData + idOffset));
+        memDescSize += kIdSize + kVertexSize * overlayMemDesc.verticesCount;
+    }
 
+    // Check size of shared memory matches overlaysMemoryDesc.
+    if (memDescSize != overlaysData.overlaysMemory.size()) {
+        ALOGE("shared memory and overlaysMemoryDesc size mismatch.");
+        return SvResult::INVALID_ARG;
+    }
+
+    sp<IMemory> pSharedMemory = mapOverlaysMemory_Locked(overlaysData.overlaysMemory);
+    if (pSharedMemory.get() == nullptr) {
+        ALOGE("mapMemory failed.");
+        return SvResult::INVALID_ARG;
+    }
+
+    // Get Data pointer.
+    const uint8_t* pData = (uint8_t*)((void*)pSharedMemory->getPointer());
+    if (pData == nullptr) {
+        ALOGE("Shared memory getPointer() failed.");
+        return SvResult::INVALID_ARG;
+    }
+
+    // All the ids must match before any overlay is updated.
+    int idOffset = 0;
+    for (const auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
+        uint16_t overlayId;
+        memcpy(&overlayId, pData + idOffset, kIdSize);
         if (overlayId != overlayMemDesc.id) {
             ALOGE("Overlay id mismatch %d , %d", overlayId, overlayMemDesc.id);
-            return false;
+            return SvResult::INVALID_ARG;
         }
 
         idOffset += kIdSize + (kVertexSize * overlayMemDesc.verticesCount);
     }
 
-    return true;
-}
-
-Return<SvResult>  SurroundView3dSession::updateOverlays(
-        const OverlaysData& overlaysData) {
+    // Overlays not passed stay as they are, and the ones passed only take new
+    // data if it changed.
+    idOffset = 0;
+    for (const auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
+        const uint8_t* pVertices = pData + idOffset + kIdSize;
+        const size_t verticesSize = kVertexSize * overlayMemDesc.verticesCount;
+        idOffset += kIdSize + verticesSize;
+
+        Overlay& overlay = mOverlays[overlayMemDesc.id];
+        if (overlay.primitive == overlayMemDesc.overlayPrimitive &&
+                overlay.vertices.size() == verticesSize &&
+                memcmp(overlay.vertices.data(), pVertices, verticesSize) == 0) {
+            continue;
+        }
 
-    if(!VerifyOverlayData(overlaysData)) {
-        ALOGE("VerifyOverlayData failed.");
-        return SvResult::INVALID_ARG;
+        overlay.primitive = overlayMemDesc.overlayPrimitive;
+        overlay.vertices.assign(pVertices, pVertices + verticesSize);
     }
 
     return SvResult::OK;
@@ -260,6 +314,11 @@ void SurroundView3dSession::generateFrames() {
 
     int sequenceId = 0;
 
+    // Frames are due on a fixed schedule, so the time spent producing and
+    // delivering them doesn't lower the frame rate.
+    const std::chrono::nanoseconds framePeriod(1000 * 1000 * 1000 / kFramesPerSecond);
+    auto nextFrameTime = std::chrono::steady_clock::now();
+
     while(true) {
         {
             std::lock_guard<std::mutex> lock(mAccessLock);
@@ -270,7 +329,13 @@ void SurroundView3dSession::generateFrames() {
             }
         }
 
-        usleep(100 * 1000);
+        nextFrameTime += framePeriod;
+        const auto now = std::chrono::steady_clock::now();
+        if (nextFrameTime < now) {
+            // Running late: deliver right away, but don't burst to catch up
+            nextFrameTime = now;
+        }
+        std::this_thread::sleep_until(nextFrameTime);
 
         framesRecord.frames.timestampNs = elapsedRealtimeNano();
         framesRecord.frames.sequenceId = sequenceId++;
@@ -19,15 +19,21 @@
 #include <android/hardware/automotive/sv/1.0/types.h>
 #include <android/hardware/automotive/sv/1.0/ISurroundViewStream.h>
 #include <android/hardware/automotive/sv/1.0/ISurroundView3dSession.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <sys/types.h>
+
+#include <map>
 #include <thread>
 
 using namespace ::android::hardware::automotive::sv::V1_0;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_vec;
+using ::android::hidl::memory::V1_0::IMemory;
 using ::android::sp;
 using ::std::mutex;
 
@@ -65,6 +71,8 @@ public:
 private:
     void generateFrames();
 
+    sp<IMemory> mapOverlaysMemory_Locked(const hidl_memory& hidlMemory);
+
     enum StreamStateValues {
         STOPPED,
         RUNNING,
@@ -90,6 +98,19 @@ private:
     Sv3dConfig mConfig;
 
     std::vector<std::string> mEvsCameraIds;
+
+    struct Overlay {
+        OverlayPrimitive primitive = OverlayPrimitive::TRIANGLES;
+        std::vector<uint8_t> vertices;  // As laid out in the overlays memory
+    };
+
+    // Overlays in the scene, by id
+    std::map<uint16_t, Overlay> mOverlays;
+
+    // Last overlays memory mapped, and the shared memory region it maps
+    sp<IMemory> mOverlaysMemory;
+    dev_t mOverlaysMemoryDev = 0;
+    ino_t mOverlaysMemoryIno = 0;
 };
 
 }  // namespace implementation
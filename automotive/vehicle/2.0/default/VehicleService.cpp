@@ -20,10 +20,12 @@
 
 #include <iostream>
 
+#include <android-base/properties.h>
 #include <android/binder_process.h>
 #include <utils/Looper.h>
 #include <vhal_v2_0/EmulatedVehicleConnector.h>
 #include <vhal_v2_0/EmulatedVehicleHal.h>
+#include <vhal_v2_0/ShardedVehiclePropertyStore.h>
 #include <vhal_v2_0/VehicleHalManager.h>
 #include <vhal_v2_0/WatchdogClient.h>
 
@@ -32,7 +34,13 @@ using namespace android::hardware;
 using namespace android::hardware::automotive::vehicle::V2_0;
 
 int main(int /* argc */, char* /* argv */ []) {
-    auto store = std::make_unique<VehiclePropertyStore>();
+    // The sharded store lets readers proceed concurrently with writers of unrelated properties.
+    std::unique_ptr<VehiclePropertyStore> store;
+    if (base::GetBoolProperty("ro.vendor.vhal.sharded_property_store", false)) {
+        store = std::make_unique<ShardedVehiclePropertyStore>();
+    } else {
+        store = std::make_unique<VehiclePropertyStore>();
+    }
     auto connector = std::make_unique<impl::EmulatedVehicleConnector>();
     auto hal = std::make_unique<impl::EmulatedVehicleHal>(store.get(), connector.get());
     auto emulator = std::make_unique<impl::VehicleEmulator>(hal.get());
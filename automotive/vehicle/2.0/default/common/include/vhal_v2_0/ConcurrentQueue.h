@@ -17,11 +17,17 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 #define android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 
+#include <algorithm>
 #include <queue>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace android {
 
@@ -84,7 +90,153 @@ private:
     std::queue<T> mQueue;
 };
 
+/**
+ * Bounded lock-free multi-producer / single-consumer queue.
+ *
+ * Has the same contract as ConcurrentQueue, but producers never take a lock unless the consumer
+ * is sleeping in waitForItems(). Each slot carries a sequence number that tells producers whether
+ * the slot is free and the consumer whether it's been published. When the queue is full the
+ * pushed item is dropped and accounted in getDroppedCount().
+ *
+ * flush() and waitForItems() must only be called from a single consumer thread.
+ */
 template<typename T>
+class BoundedMpscQueue {
+public:
+    /* Capacity is rounded up to the nearest power of two. */
+    explicit BoundedMpscQueue(size_t capacity) {
+        size_t roundedCapacity = 1;
+        while (roundedCapacity < capacity) {
+            roundedCapacity <<= 1;
+        }
+        mMask = roundedCapacity - 1;
+        mSlots.reset(new Slot[roundedCapacity]);
+        for (size_t i = 0; i < roundedCapacity; i++) {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void waitForItems() {
+        if (!isEmptyConsumer()) {
+            return;
+        }
+        std::unique_lock<std::mutex> g(mLock);
+        mConsumerWaiting.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in push(): either the producer sees that we are waiting, or we see
+        // the item it has published.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (isEmptyConsumer() && mIsActive.load(std::memory_order_acquire)) {
+            mCond.wait(g);
+        }
+        mConsumerWaiting.store(false, std::memory_order_relaxed);
+    }
+
+    std::vector<T> flush() {
+        std::vector<T> items;
+        if (!mIsActive.load(std::memory_order_acquire)) {
+            return items;
+        }
+        while (true) {
+            Slot& slot = mSlots[mHead & mMask];
+            if (slot.sequence.load(std::memory_order_acquire) != mHead + 1) {
+                break;
+            }
+            items.push_back(std::move(slot.item));
+            // Hand the slot back to producers for the next lap over the ring.
+            slot.sequence.store(mHead + mMask + 1, std::memory_order_release);
+            mHead++;
+        }
+        return items;
+    }
+
+    void push(T&& item) {
+        if (!mIsActive.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        size_t pos = mTail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &mSlots[pos & mMask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Consumer hasn't released this slot yet, the queue is full.
+                mDroppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = mTail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = std::move(item);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mConsumerWaiting.load(std::memory_order_relaxed)) {
+            // Taking the lock guarantees the consumer is either blocked in wait() or hasn't
+            // checked for items yet.
+            { MuxGuard g(mLock); }
+            mCond.notify_one();
+        }
+    }
+
+    /* Deactivates the queue, thus no one can push items to it, also
+     * notifies all waiting thread.
+     */
+    void deactivate() {
+        {
+            MuxGuard g(mLock);
+            mIsActive.store(false, std::memory_order_release);
+        }
+        mCond.notify_all();  // To unblock all waiting consumers.
+    }
+
+    /* Returns number of items dropped because the queue was full. */
+    uint64_t getDroppedCount() const {
+        return mDroppedCount.load(std::memory_order_relaxed);
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue &) = delete;
+    BoundedMpscQueue &operator=(const BoundedMpscQueue &) = delete;
+private:
+    using MuxGuard = std::lock_guard<std::mutex>;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    bool isEmptyConsumer() const {
+        return mSlots[mHead & mMask].sequence.load(std::memory_order_acquire) != mHead + 1;
+    }
+
+    std::unique_ptr<Slot[]> mSlots;
+    size_t mMask;
+
+    // Keep producer and consumer indices on separate cache lines.
+    alignas(64) std::atomic<size_t> mTail {0};
+    alignas(64) size_t mHead = 0;  // Only accessed by the consumer.
+
+    std::atomic<bool> mIsActive {true};
+    std::atomic<bool> mConsumerWaiting {false};
+    std::atomic<uint64_t> mDroppedCount {0};
+    std::mutex mLock;
+    std::condition_variable mCond;
+};
+
+/**
+ * Consumes items from the queue in batches.
+ *
+ * With a fixed batch interval the consumer waits the same time after the first item arrives. With
+ * adaptive interval (minBatchInterval < maxBatchInterval) the window shrinks while batches are
+ * small, to reduce latency under light load, and grows under bursts to reduce number of callbacks.
+ */
+template<typename T, typename Queue = ConcurrentQueue<T>>
 class BatchingConsumer {
 private:
     enum class State {
@@ -102,14 +254,33 @@ public:
 
     using OnBatchReceivedFunc = std::function<void(const std::vector<T>& vec)>;
 
-    void run(ConcurrentQueue<T>* queue,
+    /* Batches with size above this make adaptive batch interval grow. */
+    static constexpr size_t kBurstBatchSize = 32;
+    /* Batches with size below this make adaptive batch interval shrink. */
+    static constexpr size_t kLightLoadBatchSize = 4;
+
+    void run(Queue* queue,
              std::chrono::nanoseconds batchInterval,
              const OnBatchReceivedFunc& func) {
+        run(queue, batchInterval, batchInterval, func);
+    }
+
+    void run(Queue* queue,
+             std::chrono::nanoseconds minBatchInterval,
+             std::chrono::nanoseconds maxBatchInterval,
+             const OnBatchReceivedFunc& func) {
         mQueue = queue;
-        mBatchInterval = batchInterval;
+        mMinBatchInterval = minBatchInterval;
+        mMaxBatchInterval = maxBatchInterval;
+        mBatchInterval = maxBatchInterval.count();
 
         mWorkerThread = std::thread(
-            &BatchingConsumer<T>::runInternal, this, func);
+            &BatchingConsumer<T, Queue>::runInternal, this, func);
+    }
+
+    /* Returns batch interval currently in use. */
+    std::chrono::nanoseconds getBatchInterval() const {
+        return std::chrono::nanoseconds(mBatchInterval.load());
     }
 
     void requestStop() {
@@ -129,7 +300,7 @@ private:
                 mQueue->waitForItems();
                 if (State::STOP_REQUESTED == mState) break;
 
-                std::this_thread::sleep_for(mBatchInterval);
+                std::this_thread::sleep_for(getBatchInterval());
                 if (State::STOP_REQUESTED == mState) break;
 
                 std::vector<T> items = mQueue->flush();
@@ -137,18 +308,33 @@ private:
                 if (items.size() > 0) {
                     onBatchReceived(items);
                 }
+                adjustBatchInterval(items.size());
             }
         }
 
         mState = State::STOPPED;
     }
 
+    void adjustBatchInterval(size_t batchSize) {
+        if (mMinBatchInterval == mMaxBatchInterval) return;
+
+        std::chrono::nanoseconds interval = getBatchInterval();
+        if (batchSize > kBurstBatchSize) {
+            interval = std::min(interval * 2, mMaxBatchInterval);
+        } else if (batchSize < kLightLoadBatchSize) {
+            interval = std::max(interval / 2, mMinBatchInterval);
+        }
+        mBatchInterval = interval.count();
+    }
+
 private:
     std::thread mWorkerThread;
 
     std::atomic<State> mState;
-    std::chrono::nanoseconds mBatchInterval;
-    ConcurrentQueue<T>* mQueue;
+    std::chrono::nanoseconds mMinBatchInterval;
+    std::chrono::nanoseconds mMaxBatchInterval;
+    std::atomic<int64_t> mBatchInterval;  // In nanoseconds.
+    Queue* mQueue;
 };
 
 }  // namespace android
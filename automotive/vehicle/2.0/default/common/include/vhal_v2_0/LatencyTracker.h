@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_LatencyTracker_H_
+#define android_hardware_automotive_vehicle_V2_0_LatencyTracker_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/* Stages a HAL event goes through in VehicleHalManager before it reaches the clients. */
+enum class LatencyStage {
+    // From VehicleHal::doHalEvent until the BatchingConsumer picked the event up.
+    QUEUE = 0,
+    // SubscriptionManager::distributeValuesToClients for the batch the event is part of.
+    DISTRIBUTE,
+    // IVehicleCallback::onPropertyEvent calls for the batch the event is part of.
+    DELIVER,
+    // From VehicleHal::doHalEvent until all clients were called.
+    TOTAL,
+    NUM_STAGES,
+};
+
+const char* toString(LatencyStage stage);
+
+/**
+ * Histogram of latencies with power of two buckets in microseconds. Recording is lock free and can
+ * be done concurrently with reading.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kNumBuckets = 24;  // Up to ~8 seconds.
+
+    void record(int64_t nanos);
+
+    uint64_t getCount() const;
+    int64_t getMaxNanos() const { return mMaxNanos.load(std::memory_order_relaxed); }
+    int64_t getMeanNanos() const;
+    /* Returns an upper bound of the given percentile, in the range [0, 1]. */
+    int64_t getPercentileNanos(double percentile) const;
+
+private:
+    std::array<std::atomic<uint32_t>, kNumBuckets> mBuckets{};
+    std::atomic<int64_t> mSumNanos{0};
+    std::atomic<int64_t> mMaxNanos{0};
+};
+
+/**
+ * Per property latency histograms for every LatencyStage.
+ *
+ * Properties are kept in a fixed size open addressing table, so lookups and inserts are lock free.
+ * Properties beyond kMaxProperties are counted but not tracked.
+ */
+class LatencyTracker {
+public:
+    static constexpr size_t kMaxProperties = 256;
+
+    LatencyTracker();
+
+    void record(int32_t prop, LatencyStage stage, int64_t nanos);
+
+    /* Dumps the histograms of every property, or the given one if prop isn't 0. */
+    void dump(int fd, int32_t prop = 0) const;
+
+private:
+    struct Entry {
+        std::atomic<int32_t> prop{0};
+        std::array<LatencyHistogram, static_cast<size_t>(LatencyStage::NUM_STAGES)> stages;
+    };
+
+    Entry* findOrInsert(int32_t prop);
+
+    std::unique_ptr<Entry[]> mEntries;
+    std::atomic<uint64_t> mUntrackedEvents{0};
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_LatencyTracker_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_Obd2FrameHistory_H_
+#define android_hardware_automotive_vehicle_V2_0_Obd2FrameHistory_H_
+
+#include <string>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+// Bounded history of OBD2 frames, e.g. OBD2_LIVE_FRAME values as built by Obd2SensorStore.
+//
+// Frames are kept in a ring buffer with one column per sensor, so reading a single sensor over
+// time touches contiguous memory, and sensor presence is tracked with the same bitmask layout as
+// VehiclePropValue::bytes of an OBD2 frame. Memory use is fixed at construction.
+//
+// This class is not thread-safe.
+class Obd2FrameHistory {
+   public:
+    Obd2FrameHistory(size_t capacity, size_t numIntegerSensors, size_t numFloatSensors);
+
+    // Appends a frame, evicting the oldest one if the history is full. Frames older than the
+    // newest recorded one are dropped. Sensors beyond the configured counts are ignored.
+    void record(const VehiclePropValue& frame);
+    void clear();
+
+    size_t size() const { return mSize; }
+    size_t capacity() const { return mCapacity; }
+
+    // Returns the timestamps of the frames recorded at or after since, oldest first.
+    std::vector<int64_t> getTimestamps(int64_t since = 0) const;
+
+    // Fills propValue with the frame recorded at timestamp, returns false if there is none.
+    bool fillPropValue(int64_t timestamp, VehiclePropValue* propValue) const;
+
+    // Appends timestamp and value of every frame recorded at or after since that has the sensor.
+    void readIntegerSensor(size_t index, int64_t since, std::vector<int64_t>* outTimestamps,
+                           std::vector<int32_t>* outValues) const;
+    void readFloatSensor(size_t index, int64_t since, std::vector<int64_t>* outTimestamps,
+                         std::vector<float>* outValues) const;
+
+   private:
+    // Returns the slot of the i-th oldest frame.
+    size_t slotAt(size_t i) const;
+    // Returns the position, in age order, of the first frame recorded at or after timestamp.
+    size_t lowerBound(int64_t timestamp) const;
+    bool isPresent(size_t slot, size_t sensorBit) const;
+
+    const size_t mCapacity;
+    const size_t mNumIntegerSensors;
+    const size_t mNumFloatSensors;
+    const size_t mBitmaskBytes;
+
+    size_t mNext = 0;  // Slot the next frame is written to.
+    size_t mSize = 0;
+
+    std::vector<int64_t> mTimestamps;       // [slot]
+    std::vector<std::string> mDtcs;         // [slot]
+    std::vector<int32_t> mIntegerColumns;   // [sensor * capacity + slot]
+    std::vector<float> mFloatColumns;       // [sensor * capacity + slot]
+    std::vector<uint8_t> mPresence;         // [slot * bitmaskBytes + byte]
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_Obd2FrameHistory_H_
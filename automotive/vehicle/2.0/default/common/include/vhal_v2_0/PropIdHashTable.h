@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_PropIdHashTable_H_
+#define android_hardware_automotive_vehicle_V2_0_PropIdHashTable_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Immutable open addressing table keyed by property ID.
+ *
+ * The set of property IDs is known when the table is built, so build() tries a few multiplicative
+ * hash functions and keeps the one with the shortest probe sequences. Probing stops after the
+ * longest sequence seen while building, for the property sets we ship a lookup touches at most two
+ * adjacent slots, and a single one if build() found a perfect hash.
+ *
+ * This class is not thread-safe, but concurrent lookups are fine once it's built.
+ */
+template <typename T>
+class PropIdHashTable {
+public:
+    static constexpr uint32_t kMaxSeeds = 32;
+
+    /* Replaces the content of the table, keys must be unique. */
+    void build(const std::vector<std::pair<int32_t, T>>& entries) {
+        uint32_t bits = 1;
+        // Keep the load factor at or below 1/2.
+        while ((size_t{1} << bits) < entries.size() * 2) {
+            bits++;
+        }
+        mShift = 32 - bits;
+        mSlots.assign(size_t{1} << bits, Slot{});
+
+        uint32_t bestMultiplier = 0;
+        uint32_t bestMaxProbe = UINT32_MAX;
+        for (uint32_t seed = 0; seed < kMaxSeeds && bestMaxProbe > 0; seed++) {
+            uint32_t multiplier = multiplierFor(seed);
+            uint32_t maxProbe = fill(entries, multiplier);
+            if (maxProbe < bestMaxProbe) {
+                bestMaxProbe = maxProbe;
+                bestMultiplier = multiplier;
+            }
+        }
+        if (bestMultiplier != mMultiplier) {
+            fill(entries, bestMultiplier);
+        }
+        mMaxProbe = entries.empty() ? 0 : bestMaxProbe;
+        mSize = entries.size();
+    }
+
+    /* Returns the value stored for the key or nullptr. */
+    const T* find(int32_t key) const {
+        if (mSize == 0) return nullptr;
+        size_t mask = mSlots.size() - 1;
+        size_t slot = hash(key, mMultiplier);
+        for (uint32_t probe = 0; probe <= mMaxProbe; probe++) {
+            const Slot& s = mSlots[(slot + probe) & mask];
+            if (!s.used) return nullptr;
+            if (s.key == key) return &s.value;
+        }
+        return nullptr;
+    }
+
+    size_t size() const { return mSize; }
+
+    /* Longest probe sequence, 0 means every key is found in its first slot. */
+    uint32_t getMaxProbe() const { return mMaxProbe; }
+
+private:
+    struct Slot {
+        int32_t key = 0;
+        bool used = false;
+        T value{};
+    };
+
+    static constexpr uint32_t multiplierFor(uint32_t seed) {
+        // Odd multipliers spread around the golden ratio constant used by Fibonacci hashing.
+        return (0x9E3779B1u + seed * 0x85EBCA6Au) | 1u;
+    }
+
+    size_t hash(int32_t key, uint32_t multiplier) const {
+        return (static_cast<uint32_t>(key) * multiplier) >> mShift;
+    }
+
+    /* Fills the slots using the given multiplier and returns the longest probe sequence. */
+    uint32_t fill(const std::vector<std::pair<int32_t, T>>& entries, uint32_t multiplier) {
+        std::fill(mSlots.begin(), mSlots.end(), Slot{});
+        mMultiplier = multiplier;
+        size_t mask = mSlots.size() - 1;
+        uint32_t maxProbe = 0;
+        for (const auto& entry : entries) {
+            size_t slot = hash(entry.first, multiplier);
+            uint32_t probe = 0;
+            while (mSlots[(slot + probe) & mask].used) {
+                probe++;
+            }
+            Slot& s = mSlots[(slot + probe) & mask];
+            s.key = entry.first;
+            s.used = true;
+            s.value = entry.second;
+            if (probe > maxProbe) maxProbe = probe;
+        }
+        return maxProbe;
+    }
+
+private:
+    std::vector<Slot> mSlots;
+    uint32_t mShift = 32;
+    uint32_t mMultiplier = 0;
+    uint32_t mMaxProbe = 0;
+    size_t mSize = 0;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_PropIdHashTable_H_
@@ -17,13 +17,18 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 #define android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <list>
 #include <mutex>
+#include <queue>
 #include <set>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -31,6 +36,10 @@
 /**
  * This class allows to specify multiple time intervals to receive
  * notifications. A single thread is used internally.
+ *
+ * Pending deadlines are kept in a min-heap, so scheduling costs O(log n) and a wake-up only
+ * touches events that are due. Cookies that are due at the same wake-up are delivered in a single
+ * Action call.
  */
 class RecurrentTimer {
 private:
@@ -40,6 +49,14 @@ private:
 public:
     using Action = std::function<void(const std::vector<int32_t>& cookies)>;
 
+    /* How late events were delivered compared to their deadline. */
+    struct JitterStats {
+        uint64_t eventCount = 0;
+        Nanos totalLateness{0};
+        Nanos maxLateness{0};
+        uint64_t missedDeadlines = 0;  // Events that were late by one interval or more.
+    };
+
     RecurrentTimer(const Action& action) : mAction(action) {
         mTimerThread = std::thread(&RecurrentTimer::loop, this, action);
     }
@@ -61,7 +78,11 @@ public:
 
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime };
+            // A generation that no deadline of a previous registration of the cookie can have,
+            // even if it was unregistered in between.
+            uint64_t generation = ++mLastGeneration;
+            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime, generation };
+            mDeadlines.push({ absoluteTime, cookie, generation });
         }
         mCond.notify_one();
     }
@@ -69,11 +90,34 @@ public:
     void unregisterRecurrentEvent(int32_t cookie) {
         {
             std::lock_guard<std::mutex> g(mLock);
+            // Heap entries of this cookie become stale and are dropped once they are due.
             mCookieToEventsMap.erase(cookie);
         }
         mCond.notify_one();
     }
 
+    JitterStats getJitterStats() const {
+        std::lock_guard<std::mutex> g(mLock);
+        return mJitterStats;
+    }
+
+    void dump(int fd, const std::string& indent) const {
+        JitterStats stats;
+        size_t eventCount;
+        {
+            std::lock_guard<std::mutex> g(mLock);
+            stats = mJitterStats;
+            eventCount = mCookieToEventsMap.size();
+        }
+        uint64_t avgLatenessUs = stats.eventCount == 0
+                ? 0 : stats.totalLateness.count() / stats.eventCount / 1000;
+        dprintf(fd, "%sRecurrent events: %zu\n", indent.c_str(), eventCount);
+        dprintf(fd, "%sDelivered: %" PRIu64 ", missed deadlines: %" PRIu64 "\n", indent.c_str(),
+                stats.eventCount, stats.missedDeadlines);
+        dprintf(fd, "%sLateness avg: %" PRIu64 "us, max: %" PRId64 "us\n", indent.c_str(),
+                avgLatenessUs,
+                static_cast<int64_t>(stats.maxLateness.count() / 1000));
+    }
 
 private:
 
@@ -81,6 +125,7 @@ private:
         Nanos interval;
         int32_t cookie;
         TimePoint absoluteTime;  // Absolute time of the next event.
+        uint64_t generation;  // Unique to each registration, see mLastGeneration.
 
         void updateNextEventTime(TimePoint now) {
             // We want to move time to next event by adding some number of intervals (usually 1)
@@ -91,29 +136,65 @@ private:
         }
     };
 
+    struct Deadline {
+        TimePoint absoluteTime;
+        int32_t cookie;
+        uint64_t generation;
+
+        bool operator>(const Deadline& other) const {
+            return absoluteTime > other.absoluteTime;
+        }
+    };
+
+    void recordLatenessLocked(const RecurrentEvent& event, TimePoint now) {
+        Nanos lateness = now - event.absoluteTime;
+        mJitterStats.eventCount++;
+        mJitterStats.totalLateness += lateness;
+        if (lateness > mJitterStats.maxLateness) {
+            mJitterStats.maxLateness = lateness;
+        }
+        if (lateness >= event.interval) {
+            mJitterStats.missedDeadlines++;
+        }
+    }
+
     void loop(const Action& action) {
         static constexpr auto kInvalidTime = TimePoint(Nanos::max());
 
         std::vector<int32_t> cookies;
+        std::vector<Deadline> rescheduled;
 
         while (!mStopRequested) {
             auto now = Clock::now();
             auto nextEventTime = kInvalidTime;
             cookies.clear();
+            rescheduled.clear();
 
             {
                 std::unique_lock<std::mutex> g(mLock);
 
-                for (auto&& it : mCookieToEventsMap) {
-                    RecurrentEvent& event = it.second;
-                    if (event.absoluteTime <= now) {
-                        event.updateNextEventTime(now);
-                        cookies.push_back(event.cookie);
-                    }
+                while (!mDeadlines.empty() && mDeadlines.top().absoluteTime <= now) {
+                    Deadline deadline = mDeadlines.top();
+                    mDeadlines.pop();
 
-                    if (nextEventTime > event.absoluteTime) {
-                        nextEventTime = event.absoluteTime;
+                    auto it = mCookieToEventsMap.find(deadline.cookie);
+                    if (it == mCookieToEventsMap.end()
+                            || it->second.generation != deadline.generation) {
+                        continue;  // Unregistered or re-registered with another interval.
                     }
+                    RecurrentEvent& event = it->second;
+                    recordLatenessLocked(event, now);
+                    event.updateNextEventTime(now);
+                    cookies.push_back(event.cookie);
+                    // Re-scheduled after the scan, every cookie is delivered once per wake-up.
+                    rescheduled.push_back({ event.absoluteTime, event.cookie, event.generation });
+                }
+                for (const Deadline& deadline : rescheduled) {
+                    mDeadlines.push(deadline);
+                }
+
+                if (!mDeadlines.empty()) {
+                    nextEventTime = mDeadlines.top().absoluteTime;
                 }
             }
 
@@ -131,6 +212,7 @@ private:
         {
             std::lock_guard<std::mutex> g(mLock);
             mCookieToEventsMap.clear();
+            mDeadlines = {};
         }
         mCond.notify_one();
         if (mTimerThread.joinable()) {
@@ -144,6 +226,11 @@ private:
     std::atomic_bool mStopRequested { false };
     Action mAction;
     std::unordered_map<int32_t, RecurrentEvent> mCookieToEventsMap;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> mDeadlines;
+    JitterStats mJitterStats;
+    // Generations are never reused, so a deadline popped from mDeadlines matches a registered
+    // event only if it was scheduled for that very registration.
+    uint64_t mLastGeneration = 0;
 };
 
 
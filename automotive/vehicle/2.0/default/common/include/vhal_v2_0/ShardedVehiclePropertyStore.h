@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_ShardedVehiclePropertyStore_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_ShardedVehiclePropertyStore_H_
+
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+
+#include "VehiclePropertyStore.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * VehiclePropertyStore that splits property values into shards by property ID.
+ *
+ * Every shard is guarded by its own reader-writer lock, so reads never block each other and a
+ * write only blocks access to properties that live in the same shard. Configs are registered once
+ * at start up and are protected by a separate reader-writer lock.
+ *
+ * Values of the same property are kept in the same shard and sorted by area and token, but
+ * readAllValues() makes no ordering guarantees across properties.
+ */
+class ShardedVehiclePropertyStore : public VehiclePropertyStore {
+public:
+    static constexpr size_t kShardCount = 16;
+
+    void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr,
+                          const EvictionPolicy& evictionPolicy = {}) override;
+
+    bool writeValue(const VehiclePropValue& propValue, bool updateStatus) override;
+
+    void removeValue(const VehiclePropValue& propValue) override;
+    void removeValuesForProperty(int32_t propId) override;
+
+    std::vector<VehiclePropValue> readAllValues() const override;
+    std::vector<VehiclePropValue> readValuesForProperty(int32_t propId) const override;
+    std::unique_ptr<VehiclePropValue> readValueOrNull(
+            const VehiclePropValue& request) const override;
+    std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
+                                                      int64_t token = 0) const override;
+    void readValues(const std::vector<VehiclePropValue>& requests,
+                    const ReadValueFunction& func) const override;
+    std::vector<VehiclePropValue> readValuesChangedSince(uint64_t token,
+                                                         uint64_t* outToken) const override;
+
+    std::vector<VehiclePropConfig> getAllConfigs() const override;
+    const VehiclePropConfig* getConfigOrNull(int32_t propId) const override;
+
+    MemoryStats getMemoryStats() const override;
+
+private:
+    struct Shard {
+        mutable std::shared_mutex lock;
+        PropertyMap values;
+        ChangeTracker changes;
+        size_t evictions = 0;
+    };
+
+    using ReadGuard = std::shared_lock<std::shared_mutex>;
+    using WriteGuard = std::unique_lock<std::shared_mutex>;
+
+    /* Returns false if property wasn't registered. */
+    bool getRecordId(const VehiclePropValue& valuePrototype, RecordId* outRecId,
+                     EvictionPolicy* outEvictionPolicy = nullptr) const;
+
+    static size_t shardIndexFor(int32_t propId);
+    Shard& shardFor(int32_t propId);
+    const Shard& shardFor(int32_t propId) const;
+
+    static const StoredValue* getValueOrNullLocked(const Shard& shard, const RecordId& recId);
+    static PropertyMapRange findRangeLocked(const Shard& shard, int32_t propId);
+
+private:
+    mutable std::shared_mutex mConfigLock;
+    RecordConfigMap mConfigs;
+    RecordConfigTable mConfigTable;  // Points into mConfigs.
+
+    std::array<Shard, kShardCount> mShards;
+    // Generation of the last write, incremented while holding the lock of the written shard.
+    std::atomic<uint64_t> mGeneration{0};
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_ShardedVehiclePropertyStore_H_
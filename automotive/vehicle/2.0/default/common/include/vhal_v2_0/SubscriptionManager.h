@@ -21,6 +21,8 @@
 #include <map>
 #include <set>
 #include <list>
+#include <string>
+#include <vector>
 
 #include <android/log.h>
 #include <hidl/HidlSupport.h>
@@ -52,10 +54,27 @@ public:
     bool isSubscribed(int32_t propId, SubscribeFlags flags);
     std::vector<int32_t> getSubscribedProperties() const;
 
+    /**
+     * Decimates continuous property events down to the sample rate this client has requested,
+     * other clients may have subscribed to the same property with a higher rate. Must only be
+     * called for values of properties the client is subscribed to.
+     */
+    bool shouldForward(const VehiclePropValue& value);
+
+    void dump(int fd, const std::string& indent) const;
+
 private:
+    struct Subscription {
+        SubscribeOptions options;
+        // Earliest timestamp of the next event to forward, per area.
+        std::map<int32_t, int64_t> nextForwardTimestamp;
+        uint64_t forwardedCount = 0;
+        uint64_t droppedCount = 0;
+    };
+
     const sp<IVehicleCallback> mCallback;
 
-    std::map<int32_t, SubscribeOptions> mSubscriptions;
+    std::map<int32_t, Subscription> mSubscriptions;
 };
 
 class HalClientVector : private SortedVector<sp<HalClient>> , public RefBase {
@@ -73,9 +92,40 @@ public:
     using SortedVector::isEmpty;
 };
 
-struct HalClientValues {
-    sp<HalClient> client;
-    std::list<VehiclePropValue *> values;
+/**
+ * Per-client buffers of values ready for dispatching.
+ *
+ * Buffers are kept between batches, once they have grown to the size of a typical batch,
+ * distributing values to clients doesn't allocate anymore. Stored values are shallow copies of the
+ * values given to SubscriptionManager::distributeValuesToClients and only valid while those are.
+ *
+ * This class is not thread-safe.
+ */
+class HalClientEventBuffers {
+public:
+    /* Returns number of clients that received values in current batch. */
+    size_t size() const { return mActiveCount; }
+
+    const sp<HalClient>& clientAt(size_t index) const { return mEntries[index].client; }
+
+    /* Points outValues to the values for the client at given index without copying them. */
+    void valuesAt(size_t index, hidl_vec<VehiclePropValue>* outValues);
+
+    /* Starts a new batch. Forgets buffers of clients that no longer exist. */
+    void reset();
+
+    void append(const sp<HalClient>& client, const VehiclePropValue& value);
+
+private:
+    struct Entry {
+        sp<HalClient> client;
+        std::vector<VehiclePropValue> values;
+        size_t count;
+    };
+
+    // First mActiveCount entries have values in current batch.
+    std::vector<Entry> mEntries;
+    size_t mActiveCount = 0;
 };
 
 using ClientId = uint64_t;
@@ -107,12 +157,14 @@ public:
                                        std::list<SubscribeOptions>* outUpdatedOptions);
 
     /**
-     * Returns a list of IVehicleCallback -> list of VehiclePropValue ready for
-     * dispatching to its clients.
+     * Fills outBuffers with IVehicleCallback -> VehiclePropValues ready for dispatching to its
+     * clients. outBuffers is reset first, callers are expected to reuse it across batches.
      */
-    std::list<HalClientValues> distributeValuesToClients(
+    void distributeValuesToClients(
             const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-            SubscribeFlags flags) const;
+            SubscribeFlags flags, HalClientEventBuffers* outBuffers) const;
+    void distributeValuesToClients(const std::vector<const VehiclePropValue*>& propValues,
+                                   SubscribeFlags flags, HalClientEventBuffers* outBuffers) const;
 
     std::list<sp<HalClient>> getSubscribedClients(int32_t propId, SubscribeFlags flags) const;
     /**
@@ -120,6 +172,9 @@ public:
      * in the constructor will be called.
      */
     void unsubscribe(ClientId clientId, int32_t propId);
+
+    /* Dumps subscriptions of all clients, including forwarded and dropped event counts. */
+    void dump(int fd) const;
 private:
     std::list<sp<HalClient>> getSubscribedClientsLocked(int32_t propId,
                                                         SubscribeFlags flags) const;
@@ -130,6 +185,10 @@ private:
 
     sp<HalClientVector> getClientsForPropertyLocked(int32_t propId) const;
 
+    template <typename Values>
+    void distributeValuesToClientsImpl(const Values& propValues, SubscribeFlags flags,
+                                       HalClientEventBuffers* outBuffers) const;
+
     sp<HalClient> getOrCreateHalClientLocked(ClientId callingPid,
                                              const sp<IVehicleCallback>& callback);
 
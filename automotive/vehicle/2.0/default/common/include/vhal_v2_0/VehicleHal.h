@@ -46,6 +46,35 @@ public:
 
     virtual StatusCode set(const VehiclePropValue& propValue) = 0;
 
+    /**
+     * Batched variant of get(). outValues and outStatus are resized to the number of requests,
+     * outValues[i] is only set if outStatus[i] is StatusCode::OK.
+     *
+     * By default it calls get() for every request. Implementations backed by a VehiclePropertyStore
+     * should override it to read the whole batch with VehiclePropertyStore::readValues().
+     */
+    virtual void getValues(const std::vector<VehiclePropValue>& requests,
+                           std::vector<VehiclePropValuePtr>* outValues,
+                           std::vector<StatusCode>* outStatus) {
+        outValues->resize(requests.size());
+        outStatus->resize(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            (*outValues)[i] = get(requests[i], &(*outStatus)[i]);
+        }
+    }
+
+    /**
+     * Batched variant of set(), outStatus is resized to the number of values. By default it calls
+     * set() for every value.
+     */
+    virtual void setValues(const std::vector<VehiclePropValue>& values,
+                           std::vector<StatusCode>* outStatus) {
+        outStatus->resize(values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            (*outStatus)[i] = set(values[i]);
+        }
+    }
+
     /**
      * Subscribe to HAL property events. This method might be called multiple
      * times for the same vehicle property to update sample rate.
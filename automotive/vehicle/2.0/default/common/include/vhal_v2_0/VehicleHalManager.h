@@ -29,6 +29,7 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
 #include "ConcurrentQueue.h"
+#include "LatencyTracker.h"
 #include "SubscriptionManager.h"
 #include "VehicleHal.h"
 #include "VehicleObjectPool.h"
@@ -75,11 +76,27 @@ public:
 
     Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
+    // ---------------------------------------------------------------------------------------------
+    // Batched variants of get() and set() for in-process callers, e.g. a native CarService bridge
+    // reading all properties at start up. Configs and permissions are checked once per value and
+    // the batch is passed to VehicleHal at once, outValues[i] is only set if outStatus[i] is OK.
+    void getValues(const std::vector<VehiclePropValue>& requests,
+                   std::vector<VehicleHal::VehiclePropValuePtr>* outValues,
+                   std::vector<StatusCode>* outStatus);
+    void setValues(const std::vector<VehiclePropValue>& values,
+                   std::vector<StatusCode>* outStatus);
+
   private:
     using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
     // Returns true if needs to call again shortly.
     using RetriableAction = std::function<bool()>;
 
+    // Element of the HAL event queue, timestamped when VehicleHal reported it.
+    struct HalEvent {
+        VehiclePropValuePtr value;
+        int64_t receivedNanos = 0;
+    };
+
     // ---------------------------------------------------------------------------------------------
     // Events received from VehicleHal
     void onHalEvent(VehiclePropValuePtr  v);
@@ -88,7 +105,7 @@ public:
 
     // ---------------------------------------------------------------------------------------------
     // This method will be called from BatchingConsumer thread
-    void onBatchHalEvent(const std::vector<VehiclePropValuePtr >& values);
+    void onBatchHalEvent(const std::vector<HalEvent>& events);
 
     void handlePropertySetEvent(const VehiclePropValue& value);
 
@@ -113,6 +130,7 @@ public:
     void cmdDumpAllProperties(int fd);
     void cmdDumpSpecificProperties(int fd, const hidl_vec<hidl_string>& options);
     void cmdSetOneProperty(int fd, const hidl_vec<hidl_string>& options);
+    void cmdDumpLatency(int fd, const hidl_vec<hidl_string>& options);
 
     static bool isSubscribable(const VehiclePropConfig& config,
                                SubscribeFlags flags);
@@ -125,10 +143,17 @@ private:
     std::unique_ptr<VehiclePropConfigIndex> mConfigIndex;
     SubscriptionManager mSubscriptionManager;
 
-    hidl_vec<VehiclePropValue> mHidlVecOfVehiclePropValuePool;
+    // Only accessed from BatchingConsumer thread.
+    HalClientEventBuffers mClientEventBuffers;
+    std::vector<const VehiclePropValue*> mBatchValues;
+
+    LatencyTracker mLatencyTracker;
 
-    ConcurrentQueue<VehiclePropValuePtr> mEventQueue;
-    BatchingConsumer<VehiclePropValuePtr> mBatchingConsumer;
+    // HAL events are pushed from generator, emulator and vendor threads.
+    static constexpr size_t kEventQueueCapacity = 4096;
+    BoundedMpscQueue<HalEvent> mEventQueue{kEventQueueCapacity};
+    BatchingConsumer<HalEvent, BoundedMpscQueue<HalEvent>> mBatchingConsumer;
+    uint64_t mLastReportedDroppedEvents = 0;  // Only accessed from BatchingConsumer thread.
     VehiclePropValuePool mValueObjectPool;
 };
 
@@ -18,10 +18,14 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 
-#include <deque>
-#include <map>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
@@ -75,27 +79,67 @@ using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
  * multiple threads is OK, also client can obtain an object in one thread and
  * then move ownership to another thread.
  *
+ * Every thread keeps a small magazine of objects in front of the shared pool,
+ * so obtaining and recycling objects doesn't take a lock unless the magazine
+ * needs to be refilled from or spilled into the shared pool, which moves half
+ * a magazine at a time.
  */
 template<typename T>
 class ObjectPool {
 public:
-    ObjectPool() = default;
-    virtual ~ObjectPool() = default;
+    static constexpr size_t kMagazineSize = 16;
+
+    struct Stats {
+        uint64_t magazineHits;
+        uint64_t sharedHits;
+        uint64_t misses;
+    };
+
+    ObjectPool() : mId(sNextId++) {
+        std::lock_guard<std::mutex> g(sRegistryLock);
+        sRegistry[mId] = this;
+    }
+
+    virtual ~ObjectPool() {
+        {
+            std::lock_guard<std::mutex> g(sRegistryLock);
+            sRegistry.erase(mId);
+        }
+        // Magazines of other threads are deleted when those threads exit, pool ids aren't reused.
+        if (auto magazines = getThreadMagazines()) {
+            magazines->erase(mId);
+        }
+    }
 
     virtual recyclable_ptr<T> obtain() {
-        std::lock_guard<std::mutex> g(mLock);
         INC_METRIC_IF_DEBUG(Obtained)
-        if (mObjects.empty()) {
+        auto magazines = getThreadMagazines();
+        Magazine exitingThreadMagazine;
+        Magazine& magazine = magazines ? (*magazines)[mId] : exitingThreadMagazine;
+        if (magazine.empty()) {
+            refill(&magazine, magazines ? kMagazineSize / 2 : 1);
+        } else {
+            mMagazineHits.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (magazine.empty()) {
             INC_METRIC_IF_DEBUG(Created)
+            mMisses.fetch_add(1, std::memory_order_relaxed);
             return wrap(createObject());
         }
 
-        auto o = wrap(mObjects.front().release());
-        mObjects.pop_front();
-
+        auto o = wrap(magazine.back().release());
+        magazine.pop_back();
         return o;
     }
 
+    Stats getStats() const {
+        return {
+                .magazineHits = mMagazineHits.load(std::memory_order_relaxed),
+                .sharedHits = mSharedHits.load(std::memory_order_relaxed),
+                .misses = mMisses.load(std::memory_order_relaxed),
+        };
+    }
+
     ObjectPool& operator =(const ObjectPool &) = delete;
     ObjectPool(const ObjectPool &) = delete;
 
@@ -104,17 +148,76 @@ protected:
 
     virtual void recycle(T* o) {
         INC_METRIC_IF_DEBUG(Recycled)
-        std::lock_guard<std::mutex> g(mLock);
-        mObjects.push_back(std::unique_ptr<T> { o } );
+        auto magazines = getThreadMagazines();
+        if (magazines == nullptr) {
+            std::lock_guard<std::mutex> g(mLock);
+            mObjects.push_back(std::unique_ptr<T> { o } );
+            return;
+        }
+        Magazine& magazine = (*magazines)[mId];
+        if (magazine.size() == kMagazineSize) {
+            spill(&magazine, kMagazineSize / 2);
+        }
+        magazine.push_back(std::unique_ptr<T> { o } );
     }
 
 private:
-    const Deleter<T>& getDeleter() {
-        if (!mDeleter.get()) {
-            Deleter<T> *d = new Deleter<T>(std::bind(
-                &ObjectPool::recycle, this, std::placeholders::_1));
-            mDeleter.reset(d);
+    using Magazine = std::vector<std::unique_ptr<T>>;
+
+    using ThreadMagazines = std::unordered_map<uint64_t, Magazine>;
+
+    /**
+     * Returns the magazines of the calling thread, keyed by pool id, or nullptr if they were
+     * already destroyed because the thread is exiting.
+     */
+    static ThreadMagazines* getThreadMagazines() {
+        static thread_local bool tMagazinesDestroyed = false;
+        struct Holder {
+            ThreadMagazines magazines;
+            ~Holder() {
+                tMagazinesDestroyed = true;
+                // Hand the objects of an exiting thread back to the pools that are still alive.
+                std::lock_guard<std::mutex> g(sRegistryLock);
+                for (auto& it : magazines) {
+                    auto pool = sRegistry.find(it.first);
+                    if (pool != sRegistry.end()) {
+                        pool->second->spill(&it.second, it.second.size());
+                    }
+                }
+            }
+        };
+        if (tMagazinesDestroyed) {
+            return nullptr;
+        }
+        static thread_local Holder holder;
+        return &holder.magazines;
+    }
+
+    void refill(Magazine* magazine, size_t maxCount) {
+        std::lock_guard<std::mutex> g(mLock);
+        size_t count = std::min(mObjects.size(), maxCount);
+        for (size_t i = 0; i < count; i++) {
+            magazine->push_back(std::move(mObjects.back()));
+            mObjects.pop_back();
+        }
+        if (count > 0) {
+            mSharedHits.fetch_add(1, std::memory_order_relaxed);
         }
+    }
+
+    void spill(Magazine* magazine, size_t count) {
+        std::lock_guard<std::mutex> g(mLock);
+        for (size_t i = 0; i < count; i++) {
+            mObjects.push_back(std::move(magazine->back()));
+            magazine->pop_back();
+        }
+    }
+
+    const Deleter<T>& getDeleter() {
+        std::call_once(mDeleterOnce, [this] {
+            mDeleter.reset(new Deleter<T>(std::bind(
+                &ObjectPool::recycle, this, std::placeholders::_1)));
+        });
         return *mDeleter.get();
     }
 
@@ -123,9 +226,20 @@ private:
     }
 
 private:
+    static inline std::atomic<uint64_t> sNextId {0};
+    // Live pools by id, used to return objects from magazines of exiting threads.
+    static inline std::mutex sRegistryLock;
+    static inline std::unordered_map<uint64_t, ObjectPool*> sRegistry;
+
+    const uint64_t mId;
     mutable std::mutex mLock;
-    std::deque<std::unique_ptr<T>> mObjects;
+    std::vector<std::unique_ptr<T>> mObjects;
+    std::once_flag mDeleterOnce;
     std::unique_ptr<Deleter<T>> mDeleter;
+
+    std::atomic<uint64_t> mMagazineHits {0};
+    std::atomic<uint64_t> mSharedHits {0};
+    std::atomic<uint64_t> mMisses {0};
 };
 
 /**
@@ -174,8 +288,7 @@ public:
      * returning back to the object pool.
      *
      */
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4) :
-        mMaxRecyclableVectorSize(maxRecyclableVectorSize) {};
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4);
 
     RecyclableType obtain(VehiclePropertyType type);
 
@@ -188,6 +301,11 @@ public:
     RecyclableType obtainString(const char* cstr);
     RecyclableType obtainComplex();
 
+    /**
+     * Dumps hit and miss counters of every pool that was used.
+     */
+    void dump(int fd, const std::string& indent = "") const;
+
     VehiclePropValuePool(VehiclePropValuePool& ) = delete;
     VehiclePropValuePool& operator=(VehiclePropValuePool&) = delete;
 private:
@@ -201,6 +319,9 @@ private:
     RecyclableType obtainRecylable(VehiclePropertyType type,
                                    size_t vecSize);
 
+    /* Returns the index of recyclable types into mValueTypePools, or -1 for other types. */
+    static int getTypeIndex(VehiclePropertyType type);
+
     class InternalPool: public ObjectPool<VehiclePropValue> {
     public:
         InternalPool(VehiclePropertyType type, size_t vectorSize)
@@ -209,6 +330,9 @@ private:
         RecyclableType obtain() override {
             return ObjectPool<VehiclePropValue>::obtain();
         }
+
+        VehiclePropertyType getPropType() const { return mPropType; }
+        size_t getVectorSize() const { return mVectorSize; }
     protected:
         VehiclePropValue* createObject() override;
         void recycle(VehiclePropValue* o) override;
@@ -232,9 +356,11 @@ private:
     };
 
 private:
-    mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools;
+    // One pool for every recyclable type and vector size, indexed by
+    // getTypeIndex(type) * (mMaxRecyclableVectorSize + 1) + vecSize. Created upfront, so lookups
+    // don't need a lock.
+    std::vector<std::unique_ptr<InternalPool>> mValueTypePools;
 };
 
 }  // namespace V2_0
@@ -17,10 +17,10 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_VehiclePropConfigIndex_H_
 #define android_hardware_automotive_vehicle_V2_0_VehiclePropConfigIndex_H_
 
-#include <utils/KeyedVector.h>
-
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "PropIdHashTable.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -30,45 +30,44 @@ namespace V2_0 {
 /*
  * This is thread-safe immutable class to hold vehicle property configuration
  * data.
+ *
+ * Configs are kept in a contiguous array, lookups by property ID go through a PropIdHashTable
+ * built once from the fixed set of property IDs.
  */
 class VehiclePropConfigIndex {
 public:
     VehiclePropConfigIndex(
         const std::vector<VehiclePropConfig>& properties)
-        : mConfigs(properties), mPropToConfig(mConfigs)
-    {}
+        : mConfigs(properties)
+    {
+        std::vector<std::pair<int32_t, const VehiclePropConfig*>> entries;
+        entries.reserve(mConfigs.size());
+        for (const auto& config : mConfigs) {
+            entries.emplace_back(config.prop, &config);
+        }
+        mPropToConfig.build(entries);
+    }
 
     bool hasConfig(int32_t property) const {
-        return mPropToConfig.indexOfKey(property) >= 0;
+        return mPropToConfig.find(property) != nullptr;
     }
 
     const VehiclePropConfig& getConfig(int32_t property) const {
-        return *mPropToConfig.valueFor(property);
+        return **mPropToConfig.find(property);
+    }
+
+    const VehiclePropConfig* getConfigOrNull(int32_t property) const {
+        const VehiclePropConfig* const* config = mPropToConfig.find(property);
+        return config == nullptr ? nullptr : *config;
     }
 
     const std::vector<VehiclePropConfig>& getAllConfigs() const {
         return mConfigs;
     }
 
-private:
-    typedef KeyedVector<int32_t, const VehiclePropConfig*> PropConfigMap;
-    class ImmutablePropConfigMap : private PropConfigMap {
-    public:
-        ImmutablePropConfigMap(const std::vector<VehiclePropConfig>& configs) {
-            setCapacity(configs.size());
-            for (auto& config : configs) {
-                add(config.prop, &config);
-            }
-        }
-    public:
-        using PropConfigMap::valueFor;
-        using PropConfigMap::indexOfKey;
-    };
-
 private:
     const std::vector<VehiclePropConfig> mConfigs;
-    const ImmutablePropConfigMap mPropToConfig;  // mConfigs must be declared
-                                                 // first.
+    PropIdHashTable<const VehiclePropConfig*> mPropToConfig;  // Points into mConfigs.
 };
 
 }  // namespace V2_0
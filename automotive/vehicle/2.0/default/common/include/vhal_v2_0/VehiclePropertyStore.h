@@ -18,12 +18,17 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_PropertyDb_H_
 
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "PropIdHashTable.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -37,17 +42,41 @@ namespace V2_0 {
  * VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
  * to get value for all areas for particular property.
  *
- * This class is thread-safe, however it uses blocking synchronization across all methods.
+ * This class is thread-safe, however it uses blocking synchronization across all methods. See
+ * ShardedVehiclePropertyStore for a variant that allows concurrent readers.
  */
 class VehiclePropertyStore {
 public:
     /* Function that used to calculate unique token for given VehiclePropValue */
     using TokenFunction = std::function<int64_t(const VehiclePropValue& value)>;
+    /* Function that receives the stored value, or nullptr, for the request at given index */
+    using ReadValueFunction = std::function<void(size_t index, const VehiclePropValue* value)>;
+
+    /**
+     * Bounds the values kept for a property, for properties that store a value per token or carry
+     * large payloads, e.g. diagnostic frames. When a write takes the property over a bound, its
+     * least recently written values are evicted, but never the one just written. 0 is unbounded.
+     */
+    struct EvictionPolicy {
+        size_t maxRecords = 0;
+        size_t maxPayloadBytes = 0;  // Sum of bytes and stringValue sizes over all the values.
+    };
 
-private:
+    /* Estimated memory used by the stored values, including the bookkeeping per value. */
+    struct MemoryStats {
+        size_t records = 0;
+        size_t inlineRecords = 0;  // Values kept without any heap allocation of their own.
+        size_t bytes = 0;
+        size_t evictions = 0;  // Values evicted since start up.
+    };
+
+    virtual ~VehiclePropertyStore() = default;
+
+protected:
     struct RecordConfig {
         VehiclePropConfig propConfig;
         TokenFunction tokenFunction;
+        EvictionPolicy evictionPolicy;
     };
 
     struct RecordId {
@@ -59,40 +88,140 @@ private:
         bool operator<(const RecordId& other) const;
     };
 
-    using PropertyMap = std::map<RecordId, VehiclePropValue>;
+    /**
+     * A stored value, without the property ID which is part of its RecordId. Most properties hold
+     * a single int32, float or int64, or nothing at all; those are kept inline rather than in a
+     * RawValue, whose hidl_vecs cost a heap allocation each.
+     */
+    class StoredValue {
+    public:
+        explicit StoredValue(const VehiclePropValue& value);
+
+        /* Replaces timestamp and value, and status if updateStatus is set. */
+        void update(const VehiclePropValue& value, bool updateStatus);
+        /* Fills the value of property prop in, reusing outValue's storage where it can. */
+        void toValue(int32_t prop, VehiclePropValue* outValue) const;
+        VehiclePropValue toValue(int32_t prop) const;
+
+        int64_t timestamp() const { return mTimestamp; }
+        bool isInline() const { return mRawValue == nullptr; }
+        size_t payloadBytes() const;
+        size_t heapBytes() const;
+
+    private:
+        enum class InlineType : uint8_t { NONE, INT32, FLOAT, INT64 };  // NONE is empty if inline.
+
+        void setValue(const VehiclePropValue::RawValue& value);
+
+        int64_t mTimestamp;
+        int32_t mAreaId;
+        VehiclePropertyStatus mStatus;
+        InlineType mInlineType = InlineType::NONE;
+        union {
+            int32_t int32Value;
+            float floatValue;
+            int64_t int64Value;
+        } mInline{};
+        std::unique_ptr<VehiclePropValue::RawValue> mRawValue;  // nullptr if inline.
+    };
+
+    using PropertyMap = std::map<RecordId, StoredValue>;
     using PropertyMapRange = std::pair<PropertyMap::const_iterator, PropertyMap::const_iterator>;
+    using RecordConfigMap = std::unordered_map<int32_t /* VehicleProperty */, RecordConfig>;
+    using RecordConfigTable = PropIdHashTable<const RecordConfig*>;
+
+    /**
+     * Rebuilds the lookup table over the registered configs. Configs are registered at start up
+     * and looked up on every access, so lookups go through the table instead of the map.
+     */
+    static void buildConfigTable(const RecordConfigMap& configs, RecordConfigTable* outTable);
+
+    /**
+     * Remembers the generation at which every record was last written, ordered by generation so
+     * finding the records written since a given generation is proportional to their number.
+     *
+     * This class is not thread-safe.
+     */
+    class ChangeTracker {
+    public:
+        void onWrite(const RecordId& recId, uint64_t generation);
+        void onRemove(const RecordId& recId);
+        void onRemoveProperty(int32_t propId);
+        /* Returns the generation at which the record was last written, 0 if it wasn't. */
+        uint64_t generationOf(const RecordId& recId) const;
+
+        /* Calls func for every record written after the given generation, oldest first. */
+        void forEachChangedSince(uint64_t generation,
+                                 const std::function<void(const RecordId&)>& func) const;
+
+    private:
+        std::map<uint64_t /* generation */, RecordId> mChangeLog;
+        std::map<RecordId, uint64_t /* generation */> mGenerations;
+    };
+
+    /**
+     * Applies policy to the values of the property written was just written to, sparing written.
+     * Returns the number of values evicted.
+     */
+    static size_t evictLocked(const EvictionPolicy& policy, const RecordId& written,
+                              PropertyMap* values, ChangeTracker* changes);
+    static void addMemoryStatsLocked(const PropertyMap& values, MemoryStats* stats);
 
 public:
-    void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr);
+    virtual void registerProperty(const VehiclePropConfig& config,
+                                  TokenFunction tokenFunc = nullptr,
+                                  const EvictionPolicy& evictionPolicy = {});
 
     /* Stores provided value. Returns true if value was written returns false if config for
      * example wasn't registered. */
-    bool writeValue(const VehiclePropValue& propValue, bool updateStatus);
-
-    void removeValue(const VehiclePropValue& propValue);
-    void removeValuesForProperty(int32_t propId);
-
-    std::vector<VehiclePropValue> readAllValues() const;
-    std::vector<VehiclePropValue> readValuesForProperty(int32_t propId) const;
-    std::unique_ptr<VehiclePropValue> readValueOrNull(const VehiclePropValue& request) const;
-    std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
-                                                      int64_t token = 0) const;
-
-    std::vector<VehiclePropConfig> getAllConfigs() const;
-    const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
+    virtual bool writeValue(const VehiclePropValue& propValue, bool updateStatus);
+
+    virtual void removeValue(const VehiclePropValue& propValue);
+    virtual void removeValuesForProperty(int32_t propId);
+
+    virtual std::vector<VehiclePropValue> readAllValues() const;
+    virtual std::vector<VehiclePropValue> readValuesForProperty(int32_t propId) const;
+    virtual std::unique_ptr<VehiclePropValue> readValueOrNull(
+            const VehiclePropValue& request) const;
+    virtual std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
+                                                              int64_t token = 0) const;
+    /**
+     * Reads the values for a batch of requests while taking the lock once. The function is called
+     * with the lock being held and must not call back into the store; values passed to it are
+     * only valid during the call.
+     */
+    virtual void readValues(const std::vector<VehiclePropValue>& requests,
+                            const ReadValueFunction& func) const;
+
+    /**
+     * Returns the values written since the call that returned token, pass 0 to get all of them.
+     * outToken is set to the token for the next call. Removed values aren't reported, and values
+     * written while this is running may be returned again by the next call.
+     */
+    virtual std::vector<VehiclePropValue> readValuesChangedSince(uint64_t token,
+                                                                 uint64_t* outToken) const;
+
+    virtual std::vector<VehiclePropConfig> getAllConfigs() const;
+    virtual const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
     const VehiclePropConfig* getConfigOrDie(int32_t propId) const;
 
+    virtual MemoryStats getMemoryStats() const;
+
 private:
     RecordId getRecordIdLocked(const VehiclePropValue& valuePrototype) const;
-    const VehiclePropValue* getValueOrNullLocked(const RecordId& recId) const;
+    const StoredValue* getValueOrNullLocked(const RecordId& recId) const;
     PropertyMapRange findRangeLocked(int32_t propId) const;
 
 private:
     using MuxGuard = std::lock_guard<std::mutex>;
     mutable std::mutex mLock;
-    std::unordered_map<int32_t /* VehicleProperty */, RecordConfig> mConfigs;
+    RecordConfigMap mConfigs;
+    RecordConfigTable mConfigTable;  // Points into mConfigs.
 
-    PropertyMap mPropertyValues;  // Sorted map of RecordId : VehiclePropValue.
+    PropertyMap mPropertyValues;  // Sorted map of RecordId : StoredValue.
+    ChangeTracker mChangeTracker;
+    uint64_t mGeneration = 0;  // Generation of the last write.
+    size_t mEvictions = 0;
 };
 
 }  // namespace V2_0
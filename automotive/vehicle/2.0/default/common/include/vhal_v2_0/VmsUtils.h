@@ -20,6 +20,7 @@
 #include <memory>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
@@ -180,6 +181,53 @@ std::unique_ptr<VehiclePropValue> createPublisherIdRequest(
 std::unique_ptr<VehiclePropValue> createStartSessionMessage(const int service_id,
                                                             const int client_id);
 
+// Builds VMS messages into a VehiclePropValue owned by the builder instead of allocating a new
+// one per message. The int32Values and bytes of the returned message point into arenas that keep
+// their capacity across calls, so a publisher that reuses one builder for its data messages
+// doesn't allocate once the arenas have grown to the largest message.
+//
+// The returned reference is only valid until the next call on the same builder. Messages that
+// must outlive it have to be copied, e.g. by the VehiclePropValue copy constructor. A builder
+// must not be used from several threads at once.
+class VmsMessageBuilder {
+  public:
+    VmsMessageBuilder();
+    VmsMessageBuilder(const VmsMessageBuilder&) = delete;
+    VmsMessageBuilder& operator=(const VmsMessageBuilder&) = delete;
+
+    // Same contents as createSubscribeMessage.
+    const VehiclePropValue& subscribe(const VmsLayer& layer);
+
+    // Same contents as createSubscribeToPublisherMessage.
+    const VehiclePropValue& subscribeToPublisher(const VmsLayerAndPublisher& layer_publisher);
+
+    // Same contents as createUnsubscribeMessage.
+    const VehiclePropValue& unsubscribe(const VmsLayer& layer);
+
+    // Same contents as createUnsubscribeToPublisherMessage.
+    const VehiclePropValue& unsubscribeToPublisher(const VmsLayerAndPublisher& layer_publisher);
+
+    // Same contents as createOfferingMessage.
+    const VehiclePropValue& offering(const VmsOffers& offers);
+
+    // Same contents as createDataMessageWithLayerPublisherInfo. The packet is copied into the
+    // bytes arena, callers that serialize a proto can use SerializeToArray on a reused buffer
+    // and pass it here to avoid the intermediate string.
+    const VehiclePropValue& data(const VmsLayerAndPublisher& layer_publisher,
+                                 const uint8_t* vms_packet, size_t vms_packet_size);
+    const VehiclePropValue& data(const VmsLayerAndPublisher& layer_publisher,
+                                 const std::string& vms_packet);
+
+  private:
+    void beginMessage(VmsMessageType type);
+    void appendLayer(const VmsLayer& layer);
+    const VehiclePropValue& finishMessage();
+
+    VehiclePropValue mMessage;
+    std::vector<int32_t> mInt32Arena;
+    std::vector<uint8_t> mBytesArena;
+};
+
 // Returns true if the VehiclePropValue pointed to by value contains a valid Vms
 // message, i.e. the VehicleProperty, VehicleArea, and VmsMessageType are all
 // valid. Note: If the VmsMessageType enum is extended, this function will
@@ -251,6 +299,90 @@ int32_t getSequenceNumberForAvailabilityState(const VehiclePropValue& availabili
 // sequence number.
 std::vector<VmsAssociatedLayer> getAvailableLayers(const VehiclePropValue& availability_state);
 
+// A VmsAssociatedLayerView is a VmsAssociatedLayer whose publisher IDs point into the
+// int32Values of the parsed message.
+struct VmsAssociatedLayerView {
+    VmsLayer layer;
+    const int32_t* publisher_ids;
+    size_t publisher_id_count;
+};
+
+// The associated layers of a subscriptions or availability state, each laid out as
+// {type, subtype, version, number of publisher IDs, publisher IDs...}. Only valid as long as the
+// VehiclePropValue it was parsed from is alive and unchanged.
+class VmsAssociatedLayersView {
+  public:
+    size_t size() const { return mCount; }
+
+    // Calls func(const VmsAssociatedLayerView&) for every associated layer, in message order.
+    template <typename Func>
+    void forEach(Func func) const {
+        const int32_t* current = mValues;
+        for (size_t i = 0; i < mCount; i++) {
+            VmsAssociatedLayerView associated_layer = {
+                    .layer = VmsLayer(current[0], current[1], current[2]),
+                    .publisher_ids = current + 4,
+                    .publisher_id_count = static_cast<size_t>(current[3]),
+            };
+            func(associated_layer);
+            current += 4 + current[3];
+        }
+    }
+
+  private:
+    friend class VmsSubscriptionsStateView;
+    friend class VmsAvailabilityStateView;
+
+    // Returns false if count associated layers starting at values don't fit into size values.
+    bool parse(const int32_t* values, size_t size, int32_t count);
+
+    const int32_t* mValues = nullptr;
+    size_t mCount = 0;
+};
+
+// Parses a VmsMessageType.SUBSCRIPTIONS_CHANGE or SUBSCRIPTIONS_RESPONSE message in place. The
+// whole message is validated once by parse(), the accessors then read int32Values without copying
+// or further bounds checks. A view can be reused for the next message.
+class VmsSubscriptionsStateView {
+  public:
+    // Returns false, and leaves the view empty, if the message isn't a complete subscriptions
+    // state.
+    bool parse(const VehiclePropValue& subscriptions_state);
+
+    int32_t sequenceNumber() const { return mSequenceNumber; }
+    size_t layerCount() const { return mLayerCount; }
+    VmsLayer layerAt(size_t index) const {
+        const int32_t* layer = mLayers + index * 3;
+        return VmsLayer(layer[0], layer[1], layer[2]);
+    }
+    const VmsAssociatedLayersView& associatedLayers() const { return mAssociatedLayers; }
+
+  private:
+    int32_t mSequenceNumber = -1;
+    const int32_t* mLayers = nullptr;
+    size_t mLayerCount = 0;
+    VmsAssociatedLayersView mAssociatedLayers;
+};
+
+// Parses a VmsMessageType.AVAILABILITY_CHANGE or AVAILABILITY_RESPONSE message in place, see
+// VmsSubscriptionsStateView.
+class VmsAvailabilityStateView {
+  public:
+    bool parse(const VehiclePropValue& availability_state);
+
+    int32_t sequenceNumber() const { return mSequenceNumber; }
+    const VmsAssociatedLayersView& associatedLayers() const { return mAssociatedLayers; }
+
+  private:
+    int32_t mSequenceNumber = -1;
+    VmsAssociatedLayersView mAssociatedLayers;
+};
+
+// Same as getSubscribedLayers, for an already parsed subscriptions state. The result replaces
+// the contents of subscribed_layers, so a reused vector doesn't allocate.
+void getSubscribedLayers(const VmsSubscriptionsStateView& subscriptions_state,
+                         const VmsOffers& offers, std::vector<VmsLayer>* subscribed_layers);
+
 }  // namespace vms
 }  // namespace V2_0
 }  // namespace vehicle
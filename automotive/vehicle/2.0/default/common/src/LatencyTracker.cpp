@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyTracker.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int64_t kNanosPerMicro = 1000;
+
+size_t bucketFor(int64_t nanos) {
+    uint64_t micros = nanos > 0 ? static_cast<uint64_t>(nanos / kNanosPerMicro) : 0;
+    if (micros == 0) return 0;
+    size_t bucket = 64 - __builtin_clzll(micros);
+    return std::min(bucket, LatencyHistogram::kNumBuckets - 1);
+}
+
+// Exclusive upper bound of a bucket in nanoseconds.
+int64_t bucketUpperBoundNanos(size_t bucket) {
+    return (int64_t{1} << bucket) * kNanosPerMicro;
+}
+
+}  // namespace
+
+const char* toString(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::QUEUE:
+            return "queue";
+        case LatencyStage::DISTRIBUTE:
+            return "distribute";
+        case LatencyStage::DELIVER:
+            return "deliver";
+        case LatencyStage::TOTAL:
+            return "total";
+        default:
+            return "unknown";
+    }
+}
+
+void LatencyHistogram::record(int64_t nanos) {
+    mBuckets[bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+    mSumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    int64_t max = mMaxNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !mMaxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    uint64_t count = 0;
+    for (const auto& bucket : mBuckets) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+int64_t LatencyHistogram::getMeanNanos() const {
+    uint64_t count = getCount();
+    return count == 0 ? 0 : mSumNanos.load(std::memory_order_relaxed) / static_cast<int64_t>(count);
+}
+
+int64_t LatencyHistogram::getPercentileNanos(double percentile) const {
+    uint64_t count = getCount();
+    if (count == 0) return 0;
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(percentile * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::min(bucketUpperBoundNanos(i), getMaxNanos());
+        }
+    }
+    return getMaxNanos();
+}
+
+LatencyTracker::LatencyTracker() : mEntries(new Entry[kMaxProperties]) {}
+
+LatencyTracker::Entry* LatencyTracker::findOrInsert(int32_t prop) {
+    size_t start = (static_cast<uint32_t>(prop) * 2654435761u) % kMaxProperties;
+    for (size_t i = 0; i < kMaxProperties; i++) {
+        Entry& entry = mEntries[(start + i) % kMaxProperties];
+        int32_t current = entry.prop.load(std::memory_order_acquire);
+        if (current == prop) {
+            return &entry;
+        }
+        if (current == 0) {
+            if (entry.prop.compare_exchange_strong(current, prop, std::memory_order_acq_rel) ||
+                current == prop) {
+                return &entry;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void LatencyTracker::record(int32_t prop, LatencyStage stage, int64_t nanos) {
+    Entry* entry = prop == 0 ? nullptr : findOrInsert(prop);
+    if (entry == nullptr) {
+        mUntrackedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    entry->stages[static_cast<size_t>(stage)].record(nanos);
+}
+
+void LatencyTracker::dump(int fd, int32_t prop) const {
+    dprintf(fd, "HAL event latency in microseconds (count, mean, p50, p99, max)\n");
+    for (size_t i = 0; i < kMaxProperties; i++) {
+        const Entry& entry = mEntries[i];
+        int32_t entryProp = entry.prop.load(std::memory_order_acquire);
+        if (entryProp == 0 || (prop != 0 && entryProp != prop)) {
+            continue;
+        }
+        dprintf(fd, "property 0x%x\n", entryProp);
+        for (size_t stage = 0; stage < entry.stages.size(); stage++) {
+            const LatencyHistogram& histogram = entry.stages[stage];
+            dprintf(fd,
+                    "  %-10s: %" PRIu64 ", %" PRId64 ", %" PRId64 ", %" PRId64 ", %" PRId64 "\n",
+                    toString(static_cast<LatencyStage>(stage)), histogram.getCount(),
+                    histogram.getMeanNanos() / kNanosPerMicro,
+                    histogram.getPercentileNanos(0.5) / kNanosPerMicro,
+                    histogram.getPercentileNanos(0.99) / kNanosPerMicro,
+                    histogram.getMaxNanos() / kNanosPerMicro);
+        }
+    }
+    uint64_t untracked = mUntrackedEvents.load(std::memory_order_relaxed);
+    if (untracked > 0) {
+        dprintf(fd, "%" PRIu64 " events of untracked properties\n", untracked);
+    }
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Obd2FrameHistory.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+Obd2FrameHistory::Obd2FrameHistory(size_t capacity, size_t numIntegerSensors,
+                                   size_t numFloatSensors)
+    : mCapacity(std::max<size_t>(capacity, 1)),
+      mNumIntegerSensors(numIntegerSensors),
+      mNumFloatSensors(numFloatSensors),
+      mBitmaskBytes((numIntegerSensors + numFloatSensors + 7) / 8),
+      mTimestamps(mCapacity, 0),
+      mDtcs(mCapacity),
+      mIntegerColumns(mCapacity * numIntegerSensors, 0),
+      mFloatColumns(mCapacity * numFloatSensors, 0),
+      mPresence(mCapacity * mBitmaskBytes, 0) {}
+
+void Obd2FrameHistory::record(const VehiclePropValue& frame) {
+    if (mSize > 0 && frame.timestamp < mTimestamps[slotAt(mSize - 1)]) {
+        return;
+    }
+
+    size_t slot = mNext;
+    mNext = (mNext + 1) % mCapacity;
+    mSize = std::min(mSize + 1, mCapacity);
+
+    mTimestamps[slot] = frame.timestamp;
+    mDtcs[slot] = frame.value.stringValue;
+
+    const auto& ints = frame.value.int32Values;
+    const auto& floats = frame.value.floatValues;
+    const auto& bitmask = frame.value.bytes;
+    for (size_t i = 0; i < mNumIntegerSensors; i++) {
+        mIntegerColumns[i * mCapacity + slot] = i < ints.size() ? ints[i] : 0;
+    }
+    for (size_t i = 0; i < mNumFloatSensors; i++) {
+        mFloatColumns[i * mCapacity + slot] = i < floats.size() ? floats[i] : 0;
+    }
+
+    // The frame bitmask has integer sensors first, then float sensors. Only keep the bits of the
+    // configured sensors, in case the frame has more of either.
+    uint8_t* presence = mPresence.data() + slot * mBitmaskBytes;
+    memset(presence, 0, mBitmaskBytes);
+    auto frameBit = [&bitmask](size_t bit) {
+        return bit / 8 < bitmask.size() && (bitmask[bit / 8] & (1 << (bit % 8))) != 0;
+    };
+    auto setBit = [presence](size_t bit) { presence[bit / 8] |= 1 << (bit % 8); };
+    for (size_t i = 0; i < std::min(ints.size(), mNumIntegerSensors); i++) {
+        if (frameBit(i)) setBit(i);
+    }
+    for (size_t i = 0; i < std::min(floats.size(), mNumFloatSensors); i++) {
+        if (frameBit(ints.size() + i)) setBit(mNumIntegerSensors + i);
+    }
+}
+
+void Obd2FrameHistory::clear() {
+    mNext = 0;
+    mSize = 0;
+}
+
+std::vector<int64_t> Obd2FrameHistory::getTimestamps(int64_t since) const {
+    std::vector<int64_t> timestamps;
+    for (size_t i = lowerBound(since); i < mSize; i++) {
+        timestamps.push_back(mTimestamps[slotAt(i)]);
+    }
+    return timestamps;
+}
+
+bool Obd2FrameHistory::fillPropValue(int64_t timestamp, VehiclePropValue* propValue) const {
+    size_t i = lowerBound(timestamp);
+    if (i == mSize || mTimestamps[slotAt(i)] != timestamp) {
+        return false;
+    }
+    size_t slot = slotAt(i);
+
+    propValue->timestamp = timestamp;
+    propValue->value.int32Values.resize(mNumIntegerSensors);
+    for (size_t s = 0; s < mNumIntegerSensors; s++) {
+        propValue->value.int32Values[s] = mIntegerColumns[s * mCapacity + slot];
+    }
+    propValue->value.floatValues.resize(mNumFloatSensors);
+    for (size_t s = 0; s < mNumFloatSensors; s++) {
+        propValue->value.floatValues[s] = mFloatColumns[s * mCapacity + slot];
+    }
+    propValue->value.bytes.resize(mBitmaskBytes);
+    memcpy(propValue->value.bytes.data(), mPresence.data() + slot * mBitmaskBytes,
+           mBitmaskBytes);
+    propValue->value.stringValue = mDtcs[slot];
+    return true;
+}
+
+void Obd2FrameHistory::readIntegerSensor(size_t index, int64_t since,
+                                         std::vector<int64_t>* outTimestamps,
+                                         std::vector<int32_t>* outValues) const {
+    if (index >= mNumIntegerSensors) return;
+    const int32_t* column = &mIntegerColumns[index * mCapacity];
+    for (size_t i = lowerBound(since); i < mSize; i++) {
+        size_t slot = slotAt(i);
+        if (isPresent(slot, index)) {
+            outTimestamps->push_back(mTimestamps[slot]);
+            outValues->push_back(column[slot]);
+        }
+    }
+}
+
+void Obd2FrameHistory::readFloatSensor(size_t index, int64_t since,
+                                       std::vector<int64_t>* outTimestamps,
+                                       std::vector<float>* outValues) const {
+    if (index >= mNumFloatSensors) return;
+    const float* column = &mFloatColumns[index * mCapacity];
+    for (size_t i = lowerBound(since); i < mSize; i++) {
+        size_t slot = slotAt(i);
+        if (isPresent(slot, mNumIntegerSensors + index)) {
+            outTimestamps->push_back(mTimestamps[slot]);
+            outValues->push_back(column[slot]);
+        }
+    }
+}
+
+size_t Obd2FrameHistory::slotAt(size_t i) const {
+    return (mNext + mCapacity - mSize + i) % mCapacity;
+}
+
+size_t Obd2FrameHistory::lowerBound(int64_t timestamp) const {
+    // Frames are recorded in timestamp order.
+    size_t low = 0;
+    size_t high = mSize;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (mTimestamps[slotAt(mid)] < timestamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool Obd2FrameHistory::isPresent(size_t slot, size_t sensorBit) const {
+    return (mPresence[slot * mBitmaskBytes + sensorBit / 8] & (1 << (sensorBit % 8))) != 0;
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "ShardedVehiclePropertyStore"
+#include <log/log.h>
+
+#include <common/include/vhal_v2_0/VehicleUtils.h>
+#include "ShardedVehiclePropertyStore.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+void ShardedVehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
+                                                   TokenFunction tokenFunc,
+                                                   const EvictionPolicy& evictionPolicy) {
+    WriteGuard g(mConfigLock);
+    mConfigs.insert({config.prop, RecordConfig{config, tokenFunc, evictionPolicy}});
+    buildConfigTable(mConfigs, &mConfigTable);
+}
+
+bool ShardedVehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
+                                             bool updateStatus) {
+    RecordId recId;
+    EvictionPolicy evictionPolicy;
+    if (!getRecordId(propValue, &recId, &evictionPolicy)) return false;
+
+    Shard& shard = shardFor(recId.prop);
+    WriteGuard g(shard.lock);
+    auto it = shard.values.find(recId);
+    if (it == shard.values.end()) {
+        shard.values.emplace(recId, propValue);
+    } else {
+        // propValue is outdated and drops it.
+        if (it->second.timestamp() > propValue.timestamp) {
+            return false;
+        }
+        // The timestamp in propertyStore should only be updated by the server side. It indicates
+        // the time when the event is generated by the server.
+        it->second.update(propValue, updateStatus);
+    }
+    shard.changes.onWrite(recId, mGeneration.fetch_add(1) + 1);
+    shard.evictions += evictLocked(evictionPolicy, recId, &shard.values, &shard.changes);
+    return true;
+}
+
+void ShardedVehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
+    RecordId recId;
+    if (!getRecordId(propValue, &recId)) return;
+
+    Shard& shard = shardFor(recId.prop);
+    WriteGuard g(shard.lock);
+    shard.values.erase(recId);
+    shard.changes.onRemove(recId);
+}
+
+void ShardedVehiclePropertyStore::removeValuesForProperty(int32_t propId) {
+    Shard& shard = shardFor(propId);
+    WriteGuard g(shard.lock);
+    auto range = findRangeLocked(shard, propId);
+    shard.values.erase(range.first, range.second);
+    shard.changes.onRemoveProperty(propId);
+}
+
+std::vector<VehiclePropValue> ShardedVehiclePropertyStore::readAllValues() const {
+    std::vector<VehiclePropValue> allValues;
+    for (const Shard& shard : mShards) {
+        ReadGuard g(shard.lock);
+        allValues.reserve(allValues.size() + shard.values.size());
+        for (auto&& it : shard.values) {
+            allValues.push_back(it.second.toValue(it.first.prop));
+        }
+    }
+    return allValues;
+}
+
+std::vector<VehiclePropValue> ShardedVehiclePropertyStore::readValuesForProperty(
+        int32_t propId) const {
+    std::vector<VehiclePropValue> values;
+    const Shard& shard = shardFor(propId);
+    ReadGuard g(shard.lock);
+    auto range = findRangeLocked(shard, propId);
+    for (auto it = range.first; it != range.second; ++it) {
+        values.push_back(it->second.toValue(propId));
+    }
+    return values;
+}
+
+std::unique_ptr<VehiclePropValue> ShardedVehiclePropertyStore::readValueOrNull(
+        const VehiclePropValue& request) const {
+    RecordId recId;
+    if (!getRecordId(request, &recId)) return nullptr;
+
+    const Shard& shard = shardFor(recId.prop);
+    ReadGuard g(shard.lock);
+    const StoredValue* internalValue = getValueOrNullLocked(shard, recId);
+    return internalValue ? std::make_unique<VehiclePropValue>(internalValue->toValue(recId.prop))
+                         : nullptr;
+}
+
+std::unique_ptr<VehiclePropValue> ShardedVehiclePropertyStore::readValueOrNull(
+        int32_t prop, int32_t area, int64_t token) const {
+    RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token};
+    const Shard& shard = shardFor(prop);
+    ReadGuard g(shard.lock);
+    const StoredValue* internalValue = getValueOrNullLocked(shard, recId);
+    return internalValue ? std::make_unique<VehiclePropValue>(internalValue->toValue(prop))
+                         : nullptr;
+}
+
+void ShardedVehiclePropertyStore::readValues(const std::vector<VehiclePropValue>& requests,
+                                             const ReadValueFunction& func) const {
+    // Resolve all record IDs under a single config lock, unregistered properties stay unresolved.
+    std::vector<RecordId> recIds(requests.size());
+    std::vector<bool> resolved(requests.size(), false);
+    {
+        ReadGuard g(mConfigLock);
+        for (size_t i = 0; i < requests.size(); i++) {
+            const VehiclePropValue& request = requests[i];
+            const RecordConfig* const* recordConfig = mConfigTable.find(request.prop);
+            if (recordConfig == nullptr) continue;
+            recIds[i] = {request.prop, isGlobalProp(request.prop) ? 0 : request.areaId, 0};
+            if ((*recordConfig)->tokenFunction != nullptr) {
+                recIds[i].token = (*recordConfig)->tokenFunction(request);
+            }
+            resolved[i] = true;
+        }
+    }
+
+    // Then visit every shard that has requests once.
+    std::array<bool, kShardCount> hasRequests{};
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (resolved[i]) {
+            hasRequests[shardIndexFor(recIds[i].prop)] = true;
+        } else {
+            func(i, nullptr);
+        }
+    }
+    VehiclePropValue value;
+    for (size_t shardIndex = 0; shardIndex < kShardCount; shardIndex++) {
+        if (!hasRequests[shardIndex]) continue;
+        const Shard& shard = mShards[shardIndex];
+        ReadGuard g(shard.lock);
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (resolved[i] && shardIndexFor(recIds[i].prop) == shardIndex) {
+                const StoredValue* internalValue = getValueOrNullLocked(shard, recIds[i]);
+                if (internalValue != nullptr) {
+                    internalValue->toValue(recIds[i].prop, &value);
+                }
+                func(i, internalValue != nullptr ? &value : nullptr);
+            }
+        }
+    }
+}
+
+std::vector<VehiclePropValue> ShardedVehiclePropertyStore::readValuesChangedSince(
+        uint64_t token, uint64_t* outToken) const {
+    // Writers take the generation while holding their shard lock. Any write with a generation up
+    // to the one loaded here has either finished, or holds a shard lock we are about to wait for.
+    *outToken = mGeneration.load();
+    std::vector<VehiclePropValue> values;
+    for (const Shard& shard : mShards) {
+        ReadGuard g(shard.lock);
+        shard.changes.forEachChangedSince(token, [&](const RecordId& recId) {
+            const StoredValue* value = getValueOrNullLocked(shard, recId);
+            if (value != nullptr) {
+                values.push_back(value->toValue(recId.prop));
+            }
+        });
+    }
+    return values;
+}
+
+std::vector<VehiclePropConfig> ShardedVehiclePropertyStore::getAllConfigs() const {
+    ReadGuard g(mConfigLock);
+    std::vector<VehiclePropConfig> configs;
+    configs.reserve(mConfigs.size());
+    for (auto&& recordConfigIt : mConfigs) {
+        configs.push_back(recordConfigIt.second.propConfig);
+    }
+    return configs;
+}
+
+const VehiclePropConfig* ShardedVehiclePropertyStore::getConfigOrNull(int32_t propId) const {
+    ReadGuard g(mConfigLock);
+    const RecordConfig* const* recordConfig = mConfigTable.find(propId);
+    return recordConfig != nullptr ? &(*recordConfig)->propConfig : nullptr;
+}
+
+VehiclePropertyStore::MemoryStats ShardedVehiclePropertyStore::getMemoryStats() const {
+    MemoryStats stats;
+    for (const Shard& shard : mShards) {
+        ReadGuard g(shard.lock);
+        addMemoryStatsLocked(shard.values, &stats);
+        stats.evictions += shard.evictions;
+    }
+    return stats;
+}
+
+bool ShardedVehiclePropertyStore::getRecordId(const VehiclePropValue& valuePrototype,
+                                              RecordId* outRecId,
+                                              EvictionPolicy* outEvictionPolicy) const {
+    *outRecId = {
+        .prop = valuePrototype.prop,
+        .area = isGlobalProp(valuePrototype.prop) ? 0 : valuePrototype.areaId,
+        .token = 0
+    };
+
+    ReadGuard g(mConfigLock);
+    const RecordConfig* const* recordConfig = mConfigTable.find(outRecId->prop);
+    if (recordConfig == nullptr) return false;
+
+    if ((*recordConfig)->tokenFunction != nullptr) {
+        outRecId->token = (*recordConfig)->tokenFunction(valuePrototype);
+    }
+    if (outEvictionPolicy != nullptr) {
+        *outEvictionPolicy = (*recordConfig)->evictionPolicy;
+    }
+    return true;
+}
+
+ShardedVehiclePropertyStore::Shard& ShardedVehiclePropertyStore::shardFor(int32_t propId) {
+    return const_cast<Shard&>(
+            static_cast<const ShardedVehiclePropertyStore*>(this)->shardFor(propId));
+}
+
+size_t ShardedVehiclePropertyStore::shardIndexFor(int32_t propId) {
+    // Property IDs of the same group/type only differ in the lower bits, fold the upper half in so
+    // that vendor and system properties are spread evenly as well.
+    uint32_t id = static_cast<uint32_t>(propId);
+    return (id ^ (id >> 16)) % kShardCount;
+}
+
+const ShardedVehiclePropertyStore::Shard& ShardedVehiclePropertyStore::shardFor(
+        int32_t propId) const {
+    return mShards[shardIndexFor(propId)];
+}
+
+const VehiclePropertyStore::StoredValue* ShardedVehiclePropertyStore::getValueOrNullLocked(
+        const Shard& shard, const RecordId& recId) {
+    auto it = shard.values.find(recId);
+    return it == shard.values.end() ? nullptr : &it->second;
+}
+
+VehiclePropertyStore::PropertyMapRange ShardedVehiclePropertyStore::findRangeLocked(
+        const Shard& shard, int32_t propId) {
+    // Based on the fact that values are stored in a sorted map by RecordId.
+    auto beginIt = shard.values.lower_bound(RecordId{propId, INT32_MIN, 0});
+    auto endIt = shard.values.lower_bound(RecordId{propId + 1, INT32_MIN, 0});
+
+    return PropertyMapRange{beginIt, endIt};
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
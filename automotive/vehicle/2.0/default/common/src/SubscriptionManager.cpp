@@ -18,8 +18,10 @@
 
 #include "SubscriptionManager.h"
 
+#include <algorithm>
 #include <cmath>
 #include <inttypes.h>
+#include <stdio.h>
 
 #include <android/log.h>
 
@@ -31,6 +33,8 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+constexpr int64_t kDecimationToleranceNs = 1000000;  // 1ms
+
 bool mergeSubscribeOptions(const SubscribeOptions &oldOpts,
                            const SubscribeOptions &newOpts,
                            SubscribeOptions *outResult) {
@@ -52,13 +56,14 @@ void HalClient::addOrUpdateSubscription(const SubscribeOptions &opts)  {
 
     auto it = mSubscriptions.find(opts.propId);
     if (it == mSubscriptions.end()) {
-        mSubscriptions.emplace(opts.propId, opts);
+        mSubscriptions.emplace(opts.propId, Subscription{.options = opts});
     } else {
-        const SubscribeOptions& oldOpts = it->second;
+        const SubscribeOptions& oldOpts = it->second.options;
         SubscribeOptions updatedOptions;
         if (mergeSubscribeOptions(oldOpts, opts, &updatedOptions)) {
-            mSubscriptions.erase(it);
-            mSubscriptions.emplace(opts.propId, updatedOptions);
+            it->second.options = updatedOptions;
+            // Start decimating with the new rate from the next event.
+            it->second.nextForwardTimestamp.clear();
         }
     }
 }
@@ -69,7 +74,7 @@ bool HalClient::isSubscribed(int32_t propId,
     if (it == mSubscriptions.end()) {
         return false;
     }
-    const SubscribeOptions& opts = it->second;
+    const SubscribeOptions& opts = it->second.options;
     bool res = (opts.flags & flags);
     return res;
 }
@@ -77,12 +82,61 @@ bool HalClient::isSubscribed(int32_t propId,
 std::vector<int32_t> HalClient::getSubscribedProperties() const {
     std::vector<int32_t> props;
     for (const auto& subscription : mSubscriptions) {
-        ALOGI("%s propId: 0x%x, propId: 0x%x", __func__, subscription.first, subscription.second.propId);
+        ALOGI("%s propId: 0x%x, propId: 0x%x", __func__, subscription.first,
+              subscription.second.options.propId);
         props.push_back(subscription.first);
     }
     return props;
 }
 
+bool HalClient::shouldForward(const VehiclePropValue& value) {
+    auto it = mSubscriptions.find(value.prop);
+    if (it == mSubscriptions.end()) {
+        return false;
+    }
+    Subscription& subscription = it->second;
+    float sampleRate = subscription.options.sampleRate;
+    if (sampleRate <= 0) {
+        // On-change property, nothing to decimate.
+        subscription.forwardedCount++;
+        return true;
+    }
+
+    int64_t interval = static_cast<int64_t>(1e9 / sampleRate);
+    // Events can be generated slightly ahead of this client's interval due to timer jitter,
+    // tolerate that so we don't skip a whole merged period.
+    int64_t tolerance = std::min(kDecimationToleranceNs, interval / 10);
+
+    auto nextIt = subscription.nextForwardTimestamp.find(value.areaId);
+    if (nextIt == subscription.nextForwardTimestamp.end()) {
+        subscription.nextForwardTimestamp.emplace(value.areaId, value.timestamp + interval);
+        subscription.forwardedCount++;
+        return true;
+    }
+
+    int64_t& nextTimestamp = nextIt->second;
+    if (value.timestamp + tolerance < nextTimestamp) {
+        subscription.droppedCount++;
+        return false;
+    }
+    nextTimestamp += interval;
+    if (nextTimestamp <= value.timestamp) {
+        // Fell behind (e.g. the property wasn't generated for a while), restart from now.
+        nextTimestamp = value.timestamp + interval;
+    }
+    subscription.forwardedCount++;
+    return true;
+}
+
+void HalClient::dump(int fd, const std::string& indent) const {
+    for (const auto& it : mSubscriptions) {
+        const Subscription& subscription = it.second;
+        dprintf(fd, "%sprop: 0x%x, rate: %.2f Hz, forwarded: %" PRIu64 ", dropped: %" PRIu64 "\n",
+                indent.c_str(), it.first, subscription.options.sampleRate,
+                subscription.forwardedCount, subscription.droppedCount);
+    }
+}
+
 StatusCode SubscriptionManager::addOrUpdateSubscription(
         ClientId clientId,
         const sp<IVehicleCallback> &callback,
@@ -117,31 +171,78 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
     return StatusCode::OK;
 }
 
-std::list<HalClientValues> SubscriptionManager::distributeValuesToClients(
-        const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-        SubscribeFlags flags) const {
-    std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
+void HalClientEventBuffers::valuesAt(size_t index, hidl_vec<VehiclePropValue>* outValues) {
+    Entry& entry = mEntries[index];
+    outValues->setToExternal(entry.values.data(), entry.count);
+}
 
-    {
-        MuxGuard g(mLock);
-        for (const auto& propValue: propValues) {
-            VehiclePropValue* v = propValue.get();
-            auto clients = getSubscribedClientsLocked(v->prop, flags);
-            for (const auto& client : clients) {
-                clientValuesMap[client].push_back(v);
-            }
+void HalClientEventBuffers::reset() {
+    for (size_t i = 0; i < mEntries.size();) {
+        mEntries[i].count = 0;
+        // We are the last owner, the client has gone away.
+        if (mEntries[i].client->getStrongCount() == 1) {
+            std::swap(mEntries[i], mEntries.back());
+            mEntries.pop_back();
+        } else {
+            i++;
         }
     }
+    mActiveCount = 0;
+}
+
+void HalClientEventBuffers::append(const sp<HalClient>& client, const VehiclePropValue& value) {
+    // Number of clients is small, so linear search is faster than any map here.
+    size_t index = 0;
+    while (index < mEntries.size() && mEntries[index].client != client) {
+        index++;
+    }
+    if (index == mEntries.size()) {
+        mEntries.push_back(Entry{.client = client, .count = 0});
+    }
+    if (index >= mActiveCount) {
+        std::swap(mEntries[index], mEntries[mActiveCount]);
+        index = mActiveCount++;
+    }
 
-    std::list<HalClientValues> clientValues;
-    for (const auto& entry : clientValuesMap) {
-        clientValues.push_back(HalClientValues {
-            .client = entry.first,
-            .values = entry.second
-        });
+    Entry& entry = mEntries[index];
+    if (entry.count == entry.values.size()) {
+        entry.values.emplace_back();
     }
+    shallowCopy(&entry.values[entry.count++], value);
+}
 
-    return clientValues;
+void SubscriptionManager::distributeValuesToClients(
+        const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
+        SubscribeFlags flags, HalClientEventBuffers* outBuffers) const {
+    distributeValuesToClientsImpl(propValues, flags, outBuffers);
+}
+
+void SubscriptionManager::distributeValuesToClients(
+        const std::vector<const VehiclePropValue*>& propValues, SubscribeFlags flags,
+        HalClientEventBuffers* outBuffers) const {
+    distributeValuesToClientsImpl(propValues, flags, outBuffers);
+}
+
+template <typename Values>
+void SubscriptionManager::distributeValuesToClientsImpl(const Values& propValues,
+                                                        SubscribeFlags flags,
+                                                        HalClientEventBuffers* outBuffers) const {
+    outBuffers->reset();
+
+    MuxGuard g(mLock);
+    for (const auto& propValue : propValues) {
+        const VehiclePropValue& v = *propValue;
+        sp<HalClientVector> propClients = getClientsForPropertyLocked(v.prop);
+        if (propClients.get() == nullptr) {
+            continue;
+        }
+        for (size_t i = 0; i < propClients->size(); i++) {
+            const auto& client = propClients->itemAt(i);
+            if (client->isSubscribed(v.prop, flags) && client->shouldForward(v)) {
+                outBuffers->append(client, v);
+            }
+        }
+    }
 }
 
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(int32_t propId,
@@ -271,6 +372,16 @@ void SubscriptionManager::unsubscribe(ClientId clientId,
     }
 }
 
+void SubscriptionManager::dump(int fd) const {
+    MuxGuard g(mLock);
+    dprintf(fd, "%zu subscribed clients\n", mClients.size());
+    for (const auto& it : mClients) {
+        dprintf(fd, "client 0x%" PRIx64 ", callback: %p\n", it.first,
+                it.second->getCallback().get());
+        it.second->dump(fd, "  ");
+    }
+}
+
 void SubscriptionManager::onCallbackDead(uint64_t cookie) {
     ALOGI("%s, cookie: 0x%" PRIx64, __func__, cookie);
     ClientId clientId = cookie;
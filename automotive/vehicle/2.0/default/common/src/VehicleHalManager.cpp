@@ -15,20 +15,24 @@
  */
 
 #define LOG_TAG "automotive.vehicle@2.0-impl"
+#define ATRACE_TAG ATRACE_TAG_HAL
 
 #include "VehicleHalManager.h"
 
 #include <cmath>
 #include <fstream>
+#include <inttypes.h>
 
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <android/hardware/automotive/vehicle/2.0/BpHwVehicleCallback.h>
 #include <android/log.h>
 
+#include <halmetrics/Metrics.h>
 #include <hwbinder/IPCThreadState.h>
 #include <private/android_filesystem_config.h>
 #include <utils/SystemClock.h>
+#include <utils/Trace.h>
 
 #include "VehicleUtils.h"
 
@@ -44,16 +48,12 @@ using ::android::base::EqualsIgnoreCase;
 using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_string;
 
+// Batching window adapts between these two depending on the rate of HAL events.
+constexpr std::chrono::milliseconds kHalEventBatchingMinTimeWindow(1);
 constexpr std::chrono::milliseconds kHalEventBatchingTimeWindow(10);
 
 const VehiclePropValue kEmptyValue{};
 
-/**
- * Indicates what's the maximum size of hidl_vec<VehiclePropValue> we want
- * to store in reusable object pool.
- */
-constexpr auto kMaxHidlVecOfVehiclPropValuePoolSize = 20;
-
 Return<void> VehicleHalManager::getAllPropConfigs(getAllPropConfigs_cb _hidl_cb) {
     ALOGI("getAllPropConfigs called");
     hidl_vec<VehiclePropConfig> hidlConfigs;
@@ -70,24 +70,41 @@ Return<void> VehicleHalManager::getAllPropConfigs(getAllPropConfigs_cb _hidl_cb)
 
 Return<void> VehicleHalManager::getPropConfigs(const hidl_vec<int32_t> &properties,
                                                getPropConfigs_cb _hidl_cb) {
-    std::vector<VehiclePropConfig> configs;
+    // Requests for a single property, or for a run of properties in the order they were listed
+    // by the HAL, are served straight from the index without copying any config.
+    const VehiclePropConfig* first = nullptr;
+    bool contiguous = true;
     for (size_t i = 0; i < properties.size(); i++) {
         auto prop = properties[i];
-        if (mConfigIndex->hasConfig(prop)) {
-            configs.push_back(mConfigIndex->getConfig(prop));
-        } else {
+        const VehiclePropConfig* config = mConfigIndex->getConfigOrNull(prop);
+        if (config == nullptr) {
             ALOGW("Requested config for undefined property: 0x%x", prop);
             _hidl_cb(StatusCode::INVALID_ARG, hidl_vec<VehiclePropConfig>());
             return Void();
         }
+        if (i == 0) {
+            first = config;
+        } else if (config != first + i) {
+            contiguous = false;
+        }
     }
 
+    hidl_vec<VehiclePropConfig> configs;
+    if (contiguous) {
+        configs.setToExternal(const_cast<VehiclePropConfig*>(first), properties.size());
+    } else {
+        configs.resize(properties.size());
+        for (size_t i = 0; i < properties.size(); i++) {
+            configs[i] = mConfigIndex->getConfig(properties[i]);
+        }
+    }
     _hidl_cb(StatusCode::OK, configs);
 
     return Void();
 }
 
 Return<void> VehicleHalManager::get(const VehiclePropValue& requestedPropValue, get_cb _hidl_cb) {
+    HAL_METRICS_SCOPED_TIMER("vhal.get");
     const auto* config = getPropConfigOrNull(requestedPropValue.prop);
     if (config == nullptr) {
         ALOGE("Failed to get value: config not found, property: 0x%x",
@@ -110,6 +127,7 @@ Return<void> VehicleHalManager::get(const VehiclePropValue& requestedPropValue,
 }
 
 Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
+    HAL_METRICS_SCOPED_TIMER("vhal.set");
     auto prop = value.prop;
     const auto* config = getPropConfigOrNull(prop);
     if (config == nullptr) {
@@ -128,6 +146,76 @@ Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
     return Return<StatusCode>(status);
 }
 
+void VehicleHalManager::getValues(const std::vector<VehiclePropValue>& requests,
+                                  std::vector<VehiclePropValuePtr>* outValues,
+                                  std::vector<StatusCode>* outStatus) {
+    HAL_METRICS_SCOPED_TIMER("vhal.getValues");
+    HAL_METRICS_ADD("vhal.getValues.values", requests.size());
+    outValues->clear();
+    outValues->resize(requests.size());
+    outStatus->assign(requests.size(), StatusCode::OK);
+
+    std::vector<VehiclePropValue> halRequests;
+    std::vector<size_t> halIndices;
+    halRequests.reserve(requests.size());
+    halIndices.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        const auto* config = getPropConfigOrNull(requests[i].prop);
+        if (config == nullptr) {
+            ALOGE("Failed to get value: config not found, property: 0x%x", requests[i].prop);
+            (*outStatus)[i] = StatusCode::INVALID_ARG;
+        } else if (!checkReadPermission(*config)) {
+            (*outStatus)[i] = StatusCode::ACCESS_DENIED;
+        } else {
+            halRequests.push_back(requests[i]);
+            halIndices.push_back(i);
+        }
+    }
+    if (halRequests.empty()) return;
+
+    std::vector<VehiclePropValuePtr> halValues;
+    std::vector<StatusCode> halStatus;
+    mHal->getValues(halRequests, &halValues, &halStatus);
+    for (size_t i = 0; i < halIndices.size(); i++) {
+        (*outStatus)[halIndices[i]] = halStatus[i];
+        if (halStatus[i] == StatusCode::OK) {
+            (*outValues)[halIndices[i]] = std::move(halValues[i]);
+        }
+    }
+}
+
+void VehicleHalManager::setValues(const std::vector<VehiclePropValue>& values,
+                                  std::vector<StatusCode>* outStatus) {
+    HAL_METRICS_SCOPED_TIMER("vhal.setValues");
+    HAL_METRICS_ADD("vhal.setValues.values", values.size());
+    outStatus->assign(values.size(), StatusCode::OK);
+
+    std::vector<VehiclePropValue> halValues;
+    std::vector<size_t> halIndices;
+    halValues.reserve(values.size());
+    halIndices.reserve(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        const auto* config = getPropConfigOrNull(values[i].prop);
+        if (config == nullptr) {
+            ALOGE("Failed to set value: config not found, property: 0x%x", values[i].prop);
+            (*outStatus)[i] = StatusCode::INVALID_ARG;
+        } else if (!checkWritePermission(*config)) {
+            (*outStatus)[i] = StatusCode::ACCESS_DENIED;
+        } else {
+            handlePropertySetEvent(values[i]);
+            halValues.push_back(values[i]);
+            halIndices.push_back(i);
+        }
+    }
+    if (halValues.empty()) return;
+
+    std::vector<StatusCode> halStatus;
+    mHal->setValues(halValues, &halStatus);
+    for (size_t i = 0; i < halIndices.size(); i++) {
+        (*outStatus)[halIndices[i]] = halStatus[i];
+    }
+}
+
 Return<StatusCode> VehicleHalManager::subscribe(const sp<IVehicleCallback> &callback,
                                                 const hidl_vec<SubscribeOptions> &options) {
     hidl_vec<SubscribeOptions> verifiedOptions(options);
@@ -188,6 +276,9 @@ Return<void> VehicleHalManager::debug(const hidl_handle& fd, const hidl_vec<hidl
         ALOGE("Invalid parameters passed to debug()");
         return Void();
     }
+    if (metrics::dumpIfRequested(fd->data[0], options)) {
+        return Void();
+    }
 
     bool shouldContinue = mHal->dump(fd, options);
     if (!shouldContinue) {
@@ -203,6 +294,10 @@ Return<void> VehicleHalManager::debug(const hidl_handle& fd, const hidl_vec<hidl
 void VehicleHalManager::cmdDump(int fd, const hidl_vec<hidl_string>& options) {
     if (options.size() == 0) {
         cmdDumpAllProperties(fd);
+        dprintf(fd, "\n");
+        mSubscriptionManager.dump(fd);
+        dprintf(fd, "\n");
+        mValueObjectPool.dump(fd);
         return;
     }
     std::string option = options[0];
@@ -210,6 +305,12 @@ void VehicleHalManager::cmdDump(int fd, const hidl_vec<hidl_string>& options) {
         cmdHelp(fd);
     } else if (EqualsIgnoreCase(option, "--list")) {
         cmdListAllProperties(fd);
+    } else if (EqualsIgnoreCase(option, "--subscriptions")) {
+        mSubscriptionManager.dump(fd);
+    } else if (EqualsIgnoreCase(option, "--pools")) {
+        mValueObjectPool.dump(fd);
+    } else if (EqualsIgnoreCase(option, "--latency")) {
+        cmdDumpLatency(fd, options);
     } else if (EqualsIgnoreCase(option, "--get")) {
         cmdDumpSpecificProperties(fd, options);
     } else if (EqualsIgnoreCase(option, "--set")) {
@@ -252,6 +353,15 @@ void VehicleHalManager::cmdHelp(int fd) const {
     dprintf(fd, "[no args]: dumps (id and value) all supported properties \n");
     dprintf(fd, "--help: shows this help\n");
     dprintf(fd, "--list: lists the ids of all supported properties\n");
+    dprintf(fd,
+            "--subscriptions: dumps subscribed clients with the number of forwarded and "
+            "dropped events\n");
+    dprintf(fd, "--pools: dumps hit and miss counters of the property value pools\n");
+    dprintf(fd, "%s: dumps the call counters and latencies shared by all HALs\n",
+            metrics::kDebugOption);
+    dprintf(fd,
+            "--latency [PROP]: dumps how long HAL events of all or a specific property took "
+            "to reach the clients\n");
     dprintf(fd, "--get <PROP1> [PROP2] [PROPN]: dumps the value of specific properties \n");
     // TODO: support other formats (int64, float, bytes)
     dprintf(fd,
@@ -283,10 +393,42 @@ void VehicleHalManager::cmdDumpAllProperties(int fd) {
         dprintf(fd, "no properties to dump\n");
         return;
     }
-    int rowNumber = 0;
     dprintf(fd, "dumping %zu properties\n", size);
+
+    // Read everything in one batch, then print with the same row numbers as cmdDumpOneProperty().
+    std::vector<VehiclePropValue> requests;
+    std::vector<std::string> rows;
+    int rowNumber = 0;
     for (auto& config : halConfig) {
-        cmdDumpOneProperty(fd, ++rowNumber, config);
+        ++rowNumber;
+        size_t numberAreas = config.areaConfigs.size();
+        VehiclePropValue request;
+        request.prop = config.prop;
+        if (numberAreas == 0) {
+            request.areaId = 0;
+            requests.push_back(request);
+            rows.push_back(std::to_string(rowNumber));
+            continue;
+        }
+        for (size_t j = 0; j < numberAreas; ++j) {
+            request.areaId = config.areaConfigs[j].areaId;
+            requests.push_back(request);
+            rows.push_back(numberAreas > 1 ? std::to_string(rowNumber) + "/" + std::to_string(j)
+                                           : std::to_string(rowNumber));
+        }
+    }
+
+    std::vector<VehiclePropValuePtr> values;
+    std::vector<StatusCode> status;
+    getValues(requests, &values, &status);
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (status[i] == StatusCode::OK) {
+            dprintf(fd, "%s: %s\n", rows[i].c_str(),
+                    toString(values[i] ? *values[i] : kEmptyValue).c_str());
+        } else {
+            dprintf(fd, "%s: Could not get property %d. Error: %s\n", rows[i].c_str(),
+                    requests[i].prop, toString(status[i]).c_str());
+        }
     }
 }
 
@@ -333,6 +475,12 @@ void VehicleHalManager::cmdDumpSpecificProperties(int fd, const hidl_vec<hidl_st
     }
 }
 
+void VehicleHalManager::cmdDumpLatency(int fd, const hidl_vec<hidl_string>& options) {
+    int prop = 0;
+    if (options.size() > 1 && !safelyParseInt(fd, 1, options[1], &prop)) return;
+    mLatencyTracker.dump(fd, prop);
+}
+
 void VehicleHalManager::cmdDumpOneProperty(int fd, int32_t prop, int32_t areaId) {
     VehiclePropValue input;
     input.prop = prop;
@@ -431,10 +579,8 @@ void VehicleHalManager::cmdSetOneProperty(int fd, const hidl_vec<hidl_string>& o
 void VehicleHalManager::init() {
     ALOGI("VehicleHalManager::init");
 
-    mHidlVecOfVehiclePropValuePool.resize(kMaxHidlVecOfVehiclPropValuePoolSize);
-
-
     mBatchingConsumer.run(&mEventQueue,
+                          kHalEventBatchingMinTimeWindow,
                           kHalEventBatchingTimeWindow,
                           std::bind(&VehicleHalManager::onBatchHalEvent,
                                     this, _1));
@@ -465,7 +611,7 @@ VehicleHalManager::~VehicleHalManager() {
 }
 
 void VehicleHalManager::onHalEvent(VehiclePropValuePtr v) {
-    mEventQueue.push(std::move(v));
+    mEventQueue.push(HalEvent{std::move(v), elapsedRealtimeNano()});
 }
 
 void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
@@ -479,30 +625,49 @@ void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
     }
 }
 
-void VehicleHalManager::onBatchHalEvent(const std::vector<VehiclePropValuePtr>& values) {
-    const auto& clientValues =
-        mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR);
+void VehicleHalManager::onBatchHalEvent(const std::vector<HalEvent>& events) {
+    uint64_t droppedEvents = mEventQueue.getDroppedCount();
+    if (droppedEvents != mLastReportedDroppedEvents) {
+        ALOGW("Event queue overflow, %" PRIu64 " HAL events dropped so far", droppedEvents);
+        mLastReportedDroppedEvents = droppedEvents;
+    }
 
-    for (const HalClientValues& cv : clientValues) {
-        auto vecSize = cv.values.size();
-        hidl_vec<VehiclePropValue> vec;
-        if (vecSize < kMaxHidlVecOfVehiclPropValuePoolSize) {
-            vec.setToExternal(&mHidlVecOfVehiclePropValuePool[0], vecSize);
-        } else {
-            vec.resize(vecSize);
-        }
+    int64_t dequeuedNanos = elapsedRealtimeNano();
+    mBatchValues.clear();
+    for (const auto& event : events) {
+        mBatchValues.push_back(event.value.get());
+    }
+    mSubscriptionManager.distributeValuesToClients(mBatchValues, SubscribeFlags::EVENTS_FROM_CAR,
+                                                   &mClientEventBuffers);
+    int64_t distributedNanos = elapsedRealtimeNano();
 
-        int i = 0;
-        for (VehiclePropValue* pValue : cv.values) {
-            shallowCopy(&(vec)[i++], *pValue);
-        }
-        auto status = cv.client->getCallback()->onPropertyEvent(vec);
+    hidl_vec<VehiclePropValue> vec;
+    for (size_t i = 0; i < mClientEventBuffers.size(); i++) {
+        const sp<HalClient>& client = mClientEventBuffers.clientAt(i);
+        mClientEventBuffers.valuesAt(i, &vec);
+        auto status = client->getCallback()->onPropertyEvent(vec);
         if (!status.isOk()) {
             ALOGE("Failed to notify client %s, err: %s",
-                  toString(cv.client->getCallback()).c_str(),
+                  toString(client->getCallback()).c_str(),
                   status.description().c_str());
         }
     }
+    int64_t deliveredNanos = elapsedRealtimeNano();
+    HAL_METRICS_ADD("vhal.events", events.size());
+    HAL_METRICS_RECORD_NS("vhal.events.deliverBatch", deliveredNanos - dequeuedNanos);
+
+    // Distribute and deliver times are per batch, every event of the batch is charged with them.
+    for (const auto& event : events) {
+        int32_t prop = event.value->prop;
+        mLatencyTracker.record(prop, LatencyStage::QUEUE, dequeuedNanos - event.receivedNanos);
+        mLatencyTracker.record(prop, LatencyStage::DISTRIBUTE, distributedNanos - dequeuedNanos);
+        mLatencyTracker.record(prop, LatencyStage::DELIVER, deliveredNanos - distributedNanos);
+        mLatencyTracker.record(prop, LatencyStage::TOTAL, deliveredNanos - event.receivedNanos);
+    }
+    if (ATRACE_ENABLED() && !events.empty()) {
+        ATRACE_INT64("VHAL event queue latency ns", dequeuedNanos - events.front().receivedNanos);
+        ATRACE_INT64("VHAL event delivery latency ns", deliveredNanos - dequeuedNanos);
+    }
 }
 
 bool VehicleHalManager::isSampleRateFixed(VehiclePropertyChangeMode mode) {
@@ -575,8 +740,7 @@ void VehicleHalManager::handlePropertySetEvent(const VehiclePropValue& value) {
 
 const VehiclePropConfig* VehicleHalManager::getPropConfigOrNull(
         int32_t prop) const {
-    return mConfigIndex->hasConfig(prop)
-           ? &mConfigIndex->getConfig(prop) : nullptr;
+    return mConfigIndex->getConfigOrNull(prop);
 }
 
 void VehicleHalManager::onAllClientsUnsubscribed(int32_t propertyId) {
@@ -18,6 +18,11 @@
 
 #include "VehicleObjectPool.h"
 
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <iterator>
+
 #include <log/log.h>
 
 #include "VehicleUtils.h"
@@ -28,6 +33,36 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+constexpr VehiclePropertyType kRecyclableTypes[] = {
+        VehiclePropertyType::BOOLEAN,   VehiclePropertyType::INT32,
+        VehiclePropertyType::INT32_VEC, VehiclePropertyType::INT64,
+        VehiclePropertyType::INT64_VEC, VehiclePropertyType::FLOAT,
+        VehiclePropertyType::FLOAT_VEC, VehiclePropertyType::BYTES,
+};
+
+}  // namespace
+
+VehiclePropValuePool::VehiclePropValuePool(size_t maxRecyclableVectorSize)
+    : mMaxRecyclableVectorSize(maxRecyclableVectorSize) {
+    mValueTypePools.reserve(std::size(kRecyclableTypes) * (maxRecyclableVectorSize + 1));
+    for (VehiclePropertyType type : kRecyclableTypes) {
+        for (size_t vecSize = 0; vecSize <= maxRecyclableVectorSize; vecSize++) {
+            mValueTypePools.push_back(std::make_unique<InternalPool>(type, vecSize));
+        }
+    }
+}
+
+int VehiclePropValuePool::getTypeIndex(VehiclePropertyType type) {
+    for (size_t i = 0; i < std::size(kRecyclableTypes); i++) {
+        if (kRecyclableTypes[i] == type) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
         VehiclePropertyType type, size_t vecSize) {
     return isDisposable(type, vecSize)
@@ -88,18 +123,25 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecylable(
         VehiclePropertyType type, size_t vecSize) {
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type)
-                  | static_cast<int32_t>(vecSize);
-
-    std::lock_guard<std::mutex> g(mLock);
-    auto it = mValueTypePools.find(key);
+    int typeIndex = getTypeIndex(type);
+    if (typeIndex < 0) {
+        return obtainDisposable(type, vecSize);
+    }
+    return mValueTypePools[typeIndex * (mMaxRecyclableVectorSize + 1) + vecSize]->obtain();
+}
 
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vecSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+void VehiclePropValuePool::dump(int fd, const std::string& indent) const {
+    dprintf(fd, "%sValue pools (type, vector size: magazine hits, shared pool hits, misses)\n",
+            indent.c_str());
+    for (const auto& pool : mValueTypePools) {
+        auto stats = pool->getStats();
+        if (stats.magazineHits + stats.sharedHits + stats.misses == 0) {
+            continue;
+        }
+        dprintf(fd, "%s  %s, %zu: %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n", indent.c_str(),
+                toString(pool->getPropType()).c_str(), pool->getVectorSize(), stats.magazineHits,
+                stats.sharedHits, stats.misses);
     }
-    return it->second->obtain();
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(
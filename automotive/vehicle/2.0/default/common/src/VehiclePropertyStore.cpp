@@ -36,35 +36,46 @@ bool VehiclePropertyStore::RecordId::operator<(const VehiclePropertyStore::Recor
 }
 
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
-                                            VehiclePropertyStore::TokenFunction tokenFunc) {
+                                            VehiclePropertyStore::TokenFunction tokenFunc,
+                                            const EvictionPolicy& evictionPolicy) {
     MuxGuard g(mLock);
-    mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc } });
+    mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc, evictionPolicy } });
+    buildConfigTable(mConfigs, &mConfigTable);
+}
+
+void VehiclePropertyStore::buildConfigTable(const RecordConfigMap& configs,
+                                            RecordConfigTable* outTable) {
+    std::vector<std::pair<int32_t, const RecordConfig*>> entries;
+    entries.reserve(configs.size());
+    for (const auto& it : configs) {
+        entries.emplace_back(it.first, &it.second);
+    }
+    outTable->build(entries);
 }
 
 bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
                                         bool updateStatus) {
     MuxGuard g(mLock);
-    if (!mConfigs.count(propValue.prop)) return false;
+    const RecordConfig* const* recordConfig = mConfigTable.find(propValue.prop);
+    if (recordConfig == nullptr) return false;
 
     RecordId recId = getRecordIdLocked(propValue);
-    VehiclePropValue* valueToUpdate = const_cast<VehiclePropValue*>(getValueOrNullLocked(recId));
+    StoredValue* valueToUpdate = const_cast<StoredValue*>(getValueOrNullLocked(recId));
     if (valueToUpdate == nullptr) {
-        mPropertyValues.insert({ recId, propValue });
-        return true;
-    }
-
-    // propValue is outdated and drops it.
-    if (valueToUpdate->timestamp > propValue.timestamp) {
-        return false;
-    }
-    // update the propertyValue.
-    // The timestamp in propertyStore should only be updated by the server side. It indicates
-    // the time when the event is generated by the server.
-    valueToUpdate->timestamp = propValue.timestamp;
-    valueToUpdate->value = propValue.value;
-    if (updateStatus) {
-        valueToUpdate->status = propValue.status;
+        mPropertyValues.emplace(recId, propValue);
+    } else {
+        // propValue is outdated and drops it.
+        if (valueToUpdate->timestamp() > propValue.timestamp) {
+            return false;
+        }
+        // update the propertyValue.
+        // The timestamp in propertyStore should only be updated by the server side. It indicates
+        // the time when the event is generated by the server.
+        valueToUpdate->update(propValue, updateStatus);
     }
+    mChangeTracker.onWrite(recId, ++mGeneration);
+    mEvictions += evictLocked((*recordConfig)->evictionPolicy, recId, &mPropertyValues,
+                              &mChangeTracker);
     return true;
 }
 
@@ -74,6 +85,7 @@ void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
     auto it = mPropertyValues.find(recId);
     if (it != mPropertyValues.end()) {
         mPropertyValues.erase(it);
+        mChangeTracker.onRemove(recId);
     }
 }
 
@@ -81,6 +93,7 @@ void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
     MuxGuard g(mLock);
     auto range = findRangeLocked(propId);
     mPropertyValues.erase(range.first, range.second);
+    mChangeTracker.onRemoveProperty(propId);
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
@@ -88,7 +101,7 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
     std::vector<VehiclePropValue> allValues;
     allValues.reserve(mPropertyValues.size());
     for (auto&& it : mPropertyValues) {
-        allValues.push_back(it.second);
+        allValues.push_back(it.second.toValue(it.first.prop));
     }
     return allValues;
 }
@@ -98,7 +111,7 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_
     MuxGuard g(mLock);
     auto range = findRangeLocked(propId);
     for (auto it = range.first; it != range.second; ++it) {
-        values.push_back(it->second);
+        values.push_back(it->second.toValue(propId));
     }
 
     return values;
@@ -108,18 +121,47 @@ std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         const VehiclePropValue& request) const {
     MuxGuard g(mLock);
     RecordId recId = getRecordIdLocked(request);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
-    return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
+    const StoredValue* internalValue = getValueOrNullLocked(recId);
+    return internalValue ? std::make_unique<VehiclePropValue>(internalValue->toValue(recId.prop))
+                         : nullptr;
 }
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         int32_t prop, int32_t area, int64_t token) const {
     RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
     MuxGuard g(mLock);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
-    return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
+    const StoredValue* internalValue = getValueOrNullLocked(recId);
+    return internalValue ? std::make_unique<VehiclePropValue>(internalValue->toValue(prop))
+                         : nullptr;
+}
+
+void VehiclePropertyStore::readValues(const std::vector<VehiclePropValue>& requests,
+                                      const ReadValueFunction& func) const {
+    VehiclePropValue value;
+    MuxGuard g(mLock);
+    for (size_t i = 0; i < requests.size(); i++) {
+        RecordId recId = getRecordIdLocked(requests[i]);
+        const StoredValue* internalValue = getValueOrNullLocked(recId);
+        if (internalValue != nullptr) {
+            internalValue->toValue(recId.prop, &value);
+        }
+        func(i, internalValue != nullptr ? &value : nullptr);
+    }
 }
 
+std::vector<VehiclePropValue> VehiclePropertyStore::readValuesChangedSince(
+        uint64_t token, uint64_t* outToken) const {
+    std::vector<VehiclePropValue> values;
+    MuxGuard g(mLock);
+    mChangeTracker.forEachChangedSince(token, [&](const RecordId& recId) {
+        const StoredValue* value = getValueOrNullLocked(recId);
+        if (value != nullptr) {
+            values.push_back(value->toValue(recId.prop));
+        }
+    });
+    *outToken = mGeneration;
+    return values;
+}
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
     MuxGuard g(mLock);
@@ -133,8 +175,16 @@ std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrNull(int32_t propId) const {
     MuxGuard g(mLock);
-    auto recordConfigIt = mConfigs.find(propId);
-    return recordConfigIt != mConfigs.end() ? &recordConfigIt->second.propConfig : nullptr;
+    const RecordConfig* const* recordConfig = mConfigTable.find(propId);
+    return recordConfig != nullptr ? &(*recordConfig)->propConfig : nullptr;
+}
+
+VehiclePropertyStore::MemoryStats VehiclePropertyStore::getMemoryStats() const {
+    MemoryStats stats;
+    MuxGuard g(mLock);
+    addMemoryStatsLocked(mPropertyValues, &stats);
+    stats.evictions = mEvictions;
+    return stats;
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) const {
@@ -154,16 +204,205 @@ VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
         .token = 0
     };
 
-    auto it = mConfigs.find(recId.prop);
-    if (it == mConfigs.end()) return {};
+    const RecordConfig* const* recordConfig = mConfigTable.find(recId.prop);
+    if (recordConfig == nullptr) return {};
 
-    if (it->second.tokenFunction != nullptr) {
-        recId.token = it->second.tokenFunction(valuePrototype);
+    if ((*recordConfig)->tokenFunction != nullptr) {
+        recId.token = (*recordConfig)->tokenFunction(valuePrototype);
     }
     return recId;
 }
 
-const VehiclePropValue* VehiclePropertyStore::getValueOrNullLocked(
+void VehiclePropertyStore::ChangeTracker::onWrite(const RecordId& recId, uint64_t generation) {
+    auto it = mGenerations.find(recId);
+    if (it == mGenerations.end()) {
+        mGenerations.insert({recId, generation});
+        mChangeLog.insert({generation, recId});
+        return;
+    }
+    // Move the log entry to the new generation, reusing its node.
+    auto node = mChangeLog.extract(it->second);
+    node.key() = generation;
+    mChangeLog.insert(std::move(node));
+    it->second = generation;
+}
+
+void VehiclePropertyStore::ChangeTracker::onRemove(const RecordId& recId) {
+    auto it = mGenerations.find(recId);
+    if (it != mGenerations.end()) {
+        mChangeLog.erase(it->second);
+        mGenerations.erase(it);
+    }
+}
+
+void VehiclePropertyStore::ChangeTracker::onRemoveProperty(int32_t propId) {
+    auto beginIt = mGenerations.lower_bound(RecordId{propId, INT32_MIN, 0});
+    auto endIt = mGenerations.lower_bound(RecordId{propId + 1, INT32_MIN, 0});
+    for (auto it = beginIt; it != endIt; ++it) {
+        mChangeLog.erase(it->second);
+    }
+    mGenerations.erase(beginIt, endIt);
+}
+
+uint64_t VehiclePropertyStore::ChangeTracker::generationOf(const RecordId& recId) const {
+    auto it = mGenerations.find(recId);
+    return it == mGenerations.end() ? 0 : it->second;
+}
+
+void VehiclePropertyStore::ChangeTracker::forEachChangedSince(
+        uint64_t generation, const std::function<void(const RecordId&)>& func) const {
+    for (auto it = mChangeLog.upper_bound(generation); it != mChangeLog.end(); ++it) {
+        func(it->second);
+    }
+}
+
+VehiclePropertyStore::StoredValue::StoredValue(const VehiclePropValue& value)
+    : mTimestamp(value.timestamp), mAreaId(value.areaId), mStatus(value.status) {
+    setValue(value.value);
+}
+
+void VehiclePropertyStore::StoredValue::update(const VehiclePropValue& value, bool updateStatus) {
+    mTimestamp = value.timestamp;
+    if (updateStatus) {
+        mStatus = value.status;
+    }
+    setValue(value.value);
+}
+
+void VehiclePropertyStore::StoredValue::setValue(const VehiclePropValue::RawValue& value) {
+    const size_t scalars =
+            value.int32Values.size() + value.floatValues.size() + value.int64Values.size();
+    if (scalars <= 1 && value.bytes.size() == 0 && value.stringValue.size() == 0) {
+        if (scalars == 0) {
+            mInlineType = InlineType::NONE;
+        } else if (value.int32Values.size() == 1) {
+            mInlineType = InlineType::INT32;
+            mInline.int32Value = value.int32Values[0];
+        } else if (value.floatValues.size() == 1) {
+            mInlineType = InlineType::FLOAT;
+            mInline.floatValue = value.floatValues[0];
+        } else {
+            mInlineType = InlineType::INT64;
+            mInline.int64Value = value.int64Values[0];
+        }
+        mRawValue.reset();
+        return;
+    }
+    mInlineType = InlineType::NONE;
+    if (mRawValue == nullptr) {
+        mRawValue = std::make_unique<VehiclePropValue::RawValue>(value);
+    } else {
+        *mRawValue = value;
+    }
+}
+
+void VehiclePropertyStore::StoredValue::toValue(int32_t prop, VehiclePropValue* outValue) const {
+    outValue->timestamp = mTimestamp;
+    outValue->areaId = mAreaId;
+    outValue->prop = prop;
+    outValue->status = mStatus;
+    if (mRawValue != nullptr) {
+        outValue->value = *mRawValue;
+        return;
+    }
+    VehiclePropValue::RawValue& value = outValue->value;
+    value.int32Values.resize(mInlineType == InlineType::INT32 ? 1 : 0);
+    value.floatValues.resize(mInlineType == InlineType::FLOAT ? 1 : 0);
+    value.int64Values.resize(mInlineType == InlineType::INT64 ? 1 : 0);
+    value.bytes.resize(0);
+    value.stringValue.clear();
+    switch (mInlineType) {
+        case InlineType::INT32:
+            value.int32Values[0] = mInline.int32Value;
+            break;
+        case InlineType::FLOAT:
+            value.floatValues[0] = mInline.floatValue;
+            break;
+        case InlineType::INT64:
+            value.int64Values[0] = mInline.int64Value;
+            break;
+        case InlineType::NONE:
+            break;
+    }
+}
+
+VehiclePropValue VehiclePropertyStore::StoredValue::toValue(int32_t prop) const {
+    VehiclePropValue value;
+    toValue(prop, &value);
+    return value;
+}
+
+size_t VehiclePropertyStore::StoredValue::payloadBytes() const {
+    return mRawValue == nullptr ? 0 : mRawValue->bytes.size() + mRawValue->stringValue.size();
+}
+
+size_t VehiclePropertyStore::StoredValue::heapBytes() const {
+    if (mRawValue == nullptr) return 0;
+    return sizeof(*mRawValue) + mRawValue->int32Values.size() * sizeof(int32_t) +
+           mRawValue->floatValues.size() * sizeof(float) +
+           mRawValue->int64Values.size() * sizeof(int64_t) + payloadBytes();
+}
+
+size_t VehiclePropertyStore::evictLocked(const EvictionPolicy& policy, const RecordId& written,
+                                         PropertyMap* values, ChangeTracker* changes) {
+    if (policy.maxRecords == 0 && policy.maxPayloadBytes == 0) return 0;
+
+    auto beginIt = values->lower_bound(RecordId{written.prop, INT32_MIN, 0});
+    auto endIt = values->lower_bound(RecordId{written.prop + 1, INT32_MIN, 0});
+    size_t records = 0;
+    size_t payloadBytes = 0;
+    for (auto it = beginIt; it != endIt; ++it) {
+        records++;
+        payloadBytes += it->second.payloadBytes();
+    }
+
+    size_t evicted = 0;
+    while ((policy.maxRecords != 0 && records > policy.maxRecords) ||
+           (policy.maxPayloadBytes != 0 && payloadBytes > policy.maxPayloadBytes)) {
+        // Properties with eviction policies hold few values, a linear scan for the least recently
+        // written one is cheaper than keeping them ordered by generation.
+        auto oldestIt = endIt;
+        uint64_t oldestGeneration = UINT64_MAX;
+        for (auto it = beginIt; it != endIt; ++it) {
+            if (it->first == written) continue;
+            uint64_t generation = changes->generationOf(it->first);
+            if (generation < oldestGeneration) {
+                oldestIt = it;
+                oldestGeneration = generation;
+            }
+        }
+        if (oldestIt == endIt) break;  // Only the value written is left.
+
+        records--;
+        payloadBytes -= oldestIt->second.payloadBytes();
+        changes->onRemove(oldestIt->first);
+        if (oldestIt == beginIt) {
+            beginIt = values->erase(oldestIt);
+        } else {
+            values->erase(oldestIt);
+        }
+        evicted++;
+    }
+    return evicted;
+}
+
+void VehiclePropertyStore::addMemoryStatsLocked(const PropertyMap& values, MemoryStats* stats) {
+    // A red-black tree node has three links and a color besides its value. Every record has a
+    // node in the value map, and one in each of the two maps of the ChangeTracker.
+    constexpr size_t kNodeBytes = 4 * sizeof(void*);
+    constexpr size_t kRecordBytes = 3 * kNodeBytes + sizeof(PropertyMap::value_type) +
+                                    sizeof(std::pair<const uint64_t, RecordId>) +
+                                    sizeof(std::pair<const RecordId, uint64_t>);
+    for (const auto& it : values) {
+        stats->records++;
+        if (it.second.isInline()) {
+            stats->inlineRecords++;
+        }
+        stats->bytes += kRecordBytes + it.second.heapBytes();
+    }
+}
+
+const VehiclePropertyStore::StoredValue* VehiclePropertyStore::getValueOrNullLocked(
         const VehiclePropertyStore::RecordId& recId) const  {
     auto it = mPropertyValues.find(recId);
     return it == mPropertyValues.end() ? nullptr : &it->second;
@@ -158,6 +158,89 @@ std::unique_ptr<VehiclePropValue> createStartSessionMessage(const int service_id
     return result;
 }
 
+VmsMessageBuilder::VmsMessageBuilder() {
+    mMessage.prop = toInt(VehicleProperty::VEHICLE_MAP_SERVICE);
+    mMessage.areaId = toInt(VehicleArea::GLOBAL);
+}
+
+void VmsMessageBuilder::beginMessage(VmsMessageType type) {
+    // clear() keeps the capacity, so only messages larger than any built before allocate.
+    mInt32Arena.clear();
+    mBytesArena.clear();
+    mInt32Arena.push_back(toInt(type));
+}
+
+void VmsMessageBuilder::appendLayer(const VmsLayer& layer) {
+    mInt32Arena.push_back(layer.type);
+    mInt32Arena.push_back(layer.subtype);
+    mInt32Arena.push_back(layer.version);
+}
+
+const VehiclePropValue& VmsMessageBuilder::finishMessage() {
+    // The arenas may have been reallocated, so the external pointers are refreshed every time.
+    mMessage.value.int32Values.setToExternal(mInt32Arena.data(), mInt32Arena.size());
+    mMessage.value.bytes.setToExternal(mBytesArena.data(), mBytesArena.size());
+    return mMessage;
+}
+
+const VehiclePropValue& VmsMessageBuilder::subscribe(const VmsLayer& layer) {
+    beginMessage(VmsMessageType::SUBSCRIBE);
+    appendLayer(layer);
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::subscribeToPublisher(
+        const VmsLayerAndPublisher& layer_publisher) {
+    beginMessage(VmsMessageType::SUBSCRIBE_TO_PUBLISHER);
+    appendLayer(layer_publisher.layer);
+    mInt32Arena.push_back(layer_publisher.publisher_id);
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::unsubscribe(const VmsLayer& layer) {
+    beginMessage(VmsMessageType::UNSUBSCRIBE);
+    appendLayer(layer);
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::unsubscribeToPublisher(
+        const VmsLayerAndPublisher& layer_publisher) {
+    beginMessage(VmsMessageType::UNSUBSCRIBE_TO_PUBLISHER);
+    appendLayer(layer_publisher.layer);
+    mInt32Arena.push_back(layer_publisher.publisher_id);
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::offering(const VmsOffers& offers) {
+    beginMessage(VmsMessageType::OFFERING);
+    mInt32Arena.push_back(offers.publisher_id);
+    mInt32Arena.push_back(static_cast<int32_t>(offers.offerings.size()));
+    for (const auto& offer : offers.offerings) {
+        appendLayer(offer.layer);
+        mInt32Arena.push_back(static_cast<int32_t>(offer.dependencies.size()));
+        for (const auto& dependency : offer.dependencies) {
+            appendLayer(dependency);
+        }
+    }
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::data(const VmsLayerAndPublisher& layer_publisher,
+                                                const uint8_t* vms_packet,
+                                                size_t vms_packet_size) {
+    beginMessage(VmsMessageType::DATA);
+    appendLayer(layer_publisher.layer);
+    mInt32Arena.push_back(layer_publisher.publisher_id);
+    mBytesArena.insert(mBytesArena.end(), vms_packet, vms_packet + vms_packet_size);
+    return finishMessage();
+}
+
+const VehiclePropValue& VmsMessageBuilder::data(const VmsLayerAndPublisher& layer_publisher,
+                                                const std::string& vms_packet) {
+    return data(layer_publisher, reinterpret_cast<const uint8_t*>(vms_packet.data()),
+                vms_packet.size());
+}
+
 bool isValidVmsProperty(const VehiclePropValue& value) {
     return (value.prop == toInt(VehicleProperty::VEHICLE_MAP_SERVICE));
 }
@@ -374,6 +457,119 @@ std::vector<VmsAssociatedLayer> getAvailableLayers(const VehiclePropValue& avail
     return {};
 }
 
+bool VmsAssociatedLayersView::parse(const int32_t* values, size_t size, int32_t count) {
+    if (count < 0) {
+        return false;
+    }
+    size_t current_index = 0;
+    for (int32_t i = 0; i < count; i++) {
+        if (size - current_index < static_cast<size_t>(kLayerSize + kLayerNumberSize)) {
+            return false;
+        }
+        const int32_t num_of_publisher_ids = values[current_index + kLayerSize];
+        current_index += kLayerSize + kLayerNumberSize;
+        if (num_of_publisher_ids < 0 ||
+            size - current_index < static_cast<size_t>(num_of_publisher_ids)) {
+            return false;
+        }
+        current_index += num_of_publisher_ids;
+    }
+    mValues = values;
+    mCount = count;
+    return true;
+}
+
+bool VmsSubscriptionsStateView::parse(const VehiclePropValue& subscriptions_state) {
+    *this = VmsSubscriptionsStateView();
+    const auto& values = subscriptions_state.value.int32Values;
+    const size_t layers_start = toInt(VmsSubscriptionsStateIntegerValuesIndex::SUBSCRIPTIONS_START);
+    if (!isValidVmsMessage(subscriptions_state) ||
+        (parseMessageType(subscriptions_state) != VmsMessageType::SUBSCRIPTIONS_CHANGE &&
+         parseMessageType(subscriptions_state) != VmsMessageType::SUBSCRIPTIONS_RESPONSE) ||
+        values.size() < layers_start) {
+        return false;
+    }
+
+    const int32_t num_of_layers =
+            values[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)];
+    if (num_of_layers < 0 ||
+        (values.size() - layers_start) / kLayerSize < static_cast<size_t>(num_of_layers)) {
+        return false;
+    }
+    const size_t associated_layers_start = layers_start + num_of_layers * kLayerSize;
+    const int32_t num_of_associated_layers =
+            values[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_ASSOCIATED_LAYERS)];
+    VmsAssociatedLayersView associated_layers;
+    if (!associated_layers.parse(values.data() + associated_layers_start,
+                                 values.size() - associated_layers_start,
+                                 num_of_associated_layers)) {
+        return false;
+    }
+
+    mSequenceNumber = values[kSubscriptionStateSequenceNumberIndex];
+    mLayers = values.data() + layers_start;
+    mLayerCount = num_of_layers;
+    mAssociatedLayers = associated_layers;
+    return true;
+}
+
+bool VmsAvailabilityStateView::parse(const VehiclePropValue& availability_state) {
+    *this = VmsAvailabilityStateView();
+    const auto& values = availability_state.value.int32Values;
+    const size_t layers_start = toInt(VmsAvailabilityStateIntegerValuesIndex::LAYERS_START);
+    if (!isValidVmsMessage(availability_state) ||
+        (parseMessageType(availability_state) != VmsMessageType::AVAILABILITY_CHANGE &&
+         parseMessageType(availability_state) != VmsMessageType::AVAILABILITY_RESPONSE) ||
+        values.size() < layers_start) {
+        return false;
+    }
+
+    const int32_t num_of_associated_layers =
+            values[toInt(VmsAvailabilityStateIntegerValuesIndex::NUMBER_OF_ASSOCIATED_LAYERS)];
+    VmsAssociatedLayersView associated_layers;
+    if (!associated_layers.parse(values.data() + layers_start, values.size() - layers_start,
+                                 num_of_associated_layers)) {
+        return false;
+    }
+
+    mSequenceNumber = values[kAvailabilitySequenceNumberIndex];
+    mAssociatedLayers = associated_layers;
+    return true;
+}
+
+void getSubscribedLayers(const VmsSubscriptionsStateView& subscriptions_state,
+                         const VmsOffers& offers, std::vector<VmsLayer>* subscribed_layers) {
+    subscribed_layers->clear();
+    // Publishers offer a handful of layers, a linear scan beats building a hash set per message.
+    auto is_offered = [&offers](const VmsLayer& layer) {
+        for (const auto& offer : offers.offerings) {
+            if (offer.layer == layer) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (size_t i = 0; i < subscriptions_state.layerCount(); i++) {
+        VmsLayer layer = subscriptions_state.layerAt(i);
+        if (is_offered(layer)) {
+            subscribed_layers->push_back(layer);
+        }
+    }
+    subscriptions_state.associatedLayers().forEach(
+            [&](const VmsAssociatedLayerView& associated_layer) {
+                if (!is_offered(associated_layer.layer)) {
+                    return;
+                }
+                for (size_t j = 0; j < associated_layer.publisher_id_count; j++) {
+                    if (associated_layer.publisher_ids[j] == offers.publisher_id) {
+                        subscribed_layers->push_back(associated_layer.layer);
+                        return;
+                    }
+                }
+            });
+}
+
 }  // namespace vms
 }  // namespace V2_0
 }  // namespace vehicle
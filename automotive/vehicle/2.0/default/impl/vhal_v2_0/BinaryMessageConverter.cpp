@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BinaryMessageConverter"
+
+#include <string.h>
+
+#include <log/log.h>
+
+#include "BinaryMessageConverter.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace binary_msg_converter {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "Binary emulator messages are encoded in host byte order");
+static_assert(sizeof(MessageHeader) % 8 == 0, "MessageHeader must keep payloads aligned");
+static_assert(sizeof(ValueHeader) % 8 == 0, "ValueHeader must keep payloads aligned");
+
+namespace {
+
+constexpr size_t kAlignment = 8;
+
+constexpr uint64_t alignUp(uint64_t size) {
+    return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+template <typename T>
+void setToExternal(hidl_vec<T>* vec, const uint8_t* data, uint32_t count) {
+    if (count == 0) {
+        vec->setToExternal(nullptr, 0);
+    } else {
+        vec->setToExternal(const_cast<T*>(reinterpret_cast<const T*>(data)), count);
+    }
+}
+
+template <typename T>
+void appendArray(std::vector<uint8_t>* buffer, const T* data, size_t count) {
+    if (count == 0) return;
+    size_t offset = buffer->size();
+    size_t size = count * sizeof(T);
+    // Zero filled padding keeps the next payload aligned.
+    buffer->resize(offset + static_cast<size_t>(alignUp(size)), 0);
+    memcpy(buffer->data() + offset, data, size);
+}
+
+uint64_t valueSize(const ValueHeader& header) {
+    // Counts are 32 bit, computing in 64 bit can't overflow even on 32 bit targets.
+    return alignUp(uint64_t{header.int32Count} * sizeof(int32_t)) +
+           alignUp(uint64_t{header.int64Count} * sizeof(int64_t)) +
+           alignUp(uint64_t{header.floatCount} * sizeof(float)) +
+           alignUp(uint64_t{header.bytesCount}) +
+           (header.stringLength == 0 ? 0 : alignUp(uint64_t{header.stringLength} + 1));
+}
+
+}  // namespace
+
+bool isBinaryMessage(const uint8_t* data, size_t size) {
+    uint32_t magic;
+    if (size < sizeof(MessageHeader)) {
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == kMagic;
+}
+
+void appendValue(std::vector<uint8_t>* buffer, const VehiclePropValue& value) {
+    ValueHeader header = {
+        .timestamp = value.timestamp,
+        .prop = value.prop,
+        .areaId = value.areaId,
+        .status = static_cast<int32_t>(value.status),
+        .int32Count = static_cast<uint32_t>(value.value.int32Values.size()),
+        .int64Count = static_cast<uint32_t>(value.value.int64Values.size()),
+        .floatCount = static_cast<uint32_t>(value.value.floatValues.size()),
+        .bytesCount = static_cast<uint32_t>(value.value.bytes.size()),
+        .stringLength = static_cast<uint32_t>(value.value.stringValue.size()),
+    };
+    size_t offset = buffer->size();
+    buffer->resize(offset + sizeof(header));
+    memcpy(buffer->data() + offset, &header, sizeof(header));
+
+    appendArray(buffer, value.value.int32Values.data(), header.int32Count);
+    appendArray(buffer, value.value.int64Values.data(), header.int64Count);
+    appendArray(buffer, value.value.floatValues.data(), header.floatCount);
+    appendArray(buffer, value.value.bytes.data(), header.bytesCount);
+    // Strings keep their terminating NUL, decoded strings point into the buffer.
+    if (header.stringLength > 0) {
+        appendArray(buffer, value.value.stringValue.c_str(), header.stringLength + 1);
+    }
+}
+
+bool decodeValue(const uint8_t* data, size_t size, size_t* offset, VehiclePropValue* outValue) {
+    if (*offset > size || size - *offset < sizeof(ValueHeader) ||
+        reinterpret_cast<uintptr_t>(data + *offset) % kAlignment != 0) {
+        return false;
+    }
+    const ValueHeader* header = reinterpret_cast<const ValueHeader*>(data + *offset);
+    uint64_t payloadSize = valueSize(*header);
+    if (size - *offset - sizeof(ValueHeader) < payloadSize) {
+        return false;
+    }
+    const uint8_t* payload = data + *offset + sizeof(ValueHeader);
+    if (header->stringLength > 0 &&
+        payload[payloadSize - alignUp(header->stringLength + 1) + header->stringLength] != '\0') {
+        return false;
+    }
+
+    outValue->timestamp = header->timestamp;
+    outValue->prop = header->prop;
+    outValue->areaId = header->areaId;
+    outValue->status = static_cast<VehiclePropertyStatus>(header->status);
+
+    setToExternal(&outValue->value.int32Values, payload, header->int32Count);
+    payload += alignUp(header->int32Count * sizeof(int32_t));
+    setToExternal(&outValue->value.int64Values, payload, header->int64Count);
+    payload += alignUp(header->int64Count * sizeof(int64_t));
+    setToExternal(&outValue->value.floatValues, payload, header->floatCount);
+    payload += alignUp(header->floatCount * sizeof(float));
+    setToExternal(&outValue->value.bytes, payload, header->bytesCount);
+    payload += alignUp(header->bytesCount);
+    if (header->stringLength == 0) {
+        outValue->value.stringValue.clear();
+    } else {
+        outValue->value.stringValue.setToExternal(reinterpret_cast<const char*>(payload),
+                                                  header->stringLength);
+    }
+
+    *offset += sizeof(ValueHeader) + payloadSize;
+    return true;
+}
+
+Encoder::Encoder(std::vector<uint8_t>* buffer) : mBuffer(buffer) {}
+
+void Encoder::begin(uint16_t msgType, vhal_proto::Status status) {
+    MessageHeader header = {
+        .magic = kMagic,
+        .version = kVersion,
+        .msgType = msgType,
+        .status = status,
+        .valueCount = 0,
+    };
+    mBuffer->resize(sizeof(header));
+    memcpy(mBuffer->data(), &header, sizeof(header));
+}
+
+void Encoder::addValue(const VehiclePropValue& value) {
+    appendValue(mBuffer, value);
+
+    // valueCount is at the same offset in every message.
+    MessageHeader* messageHeader = reinterpret_cast<MessageHeader*>(mBuffer->data());
+    messageHeader->valueCount++;
+}
+
+bool Decoder::parse(const uint8_t* data, size_t size) {
+    if (!isBinaryMessage(data, size)) {
+        return false;
+    }
+    memcpy(&mHeader, data, sizeof(mHeader));
+    if (mHeader.version != kVersion) {
+        ALOGE("%s: unsupported binary message version %u", __func__, mHeader.version);
+        return false;
+    }
+    if (reinterpret_cast<uintptr_t>(data) % kAlignment != 0) {
+        ALOGE("%s: binary message buffer is not aligned", __func__);
+        return false;
+    }
+
+    // Validate the whole message upfront, so nextValue() can't read out of bounds.
+    size_t offset = sizeof(MessageHeader);
+    VehiclePropValue value;
+    for (uint32_t i = 0; i < mHeader.valueCount; i++) {
+        if (!decodeValue(data, size, &offset, &value)) {
+            return false;
+        }
+    }
+
+    mData = data;
+    mSize = size;
+    mOffset = sizeof(MessageHeader);
+    mValuesRead = 0;
+    return true;
+}
+
+bool Decoder::nextValue(VehiclePropValue* outValue) {
+    if (mData == nullptr || mValuesRead == mHeader.valueCount) {
+        return false;
+    }
+
+    decodeValue(mData, mSize, &mOffset, outValue);
+    mValuesRead++;
+    return true;
+}
+
+}  // namespace binary_msg_converter
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_BinaryMessageConverter_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_BinaryMessageConverter_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+#include "VehicleHalProto.pb.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Compact binary framing for the emulator link, an optional alternative to protobuf encoded
+ * EmulatorMessages for high rate property traffic.
+ *
+ * A message is a MessageHeader followed by valueCount values. Each value is a ValueHeader followed
+ * by its int32, int64, float, bytes and string payloads, each payload starts at an 8 byte aligned
+ * offset from the beginning of the message. All fields are little endian.
+ *
+ * Messages start with kMagic, which can never be the first bytes of a serialized EmulatorMessage,
+ * so both formats can share a connection. The binary format is only used to send messages to a
+ * client after it sent a kMsgTypeNegotiate message.
+ */
+namespace binary_msg_converter {
+
+constexpr uint32_t kMagic = 0x31424856;  // "VHB1"
+constexpr uint16_t kVersion = 1;
+
+/* Message type used to switch a connection to binary format, values are vhal_proto::MsgType. */
+constexpr uint16_t kMsgTypeNegotiate = 0xff00;
+
+struct MessageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t msgType;
+    int32_t status;  // vhal_proto::Status
+    uint32_t valueCount;
+};
+
+struct ValueHeader {
+    int64_t timestamp;
+    int32_t prop;
+    int32_t areaId;
+    int32_t status;
+    uint32_t int32Count;
+    uint32_t int64Count;
+    uint32_t floatCount;
+    uint32_t bytesCount;
+    uint32_t stringLength;
+};
+
+bool isBinaryMessage(const uint8_t* data, size_t size);
+
+/* Appends a ValueHeader and the payloads of value to buffer, which must be 8 byte aligned. */
+void appendValue(std::vector<uint8_t>* buffer, const VehiclePropValue& value);
+
+/**
+ * Populates outValue with a shallow view of the value starting at data + *offset and advances
+ * *offset past it. Returns false if the value is malformed or doesn't fit into size bytes.
+ */
+bool decodeValue(const uint8_t* data, size_t size, size_t* offset, VehiclePropValue* outValue);
+
+/**
+ * Serializes a message into a caller provided buffer. The buffer keeps its capacity across
+ * messages, so encoding into a reused buffer doesn't allocate.
+ */
+class Encoder {
+public:
+    explicit Encoder(std::vector<uint8_t>* buffer);
+
+    void begin(uint16_t msgType, vhal_proto::Status status);
+    void addValue(const VehiclePropValue& value);
+
+private:
+    std::vector<uint8_t>* mBuffer;
+};
+
+/**
+ * Parses a message without copying it. Values returned by nextValue() point into the parsed
+ * buffer and are only valid as long as that buffer is.
+ */
+class Decoder {
+public:
+    /* Returns false if data isn't a well formed binary message. */
+    bool parse(const uint8_t* data, size_t size);
+
+    uint16_t msgType() const { return mHeader.msgType; }
+    vhal_proto::Status status() const { return static_cast<vhal_proto::Status>(mHeader.status); }
+    uint32_t valueCount() const { return mHeader.valueCount; }
+
+    /* Populates outValue with a shallow view of the next value, returns false if none is left. */
+    bool nextValue(VehiclePropValue* outValue);
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    size_t mOffset = 0;
+    uint32_t mValuesRead = 0;
+    MessageHeader mHeader = {};
+};
+
+}  // namespace binary_msg_converter
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_BinaryMessageConverter_H_
@@ -22,6 +22,7 @@
 #include <log/log.h>
 
 #include "CommConn.h"
+#include "ProtoMessageConverter.h"
 
 namespace android {
 namespace hardware {
@@ -36,7 +37,7 @@ void CommConn::start() {
 }
 
 void CommConn::stop() {
-    if (mReadThread->joinable()) {
+    if (mReadThread && mReadThread->joinable()) {
         mReadThread->join();
     }
 }
@@ -49,9 +50,51 @@ void CommConn::sendMessage(vhal_proto::EmulatorMessage const& msg) {
         return;
     }
 
+    std::lock_guard<std::mutex> g(mWriteLock);
     write(buffer);
 }
 
+void CommConn::sendPropertyValues(const VehiclePropValue* values, size_t count) {
+    if (!mBinaryNegotiated) {
+        vhal_proto::EmulatorMessage msg;
+        for (size_t i = 0; i < count; i++) {
+            proto_msg_converter::toProto(msg.add_value(), values[i]);
+        }
+        msg.set_status(vhal_proto::RESULT_OK);
+        msg.set_msg_type(vhal_proto::SET_PROPERTY_ASYNC);
+        sendMessage(msg);
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(mWriteLock);
+    binary_msg_converter::Encoder encoder(&mTxBuffer);
+    encoder.begin(vhal_proto::SET_PROPERTY_ASYNC, vhal_proto::RESULT_OK);
+    for (size_t i = 0; i < count; i++) {
+        encoder.addValue(values[i]);
+    }
+    write(mTxBuffer);
+}
+
+void CommConn::processBinaryMessage(const std::vector<uint8_t>& buffer) {
+    binary_msg_converter::Decoder decoder;
+    if (!decoder.parse(buffer.data(), buffer.size())) {
+        ALOGW("%s: Dropping malformed binary message", __func__);
+        return;
+    }
+
+    binary_msg_converter::Encoder encoder(&mRespBuffer);
+    if (decoder.msgType() == binary_msg_converter::kMsgTypeNegotiate) {
+        ALOGI("%s: Switching connection to binary messages", __func__);
+        mBinaryNegotiated = true;
+        encoder.begin(binary_msg_converter::kMsgTypeNegotiate, vhal_proto::RESULT_OK);
+    } else {
+        mMessageProcessor->processBinaryMessage(decoder, encoder);
+    }
+
+    std::lock_guard<std::mutex> g(mWriteLock);
+    write(mRespBuffer);
+}
+
 void CommConn::readThread() {
     std::vector<uint8_t> buffer;
     while (isOpen()) {
@@ -61,13 +104,22 @@ void CommConn::readThread() {
             break;
         }
 
-        vhal_proto::EmulatorMessage rxMsg;
-        if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
-            vhal_proto::EmulatorMessage respMsg;
-            mMessageProcessor->processMessage(rxMsg, respMsg);
+        handleMessage(buffer);
+    }
+}
+
+void CommConn::handleMessage(const std::vector<uint8_t>& buffer) {
+    if (binary_msg_converter::isBinaryMessage(buffer.data(), buffer.size())) {
+        processBinaryMessage(buffer);
+        return;
+    }
 
-            sendMessage(respMsg);
-        }
+    vhal_proto::EmulatorMessage rxMsg;
+    if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
+        vhal_proto::EmulatorMessage respMsg;
+        mMessageProcessor->processMessage(rxMsg, respMsg);
+
+        sendMessage(respMsg);
     }
 }
 
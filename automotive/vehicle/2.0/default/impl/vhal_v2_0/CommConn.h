@@ -18,10 +18,13 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_CommBase_H_
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "BinaryMessageConverter.h"
 #include "VehicleHalProto.pb.h"
 
 namespace android {
@@ -46,6 +49,13 @@ class MessageProcessor {
      */
     virtual void processMessage(vhal_proto::EmulatorMessage const& rxMsg,
                                 vhal_proto::EmulatorMessage& respMsg) = 0;
+
+    /**
+     * Process a single message received over a CommConn in binary format, see
+     * BinaryMessageConverter.h. Populate the given respMsg with the reply message we should send.
+     */
+    virtual void processBinaryMessage(binary_msg_converter::Decoder& rxMsg,
+                                      binary_msg_converter::Encoder& respMsg) = 0;
 };
 
 /**
@@ -82,7 +92,7 @@ class CommConn {
     virtual std::vector<uint8_t> read() = 0;
 
     /**
-     * Transmits a string of data to the emulator.
+     * Transmits a string of data to the emulator. Always called with mWriteLock held.
      *
      * @param data Serialized protobuf data to transmit.
      *
@@ -95,10 +105,31 @@ class CommConn {
      */
     void sendMessage(vhal_proto::EmulatorMessage const& msg);
 
+    /**
+     * Sends the given values as a single SET_PROPERTY_ASYNC message. Uses the binary format if the
+     * other side negotiated it, EmulatorMessage otherwise.
+     */
+    void sendPropertyValues(const VehiclePropValue* values, size_t count);
+
    protected:
     std::unique_ptr<std::thread> mReadThread;
     MessageProcessor* mMessageProcessor;
 
+    // Set once the other side sent binary_msg_converter::kMsgTypeNegotiate.
+    std::atomic<bool> mBinaryNegotiated{false};
+    // Serializes writes from the HAL and the read thread, guards the transmit buffer.
+    std::mutex mWriteLock;
+    std::vector<uint8_t> mTxBuffer;
+    std::vector<uint8_t> mRespBuffer;  // Only used by the read thread.
+
+    void processBinaryMessage(const std::vector<uint8_t>& buffer);
+
+    /**
+     * Parses a single message received over this connection, hands it to the MessageProcessor and
+     * sends the reply.
+     */
+    void handleMessage(const std::vector<uint8_t>& buffer);
+
     /**
      * A thread that reads messages in a loop, and responds. You can stop this thread by calling
      * stop().
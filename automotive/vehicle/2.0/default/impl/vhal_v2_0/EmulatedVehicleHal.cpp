@@ -17,6 +17,7 @@
 
 #include <android/log.h>
 #include <android-base/macros.h>
+#include <android-base/parseint.h>
 
 #include "EmulatedVehicleHal.h"
 #include "JsonFakeValueGenerator.h"
@@ -31,6 +32,12 @@ namespace V2_0 {
 
 namespace impl {
 
+// Live frames kept for --obd2-history, 10 minutes at the 1Hz rate of the fake data generators.
+constexpr size_t kObd2HistoryCapacity = 600;
+// Freeze frames are stored per timestamp, the oldest are dropped beyond this.
+constexpr size_t kObd2MaxFreezeFrames = 64;
+constexpr char kObd2HistoryDumpOption[] = "--obd2-history";
+
 static std::unique_ptr<Obd2SensorStore> fillDefaultObd2Frame(size_t numVendorIntegerSensors,
                                                              size_t numVendorFloatSensors) {
     std::unique_ptr<Obd2SensorStore> sensorStore(
@@ -156,7 +163,64 @@ VehicleHal::VehiclePropValuePtr EmulatedVehicleHal::get(
     return v;
 }
 
+bool EmulatedVehicleHal::isSpecialGetProperty(int32_t propId) const {
+    return propId == OBD2_FREEZE_FRAME || propId == OBD2_FREEZE_FRAME_INFO ||
+           (mEmulatedUserHal != nullptr && mEmulatedUserHal->isSupported(propId));
+}
+
+void EmulatedVehicleHal::getValues(const std::vector<VehiclePropValue>& requests,
+                                   std::vector<VehiclePropValuePtr>* outValues,
+                                   std::vector<StatusCode>* outStatus) {
+    outValues->resize(requests.size());
+    outStatus->resize(requests.size());
+
+    // Plain properties are read from the store in one go, the rest go through get().
+    std::vector<VehiclePropValue> storeRequests;
+    std::vector<size_t> storeIndices;
+    storeRequests.reserve(requests.size());
+    storeIndices.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (isSpecialGetProperty(requests[i].prop)) {
+            (*outValues)[i] = get(requests[i], &(*outStatus)[i]);
+        } else {
+            storeRequests.push_back(requests[i]);
+            storeIndices.push_back(i);
+        }
+    }
+
+    auto& pool = *getValuePool();
+    int64_t timestamp = elapsedRealtimeNano();
+    mPropStore->readValues(storeRequests, [&](size_t index, const VehiclePropValue* value) {
+        size_t i = storeIndices[index];
+        if (value == nullptr) {
+            (*outValues)[i] = nullptr;
+            (*outStatus)[i] = StatusCode::INVALID_ARG;
+            return;
+        }
+        (*outValues)[i] = pool.obtain(*value);
+        (*outValues)[i]->timestamp = timestamp;
+        (*outStatus)[i] = StatusCode::OK;
+    });
+}
+
 bool EmulatedVehicleHal::dump(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (options.size() > 0 && options[0] == kObd2HistoryDumpOption) {
+        dumpObd2History(fd->data[0], options);
+        return false;
+    }
+    if (options.size() > 0 && options[0] == "--help") {
+        dprintf(fd->data[0],
+                "%s [SECONDS]: dumps the OBD2 live frames of the last SECONDS, default all\n",
+                kObd2HistoryDumpOption);
+    }
+    if (options.size() == 0) {
+        dprintf(fd->data[0], "Continuous properties timer:\n");
+        mRecurrentTimer.dump(fd->data[0], "  ");
+        const VehiclePropertyStore::MemoryStats stats = mPropStore->getMemoryStats();
+        dprintf(fd->data[0],
+                "Property store: %zu values (%zu inline), ~%zu bytes, %zu evicted\n\n",
+                stats.records, stats.inlineRecords, stats.bytes, stats.evictions);
+    }
     return mVehicleClient->dump(fd, options);
 }
 
@@ -352,6 +416,12 @@ void EmulatedVehicleHal::onPropertyValue(const VehiclePropValue& value, bool upd
     VehiclePropValuePtr updatedPropValue = getValuePool()->obtain(value);
 
     if (mPropStore->writeValue(*updatedPropValue, updateStatus)) {
+        if (value.prop == OBD2_LIVE_FRAME) {
+            std::lock_guard<std::mutex> g(mObd2HistoryLock);
+            if (mObd2History != nullptr) {
+                mObd2History->record(*updatedPropValue);
+            }
+        }
         getEmulatorOrDie()->doSetValueFromClient(*updatedPropValue);
         doHalEvent(std::move(updatedPropValue));
     }
@@ -361,19 +431,21 @@ void EmulatedVehicleHal::initStaticConfig() {
     for (auto&& it = std::begin(kVehicleProperties); it != std::end(kVehicleProperties); ++it) {
         const auto& cfg = it->config;
         VehiclePropertyStore::TokenFunction tokenFunction = nullptr;
+        VehiclePropertyStore::EvictionPolicy evictionPolicy;
 
         switch (cfg.prop) {
             case OBD2_FREEZE_FRAME: {
                 tokenFunction = [](const VehiclePropValue& propValue) {
                     return propValue.timestamp;
                 };
+                evictionPolicy.maxRecords = kObd2MaxFreezeFrames;
                 break;
             }
             default:
                 break;
         }
 
-        mPropStore->registerProperty(cfg, tokenFunction);
+        mPropStore->registerProperty(cfg, tokenFunction, evictionPolicy);
     }
 }
 
@@ -387,6 +459,12 @@ void EmulatedVehicleHal::initObd2LiveFrame(const VehiclePropConfig& propConfig)
     liveObd2Frame->prop = OBD2_LIVE_FRAME;
 
     mPropStore->writeValue(*liveObd2Frame, shouldUpdateStatus);
+
+    std::lock_guard<std::mutex> g(mObd2HistoryLock);
+    mObd2History = std::make_unique<Obd2FrameHistory>(kObd2HistoryCapacity,
+                                                      sensorStore->getIntegerSensors().size(),
+                                                      sensorStore->getFloatSensors().size());
+    mObd2History->record(*liveObd2Frame);
 }
 
 void EmulatedVehicleHal::initObd2FreezeFrame(const VehiclePropConfig& propConfig) {
@@ -445,6 +523,33 @@ StatusCode EmulatedVehicleHal::clearObd2FreezeFrames(const VehiclePropValue& pro
     return StatusCode::OK;
 }
 
+void EmulatedVehicleHal::dumpObd2History(int fd, const hidl_vec<hidl_string>& options) {
+    int64_t since = 0;
+    if (options.size() > 1) {
+        int seconds;
+        if (!android::base::ParseInt(std::string(options[1]), &seconds, 0)) {
+            dprintf(fd, "Invalid number of seconds: %s\n", options[1].c_str());
+            return;
+        }
+        since = elapsedRealtimeNano() - static_cast<int64_t>(seconds) * 1000000000;
+    }
+
+    std::lock_guard<std::mutex> g(mObd2HistoryLock);
+    if (mObd2History == nullptr) {
+        dprintf(fd, "OBD2 live frames are not supported\n");
+        return;
+    }
+    std::vector<int64_t> timestamps = mObd2History->getTimestamps(since);
+    dprintf(fd, "%zu of %zu OBD2 live frames (capacity %zu)\n", timestamps.size(),
+            mObd2History->size(), mObd2History->capacity());
+    VehiclePropValue frame;
+    frame.prop = OBD2_LIVE_FRAME;
+    for (int64_t timestamp : timestamps) {
+        mObd2History->fillPropValue(timestamp, &frame);
+        dprintf(fd, "%s\n", toString(frame).c_str());
+    }
+}
+
 StatusCode EmulatedVehicleHal::fillObd2DtcInfo(VehiclePropValue* outValue) {
     std::vector<int64_t> timestamps;
     for (const auto& freezeFrame : mPropStore->readValuesForProperty(OBD2_FREEZE_FRAME)) {
@@ -19,12 +19,14 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sys/socket.h>
 #include <thread>
 #include <unordered_set>
 
 #include <utils/SystemClock.h>
 
+#include <vhal_v2_0/Obd2FrameHistory.h>
 #include <vhal_v2_0/RecurrentTimer.h>
 #include <vhal_v2_0/VehicleHal.h>
 #include "vhal_v2_0/VehiclePropertyStore.h"
@@ -55,6 +57,9 @@ public:
     std::vector<VehiclePropConfig> listProperties() override;
     VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
                             StatusCode* outStatus) override;
+    void getValues(const std::vector<VehiclePropValue>& requests,
+                   std::vector<VehiclePropValuePtr>* outValues,
+                   std::vector<StatusCode>* outStatus) override;
     StatusCode set(const VehiclePropValue& propValue) override;
     StatusCode subscribe(int32_t property, float sampleRate) override;
     StatusCode unsubscribe(int32_t property) override;
@@ -63,8 +68,12 @@ public:
     //  Methods from EmulatedVehicleHalIface
     bool setPropertyFromVehicle(const VehiclePropValue& propValue) override;
     std::vector<VehiclePropValue> getAllProperties() const override;
+    bool isContinuousProperty(int32_t propId) const override;
 
 private:
+    /* Returns true if get() can't be served from the property store. */
+    bool isSpecialGetProperty(int32_t propId) const;
+
     constexpr std::chrono::nanoseconds hertzToNanoseconds(float hz) const {
         return std::chrono::nanoseconds(static_cast<int64_t>(1000000000L / hz));
     }
@@ -73,7 +82,6 @@ private:
     void onPropertyValue(const VehiclePropValue& value, bool updateStatus);
 
     void onContinuousPropertyTimer(const std::vector<int32_t>& properties);
-    bool isContinuousProperty(int32_t propId) const;
     void initStaticConfig();
     void initObd2LiveFrame(const VehiclePropConfig& propConfig);
     void initObd2FreezeFrame(const VehiclePropConfig& propConfig);
@@ -81,6 +89,7 @@ private:
                                    VehiclePropValue* outValue);
     StatusCode fillObd2DtcInfo(VehiclePropValue* outValue);
     StatusCode clearObd2FreezeFrames(const VehiclePropValue& propValue);
+    void dumpObd2History(int fd, const hidl_vec<hidl_string>& options);
 
     /* Private members */
     VehiclePropertyStore* mPropStore;
@@ -88,6 +97,10 @@ private:
     RecurrentTimer mRecurrentTimer;
     VehicleHalClient* mVehicleClient;
     EmulatedUserHal* mEmulatedUserHal;
+
+    // Live frames are recorded from the client thread and dumped from binder threads.
+    std::mutex mObd2HistoryLock;
+    std::unique_ptr<Obd2FrameHistory> mObd2History;  // Guarded by mObd2HistoryLock.
 };
 
 }  // impl
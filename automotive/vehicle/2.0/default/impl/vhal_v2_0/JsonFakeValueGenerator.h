@@ -47,16 +47,22 @@ public:
 
     bool hasNext();
 
+    /**
+     * Parses a fake data JSON file into events. Also used to precompile JSON files into a
+     * ReplayTrace, which can be replayed without parsing it first.
+     */
+    static std::vector<VehiclePropValue> parseFakeValueJson(std::istream& is);
+
 private:
-    std::vector<VehiclePropValue> parseFakeValueJson(std::istream& is);
-    void copyMixedValueJson(VehiclePropValue::RawValue& dest, const Json::Value& jsonValue);
+    static void copyMixedValueJson(VehiclePropValue::RawValue& dest, const Json::Value& jsonValue);
 
     template <typename T>
-    void copyJsonArray(hidl_vec<T>& dest, const Json::Value& jsonArray);
+    static void copyJsonArray(hidl_vec<T>& dest, const Json::Value& jsonArray);
 
-    bool isDiagnosticProperty(int32_t prop);
-    hidl_vec<uint8_t> generateDiagnosticBytes(const VehiclePropValue::RawValue& diagnosticValue);
-    void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
+    static bool isDiagnosticProperty(int32_t prop);
+    static hidl_vec<uint8_t> generateDiagnosticBytes(
+            const VehiclePropValue::RawValue& diagnosticValue);
+    static void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
 
 private:
     GeneratorCfg mGenCfg;
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ReplayTrace"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <log/log.h>
+
+#include "BinaryMessageConverter.h"
+#include "ReplayTrace.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+static_assert(sizeof(ReplayTrace::TraceHeader) % 8 == 0, "TraceHeader must keep events aligned");
+
+ReplayTrace::ReplayTrace(const uint8_t* data, size_t size, size_t eventCount, size_t indexOffset)
+    : mData(data),
+      mSize(size),
+      mEventCount(eventCount),
+      mIndexOffset(indexOffset),
+      mIndex(reinterpret_cast<const uint64_t*>(data + indexOffset)) {}
+
+ReplayTrace::~ReplayTrace() {
+    munmap(const_cast<uint8_t*>(mData), mSize);
+}
+
+std::unique_ptr<ReplayTrace> ReplayTrace::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("%s: couldn't open %s, errno=%d", __func__, path.c_str(), errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(TraceHeader)) {
+        ALOGE("%s: %s is too small to be a trace", __func__, path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        ALOGE("%s: couldn't map %s, errno=%d", __func__, path.c_str(), errno);
+        return nullptr;
+    }
+    // Events are replayed front to back.
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    const uint8_t* data = static_cast<const uint8_t*>(addr);
+    TraceHeader header;
+    memcpy(&header, data, sizeof(header));
+    bool valid = header.magic == kMagic && header.version == kVersion &&
+                 header.indexOffset % alignof(uint64_t) == 0 &&
+                 header.indexOffset >= sizeof(TraceHeader) && header.indexOffset <= size &&
+                 header.eventCount <= (size - header.indexOffset) / sizeof(uint64_t);
+    if (valid) {
+        // Event contents are validated when they are read, offsets are validated once here so
+        // timestampAt() can't read out of bounds.
+        const uint64_t* index = reinterpret_cast<const uint64_t*>(data + header.indexOffset);
+        for (uint64_t i = 0; valid && i < header.eventCount; i++) {
+            valid = index[i] % 8 == 0 && index[i] >= sizeof(TraceHeader) &&
+                    index[i] + sizeof(binary_msg_converter::ValueHeader) <= header.indexOffset;
+        }
+    }
+    if (!valid) {
+        ALOGE("%s: %s is not a valid trace", __func__, path.c_str());
+        munmap(addr, size);
+        return nullptr;
+    }
+    return std::unique_ptr<ReplayTrace>(
+            new ReplayTrace(data, size, header.eventCount, header.indexOffset));
+}
+
+bool ReplayTrace::isReplayTrace(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    uint32_t magic = 0;
+    ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return ifs && magic == kMagic;
+}
+
+bool ReplayTrace::write(const std::string& path, const std::vector<VehiclePropValue>& events) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        ALOGE("%s: couldn't open %s for writing", __func__, path.c_str());
+        return false;
+    }
+
+    TraceHeader header = {
+        .magic = kMagic,
+        .version = kVersion,
+        .reserved = 0,
+        .eventCount = events.size(),
+        .indexOffset = 0,
+    };
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<uint64_t> index;
+    index.reserve(events.size());
+    uint64_t offset = sizeof(header);
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (i > 0 && events[i].timestamp < events[i - 1].timestamp) {
+            ALOGE("%s: event %zu is out of order", __func__, i);
+            return false;
+        }
+        buffer.clear();
+        binary_msg_converter::appendValue(&buffer, events[i]);
+        ofs.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        index.push_back(offset);
+        offset += buffer.size();
+    }
+    ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t));
+
+    header.indexOffset = offset;
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(ofs.flush());
+}
+
+int64_t ReplayTrace::timestampAt(size_t index) const {
+    int64_t timestamp;
+    // The timestamp is the first field of the ValueHeader.
+    memcpy(&timestamp, mData + mIndex[index], sizeof(timestamp));
+    return timestamp;
+}
+
+bool ReplayTrace::valueAt(size_t index, VehiclePropValue* outValue) const {
+    size_t offset = mIndex[index];
+    return binary_msg_converter::decodeValue(mData, mIndexOffset, &offset, outValue);
+}
+
+size_t ReplayTrace::lowerBound(int64_t timestamp) const {
+    size_t first = 0;
+    size_t count = mEventCount;
+    while (count > 0) {
+        size_t step = count / 2;
+        if (timestampAt(first + step) < timestamp) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_ReplayTrace_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_ReplayTrace_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Precompiled fake data trace, a compact alternative to the JSON files used by
+ * JsonFakeValueGenerator that can be replayed without parsing it into memory first.
+ *
+ * A trace is a TraceHeader, followed by events encoded in binary_msg_converter's value format and
+ * an index with the file offset of every event. Events are ordered by timestamp. The file is
+ * mapped read-only, so opening a trace is constant time and only the pages that are being replayed
+ * are resident.
+ */
+class ReplayTrace {
+public:
+    static constexpr uint32_t kMagic = 0x54524856;  // "VHRT"
+    static constexpr uint16_t kVersion = 1;
+
+    struct TraceHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint64_t eventCount;
+        uint64_t indexOffset;
+    };
+
+    ~ReplayTrace();
+
+    /* Maps the trace at path, returns nullptr if it can't be opened or isn't a valid trace. */
+    static std::unique_ptr<ReplayTrace> open(const std::string& path);
+
+    /* Returns true if the file at path starts with a trace header. */
+    static bool isReplayTrace(const std::string& path);
+
+    /* Writes events, which must be ordered by timestamp, as a trace to path. */
+    static bool write(const std::string& path, const std::vector<VehiclePropValue>& events);
+
+    size_t size() const { return mEventCount; }
+
+    int64_t timestampAt(size_t index) const;
+
+    /**
+     * Populates outValue with a shallow view of the event at index, it is only valid as long as
+     * this trace is. Returns false if the event is malformed.
+     */
+    bool valueAt(size_t index, VehiclePropValue* outValue) const;
+
+    /* Returns the index of the first event with a timestamp not less than timestamp. */
+    size_t lowerBound(int64_t timestamp) const;
+
+private:
+    ReplayTrace(const uint8_t* data, size_t size, size_t eventCount, size_t indexOffset);
+
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mEventCount;
+    size_t mIndexOffset;
+    const uint64_t* mIndex;
+};
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_ReplayTrace_H_
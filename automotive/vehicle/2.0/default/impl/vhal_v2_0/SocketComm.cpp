@@ -19,10 +19,15 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 #include <android/log.h>
 #include <arpa/inet.h>
+#include <inttypes.h>
 #include <log/log.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 
+#include <algorithm>
+
 #include "SocketComm.h"
 
 // Socket to use when communicating with Host PC
@@ -36,8 +41,22 @@ namespace V2_0 {
 
 namespace impl {
 
+namespace {
+
+constexpr int kListenBacklog = 8;
+constexpr int kMaxEvents = 16;
+constexpr size_t kMsgHeaderLen = sizeof(uint32_t);
+// Upper bound for incoming messages, anything larger means the stream is out of sync.
+constexpr uint32_t kMaxRxMessageSize = 1 << 20;
+// Droppable values aren't queued for a client once this much data is waiting for it.
+constexpr size_t kDropThresholdBytes = 256 * 1024;
+// A client that falls this far behind is disconnected, it would otherwise miss on-change events.
+constexpr size_t kMaxQueuedBytes = 4 * 1024 * 1024;
+
+}  // namespace
+
 SocketComm::SocketComm(MessageProcessor* messageProcessor)
-    : mListenFd(-1), mMessageProcessor(messageProcessor) {}
+    : mListenFd(-1), mEpollFd(-1), mWakeFd(-1), mMessageProcessor(messageProcessor) {}
 
 SocketComm::~SocketComm() {
 }
@@ -47,16 +66,44 @@ void SocketComm::start() {
         return;
     }
 
-    mListenThread = std::make_unique<std::thread>(std::bind(&SocketComm::listenThread, this));
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mEpollFd < 0 || mWakeFd < 0) {
+        ALOGE("%s: Failed to create epoll loop, errno=%d", __FUNCTION__, errno);
+        return;
+    }
+
+    // The listening socket is tagged with nullptr, the wake up eventfd with mWakeFd's address and
+    // every connection with its SocketConn.
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mListenFd, &event);
+    event.data.ptr = &mWakeFd;
+    epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+
+    mEventThread = std::make_unique<std::thread>(std::bind(&SocketComm::eventThread, this));
 }
 
 void SocketComm::stop() {
-    if (mListenFd > 0) {
-        ::close(mListenFd);
-        if (mListenThread->joinable()) {
-            mListenThread->join();
+    if (mEventThread) {
+        uint64_t one = 1;
+        ::write(mWakeFd, &one, sizeof(one));
+        if (mEventThread->joinable()) {
+            mEventThread->join();
+        }
+        mEventThread.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mOpenConnections.clear();
+    }
+    for (int* fd : {&mListenFd, &mWakeFd, &mEpollFd}) {
+        if (*fd > 0) {
+            ::close(*fd);
+            *fd = -1;
         }
-        mListenFd = -1;
     }
 }
 
@@ -67,11 +114,18 @@ void SocketComm::sendMessage(vhal_proto::EmulatorMessage const& msg) {
     }
 }
 
+void SocketComm::sendPropertyValues(const VehiclePropValue* values, size_t count, bool droppable) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (std::unique_ptr<SocketConn> const& conn : mOpenConnections) {
+        conn->sendPropertyValues(values, count, droppable);
+    }
+}
+
 bool SocketComm::listen() {
     int retVal;
     struct sockaddr_in servAddr;
 
-    mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    mListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (mListenFd < 0) {
         ALOGE("%s: socket() failed, mSockFd=%d, errno=%d", __FUNCTION__, mListenFd, errno);
         mListenFd = -1;
@@ -92,128 +146,250 @@ bool SocketComm::listen() {
     }
 
     ALOGI("%s: Listening for connections on port %d", __FUNCTION__, DEBUG_SOCKET);
-    if (::listen(mListenFd, 1) == -1) {
+    if (::listen(mListenFd, kListenBacklog) == -1) {
         ALOGE("%s: Error on listening: errno: %d: %s", __FUNCTION__, errno, strerror(errno));
         return false;
     }
     return true;
 }
 
-SocketConn* SocketComm::accept() {
-    sockaddr_in cliAddr;
-    socklen_t cliLen = sizeof(cliAddr);
-    int sfd = ::accept(mListenFd, reinterpret_cast<struct sockaddr*>(&cliAddr), &cliLen);
+void SocketComm::acceptConnections() {
+    while (true) {
+        sockaddr_in cliAddr;
+        socklen_t cliLen = sizeof(cliAddr);
+        int sfd = ::accept4(mListenFd, reinterpret_cast<struct sockaddr*>(&cliAddr), &cliLen,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ALOGE("%s: accept failed, errno=%d", __FUNCTION__, errno);
+            }
+            return;
+        }
 
-    if (sfd > 0) {
         char addr[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &cliAddr.sin_addr, addr, INET_ADDRSTRLEN);
-
         ALOGD("%s: Incoming connection received from %s:%d", __FUNCTION__, addr, cliAddr.sin_port);
-        return new SocketConn(mMessageProcessor, sfd);
-    }
 
-    return nullptr;
+        auto conn = std::make_unique<SocketConn>(mMessageProcessor, sfd, mEpollFd);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = conn.get();
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, sfd, &event) < 0) {
+            ALOGE("%s: Failed to add connection to epoll, errno=%d", __FUNCTION__, errno);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mOpenConnections.push_back(std::move(conn));
+    }
 }
 
-void SocketComm::listenThread() {
+void SocketComm::eventThread() {
+    epoll_event events[kMaxEvents];
+    std::vector<SocketConn*> closed;
     while (true) {
-        SocketConn* conn = accept();
-        if (conn == nullptr) {
+        int numEvents = epoll_wait(mEpollFd, events, kMaxEvents, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) continue;
+            ALOGE("%s: epoll_wait failed, errno=%d", __FUNCTION__, errno);
             return;
         }
 
-        conn->start();
-        {
-            std::lock_guard<std::mutex> lock(mMutex);
-            mOpenConnections.push_back(std::unique_ptr<SocketConn>(conn));
+        for (int i = 0; i < numEvents; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &mWakeFd) {
+                return;
+            }
+            if (tag == nullptr) {
+                acceptConnections();
+                continue;
+            }
+
+            SocketConn* conn = static_cast<SocketConn*>(tag);
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                ok = conn->onReadable();
+            }
+            if (ok && (events[i].events & EPOLLOUT)) {
+                ok = conn->onWritable();
+            }
+            if (!ok) {
+                closed.push_back(conn);
+            }
+        }
+
+        // Connections are only destroyed once the whole batch is handled, later events in the
+        // batch may still refer to them.
+        if (!closed.empty()) {
+            removeConnections(closed);
+            closed.clear();
         }
     }
 }
 
-/**
- * Called occasionally to clean up connections that have been closed.
- */
-void SocketComm::removeClosedConnections() {
+void SocketComm::removeConnections(const std::vector<SocketConn*>& closed) {
     std::lock_guard<std::mutex> lock(mMutex);
-    std::remove_if(mOpenConnections.begin(), mOpenConnections.end(),
-                   [](std::unique_ptr<SocketConn> const& c) { return !c->isOpen(); });
+    mOpenConnections.erase(
+            std::remove_if(mOpenConnections.begin(), mOpenConnections.end(),
+                           [&closed](std::unique_ptr<SocketConn> const& c) {
+                               return std::find(closed.begin(), closed.end(), c.get()) !=
+                                      closed.end();
+                           }),
+            mOpenConnections.end());
 }
 
-SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd)
-    : CommConn(messageProcessor), mSockFd(sfd) {}
-
-/**
- * Reads, in a loop, exactly numBytes from the given fd. If the connection is closed, returns
- * an empty buffer, otherwise will return exactly the given number of bytes.
- */
-std::vector<uint8_t> readExactly(int fd, int numBytes) {
-    std::vector<uint8_t> buffer(numBytes);
-    int totalRead = 0;
-    int offset = 0;
-    while (totalRead < numBytes) {
-        int numRead = ::read(fd, &buffer.data()[offset], numBytes - offset);
-        if (numRead == 0) {
-            buffer.resize(0);
-            return buffer;
-        }
+SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd, int epollFd)
+    : CommConn(messageProcessor), mSockFd(sfd), mEpollFd(epollFd) {}
 
-        totalRead += numRead;
+SocketConn::~SocketConn() {
+    if (mDroppedValues > 0) {
+        ALOGI("%s: Dropped %" PRIu64 " values for slow client on socket %d", __FUNCTION__,
+              mDroppedValues.load(), mSockFd);
     }
-    return buffer;
+    stop();
 }
 
-/**
- * Reads an int, guaranteed to be non-zero, from the given fd. If the connection is closed, returns
- * -1.
- */
-int32_t readInt(int fd) {
-    std::vector<uint8_t> buffer = readExactly(fd, sizeof(int32_t));
-    if (buffer.size() == 0) {
-        return -1;
+std::vector<uint8_t> SocketConn::read() {
+    std::vector<uint8_t> msg;
+    size_t available = mRxBuffer.size() - mRxOffset;
+    if (available < kMsgHeaderLen) {
+        return msg;
+    }
+
+    uint32_t msgSize;
+    memcpy(&msgSize, mRxBuffer.data() + mRxOffset, kMsgHeaderLen);
+    msgSize = ntohl(msgSize);
+    if (available - kMsgHeaderLen < msgSize) {
+        return msg;
     }
 
-    int32_t value = *reinterpret_cast<int32_t*>(buffer.data());
-    return ntohl(value);
+    const uint8_t* begin = mRxBuffer.data() + mRxOffset + kMsgHeaderLen;
+    msg.assign(begin, begin + msgSize);
+    mRxOffset += kMsgHeaderLen + msgSize;
+    return msg;
 }
 
-std::vector<uint8_t> SocketConn::read() {
-    int32_t msgSize = readInt(mSockFd);
-    if (msgSize <= 0) {
+bool SocketConn::onReadable() {
+    uint8_t chunk[4096];
+    bool peerClosed = false;
+    while (!peerClosed) {
+        ssize_t numRead = ::read(mSockFd, chunk, sizeof(chunk));
+        if (numRead > 0) {
+            mRxBuffer.insert(mRxBuffer.end(), chunk, chunk + numRead);
+            continue;
+        }
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
         ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
-        return std::vector<uint8_t>();
+        peerClosed = true;
     }
 
-    return readExactly(mSockFd, msgSize);
+    while (mRxBuffer.size() - mRxOffset >= kMsgHeaderLen) {
+        uint32_t msgSize;
+        memcpy(&msgSize, mRxBuffer.data() + mRxOffset, kMsgHeaderLen);
+        msgSize = ntohl(msgSize);
+        if (msgSize == 0 || msgSize > kMaxRxMessageSize) {
+            ALOGE("%s: Invalid message size %u on socket %d", __FUNCTION__, msgSize, mSockFd);
+            return false;
+        }
+
+        mRxMessage = read();
+        if (mRxMessage.empty()) {
+            break;  // Incomplete message, wait for more data.
+        }
+        handleMessage(mRxMessage);
+    }
+
+    mRxBuffer.erase(mRxBuffer.begin(), mRxBuffer.begin() + mRxOffset);
+    mRxOffset = 0;
+    return !peerClosed && isOpen();
+}
+
+bool SocketConn::onWritable() {
+    std::lock_guard<std::mutex> g(mWriteLock);
+    return flushLocked();
 }
 
 void SocketConn::stop() {
     if (mSockFd > 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mSockFd, nullptr);
         close(mSockFd);
         mSockFd = -1;
     }
 }
 
 int SocketConn::write(const std::vector<uint8_t>& data) {
-    static constexpr int MSG_HEADER_LEN = 4;
-    int retVal = 0;
-    union {
-        uint32_t msgLen;
-        uint8_t msgLenBytes[MSG_HEADER_LEN];
-    };
+    if (mSockFd <= 0) {
+        return -1;
+    }
 
-    // Prepare header for the message
-    msgLen = static_cast<uint32_t>(data.size());
-    msgLen = htonl(msgLen);
+    size_t queued = mTxQueue.size() - mTxOffset;
+    if (queued + kMsgHeaderLen + data.size() > kMaxQueuedBytes) {
+        ALOGW("%s: Client on socket %d is not reading, disconnecting", __FUNCTION__, mSockFd);
+        // The event thread notices the hang up and removes the connection.
+        shutdown(mSockFd, SHUT_RDWR);
+        return -1;
+    }
 
-    if (mSockFd > 0) {
-        retVal = ::write(mSockFd, msgLenBytes, MSG_HEADER_LEN);
+    uint32_t msgLen = htonl(static_cast<uint32_t>(data.size()));
+    const uint8_t* msgLenBytes = reinterpret_cast<const uint8_t*>(&msgLen);
+    mTxQueue.insert(mTxQueue.end(), msgLenBytes, msgLenBytes + kMsgHeaderLen);
+    mTxQueue.insert(mTxQueue.end(), data.begin(), data.end());
+
+    if (!flushLocked()) {
+        shutdown(mSockFd, SHUT_RDWR);
+        return -1;
+    }
+    return static_cast<int>(data.size());
+}
+
+void SocketConn::sendPropertyValues(const VehiclePropValue* values, size_t count,
+                                    bool droppable) {
+    if (droppable && mQueuedBytes > kDropThresholdBytes) {
+        mDroppedValues += count;
+        return;
+    }
+    CommConn::sendPropertyValues(values, count);
+}
 
-        if (retVal == MSG_HEADER_LEN) {
-            retVal = ::write(mSockFd, data.data(), data.size());
+bool SocketConn::flushLocked() {
+    while (mTxOffset < mTxQueue.size()) {
+        ssize_t numWritten = ::send(mSockFd, mTxQueue.data() + mTxOffset,
+                                    mTxQueue.size() - mTxOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (numWritten < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            ALOGE("%s: send failed on socket %d, errno=%d", __FUNCTION__, mSockFd, errno);
+            return false;
         }
+        mTxOffset += numWritten;
+    }
+
+    if (mTxOffset == mTxQueue.size()) {
+        mTxQueue.clear();  // Keeps the capacity for the next messages.
+        mTxOffset = 0;
+    } else if (mTxOffset > mTxQueue.size() / 2) {
+        mTxQueue.erase(mTxQueue.begin(), mTxQueue.begin() + mTxOffset);
+        mTxOffset = 0;
     }
+    mQueuedBytes = mTxQueue.size() - mTxOffset;
+    setWaitingForWritableLocked(mQueuedBytes > 0);
+    return true;
+}
 
-    return retVal;
+void SocketConn::setWaitingForWritableLocked(bool waiting) {
+    if (waiting == mWaitingForWritable) {
+        return;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN | (waiting ? EPOLLOUT : 0);
+    event.data.ptr = this;
+    epoll_ctl(mEpollFd, EPOLL_CTL_MOD, mSockFd, &event);
+    mWaitingForWritable = waiting;
 }
 
 }  // impl
@@ -17,6 +17,7 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_impl_SocketComm_H_
 #define android_hardware_automotive_vehicle_V2_0_impl_SocketComm_H_
 
+#include <atomic>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -35,6 +36,10 @@ class SocketConn;
 /**
  * SocketComm opens a socket, and listens for connections from clients. Typically the client will be
  * adb's TCP port-forwarding to enable a host PC to connect to the VehicleHAL.
+ *
+ * A single thread runs an epoll loop that accepts connections and services reads and writes for all
+ * of them. Sockets are non-blocking and every connection has its own outbound queue, so a slow
+ * client never delays delivery to the others.
  */
 class SocketComm {
    public:
@@ -49,12 +54,23 @@ class SocketComm {
      */
     void sendMessage(vhal_proto::EmulatorMessage const& msg);
 
+    /**
+     * Send the given values to all connected clients, see CommConn::sendPropertyValues.
+     *
+     * @param droppable True if the values may be dropped for clients that are behind, typically
+     *              because they are samples of continuous properties that will be superseded.
+     */
+    void sendPropertyValues(const VehiclePropValue* values, size_t count, bool droppable);
+
    private:
     int mListenFd;
-    std::unique_ptr<std::thread> mListenThread;
-    std::vector<std::unique_ptr<SocketConn>> mOpenConnections;
+    int mEpollFd;
+    int mWakeFd;
+    std::unique_ptr<std::thread> mEventThread;
     MessageProcessor* mMessageProcessor;
+    // Guards mOpenConnections. Connections are only added and removed by the event thread.
     std::mutex mMutex;
+    std::vector<std::unique_ptr<SocketConn>> mOpenConnections;
 
     /**
      * Opens the socket and begins listening.
@@ -64,32 +80,32 @@ class SocketComm {
     bool listen();
 
     /**
-     * Blocks and waits for a connection from a client, returns a new SocketConn with the connection
-     * or null, if the connection has been closed.
-     *
-     * @return int Returns fd or socket number if connection is successful.
-     *              Otherwise, returns -1 if no connection is availble.
+     * Accepts all pending connections and registers them with the epoll loop.
      */
-    SocketConn* accept();
+    void acceptConnections();
 
-    void listenThread();
+    void eventThread();
 
-    void removeClosedConnections();
+    void removeConnections(const std::vector<SocketConn*>& closed);
 };
 
 /**
  * SocketConn represents a single connection to a client.
+ *
+ * Incoming data is read by SocketComm's event thread when the socket is readable. Outgoing
+ * messages are appended to a per-connection queue and written as far as the socket accepts, the
+ * rest is written by the event thread once the socket becomes writable again.
  */
 class SocketConn : public CommConn {
    public:
-    SocketConn(MessageProcessor* messageProcessor, int sfd);
-    virtual ~SocketConn() = default;
+    SocketConn(MessageProcessor* messageProcessor, int sfd, int epollFd);
+    virtual ~SocketConn();
 
     /**
-     * Blocking call to read data from the connection.
+     * Returns the next complete message received by onReadable().
      *
      * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     *              an empty vector if no complete message has been received.
      */
     std::vector<uint8_t> read() override;
 
@@ -99,18 +115,54 @@ class SocketConn : public CommConn {
     void stop() override;
 
     /**
-     * Transmits a string of data to the emulator.
+     * Queues a string of data for the emulator and writes as much of it as the socket accepts.
      *
      * @param data Serialized protobuf data to transmit.
      *
-     * @return int Number of bytes transmitted, or -1 if failed.
+     * @return int Number of bytes queued, or -1 if failed.
      */
     int write(const std::vector<uint8_t>& data) override;
 
     inline bool isOpen() override { return mSockFd > 0; }
 
+    /**
+     * Same as CommConn::sendPropertyValues, but drops droppable values while the outbound queue is
+     * backed up.
+     */
+    void sendPropertyValues(const VehiclePropValue* values, size_t count, bool droppable);
+
+    /**
+     * Reads all available data and processes every complete message.
+     *
+     * @return bool Returns false if the connection was closed or is broken.
+     */
+    bool onReadable();
+
+    /**
+     * Writes queued data.
+     *
+     * @return bool Returns false if the connection is broken.
+     */
+    bool onWritable();
+
    private:
     int mSockFd;
+    int mEpollFd;
+
+    std::vector<uint8_t> mRxBuffer;
+    size_t mRxOffset = 0;
+    std::vector<uint8_t> mRxMessage;
+
+    // Guarded by CommConn::mWriteLock.
+    std::vector<uint8_t> mTxQueue;
+    size_t mTxOffset = 0;
+    bool mWaitingForWritable = false;
+
+    std::atomic<size_t> mQueuedBytes{0};
+    std::atomic<uint64_t> mDroppedValues{0};
+
+    bool flushLocked();
+    void setWaitingForWritableLocked(bool waiting);
 };
 
 }  // impl
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "vhal-trace-compiler"
+
+#include <fstream>
+#include <iostream>
+
+#include "JsonFakeValueGenerator.h"
+#include "ReplayTrace.h"
+
+using android::hardware::automotive::vehicle::V2_0::VehiclePropValue;
+using android::hardware::automotive::vehicle::V2_0::impl::JsonFakeValueGenerator;
+using android::hardware::automotive::vehicle::V2_0::impl::ReplayTrace;
+
+/**
+ * Precompiles a fake data JSON file into a ReplayTrace, so long recordings can be replayed through
+ * the GENERATE_FAKE_DATA_CONTROLLING_PROPERTY StartJson command without parsing them first.
+ */
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.json> <output.trace>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream ifs(argv[1]);
+    if (!ifs) {
+        std::cerr << "Couldn't open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<VehiclePropValue> events = JsonFakeValueGenerator::parseFakeValueJson(ifs);
+    if (events.empty()) {
+        std::cerr << "No events found in " << argv[1] << std::endl;
+        return 1;
+    }
+    if (!ReplayTrace::write(argv[2], events)) {
+        std::cerr << "Couldn't write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << events.size() << " events to " << argv[2] << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TraceFakeValueGenerator"
+
+#include <inttypes.h>
+
+#include <log/log.h>
+
+#include "TraceFakeValueGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+TraceFakeValueGenerator::TraceFakeValueGenerator(const VehiclePropValue& request) {
+    const auto& v = request.value;
+    mTrace = ReplayTrace::open(v.stringValue);
+    // Iterate infinitely if repetition number is not provided
+    mNumOfIterations = v.int32Values.size() < 2 ? -1 : v.int32Values[1];
+    if (v.floatValues.size() > 0 && v.floatValues[0] >= 0) {
+        mPlaybackRate = v.floatValues[0];
+    }
+    if (mTrace != nullptr && mTrace->size() > 0 && v.int64Values.size() > 0) {
+        mStartIndex = mTrace->lowerBound(mTrace->timestampAt(0) + v.int64Values[0]);
+        if (mStartIndex == mTrace->size()) {
+            ALOGW("%s: start offset %" PRId64 " is past the end of the trace", __func__,
+                  v.int64Values[0]);
+            mStartIndex = 0;
+        }
+    }
+    mIndex = mStartIndex;
+}
+
+VehiclePropValue TraceFakeValueGenerator::nextEvent() {
+    VehiclePropValue generatedValue;
+    if (!hasNext()) {
+        return generatedValue;
+    }
+
+    TimePoint eventTime = Clock::now();
+    if (mIndex != mStartIndex) {
+        // Scheduled relative to the previous event rather than to now, so delays in delivering
+        // events don't accumulate over a long trace.
+        if (mPlaybackRate > 0) {
+            Nanos delta(mTrace->timestampAt(mIndex) - mTrace->timestampAt(mIndex - 1));
+            eventTime = mLastEventTime +
+                        Nanos(static_cast<int64_t>(delta.count() / mPlaybackRate));
+        } else {
+            eventTime = mLastEventTime;
+        }
+    }
+
+    VehiclePropValue view;
+    if (mTrace->valueAt(mIndex, &view)) {
+        // Deep copy, the view points into the mapped trace.
+        generatedValue = view;
+    } else {
+        ALOGE("%s: event %zu is malformed", __func__, mIndex);
+    }
+    generatedValue.timestamp = eventTime.time_since_epoch().count();
+    mLastEventTime = eventTime;
+
+    mIndex++;
+    if (mIndex == mTrace->size()) {
+        mIndex = mStartIndex;
+        if (mNumOfIterations > 0) {
+            mNumOfIterations--;
+        }
+    }
+    return generatedValue;
+}
+
+bool TraceFakeValueGenerator::hasNext() {
+    return mNumOfIterations != 0 && mTrace != nullptr && mTrace->size() > 0;
+}
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
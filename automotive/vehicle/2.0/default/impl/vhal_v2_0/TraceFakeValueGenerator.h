@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_TraceFakeValueGenerator_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_TraceFakeValueGenerator_H_
+
+#include <memory>
+
+#include "FakeValueGenerator.h"
+#include "ReplayTrace.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Replays a precompiled ReplayTrace. Accepts the same request as JsonFakeValueGenerator, with two
+ * optional parameters:
+ *   int64Values[0]: offset from the first event, in nanoseconds, to start replaying at.
+ *   floatValues[0]: playback rate, 1.0 replays in real time, 0 replays as fast as possible.
+ */
+class TraceFakeValueGenerator : public FakeValueGenerator {
+public:
+    TraceFakeValueGenerator(const VehiclePropValue& request);
+    ~TraceFakeValueGenerator() = default;
+
+    VehiclePropValue nextEvent();
+
+    bool hasNext();
+
+private:
+    std::unique_ptr<ReplayTrace> mTrace;
+    size_t mStartIndex = 0;
+    size_t mIndex = 0;
+    int32_t mNumOfIterations = -1;
+    float mPlaybackRate = 1.0f;
+    TimePoint mLastEventTime;
+};
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_TraceFakeValueGenerator_H_
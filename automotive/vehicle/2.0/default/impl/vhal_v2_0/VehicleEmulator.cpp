@@ -63,15 +63,11 @@ VehicleEmulator::~VehicleEmulator() {
  * changed.
  */
 void VehicleEmulator::doSetValueFromClient(const VehiclePropValue& propValue) {
-    vhal_proto::EmulatorMessage msg;
-    vhal_proto::VehiclePropValue* val = msg.add_value();
-    populateProtoVehiclePropValue(val, &propValue);
-    msg.set_status(vhal_proto::RESULT_OK);
-    msg.set_msg_type(vhal_proto::SET_PROPERTY_ASYNC);
-
-    mSocketComm->sendMessage(msg);
+    // Every connection picks proto or binary encoding, depending on what it negotiated.
+    // Samples of continuous properties are superseded by the next one, slow clients may skip them.
+    mSocketComm->sendPropertyValues(&propValue, 1, mHal->isContinuousProperty(propValue.prop));
     if (mPipeComm) {
-        mPipeComm->sendMessage(msg);
+        mPipeComm->sendPropertyValues(&propValue, 1);
     }
 }
 
@@ -191,6 +187,34 @@ void VehicleEmulator::doSetProperty(VehicleEmulator::EmulatorMessage const& rxMs
     respMsg.set_status(halRes ? vhal_proto::RESULT_OK : vhal_proto::ERROR_INVALID_PROPERTY);
 }
 
+void VehicleEmulator::doSetPropertyBinary(binary_msg_converter::Decoder& rxMsg,
+                                          binary_msg_converter::Encoder& respMsg) {
+    // Binary messages can carry a batch of values, all of them are applied.
+    bool halRes = true;
+    VehiclePropValue val;
+    while (rxMsg.nextValue(&val)) {
+        val.timestamp = elapsedRealtimeNano();
+        halRes &= mHal->setPropertyFromVehicle(val);
+    }
+    respMsg.begin(vhal_proto::SET_PROPERTY_RESP,
+                  halRes ? vhal_proto::RESULT_OK : vhal_proto::ERROR_INVALID_PROPERTY);
+}
+
+void VehicleEmulator::processBinaryMessage(binary_msg_converter::Decoder& rxMsg,
+                                           binary_msg_converter::Encoder& respMsg) {
+    switch (rxMsg.msgType()) {
+        case vhal_proto::SET_PROPERTY_CMD:
+            doSetPropertyBinary(rxMsg, respMsg);
+            break;
+        default:
+            // Everything else is rare enough to keep using EmulatorMessage.
+            ALOGW("%s: Unsupported binary message received, type = %d", __func__,
+                  rxMsg.msgType());
+            respMsg.begin(rxMsg.msgType(), vhal_proto::ERROR_UNIMPLEMENTED_CMD);
+            break;
+    }
+}
+
 void VehicleEmulator::processMessage(vhal_proto::EmulatorMessage const& rxMsg,
                                      vhal_proto::EmulatorMessage& respMsg) {
     switch (rxMsg.msg_type()) {
@@ -44,6 +44,7 @@ class EmulatedVehicleHalIface : public VehicleHal {
 public:
     virtual bool setPropertyFromVehicle(const VehiclePropValue& propValue) = 0;
     virtual std::vector<VehiclePropValue> getAllProperties() const = 0;
+    virtual bool isContinuousProperty(int32_t propId) const = 0;
 
     void registerEmulator(VehicleEmulator* emulator) {
         ALOGI("%s, emulator: %p", __func__, emulator);
@@ -74,6 +75,8 @@ class VehicleEmulator : public MessageProcessor {
     void doSetValueFromClient(const VehiclePropValue& propValue);
     void processMessage(vhal_proto::EmulatorMessage const& rxMsg,
                         vhal_proto::EmulatorMessage& respMsg) override;
+    void processBinaryMessage(binary_msg_converter::Decoder& rxMsg,
+                              binary_msg_converter::Encoder& respMsg) override;
 
    private:
     friend class ConnectionThread;
@@ -84,6 +87,8 @@ class VehicleEmulator : public MessageProcessor {
     void doGetProperty(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
     void doGetPropertyAll(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
     void doSetProperty(EmulatorMessage const& rxMsg, EmulatorMessage& respMsg);
+    void doSetPropertyBinary(binary_msg_converter::Decoder& rxMsg,
+                             binary_msg_converter::Encoder& respMsg);
     void populateProtoVehicleConfig(vhal_proto::VehiclePropConfig* protoCfg,
                                     const VehiclePropConfig& cfg);
     void populateProtoVehiclePropValue(vhal_proto::VehiclePropValue* protoVal,
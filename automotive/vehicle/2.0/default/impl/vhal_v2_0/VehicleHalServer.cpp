@@ -27,6 +27,8 @@
 #include "JsonFakeValueGenerator.h"
 #include "LinearFakeValueGenerator.h"
 #include "Obd2SensorStore.h"
+#include "ReplayTrace.h"
+#include "TraceFakeValueGenerator.h"
 
 namespace android::hardware::automotive::vehicle::V2_0::impl {
 
@@ -110,6 +112,12 @@ StatusCode VehicleHalServer::handleGenerateFakeDataRequest(const VehiclePropValu
                 return StatusCode::INVALID_ARG;
             }
             int32_t cookie = std::hash<std::string>()(v.stringValue);
+            // Precompiled traces are replayed from the mapped file instead of being parsed.
+            if (ReplayTrace::isReplayTrace(v.stringValue)) {
+                getGenerator()->registerGenerator(
+                        cookie, std::make_unique<TraceFakeValueGenerator>(request));
+                break;
+            }
             getGenerator()->registerGenerator(cookie,
                                               std::make_unique<JsonFakeValueGenerator>(request));
             break;
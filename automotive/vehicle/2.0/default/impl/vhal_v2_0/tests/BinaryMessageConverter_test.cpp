@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/SystemClock.h>
+
+#include "vhal_v2_0/BinaryMessageConverter.h"
+#include "vhal_v2_0/DefaultConfig.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+namespace binary_msg_converter {
+
+namespace {
+
+TEST(BinaryMessageConverterTest, batchedValues) {
+    std::vector<VehiclePropValue> values;
+    for (auto& property : impl::kVehicleProperties) {
+        VehiclePropValue prop;
+        prop.timestamp = elapsedRealtimeNano();
+        prop.areaId = 123;
+        prop.prop = property.config.prop;
+        prop.value = property.initialValue;
+        prop.status = VehiclePropertyStatus::ERROR;
+        values.push_back(prop);
+    }
+
+    std::vector<uint8_t> buffer;
+    Encoder encoder(&buffer);
+    encoder.begin(vhal_proto::SET_PROPERTY_ASYNC, vhal_proto::RESULT_OK);
+    for (const auto& value : values) {
+        encoder.addValue(value);
+    }
+
+    ASSERT_TRUE(isBinaryMessage(buffer.data(), buffer.size()));
+    Decoder decoder;
+    ASSERT_TRUE(decoder.parse(buffer.data(), buffer.size()));
+    EXPECT_EQ(vhal_proto::SET_PROPERTY_ASYNC, decoder.msgType());
+    EXPECT_EQ(vhal_proto::RESULT_OK, decoder.status());
+    ASSERT_EQ(values.size(), decoder.valueCount());
+
+    VehiclePropValue decoded;
+    for (const auto& value : values) {
+        ASSERT_TRUE(decoder.nextValue(&decoded));
+        EXPECT_EQ(value, decoded);
+    }
+    EXPECT_FALSE(decoder.nextValue(&decoded));
+}
+
+TEST(BinaryMessageConverterTest, stringValue) {
+    VehiclePropValue value;
+    value.prop = toInt(VehicleProperty::INFO_MAKE);
+    value.value.stringValue = "Toy Vehicle";
+
+    std::vector<uint8_t> buffer;
+    Encoder encoder(&buffer);
+    encoder.begin(vhal_proto::SET_PROPERTY_CMD, vhal_proto::RESULT_OK);
+    encoder.addValue(value);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.parse(buffer.data(), buffer.size()));
+    VehiclePropValue decoded;
+    ASSERT_TRUE(decoder.nextValue(&decoded));
+    EXPECT_STREQ("Toy Vehicle", decoded.value.stringValue.c_str());
+}
+
+TEST(BinaryMessageConverterTest, rejectsTruncatedMessage) {
+    VehiclePropValue value;
+    value.prop = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+    value.value.floatValues = {1.0f, 2.0f, 3.0f};
+
+    std::vector<uint8_t> buffer;
+    Encoder encoder(&buffer);
+    encoder.begin(vhal_proto::SET_PROPERTY_CMD, vhal_proto::RESULT_OK);
+    encoder.addValue(value);
+
+    Decoder decoder;
+    EXPECT_FALSE(decoder.parse(buffer.data(), buffer.size() - 8));
+    EXPECT_FALSE(decoder.parse(buffer.data(), sizeof(MessageHeader) - 1));
+}
+
+TEST(BinaryMessageConverterTest, notConfusedWithProto) {
+    vhal_proto::EmulatorMessage msg;
+    msg.set_msg_type(vhal_proto::GET_PROPERTY_ALL_CMD);
+    msg.set_status(vhal_proto::RESULT_OK);
+    std::string serialized;
+    ASSERT_TRUE(msg.SerializeToString(&serialized));
+    serialized.resize(std::max(serialized.size(), sizeof(MessageHeader)));
+
+    EXPECT_FALSE(isBinaryMessage(reinterpret_cast<const uint8_t*>(serialized.data()),
+                                 serialized.size()));
+}
+
+}  // namespace
+
+}  // namespace binary_msg_converter
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "vhal_v2_0/DefaultConfig.h"
+#include "vhal_v2_0/EmulatedVehicleConnector.h"
+#include "vhal_v2_0/EmulatedVehicleHal.h"
+#include "vhal_v2_0/ShardedVehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleHalManager.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+// Reads every readable property of DefaultConfig.h in all of its areas, like CarService does when
+// it starts up.
+class ColdStartFixture : public benchmark::Fixture {
+public:
+    void SetUp(const benchmark::State& state) override {
+        if (state.range(0)) {
+            mStore = std::make_unique<ShardedVehiclePropertyStore>();
+        } else {
+            mStore = std::make_unique<VehiclePropertyStore>();
+        }
+        mConnector = std::make_unique<EmulatedVehicleConnector>();
+        mHal = std::make_unique<EmulatedVehicleHal>(mStore.get(), mConnector.get());
+        mManager = std::make_unique<VehicleHalManager>(mHal.get());
+        mConnector->setValuePool(mHal->getValuePool());
+
+        mRequests.clear();
+        for (const auto& declaration : kVehicleProperties) {
+            const VehiclePropConfig& config = declaration.config;
+            if (!(config.access & VehiclePropertyAccess::READ)) continue;
+            VehiclePropValue request;
+            request.prop = config.prop;
+            if (config.areaConfigs.size() == 0) {
+                request.areaId = 0;
+                mRequests.push_back(request);
+            }
+            for (const auto& areaConfig : config.areaConfigs) {
+                request.areaId = areaConfig.areaId;
+                mRequests.push_back(request);
+            }
+        }
+    }
+
+    void TearDown(const benchmark::State& /* state */) override {
+        mManager.reset();
+        mHal.reset();
+        mConnector.reset();
+        mStore.reset();
+    }
+
+protected:
+    std::unique_ptr<VehiclePropertyStore> mStore;
+    std::unique_ptr<EmulatedVehicleConnector> mConnector;
+    std::unique_ptr<EmulatedVehicleHal> mHal;
+    std::unique_ptr<VehicleHalManager> mManager;
+    std::vector<VehiclePropValue> mRequests;
+};
+
+BENCHMARK_DEFINE_F(ColdStartFixture, BM_GetOneByOne)(benchmark::State& state) {
+    for (auto _ : state) {
+        for (const auto& request : mRequests) {
+            mManager->get(request, [](StatusCode status, const VehiclePropValue& value) {
+                benchmark::DoNotOptimize(status);
+                benchmark::DoNotOptimize(value);
+            });
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * mRequests.size());
+}
+
+BENCHMARK_DEFINE_F(ColdStartFixture, BM_GetValues)(benchmark::State& state) {
+    std::vector<VehicleHal::VehiclePropValuePtr> values;
+    std::vector<StatusCode> status;
+    for (auto _ : state) {
+        mManager->getValues(mRequests, &values, &status);
+        benchmark::DoNotOptimize(values);
+    }
+    state.SetItemsProcessed(state.iterations() * mRequests.size());
+}
+
+// Argument selects the property store: 0 for VehiclePropertyStore, 1 for the sharded one.
+BENCHMARK_REGISTER_F(ColdStartFixture, BM_GetOneByOne)->Arg(0)->Arg(1);
+BENCHMARK_REGISTER_F(ColdStartFixture, BM_GetValues)->Arg(0)->Arg(1);
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/BinaryMessageConverter.h"
+#include "vhal_v2_0/ProtoMessageConverter.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+// Typical HIL traffic: a batch of float sensor values.
+std::vector<VehiclePropValue> createValues(size_t count) {
+    std::vector<VehiclePropValue> values(count);
+    for (size_t i = 0; i < count; i++) {
+        values[i].prop = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+        values[i].timestamp = i;
+        values[i].value.floatValues = {static_cast<float>(i)};
+    }
+    return values;
+}
+
+void BM_ProtoEncodeDecode(benchmark::State& state) {
+    std::vector<VehiclePropValue> values = createValues(state.range(0));
+    std::string buffer;
+    for (auto _ : state) {
+        vhal_proto::EmulatorMessage msg;
+        msg.set_msg_type(vhal_proto::SET_PROPERTY_CMD);
+        msg.set_status(vhal_proto::RESULT_OK);
+        for (const auto& value : values) {
+            proto_msg_converter::toProto(msg.add_value(), value);
+        }
+        msg.SerializeToString(&buffer);
+
+        vhal_proto::EmulatorMessage rxMsg;
+        rxMsg.ParseFromString(buffer);
+        VehiclePropValue decoded;
+        for (const auto& protoValue : rxMsg.value()) {
+            proto_msg_converter::fromProto(&decoded, protoValue);
+            benchmark::DoNotOptimize(decoded);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+void BM_BinaryEncodeDecode(benchmark::State& state) {
+    std::vector<VehiclePropValue> values = createValues(state.range(0));
+    std::vector<uint8_t> buffer;
+    for (auto _ : state) {
+        binary_msg_converter::Encoder encoder(&buffer);
+        encoder.begin(vhal_proto::SET_PROPERTY_CMD, vhal_proto::RESULT_OK);
+        for (const auto& value : values) {
+            encoder.addValue(value);
+        }
+
+        binary_msg_converter::Decoder decoder;
+        decoder.parse(buffer.data(), buffer.size());
+        VehiclePropValue decoded;
+        while (decoder.nextValue(&decoded)) {
+            benchmark::DoNotOptimize(decoded);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+BENCHMARK(BM_ProtoEncodeDecode)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_BinaryEncodeDecode)->Arg(1)->Arg(16)->Arg(256);
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
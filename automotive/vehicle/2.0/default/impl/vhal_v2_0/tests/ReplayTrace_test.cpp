@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sstream>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/JsonFakeValueGenerator.h"
+#include "vhal_v2_0/ReplayTrace.h"
+#include "vhal_v2_0/TraceFakeValueGenerator.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace impl {
+
+namespace {
+
+constexpr int64_t kEventInterval = 1000000;  // 1 ms
+
+std::vector<VehiclePropValue> createEvents(size_t count) {
+    std::vector<VehiclePropValue> events(count);
+    for (size_t i = 0; i < count; i++) {
+        events[i].prop = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+        events[i].timestamp = i * kEventInterval;
+        events[i].value.floatValues = {static_cast<float>(i)};
+    }
+    return events;
+}
+
+VehiclePropValue createRequest(const std::string& path, int32_t repetitions) {
+    VehiclePropValue request;
+    request.value.stringValue = path;
+    request.value.int32Values = {toInt(FakeDataCommand::StartJson), repetitions};
+    return request;
+}
+
+TEST(ReplayTraceTest, writeAndRead) {
+    TemporaryFile file;
+    std::vector<VehiclePropValue> events = createEvents(100);
+    ASSERT_TRUE(ReplayTrace::write(file.path, events));
+    ASSERT_TRUE(ReplayTrace::isReplayTrace(file.path));
+
+    auto trace = ReplayTrace::open(file.path);
+    ASSERT_NE(nullptr, trace);
+    ASSERT_EQ(events.size(), trace->size());
+    for (size_t i = 0; i < events.size(); i++) {
+        VehiclePropValue value;
+        ASSERT_TRUE(trace->valueAt(i, &value));
+        ASSERT_EQ(events[i].prop, value.prop);
+        ASSERT_EQ(events[i].timestamp, trace->timestampAt(i));
+        ASSERT_EQ(events[i].value.floatValues, value.value.floatValues);
+    }
+
+    ASSERT_EQ(0u, trace->lowerBound(-1));
+    ASSERT_EQ(50u, trace->lowerBound(50 * kEventInterval));
+    ASSERT_EQ(51u, trace->lowerBound(50 * kEventInterval + 1));
+    ASSERT_EQ(events.size(), trace->lowerBound(1000 * kEventInterval));
+}
+
+TEST(ReplayTraceTest, rejectsJsonAndTruncatedFiles) {
+    TemporaryFile json;
+    ASSERT_TRUE(base::WriteStringToFile("[]", json.path));
+    ASSERT_FALSE(ReplayTrace::isReplayTrace(json.path));
+    ASSERT_EQ(nullptr, ReplayTrace::open(json.path));
+
+    TemporaryFile file;
+    ASSERT_TRUE(ReplayTrace::write(file.path, createEvents(10)));
+    ASSERT_EQ(0, truncate(file.path, 64));
+    ASSERT_EQ(nullptr, ReplayTrace::open(file.path));
+}
+
+TEST(ReplayTraceTest, compileJson) {
+    std::istringstream json(
+            "[{\"timestamp\": 1000, \"areaId\": 0, \"value\": 8, \"prop\": 289408000},"
+            " {\"timestamp\": 2000, \"areaId\": 0, \"value\": 4, \"prop\": 289408000}]");
+    std::vector<VehiclePropValue> events = JsonFakeValueGenerator::parseFakeValueJson(json);
+    ASSERT_EQ(2u, events.size());
+
+    TemporaryFile file;
+    ASSERT_TRUE(ReplayTrace::write(file.path, events));
+    auto trace = ReplayTrace::open(file.path);
+    ASSERT_NE(nullptr, trace);
+    VehiclePropValue value;
+    ASSERT_TRUE(trace->valueAt(1, &value));
+    ASSERT_EQ(289408000, value.prop);
+    ASSERT_EQ(std::vector<int32_t>{4}, std::vector<int32_t>(value.value.int32Values));
+}
+
+TEST(TraceFakeValueGeneratorTest, seekAndRepeat) {
+    TemporaryFile file;
+    ASSERT_TRUE(ReplayTrace::write(file.path, createEvents(10)));
+
+    VehiclePropValue request = createRequest(file.path, 2);
+    request.value.int64Values = {7 * kEventInterval};
+    TraceFakeValueGenerator generator(request);
+
+    // Starts at the 8th event and replays the rest of the trace twice.
+    std::vector<float> values;
+    while (generator.hasNext()) {
+        values.push_back(generator.nextEvent().value.floatValues[0]);
+    }
+    ASSERT_EQ((std::vector<float>{7, 8, 9, 7, 8, 9}), values);
+}
+
+TEST(TraceFakeValueGeneratorTest, playbackRate) {
+    TemporaryFile file;
+    ASSERT_TRUE(ReplayTrace::write(file.path, createEvents(3)));
+
+    VehiclePropValue request = createRequest(file.path, 1);
+    request.value.floatValues = {2.0f};
+    TraceFakeValueGenerator doubleSpeed(request);
+    int64_t first = doubleSpeed.nextEvent().timestamp;
+    ASSERT_EQ(kEventInterval / 2, doubleSpeed.nextEvent().timestamp - first);
+
+    request.value.floatValues = {0.0f};
+    TraceFakeValueGenerator fullSpeed(request);
+    first = fullSpeed.nextEvent().timestamp;
+    ASSERT_EQ(first, fullSpeed.nextEvent().timestamp);
+}
+
+}  // namespace
+
+}  // namespace impl
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
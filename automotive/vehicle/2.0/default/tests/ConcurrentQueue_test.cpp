@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/ConcurrentQueue.h"
+
+namespace android {
+
+namespace {
+
+using std::chrono::milliseconds;
+
+TEST(BoundedMpscQueueTest, flushReturnsItemsInOrder) {
+    BoundedMpscQueue<int> queue(8);
+    for (int i = 0; i < 5; i++) {
+        queue.push(int(i));
+    }
+
+    std::vector<int> items = queue.flush();
+    ASSERT_EQ((std::vector<int>{0, 1, 2, 3, 4}), items);
+    ASSERT_TRUE(queue.flush().empty());
+}
+
+TEST(BoundedMpscQueueTest, dropsWhenFull) {
+    BoundedMpscQueue<int> queue(4);
+    for (int i = 0; i < 6; i++) {
+        queue.push(int(i));
+    }
+    ASSERT_EQ(4u, queue.flush().size());
+    ASSERT_EQ(2u, queue.getDroppedCount());
+
+    // Slots are reusable after flush.
+    queue.push(42);
+    ASSERT_EQ(std::vector<int>{42}, queue.flush());
+}
+
+TEST(BoundedMpscQueueTest, deactivate) {
+    BoundedMpscQueue<int> queue(4);
+    std::thread consumer([&queue]() { queue.waitForItems(); });
+    queue.deactivate();
+    consumer.join();
+
+    queue.push(1);
+    ASSERT_TRUE(queue.flush().empty());
+}
+
+TEST(BoundedMpscQueueTest, multipleProducers) {
+    constexpr int kProducers = 4;
+    constexpr int kItemsPerProducer = 1000;
+    BoundedMpscQueue<int> queue(kProducers * kItemsPerProducer);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++) {
+        producers.emplace_back([&queue]() {
+            for (int i = 0; i < kItemsPerProducer; i++) {
+                queue.push(1);
+            }
+        });
+    }
+
+    int received = 0;
+    while (received < kProducers * kItemsPerProducer) {
+        queue.waitForItems();
+        for (int item : queue.flush()) {
+            received += item;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    ASSERT_EQ(0u, queue.getDroppedCount());
+}
+
+TEST(BatchingConsumerTest, adaptiveBatchInterval) {
+    BoundedMpscQueue<int> queue(1024);
+    BatchingConsumer<int, BoundedMpscQueue<int>> consumer;
+    std::atomic<int> received{0};
+    consumer.run(&queue, milliseconds(1), milliseconds(8),
+                 [&received](const std::vector<int>& items) { received += items.size(); });
+    ASSERT_EQ(milliseconds(8), consumer.getBatchInterval());
+
+    // Single events shrink the window down to the minimum.
+    for (int i = 0; i < 10; i++) {
+        queue.push(1);
+        std::this_thread::sleep_for(milliseconds(20));
+    }
+    ASSERT_EQ(10, received.load());
+    ASSERT_EQ(milliseconds(1), consumer.getBatchInterval());
+
+    consumer.requestStop();
+    queue.deactivate();
+    consumer.waitStopped();
+}
+
+}  // namespace anonymous
+
+}  // namespace android
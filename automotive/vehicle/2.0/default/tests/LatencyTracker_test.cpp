@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/LatencyTracker.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int64_t kMicro = 1000;
+
+std::string dumpToString(const LatencyTracker& tracker, int32_t prop = 0) {
+    FILE* file = tmpfile();
+    tracker.dump(fileno(file), prop);
+    std::string output(static_cast<size_t>(ftell(file)), '\0');
+    rewind(file);
+    fread(&output[0], 1, output.size(), file);
+    fclose(file);
+    return output;
+}
+
+TEST(LatencyHistogramTest, empty) {
+    LatencyHistogram histogram;
+    ASSERT_EQ(0u, histogram.getCount());
+    ASSERT_EQ(0, histogram.getMeanNanos());
+    ASSERT_EQ(0, histogram.getPercentileNanos(0.5));
+}
+
+TEST(LatencyHistogramTest, percentiles) {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 99; i++) {
+        histogram.record(3 * kMicro);
+    }
+    histogram.record(5000 * kMicro);
+
+    ASSERT_EQ(100u, histogram.getCount());
+    ASSERT_EQ(5000 * kMicro, histogram.getMaxNanos());
+    // Percentiles are upper bounds of power of two buckets.
+    ASSERT_EQ(4 * kMicro, histogram.getPercentileNanos(0.5));
+    ASSERT_EQ(4 * kMicro, histogram.getPercentileNanos(0.99));
+    ASSERT_EQ(5000 * kMicro, histogram.getPercentileNanos(1));
+    ASSERT_EQ((99 * 3 + 5000) * kMicro / 100, histogram.getMeanNanos());
+}
+
+TEST(LatencyTrackerTest, dumpsRecordedProperties) {
+    LatencyTracker tracker;
+    tracker.record(0x1001, LatencyStage::QUEUE, 10 * kMicro);
+    tracker.record(0x1001, LatencyStage::TOTAL, 20 * kMicro);
+    tracker.record(0x2002, LatencyStage::TOTAL, 30 * kMicro);
+
+    std::string all = dumpToString(tracker);
+    ASSERT_NE(std::string::npos, all.find("property 0x1001"));
+    ASSERT_NE(std::string::npos, all.find("property 0x2002"));
+
+    std::string one = dumpToString(tracker, 0x2002);
+    ASSERT_EQ(std::string::npos, one.find("property 0x1001"));
+    ASSERT_NE(std::string::npos, one.find("total     : 1, 30, 30, 30, 30"));
+}
+
+TEST(LatencyTrackerTest, countsUntrackedProperties) {
+    LatencyTracker tracker;
+    for (int32_t prop = 1; prop <= static_cast<int32_t>(LatencyTracker::kMaxProperties) + 3;
+         prop++) {
+        tracker.record(prop, LatencyStage::TOTAL, kMicro);
+    }
+    ASSERT_NE(std::string::npos, dumpToString(tracker).find("3 events of untracked properties"));
+}
+
+TEST(LatencyTrackerTest, concurrentRecords) {
+    LatencyTracker tracker;
+    constexpr int kThreads = 4;
+    constexpr int kRecords = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&tracker]() {
+            for (int i = 0; i < kRecords; i++) {
+                tracker.record(0x100 + i % 8, LatencyStage::QUEUE, i * kMicro);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::string output = dumpToString(tracker, 0x100);
+    std::string expectedCount = std::to_string(kThreads * kRecords / 8);
+    ASSERT_NE(std::string::npos, output.find("queue     : " + expectedCount + ","));
+}
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/Obd2FrameHistory.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr size_t kNumIntegerSensors = 3;
+constexpr size_t kNumFloatSensors = 2;
+
+// All sensors present except the second integer one.
+VehiclePropValue createFrame(int64_t timestamp, int32_t value) {
+    VehiclePropValue frame;
+    frame.timestamp = timestamp;
+    frame.value.int32Values = {value, value + 1, value + 2};
+    frame.value.floatValues = {value * 0.5f, value * 0.25f};
+    frame.value.bytes = {0x1d};  // 0b11101
+    frame.value.stringValue = "P0070";
+    return frame;
+}
+
+TEST(Obd2FrameHistoryTest, fillPropValue) {
+    Obd2FrameHistory history(4, kNumIntegerSensors, kNumFloatSensors);
+    history.record(createFrame(10, 1));
+    history.record(createFrame(20, 2));
+
+    VehiclePropValue frame;
+    ASSERT_TRUE(history.fillPropValue(20, &frame));
+    VehiclePropValue expected = createFrame(20, 2);
+    ASSERT_EQ(expected.value.int32Values, frame.value.int32Values);
+    ASSERT_EQ(expected.value.floatValues, frame.value.floatValues);
+    ASSERT_EQ(expected.value.bytes, frame.value.bytes);
+    ASSERT_EQ(expected.value.stringValue, frame.value.stringValue);
+    ASSERT_EQ(20, frame.timestamp);
+
+    ASSERT_FALSE(history.fillPropValue(15, &frame));
+}
+
+TEST(Obd2FrameHistoryTest, evictsOldestFrames) {
+    Obd2FrameHistory history(3, kNumIntegerSensors, kNumFloatSensors);
+    for (int i = 1; i <= 5; i++) {
+        history.record(createFrame(i * 10, i));
+    }
+    ASSERT_EQ(3u, history.size());
+    ASSERT_EQ((std::vector<int64_t>{30, 40, 50}), history.getTimestamps());
+    ASSERT_EQ((std::vector<int64_t>{40, 50}), history.getTimestamps(35));
+
+    // Outdated frames are dropped.
+    history.record(createFrame(45, 0));
+    ASSERT_EQ((std::vector<int64_t>{30, 40, 50}), history.getTimestamps());
+
+    history.clear();
+    ASSERT_EQ(0u, history.size());
+    ASSERT_TRUE(history.getTimestamps().empty());
+}
+
+TEST(Obd2FrameHistoryTest, readSensorColumns) {
+    Obd2FrameHistory history(8, kNumIntegerSensors, kNumFloatSensors);
+    for (int i = 1; i <= 4; i++) {
+        history.record(createFrame(i * 10, i));
+    }
+
+    std::vector<int64_t> timestamps;
+    std::vector<float> floats;
+    history.readFloatSensor(1, 20, &timestamps, &floats);
+    ASSERT_EQ((std::vector<int64_t>{20, 30, 40}), timestamps);
+    ASSERT_EQ((std::vector<float>{0.5f, 0.75f, 1.0f}), floats);
+
+    // Absent sensors are skipped.
+    timestamps.clear();
+    std::vector<int32_t> ints;
+    history.readIntegerSensor(1, 0, &timestamps, &ints);
+    ASSERT_TRUE(ints.empty());
+    history.readIntegerSensor(2, 0, &timestamps, &ints);
+    ASSERT_EQ((std::vector<int32_t>{3, 4, 5, 6}), ints);
+}
+
+TEST(Obd2FrameHistoryTest, framesWithFewerSensors) {
+    Obd2FrameHistory history(2, kNumIntegerSensors, kNumFloatSensors);
+    VehiclePropValue frame;
+    frame.timestamp = 1;
+    frame.value.int32Values = {7};
+    frame.value.floatValues = {1.5f};
+    frame.value.bytes = {0x3};  // Integer 0 and float 0 in the frame layout.
+    history.record(frame);
+
+    VehiclePropValue filled;
+    ASSERT_TRUE(history.fillPropValue(1, &filled));
+    ASSERT_EQ((hidl_vec<int32_t>{7, 0, 0}), filled.value.int32Values);
+    ASSERT_EQ((hidl_vec<float>{1.5f, 0}), filled.value.floatValues);
+    // Float 0 moves to bit 3, after the configured integer sensors.
+    ASSERT_EQ(hidl_vec<uint8_t>{0x9}, filled.value.bytes);
+}
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
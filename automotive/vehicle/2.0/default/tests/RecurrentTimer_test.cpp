@@ -70,4 +70,60 @@ TEST(RecurrentTimerTest, multipleIntervals) {
     ASSERT_EQ_WITH_TOLERANCE(20, counter5ms.load(), 5);
 }
 
+TEST(RecurrentTimerTest, coalescesCookiesWithSameDeadline) {
+    std::atomic<int64_t> calls { 0L };
+    std::atomic<int64_t> cookiesReceived { 0L };
+    RecurrentTimer timer([&calls, &cookiesReceived](const std::vector<int32_t>& cookies) {
+        calls++;
+        cookiesReceived += cookies.size();
+    });
+
+    for (int32_t cookie = 0; cookie < 100; cookie++) {
+        timer.registerRecurrentEvent(milliseconds(10), cookie);
+    }
+
+    std::this_thread::sleep_for(milliseconds(100));
+    // All cookies are aligned to the same deadline, so they are delivered in one call.
+    ASSERT_EQ(100 * calls.load(), cookiesReceived.load());
+    ASSERT_EQ_WITH_TOLERANCE(10, calls.load(), 3);
+
+    RecurrentTimer::JitterStats stats = timer.getJitterStats();
+    ASSERT_EQ(static_cast<uint64_t>(cookiesReceived.load()), stats.eventCount);
+    ASSERT_LE(stats.totalLateness.count(), stats.maxLateness.count() * (int64_t)stats.eventCount);
+}
+
+TEST(RecurrentTimerTest, reregisterAndUnregister) {
+    std::atomic<int64_t> counter { 0L };
+    RecurrentTimer timer([&counter](const std::vector<int32_t>& cookies) {
+        ASSERT_EQ(1u, cookies.size());
+        counter++;
+    });
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    // Overrides previous interval, the old deadline must not fire anymore.
+    timer.registerRecurrentEvent(milliseconds(10), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(10, counter.load(), 3);
+
+    timer.unregisterRecurrentEvent(0xdead);
+    int64_t counterAfterUnregister = counter.load();
+    std::this_thread::sleep_for(milliseconds(50));
+    ASSERT_EQ(counterAfterUnregister, counter.load());
+}
+
+TEST(RecurrentTimerTest, unregisterAndRegisterAgain) {
+    std::atomic<int64_t> counter { 0L };
+    RecurrentTimer timer([&counter](const std::vector<int32_t>& cookies) {
+        ASSERT_EQ(1u, cookies.size());
+        counter++;
+    });
+
+    timer.registerRecurrentEvent(milliseconds(10), 0xdead);
+    timer.unregisterRecurrentEvent(0xdead);
+    // The deadline of the first registration is still queued, it must not be delivered as well.
+    timer.registerRecurrentEvent(milliseconds(10), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(10, counter.load(), 3);
+}
+
 }  // anonymous namespace
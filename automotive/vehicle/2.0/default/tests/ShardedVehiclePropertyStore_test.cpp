@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iterator>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/ShardedVehiclePropertyStore.h"
+
+#include "VehicleHalTestUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+class ShardedVehiclePropertyStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const auto& config : kVehicleProperties) {
+            store.registerProperty(config);
+        }
+    }
+
+    VehiclePropValue createInt32Value(int32_t prop, int32_t area, int32_t value,
+                                      int64_t timestamp) {
+        VehiclePropValue v;
+        v.prop = prop;
+        v.areaId = area;
+        v.timestamp = timestamp;
+        v.value.int32Values = {value};
+        return v;
+    }
+
+public:
+    ShardedVehiclePropertyStore store;
+};
+
+TEST_F(ShardedVehiclePropertyStoreTest, writeUnregisteredProperty) {
+    auto v = createInt32Value(toInt(VehicleProperty::INVALID), 0, 1, 0);
+    ASSERT_FALSE(store.writeValue(v, true));
+    ASSERT_EQ(nullptr, store.readValueOrNull(v));
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, writeAndRead) {
+    const int32_t prop = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t left = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const int32_t right = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, left, 3, 1), true));
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, right, 5, 1), true));
+
+    auto leftValue = store.readValueOrNull(prop, left);
+    ASSERT_NE(nullptr, leftValue);
+    ASSERT_EQ(3, leftValue->value.int32Values[0]);
+
+    auto values = store.readValuesForProperty(prop);
+    ASSERT_EQ(2u, values.size());
+    ASSERT_EQ(left, values[0].areaId);
+    ASSERT_EQ(right, values[1].areaId);
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, outdatedValueIsDropped) {
+    const int32_t prop = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, 0, 7, 10), true));
+    ASSERT_FALSE(store.writeValue(createInt32Value(prop, 0, 2, 5), true));
+
+    auto value = store.readValueOrNull(prop);
+    ASSERT_NE(nullptr, value);
+    ASSERT_EQ(7, value->value.int32Values[0]);
+    ASSERT_EQ(10, value->timestamp);
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, removeValues) {
+    const int32_t fanSpeed = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t brightness = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+
+    store.writeValue(createInt32Value(fanSpeed, toInt(VehicleAreaSeat::ROW_1_LEFT), 1, 0), true);
+    store.writeValue(createInt32Value(fanSpeed, toInt(VehicleAreaSeat::ROW_1_RIGHT), 1, 0), true);
+    auto brightnessValue = createInt32Value(brightness, 0, 1, 0);
+    store.writeValue(brightnessValue, true);
+    ASSERT_EQ(3u, store.readAllValues().size());
+
+    store.removeValuesForProperty(fanSpeed);
+    ASSERT_EQ(1u, store.readAllValues().size());
+
+    store.removeValue(brightnessValue);
+    ASSERT_EQ(0u, store.readAllValues().size());
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, readValuesBatch) {
+    const int32_t fanSpeed = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t brightness = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    const int32_t left = toInt(VehicleAreaSeat::ROW_1_LEFT);
+
+    store.writeValue(createInt32Value(fanSpeed, left, 4, 0), true);
+    store.writeValue(createInt32Value(brightness, 0, 9, 0), true);
+
+    std::vector<VehiclePropValue> requests = {
+            createInt32Value(brightness, 0, 0, 0),
+            createInt32Value(toInt(VehicleProperty::INVALID), 0, 0, 0),
+            createInt32Value(fanSpeed, left, 0, 0),
+            createInt32Value(fanSpeed, toInt(VehicleAreaSeat::ROW_1_RIGHT), 0, 0),
+    };
+    std::vector<int32_t> results(requests.size(), -1);
+    std::vector<int> calls(requests.size(), 0);
+    store.readValues(requests, [&](size_t index, const VehiclePropValue* value) {
+        calls[index]++;
+        results[index] = value == nullptr ? 0 : value->value.int32Values[0];
+    });
+
+    ASSERT_EQ((std::vector<int>{1, 1, 1, 1}), calls);
+    ASSERT_EQ((std::vector<int32_t>{9, 0, 4, 0}), results);
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, readValuesChangedSince) {
+    const int32_t fanSpeed = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t brightness = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    const int32_t left = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const int32_t right = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    store.writeValue(createInt32Value(fanSpeed, left, 1, 0), true);
+    store.writeValue(createInt32Value(fanSpeed, right, 1, 0), true);
+    store.writeValue(createInt32Value(brightness, 0, 1, 0), true);
+
+    uint64_t token;
+    ASSERT_EQ(3u, store.readValuesChangedSince(0, &token).size());
+    uint64_t nextToken;
+    ASSERT_TRUE(store.readValuesChangedSince(token, &nextToken).empty());
+    ASSERT_EQ(token, nextToken);
+
+    // Outdated writes are not changes.
+    ASSERT_FALSE(store.writeValue(createInt32Value(brightness, 0, 2, -1), true));
+    ASSERT_TRUE(store.writeValue(createInt32Value(fanSpeed, right, 2, 1), true));
+    ASSERT_TRUE(store.writeValue(createInt32Value(fanSpeed, right, 3, 2), true));
+    auto changed = store.readValuesChangedSince(token, &nextToken);
+    ASSERT_EQ(1u, changed.size());
+    ASSERT_EQ(right, changed[0].areaId);
+    ASSERT_EQ(3, changed[0].value.int32Values[0]);
+
+    // Removed values aren't reported.
+    store.removeValuesForProperty(fanSpeed);
+    ASSERT_TRUE(store.readValuesChangedSince(token, &nextToken).empty());
+    ASSERT_EQ(1u, store.readValuesChangedSince(0, &nextToken).size());
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, inlineAndFullValues) {
+    const int32_t brightness = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    const int32_t make = toInt(VehicleProperty::INFO_MAKE);
+
+    VehiclePropValue full = createInt32Value(brightness, 0, 1, 1);
+    full.value.int32Values = {1, 2};
+    full.status = VehiclePropertyStatus::UNAVAILABLE;
+    ASSERT_TRUE(store.writeValue(full, true));
+    VehiclePropValue name = createInt32Value(make, 0, 0, 1);
+    name.value.int32Values = {};
+    name.value.stringValue = "Toy Vehicle";
+    ASSERT_TRUE(store.writeValue(name, true));
+    auto stats = store.getMemoryStats();
+    ASSERT_EQ(2u, stats.records);
+    ASSERT_EQ(0u, stats.inlineRecords);
+
+    // The value switches to inline and back, status is only updated if asked to.
+    ASSERT_TRUE(store.writeValue(createInt32Value(brightness, 0, 5, 2), false));
+    auto value = store.readValueOrNull(brightness);
+    ASSERT_NE(nullptr, value);
+    ASSERT_EQ(brightness, value->prop);
+    ASSERT_EQ(VehiclePropertyStatus::UNAVAILABLE, value->status);
+    ASSERT_EQ((std::vector<int32_t>{5}), std::vector<int32_t>(value->value.int32Values));
+    ASSERT_EQ(1u, store.getMemoryStats().inlineRecords);
+    ASSERT_LT(store.getMemoryStats().bytes, stats.bytes);
+
+    full.timestamp = 3;
+    ASSERT_TRUE(store.writeValue(full, true));
+    std::vector<VehiclePropValue> results;
+    store.readValues({full, name}, [&](size_t, const VehiclePropValue* value) {
+        ASSERT_NE(nullptr, value);
+        results.push_back(*value);
+    });
+    ASSERT_EQ(2u, results.size());
+    ASSERT_EQ(full, results[0]);
+    ASSERT_EQ(name, results[1]);
+    ASSERT_EQ(0u, store.getMemoryStats().inlineRecords);
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, evictOldestValues) {
+    const int32_t prop = toInt(VehiclePropertyGroup::VENDOR) | toInt(VehicleArea::GLOBAL) |
+                         toInt(VehiclePropertyType::BYTES) | 0x0f01;
+    store.registerProperty(
+            VehiclePropConfig{.prop = prop},
+            [](const VehiclePropValue& value) { return value.timestamp; },
+            VehiclePropertyStore::EvictionPolicy{.maxRecords = 3, .maxPayloadBytes = 10});
+    auto createBytesValue = [&](int64_t timestamp, size_t size) {
+        VehiclePropValue v = createInt32Value(prop, 0, 0, timestamp);
+        v.value.int32Values = {};
+        v.value.bytes = std::vector<uint8_t>(size, 0);
+        return v;
+    };
+
+    ASSERT_TRUE(store.writeValue(createBytesValue(1, 2), true));
+    ASSERT_TRUE(store.writeValue(createBytesValue(2, 2), true));
+    ASSERT_TRUE(store.writeValue(createBytesValue(3, 2), true));
+    ASSERT_EQ(3u, store.readValuesForProperty(prop).size());
+
+    // Over maxRecords.
+    ASSERT_TRUE(store.writeValue(createBytesValue(4, 2), true));
+    ASSERT_EQ(nullptr, store.readValueOrNull(prop, 0, 1));
+    ASSERT_EQ(3u, store.readValuesForProperty(prop).size());
+
+    // Rewriting a value makes it the most recent one.
+    ASSERT_TRUE(store.writeValue(createBytesValue(2, 2), true));
+    // Over maxPayloadBytes.
+    ASSERT_TRUE(store.writeValue(createBytesValue(5, 8), true));
+    auto values = store.readValuesForProperty(prop);
+    ASSERT_EQ(2u, values.size());
+    ASSERT_EQ(2, values[0].timestamp);
+    ASSERT_EQ(5, values[1].timestamp);
+
+    // The value written is kept even if it is over the bounds on its own.
+    ASSERT_TRUE(store.writeValue(createBytesValue(6, 20), true));
+    values = store.readValuesForProperty(prop);
+    ASSERT_EQ(1u, values.size());
+    ASSERT_EQ(6, values[0].timestamp);
+    ASSERT_EQ(5u, store.getMemoryStats().evictions);
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, configs) {
+    ASSERT_EQ(std::size(kVehicleProperties), store.getAllConfigs().size());
+    ASSERT_NE(nullptr, store.getConfigOrNull(toInt(VehicleProperty::INFO_MAKE)));
+    ASSERT_EQ(nullptr, store.getConfigOrNull(toInt(VehicleProperty::INVALID)));
+}
+
+TEST_F(ShardedVehiclePropertyStoreTest, concurrentReadersAndWriters) {
+    const int32_t prop = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    constexpr int kIterations = 10000;
+    store.writeValue(createInt32Value(prop, 0, 0, 0), true);
+
+    std::thread writer([&]() {
+        for (int i = 1; i <= kIterations; i++) {
+            store.writeValue(createInt32Value(prop, 0, i, i), true);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; r++) {
+        readers.emplace_back([&]() {
+            int64_t lastTimestamp = 0;
+            for (int i = 0; i < kIterations; i++) {
+                auto value = store.readValueOrNull(prop);
+                ASSERT_NE(nullptr, value);
+                // Value and timestamp are always updated together.
+                ASSERT_EQ(value->timestamp, value->value.int32Values[0]);
+                ASSERT_LE(lastTimestamp, value->timestamp);
+                lastTimestamp = value->timestamp;
+            }
+        });
+    }
+
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(kIterations, store.readValueOrNull(prop)->timestamp);
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -188,6 +188,93 @@ TEST_F(SubscriptionManagerTest, unsubscribe) {
     assertLastUnsubscribedProperty(PROP1);
 }
 
+TEST_F(SubscriptionManagerTest, distributeValuesToClients) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp1, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(2, cb2, subscrToProp1and2, &updatedOptions));
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    values.push_back(pool.obtainInt32(1));
+    values.back()->prop = PROP1;
+    values.push_back(pool.obtainInt32(2));
+    values.back()->prop = PROP2;
+
+    HalClientEventBuffers buffers;
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &buffers);
+    ASSERT_EQ(2u, buffers.size());
+
+    hidl_vec<VehiclePropValue> clientValues;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        buffers.valuesAt(i, &clientValues);
+        if (buffers.clientAt(i)->getCallback() == cb1) {
+            ASSERT_EQ(1u, clientValues.size());
+            ASSERT_EQ(PROP1, clientValues[0].prop);
+        } else {
+            ASSERT_EQ(cb2, buffers.clientAt(i)->getCallback());
+            ASSERT_EQ(2u, clientValues.size());
+            ASSERT_EQ(PROP1, clientValues[0].prop);
+            ASSERT_EQ(PROP2, clientValues[1].prop);
+            ASSERT_EQ(2, clientValues[1].value.int32Values[0]);
+        }
+    }
+
+    // Buffers are reused for the next batch, only clients with values are reported.
+    values.clear();
+    values.push_back(pool.obtainInt32(3));
+    values.back()->prop = PROP2;
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &buffers);
+    ASSERT_EQ(1u, buffers.size());
+    ASSERT_EQ(cb2, buffers.clientAt(0)->getCallback());
+    buffers.valuesAt(0, &clientValues);
+    ASSERT_EQ(1u, clientValues.size());
+    ASSERT_EQ(3, clientValues[0].value.int32Values[0]);
+}
+
+TEST_F(SubscriptionManagerTest, decimatesPerClientSampleRate) {
+    const int32_t prop = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+    std::list<SubscribeOptions> updatedOptions;
+    hidl_vec<SubscribeOptions> fastSubscription = {
+        SubscribeOptions{.propId = prop, .sampleRate = 100,
+                         .flags = SubscribeFlags::EVENTS_FROM_CAR},
+    };
+    hidl_vec<SubscribeOptions> slowSubscription = {
+        SubscribeOptions{.propId = prop, .sampleRate = 1,
+                         .flags = SubscribeFlags::EVENTS_FROM_CAR},
+    };
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, fastSubscription, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(2, cb2, slowSubscription, &updatedOptions));
+
+    // Two seconds worth of events generated at the merged rate of 100 Hz.
+    VehiclePropValuePool pool;
+    HalClientEventBuffers buffers;
+    hidl_vec<VehiclePropValue> clientValues;
+    size_t fastEvents = 0;
+    size_t slowEvents = 0;
+    for (int64_t i = 0; i < 200; i++) {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        values.push_back(pool.obtainFloat(1.0f));
+        values.back()->prop = prop;
+        values.back()->timestamp = i * 10000000;
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &buffers);
+        for (size_t c = 0; c < buffers.size(); c++) {
+            buffers.valuesAt(c, &clientValues);
+            if (buffers.clientAt(c)->getCallback() == cb1) {
+                fastEvents += clientValues.size();
+            } else {
+                slowEvents += clientValues.size();
+            }
+        }
+    }
+
+    ASSERT_EQ(200u, fastEvents);
+    ASSERT_EQ(2u, slowEvents);
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
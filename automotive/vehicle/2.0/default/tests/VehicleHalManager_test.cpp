@@ -220,6 +220,49 @@ TEST_F(VehicleHalManagerTest, getPropConfigs) {
     // TODO(pavelm): add case case when property was not declared.
 }
 
+TEST_F(VehicleHalManagerTest, getPropConfigsSharesStorage) {
+    const VehiclePropConfig* allConfigs = nullptr;
+    manager->getAllPropConfigs([&](const hidl_vec<VehiclePropConfig>& propConfigs) {
+        allConfigs = propConfigs.data();
+    });
+    ASSERT_NE(nullptr, allConfigs);
+
+    // Properties in the order they are listed in are served from the same storage.
+    bool called = false;
+    manager->getPropConfigs(
+            {toInt(VehicleProperty::INFO_MAKE), toInt(VehicleProperty::HVAC_FAN_SPEED)},
+            [&](StatusCode status, const hidl_vec<VehiclePropConfig>& c) {
+                ASSERT_EQ(StatusCode::OK, status);
+                ASSERT_EQ(2u, c.size());
+                ASSERT_EQ(allConfigs, c.data());
+                called = true;
+            });
+    ASSERT_TRUE(called);
+
+    // Any other order is copied.
+    called = false;
+    manager->getPropConfigs(
+            {toInt(VehicleProperty::HVAC_FAN_SPEED), toInt(VehicleProperty::INFO_MAKE)},
+            [&](StatusCode status, const hidl_vec<VehiclePropConfig>& c) {
+                ASSERT_EQ(StatusCode::OK, status);
+                ASSERT_EQ(2u, c.size());
+                ASSERT_EQ(toString(kVehicleProperties[1]), toString(c[0]));
+                ASSERT_EQ(toString(kVehicleProperties[0]), toString(c[1]));
+                called = true;
+            });
+    ASSERT_TRUE(called);
+
+    called = false;
+    manager->getPropConfigs(
+            {toInt(VehicleProperty::INFO_MAKE), toInt(VehicleProperty::INVALID)},
+            [&](StatusCode status, const hidl_vec<VehiclePropConfig>& c) {
+                ASSERT_EQ(StatusCode::INVALID_ARG, status);
+                ASSERT_EQ(0u, c.size());
+                called = true;
+            });
+    ASSERT_TRUE(called);
+}
+
 TEST_F(VehicleHalManagerTest, getAllPropConfigs) {
     bool called = false;
     manager->getAllPropConfigs(
@@ -437,6 +480,50 @@ TEST_F(VehicleHalManagerTest, set_Retriable) {
     ASSERT_TRUE(actualValue.value.int32Values[0]);
 }
 
+TEST_F(VehicleHalManagerTest, getValues_Batch) {
+    std::vector<VehiclePropValue> requests(3);
+    requests[0].prop = toInt(VehicleProperty::INFO_MAKE);
+    requests[1].prop = toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE);  // Write-only.
+    requests[2].prop = toInt(VehicleProperty::MIRROR_Z_MOVE);  // Unknown.
+
+    std::vector<VehicleHal::VehiclePropValuePtr> values;
+    std::vector<StatusCode> status;
+    manager->getValues(requests, &values, &status);
+
+    ASSERT_EQ(3u, values.size());
+    ASSERT_EQ((std::vector<StatusCode>{StatusCode::OK, StatusCode::ACCESS_DENIED,
+                                       StatusCode::INVALID_ARG}),
+              status);
+    ASSERT_NE(nullptr, values[0].get());
+    ASSERT_STREQ(kCarMake, values[0]->value.stringValue.c_str());
+    ASSERT_EQ(nullptr, values[1].get());
+    ASSERT_EQ(nullptr, values[2].get());
+}
+
+TEST_F(VehicleHalManagerTest, setValues_Batch) {
+    const auto PROP = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const auto AREA1 = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const auto AREA2 = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    std::vector<VehiclePropValue> values(3);
+    values[0].prop = PROP;
+    values[0].areaId = AREA1;
+    values[0].value.int32Values = {1};
+    values[1].prop = PROP;
+    values[1].areaId = AREA2;
+    values[1].value.int32Values = {2};
+    values[2].prop = toInt(VehicleProperty::MIRROR_Z_MOVE);  // Unknown.
+
+    std::vector<StatusCode> status;
+    manager->setValues(values, &status);
+    ASSERT_EQ((std::vector<StatusCode>{StatusCode::OK, StatusCode::OK, StatusCode::INVALID_ARG}),
+              status);
+
+    invokeGet(PROP, AREA2);
+    ASSERT_EQ(StatusCode::OK, actualStatusCode);
+    ASSERT_EQ(2, actualValue.value.int32Values[0]);
+}
+
 TEST(HalClientVectorTest, basic) {
     HalClientVector clients;
     sp<IVehicleCallback> callback1 = new MockedVehicleCallback();
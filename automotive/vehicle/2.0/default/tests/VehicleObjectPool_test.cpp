@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -81,6 +83,34 @@ TEST_F(VehicleObjectPoolTest, valuePoolStrings) {
     ASSERT_EQ(0u, stats->Obtained);
 }
 
+TEST_F(VehicleObjectPoolTest, valuePoolRecycleOnOtherThread) {
+    auto value = valuePool->obtain(VehiclePropertyType::INT64);
+    void* raw = value.get();
+    std::thread([&value]() { value.reset(); }).join();
+
+    // The object went to the exiting thread's magazine, which is released into the shared pool.
+    ASSERT_EQ(raw, valuePool->obtain(VehiclePropertyType::INT64).get());
+    ASSERT_EQ(1u, stats->Created);
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolDump) {
+    valuePool->obtain(VehiclePropertyType::FLOAT);
+    valuePool->obtain(VehiclePropertyType::FLOAT);
+
+    FILE* file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    valuePool->dump(fileno(file));
+    rewind(file);
+    char buffer[1024] = {};
+    fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+
+    // One miss creating the object, one magazine hit reusing it.
+    std::string expected =
+            "  " + toString(VehiclePropertyType::FLOAT) + ", 1: 1, 0, 1\n";
+    ASSERT_NE(std::string::npos, std::string(buffer).find(expected)) << buffer;
+}
+
 TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
     // In this test we have T threads that concurrently in C cycles
     // obtain and release O VehiclePropValue objects of FLOAT / INT32 types.
@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 
+#include "vhal_v2_0/PropIdHashTable.h"
 #include "vhal_v2_0/VehiclePropConfigIndex.h"
 
 #include "VehicleHalTestUtils.h"
@@ -68,6 +69,46 @@ TEST_F(PropConfigTest, getConfigs) {
     ASSERT_EQ(toString(configs[1]), toString(actualConfig));
 }
 
+TEST_F(PropConfigTest, getConfigOrNull) {
+    VehiclePropConfigIndex index(configs);
+    for (const auto& config : configs) {
+        const VehiclePropConfig* actualConfig = index.getConfigOrNull(config.prop);
+        ASSERT_NE(nullptr, actualConfig);
+        ASSERT_EQ(config.prop, actualConfig->prop);
+    }
+    ASSERT_EQ(nullptr, index.getConfigOrNull(toInt(VehicleProperty::INVALID)));
+}
+
+TEST(PropIdHashTableTest, findsEveryKey) {
+    std::vector<std::pair<int32_t, int>> entries;
+    for (int i = 0; i < 300; i++) {
+        entries.emplace_back(0x11400000 | (0x100 + i * 3), i);
+    }
+    PropIdHashTable<int> table;
+    table.build(entries);
+
+    ASSERT_EQ(entries.size(), table.size());
+    for (const auto& entry : entries) {
+        const int* value = table.find(entry.first);
+        ASSERT_NE(nullptr, value);
+        ASSERT_EQ(entry.second, *value);
+    }
+    ASSERT_EQ(nullptr, table.find(0));
+    ASSERT_EQ(nullptr, table.find(0x11400000 | 0x101));
+}
+
+TEST(PropIdHashTableTest, empty) {
+    PropIdHashTable<int> table;
+    ASSERT_EQ(nullptr, table.find(0));
+    table.build({});
+    ASSERT_EQ(nullptr, table.find(0));
+
+    // Zero is a valid key.
+    table.build({{0, 7}});
+    ASSERT_NE(nullptr, table.find(0));
+    ASSERT_EQ(7, *table.find(0));
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
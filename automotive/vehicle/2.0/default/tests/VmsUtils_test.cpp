@@ -601,6 +601,205 @@ TEST(VmsUtilsTest, availableLayersForMalformedResponse) {
     testGetAvailableLayersMalformedData(VmsMessageType::AVAILABILITY_RESPONSE);
 }
 
+void expectSameMessage(const VehiclePropValue& actual, const VehiclePropValue& expected) {
+    EXPECT_EQ(actual.prop, expected.prop);
+    EXPECT_EQ(actual.areaId, expected.areaId);
+    EXPECT_EQ(actual.value.int32Values, expected.value.int32Values);
+    EXPECT_EQ(actual.value.bytes, expected.value.bytes);
+}
+
+TEST(VmsUtilsTest, builderMatchesHelpers) {
+    VmsMessageBuilder builder;
+    const VmsLayer layer(1, 0, 2);
+    const VmsLayerAndPublisher layer_and_publisher(VmsLayer(2, 0, 1), 123);
+    const VmsOffers offers = {123,
+                              {VmsLayerOffering(VmsLayer(1, 0, 1), {VmsLayer(4, 1, 1)}),
+                               VmsLayerOffering(VmsLayer(2, 0, 1))}};
+
+    expectSameMessage(builder.subscribe(layer), *createSubscribeMessage(layer));
+    expectSameMessage(builder.subscribeToPublisher(layer_and_publisher),
+                      *createSubscribeToPublisherMessage(layer_and_publisher));
+    expectSameMessage(builder.unsubscribe(layer), *createUnsubscribeMessage(layer));
+    expectSameMessage(builder.unsubscribeToPublisher(layer_and_publisher),
+                      *createUnsubscribeToPublisherMessage(layer_and_publisher));
+    expectSameMessage(builder.offering(offers), *createOfferingMessage(offers));
+    expectSameMessage(builder.data(layer_and_publisher, "aaa"),
+                      *createDataMessageWithLayerPublisherInfo(layer_and_publisher, "aaa"));
+}
+
+TEST(VmsUtilsTest, builderReusesBuffers) {
+    VmsMessageBuilder builder;
+    const VmsLayerAndPublisher layer_and_publisher(VmsLayer(2, 0, 1), 123);
+    const VehiclePropValue& first = builder.data(layer_and_publisher, "abcd");
+    const int32_t* int32_values = first.value.int32Values.data();
+    const uint8_t* bytes = first.value.bytes.data();
+
+    const VehiclePropValue& second = builder.data(layer_and_publisher, "xy");
+    EXPECT_EQ(&second, &first);
+    EXPECT_EQ(second.value.int32Values.data(), int32_values);
+    EXPECT_EQ(second.value.bytes.data(), bytes);
+    EXPECT_EQ(parseData(second), "xy");
+
+    // Messages without a packet don't keep the bytes of the previous one.
+    EXPECT_EQ(builder.subscribe(VmsLayer(1, 0, 2)).value.bytes.size(), 0ul);
+}
+
+TEST(VmsUtilsTest, builderMessageCanBeCopied) {
+    VmsMessageBuilder builder;
+    VehiclePropValue copy = builder.subscribe(VmsLayer(1, 0, 2));
+    builder.subscribe(VmsLayer(3, 4, 5));
+    EXPECT_EQ(copy.value.int32Values,
+              (hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIBE), 1, 0, 2}));
+}
+
+void testSubscriptionsStateView(VmsMessageType type) {
+    auto message = createBaseVmsMessage(16);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(type),
+                                                   1234,  // sequence number
+                                                   2,     // number of layers
+                                                   1,     // number of associated layers
+                                                   1,     // layer 1
+                                                   0,           1,
+                                                   4,  // layer 2
+                                                   1,           1,
+                                                   2,  // associated layer
+                                                   0,           1,
+                                                   2,    // number of publisher IDs
+                                                   111,  // publisher IDs
+                                                   123};
+    VmsSubscriptionsStateView view;
+    ASSERT_TRUE(view.parse(*message));
+    EXPECT_EQ(view.sequenceNumber(), 1234);
+    ASSERT_EQ(view.layerCount(), 2ul);
+    EXPECT_EQ(view.layerAt(0), VmsLayer(1, 0, 1));
+    EXPECT_EQ(view.layerAt(1), VmsLayer(4, 1, 1));
+    ASSERT_EQ(view.associatedLayers().size(), 1ul);
+    view.associatedLayers().forEach([&](const VmsAssociatedLayerView& associated_layer) {
+        EXPECT_EQ(associated_layer.layer, VmsLayer(2, 0, 1));
+        ASSERT_EQ(associated_layer.publisher_id_count, 2ul);
+        EXPECT_EQ(associated_layer.publisher_ids, message->value.int32Values.data() + 14);
+        EXPECT_EQ(associated_layer.publisher_ids[0], 111);
+        EXPECT_EQ(associated_layer.publisher_ids[1], 123);
+    });
+
+    VmsOffers offers = {123,
+                        {VmsLayerOffering(VmsLayer(1, 0, 1), {VmsLayer(4, 1, 1)}),
+                         VmsLayerOffering(VmsLayer(2, 0, 1))}};
+    std::vector<VmsLayer> result = {VmsLayer(9, 9, 9)};
+    getSubscribedLayers(view, offers, &result);
+    EXPECT_EQ(result, getSubscribedLayers(*message, offers));
+}
+
+TEST(VmsUtilsTest, subscriptionsStateViewForChange) {
+    testSubscriptionsStateView(VmsMessageType::SUBSCRIPTIONS_CHANGE);
+}
+
+TEST(VmsUtilsTest, subscriptionsStateViewForResponse) {
+    testSubscriptionsStateView(VmsMessageType::SUBSCRIPTIONS_RESPONSE);
+}
+
+TEST(VmsUtilsTest, subscriptionsStateViewSkipsPublishersOfOtherLayers) {
+    VmsOffers offers = {123, {VmsLayerOffering(VmsLayer(2, 0, 1))}};
+    auto message = createBaseVmsMessage(15);
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                              1234,  // sequence number
+                              0,     // number of layers
+                              2,     // number of associated layers
+                              1,           0, 1,  // associated layer 1, not offered
+                              1,                  // number of publisher IDs
+                              123,
+                              2,           0, 1,  // associated layer 2
+                              1,                  // number of publisher IDs
+                              123};
+    VmsSubscriptionsStateView view;
+    ASSERT_TRUE(view.parse(*message));
+    std::vector<VmsLayer> result;
+    getSubscribedLayers(view, offers, &result);
+    ASSERT_EQ(result.size(), 1ul);
+    EXPECT_EQ(result[0], VmsLayer(2, 0, 1));
+}
+
+TEST(VmsUtilsTest, subscriptionsStateViewForMalformedMessages) {
+    VmsSubscriptionsStateView view;
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 1234};
+    EXPECT_FALSE(view.parse(*message));
+
+    // Truncated layer.
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 1234, 1, 0, 1, 0};
+    EXPECT_FALSE(view.parse(*message));
+
+    // Truncated publisher IDs.
+    message->value.int32Values = hidl_vec<int32_t>{
+            toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 1234, 0, 1, 1, 0, 1, 2, 111};
+    EXPECT_FALSE(view.parse(*message));
+
+    // Negative number of publisher IDs.
+    message->value.int32Values = hidl_vec<int32_t>{
+            toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 1234, 0, 1, 1, 0, 1, -1};
+    EXPECT_FALSE(view.parse(*message));
+
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::AVAILABILITY_CHANGE),
+                                                   1234, 0, 0};
+    EXPECT_FALSE(view.parse(*message));
+    EXPECT_EQ(view.layerCount(), 0ul);
+    EXPECT_EQ(view.associatedLayers().size(), 0ul);
+}
+
+void testAvailabilityStateView(VmsMessageType type) {
+    auto message = createBaseVmsMessage(13);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(type),
+                                                   1234,  // sequence number
+                                                   2,     // number of associated layers
+                                                   1,     // associated layer 1
+                                                   0,           1,
+                                                   2,    // number of publisher IDs
+                                                   111,  // publisher IDs
+                                                   123,
+                                                   2,                   // associated layer 2
+                                                   0,           1, 0};  // number of publisher IDs
+    VmsAvailabilityStateView view;
+    ASSERT_TRUE(view.parse(*message));
+    EXPECT_EQ(view.sequenceNumber(), 1234);
+
+    auto expected = getAvailableLayers(*message);
+    ASSERT_EQ(view.associatedLayers().size(), expected.size());
+    size_t index = 0;
+    view.associatedLayers().forEach([&](const VmsAssociatedLayerView& associated_layer) {
+        EXPECT_EQ(associated_layer.layer, expected[index].layer);
+        EXPECT_EQ(std::vector<int>(associated_layer.publisher_ids,
+                                   associated_layer.publisher_ids +
+                                           associated_layer.publisher_id_count),
+                  expected[index].publisher_ids);
+        index++;
+    });
+    EXPECT_EQ(index, expected.size());
+}
+
+TEST(VmsUtilsTest, availabilityStateViewForChange) {
+    testAvailabilityStateView(VmsMessageType::AVAILABILITY_CHANGE);
+}
+
+TEST(VmsUtilsTest, availabilityStateViewForResponse) {
+    testAvailabilityStateView(VmsMessageType::AVAILABILITY_RESPONSE);
+}
+
+TEST(VmsUtilsTest, availabilityStateViewForMalformedMessage) {
+    VmsAvailabilityStateView view;
+    auto message = createBaseVmsMessage(2);
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::AVAILABILITY_CHANGE), 1234};
+    EXPECT_FALSE(view.parse(*message));
+
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::AVAILABILITY_CHANGE), 1234, 1, 1, 0, 1, 3, 7};
+    EXPECT_FALSE(view.parse(*message));
+    EXPECT_EQ(view.sequenceNumber(), -1);
+}
+
 }  // namespace
 
 }  // namespace vms
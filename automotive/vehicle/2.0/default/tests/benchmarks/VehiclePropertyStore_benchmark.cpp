@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/ShardedVehiclePropertyStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int32_t kPropertyCount = 64;
+// One writer for every kReadsPerWrite reads roughly matches CarService polling a store that is
+// being fed with sensor values by the emulator.
+constexpr int kReadsPerWrite = 8;
+
+int32_t propIdForIndex(int32_t index) {
+    return (0x1000 + index) | VehiclePropertyGroup::VENDOR | VehiclePropertyType::INT32 |
+           VehicleArea::GLOBAL;
+}
+
+template <typename Store>
+Store* createStore() {
+    Store* store = new Store();
+    for (int32_t i = 0; i < kPropertyCount; i++) {
+        VehiclePropConfig config = {
+                .prop = propIdForIndex(i),
+                .access = VehiclePropertyAccess::READ_WRITE,
+                .changeMode = VehiclePropertyChangeMode::CONTINUOUS,
+        };
+        store->registerProperty(config);
+
+        VehiclePropValue value;
+        value.prop = config.prop;
+        value.value.int32Values = {0};
+        store->writeValue(value, true);
+    }
+    return store;
+}
+
+template <typename Store>
+void BM_ReadWrite(benchmark::State& state) {
+    // Shared by every thread of the benchmark run, created and destroyed by thread 0.
+    static Store* store = nullptr;
+    if (state.thread_index == 0) {
+        store = createStore<Store>();
+    }
+
+    VehiclePropValue value;
+    value.value.int32Values = {0};
+    int64_t iteration = 0;
+    for (auto _ : state) {
+        int32_t prop = propIdForIndex((iteration + state.thread_index) % kPropertyCount);
+        if (iteration % kReadsPerWrite == 0) {
+            value.prop = prop;
+            value.timestamp = iteration;
+            store->writeValue(value, true);
+        } else {
+            benchmark::DoNotOptimize(store->readValueOrNull(prop));
+        }
+        iteration++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) {
+        delete store;
+        store = nullptr;
+    }
+}
+
+template <typename Store>
+void BM_ReadAllValues(benchmark::State& state) {
+    static Store* store = nullptr;
+    if (state.thread_index == 0) {
+        store = createStore<Store>();
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store->readAllValues());
+    }
+    state.SetItemsProcessed(state.iterations() * kPropertyCount);
+
+    if (state.thread_index == 0) {
+        delete store;
+        store = nullptr;
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ReadWrite, VehiclePropertyStore)->Threads(1)->Threads(4)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ReadWrite, ShardedVehiclePropertyStore)->Threads(1)->Threads(4)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ReadAllValues, VehiclePropertyStore)->Threads(1)->Threads(4)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ReadAllValues, ShardedVehiclePropertyStore)
+        ->Threads(1)
+        ->Threads(4)
+        ->Threads(8);
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/VehicleUtils.h"
+#include "vhal_v2_0/VmsUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+namespace {
+
+// Roughly the size of a serialized ADAS data layer packet.
+constexpr size_t kPacketSize = 256;
+
+const VmsLayerAndPublisher kLayerAndPublisher(VmsLayer(2, 0, 1), 123);
+
+VmsOffers createOffers() {
+    return VmsOffers(123, {VmsLayerOffering(VmsLayer(1, 0, 1), {VmsLayer(4, 1, 1)}),
+                           VmsLayerOffering(VmsLayer(2, 0, 1)),
+                           VmsLayerOffering(VmsLayer(3, 0, 1))});
+}
+
+// A subscriptions state with layer_count layers and as many associated layers, every second one of
+// them offered by the benchmarked publisher.
+std::unique_ptr<VehiclePropValue> createSubscriptionsState(int layer_count) {
+    std::vector<int32_t> values = {toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 1234, layer_count,
+                                   layer_count};
+    for (int i = 0; i < layer_count; i++) {
+        values.insert(values.end(), {i % 2 == 0 ? 2 : 10 + i, 0, 1});
+    }
+    for (int i = 0; i < layer_count; i++) {
+        values.insert(values.end(), {i % 2 == 0 ? 3 : 10 + i, 0, 1, 2, 111, 123});
+    }
+    auto message = createBaseVmsMessage(values.size());
+    message->value.int32Values = values;
+    return message;
+}
+
+std::unique_ptr<VehiclePropValue> createAvailabilityState(int layer_count) {
+    std::vector<int32_t> values = {toInt(VmsMessageType::AVAILABILITY_CHANGE), 1234, layer_count};
+    for (int i = 0; i < layer_count; i++) {
+        values.insert(values.end(), {i, 0, 1, 2, 111, 123});
+    }
+    auto message = createBaseVmsMessage(values.size());
+    message->value.int32Values = values;
+    return message;
+}
+
+void BM_CreateDataMessage(benchmark::State& state) {
+    const std::string packet(kPacketSize, 'x');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                createDataMessageWithLayerPublisherInfo(kLayerAndPublisher, packet));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BuildDataMessage(benchmark::State& state) {
+    const std::string packet(kPacketSize, 'x');
+    VmsMessageBuilder builder;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&builder.data(kLayerAndPublisher, packet));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_CreateOfferingMessage(benchmark::State& state) {
+    const VmsOffers offers = createOffers();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(createOfferingMessage(offers));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BuildOfferingMessage(benchmark::State& state) {
+    const VmsOffers offers = createOffers();
+    VmsMessageBuilder builder;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&builder.offering(offers));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GetSubscribedLayers(benchmark::State& state) {
+    const VmsOffers offers = createOffers();
+    auto message = createSubscriptionsState(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(getSubscribedLayers(*message, offers));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GetSubscribedLayersFromView(benchmark::State& state) {
+    const VmsOffers offers = createOffers();
+    auto message = createSubscriptionsState(state.range(0));
+    VmsSubscriptionsStateView view;
+    std::vector<VmsLayer> subscribed_layers;
+    for (auto _ : state) {
+        view.parse(*message);
+        getSubscribedLayers(view, offers, &subscribed_layers);
+        benchmark::DoNotOptimize(subscribed_layers.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GetAvailableLayers(benchmark::State& state) {
+    auto message = createAvailabilityState(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(getAvailableLayers(*message));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GetAvailableLayersFromView(benchmark::State& state) {
+    auto message = createAvailabilityState(state.range(0));
+    VmsAvailabilityStateView view;
+    for (auto _ : state) {
+        view.parse(*message);
+        size_t publisher_id_count = 0;
+        view.associatedLayers().forEach([&](const VmsAssociatedLayerView& associated_layer) {
+            publisher_id_count += associated_layer.publisher_id_count;
+        });
+        benchmark::DoNotOptimize(publisher_id_count);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_CreateDataMessage);
+BENCHMARK(BM_BuildDataMessage);
+BENCHMARK(BM_CreateOfferingMessage);
+BENCHMARK(BM_BuildOfferingMessage);
+BENCHMARK(BM_GetSubscribedLayers)->Arg(4)->Arg(32);
+BENCHMARK(BM_GetSubscribedLayersFromView)->Arg(4)->Arg(32);
+BENCHMARK(BM_GetAvailableLayers)->Arg(4)->Arg(32);
+BENCHMARK(BM_GetAvailableLayersFromView)->Arg(4)->Arg(32);
+
+}  // namespace
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
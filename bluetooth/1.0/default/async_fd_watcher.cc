@@ -19,7 +19,6 @@
 #include "async_fd_watcher.h"
 
 #include <log/log.h>
-#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <map>
@@ -27,11 +26,15 @@
 #include <thread>
 #include <vector>
 #include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
+#include "sys/eventfd.h"
+#include "sys/timerfd.h"
 #include "unistd.h"
 
 static const int INVALID_FD = -1;
 
+static const int MAX_EPOLL_EVENTS = 8;
+
 static const int BT_RT_PRIORITY = 1;
 
 namespace android {
@@ -45,6 +48,8 @@ int AsyncFdWatcher::WatchFdForNonBlockingReads(
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    // Once the thread is running, register the descriptor with it directly.
+    if (epoll_fd_ != INVALID_FD && addToEpoll(file_descriptor)) return -1;
   }
 
   // Start the thread if not started yet
@@ -74,15 +79,41 @@ AsyncFdWatcher::~AsyncFdWatcher() {}
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
-  // Set up the communication channel
-  int pipe_fds[2];
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+
+    // Set up the epoll set, the notification channel and the timeout timer
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    notification_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd_ == INVALID_FD || notification_fd_ == INVALID_FD ||
+        timer_fd_ == INVALID_FD) {
+      ALOGE("%s unable to create the watcher fds: %s", __func__,
+            strerror(errno));
+      closeFdsLocked();
+      running_ = false;
+      return -1;
+    }
 
-  notification_listen_fd_ = pipe_fds[0];
-  notification_write_fd_ = pipe_fds[1];
+    bool added = !addToEpoll(notification_fd_) && !addToEpoll(timer_fd_);
+    for (auto it = watched_fds_.begin(); added && it != watched_fds_.end();
+         ++it) {
+      added = !addToEpoll(it->first);
+    }
+    if (!added) {
+      closeFdsLocked();
+      running_ = false;
+      return -1;
+    }
+  }
 
   thread_ = std::thread([this]() { ThreadRoutine(); });
-  if (!thread_.joinable()) return -1;
+  if (!thread_.joinable()) {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    closeFdsLocked();
+    running_ = false;
+    return -1;
+  }
 
   return 0;
 }
@@ -105,20 +136,56 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    closeFdsLocked();
+  }
 
   return 0;
 }
 
+void AsyncFdWatcher::closeFdsLocked() {
+  for (int* fd : {&epoll_fd_, &notification_fd_, &timer_fd_}) {
+    if (*fd != INVALID_FD) close(*fd);
+    *fd = INVALID_FD;
+  }
+}
+
 int AsyncFdWatcher::notifyThread() {
-  uint8_t buffer[] = {0};
-  if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
+  uint64_t value = 1;
+  if (TEMP_FAILURE_RETRY(write(notification_fd_, &value, sizeof(value))) < 0) {
     return -1;
   }
   return 0;
 }
 
+int AsyncFdWatcher::addToEpoll(int file_descriptor) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) == 0 ||
+      errno == EEXIST) {
+    return 0;
+  }
+  ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+        strerror(errno));
+  return -1;
+}
+
+void AsyncFdWatcher::armTimer() {
+  // A one-shot timer re-armed on every wakeup, so the timeout only fires
+  // after timeout_ms_ without any activity. A zero value disarms it.
+  struct itimerspec spec = {};
+  {
+    std::unique_lock<std::mutex> guard(timeout_mutex_);
+    if (timeout_ms_ > std::chrono::milliseconds(0)) {
+      spec.it_value.tv_sec = timeout_ms_.count() / 1000;
+      spec.it_value.tv_nsec = (timeout_ms_.count() % 1000) * 1000000;
+    }
+  }
+  timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
 void AsyncFdWatcher::ThreadRoutine() {
   // Make watching thread RT.
   struct sched_param rt_params;
@@ -129,32 +196,37 @@ void AsyncFdWatcher::ThreadRoutine() {
   }
 
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
-    }
+    armTimer();
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int retval = TEMP_FAILURE_RETRY(
+        epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, -1));
 
     // There was some error.
     if (retval < 0) continue;
 
-    // Timeout.
-    if (retval == 0) {
+    bool notified = false;
+    bool timed_out = false;
+    int ready_fds[MAX_EPOLL_EVENTS];
+    int num_ready_fds = 0;
+    for (int i = 0; i < retval; i++) {
+      int fd = events[i].data.fd;
+      if (fd == notification_fd_) {
+        uint64_t value;
+        TEMP_FAILURE_RETRY(read(notification_fd_, &value, sizeof(value)));
+        notified = true;
+      } else if (fd == timer_fd_) {
+        uint64_t expirations;
+        TEMP_FAILURE_RETRY(read(timer_fd_, &expirations, sizeof(expirations)));
+        timed_out = true;
+      } else {
+        ready_fds[num_ready_fds++] = fd;
+      }
+    }
+
+    // Timeout, only when nothing else woke the thread up meanwhile.
+    if (timed_out && !notified && num_ready_fds == 0) {
       // Allow the timeout callback to modify the timeout.
       TimeoutCallback saved_cb;
       {
@@ -165,20 +237,14 @@ void AsyncFdWatcher::ThreadRoutine() {
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
-    }
-
     // Invoke the data ready callbacks if appropriate.
-    {
+    if (num_ready_fds > 0) {
       // Hold the mutex to make sure that the callbacks are still valid.
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
+      for (int i = 0; i < num_ready_fds; i++) {
+        auto it = watched_fds_.find(ready_fds[i]);
+        if (it != watched_fds_.end()) {
+          it->second(it->first);
         }
       }
     }
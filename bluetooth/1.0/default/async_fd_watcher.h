@@ -45,7 +45,11 @@ class AsyncFdWatcher {
 
   int tryStartThread();
   int stopThread();
+  // Closes the epoll set, the notification channel and the timeout timer.
+  void closeFdsLocked();
   int notifyThread();
+  int addToEpoll(int file_descriptor);
+  void armTimer();
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -54,8 +58,9 @@ class AsyncFdWatcher {
   std::mutex timeout_mutex_;
 
   std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  int epoll_fd_ = -1;
+  int notification_fd_ = -1;
+  int timer_fd_ = -1;
   TimeoutCallback timeout_cb_;
   std::chrono::milliseconds timeout_ms_;
 };
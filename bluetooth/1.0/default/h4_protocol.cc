@@ -70,32 +70,40 @@ void H4Protocol::OnPacketReady() {
 }
 
 void H4Protocol::OnDataReady(int fd) {
-  if (hci_packet_type_ == HCI_PACKET_TYPE_UNKNOWN) {
-    uint8_t buffer[1] = {0};
-    ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer, 1));
-    if (bytes_read != 1) {
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the packet type!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      } else if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read packet type error: %s", __func__,
-                         strerror(errno));
-      } else {
-        LOG_ALWAYS_FATAL("%s: More bytes read than expected (%u)!", __func__,
-                         static_cast<unsigned int>(bytes_read));
+  // Pull in whatever is available and parse all the packets it holds, rather
+  // than reading the type, preamble and payload of each packet separately.
+  ssize_t bytes_read =
+      TEMP_FAILURE_RETRY(read(fd, read_buffer_, sizeof(read_buffer_)));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading from the UART!", __func__);
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  } else if (bytes_read < 0) {
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+
+  const uint8_t* data = read_buffer_;
+  size_t length = bytes_read;
+  while (length > 0) {
+    if (hci_packet_type_ == HCI_PACKET_TYPE_UNKNOWN) {
+      hci_packet_type_ = static_cast<HciPacketType>(data[0]);
+      data++;
+      length--;
+      if (hci_packet_type_ != HCI_PACKET_TYPE_ACL_DATA &&
+          hci_packet_type_ != HCI_PACKET_TYPE_SCO_DATA &&
+          hci_packet_type_ != HCI_PACKET_TYPE_EVENT &&
+          hci_packet_type_ != HCI_PACKET_TYPE_ISO_DATA) {
+        ALOGE("%s: Unimplemented packet type %d", __func__,
+                         static_cast<int>(hci_packet_type_));
+        // Skip the byte and try to resynchronize on the next one.
+        hci_packet_type_ = HCI_PACKET_TYPE_UNKNOWN;
       }
+      continue;
     }
-    hci_packet_type_ = static_cast<HciPacketType>(buffer[0]);
-    if (hci_packet_type_ != HCI_PACKET_TYPE_ACL_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_SCO_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_EVENT) {
-      ALOGE("%s: Unimplemented packet type %d", __func__,
-                       static_cast<int>(hci_packet_type_));
-    }
-  } else {
-    hci_packetizer_.OnDataReady(fd, hci_packet_type_);
+    size_t used = hci_packetizer_.OnDataReady(hci_packet_type_, data, length);
+    data += used;
+    length -= used;
   }
 }
 
@@ -55,6 +55,7 @@ class H4Protocol : public HciProtocol {
 
   HciPacketType hci_packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hci::HciPacketizer hci_packetizer_;
+  uint8_t read_buffer_[HCI_READ_BUFFER_SIZE];
 };
 
 }  // namespace hci
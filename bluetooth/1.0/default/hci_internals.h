@@ -44,7 +44,14 @@ const size_t HCI_LENGTH_OFFSET_SCO = 2;
 const size_t HCI_EVENT_PREAMBLE_SIZE = 2;
 const size_t HCI_LENGTH_OFFSET_EVT = 1;
 
+// 2 bytes for handle, 2 bytes for data length (Volume 2, Part E, 5.4.5)
+const size_t HCI_ISO_PREAMBLE_SIZE = 4;
+const size_t HCI_LENGTH_OFFSET_ISO = 2;
+
 const size_t HCI_PREAMBLE_SIZE_MAX = HCI_ACL_PREAMBLE_SIZE;
 
+// Bytes pulled from the transport per read, enough for several packets
+const size_t HCI_READ_BUFFER_SIZE = 4096;
+
 // Event codes (Volume 2, Part E, 7.7.14)
 const uint8_t HCI_COMMAND_COMPLETE_EVENT = 0x0E;
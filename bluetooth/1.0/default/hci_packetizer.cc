@@ -21,20 +21,27 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
 namespace {
 
 const size_t preamble_size_for_type[] = {
     0, HCI_COMMAND_PREAMBLE_SIZE, HCI_ACL_PREAMBLE_SIZE, HCI_SCO_PREAMBLE_SIZE,
-    HCI_EVENT_PREAMBLE_SIZE};
+    HCI_EVENT_PREAMBLE_SIZE, HCI_ISO_PREAMBLE_SIZE};
 const size_t packet_length_offset_for_type[] = {
     0, HCI_LENGTH_OFFSET_CMD, HCI_LENGTH_OFFSET_ACL, HCI_LENGTH_OFFSET_SCO,
-    HCI_LENGTH_OFFSET_EVT};
+    HCI_LENGTH_OFFSET_EVT, HCI_LENGTH_OFFSET_ISO};
 
 size_t HciGetPacketLengthForType(HciPacketType type, const uint8_t* preamble) {
   size_t offset = packet_length_offset_for_type[type];
+  if (type == HCI_PACKET_TYPE_ISO_DATA) {
+    // The upper two bits are reserved (Volume 2, Part E, 5.4.5)
+    return (((preamble[offset + 1] & 0x3f) << 8) | preamble[offset]);
+  }
   if (type != HCI_PACKET_TYPE_ACL_DATA) return preamble[offset];
   return (((preamble[offset + 1]) << 8) | preamble[offset]);
 }
@@ -49,59 +56,57 @@ namespace hci {
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the header!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+  // Pull in whatever is available, it may hold several packets.
+  ssize_t bytes_read =
+      TEMP_FAILURE_RETRY(read(fd, read_buffer_, sizeof(read_buffer_)));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading the packet!", __func__);
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  }
+  if (bytes_read < 0) {
+    LOG_ALWAYS_FATAL("%s: Read packet error: %s", __func__, strerror(errno));
+  }
+  const uint8_t* data = read_buffer_;
+  size_t length = bytes_read;
+  while (length > 0) {
+    size_t used = OnDataReady(packet_type, data, length);
+    data += used;
+    length -= used;
+  }
+}
+
+size_t HciPacketizer::OnDataReady(HciPacketType packet_type,
+                                  const uint8_t* data, size_t length) {
+  size_t used = 0;
+  if (state_ == HCI_PREAMBLE) {
+    const size_t preamble_size = preamble_size_for_type[packet_type];
+    size_t to_copy = std::min(length, preamble_size - bytes_read_);
+    memcpy(preamble_ + bytes_read_, data, to_copy);
+    bytes_read_ += to_copy;
+    used += to_copy;
+    if (bytes_read_ < preamble_size) return used;
+
+    size_t packet_length = HciGetPacketLengthForType(packet_type, preamble_);
+    packet_.resize(preamble_size + packet_length);
+    memcpy(packet_.data(), preamble_, preamble_size);
+    bytes_remaining_ = packet_length;
+    state_ = HCI_PAYLOAD;
+    bytes_read_ = preamble_size;
+  }
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the payload!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+  size_t to_copy = std::min(length - used, bytes_remaining_);
+  memcpy(packet_.data() + bytes_read_, data + used, to_copy);
+  bytes_remaining_ -= to_copy;
+  bytes_read_ += to_copy;
+  used += to_copy;
+  if (bytes_remaining_ == 0) {
+    packet_ready_cb_();
+    state_ = HCI_PREAMBLE;
+    bytes_read_ = 0;
   }
+  return used;
 }
 
 }  // namespace hci
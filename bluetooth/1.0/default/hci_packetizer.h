@@ -35,6 +35,11 @@ class HciPacketizer {
   HciPacketizer(HciPacketReadyCallback packet_cb)
       : packet_ready_cb_(packet_cb){};
   void OnDataReady(int fd, HciPacketType packet_type);
+  // Parses packet_type data already read from the transport. Returns how many
+  // bytes were used, which is less than length only when a packet completed,
+  // after packet_ready_cb_ has been called for it.
+  size_t OnDataReady(HciPacketType packet_type, const uint8_t* data,
+                     size_t length);
   const hidl_vec<uint8_t>& GetPacket() const;
 
  protected:
@@ -45,6 +50,7 @@ class HciPacketizer {
   size_t bytes_remaining_{0};
   size_t bytes_read_{0};
   HciPacketReadyCallback packet_ready_cb_;
+  uint8_t read_buffer_[HCI_READ_BUFFER_SIZE];
 };
 
 }  // namespace hci
@@ -189,9 +189,11 @@ class H4ProtocolTest : public ::testing::Test {
   }
 
   void WriteAndExpectInboundIsoData(char* payload) {
-    // h4 type[1] + handle[2] + size[1]
-    char preamble[4] = {HCI_PACKET_TYPE_ISO_DATA, 20, 17, 0};
-    preamble[3] = strlen(payload) & 0xFF;
+    // h4 type[1] + handle[2] + size[2]
+    char preamble[5] = {HCI_PACKET_TYPE_ISO_DATA, 20, 17, 0, 0};
+    int length = strlen(payload);
+    preamble[3] = length & 0xFF;
+    preamble[4] = (length >> 8) & 0x3F;
 
     ALOGD("%s writing", __func__);
     TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
@@ -213,6 +215,49 @@ class H4ProtocolTest : public ::testing::Test {
     }
   }
 
+  void WriteAndExpectInboundBatch() {
+    // Several packets written at once, so they are read together
+    std::vector<char> uart;
+    char acl_preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92,
+                            static_cast<char>(strlen(acl_data)), 0};
+    char event_preamble[3] = {HCI_PACKET_TYPE_EVENT, 9,
+                              static_cast<char>(strlen(event_data))};
+    uart.insert(uart.end(), acl_preamble, acl_preamble + sizeof(acl_preamble));
+    uart.insert(uart.end(), acl_data, acl_data + strlen(acl_data));
+    uart.insert(uart.end(), event_preamble,
+                event_preamble + sizeof(event_preamble));
+    uart.insert(uart.end(), event_data, event_data + strlen(event_data));
+    uart.insert(uart.end(), acl_preamble, acl_preamble + sizeof(acl_preamble));
+    uart.insert(uart.end(), acl_data, acl_data + strlen(acl_data));
+
+    std::mutex mutex;
+    std::condition_variable done;
+    {
+      ::testing::InSequence s;
+      EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble + 1,
+                                               sizeof(acl_preamble) - 1,
+                                               acl_data)));
+      EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble + 1,
+                                                 sizeof(event_preamble) - 1,
+                                                 event_data)));
+      EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble + 1,
+                                               sizeof(acl_preamble) - 1,
+                                               acl_data)))
+          .WillOnce(Notify(&mutex, &done));
+    }
+
+    ALOGD("%s writing", __func__);
+    TEMP_FAILURE_RETRY(write(fake_uart_, uart.data(), uart.size()));
+
+    // Fail if it takes longer than 100 ms.
+    auto timeout_time =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait_until(lock, timeout_time);
+    }
+  }
+
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> event_cb_;
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> acl_cb_;
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> sco_cb_;
@@ -238,6 +283,11 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundIsoData(iso_data);
 }
 
+// Ensure packets arriving back to back are all parsed from one read
+TEST_F(H4ProtocolTest, TestBatchedReads) {
+  WriteAndExpectInboundBatch();
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
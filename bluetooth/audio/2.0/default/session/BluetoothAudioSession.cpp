@@ -18,6 +18,9 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -43,7 +46,10 @@ AudioConfiguration BluetoothAudioSession::invalidSoftwareAudioConfiguration =
 AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
-static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+static constexpr int kWritePollMs = 1;          // wait interval for room
+// EventFlag bits of the data path, as used by the FMQ blocking read / write
+static constexpr uint32_t kFmqNotEmpty = 1 << 0;
+static constexpr uint32_t kFmqNotFull = 1 << 1;
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -51,7 +57,10 @@ static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      mDataMQ(nullptr),
+      data_path_generation_(0) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -152,17 +161,28 @@ bool BluetoothAudioSession::IsSessionReady() {
 }
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
+  data_path_generation_++;
+  data_mq_event_flag_ = nullptr;
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
     mDataMQ = nullptr;
     return true;
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
+  std::shared_ptr<DataMQ> tempDataMQ;
   tempDataMQ.reset(new DataMQ(*dataMQ));
   if (!tempDataMQ || !tempDataMQ->isValid()) {
     mDataMQ = nullptr;
     return false;
   }
+  // The event flag is optional, without it the writer falls back to polling
+  EventFlag* event_flag = nullptr;
+  if (tempDataMQ->getEventFlagWord() != nullptr &&
+      EventFlag::createEventFlag(tempDataMQ->getEventFlagWord(), &event_flag) ==
+          ::android::OK) {
+    data_mq_event_flag_.reset(event_flag, [](EventFlag* ef) {
+      EventFlag::deleteEventFlag(&ef);
+    });
+  }
   mDataMQ = std::move(tempDataMQ);
   return true;
 }
@@ -367,39 +387,117 @@ void BluetoothAudioSession::UpdateTracksMetadata(
 }
 
 // The control function writes stream to FMQ
+bool BluetoothAudioSession::AcquireDataPath(DataPathRef* data_path) {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  if (!IsSessionReady() || mDataMQ == nullptr) return false;
+  data_path->data_mq = mDataMQ;
+  data_path->event_flag = data_mq_event_flag_;
+  data_path->generation = data_path_generation_;
+  return true;
+}
+
+size_t BluetoothAudioSession::WaitForDataPathRoom(
+    const DataPathRef& data_path,
+    std::chrono::steady_clock::time_point deadline) {
+  while (data_path_generation_ == data_path.generation) {
+    size_t availableToWrite = data_path.data_mq->availableToWrite();
+    if (availableToWrite) return availableToWrite;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) break;
+    // Wait for the reader to make room. A reader that signals NOT_FULL wakes
+    // us right away, otherwise this degrades to the polling interval.
+    int64_t wait_ns = std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+            .count(),
+        kWritePollMs * 1000000LL);
+    if (data_path.event_flag) {
+      uint32_t ef_state = 0;
+      data_path.event_flag->wait(kFmqNotFull, &ef_state, wait_ns);
+    } else {
+      usleep(wait_ns / 1000);
+    }
+  }
+  return 0;
+}
+
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  // Only the session state is guarded by mutex_, the FMQ itself is only
+  // written by this single writer
+  DataPathRef data_path;
+  if (!AcquireDataPath(&data_path)) return 0;
+
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
   do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) break;
-    size_t availableToWrite = mDataMQ->availableToWrite();
-    if (availableToWrite) {
-      if (availableToWrite > (bytes - totalWritten)) {
-        availableToWrite = bytes - totalWritten;
-      }
-
-      if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
-                          availableToWrite)) {
-        ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
-        return totalWritten;
-      }
-      totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
-    } else {
-      ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
+    size_t availableToWrite = WaitForDataPathRoom(data_path, deadline);
+    if (!availableToWrite) {
+      ALOGD("data %zu/%zu overflow or session ended", totalWritten, bytes);
+      return totalWritten;
+    }
+    if (availableToWrite > (bytes - totalWritten)) {
+      availableToWrite = bytes - totalWritten;
+    }
+
+    if (!data_path.data_mq->write(
+            static_cast<const uint8_t*>(buffer) + totalWritten,
+            availableToWrite)) {
+      ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
       return totalWritten;
     }
+    totalWritten += availableToWrite;
+    if (data_path.event_flag) data_path.event_flag->wake(kFmqNotEmpty);
   } while (totalWritten < bytes);
   return totalWritten;
 }
 
+size_t BluetoothAudioSession::OutBeginWritePcmData(
+    size_t bytes, DataMQ::MemTransaction* tx) {
+  pending_write_ = {};
+  if (tx == nullptr || !bytes) return 0;
+  DataPathRef data_path;
+  if (!AcquireDataPath(&data_path)) return 0;
+
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(kFmqSendTimeoutMs);
+  size_t availableToWrite = WaitForDataPathRoom(data_path, deadline);
+  if (!availableToWrite) {
+    ALOGD("data %zu overflow or session ended", bytes);
+    return 0;
+  }
+  if (availableToWrite > bytes) availableToWrite = bytes;
+  if (!data_path.data_mq->beginWrite(availableToWrite, tx)) {
+    ALOGE("FMQ datapath reserving %zu failed", availableToWrite);
+    return 0;
+  }
+  pending_write_.data_path = std::move(data_path);
+  pending_write_.reserved_bytes = availableToWrite;
+  return availableToWrite;
+}
+
+bool BluetoothAudioSession::OutCommitWritePcmData(size_t bytes) {
+  PendingWrite pending_write = std::move(pending_write_);
+  pending_write_ = {};
+  DataPathRef& data_path = pending_write.data_path;
+  if (data_path.data_mq == nullptr) return false;
+  if (bytes > pending_write.reserved_bytes) {
+    ALOGE("FMQ datapath committing %zu but only %zu reserved", bytes,
+          pending_write.reserved_bytes);
+    return false;
+  }
+  // the regions belong to a data path which is gone, drop what was rendered
+  if (data_path_generation_ != data_path.generation) return false;
+  if (!data_path.data_mq->commitWrite(bytes)) {
+    ALOGE("FMQ datapath committing %zu failed", bytes);
+    return false;
+  }
+  if (data_path.event_flag) data_path.event_flag->wake(kFmqNotEmpty);
+  return true;
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +33,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -86,8 +91,29 @@ class BluetoothAudioSession {
 
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  // audio data path (FMQ) for software encoding. The writer takes its own
+  // references so that it can run without holding mutex_
+  std::shared_ptr<DataMQ> mDataMQ;
+  std::shared_ptr<EventFlag> data_mq_event_flag_;
+  // bumped whenever the data path changes, so the writer notices a session
+  // that ended while it was waiting for room in the FMQ
+  std::atomic<uint32_t> data_path_generation_;
+
+  // What the single writer uses of the data path, taken under mutex_ once per
+  // write and then used without it
+  struct DataPathRef {
+    std::shared_ptr<DataMQ> data_mq;
+    std::shared_ptr<EventFlag> event_flag;
+    uint32_t generation = 0;
+  };
+  // the in-place write between OutBeginWritePcmData and OutCommitWritePcmData,
+  // only touched by the writer
+  struct PendingWrite {
+    DataPathRef data_path;
+    // what OutBeginWritePcmData reserved, the most that can be committed
+    size_t reserved_bytes = 0;
+  };
+  PendingWrite pending_write_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
@@ -99,6 +125,12 @@ class BluetoothAudioSession {
       observers_;
 
   bool UpdateDataPath(const DataMQ::Descriptor* dataMQ);
+  bool AcquireDataPath(DataPathRef* data_path);
+  // waits until the FMQ has room, returning the room available or 0 when the
+  // deadline passed or the session ended
+  size_t WaitForDataPathRoom(
+      const DataPathRef& data_path,
+      std::chrono::steady_clock::time_point deadline);
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
@@ -154,6 +186,16 @@ class BluetoothAudioSession {
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The control functions let the caller render the stream straight into the
+  // FMQ. OutBeginWritePcmData reserves up to bytes, waiting for room like
+  // OutWritePcmData, and returns the reserved size; the reservation is split
+  // over the two regions of tx when it wraps around the end of the FMQ.
+  // OutCommitWritePcmData then hands the first bytes of it to the reader,
+  // which is what the reader counts for the presentation position; it fails
+  // if bytes is more than was reserved.
+  size_t OutBeginWritePcmData(size_t bytes, DataMQ::MemTransaction* tx);
+  bool OutCommitWritePcmData(size_t bytes);
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .channelMode = ChannelMode::UNKNOWN,
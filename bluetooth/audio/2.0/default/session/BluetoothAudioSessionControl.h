@@ -136,6 +136,27 @@ class BluetoothAudioSessionControl {
     }
     return 0;
   }
+
+  // The control APIs let the caller render stream straight into FMQ
+  static size_t OutBeginWritePcmData(const SessionType& session_type,
+                                     size_t bytes, DataMQ::MemTransaction* tx) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->OutBeginWritePcmData(bytes, tx);
+    }
+    return 0;
+  }
+
+  static bool OutCommitWritePcmData(const SessionType& session_type,
+                                    size_t bytes) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->OutCommitWritePcmData(bytes);
+    }
+    return false;
+  }
 };
 
 }  // namespace audio
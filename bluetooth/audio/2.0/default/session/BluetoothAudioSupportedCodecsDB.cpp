@@ -114,18 +114,14 @@ const std::vector<CodecCapabilities> kDefaultOffloadA2dpCodecCapabilities = {
     {.codecType = CodecType::APTX, .capabilities = {}},
     {.codecType = CodecType::APTX_HD, .capabilities = {}}};
 
+// Whether exactly one of the bits in bitfield is set in bitmasks
 static bool IsSingleBit(uint32_t bitmasks, uint32_t bitfield) {
-  bool single = false;
-  uint32_t test_bit = 0x00000001;
-  while (test_bit <= bitmasks && test_bit <= bitfield) {
-    if (bitfield & test_bit && bitmasks & test_bit) {
-      if (single) return false;
-      single = true;
-    }
-    if (test_bit == 0x80000000) break;
-    test_bit <<= 1;
-  }
-  return single;
+  return __builtin_popcount(bitmasks & bitfield) == 1;
+}
+
+// Whether value is exactly one of the bits in capability
+static bool IsSingleCapability(uint32_t value, uint32_t capability) {
+  return (value & capability) == value && IsSingleBit(value, 0xffffffff);
 }
 
 static bool IsOffloadSbcConfigurationValid(
@@ -296,15 +292,9 @@ static bool IsOffloadAptxHdConfigurationValid(
   return false;
 }
 
-std::vector<PcmParameters> GetSoftwarePcmCapabilities() {
-  return std::vector<PcmParameters>(1, kDefaultSoftwarePcmCapabilities);
-}
-
-std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
-    const SessionType& session_type) {
-  if (session_type != SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
-    return std::vector<CodecCapabilities>(0);
-  }
+// The capabilities reported to the stack never change, so they are built
+// once instead of on each getProviderCapabilities() call.
+static std::vector<CodecCapabilities> BuildOffloadA2dpCodecCapabilities() {
   std::vector<CodecCapabilities> offload_a2dp_codec_capabilities =
       kDefaultOffloadA2dpCodecCapabilities;
   for (auto& codec_capability : offload_a2dp_codec_capabilities) {
@@ -337,31 +327,38 @@ std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
   return offload_a2dp_codec_capabilities;
 }
 
+std::vector<PcmParameters> GetSoftwarePcmCapabilities() {
+  static const std::vector<PcmParameters> software_pcm_capabilities(
+      1, kDefaultSoftwarePcmCapabilities);
+  return software_pcm_capabilities;
+}
+
+std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
+    const SessionType& session_type) {
+  if (session_type != SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
+    return std::vector<CodecCapabilities>(0);
+  }
+  static const std::vector<CodecCapabilities> offload_a2dp_codec_capabilities =
+      BuildOffloadA2dpCodecCapabilities();
+  return offload_a2dp_codec_capabilities;
+}
+
 bool IsSoftwarePcmConfigurationValid(const PcmParameters& pcm_config) {
-  if ((pcm_config.sampleRate != SampleRate::RATE_44100 &&
-       pcm_config.sampleRate != SampleRate::RATE_48000 &&
-       pcm_config.sampleRate != SampleRate::RATE_88200 &&
-       pcm_config.sampleRate != SampleRate::RATE_96000 &&
-       pcm_config.sampleRate != SampleRate::RATE_16000 &&
-       pcm_config.sampleRate != SampleRate::RATE_24000) ||
-      (pcm_config.bitsPerSample != BitsPerSample::BITS_16 &&
-       pcm_config.bitsPerSample != BitsPerSample::BITS_24 &&
-       pcm_config.bitsPerSample != BitsPerSample::BITS_32) ||
-      (pcm_config.channelMode != ChannelMode::MONO &&
-       pcm_config.channelMode != ChannelMode::STEREO)) {
-    LOG(WARNING) << __func__
-                 << ": Invalid PCM Configuration=" << toString(pcm_config);
-    return false;
-  } else if (pcm_config.sampleRate &
-                 kDefaultSoftwarePcmCapabilities.sampleRate &&
-             pcm_config.bitsPerSample &
-                 kDefaultSoftwarePcmCapabilities.bitsPerSample &&
-             pcm_config.channelMode &
-                 kDefaultSoftwarePcmCapabilities.channelMode) {
+  // Each parameter must be exactly one of the supported values.
+  if (IsSingleCapability(
+          static_cast<uint32_t>(pcm_config.sampleRate),
+          static_cast<uint32_t>(kDefaultSoftwarePcmCapabilities.sampleRate)) &&
+      IsSingleCapability(
+          static_cast<uint32_t>(pcm_config.bitsPerSample),
+          static_cast<uint32_t>(
+              kDefaultSoftwarePcmCapabilities.bitsPerSample)) &&
+      IsSingleCapability(
+          static_cast<uint32_t>(pcm_config.channelMode),
+          static_cast<uint32_t>(kDefaultSoftwarePcmCapabilities.channelMode))) {
     return true;
   }
   LOG(WARNING) << __func__
-               << ": Unsupported PCM Configuration=" << toString(pcm_config);
+               << ": Invalid PCM Configuration=" << toString(pcm_config);
   return false;
 }
 
@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include <android/hardware/boot/1.1/IBootControl.h>
 
+struct bootloader_control;
+
 namespace android {
 namespace bootable {
 
@@ -28,6 +32,9 @@ class BootControl {
   using MergeStatus = ::android::hardware::boot::V1_1::MergeStatus;
 
  public:
+  BootControl();
+  ~BootControl();
+
   bool Init();
   unsigned int GetNumberSlots();
   unsigned int GetCurrentSlot();
@@ -43,11 +50,23 @@ class BootControl {
 
   bool IsValidSlot(unsigned int slot);
 
+  // Drop the cached bootloader control block, so that the next access reads
+  // it from the misc partition again. Only needed if something other than
+  // this object may have written it.
+  void InvalidateBootloaderControl();
+
   const std::string& misc_device() const {
     return misc_device_;
   }
 
  private:
+  // Load the bootloader control block into |buffer|, from the cache if valid.
+  bool LoadCachedBootloaderControl(bootloader_control* buffer);
+
+  // Save |buffer| to the misc partition, unless it matches what was last read
+  // or written.
+  bool SaveCachedBootloaderControl(bootloader_control* buffer);
+
   // Whether this object was initialized with data from the bootloader message
   // that doesn't change until next reboot.
   bool initialized_ = false;
@@ -60,6 +79,11 @@ class BootControl {
 
   // The slot where we are running from.
   unsigned int current_slot_ = 0;
+
+  // The bootloader control block as last read or written, if any. Nothing
+  // else writes it while Android is running.
+  std::mutex boot_ctrl_lock_;
+  std::unique_ptr<bootloader_control> boot_ctrl_;
 };
 
 // Helper functions to write the Virtual A/B merge status message. These are
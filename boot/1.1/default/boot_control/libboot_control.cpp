@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <string.h>
 
+#include <memory>
 #include <string>
 
 #include <android-base/file.h>
@@ -189,6 +190,43 @@ int SlotSuffixToIndex(const char* suffix) {
   return -1;
 }
 
+BootControl::BootControl() = default;
+
+BootControl::~BootControl() = default;
+
+bool BootControl::LoadCachedBootloaderControl(bootloader_control* buffer) {
+  std::lock_guard<std::mutex> lock(boot_ctrl_lock_);
+  if (!boot_ctrl_) {
+    auto boot_ctrl = std::make_unique<bootloader_control>();
+    if (!LoadBootloaderControl(misc_device_, boot_ctrl.get())) return false;
+    boot_ctrl_ = std::move(boot_ctrl);
+  }
+  *buffer = *boot_ctrl_;
+  return true;
+}
+
+bool BootControl::SaveCachedBootloaderControl(bootloader_control* buffer) {
+  std::lock_guard<std::mutex> lock(boot_ctrl_lock_);
+  buffer->crc32_le = BootloaderControlLECRC(buffer);
+  if (boot_ctrl_ && !memcmp(boot_ctrl_.get(), buffer, sizeof(*buffer))) {
+    // Already on disk, e.g. a slot marked successful twice.
+    return true;
+  }
+  if (!UpdateAndSaveBootloaderControl(misc_device_, buffer)) {
+    // The block on disk may have been partially written.
+    boot_ctrl_.reset();
+    return false;
+  }
+  if (!boot_ctrl_) boot_ctrl_ = std::make_unique<bootloader_control>();
+  *boot_ctrl_ = *buffer;
+  return true;
+}
+
+void BootControl::InvalidateBootloaderControl() {
+  std::lock_guard<std::mutex> lock(boot_ctrl_lock_);
+  boot_ctrl_.reset();
+}
+
 // Initialize the boot_control_private struct with the information from
 // the bootloader_message buffer stored in |boot_ctrl|. Returns whether the
 // initialization succeeded.
@@ -230,7 +268,10 @@ bool BootControl::Init() {
     LOG(WARNING) << "Invalid boot control found, expected CRC-32 0x" << std::hex << computed_crc32
                  << " but found 0x" << std::hex << boot_ctrl.crc32_le << ". Re-initializing.";
     InitDefaultBootloaderControl(this, &boot_ctrl);
-    UpdateAndSaveBootloaderControl(device.c_str(), &boot_ctrl);
+    SaveCachedBootloaderControl(&boot_ctrl);
+  } else {
+    std::lock_guard<std::mutex> lock(boot_ctrl_lock_);
+    boot_ctrl_ = std::make_unique<bootloader_control>(boot_ctrl);
   }
 
   if (!InitMiscVirtualAbMessageIfNeeded()) {
@@ -251,14 +292,14 @@ unsigned int BootControl::GetCurrentSlot() {
 
 bool BootControl::MarkBootSuccessful() {
   bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  if (!LoadCachedBootloaderControl(&bootctrl)) return false;
 
   bootctrl.slot_info[current_slot_].successful_boot = 1;
   // tries_remaining == 0 means that the slot is not bootable anymore, make
   // sure we mark the current slot as bootable if it succeeds in the last
   // attempt.
   bootctrl.slot_info[current_slot_].tries_remaining = 1;
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  return SaveCachedBootloaderControl(&bootctrl);
 }
 
 bool BootControl::SetActiveBootSlot(unsigned int slot) {
@@ -268,7 +309,7 @@ bool BootControl::SetActiveBootSlot(unsigned int slot) {
   }
 
   bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  if (!LoadCachedBootloaderControl(&bootctrl)) return false;
 
   // Set every other slot with a lower priority than the new "active" slot.
   const unsigned int kActivePriority = 15;
@@ -292,7 +333,7 @@ bool BootControl::SetActiveBootSlot(unsigned int slot) {
   // slot would be flip.
   if (slot != current_slot_) bootctrl.slot_info[slot].verity_corrupted = 0;
 
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  return SaveCachedBootloaderControl(&bootctrl);
 }
 
 bool BootControl::SetSlotAsUnbootable(unsigned int slot) {
@@ -302,13 +343,13 @@ bool BootControl::SetSlotAsUnbootable(unsigned int slot) {
   }
 
   bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  if (!LoadCachedBootloaderControl(&bootctrl)) return false;
 
   // The only way to mark a slot as unbootable, regardless of the priority is to
   // set the tries_remaining to 0.
   bootctrl.slot_info[slot].successful_boot = 0;
   bootctrl.slot_info[slot].tries_remaining = 0;
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  return SaveCachedBootloaderControl(&bootctrl);
 }
 
 bool BootControl::IsSlotBootable(unsigned int slot) {
@@ -318,7 +359,7 @@ bool BootControl::IsSlotBootable(unsigned int slot) {
   }
 
   bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  if (!LoadCachedBootloaderControl(&bootctrl)) return false;
 
   return bootctrl.slot_info[slot].tries_remaining != 0;
 }
@@ -330,7 +371,7 @@ bool BootControl::IsSlotMarkedSuccessful(unsigned int slot) {
   }
 
   bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  if (!LoadCachedBootloaderControl(&bootctrl)) return false;
 
   return bootctrl.slot_info[slot].successful_boot && bootctrl.slot_info[slot].tries_remaining;
 }
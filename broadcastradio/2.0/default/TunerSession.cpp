@@ -34,7 +34,6 @@ using utils::tunesTo;
 using std::lock_guard;
 using std::move;
 using std::mutex;
-using std::sort;
 using std::vector;
 
 namespace delay {
@@ -46,6 +45,9 @@ static constexpr auto list = 1s;
 
 }  // namespace delay
 
+// Keeps each program list update well within the binder transaction limit.
+static constexpr size_t kMaxProgramListChunkSize = 100;
+
 TunerSession::TunerSession(BroadcastRadio& module, const sp<ITunerCallback>& callback)
     : mCallback(callback), mModule(module) {
     auto&& ranges = module.getAmFmConfig().ranges;
@@ -112,7 +114,7 @@ Return<Result> TunerSession::tune(const ProgramSelector& sel) {
         lock_guard<mutex> lk(mMut);
         tuneInternalLocked(sel);
     };
-    mThread.schedule(task, delay::tune);
+    mTuneTask = mThread.schedule(task, delay::tune);
 
     return Result::OK;
 }
@@ -125,40 +127,19 @@ Return<Result> TunerSession::scan(bool directionUp, bool skipSubChannel) {
 
     cancelLocked();
 
-    auto list = virtualRadio().getProgramList();
-
-    if (list.empty()) {
+    ProgramSelector tuneTo;
+    if (!virtualRadio().getNextProgram(mCurrentProgram, directionUp, tuneTo)) {
         mIsTuneCompleted = false;
         auto task = [this]() {
             LOG(DEBUG) << "program list is empty, seek couldn't stop";
 
             mCallback->onTuneFailed(Result::TIMEOUT, {});
         };
-        mThread.schedule(task, delay::seek);
+        mTuneTask = mThread.schedule(task, delay::seek);
 
         return Result::OK;
     }
 
-    // Not optimal (O(sort) instead of O(n)), but not a big deal here;
-    // also, it's likely that list is already sorted (so O(n) anyway).
-    sort(list.begin(), list.end());
-    auto current = mCurrentProgram;
-    auto found = lower_bound(list.begin(), list.end(), VirtualProgram({current}));
-    if (directionUp) {
-        if (found < list.end() - 1) {
-            if (tunesTo(current, found->selector)) found++;
-        } else {
-            found = list.begin();
-        }
-    } else {
-        if (found > list.begin() && found != list.end()) {
-            found--;
-        } else {
-            found = list.end() - 1;
-        }
-    }
-    auto tuneTo = found->selector;
-
     mIsTuneCompleted = false;
     auto task = [this, tuneTo, directionUp]() {
         LOG(VERBOSE) << "executing seek up=" << directionUp;
@@ -166,7 +147,7 @@ Return<Result> TunerSession::scan(bool directionUp, bool skipSubChannel) {
         lock_guard<mutex> lk(mMut);
         tuneInternalLocked(tuneTo);
     };
-    mThread.schedule(task, delay::seek);
+    mTuneTask = mThread.schedule(task, delay::seek);
 
     return Result::OK;
 }
@@ -206,7 +187,7 @@ Return<Result> TunerSession::step(bool directionUp) {
 
         tuneInternalLocked(utils::make_selector_amfm(stepTo));
     };
-    mThread.schedule(task, delay::step);
+    mTuneTask = mThread.schedule(task, delay::step);
 
     return Result::OK;
 }
@@ -214,7 +195,8 @@ Return<Result> TunerSession::step(bool directionUp) {
 void TunerSession::cancelLocked() {
     LOG(VERBOSE) << "cancelling current operations...";
 
-    mThread.cancelAll();
+    // Only a pending tune, scan or step is cancelled; program list updates carry on.
+    mThread.cancel(mTuneTask);
     if (utils::getType(mCurrentProgram.primaryId) != IdentifierType::INVALID) {
         mIsTuneCompleted = true;
     }
@@ -234,30 +216,65 @@ Return<Result> TunerSession::startProgramListUpdates(const ProgramFilter& filter
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::INVALID_STATE;
 
-    auto list = virtualRadio().getProgramList();
-    vector<VirtualProgram> filteredList;
-    auto filterCb = [&filter](const VirtualProgram& program) {
-        return utils::satisfies(filter, program.selector);
+    mIsProgramListEnabled = true;
+    auto task = [this, filteredList = virtualRadio().getProgramList(filter)]() {
+        lock_guard<mutex> lk(mMut);
+        if (!mIsProgramListEnabled) return;
+        sendProgramListLocked(filteredList);
     };
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filteredList), filterCb);
+    mThread.schedule(task, delay::list);
 
-    auto task = [this, list]() {
-        lock_guard<mutex> lk(mMut);
+    return Result::OK;
+}
 
+void TunerSession::sendProgramListLocked(const vector<VirtualProgram>& list) {
+    vector<ProgramInfo> modified;
+    vector<ProgramIdentifier> removed;
+    const bool purge = !mSentProgramList.has_value();
+
+    if (purge) {
+        mSentProgramList.emplace();
+        modified.assign(list.begin(), list.end());
+    } else {
+        // Only send what changed since the list the client already has.
+        utils::ProgramInfoSet current(list.begin(), list.end());
+        for (auto&& info : current) {
+            auto it = mSentProgramList->find(info);
+            if (it == mSentProgramList->end() || !(*it == info)) modified.push_back(info);
+        }
+        for (auto&& info : *mSentProgramList) {
+            if (current.count(info) == 0) removed.push_back(info.selector.primaryId);
+        }
+    }
+
+    // Always send at least one chunk, for the client to see the list complete.
+    size_t modifiedSent = 0;
+    size_t removedSent = 0;
+    do {
         ProgramListChunk chunk = {};
-        chunk.purge = true;
-        chunk.complete = true;
-        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
+        chunk.purge = purge && modifiedSent == 0;
 
-        mCallback->onProgramListUpdated(chunk);
-    };
-    mThread.schedule(task, delay::list);
+        size_t n = std::min(kMaxProgramListChunkSize, removed.size() - removedSent);
+        chunk.removed = hidl_vec<ProgramIdentifier>(removed.begin() + removedSent,
+                                                    removed.begin() + removedSent + n);
+        removedSent += n;
 
-    return Result::OK;
+        n = std::min(kMaxProgramListChunkSize - n, modified.size() - modifiedSent);
+        chunk.modified = hidl_vec<ProgramInfo>(modified.begin() + modifiedSent,
+                                               modified.begin() + modifiedSent + n);
+        modifiedSent += n;
+
+        chunk.complete = modifiedSent == modified.size() && removedSent == removed.size();
+        utils::updateProgramList(*mSentProgramList, chunk);
+        mCallback->onProgramListUpdated(chunk);
+    } while (modifiedSent < modified.size() || removedSent < removed.size());
 }
 
 Return<void> TunerSession::stopProgramListUpdates() {
     LOG(DEBUG) << "requested program list updates to stop";
+    lock_guard<mutex> lk(mMut);
+    mIsProgramListEnabled = false;
+    mSentProgramList.reset();
     return {};
 }
 
@@ -20,6 +20,7 @@
 
 #include <android/hardware/broadcastradio/2.0/ITunerCallback.h>
 #include <android/hardware/broadcastradio/2.0/ITunerSession.h>
+#include <broadcastradio-utils-2x/Utils.h>
 #include <broadcastradio-utils/WorkerThread.h>
 
 #include <optional>
@@ -55,6 +56,7 @@ struct TunerSession : public ITunerSession {
    private:
     std::mutex mMut;
     WorkerThread mThread;
+    WorkerThread::TaskId mTuneTask = 0;
     bool mIsClosed = false;
 
     const sp<ITunerCallback> mCallback;
@@ -63,7 +65,12 @@ struct TunerSession : public ITunerSession {
     bool mIsTuneCompleted = false;
     ProgramSelector mCurrentProgram = {};
 
+    bool mIsProgramListEnabled = false;
+    // The program list as the client has it, once it was sent.
+    std::optional<utils::ProgramInfoSet> mSentProgramList;
+
     void cancelLocked();
+    void sendProgramListLocked(const std::vector<VirtualProgram>& list);
     void tuneInternalLocked(const ProgramSelector& sel);
     const VirtualRadio& virtualRadio() const;
     const BroadcastRadio& module() const;
@@ -17,6 +17,9 @@
 
 #include <broadcastradio-utils-2x/Utils.h>
 
+#include <algorithm>
+#include <numeric>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
@@ -53,7 +56,21 @@ VirtualRadio gDabRadio(
 // clang-format on
 
 VirtualRadio::VirtualRadio(const std::string& name, const vector<VirtualProgram>& initialList)
-    : mName(name), mPrograms(initialList) {}
+    : mName(name), mPrograms(initialList), mSortedPrograms(initialList) {
+    for (size_t i = 0; i < mPrograms.size(); i++) {
+        for (auto&& id : mPrograms[i].selector) {
+            auto& typeIndices = mProgramsByIdType[id.type];
+            if (typeIndices.empty() || typeIndices.back() != i) typeIndices.push_back(i);
+            auto& idIndices = mProgramsById[id];
+            if (idIndices.empty() || idIndices.back() != i) idIndices.push_back(i);
+        }
+    }
+    std::sort(mSortedPrograms.begin(), mSortedPrograms.end());
+}
+
+size_t VirtualRadio::IdentifierHasher::operator()(const ProgramIdentifier& id) const {
+    return std::hash<uint64_t>{}(id.value) ^ (std::hash<uint32_t>{}(id.type) * 0x9e3779b9);
+}
 
 std::string VirtualRadio::getName() const {
     return mName;
@@ -64,15 +81,84 @@ vector<VirtualProgram> VirtualRadio::getProgramList() const {
     return mPrograms;
 }
 
+vector<VirtualProgram> VirtualRadio::getProgramList(const ProgramFilter& filter) const {
+    lock_guard<mutex> lk(mMut);
+
+    /* A program can only satisfy the filter if it has an identifier of one of the filtered types
+     * (or of the filtered identifiers), so only programs indexed under those are checked. */
+    vector<uint32_t> types;
+    if (filter.identifierTypes.size() > 0) {
+        types.assign(filter.identifierTypes.begin(), filter.identifierTypes.end());
+    } else {
+        for (auto&& id : filter.identifiers) types.push_back(id.type);
+    }
+
+    vector<size_t> candidates;
+    if (types.empty()) {
+        candidates.resize(mPrograms.size());
+        std::iota(candidates.begin(), candidates.end(), 0);
+    } else {
+        for (auto type : types) {
+            auto it = mProgramsByIdType.find(type);
+            if (it == mProgramsByIdType.end()) continue;
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    vector<VirtualProgram> filtered;
+    for (auto i : candidates) {
+        if (utils::satisfies(filter, mPrograms[i].selector)) filtered.push_back(mPrograms[i]);
+    }
+    return filtered;
+}
+
 bool VirtualRadio::getProgram(const ProgramSelector& selector, VirtualProgram& programOut) const {
     lock_guard<mutex> lk(mMut);
-    for (auto&& program : mPrograms) {
-        if (utils::tunesTo(selector, program.selector)) {
-            programOut = program;
-            return true;
+
+    /* A program the selector tunes to shares one of its identifiers, so only the programs indexed
+     * under the selector's identifiers are checked. Of those, the first one listed wins. */
+    size_t found = mPrograms.size();
+    for (auto&& id : selector) {
+        auto it = mProgramsById.find(id);
+        if (it == mProgramsById.end()) continue;
+        for (auto i : it->second) {
+            if (i >= found) break;
+            if (utils::tunesTo(selector, mPrograms[i].selector)) {
+                found = i;
+                break;
+            }
+        }
+    }
+    if (found == mPrograms.size()) return false;
+
+    programOut = mPrograms[found];
+    return true;
+}
+
+bool VirtualRadio::getNextProgram(const ProgramSelector& current, bool directionUp,
+                                  ProgramSelector& next) const {
+    lock_guard<mutex> lk(mMut);
+    auto& list = mSortedPrograms;
+    if (list.empty()) return false;
+
+    auto found = std::lower_bound(list.begin(), list.end(), VirtualProgram({current}));
+    if (directionUp) {
+        if (found < list.end() - 1) {
+            if (utils::tunesTo(current, found->selector)) found++;
+        } else {
+            found = list.begin();
+        }
+    } else {
+        if (found > list.begin() && found != list.end()) {
+            found--;
+        } else {
+            found = list.end() - 1;
         }
     }
-    return false;
+    next = found->selector;
+    return true;
 }
 
 }  // namespace implementation
@@ -19,6 +19,7 @@
 #include "VirtualProgram.h"
 
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace android {
@@ -41,12 +42,35 @@ class VirtualRadio {
 
     std::string getName() const;
     std::vector<VirtualProgram> getProgramList() const;
+    std::vector<VirtualProgram> getProgramList(const ProgramFilter& filter) const;
     bool getProgram(const ProgramSelector& selector, VirtualProgram& program) const;
 
+    /**
+     * Finds the program a seek from the current one ends up on.
+     *
+     * @param current The selector currently tuned to.
+     * @param directionUp Whether to seek up or down, wrapping around at the ends.
+     * @param next The program found.
+     * @return false if there are no programs.
+     */
+    bool getNextProgram(const ProgramSelector& current, bool directionUp,
+                        ProgramSelector& next) const;
+
    private:
     mutable std::mutex mMut;
     std::string mName;
     std::vector<VirtualProgram> mPrograms;
+
+    struct IdentifierHasher {
+        size_t operator()(const ProgramIdentifier& id) const;
+    };
+
+    // Indices into mPrograms of the programs having an identifier of a given type, in order.
+    std::unordered_map<uint32_t, std::vector<size_t>> mProgramsByIdType;
+    // Indices into mPrograms of the programs having a given identifier, in order.
+    std::unordered_map<ProgramIdentifier, std::vector<size_t>, IdentifierHasher> mProgramsById;
+    // mPrograms, sorted.
+    std::vector<VirtualProgram> mSortedPrograms;
 };
 
 /** AM/FM virtual radio space. */
@@ -72,6 +72,38 @@ TEST(WorkerThreadTest, cancelSecond) {
     ASSERT_FALSE(executed2);
 }
 
+TEST(WorkerThreadTest, cancelOne) {
+    atomic<bool> executed1(false);
+    atomic<bool> executed2(false);
+    WorkerThread thread;
+
+    auto id1 = thread.schedule([&]() { executed1 = true; }, 50ms);
+    auto id2 = thread.schedule([&]() { executed2 = true; }, 50ms);
+
+    ASSERT_TRUE(thread.cancel(id1));
+    ASSERT_FALSE(thread.cancel(id1));
+    sleep_for(100ms);
+
+    ASSERT_FALSE(executed1);
+    ASSERT_TRUE(executed2);
+    ASSERT_FALSE(thread.cancel(id2));
+}
+
+TEST(WorkerThreadTest, coalesceCloseDeadlines) {
+    atomic<time_point<steady_clock>> stop1;
+    atomic<time_point<steady_clock>> stop2;
+    WorkerThread thread;
+
+    thread.schedule([&]() { stop1 = steady_clock::now(); }, 100ms);
+    thread.schedule([&]() { stop2 = steady_clock::now(); },
+                    100ms + WorkerThread::kCoalescingWindow / 2);
+
+    sleep_for(150ms);
+
+    // The second task runs right after the first one instead of in a wakeup of its own.
+    ASSERT_LT(stop2.load() - stop1.load(), WorkerThread::kCoalescingWindow / 2);
+}
+
 TEST(WorkerThreadTest, executeInOrder) {
     mutex mut;
     vector<int> order;
@@ -23,14 +23,8 @@ using std::chrono::steady_clock;
 using std::function;
 using std::lock_guard;
 using std::mutex;
-using std::priority_queue;
-using std::this_thread::sleep_for;
 using std::unique_lock;
 
-bool operator<(const WorkerThread::Task& lhs, const WorkerThread::Task& rhs) {
-    return lhs.when > rhs.when;
-}
-
 WorkerThread::WorkerThread() : mIsTerminating(false), mThread(&WorkerThread::threadLoop, this) {}
 
 WorkerThread::~WorkerThread() {
@@ -42,20 +36,38 @@ WorkerThread::~WorkerThread() {
     mThread.join();
 }
 
-void WorkerThread::schedule(function<void()> task, milliseconds delay) {
+WorkerThread::TaskId WorkerThread::schedule(function<void()> task, milliseconds delay) {
     auto when = steady_clock::now() + delay;
 
     lock_guard<mutex> lk(mMut);
-    mTasks.push(Task({when, task}));
+    auto id = mNextTaskId++;
+    mTasks.emplace(std::make_pair(when, id), std::move(task));
+    mTaskDeadlines.emplace(id, when);
     mCond.notify_one();
+    return id;
+}
+
+bool WorkerThread::cancel(TaskId id) {
+    lock_guard<mutex> lk(mMut);
+    auto it = mTaskDeadlines.find(id);
+    if (it == mTaskDeadlines.end()) return false;
+
+    mTasks.erase(std::make_pair(it->second, id));
+    mTaskDeadlines.erase(it);
+    return true;
 }
 
 void WorkerThread::cancelAll() {
     lock_guard<mutex> lk(mMut);
-    priority_queue<Task>().swap(mTasks);  // empty queue
+    mTasks.clear();
+    mTaskDeadlines.clear();
 }
 
 void WorkerThread::threadLoop() {
+    // Tasks due before this are run without waiting for their deadline, as part of the wakeup
+    // that ran the task before them.
+    TimePoint runUntil;
+
     while (!mIsTerminating) {
         unique_lock<mutex> lk(mMut);
         if (mTasks.empty()) {
@@ -63,15 +75,21 @@ void WorkerThread::threadLoop() {
             continue;
         }
 
-        auto task = mTasks.top();
-        if (task.when > steady_clock::now()) {
-            mCond.wait_until(lk, task.when);
-            continue;
+        auto next = mTasks.begin();
+        auto when = next->first.first;
+        if (when > runUntil) {
+            if (when > steady_clock::now()) {
+                mCond.wait_until(lk, when);
+                continue;
+            }
+            runUntil = when + kCoalescingWindow;
         }
 
-        mTasks.pop();
+        auto what = std::move(next->second);
+        mTaskDeadlines.erase(next->first.second);
+        mTasks.erase(next);
         lk.unlock();  // what() might need to schedule another task
-        task.what();
+        what();
     }
 }
 
@@ -16,32 +16,55 @@
 #ifndef ANDROID_HARDWARE_BROADCASTRADIO_COMMON_WORKERTHREAD_H
 #define ANDROID_HARDWARE_BROADCASTRADIO_COMMON_WORKERTHREAD_H
 
+#include <atomic>
 #include <chrono>
-#include <queue>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 
 namespace android {
 
 class WorkerThread {
    public:
+    typedef uint64_t TaskId;
+
     WorkerThread();
     virtual ~WorkerThread();
 
-    void schedule(std::function<void()> task, std::chrono::milliseconds delay);
+    /**
+     * Schedules a task.
+     *
+     * Tasks due within kCoalescingWindow of each other may be run together, so a task may run up
+     * to that much ahead of its deadline.
+     *
+     * @return The id to cancel the task with.
+     */
+    TaskId schedule(std::function<void()> task, std::chrono::milliseconds delay);
+
+    /**
+     * Cancels a task, unless it already started running.
+     *
+     * @return true if the task was cancelled.
+     */
+    bool cancel(TaskId id);
     void cancelAll();
 
+    static constexpr std::chrono::milliseconds kCoalescingWindow{10};
+
    private:
-    struct Task {
-        std::chrono::time_point<std::chrono::steady_clock> when;
-        std::function<void()> what;
-    };
-    friend bool operator<(const Task& lhs, const Task& rhs);
+    typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
 
     std::atomic<bool> mIsTerminating;
     std::mutex mMut;
     std::condition_variable mCond;
     std::thread mThread;
-    std::priority_queue<Task> mTasks;
+    TaskId mNextTaskId = 1;
+    // Ordered by deadline, and by scheduling order for equal deadlines.
+    std::map<std::pair<TimePoint, TaskId>, std::function<void()>> mTasks;
+    std::unordered_map<TaskId, TimePoint> mTaskDeadlines;
 
     void threadLoop();
 };
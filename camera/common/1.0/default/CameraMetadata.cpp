@@ -19,6 +19,7 @@
 #define LOG_TAG "CamComm1.0-MD"
 #include <log/log.h>
 #include <utils/Errors.h>
+#include <algorithm>
 
 #include "CameraMetadata.h"
 #include "VendorTagDescriptor.h"
@@ -137,6 +138,50 @@ void CameraMetadata::acquire(CameraMetadata &other) {
     acquire(other.release());
 }
 
+status_t CameraMetadata::assign(const CameraMetadata &other, size_t entryCapacity,
+        size_t dataCapacity) {
+    return assign(other.mBuffer, entryCapacity, dataCapacity);
+}
+
+status_t CameraMetadata::assign(const camera_metadata_t* other, size_t entryCapacity,
+        size_t dataCapacity) {
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    if (CC_UNLIKELY(other != NULL && other == mBuffer)) {
+        ALOGE("%s: Assignment from the same metadata buffer!", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+
+    if (other != NULL) {
+        entryCapacity = std::max(entryCapacity, get_camera_metadata_entry_count(other));
+        dataCapacity = std::max(dataCapacity, get_camera_metadata_data_count(other));
+    }
+    if (mBuffer != NULL &&
+            get_camera_metadata_entry_capacity(mBuffer) >= entryCapacity &&
+            get_camera_metadata_data_capacity(mBuffer) >= dataCapacity) {
+        // Empty the buffer in place; it was allocated with the size of its capacity
+        entryCapacity = get_camera_metadata_entry_capacity(mBuffer);
+        dataCapacity = get_camera_metadata_data_capacity(mBuffer);
+        mBuffer = place_camera_metadata(mBuffer,
+                calculate_camera_metadata_size(entryCapacity, dataCapacity),
+                entryCapacity, dataCapacity);
+    } else {
+        clear();
+        mBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
+    }
+    if (mBuffer == NULL) {
+        ALOGE("%s: Can't allocate metadata buffer", __FUNCTION__);
+        return NO_MEMORY;
+    }
+
+    if (other == NULL) {
+        return OK;
+    }
+    return append_camera_metadata(mBuffer, other);
+}
+
 status_t CameraMetadata::append(const CameraMetadata &other) {
     return append(other.mBuffer);
 }
@@ -158,6 +203,11 @@ size_t CameraMetadata::entryCount() const {
             get_camera_metadata_entry_count(mBuffer);
 }
 
+size_t CameraMetadata::dataCount() const {
+    return (mBuffer == NULL) ? 0 :
+            get_camera_metadata_data_count(mBuffer);
+}
+
 bool CameraMetadata::isEmpty() const {
     return entryCount() == 0;
 }
@@ -316,7 +366,21 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     size_t data_size = calculate_camera_metadata_entry_data_size(type,
             data_count);
 
-    res = resizeIfNeeded(1, data_size);
+    // An existing entry is updated in place, with no extra room needed unless
+    // its data grows
+    size_t extraEntries = 1;
+    size_t extraData = data_size;
+    camera_metadata_entry_t existing;
+    if (mBuffer != NULL &&
+            find_camera_metadata_entry(mBuffer, tag, &existing) == OK) {
+        extraEntries = 0;
+        if (data_size <= calculate_camera_metadata_entry_data_size(type,
+                existing.count)) {
+            extraData = 0;
+        }
+    }
+
+    res = resizeIfNeeded(extraEntries, extraData);
 
     if (res == OK) {
         camera_metadata_entry_t entry;
@@ -462,11 +526,40 @@ void CameraMetadata::swap(CameraMetadata& other) {
     mBuffer = otherBuf;
 }
 
+const std::unordered_map<std::string, uint32_t>& CameraMetadata::getAndroidTagsByName() {
+    static const std::unordered_map<std::string, uint32_t> sTagsByName = [] {
+        std::unordered_map<std::string, uint32_t> tagsByName;
+        for (size_t i = 0; i < ANDROID_SECTION_COUNT; ++i) {
+            std::string prefix = std::string(camera_metadata_section_names[i]) + ".";
+            for (uint32_t tag = camera_metadata_section_bounds[i][0];
+                    tag < camera_metadata_section_bounds[i][1]; ++tag) {
+                const char *tagName = get_camera_metadata_tag_name(tag);
+                if (tagName != nullptr) {
+                    tagsByName.insert(std::make_pair(prefix + tagName, tag));
+                }
+            }
+        }
+        return tagsByName;
+    }();
+    return sTagsByName;
+}
+
 status_t CameraMetadata::getTagFromName(const char *name,
         const VendorTagDescriptor* vTags, uint32_t *tag) {
 
     if (name == nullptr || tag == nullptr) return BAD_VALUE;
 
+    // Exact names are resolved by hash; the scan below finds the errors of the others
+    const std::unordered_map<std::string, uint32_t>& androidTags = getAndroidTagsByName();
+    auto iter = androidTags.find(name);
+    if (iter != androidTags.end()) {
+        *tag = iter->second;
+        return OK;
+    }
+    if (vTags != NULL && vTags->lookupTag(name, tag) == OK) {
+        return OK;
+    }
+
     size_t nameLength = strlen(name);
 
     const SortedVector<String8> *vendorSections;
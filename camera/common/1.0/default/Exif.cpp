@@ -57,9 +57,13 @@ class ExifUtilsImpl : public ExifUtils {
     virtual ~ExifUtilsImpl();
 
     // Initialize() can be called multiple times. The setting of Exif tags will be
-    // cleared.
+    // cleared, back to the saved template if any.
     virtual bool initialize();
 
+    // Saves the tags set since Initialize() as the template of the next images.
+    // Returns false if serializing the tags fails.
+    virtual bool saveTemplate();
+
     // set all known fields from a metadata structure
     virtual bool setFromMetadata(const CameraMetadata& metadata,
                                  const size_t imageWidth,
@@ -313,6 +317,8 @@ class ExifUtilsImpl : public ExifUtils {
     uint8_t* app1_buffer_;
     // The length of |app1_buffer_|.
     unsigned int app1_length_;
+    // The serialized tags that initialize() starts from, if not empty.
+    std::vector<uint8_t> template_;
 
 };
 
@@ -384,6 +390,11 @@ bool ExifUtilsImpl::initialize() {
         ALOGE("%s: allocate memory for exif_data_ failed", __FUNCTION__);
         return false;
     }
+    if (!template_.empty()) {
+        // Loaded as is, the specification is followed when the image tags are set.
+        exif_data_unset_option(exif_data_, EXIF_DATA_OPTION_FOLLOW_SPECIFICATION);
+        exif_data_load_data(exif_data_, template_.data(), template_.size());
+    }
     // set the image options.
     exif_data_set_option(exif_data_, EXIF_DATA_OPTION_FOLLOW_SPECIFICATION);
     exif_data_set_data_type(exif_data_, EXIF_DATA_TYPE_COMPRESSED);
@@ -397,6 +408,26 @@ bool ExifUtilsImpl::initialize() {
     return true;
 }
 
+bool ExifUtilsImpl::saveTemplate() {
+    if (exif_data_ == nullptr) {
+        ALOGE("%s: not initialized", __FUNCTION__);
+        return false;
+    }
+    uint8_t* buffer = nullptr;
+    unsigned int length = 0;
+    exif_data_->data = nullptr;
+    exif_data_->size = 0;
+    exif_data_save_data(exif_data_, &buffer, &length);
+    if (!length) {
+        ALOGE("%s: Allocate memory for the template failed", __FUNCTION__);
+        return false;
+    }
+    template_.assign(buffer, buffer + length);
+    // Allocated by the default ExifMem, like |app1_buffer_|.
+    free(buffer);
+    return true;
+}
+
 bool ExifUtilsImpl::setAperture(uint32_t numerator, uint32_t denominator) {
     SET_RATIONAL(EXIF_IFD_EXIF, EXIF_TAG_APERTURE_VALUE, numerator, denominator);
     return true;
@@ -19,6 +19,7 @@
 
 #include <gralloctypes/Gralloc4.h>
 #include <log/log.h>
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -69,19 +70,35 @@ void HandleImporter::cleanup() {
     mMapperV4.clear();
     mMapperV3.clear();
     mMapperV2.clear();
+    mYCbCrOffsets.clear();
     mInitialized = false;
 }
 
+void HandleImporter::recordMapperCall(MapperCallStats* stats, nsecs_t startTime) {
+    nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    Mutex::Autolock lock(mStatsLock);
+    stats->count++;
+    stats->totalTimeNs += duration;
+    stats->maxTimeNs = std::max(stats->maxTimeNs, duration);
+}
+
+HandleImporter::MapperStats HandleImporter::getMapperStats() {
+    Mutex::Autolock lock(mStatsLock);
+    return mStats;
+}
+
 template<class M, class E>
 bool HandleImporter::importBufferInternal(const sp<M> mapper, buffer_handle_t& handle) {
     E error;
     buffer_handle_t importedHandle;
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     auto ret = mapper->importBuffer(
         hidl_handle(handle),
         [&](const auto& tmpError, const auto& tmpBufferHandle) {
             error = tmpError;
             importedHandle = static_cast<buffer_handle_t>(tmpBufferHandle);
         });
+    recordMapperCall(&mStats.importBuffer, startTime);
 
     if (!ret.isOk()) {
         ALOGE("%s: mapper importBuffer failed: %s",
@@ -106,6 +123,7 @@ YCbCrLayout HandleImporter::lockYCbCrInternal(const sp<M> mapper, buffer_handle_
 
     typename M::Rect accessRegionCopy = {accessRegion.left, accessRegion.top,
             accessRegion.width, accessRegion.height};
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     mapper->lockYCbCr(buffer, cpuUsage, accessRegionCopy, acquireFenceHandle,
             [&](const auto& tmpError, const auto& tmpLayout) {
                 if (tmpError == E::NONE) {
@@ -120,6 +138,7 @@ YCbCrLayout HandleImporter::lockYCbCrInternal(const sp<M> mapper, buffer_handle_
                     ALOGE("%s: failed to lockYCbCr error %d!", __FUNCTION__, tmpError);
                 }
            });
+    recordMapperCall(&mStats.lock, startTime);
     return layout;
 }
 
@@ -134,6 +153,7 @@ YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
 
     typename IMapperV4::Rect accessRegionV4 = {accessRegion.left, accessRegion.top,
                                                accessRegion.width, accessRegion.height};
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     mapper->lock(buffer, cpuUsage, accessRegionV4, acquireFenceHandle,
                  [&](const auto& tmpError, const auto& tmpPtr) {
                      if (tmpError == MapperErrorV4::NONE) {
@@ -142,57 +162,86 @@ YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
                          ALOGE("%s: failed to lock error %d!", __FUNCTION__, tmpError);
                      }
                  });
+    recordMapperCall(&mStats.lock, startTime);
 
     if (mapped == nullptr) {
         return layout;
     }
 
-    hidl_vec<uint8_t> encodedPlaneLayouts;
-    mapper->get(buffer, gralloc4::MetadataType_PlaneLayouts,
-                [&](const auto& tmpError, const auto& tmpEncodedPlaneLayouts) {
-                    if (tmpError == MapperErrorV4::NONE) {
-                        encodedPlaneLayouts = tmpEncodedPlaneLayouts;
-                    } else {
-                        ALOGE("%s: failed to get plane layouts %d!", __FUNCTION__, tmpError);
-                    }
-                });
+    // Buffers not imported by this importer have no entry, and their offsets are not cached as
+    // their handle may be reused by another buffer without us knowing
+    YCbCrOffsets offsets;
+    auto cached = mYCbCrOffsets.find(buf);
+    if (cached != mYCbCrOffsets.end() && cached->second.valid) {
+        offsets = cached->second;
+        Mutex::Autolock lock(mStatsLock);
+        mStats.planeLayoutCacheHits++;
+    } else {
+        hidl_vec<uint8_t> encodedPlaneLayouts;
+        mapper->get(buffer, gralloc4::MetadataType_PlaneLayouts,
+                    [&](const auto& tmpError, const auto& tmpEncodedPlaneLayouts) {
+                        if (tmpError == MapperErrorV4::NONE) {
+                            encodedPlaneLayouts = tmpEncodedPlaneLayouts;
+                        } else {
+                            ALOGE("%s: failed to get plane layouts %d!", __FUNCTION__, tmpError);
+                        }
+                    });
+
+        std::vector<PlaneLayout> planeLayouts;
+        if (gralloc4::decodePlaneLayouts(encodedPlaneLayouts, &planeLayouts) == OK) {
+            offsets.valid = true;
+        }
 
-    std::vector<PlaneLayout> planeLayouts;
-    gralloc4::decodePlaneLayouts(encodedPlaneLayouts, &planeLayouts);
+        for (const auto& planeLayout : planeLayouts) {
+            for (const auto& planeLayoutComponent : planeLayout.components) {
+                const auto& type = planeLayoutComponent.type;
 
-    for (const auto& planeLayout : planeLayouts) {
-        for (const auto& planeLayoutComponent : planeLayout.components) {
-            const auto& type = planeLayoutComponent.type;
+                if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
+                    continue;
+                }
 
-            if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
-                continue;
+                ssize_t offset = planeLayout.offsetInBytes + planeLayoutComponent.offsetInBits / 8;
+
+                switch (static_cast<PlaneLayoutComponentType>(type.value)) {
+                    case PlaneLayoutComponentType::Y:
+                        offsets.y = offset;
+                        offsets.yStride = planeLayout.strideInBytes;
+                        break;
+                    case PlaneLayoutComponentType::CB:
+                        offsets.cb = offset;
+                        offsets.cStride = planeLayout.strideInBytes;
+                        offsets.chromaStep = planeLayout.sampleIncrementInBits / 8;
+                        break;
+                    case PlaneLayoutComponentType::CR:
+                        offsets.cr = offset;
+                        offsets.cStride = planeLayout.strideInBytes;
+                        offsets.chromaStep = planeLayout.sampleIncrementInBits / 8;
+                        break;
+                    default:
+                        break;
+                }
             }
+        }
 
-            uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
-            data += planeLayout.offsetInBytes;
-            data += planeLayoutComponent.offsetInBits / 8;
-
-            switch (static_cast<PlaneLayoutComponentType>(type.value)) {
-                case PlaneLayoutComponentType::Y:
-                    layout.y = data;
-                    layout.yStride = planeLayout.strideInBytes;
-                    break;
-                case PlaneLayoutComponentType::CB:
-                    layout.cb = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                case PlaneLayoutComponentType::CR:
-                    layout.cr = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                default:
-                    break;
-            }
+        if (cached != mYCbCrOffsets.end()) {
+            cached->second = offsets;
         }
     }
 
+    uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
+    if (offsets.y >= 0) {
+        layout.y = data + offsets.y;
+        layout.yStride = offsets.yStride;
+    }
+    if (offsets.cb >= 0) {
+        layout.cb = data + offsets.cb;
+    }
+    if (offsets.cr >= 0) {
+        layout.cr = data + offsets.cr;
+    }
+    layout.cStride = offsets.cStride;
+    layout.chromaStep = offsets.chromaStep;
+
     return layout;
 }
 
@@ -201,6 +250,7 @@ int HandleImporter::unlockInternal(const sp<M> mapper, buffer_handle_t& buf) {
     int releaseFence = -1;
     auto buffer = const_cast<native_handle_t*>(buf);
 
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     mapper->unlock(
         buffer, [&](const auto& tmpError, const auto& tmpReleaseFence) {
             if (tmpError == E::NONE) {
@@ -221,6 +271,7 @@ int HandleImporter::unlockInternal(const sp<M> mapper, buffer_handle_t& buf) {
                 ALOGE("%s: failed to unlock error %d!", __FUNCTION__, tmpError);
             }
         });
+    recordMapperCall(&mStats.unlock, startTime);
     return releaseFence;
 }
 
@@ -239,7 +290,11 @@ bool HandleImporter::importBuffer(buffer_handle_t& handle) {
     }
 
     if (mMapperV4 != nullptr) {
-        return importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle);
+        if (!importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle)) {
+            return false;
+        }
+        mYCbCrOffsets[handle] = {};
+        return true;
     }
 
     if (mMapperV3 != nullptr) {
@@ -265,6 +320,7 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
     }
 
     if (mMapperV4 != nullptr) {
+        mYCbCrOffsets.erase(handle);
         auto ret = mMapperV4->freeBuffer(const_cast<native_handle_t*>(handle));
         if (!ret.isOk()) {
             ALOGE("%s: mapper freeBuffer failed: %s", __FUNCTION__, ret.description().c_str());
@@ -331,6 +387,7 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
 
     hidl_handle acquireFenceHandle;
     auto buffer = const_cast<native_handle_t*>(buf);
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     if (mMapperV4 != nullptr) {
         IMapperV4::Rect accessRegionV4{accessRegion.left, accessRegion.top, accessRegion.width,
                                        accessRegion.height};
@@ -366,6 +423,7 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
                     }
                });
     }
+    recordMapperCall(&mStats.lock, startTime);
 
     ALOGV("%s: ptr %p accessRegion.top: %d accessRegion.left: %d accessRegion.width: %d "
           "accessRegion.height: %d",
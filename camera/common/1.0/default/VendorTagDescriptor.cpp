@@ -75,6 +75,7 @@ void VendorTagDescriptor::copyFrom(const VendorTagDescriptor& src) {
     mTagToNameMap = src.mTagToNameMap;
     mTagToSectionMap = src.mTagToSectionMap;
     mTagToTypeMap = src.mTagToTypeMap;
+    mFullNameToTagMap = src.mFullNameToTagMap;
     mSections = src.mSections;
     mTagCount = src.mTagCount;
     mVendorOps = src.mVendorOps;
@@ -146,6 +147,17 @@ status_t VendorTagDescriptor::lookupTag(const String8& name, const String8& sect
     return OK;
 }
 
+status_t VendorTagDescriptor::lookupTag(const char* fullName, /*out*/uint32_t* tag) const {
+    auto iter = mFullNameToTagMap.find(fullName);
+    if (iter == mFullNameToTagMap.end()) {
+        return NAME_NOT_FOUND;
+    }
+    if (tag != NULL) {
+        *tag = iter->second;
+    }
+    return OK;
+}
+
 void VendorTagDescriptor::dump(int fd, int verbosity, int indentation) const {
 
     size_t size = mTagToNameMap.size();
@@ -291,6 +303,11 @@ static Mutex sLock;
 static sp<VendorTagDescriptor> sGlobalVendorTagDescriptor;
 static sp<VendorTagDescriptorCache> sGlobalVendorTagDescriptorCache;
 
+// The vendor tags of a camera module do not change while it is loaded, so the descriptor built
+// from its ops is shared by all the providers of the process. Protected by sLock.
+static vendor_tag_ops_t sCachedDescriptorOps;
+static sp<VendorTagDescriptor> sCachedDescriptor;
+
 status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vOps,
             /*out*/
             sp<VendorTagDescriptor>& descriptor) {
@@ -305,6 +322,19 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
         return BAD_VALUE;
     }
 
+    {
+        Mutex::Autolock al(sLock);
+        if (sCachedDescriptor != NULL && sCachedDescriptor->mTagCount == tagCount &&
+                sCachedDescriptorOps.get_tag_count == vOps->get_tag_count &&
+                sCachedDescriptorOps.get_all_tags == vOps->get_all_tags &&
+                sCachedDescriptorOps.get_section_name == vOps->get_section_name &&
+                sCachedDescriptorOps.get_tag_name == vOps->get_tag_name &&
+                sCachedDescriptorOps.get_tag_type == vOps->get_tag_type) {
+            descriptor = sCachedDescriptor;
+            return OK;
+        }
+    }
+
     Vector<uint32_t> tagArray;
     LOG_ALWAYS_FATAL_IF(tagArray.resize(tagCount) != tagCount,
             "%s: too many (%u) vendor tags defined.", __FUNCTION__, tagCount);
@@ -366,8 +396,22 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
             reverseIndex = desc->mReverseMapping.add(sectionString, nameMapper);
         }
         desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
+
+        // Set up full name mapping
+        std::string fullName = std::string(sectionString.string()) + "." +
+                desc->mTagToNameMap.valueFor(tag).string();
+        auto inserted = desc->mFullNameToTagMap.insert(std::make_pair(fullName, tag));
+        if (!inserted.second && sectionString.length() >
+                strlen(desc->getSectionName(inserted.first->second))) {
+            inserted.first->second = tag;
+        }
     }
 
+    {
+        Mutex::Autolock al(sLock);
+        sCachedDescriptorOps = *vOps;
+        sCachedDescriptor = desc;
+    }
     descriptor = desc;
     return OK;
 }
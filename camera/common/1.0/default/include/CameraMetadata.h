@@ -21,6 +21,8 @@
 
 #include <utils/String8.h>
 #include <utils/Vector.h>
+#include <string>
+#include <unordered_map>
 
 namespace android {
 namespace hardware {
@@ -100,6 +102,14 @@ class CameraMetadata {
      */
     void acquire(CameraMetadata &other);
 
+    /**
+     * Replace the contents with a copy of other, leaving room for at least entryCapacity entries
+     * and dataCapacity bytes of data so that later updates need not reallocate. The current
+     * buffer is reused when it is large enough.
+     */
+    status_t assign(const CameraMetadata &other, size_t entryCapacity, size_t dataCapacity);
+    status_t assign(const camera_metadata_t* other, size_t entryCapacity, size_t dataCapacity);
+
     /**
      * Append metadata from another CameraMetadata object.
      */
@@ -115,6 +125,11 @@ class CameraMetadata {
      */
     size_t entryCount() const;
 
+    /**
+     * Bytes of entry data stored out of the entries.
+     */
+    size_t dataCount() const;
+
     /**
      * Is the buffer empty (no entires)
      */
@@ -127,8 +142,9 @@ class CameraMetadata {
 
     /**
      * Update metadata entry. Will create entry if it doesn't exist already, and
-     * will reallocate the buffer if insufficient space exists. Overloaded for
-     * the various types of valid data.
+     * will reallocate the buffer if insufficient space exists. Existing entries
+     * are updated in place when the new data is no larger. Overloaded for the
+     * various types of valid data.
      */
     status_t update(uint32_t tag,
             const uint8_t *data, size_t data_count);
@@ -194,12 +210,15 @@ class CameraMetadata {
      * Find tag id for a given tag name, also checking vendor tags if available.
      * On success, returns OK and writes the tag id into tag.
      *
-     * This is a slow method.
+     * Fully qualified names are looked up by hash; the others take a slow scan.
      */
     static status_t getTagFromName(const char *name,
             const VendorTagDescriptor* vTags, uint32_t *tag);
 
   private:
+    // Fully qualified name to tag id of the android.* tags, built at the first use
+    static const std::unordered_map<std::string, uint32_t>& getAndroidTagsByName();
+
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
@@ -37,6 +37,9 @@ namespace helper {
 //  std::unique_ptr<ExifUtils> utils(ExifUtils::Create());
 //  utils->initialize();
 //  ...
+//  // Optionally, keep the tags set so far for the next images.
+//  utils->saveTemplate();
+//  ...
 //  // Call ExifUtils functions to set Exif tags.
 //  ...
 //  utils->GenerateApp1(thumbnail_buffer, thumbnail_size);
@@ -51,9 +54,15 @@ class ExifUtils {
     static ExifUtils* create();
 
     // Initialize() can be called multiple times. The setting of Exif tags will be
-    // cleared.
+    // cleared, back to the saved template if any.
     virtual bool initialize() = 0;
 
+    // Saves the tags set since Initialize() as a template that the next
+    // Initialize() calls start from, for the tags that are the same for all the
+    // images of a camera. The template is serialized once here.
+    // Returns false if serializing the tags fails.
+    virtual bool saveTemplate() = 0;
+
     // Set all known fields from a metadata structure
     virtual bool setFromMetadata(const CameraMetadata& metadata,
                                  const size_t imageWidth,
@@ -22,6 +22,8 @@
 #include <android/hardware/graphics/mapper/4.0/IMapper.h>
 #include <cutils/native_handle.h>
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <unordered_map>
 
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
@@ -58,9 +60,27 @@ public:
 
     int unlock(buffer_handle_t& buf); // returns release fence
 
+    struct MapperCallStats {
+        uint64_t count = 0;
+        nsecs_t totalTimeNs = 0;
+        nsecs_t maxTimeNs = 0;
+    };
+
+    // Graphics mapper calls made by this importer so far
+    struct MapperStats {
+        MapperCallStats importBuffer;
+        MapperCallStats lock;
+        MapperCallStats unlock;
+        // lockYCbCr calls that reused the plane layouts of an imported buffer
+        uint64_t planeLayoutCacheHits = 0;
+    };
+
+    MapperStats getMapperStats();
+
 private:
     void initializeLocked();
     void cleanup();
+    void recordMapperCall(MapperCallStats* stats, nsecs_t startTime);
 
     template<class M, class E>
     bool importBufferInternal(const sp<M> mapper, buffer_handle_t& handle);
@@ -75,6 +95,26 @@ private:
     sp<IMapper> mMapperV2;
     sp<graphics::mapper::V3_0::IMapper> mMapperV3;
     sp<graphics::mapper::V4_0::IMapper> mMapperV4;
+
+    // Where the planes of a buffer are from its mapped address, or -1 for missing planes
+    struct YCbCrOffsets {
+        bool valid = false;
+        ssize_t y = -1;
+        ssize_t cb = -1;
+        ssize_t cr = -1;
+        uint32_t yStride = 0;
+        uint32_t cStride = 0;
+        uint32_t chromaStep = 0;
+    };
+
+    // Plane offsets of the buffers imported from mapper 4.0, read from their plane layouts at
+    // their first lockYCbCr and kept until freeBuffer since they do not change for the life of
+    // a buffer
+    std::unordered_map<buffer_handle_t, YCbCrOffsets> mYCbCrOffsets;
+
+    // unlock() does not hold mLock, so the stats have a lock of their own
+    Mutex mStatsLock;
+    MapperStats mStats;
 };
 
 } // namespace helper
@@ -24,6 +24,7 @@
 #include <system/camera_vendor_tags.h>
 
 #include <stdint.h>
+#include <string>
 #include <unordered_map>
 
 namespace android {
@@ -86,6 +87,13 @@ class VendorTagDescriptor {
          */
         status_t lookupTag(const String8& name, const String8& section, /*out*/uint32_t* tag) const;
 
+        /**
+         * Lookup the tag id for a fully qualified tag name, i.e. "<section>.<name>".
+         *
+         * Returns OK on success, or NAME_NOT_FOUND.
+         */
+        status_t lookupTag(const char* fullName, /*out*/uint32_t* tag) const;
+
         /**
          * Dump the currently configured vendor tags to a file descriptor.
          */
@@ -97,6 +105,9 @@ class VendorTagDescriptor {
         KeyedVector<uint32_t, uint32_t> mTagToSectionMap; // Value is offset in mSections
 
         std::unordered_map<uint32_t, int32_t> mTagToTypeMap;
+        // Fully qualified tag name to tag id. Where two sections yield the same name, the tag
+        // of the longer section wins as in CameraMetadata::getTagFromName.
+        std::unordered_map<std::string, uint32_t> mFullNameToTagMap;
         SortedVector<String8> mSections;
         // must be int32_t to be compatible with Parcel::writeInt32
         int32_t mTagCount;
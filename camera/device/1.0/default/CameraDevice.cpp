@@ -119,6 +119,7 @@ CameraDevice::~CameraDevice() {
         closeLocked();
     }
     mHalPreviewWindow.cleanUpCirculatingBuffers();
+    clearHeapPool();
 }
 
 
@@ -302,8 +303,7 @@ CameraDevice::CameraHeapMemory::CameraHeapMemory(
         mNumBufs(num_buffers) {
     mHidlHandle = native_handle_create(1,0);
     mHidlHandle->data[0] = fcntl(fd, F_DUPFD_CLOEXEC, 0);
-    const size_t pagesize = getpagesize();
-    size_t size = ((buf_size * num_buffers + pagesize-1) & ~(pagesize-1));
+    size_t size = getHeapSize(buf_size, num_buffers);
     mHidlHeap = hidl_memory("ashmem", mHidlHandle, size);
     commonInitialization();
 }
@@ -313,8 +313,7 @@ CameraDevice::CameraHeapMemory::CameraHeapMemory(
     size_t buf_size, uint_t num_buffers) :
         mBufSize(buf_size),
         mNumBufs(num_buffers) {
-    const size_t pagesize = getpagesize();
-    size_t size = ((buf_size * num_buffers + pagesize-1) & ~(pagesize-1));
+    size_t size = getHeapSize(buf_size, num_buffers);
     ashmemAllocator->allocate(size,
         [&](bool success, const hidl_memory& mem) {
             if (!success) {
@@ -346,6 +345,11 @@ void CameraDevice::CameraHeapMemory::commonInitialization() {
     handle.release = sPutMemory;
 }
 
+size_t CameraDevice::CameraHeapMemory::getHeapSize(size_t buf_size, uint_t num_buffers) {
+    const size_t pagesize = getpagesize();
+    return ((buf_size * num_buffers + pagesize-1) & ~(pagesize-1));
+}
+
 CameraDevice::CameraHeapMemory::~CameraHeapMemory() {
     if (mHidlHeapMemory != nullptr) {
         mHidlHeapMemData = nullptr;
@@ -367,13 +371,20 @@ camera_memory_t* CameraDevice::sGetMemory(int fd, size_t buf_size, uint_t num_bu
         return nullptr;
     }
 
-    CameraHeapMemory* mem;
+    CameraHeapMemory* mem = nullptr;
     if (fd < 0) {
-        mem = new CameraHeapMemory(object->mAshmemAllocator, buf_size, num_bufs);
-    } else {
-        mem = new CameraHeapMemory(fd, buf_size, num_bufs);
+        Mutex::Autolock _l(object->mMemoryMapLock);
+        mem = object->takePooledHeapLocked(buf_size, num_bufs);
+    }
+    if (mem == nullptr) {
+        if (fd < 0) {
+            mem = new CameraHeapMemory(object->mAshmemAllocator, buf_size, num_bufs);
+            mem->mPoolable = true;
+        } else {
+            mem = new CameraHeapMemory(fd, buf_size, num_bufs);
+        }
+        mem->incStrong(mem);
     }
-    mem->incStrong(mem);
     hidl_handle hidlHandle = mem->mHidlHandle;
     MemoryId id = object->mDeviceCallback->registerMemory(hidlHandle, buf_size, num_bufs);
     mem->handle.mId = id;
@@ -407,10 +418,50 @@ void CameraDevice::sPutMemory(camera_memory_t *data) {
     {
         Mutex::Autolock _l(device->mMemoryMapLock);
         device->mMemoryMap.erase(mem->handle.mId);
+        if (device->poolHeapLocked(mem)) {
+            return;
+        }
     }
     mem->decStrong(mem);
 }
 
+CameraDevice::CameraHeapMemory* CameraDevice::takePooledHeapLocked(
+        size_t buf_size, uint_t num_bufs) {
+    auto it = mHeapPool.find(CameraHeapMemory::getHeapSize(buf_size, num_bufs));
+    if (it == mHeapPool.end() || it->second.empty()) {
+        return nullptr;
+    }
+    CameraHeapMemory* mem = it->second.back();
+    it->second.pop_back();
+    mNumPooledHeaps--;
+
+    mem->mBufSize = buf_size;
+    mem->mNumBufs = num_bufs;
+    mem->handle.size = buf_size * num_bufs;
+    return mem;
+}
+
+bool CameraDevice::poolHeapLocked(CameraHeapMemory* mem) {
+    if (!mem->mPoolable || mem->mHidlHeapMemory == nullptr ||
+            mNumPooledHeaps == kMaxPooledHeaps) {
+        return false;
+    }
+    mHeapPool[mem->mHidlHeap.size()].push_back(mem);
+    mNumPooledHeaps++;
+    return true;
+}
+
+void CameraDevice::clearHeapPool() {
+    Mutex::Autolock _l(mMemoryMapLock);
+    for (auto& bucket : mHeapPool) {
+        for (CameraHeapMemory* mem : bucket.second) {
+            mem->decStrong(mem);
+        }
+    }
+    mHeapPool.clear();
+    mNumPooledHeaps = 0;
+}
+
 // Callback forwarding methods
 void CameraDevice::sNotifyCb(int32_t msg_type, int32_t ext1, int32_t ext2, void *user) {
     ALOGV("%s", __FUNCTION__);
@@ -1063,6 +1114,8 @@ void CameraDevice::closeLocked() {
         }
         mDevice = nullptr;
     }
+    // The camera HAL has released all its memory by now
+    clearHeapPool();
 }
 
 }  // namespace implementation
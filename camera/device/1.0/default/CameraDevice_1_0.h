@@ -18,6 +18,7 @@
 #define ANDROID_HARDWARE_CAMERA_DEVICE_V1_0_CAMERADEVICE_H
 
 #include <unordered_map>
+#include <vector>
 #include "utils/Mutex.h"
 #include "utils/SortedVector.h"
 #include "CameraModule.h"
@@ -126,8 +127,14 @@ private:
         void commonInitialization();
         virtual ~CameraHeapMemory();
 
+        // Size of the shared memory of num_buffers buffers, rounded up to whole pages
+        static size_t getHeapSize(size_t buf_size, uint_t num_buffers);
+
         size_t mBufSize;
         uint_t mNumBufs;
+        // Allocated by the HAL service rather than wrapping a camera HAL FD, so that the memory
+        // can be kept for the next request of the same heap size once released
+        bool mPoolable = false;
 
         // Shared memory related members
         hidl_memory      mHidlHeap;
@@ -178,6 +185,16 @@ private:
                                   // must not hold mLock after this lock is acquired
     std::unordered_map<MemoryId, CameraHeapMemory*> mMemoryMap;
 
+    // Shared memory released by the camera HAL, by heap size, also gated by mMemoryMapLock.
+    // Legacy HALs get a memory per preview callback and release it once the callback returns;
+    // the pooled ones are registered again with the client instead of allocated and mapped.
+    static const size_t kMaxPooledHeaps = 8;
+    std::unordered_map<size_t, std::vector<CameraHeapMemory*>> mHeapPool;
+    size_t mNumPooledHeaps = 0;
+    CameraHeapMemory* takePooledHeapLocked(size_t buf_size, uint_t num_bufs);
+    bool poolHeapLocked(CameraHeapMemory* mem);
+    void clearHeapPool();
+
     bool mMetadataMode = false;
 
     mutable Mutex mBatchLock;
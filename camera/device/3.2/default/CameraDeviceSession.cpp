@@ -396,6 +396,46 @@ bool CameraDeviceSession::ResultBatcher::InflightBatch::allDelivered() const {
     return true;
 }
 
+void CameraDeviceSession::ResultBatcher::InflightBatch::reset(
+        uint32_t firstFrame, uint32_t batchSize, uint32_t numPartialResults,
+        const std::vector<int>& streamsToBatch) {
+    mFirstFrame = firstFrame;
+    mBatchSize = batchSize;
+    mLastFrame = mFirstFrame + mBatchSize - 1;
+
+    mShutterDelivered = false;
+    mShutterMsgs.clear();
+    mShutterMsgs.reserve(batchSize);
+
+    bool sameStreams = mBatchBufs.size() == streamsToBatch.size();
+    for (int id : streamsToBatch) {
+        auto it = mBatchBufs.find(id);
+        if (it == mBatchBufs.end()) {
+            sameStreams = false;
+            break;
+        }
+        it->second.mDelivered = false;
+        it->second.mBuffers.clear();
+    }
+    if (!sameStreams) {
+        mBatchBufs.clear();
+        for (int id : streamsToBatch) {
+            mBatchBufs.emplace(id, batchSize);
+        }
+    }
+
+    mNumPartialResults = numPartialResults;
+    mPartialResultProgress = 0;
+    mResultMds.resize(numPartialResults);
+    for (auto& mb : mResultMds) {
+        mb.mMds.clear();
+        mb.mMds.reserve(batchSize);
+    }
+    mMdArena.clear();
+
+    mRemoved = false;
+}
+
 void CameraDeviceSession::ResultBatcher::setNumPartialResults(uint32_t n) {
     Mutex::Autolock _l(mLock);
     mNumPartialResults = n;
@@ -414,18 +454,32 @@ void CameraDeviceSession::ResultBatcher::setResultMetadataQueue(
 }
 
 void CameraDeviceSession::ResultBatcher::registerBatch(uint32_t frameNumber, uint32_t batchSize) {
-    auto batch = std::make_shared<InflightBatch>();
-    batch->mFirstFrame = frameNumber;
-    batch->mBatchSize = batchSize;
-    batch->mLastFrame = batch->mFirstFrame + batch->mBatchSize - 1;
-    batch->mNumPartialResults = mNumPartialResults;
-    for (int id : mStreamsToBatch) {
-        batch->mBatchBufs.emplace(id, batch->mBatchSize);
-    }
     Mutex::Autolock _l(mLock);
+    std::shared_ptr<InflightBatch> batch;
+    for (auto it = mFreeBatches.begin(); it != mFreeBatches.end(); it++) {
+        // A removed batch may still be held by a result or notify racing with its removal
+        if (it->use_count() == 1) {
+            batch = std::move(*it);
+            mFreeBatches.erase(it);
+            break;
+        }
+    }
+    if (batch == nullptr) {
+        batch = std::make_shared<InflightBatch>();
+    }
+    {
+        Mutex::Autolock _l(batch->mLock);
+        batch->reset(frameNumber, batchSize, mNumPartialResults, mStreamsToBatch);
+    }
     mInflightBatches.push_back(batch);
 }
 
+void CameraDeviceSession::ResultBatcher::recycleBatchLocked(std::shared_ptr<InflightBatch> batch) {
+    if (mFreeBatches.size() < kMaxFreeBatches) {
+        mFreeBatches.push_back(std::move(batch));
+    }
+}
+
 std::pair<int, std::shared_ptr<CameraDeviceSession::ResultBatcher::InflightBatch>>
 CameraDeviceSession::ResultBatcher::getBatch(
         uint32_t frameNumber) {
@@ -462,6 +516,7 @@ void CameraDeviceSession::ResultBatcher::checkAndRemoveFirstBatch() {
         }
         if (shouldRemove) {
             mInflightBatches.pop_front();
+            recycleBatchLocked(batch);
         }
     }
 }
@@ -607,6 +662,24 @@ void CameraDeviceSession::ResultBatcher::sendBatchBuffersLocked(
     }
 }
 
+void CameraDeviceSession::ResultBatcher::queueBatchMetadataLocked(
+        std::shared_ptr<InflightBatch> batch, uint32_t frameNumber, uint32_t partialResult,
+        const CameraMetadata& metadata) {
+    if (partialResult == 0) {
+        ALOGE("%s: frame %u has metadata in a buffer only result!", __FUNCTION__, frameNumber);
+        return;
+    }
+    if (partialResult > batch->mResultMds.size()) {
+        ALOGW("%s: frame %u partial result %u is over the %u partial results",
+                __FUNCTION__, frameNumber, partialResult, batch->mNumPartialResults);
+        batch->mResultMds.resize(partialResult);
+    }
+    size_t offset = batch->mMdArena.size();
+    batch->mMdArena.insert(batch->mMdArena.end(), metadata.data(),
+            metadata.data() + metadata.size());
+    batch->mResultMds[partialResult - 1].mMds.push_back({frameNumber, offset, metadata.size()});
+}
+
 void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
     std::shared_ptr<InflightBatch> batch, uint32_t lastPartialResultIdx) {
     if (lastPartialResultIdx <= batch->mPartialResultProgress) {
@@ -615,35 +688,36 @@ void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
         return;
     }
 
-    std::vector<CaptureResult> results;
-    std::vector<uint32_t> toBeRemovedIdxes;
-    for (auto& pair : batch->mResultMds) {
-        uint32_t partialIdx = pair.first;
-        if (partialIdx > lastPartialResultIdx) {
-            continue;
-        }
-        toBeRemovedIdxes.push_back(partialIdx);
-        InflightBatch::MetadataBatch& mb = pair.second;
-        for (const auto& p : mb.mMds) {
-            CaptureResult result;
-            result.frameNumber = p.first;
-            result.result = std::move(p.second);
+    size_t numResults = 0;
+    for (uint32_t partialIdx = 1;
+            partialIdx <= lastPartialResultIdx && partialIdx <= batch->mResultMds.size();
+            partialIdx++) {
+        numResults += batch->mResultMds[partialIdx - 1].mMds.size();
+    }
+    // The results point into mMdArena, which is not modified until the callback returns as the
+    // batch lock is held. invokeProcessCaptureResultCallback then copies the metadata straight
+    // from it into the result FMQ.
+    hidl_vec<CaptureResult> results;
+    results.resize(numResults);
+    size_t i = 0;
+    for (uint32_t partialIdx = 1;
+            partialIdx <= lastPartialResultIdx && partialIdx <= batch->mResultMds.size();
+            partialIdx++) {
+        InflightBatch::MetadataBatch& mb = batch->mResultMds[partialIdx - 1];
+        for (const auto& md : mb.mMds) {
+            CaptureResult& result = results[i++];
+            result.frameNumber = md.frameNumber;
+            result.result.setToExternal(batch->mMdArena.data() + md.offset, md.size);
             result.fmqResultSize = 0;
             result.inputBuffer.streamId = -1;
             result.inputBuffer.bufferId = 0;
             result.inputBuffer.buffer = nullptr;
             result.partialResult = partialIdx;
-            results.push_back(std::move(result));
         }
         mb.mMds.clear();
     }
-    hidl_vec<CaptureResult> hResults;
-    hResults.setToExternal(results.data(), results.size());
-    invokeProcessCaptureResultCallback(hResults, /* tryWriteFmq */true);
+    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
     batch->mPartialResultProgress = lastPartialResultIdx;
-    for (uint32_t partialIdx : toBeRemovedIdxes) {
-        batch->mResultMds.erase(partialIdx);
-    }
 }
 
 void CameraDeviceSession::ResultBatcher::notifySingleMsg(NotifyMsg& msg) {
@@ -688,6 +762,7 @@ void CameraDeviceSession::ResultBatcher::notify(NotifyMsg& msg) {
                 batch->mRemoved = true;
             }
             mInflightBatches.pop_front();
+            recycleBatchLocked(batch);
         }
         // Send the error up
         notifySingleMsg(msg);
@@ -778,9 +853,8 @@ void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& res
 
         // queue metadata
         if (result.result.size() != 0) {
-            // Save a copy of metadata
-            batch->mResultMds[result.partialResult].mMds.push_back(
-                    std::make_pair(result.frameNumber, result.result));
+            queueBatchMetadataLocked(batch, result.frameNumber, result.partialResult,
+                    result.result);
         }
 
         // queue buffer
@@ -204,6 +204,11 @@ protected:
 
             bool allDelivered() const;
 
+            // Prepare a new or reused batch for the given frames, keeping the capacity of its
+            // containers
+            void reset(uint32_t firstFrame, uint32_t batchSize, uint32_t numPartialResults,
+                    const std::vector<int>& streamsToBatch);
+
             uint32_t mFirstFrame;
             uint32_t mLastFrame;
             uint32_t mBatchSize;
@@ -225,14 +230,22 @@ protected:
             std::unordered_map<int, BufferBatch> mBatchBufs;
 
             struct MetadataBatch {
-                //                   (frameNumber, metadata)
-                std::vector<std::pair<uint32_t, CameraMetadata>> mMds;
+                struct Metadata {
+                    uint32_t frameNumber;
+                    // Location of the metadata in mMdArena
+                    size_t offset;
+                    size_t size;
+                };
+                std::vector<Metadata> mMds;
             };
             // Partial result IDs that has been delivered to framework
             uint32_t mNumPartialResults;
             uint32_t mPartialResultProgress = 0;
-            // partialResult -> MetadataBatch
-            std::map<uint32_t, MetadataBatch> mResultMds;
+            // partialResult - 1 -> MetadataBatch, sized by mNumPartialResults
+            std::vector<MetadataBatch> mResultMds;
+            // The batched metadata, copied out of the HAL results and sent up from here without
+            // further copies. Its capacity is kept when the batch is reused.
+            std::vector<uint8_t> mMdArena;
 
             // Set to true when batch is removed from mInflightBatches
             // processCaptureResult and notify must check this flag after acquiring mLock to make
@@ -256,6 +269,11 @@ protected:
         void moveStreamBuffer(StreamBuffer&& src, StreamBuffer& dst);
         void pushStreamBuffer(StreamBuffer&& src, std::vector<StreamBuffer>& dst);
 
+        // Copy the metadata of a frame into the batch. Must be called while the
+        // InflightBatch::mLock is locked
+        void queueBatchMetadataLocked(std::shared_ptr<InflightBatch> batch,
+                uint32_t frameNumber, uint32_t partialResult, const CameraMetadata& metadata);
+
         void sendBatchMetadataLocked(
                 std::shared_ptr<InflightBatch> batch, uint32_t lastPartialResultIdx);
 
@@ -284,6 +302,11 @@ protected:
         // Do NOT issue HIDL IPCs while holding this lock (except when HAL reports error)
         mutable Mutex mLock;
         std::deque<std::shared_ptr<InflightBatch>> mInflightBatches;
+        // Batches removed from mInflightBatches, reused by registerBatch once no other thread holds
+        // them so that steady-state batching does not allocate
+        static const size_t kMaxFreeBatches = 8;
+        std::vector<std::shared_ptr<InflightBatch>> mFreeBatches;
+        void recycleBatchLocked(std::shared_ptr<InflightBatch> batch);
         uint32_t mNumPartialResults;
         std::vector<int> mStreamsToBatch;
         const sp<ICameraDeviceCallback> mCallback;
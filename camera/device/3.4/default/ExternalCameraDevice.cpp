@@ -26,6 +26,7 @@
 #include "CameraMetadata.h"
 #include "../../3.2/default/include/convert.h"
 #include "ExternalCameraDevice_3_4.h"
+#include "ExternalCameraProbeCache.h"
 
 namespace android {
 namespace hardware {
@@ -35,13 +36,6 @@ namespace V3_4 {
 namespace implementation {
 
 namespace {
-// Only support MJPEG for now as it seems to be the one supports higher fps
-// Other formats to consider in the future:
-// * V4L2_PIX_FMT_YVU420 (== YV12)
-// * V4L2_PIX_FMT_YVYU (YVYU: can be converted to YV12 or other YUV420_888 formats)
-const std::array<uint32_t, /*size*/ 2> kSupportedFourCCs{
-    {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_Z16}};  // double braces required in C++11
-
 constexpr int MAX_RETRY = 5; // Allow retry v4l2 open failures a few times.
 constexpr int OPEN_RETRY_SLEEP_US = 100000; // 100ms * MAX_RETRY = 0.5 seconds
 
@@ -762,48 +756,31 @@ status_t ExternalCameraDevice::initOutputCharsKeys(
 #undef UPDATE
 
 void ExternalCameraDevice::getFrameRateList(
-        int fd, double fpsUpperBound, SupportedV4L2Format* format) {
-    format->frameRates.clear();
-
-    v4l2_frmivalenum frameInterval{
-            .index = 0,
-            .pixel_format = format->fourcc,
-            .width = format->width,
-            .height = format->height,
-    };
-
-    for (frameInterval.index = 0;
-            TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frameInterval)) == 0;
-            ++frameInterval.index) {
-        if (frameInterval.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
-            if (frameInterval.discrete.numerator != 0) {
-                SupportedV4L2Format::FrameRate fr = {
-                        frameInterval.discrete.numerator,
-                        frameInterval.discrete.denominator};
-                double framerate = fr.getDouble();
-                if (framerate > fpsUpperBound) {
-                    continue;
-                }
-                ALOGV("index:%d, format:%c%c%c%c, w %d, h %d, framerate %f",
-                    frameInterval.index,
-                    frameInterval.pixel_format & 0xFF,
-                    (frameInterval.pixel_format >> 8) & 0xFF,
-                    (frameInterval.pixel_format >> 16) & 0xFF,
-                    (frameInterval.pixel_format >> 24) & 0xFF,
-                    frameInterval.width, frameInterval.height, framerate);
-                format->frameRates.push_back(fr);
-            }
+        double fpsUpperBound, SupportedV4L2Format* format) {
+    std::vector<SupportedV4L2Format::FrameRate> frameRates;
+    for (const auto& fr : format->frameRates) {
+        double framerate = fr.getDouble();
+        if (framerate > fpsUpperBound) {
+            continue;
         }
+        ALOGV("format:%c%c%c%c, w %d, h %d, framerate %f",
+            format->fourcc & 0xFF,
+            (format->fourcc >> 8) & 0xFF,
+            (format->fourcc >> 16) & 0xFF,
+            (format->fourcc >> 24) & 0xFF,
+            format->width, format->height, framerate);
+        frameRates.push_back(fr);
     }
+    format->frameRates = frameRates;
 
     if (format->frameRates.empty()) {
         ALOGE("%s: failed to get supported frame rates for format:%c%c%c%c w %d h %d",
                 __FUNCTION__,
-                frameInterval.pixel_format & 0xFF,
-                (frameInterval.pixel_format >> 8) & 0xFF,
-                (frameInterval.pixel_format >> 16) & 0xFF,
-                (frameInterval.pixel_format >> 24) & 0xFF,
-                frameInterval.width, frameInterval.height);
+                format->fourcc & 0xFF,
+                (format->fourcc >> 8) & 0xFF,
+                (format->fourcc >> 16) & 0xFF,
+                (format->fourcc >> 24) & 0xFF,
+                format->width, format->height);
     }
 }
 
@@ -858,73 +835,36 @@ void ExternalCameraDevice::trimSupportedFormats(
 }
 
 std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedFormatsLocked(
-    int fd, CroppingType cropType,
+    const std::vector<SupportedV4L2Format>& probedFormats, CroppingType cropType,
     const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
     const std::vector<ExternalCameraConfig::FpsLimitation>& depthFpsLimits,
     const Size& minStreamSize,
     bool depthEnabled) {
     std::vector<SupportedV4L2Format> outFmts;
-    struct v4l2_fmtdesc fmtdesc {
-        .index = 0,
-        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
-    int ret = 0;
-    while (ret == 0) {
-        ret = TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc));
-        ALOGV("index:%d,ret:%d, format:%c%c%c%c", fmtdesc.index, ret,
-                fmtdesc.pixelformat & 0xFF,
-                (fmtdesc.pixelformat >> 8) & 0xFF,
-                (fmtdesc.pixelformat >> 16) & 0xFF,
-                (fmtdesc.pixelformat >> 24) & 0xFF);
-        if (ret == 0 && !(fmtdesc.flags & V4L2_FMT_FLAG_EMULATED)) {
-            auto it = std::find (
-                    kSupportedFourCCs.begin(), kSupportedFourCCs.end(), fmtdesc.pixelformat);
-            if (it != kSupportedFourCCs.end()) {
-                // Found supported format
-                v4l2_frmsizeenum frameSize {
-                        .index = 0,
-                        .pixel_format = fmtdesc.pixelformat};
-                for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frameSize)) == 0;
-                        ++frameSize.index) {
-                    if (frameSize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-                        ALOGV("index:%d, format:%c%c%c%c, w %d, h %d", frameSize.index,
-                            fmtdesc.pixelformat & 0xFF,
-                            (fmtdesc.pixelformat >> 8) & 0xFF,
-                            (fmtdesc.pixelformat >> 16) & 0xFF,
-                            (fmtdesc.pixelformat >> 24) & 0xFF,
-                            frameSize.discrete.width, frameSize.discrete.height);
-                        // Disregard h > w formats so all aspect ratio (h/w) <= 1.0
-                        // This will simplify the crop/scaling logic down the road
-                        if (frameSize.discrete.height > frameSize.discrete.width) {
-                            continue;
-                        }
-                        // Discard all formats which is smaller than minStreamSize
-                        if (frameSize.discrete.width < minStreamSize.width
-                            || frameSize.discrete.height < minStreamSize.height) {
-                            continue;
-                        }
-                        SupportedV4L2Format format {
-                            .width = frameSize.discrete.width,
-                            .height = frameSize.discrete.height,
-                            .fourcc = fmtdesc.pixelformat
-                        };
-
-                        if (format.fourcc == V4L2_PIX_FMT_Z16 && depthEnabled) {
-                            updateFpsBounds(fd, cropType, depthFpsLimits, format, outFmts);
-                        } else {
-                            updateFpsBounds(fd, cropType, fpsLimits, format, outFmts);
-                        }
-                    }
-                }
-            }
+    for (const auto& format : probedFormats) {
+        // Disregard h > w formats so all aspect ratio (h/w) <= 1.0
+        // This will simplify the crop/scaling logic down the road
+        if (format.height > format.width) {
+            continue;
+        }
+        // Discard all formats which is smaller than minStreamSize
+        if (format.width < minStreamSize.width
+            || format.height < minStreamSize.height) {
+            continue;
+        }
+
+        if (format.fourcc == V4L2_PIX_FMT_Z16 && depthEnabled) {
+            updateFpsBounds(cropType, depthFpsLimits, format, outFmts);
+        } else {
+            updateFpsBounds(cropType, fpsLimits, format, outFmts);
         }
-        fmtdesc.index++;
     }
     trimSupportedFormats(cropType, &outFmts);
     return outFmts;
 }
 
 void ExternalCameraDevice::updateFpsBounds(
-    int fd, CroppingType cropType,
+    CroppingType cropType,
     const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits, SupportedV4L2Format format,
     std::vector<SupportedV4L2Format>& outFmts) {
     double fpsUpperBound = -1.0;
@@ -945,17 +885,26 @@ void ExternalCameraDevice::updateFpsBounds(
         return;
     }
 
-    getFrameRateList(fd, fpsUpperBound, &format);
+    getFrameRateList(fpsUpperBound, &format);
     if (!format.frameRates.empty()) {
         outFmts.push_back(format);
     }
 }
 
 void ExternalCameraDevice::initSupportedFormatsLocked(int fd) {
+    std::vector<SupportedV4L2Format> probedFmts;
+    ExternalCameraProbeCache& probeCache = ExternalCameraProbeCache::getInstance();
+    if (!probeCache.lookup(mDevicePath, mCfg.probeCacheDir, &probedFmts)) {
+        probedFmts = ExternalCameraProbeCache::probe(fd);
+        probeCache.store(mDevicePath, mCfg.probeCacheDir, probedFmts);
+    }
+
     std::vector<SupportedV4L2Format> horizontalFmts = getCandidateSupportedFormatsLocked(
-        fd, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize, mCfg.depthEnabled);
+        probedFmts, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize,
+        mCfg.depthEnabled);
     std::vector<SupportedV4L2Format> verticalFmts = getCandidateSupportedFormatsLocked(
-        fd, VERTICAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize, mCfg.depthEnabled);
+        probedFmts, VERTICAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize,
+        mCfg.depthEnabled);
 
     size_t horiSize = horizontalFmts.size();
     size_t vertSize = verticalFmts.size();
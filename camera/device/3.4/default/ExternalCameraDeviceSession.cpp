@@ -18,14 +18,18 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 #include <log/log.h>
 
+#include <algorithm>
 #include <inttypes.h>
 #include "ExternalCameraDeviceSession.h"
 
 #include "android-base/macros.h"
+#include <halmetrics/Metrics.h>
 #include <utils/Timers.h>
 #include <utils/Trace.h>
 #include <linux/videodev2.h>
 #include <sync/sync.h>
+#include <ion/ion.h>
+#include <sys/mman.h>
 
 #define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -81,6 +85,13 @@ bool tryLock(std::mutex& mutex)
     return locked;
 }
 
+void dumpLatency(int fd, const char* name, const metrics::Histogram& latency) {
+    const uint64_t count = latency.count();
+    dprintf(fd, "%s: %" PRIu64 " samples, mean %" PRIu64 "us, p50 %" PRIu64 "us, p99 %" PRIu64
+            "us, max %" PRIu64 "us\n", name, count, count == 0 ? 0 : latency.sum() / count / 1000,
+            latency.percentile(50) / 1000, latency.percentile(99) / 1000, latency.max() / 1000);
+}
+
 } // Anonymous namespace
 
 // Static instances
@@ -103,6 +114,8 @@ ExternalCameraDeviceSession::ExternalCameraDeviceSession(
         mCroppingType(croppingType),
         mCameraId(cameraId),
         mV4l2Fd(std::move(v4l2Fd)),
+        mNumVideoBuffers(cfg.numVideoBuffers),
+        mNumStillBuffers(cfg.numStillBuffers),
         mMaxThumbResolution(getMaxThumbResolution()),
         mMaxJpegResolution(getMaxJpegResolution()) {}
 
@@ -146,6 +159,7 @@ bool ExternalCameraDeviceSession::initialize() {
         return true;
     }
     mOutputThread->setExifMakeModel(mExifMake, mExifModel);
+    mOutputThread->setScaleFilter(mCfg.scaleFilter);
 
     status_t status = initDefaultRequests();
     if (status != OK) {
@@ -176,6 +190,10 @@ bool ExternalCameraDeviceSession::isInitFailed() {
     if (!mInitialized) {
         mInitFail = initialize();
         mInitialized = true;
+        if (!mInitFail) {
+            registerOpenSession();
+            mCountedAsOpen = true;
+        }
     }
     return mInitFail;
 }
@@ -286,6 +304,31 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
                 v4L2BufferCount, numDequeuedV4l2Buffers);
     }
 
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        dprintf(fd, "V4L2 buffer waits %" PRIu64 ", total %" PRIu64 "ms, dropped frames %" PRIu64
+                "\n", mV4l2Starvation.count(), mV4l2Starvation.sum() / 1000000,
+                mNumDroppedV4l2Frames);
+    }
+    dumpLatency(fd, "V4L2 buffer wait", mV4l2Starvation);
+
+    static const char* kStageNames[NUM_LATENCY_STAGES] = {
+            "queue", "decode", "convert", "jpeg", "result", "total"};
+    for (size_t i = 0; i < NUM_LATENCY_STAGES; i++) {
+        dumpLatency(fd, (std::string("Result latency ") + kStageNames[i]).c_str(), mLatency[i]);
+    }
+
+    HandleImporter::MapperStats mapperStats = sHandleImporter.getMapperStats();
+    for (const auto& call : {std::make_pair("import", &mapperStats.importBuffer),
+                             std::make_pair("lock", &mapperStats.lock),
+                             std::make_pair("unlock", &mapperStats.unlock)}) {
+        dprintf(fd, "Mapper %s calls %" PRIu64 ", total %" PRId64 "us, max %" PRId64 "us\n",
+                call.first, call.second->count, call.second->totalTimeNs / 1000,
+                call.second->maxTimeNs / 1000);
+    }
+    dprintf(fd, "Mapper plane layout cache hits %" PRIu64 "\n",
+            mapperStats.planeLayoutCacheHits);
+
     dprintf(fd, "In-flight frames (not sorted):");
     for (const auto& frameNumber : inflightFrames) {
         dprintf(fd, "%d, ", frameNumber);
@@ -294,6 +337,10 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
     mOutputThread->dump(fd);
     dprintf(fd, "\n");
 
+    // Shared with the other HALs of the process, see common/metrics.
+    dprintf(fd, "HAL metrics:\n");
+    metrics::Registry::get().dump(fd);
+
     if (intfLocked) {
         mInterfaceLock.unlock();
     }
@@ -490,13 +537,22 @@ Return<void> ExternalCameraDeviceSession::close(bool callerIsDtor) {
             }
         }
         v4l2StreamOffLocked();
+        freeV4l2DmaBuffersLocked();
         ALOGV("%s: closing V4L2 camera FD %d", __FUNCTION__, mV4l2Fd.get());
         mV4l2Fd.reset();
         mClosed = true;
+        markSessionInactiveLocked();
     }
     return Void();
 }
 
+void ExternalCameraDeviceSession::markSessionInactiveLocked() {
+    if (mCountedAsOpen) {
+        unregisterOpenSession();
+        mCountedAsOpen = false;
+    }
+}
+
 Status ExternalCameraDeviceSession::importRequestLocked(
     const CaptureRequest& request,
     hidl_vec<buffer_handle_t*>& allBufPtrs,
@@ -686,7 +742,7 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
             requestFpsMax = closestFps;
         }
 
-        if (requestFpsMax != mV4l2StreamingFps) {
+        if (requestFpsMax != mV4l2StreamingFps || mV4l2BufferCountChanged) {
             {
                 std::unique_lock<std::mutex> lk(mV4l2BufferLock);
                 while (mNumDequeuedV4l2Buffers != 0) {
@@ -700,6 +756,18 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
             }
             configureV4l2StreamLocked(mV4l2StreamingFmt, requestFpsMax);
         }
+    } else if (mV4l2BufferCountChanged) {
+        {
+            std::unique_lock<std::mutex> lk(mV4l2BufferLock);
+            while (mNumDequeuedV4l2Buffers != 0) {
+                int waitRet = waitForV4L2BufferReturnLocked(lk);
+                if (waitRet != 0) {
+                    ALOGE("%s: wait for pipeline idle failed!", __FUNCTION__);
+                    return Status::INTERNAL_ERROR;
+                }
+            }
+        }
+        configureV4l2StreamLocked(mV4l2StreamingFmt, mV4l2StreamingFps);
     }
 
     status = importRequestLocked(request, allBufPtrs, allFences);
@@ -716,9 +784,10 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
 
     std::shared_ptr<HalRequest> halReq = std::make_shared<HalRequest>();
     halReq->frameNumber = request.frameNumber;
-    halReq->setting = mLatestReqSetting;
+    prepareResultMetadata(&halReq->setting);
     halReq->frameIn = frameIn;
     halReq->shutterTs = shutterTs;
+    halReq->dequeueTime = systemTime(SYSTEM_TIME_MONOTONIC);
     halReq->buffers.resize(numOutputBufs);
     for (size_t i = 0; i < numOutputBufs; i++) {
         HalStreamBuffer& halBuf = halReq->buffers[i];
@@ -880,9 +949,50 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     // Callback into framework
     invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
     freeReleaseFences(results);
+    recordLatency(req);
+    recycleResultMetadata(&req->setting);
     return Status::OK;
 }
 
+void ExternalCameraDeviceSession::recordLatency(const std::shared_ptr<HalRequest>& req) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mLatency[STAGE_QUEUE].record(req->processStartTime - req->dequeueTime);
+    mLatency[STAGE_DECODE].record(req->decodeDoneTime - req->processStartTime);
+    mLatency[STAGE_CONVERT].record(req->convertDoneTime - req->decodeDoneTime);
+    mLatency[STAGE_JPEG].record(req->jpegDoneTime - req->convertDoneTime);
+    mLatency[STAGE_RESULT].record(now - req->jpegDoneTime);
+    mLatency[STAGE_TOTAL].record(now - req->dequeueTime);
+    HAL_METRICS_RECORD_NS("camera.external.request", now - req->dequeueTime);
+}
+
+void ExternalCameraDeviceSession::prepareResultMetadata(
+        common::V1_0::helper::CameraMetadata* setting) {
+    size_t entryCount, dataCount;
+    {
+        std::lock_guard<std::mutex> lk(mResultMetadataLock);
+        if (!mFreeResultMetadata.empty()) {
+            setting->swap(mFreeResultMetadata.back());
+            mFreeResultMetadata.pop_back();
+        }
+        entryCount = mResultEntryCount;
+        dataCount = mResultDataCount;
+    }
+    setting->assign(mLatestReqSetting, entryCount, dataCount);
+}
+
+void ExternalCameraDeviceSession::recycleResultMetadata(
+        common::V1_0::helper::CameraMetadata* result) {
+    std::lock_guard<std::mutex> lk(mResultMetadataLock);
+    mResultEntryCount = result->entryCount();
+    mResultDataCount = result->dataCount();
+    if (mFreeResultMetadata.size() < kMaxFreeResultMetadata) {
+        // Swapped in so that the vector never clones a metadata buffer
+        mFreeResultMetadata.reserve(kMaxFreeResultMetadata);
+        mFreeResultMetadata.emplace_back();
+        mFreeResultMetadata.back().swap(*result);
+    }
+}
+
 void ExternalCameraDeviceSession::invokeProcessCaptureResultCallback(
         hidl_vec<CaptureResult> &results, bool tryWriteFmq) {
     if (mProcessCaptureResultLock.tryLock() != OK) {
@@ -921,14 +1031,24 @@ void ExternalCameraDeviceSession::invokeProcessCaptureResultCallback(
 ExternalCameraDeviceSession::OutputThread::OutputThread(
         wp<OutputThreadInterface> parent, CroppingType ct,
         const common::V1_0::helper::CameraMetadata& chars) :
-        mParent(parent), mCroppingType(ct), mCameraCharacteristics(chars) {}
+        mParent(parent), mCroppingType(ct), mCameraCharacteristics(chars),
+        mJpegDecoder(createJpegDecoder()) {}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    stopOutputWorkers();
+}
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
         const std::string& make, const std::string& model) {
+    std::lock_guard<std::mutex> lk(mExifLock);
     mExifMake = make;
     mExifModel = model;
+    mExifUtils.reset();
+}
+
+void ExternalCameraDeviceSession::OutputThread::setScaleFilter(
+        ExternalCameraConfig::ScaleFilter filter) {
+    mScaleFilter = filter;
 }
 
 int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
@@ -969,18 +1089,21 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
     sp<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
-        scaledYu12Buf = it->second;
-    } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
-            ALOGE("%s: failed to find intermediate buffer size %dx%d",
-                    __FUNCTION__, outSz.width, outSz.height);
-            return -1;
+    {
+        std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
+        auto it = mScaledYu12Frames.find(outSz);
+        if (it != mScaledYu12Frames.end()) {
+            scaledYu12Buf = it->second;
+        } else {
+            it = mIntermediateBuffers.find(outSz);
+            if (it == mIntermediateBuffers.end()) {
+                ALOGE("%s: failed to find intermediate buffer size %dx%d",
+                        __FUNCTION__, outSz.width, outSz.height);
+                return -1;
+            }
+            scaledYu12Buf = it->second;
         }
-        scaledYu12Buf = it->second;
     }
     // Scale
     YCbCrLayout outLayout;
@@ -1007,8 +1130,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
             outLayout.cStride,
             outSz.width,
             outSz.height,
-            // TODO: b/72261744 see if we can use better filter without losing too much perf
-            libyuv::FilterMode::kFilterNone);
+            static_cast<libyuv::FilterMode>(mScaleFilter));
 
     if (ret != 0) {
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d",
@@ -1018,6 +1140,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
+    std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
     mScaledYu12Frames.insert({outSz, scaledYu12Buf});
     return 0;
 }
@@ -1155,7 +1278,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
             outFullLayout.cStride,
             outSz.width,
             outSz.height,
-            libyuv::FilterMode::kFilterNone);
+            static_cast<libyuv::FilterMode>(mScaleFilter));
 
     if (ret != 0) {
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d",
@@ -1236,6 +1359,20 @@ ssize_t ExternalCameraDeviceSession::getJpegBufferSize(
 int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         HalStreamBuffer &halBuf,
         const common::V1_0::helper::CameraMetadata& setting)
+{
+    ATRACE_CALL();
+    JpegJob job;
+    int ret = prepareJpegLocked(halBuf, setting, /*copyImages*/false, &job);
+    if (ret != 0) {
+        return ret;
+    }
+    return encodeJpeg(job);
+}
+
+int ExternalCameraDeviceSession::OutputThread::prepareJpegLocked(
+        HalStreamBuffer &halBuf,
+        const common::V1_0::helper::CameraMetadata& setting,
+        bool copyImages, JpegJob* job)
 {
     ATRACE_CALL();
     int ret;
@@ -1260,14 +1397,14 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
           __FUNCTION__,
           mYu12Frame->mWidth, mYu12Frame->mHeight);
 
-    int jpegQuality, thumbQuality;
-    Size thumbSize;
-    bool outputThumbnail = true;
+    job->halBuf = &halBuf;
+    job->setting = &setting;
+    job->outputThumbnail = true;
 
     if (setting.exists(ANDROID_JPEG_QUALITY)) {
         camera_metadata_ro_entry entry =
             setting.find(ANDROID_JPEG_QUALITY);
-        jpegQuality = entry.data.u8[0];
+        job->jpegQuality = entry.data.u8[0];
     } else {
         return lfail("%s: ANDROID_JPEG_QUALITY not set",__FUNCTION__);
     }
@@ -1275,7 +1412,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     if (setting.exists(ANDROID_JPEG_THUMBNAIL_QUALITY)) {
         camera_metadata_ro_entry entry =
             setting.find(ANDROID_JPEG_THUMBNAIL_QUALITY);
-        thumbQuality = entry.data.u8[0];
+        job->thumbQuality = entry.data.u8[0];
     } else {
         return lfail(
             "%s: ANDROID_JPEG_THUMBNAIL_QUALITY not set",
@@ -1285,45 +1422,35 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     if (setting.exists(ANDROID_JPEG_THUMBNAIL_SIZE)) {
         camera_metadata_ro_entry entry =
             setting.find(ANDROID_JPEG_THUMBNAIL_SIZE);
-        thumbSize = Size { static_cast<uint32_t>(entry.data.i32[0]),
+        job->thumbSize = Size { static_cast<uint32_t>(entry.data.i32[0]),
                            static_cast<uint32_t>(entry.data.i32[1])
         };
-        if (thumbSize.width == 0 && thumbSize.height == 0) {
-            outputThumbnail = false;
+        if (job->thumbSize.width == 0 && job->thumbSize.height == 0) {
+            job->outputThumbnail = false;
         }
     } else {
         return lfail(
             "%s: ANDROID_JPEG_THUMBNAIL_SIZE not set", __FUNCTION__);
     }
 
-    /* Cropped and scaled YU12 buffer for main and thumbnail */
-    YCbCrLayout yu12Main;
-    Size jpegSize { halBuf.width, halBuf.height };
+    job->jpegSize = Size { halBuf.width, halBuf.height };
 
     /* Compute temporary buffer sizes accounting for the following:
-     * thumbnail can't exceed APP1 size of 64K
      * main image needs to hold APP1, headers, and at most a poorly
      * compressed image */
-    const ssize_t maxThumbCodeSize = 64 * 1024;
-    const ssize_t maxJpegCodeSize = mBlobBufferSize == 0 ?
-            parent->getJpegBufferSize(jpegSize.width, jpegSize.height) :
+    job->maxJpegCodeSize = mBlobBufferSize == 0 ?
+            parent->getJpegBufferSize(job->jpegSize.width, job->jpegSize.height) :
             mBlobBufferSize;
 
     /* Check that getJpegBufferSize did not return an error */
-    if (maxJpegCodeSize < 0) {
+    if (job->maxJpegCodeSize < 0) {
         return lfail(
-            "%s: getJpegBufferSize returned %zd",__FUNCTION__,maxJpegCodeSize);
+            "%s: getJpegBufferSize returned %zd",__FUNCTION__,job->maxJpegCodeSize);
     }
 
-
-    /* Hold actual thumbnail and main image code sizes */
-    size_t thumbCodeSize = 0, jpegCodeSize = 0;
-    /* Temporary thumbnail code buffer */
-    std::vector<uint8_t> thumbCode(outputThumbnail ? maxThumbCodeSize : 0);
-
-    YCbCrLayout yu12Thumb;
-    if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+    /* Cropped and scaled YU12 buffer for main and thumbnail */
+    if (job->outputThumbnail) {
+        ret = cropAndScaleThumbLocked(mYu12Frame, job->thumbSize, &job->yu12Thumb);
 
         if (ret != 0) {
             return lfail(
@@ -1332,16 +1459,65 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    ret = cropAndScaleLocked(mYu12Frame, job->jpegSize, &job->yu12Main);
 
     if (ret != 0) {
         return lfail("%s: crop and scale main failed!", __FUNCTION__);
     }
 
+    if (!copyImages) {
+        return 0;
+    }
+
+    /* Copy the images out of the intermediate buffers for the JPEG thread */
+    auto copyImage = [&](const Size& sz, YCbCrLayout* layout, sp<AllocatedFrame>* frame) {
+        *frame = new AllocatedFrame(sz.width, sz.height);
+        YCbCrLayout copyLayout;
+        int copyRet = (*frame)->allocate(&copyLayout);
+        if (copyRet != 0) {
+            return copyRet;
+        }
+        copyRet = formatConvert(*layout, copyLayout, sz, V4L2_PIX_FMT_YUV420);
+        *layout = copyLayout;
+        return copyRet;
+    };
+    ATRACE_BEGIN("copyJpegImages");
+    ret = copyImage(job->jpegSize, &job->yu12Main, &job->mainFrame);
+    if (ret == 0 && job->outputThumbnail) {
+        ret = copyImage(job->thumbSize, &job->yu12Thumb, &job->thumbFrame);
+    }
+    ATRACE_END();
+    if (ret != 0) {
+        return lfail("%s: copy of the JPEG images failed with %d", __FUNCTION__, ret);
+    }
+    return 0;
+}
+
+int ExternalCameraDeviceSession::OutputThread::encodeJpeg(JpegJob& job)
+{
+    ATRACE_CALL();
+    int ret;
+    auto lfail = [&](auto... args) {
+        ALOGE(args...);
+
+        return 1;
+    };
+    HalStreamBuffer& halBuf = *job.halBuf;
+
+    /* Compute temporary buffer sizes accounting for the following:
+     * thumbnail can't exceed APP1 size of 64K */
+    const ssize_t maxThumbCodeSize = 64 * 1024;
+    const ssize_t maxJpegCodeSize = job.maxJpegCodeSize;
+
+    /* Hold actual thumbnail and main image code sizes */
+    size_t thumbCodeSize = 0, jpegCodeSize = 0;
+    /* Temporary thumbnail code buffer */
+    std::vector<uint8_t> thumbCode(job.outputThumbnail ? maxThumbCodeSize : 0);
+
     /* Encode the thumbnail image */
-    if (outputThumbnail) {
-        ret = encodeJpegYU12(thumbSize, yu12Thumb,
-                thumbQuality, 0, 0,
+    if (job.outputThumbnail) {
+        ret = encodeJpegYU12(job.thumbSize, job.yu12Thumb,
+                job.thumbQuality, 0, 0,
                 &thumbCode[0], maxThumbCodeSize, thumbCodeSize);
 
         if (ret != 0) {
@@ -1349,29 +1525,39 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         }
     }
 
-    /* Combine camera characteristics with request settings to form EXIF
-     * metadata */
-    common::V1_0::helper::CameraMetadata meta(mCameraCharacteristics);
-    meta.append(setting);
-
-    /* Generate EXIF object */
-    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
-    /* Make sure it's initialized */
-    utils->initialize();
+    /* Generate EXIF object. The tags from the camera characteristics are
+     * in the template, so only the request settings are set here. */
+    std::unique_lock<std::mutex> exifLock(mExifLock);
+    if (mExifUtils == nullptr) {
+        mExifUtils.reset(ExifUtils::create());
+        mExifUtils->initialize();
+        /* The image tags set from the characteristics are overwritten for
+         * each image */
+        mExifUtils->setFromMetadata(mCameraCharacteristics, job.jpegSize.width,
+                job.jpegSize.height);
+        mExifUtils->setMake(mExifMake);
+        mExifUtils->setModel(mExifModel);
+        if (!mExifUtils->saveTemplate()) {
+            mExifUtils.reset();
+            return lfail("%s: saving EXIF template failed", __FUNCTION__);
+        }
+    }
+    mExifUtils->initialize();
 
-    utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
-    utils->setMake(mExifMake);
-    utils->setModel(mExifModel);
+    mExifUtils->setFromMetadata(*job.setting, job.jpegSize.width, job.jpegSize.height);
 
-    ret = utils->generateApp1(outputThumbnail ? &thumbCode[0] : 0, thumbCodeSize);
+    ret = mExifUtils->generateApp1(job.outputThumbnail ? &thumbCode[0] : 0, thumbCodeSize);
 
     if (!ret) {
         return lfail("%s: generating APP1 failed", __FUNCTION__);
     }
 
-    /* Get internal buffer */
-    size_t exifDataSize = utils->getApp1Length();
-    const uint8_t* exifData = utils->getApp1Buffer();
+    /* Copy out of the EXIF object so that the lock is not held while encoding */
+    std::vector<uint8_t> exifCode(mExifUtils->getApp1Buffer(),
+            mExifUtils->getApp1Buffer() + mExifUtils->getApp1Length());
+    exifLock.unlock();
+    size_t exifDataSize = exifCode.size();
+    const uint8_t* exifData = exifCode.data();
 
     /* Lock the HAL jpeg code buffer */
     void *bufPtr = sHandleImporter.lock(
@@ -1382,8 +1568,8 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main,
-            jpegQuality, exifData, exifDataSize,
+    ret = encodeJpegYU12(job.jpegSize, job.yu12Main,
+            job.jpegQuality, exifData, exifDataSize,
             bufPtr, maxJpegCodeSize, jpegCodeSize);
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
@@ -1413,6 +1599,18 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     return 0;
 }
 
+int ExternalCameraDeviceSession::OutputThread::decodeToYu12Locked(
+        const uint8_t* inData, size_t inDataSize) {
+    ATRACE_BEGIN("MJPGtoI420");
+    int res = libyuv::MJPGToI420(
+        inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
+        static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
+        static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride,
+        mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth, mYu12Frame->mHeight);
+    ATRACE_END();
+    return res;
+}
+
 bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     std::shared_ptr<HalRequest> req;
     auto parent = mParent.promote();
@@ -1421,6 +1619,14 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
        return false;
     }
 
+    {
+        std::lock_guard<std::mutex> lk(mResultLock);
+        if (mOutputFailed) {
+            ALOGE("%s: a device error was sent!", __FUNCTION__);
+            return false;
+        }
+    }
+
     // TODO: maybe we need to setup a sensor thread to dq/enq v4l frames
     //       regularly to prevent v4l buffer queue filled with stale buffers
     //       when app doesn't program a preveiw request
@@ -1429,6 +1635,7 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         // No new request, wait again
         return true;
     }
+    req->processStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     auto onDeviceError = [&](auto... args) {
         ALOGE(args...);
@@ -1453,8 +1660,6 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     }
 
     std::unique_lock<std::mutex> lk(mBufferLock);
-    // Convert input V4L2 frame to YU12 of the same size
-    // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
     size_t inDataSize;
     if (req->frameIn->getData(&inData, &inDataSize) != 0) {
@@ -1462,28 +1667,37 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
     }
 
-    // TODO: in some special case maybe we can decode jpg directly to gralloc output?
-    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
-        ATRACE_BEGIN("MJPGtoI420");
-        int res = libyuv::MJPGToI420(
-            inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride,
-            mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth, mYu12Frame->mHeight);
-        ATRACE_END();
+    auto onMalformedFrame = [&](int res) {
+        // For some webcam, the first few V4L2 frames might be malformed...
+        ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
+        lk.unlock();
+        // The requests before this one are returned first
+        waitForPendingResults();
+        Status st = parent->processCaptureRequestError(req);
+        if (st != Status::OK) {
+            return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
+        }
+        signalRequestDone();
+        return true;
+    };
 
+    // A single YUV output of the V4L2 frame size needs neither scaling nor the intermediate
+    // YU12 frame, so the MJPG frame is decoded straight into the gralloc buffer
+    bool decodeToOutput = req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG &&
+            req->buffers.size() == 1 &&
+            (req->buffers[0].format == PixelFormat::YCBCR_420_888 ||
+             req->buffers[0].format == PixelFormat::YV12) &&
+            req->buffers[0].width == mYu12Frame->mWidth &&
+            req->buffers[0].height == mYu12Frame->mHeight;
+
+    // Convert input V4L2 frame to YU12 of the same size
+    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG && !decodeToOutput) {
+        int res = decodeToYu12Locked(inData, inDataSize);
         if (res != 0) {
-            // For some webcam, the first few V4L2 frames might be malformed...
-            ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-            lk.unlock();
-            Status st = parent->processCaptureRequestError(req);
-            if (st != Status::OK) {
-                return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
-            }
-            signalRequestDone();
-            return true;
+            return onMalformedFrame(res);
         }
     }
+    req->decodeDoneTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     ATRACE_BEGIN("Wait for BufferRequest done");
     res = waitForBufferRequestDone(&req->buffers);
@@ -1497,6 +1711,11 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
 
     ALOGV("%s processing new request", __FUNCTION__);
     const int kSyncWaitTimeoutMs = 500;
+    // Output buffers of the same size share their crop and scale, and the sizes are processed in
+    // parallel. JPEG outputs are encoded on the JPEG thread from a copy of their images.
+    std::vector<JpegJob> jpegJobs;
+    std::unordered_map<Size, std::vector<HalStreamBuffer*>, SizeHasher> yuvBufs;
+    std::vector<std::function<int()>> tasks;
     for (auto& halBuf : req->buffers) {
         if (*(halBuf.bufPtr) == nullptr) {
             ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
@@ -1515,10 +1734,12 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
             continue;
         }
 
-        // Gralloc lockYCbCr the buffer
         switch (halBuf.format) {
             case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req->setting);
+                jpegJobs.emplace_back();
+                jpegJobs.back().req = req;
+                int ret = prepareJpegLocked(halBuf, req->setting, /*copyImages*/true,
+                        &jpegJobs.back());
 
                 if(ret != 0) {
                     lk.unlock();
@@ -1527,76 +1748,361 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                 }
             } break;
             case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr), halBuf.usage, inDataSize);
+                HalStreamBuffer* buf = &halBuf;
+                tasks.push_back([buf, inData, inDataSize]() {
+                    void* outLayout = sHandleImporter.lock(*(buf->bufPtr), buf->usage, inDataSize);
 
-                std::memcpy(outLayout, inData, inDataSize);
+                    std::memcpy(outLayout, inData, inDataSize);
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
+                    int relFence = sHandleImporter.unlock(*(buf->bufPtr));
+                    if (relFence >= 0) {
+                        buf->acquireFence = relFence;
+                    }
+                    return 0;
+                });
             } break;
             case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                IMapper::Rect outRect {0, 0,
-                        static_cast<int32_t>(halBuf.width),
-                        static_cast<int32_t>(halBuf.height)};
-                YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), halBuf.usage, outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
-                        __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
-                        outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
-                        outputFourcc & 0xFF,
-                        (outputFourcc >> 8) & 0xFF,
-                        (outputFourcc >> 16) & 0xFF,
-                        (outputFourcc >> 24) & 0xFF);
-
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(
-                        mYu12Frame,
-                        Size { halBuf.width, halBuf.height },
-                        &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
-                }
-
-                Size sz {halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format coversion failed!", __FUNCTION__);
-                }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
+            case PixelFormat::YV12:
+                yuvBufs[Size { halBuf.width, halBuf.height }].push_back(&halBuf);
+                break;
             default:
                 lk.unlock();
                 return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
         }
     } // for each buffer
+
+    if (decodeToOutput && !yuvBufs.empty()) {
+        int ret = decodeToOutputLocked(req->buffers[0], inData, inDataSize);
+        if (ret == 0) {
+            yuvBufs.clear();
+        } else {
+            // Fall back to decoding into the intermediate YU12 frame
+            ALOGV("%s: decode to output failed with %d", __FUNCTION__, ret);
+            ret = decodeToYu12Locked(inData, inDataSize);
+            if (ret != 0) {
+                return onMalformedFrame(ret);
+            }
+        }
+        req->decodeDoneTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    for (const auto& group : yuvBufs) {
+        const Size& sz = group.first;
+        const std::vector<HalStreamBuffer*>& bufs = group.second;
+        tasks.push_back([this, &sz, &bufs]() {
+            return processOutputGroupLocked(sz, bufs);
+        });
+    }
+    int ret = runTasks(tasks);
     mScaledYu12Frames.clear();
+    if (ret != 0) {
+        lk.unlock();
+        return onDeviceError("%s: output buffer processing failed with %d", __FUNCTION__, ret);
+    }
+    req->convertDoneTime = req->jpegDoneTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     // Don't hold the lock while calling back to parent
     lk.unlock();
-    Status st = parent->processCaptureResult(req);
-    if (st != Status::OK) {
-        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
-    }
+    submitResult(req, jpegJobs);
     signalRequestDone();
     return true;
 }
 
+int ExternalCameraDeviceSession::OutputThread::decodeToOutputLocked(
+        HalStreamBuffer& halBuf, const uint8_t* inData, size_t inDataSize) {
+    IMapper::Rect outRect {0, 0,
+            static_cast<int32_t>(halBuf.width),
+            static_cast<int32_t>(halBuf.height)};
+    YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+            *(halBuf.bufPtr), halBuf.usage, outRect);
+    uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+
+    ATRACE_BEGIN("decodeToOutput");
+    int ret = mJpegDecoder->decode(inData, inDataSize,
+            Size { halBuf.width, halBuf.height }, outLayout, outputFourcc);
+    ATRACE_END();
+
+    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+    if (relFence >= 0) {
+        halBuf.acquireFence = relFence;
+    }
+    return ret;
+}
+
+int ExternalCameraDeviceSession::OutputThread::scaleToOutputLocked(
+        const Size& outSz, HalStreamBuffer& halBuf, bool* scaled) {
+    *scaled = false;
+    Size inSz = {mYu12Frame->mWidth, mYu12Frame->mHeight};
+    if (inSz == outSz ||
+            (mCroppingType == VERTICAL && inSz.width == outSz.width) ||
+            (mCroppingType == HORIZONTAL && inSz.height == outSz.height)) {
+        // Format conversion reads the cropped mYu12Frame in place
+        return 0;
+    }
+
+    // The intermediate frame of the size only holds the scaled chroma planes here
+    sp<AllocatedFrame> scratchFrame;
+    {
+        std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
+        if (mScaledYu12Frames.count(outSz) != 0) {
+            return 0;
+        }
+        auto it = mIntermediateBuffers.find(outSz);
+        if (it == mIntermediateBuffers.end()) {
+            return 0;
+        }
+        scratchFrame = it->second;
+    }
+
+    IMapper::Rect inputCrop;
+    YCbCrLayout croppedLayout;
+    YCbCrLayout scratchLayout;
+    if (getCropRect(mCroppingType, inSz, outSz, &inputCrop) != 0 ||
+            mYu12Frame->getCroppedLayout(inputCrop, &croppedLayout) != 0 ||
+            scratchFrame->getLayout(&scratchLayout) != 0) {
+        // Let cropAndScaleLocked report the error
+        return 0;
+    }
+
+    IMapper::Rect outRect {0, 0,
+            static_cast<int32_t>(halBuf.width),
+            static_cast<int32_t>(halBuf.height)};
+    YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+            *(halBuf.bufPtr), halBuf.usage, outRect);
+    uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+
+    ATRACE_BEGIN("scaleAndConvert");
+    int ret = scaleAndConvert(croppedLayout, Size {
+                    static_cast<uint32_t>(inputCrop.width),
+                    static_cast<uint32_t>(inputCrop.height) },
+            outLayout, outSz, outputFourcc, mScaleFilter, scratchLayout);
+    ATRACE_END();
+
+    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+    if (relFence >= 0) {
+        halBuf.acquireFence = relFence;
+    }
+    if (ret == -EINVAL) {
+        // Not a format scaled in place, go through the intermediate frame
+        return 0;
+    }
+    if (ret != 0) {
+        ALOGE("%s: failed to scale %dx%d to %dx%d. Ret %d", __FUNCTION__,
+                inputCrop.width, inputCrop.height, outSz.width, outSz.height, ret);
+        return ret;
+    }
+    *scaled = true;
+    return 0;
+}
+
+int ExternalCameraDeviceSession::OutputThread::processOutputGroupLocked(
+        const Size& sz, const std::vector<HalStreamBuffer*>& bufs) {
+    if (bufs.size() == 1) {
+        bool scaled = false;
+        int ret = scaleToOutputLocked(sz, *bufs[0], &scaled);
+        if (ret != 0 || scaled) {
+            return ret;
+        }
+    }
+
+    YCbCrLayout cropAndScaled;
+    ATRACE_BEGIN("cropAndScaleLocked");
+    int ret = cropAndScaleLocked(mYu12Frame, sz, &cropAndScaled);
+    ATRACE_END();
+    if (ret != 0) {
+        ALOGE("%s: crop and scale failed!", __FUNCTION__);
+        return ret;
+    }
+
+    for (HalStreamBuffer* halBuf : bufs) {
+        // Gralloc lockYCbCr the buffer
+        IMapper::Rect outRect {0, 0,
+                static_cast<int32_t>(halBuf->width),
+                static_cast<int32_t>(halBuf->height)};
+        YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+                *(halBuf->bufPtr), halBuf->usage, outRect);
+        ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
+                __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
+                outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
+
+        // Convert to output buffer size/format
+        uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+        ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
+                outputFourcc & 0xFF,
+                (outputFourcc >> 8) & 0xFF,
+                (outputFourcc >> 16) & 0xFF,
+                (outputFourcc >> 24) & 0xFF);
+
+        ATRACE_BEGIN("formatConvert");
+        ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+        ATRACE_END();
+        int relFence = sHandleImporter.unlock(*(halBuf->bufPtr));
+        if (relFence >= 0) {
+            halBuf->acquireFence = relFence;
+        }
+        if (ret != 0) {
+            ALOGE("%s: format coversion failed!", __FUNCTION__);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int ExternalCameraDeviceSession::OutputThread::runTasks(
+        std::vector<std::function<int()>>& tasks) {
+    if (tasks.empty()) {
+        return 0;
+    }
+
+    int result = 0;
+    size_t pendingCount = tasks.size() - 1;
+    if (pendingCount > 0) {
+        std::lock_guard<std::mutex> lk(mTaskLock);
+        if (mOutputWorkers.empty()) {
+            for (int i = 0; i < kOutputWorkerCount; i++) {
+                mOutputWorkers.emplace_back(&OutputThread::outputWorkerLoop, this);
+            }
+        }
+        for (size_t i = 1; i < tasks.size(); i++) {
+            std::function<int()>* task = &tasks[i];
+            mTasks.push_back([this, task, &result, &pendingCount]() {
+                int ret = (*task)();
+                std::lock_guard<std::mutex> lk(mTaskLock);
+                if (result == 0) {
+                    result = ret;
+                }
+                if (--pendingCount == 0) {
+                    mTaskDoneCond.notify_all();
+                }
+            });
+        }
+    }
+    mTaskCond.notify_all();
+
+    // The first task runs on this thread meanwhile
+    int ret = tasks[0]();
+
+    std::unique_lock<std::mutex> lk(mTaskLock);
+    mTaskDoneCond.wait(lk, [&pendingCount] { return pendingCount == 0; });
+    return ret != 0 ? ret : result;
+}
+
+void ExternalCameraDeviceSession::OutputThread::outputWorkerLoop() {
+    std::unique_lock<std::mutex> lk(mTaskLock);
+    while (true) {
+        mTaskCond.wait(lk, [this] { return mOutputWorkersExiting || !mTasks.empty(); });
+        if (mTasks.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(mTasks.front());
+        mTasks.pop_front();
+        lk.unlock();
+        task();
+        lk.lock();
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::submitResult(
+        const std::shared_ptr<HalRequest>& req, std::vector<JpegJob>& jpegJobs) {
+    std::lock_guard<std::mutex> lk(mResultLock);
+    mPendingResults.push_back({req, jpegJobs.size(), /*failed*/false});
+    if (!jpegJobs.empty()) {
+        if (!mJpegThread.joinable()) {
+            mJpegThread = std::thread(&OutputThread::jpegThreadLoop, this);
+        }
+        for (auto& job : jpegJobs) {
+            mJpegJobs.push_back(std::move(job));
+        }
+        mJpegCond.notify_one();
+    }
+    returnResultsLocked();
+}
+
+void ExternalCameraDeviceSession::OutputThread::jpegThreadLoop() {
+    std::unique_lock<std::mutex> lk(mResultLock);
+    while (true) {
+        mJpegCond.wait(lk, [this] { return mJpegThreadExiting || !mJpegJobs.empty(); });
+        if (mJpegJobs.empty()) {
+            return;
+        }
+        JpegJob job = std::move(mJpegJobs.front());
+        mJpegJobs.pop_front();
+        lk.unlock();
+        int ret = encodeJpeg(job);
+        lk.lock();
+        job.req->jpegDoneTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        auto it = std::find_if(mPendingResults.begin(), mPendingResults.end(),
+                [&job](const PendingResult& result) { return result.req == job.req; });
+        if (it == mPendingResults.end()) {
+            continue;
+        }
+        if (ret != 0) {
+            ALOGE("%s: encodeJpeg failed with %d", __FUNCTION__, ret);
+            auto parent = mParent.promote();
+            if (parent != nullptr) {
+                parent->notifyError(
+                        job.req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+            }
+            it->failed = true;
+            mOutputFailed = true;
+        }
+        it->pendingJpegCount--;
+        returnResultsLocked();
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::returnResultsLocked() {
+    auto parent = mParent.promote();
+    while (!mPendingResults.empty() && mPendingResults.front().pendingJpegCount == 0) {
+        PendingResult result = std::move(mPendingResults.front());
+        mPendingResults.pop_front();
+        // Requests failing with a device error are not returned
+        if (parent == nullptr || result.failed) {
+            continue;
+        }
+        Status st = parent->processCaptureResult(result.req);
+        if (st != Status::OK) {
+            ALOGE("%s: failed to process capture result!", __FUNCTION__);
+            parent->notifyError(
+                    result.req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+            mOutputFailed = true;
+        }
+    }
+    if (mPendingResults.empty()) {
+        mResultDoneCond.notify_all();
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::waitForPendingResults() {
+    std::unique_lock<std::mutex> lk(mResultLock);
+    std::chrono::seconds timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    if (!mResultDoneCond.wait_for(lk, timeout, [this] { return mPendingResults.empty(); })) {
+        ALOGE("%s: wait for pending results timeout!", __FUNCTION__);
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::stopOutputWorkers() {
+    {
+        std::lock_guard<std::mutex> lk(mTaskLock);
+        mOutputWorkersExiting = true;
+    }
+    mTaskCond.notify_all();
+    for (auto& worker : mOutputWorkers) {
+        worker.join();
+    }
+    mOutputWorkers.clear();
+
+    {
+        std::lock_guard<std::mutex> lk(mResultLock);
+        mJpegThreadExiting = true;
+    }
+    mJpegCond.notify_all();
+    if (mJpegThread.joinable()) {
+        mJpegThread.join();
+    }
+}
+
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         const Size& v4lSize, const Size& thumbSize,
         const hidl_vec<Stream>& streams,
@@ -1712,6 +2218,7 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
 
     ALOGV("%s: flusing inflight requests", __FUNCTION__);
     lk.unlock();
+    waitForPendingResults();
     for (const auto& req : reqs) {
         parent->processCaptureRequestError(req);
     }
@@ -1738,6 +2245,7 @@ ExternalCameraDeviceSession::OutputThread::switchToOffline() {
         }
     }
     lk.unlock();
+    waitForPendingResults();
     clearIntermediateBuffers();
     ALOGV("%s: returning %zu request for offline processing", __FUNCTION__, reqs.size());
     return reqs;
@@ -1793,6 +2301,13 @@ void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
         dprintf(fd, "%d, ", req->frameNumber);
     }
     dprintf(fd, "\n");
+
+    std::lock_guard<std::mutex> resultLk(mResultLock);
+    dprintf(fd, "OutputThread pending results of frame: ");
+    for (const auto& result : mPendingResults) {
+        dprintf(fd, "%d (%zu JPEG left), ", result.req->frameNumber, result.pendingJpegCount);
+    }
+    dprintf(fd, "\n");
 }
 
 void ExternalCameraDeviceSession::cleanupBuffersLocked(int id) {
@@ -1882,6 +2397,58 @@ bool ExternalCameraDeviceSession::isSupported(const Stream& stream,
     return false;
 }
 
+int ExternalCameraDeviceSession::allocateV4l2DmaBuffersLocked(uint32_t count, size_t size) {
+    if (mV4l2DmaBuffers.size() == count &&
+            (count == 0 || mV4l2DmaBuffers[0].size == size)) {
+        return OK;
+    }
+    freeV4l2DmaBuffersLocked();
+
+    int ionFd = ion_open();
+    if (ionFd < 0) {
+        ALOGE("%s: cannot open ION: %s", __FUNCTION__, strerror(-ionFd));
+        return ionFd;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        int bufFd;
+        int ret = ion_alloc_fd(ionFd, size, 0, ION_HEAP_SYSTEM_MASK, 0, &bufFd);
+        if (ret != 0) {
+            ALOGE("%s: ION allocation of buffer %u (%zu bytes) failed: %s",
+                    __FUNCTION__, i, size, strerror(-ret));
+            ion_close(ionFd);
+            freeV4l2DmaBuffersLocked();
+            return NO_MEMORY;
+        }
+        unique_fd fd(bufFd);
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+        if (addr == MAP_FAILED) {
+            ALOGE("%s: mmap of buffer %u failed: %s", __FUNCTION__, i, strerror(errno));
+            ion_close(ionFd);
+            freeV4l2DmaBuffersLocked();
+            return NO_MEMORY;
+        }
+        mV4l2DmaBuffers.push_back({std::move(fd), static_cast<uint8_t*>(addr), size});
+    }
+    ion_close(ionFd);
+    ALOGV("%s: allocated %u DMA-BUF capture buffers of %zu bytes", __FUNCTION__, count, size);
+    return OK;
+}
+
+void ExternalCameraDeviceSession::freeV4l2DmaBuffersLocked() {
+    for (auto& dmaBuf : mV4l2DmaBuffers) {
+        munmap(dmaBuf.data, dmaBuf.size);
+    }
+    mV4l2DmaBuffers.clear();
+}
+
+void ExternalCameraDeviceSession::setV4l2BufferMemory(v4l2_buffer* buffer) {
+    buffer->memory = mV4l2MemoryType;
+    if (mV4l2MemoryType == V4L2_MEMORY_DMABUF && buffer->index < mV4l2DmaBuffers.size()) {
+        buffer->m.fd = mV4l2DmaBuffers[buffer->index].fd.get();
+        buffer->length = mV4l2DmaBuffers[buffer->index].size;
+    }
+}
+
 int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
     if (!mV4l2Streaming) {
         return OK;
@@ -1907,7 +2474,7 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
     // VIDIOC_REQBUFS: clear buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    req_buffers.memory = mV4l2MemoryType;
     req_buffers.count = 0;
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
         ALOGE("%s: REQBUFS failed: %s", __FUNCTION__, strerror(errno));
@@ -2041,14 +2608,24 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
         return fpsRet;
     }
 
-    uint32_t v4lBufferCount = (fps >= kDefaultFps) ?
-            mCfg.numVideoBuffers : mCfg.numStillBuffers;
+    mV4l2BufferCountIsVideo = (fps >= kDefaultFps);
+    mV4l2BufferCountChanged = false;
+    uint32_t v4lBufferCount = mV4l2BufferCountIsVideo ? mNumVideoBuffers : mNumStillBuffers;
     // VIDIOC_REQBUFS: create buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req_buffers.memory = V4L2_MEMORY_MMAP;
+    mV4l2MemoryType = mCfg.dmaBufEnabled ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+    req_buffers.memory = mV4l2MemoryType;
     req_buffers.count = v4lBufferCount;
-    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers)) < 0) {
+    ret = TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers));
+    if (ret < 0 && errno == EINVAL && mV4l2MemoryType == V4L2_MEMORY_DMABUF) {
+        ALOGW("%s: DMA-BUF capture not supported by the device, using MMAP", __FUNCTION__);
+        mV4l2MemoryType = V4L2_MEMORY_MMAP;
+        req_buffers.memory = mV4l2MemoryType;
+        req_buffers.count = v4lBufferCount;
+        ret = TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_REQBUFS, &req_buffers));
+    }
+    if (ret < 0) {
         ALOGE("%s: VIDIOC_REQBUFS failed: %s", __FUNCTION__, strerror(errno));
         return -errno;
     }
@@ -2060,17 +2637,25 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
         return NO_MEMORY;
     }
 
+    if (mV4l2MemoryType == V4L2_MEMORY_DMABUF) {
+        int allocRet = allocateV4l2DmaBuffersLocked(req_buffers.count, mMaxV4L2BufferSize);
+        if (allocRet != 0) {
+            return allocRet;
+        }
+    }
+
     // VIDIOC_QUERYBUF:  get buffer offset in the V4L2 fd
     // VIDIOC_QBUF: send buffer to driver
     mV4L2BufferCount = req_buffers.count;
     for (uint32_t i = 0; i < req_buffers.count; i++) {
         v4l2_buffer buffer = {
-                .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = V4L2_MEMORY_MMAP};
+                .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = mV4l2MemoryType};
 
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QUERYBUF, &buffer)) < 0) {
             ALOGE("%s: QUERYBUF %d failed: %s", __FUNCTION__, i,  strerror(errno));
             return -errno;
         }
+        setV4l2BufferMemory(&buffer);
 
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF %d failed: %s", __FUNCTION__, i,  strerror(errno));
@@ -2102,11 +2687,12 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
     for (int i = 0; i < kBadFramesAfterStreamOn; i++) {
         v4l2_buffer buffer{};
         buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.memory = mV4l2MemoryType;
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
             ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
             return -errno;
         }
+        setV4l2BufferMemory(&buffer);
 
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__, buffer.index, strerror(errno));
@@ -2114,8 +2700,14 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
         }
     }
 
-    ALOGI("%s: start V4L2 streaming %dx%d@%ffps",
-                __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height, fps);
+    mAdaptNumFrames = 0;
+    mAdaptNumStarved = 0;
+    mAdaptNumDropped = 0;
+    mAdaptMaxDequeued = 0;
+    mHasV4l2Sequence = false;
+
+    ALOGI("%s: start V4L2 streaming %dx%d@%ffps, %u buffers",
+                __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height, fps, req_buffers.count);
     mV4l2StreamingFmt = v4l2Fmt;
     mV4l2Streaming = true;
     return OK;
@@ -2133,17 +2725,23 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
     {
         std::unique_lock<std::mutex> lk(mV4l2BufferLock);
         if (mNumDequeuedV4l2Buffers == mV4L2BufferCount) {
+            nsecs_t waitStart = systemTime(SYSTEM_TIME_MONOTONIC);
             int waitRet = waitForV4L2BufferReturnLocked(lk);
+            nsecs_t waited = systemTime(SYSTEM_TIME_MONOTONIC) - waitStart;
+            mV4l2Starvation.record(waited);
+            HAL_METRICS_RECORD_NS("camera.external.v4l2BufferWait", waited);
+            mAdaptNumStarved++;
             if (waitRet != 0) {
                 return ret;
             }
         }
+        mAdaptMaxDequeued = std::max(mAdaptMaxDequeued, mNumDequeuedV4l2Buffers + 1);
     }
 
     ATRACE_BEGIN("VIDIOC_DQBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.memory = mV4l2MemoryType;
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
         ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
         return ret;
@@ -2179,19 +2777,71 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         mNumDequeuedV4l2Buffers++;
     }
+    updateV4l2BufferStatsLocked(buffer);
+    if (mV4l2MemoryType == V4L2_MEMORY_DMABUF) {
+        const V4l2DmaBuffer& dmaBuf = mV4l2DmaBuffers[buffer.index];
+        return new V4L2Frame(
+                mV4l2StreamingFmt.width, mV4l2StreamingFmt.height, mV4l2StreamingFmt.fourcc,
+                buffer.index, dmaBuf.fd.get(), dmaBuf.data, buffer.bytesused);
+    }
     return new V4L2Frame(
             mV4l2StreamingFmt.width, mV4l2StreamingFmt.height, mV4l2StreamingFmt.fourcc,
             buffer.index, mV4l2Fd.get(), buffer.bytesused, buffer.m.offset);
 }
 
+void ExternalCameraDeviceSession::updateV4l2BufferStatsLocked(const v4l2_buffer& buffer) {
+    if (mHasV4l2Sequence && buffer.sequence > mLastV4l2Sequence + 1) {
+        uint32_t dropped = buffer.sequence - mLastV4l2Sequence - 1;
+        {
+            std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+            mNumDroppedV4l2Frames += dropped;
+        }
+        HAL_METRICS_ADD("camera.external.droppedV4l2Frames", dropped);
+        mAdaptNumDropped++;
+    }
+    mHasV4l2Sequence = true;
+    mLastV4l2Sequence = buffer.sequence;
+
+    if (++mAdaptNumFrames == kV4l2BufferAdaptFrames) {
+        adaptV4l2BufferCountLocked();
+        mAdaptNumFrames = 0;
+        mAdaptNumStarved = 0;
+        mAdaptNumDropped = 0;
+        mAdaptMaxDequeued = 0;
+    }
+}
+
+void ExternalCameraDeviceSession::adaptV4l2BufferCountLocked() {
+    uint32_t& count = mV4l2BufferCountIsVideo ? mNumVideoBuffers : mNumStillBuffers;
+    uint32_t minCount = mV4l2BufferCountIsVideo ? mCfg.numVideoBuffers : mCfg.numStillBuffers;
+    uint32_t maxCount =
+            mV4l2BufferCountIsVideo ? mCfg.maxNumVideoBuffers : mCfg.maxNumStillBuffers;
+
+    uint32_t newCount = count;
+    if (mAdaptNumStarved + mAdaptNumDropped > kV4l2BufferAdaptThreshold) {
+        if (count < maxCount) {
+            newCount = count + 1;
+        }
+    } else if (mAdaptMaxDequeued + 2 < count && count > minCount) {
+        newCount = count - 1;
+    }
+    if (newCount != count) {
+        ALOGI("%s: %s buffer count %u -> %u (%u waits, %u drops, %zu max dequeued)",
+                __FUNCTION__, mV4l2BufferCountIsVideo ? "video" : "still", count, newCount,
+                mAdaptNumStarved, mAdaptNumDropped, mAdaptMaxDequeued);
+        count = newCount;
+        mV4l2BufferCountChanged = true;
+    }
+}
+
 void ExternalCameraDeviceSession::enqueueV4l2Frame(const sp<V4L2Frame>& frame) {
     ATRACE_CALL();
     frame->unmap();
     ATRACE_BEGIN("VIDIOC_QBUF");
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buffer.memory = V4L2_MEMORY_MMAP;
     buffer.index = frame->mBufferIndex;
+    setV4l2BufferMemory(&buffer);
     if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
         ALOGE("%s: QBUF index %d fails: %s", __FUNCTION__,
                 frame->mBufferIndex, strerror(errno));
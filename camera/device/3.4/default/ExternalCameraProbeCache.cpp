@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ExtCamProbeCache@3.4"
+//#define LOG_NDEBUG 0
+#include <log/log.h>
+
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include "android-base/unique_fd.h"
+#include "ExternalCameraProbeCache.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+namespace {
+// Only support MJPEG for now as it seems to be the one supports higher fps
+// Other formats to consider in the future:
+// * V4L2_PIX_FMT_YVU420 (== YV12)
+// * V4L2_PIX_FMT_YVYU (YVYU: can be converted to YV12 or other YUV420_888 formats)
+const std::array<uint32_t, /*size*/ 2> kSupportedFourCCs{
+    {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_Z16}};  // double braces required in C++11
+
+// Bumped when the format of the cache files changes
+const char* kCacheFileHeader = "extcam-probe-v1";
+
+std::string readSysfsAttribute(const std::string& path) {
+    std::ifstream file(path);
+    std::string value;
+    if (!(file >> value)) {
+        return "";
+    }
+    return value;
+}
+
+} // anonymous namespace
+
+ExternalCameraProbeCache& ExternalCameraProbeCache::getInstance() {
+    static ExternalCameraProbeCache sInstance;
+    return sInstance;
+}
+
+std::vector<SupportedV4L2Format> ExternalCameraProbeCache::probe(int fd) {
+    std::vector<SupportedV4L2Format> formats;
+    struct v4l2_fmtdesc fmtdesc {
+        .index = 0,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
+    for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc)) == 0; fmtdesc.index++) {
+        ALOGV("index:%d, format:%c%c%c%c", fmtdesc.index,
+                fmtdesc.pixelformat & 0xFF,
+                (fmtdesc.pixelformat >> 8) & 0xFF,
+                (fmtdesc.pixelformat >> 16) & 0xFF,
+                (fmtdesc.pixelformat >> 24) & 0xFF);
+        if ((fmtdesc.flags & V4L2_FMT_FLAG_EMULATED) ||
+                std::find(kSupportedFourCCs.begin(), kSupportedFourCCs.end(),
+                        fmtdesc.pixelformat) == kSupportedFourCCs.end()) {
+            continue;
+        }
+
+        v4l2_frmsizeenum frameSize {
+                .index = 0,
+                .pixel_format = fmtdesc.pixelformat};
+        for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frameSize)) == 0;
+                ++frameSize.index) {
+            if (frameSize.type != V4L2_FRMSIZE_TYPE_DISCRETE) {
+                continue;
+            }
+            SupportedV4L2Format format {
+                .width = frameSize.discrete.width,
+                .height = frameSize.discrete.height,
+                .fourcc = fmtdesc.pixelformat
+            };
+
+            v4l2_frmivalenum frameInterval{
+                    .index = 0,
+                    .pixel_format = format.fourcc,
+                    .width = format.width,
+                    .height = format.height,
+            };
+            for (; TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &frameInterval)) == 0;
+                    ++frameInterval.index) {
+                if (frameInterval.type == V4L2_FRMIVAL_TYPE_DISCRETE &&
+                        frameInterval.discrete.numerator != 0) {
+                    format.frameRates.push_back({
+                            frameInterval.discrete.numerator,
+                            frameInterval.discrete.denominator});
+                }
+            }
+            ALOGV("format:%c%c%c%c, w %d, h %d, %zu frame rates",
+                    format.fourcc & 0xFF,
+                    (format.fourcc >> 8) & 0xFF,
+                    (format.fourcc >> 16) & 0xFF,
+                    (format.fourcc >> 24) & 0xFF,
+                    format.width, format.height, format.frameRates.size());
+            formats.push_back(format);
+        }
+    }
+    return formats;
+}
+
+bool ExternalCameraProbeCache::lookup(const std::string& devicePath,
+        const std::string& cacheDir, std::vector<SupportedV4L2Format>* out) {
+    std::string key = getDeviceKey(devicePath);
+    if (key.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk(mLock);
+    auto it = mEntries.find(key);
+    if (it != mEntries.end()) {
+        *out = it->second.probe;
+        return true;
+    }
+
+    if (cacheDir.empty()) {
+        return false;
+    }
+    Entry entry;
+    if (!readProbe(getCachePath(cacheDir, key), &entry.probe)) {
+        return false;
+    }
+    ALOGI("%s: using cached probe of %s (%s)", __FUNCTION__, devicePath.c_str(), key.c_str());
+    entry.validated = false;
+    *out = entry.probe;
+    mEntries[key] = std::move(entry);
+    return true;
+}
+
+void ExternalCameraProbeCache::store(const std::string& devicePath,
+        const std::string& cacheDir, const std::vector<SupportedV4L2Format>& probe) {
+    std::string key = getDeviceKey(devicePath);
+    if (key.empty() || probe.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(mLock);
+    mEntries[key] = {probe, /*validated*/true};
+    if (!cacheDir.empty() && !writeProbe(getCachePath(cacheDir, key), probe)) {
+        ALOGW("%s: cannot write probe of %s to %s", __FUNCTION__,
+                devicePath.c_str(), cacheDir.c_str());
+    }
+}
+
+bool ExternalCameraProbeCache::needsRevalidation(const std::string& devicePath) {
+    std::string key = getDeviceKey(devicePath);
+    std::lock_guard<std::mutex> lk(mLock);
+    auto it = mEntries.find(key);
+    return it != mEntries.end() && !it->second.validated;
+}
+
+bool ExternalCameraProbeCache::revalidate(const std::string& devicePath,
+        const std::string& cacheDir) {
+    std::vector<SupportedV4L2Format> cached;
+    {
+        std::string key = getDeviceKey(devicePath);
+        std::lock_guard<std::mutex> lk(mLock);
+        auto it = mEntries.find(key);
+        if (it == mEntries.end() || it->second.validated) {
+            return false;
+        }
+        cached = it->second.probe;
+    }
+
+    base::unique_fd fd(::open(devicePath.c_str(), O_RDWR));
+    if (fd.get() < 0) {
+        ALOGE("%s: v4l2 device open %s failed", __FUNCTION__, devicePath.c_str());
+        return false;
+    }
+    std::vector<SupportedV4L2Format> probed = probe(fd.get());
+    if (probed.empty()) {
+        return false;
+    }
+
+    bool changed = !isSameProbe(cached, probed);
+    if (changed) {
+        ALOGW("%s: cached probe of %s is stale", __FUNCTION__, devicePath.c_str());
+    }
+    store(devicePath, cacheDir, probed);
+    return changed;
+}
+
+std::string ExternalCameraProbeCache::getDeviceKey(const std::string& devicePath) {
+    // /sys/class/video4linux/videoN/device is the USB interface of the device, and its parent
+    // the USB device
+    std::string node = devicePath.substr(devicePath.find_last_of('/') + 1);
+    std::string usbDevice = "/sys/class/video4linux/" + node + "/device/../";
+    std::string vendor = readSysfsAttribute(usbDevice + "idVendor");
+    std::string product = readSysfsAttribute(usbDevice + "idProduct");
+    std::string version = readSysfsAttribute(usbDevice + "bcdDevice");
+    if (vendor.empty() || product.empty() || version.empty()) {
+        return "";
+    }
+    return vendor + "_" + product + "_" + version;
+}
+
+std::string ExternalCameraProbeCache::getCachePath(
+        const std::string& cacheDir, const std::string& key) {
+    return cacheDir + "/extcam_probe_" + key;
+}
+
+// The file has a header line, then a line per format:
+// <fourcc> <width> <height> [<duration numerator>/<duration denominator>]...
+bool ExternalCameraProbeCache::readProbe(
+        const std::string& path, std::vector<SupportedV4L2Format>* out) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheFileHeader) {
+        return false;
+    }
+
+    std::vector<SupportedV4L2Format> probe;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        SupportedV4L2Format format;
+        if (!(fields >> format.fourcc >> format.width >> format.height)) {
+            ALOGE("%s: malformed line in %s: %s", __FUNCTION__, path.c_str(), line.c_str());
+            return false;
+        }
+        SupportedV4L2Format::FrameRate fr;
+        char slash;
+        while (fields >> fr.durationNumerator >> slash >> fr.durationDenominator) {
+            if (slash != '/' || fr.durationNumerator == 0) {
+                ALOGE("%s: malformed line in %s: %s", __FUNCTION__, path.c_str(), line.c_str());
+                return false;
+            }
+            format.frameRates.push_back(fr);
+        }
+        probe.push_back(format);
+    }
+    if (probe.empty()) {
+        return false;
+    }
+    *out = std::move(probe);
+    return true;
+}
+
+bool ExternalCameraProbeCache::writeProbe(
+        const std::string& path, const std::vector<SupportedV4L2Format>& probe) {
+    // Written aside and renamed so that readers never see a partial file
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        file << kCacheFileHeader << "\n";
+        for (const auto& format : probe) {
+            file << format.fourcc << " " << format.width << " " << format.height;
+            for (const auto& fr : format.frameRates) {
+                file << " " << fr.durationNumerator << "/" << fr.durationDenominator;
+            }
+            file << "\n";
+        }
+        file.flush();
+        if (!file) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ExternalCameraProbeCache::isSameProbe(const std::vector<SupportedV4L2Format>& a,
+        const std::vector<SupportedV4L2Format>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+            [](const SupportedV4L2Format& fa, const SupportedV4L2Format& fb) {
+                return fa.fourcc == fb.fourcc && fa.width == fb.width &&
+                        fa.height == fb.height &&
+                        std::equal(fa.frameRates.begin(), fa.frameRates.end(),
+                                fb.frameRates.begin(), fb.frameRates.end(),
+                                [](const SupportedV4L2Format::FrameRate& ra,
+                                        const SupportedV4L2Format::FrameRate& rb) {
+                                    return ra.durationNumerator == rb.durationNumerator &&
+                                            ra.durationDenominator == rb.durationDenominator;
+                                });
+            });
+}
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
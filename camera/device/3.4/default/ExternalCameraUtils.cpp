@@ -17,9 +17,16 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <stdio.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <linux/dma-buf.h>
 #include <linux/videodev2.h>
 
 #define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
@@ -51,6 +58,22 @@ V4L2Frame::V4L2Frame(
         Frame(w, h, fourcc),
         mBufferIndex(bufIdx), mFd(fd), mDataSize(dataSize), mOffset(offset) {}
 
+V4L2Frame::V4L2Frame(
+        uint32_t w, uint32_t h, uint32_t fourcc,
+        int bufIdx, int dmaBufFd, uint8_t* mappedData, uint32_t dataSize) :
+        Frame(w, h, fourcc),
+        mBufferIndex(bufIdx), mFd(dmaBufFd), mIsDmaBuf(true), mDataSize(dataSize), mOffset(0),
+        mData(mappedData) {}
+
+static int syncDmaBuf(int fd, uint64_t flags) {
+    struct dma_buf_sync sync = { .flags = flags | DMA_BUF_SYNC_READ };
+    if (TEMP_FAILURE_RETRY(ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+        ALOGE("%s: DMA-BUF sync failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
 int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
     if (data == nullptr || dataSize == nullptr) {
         ALOGI("%s: V4L2 buffer map bad argument: data %p, dataSize %p",
@@ -59,6 +82,18 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
     }
 
     std::lock_guard<std::mutex> lk(mLock);
+    if (mIsDmaBuf) {
+        if (!mMapped) {
+            int ret = syncDmaBuf(mFd, DMA_BUF_SYNC_START);
+            if (ret != 0) {
+                return ret;
+            }
+            mMapped = true;
+        }
+        *data = mData;
+        *dataSize = mDataSize;
+        return 0;
+    }
     if (!mMapped) {
         void* addr = mmap(NULL, mDataSize, PROT_READ, MAP_SHARED, mFd, mOffset);
         if (addr == MAP_FAILED) {
@@ -76,6 +111,14 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
 
 int V4L2Frame::unmap() {
     std::lock_guard<std::mutex> lk(mLock);
+    if (mIsDmaBuf) {
+        // The buffer stays mapped by the HAL
+        if (mMapped) {
+            mMapped = false;
+            return syncDmaBuf(mFd, DMA_BUF_SYNC_END);
+        }
+        return 0;
+    }
     if (mMapped) {
         ALOGV("%s: V4L unmap data %p size %zu", __FUNCTION__, mData, mDataSize);
         if (munmap(mData, mDataSize) != 0) {
@@ -382,6 +425,78 @@ int formatConvert(
     return 0;
 }
 
+int scaleAndConvert(const YCbCrLayout& in, Size inSz, const YCbCrLayout& out, Size outSz,
+        uint32_t format, ExternalCameraConfig::ScaleFilter filter, const YCbCrLayout& scratch) {
+    libyuv::FilterMode filterMode = static_cast<libyuv::FilterMode>(filter);
+    switch (format) {
+        case V4L2_PIX_FMT_YVU420: // YV12
+        case V4L2_PIX_FMT_YUV420: // YU12
+            return libyuv::I420Scale(
+                    static_cast<uint8_t*>(in.y), in.yStride,
+                    static_cast<uint8_t*>(in.cb), in.cStride,
+                    static_cast<uint8_t*>(in.cr), in.cStride,
+                    inSz.width, inSz.height,
+                    static_cast<uint8_t*>(out.y), out.yStride,
+                    static_cast<uint8_t*>(out.cb), out.cStride,
+                    static_cast<uint8_t*>(out.cr), out.cStride,
+                    outSz.width, outSz.height, filterMode);
+        case V4L2_PIX_FMT_NV21:
+        case V4L2_PIX_FMT_NV12: {
+            const int inChromaWidth = (inSz.width + 1) / 2;
+            const int inChromaHeight = (inSz.height + 1) / 2;
+            const int outChromaWidth = (outSz.width + 1) / 2;
+            const int outChromaHeight = (outSz.height + 1) / 2;
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(in.y), in.yStride, inSz.width, inSz.height,
+                    static_cast<uint8_t*>(out.y), out.yStride, outSz.width, outSz.height,
+                    filterMode);
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(in.cb), in.cStride, inChromaWidth, inChromaHeight,
+                    static_cast<uint8_t*>(scratch.cb), scratch.cStride,
+                    outChromaWidth, outChromaHeight, filterMode);
+            libyuv::ScalePlane(
+                    static_cast<uint8_t*>(in.cr), in.cStride, inChromaWidth, inChromaHeight,
+                    static_cast<uint8_t*>(scratch.cr), scratch.cStride,
+                    outChromaWidth, outChromaHeight, filterMode);
+            // NV21 interleaves V before U, and its chroma starts at cr
+            bool vu = (format == V4L2_PIX_FMT_NV21);
+            libyuv::MergeUVPlane(
+                    static_cast<uint8_t*>(vu ? scratch.cr : scratch.cb), scratch.cStride,
+                    static_cast<uint8_t*>(vu ? scratch.cb : scratch.cr), scratch.cStride,
+                    static_cast<uint8_t*>(vu ? out.cr : out.cb), out.cStride,
+                    outChromaWidth, outChromaHeight);
+            return 0;
+        }
+        default:
+            return -EINVAL;
+    }
+}
+
+namespace {
+
+class SwJpegDecoder : public JpegDecoder {
+public:
+    int decode(const uint8_t* inData, size_t inDataSize, Size sz,
+            const YCbCrLayout& out, uint32_t outFourcc) override {
+        if (outFourcc != V4L2_PIX_FMT_YUV420 && outFourcc != V4L2_PIX_FMT_YVU420) {
+            return -EINVAL;
+        }
+        // YU12 and YV12 only differ by the order of their chroma planes
+        return libyuv::MJPGToI420(
+                inData, inDataSize,
+                static_cast<uint8_t*>(out.y), out.yStride,
+                static_cast<uint8_t*>(out.cb), out.cStride,
+                static_cast<uint8_t*>(out.cr), out.cStride,
+                sz.width, sz.height, sz.width, sz.height);
+    }
+};
+
+} // Anonymous namespace
+
+std::unique_ptr<JpegDecoder> createJpegDecoder() {
+    return std::make_unique<SwJpegDecoder>();
+}
+
 int encodeJpegYU12(
         const Size & inSz, const YCbCrLayout& inLayout,
         int jpegQuality, const void *app1Buffer, size_t app1Size,
@@ -662,6 +777,34 @@ status_t fillCaptureResultCommon(
 #undef ARRAY_SIZE
 #undef UPDATE
 
+namespace {
+std::mutex gOpenSessionLock;
+std::condition_variable gOpenSessionCond; // signaled when the last open session is closed
+int gNumOpenSessions = 0;
+} // anonymous namespace
+
+void registerOpenSession() {
+    std::lock_guard<std::mutex> lk(gOpenSessionLock);
+    gNumOpenSessions++;
+}
+
+void unregisterOpenSession() {
+    std::lock_guard<std::mutex> lk(gOpenSessionLock);
+    if (gNumOpenSessions == 0) {
+        ALOGE("%s: no session is open!", __FUNCTION__);
+        return;
+    }
+    if (--gNumOpenSessions == 0) {
+        gOpenSessionCond.notify_all();
+    }
+}
+
+bool waitForNoOpenSession(nsecs_t timeout) {
+    std::unique_lock<std::mutex> lk(gOpenSessionLock);
+    return gOpenSessionCond.wait_for(lk, std::chrono::nanoseconds(timeout),
+            [] { return gNumOpenSessions == 0; });
+}
+
 }  // namespace implementation
 }  // namespace V3_4
 
@@ -707,6 +850,9 @@ namespace {
     const int kDefaultJpegBufSize = 5 << 20; // 5MB
     const int kDefaultNumVideoBuffer = 4;
     const int kDefaultNumStillBuffer = 2;
+    const int kDefaultMaxNumVideoBuffer = 8;
+    const int kDefaultMaxNumStillBuffer = 4;
+    const char* kDefaultProbeCacheDir = "/data/vendor/camera";
     const int kDefaultOrientation = 0; // suitable for natural landscape displays like tablet/TV
                                        // For phone devices 270 is better
 } // anonymous namespace
@@ -780,7 +926,10 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     } else {
         ret.numVideoBuffers =
                 numVideoBuf->UnsignedAttribute("count", /*Default*/kDefaultNumVideoBuffer);
+        ret.maxNumVideoBuffers =
+                numVideoBuf->UnsignedAttribute("max", /*Default*/kDefaultMaxNumVideoBuffer);
     }
+    ret.maxNumVideoBuffers = std::max(ret.maxNumVideoBuffers, ret.numVideoBuffers);
 
     XMLElement *numStillBuf = deviceCfg->FirstChildElement("NumStillBuffers");
     if (numStillBuf == nullptr) {
@@ -788,7 +937,10 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     } else {
         ret.numStillBuffers =
                 numStillBuf->UnsignedAttribute("count", /*Default*/kDefaultNumStillBuffer);
+        ret.maxNumStillBuffers =
+                numStillBuf->UnsignedAttribute("max", /*Default*/kDefaultMaxNumStillBuffer);
     }
+    ret.maxNumStillBuffers = std::max(ret.maxNumStillBuffers, ret.numStillBuffers);
 
     XMLElement *fpsList = deviceCfg->FirstChildElement("FpsList");
     if (fpsList == nullptr) {
@@ -818,6 +970,49 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         }
     }
 
+    XMLElement *scaleFilter = deviceCfg->FirstChildElement("ScaleFilter");
+    if (scaleFilter == nullptr) {
+        ALOGI("%s: no scale filter specified", __FUNCTION__);
+    } else {
+        const char* mode = scaleFilter->Attribute("mode");
+        if (mode == nullptr || !strcmp(mode, "none")) {
+            ret.scaleFilter = ScaleFilter::NONE;
+        } else if (!strcmp(mode, "linear")) {
+            ret.scaleFilter = ScaleFilter::LINEAR;
+        } else if (!strcmp(mode, "bilinear")) {
+            ret.scaleFilter = ScaleFilter::BILINEAR;
+        } else if (!strcmp(mode, "box")) {
+            ret.scaleFilter = ScaleFilter::BOX;
+        } else {
+            ALOGW("%s: unknown scale filter %s, using none", __FUNCTION__, mode);
+            ret.scaleFilter = ScaleFilter::NONE;
+        }
+    }
+
+    XMLElement *dmaBuf = deviceCfg->FirstChildElement("DmaBufCapture");
+    if (dmaBuf == nullptr) {
+        ret.dmaBufEnabled = false;
+        ALOGI("%s: DMA-BUF capture is not enabled", __FUNCTION__);
+    } else {
+        ret.dmaBufEnabled = dmaBuf->BoolAttribute("enabled", false);
+    }
+
+    XMLElement *probeCache = deviceCfg->FirstChildElement("ProbeCache");
+    if (probeCache == nullptr) {
+        ALOGI("%s: no probe cache dir specified", __FUNCTION__);
+    } else {
+        const char* dir = probeCache->Attribute("dir");
+        ret.probeCacheDir = (dir == nullptr) ? "" : dir;
+    }
+
+    XMLElement *offline = deviceCfg->FirstChildElement("OfflineProcessing");
+    if (offline == nullptr) {
+        ALOGI("%s: no offline buffer budget specified", __FUNCTION__);
+    } else {
+        ret.offlineBufferBudget =
+                static_cast<size_t>(offline->UnsignedAttribute("bufferBudgetMb", 0)) << 20;
+    }
+
     XMLElement *minStreamSize = deviceCfg->FirstChildElement("MinimumStreamSize");
     if (minStreamSize == nullptr) {
        ALOGI("%s: no minimum stream size specified", __FUNCTION__);
@@ -835,9 +1030,10 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     }
 
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
-            " num video buffers %d, num still buffers %d, orientation %d",
+            " num video buffers %d (max %d), num still buffers %d (max %d), orientation %d",
             __FUNCTION__, ret.maxJpegBufSize,
-            ret.numVideoBuffers, ret.numStillBuffers, ret.orientation);
+            ret.numVideoBuffers, ret.maxNumVideoBuffers,
+            ret.numStillBuffers, ret.maxNumStillBuffers, ret.orientation);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__,
                 limit.size.width, limit.size.height, limit.fpsUpperBound);
@@ -884,7 +1080,13 @@ ExternalCameraConfig::ExternalCameraConfig() :
         maxJpegBufSize(kDefaultJpegBufSize),
         numVideoBuffers(kDefaultNumVideoBuffer),
         numStillBuffers(kDefaultNumStillBuffer),
+        maxNumVideoBuffers(kDefaultMaxNumVideoBuffer),
+        maxNumStillBuffers(kDefaultMaxNumStillBuffer),
         depthEnabled(false),
+        scaleFilter(ScaleFilter::NONE),
+        dmaBufEnabled(false),
+        offlineBufferBudget(0),
+        probeCacheDir(kDefaultProbeCacheDir),
         orientation(kDefaultOrientation) {
     fpsLimits.push_back({/*Size*/{ 640,  480}, /*FPS upper bound*/30.0});
     fpsLimits.push_back({/*Size*/{1280,  720}, /*FPS upper bound*/7.5});
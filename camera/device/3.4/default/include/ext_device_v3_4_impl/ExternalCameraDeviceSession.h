@@ -20,12 +20,18 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android/hardware/camera/device/3.4/ICameraDeviceSession.h>
 #include <fmq/MessageQueue.h>
+#include <halmetrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <include/convert.h>
+#include <array>
+#include <linux/videodev2.h>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <list>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include "CameraMetadata.h"
@@ -127,6 +133,7 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
         virtual bool threadLoop() override;
 
         void setExifMakeModel(const std::string& make, const std::string& model);
+        void setScaleFilter(ExternalCameraConfig::ScaleFilter filter);
 
         // The remaining request list is returned for offline processing
         std::list<std::shared_ptr<HalRequest>> switchToOffline();
@@ -156,6 +163,61 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
         int createJpegLocked(HalStreamBuffer &halBuf,
                 const common::V1_0::helper::CameraMetadata& settings);
 
+        // The main and thumbnail images of a JPEG output, and what is needed to encode them
+        struct JpegJob {
+            std::shared_ptr<HalRequest> req;
+            HalStreamBuffer* halBuf;
+            const common::V1_0::helper::CameraMetadata* setting;
+            int jpegQuality;
+            int thumbQuality;
+            Size jpegSize;
+            Size thumbSize;
+            bool outputThumbnail;
+            ssize_t maxJpegCodeSize;
+            YCbCrLayout yu12Main;
+            YCbCrLayout yu12Thumb;
+            // Copies of the main and thumbnail images when they are encoded after the
+            // intermediate buffers are reused
+            sp<AllocatedFrame> mainFrame;
+            sp<AllocatedFrame> thumbFrame;
+        };
+
+        // Crops and scales the main and thumbnail images, copying them out of the intermediate
+        // buffers if copyImages is set
+        int prepareJpegLocked(HalStreamBuffer &halBuf,
+                const common::V1_0::helper::CameraMetadata& settings, bool copyImages,
+                JpegJob* job);
+        // Encodes the images of the job into its output buffer, without intermediate buffers
+        int encodeJpeg(JpegJob& job);
+
+        // Decodes the MJPEG input frame into the output buffer of the V4L2 frame size
+        int decodeToOutputLocked(HalStreamBuffer& halBuf, const uint8_t* inData,
+                size_t inDataSize);
+        // Crops and scales mYu12Frame to the size of the output buffers, and converts it into
+        // each of them
+        int processOutputGroupLocked(const Size& sz, const std::vector<HalStreamBuffer*>& bufs);
+        // Crops and scales mYu12Frame straight into the output buffer when scaling is needed and
+        // no intermediate frame of the size was filled yet. Sets scaled if it did.
+        int scaleToOutputLocked(const Size& sz, HalStreamBuffer& halBuf, bool* scaled);
+
+        // Runs the tasks on the output workers and the calling thread, returning the first
+        // non-zero task result
+        int runTasks(std::vector<std::function<int()>>& tasks);
+        void outputWorkerLoop();
+
+        // Queues the request to be returned after the requests before it, once its JPEG outputs
+        // are encoded on the JPEG thread
+        void submitResult(const std::shared_ptr<HalRequest>& req, std::vector<JpegJob>& jpegJobs);
+        void jpegThreadLoop();
+        // Returns the requests at the front of mPendingResults with no JPEG output left to encode.
+        // Expects mResultLock to be held.
+        void returnResultsLocked();
+        void waitForPendingResults();
+        void stopOutputWorkers();
+
+        // Decodes the MJPEG input frame into mYu12Frame
+        int decodeToYu12Locked(const uint8_t* inData, size_t inDataSize);
+
         void clearIntermediateBuffers();
 
         const wp<OutputThreadInterface> mParent;
@@ -174,17 +236,54 @@ struct ExternalCameraDeviceSession : public virtual RefBase,
         // (MJPG decode)-> mYu12Frame
         // (Scale)-> mScaledYu12Frames
         // (Format convert) -> output gralloc frames
+        // or for a single YUV output of a scaled size
+        // (Scale and format convert) -> output gralloc frame
+        // or for a single YUV output of the V4L2 frame size
+        // (MJPG decode)-> output gralloc frame
         mutable std::mutex mBufferLock; // Protect access to intermediate buffers
+        std::unique_ptr<JpegDecoder> mJpegDecoder;
         sp<AllocatedFrame> mYu12Frame;
         sp<AllocatedFrame> mYu12ThumbFrame;
         std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
         std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
+        std::mutex mScaledYu12FramesLock; // Protect mScaledYu12Frames from the output workers
         YCbCrLayout mYu12FrameLayout;
         YCbCrLayout mYu12ThumbFrameLayout;
         uint32_t mBlobBufferSize = 0; // 0 -> HAL derive buffer size, else: use given size
 
         std::string mExifMake;
         std::string mExifModel;
+        // EXIF generator, created on the first JPEG with a template of the tags from the make,
+        // model and camera characteristics
+        std::mutex mExifLock;
+        std::unique_ptr<ExifUtils> mExifUtils;
+        ExternalCameraConfig::ScaleFilter mScaleFilter = ExternalCameraConfig::ScaleFilter::NONE;
+
+        // Output buffers of different sizes are processed in parallel by the output workers,
+        // started on first use
+        static const int kOutputWorkerCount = 2;
+        std::mutex mTaskLock;
+        std::condition_variable mTaskCond;     // signaled when a task is queued or on exit
+        std::condition_variable mTaskDoneCond; // signaled when the tasks of a request are done
+        std::deque<std::function<void()>> mTasks;
+        std::vector<std::thread> mOutputWorkers;
+        bool mOutputWorkersExiting = false;
+
+        // JPEG outputs are encoded on the JPEG thread, so that the following requests are
+        // processed meanwhile. Requests are returned in order from mPendingResults.
+        struct PendingResult {
+            std::shared_ptr<HalRequest> req;
+            size_t pendingJpegCount;
+            bool failed;
+        };
+        std::mutex mResultLock; // Protect mPendingResults and mJpegJobs, held while returning
+        std::condition_variable mJpegCond;       // signaled when a JPEG job is queued or on exit
+        std::condition_variable mResultDoneCond; // signaled when pending results are returned
+        std::list<PendingResult> mPendingResults;
+        std::deque<JpegJob> mJpegJobs;
+        std::thread mJpegThread;
+        bool mJpegThreadExiting = false;
+        bool mOutputFailed = false; // a device error was sent from the JPEG thread
     };
 
 protected:
@@ -244,6 +343,10 @@ protected:
     virtual void notifyError(uint32_t frameNumber, int32_t streamId, ErrorCode ec) override;
     // End of OutputThreadInterface methods
 
+    // Stops counting the session as open, once it no longer captures. Expects mInterfaceLock to
+    // be held.
+    void markSessionInactiveLocked();
+
     Status constructDefaultRequestSettingsRaw(RequestTemplate type,
             V3_2::CameraMetadata *outMetadata);
 
@@ -265,10 +368,20 @@ protected:
     int configureV4l2StreamLocked(const SupportedV4L2Format& fmt, double fps = 0.0);
     int v4l2StreamOffLocked();
     int setV4l2FpsLocked(double fps);
+    // Allocates the DMA-BUF capture buffers, or keeps the current ones if they fit
+    int allocateV4l2DmaBuffersLocked(uint32_t count, size_t size);
+    void freeV4l2DmaBuffersLocked();
+    // Fills the memory type of the buffer, and the DMA-BUF of its index when capturing to DMA-BUFs
+    void setV4l2BufferMemory(v4l2_buffer* buffer);
     static Status isStreamCombinationSupported(const V3_2::StreamConfiguration& config,
             const std::vector<SupportedV4L2Format>& supportedFormats,
             const ExternalCameraConfig& devCfg);
 
+    // Counts the frames the device dropped before the dequeued buffer, and adapts the buffer
+    // count at the end of each window of frames. Called with mLock hold
+    void updateV4l2BufferStatsLocked(const v4l2_buffer& buffer);
+    void adaptV4l2BufferCountLocked();
+
     // TODO: change to unique_ptr for better tracking
     sp<V4L2Frame> dequeueV4l2FrameLocked(/*out*/nsecs_t* shutterTs); // Called with mLock hold
     void enqueueV4l2Frame(const sp<V4L2Frame>&);
@@ -335,8 +448,22 @@ protected:
     bool mInitialized = false;
     bool mInitFail = false;
     bool mFirstRequest = false;
+    // Counted by registerOpenSession() between a successful init and close() or a switch to
+    // offline processing
+    bool mCountedAsOpen = false;
     common::V1_0::helper::CameraMetadata mLatestReqSetting;
 
+    // The result metadata of a request is built on a copy of its settings. Buffers of sent
+    // results are kept here and reused for the next requests, with room for the tags of the last
+    // result so that filling a result neither allocates nor reallocates.
+    static const size_t kMaxFreeResultMetadata = 8;
+    std::mutex mResultMetadataLock;
+    std::vector<common::V1_0::helper::CameraMetadata> mFreeResultMetadata;
+    size_t mResultEntryCount = 0;
+    size_t mResultDataCount = 0;
+    void prepareResultMetadata(common::V1_0::helper::CameraMetadata* setting);
+    void recycleResultMetadata(common::V1_0::helper::CameraMetadata* result);
+
     bool mV4l2Streaming = false;
     SupportedV4L2Format mV4l2StreamingFmt;
     double mV4l2StreamingFps = 0.0;
@@ -348,6 +475,55 @@ protected:
     size_t mNumDequeuedV4l2Buffers = 0;
     uint32_t mMaxV4L2BufferSize = 0;
 
+    // Time requests waited for a V4L2 buffer
+    metrics::Histogram mV4l2Starvation;
+    uint64_t mNumDroppedV4l2Frames = 0; // protected by mV4l2BufferLock
+
+    // Time spent by the results in each processing stage, from the V4L2 dequeue to the result
+    // callback, and end to end. Recorded when the result is sent. A frame decoded straight into
+    // its output buffer counts the wait for that buffer in the decode stage.
+    enum LatencyStage {
+        STAGE_QUEUE,    // dequeued until picked by the output thread
+        STAGE_DECODE,   // MJPEG decode
+        STAGE_CONVERT,  // waiting for output buffers, scaling and color conversion
+        STAGE_JPEG,     // JPEG encode
+        STAGE_RESULT,   // waiting for the earlier results and sending the result
+        STAGE_TOTAL,
+        NUM_LATENCY_STAGES
+    };
+    std::array<metrics::Histogram, NUM_LATENCY_STAGES> mLatency;
+    void recordLatency(const std::shared_ptr<HalRequest>& req);
+
+    // Adaptation of the V4L2 buffer count, protected by mLock. At the end of each window of
+    // kV4l2BufferAdaptFrames frames, the count of the current fps class grows by one if requests
+    // waited for buffers or the device dropped frames in more than kV4l2BufferAdaptThreshold
+    // frames, or shrinks by one if the HAL never held more than all but two buffers, within the
+    // bounds of the config. The stream is reconfigured with the new count at the next request.
+    static const uint32_t kV4l2BufferAdaptFrames = 90;
+    static const uint32_t kV4l2BufferAdaptThreshold = 2;
+    uint32_t mNumVideoBuffers;
+    uint32_t mNumStillBuffers;
+    bool mV4l2BufferCountIsVideo = false;
+    bool mV4l2BufferCountChanged = false;
+    uint32_t mAdaptNumFrames = 0;
+    uint32_t mAdaptNumStarved = 0;
+    uint32_t mAdaptNumDropped = 0;
+    size_t mAdaptMaxDequeued = 0;
+    bool mHasV4l2Sequence = false;
+    uint32_t mLastV4l2Sequence = 0;
+
+    // V4L2_MEMORY_MMAP, or V4L2_MEMORY_DMABUF when enabled by the config and supported by the
+    // device. Only changed in configureV4l2StreamLocked, while no V4L2 buffer is dequeued.
+    uint32_t mV4l2MemoryType = V4L2_MEMORY_MMAP;
+    struct V4l2DmaBuffer {
+        unique_fd fd;
+        uint8_t* data;
+        size_t size;
+    };
+    // Capture buffers allocated from ION and mapped once, kept across stream configurations
+    // with the same buffer count and size. Freed in close().
+    std::vector<V4l2DmaBuffer> mV4l2DmaBuffers;
+
     // Not protected by mLock (but might be used when mLock is locked)
     sp<OutputThread> mOutputThread;
 
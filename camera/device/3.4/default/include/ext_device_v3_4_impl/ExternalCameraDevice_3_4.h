@@ -99,7 +99,8 @@ protected:
             const std::string& cameraId,
             unique_fd v4l2Fd);
 
-    // Init supported w/h/format/fps in mSupportedFormats. Caller still owns fd
+    // Init supported w/h/format/fps in mSupportedFormats, from the probe cache if the device is
+    // cached. Caller still owns fd
     void initSupportedFormatsLocked(int fd);
 
     // Calls into virtual member function. Do not use it in constructor
@@ -127,16 +128,17 @@ protected:
 
     bool calculateMinFps(::android::hardware::camera::common::V1_0::helper::CameraMetadata*);
 
-    static void getFrameRateList(int fd, double fpsUpperBound, SupportedV4L2Format* format);
+    // Keeps the frame rates of the format up to fpsUpperBound
+    static void getFrameRateList(double fpsUpperBound, SupportedV4L2Format* format);
 
-    static void updateFpsBounds(int fd, CroppingType cropType,
+    static void updateFpsBounds(CroppingType cropType,
             const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
             SupportedV4L2Format format,
             std::vector<SupportedV4L2Format>& outFmts);
 
-    // Get candidate supported formats list of input cropping type.
+    // Get candidate supported formats list of input cropping type from the probed formats.
     static std::vector<SupportedV4L2Format> getCandidateSupportedFormatsLocked(
-            int fd, CroppingType cropType,
+            const std::vector<SupportedV4L2Format>& probedFormats, CroppingType cropType,
             const std::vector<ExternalCameraConfig::FpsLimitation>& fpsLimits,
             const std::vector<ExternalCameraConfig::FpsLimitation>& depthFpsLimits,
             const Size& minStreamSize,
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMPROBECACHE_H
+#define ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMPROBECACHE_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ExternalCameraUtils.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+/**
+ * Caches what the V4L2 ioctls of the external cameras enumerate, which can take over a second
+ * on some UVC devices: the frame sizes of the supported fourccs and all of their discrete frame
+ * rates, before any filtering by the config.
+ *
+ * Devices are keyed by their USB vendor and product ids and firmware version (bcdDevice), so
+ * the probe of a model is shared by its devices and survives replugs. Probes are kept in memory
+ * for the process, and in a file per key in the cache directory of the config so that they
+ * survive restarts. A probe loaded from a file is served until revalidate() compares it to the
+ * device.
+ */
+class ExternalCameraProbeCache {
+public:
+    static ExternalCameraProbeCache& getInstance();
+
+    // Enumerates the formats of the device. Caller still owns fd
+    static std::vector<SupportedV4L2Format> probe(int fd);
+
+    // Gets the probe of the device at devicePath from the cache. Returns false if the device is
+    // not cached or is not a USB device.
+    bool lookup(const std::string& devicePath, const std::string& cacheDir,
+            std::vector<SupportedV4L2Format>* out);
+
+    // Caches the probe of the device at devicePath, as read from the device
+    void store(const std::string& devicePath, const std::string& cacheDir,
+            const std::vector<SupportedV4L2Format>& probe);
+
+    // Whether the probe of the device was loaded from a file and not compared to the device yet
+    bool needsRevalidation(const std::string& devicePath);
+
+    // Probes the device again and caches the result. Returns true if it differs from the probe
+    // that was served from the cache.
+    bool revalidate(const std::string& devicePath, const std::string& cacheDir);
+
+private:
+    ExternalCameraProbeCache() = default;
+
+    // "<idVendor>_<idProduct>_<bcdDevice>", or empty for devices not on USB
+    static std::string getDeviceKey(const std::string& devicePath);
+    static std::string getCachePath(const std::string& cacheDir, const std::string& key);
+    static bool readProbe(const std::string& path, std::vector<SupportedV4L2Format>* out);
+    static bool writeProbe(const std::string& path, const std::vector<SupportedV4L2Format>& probe);
+    static bool isSameProbe(const std::vector<SupportedV4L2Format>& a,
+            const std::vector<SupportedV4L2Format>& b);
+
+    struct Entry {
+        std::vector<SupportedV4L2Format> probe;
+        bool validated;
+    };
+
+    std::mutex mLock;
+    std::unordered_map<std::string, Entry> mEntries; // device key -> probe
+};
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMPROBECACHE_H
@@ -21,7 +21,9 @@
 #include <android/hardware/camera/device/3.2/types.h>
 #include <android/hardware/graphics/common/1.0/types.h>
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
+#include <array>
 #include <inttypes.h>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -86,9 +88,23 @@ struct ExternalCameraConfig {
     // Size of v4l2 buffer queue when streaming > kMaxVideoSize
     uint32_t numStillBuffers;
 
+    // Bounds the session may grow the v4l2 buffer queues to when requests wait for buffers or
+    // the device drops frames. Equal to the initial sizes to disable the adaptation.
+    uint32_t maxNumVideoBuffers;
+    uint32_t maxNumStillBuffers;
+
     // Indication that the device connected supports depth output
     bool depthEnabled;
 
+    // Filter of the scaling to the output sizes, from fastest to smoothest, in the order of
+    // libyuv::FilterMode
+    enum class ScaleFilter : uint8_t { NONE, LINEAR, BILINEAR, BOX };
+    ScaleFilter scaleFilter;
+
+    // Capture into buffers allocated by the HAL and imported by the V4L2 driver as DMA-BUFs,
+    // instead of mapping the driver buffers for each frame
+    bool dmaBufEnabled;
+
     struct FpsLimitation {
         Size size;
         double fpsUpperBound;
@@ -99,6 +115,14 @@ struct ExternalCameraConfig {
     // Minimum output stream size
     Size minStreamSize;
 
+    // Bytes of intermediate buffers an offline session may keep across its requests, or 0 for no
+    // limit. Beyond it, the buffers of each offline request are allocated for that request only.
+    size_t offlineBufferBudget;
+
+    // Directory of the persistent cache of the V4L2 formats probed from the devices, or empty
+    // to only cache them in memory
+    std::string probeCacheDir;
+
     // The value of android.sensor.orientation
     int32_t orientation;
 
@@ -145,6 +169,10 @@ class V4L2Frame : public Frame {
 public:
     V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd,
               uint32_t dataSize, uint64_t offset);
+    // A frame of a DMA-BUF capture buffer already mapped by the HAL. CPU access to the data
+    // between map and unmap is synchronized with the device through the DMA-BUF fd.
+    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int dmaBufFd,
+              uint8_t* mappedData, uint32_t dataSize);
     ~V4L2Frame() override;
 
     virtual int getData(uint8_t** outData, size_t* dataSize) override;
@@ -154,7 +182,8 @@ public:
     int unmap();
 private:
     std::mutex mLock;
-    const int mFd; // used for mmap but doesn't claim ownership
+    const int mFd; // used for mmap (or DMA-BUF sync) but doesn't claim ownership
+    const bool mIsDmaBuf = false;
     const size_t mDataSize;
     const uint64_t mOffset; // used for mmap
     uint8_t* mData = nullptr;
@@ -209,6 +238,14 @@ struct HalRequest {
     sp<Frame> frameIn;
     nsecs_t shutterTs;
     std::vector<HalStreamBuffer> buffers;
+
+    // Times a request went through its processing stages, for the latency stats in dumpState. The
+    // stages a request skips (no MJPEG decode, no JPEG output) keep the time of the previous one.
+    nsecs_t dequeueTime = 0;
+    nsecs_t processStartTime = 0;
+    nsecs_t decodeDoneTime = 0;
+    nsecs_t convertDoneTime = 0;
+    nsecs_t jpegDoneTime = 0;
 };
 
 static const uint64_t BUFFER_ID_NO_BUFFER = 0;
@@ -242,6 +279,45 @@ int getCropRect(CroppingType ct, const Size& inSize,
 
 int formatConvert(const YCbCrLayout& in, const YCbCrLayout& out, Size sz, uint32_t format);
 
+using ::android::hardware::camera::external::common::ExternalCameraConfig;
+// Scales the YU12 input into the output layout of the given format in a single pass, without an
+// intermediate YU12 image of the output size. For NV12/NV21 the scaled chroma planes go through
+// the chroma planes of the scratch layout, which must be of the output size.
+// Returns -EINVAL for the formats not supported.
+int scaleAndConvert(const YCbCrLayout& in, Size inSz, const YCbCrLayout& out, Size outSz,
+        uint32_t format, ExternalCameraConfig::ScaleFilter filter, const YCbCrLayout& scratch);
+
+    uint64_t count = 0;
+    nsecs_t totalNs = 0;
+    nsecs_t maxNs = 0;
+
+    void add(nsecs_t duration);
+    // Prints one line per bucket, or nothing if no duration was added
+    void dump(int fd) const;
+};
+
+// Counts the external camera sessions open in the process. Offline sessions yield to them, so
+// that a camera reopened after a burst does not compete with finishing the offline captures.
+void registerOpenSession();
+void unregisterOpenSession();
+// Waits up to timeout for no session to be open. Returns false if one still is.
+bool waitForNoOpenSession(nsecs_t timeout);
+
+// Decodes MJPEG frames straight into a locked output buffer of the same size
+class JpegDecoder {
+public:
+    virtual ~JpegDecoder() {}
+
+    // Returns non-zero if the frame cannot be decoded into the output format, in which case the
+    // output buffer content is undefined
+    virtual int decode(const uint8_t* inData, size_t inDataSize, Size sz,
+            const YCbCrLayout& out, uint32_t outFourcc) = 0;
+};
+
+// Returns the JPEG decoder used by the output thread. The default one decodes to the planar
+// formats with libyuv; a device with a hardware JPEG decoder plugs it in here.
+std::unique_ptr<JpegDecoder> createJpegDecoder();
+
 int encodeJpegYU12(const Size &inSz,
         const YCbCrLayout& inLayout, int jpegQuality,
         const void *app1Buffer, size_t app1Size,
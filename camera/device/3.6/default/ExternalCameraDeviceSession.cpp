@@ -312,7 +312,7 @@ Status ExternalCameraDeviceSession::switchToOffline(const hidl_vec<int32_t>& off
     }
     sp<ExternalCameraOfflineSession> sessionImpl = new ExternalCameraOfflineSession(
             mCroppingType, mCameraCharacteristics, mCameraId,
-            mExifMake, mExifModel, mBlobBufferSize, afTrigger,
+            mExifMake, mExifModel, mBlobBufferSize, mCfg.offlineBufferBudget, afTrigger,
             streamInfos, offlineReqs, circulatingBuffers);
 
     bool initFailed = sessionImpl->initialize();
@@ -342,6 +342,8 @@ Status ExternalCameraDeviceSession::switchToOffline(const hidl_vec<int32_t>& off
         ALOGE("%s: stop V4L2 streaming failed!", __FUNCTION__);
         return Status::INTERNAL_ERROR;
     }
+    // The offline session must not yield to this session, which no longer captures
+    markSessionInactiveLocked();
 
     // No need to return session if there is no offline requests left
     if (offlineReqs.size() != 0) {
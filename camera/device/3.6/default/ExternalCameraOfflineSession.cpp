@@ -53,13 +53,15 @@ ExternalCameraOfflineSession::ExternalCameraOfflineSession(
         const std::string& exifMake,
         const std::string& exifModel,
         const uint32_t blobBufferSize,
+        const size_t bufferBudget,
         const bool afTrigger,
         const hidl_vec<Stream>& offlineStreams,
         std::deque<std::shared_ptr<HalRequest>>& offlineReqs,
         const std::map<int, CirculatingBuffers>& circulatingBuffers) :
         mCroppingType(croppingType), mChars(chars), mCameraId(cameraId),
         mExifMake(exifMake), mExifModel(exifModel), mBlobBufferSize(blobBufferSize),
-        mAfTrigger(afTrigger), mOfflineStreams(offlineStreams), mOfflineReqs(offlineReqs),
+        mBufferBudget(bufferBudget), mAfTrigger(afTrigger), mOfflineStreams(offlineStreams),
+        mOfflineReqs(offlineReqs),
         mCirculatingBuffers(circulatingBuffers) {}
 
 ExternalCameraOfflineSession::~ExternalCameraOfflineSession() {
@@ -82,9 +84,11 @@ void ExternalCameraOfflineSession::initOutputThread() {
         return;
     }
 
+    // Offline processing runs in the background, so that it does not compete with the sessions
+    // opened meanwhile
     mBufferRequestThread = new ExternalCameraDeviceSession::BufferRequestThread(
             this, mCallback);
-    mBufferRequestThread->run("ExtCamBufReq", PRIORITY_DISPLAY);
+    mBufferRequestThread->run("ExtCamBufReq", PRIORITY_BACKGROUND);
 
     mOutputThread = new OutputThread(this, mCroppingType, mChars,
             mBufferRequestThread, mOfflineReqs);
@@ -93,10 +97,43 @@ void ExternalCameraOfflineSession::initOutputThread() {
 
     Size inputSize = { mOfflineReqs[0]->frameIn->mWidth, mOfflineReqs[0]->frameIn->mHeight};
     Size maxThumbSize = V3_4::implementation::getMaxThumbnailResolution(mChars);
-    mOutputThread->allocateIntermediateBuffers(
-            inputSize, maxThumbSize, mOfflineStreams, mBlobBufferSize);
+    if (mBufferBudget != 0 && getIntermediateBufferBytes(inputSize, maxThumbSize) > mBufferBudget) {
+        ALOGI("%s: intermediate buffers over the %zu bytes budget, allocating them per request",
+                __FUNCTION__, mBufferBudget);
+        mOutputThread->setPerRequestBuffers(inputSize, maxThumbSize, mBlobBufferSize);
+        mOutputThread->allocateIntermediateBuffers(
+                inputSize, maxThumbSize, hidl_vec<Stream>(), mBlobBufferSize);
+    } else {
+        mOutputThread->allocateIntermediateBuffers(
+                inputSize, maxThumbSize, mOfflineStreams, mBlobBufferSize);
+    }
+
+    mOutputThread->run("ExtCamOfflnOut", PRIORITY_BACKGROUND);
+}
 
-    mOutputThread->run("ExtCamOfflnOut", PRIORITY_DISPLAY);
+size_t ExternalCameraOfflineSession::getIntermediateBufferBytes(
+        const Size& inputSize, const Size& thumbSize) const {
+    // YU12 frames of the input size, the thumbnail size and each other stream size
+    auto yu12Bytes = [](const Size& sz) {
+        return static_cast<size_t>(sz.width) * sz.height * 3 / 2;
+    };
+    size_t bytes = yu12Bytes(inputSize) + yu12Bytes(thumbSize);
+    std::unordered_set<Size, SizeHasher> sizes;
+    for (const auto& stream : mOfflineStreams) {
+        Size sz = {stream.width, stream.height};
+        if (!(sz == inputSize) && sizes.insert(sz).second) {
+            bytes += yu12Bytes(sz);
+        }
+    }
+    return bytes;
+}
+
+void ExternalCameraOfflineSession::OutputThread::setPerRequestBuffers(
+        const Size& inputSize, const Size& thumbSize, uint32_t blobBufferSize) {
+    mPerRequestBuffers = true;
+    mInputSize = inputSize;
+    mThumbSize = thumbSize;
+    mPerRequestBlobBufferSize = blobBufferSize;
 }
 
 bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
@@ -108,9 +145,16 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
 
     if (mOfflineReqs.empty()) {
         ALOGI("%s: all offline requests are processed. Stopping.", __FUNCTION__);
+        // Nothing left to use them until the session is closed
+        clearIntermediateBuffers();
         return false;
     }
 
+    // Let a session opened meanwhile, like the camera reopened after a burst, go first
+    if (!V3_4::implementation::waitForNoOpenSession(kOpenSessionYieldTime)) {
+        ALOGV("%s: processing the next request with a session open", __FUNCTION__);
+    }
+
     std::shared_ptr<HalRequest> req = mOfflineReqs.front();
     mOfflineReqs.pop_front();
 
@@ -136,6 +180,20 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
         return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
     }
 
+    if (mPerRequestBuffers) {
+        // Only the sizes of this request are kept, the others are freed
+        hidl_vec<Stream> streams;
+        streams.resize(req->buffers.size());
+        for (size_t i = 0; i < req->buffers.size(); i++) {
+            streams[i].width = req->buffers[i].width;
+            streams[i].height = req->buffers[i].height;
+        }
+        if (allocateIntermediateBuffers(mInputSize, mThumbSize, streams,
+                mPerRequestBlobBufferSize) != Status::OK) {
+            return onDeviceError("%s: failed to allocate intermediate buffers!", __FUNCTION__);
+        }
+    }
+
     std::unique_lock<std::mutex> lk(mBufferLock);
     // Convert input V4L2 frame to YU12 of the same size
     // TODO: see if we can save some computation by converting to YV12 here
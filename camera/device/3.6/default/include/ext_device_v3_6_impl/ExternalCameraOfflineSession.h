@@ -95,6 +95,7 @@ struct ExternalCameraOfflineSession : public virtual RefBase,
             const std::string& exifMake,
             const std::string& exifModel,
             uint32_t blobBufferSize,
+            size_t bufferBudget,
             bool afTrigger,
             const hidl_vec<Stream>& offlineStreams,
             std::deque<std::shared_ptr<HalRequest>>& offlineReqs,
@@ -140,10 +141,23 @@ protected:
                         parent, ct, chars, bufReqThread),
                 mOfflineReqs(offlineReqs) {}
 
+        // Allocates the intermediate buffers of each request before processing it, instead of
+        // keeping those of all the offline streams
+        void setPerRequestBuffers(const Size& inputSize, const Size& thumbSize,
+                uint32_t blobBufferSize);
+
         virtual bool threadLoop() override;
 
     protected:
+        // How long the processing of a request waits for the open sessions to be closed
+        static constexpr nsecs_t kOpenSessionYieldTime = 50000000; // 50ms
+
         std::deque<std::shared_ptr<HalRequest>> mOfflineReqs;
+
+        bool mPerRequestBuffers = false;
+        Size mInputSize;
+        Size mThumbSize;
+        uint32_t mPerRequestBlobBufferSize = 0;
     }; // OutputThread
 
 
@@ -156,6 +170,9 @@ protected:
 
     void initOutputThread();
 
+    // Bytes of the intermediate buffers of all the offline streams
+    size_t getIntermediateBufferBytes(const Size& inputSize, const Size& thumbSize) const;
+
     void invokeProcessCaptureResultCallback(
             hidl_vec<CaptureResult> &results, bool tryWriteFmq);
 
@@ -175,6 +192,7 @@ protected:
     const std::string mExifMake;
     const std::string mExifModel;
     const uint32_t mBlobBufferSize;
+    const size_t mBufferBudget;
 
     std::mutex mAfTriggerLock; // protect mAfTrigger
     bool mAfTrigger;
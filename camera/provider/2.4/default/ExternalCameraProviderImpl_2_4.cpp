@@ -18,7 +18,10 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include <algorithm>
+#include <atomic>
 #include <regex>
+#include <thread>
 #include <sys/inotify.h>
 #include <errno.h>
 #include <linux/videodev2.h>
@@ -27,6 +30,7 @@
 #include "ExternalCameraDevice_3_4.h"
 #include "ExternalCameraDevice_3_5.h"
 #include "ExternalCameraDevice_3_6.h"
+#include "ExternalCameraProbeCache.h"
 
 namespace android {
 namespace hardware {
@@ -228,24 +232,24 @@ void ExternalCameraProviderImpl_2_4::addExternalCamera(const char* devName) {
     }
 }
 
-void ExternalCameraProviderImpl_2_4::deviceAdded(const char* devName) {
+bool ExternalCameraProviderImpl_2_4::probeDevice(const char* devName) {
     {
         base::unique_fd fd(::open(devName, O_RDWR));
         if (fd.get() < 0) {
             ALOGE("%s open v4l2 device %s failed:%s", __FUNCTION__, devName, strerror(errno));
-            return;
+            return false;
         }
 
         struct v4l2_capability capability;
         int ret = ioctl(fd.get(), VIDIOC_QUERYCAP, &capability);
         if (ret < 0) {
             ALOGE("%s v4l2 QUERYCAP %s failed", __FUNCTION__, devName);
-            return;
+            return false;
         }
 
         if (!(capability.device_caps & V4L2_CAP_VIDEO_CAPTURE)) {
             ALOGW("%s device %s does not support VIDEO_CAPTURE", __FUNCTION__, devName);
-            return;
+            return false;
         }
     }
     // See if we can initialize ExternalCameraDevice correctly
@@ -253,14 +257,68 @@ void ExternalCameraProviderImpl_2_4::deviceAdded(const char* devName) {
             new device::V3_4::implementation::ExternalCameraDevice(devName, mCfg);
     if (deviceImpl == nullptr || deviceImpl->isInitFailed()) {
         ALOGW("%s: Attempt to init camera device %s failed!", __FUNCTION__, devName);
-        return;
+        return false;
+    }
+    return true;
+}
+
+void ExternalCameraProviderImpl_2_4::devicesAdded(std::vector<std::string> devNames) {
+    auto nodeNumber = [](const std::string& devName) {
+        return std::atoi(devName.c_str() + strlen(kDevicePath) + kPrefixLen);
+    };
+    std::sort(devNames.begin(), devNames.end(),
+            [&](const std::string& a, const std::string& b) {
+                return nodeNumber(a) < nodeNumber(b);
+            });
+
+    // Each worker takes the next device to probe until none is left
+    std::vector<char> usable(devNames.size(), false);
+    std::atomic<size_t> next(0);
+    auto probeNext = [&]() {
+        for (size_t i = next++; i < devNames.size(); i = next++) {
+            usable[i] = probeDevice(devNames[i].c_str());
+        }
+    };
+    std::vector<std::thread> workers;
+    size_t numWorkers = std::min(devNames.size(), kMaxProbeThreads);
+    for (size_t i = 1; i < numWorkers; i++) {
+        workers.emplace_back(probeNext);
+    }
+    probeNext();
+    for (auto& worker : workers) {
+        worker.join();
     }
-    deviceImpl.clear();
 
+    for (size_t i = 0; i < devNames.size(); i++) {
+        if (usable[i]) {
+            deviceAdded(devNames[i].c_str());
+        }
+    }
+}
+
+void ExternalCameraProviderImpl_2_4::deviceAdded(const char* devName) {
     addExternalCamera(devName);
+    if (device::V3_4::implementation::ExternalCameraProbeCache::getInstance()
+            .needsRevalidation(devName)) {
+        mPendingRevalidations.push_back(devName);
+    }
     return;
 }
 
+void ExternalCameraProviderImpl_2_4::revalidateDevices() {
+    for (const auto& devName : mPendingRevalidations) {
+        bool changed = device::V3_4::implementation::ExternalCameraProbeCache::getInstance()
+                .revalidate(devName, mCfg.probeCacheDir);
+        if (changed) {
+            // Have the framework query the characteristics again
+            ALOGI("%s: re-adding %s with its new formats", __FUNCTION__, devName.c_str());
+            deviceRemoved(devName.c_str());
+            addExternalCamera(devName.c_str());
+        }
+    }
+    mPendingRevalidations.clear();
+}
+
 void ExternalCameraProviderImpl_2_4::deviceRemoved(const char* devName) {
     Mutex::Autolock _l(mLock);
     std::string deviceName;
@@ -299,6 +357,7 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
         return false;
     }
 
+    std::vector<std::string> existingDevices;
     struct dirent* de;
     while ((de = readdir(devdir)) != 0) {
         // Find external v4l devices that's existing before we start watching and add them
@@ -311,11 +370,14 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                 char v4l2DevicePath[kMaxDevicePathLen];
                 snprintf(v4l2DevicePath, kMaxDevicePathLen,
                         "%s%s", kDevicePath, de->d_name);
-                mParent->deviceAdded(v4l2DevicePath);
+                existingDevices.push_back(v4l2DevicePath);
             }
         }
     }
     closedir(devdir);
+    mParent->devicesAdded(std::move(existingDevices));
+    // Cameras served from the probe cache are already added, check their formats now
+    mParent->revalidateDevices();
 
     // Watch new video devices
     mINotifyFD = inotify_init();
@@ -338,6 +400,9 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
         int offset = 0;
         int ret = read(mINotifyFD, eventBuf, sizeof(eventBuf));
         if (ret >= (int)sizeof(struct inotify_event)) {
+            // Devices created together, e.g. the cameras of a hub, are probed together. A removal
+            // first adds the devices created before it.
+            std::vector<std::string> createdDevices;
             while (offset < ret) {
                 struct inotify_event* event = (struct inotify_event*)&eventBuf[offset];
                 if (event->wd == mWd) {
@@ -348,9 +413,11 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                             snprintf(v4l2DevicePath, kMaxDevicePathLen,
                                     "%s%s", kDevicePath, event->name);
                             if (event->mask & IN_CREATE) {
-                                mParent->deviceAdded(v4l2DevicePath);
+                                createdDevices.push_back(v4l2DevicePath);
                             }
                             if (event->mask & IN_DELETE) {
+                                mParent->devicesAdded(std::move(createdDevices));
+                                createdDevices.clear();
                                 mParent->deviceRemoved(v4l2DevicePath);
                             }
                         }
@@ -358,6 +425,8 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                 }
                 offset += sizeof(struct inotify_event) + event->len;
             }
+            mParent->devicesAdded(std::move(createdDevices));
+            mParent->revalidateDevices();
         }
     }
 
@@ -20,6 +20,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <utils/Mutex.h>
 #include <utils/Thread.h>
 #include <hidl/Status.h>
@@ -79,10 +80,22 @@ private:
 
     void addExternalCamera(const char* devName);
 
+    // Adds a device that passed probeDevice()
     void deviceAdded(const char* devName);
 
+    // Probes the devices in parallel, then adds the usable ones in the order of their node
+    // numbers so that the status callbacks do not depend on which probe finished first
+    void devicesAdded(std::vector<std::string> devNames);
+
+    // Checks the device is a capture device the HAL can initialize. Safe to call concurrently.
+    bool probeDevice(const char* devName);
+
     void deviceRemoved(const char* devName);
 
+    // Probes the cameras added from the probe cache again, and re-adds those whose formats
+    // changed. Called on the hotplug thread.
+    void revalidateDevices();
+
     class HotplugThread : public android::Thread {
     public:
         HotplugThread(ExternalCameraProviderImpl_2_4* parent);
@@ -104,6 +117,9 @@ private:
     const ExternalCameraConfig mCfg;
     HotplugThread mHotPlugThread;
     int mPreferredHal3MinorVersion;
+    static constexpr size_t kMaxProbeThreads = 4;
+    // Devices added from the probe cache, only accessed by the hotplug thread
+    std::vector<std::string> mPendingRevalidations;
 };
 
 
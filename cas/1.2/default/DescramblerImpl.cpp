@@ -17,10 +17,14 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.1-DescramblerImpl"
 
+#include <atomic>
+#include <fcntl.h>
+#include <halfiles/SameFile.h>
 #include <hidlmemory/mapping.h>
 #include <media/cas/DescramblerAPI.h>
 #include <media/hardware/CryptoAPI.h>
 #include <media/stagefright/foundation/AUtils.h>
+#include <unistd.h>
 #include <utils/Log.h>
 
 #include "DescramblerImpl.h"
@@ -77,6 +81,31 @@ Return<bool> DescramblerImpl::requiresSecureDecoderComponent(const hidl_string&
     return holder->requiresSecureDecoderComponent(String8(mime.c_str()));
 }
 
+sp<IMemory> DescramblerImpl::mapSrcMemory(const hidl_memory& heapBase) {
+    const native_handle_t* handle = heapBase.handle();
+    if (handle == nullptr || handle->numFds < 1) {
+        return mapMemory(heapBase);
+    }
+    const int fd = handle->data[0];
+
+    std::lock_guard<std::mutex> lock(mSrcMemLock);
+    if (mSrcMem != nullptr && mSrcMemSize == heapBase.size() && files::isSameFile(mSrcMemFd, fd)) {
+        return mSrcMem;
+    }
+
+    sp<IMemory> srcMem = mapMemory(heapBase);
+    if (srcMem == nullptr) {
+        return srcMem;
+    }
+    if (mSrcMemFd >= 0) {
+        close(mSrcMemFd);
+    }
+    mSrcMemFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    mSrcMemSize = heapBase.size();
+    mSrcMem = mSrcMemFd >= 0 ? srcMem : nullptr;
+    return srcMem;
+}
+
 static inline bool validateRangeForSize(uint64_t offset, uint64_t length, uint64_t size) {
     return isInRange<uint64_t, uint64_t>(0, size, offset, length);
 }
@@ -98,7 +127,7 @@ Return<void> DescramblerImpl::descramble(ScramblingControl scramblingControl,
         return Void();
     }
 
-    sp<IMemory> srcMem = mapMemory(srcBuffer.heapBase);
+    sp<IMemory> srcMem = mapSrcMemory(srcBuffer.heapBase);
 
     // Validate if the offset and size in the SharedBuffer is consistent with the
     // mapped ashmem, since the offset and size is controlled by client.
@@ -185,6 +214,13 @@ Return<Status> DescramblerImpl::release() {
     std::shared_ptr<DescramblerPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    std::lock_guard<std::mutex> lock(mSrcMemLock);
+    mSrcMem.clear();
+    if (mSrcMemFd >= 0) {
+        close(mSrcMemFd);
+        mSrcMemFd = -1;
+    }
+
     return Status::OK;
 }
 
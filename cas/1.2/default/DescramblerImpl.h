@@ -18,8 +18,11 @@
 #define ANDROID_HARDWARE_CAS_V1_1_DESCRAMBLER_IMPL_H_
 
 #include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <media/stagefright/foundation/ABase.h>
 
+#include <mutex>
+
 namespace android {
 struct DescramblerPlugin;
 using namespace hardware::cas::native::V1_0;
@@ -52,9 +55,20 @@ class DescramblerImpl : public IDescrambler {
     virtual Return<Status> release() override;
 
   private:
+    // Returns the mapping of heapBase, reusing the previous one when heapBase is
+    // the same shared memory as in the previous call.
+    sp<::android::hidl::memory::V1_0::IMemory> mapSrcMemory(const hidl_memory& heapBase);
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<DescramblerPlugin> mPluginHolder;
 
+    std::mutex mSrcMemLock;
+    // A dup of the fd mSrcMem was mapped from, to recognize the same heap
+    // when it is passed again.
+    int mSrcMemFd = -1;
+    uint64_t mSrcMemSize = 0;
+    sp<::android::hidl::memory::V1_0::IMemory> mSrcMem;
+
     DISALLOW_EVIL_CONSTRUCTORS(DescramblerImpl);
 };
 
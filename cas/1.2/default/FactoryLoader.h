@@ -22,6 +22,8 @@
 #include <media/cas/CasAPI.h>
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include "SharedLibrary.h"
 
 using namespace std;
@@ -37,9 +39,9 @@ using ::android::hardware::cas::V1_0::HidlCasPluginDescriptor;
 template <class T>
 class FactoryLoader {
   public:
-    FactoryLoader(const char* name) : mFactory(NULL), mCreateFactoryFuncName(name) {}
+    FactoryLoader(const char* name) : mCreateFactoryFuncName(name), mPluginPathsListed(false) {}
 
-    virtual ~FactoryLoader() { closeFactory(); }
+    virtual ~FactoryLoader();
 
     bool findFactoryForScheme(int32_t CA_system_id, sp<SharedLibrary>* library = NULL,
                               T** factory = NULL);
@@ -49,22 +51,39 @@ class FactoryLoader {
   private:
     typedef T* (*CreateFactoryFunc)();
 
+    // An opened plugin library and its factory. Libraries that aren't
+    // plugins are kept with a NULL factory, so they are only tried once.
+    struct LoadedFactory {
+        sp<SharedLibrary> library;
+        T* factory;
+        nsecs_t lastUsed;
+    };
+
+    // Factories unused for this long are deleted, and their library is
+    // closed unless a plugin created from it is still alive.
+    static constexpr nsecs_t kFactoryIdleTimeoutNs = 60 * 1000000000LL;
+
     Mutex mMapLock;
-    T* mFactory;
     const char* mCreateFactoryFuncName;
-    sp<SharedLibrary> mLibrary;
     KeyedVector<int32_t, String8> mCASystemIdToLibraryPathMap;
-    KeyedVector<String8, wp<SharedLibrary>> mLibraryPathToOpenLibraryMap;
-
-    bool loadFactoryForSchemeFromPath(const String8& path, int32_t CA_system_id,
-                                      sp<SharedLibrary>* library, T** factory);
-
-    bool queryPluginsFromPath(const String8& path, vector<HidlCasPluginDescriptor>* results);
-
-    bool openFactory(const String8& path);
-    void closeFactory();
+    KeyedVector<String8, LoadedFactory> mLoadedFactories;
+    // The plugin directory is on the read-only vendor partition, so it is
+    // only listed once.
+    Vector<String8> mPluginPaths;
+    bool mPluginPathsListed;
+
+    bool listPluginPaths();
+    T* getFactory(const String8& path, nsecs_t now, sp<SharedLibrary>* library);
+    void evictIdleFactories(nsecs_t now);
 };
 
+template <class T>
+FactoryLoader<T>::~FactoryLoader() {
+    for (size_t i = 0; i < mLoadedFactories.size(); i++) {
+        delete mLoadedFactories.valueAt(i).factory;
+    }
+}
+
 template <class T>
 bool FactoryLoader<T>::findFactoryForScheme(int32_t CA_system_id, sp<SharedLibrary>* library,
                                             T** factory) {
@@ -77,39 +96,45 @@ bool FactoryLoader<T>::findFactoryForScheme(int32_t CA_system_id, sp<SharedLibra
 
     Mutex::Autolock autoLock(mMapLock);
 
+    const nsecs_t now = systemTime();
+    evictIdleFactories(now);
+
+    sp<SharedLibrary> pluginLibrary;
+    T* pluginFactory = NULL;
+
     // first check cache
     ssize_t index = mCASystemIdToLibraryPathMap.indexOfKey(CA_system_id);
     if (index >= 0) {
-        return loadFactoryForSchemeFromPath(mCASystemIdToLibraryPathMap[index], CA_system_id,
-                                            library, factory);
-    }
-
-    // no luck, have to search
-    String8 dirPath("/vendor/lib/mediacas");
-    DIR* pDir = opendir(dirPath.string());
-
-    if (pDir == NULL) {
-        ALOGE("Failed to open plugin directory %s", dirPath.string());
-        return false;
-    }
-
-    struct dirent* pEntry;
-    while ((pEntry = readdir(pDir))) {
-        String8 pluginPath = dirPath + "/" + pEntry->d_name;
-        if (pluginPath.getPathExtension() == ".so") {
-            if (loadFactoryForSchemeFromPath(pluginPath, CA_system_id, library, factory)) {
-                mCASystemIdToLibraryPathMap.add(CA_system_id, pluginPath);
-                closedir(pDir);
-
-                return true;
+        pluginFactory = getFactory(mCASystemIdToLibraryPathMap[index], now, &pluginLibrary);
+        if (pluginFactory == NULL || !pluginFactory->isSystemIdSupported(CA_system_id)) {
+            return false;
+        }
+    } else {
+        // no luck, have to search
+        if (!listPluginPaths()) {
+            return false;
+        }
+        for (size_t i = 0; i < mPluginPaths.size(); i++) {
+            pluginFactory = getFactory(mPluginPaths[i], now, &pluginLibrary);
+            if (pluginFactory != NULL && pluginFactory->isSystemIdSupported(CA_system_id)) {
+                mCASystemIdToLibraryPathMap.add(CA_system_id, mPluginPaths[i]);
+                break;
             }
+            pluginFactory = NULL;
+        }
+        if (pluginFactory == NULL) {
+            ALOGE("Failed to find plugin");
+            return false;
         }
     }
 
-    closedir(pDir);
-
-    ALOGE("Failed to find plugin");
-    return false;
+    if (library != NULL) {
+        *library = pluginLibrary;
+    }
+    if (factory != NULL) {
+        *factory = pluginFactory;
+    }
+    return true;
 }
 
 template <class T>
@@ -118,94 +143,91 @@ bool FactoryLoader<T>::enumeratePlugins(vector<HidlCasPluginDescriptor>* results
 
     results->clear();
 
-    String8 dirPath("/vendor/lib/mediacas");
-    DIR* pDir = opendir(dirPath.string());
+    Mutex::Autolock autoLock(mMapLock);
 
-    if (pDir == NULL) {
-        ALOGE("Failed to open plugin directory %s", dirPath.string());
+    const nsecs_t now = systemTime();
+    evictIdleFactories(now);
+
+    if (!listPluginPaths()) {
         return false;
     }
 
-    Mutex::Autolock autoLock(mMapLock);
-
-    struct dirent* pEntry;
-    while ((pEntry = readdir(pDir))) {
-        String8 pluginPath = dirPath + "/" + pEntry->d_name;
-        if (pluginPath.getPathExtension() == ".so") {
-            queryPluginsFromPath(pluginPath, results);
+    for (size_t i = 0; i < mPluginPaths.size(); i++) {
+        T* factory = getFactory(mPluginPaths[i], now, NULL);
+        vector<CasPluginDescriptor> descriptors;
+        if (factory == NULL || factory->queryPlugins(&descriptors) != OK) {
+            continue;
+        }
+        for (auto it = descriptors.begin(); it != descriptors.end(); it++) {
+            results->push_back(HidlCasPluginDescriptor{.caSystemId = it->CA_system_id,
+                                                       .name = it->name.c_str()});
         }
     }
     return true;
 }
 
 template <class T>
-bool FactoryLoader<T>::loadFactoryForSchemeFromPath(const String8& path, int32_t CA_system_id,
-                                                    sp<SharedLibrary>* library, T** factory) {
-    closeFactory();
-
-    if (!openFactory(path) || !mFactory->isSystemIdSupported(CA_system_id)) {
-        closeFactory();
-        return false;
+bool FactoryLoader<T>::listPluginPaths() {
+    if (mPluginPathsListed) {
+        return true;
     }
 
-    if (library != NULL) {
-        *library = mLibrary;
-    }
-    if (factory != NULL) {
-        *factory = mFactory;
-    }
-    return true;
-}
-
-template <class T>
-bool FactoryLoader<T>::queryPluginsFromPath(const String8& path,
-                                            vector<HidlCasPluginDescriptor>* results) {
-    closeFactory();
+    String8 dirPath("/vendor/lib/mediacas");
+    DIR* pDir = opendir(dirPath.string());
 
-    vector<CasPluginDescriptor> descriptors;
-    if (!openFactory(path) || mFactory->queryPlugins(&descriptors) != OK) {
-        closeFactory();
+    if (pDir == NULL) {
+        ALOGE("Failed to open plugin directory %s", dirPath.string());
         return false;
     }
 
-    for (auto it = descriptors.begin(); it != descriptors.end(); it++) {
-        results->push_back(
-                HidlCasPluginDescriptor{.caSystemId = it->CA_system_id, .name = it->name.c_str()});
+    struct dirent* pEntry;
+    while ((pEntry = readdir(pDir))) {
+        String8 pluginPath = dirPath + "/" + pEntry->d_name;
+        if (pluginPath.getPathExtension() == ".so") {
+            mPluginPaths.push_back(pluginPath);
+        }
     }
+
+    closedir(pDir);
+    mPluginPathsListed = true;
     return true;
 }
 
 template <class T>
-bool FactoryLoader<T>::openFactory(const String8& path) {
-    // get strong pointer to open shared library
-    ssize_t index = mLibraryPathToOpenLibraryMap.indexOfKey(path);
-    if (index >= 0) {
-        mLibrary = mLibraryPathToOpenLibraryMap[index].promote();
-    } else {
-        index = mLibraryPathToOpenLibraryMap.add(path, NULL);
-    }
-
-    if (!mLibrary.get()) {
-        mLibrary = new SharedLibrary(path);
-        if (!*mLibrary) {
-            return false;
+T* FactoryLoader<T>::getFactory(const String8& path, nsecs_t now, sp<SharedLibrary>* library) {
+    ssize_t index = mLoadedFactories.indexOfKey(path);
+    if (index < 0) {
+        LoadedFactory loaded = {.library = new SharedLibrary(path), .factory = NULL};
+        if (*loaded.library) {
+            CreateFactoryFunc createFactory =
+                    (CreateFactoryFunc)loaded.library->lookup(mCreateFactoryFuncName);
+            if (createFactory != NULL) {
+                loaded.factory = createFactory();
+            }
         }
-
-        mLibraryPathToOpenLibraryMap.replaceValueAt(index, mLibrary);
+        if (loaded.factory == NULL) {
+            loaded.library.clear();
+        }
+        index = mLoadedFactories.add(path, loaded);
     }
 
-    CreateFactoryFunc createFactory = (CreateFactoryFunc)mLibrary->lookup(mCreateFactoryFuncName);
-    if (createFactory == NULL || (mFactory = createFactory()) == NULL) {
-        return false;
+    LoadedFactory& loaded = mLoadedFactories.editValueAt(index);
+    loaded.lastUsed = now;
+    if (library != NULL) {
+        *library = loaded.library;
     }
-    return true;
+    return loaded.factory;
 }
 
 template <class T>
-void FactoryLoader<T>::closeFactory() {
-    delete mFactory;
-    mFactory = NULL;
-    mLibrary.clear();
+void FactoryLoader<T>::evictIdleFactories(nsecs_t now) {
+    for (size_t i = mLoadedFactories.size(); i > 0; i--) {
+        const LoadedFactory& loaded = mLoadedFactories.valueAt(i - 1);
+        if (loaded.factory != NULL && now - loaded.lastUsed > kFactoryIdleTimeoutNs) {
+            delete loaded.factory;
+            mLoadedFactories.removeItemsAt(i - 1);
+        }
+    }
 }
 
 }  // namespace implementation
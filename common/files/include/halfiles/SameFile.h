@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_COMMON_SAME_FILE_H
+#define ANDROID_HARDWARE_COMMON_SAME_FILE_H
+
+#include <errno.h>
+#include <linux/kcmp.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace files {
+
+/**
+ * Returns true if both fds refer to the same open file. Binder hands the receiver the sender's
+ * open file, so a client passing the same buffer or heap again results in the same file even
+ * though the fd number differs, and so does an fd dup'ed from it.
+ *
+ * Returns false when kcmp is not available, e.g. blocked by seccomp or not built into the kernel,
+ * so callers fall back to treating every fd as a new file.
+ */
+inline bool isSameFile(int fd1, int fd2) {
+    static std::atomic<bool> sKcmpSupported{true};
+    if (!sKcmpSupported.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    const pid_t pid = getpid();
+    int ret = syscall(__NR_kcmp, pid, pid, KCMP_FILE, fd1, fd2);
+    if (ret < 0) {
+        if (errno == ENOSYS || errno == EPERM) {
+            ALOGW("kcmp unavailable (%s), fds are never considered the same file",
+                  strerror(errno));
+            sKcmpSupported = false;
+        }
+        return false;
+    }
+    return ret == 0;
+}
+
+}  // namespace files
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_COMMON_SAME_FILE_H
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_COMMON_METRICS_H
+#define ANDROID_HARDWARE_COMMON_METRICS_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Lightweight instrumentation for the hot paths of HAL implementations.
+ *
+ * Metrics are registered by name in a process wide Registry, and recorded through the macros at
+ * the bottom of this file, which cache the metric in a function local static so that recording is
+ * a couple of relaxed atomic operations:
+ *
+ *     Return<void> StreamOut::write(...) {
+ *         HAL_METRICS_SCOPED_TIMER("audio.StreamOut.write");
+ *         ...
+ *         HAL_METRICS_COUNT("audio.StreamOut.underruns");
+ *     }
+ *
+ * Every HAL prints them the same way from its debug() with:
+ *
+ *     if (metrics::dumpIfRequested(fd, options)) return Void();
+ *
+ * Building with HAL_METRICS_ENABLED=0 compiles the macros to nothing.
+ */
+
+#ifndef HAL_METRICS_ENABLED
+#define HAL_METRICS_ENABLED 1
+#endif
+
+namespace android {
+namespace hardware {
+namespace metrics {
+
+// The first debug() option that asks for the metrics.
+constexpr char kDebugOption[] = "--metrics";
+
+namespace internal {
+
+constexpr size_t kCacheLineSize = 64;
+constexpr size_t kThreadShardCount = 16;
+
+// Threads are spread over the shards in the order they first record something, so that up to
+// kThreadShardCount threads never share a cache line.
+inline size_t threadShard() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) %
+                                kThreadShardCount;
+    return shard;
+}
+
+}  // namespace internal
+
+/**
+ * Monotonic counter. Every thread adds to its own shard without any lock or contended atomic,
+ * reading sums the shards.
+ */
+class Counter {
+  public:
+    void add(uint64_t n = 1) {
+        mShards[internal::threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t value = 0;
+        for (const Shard& shard : mShards) {
+            value += shard.value.load(std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+  private:
+    struct alignas(internal::kCacheLineSize) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, internal::kThreadShardCount> mShards;
+};
+
+/**
+ * Histogram of durations in nanoseconds, with log-linear buckets: every power of two is split
+ * into kSubBuckets linear buckets, so any value is reported within 1/kSubBuckets of its
+ * magnitude, from nanoseconds to centuries, in a fixed 2KB.
+ */
+class Histogram {
+  public:
+    static constexpr size_t kSubBucketBits = 2;
+    static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) {
+        mBuckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        mSum.add(value);
+        uint64_t max = mMax.load(std::memory_order_relaxed);
+        while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const {
+        uint64_t count = 0;
+        for (const auto& bucket : mBuckets) {
+            count += bucket.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    uint64_t sum() const { return mSum.value(); }
+    uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+
+    // Returns an upper bound of the given percentile, 0 if nothing was recorded.
+    uint64_t percentile(double percent) const {
+        std::array<uint64_t, kBucketCount> buckets;
+        uint64_t count = 0;
+        for (size_t i = 0; i < kBucketCount; i++) {
+            buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+            count += buckets[i];
+        }
+        if (count == 0) return 0;
+
+        const uint64_t rank =
+                std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percent / 100 * count)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(bucketUpperBound(i), max());
+        }
+        return max();
+    }
+
+    static size_t bucketFor(uint64_t value) {
+        if (value < kSubBuckets) return value;
+        const size_t exponent = 63 - __builtin_clzll(value);
+        return (exponent - kSubBucketBits + 1) * kSubBuckets +
+               ((value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1));
+    }
+
+    static uint64_t bucketLowerBound(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket;
+        const size_t exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+        return (kSubBuckets + bucket % kSubBuckets) << (exponent - kSubBucketBits);
+    }
+
+    static uint64_t bucketUpperBound(size_t bucket) {
+        return bucket + 1 < kBucketCount ? bucketLowerBound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, kBucketCount> mBuckets{};
+    Counter mSum;
+    std::atomic<uint64_t> mMax{0};
+};
+
+/* Records the time from its construction to its destruction into a histogram. */
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(Histogram& histogram)
+        : mHistogram(histogram), mStart(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        mHistogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - mStart)
+                                  .count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    Histogram& mHistogram;
+    const std::chrono::steady_clock::time_point mStart;
+};
+
+/**
+ * Process wide metrics by name. Metrics are never removed, so references to them stay valid for
+ * the life of the process. Looking a metric up takes a lock, callers on hot paths look it up
+ * once.
+ */
+class Registry {
+  public:
+    // Never destroyed, so that threads still running at exit can record.
+    static Registry& get() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    Counter& counter(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto& counter = mCounters[name];
+        if (counter == nullptr) counter = std::make_unique<Counter>();
+        return *counter;
+    }
+
+    Histogram& histogram(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto& histogram = mHistograms[name];
+        if (histogram == nullptr) histogram = std::make_unique<Histogram>();
+        return *histogram;
+    }
+
+    // One line per metric sorted by name, latencies in microseconds.
+    void dump(int fd) const {
+        if (!HAL_METRICS_ENABLED) {
+            dprintf(fd, "HAL metrics are disabled in this build\n");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mLock);
+        for (const auto& [name, counter] : mCounters) {
+            dprintf(fd, "counter %s: %" PRIu64 "\n", name.c_str(), counter->value());
+        }
+        for (const auto& [name, histogram] : mHistograms) {
+            const uint64_t count = histogram->count();
+            dprintf(fd,
+                    "latency %s: count=%" PRIu64
+                    " mean=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus\n",
+                    name.c_str(), count, count == 0 ? 0.0 : histogram->sum() / 1000.0 / count,
+                    histogram->percentile(50) / 1000.0, histogram->percentile(90) / 1000.0,
+                    histogram->percentile(99) / 1000.0, histogram->max() / 1000.0);
+        }
+    }
+
+  private:
+    Registry() = default;
+
+    mutable std::mutex mLock;
+    std::map<std::string, std::unique_ptr<Counter>> mCounters;
+    std::map<std::string, std::unique_ptr<Histogram>> mHistograms;
+};
+
+/**
+ * Dumps the metrics to fd if the first of options is kDebugOption. Options may be any container
+ * of strings, e.g. the hidl_vec<hidl_string> passed to debug(). Returns true if it dumped.
+ */
+template <typename Options>
+bool dumpIfRequested(int fd, const Options& options) {
+    if (options.size() == 0 || std::string(options[0]) != kDebugOption) return false;
+    Registry::get().dump(fd);
+    return true;
+}
+
+}  // namespace metrics
+}  // namespace hardware
+}  // namespace android
+
+#define HAL_METRICS_CONCAT_(a, b) a##b
+#define HAL_METRICS_CONCAT(a, b) HAL_METRICS_CONCAT_(a, b)
+
+// The name passed to these must be the same every time the line is executed.
+#if HAL_METRICS_ENABLED
+
+#define HAL_METRICS_ADD(name, n)                                                    \
+    do {                                                                            \
+        static ::android::hardware::metrics::Counter& halMetricsCounter =           \
+                ::android::hardware::metrics::Registry::get().counter(name);        \
+        halMetricsCounter.add(n);                                                   \
+    } while (0)
+
+#define HAL_METRICS_RECORD_NS(name, ns)                                             \
+    do {                                                                            \
+        static ::android::hardware::metrics::Histogram& halMetricsHistogram =       \
+                ::android::hardware::metrics::Registry::get().histogram(name);      \
+        halMetricsHistogram.record(ns);                                             \
+    } while (0)
+
+// Times the rest of the enclosing scope.
+#define HAL_METRICS_SCOPED_TIMER(name)                                              \
+    static ::android::hardware::metrics::Histogram& HAL_METRICS_CONCAT(             \
+            halMetricsHistogram, __LINE__) =                                        \
+            ::android::hardware::metrics::Registry::get().histogram(name);          \
+    ::android::hardware::metrics::ScopedTimer HAL_METRICS_CONCAT(halMetricsTimer,   \
+                                                                 __LINE__)(         \
+            HAL_METRICS_CONCAT(halMetricsHistogram, __LINE__))
+
+#else  // HAL_METRICS_ENABLED
+
+#define HAL_METRICS_ADD(name, n) \
+    do {                         \
+    } while (0)
+#define HAL_METRICS_RECORD_NS(name, ns) \
+    do {                                \
+    } while (0)
+#define HAL_METRICS_SCOPED_TIMER(name) \
+    do {                               \
+    } while (0)
+
+#endif  // HAL_METRICS_ENABLED
+
+#define HAL_METRICS_COUNT(name) HAL_METRICS_ADD(name, 1)
+
+#endif  // ANDROID_HARDWARE_COMMON_METRICS_H
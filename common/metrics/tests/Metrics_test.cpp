@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <halmetrics/Metrics.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace metrics {
+
+namespace {
+
+TEST(MetricsTest, counterSumsThreads) {
+    Counter counter;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 32; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 1000; i++) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(32000u, counter.value());
+}
+
+TEST(MetricsTest, bucketsAreContiguous) {
+    ASSERT_EQ(0u, Histogram::bucketFor(0));
+    ASSERT_EQ(Histogram::kBucketCount - 1, Histogram::bucketFor(UINT64_MAX));
+    for (size_t bucket = 0; bucket + 1 < Histogram::kBucketCount; bucket++) {
+        const uint64_t lower = Histogram::bucketLowerBound(bucket);
+        const uint64_t upper = Histogram::bucketUpperBound(bucket);
+        ASSERT_EQ(bucket, Histogram::bucketFor(lower));
+        ASSERT_EQ(bucket, Histogram::bucketFor(upper));
+        ASSERT_EQ(upper + 1, Histogram::bucketLowerBound(bucket + 1));
+        // Log-linear: no bucket is wider than a quarter of its lower bound.
+        ASSERT_LE(upper - lower, lower / Histogram::kSubBuckets);
+    }
+}
+
+TEST(MetricsTest, percentiles) {
+    Histogram histogram;
+    ASSERT_EQ(0u, histogram.percentile(50));
+    for (uint64_t value = 1; value <= 1000; value++) {
+        histogram.record(value);
+    }
+    ASSERT_EQ(1000u, histogram.count());
+    ASSERT_EQ(500500u, histogram.sum());
+    ASSERT_EQ(1000u, histogram.max());
+
+    const uint64_t p50 = histogram.percentile(50);
+    ASSERT_GE(p50, 500u);
+    ASSERT_LE(p50, 500u + 500u / Histogram::kSubBuckets);
+    ASSERT_EQ(1000u, histogram.percentile(100));
+}
+
+TEST(MetricsTest, macrosShareRegisteredMetrics) {
+    for (int i = 0; i < 3; i++) {
+        HAL_METRICS_COUNT("test.count");
+        HAL_METRICS_SCOPED_TIMER("test.timer");
+    }
+    HAL_METRICS_ADD("test.count", 2);
+    HAL_METRICS_RECORD_NS("test.timer", 1000);
+    if (!HAL_METRICS_ENABLED) return;
+
+    ASSERT_EQ(5u, Registry::get().counter("test.count").value());
+    ASSERT_EQ(4u, Registry::get().histogram("test.timer").count());
+}
+
+TEST(MetricsTest, dumpIfRequested) {
+    Registry::get().counter("test.dump").add(7);
+    FILE* file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    const int fd = fileno(file);
+
+    ASSERT_FALSE(dumpIfRequested(fd, std::vector<std::string>{}));
+    ASSERT_FALSE(dumpIfRequested(fd, std::vector<std::string>{"--help"}));
+    ASSERT_TRUE(dumpIfRequested(fd, std::vector<std::string>{kDebugOption}));
+
+    std::string output(4096, '\0');
+    output.resize(pread(fd, output.data(), output.size(), 0));
+    fclose(file);
+    const char* expected = HAL_METRICS_ENABLED ? "counter test.dump: 7\n" : "disabled";
+    ASSERT_NE(std::string::npos, output.find(expected)) << output;
+}
+
+}  // namespace
+
+}  // namespace metrics
+}  // namespace hardware
+}  // namespace android
@@ -92,6 +92,7 @@ std::tuple<std::remove_reference_t<T>&&...> tuple_move(std::tuple<T...>& t) {
     return tuple_move_helper(integer_sequence::make_t<sizeof...(T)>(), std::move(t));
 }
 
+using ::android::hardware::confirmationui::V1_0::MessageSize;
 using ::android::hardware::confirmationui::V1_0::ResponseCode;
 using ::android::hardware::confirmationui::V1_0::UIOption;
 using ::android::hardware::keymaster::V4_0::HardwareAuthToken;
@@ -465,6 +466,92 @@ std::tuple<const Tail&...> tuple_tail(const std::tuple<HEAD, Tail...>& t) {
     return tuple_tail(integer_sequence::make_t<1, sizeof...(Tail)>(), t);
 }
 
+// Upper bounds of the variable length fields. The prompt text and the extra data must fit into
+// MessageSize::MAX together. The locale is a BCP 47 language tag, for which RFC 5646 recommends
+// buffers of 35 characters. The UI options are a set of UIOption values, which leaves ample room.
+constexpr size_t kMaxPromptAndExtraDataSize = size_t(MessageSize::MAX);
+constexpr size_t kMaxLocaleSize = 35;
+constexpr size_t kMaxUIOptions = 8;
+
+// Serialized size of a length prefixed buffer, and of a length prefixed, zero terminated string.
+constexpr size_t bufferSize(size_t size) {
+    return sizeof(uint32_t) + size;
+}
+constexpr size_t stringSize(size_t length) {
+    return bufferSize(length) + 1;
+}
+// unalign() skips at most this many bytes.
+constexpr size_t kMaxUnalignment = 7;
+
+/**
+ * MaxSerializedSize<Msg>::value is the largest number of bytes that write() produces for a
+ * message of type Msg within the bounds above.
+ */
+template <typename Msg>
+struct MaxSerializedSize {};
+
+template <>
+struct MaxSerializedSize<PromptUserConfirmationMsg> {
+    static constexpr size_t value = sizeof(Command) + stringSize(0) + bufferSize(0) +
+                                    kMaxPromptAndExtraDataSize + stringSize(kMaxLocaleSize) +
+                                    kMaxUnalignment + bufferSize(kMaxUIOptions * sizeof(UIOption));
+};
+
+template <>
+struct MaxSerializedSize<DeliverSecureInputEventMsg> {
+    static constexpr size_t value =
+            sizeof(Command) + bufferSize(hatSizeNoMac()) + bufferSize(hmac_size_bytes);
+};
+
+template <>
+struct MaxSerializedSize<AbortMsg> {
+    static constexpr size_t value = sizeof(Command);
+};
+
+// Also covers DeliverSecureInputEventRespose, which is the same type.
+template <>
+struct MaxSerializedSize<PromptUserConfirmationResponse> {
+    static constexpr size_t value = bufferSize(sizeof(ResponseCode));
+};
+
+template <>
+struct MaxSerializedSize<ResultMsg> {
+    static constexpr size_t value = bufferSize(sizeof(ResponseCode)) +
+                                    bufferSize(size_t(MessageSize::MAX)) +
+                                    bufferSize(hmac_size_bytes);
+};
+
+/**
+ * A fixed capacity buffer that fits any message of type Msg, so that messages can be formatted on
+ * the stack without touching the heap. The fields must be passed as the exact types of the
+ * message, which rules out implicit conversions that would allocate, e.g., from a char pointer to
+ * a hidl_string.
+ */
+template <typename Msg>
+class MessageBuffer {
+  public:
+    static constexpr size_t kCapacity = MaxSerializedSize<Msg>::value;
+
+    /**
+     * Formats the message into the buffer. Returns false, and leaves the buffer empty, if the
+     * message exceeds the bounds above.
+     */
+    template <typename... Fields>
+    bool format(const Fields&... fields) {
+        WriteStream out(buffer_);
+        out = write(Msg(), out, fields...);
+        size_ = out ? kCapacity - out.bytes_left_ : 0;
+        return out;
+    }
+
+    const uint8_t* data() const { return buffer_; }
+    size_t size() const { return size_; }
+
+  private:
+    uint8_t buffer_[kCapacity];
+    size_t size_ = 0;
+};
+
 }  // namespace support
 }  // namespace confirmationui
 }  // namespace hardware
@@ -20,11 +20,18 @@
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <android/hardware/confirmationui/support/msg_formatting.h>
 #include <gtest/gtest.h>
 
+using android::hardware::confirmationui::support::AbortMsg;
+using android::hardware::confirmationui::support::DeliverSecureInputEventMsg;
+using android::hardware::confirmationui::support::kMaxLocaleSize;
+using android::hardware::confirmationui::support::kMaxPromptAndExtraDataSize;
+using android::hardware::confirmationui::support::kMaxUIOptions;
 using android::hardware::confirmationui::support::Message;
+using android::hardware::confirmationui::support::MessageBuffer;
 using android::hardware::confirmationui::support::WriteStream;
 using android::hardware::confirmationui::support::ReadStream;
 using android::hardware::confirmationui::support::PromptUserConfirmationMsg;
@@ -126,3 +133,54 @@ TEST(MsgFormattingTest, HardwareAuthTokenTest) {
     std::tie(in, actual) = read(Message<HardwareAuthToken>(), in);
     ASSERT_EQ(expected, actual);
 }
+
+TEST(MsgFormattingTest, MessageBufferFixedSizeTest) {
+    MessageBuffer<AbortMsg> abort;
+    ASSERT_TRUE(abort.format());
+    ASSERT_EQ(MessageBuffer<AbortMsg>::kCapacity, abort.size());
+
+    HardwareAuthToken hat = {};
+    hat.mac = std::vector<uint8_t>(32, 0x5a);
+    MessageBuffer<DeliverSecureInputEventMsg> event;
+    ASSERT_TRUE(event.format(hat));
+    ASSERT_EQ(MessageBuffer<DeliverSecureInputEventMsg>::kCapacity, event.size());
+
+    HardwareAuthToken actual;
+    bool command_matches;
+    ReadStream in(event.data(), event.size());
+    std::tie(in, command_matches, actual) = read(DeliverSecureInputEventMsg(), in);
+    ASSERT_TRUE(in);
+    ASSERT_TRUE(command_matches);
+    ASSERT_EQ(hat, actual);
+}
+
+TEST(MsgFormattingTest, MessageBufferPromptTest) {
+    const hidl_string prompt(std::string(kMaxPromptAndExtraDataSize - 100, 'p'));
+    const hidl_vec<uint8_t> extra(std::vector<uint8_t>(100, 0xe));
+    const hidl_string locale(std::string(kMaxLocaleSize, 'l'));
+    const hidl_vec<UIOption> uiOpts(
+        std::vector<UIOption>(kMaxUIOptions, UIOption::AccessibilityMagnified));
+
+    MessageBuffer<PromptUserConfirmationMsg> buffer;
+    ASSERT_TRUE(buffer.format(prompt, extra, locale, uiOpts));
+    ASSERT_LE(buffer.size(), MessageBuffer<PromptUserConfirmationMsg>::kCapacity);
+
+    hidl_string actualPrompt;
+    hidl_vec<uint8_t> actualExtra;
+    hidl_string actualLocale;
+    hidl_vec<UIOption> actualUiOpts;
+    bool command_matches;
+    ReadStream in(buffer.data(), buffer.size());
+    std::tie(in, command_matches, actualPrompt, actualExtra, actualLocale, actualUiOpts) =
+        read(PromptUserConfirmationMsg(), in);
+    ASSERT_TRUE(in);
+    ASSERT_TRUE(command_matches);
+    ASSERT_EQ(prompt, actualPrompt);
+    ASSERT_EQ(extra, actualExtra);
+    ASSERT_EQ(locale, actualLocale);
+    ASSERT_EQ(uiOpts, actualUiOpts);
+
+    const hidl_string tooLong(std::string(kMaxPromptAndExtraDataSize + 100, 'p'));
+    ASSERT_FALSE(buffer.format(tooLong, extra, locale, uiOpts));
+    ASSERT_EQ(0u, buffer.size());
+}
@@ -35,11 +35,16 @@ namespace implementation {
 
 static constexpr uint64_t ALL_APPS = UINT64_C(0xFFFFFFFFFFFFFFFF);
 
+// Nanoapps can also stop on their own, which the hub does not report, so a
+// cached app list is only trusted for this long.
+static constexpr std::chrono::seconds kMaxAppsAge(5);
+
 Contexthub::Contexthub()
         : mInitCheck(NO_INIT),
           mContextHubModule(nullptr),
           mDeathRecipient(new DeathRecipient(this)),
-          mIsTransactionPending(false) {
+          mIsTransactionPending(false),
+          mReplyThread(&Contexthub::sendCachedReplies, this) {
     const hw_module_t *module;
 
     mInitCheck = hw_get_module(CONTEXT_HUB_MODULE_ID, &module);
@@ -56,6 +61,31 @@ Contexthub::Contexthub()
     }
 }
 
+Contexthub::~Contexthub() {
+    {
+        std::lock_guard<std::mutex> lock(mRepliesLock);
+        mStopReplies = true;
+    }
+    mRepliesCond.notify_one();
+    mReplyThread.join();
+}
+
+void Contexthub::sendCachedReplies() {
+    std::unique_lock<std::mutex> lock(mRepliesLock);
+    while (true) {
+        mRepliesCond.wait(lock, [this] { return mStopReplies || !mCachedReplies.empty(); });
+        if (mStopReplies) {
+            return;
+        }
+        auto reply = std::move(mCachedReplies.front());
+        mCachedReplies.pop_front();
+        lock.unlock();
+        ALOGV("Reporting %zu cached apps", reply.second.size());
+        reply.first->handleAppsInfo(reply.second);
+        lock.lock();
+    }
+}
+
 bool Contexthub::setOsAppAsDestination(hub_message_t *msg, int hubId) {
     if (!isValidHubId(hubId)) {
         ALOGW("%s: Hub information is null for hubHandle %d",
@@ -79,6 +109,7 @@ Return<void> Contexthub::getHubs(getHubs_cb _hidl_cb) {
                                               &hubArray);
         ALOGI("Context Hub Hal Adapter reports %zu hubs", numHubs);
 
+        std::lock_guard<std::mutex> lock(mLock);
         mCachedHubInfo.clear();
 
         for (size_t i = 0; i < numHubs; i++) {
@@ -134,6 +165,7 @@ sp<IContexthubCallback> Contexthub::getCallBackForHubId(uint32_t hubId) {
     if (!isValidHubId(hubId)) {
         return nullptr;
     } else {
+        std::lock_guard<std::mutex> lock(mLock);
         return mCachedHubInfo[hubId].callback;
     }
 }
@@ -188,6 +220,7 @@ Return<Result> Contexthub::reboot(uint32_t hubId) {
     msg.message_len = 0;
     msg.message = nullptr;
 
+    invalidateApps(hubId);
     if(mContextHubModule->send_message(hubId, &msg) != 0) {
         return Result::TRANSACTION_FAILED;
     } else {
@@ -210,12 +243,17 @@ Return<Result> Contexthub::registerCallback(uint32_t hubId,
                                                      contextHubCb,
                                                      this) == 0) {
         // Initialized && valid hub && subscription successful
-        if (mCachedHubInfo[hubId].callback != nullptr) {
+        sp<IContexthubCallback> oldCb;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            oldCb = mCachedHubInfo[hubId].callback;
+            mCachedHubInfo[hubId].callback = cb;
+        }
+        if (oldCb != nullptr) {
             ALOGD("Modifying callback for hubId %" PRIu32, hubId);
-            mCachedHubInfo[hubId].callback->unlinkToDeath(mDeathRecipient);
+            oldCb->unlinkToDeath(mDeathRecipient);
         }
 
-        mCachedHubInfo[hubId].callback = cb;
         if (cb != nullptr) {
             Return<bool> linkResult = cb->linkToDeath(mDeathRecipient, hubId);
             bool linkSuccess = linkResult.isOk() ?
@@ -259,7 +297,20 @@ static bool isValidOsStatus(const uint8_t *msg,
     return true;
 }
 
-int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
+void Contexthub::invalidateApps(uint32_t hubId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    invalidateAppsLocked(hubId);
+}
+
+void Contexthub::invalidateAppsLocked(uint32_t hubId) {
+    CachedHubInformation &info = mCachedHubInfo[hubId];
+    info.appsValid = false;
+    info.apps.clear();
+    info.appsGeneration++;
+}
+
+int Contexthub::handleOsMessage(uint32_t hubId,
+                                sp<IContexthubCallback> cb,
                                 uint32_t msgType,
                                 const uint8_t *msg,
                                 int msgLen) {
@@ -281,9 +332,15 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
                 result = TransactionResult::FAILURE;
             }
 
-            mIsTransactionPending = false;
+            uint32_t transactionId;
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                invalidateAppsLocked(hubId);
+                mIsTransactionPending = false;
+                transactionId = mTransactionId;
+            }
             if (cb != nullptr) {
-                cb->handleTxnResult(mTransactionId, result);
+                cb->handleTxnResult(transactionId, result);
             }
             retVal = 0;
             break;
@@ -306,6 +363,16 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
                 apps.push_back(app);
             }
 
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                CachedHubInformation &info = mCachedHubInfo[hubId];
+                if (!mIsTransactionPending && info.queryGeneration == info.appsGeneration) {
+                    info.appsValid = true;
+                    info.apps = apps;
+                    info.appsTime = std::chrono::steady_clock::now();
+                }
+            }
+
             if (cb != nullptr) {
                 cb->handleAppsInfo(apps);
             }
@@ -322,7 +389,11 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
 
         case CONTEXT_HUB_OS_REBOOT:
         {
-            mIsTransactionPending = false;
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                invalidateAppsLocked(hubId);
+                mIsTransactionPending = false;
+            }
             if (cb != nullptr) {
                 cb->handleHubEvent(AsyncEventType::RESTARTED);
             }
@@ -347,6 +418,7 @@ void Contexthub::handleServiceDeath(uint32_t hubId) {
         ALOGW("Failed to unregister callback from hubId %" PRIu32 ": %d",
               hubId, ret);
     }
+    std::lock_guard<std::mutex> lock(mLock);
     mCachedHubInfo[hubId].callback.clear();
 }
 
@@ -374,7 +446,8 @@ int Contexthub::contextHubCb(uint32_t hubId,
     }
 
     if (rxMsg->message_type < CONTEXT_HUB_TYPE_PRIVATE_MSG_BASE) {
-        obj->handleOsMessage(cb,
+        obj->handleOsMessage(hubId,
+                             cb,
                              rxMsg->message_type,
                              static_cast<const uint8_t *>(rxMsg->message),
                              rxMsg->message_len);
@@ -401,10 +474,6 @@ Return<Result> Contexthub::unloadNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -418,11 +487,15 @@ Return<Result> Contexthub::unloadNanoApp(uint32_t hubId,
     msg.message = &req;
     req.app_name.id = appId;
 
+    if (!startTransaction(transactionId)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    invalidateApps(hubId);
     if(mContextHubModule->send_message(hubId, &msg) != 0) {
+        cancelTransaction();
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -434,10 +507,6 @@ Return<Result> Contexthub::loadNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t hubMsg;
 
     if (setOsAppAsDestination(&hubMsg, hubId) == false) {
@@ -468,11 +537,15 @@ Return<Result> Contexthub::loadNanoApp(uint32_t hubId,
     hubMsg.message_len = binaryWithHeader.size();
     hubMsg.message = binaryWithHeader.data();
 
+    if (!startTransaction(transactionId)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    invalidateApps(hubId);
     if (mContextHubModule->send_message(hubId, &hubMsg) != 0) {
+        cancelTransaction();
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -484,10 +557,6 @@ Return<Result> Contexthub::enableNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -501,11 +570,15 @@ Return<Result> Contexthub::enableNanoApp(uint32_t hubId,
     req.app_name.id = appId;
     msg.message = &req;
 
+    if (!startTransaction(transactionId)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    invalidateApps(hubId);
     if(mContextHubModule->send_message(hubId, &msg) != 0) {
+        cancelTransaction();
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -517,10 +590,6 @@ Return<Result> Contexthub::disableNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -534,11 +603,15 @@ Return<Result> Contexthub::disableNanoApp(uint32_t hubId,
     req.app_name.id = appId;
     msg.message = &req;
 
+    if (!startTransaction(transactionId)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    invalidateApps(hubId);
     if(mContextHubModule->send_message(hubId, &msg) != 0) {
+        cancelTransaction();
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -555,6 +628,29 @@ Return<Result> Contexthub::queryApps(uint32_t hubId) {
         return Result::BAD_PARAMS;
     }
 
+    sp<IContexthubCallback> cb;
+    std::vector<HubAppInfo> apps;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        CachedHubInformation &info = mCachedHubInfo[hubId];
+        if (info.appsValid && info.callback != nullptr &&
+                std::chrono::steady_clock::now() - info.appsTime < kMaxAppsAge) {
+            cb = info.callback;
+            apps = info.apps;
+        } else {
+            info.queryGeneration = info.appsGeneration;
+        }
+    }
+
+    if (cb != nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(mRepliesLock);
+            mCachedReplies.emplace_back(std::move(cb), std::move(apps));
+        }
+        mRepliesCond.notify_one();
+        return Result::OK;
+    }
+
     query_apps_request_t payload;
     payload.app_name.id = ALL_APPS; // TODO : Pass this in as a parameter
     msg.message = &payload;
@@ -569,6 +665,23 @@ Return<Result> Contexthub::queryApps(uint32_t hubId) {
     return Result::OK;
 }
 
+bool Contexthub::startTransaction(uint32_t transactionId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mIsTransactionPending) {
+        return false;
+    }
+    // Reserved before the request is sent, as the hub may answer it before
+    // send_message() returns.
+    mIsTransactionPending = true;
+    mTransactionId = transactionId;
+    return true;
+}
+
+void Contexthub::cancelTransaction() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mIsTransactionPending = false;
+}
+
 bool Contexthub::isInitialized() {
     return (mInitCheck == OK && mContextHubModule != nullptr);
 }
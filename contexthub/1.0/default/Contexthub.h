@@ -17,7 +17,13 @@
 #ifndef ANDROID_HARDWARE_CONTEXTHUB_V1_0_CONTEXTHUB_H_
 #define ANDROID_HARDWARE_CONTEXTHUB_V1_0_CONTEXTHUB_H_
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <android-base/macros.h>
 #include <android/hardware/contexthub/1.0/IContexthub.h>
@@ -31,6 +37,7 @@ namespace implementation {
 
 struct Contexthub : public ::android::hardware::contexthub::V1_0::IContexthub {
     Contexthub();
+    ~Contexthub();
 
     Return<void> getHubs(getHubs_cb _hidl_cb) override;
 
@@ -66,7 +73,16 @@ private:
 
     struct CachedHubInformation{
         struct hub_app_name_t osAppName;
-        sp<IContexthubCallback> callback;
+        sp<IContexthubCallback> callback;  // guarded by mLock
+
+        // The app list last reported by the hub, guarded by mLock.
+        bool appsValid = false;
+        std::vector<HubAppInfo> apps;
+        std::chrono::steady_clock::time_point appsTime;
+        // Bumped whenever the app list may change, so that the reply to a
+        // query racing the change is not cached.
+        uint32_t appsGeneration = 0;
+        uint32_t queryGeneration = 0;
     };
 
     class DeathRecipient : public hidl_death_recipient {
@@ -86,18 +102,35 @@ private:
     std::unordered_map<uint32_t, CachedHubInformation> mCachedHubInfo;
 
     sp<DeathRecipient> mDeathRecipient;
+
+    // Guards the callbacks and the app lists of mCachedHubInfo, and the
+    // pending transaction.
+    std::mutex mLock;
     bool mIsTransactionPending;
     uint32_t mTransactionId;
 
+    // Replies to queryApps() served from a cached app list. They are sent
+    // from mReplyThread, as a reply from the hub would be, so that the client
+    // never gets handleAppsInfo() before its queryApps() call returns.
+    std::mutex mRepliesLock;
+    std::condition_variable mRepliesCond;
+    std::deque<std::pair<sp<IContexthubCallback>, std::vector<HubAppInfo>>> mCachedReplies;
+    bool mStopReplies = false;
+
     bool isValidHubId(uint32_t hubId);
 
     sp<IContexthubCallback> getCallBackForHubId(uint32_t hubId);
 
-    int handleOsMessage(sp<IContexthubCallback> cb,
+    int handleOsMessage(uint32_t hubId,
+                        sp<IContexthubCallback> cb,
                         uint32_t msgType,
                         const uint8_t *msg,
                         int msgLen);
 
+    // Drop the cached app list of the given hub ID
+    void invalidateApps(uint32_t hubId);
+    void invalidateAppsLocked(uint32_t hubId);
+
     // Handle the case where the callback registered for the given hub ID dies
     void handleServiceDeath(uint32_t hubId);
 
@@ -107,6 +140,16 @@ private:
 
     bool setOsAppAsDestination(hub_message_t *msg, int hubId);
 
+    // Reserves the transaction, returning false if one is already pending
+    bool startTransaction(uint32_t transactionId);
+
+    // Releases the transaction reserved by startTransaction
+    void cancelTransaction();
+
+    void sendCachedReplies();
+
+    std::thread mReplyThread;
+
     DISALLOW_COPY_AND_ASSIGN(Contexthub);
 };
 
@@ -23,6 +23,8 @@
 #include <log/log.h>
 #include <media/stagefright/foundation/AString.h>
 
+#include <vector>
+
 using android::hardware::hidl_memory;
 using android::hidl::memory::V1_0::IMemory;
 
@@ -68,17 +70,22 @@ namespace implementation {
             const DestinationBuffer& destination,
             decrypt_cb _hidl_cb) {
         std::unique_lock<std::mutex> shared_buffer_lock(mSharedBufferLock);
-        if (mSharedBufferMap.find(source.bufferId) == mSharedBufferMap.end()) {
+        auto sourceIt = mSharedBufferMap.find(source.bufferId);
+        if (sourceIt == mSharedBufferMap.end()) {
             _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source decrypt buffer base not set");
             return Void();
         }
+        sp<IMemory> sourceBase = sourceIt->second;
 
+        sp<IMemory> destBase;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& dest = destination.nonsecureMemory;
-            if (mSharedBufferMap.find(dest.bufferId) == mSharedBufferMap.end()) {
+            auto destIt = mSharedBufferMap.find(dest.bufferId);
+            if (destIt == mSharedBufferMap.end()) {
                 _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination decrypt buffer base not set");
                 return Void();
             }
+            destBase = destIt->second;
         }
 
         android::CryptoPlugin::Mode legacyMode = android::CryptoPlugin::kMode_Unencrypted;
@@ -100,8 +107,10 @@ namespace implementation {
         legacyPattern.mEncryptBlocks = pattern.encryptBlocks;
         legacyPattern.mSkipBlocks = pattern.skipBlocks;
 
-        std::unique_ptr<android::CryptoPlugin::SubSample[]> legacySubSamples =
-                std::make_unique<android::CryptoPlugin::SubSample[]>(subSamples.size());
+        // Reused across calls so that decrypting a sample does not allocate. It is per thread
+        // since the legacy plugin is called without mSharedBufferLock held.
+        thread_local std::vector<android::CryptoPlugin::SubSample> legacySubSamples;
+        legacySubSamples.resize(subSamples.size());
 
         size_t destSize = 0;
         for (size_t i = 0; i < subSamples.size(); i++) {
@@ -120,7 +129,6 @@ namespace implementation {
         }
 
         AString detailMessage;
-        sp<IMemory> sourceBase = mSharedBufferMap[source.bufferId];
         if (sourceBase == nullptr) {
             _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source is a nullptr");
             return Void();
@@ -142,7 +150,6 @@ namespace implementation {
         void *destPtr = NULL;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& destBuffer = destination.nonsecureMemory;
-            sp<IMemory> destBase = mSharedBufferMap[destBuffer.bufferId];
             if (destBase == nullptr) {
                 _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination is a nullptr");
                 return Void();
@@ -180,7 +187,7 @@ namespace implementation {
         shared_buffer_lock.unlock();
 
         ssize_t result = mLegacyPlugin->decrypt(secure, keyId.data(), iv.data(),
-                legacyMode, legacyPattern, srcPtr, legacySubSamples.get(),
+                legacyMode, legacyPattern, srcPtr, legacySubSamples.data(),
                 subSamples.size(), destPtr, &detailMessage);
 
         uint32_t status;
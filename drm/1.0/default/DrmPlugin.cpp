@@ -37,7 +37,10 @@ namespace implementation {
     }
 
     Return<Status> DrmPlugin::closeSession(const hidl_vec<uint8_t>& sessionId) {
-        return toStatus(mLegacyPlugin->closeSession(toVector(sessionId)));
+        const Vector<uint8_t> legacySessionId = toVector(sessionId);
+        status_t status = mLegacyPlugin->closeSession(legacySessionId);
+        invalidateKeyStatus(&legacySessionId);
+        return toStatus(status);
     }
 
     Return<void> DrmPlugin::getKeyRequest(const hidl_vec<uint8_t>& scope,
@@ -109,36 +112,66 @@ namespace implementation {
         Vector<uint8_t> keySetId;
         status_t status = mLegacyPlugin->provideKeyResponse(toVector(scope),
                 toVector(response), keySetId);
+        // The scope is a key set id rather than a session id when releasing
+        // offline keys, so it can't tell which session changed.
+        invalidateKeyStatus(nullptr);
         _hidl_cb(toStatus(status), toHidlVec(keySetId));
         return Void();
     }
 
     Return<Status> DrmPlugin::removeKeys(const hidl_vec<uint8_t>& sessionId) {
-        return toStatus(mLegacyPlugin->removeKeys(toVector(sessionId)));
+        const Vector<uint8_t> legacySessionId = toVector(sessionId);
+        status_t status = mLegacyPlugin->removeKeys(legacySessionId);
+        invalidateKeyStatus(&legacySessionId);
+        return toStatus(status);
     }
 
     Return<Status> DrmPlugin::restoreKeys(const hidl_vec<uint8_t>& sessionId,
             const hidl_vec<uint8_t>& keySetId) {
-        status_t legacyStatus = mLegacyPlugin->restoreKeys(toVector(sessionId),
+        const Vector<uint8_t> legacySessionId = toVector(sessionId);
+        status_t legacyStatus = mLegacyPlugin->restoreKeys(legacySessionId,
                 toVector(keySetId));
+        invalidateKeyStatus(&legacySessionId);
         return toStatus(legacyStatus);
     }
 
     Return<void> DrmPlugin::queryKeyStatus(const hidl_vec<uint8_t>& sessionId,
             queryKeyStatus_cb _hidl_cb) {
 
+        std::vector<uint8_t> cacheKey(sessionId.data(), sessionId.data() + sessionId.size());
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mKeyStatusLock);
+            generation = mKeyStatusGeneration;
+            auto it = mKeyStatusCache.find(cacheKey);
+            if (it != mKeyStatusCache.end()) {
+                if (std::chrono::steady_clock::now() - it->second.time < kMaxKeyStatusAge) {
+                    _hidl_cb(Status::OK, it->second.infoMap);
+                    return Void();
+                }
+                mKeyStatusCache.erase(it);
+            }
+        }
+
+        const auto queryTime = std::chrono::steady_clock::now();
         android::KeyedVector<String8, String8> legacyInfoMap;
         status_t status = mLegacyPlugin->queryKeyStatus(toVector(sessionId),
                 legacyInfoMap);
 
-        Vector<KeyValue> infoMapVec;
+        hidl_vec<KeyValue> infoMap;
+        infoMap.resize(legacyInfoMap.size());
         for (size_t i = 0; i < legacyInfoMap.size(); i++) {
-            KeyValue keyValuePair;
-            keyValuePair.key = String8(legacyInfoMap.keyAt(i));
-            keyValuePair.value = String8(legacyInfoMap.valueAt(i));
-            infoMapVec.push_back(keyValuePair);
+            infoMap[i].key = legacyInfoMap.keyAt(i).string();
+            infoMap[i].value = legacyInfoMap.valueAt(i).string();
         }
-        _hidl_cb(toStatus(status), toHidlVec(infoMapVec));
+        if (status == android::OK) {
+            std::lock_guard<std::mutex> lock(mKeyStatusLock);
+            // Keys that changed while querying may not be reflected in the result.
+            if (generation == mKeyStatusGeneration) {
+                mKeyStatusCache[std::move(cacheKey)] = {queryTime, infoMap};
+            }
+        }
+        _hidl_cb(toStatus(status), infoMap);
         return Void();
     }
 
@@ -357,6 +390,9 @@ namespace implementation {
             int /*unused*/, Vector<uint8_t> const *sessionId,
             Vector<uint8_t> const *data) {
 
+        // Any event may reflect a change in key status; without a session it
+        // may concern all of them.
+        invalidateKeyStatus(sessionId);
         EventType eventType;
         bool sendEvent = true;
         switch(legacyEventType) {
@@ -389,6 +425,7 @@ namespace implementation {
 
     void DrmPlugin::sendExpirationUpdate(Vector<uint8_t> const *sessionId,
             int64_t expiryTimeInMS) {
+        invalidateKeyStatus(sessionId);
         mListener->sendExpirationUpdate(toHidlVec(*sessionId), expiryTimeInMS);
     }
 
@@ -396,6 +433,7 @@ namespace implementation {
             Vector<android::DrmPlugin::KeyStatus> const *legacyKeyStatusList,
             bool hasNewUsableKey) {
 
+        invalidateKeyStatus(sessionId);
         Vector<KeyStatus> keyStatusVec;
         for (size_t i = 0; i < legacyKeyStatusList->size(); i++) {
             const android::DrmPlugin::KeyStatus &legacyKeyStatus =
@@ -429,6 +467,17 @@ namespace implementation {
                 toHidlVec(keyStatusVec), hasNewUsableKey);
     }
 
+    void DrmPlugin::invalidateKeyStatus(const Vector<uint8_t> *sessionId) {
+        std::lock_guard<std::mutex> lock(mKeyStatusLock);
+        mKeyStatusGeneration++;
+        if (sessionId == nullptr) {
+            mKeyStatusCache.clear();
+        } else {
+            mKeyStatusCache.erase(std::vector<uint8_t>(sessionId->array(),
+                    sessionId->array() + sessionId->size()));
+        }
+    }
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace drm
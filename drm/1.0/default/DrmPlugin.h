@@ -22,6 +22,11 @@
 #include <hidl/Status.h>
 #include <media/drm/DrmAPI.h>
 
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace drm {
@@ -152,9 +157,26 @@ struct DrmPlugin : public IDrmPlugin, android::DrmPluginListener {
             bool hasNewUsableKey);
 
 private:
+    // The result of a successful queryKeyStatus, which is returned again for
+    // the session until its keys change or it is kMaxKeyStatusAge old.
+    struct CachedKeyStatus {
+        std::chrono::steady_clock::time_point time;
+        hidl_vec<KeyValue> infoMap;
+    };
+    // Bounds how stale the time based values plugins report, such as the
+    // remaining license duration, can get.
+    static constexpr std::chrono::milliseconds kMaxKeyStatusAge{1000};
+
+    void invalidateKeyStatus(const Vector<uint8_t> *sessionId);
+
     android::DrmPlugin *mLegacyPlugin;
     sp<IDrmPluginListener> mListener;
 
+    std::mutex mKeyStatusLock;
+    std::map<std::vector<uint8_t>, CachedKeyStatus> mKeyStatusCache;
+    // Bumped by every invalidation, so that a query racing with one isn't cached.
+    uint64_t mKeyStatusGeneration = 0;
+
     DrmPlugin() = delete;
     DrmPlugin(const DrmPlugin &) = delete;
     void operator=(const DrmPlugin &) = delete;
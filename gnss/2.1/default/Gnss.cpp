@@ -18,6 +18,7 @@
 
 #include "Gnss.h"
 #include "GnssAntennaInfo.h"
+#include "GnssBatching.h"
 #include "GnssDebug.h"
 #include "GnssMeasurement.h"
 #include "GnssMeasurementCorrections.h"
@@ -40,7 +41,10 @@ sp<V2_0::IGnssCallback> Gnss::sGnssCallback_2_0 = nullptr;
 sp<V1_1::IGnssCallback> Gnss::sGnssCallback_1_1 = nullptr;
 sp<V1_0::IGnssCallback> Gnss::sGnssCallback_1_0 = nullptr;
 
-Gnss::Gnss() : mMinIntervalMs(1000), mGnssConfiguration{new GnssConfiguration()} {}
+Gnss::Gnss()
+    : mMinIntervalMs(1000),
+      mGnssConfiguration{new GnssConfiguration()},
+      mGnssBatching{new GnssBatching()} {}
 
 Gnss::~Gnss() {
     stop();
@@ -56,7 +60,8 @@ Return<bool> Gnss::start() {
     mIsActive = true;
     mThread = std::thread([this]() {
         while (mIsActive == true) {
-            auto svStatus = filterBlacklistedSatellitesV2_1(Utils::getMockSvInfoListV2_1());
+            auto svStatus = Utils::getMockSvInfoListV2_1();
+            filterBlacklistedSatellitesV2_1(&svStatus);
             this->reportSvStatus(svStatus);
 
             if (sGnssCallback_2_1 != nullptr || sGnssCallback_2_0 != nullptr) {
@@ -67,20 +72,21 @@ Return<bool> Gnss::start() {
                 this->reportLocation(location);
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMs));
+            std::this_thread::sleep_until(
+                    Utils::nextReportTime(std::chrono::milliseconds(mMinIntervalMs)));
         }
     });
     return true;
 }
 
-hidl_vec<GnssSvInfo> Gnss::filterBlacklistedSatellitesV2_1(hidl_vec<GnssSvInfo> gnssSvInfoList) {
-    for (uint32_t i = 0; i < gnssSvInfoList.size(); i++) {
-        if (mGnssConfiguration->isBlacklistedV2_1(gnssSvInfoList[i])) {
-            gnssSvInfoList[i].v2_0.v1_0.svFlag &=
+void Gnss::filterBlacklistedSatellitesV2_1(hidl_vec<GnssSvInfo>* gnssSvInfoList) {
+    const auto blacklist = mGnssConfiguration->getBlacklist();
+    for (auto& gnssSvInfo : *gnssSvInfoList) {
+        if (blacklist->contains(gnssSvInfo.v2_0.constellation, gnssSvInfo.v2_0.v1_0.svid)) {
+            gnssSvInfo.v2_0.v1_0.svFlag &=
                     ~static_cast<uint8_t>(V1_0::IGnssCallback::GnssSvFlags::USED_IN_FIX);
         }
     }
-    return gnssSvInfoList;
 }
 
 Return<bool> Gnss::stop() {
@@ -189,8 +195,8 @@ Return<sp<V1_0::IGnssDebug>> Gnss::getExtensionGnssDebug() {
 }
 
 Return<sp<V1_0::IGnssBatching>> Gnss::getExtensionGnssBatching() {
-    // TODO implement
-    return ::android::sp<V1_0::IGnssBatching>{};
+    ALOGD("Gnss::getExtensionGnssBatching");
+    return mGnssBatching;
 }
 
 // Methods from V1_1::IGnss follow.
@@ -316,8 +322,8 @@ Return<sp<visibility_control::V1_0::IGnssVisibilityControl>> Gnss::getExtensionV
 }
 
 Return<sp<V2_0::IGnssBatching>> Gnss::getExtensionGnssBatching_2_0() {
-    // TODO implement
-    return ::android::sp<V2_0::IGnssBatching>{};
+    ALOGD("Gnss::getExtensionGnssBatching_2_0");
+    return mGnssBatching;
 }
 
 Return<bool> Gnss::injectBestLocation_2_0(const V2_0::GnssLocation&) {
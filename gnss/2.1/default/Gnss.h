@@ -23,6 +23,7 @@
 #include <mutex>
 #include <thread>
 #include "GnssAntennaInfo.h"
+#include "GnssBatching.h"
 #include "GnssConfiguration.h"
 
 namespace android {
@@ -105,10 +106,11 @@ struct Gnss : public IGnss {
     static sp<V1_0::IGnssCallback> sGnssCallback_1_0;
     std::atomic<long> mMinIntervalMs;
     sp<GnssConfiguration> mGnssConfiguration;
+    sp<GnssBatching> mGnssBatching;
     std::atomic<bool> mIsActive;
     std::thread mThread;
     mutable std::mutex mMutex;
-    hidl_vec<GnssSvInfo> filterBlacklistedSatellitesV2_1(hidl_vec<GnssSvInfo> gnssSvInfoList);
+    void filterBlacklistedSatellitesV2_1(hidl_vec<GnssSvInfo>* gnssSvInfoList);
 };
 
 }  // namespace implementation
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssBatching"
+
+#include "GnssBatching.h"
+#include "Utils.h"
+
+#include <inttypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <chrono>
+
+using ::android::hardware::gnss::common::Utils;
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_1 {
+namespace implementation {
+
+// Number of locations the ring holds.
+constexpr uint16_t kBatchSize = 128;
+// Shortest period batched locations are produced at.
+constexpr int64_t kMinPeriodNanos = 100 * 1000 * 1000;
+
+GnssBatching::GnssBatching() : mRing(kBatchSize), mRingHead(0), mRingCount(0), mIsActive(false) {}
+
+GnssBatching::~GnssBatching() {
+    stopThread();
+}
+
+// Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
+Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>& callback) {
+    ALOGD("init");
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCallback_1_0 = callback;
+    mCallback_2_0 = nullptr;
+    return true;
+}
+
+Return<uint16_t> GnssBatching::getBatchSize() {
+    return kBatchSize;
+}
+
+Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options& options) {
+    ALOGD("start: periodNanos=%" PRId64 " flags=0x%x", options.periodNanos, options.flags);
+    stopThread();
+
+    const auto period = std::chrono::nanoseconds(std::max(options.periodNanos, kMinPeriodNanos));
+    const bool wakeupOnFifoFull =
+            (options.flags & static_cast<uint8_t>(V1_0::IGnssBatching::Flag::WAKEUP_ON_FIFO_FULL));
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIsActive = true;
+    }
+    mThread = std::thread([this, period, wakeupOnFifoFull]() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopCv.wait_for(lock, period, [this] { return !mIsActive; })) {
+            // The ring overwrites the oldest location once full.
+            mRing[(mRingHead + mRingCount) % mRing.size()] = Utils::getMockLocationV2_0();
+            if (mRingCount < mRing.size()) {
+                mRingCount++;
+            } else {
+                mRingHead = (mRingHead + 1) % mRing.size();
+            }
+
+            if (mRingCount == mRing.size() && wakeupOnFifoFull) {
+                std::vector<V2_0::GnssLocation> locations;
+                drainLocked(&locations);
+                lock.unlock();
+                reportBatch(locations);
+                lock.lock();
+            }
+        }
+    });
+    return true;
+}
+
+Return<void> GnssBatching::flush() {
+    ALOGD("flush");
+    std::vector<V2_0::GnssLocation> locations;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        drainLocked(&locations);
+    }
+    // Must be called even when there is nothing to flush.
+    reportBatch(locations);
+    return Void();
+}
+
+Return<bool> GnssBatching::stop() {
+    ALOGD("stop");
+    stopThread();
+    return true;
+}
+
+Return<void> GnssBatching::cleanup() {
+    ALOGD("cleanup");
+    stopThread();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCallback_2_0 = nullptr;
+    mCallback_1_0 = nullptr;
+    // Batched locations must be deleted, not reported.
+    mRingHead = 0;
+    mRingCount = 0;
+    return Void();
+}
+
+// Methods from ::android::hardware::gnss::V2_0::IGnssBatching follow.
+Return<bool> GnssBatching::init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) {
+    ALOGD("init_2_0");
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCallback_2_0 = callback;
+    mCallback_1_0 = nullptr;
+    return true;
+}
+
+// Private methods
+void GnssBatching::stopThread() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIsActive = false;
+    }
+    mStopCv.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void GnssBatching::drainLocked(std::vector<V2_0::GnssLocation>* locations) {
+    locations->reserve(mRingCount);
+    for (size_t i = 0; i < mRingCount; i++) {
+        locations->push_back(std::move(mRing[(mRingHead + i) % mRing.size()]));
+    }
+    mRingHead = 0;
+    mRingCount = 0;
+}
+
+void GnssBatching::reportBatch(const std::vector<V2_0::GnssLocation>& locations) const {
+    sp<V2_0::IGnssBatchingCallback> callback_2_0;
+    sp<V1_0::IGnssBatchingCallback> callback_1_0;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        callback_2_0 = mCallback_2_0;
+        callback_1_0 = mCallback_1_0;
+    }
+
+    if (callback_2_0 != nullptr) {
+        auto ret = callback_2_0->gnssLocationBatchCb(locations);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback v2.0", __func__);
+        }
+        return;
+    }
+    if (callback_1_0 == nullptr) {
+        ALOGE("%s: No non-null callback", __func__);
+        return;
+    }
+    std::vector<V1_0::GnssLocation> locations_1_0;
+    locations_1_0.reserve(locations.size());
+    for (const auto& location : locations) {
+        locations_1_0.push_back(location.v1_0);
+    }
+    auto ret = callback_1_0->gnssLocationBatchCb(locations_1_0);
+    if (!ret.isOk()) {
+        ALOGE("%s: Unable to invoke callback v1.0", __func__);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_1_GNSSBATCHING_H
+#define ANDROID_HARDWARE_GNSS_V2_1_GNSSBATCHING_H
+
+#include <android/hardware/gnss/2.0/IGnssBatching.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_1 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+/**
+ * Batches mock locations in a fixed size ring, and hands them over in one batch callback on
+ * flush(), or when the ring is full if WAKEUP_ON_FIFO_FULL is set. Otherwise the oldest location
+ * is dropped when the ring is full. Runs independently of IGnss::start().
+ */
+struct GnssBatching : public V2_0::IGnssBatching {
+    GnssBatching();
+    ~GnssBatching();
+
+    // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
+    Return<bool> init(const sp<V1_0::IGnssBatchingCallback>& callback) override;
+    Return<uint16_t> getBatchSize() override;
+    Return<bool> start(const V1_0::IGnssBatching::Options& options) override;
+    Return<void> flush() override;
+    Return<bool> stop() override;
+    Return<void> cleanup() override;
+
+    // Methods from ::android::hardware::gnss::V2_0::IGnssBatching follow.
+    Return<bool> init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) override;
+
+  private:
+    void stopThread();
+    // Moves the batched locations, oldest first, out of the ring and into |locations|.
+    void drainLocked(std::vector<V2_0::GnssLocation>* locations);
+    void reportBatch(const std::vector<V2_0::GnssLocation>& locations) const;
+
+    // Guarded by mMutex
+    sp<V2_0::IGnssBatchingCallback> mCallback_2_0;
+    sp<V1_0::IGnssBatchingCallback> mCallback_1_0;
+    std::vector<V2_0::GnssLocation> mRing;
+    size_t mRingHead;
+    size_t mRingCount;
+    bool mIsActive;
+
+    std::thread mThread;
+    mutable std::mutex mMutex;
+    std::condition_variable mStopCv;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_1_GNSSBATCHING_H
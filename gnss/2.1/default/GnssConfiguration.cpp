@@ -18,6 +18,7 @@
 
 #include "GnssConfiguration.h"
 #include <log/log.h>
+#include <atomic>
 
 namespace android {
 namespace hardware {
@@ -74,29 +75,47 @@ Return<bool> GnssConfiguration::setEsExtensionSec(uint32_t emergencyExtensionSec
 // Methods from ::android::hardware::gnss::V2_1::IGnssConfiguration follow.
 Return<bool> GnssConfiguration::setBlacklist_2_1(
         const hidl_vec<V2_1::IGnssConfiguration::BlacklistedSource>& sourceList) {
-    std::unique_lock<std::recursive_mutex> lock(mMutex);
-    mBlacklistedConstellationSet.clear();
-    mBlacklistedSourceSet.clear();
-    for (auto source : sourceList) {
-        if (source.svid == 0) {
+    std::shared_ptr<const BlacklistBitmapV2_1> blacklist =
+            std::make_shared<BlacklistBitmapV2_1>(sourceList);
+    std::atomic_store(&mBlacklist, blacklist);
+    return true;
+}
+
+Return<bool> GnssConfiguration::isBlacklistedV2_1(const GnssSvInfoV2_1& gnssSvInfo) const {
+    return getBlacklist()->contains(gnssSvInfo.v2_0.constellation, gnssSvInfo.v2_0.v1_0.svid);
+}
+
+std::shared_ptr<const BlacklistBitmapV2_1> GnssConfiguration::getBlacklist() const {
+    return std::atomic_load(&mBlacklist);
+}
+
+std::recursive_mutex& GnssConfiguration::getMutex() const {
+    return mMutex;
+}
+
+BlacklistBitmapV2_1::BlacklistBitmapV2_1(const hidl_vec<BlacklistedSourceV2_1>& sourceList) {
+    for (const auto& source : sourceList) {
+        const size_t index = static_cast<size_t>(source.constellation);
+        if (index >= kNumConstellations || source.svid < 0 ||
+            source.svid >= static_cast<int16_t>(kMaxSvid)) {
+            outOfRange.push_back(source);
+        } else if (source.svid == 0) {
             // Wildcard blacklist, i.e., blacklist entire constellation.
-            mBlacklistedConstellationSet.insert(source.constellation);
+            constellations.set(index);
         } else {
-            mBlacklistedSourceSet.insert(source);
+            svids[index].set(source.svid);
         }
     }
-    return true;
 }
 
-Return<bool> GnssConfiguration::isBlacklistedV2_1(const GnssSvInfoV2_1& gnssSvInfo) const {
-    std::unique_lock<std::recursive_mutex> lock(mMutex);
-    if (mBlacklistedConstellationSet.find(gnssSvInfo.v2_0.constellation) !=
-        mBlacklistedConstellationSet.end()) {
-        return true;
+bool BlacklistBitmapV2_1::containsOutOfRange(GnssConstellationTypeV2_0 constellation,
+                                             int16_t svid) const {
+    for (const auto& source : outOfRange) {
+        if (source.constellation == constellation && (source.svid == 0 || source.svid == svid)) {
+            return true;
+        }
     }
-    BlacklistedSourceV2_1 source = {.constellation = gnssSvInfo.v2_0.constellation,
-                                    .svid = gnssSvInfo.v2_0.v1_0.svid};
-    return (mBlacklistedSourceSet.find(source) != mBlacklistedSourceSet.end());
+    return false;
 }
 
 }  // namespace implementation
@@ -21,8 +21,11 @@
 #include <android/hardware/gnss/2.1/IGnssConfiguration.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <array>
+#include <bitset>
+#include <memory>
 #include <mutex>
-#include <unordered_set>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -43,22 +46,35 @@ using BlacklistedSourceV2_1 =
 using GnssConstellationTypeV2_0 = V2_0::GnssConstellationType;
 using GnssSvInfoV2_1 = V2_1::IGnssCallback::GnssSvInfo;
 
-struct BlacklistedSourceHashV2_1 {
-    inline int operator()(const BlacklistedSourceV2_1& source) const {
-        return int(source.constellation) * 1000 + int(source.svid);
+// The satellite blacklist as one bit per SVID of each constellation, so that checking a
+// satellite is a couple of indexing operations. It is never modified once published; see
+// GnssConfiguration::getBlacklist().
+struct BlacklistBitmapV2_1 {
+    // Covers every constellation and SVID range defined by GnssSvInfo.
+    static constexpr size_t kNumConstellations =
+            static_cast<size_t>(GnssConstellationTypeV2_0::IRNSS) + 1;
+    static constexpr size_t kMaxSvid = 256;
+
+    explicit BlacklistBitmapV2_1(const hidl_vec<BlacklistedSourceV2_1>& sourceList);
+
+    inline bool contains(GnssConstellationTypeV2_0 constellation, int16_t svid) const {
+        const size_t index = static_cast<size_t>(constellation);
+        if (index < kNumConstellations) {
+            if (constellations[index]) return true;
+            if (svid >= 0 && svid < static_cast<int16_t>(kMaxSvid)) return svids[index][svid];
+        }
+        return containsOutOfRange(constellation, svid);
     }
-};
 
-struct BlacklistedSourceEqualV2_1 {
-    inline bool operator()(const BlacklistedSourceV2_1& s1, const BlacklistedSourceV2_1& s2) const {
-        return (s1.constellation == s2.constellation) && (s1.svid == s2.svid);
-    }
-};
+  private:
+    bool containsOutOfRange(GnssConstellationTypeV2_0 constellation, int16_t svid) const;
 
-using BlacklistedSourceSetV2_1 =
-        std::unordered_set<BlacklistedSourceV2_1, BlacklistedSourceHashV2_1,
-                           BlacklistedSourceEqualV2_1>;
-using BlacklistedConstellationSetV2_1 = std::unordered_set<GnssConstellationTypeV2_0>;
+    // Constellations blacklisted as a whole.
+    std::bitset<kNumConstellations> constellations;
+    std::array<std::bitset<kMaxSvid>, kNumConstellations> svids;
+    // Sources outside the ranges above, which no valid GnssSvInfo has.
+    std::vector<BlacklistedSourceV2_1> outOfRange;
+};
 
 struct GnssConfiguration : public IGnssConfiguration {
     // Methods from ::android::hardware::gnss::V1_0::IGnssConfiguration follow.
@@ -85,11 +101,17 @@ struct GnssConfiguration : public IGnssConfiguration {
 
     Return<bool> isBlacklistedV2_1(const GnssSvInfoV2_1& gnssSvInfo) const;
 
+    // Returns the current blacklist. Callers checking many satellites should check them all
+    // against the one blacklist returned, rather than call isBlacklistedV2_1 for each.
+    std::shared_ptr<const BlacklistBitmapV2_1> getBlacklist() const;
+
   private:
     mutable std::recursive_mutex mMutex;
 
-    BlacklistedSourceSetV2_1 mBlacklistedSourceSet;
-    BlacklistedConstellationSetV2_1 mBlacklistedConstellationSet;
+    // Replaced as a whole, and only accessed through std::atomic_load and std::atomic_store, so
+    // that readers need no lock.
+    std::shared_ptr<const BlacklistBitmapV2_1> mBlacklist =
+            std::make_shared<const BlacklistBitmapV2_1>(hidl_vec<BlacklistedSourceV2_1>());
 };
 
 }  // namespace implementation
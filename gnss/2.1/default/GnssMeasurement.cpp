@@ -18,6 +18,7 @@
 
 #include "GnssMeasurement.h"
 #include <log/log.h>
+#include <utils/SystemClock.h>
 #include "Utils.h"
 
 namespace android {
@@ -97,16 +98,22 @@ void GnssMeasurement::start() {
     ALOGD("start");
     mIsActive = true;
     mThread = std::thread([this]() {
+        // The reports are built once and reused; only their timestamps change between reports.
+        auto measurementV2_1 = Utils::getMockMeasurementV2_1();
+        auto measurementV2_0 = Utils::getMockMeasurementV2_0();
         while (mIsActive == true) {
+            const auto timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano());
             if (sCallback_2_1 != nullptr) {
-                auto measurement = Utils::getMockMeasurementV2_1();
-                this->reportMeasurement(measurement);
+                measurementV2_1.elapsedRealtime.timestampNs = timestampNs;
+                this->reportMeasurement(measurementV2_1);
             } else {
-                auto measurement = Utils::getMockMeasurementV2_0();
-                this->reportMeasurement(measurement);
+                measurementV2_0.elapsedRealtime.timestampNs = timestampNs;
+                this->reportMeasurement(measurementV2_0);
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMillis));
+            // Aligned with the location reports of the same interval.
+            std::this_thread::sleep_until(
+                    Utils::nextReportTime(std::chrono::milliseconds(mMinIntervalMillis)));
         }
     });
 }
@@ -287,6 +287,14 @@ hidl_vec<GnssAntennaInfo> Utils::getMockAntennaInfos() {
     return mockAntennaInfos;
 }
 
+std::chrono::steady_clock::time_point Utils::nextReportTime(std::chrono::milliseconds interval) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    if (interval.count() <= 0) {
+        return std::chrono::steady_clock::time_point(now);
+    }
+    return std::chrono::steady_clock::time_point((now / interval + 1) * interval);
+}
+
 }  // namespace common
 }  // namespace gnss
 }  // namespace hardware
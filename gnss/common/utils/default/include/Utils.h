@@ -21,6 +21,8 @@
 #include <android/hardware/gnss/2.0/IGnss.h>
 #include <android/hardware/gnss/2.1/IGnss.h>
 
+#include <chrono>
+
 using ::android::hardware::hidl_vec;
 
 namespace android {
@@ -50,6 +52,11 @@ struct Utils {
                                             float cN0DbHz, float elevationDegrees,
                                             float azimuthDegrees);
     static hidl_vec<GnssAntennaInfo> getMockAntennaInfos();
+
+    // Returns when the next report of a stream reported every |interval| is due. Report times
+    // are aligned to a common epoch, so that streams with the same interval are reported in the
+    // same wakeup, and don't drift apart.
+    static std::chrono::steady_clock::time_point nextReportTime(std::chrono::milliseconds interval);
 };
 
 }  // namespace common
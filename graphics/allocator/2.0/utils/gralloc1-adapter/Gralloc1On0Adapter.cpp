@@ -202,7 +202,7 @@ gralloc1_error_t Gralloc1On0Adapter::createDescriptor(
         gralloc1_buffer_descriptor_t* outDescriptor)
 {
     auto descriptorId = sNextBufferDescriptorId++;
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
+    std::unique_lock<std::shared_mutex> lock(mDescriptorMutex);
     mDescriptors.emplace(descriptorId, std::make_shared<Descriptor>());
 
     ALOGV("Created descriptor %" PRIu64, descriptorId);
@@ -216,7 +216,7 @@ gralloc1_error_t Gralloc1On0Adapter::destroyDescriptor(
 {
     ALOGV("Destroying descriptor %" PRIu64, descriptor);
 
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
+    std::unique_lock<std::shared_mutex> lock(mDescriptorMutex);
     if (mDescriptors.count(descriptor) == 0) {
         return GRALLOC1_ERROR_BAD_DESCRIPTOR;
     }
@@ -279,8 +279,9 @@ gralloc1_error_t Gralloc1On0Adapter::allocate(
     auto buffer = std::make_shared<Buffer>(handle, backingStore,
             *descriptor, stride, numFlexPlanes, true);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    mBuffers.emplace(handle, std::move(buffer));
+    auto& shard = getBufferShard(handle);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.buffers.emplace(handle, std::move(buffer));
 
     return GRALLOC1_ERROR_NONE;
 }
@@ -331,7 +332,8 @@ int32_t Gralloc1On0Adapter::allocateHook(gralloc1_device* device,
 gralloc1_error_t Gralloc1On0Adapter::retain(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    auto& shard = getBufferShard(buffer->getHandle());
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
     buffer->retain();
     return GRALLOC1_ERROR_NONE;
 }
@@ -339,12 +341,13 @@ gralloc1_error_t Gralloc1On0Adapter::retain(
 gralloc1_error_t Gralloc1On0Adapter::release(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    buffer_handle_t handle = buffer->getHandle();
+    auto& shard = getBufferShard(handle);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
     if (!buffer->release()) {
         return GRALLOC1_ERROR_NONE;
     }
 
-    buffer_handle_t handle = buffer->getHandle();
     if (buffer->wasAllocated()) {
         ALOGV("Calling free(%p)", handle);
         int result = mDevice->free(mDevice, handle);
@@ -359,7 +362,7 @@ gralloc1_error_t Gralloc1On0Adapter::release(
         }
     }
 
-    mBuffers.erase(handle);
+    shard.buffers.erase(handle);
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -367,10 +370,12 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 {
     ALOGV("retain(%p)", bufferHandle);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    auto& shard = getBufferShard(bufferHandle);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
 
-    if (mBuffers.count(bufferHandle) != 0) {
-        mBuffers[bufferHandle]->retain();
+    auto iter = shard.buffers.find(bufferHandle);
+    if (iter != shard.buffers.end()) {
+        iter->second->retain();
         return GRALLOC1_ERROR_NONE;
     }
 
@@ -417,7 +422,7 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 
     auto buffer = std::make_shared<Buffer>(bufferHandle, backingStore,
             descriptor, stride, numFlexPlanes, false);
-    mBuffers.emplace(bufferHandle, std::move(buffer));
+    shard.buffers.emplace(bufferHandle, std::move(buffer));
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -541,23 +546,54 @@ gralloc1_error_t Gralloc1On0Adapter::unlock(
 std::shared_ptr<Gralloc1On0Adapter::Descriptor>
 Gralloc1On0Adapter::getDescriptor(gralloc1_buffer_descriptor_t descriptorId)
 {
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    if (mDescriptors.count(descriptorId) == 0) {
+    std::shared_lock<std::shared_mutex> lock(mDescriptorMutex);
+    auto iter = mDescriptors.find(descriptorId);
+    if (iter == mDescriptors.end()) {
         return nullptr;
     }
 
-    return mDescriptors[descriptorId];
+    return iter->second;
+}
+
+Gralloc1On0Adapter::BufferShard& Gralloc1On0Adapter::getBufferShard(
+        buffer_handle_t bufferHandle)
+{
+    // handles are heap pointers; drop the low bits that are always zero
+    auto key = reinterpret_cast<uintptr_t>(bufferHandle) >> 4;
+    return mBufferShards[key % kBufferShardCount];
 }
 
 std::shared_ptr<Gralloc1On0Adapter::Buffer> Gralloc1On0Adapter::getBuffer(
         buffer_handle_t bufferHandle)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (mBuffers.count(bufferHandle) == 0) {
-        return nullptr;
+    // A thread usually locks and unlocks the same buffer back to back, so
+    // remember the last buffer looked up by this thread.  The cached buffer
+    // is used only while it is still retained; a released and re-registered
+    // handle gets a new Buffer.
+    static thread_local const Gralloc1On0Adapter* sLastAdapter = nullptr;
+    static thread_local std::weak_ptr<Buffer> sLastBuffer;
+    if (sLastAdapter == this) {
+        auto buffer = sLastBuffer.lock();
+        if (buffer && buffer->getHandle() == bufferHandle &&
+                buffer->isRetained()) {
+            return buffer;
+        }
+    }
+
+    std::shared_ptr<Buffer> buffer;
+    {
+        auto& shard = getBufferShard(bufferHandle);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.buffers.find(bufferHandle);
+        if (iter == shard.buffers.end()) {
+            return nullptr;
+        }
+        buffer = iter->second;
     }
 
-    return mBuffers[bufferHandle];
+    sLastAdapter = this;
+    sLastBuffer = buffer;
+    return buffer;
 }
 
 std::atomic<gralloc1_buffer_descriptor_t>
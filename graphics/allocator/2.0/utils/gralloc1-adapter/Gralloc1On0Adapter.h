@@ -20,9 +20,11 @@
 #include <hardware/gralloc1.h>
 #include <log/log.h>
 
+#include <array>
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -207,6 +209,8 @@ private:
         // the buffer needs to be released
         bool release() { return --mReferenceCount == 0; }
 
+        bool isRetained() const { return mReferenceCount > 0; }
+
         bool wasAllocated() const { return mWasAllocated; }
 
         gralloc1_error_t getBackingStore(
@@ -257,7 +261,7 @@ private:
     private:
 
         const buffer_handle_t mHandle;
-        size_t mReferenceCount;
+        std::atomic<size_t> mReferenceCount;
 
         const gralloc1_backing_store_t mStore;
         const Descriptor mDescriptor;
@@ -445,11 +449,20 @@ private:
     std::shared_ptr<Buffer> getBuffer(buffer_handle_t bufferHandle);
 
     static std::atomic<gralloc1_buffer_descriptor_t> sNextBufferDescriptorId;
-    std::mutex mDescriptorMutex;
+    std::shared_mutex mDescriptorMutex;
     std::unordered_map<gralloc1_buffer_descriptor_t,
             std::shared_ptr<Descriptor>> mDescriptors;
-    std::mutex mBufferMutex;
-    std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> mBuffers;
+
+    // Buffers are spread over shards by handle, so that lookups from
+    // different threads rarely contend.  Lookups take the shard lock shared;
+    // registration and reference count changes take it exclusively.
+    struct BufferShard {
+        std::shared_mutex mutex;
+        std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> buffers;
+    };
+    static constexpr size_t kBufferShardCount = 16;
+    BufferShard& getBufferShard(buffer_handle_t bufferHandle);
+    std::array<BufferShard, kBufferShardCount> mBufferShards;
 };
 
 } // namespace hardware
@@ -20,7 +20,11 @@
 #warning "Gralloc1Hal.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>  // for strerror
+#include <mutex>
+#include <vector>
 
 #include <allocator-hal/2.0/AllocatorHal.h>
 #include <hardware/gralloc1.h>
@@ -47,6 +51,9 @@ class Gralloc1HalImpl : public Hal {
    public:
     ~Gralloc1HalImpl() {
         if (mDevice) {
+            for (const auto& entry : mDescriptorCache) {
+                mDispatch.destroyDescriptor(mDevice, entry.descriptor);
+            }
             gralloc1_close(mDevice);
         }
     }
@@ -89,7 +96,7 @@ class Gralloc1HalImpl : public Hal {
         }
 
         gralloc1_buffer_descriptor_t desc;
-        Error error = createDescriptor(descriptorInfo, &desc);
+        Error error = acquireDescriptor(descriptorInfo, &desc);
         if (error != Error::NONE) {
             return error;
         }
@@ -118,7 +125,7 @@ class Gralloc1HalImpl : public Hal {
             }
         }
 
-        mDispatch.destroyDescriptor(mDevice, desc);
+        recycleDescriptor(descriptorInfo, desc);
 
         if (error != Error::NONE) {
             freeBuffers(buffers);
@@ -310,6 +317,57 @@ class Gralloc1HalImpl : public Hal {
         return toError(error);
     }
 
+    // Get a gralloc1 descriptor for info, reusing a cached one when possible.
+    // The descriptor is owned by the caller until it is recycled.
+    Error acquireDescriptor(const mapper::V2_0::IMapper::BufferDescriptorInfo& info,
+                            gralloc1_buffer_descriptor_t* outDescriptor) {
+        {
+            std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+            auto iter = std::find_if(mDescriptorCache.begin(), mDescriptorCache.end(),
+                                     [&info](const auto& entry) { return entry.info == info; });
+            if (iter != mDescriptorCache.end()) {
+                *outDescriptor = iter->descriptor;
+                mDescriptorCache.erase(iter);
+                return Error::NONE;
+            }
+        }
+
+        return createDescriptor(info, outDescriptor);
+    }
+
+    // Return a descriptor to the cache, and destroy the descriptors that are
+    // no longer worth keeping
+    void recycleDescriptor(const mapper::V2_0::IMapper::BufferDescriptorInfo& info,
+                           gralloc1_buffer_descriptor_t descriptor) {
+        std::vector<gralloc1_buffer_descriptor_t> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mDescriptorCacheMutex);
+            auto now = std::chrono::steady_clock::now();
+
+            // another allocation with the same info may have recycled first
+            auto iter = std::find_if(mDescriptorCache.begin(), mDescriptorCache.end(),
+                                     [&info](const auto& entry) { return entry.info == info; });
+            if (iter == mDescriptorCache.end()) {
+                mDescriptorCache.insert(mDescriptorCache.begin(), {info, descriptor, now});
+            } else {
+                iter->lastUsed = now;
+                evicted.push_back(descriptor);
+            }
+
+            // the cache is ordered from the most to the least recently used
+            while (!mDescriptorCache.empty() &&
+                   (mDescriptorCache.size() > kDescriptorCacheSize ||
+                    now - mDescriptorCache.back().lastUsed > kDescriptorCacheTimeout)) {
+                evicted.push_back(mDescriptorCache.back().descriptor);
+                mDescriptorCache.pop_back();
+            }
+        }
+
+        for (auto desc : evicted) {
+            mDispatch.destroyDescriptor(mDevice, desc);
+        }
+    }
+
     Error allocateOneBuffer(gralloc1_buffer_descriptor_t descriptor,
                             const native_handle_t** outBuffer, uint32_t* outStride) {
         const native_handle_t* buffer = nullptr;
@@ -350,6 +408,20 @@ class Gralloc1HalImpl : public Hal {
         GRALLOC1_PFN_ALLOCATE allocate;
         GRALLOC1_PFN_RELEASE release;
     } mDispatch = {};
+
+    // gralloc1 descriptors of recent allocations, so that producers
+    // reallocating with the same info do not need to set up a new descriptor
+    static constexpr size_t kDescriptorCacheSize = 8;
+    static constexpr std::chrono::seconds kDescriptorCacheTimeout{10};
+
+    struct CachedDescriptor {
+        mapper::V2_0::IMapper::BufferDescriptorInfo info;
+        gralloc1_buffer_descriptor_t descriptor;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    std::mutex mDescriptorCacheMutex;
+    std::vector<CachedDescriptor> mDescriptorCache;
 };
 
 }  // namespace detail
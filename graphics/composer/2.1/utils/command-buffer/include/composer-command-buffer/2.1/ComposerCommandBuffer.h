@@ -59,21 +59,39 @@ class CommandWriterBase {
         reset();
     }
 
-    virtual ~CommandWriterBase() { reset(); }
+    virtual ~CommandWriterBase() { clearData(); }
 
-    void reset() {
-        mDataWritten = 0;
-        mCommandEnd = 0;
+    // Command lengths of the frames written so far, for dumps
+    struct Stats {
+        uint64_t frameCount = 0;
+        uint32_t lastLength = 0;
+        uint32_t maxLength = 0;
+        // Times the data grew in the middle of a frame
+        uint64_t dataGrowthCount = 0;
+        // Times the client had to fetch a new queue descriptor
+        uint64_t queueChangeCount = 0;
+    };
 
-        // handles in mDataHandles are owned by the caller
-        mDataHandles.clear();
+    const Stats& getStats() const { return mStats; }
 
-        // handles in mTemporaryHandles are owned by the writer
-        for (auto handle : mTemporaryHandles) {
-            native_handle_close(handle);
-            native_handle_delete(handle);
+    void reset() {
+        clearData();
+
+        // Between frames, make room for the longest frame so far plus half, and prepare the
+        // queue to hold it, so that neither is reallocated while the next frames are written
+        if (mStats.frameCount > 0) {
+            uint32_t highWaterMark = mStats.maxLength + mStats.maxLength / 2;
+            if (highWaterMark > mDataMaxSize) {
+                resizeData(highWaterMark);
+            }
+            if ((!mQueue || mDataMaxSize > mQueue->getQuantumCount()) &&
+                (!mPendingQueue || mDataMaxSize > mPendingQueue->getQuantumCount())) {
+                auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+                if (newQueue->isValid()) {
+                    mPendingQueue = std::move(newQueue);
+                }
+            }
         }
-        mTemporaryHandles.clear();
     }
 
     IComposerClient::Command getCommand(uint32_t offset) {
@@ -91,6 +109,10 @@ class CommandWriterBase {
             return true;
         }
 
+        mStats.frameCount++;
+        mStats.lastLength = mDataWritten;
+        mStats.maxLength = std::max(mStats.maxLength, mDataWritten);
+
         // After data are written to the queue, it may not be read by the
         // remote reader when
         //
@@ -108,7 +130,8 @@ class CommandWriterBase {
             }
         }
 
-        // write data to queue, optionally resizing it
+        // write data to queue, optionally switching to the queue prepared by reset() or to a
+        // new one when it is too small
         if (mQueue && (mDataMaxSize <= mQueue->getQuantumCount())) {
             if (!mQueue->write(mData.get(), mDataWritten)) {
                 ALOGE("failed to write commands to message queue");
@@ -117,7 +140,13 @@ class CommandWriterBase {
 
             *outQueueChanged = false;
         } else {
-            auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+            std::unique_ptr<CommandQueueType> newQueue;
+            if (mPendingQueue && (mDataMaxSize <= mPendingQueue->getQuantumCount())) {
+                newQueue = std::move(mPendingQueue);
+            } else {
+                newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+            }
+            mPendingQueue = nullptr;
             if (!newQueue->isValid() || !newQueue->write(mData.get(), mDataWritten)) {
                 ALOGE("failed to prepare a new message queue ");
                 return false;
@@ -125,6 +154,7 @@ class CommandWriterBase {
 
             mQueue = std::move(newQueue);
             *outQueueChanged = true;
+            mStats.queueChangeCount++;
         }
 
         *outCommandLength = mDataWritten;
@@ -543,6 +573,21 @@ class CommandWriterBase {
     uint32_t mDataWritten;
 
    private:
+    void clearData() {
+        mDataWritten = 0;
+        mCommandEnd = 0;
+
+        // handles in mDataHandles are owned by the caller
+        mDataHandles.clear();
+
+        // handles in mTemporaryHandles are owned by the writer
+        for (auto handle : mTemporaryHandles) {
+            native_handle_close(handle);
+            native_handle_delete(handle);
+        }
+        mTemporaryHandles.clear();
+    }
+
     void growData(uint32_t grow) {
         uint32_t newWritten = mDataWritten + grow;
         if (newWritten < mDataWritten) {
@@ -559,6 +604,11 @@ class CommandWriterBase {
             newMaxSize = newWritten;
         }
 
+        resizeData(newMaxSize);
+        mStats.dataGrowthCount++;
+    }
+
+    void resizeData(uint32_t newMaxSize) {
         auto newData = std::make_unique<uint32_t[]>(newMaxSize);
         std::copy_n(mData.get(), mDataWritten, newData.get());
         mDataMaxSize = newMaxSize;
@@ -573,6 +623,10 @@ class CommandWriterBase {
     std::vector<native_handle_t*> mTemporaryHandles;
 
     std::unique_ptr<CommandQueueType> mQueue;
+    // A larger queue allocated between frames, used once the data outgrows mQueue
+    std::unique_ptr<CommandQueueType> mPendingQueue;
+
+    Stats mStats;
 };
 
 // This class helps parse a command queue.  Note that all sizes/lengths are in
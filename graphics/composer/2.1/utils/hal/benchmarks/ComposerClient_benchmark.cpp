@@ -0,0 +1,452 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <composer-command-buffer/2.1/ComposerCommandBuffer.h>
+#include <composer-hal/2.1/ComposerClient.h>
+#include <composer-hal/2.1/ComposerHal.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Every allocation made by the process is counted, so that the benchmarks can report the
+// allocations made per frame
+static std::atomic<uint64_t> gAllocationCount{0};
+
+void* operator new(size_t size) {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::graphics::common::V1_0::ColorMode;
+using ::android::hardware::graphics::common::V1_0::Dataspace;
+using ::android::hardware::graphics::common::V1_0::Hdr;
+using ::android::hardware::graphics::common::V1_0::PixelFormat;
+using ::android::hardware::graphics::composer::V2_1::CommandReaderBase;
+using ::android::hardware::graphics::composer::V2_1::CommandWriterBase;
+using ::android::hardware::graphics::composer::V2_1::Config;
+using ::android::hardware::graphics::composer::V2_1::Display;
+using ::android::hardware::graphics::composer::V2_1::Error;
+using ::android::hardware::graphics::composer::V2_1::IComposerCallback;
+using ::android::hardware::graphics::composer::V2_1::IComposerClient;
+using ::android::hardware::graphics::composer::V2_1::Layer;
+using ::android::hardware::graphics::composer::V2_1::hal::ComposerClient;
+using ::android::hardware::graphics::composer::V2_1::hal::ComposerHal;
+
+constexpr Display kDisplay = 1;
+constexpr uint32_t kBufferSlotCount = 3;
+constexpr uint32_t kDisplayWidth = 1920;
+constexpr uint32_t kDisplayHeight = 1080;
+constexpr uint32_t kWriterInitialSize = 64;
+
+// A HAL that does nothing, so that only the overhead of the composer HAL itself is measured
+class NullComposerHal : public ComposerHal {
+  public:
+    bool hasCapability(hwc2_capability_t /*capability*/) override { return false; }
+    std::string dumpDebugInfo() override { return ""; }
+
+    void registerEventCallback(EventCallback* callback) override {
+        callback->onHotplug(kDisplay, IComposerCallback::Connection::CONNECTED);
+    }
+    void unregisterEventCallback() override {}
+
+    uint32_t getMaxVirtualDisplayCount() override { return 0; }
+    Error createVirtualDisplay(uint32_t /*width*/, uint32_t /*height*/, PixelFormat* /*format*/,
+                               Display* /*outDisplay*/) override {
+        return Error::NO_RESOURCES;
+    }
+    Error destroyVirtualDisplay(Display /*display*/) override { return Error::BAD_DISPLAY; }
+    Error createLayer(Display /*display*/, Layer* outLayer) override {
+        *outLayer = ++mLastLayer;
+        return Error::NONE;
+    }
+    Error destroyLayer(Display /*display*/, Layer /*layer*/) override { return Error::NONE; }
+
+    Error getActiveConfig(Display /*display*/, Config* outConfig) override {
+        *outConfig = 0;
+        return Error::NONE;
+    }
+    Error getClientTargetSupport(Display /*display*/, uint32_t /*width*/, uint32_t /*height*/,
+                                 PixelFormat /*format*/, Dataspace /*dataspace*/) override {
+        return Error::NONE;
+    }
+    Error getColorModes(Display /*display*/, hidl_vec<ColorMode>* outModes) override {
+        *outModes = hidl_vec<ColorMode>({ColorMode::NATIVE});
+        return Error::NONE;
+    }
+    Error getDisplayAttribute(Display /*display*/, Config /*config*/,
+                              IComposerClient::Attribute /*attribute*/,
+                              int32_t* outValue) override {
+        *outValue = 0;
+        return Error::NONE;
+    }
+    Error getDisplayConfigs(Display /*display*/, hidl_vec<Config>* outConfigs) override {
+        *outConfigs = hidl_vec<Config>({0});
+        return Error::NONE;
+    }
+    Error getDisplayName(Display /*display*/, hidl_string* outName) override {
+        *outName = "null";
+        return Error::NONE;
+    }
+    Error getDisplayType(Display /*display*/, IComposerClient::DisplayType* outType) override {
+        *outType = IComposerClient::DisplayType::PHYSICAL;
+        return Error::NONE;
+    }
+    Error getDozeSupport(Display /*display*/, bool* outSupport) override {
+        *outSupport = false;
+        return Error::NONE;
+    }
+    Error getHdrCapabilities(Display /*display*/, hidl_vec<Hdr>* /*outTypes*/,
+                             float* /*outMaxLuminance*/, float* /*outMaxAverageLuminance*/,
+                             float* /*outMinLuminance*/) override {
+        return Error::NONE;
+    }
+
+    Error setActiveConfig(Display /*display*/, Config /*config*/) override { return Error::NONE; }
+    Error setColorMode(Display /*display*/, ColorMode /*mode*/) override { return Error::NONE; }
+    Error setPowerMode(Display /*display*/, IComposerClient::PowerMode /*mode*/) override {
+        return Error::NONE;
+    }
+    Error setVsyncEnabled(Display /*display*/, IComposerClient::Vsync /*enabled*/) override {
+        return Error::NONE;
+    }
+
+    Error setColorTransform(Display /*display*/, const float* /*matrix*/,
+                            int32_t /*hint*/) override {
+        return Error::NONE;
+    }
+    Error setClientTarget(Display /*display*/, buffer_handle_t /*target*/, int32_t acquireFence,
+                          int32_t /*dataspace*/,
+                          const std::vector<hwc_rect_t>& /*damage*/) override {
+        closeFence(acquireFence);
+        return Error::NONE;
+    }
+    Error setOutputBuffer(Display /*display*/, buffer_handle_t /*buffer*/,
+                          int32_t releaseFence) override {
+        closeFence(releaseFence);
+        return Error::NONE;
+    }
+    Error validateDisplay(Display /*display*/, std::vector<Layer>* /*outChangedLayers*/,
+                          std::vector<IComposerClient::Composition>* /*outCompositionTypes*/,
+                          uint32_t* outDisplayRequestMask,
+                          std::vector<Layer>* /*outRequestedLayers*/,
+                          std::vector<uint32_t>* /*outRequestMasks*/) override {
+        *outDisplayRequestMask = 0;
+        return Error::NONE;
+    }
+    Error acceptDisplayChanges(Display /*display*/) override { return Error::NONE; }
+    Error presentDisplay(Display /*display*/, int32_t* outPresentFence,
+                         std::vector<Layer>* /*outLayers*/,
+                         std::vector<int32_t>* /*outReleaseFences*/) override {
+        *outPresentFence = -1;
+        return Error::NONE;
+    }
+
+    Error setLayerCursorPosition(Display /*display*/, Layer /*layer*/, int32_t /*x*/,
+                                 int32_t /*y*/) override {
+        return Error::NONE;
+    }
+    Error setLayerBuffer(Display /*display*/, Layer /*layer*/, buffer_handle_t /*buffer*/,
+                         int32_t acquireFence) override {
+        closeFence(acquireFence);
+        return Error::NONE;
+    }
+    Error setLayerSurfaceDamage(Display /*display*/, Layer /*layer*/,
+                                const std::vector<hwc_rect_t>& /*damage*/) override {
+        return Error::NONE;
+    }
+    Error setLayerBlendMode(Display /*display*/, Layer /*layer*/, int32_t /*mode*/) override {
+        return Error::NONE;
+    }
+    Error setLayerColor(Display /*display*/, Layer /*layer*/,
+                        IComposerClient::Color /*color*/) override {
+        return Error::NONE;
+    }
+    Error setLayerCompositionType(Display /*display*/, Layer /*layer*/,
+                                  int32_t /*type*/) override {
+        return Error::NONE;
+    }
+    Error setLayerDataspace(Display /*display*/, Layer /*layer*/, int32_t /*dataspace*/) override {
+        return Error::NONE;
+    }
+    Error setLayerDisplayFrame(Display /*display*/, Layer /*layer*/,
+                               const hwc_rect_t& /*frame*/) override {
+        return Error::NONE;
+    }
+    Error setLayerPlaneAlpha(Display /*display*/, Layer /*layer*/, float /*alpha*/) override {
+        return Error::NONE;
+    }
+    Error setLayerSidebandStream(Display /*display*/, Layer /*layer*/,
+                                 buffer_handle_t /*stream*/) override {
+        return Error::NONE;
+    }
+    Error setLayerSourceCrop(Display /*display*/, Layer /*layer*/,
+                             const hwc_frect_t& /*crop*/) override {
+        return Error::NONE;
+    }
+    Error setLayerTransform(Display /*display*/, Layer /*layer*/, int32_t /*transform*/) override {
+        return Error::NONE;
+    }
+    Error setLayerVisibleRegion(Display /*display*/, Layer /*layer*/,
+                                const std::vector<hwc_rect_t>& /*visible*/) override {
+        return Error::NONE;
+    }
+    Error setLayerZOrder(Display /*display*/, Layer /*layer*/, uint32_t /*z*/) override {
+        return Error::NONE;
+    }
+
+  private:
+    static void closeFence(int32_t fence) {
+        if (fence >= 0) {
+            close(fence);
+        }
+    }
+
+    Layer mLastLayer = 0;
+};
+
+class NullComposerCallback : public IComposerCallback {
+  public:
+    Return<void> onHotplug(Display /*display*/, Connection /*connected*/) override {
+        return Void();
+    }
+    Return<void> onRefresh(Display /*display*/) override { return Void(); }
+    Return<void> onVsync(Display /*display*/, int64_t /*timestamp*/) override { return Void(); }
+};
+
+// Plays the part of SurfaceFlinger: writes command streams, sends them to a ComposerClient and
+// reads its replies, all in process
+class ComposerClientHarness {
+  public:
+    bool init(uint32_t layerCount) {
+        mClient = ComposerClient::create(&mHal).release();
+        if (!mClient) {
+            return false;
+        }
+        mClient->registerCallback(new NullComposerCallback());
+
+        for (uint32_t i = 0; i < layerCount; i++) {
+            Error error = Error::NONE;
+            Layer layer = 0;
+            mClient->createLayer(kDisplay, kBufferSlotCount,
+                                 [&](const auto& tmpError, auto tmpLayer) {
+                                     error = tmpError;
+                                     layer = tmpLayer;
+                                 });
+            if (error != Error::NONE) {
+                return false;
+            }
+            mLayers.push_back(layer);
+        }
+
+        return true;
+    }
+
+    CommandWriterBase& getWriter() { return mWriter; }
+    const std::vector<Layer>& getLayers() const { return mLayers; }
+
+    // Write the per-frame state SurfaceFlinger sends for each layer: a buffer from a cached slot,
+    // its damage and geometry.  Return the number of commands written.
+    uint32_t writeLayerState(uint32_t frame) {
+        const IComposerClient::Rect frameRect{0, 0, int32_t(kDisplayWidth),
+                                              int32_t(kDisplayHeight)};
+        const IComposerClient::FRect crop{0.0f, 0.0f, float(kDisplayWidth),
+                                          float(kDisplayHeight)};
+        const std::vector<IComposerClient::Rect> damage{{0, 0, 64, 64}};
+
+        uint32_t z = 0;
+        for (auto layer : mLayers) {
+            mWriter.selectLayer(layer);
+            mWriter.setLayerBuffer(frame % kBufferSlotCount, nullptr, -1);
+            mWriter.setLayerSurfaceDamage(damage);
+            mWriter.setLayerDisplayFrame(frameRect);
+            mWriter.setLayerSourceCrop(crop);
+            mWriter.setLayerPlaneAlpha(1.0f);
+            mWriter.setLayerZOrder(z++);
+        }
+
+        return 7 * mLayers.size();
+    }
+
+    // Send the commands written so far and read the reply
+    bool execute() {
+        bool queueChanged = false;
+        uint32_t commandLength = 0;
+        hidl_vec<hidl_handle> commandHandles;
+        if (!mWriter.writeQueue(&queueChanged, &commandLength, &commandHandles)) {
+            return false;
+        }
+        if (queueChanged) {
+            auto ret = mClient->setInputCommandQueue(*mWriter.getMQDescriptor());
+            if (!ret.isOk() || static_cast<Error>(ret) != Error::NONE) {
+                return false;
+            }
+        }
+
+        // same as what SurfaceFlinger does with the reply
+        Error error = Error::NONE;
+        bool outQueueChanged = false;
+        uint32_t outLength = 0;
+        hidl_vec<hidl_handle> outHandles;
+        mClient->executeCommands(commandLength, commandHandles,
+                                 [&](const auto& tmpError, auto tmpOutQueueChanged,
+                                     auto tmpOutLength, const auto& tmpOutHandles) {
+                                     error = tmpError;
+                                     outQueueChanged = tmpOutQueueChanged;
+                                     outLength = tmpOutLength;
+                                     outHandles = tmpOutHandles;
+                                 });
+        mWriter.reset();
+
+        if (error == Error::NONE && outQueueChanged) {
+            mClient->getOutputCommandQueue([&](const auto& tmpError, const auto& tmpDescriptor) {
+                error = tmpError;
+                if (error == Error::NONE && !mReader.setMQDescriptor(tmpDescriptor)) {
+                    error = Error::NO_RESOURCES;
+                }
+            });
+        }
+        if (error == Error::NONE && outLength > 0 && !mReader.readQueue(outLength, outHandles)) {
+            error = Error::NO_RESOURCES;
+        }
+        mReader.reset();
+
+        return error == Error::NONE;
+    }
+
+  private:
+
+    NullComposerHal mHal;
+    sp<ComposerClient> mClient;
+    std::vector<Layer> mLayers;
+
+    CommandWriterBase mWriter{kWriterInitialSize};
+    CommandReaderBase mReader;
+};
+
+// Run frame for each iteration, and report the time per command and the allocations per frame
+template <typename Frame>
+void runFrames(benchmark::State& state, ComposerClientHarness& harness, Frame frame) {
+    uint64_t commandCount = 0;
+    uint32_t frameIndex = 0;
+
+    const uint64_t allocationsBefore = gAllocationCount.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        commandCount += frame(frameIndex++);
+        if (!harness.execute()) {
+            state.SkipWithError("failed to execute commands");
+            return;
+        }
+    }
+    const uint64_t allocations = gAllocationCount.load(std::memory_order_relaxed) -
+            allocationsBefore;
+
+    state.counters["time/command"] = benchmark::Counter(
+            commandCount, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["allocs/frame"] =
+            benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+void BM_SetLayerState(benchmark::State& state) {
+    ComposerClientHarness harness;
+    if (!harness.init(state.range(0))) {
+        state.SkipWithError("failed to create ComposerClient");
+        return;
+    }
+
+    runFrames(state, harness, [&](uint32_t frame) {
+        harness.getWriter().selectDisplay(kDisplay);
+        return 1 + harness.writeLayerState(frame);
+    });
+}
+BENCHMARK(BM_SetLayerState)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+void BM_ValidateDisplay(benchmark::State& state) {
+    ComposerClientHarness harness;
+    if (!harness.init(state.range(0))) {
+        state.SkipWithError("failed to create ComposerClient");
+        return;
+    }
+
+    runFrames(state, harness, [&](uint32_t /*frame*/) {
+        harness.getWriter().selectDisplay(kDisplay);
+        harness.getWriter().validateDisplay();
+        return 2;
+    });
+}
+BENCHMARK(BM_ValidateDisplay)->Arg(1)->Arg(16);
+
+void BM_PresentDisplay(benchmark::State& state) {
+    ComposerClientHarness harness;
+    if (!harness.init(state.range(0))) {
+        state.SkipWithError("failed to create ComposerClient");
+        return;
+    }
+
+    runFrames(state, harness, [&](uint32_t /*frame*/) {
+        harness.getWriter().selectDisplay(kDisplay);
+        harness.getWriter().presentDisplay();
+        return 2;
+    });
+}
+BENCHMARK(BM_PresentDisplay)->Arg(1)->Arg(16);
+
+// A whole frame as SurfaceFlinger sends it when the composition does not change
+void BM_Frame(benchmark::State& state) {
+    ComposerClientHarness harness;
+    if (!harness.init(state.range(0))) {
+        state.SkipWithError("failed to create ComposerClient");
+        return;
+    }
+
+    runFrames(state, harness, [&](uint32_t frame) {
+        harness.getWriter().selectDisplay(kDisplay);
+        uint32_t commandCount = 1 + harness.writeLayerState(frame);
+        harness.getWriter().presentOrvalidateDisplay();
+        return commandCount + 1;
+    });
+}
+BENCHMARK(BM_Frame)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
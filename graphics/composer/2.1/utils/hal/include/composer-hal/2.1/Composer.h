@@ -82,7 +82,7 @@ class ComposerImpl : public Interface {
     }
 
     Return<void> dumpDebugInfo(IComposer::dumpDebugInfo_cb hidl_cb) override {
-        hidl_cb(mHal->dumpDebugInfo());
+        hidl_cb(mHal->dumpDebugInfo() + ComposerHandleImporter::dumpStats());
         return Void();
     }
 
@@ -20,6 +20,7 @@
 #warning "ComposerCommandEngine.h included without LOG_TAG"
 #endif
 
+#include <array>
 #include <vector>
 
 #include <composer-command-buffer/2.1/ComposerCommandBuffer.h>
@@ -42,6 +43,53 @@ class ComposerCommandEngine : protected CommandReaderBase {
      ComposerCommandEngine(ComposerHal* hal, ComposerResources* resources)
          : mHal(hal), mResources(resources) {
          mWriter = createCommandWriter(kWriterInitialSize);
+
+         registerCommand(IComposerClient::Command::SELECT_DISPLAY,
+                         &ComposerCommandEngine::executeSelectDisplay);
+         registerCommand(IComposerClient::Command::SELECT_LAYER,
+                         &ComposerCommandEngine::executeSelectLayer);
+         registerCommand(IComposerClient::Command::SET_COLOR_TRANSFORM,
+                         &ComposerCommandEngine::executeSetColorTransform);
+         registerCommand(IComposerClient::Command::SET_CLIENT_TARGET,
+                         &ComposerCommandEngine::executeSetClientTarget);
+         registerCommand(IComposerClient::Command::SET_OUTPUT_BUFFER,
+                         &ComposerCommandEngine::executeSetOutputBuffer);
+         registerCommand(IComposerClient::Command::VALIDATE_DISPLAY,
+                         &ComposerCommandEngine::executeValidateDisplay);
+         registerCommand(IComposerClient::Command::PRESENT_OR_VALIDATE_DISPLAY,
+                         &ComposerCommandEngine::executePresentOrValidateDisplay);
+         registerCommand(IComposerClient::Command::ACCEPT_DISPLAY_CHANGES,
+                         &ComposerCommandEngine::executeAcceptDisplayChanges);
+         registerCommand(IComposerClient::Command::PRESENT_DISPLAY,
+                         &ComposerCommandEngine::executePresentDisplay);
+         registerCommand(IComposerClient::Command::SET_LAYER_CURSOR_POSITION,
+                         &ComposerCommandEngine::executeSetLayerCursorPosition);
+         registerCommand(IComposerClient::Command::SET_LAYER_BUFFER,
+                         &ComposerCommandEngine::executeSetLayerBuffer);
+         registerCommand(IComposerClient::Command::SET_LAYER_SURFACE_DAMAGE,
+                         &ComposerCommandEngine::executeSetLayerSurfaceDamage);
+         registerCommand(IComposerClient::Command::SET_LAYER_BLEND_MODE,
+                         &ComposerCommandEngine::executeSetLayerBlendMode);
+         registerCommand(IComposerClient::Command::SET_LAYER_COLOR,
+                         &ComposerCommandEngine::executeSetLayerColor);
+         registerCommand(IComposerClient::Command::SET_LAYER_COMPOSITION_TYPE,
+                         &ComposerCommandEngine::executeSetLayerCompositionType);
+         registerCommand(IComposerClient::Command::SET_LAYER_DATASPACE,
+                         &ComposerCommandEngine::executeSetLayerDataspace);
+         registerCommand(IComposerClient::Command::SET_LAYER_DISPLAY_FRAME,
+                         &ComposerCommandEngine::executeSetLayerDisplayFrame);
+         registerCommand(IComposerClient::Command::SET_LAYER_PLANE_ALPHA,
+                         &ComposerCommandEngine::executeSetLayerPlaneAlpha);
+         registerCommand(IComposerClient::Command::SET_LAYER_SIDEBAND_STREAM,
+                         &ComposerCommandEngine::executeSetLayerSidebandStream);
+         registerCommand(IComposerClient::Command::SET_LAYER_SOURCE_CROP,
+                         &ComposerCommandEngine::executeSetLayerSourceCrop);
+         registerCommand(IComposerClient::Command::SET_LAYER_TRANSFORM,
+                         &ComposerCommandEngine::executeSetLayerTransform);
+         registerCommand(IComposerClient::Command::SET_LAYER_VISIBLE_REGION,
+                         &ComposerCommandEngine::executeSetLayerVisibleRegion);
+         registerCommand(IComposerClient::Command::SET_LAYER_Z_ORDER,
+                         &ComposerCommandEngine::executeSetLayerZOrder);
      }
 
     virtual ~ComposerCommandEngine() = default;
@@ -90,56 +138,21 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
    protected:
     virtual bool executeCommand(IComposerClient::Command command, uint16_t length) {
-        switch (command) {
-            case IComposerClient::Command::SELECT_DISPLAY:
-                return executeSelectDisplay(length);
-            case IComposerClient::Command::SELECT_LAYER:
-                return executeSelectLayer(length);
-            case IComposerClient::Command::SET_COLOR_TRANSFORM:
-                return executeSetColorTransform(length);
-            case IComposerClient::Command::SET_CLIENT_TARGET:
-                return executeSetClientTarget(length);
-            case IComposerClient::Command::SET_OUTPUT_BUFFER:
-                return executeSetOutputBuffer(length);
-            case IComposerClient::Command::VALIDATE_DISPLAY:
-                return executeValidateDisplay(length);
-            case IComposerClient::Command::PRESENT_OR_VALIDATE_DISPLAY:
-                return executePresentOrValidateDisplay(length);
-            case IComposerClient::Command::ACCEPT_DISPLAY_CHANGES:
-                return executeAcceptDisplayChanges(length);
-            case IComposerClient::Command::PRESENT_DISPLAY:
-                return executePresentDisplay(length);
-            case IComposerClient::Command::SET_LAYER_CURSOR_POSITION:
-                return executeSetLayerCursorPosition(length);
-            case IComposerClient::Command::SET_LAYER_BUFFER:
-                return executeSetLayerBuffer(length);
-            case IComposerClient::Command::SET_LAYER_SURFACE_DAMAGE:
-                return executeSetLayerSurfaceDamage(length);
-            case IComposerClient::Command::SET_LAYER_BLEND_MODE:
-                return executeSetLayerBlendMode(length);
-            case IComposerClient::Command::SET_LAYER_COLOR:
-                return executeSetLayerColor(length);
-            case IComposerClient::Command::SET_LAYER_COMPOSITION_TYPE:
-                return executeSetLayerCompositionType(length);
-            case IComposerClient::Command::SET_LAYER_DATASPACE:
-                return executeSetLayerDataspace(length);
-            case IComposerClient::Command::SET_LAYER_DISPLAY_FRAME:
-                return executeSetLayerDisplayFrame(length);
-            case IComposerClient::Command::SET_LAYER_PLANE_ALPHA:
-                return executeSetLayerPlaneAlpha(length);
-            case IComposerClient::Command::SET_LAYER_SIDEBAND_STREAM:
-                return executeSetLayerSidebandStream(length);
-            case IComposerClient::Command::SET_LAYER_SOURCE_CROP:
-                return executeSetLayerSourceCrop(length);
-            case IComposerClient::Command::SET_LAYER_TRANSFORM:
-                return executeSetLayerTransform(length);
-            case IComposerClient::Command::SET_LAYER_VISIBLE_REGION:
-                return executeSetLayerVisibleRegion(length);
-            case IComposerClient::Command::SET_LAYER_Z_ORDER:
-                return executeSetLayerZOrder(length);
-            default:
-                return false;
+        size_t index = getCommandIndex(static_cast<uint32_t>(command));
+        if (index >= mCommandHandlers.size() || mCommandHandlers[index] == nullptr) {
+            return false;
         }
+        return (this->*mCommandHandlers[index])(length);
+    }
+
+    // Makes executeCommand() call handler for command. The engines of later composer versions
+    // register the handlers of their own commands in their constructors.
+    template <typename Command, typename Engine>
+    void registerCommand(Command command, bool (Engine::*handler)(uint16_t length)) {
+        size_t index = getCommandIndex(static_cast<uint32_t>(command));
+        LOG_ALWAYS_FATAL_IF(index >= mCommandHandlers.size(), "cannot register command 0x%x",
+                            static_cast<uint32_t>(command));
+        mCommandHandlers[index] = static_cast<CommandHandler>(handler);
     }
 
     virtual std::unique_ptr<CommandWriterBase> createCommandWriter(size_t writerInitialSize) {
@@ -579,6 +592,23 @@ class ComposerCommandEngine : protected CommandReaderBase {
     // 64KiB minus a small space for metadata such as read/write pointers
     static constexpr size_t kWriterInitialSize = 64 * 1024 / sizeof(uint32_t) - 16;
 
+    // Command handlers indexed by opcode: the high byte of the opcode selects a group of
+    // kCommandGroupSize handlers, and the low byte the handler in the group
+    using CommandHandler = bool (ComposerCommandEngine::*)(uint16_t length);
+    static constexpr size_t kNumCommandGroups = 5;
+    static constexpr size_t kCommandGroupSize = 16;
+    std::array<CommandHandler, kNumCommandGroups * kCommandGroupSize> mCommandHandlers{};
+
+    static size_t getCommandIndex(uint32_t command) {
+        uint32_t opcode = command >> static_cast<uint32_t>(IComposerClient::Command::OPCODE_SHIFT);
+        uint32_t group = opcode >> 8;
+        uint32_t offset = opcode & 0xff;
+        if (group >= kNumCommandGroups || offset >= kCommandGroupSize) {
+            return kNumCommandGroups * kCommandGroupSize;
+        }
+        return group * kCommandGroupSize + offset;
+    }
+
     ComposerHal* mHal;
     ComposerResources* mResources;
     std::unique_ptr<CommandWriterBase> mWriter;
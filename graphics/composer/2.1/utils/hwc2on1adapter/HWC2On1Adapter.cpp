@@ -25,7 +25,6 @@
 
 #include <inttypes.h>
 
-#include <chrono>
 #include <cstdlib>
 #include <sstream>
 
@@ -33,8 +32,6 @@
 #include <log/log.h>
 #include <utils/Trace.h>
 
-using namespace std::chrono_literals;
-
 static uint8_t getMinorVersion(struct hwc_composer_device_1* device)
 {
     auto version = device->common.version & HARDWARE_API_VERSION_2_MAJ_MIN_MASK;
@@ -98,9 +95,11 @@ HWC2On1Adapter::HWC2On1Adapter(hwc_composer_device_1_t* hwc1Device)
     mHwc1SupportsBackgroundColor(false),
     mHwc1Callbacks(std::make_unique<Callbacks>(*this)),
     mCapabilities(),
-    mLayers(),
     mHwc1VirtualDisplay(),
     mStateMutex(),
+    mDisplaysMutex(),
+    mLayers(),
+    mCallbacksMutex(),
     mCallbacks(),
     mHasPendingInvalidate(false),
     mPendingVsyncs(),
@@ -315,7 +314,7 @@ hwc2_function_pointer_t HWC2On1Adapter::doGetFunction(
 
 Error HWC2On1Adapter::createVirtualDisplay(uint32_t width,
         uint32_t height, hwc2_display_t* outDisplay) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     if (mHwc1VirtualDisplay) {
         // We have already allocated our only HWC1 virtual display
@@ -327,22 +326,26 @@ Error HWC2On1Adapter::createVirtualDisplay(uint32_t width,
             HWC2::DisplayType::Virtual);
     mHwc1VirtualDisplay->populateConfigs(width, height);
     const auto displayId = mHwc1VirtualDisplay->getId();
-    mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL] = displayId;
     mHwc1VirtualDisplay->setHwc1Id(HWC_DISPLAY_VIRTUAL);
-    mDisplays.emplace(displayId, mHwc1VirtualDisplay);
+    {
+        std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
+        mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL] = displayId;
+        mDisplays.emplace(displayId, mHwc1VirtualDisplay);
+    }
     *outDisplay = displayId;
 
     return Error::None;
 }
 
 Error HWC2On1Adapter::destroyVirtualDisplay(hwc2_display_t displayId) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     if (!mHwc1VirtualDisplay || (mHwc1VirtualDisplay->getId() != displayId)) {
         return Error::BadDisplay;
     }
 
     mHwc1VirtualDisplay.reset();
+    std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
     mHwc1DisplayMap.erase(HWC_DISPLAY_VIRTUAL);
     mDisplays.erase(displayId);
 
@@ -363,12 +366,6 @@ void HWC2On1Adapter::dump(uint32_t* outSize, char* outBuffer) {
     output << "Adapting to a HWC 1." << static_cast<int>(mHwc1MinorVersion) <<
             " device\n";
 
-    // Attempt to acquire the lock for 1 second, but proceed without the lock
-    // after that, so we can still get some information if we're deadlocked
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex,
-            std::defer_lock);
-    lock.try_lock_for(1s);
-
     if (mCapabilities.empty()) {
         output << "Capabilities: None\n";
     } else {
@@ -378,17 +375,22 @@ void HWC2On1Adapter::dump(uint32_t* outSize, char* outBuffer) {
         }
     }
 
+    // Dump the displays without mDisplaysMutex held, since each takes its own
+    // lock
+    std::vector<std::shared_ptr<Display>> displays;
+    {
+        std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
+        for (const auto& element : mDisplays) {
+            displays.push_back(element.second);
+        }
+    }
+
     output << "Displays:\n";
-    for (const auto& element : mDisplays) {
-        const auto& display = element.second;
+    for (const auto& display : displays) {
         output << display->dump();
     }
     output << '\n';
 
-    // Release the lock before calling into HWC1, and since we no longer require
-    // mutual exclusion to access mCapabilities or mDisplays
-    lock.unlock();
-
     if (mHwc1Device->dump) {
         output << "HWC1 dump:\n";
         std::vector<char> hwc1Dump(4096);
@@ -424,7 +426,7 @@ Error HWC2On1Adapter::registerCallback(Callback descriptor,
     ALOGV("registerCallback(%s, %p, %p)", to_string(descriptor).c_str(),
             callbackData, pointer);
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::mutex> lock(mCallbacksMutex);
 
     if (pointer != nullptr) {
         mCallbacks[descriptor] = {callbackData, pointer};
@@ -439,6 +441,7 @@ Error HWC2On1Adapter::registerCallback(Callback descriptor,
     std::vector<std::pair<hwc2_display_t, int64_t>> pendingVsyncs;
     std::vector<std::pair<hwc2_display_t, int>> pendingHotplugs;
 
+    std::unique_lock<std::mutex> displaysLock(mDisplaysMutex);
     if (descriptor == Callback::Refresh) {
         hasPendingInvalidate = mHasPendingInvalidate;
         if (hasPendingInvalidate) {
@@ -478,7 +481,8 @@ Error HWC2On1Adapter::registerCallback(Callback descriptor,
         }
     }
 
-    // Call pending callbacks without the state lock held
+    // Call pending callbacks without the locks held
+    displaysLock.unlock();
     lock.unlock();
 
     if (hasPendingInvalidate) {
@@ -528,7 +532,8 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mHwc1LayerMap(),
     mNumAvailableRects(0),
     mNextAvailableRect(nullptr),
-    mGeometryChanged(false)
+    mGeometryChanged(false),
+    mLayoutChanged(true)
     {}
 
 Error HWC2On1Adapter::Display::acceptChanges() {
@@ -544,13 +549,13 @@ Error HWC2On1Adapter::Display::acceptChanges() {
     for (auto& change : mChanges->getTypeChanges()) {
         auto layerId = change.first;
         auto type = change.second;
-        if (mDevice.mLayers.count(layerId) == 0) {
+        auto layer = mDevice.findLayer(layerId);
+        if (!layer) {
             // This should never happen but somehow does.
             ALOGW("Cannot accept change for unknown layer (%" PRIu64 ")",
                   layerId);
             continue;
         }
-        auto layer = mDevice.mLayers[layerId];
         layer->setCompositionType(type);
     }
 
@@ -563,24 +568,23 @@ Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     auto layer = *mLayers.emplace(std::make_shared<Layer>(*this));
-    mDevice.mLayers.emplace(std::make_pair(layer->getId(), layer));
+    mDevice.addLayer(layer);
     *outLayerId = layer->getId();
     ALOGV("[%" PRIu64 "] created layer %" PRIu64, mId, *outLayerId);
     markGeometryChanged();
+    markLayoutChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    const auto mapLayer = mDevice.mLayers.find(layerId);
-    if (mapLayer == mDevice.mLayers.end()) {
+    const auto layer = mDevice.removeLayer(layerId);
+    if (!layer) {
         ALOGV("[%" PRIu64 "] destroyLayer(%" PRIu64 ") failed: no such layer",
                 mId, layerId);
         return Error::BadLayer;
     }
-    const auto layer = mapLayer->second;
-    mDevice.mLayers.erase(mapLayer);
     const auto zRange = mLayers.equal_range(layer);
     for (auto current = zRange.first; current != zRange.second; ++current) {
         if (**current == *layer) {
@@ -590,6 +594,7 @@ Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
     }
     ALOGV("[%" PRIu64 "] destroyed layer %" PRIu64, mId, layerId);
     markGeometryChanged();
+    markLayoutChanged();
     return Error::None;
 }
 
@@ -994,13 +999,12 @@ Error HWC2On1Adapter::Display::validate(uint32_t* outNumTypes,
 Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    const auto mapLayer = mDevice.mLayers.find(layerId);
-    if (mapLayer == mDevice.mLayers.end()) {
+    auto layer = mDevice.findLayer(layerId);
+    if (!layer) {
         ALOGE("[%" PRIu64 "] updateLayerZ failed to find layer", mId);
         return Error::BadLayer;
     }
 
-    const auto layer = mapLayer->second;
     const auto zRange = mLayers.equal_range(layer);
     bool layerOnDisplay = false;
     for (auto current = zRange.first; current != zRange.second; ++current) {
@@ -1024,6 +1028,7 @@ Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     layer->setZ(z);
     mLayers.emplace(std::move(layer));
     markGeometryChanged();
+    markLayoutChanged();
 
     return Error::None;
 }
@@ -1214,8 +1219,14 @@ bool HWC2On1Adapter::Display::prepare() {
         return false;
     }
 
-    allocateRequestedContents();
-    assignHwc1LayerIds();
+    // Most frames only change buffers, so unless the layout changed, the
+    // contents sent on the last prepare are patched in place
+    const bool rebuild = !mHwc1RequestedContents || mLayoutChanged;
+    if (rebuild) {
+        allocateRequestedContents();
+        assignHwc1LayerIds();
+        mLayoutChanged = false;
+    }
 
     mHwc1RequestedContents->retireFenceFd = -1;
     mHwc1RequestedContents->flags = 0;
@@ -1231,8 +1242,15 @@ bool HWC2On1Adapter::Display::prepare() {
         auto& hwc1Layer = mHwc1RequestedContents->hwLayers[layer->getHwc1Id()];
         hwc1Layer.releaseFenceFd = -1;
         hwc1Layer.acquireFenceFd = -1;
-        ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
-        layer->applyState(hwc1Layer);
+        // HWC1 writes hints during prepare
+        hwc1Layer.hints = 0;
+        if (rebuild) {
+            ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
+            layer->applyState(hwc1Layer);
+        } else {
+            ALOGV("Patching states for layer %" PRIu64 " ", layer->getId());
+            layer->patchState(hwc1Layer);
+        }
     }
 
     prepareFramebufferTarget();
@@ -1886,8 +1904,13 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget() {
     hwc1Target.displayFrame = {0, 0, width, height};
     hwc1Target.planeAlpha = 255;
 
+    // Rects are only taken from the pool right after the contents were
+    // (re)allocated, zero-filled
     hwc1Target.visibleRegionScreen.numRects = 1;
-    hwc_rect_t* rects = GetRects(1);
+    hwc_rect_t* rects = const_cast<hwc_rect_t*>(hwc1Target.visibleRegionScreen.rects);
+    if (rects == nullptr) {
+        rects = GetRects(1);
+    }
     rects[0].left = 0;
     rects[0].top = 0;
     rects[0].right = width;
@@ -1919,7 +1942,8 @@ HWC2On1Adapter::Layer::Layer(Display& display)
     mZ(0),
     mReleaseFence(),
     mHwc1Id(0),
-    mHasUnsupportedPlaneAlpha(false) {}
+    mHasUnsupportedPlaneAlpha(false),
+    mDirtyFields(DIRTY_ALL) {}
 
 bool HWC2On1Adapter::SortLayersByZ::operator()(const std::shared_ptr<Layer>& lhs,
                                                const std::shared_ptr<Layer>& rhs) const {
@@ -1963,6 +1987,7 @@ Error HWC2On1Adapter::Layer::setSurfaceDamage(hwc_region_t damage) {
 
 Error HWC2On1Adapter::Layer::setBlendMode(BlendMode mode) {
     mBlendMode = mode;
+    mDirtyFields |= DIRTY_BLEND_MODE;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -1985,12 +2010,14 @@ Error HWC2On1Adapter::Layer::setDataspace(android_dataspace_t) {
 
 Error HWC2On1Adapter::Layer::setDisplayFrame(hwc_rect_t frame) {
     mDisplayFrame = frame;
+    mDirtyFields |= DIRTY_DISPLAY_FRAME;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setPlaneAlpha(float alpha) {
     mPlaneAlpha = alpha;
+    mDirtyFields |= DIRTY_PLANE_ALPHA;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -2003,12 +2030,14 @@ Error HWC2On1Adapter::Layer::setSidebandStream(const native_handle_t* stream) {
 
 Error HWC2On1Adapter::Layer::setSourceCrop(hwc_frect_t crop) {
     mSourceCrop = crop;
+    mDirtyFields |= DIRTY_SOURCE_CROP;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setTransform(Transform transform) {
     mTransform = transform;
+    mDirtyFields |= DIRTY_TRANSFORM;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -2024,8 +2053,13 @@ Error HWC2On1Adapter::Layer::setVisibleRegion(hwc_region_t visible) {
     if ((getNumVisibleRegions() != visible.numRects) ||
         !std::equal(mVisibleRegion.begin(), mVisibleRegion.end(), visible.rects,
                     compareRects)) {
+        if (getNumVisibleRegions() != visible.numRects) {
+            // The rects of the region are allocated with the contents
+            mDisplay.markLayoutChanged();
+        }
         mVisibleRegion.resize(visible.numRects);
         std::copy_n(visible.rects, visible.numRects, mVisibleRegion.begin());
+        mDirtyFields |= DIRTY_VISIBLE_REGION;
         mDisplay.markGeometryChanged();
     }
     return Error::None;
@@ -2046,7 +2080,16 @@ const sp<MiniFence>& HWC2On1Adapter::Layer::getReleaseFence() const {
 }
 
 void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer) {
-    applyCommonState(hwc1Layer);
+    mDirtyFields = DIRTY_ALL;
+    patchState(hwc1Layer);
+}
+
+void HWC2On1Adapter::Layer::patchState(hwc_layer_1_t& hwc1Layer) {
+    applyCommonState(hwc1Layer, mDirtyFields);
+    mDirtyFields = 0;
+
+    // The composition type is overwritten by HWC1, and the color, sideband
+    // stream and buffer share a union, so these are always written
     applyCompositionType(hwc1Layer);
     switch (mCompositionType) {
         case Composition::SolidColor : applySolidColorState(hwc1Layer); break;
@@ -2122,41 +2165,59 @@ static int getHwc1Blending(HWC2::BlendMode blendMode) {
     }
 }
 
-void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer) {
+void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer,
+        uint32_t fields) {
     auto minorVersion = mDisplay.getDevice().getHwc1MinorVersion();
-    hwc1Layer.blending = getHwc1Blending(mBlendMode);
-    hwc1Layer.displayFrame = mDisplayFrame;
+    if (fields & DIRTY_BLEND_MODE) {
+        hwc1Layer.blending = getHwc1Blending(mBlendMode);
+    }
+    if (fields & DIRTY_DISPLAY_FRAME) {
+        hwc1Layer.displayFrame = mDisplayFrame;
+    }
 
-    auto pendingAlpha = mPlaneAlpha;
-    if (minorVersion < 2) {
-        mHasUnsupportedPlaneAlpha = pendingAlpha < 1.0f;
-    } else {
-        hwc1Layer.planeAlpha =
-                static_cast<uint8_t>(255.0f * pendingAlpha + 0.5f);
-    }
-
-    if (minorVersion < 3) {
-        auto pending = mSourceCrop;
-        hwc1Layer.sourceCropi.left =
-                static_cast<int32_t>(std::ceil(pending.left));
-        hwc1Layer.sourceCropi.top =
-                static_cast<int32_t>(std::ceil(pending.top));
-        hwc1Layer.sourceCropi.right =
-                static_cast<int32_t>(std::floor(pending.right));
-        hwc1Layer.sourceCropi.bottom =
-                static_cast<int32_t>(std::floor(pending.bottom));
-    } else {
-        hwc1Layer.sourceCropf = mSourceCrop;
+    if (fields & DIRTY_PLANE_ALPHA) {
+        auto pendingAlpha = mPlaneAlpha;
+        if (minorVersion < 2) {
+            mHasUnsupportedPlaneAlpha = pendingAlpha < 1.0f;
+        } else {
+            hwc1Layer.planeAlpha =
+                    static_cast<uint8_t>(255.0f * pendingAlpha + 0.5f);
+        }
+    }
+
+    if (fields & DIRTY_SOURCE_CROP) {
+        if (minorVersion < 3) {
+            auto pending = mSourceCrop;
+            hwc1Layer.sourceCropi.left =
+                    static_cast<int32_t>(std::ceil(pending.left));
+            hwc1Layer.sourceCropi.top =
+                    static_cast<int32_t>(std::ceil(pending.top));
+            hwc1Layer.sourceCropi.right =
+                    static_cast<int32_t>(std::floor(pending.right));
+            hwc1Layer.sourceCropi.bottom =
+                    static_cast<int32_t>(std::floor(pending.bottom));
+        } else {
+            hwc1Layer.sourceCropf = mSourceCrop;
+        }
     }
 
-    hwc1Layer.transform = static_cast<uint32_t>(mTransform);
+    if (fields & DIRTY_TRANSFORM) {
+        hwc1Layer.transform = static_cast<uint32_t>(mTransform);
+    }
 
-    auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
-    hwc1VisibleRegion.numRects = mVisibleRegion.size();
-    hwc_rect_t* rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
-    hwc1VisibleRegion.rects = rects;
-    for (size_t i = 0; i < mVisibleRegion.size(); i++) {
-        rects[i] = mVisibleRegion[i];
+    if (fields & DIRTY_VISIBLE_REGION) {
+        // A region keeps its rects until its size changes, which forces the
+        // contents to be reallocated and zero-filled
+        auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
+        hwc_rect_t* rects = const_cast<hwc_rect_t*>(hwc1VisibleRegion.rects);
+        if (rects == nullptr) {
+            rects = mDisplay.GetRects(mVisibleRegion.size());
+        }
+        hwc1VisibleRegion.numRects = mVisibleRegion.size();
+        hwc1VisibleRegion.rects = rects;
+        for (size_t i = 0; i < mVisibleRegion.size(); i++) {
+            rects[i] = mVisibleRegion[i];
+        }
     }
 }
 
@@ -2272,7 +2333,7 @@ void HWC2On1Adapter::populateCapabilities() {
 }
 
 HWC2On1Adapter::Display* HWC2On1Adapter::getDisplay(hwc2_display_t id) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::lock_guard<std::mutex> lock(mDisplaysMutex);
 
     auto display = mDisplays.find(id);
     if (display == mDisplays.end()) {
@@ -2289,12 +2350,11 @@ std::tuple<HWC2On1Adapter::Layer*, Error> HWC2On1Adapter::getLayer(
         return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadDisplay);
     }
 
-    auto layerEntry = mLayers.find(layerId);
-    if (layerEntry == mLayers.end()) {
+    auto layer = findLayer(layerId);
+    if (!layer) {
         return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadLayer);
     }
 
-    auto layer = layerEntry->second;
     if (layer->getDisplay().getId() != displayId) {
         return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadLayer);
     }
@@ -2302,60 +2362,107 @@ std::tuple<HWC2On1Adapter::Layer*, Error> HWC2On1Adapter::getLayer(
 }
 
 void HWC2On1Adapter::populatePrimary() {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
-
     auto display = std::make_shared<Display>(*this, HWC2::DisplayType::Physical);
-    mHwc1DisplayMap[HWC_DISPLAY_PRIMARY] = display->getId();
     display->setHwc1Id(HWC_DISPLAY_PRIMARY);
     display->populateConfigs();
+
+    std::lock_guard<std::mutex> lock(mDisplaysMutex);
+    mHwc1DisplayMap[HWC_DISPLAY_PRIMARY] = display->getId();
     mDisplays.emplace(display->getId(), std::move(display));
 }
 
+std::shared_ptr<HWC2On1Adapter::Display> HWC2On1Adapter::getHwc1DisplayLocked(
+        int hwc1DisplayId) {
+    auto displayIdEntry = mHwc1DisplayMap.find(hwc1DisplayId);
+    if (displayIdEntry == mHwc1DisplayMap.end()) {
+        return nullptr;
+    }
+
+    auto display = mDisplays.find(displayIdEntry->second);
+    if (display == mDisplays.end()) {
+        return nullptr;
+    }
+    return display->second;
+}
+
+void HWC2On1Adapter::addLayer(const std::shared_ptr<Layer>& layer) {
+    std::lock_guard<std::mutex> lock(mDisplaysMutex);
+    mLayers.emplace(layer->getId(), layer);
+}
+
+std::shared_ptr<HWC2On1Adapter::Layer> HWC2On1Adapter::findLayer(
+        hwc2_layer_t layerId) {
+    std::lock_guard<std::mutex> lock(mDisplaysMutex);
+    auto layerEntry = mLayers.find(layerId);
+    if (layerEntry == mLayers.end()) {
+        return nullptr;
+    }
+    return layerEntry->second;
+}
+
+std::shared_ptr<HWC2On1Adapter::Layer> HWC2On1Adapter::removeLayer(
+        hwc2_layer_t layerId) {
+    std::lock_guard<std::mutex> lock(mDisplaysMutex);
+    auto layerEntry = mLayers.find(layerId);
+    if (layerEntry == mLayers.end()) {
+        return nullptr;
+    }
+    auto layer = std::move(layerEntry->second);
+    mLayers.erase(layerEntry);
+    return layer;
+}
+
 bool HWC2On1Adapter::prepareAllDisplays() {
     ATRACE_CALL();
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::recursive_mutex> lock(mStateMutex);
+
+    // Take references to the displays, since their locks must not be acquired
+    // with mDisplaysMutex held
+    std::vector<std::shared_ptr<Display>> displays;
+    std::shared_ptr<Display> primaryDisplay;
+    std::shared_ptr<Display> externalDisplay;
+    std::shared_ptr<Display> virtualDisplay;
+    {
+        std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
+        for (const auto& displayPair : mDisplays) {
+            displays.push_back(displayPair.second);
+        }
+        primaryDisplay = getHwc1DisplayLocked(HWC_DISPLAY_PRIMARY);
+        externalDisplay = getHwc1DisplayLocked(HWC_DISPLAY_EXTERNAL);
+        virtualDisplay = getHwc1DisplayLocked(HWC_DISPLAY_VIRTUAL);
+    }
 
-    for (const auto& displayPair : mDisplays) {
-        auto& display = displayPair.second;
+    for (const auto& display : displays) {
         if (!display->prepare()) {
             return false;
         }
     }
 
-    if (mHwc1DisplayMap.count(HWC_DISPLAY_PRIMARY) == 0) {
+    if (!primaryDisplay) {
         ALOGE("prepareAllDisplays: Unable to find primary HWC1 display");
         return false;
     }
 
     // Build an array of hwc_display_contents_1 to call prepare() on HWC1.
     mHwc1Contents.clear();
+    mHwc1ContentsDisplays.clear();
 
     // Always push the primary display
-    auto primaryDisplayId = mHwc1DisplayMap[HWC_DISPLAY_PRIMARY];
-    auto& primaryDisplay = mDisplays[primaryDisplayId];
     mHwc1Contents.push_back(primaryDisplay->getDisplayContents());
+    mHwc1ContentsDisplays.push_back(primaryDisplay);
 
-    // Push the external display, if present
-    if (mHwc1DisplayMap.count(HWC_DISPLAY_EXTERNAL) != 0) {
-        auto externalDisplayId = mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL];
-        auto& externalDisplay = mDisplays[externalDisplayId];
-        mHwc1Contents.push_back(externalDisplay->getDisplayContents());
-    } else {
-        // Even if an external display isn't present, we still need to send
-        // at least two displays down to HWC1
-        mHwc1Contents.push_back(nullptr);
-    }
+    // Push the external display, if present. Even if an external display
+    // isn't present, we still need to send at least two displays down to HWC1
+    mHwc1Contents.push_back(externalDisplay ?
+            externalDisplay->getDisplayContents() : nullptr);
+    mHwc1ContentsDisplays.push_back(externalDisplay);
 
     // Push the hardware virtual display, if supported and present
     if (mHwc1MinorVersion >= 3) {
-        if (mHwc1DisplayMap.count(HWC_DISPLAY_VIRTUAL) != 0) {
-            auto virtualDisplayId = mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL];
-            auto& virtualDisplay = mDisplays[virtualDisplayId];
-            mHwc1Contents.push_back(virtualDisplay->getDisplayContents());
-        } else {
-            mHwc1Contents.push_back(nullptr);
-        }
+        mHwc1Contents.push_back(virtualDisplay ?
+                virtualDisplay->getDisplayContents() : nullptr);
+        mHwc1ContentsDisplays.push_back(virtualDisplay);
     }
 
     for (auto& displayContents : mHwc1Contents) {
@@ -2394,9 +2501,7 @@ bool HWC2On1Adapter::prepareAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
-        display->generateChanges();
+        mHwc1ContentsDisplays[hwc1Id]->generateChanges();
     }
 
     return true;
@@ -2482,7 +2587,7 @@ void dumpHWC1Message(hwc_composer_device_1* device, size_t numDisplays,
 Error HWC2On1Adapter::setAllDisplays() {
     ATRACE_CALL();
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     // Make sure we're ready to validate
     for (size_t hwc1Id = 0; hwc1Id < mHwc1Contents.size(); ++hwc1Id) {
@@ -2490,8 +2595,7 @@ Error HWC2On1Adapter::setAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1ContentsDisplays[hwc1Id];
         Error error = display->set(*mHwc1Contents[hwc1Id]);
         if (error != Error::None) {
             ALOGE("setAllDisplays: Failed to set display %zd: %s", hwc1Id,
@@ -2514,8 +2618,7 @@ Error HWC2On1Adapter::setAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1ContentsDisplays[hwc1Id];
         auto retireFenceFd = mHwc1Contents[hwc1Id]->retireFenceFd;
         ALOGV("setAllDisplays: Adding retire fence %d to display %zd",
                 retireFenceFd, hwc1Id);
@@ -2529,7 +2632,7 @@ Error HWC2On1Adapter::setAllDisplays() {
 void HWC2On1Adapter::hwc1Invalidate() {
     ALOGV("Received hwc1Invalidate");
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::mutex> lock(mCallbacksMutex);
 
     // If the HWC2-side callback hasn't been registered yet, buffer this until
     // it is registered.
@@ -2538,13 +2641,16 @@ void HWC2On1Adapter::hwc1Invalidate() {
         return;
     }
 
-    const auto& callbackInfo = mCallbacks[Callback::Refresh];
+    const auto callbackInfo = mCallbacks[Callback::Refresh];
     std::vector<hwc2_display_t> displays;
-    for (const auto& displayPair : mDisplays) {
-        displays.emplace_back(displayPair.first);
+    {
+        std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
+        for (const auto& displayPair : mDisplays) {
+            displays.emplace_back(displayPair.first);
+        }
     }
 
-    // Call back without the state lock held.
+    // Call back without the lock held.
     lock.unlock();
 
     auto refresh = reinterpret_cast<HWC2_PFN_REFRESH>(callbackInfo.pointer);
@@ -2556,7 +2662,7 @@ void HWC2On1Adapter::hwc1Invalidate() {
 void HWC2On1Adapter::hwc1Vsync(int hwc1DisplayId, int64_t timestamp) {
     ALOGV("Received hwc1Vsync(%d, %" PRId64 ")", hwc1DisplayId, timestamp);
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::mutex> lock(mCallbacksMutex);
 
     // If the HWC2-side callback hasn't been registered yet, buffer this until
     // it is registered.
@@ -2565,15 +2671,20 @@ void HWC2On1Adapter::hwc1Vsync(int hwc1DisplayId, int64_t timestamp) {
         return;
     }
 
-    if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
-        ALOGE("hwc1Vsync: Couldn't find display for HWC1 id %d", hwc1DisplayId);
-        return;
+    hwc2_display_t displayId;
+    {
+        std::lock_guard<std::mutex> displaysLock(mDisplaysMutex);
+        auto displayIdEntry = mHwc1DisplayMap.find(hwc1DisplayId);
+        if (displayIdEntry == mHwc1DisplayMap.end()) {
+            ALOGE("hwc1Vsync: Couldn't find display for HWC1 id %d", hwc1DisplayId);
+            return;
+        }
+        displayId = displayIdEntry->second;
     }
 
-    const auto& callbackInfo = mCallbacks[Callback::Vsync];
-    auto displayId = mHwc1DisplayMap[hwc1DisplayId];
+    const auto callbackInfo = mCallbacks[Callback::Vsync];
 
-    // Call back without the state lock held.
+    // Call back without the lock held.
     lock.unlock();
 
     auto vsync = reinterpret_cast<HWC2_PFN_VSYNC>(callbackInfo.pointer);
@@ -2588,21 +2699,26 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         return;
     }
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    // Changes to the set of displays are serialized with prepare/set
+    std::unique_lock<std::recursive_mutex> stateLock(mStateMutex);
 
     hwc2_display_t displayId = UINT64_MAX;
+    std::unique_lock<std::mutex> displaysLock(mDisplaysMutex);
     if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
         if (connected == 0) {
             ALOGW("hwc1Hotplug: Received disconnect for unconnected display");
             return;
         }
 
-        // Create a new display on connect
+        // Create a new display on connect. Its configs are queried from HWC1
+        // without mDisplaysMutex held.
+        displaysLock.unlock();
         auto display = std::make_shared<HWC2On1Adapter::Display>(*this,
                 HWC2::DisplayType::Physical);
         display->setHwc1Id(HWC_DISPLAY_EXTERNAL);
         display->populateConfigs();
         displayId = display->getId();
+        displaysLock.lock();
         mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL] = displayId;
         mDisplays.emplace(displayId, std::move(display));
     } else {
@@ -2617,6 +2733,10 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         mHwc1DisplayMap.erase(HWC_DISPLAY_EXTERNAL);
         mDisplays.erase(displayId);
     }
+    displaysLock.unlock();
+    stateLock.unlock();
+
+    std::unique_lock<std::mutex> lock(mCallbacksMutex);
 
     // If the HWC2-side callback hasn't been registered yet, buffer this until
     // it is registered
@@ -2625,9 +2745,9 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         return;
     }
 
-    const auto& callbackInfo = mCallbacks[Callback::Hotplug];
+    const auto callbackInfo = mCallbacks[Callback::Hotplug];
 
-    // Call back without the state lock held
+    // Call back without the lock held
     lock.unlock();
 
     auto hotplug = reinterpret_cast<HWC2_PFN_HOTPLUG>(callbackInfo.pointer);
@@ -278,6 +278,10 @@ private:
 
             void markGeometryChanged() { mGeometryChanged = true; }
             void resetGeometryMarker() { mGeometryChanged = false;}
+
+            // Forces the next prepare() to rebuild mHwc1RequestedContents
+            // instead of patching the layers of the last one in place
+            void markLayoutChanged() { mLayoutChanged = true; }
         private:
             class Config {
                 public:
@@ -458,6 +462,12 @@ private:
             // updated with anything other than a buffer since last call to
             // Display::set()
             bool mGeometryChanged;
+
+            // True if layers were added, removed or reordered, or a visible
+            // region changed size, since mHwc1RequestedContents was built.
+            // Otherwise the contents are reused and each layer only writes
+            // what changed.
+            bool mLayoutChanged;
     };
 
     // Utility template calling a Display object method directly based on the
@@ -563,6 +573,10 @@ private:
             // Write state to HWC1 communication struct.
             void applyState(struct hwc_layer_1& hwc1Layer);
 
+            // Write state to a HWC1 communication struct this layer was
+            // applied to on the last prepare, skipping unchanged fields.
+            void patchState(struct hwc_layer_1& hwc1Layer);
+
             std::string dump() const;
 
             std::size_t getNumVisibleRegions() { return mVisibleRegion.size(); }
@@ -576,7 +590,19 @@ private:
                         !mDisplay.getDevice().supportsBackgroundColor());
             }
         private:
-            void applyCommonState(struct hwc_layer_1& hwc1Layer);
+            // Fields of the common state changed since the last apply
+            enum DirtyField : uint32_t {
+                DIRTY_BLEND_MODE = 1 << 0,
+                DIRTY_DISPLAY_FRAME = 1 << 1,
+                DIRTY_PLANE_ALPHA = 1 << 2,
+                DIRTY_SOURCE_CROP = 1 << 3,
+                DIRTY_TRANSFORM = 1 << 4,
+                DIRTY_VISIBLE_REGION = 1 << 5,
+                DIRTY_ALL = (1 << 6) - 1,
+            };
+
+            void applyCommonState(struct hwc_layer_1& hwc1Layer,
+                    uint32_t fields);
             void applySolidColorState(struct hwc_layer_1& hwc1Layer);
             void applySidebandState(struct hwc_layer_1& hwc1Layer);
             void applyBufferState(struct hwc_layer_1& hwc1Layer);
@@ -605,6 +631,8 @@ private:
 
             size_t mHwc1Id;
             bool mHasUnsupportedPlaneAlpha;
+
+            uint32_t mDirtyFields;
     };
 
     // Utility tempate calling a Layer object method based on ID parameters:
@@ -675,8 +703,18 @@ private:
             hwc2_layer_t layerId);
     void populatePrimary();
 
+    // Must be called with mDisplaysMutex held
+    std::shared_ptr<Display> getHwc1DisplayLocked(int hwc1DisplayId);
+
+    // Used by Display to maintain mLayers
+    void addLayer(const std::shared_ptr<Layer>& layer);
+    std::shared_ptr<Layer> findLayer(hwc2_layer_t layerId);
+    std::shared_ptr<Layer> removeLayer(hwc2_layer_t layerId);
+
     bool prepareAllDisplays();
     std::vector<struct hwc_display_contents_1*> mHwc1Contents;
+    // The displays owning mHwc1Contents, kept alive until the next prepare
+    std::vector<std::shared_ptr<Display>> mHwc1ContentsDisplays;
     HWC2::Error setAllDisplays();
 
     // Callbacks
@@ -697,19 +735,26 @@ private:
 
     std::unordered_set<HWC2::Capability> mCapabilities;
 
-    // These are only accessed from the main SurfaceFlinger thread (not from
-    // callbacks or dump
-
-    std::map<hwc2_layer_t, std::shared_ptr<Layer>> mLayers;
-
     // A HWC1 supports only one virtual display.
     std::shared_ptr<Display> mHwc1VirtualDisplay;
 
-    // These are potentially accessed from multiple threads, and are protected
-    // by this mutex. This needs to be recursive, since the HWC1 implementation
-    // can call back into the invalidate callback on the same thread that is
-    // calling prepare.
-    std::recursive_timed_mutex mStateMutex;
+    // Serializes the prepare/set hand-off to HWC1 (mHwc1Contents) with
+    // changes to the set of displays. Per-display and per-layer calls only
+    // take the lock of their Display. This needs to be recursive, since the
+    // HWC1 implementation can call back into the hotplug callback on the same
+    // thread that is calling prepare.
+    std::recursive_mutex mStateMutex;
+
+    // Protects mDisplays, mHwc1DisplayMap and mLayers. It is never held while
+    // acquiring another lock or calling out, so it can be taken with any
+    // other lock held.
+    std::mutex mDisplaysMutex;
+
+    std::map<hwc2_layer_t, std::shared_ptr<Layer>> mLayers;
+
+    // Protects mCallbacks, mHasPendingInvalidate and the pending events below.
+    // It may be held while acquiring mDisplaysMutex, but not the reverse.
+    std::mutex mCallbacksMutex;
 
     struct CallbackInfo {
         hwc2_callback_data_t data;
@@ -38,6 +38,34 @@ namespace android {
 
 namespace {
 
+bool isEmpty(const hwc_rect_t& rect) {
+    return rect.left >= rect.right || rect.top >= rect.bottom;
+}
+
+// an explicitly empty region, as opposed to an unknown one with no rects
+bool isEmpty(const hwc_region_t& region) {
+    for (size_t i = 0; i < region.numRects; i++) {
+        if (!isEmpty(region.rects[i])) {
+            return false;
+        }
+    }
+    return region.numRects > 0;
+}
+
+void unionRect(hwc_rect_t& rect, const hwc_rect_t& other) {
+    if (isEmpty(other)) {
+        return;
+    }
+    if (isEmpty(rect)) {
+        rect = other;
+        return;
+    }
+    rect.left = std::min(rect.left, other.left);
+    rect.top = std::min(rect.top, other.top);
+    rect.right = std::max(rect.right, other.right);
+    rect.bottom = std::max(rect.bottom, other.bottom);
+}
+
 void dumpHook(hwc2_device_t* device, uint32_t* outSize, char* outBuffer) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (outBuffer) {
@@ -217,7 +245,7 @@ int32_t getClientTargetSupportHook(hwc2_device_t* device, hwc2_display_t display
 }
 
 int32_t setClientTargetHook(hwc2_device_t* device, hwc2_display_t display, buffer_handle_t target,
-                            int32_t acquireFence, int32_t dataspace, hwc_region_t /*damage*/) {
+                            int32_t acquireFence, int32_t dataspace, hwc_region_t damage) {
     if (acquireFence >= 0) {
         sync_wait(acquireFence, -1);
         close(acquireFence);
@@ -233,6 +261,7 @@ int32_t setClientTargetHook(hwc2_device_t* device, hwc2_display_t display, buffe
 
     // no state change
     adapter.setBuffer(target);
+    adapter.setBufferDamage(damage);
     return HWC2_ERROR_NONE;
 }
 
@@ -473,7 +502,7 @@ int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_l
 }
 
 int32_t setLayerSurfaceDamageHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
-                                  hwc_region_t /*damage*/) {
+                                  hwc_region_t damage) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
@@ -483,6 +512,7 @@ int32_t setLayerSurfaceDamageHook(hwc2_device_t* device, hwc2_display_t display,
     }
 
     // no state change
+    adapter.addLayerDamage(damage);
     return HWC2_ERROR_NONE;
 }
 
@@ -781,13 +811,69 @@ void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer) {
     mBuffer = buffer;
 }
 
+void HWC2OnFbAdapter::setBufferDamage(const hwc_region_t& damage) {
+    // no rects means the damage is unknown
+    mBufferDamageKnown = damage.numRects > 0;
+    mBufferDamage = hwc_rect_t{};
+    for (size_t i = 0; i < damage.numRects; i++) {
+        unionRect(mBufferDamage, damage.rects[i]);
+    }
+
+    const hwc_rect_t bounds{0, 0, int(mFbInfo.width), int(mFbInfo.height)};
+    mBufferDamage.left = std::max(mBufferDamage.left, bounds.left);
+    mBufferDamage.top = std::max(mBufferDamage.top, bounds.top);
+    mBufferDamage.right = std::min(mBufferDamage.right, bounds.right);
+    mBufferDamage.bottom = std::min(mBufferDamage.bottom, bounds.bottom);
+}
+
+void HWC2OnFbAdapter::addLayerDamage(const hwc_region_t& damage) {
+    if (!isEmpty(damage)) {
+        mLayerDamaged = true;
+    }
+}
+
+/*
+ * A frame is skipped when the client target is the buffer already on screen
+ * and nothing reports damage.  Otherwise, fb devices supporting partial
+ * updates are told the damaged rect.  post already blocks on vsync, so posts
+ * are not throttled here.
+ */
 bool HWC2OnFbAdapter::postBuffer() {
-    int error = 0;
-    if (mBuffer) {
-        error = mFbDevice->post(mFbDevice, mBuffer);
+    if (!mBuffer) {
+        return true;
     }
 
-    return error == 0;
+    const hwc_rect_t bounds{0, 0, int(mFbInfo.width), int(mFbInfo.height)};
+    hwc_rect_t damage{};
+    if (mBufferDamageKnown) {
+        damage = mBufferDamage;
+    } else if (mLayerDamaged) {
+        damage = bounds;
+    }
+    mBufferDamageKnown = false;
+    mLayerDamaged = false;
+
+    if (isEmpty(damage)) {
+        if (mBuffer == mPostedBuffer) {
+            ALOGV("skipping unchanged frame");
+            return true;
+        }
+        damage = bounds;
+    }
+
+    if (mFbDevice->setUpdateRect) {
+        mFbDevice->setUpdateRect(mFbDevice, damage.left, damage.top, damage.right - damage.left,
+                                 damage.bottom - damage.top);
+    }
+
+    int error = mFbDevice->post(mFbDevice, mBuffer);
+    if (error) {
+        mPostedBuffer = nullptr;
+        return false;
+    }
+
+    mPostedBuffer = mBuffer;
+    return true;
 }
 
 void HWC2OnFbAdapter::setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data) {
@@ -75,6 +75,8 @@ public:
     void clearDirtyLayers();
 
     void setBuffer(buffer_handle_t buffer);
+    void setBufferDamage(const hwc_region_t& damage);
+    void addLayerDamage(const hwc_region_t& damage);
     bool postBuffer();
 
     void setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
@@ -95,6 +97,15 @@ private:
 
     buffer_handle_t mBuffer{nullptr};
 
+    // Damage of the current frame.  The client target damage is in display
+    // space and is used as is when known.  Layer damage is in buffer space,
+    // so it only tells whether anything changed at all.
+    bool mBufferDamageKnown{false};
+    hwc_rect_t mBufferDamage{};
+    bool mLayerDamaged{false};
+
+    buffer_handle_t mPostedBuffer{nullptr};
+
     std::unordered_set<HWC2::Capability> mCapabilities;
 
     class VsyncThread {
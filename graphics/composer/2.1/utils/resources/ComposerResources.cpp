@@ -18,6 +18,14 @@
 
 #include "composer-resources/2.1/ComposerResources.h"
 
+#include <algorithm>
+
+#include <cinttypes>
+
+#include <stdio.h>
+
+#include <halfiles/SameFile.h>
+
 namespace android {
 namespace hardware {
 namespace graphics {
@@ -25,6 +33,11 @@ namespace composer {
 namespace V2_1 {
 namespace hal {
 
+std::atomic<uint64_t> ComposerHandleImporter::sImportCount{0};
+std::atomic<uint64_t> ComposerHandleImporter::sReuseCount{0};
+std::atomic<int64_t> ComposerHandleImporter::sImportTimeNs{0};
+std::atomic<int64_t> ComposerHandleImporter::sMaxImportTimeNs{0};
+
 bool ComposerHandleImporter::init() {
     mMapper4 = mapper::V4_0::IMapper::getService();
     if (mMapper4) {
@@ -51,6 +64,7 @@ Error ComposerHandleImporter::importBuffer(const native_handle_t* rawHandle,
         return Error::NONE;
     }
 
+    const nsecs_t startTime = systemTime();
     const native_handle_t* bufferHandle;
     if (mMapper2) {
         mapper::V2_0::Error error;
@@ -83,6 +97,8 @@ Error ComposerHandleImporter::importBuffer(const native_handle_t* rawHandle,
         }
     }
 
+    recordImport(systemTime() - startTime);
+
     *outBufferHandle = bufferHandle;
     return Error::NONE;
 }
@@ -120,9 +136,41 @@ void ComposerHandleImporter::freeStream(const native_handle_t* streamHandle) {
     }
 }
 
+void ComposerHandleImporter::noteReusedBuffer() {
+    sReuseCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ComposerHandleImporter::recordImport(nsecs_t duration) {
+    sImportCount.fetch_add(1, std::memory_order_relaxed);
+    sImportTimeNs.fetch_add(duration, std::memory_order_relaxed);
+    int64_t maxTime = sMaxImportTimeNs.load(std::memory_order_relaxed);
+    while (duration > maxTime &&
+           !sMaxImportTimeNs.compare_exchange_weak(maxTime, duration, std::memory_order_relaxed)) {
+    }
+}
+
+std::string ComposerHandleImporter::dumpStats() {
+    const uint64_t importCount = sImportCount.load(std::memory_order_relaxed);
+    const uint64_t reuseCount = sReuseCount.load(std::memory_order_relaxed);
+    const uint64_t total = importCount + reuseCount;
+    const int64_t importTimeNs = sImportTimeNs.load(std::memory_order_relaxed);
+
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "Buffer handle cache: %" PRIu64 " imports, %" PRIu64 " reused (%.1f%% hit rate)\n"
+             "Buffer import time: avg %.1f us, max %.1f us\n",
+             importCount, reuseCount, total ? 100.0 * reuseCount / total : 0.0,
+             importCount ? importTimeNs / 1000.0 / importCount : 0.0,
+             sMaxImportTimeNs.load(std::memory_order_relaxed) / 1000.0);
+    return buf;
+}
+
 ComposerHandleCache::ComposerHandleCache(ComposerHandleImporter& importer, HandleType type,
                                          uint32_t cacheSize)
-    : mImporter(importer), mHandleType(type), mHandles(cacheSize, nullptr) {}
+    : mImporter(importer),
+      mHandleType(type),
+      mHandles(cacheSize, nullptr),
+      mRawInts(type == HandleType::BUFFER ? cacheSize : 0) {}
 
 // must be initialized later with initCache
 ComposerHandleCache::ComposerHandleCache(ComposerHandleImporter& importer) : mImporter(importer) {}
@@ -152,6 +200,9 @@ bool ComposerHandleCache::initCache(HandleType type, uint32_t cacheSize) {
 
     mHandleType = type;
     mHandles.resize(cacheSize, nullptr);
+    if (type == HandleType::BUFFER) {
+        mRawInts.resize(cacheSize);
+    }
 
     return true;
 }
@@ -177,17 +228,79 @@ Error ComposerHandleCache::updateCache(uint32_t slot, const native_handle_t* han
     }
 }
 
-// when fromCache is true, look up in the cache; otherwise, update the cache
-Error ComposerHandleCache::getHandle(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+// when fromCache is true, look up in the cache; otherwise, import and update the cache
+Error ComposerHandleCache::getHandle(uint32_t slot, bool fromCache,
+                                     const native_handle_t* rawHandle,
                                      const native_handle_t** outHandle,
                                      const native_handle** outReplacedHandle) {
     if (fromCache) {
         *outReplacedHandle = nullptr;
         return lookupCache(slot, outHandle);
-    } else {
-        *outHandle = inHandle;
-        return updateCache(slot, inHandle, outReplacedHandle);
     }
+
+    if (slot >= mHandles.size()) {
+        return Error::BAD_PARAMETER;
+    }
+
+    // swapchains cycle the same buffers through the same slots
+    if (mHandleType == HandleType::BUFFER && isCachedBuffer(slot, rawHandle)) {
+        ComposerHandleImporter::noteReusedBuffer();
+        *outReplacedHandle = nullptr;
+        return lookupCache(slot, outHandle);
+    }
+
+    const native_handle_t* importedHandle = nullptr;
+    Error error;
+    switch (mHandleType) {
+        case HandleType::BUFFER:
+            error = mImporter.importBuffer(rawHandle, &importedHandle);
+            break;
+        case HandleType::STREAM:
+            error = mImporter.importStream(rawHandle, &importedHandle);
+            break;
+        default:
+            error = Error::BAD_PARAMETER;
+            break;
+    }
+    if (error != Error::NONE) {
+        return error;
+    }
+
+    if (mHandleType == HandleType::BUFFER) {
+        auto& rawInts = mRawInts[slot];
+        if (rawHandle && importedHandle) {
+            rawInts.assign(rawHandle->data + rawHandle->numFds,
+                           rawHandle->data + rawHandle->numFds + rawHandle->numInts);
+        } else {
+            rawInts.clear();
+        }
+    }
+
+    *outHandle = importedHandle;
+    return updateCache(slot, importedHandle, outReplacedHandle);
+}
+
+bool ComposerHandleCache::isCachedBuffer(uint32_t slot, const native_handle_t* rawHandle) const {
+    const native_handle_t* cachedHandle = mHandles[slot];
+    if (!cachedHandle || !rawHandle || rawHandle->numFds == 0 ||
+        rawHandle->numFds != cachedHandle->numFds) {
+        return false;
+    }
+
+    const auto& rawInts = mRawInts[slot];
+    const int* ints = rawHandle->data + rawHandle->numFds;
+    if (static_cast<size_t>(rawHandle->numInts) != rawInts.size() ||
+        !std::equal(rawInts.begin(), rawInts.end(), ints)) {
+        return false;
+    }
+
+    // the fds of a resubmitted buffer are new, but refer to the files we imported
+    for (int i = 0; i < rawHandle->numFds; i++) {
+        if (!files::isSameFile(rawHandle->data[i], cachedHandle->data[i])) {
+            return false;
+        }
+    }
+    return true;
 }
 
 ComposerLayerResource::ComposerLayerResource(ComposerHandleImporter& importer,
@@ -196,17 +309,17 @@ ComposerLayerResource::ComposerLayerResource(ComposerHandleImporter& importer,
       mSidebandStreamCache(importer, ComposerHandleCache::HandleType::STREAM, 1) {}
 
 Error ComposerLayerResource::getBuffer(uint32_t slot, bool fromCache,
-                                       const native_handle_t* inHandle,
+                                       const native_handle_t* rawHandle,
                                        const native_handle_t** outHandle,
                                        const native_handle** outReplacedHandle) {
-    return mBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+    return mBufferCache.getHandle(slot, fromCache, rawHandle, outHandle, outReplacedHandle);
 }
 
 Error ComposerLayerResource::getSidebandStream(uint32_t slot, bool fromCache,
-                                               const native_handle_t* inHandle,
+                                               const native_handle_t* rawHandle,
                                                const native_handle_t** outHandle,
                                                const native_handle** outReplacedHandle) {
-    return mSidebandStreamCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+    return mSidebandStreamCache.getHandle(slot, fromCache, rawHandle, outHandle, outReplacedHandle);
 }
 
 ComposerDisplayResource::ComposerDisplayResource(DisplayType type, ComposerHandleImporter& importer,
@@ -225,45 +338,56 @@ bool ComposerDisplayResource::isVirtual() const {
 }
 
 Error ComposerDisplayResource::getClientTarget(uint32_t slot, bool fromCache,
-                                               const native_handle_t* inHandle,
+                                               const native_handle_t* rawHandle,
                                                const native_handle_t** outHandle,
                                                const native_handle** outReplacedHandle) {
-    return mClientTargetCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+    return mClientTargetCache.getHandle(slot, fromCache, rawHandle, outHandle, outReplacedHandle);
 }
 
 Error ComposerDisplayResource::getOutputBuffer(uint32_t slot, bool fromCache,
-                                               const native_handle_t* inHandle,
+                                               const native_handle_t* rawHandle,
                                                const native_handle_t** outHandle,
                                                const native_handle** outReplacedHandle) {
-    return mOutputBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+    return mOutputBufferCache.getHandle(slot, fromCache, rawHandle, outHandle, outReplacedHandle);
 }
 
 bool ComposerDisplayResource::addLayer(Layer layer,
                                        std::unique_ptr<ComposerLayerResource> layerResource) {
-    auto result = mLayerResources.emplace(layer, std::move(layerResource));
-    return result.second;
+    if (std::find(mLayers.begin(), mLayers.end(), layer) != mLayers.end()) {
+        return false;
+    }
+
+    mLayers.push_back(layer);
+    mLayerResources.push_back(std::move(layerResource));
+    return true;
 }
 
 bool ComposerDisplayResource::removeLayer(Layer layer) {
-    return mLayerResources.erase(layer) > 0;
+    auto layerIter = std::find(mLayers.begin(), mLayers.end(), layer);
+    if (layerIter == mLayers.end()) {
+        return false;
+    }
+
+    // move the last slot into the hole
+    const size_t index = layerIter - mLayers.begin();
+    mLayers[index] = mLayers.back();
+    mLayers.pop_back();
+    mLayerResources[index] = std::move(mLayerResources.back());
+    mLayerResources.pop_back();
+    return true;
 }
 
 ComposerLayerResource* ComposerDisplayResource::findLayerResource(Layer layer) {
-    auto layerIter = mLayerResources.find(layer);
-    if (layerIter == mLayerResources.end()) {
+    auto layerIter = std::find(mLayers.begin(), mLayers.end(), layer);
+    if (layerIter == mLayers.end()) {
         return nullptr;
     }
 
-    return layerIter->second.get();
+    return mLayerResources[layerIter - mLayers.begin()].get();
 }
 
 std::vector<Layer> ComposerDisplayResource::getLayers() const {
-    std::vector<Layer> layers;
-    layers.reserve(mLayerResources.size());
-    for (const auto& layerKey : mLayerResources) {
-        layers.push_back(layerKey.first);
-    }
-    return layers;
+    return mLayers;
 }
 
 void ComposerDisplayResource::setMustValidateState(bool mustValidate) {
@@ -284,11 +408,16 @@ bool ComposerResources::init() {
 }
 
 void ComposerResources::clear(RemoveDisplay removeDisplay) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
     for (const auto& displayKey : mDisplayResources) {
         Display display = displayKey.first;
-        const ComposerDisplayResource& displayResource = *displayKey.second;
-        removeDisplay(display, displayResource.isVirtual(), displayResource.getLayers());
+        ComposerDisplayResource& displayResource = *displayKey.second;
+        std::vector<Layer> layers;
+        {
+            std::lock_guard<std::mutex> displayLock(displayResource.getLock());
+            layers = displayResource.getLayers();
+        }
+        removeDisplay(display, displayResource.isVirtual(), layers);
     }
     mDisplayResources.clear();
 }
@@ -296,7 +425,7 @@ void ComposerResources::clear(RemoveDisplay removeDisplay) {
 Error ComposerResources::addPhysicalDisplay(Display display) {
     auto displayResource = createDisplayResource(ComposerDisplayResource::DisplayType::PHYSICAL, 0);
 
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
     auto result = mDisplayResources.emplace(display, std::move(displayResource));
     return result.second ? Error::NONE : Error::BAD_DISPLAY;
 }
@@ -305,23 +434,23 @@ Error ComposerResources::addVirtualDisplay(Display display, uint32_t outputBuffe
     auto displayResource = createDisplayResource(ComposerDisplayResource::DisplayType::VIRTUAL,
                                                  outputBufferCacheSize);
 
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
     auto result = mDisplayResources.emplace(display, std::move(displayResource));
     return result.second ? Error::NONE : Error::BAD_DISPLAY;
 }
 
 Error ComposerResources::removeDisplay(Display display) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    std::unique_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
     return mDisplayResources.erase(display) > 0 ? Error::NONE : Error::BAD_DISPLAY;
 }
 
 Error ComposerResources::setDisplayClientTargetCacheSize(Display display,
                                                          uint32_t clientTargetCacheSize) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
     if (!displayResource) {
         return Error::BAD_DISPLAY;
     }
+    std::lock_guard<std::mutex> lock(displayResource->getLock());
 
     return displayResource->initClientTargetCache(clientTargetCacheSize) ? Error::NONE
                                                                          : Error::BAD_PARAMETER;
@@ -330,22 +459,22 @@ Error ComposerResources::setDisplayClientTargetCacheSize(Display display,
 Error ComposerResources::addLayer(Display display, Layer layer, uint32_t bufferCacheSize) {
     auto layerResource = createLayerResource(bufferCacheSize);
 
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
     if (!displayResource) {
         return Error::BAD_DISPLAY;
     }
+    std::lock_guard<std::mutex> lock(displayResource->getLock());
 
     return displayResource->addLayer(layer, std::move(layerResource)) ? Error::NONE
                                                                       : Error::BAD_LAYER;
 }
 
 Error ComposerResources::removeLayer(Display display, Layer layer) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
     if (!displayResource) {
         return Error::BAD_DISPLAY;
     }
+    std::lock_guard<std::mutex> lock(displayResource->getLock());
 
     return displayResource->removeLayer(layer) ? Error::NONE : Error::BAD_LAYER;
 }
@@ -383,17 +512,17 @@ Error ComposerResources::getLayerSidebandStream(Display display, Layer layer,
 }
 
 void ComposerResources::setDisplayMustValidateState(Display display, bool mustValidate) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-    auto* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
     if (displayResource) {
+        std::lock_guard<std::mutex> lock(displayResource->getLock());
         displayResource->setMustValidateState(mustValidate);
     }
 }
 
 bool ComposerResources::mustValidateDisplay(Display display) {
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-    auto* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
     if (displayResource) {
+        std::lock_guard<std::mutex> lock(displayResource->getLock());
         return displayResource->mustValidate();
     }
     return false;
@@ -409,12 +538,13 @@ std::unique_ptr<ComposerLayerResource> ComposerResources::createLayerResource(
     return std::make_unique<ComposerLayerResource>(mImporter, bufferCacheSize);
 }
 
-ComposerDisplayResource* ComposerResources::findDisplayResourceLocked(Display display) {
+std::shared_ptr<ComposerDisplayResource> ComposerResources::findDisplayResource(Display display) {
+    std::shared_lock<std::shared_mutex> lock(mDisplayResourcesMutex);
     auto iter = mDisplayResources.find(display);
     if (iter == mDisplayResources.end()) {
         return nullptr;
     }
-    return iter->second.get();
+    return iter->second;
 }
 
 Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot, Cache cache,
@@ -423,23 +553,14 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
                                    ReplacedHandle* outReplacedHandle) {
     Error error;
 
-    // import the raw handle (or ignore raw handle when fromCache is true)
-    const native_handle_t* importedHandle = nullptr;
-    if (!fromCache) {
-        error = (outReplacedHandle->isBuffer())
-                        ? mImporter.importBuffer(rawHandle, &importedHandle)
-                        : mImporter.importStream(rawHandle, &importedHandle);
-        if (error != Error::NONE) {
-            return error;
-        }
-    }
-
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-
     // find display/layer resource
     const bool needLayerResource = (cache == ComposerResources::Cache::LAYER_BUFFER ||
                                     cache == ComposerResources::Cache::LAYER_SIDEBAND_STREAM);
-    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    auto displayResource = findDisplayResource(display);
+    std::unique_lock<std::mutex> lock;
+    if (displayResource) {
+        lock = std::unique_lock<std::mutex>(displayResource->getLock());
+    }
     ComposerLayerResource* layerResource = (displayResource && needLayerResource)
                                                    ? displayResource->findLayerResource(layer)
                                                    : nullptr;
@@ -449,19 +570,19 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
     if (displayResource && (!needLayerResource || layerResource)) {
         switch (cache) {
             case ComposerResources::Cache::CLIENT_TARGET:
-                error = displayResource->getClientTarget(slot, fromCache, importedHandle, outHandle,
+                error = displayResource->getClientTarget(slot, fromCache, rawHandle, outHandle,
                                                          &replacedHandle);
                 break;
             case ComposerResources::Cache::OUTPUT_BUFFER:
-                error = displayResource->getOutputBuffer(slot, fromCache, importedHandle, outHandle,
+                error = displayResource->getOutputBuffer(slot, fromCache, rawHandle, outHandle,
                                                          &replacedHandle);
                 break;
             case ComposerResources::Cache::LAYER_BUFFER:
-                error = layerResource->getBuffer(slot, fromCache, importedHandle, outHandle,
+                error = layerResource->getBuffer(slot, fromCache, rawHandle, outHandle,
                                                  &replacedHandle);
                 break;
             case ComposerResources::Cache::LAYER_SIDEBAND_STREAM:
-                error = layerResource->getSidebandStream(slot, fromCache, importedHandle, outHandle,
+                error = layerResource->getSidebandStream(slot, fromCache, rawHandle, outHandle,
                                                          &replacedHandle);
                 break;
             default:
@@ -478,15 +599,7 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
         error = Error::BAD_LAYER;
     }
 
-    // clean up on errors
     if (error != Error::NONE) {
-        if (!fromCache) {
-            if (outReplacedHandle->isBuffer()) {
-                mImporter.freeBuffer(importedHandle);
-            } else {
-                mImporter.freeStream(importedHandle);
-            }
-        }
         return error;
     }
 
@@ -20,8 +20,11 @@
 #warning "ComposerResources.h included without LOG_TAG"
 #endif
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -31,6 +34,7 @@
 #include <android/hardware/graphics/mapper/3.0/IMapper.h>
 #include <android/hardware/graphics/mapper/4.0/IMapper.h>
 #include <log/log.h>
+#include <utils/Timers.h>
 
 namespace android {
 namespace hardware {
@@ -49,7 +53,20 @@ class ComposerHandleImporter {
     Error importStream(const native_handle_t* rawHandle, const native_handle_t** outStreamHandle);
     void freeStream(const native_handle_t* streamHandle);
 
+    // called when a buffer import was skipped because the buffer was already cached
+    static void noteReusedBuffer();
+
+    // process-wide import statistics, for dumpDebugInfo
+    static std::string dumpStats();
+
   private:
+    static void recordImport(nsecs_t duration);
+
+    static std::atomic<uint64_t> sImportCount;
+    static std::atomic<uint64_t> sReuseCount;
+    static std::atomic<int64_t> sImportTimeNs;
+    static std::atomic<int64_t> sMaxImportTimeNs;
+
     sp<mapper::V2_0::IMapper> mMapper2;
     sp<mapper::V3_0::IMapper> mMapper3;
     sp<mapper::V4_0::IMapper> mMapper4;
@@ -78,14 +95,21 @@ class ComposerHandleCache {
     Error updateCache(uint32_t slot, const native_handle_t* handle,
                       const native_handle** outReplacedHandle);
 
-    // when fromCache is true, look up in the cache; otherwise, update the cache
-    Error getHandle(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+    // when fromCache is true, look up in the cache; otherwise, import rawHandle and update the
+    // cache.  A buffer resubmitted to the slot it already occupies is not imported again, and
+    // nothing is replaced.  On errors, nothing is imported.
+    Error getHandle(uint32_t slot, bool fromCache, const native_handle_t* rawHandle,
                     const native_handle_t** outHandle, const native_handle** outReplacedHandle);
 
   private:
+    bool isCachedBuffer(uint32_t slot, const native_handle_t* rawHandle) const;
+
     ComposerHandleImporter& mImporter;
     HandleType mHandleType = HandleType::INVALID;
     std::vector<const native_handle_t*> mHandles;
+    // the ints of the raw handle each buffer was imported from; the importer may rewrite the
+    // ints of the handle it returns
+    std::vector<std::vector<int>> mRawInts;
 };
 
 // layer resource
@@ -95,9 +119,9 @@ class ComposerLayerResource {
 
     virtual ~ComposerLayerResource() = default;
 
-    Error getBuffer(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+    Error getBuffer(uint32_t slot, bool fromCache, const native_handle_t* rawHandle,
                     const native_handle_t** outHandle, const native_handle** outReplacedHandle);
-    Error getSidebandStream(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+    Error getSidebandStream(uint32_t slot, bool fromCache, const native_handle_t* rawHandle,
                             const native_handle_t** outHandle,
                             const native_handle** outReplacedHandle);
 
@@ -123,11 +147,11 @@ class ComposerDisplayResource {
 
     bool isVirtual() const;
 
-    Error getClientTarget(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+    Error getClientTarget(uint32_t slot, bool fromCache, const native_handle_t* rawHandle,
                           const native_handle_t** outHandle,
                           const native_handle** outReplacedHandle);
 
-    Error getOutputBuffer(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
+    Error getOutputBuffer(uint32_t slot, bool fromCache, const native_handle_t* rawHandle,
                           const native_handle_t** outHandle,
                           const native_handle** outReplacedHandle);
 
@@ -140,13 +164,23 @@ class ComposerDisplayResource {
 
     bool mustValidate() const;
 
+    // guards the caches and layers of this display; held instead of the display map lock so
+    // that commands for different displays do not serialize
+    std::mutex& getLock() { return mLock; }
+
   protected:
     const DisplayType mType;
     ComposerHandleCache mClientTargetCache;
     ComposerHandleCache mOutputBufferCache;
     bool mMustValidate;
 
-    std::unordered_map<Layer, std::unique_ptr<ComposerLayerResource>> mLayerResources;
+    std::mutex mLock;
+
+    // Layer ids are opaque to us, so they cannot index an array directly.  A display rarely has
+    // more than a few dozen layers, and a linear scan of the packed ids beats hashing them.
+    // mLayers[i] owns mLayerResources[i].
+    std::vector<Layer> mLayers;
+    std::vector<std::unique_ptr<ComposerLayerResource>> mLayerResources;
 };
 
 class ComposerResources {
@@ -232,12 +266,15 @@ class ComposerResources {
 
     virtual std::unique_ptr<ComposerLayerResource> createLayerResource(uint32_t bufferCacheSize);
 
-    ComposerDisplayResource* findDisplayResourceLocked(Display display);
+    // the caller locks the returned display resource before using it
+    std::shared_ptr<ComposerDisplayResource> findDisplayResource(Display display);
 
     ComposerHandleImporter mImporter;
 
-    std::mutex mDisplayResourcesMutex;
-    std::unordered_map<Display, std::unique_ptr<ComposerDisplayResource>> mDisplayResources;
+    // only guards the map itself; a display resource stays alive for as long as someone holds
+    // it, even after removeDisplay
+    std::shared_mutex mDisplayResourcesMutex;
+    std::unordered_map<Display, std::shared_ptr<ComposerDisplayResource>> mDisplayResources;
 
   private:
     enum class Cache {
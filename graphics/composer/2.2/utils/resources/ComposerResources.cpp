@@ -31,12 +31,12 @@ using V2_1::Layer;
 using V2_1::hal::ComposerHandleCache;
 using V2_1::hal::ComposerHandleImporter;
 
-Error ComposerDisplayResource::getReadbackBuffer(const native_handle_t* inHandle,
+Error ComposerDisplayResource::getReadbackBuffer(const native_handle_t* rawHandle,
                                                  const native_handle_t** outHandle,
                                                  const native_handle** outReplacedHandle) {
     const uint32_t slot = 0;
     const bool fromCache = false;
-    return mReadbackBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+    return mReadbackBufferCache.getHandle(slot, fromCache, rawHandle, outHandle, outReplacedHandle);
 }
 
 std::unique_ptr<ComposerResources> ComposerResources::create() {
@@ -47,28 +47,18 @@ std::unique_ptr<ComposerResources> ComposerResources::create() {
 Error ComposerResources::getDisplayReadbackBuffer(Display display, const native_handle_t* rawHandle,
                                                   const native_handle_t** outHandle,
                                                   ReplacedHandle* outReplacedHandle) {
-    // import buffer
-    const native_handle_t* importedHandle;
-    Error error = mImporter.importBuffer(rawHandle, &importedHandle);
-    if (error != Error::NONE) {
-        return error;
-    }
-
-    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-
-    auto iter = mDisplayResources.find(display);
-    if (iter == mDisplayResources.end()) {
-        mImporter.freeBuffer(importedHandle);
+    auto baseDisplayResource = findDisplayResource(display);
+    if (!baseDisplayResource) {
         return Error::BAD_DISPLAY;
     }
+    std::lock_guard<std::mutex> lock(baseDisplayResource->getLock());
     ComposerDisplayResource& displayResource =
-            *static_cast<ComposerDisplayResource*>(iter->second.get());
+            *static_cast<ComposerDisplayResource*>(baseDisplayResource.get());
 
-    // update cache
+    // import buffer and update cache
     const native_handle_t* replacedHandle;
-    error = displayResource.getReadbackBuffer(importedHandle, outHandle, &replacedHandle);
+    Error error = displayResource.getReadbackBuffer(rawHandle, outHandle, &replacedHandle);
     if (error != Error::NONE) {
-        mImporter.freeBuffer(importedHandle);
         return error;
     }
 
@@ -39,11 +39,11 @@ class ComposerDisplayResource : public V2_1::hal::ComposerDisplayResource {
         : V2_1::hal::ComposerDisplayResource(type, importer, outputBufferCacheSize),
           mReadbackBufferCache(importer, ComposerHandleCache::HandleType::BUFFER, 1) {}
 
-    Error getReadbackBuffer(const native_handle_t* inHandle, const native_handle_t** outHandle,
+    Error getReadbackBuffer(const native_handle_t* rawHandle, const native_handle_t** outHandle,
                             const native_handle** outReplacedHandle) {
         const uint32_t slot = 0;
         const bool fromCache = false;
-        return mReadbackBufferCache.getHandle(slot, fromCache, inHandle, outHandle,
+        return mReadbackBufferCache.getHandle(slot, fromCache, rawHandle, outHandle,
                                               outReplacedHandle);
     }
 
@@ -61,28 +61,18 @@ class ComposerResources : public V2_1::hal::ComposerResources {
     Error getDisplayReadbackBuffer(Display display, const native_handle_t* rawHandle,
                                    const native_handle_t** outHandle,
                                    ReplacedHandle* outReplacedHandle) {
-        // import buffer
-        const native_handle_t* importedHandle;
-        Error error = mImporter.importBuffer(rawHandle, &importedHandle);
-        if (error != Error::NONE) {
-            return error;
-        }
-
-        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
-
-        auto iter = mDisplayResources.find(display);
-        if (iter == mDisplayResources.end()) {
-            mImporter.freeBuffer(importedHandle);
+        auto baseDisplayResource = findDisplayResource(display);
+        if (!baseDisplayResource) {
             return Error::BAD_DISPLAY;
         }
+        std::lock_guard<std::mutex> lock(baseDisplayResource->getLock());
         ComposerDisplayResource& displayResource =
-                *static_cast<ComposerDisplayResource*>(iter->second.get());
+                *static_cast<ComposerDisplayResource*>(baseDisplayResource.get());
 
-        // update cache
+        // import buffer and update cache
         const native_handle_t* replacedHandle;
-        error = displayResource.getReadbackBuffer(importedHandle, outHandle, &replacedHandle);
+        Error error = displayResource.getReadbackBuffer(rawHandle, outHandle, &replacedHandle);
         if (error != Error::NONE) {
-            mImporter.freeBuffer(importedHandle);
             return error;
         }
 
@@ -36,20 +36,14 @@ namespace hal {
 class ComposerCommandEngine : public V2_2::hal::ComposerCommandEngine {
    public:
     ComposerCommandEngine(ComposerHal* hal, V2_2::hal::ComposerResources* resources)
-        : BaseType2_2(hal, resources), mHal(hal) {}
-
-   protected:
-    bool executeCommand(V2_1::IComposerClient::Command command, uint16_t length) override {
-        switch (static_cast<IComposerClient::Command>(command)) {
-            case IComposerClient::Command::SET_LAYER_COLOR_TRANSFORM:
-                return executeSetLayerColorTransform(length);
-            case IComposerClient::Command::SET_LAYER_PER_FRAME_METADATA_BLOBS:
-                return executeSetLayerPerFrameMetadataBlobs(length);
-            default:
-                return BaseType2_2::executeCommand(command, length);
-        }
+        : BaseType2_2(hal, resources), mHal(hal) {
+        registerCommand(IComposerClient::Command::SET_LAYER_COLOR_TRANSFORM,
+                        &ComposerCommandEngine::executeSetLayerColorTransform);
+        registerCommand(IComposerClient::Command::SET_LAYER_PER_FRAME_METADATA_BLOBS,
+                        &ComposerCommandEngine::executeSetLayerPerFrameMetadataBlobs);
     }
 
+   protected:
     std::unique_ptr<V2_1::CommandWriterBase> createCommandWriter(
             size_t writerInitialSize) override {
         return std::make_unique<CommandWriterBase>(writerInitialSize);
@@ -23,6 +23,7 @@
 #include <android/hardware/graphics/composer/2.4/IComposer.h>
 #include <composer-hal/2.3/Composer.h>
 #include <composer-hal/2.4/ComposerClient.h>
+#include <composer-hal/2.4/ComposerVsyncTracker.h>
 
 namespace android {
 namespace hardware {
@@ -43,6 +44,14 @@ class ComposerImpl : public V2_3::hal::detail::ComposerImpl<Interface, Hal> {
 
     explicit ComposerImpl(std::unique_ptr<Hal> hal) : BaseType2_3(std::move(hal)) {}
 
+    // IComposer 2.1 interface
+
+    Return<void> dumpDebugInfo(IComposer::dumpDebugInfo_cb hidl_cb) override {
+        return BaseType2_1::dumpDebugInfo([&](const hidl_string& debugInfo) {
+            hidl_cb(std::string(debugInfo) + mVsyncTracker.dump());
+        });
+    }
+
     // IComposer 2.4 interface
 
     Return<void> createClient_2_4(IComposer::createClient_2_4_cb hidl_cb) override {
@@ -58,6 +67,8 @@ class ComposerImpl : public V2_3::hal::detail::ComposerImpl<Interface, Hal> {
             return Void();
         }
 
+        client->setVsyncTracker(&mVsyncTracker);
+
         auto clientDestroyed = [this]() { onClientDestroyed(); };
         client->setOnClientDestroyed(clientDestroyed);
 
@@ -75,6 +86,8 @@ class ComposerImpl : public V2_3::hal::detail::ComposerImpl<Interface, Hal> {
     using BaseType2_1::mHal;
     using BaseType2_1::onClientDestroyed;
     using BaseType2_1::waitForClientDestroyedLocked;
+
+    ComposerVsyncTracker mVsyncTracker;
 };
 
 }  // namespace detail
@@ -24,6 +24,7 @@
 #include <android/hardware/graphics/composer/2.4/IComposerClient.h>
 #include <composer-hal/2.4/ComposerCommandEngine.h>
 #include <composer-hal/2.4/ComposerHal.h>
+#include <composer-hal/2.4/ComposerVsyncTracker.h>
 #include <composer-resources/2.1/ComposerResources.h>
 
 namespace android {
@@ -46,14 +47,18 @@ class ComposerClientImpl : public V2_3::hal::detail::ComposerClientImpl<Interfac
     class HalEventCallback : public Hal::EventCallback_2_4 {
       public:
         HalEventCallback(const sp<IComposerCallback> callback,
-                         V2_1::hal::ComposerResources* resources)
-            : mCallback(callback), mResources(resources) {}
+                         V2_1::hal::ComposerResources* resources,
+                         ComposerVsyncTracker* vsyncTracker)
+            : mCallback(callback), mResources(resources), mVsyncTracker(vsyncTracker) {}
 
         void onHotplug(Display display, IComposerCallback::Connection connected) override {
             if (connected == IComposerCallback::Connection::CONNECTED) {
                 mResources->addPhysicalDisplay(display);
             } else if (connected == IComposerCallback::Connection::DISCONNECTED) {
                 mResources->removeDisplay(display);
+                if (mVsyncTracker) {
+                    mVsyncTracker->removeDisplay(display);
+                }
             }
 
             auto ret = mCallback->onHotplug(display, connected);
@@ -73,12 +78,18 @@ class ComposerClientImpl : public V2_3::hal::detail::ComposerClientImpl<Interfac
 
         void onVsync_2_4(Display display, int64_t timestamp,
                          VsyncPeriodNanos vsyncPeriodNanos) override {
+            if (mVsyncTracker) {
+                mVsyncTracker->onVsync(display, timestamp, vsyncPeriodNanos);
+            }
             auto ret = mCallback->onVsync_2_4(display, timestamp, vsyncPeriodNanos);
             ALOGE_IF(!ret.isOk(), "failed to send onVsync_2_4: %s", ret.description().c_str());
         }
 
         void onVsyncPeriodTimingChanged(Display display,
                                         const VsyncPeriodChangeTimeline& updatedTimeline) override {
+            if (mVsyncTracker) {
+                mVsyncTracker->onVsyncPeriodTimingChanged(display, updatedTimeline);
+            }
             auto ret = mCallback->onVsyncPeriodTimingChanged(display, updatedTimeline);
             ALOGE_IF(!ret.isOk(), "failed to send onVsyncPeriodTimingChanged: %s",
                      ret.description().c_str());
@@ -93,11 +104,16 @@ class ComposerClientImpl : public V2_3::hal::detail::ComposerClientImpl<Interfac
       protected:
         const sp<IComposerCallback> mCallback;
         V2_1::hal::ComposerResources* const mResources;
+        ComposerVsyncTracker* const mVsyncTracker;
     };
 
+    // must be called before registerCallback_2_4
+    void setVsyncTracker(ComposerVsyncTracker* vsyncTracker) { mVsyncTracker = vsyncTracker; }
+
     Return<void> registerCallback_2_4(const sp<IComposerCallback>& callback) override {
         // no locking as we require this function to be called only once
-        mHalEventCallback_2_4 = std::make_unique<HalEventCallback>(callback, mResources.get());
+        mHalEventCallback_2_4 =
+                std::make_unique<HalEventCallback>(callback, mResources.get(), mVsyncTracker);
         mHal->registerEventCallback_2_4(mHalEventCallback_2_4.get());
         return Void();
     }
@@ -131,17 +147,38 @@ class ComposerClientImpl : public V2_3::hal::detail::ComposerClientImpl<Interfac
                                        IComposerClient::getDisplayVsyncPeriod_cb hidl_cb) override {
         VsyncPeriodNanos vsyncPeriods;
         Error error = mHal->getDisplayVsyncPeriod(display, &vsyncPeriods);
+        if (error == Error::NONE && mVsyncTracker) {
+            mVsyncTracker->onVsyncPeriod(display, vsyncPeriods);
+        }
         hidl_cb(error, vsyncPeriods);
         return Void();
     }
 
+    Return<Error> setActiveConfig(Display display, Config config) override {
+        Error error = BaseType2_1::setActiveConfig(display, config);
+        if (error == Error::NONE && mVsyncTracker) {
+            mVsyncTracker->onConfigSet(display);
+        }
+        return error;
+    }
+
     Return<void> setActiveConfigWithConstraints(
             Display display, Config config,
             const IComposerClient::VsyncPeriodChangeConstraints& vsyncPeriodChangeConstraints,
             IComposerClient::setActiveConfigWithConstraints_cb hidl_cb) override {
         VsyncPeriodChangeTimeline timeline = {};
+        if (mVsyncTracker && mVsyncTracker->getPendingChange(
+                                     display, config, vsyncPeriodChangeConstraints, &timeline)) {
+            hidl_cb(Error::NONE, timeline);
+            return Void();
+        }
+
         Error error = mHal->setActiveConfigWithConstraints(display, config,
                                                            vsyncPeriodChangeConstraints, &timeline);
+        if (error == Error::NONE && mVsyncTracker) {
+            mVsyncTracker->onChangeScheduled(display, config, vsyncPeriodChangeConstraints,
+                                             timeline);
+        }
         hidl_cb(error, timeline);
         return Void();
     }
@@ -189,6 +226,7 @@ class ComposerClientImpl : public V2_3::hal::detail::ComposerClientImpl<Interfac
     using BaseType2_1::mHal;
     using BaseType2_1::mResources;
     std::unique_ptr<HalEventCallback> mHalEventCallback_2_4;
+    ComposerVsyncTracker* mVsyncTracker = nullptr;
 };
 
 }  // namespace detail
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <android/hardware/graphics/composer/2.4/IComposerClient.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_4 {
+namespace hal {
+
+using V2_1::Config;
+using V2_1::Display;
+
+// ComposerVsyncTracker follows the vsync timeline of each display, as reported
+// by vsync callbacks and vsync period changes.  It lets repeated requests for
+// a config change that is already scheduled be answered without going to the
+// device, and records how far the predicted change times are from the vsyncs
+// actually observed.
+class ComposerVsyncTracker {
+  public:
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    void onVsync(Display display, int64_t timestamp, VsyncPeriodNanos vsyncPeriod) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto& timeline = mTimelines[display];
+        timeline.lastVsyncTime = timestamp;
+
+        // the change is in effect once the period changes, or once its
+        // predicted time has passed when the period stays the same
+        if (timeline.changePending &&
+            ((timeline.vsyncPeriod != 0 && vsyncPeriod != timeline.vsyncPeriod) ||
+             timestamp >= timeline.pendingTimeline.newVsyncAppliedTimeNanos)) {
+            int64_t error = timestamp - timeline.pendingTimeline.newVsyncAppliedTimeNanos;
+            timeline.appliedChangeCount++;
+            timeline.totalLatencyErrorNs += error;
+            timeline.maxLatencyErrorNs = std::max(timeline.maxLatencyErrorNs, std::abs(error));
+            timeline.changePending = false;
+        }
+        timeline.vsyncPeriod = vsyncPeriod;
+    }
+
+    void onVsyncPeriodTimingChanged(Display display, const VsyncPeriodChangeTimeline& updated) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTimelines.find(display);
+        if (iter != mTimelines.end() && iter->second.changePending) {
+            iter->second.pendingTimeline = updated;
+        }
+    }
+
+    void onVsyncPeriod(Display display, VsyncPeriodNanos vsyncPeriod) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTimelines[display].vsyncPeriod = vsyncPeriod;
+    }
+
+    void removeDisplay(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTimelines.erase(display);
+    }
+
+    // Return true and the timeline of the pending change when a change to
+    // config that satisfies constraints is already scheduled
+    bool getPendingChange(Display display, Config config,
+                          const IComposerClient::VsyncPeriodChangeConstraints& constraints,
+                          VsyncPeriodChangeTimeline* outTimeline) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTimelines.find(display);
+        if (iter == mTimelines.end()) {
+            return false;
+        }
+
+        auto& timeline = iter->second;
+        if (!timeline.changePending || timeline.pendingConfig != config ||
+            timeline.pendingSeamlessRequired != constraints.seamlessRequired ||
+            timeline.pendingTimeline.newVsyncAppliedTimeNanos < constraints.desiredTimeNanos ||
+            timeline.pendingTimeline.newVsyncAppliedTimeNanos < now()) {
+            return false;
+        }
+
+        timeline.coalescedChangeCount++;
+        *outTimeline = timeline.pendingTimeline;
+        return true;
+    }
+
+    void onChangeScheduled(Display display, Config config,
+                           const IComposerClient::VsyncPeriodChangeConstraints& constraints,
+                           const VsyncPeriodChangeTimeline& scheduled) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto& timeline = mTimelines[display];
+        timeline.changePending = true;
+        timeline.pendingConfig = config;
+        timeline.pendingSeamlessRequired = constraints.seamlessRequired;
+        timeline.pendingTimeline = scheduled;
+        timeline.scheduledChangeCount++;
+    }
+
+    // A config set through the 2.1 setActiveConfig replaces any scheduled
+    // change, which must then no longer answer repeated requests
+    void onConfigSet(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mTimelines.find(display);
+        if (iter != mTimelines.end()) {
+            iter->second.changePending = false;
+        }
+    }
+
+    std::string dump() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::string result;
+        for (const auto& [display, timeline] : mTimelines) {
+            char buf[512];
+            snprintf(buf, sizeof(buf),
+                     "Display %" PRIu64 ": vsync period %u ns, last vsync %" PRId64 "%s\n"
+                     "  config changes: %u scheduled, %u coalesced, %u applied\n"
+                     "  applied vs predicted: avg %.1f us, max %.1f us\n",
+                     display, timeline.vsyncPeriod, timeline.lastVsyncTime,
+                     timeline.changePending ? ", change pending" : "",
+                     timeline.scheduledChangeCount, timeline.coalescedChangeCount,
+                     timeline.appliedChangeCount,
+                     timeline.appliedChangeCount
+                             ? timeline.totalLatencyErrorNs / 1000.0 / timeline.appliedChangeCount
+                             : 0.0,
+                     timeline.maxLatencyErrorNs / 1000.0);
+            result += buf;
+        }
+        return result;
+    }
+
+  private:
+    struct Timeline {
+        int64_t lastVsyncTime = 0;
+        VsyncPeriodNanos vsyncPeriod = 0;
+
+        bool changePending = false;
+        Config pendingConfig = 0;
+        bool pendingSeamlessRequired = false;
+        VsyncPeriodChangeTimeline pendingTimeline = {};
+
+        uint32_t scheduledChangeCount = 0;
+        uint32_t coalescedChangeCount = 0;
+        uint32_t appliedChangeCount = 0;
+        int64_t totalLatencyErrorNs = 0;
+        int64_t maxLatencyErrorNs = 0;
+    };
+
+    std::mutex mMutex;
+    std::unordered_map<Display, Timeline> mTimelines;
+};
+
+}  // namespace hal
+}  // namespace V2_4
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
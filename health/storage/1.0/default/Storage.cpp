@@ -16,7 +16,10 @@
 
 #include "Storage.h"
 
+#include <algorithm>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
@@ -39,60 +42,95 @@ using base::WriteStringToFile;
 using fs_mgr::Fstab;
 using fs_mgr::ReadDefaultFstab;
 
-std::string getGarbageCollectPath() {
+// Dev GC is driven in slices of at most this long. Every slice polls each device and triggers
+// the ones that still need GC again, so the loop stops soon after GC is done or the timeout hits.
+constexpr std::chrono::milliseconds kGcSlice{2000};
+
+std::vector<std::string> getGarbageCollectPaths() {
     Fstab fstab;
     ReadDefaultFstab(&fstab);
 
+    std::vector<std::string> paths;
     for (const auto& entry : fstab) {
-        if (!entry.sysfs_path.empty()) {
-            return entry.sysfs_path + "/manual_gc";
+        if (entry.sysfs_path.empty()) continue;
+        std::string path = entry.sysfs_path + "/manual_gc";
+        if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
+            paths.push_back(std::move(path));
         }
     }
+    return paths;
+}
 
-    return "";
+// Triggers another round of Dev GC on |path| if it still needs one. Returns false if no more GC
+// is needed on |path| or if it cannot be triggered; |result| is set to IO_ERROR in the latter case.
+static bool triggerGarbageCollect(const std::string& path, Result* result) {
+    std::string require;
+    if (!ReadFileToString(path, &require)) {
+        PLOG(WARNING) << "Reading manual_gc failed in " << path;
+        *result = Result::IO_ERROR;
+        return false;
+    }
+    require = Trim(require);
+    if (require == "" || require == "off" || require == "disabled") {
+        LOG(DEBUG) << "No more to do Dev GC on " << path;
+        return false;
+    }
+    LOG(DEBUG) << "Trigger Dev GC on " << path;
+    if (!WriteStringToFile("1", path)) {
+        PLOG(WARNING) << "Start Dev GC failed on " << path;
+        *result = Result::IO_ERROR;
+        return false;
+    }
+    return true;
 }
 
 Return<void> Storage::garbageCollect(uint64_t timeoutSeconds,
                                      const sp<IGarbageCollectCallback>& cb) {
     Result result = Result::SUCCESS;
-    std::string path = getGarbageCollectPath();
+    std::vector<std::string> paths = getGarbageCollectPaths();
 
-    if (path.empty()) {
+    if (paths.empty()) {
         LOG(WARNING) << "Cannot find Dev GC path";
         result = Result::UNKNOWN_ERROR;
     } else {
         Timer timer;
-        LOG(INFO) << "Start Dev GC on " << path;
-        while (1) {
-            std::string require;
-            if (!ReadFileToString(path, &require)) {
-                PLOG(WARNING) << "Reading manual_gc failed in " << path;
-                result = Result::IO_ERROR;
-                break;
-            }
-            require = Trim(require);
-            if (require == "" || require == "off" || require == "disabled") {
+        const std::chrono::milliseconds timeout = std::chrono::seconds(timeoutSeconds);
+        for (const auto& path : paths) {
+            LOG(INFO) << "Start Dev GC on " << path;
+        }
+        setGcProgress(true, paths.size(), paths.size(), 0);
+
+        // All devices are collected concurrently; a device leaves |pending| once it is done.
+        std::vector<std::string> pending = paths;
+        for (uint64_t slices = 1;; slices++) {
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                         [&](const auto& path) {
+                                             return !triggerGarbageCollect(path, &result);
+                                         }),
+                          pending.end());
+            setGcProgress(true, paths.size(), pending.size(), slices);
+            if (pending.empty()) {
                 LOG(DEBUG) << "No more to do Dev GC";
                 break;
             }
-            LOG(DEBUG) << "Trigger Dev GC on " << path;
-            if (!WriteStringToFile("1", path)) {
-                PLOG(WARNING) << "Start Dev GC failed on " << path;
-                result = Result::IO_ERROR;
-                break;
-            }
-            if (timer.duration() >= std::chrono::seconds(timeoutSeconds)) {
-                LOG(WARNING) << "Dev GC timeout";
+            auto elapsed = timer.duration();
+            if (elapsed >= timeout) {
+                LOG(WARNING) << "Dev GC timeout, " << pending.size() << " of " << paths.size()
+                             << " devices not done";
                 // Timeout is not treated as an error. Try next time.
                 break;
             }
-            sleep(2);
+            std::this_thread::sleep_for(std::min(kGcSlice, timeout - elapsed));
         }
-        LOG(INFO) << "Stop Dev GC on " << path;
-        if (!WriteStringToFile("0", path)) {
-            PLOG(WARNING) << "Stop Dev GC failed on " << path;
-            result = Result::IO_ERROR;
+
+        for (const auto& path : paths) {
+            LOG(INFO) << "Stop Dev GC on " << path;
+            if (!WriteStringToFile("0", path)) {
+                PLOG(WARNING) << "Stop Dev GC failed on " << path;
+                result = Result::IO_ERROR;
+            }
         }
+        setGcProgress(false, paths.size(), pending.size(), 0);
     }
 
     if (cb != nullptr) {
@@ -104,6 +142,14 @@ Return<void> Storage::garbageCollect(uint64_t timeoutSeconds,
     return Void();
 }
 
+void Storage::setGcProgress(bool running, size_t devices, size_t pending, uint64_t slices) {
+    std::lock_guard<std::mutex> lock(mGcProgressMutex);
+    mGcRunning = running;
+    mGcDevices = devices;
+    mGcDevicesPending = pending;
+    mGcSlices = slices;
+}
+
 Return<void> Storage::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
     if (handle == nullptr || handle->numFds < 1) {
         return Void();
@@ -112,10 +158,19 @@ Return<void> Storage::debug(const hidl_handle& handle, const hidl_vec<hidl_strin
     int fd = handle->data[0];
     std::stringstream output;
 
-    std::string path = getGarbageCollectPath();
-    if (path.empty()) {
+    {
+        std::lock_guard<std::mutex> lock(mGcProgressMutex);
+        if (mGcRunning) {
+            output << "Dev GC running: slice " << mGcSlices << ", " << mGcDevicesPending << " of "
+                   << mGcDevices << " devices pending" << std::endl;
+        }
+    }
+
+    std::vector<std::string> paths = getGarbageCollectPaths();
+    if (paths.empty()) {
         output << "Cannot find Dev GC path";
-    } else {
+    }
+    for (const auto& path : paths) {
         std::string require;
 
         if (ReadFileToString(path, &require)) {
@@ -17,6 +17,8 @@
 #ifndef ANDROID_HARDWARE_HEALTH_FILESYSTEM_V1_0_FILESYSTEM_H
 #define ANDROID_HARDWARE_HEALTH_FILESYSTEM_V1_0_FILESYSTEM_H
 
+#include <mutex>
+
 #include <android/hardware/health/storage/1.0/IStorage.h>
 #include <hidl/Status.h>
 
@@ -37,6 +39,16 @@ struct Storage : public IStorage {
     Return<void> garbageCollect(uint64_t timeoutSeconds,
                                 const sp<IGarbageCollectCallback>& cb) override;
     Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) override;
+
+  private:
+    void setGcProgress(bool running, size_t devices, size_t pending, uint64_t slices);
+
+    // Progress of the running Dev GC, reported by debug().
+    std::mutex mGcProgressMutex;
+    bool mGcRunning = false;
+    size_t mGcDevices = 0;
+    size_t mGcDevicesPending = 0;
+    uint64_t mGcSlices = 0;
 };
 
 }  // namespace implementation
@@ -17,6 +17,7 @@
 #include <health2impl/Health.h>
 
 #include <functional>
+#include <optional>
 #include <string_view>
 
 #include <android-base/file.h>
@@ -64,6 +65,7 @@ class MyHealth : public Health {
 
 Health::Health(std::unique_ptr<healthd_config>&& config) : healthd_config_(std::move(config)) {
     battery_monitor_.init(healthd_config_.get());
+    power_supply_snapshot_ = std::make_unique<PowerSupplySnapshot>(healthd_config_.get());
 }
 
 //
@@ -124,20 +126,31 @@ static Return<void> GetProperty(BatteryMonitor* monitor, int id, T defaultValue,
     return Void();
 }
 
+template <typename T>
+static Return<void> GetSnapshotValue(const std::optional<T>& value,
+                                     const std::function<void(Result, T)>& callback) {
+    if (value.has_value()) {
+        callback(Result::SUCCESS, *value);
+    } else {
+        callback(Result::NOT_SUPPORTED, T{});
+    }
+    return Void();
+}
+
 Return<void> Health::getChargeCounter(getChargeCounter_cb _hidl_cb) {
-    return GetProperty<int32_t>(&battery_monitor_, BATTERY_PROP_CHARGE_COUNTER, 0, _hidl_cb);
+    return GetSnapshotValue(power_supply_snapshot_->get().chargeCounter, _hidl_cb);
 }
 
 Return<void> Health::getCurrentNow(getCurrentNow_cb _hidl_cb) {
-    return GetProperty<int32_t>(&battery_monitor_, BATTERY_PROP_CURRENT_NOW, 0, _hidl_cb);
+    return GetSnapshotValue(power_supply_snapshot_->get().currentNow, _hidl_cb);
 }
 
 Return<void> Health::getCurrentAverage(getCurrentAverage_cb _hidl_cb) {
-    return GetProperty<int32_t>(&battery_monitor_, BATTERY_PROP_CURRENT_AVG, 0, _hidl_cb);
+    return GetSnapshotValue(power_supply_snapshot_->get().currentAverage, _hidl_cb);
 }
 
 Return<void> Health::getCapacity(getCapacity_cb _hidl_cb) {
-    return GetProperty<int32_t>(&battery_monitor_, BATTERY_PROP_CAPACITY, 0, _hidl_cb);
+    return GetSnapshotValue(power_supply_snapshot_->get().capacity, _hidl_cb);
 }
 
 Return<void> Health::getEnergyCounter(getEnergyCounter_cb _hidl_cb) {
@@ -145,8 +158,8 @@ Return<void> Health::getEnergyCounter(getEnergyCounter_cb _hidl_cb) {
 }
 
 Return<void> Health::getChargeStatus(getChargeStatus_cb _hidl_cb) {
-    return GetProperty(&battery_monitor_, BATTERY_PROP_BATTERY_STATUS, BatteryStatus::UNKNOWN,
-                       _hidl_cb);
+    _hidl_cb(Result::SUCCESS, power_supply_snapshot_->get().chargeStatus);
+    return Void();
 }
 
 Return<void> Health::getStorageInfo(getStorageInfo_cb _hidl_cb) {
@@ -178,6 +191,8 @@ Return<void> Health::getHealthInfo(getHealthInfo_cb _hidl_cb) {
 
 Return<void> Health::getHealthInfo_2_1(getHealthInfo_2_1_cb _hidl_cb) {
     battery_monitor_.updateValues();
+    // Values may have changed, e.g. on a uevent; don't let the getters return older ones.
+    power_supply_snapshot_->invalidate();
 
     HealthInfo health_info = battery_monitor_.getHealthInfo_2_1();
 
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <health2impl/PowerSupplySnapshot.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+
+using android::hardware::health::V1_0::BatteryStatus;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_1 {
+namespace implementation {
+
+// Large enough for any of the integer and status attributes read here.
+static constexpr size_t kMaxAttributeSize = 32;
+
+// Same mapping as BatteryMonitor.
+static BatteryStatus ParseBatteryStatus(const char* status) {
+    static const struct {
+        const char* name;
+        BatteryStatus value;
+    } kStatusMap[] = {
+            {"Unknown", BatteryStatus::UNKNOWN},
+            {"Charging", BatteryStatus::CHARGING},
+            {"Discharging", BatteryStatus::DISCHARGING},
+            {"Not charging", BatteryStatus::NOT_CHARGING},
+            {"Full", BatteryStatus::FULL},
+    };
+    for (const auto& entry : kStatusMap) {
+        if (strcmp(status, entry.name) == 0) return entry.value;
+    }
+    LOG(WARNING) << "Unknown battery status '" << status << "'";
+    return BatteryStatus::UNKNOWN;
+}
+
+PowerSupplySnapshot::PowerSupplySnapshot(const healthd_config* config) {
+    attributes_[CHARGE_COUNTER].path = &config->batteryChargeCounterPath;
+    attributes_[CURRENT_NOW].path = &config->batteryCurrentNowPath;
+    attributes_[CURRENT_AVERAGE].path = &config->batteryCurrentAvgPath;
+    attributes_[CAPACITY].path = &config->batteryCapacityPath;
+    attributes_[STATUS].path = &config->batteryStatusPath;
+}
+
+PowerSupplySnapshot::Values PowerSupplySnapshot::get() {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto now = std::chrono::steady_clock::now();
+    if (!read_time_.has_value() || now - *read_time_ >= kMaxAge) {
+        readLocked();
+        read_time_ = now;
+    }
+    return values_;
+}
+
+void PowerSupplySnapshot::invalidate() {
+    std::lock_guard<std::mutex> lock(lock_);
+    read_time_.reset();
+}
+
+void PowerSupplySnapshot::readLocked() {
+    values_.chargeCounter = readInt(&attributes_[CHARGE_COUNTER]);
+    values_.currentNow = readInt(&attributes_[CURRENT_NOW]);
+    values_.currentAverage = readInt(&attributes_[CURRENT_AVERAGE]);
+    values_.capacity = readInt(&attributes_[CAPACITY]);
+
+    char buf[kMaxAttributeSize];
+    values_.chargeStatus = readAttribute(&attributes_[STATUS], buf, sizeof(buf)) > 0
+                                   ? ParseBatteryStatus(buf)
+                                   : BatteryStatus::UNKNOWN;
+}
+
+ssize_t PowerSupplySnapshot::readAttribute(Attribute* attr, char* buf, size_t size) {
+    if (attr->path->isEmpty()) return -1;
+    // The attribute may not have been readable yet when the last read was attempted.
+    if (attr->fd == -1) {
+        attr->fd.reset(TEMP_FAILURE_RETRY(open(attr->path->string(), O_RDONLY | O_CLOEXEC)));
+        if (attr->fd == -1) {
+            PLOG(ERROR) << "Cannot open " << attr->path->string();
+            return -1;
+        }
+    }
+    ssize_t len = TEMP_FAILURE_RETRY(pread(attr->fd, buf, size - 1, 0));
+    if (len < 0) {
+        PLOG(ERROR) << "Cannot read " << attr->path->string();
+        // Reopen on the next read in case the device went away and came back.
+        attr->fd.reset();
+        return -1;
+    }
+    buf[len] = '\0';
+    char* newline = strchr(buf, '\n');
+    if (newline != nullptr) *newline = '\0';
+    return newline != nullptr ? newline - buf : len;
+}
+
+std::optional<int32_t> PowerSupplySnapshot::readInt(Attribute* attr) {
+    if (attr->path->isEmpty()) return std::nullopt;
+    // Like BatteryMonitor, report 0 if the attribute is configured but cannot be read.
+    int32_t value = 0;
+    char buf[kMaxAttributeSize];
+    if (readAttribute(attr, buf, sizeof(buf)) > 0 && !android::base::ParseInt(buf, &value)) {
+        value = 0;
+    }
+    return value;
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -25,6 +25,7 @@
 #include <hidl/Status.h>
 
 #include <health2impl/Callback.h>
+#include <health2impl/PowerSupplySnapshot.h>
 
 using ::android::sp;
 using ::android::hardware::hidl_string;
@@ -78,6 +79,8 @@ class Health : public IHealth {
 
     BatteryMonitor battery_monitor_;
     std::unique_ptr<healthd_config> healthd_config_;
+    // Serves the single-property getters; created once battery_monitor_ has filled in the paths.
+    std::unique_ptr<PowerSupplySnapshot> power_supply_snapshot_;
 
     std::mutex callbacks_lock_;
     std::vector<std::unique_ptr<Callback>> callbacks_;
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/health/1.0/types.h>
+#include <healthd/healthd.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_1 {
+namespace implementation {
+
+// Reads the power_supply attributes behind the single-property getters of IHealth. The attribute
+// files stay open and are all read with pread() in one pass, and the values read are reused for
+// a short while, since clients tend to call several getters back to back.
+class PowerSupplySnapshot {
+  public:
+    // Values older than this are read again.
+    static constexpr std::chrono::milliseconds kMaxAge{100};
+
+    struct Values {
+        // std::nullopt if the attribute is not configured.
+        std::optional<int32_t> chargeCounter;
+        std::optional<int32_t> currentNow;
+        std::optional<int32_t> currentAverage;
+        std::optional<int32_t> capacity;
+        V1_0::BatteryStatus chargeStatus = V1_0::BatteryStatus::UNKNOWN;
+    };
+
+    // |config| must already be initialized by BatteryMonitor::init(), which fills in the paths
+    // it found; it must outlive this object.
+    explicit PowerSupplySnapshot(const healthd_config* config);
+
+    Values get();
+
+    // Makes the next get() read the attributes again, e.g. after a uevent.
+    void invalidate();
+
+  private:
+    struct Attribute {
+        const android::String8* path;
+        android::base::unique_fd fd;
+    };
+
+    enum Index { CHARGE_COUNTER, CURRENT_NOW, CURRENT_AVERAGE, CAPACITY, STATUS, NUM_ATTRIBUTES };
+
+    void readLocked();
+    // Reads the first line of |attr| into |buf| and returns its length, or -1 on error.
+    ssize_t readAttribute(Attribute* attr, char* buf, size_t size);
+    std::optional<int32_t> readInt(Attribute* attr);
+
+    std::mutex lock_;
+    Attribute attributes_[NUM_ATTRIBUTES];
+    Values values_;
+    std::optional<std::chrono::steady_clock::time_point> read_time_;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -142,16 +142,83 @@ void HealthLoop::UeventEvent(uint32_t /*epevents*/) {
     msg[n + 1] = '\0';
     cp = msg;
 
+    bool power_supply = false;
+    std::string properties;
     while (*cp) {
         if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
-            ScheduleBatteryUpdate();
-            break;
+            power_supply = true;
+        }
+        // The sequence number differs for every uevent, even if nothing has changed.
+        if (strncmp(cp, "SEQNUM=", strlen("SEQNUM="))) {
+            properties.append(cp).push_back('\n');
         }
 
         /* advance to after the next \0 */
         while (*cp++)
             ;
     }
+    if (!power_supply) return;
+
+    // Only a repeat of the very last uevent is dropped. A supply reporting the same properties
+    // as in its own last uevent may still signal a change of another one, as chargers do for
+    // the battery.
+    if (properties == last_power_supply_uevent_) return;
+    last_power_supply_uevent_ = std::move(properties);
+    ScheduleUeventBatteryUpdate();
+}
+
+// Power supplies can send bursts of uevents, e.g. while charging. The first uevent is handled
+// right away and opens a coalescing window; further uevents within the window are handled
+// together when it closes.
+#define UEVENT_COALESCE_WINDOW_MS 100
+void HealthLoop::ScheduleUeventBatteryUpdate() {
+    if (uevent_coalescing_) {
+        uevent_update_pending_ = true;
+        return;
+    }
+    ScheduleBatteryUpdate();
+    if (uevent_coalesce_fd_ == -1) return;
+
+    struct itimerspec itval = {};
+    itval.it_value.tv_sec = UEVENT_COALESCE_WINDOW_MS / 1000;
+    itval.it_value.tv_nsec = (UEVENT_COALESCE_WINDOW_MS % 1000) * 1000000;
+    if (timerfd_settime(uevent_coalesce_fd_, 0, &itval, NULL) == -1) {
+        KLOG_ERROR(LOG_TAG, "uevent_coalesce: timerfd_settime failed\n");
+        return;
+    }
+    uevent_coalescing_ = true;
+}
+
+void HealthLoop::UeventCoalesceEvent(uint32_t /*epevents*/) {
+    unsigned long long expirations;
+
+    if (read(uevent_coalesce_fd_, &expirations, sizeof(expirations)) == -1) {
+        KLOG_ERROR(LOG_TAG, "uevent_coalesce: read timer fd failed\n");
+        return;
+    }
+
+    uevent_coalescing_ = false;
+    if (uevent_update_pending_) {
+        uevent_update_pending_ = false;
+        // Opens another window, in case the burst goes on.
+        ScheduleUeventBatteryUpdate();
+    }
+}
+
+void HealthLoop::UeventCoalesceInit(void) {
+    // Not an alarm: the first uevent of a burst is handled right away, so waking the device up
+    // just to close the window is not worth it. A window still open at suspend closes on resume.
+    uevent_coalesce_fd_.reset(timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK));
+    if (uevent_coalesce_fd_ == -1) {
+        KLOG_ERROR(LOG_TAG, "uevent_coalesce_init: timerfd_create failed\n");
+        return;
+    }
+
+    if (RegisterEvent(uevent_coalesce_fd_, &HealthLoop::UeventCoalesceEvent,
+                      EVENT_NO_WAKEUP_FD)) {
+        KLOG_ERROR(LOG_TAG, "Registration of uevent coalescing event failed\n");
+        uevent_coalesce_fd_.reset();
+    }
 }
 
 void HealthLoop::UeventInit(void) {
@@ -241,6 +308,7 @@ int HealthLoop::InitInternal() {
     Init(&healthd_config_);
 
     WakeAlarmInit();
+    UeventCoalesceInit();
     UeventInit();
 
     return 0;
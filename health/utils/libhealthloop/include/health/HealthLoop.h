@@ -17,6 +17,7 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <android-base/unique_fd.h>
@@ -85,6 +86,9 @@ class HealthLoop {
     void WakeAlarmEvent(uint32_t);
     void UeventInit();
     void UeventEvent(uint32_t);
+    void UeventCoalesceInit();
+    void UeventCoalesceEvent(uint32_t);
+    void ScheduleUeventBatteryUpdate();
     void WakeAlarmSetInterval(int interval);
     void PeriodicChores();
 
@@ -92,12 +96,20 @@ class HealthLoop {
     struct healthd_config healthd_config_;
     android::base::unique_fd wakealarm_fd_;
     android::base::unique_fd uevent_fd_;
+    android::base::unique_fd uevent_coalesce_fd_;
 
     android::base::unique_fd epollfd_;
     std::vector<std::unique_ptr<EventHandler>> event_handlers_;
     int awake_poll_interval_;  // -1 for no epoll timeout
     int wakealarm_wake_interval_;
 
+    // While a coalescing window is open, power_supply uevents only mark an update as pending,
+    // and the update runs once when the window closes.
+    bool uevent_coalescing_ = false;
+    bool uevent_update_pending_ = false;
+    // The properties of the last power_supply uevent, whichever supply sent it.
+    std::string last_power_supply_uevent_;
+
     // If set to true, future RegisterEvent() will be rejected. This is to ensure all
     // events are registered before StartLoop().
     bool reject_event_register_ = false;
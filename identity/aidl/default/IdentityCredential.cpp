@@ -103,6 +103,11 @@ int IdentityCredential::initialize() {
     }
     storageKey_ = storageKeyItem->value();
     credentialPrivKey_ = credentialPrivKeyItem->value();
+    storageKeyCipher_ = support::Aes128GcmCipher::create(storageKey_);
+    if (!storageKeyCipher_) {
+        LOG(ERROR) << "Error creating storageKey cipher";
+        return IIdentityCredentialStore::STATUS_INVALID_DATA;
+    }
 
     return IIdentityCredentialStore::STATUS_OK;
 }
@@ -491,17 +496,53 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
         profileIdToAccessCheckResult_[profile.id] = accessControlCheck;
     }
 
-    deviceNameSpacesMap_ = cppbor::Map();
-    currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
-
     requestCountsRemaining_ = requestCounts;
     currentNameSpace_ = "";
 
     itemsRequest_ = itemsRequest;
     signingKeyBlob_ = byteStringToUnsigned(signingKeyBlobS);
 
-    // Finally, calculate the size of DeviceNameSpaces. We need to know it ahead of time.
-    expectedDeviceNameSpacesSize_ = calcDeviceNameSpacesSize();
+    // Finally, calculate the size of DeviceNameSpaces. We need to know it ahead of time, to
+    // encode and MAC it as the entries are retrieved.
+    expectedDeviceNameSpacesSize_ = calcDeviceNameSpacesSize(&expectedNumNameSpaces_);
+
+    encodedDeviceNameSpaces_.clear();
+    cppbor::encodeHeader(cppbor::MAP, expectedNumNameSpaces_,
+                         std::back_inserter(encodedDeviceNameSpaces_));
+    numNameSpaces_ = 0;
+    currentNameSpaceEncodedEntries_.clear();
+    currentNameSpaceNumEntries_ = 0;
+
+    // If there's no signing key or no sessionTranscript or no reader ephemeral
+    // public key, finishRetrieval() returns the empty MAC.
+    deviceAuthenticationMac_.reset();
+    if (signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
+        readerPublicKey_.size() > 0) {
+        vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
+        optional<vector<uint8_t>> signingKey =
+                support::decryptAes128Gcm(storageKey_, signingKeyBlob_, docTypeAsBlob);
+        if (!signingKey) {
+            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                    IIdentityCredentialStore::STATUS_INVALID_DATA,
+                    "Error decrypting signingKeyBlob"));
+        }
+
+        vector<uint8_t> sessionTranscriptBytes = cppbor::Semantic(24, sessionTranscript_).encode();
+        optional<vector<uint8_t>> eMacKey =
+                support::calcEMacKey(signingKey.value(), readerPublicKey_, sessionTranscriptBytes);
+        if (!eMacKey) {
+            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                    IIdentityCredentialStore::STATUS_FAILED, "Error calculating EMacKey"));
+        }
+        deviceAuthenticationMac_ = support::DeviceAuthenticationMac::create(
+                sessionTranscript_, docType_, expectedDeviceNameSpacesSize_, eMacKey.value());
+        if (!deviceAuthenticationMac_ ||
+            !deviceAuthenticationMac_->update(encodedDeviceNameSpaces_.data(),
+                                              encodedDeviceNameSpaces_.size())) {
+            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                    IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
+        }
+    }
 
     numStartRetrievalCalls_ += 1;
     return ndk::ScopedAStatus::ok();
@@ -524,7 +565,7 @@ size_t cborNumBytesForTstr(const string& value) {
     return 1 + cborNumBytesForLength(value.size()) + value.size();
 }
 
-size_t IdentityCredential::calcDeviceNameSpacesSize() {
+size_t IdentityCredential::calcDeviceNameSpacesSize(size_t* outNumNameSpaces) {
     /*
      * This is how DeviceNameSpaces is defined:
      *
@@ -609,9 +650,42 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
     // bytes the DeviceNamespaces map in the beginning is going to take up.
     ret += 1 + cborNumBytesForLength(numNamespacesWithValues);
 
+    *outNumNameSpaces = numNamespacesWithValues;
     return ret;
 }
 
+ndk::ScopedAStatus IdentityCredential::appendCurrentNameSpace() {
+    if (currentNameSpaceNumEntries_ == 0) {
+        return ndk::ScopedAStatus::ok();
+    }
+
+    size_t begin = encodedDeviceNameSpaces_.size();
+    auto out = std::back_inserter(encodedDeviceNameSpaces_);
+    cppbor::Tstr(currentNameSpace_).encode(out);
+    cppbor::encodeHeader(cppbor::MAP, currentNameSpaceNumEntries_, out);
+    encodedDeviceNameSpaces_.insert(encodedDeviceNameSpaces_.end(),
+                                    currentNameSpaceEncodedEntries_.begin(),
+                                    currentNameSpaceEncodedEntries_.end());
+    numNameSpaces_ += 1;
+    currentNameSpaceEncodedEntries_.clear();
+    currentNameSpaceNumEntries_ = 0;
+
+    if (encodedDeviceNameSpaces_.size() > expectedDeviceNameSpacesSize_) {
+        LOG(ERROR) << "encodedDeviceNameSpaces is already " << encodedDeviceNameSpaces_.size()
+                   << " bytes, was expecting " << expectedDeviceNameSpacesSize_;
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA,
+                "DeviceNameSpaces is bigger than expected"));
+    }
+    if (deviceAuthenticationMac_ &&
+        !deviceAuthenticationMac_->update(encodedDeviceNameSpaces_.data() + begin,
+                                          encodedDeviceNameSpaces_.size() - begin)) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
 ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
         const string& nameSpace, const string& name, int32_t entrySize,
         const vector<int32_t>& accessControlProfileIds) {
@@ -651,11 +725,10 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
                     "Moved to new name space but one or more entries need to be retrieved "
                     "in current name space"));
         }
-        if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-            deviceNameSpacesMap_.add(currentNameSpace_,
-                                     std::move(currentNameSpaceDeviceNameSpacesMap_));
+        ndk::ScopedAStatus status = appendCurrentNameSpace();
+        if (!status.isOk()) {
+            return status;
         }
-        currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
 
         requestCountsRemaining_.erase(requestCountsRemaining_.begin());
         currentNameSpace_ = nameSpace;
@@ -715,15 +788,22 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
 
 ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<int8_t>& encryptedContentS,
                                                           vector<int8_t>* outContent) {
-    auto encryptedContent = byteStringToUnsigned(encryptedContentS);
-    optional<vector<uint8_t>> content =
-            support::decryptAes128Gcm(storageKey_, encryptedContent, entryAdditionalData_);
-    if (!content) {
+    if (encryptedContentS.size() < support::kAesGcmIvSize + support::kAesGcmTagSize) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA, "Error decrypting data"));
+    }
+    // Decrypt straight into the output, with the cipher set up in initialize().
+    size_t chunkSize =
+            encryptedContentS.size() - support::kAesGcmIvSize - support::kAesGcmTagSize;
+    outContent->resize(chunkSize);
+    const uint8_t* content = reinterpret_cast<const uint8_t*>(outContent->data());
+    if (!storageKeyCipher_->decrypt(reinterpret_cast<const uint8_t*>(encryptedContentS.data()),
+                                    encryptedContentS.size(), entryAdditionalData_,
+                                    reinterpret_cast<uint8_t*>(outContent->data()))) {
+        outContent->clear();
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA, "Error decrypting data"));
     }
-
-    size_t chunkSize = content.value().size();
 
     if (chunkSize > entryRemainingBytes_) {
         LOG(ERROR) << "Retrieved chunk of size " << chunkSize
@@ -742,64 +822,55 @@ ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<int8_t>&
         }
     }
 
-    entryValue_.insert(entryValue_.end(), content.value().begin(), content.value().end());
+    entryValue_.insert(entryValue_.end(), content, content + chunkSize);
 
     if (entryRemainingBytes_ == 0) {
-        auto [entryValueItem, _, message] = cppbor::parse(entryValue_);
-        if (entryValueItem == nullptr) {
+        // The value goes into DeviceNameSpaces as is, it only needs to be valid CBOR.
+        auto [entryValueView, pos, message] = cppbor::parseView(entryValue_);
+        if (!entryValueView.isValid() || pos != entryValue_.data() + entryValue_.size()) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_INVALID_DATA,
                     "Retrieved data which is invalid CBOR"));
         }
-        currentNameSpaceDeviceNameSpacesMap_.add(currentName_, std::move(entryValueItem));
+        cppbor::Tstr(currentName_).encode(std::back_inserter(currentNameSpaceEncodedEntries_));
+        currentNameSpaceEncodedEntries_.insert(currentNameSpaceEncodedEntries_.end(),
+                                               entryValue_.begin(), entryValue_.end());
+        currentNameSpaceNumEntries_ += 1;
     }
 
-    *outContent = byteStringToSigned(content.value());
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<int8_t>* outMac,
                                                        vector<int8_t>* outDeviceNameSpaces) {
-    if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-        deviceNameSpacesMap_.add(currentNameSpace_,
-                                 std::move(currentNameSpaceDeviceNameSpacesMap_));
+    ndk::ScopedAStatus status = appendCurrentNameSpace();
+    if (!status.isOk()) {
+        return status;
     }
-    vector<uint8_t> encodedDeviceNameSpaces = deviceNameSpacesMap_.encode();
 
-    if (encodedDeviceNameSpaces.size() != expectedDeviceNameSpacesSize_) {
-        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces.size() << " bytes, "
+    if (encodedDeviceNameSpaces_.size() != expectedDeviceNameSpacesSize_) {
+        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces_.size() << " bytes, "
                    << "was expecting " << expectedDeviceNameSpacesSize_;
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA,
                 StringPrintf(
                         "Unexpected CBOR size %zd for encodedDeviceNameSpaces, was expecting %zd",
-                        encodedDeviceNameSpaces.size(), expectedDeviceNameSpacesSize_)
+                        encodedDeviceNameSpaces_.size(), expectedDeviceNameSpacesSize_)
+                        .c_str()));
+    }
+    // The map header was written for the expected number of name spaces.
+    if (numNameSpaces_ != expectedNumNameSpaces_) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA,
+                StringPrintf("Unexpected number of name spaces %zd in encodedDeviceNameSpaces, "
+                             "was expecting %zd",
+                             numNameSpaces_, expectedNumNameSpaces_)
                         .c_str()));
     }
 
-    // If there's no signing key or no sessionTranscript or no reader ephemeral
-    // public key, we return the empty MAC.
     optional<vector<uint8_t>> mac;
-    if (signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
-        readerPublicKey_.size() > 0) {
-        vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
-        optional<vector<uint8_t>> signingKey =
-                support::decryptAes128Gcm(storageKey_, signingKeyBlob_, docTypeAsBlob);
-        if (!signingKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_INVALID_DATA,
-                    "Error decrypting signingKeyBlob"));
-        }
-
-        vector<uint8_t> sessionTranscriptBytes = cppbor::Semantic(24, sessionTranscript_).encode();
-        optional<vector<uint8_t>> eMacKey =
-                support::calcEMacKey(signingKey.value(), readerPublicKey_, sessionTranscriptBytes);
-        if (!eMacKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_FAILED, "Error calculating EMacKey"));
-        }
-        mac = support::calcMac(sessionTranscript_, docType_, encodedDeviceNameSpaces,
-                               eMacKey.value());
+    if (deviceAuthenticationMac_) {
+        mac = deviceAuthenticationMac_->finish();
         if (!mac) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
@@ -807,7 +878,7 @@ ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<int8_t>* outMac,
     }
 
     *outMac = byteStringToSigned(mac.value_or(vector<uint8_t>({})));
-    *outDeviceNameSpaces = byteStringToSigned(encodedDeviceNameSpaces);
+    *outDeviceNameSpaces = byteStringToSigned(encodedDeviceNameSpaces_);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -34,6 +34,7 @@ namespace aidl::android::hardware::identity {
 using ::aidl::android::hardware::keymaster::HardwareAuthToken;
 using ::aidl::android::hardware::keymaster::VerificationToken;
 using ::std::map;
+using ::std::optional;
 using ::std::set;
 using ::std::string;
 using ::std::vector;
@@ -44,7 +45,8 @@ class IdentityCredential : public BnIdentityCredential {
         : credentialData_(credentialData),
           numStartRetrievalCalls_(0),
           authChallenge_(0),
-          expectedDeviceNameSpacesSize_(0) {}
+          expectedDeviceNameSpacesSize_(0),
+          expectedNumNameSpaces_(0) {}
 
     // Parses and decrypts credentialData_, return a status code from
     // IIdentityCredentialStore. Must be called right after construction.
@@ -82,6 +84,7 @@ class IdentityCredential : public BnIdentityCredential {
     string docType_;
     bool testCredential_;
     vector<uint8_t> storageKey_;
+    optional<::android::hardware::identity::support::Aes128GcmCipher> storageKeyCipher_;
     vector<uint8_t> credentialPrivKey_;
 
     // Set by createEphemeralKeyPair()
@@ -106,11 +109,19 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> itemsRequest_;
     vector<int32_t> requestCountsRemaining_;
     map<string, set<string>> requestedNameSpacesAndNames_;
-    cppbor::Map deviceNameSpacesMap_;
-    cppbor::Map currentNameSpaceDeviceNameSpacesMap_;
+    optional<::android::hardware::identity::support::DeviceAuthenticationMac>
+            deviceAuthenticationMac_;
 
     // Calculated at startRetrieval() time.
     size_t expectedDeviceNameSpacesSize_;
+    size_t expectedNumNameSpaces_;
+
+    // DeviceNameSpaces, encoded and MACed as entries are retrieved. A name space is
+    // appended once it's complete, since its map header holds its number of entries.
+    vector<uint8_t> encodedDeviceNameSpaces_;
+    size_t numNameSpaces_;
+    vector<uint8_t> currentNameSpaceEncodedEntries_;
+    size_t currentNameSpaceNumEntries_;
 
     // Set at startRetrieveEntryValue() time.
     string currentNameSpace_;
@@ -119,7 +130,8 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> entryValue_;
     vector<uint8_t> entryAdditionalData_;
 
-    size_t calcDeviceNameSpacesSize();
+    size_t calcDeviceNameSpacesSize(size_t* outNumNameSpaces);
+    ndk::ScopedAStatus appendCurrentNameSpace();
 };
 
 }  // namespace aidl::android::hardware::identity
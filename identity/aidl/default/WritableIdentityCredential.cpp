@@ -46,6 +46,11 @@ bool WritableIdentityCredential::initialize() {
         return false;
     }
     storageKey_ = random.value();
+    storageKeyCipher_ = support::Aes128GcmCipher::create(storageKey_);
+    if (!storageKeyCipher_) {
+        LOG(ERROR) << "Error creating storageKey cipher";
+        return false;
+    }
     startPersonalizationCalled_ = false;
     firstEntry_ = true;
 
@@ -275,8 +280,8 @@ ndk::ScopedAStatus WritableIdentityCredential::beginAddEntry(
 
 ndk::ScopedAStatus WritableIdentityCredential::addEntryValue(const vector<int8_t>& contentS,
                                                              vector<int8_t>* outEncryptedContentS) {
-    auto content = byteStringToUnsigned(contentS);
-    size_t contentSize = content.size();
+    const uint8_t* content = reinterpret_cast<const uint8_t*>(contentS.data());
+    size_t contentSize = contentS.size();
 
     if (contentSize > IdentityCredentialStore::kGcmChunkSize) {
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
@@ -289,7 +294,7 @@ ndk::ScopedAStatus WritableIdentityCredential::addEntryValue(const vector<int8_t
                 "Passed in chunk is bigger than remaining space"));
     }
 
-    entryBytes_.insert(entryBytes_.end(), content.begin(), content.end());
+    entryBytes_.insert(entryBytes_.end(), content, content + contentSize);
     entryRemainingBytes_ -= contentSize;
     if (entryRemainingBytes_ > 0) {
         if (contentSize != IdentityCredentialStore::kGcmChunkSize) {
@@ -304,9 +309,11 @@ ndk::ScopedAStatus WritableIdentityCredential::addEntryValue(const vector<int8_t
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_FAILED, "Error getting nonce"));
     }
-    optional<vector<uint8_t>> encryptedContent =
-            support::encryptAes128Gcm(storageKey_, nonce.value(), content, entryAdditionalData_);
-    if (!encryptedContent) {
+    // Encrypt straight into the output, with the cipher set up in initialize().
+    outEncryptedContentS->resize(contentSize + support::kAesGcmIvSize + support::kAesGcmTagSize);
+    if (!storageKeyCipher_->encrypt(nonce.value().data(), content, contentSize,
+                                    entryAdditionalData_,
+                                    reinterpret_cast<uint8_t*>(outEncryptedContentS->data()))) {
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_FAILED, "Error encrypting content"));
     }
@@ -330,7 +337,6 @@ ndk::ScopedAStatus WritableIdentityCredential::addEntryValue(const vector<int8_t
         signedDataCurrentNamespace_.add(std::move(entryMap));
     }
 
-    *outEncryptedContentS = byteStringToSigned(encryptedContent.value());
     return ndk::ScopedAStatus::ok();
 }
 
@@ -25,6 +25,7 @@
 
 namespace aidl::android::hardware::identity {
 
+using ::std::optional;
 using ::std::set;
 using ::std::string;
 using ::std::vector;
@@ -71,6 +72,7 @@ class WritableIdentityCredential : public BnWritableIdentityCredential {
 
     // This is set in initialize().
     vector<uint8_t> storageKey_;
+    optional<::android::hardware::identity::support::Aes128GcmCipher> storageKeyCipher_;
     bool startPersonalizationCalled_;
     bool firstEntry_;
 
@@ -18,12 +18,17 @@
 #define IDENTITY_SUPPORT_INCLUDE_IDENTITY_CREDENTIAL_UTILS_H_
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+// From OpenSSL, as EVP_CIPHER_CTX and HMAC_CTX.
+struct evp_cipher_ctx_st;
+struct hmac_ctx_st;
+
 namespace android {
 namespace hardware {
 namespace identity {
@@ -108,6 +113,40 @@ optional<vector<uint8_t>> encryptAes128Gcm(const vector<uint8_t>& key, const vec
                                            const vector<uint8_t>& data,
                                            const vector<uint8_t>& additionalAuthenticatedData);
 
+// An AES-128-GCM key with an OpenSSL cipher context which is set up once and
+// then reused, for encrypting and decrypting many messages in the format of
+// encryptAes128Gcm() without a context setup or allocation per message. Large
+// data elements are processed in chunks this way. Not thread-safe.
+class Aes128GcmCipher {
+  public:
+    // Returns the cipher for |key|, which must be kAes128GcmKeySize bytes.
+    static optional<Aes128GcmCipher> create(const vector<uint8_t>& key);
+
+    // Encrypts the |dataSize| bytes at |data| with |additionalAuthenticatedData|
+    // using |nonce| (kAesGcmIvSize bytes), writing (nonce || ciphertext || tag)
+    // to |out|, which must have room for dataSize + kAesGcmIvSize +
+    // kAesGcmTagSize bytes. For in-place encryption, |data| may be equal to
+    // |out| + kAesGcmIvSize, and |nonce| to |out|.
+    bool encrypt(const uint8_t* nonce, const uint8_t* data, size_t dataSize,
+                 const vector<uint8_t>& additionalAuthenticatedData, uint8_t* out);
+
+    // Decrypts the |encryptedDataSize| bytes at |encryptedData|, in the format
+    // written by encrypt(), with |additionalAuthenticatedData|, writing the
+    // plaintext to |out|, which must have room for encryptedDataSize -
+    // kAesGcmIvSize - kAesGcmTagSize bytes.
+    bool decrypt(const uint8_t* encryptedData, size_t encryptedDataSize,
+                 const vector<uint8_t>& additionalAuthenticatedData, uint8_t* out);
+
+  private:
+    struct CtxDeleter {
+        void operator()(evp_cipher_ctx_st* ctx) const;
+    };
+
+    Aes128GcmCipher() = default;
+
+    std::unique_ptr<evp_cipher_ctx_st, CtxDeleter> ctx_;
+};
+
 // ---------------------------------------------------------------------------
 // EC crypto functionality / abstraction (only supports P-256).
 // ---------------------------------------------------------------------------
@@ -368,6 +407,34 @@ optional<vector<uint8_t>> calcMac(const vector<uint8_t>& sessionTranscriptEncode
                                   const vector<uint8_t>& deviceNameSpacesEncoded,
                                   const vector<uint8_t>& eMacKey);
 
+// Calculates the same MAC as calcMac(), but is passed the encoded
+// DeviceNameSpaces piece by piece, e.g. as entries are retrieved, so neither
+// DeviceNameSpaces nor the DeviceAuthentication containing it have to be built
+// in memory. Only the size of DeviceNameSpaces must be known up front.
+class DeviceAuthenticationMac {
+  public:
+    static optional<DeviceAuthenticationMac> create(
+            const vector<uint8_t>& sessionTranscriptEncoded, const string& docType,
+            size_t deviceNameSpacesEncodedSize, const vector<uint8_t>& eMacKey);
+
+    // Adds the next |size| bytes of the encoded DeviceNameSpaces.
+    bool update(const uint8_t* data, size_t size);
+
+    // Returns the MAC in COSE_Mac0 format. Fails unless exactly
+    // |deviceNameSpacesEncodedSize| bytes have been added.
+    optional<vector<uint8_t>> finish();
+
+  private:
+    struct HmacCtxDeleter {
+        void operator()(hmac_ctx_st* ctx) const;
+    };
+
+    DeviceAuthenticationMac() = default;
+
+    std::unique_ptr<hmac_ctx_st, HmacCtxDeleter> ctx_;
+    size_t remainingBytes_ = 0;
+};
+
 optional<vector<uint8_t>> calcEMacKey(const vector<uint8_t>& privateKey,
                                       const vector<uint8_t>& publicKey,
                                       const vector<uint8_t>& sessionTranscriptBytes);
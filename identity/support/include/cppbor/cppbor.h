@@ -164,9 +164,10 @@ class Item {
      * Encodes the Item into a new std::vector<uint8_t>.
      */
     std::vector<uint8_t> encode() const {
-        std::vector<uint8_t> retval;
-        retval.reserve(encodedSize());
-        encode(std::back_inserter(retval));
+        // Sizing the buffer up front lets the whole tree be written through the bulk encoder,
+        // rather than a callback per byte.
+        std::vector<uint8_t> retval(encodedSize());
+        encode(retval.data(), retval.data() + retval.size());
         return retval;
     }
 
@@ -174,9 +175,9 @@ class Item {
      * Encodes the Item into a new std::string.
      */
     std::string toString() const {
-        std::string retval;
-        retval.reserve(encodedSize());
-        encode([&](uint8_t v) { retval.push_back(v); });
+        std::string retval(encodedSize(), '\0');
+        uint8_t* data = reinterpret_cast<uint8_t*>(retval.data());
+        encode(data, data + retval.size());
         return retval;
     }
 
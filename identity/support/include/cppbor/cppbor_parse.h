@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <string_view>
+
 #include "cppbor.h"
 
 namespace cppbor {
@@ -130,4 +132,189 @@ class ParseClient {
     virtual void error(const uint8_t* position, const std::string& errorMessage) = 0;
 };
 
+/**
+ * A non-owning reference to a range of bytes in an encoded CBOR buffer.
+ */
+struct ByteView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+};
+
+/**
+ * ItemView is a non-owning, read-only view of an encoded CBOR data item, as returned by
+ * parseView().  Unlike the Item tree built by parse(), it allocates nothing: scalar values are
+ * decoded from the item header on demand, string values refer to the encoded buffer and the entries
+ * of compound items are decoded lazily, as they are visited.  The encoded buffer must outlive the
+ * view and everything derived from it.
+ *
+ * The value accessors must only be called on a view of the matching type.
+ */
+class ItemView {
+  public:
+    class Iterator;
+
+    /**
+     * Constructs an invalid view, which refers to no item.
+     */
+    ItemView() = default;
+
+    bool isValid() const { return mHdrBegin != nullptr; }
+
+    MajorType type() const { return mType; }
+
+    bool isCompound() const { return mType == ARRAY || mType == MAP || mType == SEMANTIC; }
+
+    /**
+     * Returns the value of a UINT.
+     */
+    uint64_t uintValue() const { return mAddlInfo; }
+
+    /**
+     * Returns the value of a UINT or NINT.
+     */
+    int64_t intValue() const {
+        return mType == NINT ? -1 - static_cast<int64_t>(mAddlInfo)
+                             : static_cast<int64_t>(mAddlInfo);
+    }
+
+    /**
+     * Returns the value of a SIMPLE boolean.
+     */
+    bool boolValue() const { return mAddlInfo == TRUE; }
+
+    bool isNull() const { return mType == SIMPLE && mAddlInfo == NULL_V; }
+
+    /**
+     * Returns the value of a TSTR, referring to the encoded buffer.
+     */
+    std::string_view tstr() const {
+        return std::string_view(reinterpret_cast<const char*>(mValueBegin), mEnd - mValueBegin);
+    }
+
+    /**
+     * Returns the value of a BSTR, referring to the encoded buffer.
+     */
+    ByteView bstr() const { return {mValueBegin, static_cast<size_t>(mEnd - mValueBegin)}; }
+
+    /**
+     * Returns the tag of a SEMANTIC.
+     */
+    uint64_t semanticTag() const { return mAddlInfo; }
+
+    /**
+     * Returns the number of entries of an ARRAY, the number of key/value pairs of a MAP and 1 for a
+     * SEMANTIC.  Returns 0 for all other types.
+     */
+    size_t size() const;
+
+    /**
+     * Iterate over the entries of a compound item.  The entries of a MAP are visited as alternating
+     * keys and values, the only entry of a SEMANTIC is the tagged item.  Each step decodes the next
+     * entry's header and skips over the previous entry's content.
+     */
+    Iterator begin() const;
+    Iterator end() const;
+
+    /**
+     * Returns the entry at index of an ARRAY, or the tagged item of a SEMANTIC if index is 0.  This
+     * skips over all of the preceding entries, so prefer iteration to visit all of them.
+     */
+    ItemView operator[](size_t index) const;
+
+    /**
+     * Returns the value of the first entry of a MAP whose key is a TSTR or an integer equal to key,
+     * or an invalid view if there is none.
+     */
+    ItemView get(std::string_view key) const;
+    ItemView get(int64_t key) const;
+
+    /**
+     * Returns the complete encoding of the item, header included.
+     */
+    ByteView encoded() const { return {mHdrBegin, static_cast<size_t>(mEnd - mHdrBegin)}; }
+
+    /**
+     * Builds an owning Item tree from the view, for callers that need to keep or modify the item.
+     */
+    std::unique_ptr<Item> toItem() const;
+
+  private:
+    friend class Iterator;
+    friend std::tuple<ItemView, const uint8_t*, std::string> parseView(const uint8_t* begin,
+                                                                      const uint8_t* end);
+
+    // Decodes the already validated item starting at hdrBegin, which ends before end.
+    ItemView(const uint8_t* hdrBegin, const uint8_t* end);
+
+    const uint8_t* mHdrBegin = nullptr;
+    const uint8_t* mValueBegin = nullptr;
+    const uint8_t* mEnd = nullptr;  // One past the last byte of the item.
+    MajorType mType = UINT;
+    uint64_t mAddlInfo = 0;
+};
+
+class ItemView::Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ItemView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ItemView*;
+    using reference = const ItemView&;
+
+    const ItemView& operator*() const { return mCurrent; }
+    const ItemView* operator->() const { return &mCurrent; }
+
+    Iterator& operator++() {
+        if (--mRemaining > 0) mCurrent = ItemView(mCurrent.mEnd, mParentEnd);
+        return *this;
+    }
+
+    bool operator==(const Iterator& other) const { return mRemaining == other.mRemaining; }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+  private:
+    friend class ItemView;
+
+    Iterator(const uint8_t* pos, const uint8_t* parentEnd, size_t remaining)
+        : mParentEnd(parentEnd), mRemaining(remaining) {
+        if (mRemaining > 0) mCurrent = ItemView(pos, mParentEnd);
+    }
+
+    ItemView mCurrent;
+    const uint8_t* mParentEnd;
+    size_t mRemaining;
+};
+
+using ParseViewResult = std::tuple<ItemView /* result */, const uint8_t* /* newPos */,
+                                   std::string /* errMsg */>;
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the range [begin, end) into a
+ * non-owning ItemView over the range.  The whole item is validated up front, without allocating,
+ * so that later accesses through the view cannot fail.
+ *
+ * Returns a tuple of ItemView, buffer pointer and error message, with the same meaning as for
+ * parse(), except that the ItemView is invalid rather than null on failure.
+ */
+ParseViewResult parseView(const uint8_t* begin, const uint8_t* end);
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the byte vector into a non-owning
+ * ItemView, which must not outlive the vector's contents.  See above.
+ */
+inline ParseViewResult parseView(const std::vector<uint8_t>& encoding) {
+    return parseView(encoding.data(), encoding.data() + encoding.size());
+}
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the range [begin, begin + size) into a
+ * non-owning ItemView.  See above.
+ */
+inline ParseViewResult parseView(const uint8_t* begin, size_t size) {
+    return parseView(begin, begin + size);
+}
+
 }  // namespace cppbor
@@ -26,6 +26,9 @@
 #include <time.h>
 #include <chrono>
 #include <iomanip>
+#include <limits>
+#include <list>
+#include <mutex>
 
 #include <openssl/aes.h>
 #include <openssl/bn.h>
@@ -343,16 +346,6 @@ string cborPrettyPrint(const vector<uint8_t>& encodedCbor, size_t maxBStrSize,
 // Crypto functionality / abstraction.
 // ---------------------------------------------------------------------------
 
-struct EVP_CIPHER_CTX_Deleter {
-    void operator()(EVP_CIPHER_CTX* ctx) const {
-        if (ctx != nullptr) {
-            EVP_CIPHER_CTX_free(ctx);
-        }
-    }
-};
-
-using EvpCipherCtxPtr = unique_ptr<EVP_CIPHER_CTX, EVP_CIPHER_CTX_Deleter>;
-
 // bool getRandom(size_t numBytes, vector<uint8_t>& output) {
 optional<vector<uint8_t>> getRandom(size_t numBytes) {
     vector<uint8_t> output;
@@ -364,172 +357,203 @@ optional<vector<uint8_t>> getRandom(size_t numBytes) {
     return output;
 }
 
-optional<vector<uint8_t>> decryptAes128Gcm(const vector<uint8_t>& key,
-                                           const vector<uint8_t>& encryptedData,
-                                           const vector<uint8_t>& additionalAuthenticatedData) {
-    int cipherTextSize = int(encryptedData.size()) - kAesGcmIvSize - kAesGcmTagSize;
-    if (cipherTextSize < 0) {
-        LOG(ERROR) << "encryptedData too small";
-        return {};
+void Aes128GcmCipher::CtxDeleter::operator()(EVP_CIPHER_CTX* ctx) const {
+    if (ctx != nullptr) {
+        EVP_CIPHER_CTX_free(ctx);
     }
-    unsigned char* nonce = (unsigned char*)encryptedData.data();
-    unsigned char* cipherText = nonce + kAesGcmIvSize;
-    unsigned char* tag = cipherText + cipherTextSize;
+}
 
-    vector<uint8_t> plainText;
-    plainText.resize(cipherTextSize);
+optional<Aes128GcmCipher> Aes128GcmCipher::create(const vector<uint8_t>& key) {
+    if (key.size() != kAes128GcmKeySize) {
+        LOG(ERROR) << "key is not kAes128GcmKeySize bytes";
+        return {};
+    }
 
-    auto ctx = EvpCipherCtxPtr(EVP_CIPHER_CTX_new());
-    if (ctx.get() == nullptr) {
+    Aes128GcmCipher cipher;
+    cipher.ctx_.reset(EVP_CIPHER_CTX_new());
+    if (cipher.ctx_.get() == nullptr) {
         LOG(ERROR) << "EVP_CIPHER_CTX_new: failed";
         return {};
     }
 
-    if (EVP_DecryptInit_ex(ctx.get(), EVP_aes_128_gcm(), NULL, NULL, NULL) != 1) {
-        LOG(ERROR) << "EVP_DecryptInit_ex: failed";
+    if (EVP_EncryptInit_ex(cipher.ctx_.get(), EVP_aes_128_gcm(), NULL, NULL, NULL) != 1) {
+        LOG(ERROR) << "EVP_EncryptInit_ex: failed";
         return {};
     }
 
-    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, kAesGcmIvSize, NULL) != 1) {
+    if (EVP_CIPHER_CTX_ctrl(cipher.ctx_.get(), EVP_CTRL_GCM_SET_IVLEN, kAesGcmIvSize, NULL) != 1) {
         LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed setting nonce length";
         return {};
     }
 
-    if (EVP_DecryptInit_ex(ctx.get(), NULL, NULL, (unsigned char*)key.data(), nonce) != 1) {
-        LOG(ERROR) << "EVP_DecryptInit_ex: failed";
+    // The key schedule is computed here, once. Each message then only sets its nonce, which also
+    // resets the GCM state left by the previous message.
+    if (EVP_EncryptInit_ex(cipher.ctx_.get(), NULL, NULL, key.data(), NULL) != 1) {
+        LOG(ERROR) << "EVP_EncryptInit_ex: failed";
         return {};
     }
 
+    return cipher;
+}
+
+bool Aes128GcmCipher::encrypt(const uint8_t* nonce, const uint8_t* data, size_t dataSize,
+                              const vector<uint8_t>& additionalAuthenticatedData, uint8_t* out) {
+    EVP_CIPHER_CTX* ctx = ctx_.get();
+    // The result is the nonce (kAesGcmIvSize bytes), the ciphertext, and
+    // finally the tag (kAesGcmTagSize bytes).
+    unsigned char* cipherText = out + kAesGcmIvSize;
+    unsigned char* tag = cipherText + dataSize;
+
+    if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce) != 1) {
+        LOG(ERROR) << "EVP_EncryptInit_ex: failed";
+        return false;
+    }
+    memmove(out, nonce, kAesGcmIvSize);
+
+    int numWritten;
+    if (additionalAuthenticatedData.size() > 0) {
+        if (EVP_EncryptUpdate(ctx, NULL, &numWritten, additionalAuthenticatedData.data(),
+                              additionalAuthenticatedData.size()) != 1) {
+            LOG(ERROR) << "EVP_EncryptUpdate: failed for additionalAuthenticatedData";
+            return false;
+        }
+        if ((size_t)numWritten != additionalAuthenticatedData.size()) {
+            LOG(ERROR) << "EVP_EncryptUpdate: Unexpected outl=" << numWritten << " (expected "
+                       << additionalAuthenticatedData.size() << ") for additionalAuthenticatedData";
+            return false;
+        }
+    }
+
+    numWritten = 0;
+    if (dataSize > 0) {
+        if (EVP_EncryptUpdate(ctx, cipherText, &numWritten, data, dataSize) != 1) {
+            LOG(ERROR) << "EVP_EncryptUpdate: failed";
+            return false;
+        }
+        if ((size_t)numWritten != dataSize) {
+            LOG(ERROR) << "EVP_EncryptUpdate: Unexpected outl=" << numWritten << " (expected "
+                       << dataSize << ")";
+            return false;
+        }
+    }
+
+    if (EVP_EncryptFinal_ex(ctx, cipherText + numWritten, &numWritten) != 1) {
+        LOG(ERROR) << "EVP_EncryptFinal_ex: failed";
+        return false;
+    }
+    if (numWritten != 0) {
+        LOG(ERROR) << "EVP_EncryptFinal_ex: Unexpected non-zero outl=" << numWritten;
+        return false;
+    }
+
+    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, kAesGcmTagSize, tag) != 1) {
+        LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed getting tag";
+        return false;
+    }
+    return true;
+}
+
+bool Aes128GcmCipher::decrypt(const uint8_t* encryptedData, size_t encryptedDataSize,
+                              const vector<uint8_t>& additionalAuthenticatedData, uint8_t* out) {
+    EVP_CIPHER_CTX* ctx = ctx_.get();
+    int cipherTextSize = int(encryptedDataSize) - kAesGcmIvSize - kAesGcmTagSize;
+    if (cipherTextSize < 0) {
+        LOG(ERROR) << "encryptedData too small";
+        return false;
+    }
+    const unsigned char* nonce = encryptedData;
+    const unsigned char* cipherText = nonce + kAesGcmIvSize;
+    const unsigned char* tag = cipherText + cipherTextSize;
+
+    if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, nonce) != 1) {
+        LOG(ERROR) << "EVP_DecryptInit_ex: failed";
+        return false;
+    }
+
     int numWritten;
     if (additionalAuthenticatedData.size() > 0) {
-        if (EVP_DecryptUpdate(ctx.get(), NULL, &numWritten,
-                              (unsigned char*)additionalAuthenticatedData.data(),
+        if (EVP_DecryptUpdate(ctx, NULL, &numWritten, additionalAuthenticatedData.data(),
                               additionalAuthenticatedData.size()) != 1) {
             LOG(ERROR) << "EVP_DecryptUpdate: failed for additionalAuthenticatedData";
-            return {};
+            return false;
         }
         if ((size_t)numWritten != additionalAuthenticatedData.size()) {
             LOG(ERROR) << "EVP_DecryptUpdate: Unexpected outl=" << numWritten << " (expected "
                        << additionalAuthenticatedData.size() << ") for additionalAuthenticatedData";
-            return {};
+            return false;
         }
     }
 
-    if (EVP_DecryptUpdate(ctx.get(), (unsigned char*)plainText.data(), &numWritten, cipherText,
-                          cipherTextSize) != 1) {
+    if (EVP_DecryptUpdate(ctx, out, &numWritten, cipherText, cipherTextSize) != 1) {
         LOG(ERROR) << "EVP_DecryptUpdate: failed";
-        return {};
+        return false;
     }
     if (numWritten != cipherTextSize) {
         LOG(ERROR) << "EVP_DecryptUpdate: Unexpected outl=" << numWritten << " (expected "
                    << cipherTextSize << ")";
-        return {};
+        return false;
     }
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, kAesGcmTagSize, tag)) {
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, kAesGcmTagSize,
+                             const_cast<unsigned char*>(tag))) {
         LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed setting expected tag";
-        return {};
+        return false;
     }
 
-    int ret = EVP_DecryptFinal_ex(ctx.get(), (unsigned char*)plainText.data() + numWritten,
-                                  &numWritten);
+    int ret = EVP_DecryptFinal_ex(ctx, out + numWritten, &numWritten);
     if (ret != 1) {
         LOG(ERROR) << "EVP_DecryptFinal_ex: failed";
-        return {};
+        return false;
     }
     if (numWritten != 0) {
         LOG(ERROR) << "EVP_DecryptFinal_ex: Unexpected non-zero outl=" << numWritten;
-        return {};
+        return false;
     }
-
-    return plainText;
+    return true;
 }
 
-optional<vector<uint8_t>> encryptAes128Gcm(const vector<uint8_t>& key, const vector<uint8_t>& nonce,
-                                           const vector<uint8_t>& data,
+optional<vector<uint8_t>> decryptAes128Gcm(const vector<uint8_t>& key,
+                                           const vector<uint8_t>& encryptedData,
                                            const vector<uint8_t>& additionalAuthenticatedData) {
-    if (key.size() != kAes128GcmKeySize) {
-        LOG(ERROR) << "key is not kAes128GcmKeySize bytes";
-        return {};
-    }
-    if (nonce.size() != kAesGcmIvSize) {
-        LOG(ERROR) << "nonce is not kAesGcmIvSize bytes";
-        return {};
-    }
-
-    // The result is the nonce (kAesGcmIvSize bytes), the ciphertext, and
-    // finally the tag (kAesGcmTagSize bytes).
-    vector<uint8_t> encryptedData;
-    encryptedData.resize(data.size() + kAesGcmIvSize + kAesGcmTagSize);
-    unsigned char* noncePtr = (unsigned char*)encryptedData.data();
-    unsigned char* cipherText = noncePtr + kAesGcmIvSize;
-    unsigned char* tag = cipherText + data.size();
-    memcpy(noncePtr, nonce.data(), kAesGcmIvSize);
-
-    auto ctx = EvpCipherCtxPtr(EVP_CIPHER_CTX_new());
-    if (ctx.get() == nullptr) {
-        LOG(ERROR) << "EVP_CIPHER_CTX_new: failed";
+    int cipherTextSize = int(encryptedData.size()) - kAesGcmIvSize - kAesGcmTagSize;
+    if (cipherTextSize < 0) {
+        LOG(ERROR) << "encryptedData too small";
         return {};
     }
 
-    if (EVP_EncryptInit_ex(ctx.get(), EVP_aes_128_gcm(), NULL, NULL, NULL) != 1) {
-        LOG(ERROR) << "EVP_EncryptInit_ex: failed";
+    optional<Aes128GcmCipher> cipher = Aes128GcmCipher::create(key);
+    if (!cipher) {
         return {};
     }
 
-    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, kAesGcmIvSize, NULL) != 1) {
-        LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed setting nonce length";
+    vector<uint8_t> plainText;
+    plainText.resize(cipherTextSize);
+    if (!cipher->decrypt(encryptedData.data(), encryptedData.size(), additionalAuthenticatedData,
+                         plainText.data())) {
         return {};
     }
+    return plainText;
+}
 
-    if (EVP_EncryptInit_ex(ctx.get(), NULL, NULL, (unsigned char*)key.data(),
-                           (unsigned char*)nonce.data()) != 1) {
-        LOG(ERROR) << "EVP_EncryptInit_ex: failed";
+optional<vector<uint8_t>> encryptAes128Gcm(const vector<uint8_t>& key, const vector<uint8_t>& nonce,
+                                           const vector<uint8_t>& data,
+                                           const vector<uint8_t>& additionalAuthenticatedData) {
+    if (nonce.size() != kAesGcmIvSize) {
+        LOG(ERROR) << "nonce is not kAesGcmIvSize bytes";
         return {};
     }
 
-    int numWritten;
-    if (additionalAuthenticatedData.size() > 0) {
-        if (EVP_EncryptUpdate(ctx.get(), NULL, &numWritten,
-                              (unsigned char*)additionalAuthenticatedData.data(),
-                              additionalAuthenticatedData.size()) != 1) {
-            LOG(ERROR) << "EVP_EncryptUpdate: failed for additionalAuthenticatedData";
-            return {};
-        }
-        if ((size_t)numWritten != additionalAuthenticatedData.size()) {
-            LOG(ERROR) << "EVP_EncryptUpdate: Unexpected outl=" << numWritten << " (expected "
-                       << additionalAuthenticatedData.size() << ") for additionalAuthenticatedData";
-            return {};
-        }
-    }
-
-    if (data.size() > 0) {
-        if (EVP_EncryptUpdate(ctx.get(), cipherText, &numWritten, (unsigned char*)data.data(),
-                              data.size()) != 1) {
-            LOG(ERROR) << "EVP_EncryptUpdate: failed";
-            return {};
-        }
-        if ((size_t)numWritten != data.size()) {
-            LOG(ERROR) << "EVP_EncryptUpdate: Unexpected outl=" << numWritten << " (expected "
-                       << data.size() << ")";
-            return {};
-        }
-    }
-
-    if (EVP_EncryptFinal_ex(ctx.get(), cipherText + numWritten, &numWritten) != 1) {
-        LOG(ERROR) << "EVP_EncryptFinal_ex: failed";
-        return {};
-    }
-    if (numWritten != 0) {
-        LOG(ERROR) << "EVP_EncryptFinal_ex: Unexpected non-zero outl=" << numWritten;
+    optional<Aes128GcmCipher> cipher = Aes128GcmCipher::create(key);
+    if (!cipher) {
         return {};
     }
 
-    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, kAesGcmTagSize, tag) != 1) {
-        LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed getting tag";
+    vector<uint8_t> encryptedData;
+    encryptedData.resize(data.size() + kAesGcmIvSize + kAesGcmTagSize);
+    if (!cipher->encrypt(nonce.data(), data.data(), data.size(), additionalAuthenticatedData,
+                         encryptedData.data())) {
         return {};
     }
-
     return encryptedData;
 }
 
@@ -728,35 +752,181 @@ bool certificateSignedByPublicKey(const vector<uint8_t>& certificate,
     return true;
 }
 
+bool parseAsn1Time(const ASN1_TIME* asn1Time, time_t* outTime);
+
+namespace {
+
+// Returns the public key of |cert| in the format returned by ecKeyPairGetPublicKey(), or nothing
+// if it's not an EC key.
+optional<vector<uint8_t>> x509GetEcPublicKey(X509* cert) {
+    int algoId = OBJ_obj2nid(cert->cert_info->key->algor->algorithm);
+    if (algoId != NID_X9_62_id_ecPublicKey) {
+        LOG(ERROR) << "Expected NID_X9_62_id_ecPublicKey, got " << OBJ_nid2ln(algoId);
+        return {};
+    }
+
+    auto pkey = EVP_PKEY_Ptr(X509_get_pubkey(cert));
+    if (pkey.get() == nullptr) {
+        LOG(ERROR) << "No public key";
+        return {};
+    }
+
+    auto ecKey = EC_KEY_Ptr(EVP_PKEY_get1_EC_KEY(pkey.get()));
+    if (ecKey.get() == nullptr) {
+        LOG(ERROR) << "Failed getting EC key";
+        return {};
+    }
+
+    auto ecGroup = EC_KEY_get0_group(ecKey.get());
+    auto ecPoint = EC_KEY_get0_public_key(ecKey.get());
+    int size = EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, nullptr, 0,
+                                  nullptr);
+    if (size == 0) {
+        LOG(ERROR) << "Error generating public key encoding";
+        return {};
+    }
+    vector<uint8_t> publicKey;
+    publicKey.resize(size);
+    EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, publicKey.data(),
+                       publicKey.size(), nullptr);
+    return publicKey;
+}
+
+// What certificateChainValidate() and certificateChainGetTopMostKey() learn from parsing a
+// certificate chain.
+struct CertificateChainInfo {
+    // Index of the first certificate not signed by its successor, if any.
+    optional<size_t> unsignedCertIndex;
+    optional<vector<uint8_t>> topMostKey;
+
+    // The intersection of the validity periods of all certificates in the chain.
+    time_t notBefore = 0;
+    time_t notAfter = 0;
+};
+
 // TODO: Right now the only check we perform is to check that each certificate
 //       is signed by its successor. We should - but currently don't - also check
 //       things like valid dates etc.
 //
 //       It would be nice to use X509_verify_cert() instead of doing our own thing.
 //
-bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
+optional<CertificateChainInfo> certificateChainParse(const vector<uint8_t>& certificateChain) {
     vector<X509_Ptr> certs;
-
     if (!parseX509Certificates(certificateChain, certs)) {
         LOG(ERROR) << "Error parsing X509 certificates";
-        return false;
-    }
-
-    if (certs.size() == 1) {
-        return true;
+        return {};
     }
 
+    CertificateChainInfo info;
     for (size_t n = 1; n < certs.size(); n++) {
         const X509_Ptr& keyCert = certs[n - 1];
         const X509_Ptr& signingCert = certs[n];
         EVP_PKEY_Ptr signingPubkey(X509_get_pubkey(signingCert.get()));
         if (X509_verify(keyCert.get(), signingPubkey.get()) != 1) {
-            LOG(ERROR) << "Error validating cert at index " << n - 1
-                       << " is signed by its successor";
-            return false;
+            info.unsignedCertIndex = n - 1;
+            break;
+        }
+    }
+    if (certs.size() > 0) {
+        info.topMostKey = x509GetEcPublicKey(certs[0].get());
+    }
+
+    // An empty validity period makes sure the result is never cached if we can't get the dates.
+    info.notBefore = std::numeric_limits<time_t>::min();
+    info.notAfter = std::numeric_limits<time_t>::max();
+    for (const X509_Ptr& cert : certs) {
+        time_t notBefore, notAfter;
+        if (!parseAsn1Time(X509_get0_notBefore(cert.get()), &notBefore) ||
+            !parseAsn1Time(X509_get0_notAfter(cert.get()), &notAfter)) {
+            info.notBefore = 1;
+            info.notAfter = 0;
+            break;
+        }
+        info.notBefore = std::max(info.notBefore, notBefore);
+        info.notAfter = std::min(info.notAfter, notAfter);
+    }
+    return info;
+}
+
+// A small LRU cache of certificate chains which validated and have an EC public key, keyed by the
+// SHA-256 of the chain encoding. Readers present the same certificate chain for every
+// presentation and access control profiles are checked against it for every entry, so this saves
+// parsing the chain and checking its signatures over and over again.
+//
+// A chain is only cached - and the cached result only used - while all its certificates are
+// valid, so the outcome doesn't depend on whether the chain was seen before.
+class CertificateChainCache {
+  public:
+    static constexpr size_t kMaxEntries = 16;
+
+    optional<CertificateChainInfo> lookup(const vector<uint8_t>& digest, time_t now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); it++) {
+            if (it->first != digest) {
+                continue;
+            }
+            if (now < it->second.notBefore || now > it->second.notAfter) {
+                entries_.erase(it);
+                return {};
+            }
+            entries_.splice(entries_.begin(), entries_, it);
+            return it->second;
+        }
+        return {};
+    }
+
+    void insert(vector<uint8_t> digest, const CertificateChainInfo& info) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : entries_) {
+            if (entry.first == digest) {
+                return;
+            }
+        }
+        entries_.emplace_front(std::move(digest), info);
+        if (entries_.size() > kMaxEntries) {
+            entries_.pop_back();
         }
     }
 
+  private:
+    std::mutex mutex_;
+    // Most recently used first.
+    std::list<pair<vector<uint8_t>, CertificateChainInfo>> entries_;
+};
+
+CertificateChainCache& certificateChainCache() {
+    static CertificateChainCache cache;
+    return cache;
+}
+
+optional<CertificateChainInfo> certificateChainGetInfo(const vector<uint8_t>& certificateChain) {
+    time_t now = time(nullptr);
+    vector<uint8_t> digest = sha256(certificateChain);
+    optional<CertificateChainInfo> info = certificateChainCache().lookup(digest, now);
+    if (info) {
+        return info;
+    }
+
+    info = certificateChainParse(certificateChain);
+    if (info && !info.value().unsignedCertIndex && info.value().topMostKey &&
+        now >= info.value().notBefore && now <= info.value().notAfter) {
+        certificateChainCache().insert(std::move(digest), info.value());
+    }
+    return info;
+}
+
+}  // namespace
+
+bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
+    optional<CertificateChainInfo> info = certificateChainGetInfo(certificateChain);
+    if (!info) {
+        return false;
+    }
+    if (info.value().unsignedCertIndex) {
+        LOG(ERROR) << "Error validating cert at index " << info.value().unsignedCertIndex.value()
+                   << " is signed by its successor";
+        return false;
+    }
     return true;
 }
 
@@ -1602,46 +1772,15 @@ tuple<bool, vector<uint8_t>, vector<uint8_t>> ecPublicKeyGetXandY(
 }
 
 optional<vector<uint8_t>> certificateChainGetTopMostKey(const vector<uint8_t>& certificateChain) {
-    vector<X509_Ptr> certs;
-    if (!parseX509Certificates(certificateChain, certs)) {
+    optional<CertificateChainInfo> info = certificateChainGetInfo(certificateChain);
+    if (!info) {
         return {};
     }
-    if (certs.size() < 1) {
-        LOG(ERROR) << "No certificates in chain";
-        return {};
-    }
-
-    int algoId = OBJ_obj2nid(certs[0]->cert_info->key->algor->algorithm);
-    if (algoId != NID_X9_62_id_ecPublicKey) {
-        LOG(ERROR) << "Expected NID_X9_62_id_ecPublicKey, got " << OBJ_nid2ln(algoId);
-        return {};
-    }
-
-    auto pkey = EVP_PKEY_Ptr(X509_get_pubkey(certs[0].get()));
-    if (pkey.get() == nullptr) {
-        LOG(ERROR) << "No public key";
-        return {};
-    }
-
-    auto ecKey = EC_KEY_Ptr(EVP_PKEY_get1_EC_KEY(pkey.get()));
-    if (ecKey.get() == nullptr) {
-        LOG(ERROR) << "Failed getting EC key";
-        return {};
-    }
-
-    auto ecGroup = EC_KEY_get0_group(ecKey.get());
-    auto ecPoint = EC_KEY_get0_public_key(ecKey.get());
-    int size = EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, nullptr, 0,
-                                  nullptr);
-    if (size == 0) {
-        LOG(ERROR) << "Error generating public key encoding";
+    if (!info.value().topMostKey) {
+        LOG(ERROR) << "No EC public key in top-most certificate in chain";
         return {};
     }
-    vector<uint8_t> publicKey;
-    publicKey.resize(size);
-    EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, publicKey.data(),
-                       publicKey.size(), nullptr);
-    return publicKey;
+    return info.value().topMostKey;
 }
 
 optional<pair<size_t, size_t>> certificateFindPublicKey(const vector<uint8_t>& x509Certificate) {
@@ -2343,29 +2482,119 @@ optional<vector<uint8_t>> calcEMacKey(const vector<uint8_t>& privateKey,
     return derivedKey.value();
 }
 
-optional<vector<uint8_t>> calcMac(const vector<uint8_t>& sessionTranscriptEncoded,
-                                  const string& docType,
-                                  const vector<uint8_t>& deviceNameSpacesEncoded,
-                                  const vector<uint8_t>& eMacKey) {
+void DeviceAuthenticationMac::HmacCtxDeleter::operator()(HMAC_CTX* ctx) const {
+    if (ctx != nullptr) {
+        HMAC_CTX_free(ctx);
+    }
+}
+
+optional<DeviceAuthenticationMac> DeviceAuthenticationMac::create(
+        const vector<uint8_t>& sessionTranscriptEncoded, const string& docType,
+        size_t deviceNameSpacesEncodedSize, const vector<uint8_t>& eMacKey) {
     auto [sessionTranscriptItem, _, errMsg] = cppbor::parse(sessionTranscriptEncoded);
     if (sessionTranscriptItem == nullptr) {
         LOG(ERROR) << "Error parsing sessionTranscriptEncoded: " << errMsg;
         return {};
     }
+
     // The data that is MACed is ["DeviceAuthentication", sessionTranscript, docType,
-    // deviceNameSpacesBytes] so build up that structure
-    cppbor::Array deviceAuthentication =
-            cppbor::Array()
-                    .add("DeviceAuthentication")
-                    .add(std::move(sessionTranscriptItem))
-                    .add(docType)
-                    .add(cppbor::Semantic(kSemanticTagEncodedCbor, deviceNameSpacesEncoded));
-    vector<uint8_t> deviceAuthenticationBytes =
-            cppbor::Semantic(kSemanticTagEncodedCbor, deviceAuthentication.encode()).encode();
-    optional<vector<uint8_t>> calculatedMac =
-            support::coseMac0(eMacKey, {},                 // payload
-                              deviceAuthenticationBytes);  // detached content
-    return calculatedMac;
+    // deviceNameSpacesBytes], as detached content of a COSE_Mac0. Everything but
+    // deviceNameSpacesBytes' content is encoded up front, using its known size.
+    cppbor::Tstr deviceAuthenticationLabel("DeviceAuthentication");
+    cppbor::Tstr docTypeItem(docType);
+    size_t deviceAuthenticationSize =
+            cppbor::headerSize(4) + deviceAuthenticationLabel.encodedSize() +
+            sessionTranscriptItem->encodedSize() + docTypeItem.encodedSize() +
+            cppbor::headerSize(kSemanticTagEncodedCbor) +
+            cppbor::headerSize(deviceNameSpacesEncodedSize) + deviceNameSpacesEncodedSize;
+    size_t deviceAuthenticationBytesSize = cppbor::headerSize(kSemanticTagEncodedCbor) +
+                                           cppbor::headerSize(deviceAuthenticationSize) +
+                                           deviceAuthenticationSize;
+
+    cppbor::Map protectedHeaders;
+    protectedHeaders.add(COSE_LABEL_ALG, COSE_ALG_HMAC_256_256);
+
+    // This is the start of the ToBeMaced structure built by coseBuildToBeMACed(), i.e.
+    // ["MAC0", protectedHeaders, externalAad, detachedContent], up to the content of
+    // deviceNameSpacesBytes in detachedContent.
+    vector<uint8_t> prefix;
+    auto out = std::back_inserter(prefix);
+    cppbor::encodeHeader(cppbor::ARRAY, 4, out);
+    cppbor::Tstr("MAC0").encode(out);
+    cppbor::Bstr(coseEncodeHeaders(protectedHeaders)).encode(out);
+    cppbor::Bstr(vector<uint8_t>()).encode(out);
+    cppbor::encodeHeader(cppbor::BSTR, deviceAuthenticationBytesSize, out);
+    cppbor::encodeHeader(cppbor::SEMANTIC, kSemanticTagEncodedCbor, out);
+    cppbor::encodeHeader(cppbor::BSTR, deviceAuthenticationSize, out);
+    cppbor::encodeHeader(cppbor::ARRAY, 4, out);
+    deviceAuthenticationLabel.encode(out);
+    sessionTranscriptItem->encode(out);
+    docTypeItem.encode(out);
+    cppbor::encodeHeader(cppbor::SEMANTIC, kSemanticTagEncodedCbor, out);
+    cppbor::encodeHeader(cppbor::BSTR, deviceNameSpacesEncodedSize, out);
+
+    DeviceAuthenticationMac mac;
+    mac.ctx_.reset(HMAC_CTX_new());
+    if (mac.ctx_.get() == nullptr) {
+        LOG(ERROR) << "Error allocating HMAC_CTX";
+        return {};
+    }
+    if (HMAC_Init_ex(mac.ctx_.get(), eMacKey.data(), eMacKey.size(), EVP_sha256(),
+                     nullptr /* impl */) != 1) {
+        LOG(ERROR) << "Error initializing HMAC_CTX";
+        return {};
+    }
+    if (HMAC_Update(mac.ctx_.get(), prefix.data(), prefix.size()) != 1) {
+        LOG(ERROR) << "Error updating HMAC_CTX";
+        return {};
+    }
+    mac.remainingBytes_ = deviceNameSpacesEncodedSize;
+    return mac;
+}
+
+bool DeviceAuthenticationMac::update(const uint8_t* data, size_t size) {
+    if (size > remainingBytes_) {
+        LOG(ERROR) << "Got " << size << " bytes of DeviceNameSpaces, only " << remainingBytes_
+                   << " bytes remaining";
+        return false;
+    }
+    if (HMAC_Update(ctx_.get(), data, size) != 1) {
+        LOG(ERROR) << "Error updating HMAC_CTX";
+        return false;
+    }
+    remainingBytes_ -= size;
+    return true;
+}
+
+optional<vector<uint8_t>> DeviceAuthenticationMac::finish() {
+    if (remainingBytes_ != 0) {
+        LOG(ERROR) << "Missing " << remainingBytes_ << " bytes of DeviceNameSpaces";
+        return {};
+    }
+    vector<uint8_t> digest;
+    digest.resize(32);
+    unsigned int size = 0;
+    if (HMAC_Final(ctx_.get(), digest.data(), &size) != 1) {
+        LOG(ERROR) << "Error finalizing HMAC_CTX";
+        return {};
+    }
+    if (size != 32) {
+        LOG(ERROR) << "Expected 32 bytes from HMAC_Final, got " << size;
+        return {};
+    }
+    return coseMacWithDigest(digest, {} /* data */);
+}
+
+optional<vector<uint8_t>> calcMac(const vector<uint8_t>& sessionTranscriptEncoded,
+                                  const string& docType,
+                                  const vector<uint8_t>& deviceNameSpacesEncoded,
+                                  const vector<uint8_t>& eMacKey) {
+    optional<DeviceAuthenticationMac> mac = DeviceAuthenticationMac::create(
+            sessionTranscriptEncoded, docType, deviceNameSpacesEncoded.size(), eMacKey);
+    if (!mac || !mac->update(deviceNameSpacesEncoded.data(), deviceNameSpacesEncoded.size())) {
+        return {};
+    }
+    return mac->finish();
 }
 
 vector<vector<uint8_t>> chunkVector(const vector<uint8_t>& content, size_t maxChunkSize) {
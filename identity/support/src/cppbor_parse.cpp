@@ -334,6 +334,129 @@ class FullParseClient : public ParseClient {
     std::string mErrorMessage;
 };
 
+// Decodes the header of the item at pos, for parseView().  Returns the header's type, additional
+// info and end, or nullptr and an error message if the header extends beyond end.
+std::tuple<MajorType, uint64_t, const uint8_t*> decodeHeader(const uint8_t* pos,
+                                                             const uint8_t* end,
+                                                             std::string* errMsg) {
+    MajorType type = static_cast<MajorType>(*pos & 0xE0);
+    uint8_t tagInt = *pos & 0x1F;
+    ++pos;
+
+    if (tagInt < ONE_BYTE_LENGTH || tagInt > EIGHT_BYTE_LENGTH) return {type, tagInt, pos};
+
+    size_t lengthSize = size_t{1} << (tagInt - ONE_BYTE_LENGTH);
+    if (end - pos < static_cast<ssize_t>(lengthSize)) {
+        *errMsg = insufficientLengthString(lengthSize, end - pos, "length field");
+        return {type, 0, nullptr};
+    }
+    uint64_t addlInfo = 0;
+    for (const uint8_t* lengthEnd = pos + lengthSize; pos < lengthEnd; ++pos) {
+        addlInfo = (addlInfo << 8) | *pos;
+    }
+    return {type, addlInfo, pos};
+}
+
+// Checks that the range [begin, end) starts with a complete item that parse() would accept, without
+// building it.  Returns one past the end of the item, or nullptr with the position and description
+// of the first problem.
+const uint8_t* validateRecursively(const uint8_t* begin, const uint8_t* end,
+                                   const uint8_t** errPos, std::string* errMsg) {
+    auto [type, addlInfo, pos] = decodeHeader(begin, end, errMsg);
+    if (!pos) {
+        *errPos = begin;
+        return nullptr;
+    }
+
+    uint64_t entryCount = 0;
+    std::string typeName;
+    switch (type) {
+        case UINT:
+            return pos;
+
+        case NINT:
+            if (addlInfo > std::numeric_limits<int64_t>::max()) {
+                *errPos = begin;
+                *errMsg = "NINT values that don't fit in int64_t are not supported.";
+                return nullptr;
+            }
+            return pos;
+
+        case BSTR:
+        case TSTR:
+            if (end - pos < static_cast<ssize_t>(addlInfo)) {
+                *errPos = begin;
+                *errMsg = insufficientLengthString(addlInfo, end - pos,
+                                                   type == BSTR ? "byte string" : "text string");
+                return nullptr;
+            }
+            return pos + addlInfo;
+
+        case ARRAY:
+            entryCount = addlInfo;
+            typeName = "array";
+            break;
+
+        case MAP:
+            // Every entry takes at least one byte, so this also rules out overflow below.
+            entryCount = addlInfo > static_cast<uint64_t>(end - pos) ? addlInfo : addlInfo * 2;
+            typeName = "map";
+            break;
+
+        case SEMANTIC:
+            entryCount = 1;
+            typeName = "semantic";
+            break;
+
+        case SIMPLE:
+            if (addlInfo != TRUE && addlInfo != FALSE && addlInfo != NULL_V) {
+                *errPos = begin;
+                *errMsg = "Unsupported simple value.";
+                return nullptr;
+            }
+            return pos;
+    }
+
+    for (; entryCount > 0; --entryCount) {
+        if (pos == end) {
+            *errPos = begin;
+            *errMsg = "Not enough entries for " + typeName + ".";
+            return nullptr;
+        }
+        pos = validateRecursively(pos, end, errPos, errMsg);
+        if (!pos) return nullptr;
+    }
+    return pos;
+}
+
+// Returns one past the end of the already validated item at pos, which ends before end.
+const uint8_t* skipItem(const uint8_t* pos, const uint8_t* end) {
+    std::string errMsg;
+    auto [type, addlInfo, valueBegin] = decodeHeader(pos, end, &errMsg);
+    CHECK(valueBegin) << errMsg;
+
+    uint64_t entryCount = 0;
+    switch (type) {
+        case BSTR:
+        case TSTR:
+            return valueBegin + addlInfo;
+        case ARRAY:
+            entryCount = addlInfo;
+            break;
+        case MAP:
+            entryCount = addlInfo * 2;
+            break;
+        case SEMANTIC:
+            entryCount = 1;
+            break;
+        default:
+            return valueBegin;
+    }
+
+    for (pos = valueBegin; entryCount > 0; --entryCount) pos = skipItem(pos, end);
+    return pos;
+}
+
 }  // anonymous namespace
 
 void parse(const uint8_t* begin, const uint8_t* end, ParseClient* parseClient) {
@@ -348,4 +471,70 @@ parse(const uint8_t* begin, const uint8_t* end) {
     return parseClient.parseResult();
 }
 
+ItemView::ItemView(const uint8_t* hdrBegin, const uint8_t* end) : mHdrBegin(hdrBegin) {
+    std::string errMsg;
+    std::tie(mType, mAddlInfo, mValueBegin) = decodeHeader(hdrBegin, end, &errMsg);
+    CHECK(mValueBegin) << errMsg;
+    mEnd = skipItem(hdrBegin, end);
+}
+
+size_t ItemView::size() const {
+    switch (mType) {
+        case ARRAY:
+        case MAP:
+            return mAddlInfo;
+        case SEMANTIC:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+ItemView::Iterator ItemView::begin() const {
+    return Iterator(mValueBegin, mEnd, mType == MAP ? size() * 2 : size());
+}
+
+ItemView::Iterator ItemView::end() const {
+    return Iterator(mEnd, mEnd, 0);
+}
+
+ItemView ItemView::operator[](size_t index) const {
+    auto iter = begin();
+    for (; index > 0; --index) ++iter;
+    return *iter;
+}
+
+ItemView ItemView::get(std::string_view key) const {
+    for (auto iter = begin(); iter != end(); ++iter) {
+        bool matches = iter->type() == TSTR && iter->tstr() == key;
+        ++iter;
+        if (matches) return *iter;
+    }
+    return {};
+}
+
+ItemView ItemView::get(int64_t key) const {
+    for (auto iter = begin(); iter != end(); ++iter) {
+        bool matches = (iter->type() == UINT || iter->type() == NINT) && iter->intValue() == key &&
+                       (iter->type() == NINT) == (key < 0);
+        ++iter;
+        if (matches) return *iter;
+    }
+    return {};
+}
+
+std::unique_ptr<Item> ItemView::toItem() const {
+    return std::get<0>(parse(mHdrBegin, mEnd));
+}
+
+ParseViewResult parseView(const uint8_t* begin, const uint8_t* end) {
+    if (begin == end) return {ItemView(), begin, "Need 1 byte(s) for header, have 0."};
+
+    const uint8_t* errPos = begin;
+    std::string errMsg;
+    const uint8_t* itemEnd = validateRecursively(begin, end, &errPos, &errMsg);
+    if (!itemEnd) return {ItemView(), errPos, std::move(errMsg)};
+    return {ItemView(begin, itemEnd), itemEnd, ""};
+}
+
 }  // namespace cppbor
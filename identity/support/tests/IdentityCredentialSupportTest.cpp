@@ -370,6 +370,60 @@ TEST(IdentityCredentialSupport, CertificateChain) {
     ASSERT_EQ(certs2, splitCerts2.value());
 }
 
+TEST(IdentityCredentialSupport, CertificateChainValidateRepeatedly) {
+    optional<vector<uint8_t>> leafKeyPair = support::createEcKeyPair();
+    ASSERT_TRUE(leafKeyPair);
+    optional<vector<uint8_t>> leafPubKey = support::ecKeyPairGetPublicKey(leafKeyPair.value());
+    ASSERT_TRUE(leafPubKey);
+    optional<vector<uint8_t>> rootKeyPair = support::createEcKeyPair();
+    ASSERT_TRUE(rootKeyPair);
+    optional<vector<uint8_t>> rootPrivKey = support::ecKeyPairGetPrivateKey(rootKeyPair.value());
+    ASSERT_TRUE(rootPrivKey);
+    optional<vector<uint8_t>> rootPubKey = support::ecKeyPairGetPublicKey(rootKeyPair.value());
+    ASSERT_TRUE(rootPubKey);
+
+    time_t now = time(nullptr);
+    optional<vector<uint8_t>> leafCert = support::ecPublicKeyGenerateCertificate(
+            leafPubKey.value(), rootPrivKey.value(), "0001", "root", "leaf", now - 3600,
+            now + 3600);
+    ASSERT_TRUE(leafCert);
+    optional<vector<uint8_t>> rootCert = support::ecPublicKeyGenerateCertificate(
+            rootPubKey.value(), rootPrivKey.value(), "0002", "root", "root", now - 3600,
+            now + 3600);
+    ASSERT_TRUE(rootCert);
+    optional<vector<uint8_t>> expiredLeafCert = support::ecPublicKeyGenerateCertificate(
+            leafPubKey.value(), rootPrivKey.value(), "0003", "root", "leaf", now - 7200,
+            now - 3600);
+    ASSERT_TRUE(expiredLeafCert);
+
+    // Validation results are cached, so check that asking more than once gives the same answer.
+    vector<uint8_t> chain = support::certificateChainJoin({leafCert.value(), rootCert.value()});
+    vector<uint8_t> reversedChain =
+            support::certificateChainJoin({rootCert.value(), leafCert.value()});
+    vector<uint8_t> expiredChain =
+            support::certificateChainJoin({expiredLeafCert.value(), rootCert.value()});
+    for (int n = 0; n < 3; n++) {
+        EXPECT_TRUE(support::certificateChainValidate(chain));
+        optional<vector<uint8_t>> topMostKey = support::certificateChainGetTopMostKey(chain);
+        ASSERT_TRUE(topMostKey);
+        EXPECT_EQ(leafPubKey.value(), topMostKey.value());
+
+        EXPECT_FALSE(support::certificateChainValidate(reversedChain));
+        topMostKey = support::certificateChainGetTopMostKey(reversedChain);
+        ASSERT_TRUE(topMostKey);
+        EXPECT_EQ(rootPubKey.value(), topMostKey.value());
+
+        // Expired chains aren't cached but are otherwise treated the same.
+        EXPECT_TRUE(support::certificateChainValidate(expiredChain));
+        topMostKey = support::certificateChainGetTopMostKey(expiredChain);
+        ASSERT_TRUE(topMostKey);
+        EXPECT_EQ(leafPubKey.value(), topMostKey.value());
+    }
+
+    EXPECT_FALSE(support::certificateChainValidate({0x30, 0x01}));
+    EXPECT_FALSE(support::certificateChainGetTopMostKey({0x30, 0x01}));
+}
+
 vector<uint8_t> strToVec(const string& str) {
     vector<uint8_t> ret;
     size_t size = str.size();
@@ -392,6 +446,35 @@ TEST(IdentityCredentialSupport, hmacSha256) {
     ASSERT_EQ(expected, hmac.value());
 }
 
+TEST(IdentityCredentialSupport, Aes128GcmCipher) {
+    vector<uint8_t> key(support::kAes128GcmKeySize, 0x42);
+    vector<uint8_t> nonce(support::kAesGcmIvSize, 0x01);
+    vector<uint8_t> additionalData = strToVec("additional data");
+    optional<support::Aes128GcmCipher> cipher = support::Aes128GcmCipher::create(key);
+    ASSERT_TRUE(cipher);
+
+    // The same cipher is used for several messages in both directions, and agrees with the
+    // one-shot functions.
+    for (size_t size : {0, 1, 100, 4096}) {
+        vector<uint8_t> data(size, 0x5a);
+        vector<uint8_t> encrypted(size + support::kAesGcmIvSize + support::kAesGcmTagSize);
+        ASSERT_TRUE(cipher->encrypt(nonce.data(), data.data(), data.size(), additionalData,
+                                    encrypted.data()));
+        EXPECT_EQ(support::encryptAes128Gcm(key, nonce, data, additionalData).value(), encrypted);
+
+        vector<uint8_t> decrypted(size);
+        ASSERT_TRUE(cipher->decrypt(encrypted.data(), encrypted.size(), additionalData,
+                                    decrypted.data()));
+        EXPECT_EQ(data, decrypted);
+
+        encrypted.back() ^= 1;
+        EXPECT_FALSE(cipher->decrypt(encrypted.data(), encrypted.size(), additionalData,
+                                     decrypted.data()));
+    }
+
+    EXPECT_FALSE(support::Aes128GcmCipher::create(vector<uint8_t>(8)));
+}
+
 // See also CoseMac0 test in UtilUnitTest.java inside cts/tests/tests/identity/
 TEST(IdentityCredentialSupport, CoseMac0) {
     vector<uint8_t> key;
@@ -728,6 +811,17 @@ TEST(IdentityCredentialSupport, testVectors_18013_5) {
     ASSERT_EQ(calculatedMac.value().size(), deviceMacEncoded.size());
     EXPECT_TRUE(memcmp(calculatedMac.value().data(), deviceMacEncoded.data(),
                        deviceMacEncoded.size()) == 0);
+
+    // Same when DeviceNameSpaces is passed in pieces.
+    optional<support::DeviceAuthenticationMac> mac = support::DeviceAuthenticationMac::create(
+            sessionTranscriptEncoded, docType, deviceNameSpacesEncoded.size(), eMacKey.value());
+    ASSERT_TRUE(mac);
+    for (size_t pos = 0; pos < deviceNameSpacesEncoded.size(); pos += 5) {
+        ASSERT_TRUE(mac->update(deviceNameSpacesEncoded.data() + pos,
+                                std::min<size_t>(5, deviceNameSpacesEncoded.size() - pos)));
+    }
+    EXPECT_FALSE(mac->update(deviceNameSpacesEncoded.data(), 1));
+    EXPECT_EQ(deviceMacEncoded, mac->finish());
 }
 
 }  // namespace identity
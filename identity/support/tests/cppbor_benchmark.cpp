@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "cppbor.h"
+#include "cppbor_parse.h"
+
+namespace cppbor {
+
+namespace {
+
+// An IssuerSignedItem, wrapped in a tag 24 bstr as it appears in IssuerNameSpaces.  Takes ownership
+// of elementValue.
+Semantic createIssuerSignedItem(uint64_t digestId, const std::string& elementIdentifier,
+                                Item* elementValue) {
+    Map item("digestID", digestId,                      //
+             "random", std::vector<uint8_t>(16, 0x5a),  //
+             "elementIdentifier", elementIdentifier,    //
+             "elementValue", elementValue);
+    return Semantic(24, item.encode());
+}
+
+// A DeviceResponse for an mDL presentation, as defined in ISO/IEC 18013-5, with a handful of data
+// elements including a portrait, an MSO and a certificate chain of typical sizes.
+Map createDeviceResponse() {
+    Array nameSpace;
+    nameSpace.add(createIssuerSignedItem(0, "family_name", new Tstr("Mustermann")));
+    nameSpace.add(createIssuerSignedItem(1, "given_name", new Tstr("Erika")));
+    nameSpace.add(createIssuerSignedItem(2, "birth_date", new Semantic(1004, "1971-09-01")));
+    nameSpace.add(createIssuerSignedItem(3, "issue_date", new Semantic(1004, "2020-01-01")));
+    nameSpace.add(createIssuerSignedItem(4, "expiry_date", new Semantic(1004, "2030-01-01")));
+    nameSpace.add(createIssuerSignedItem(5, "issuing_country", new Tstr("US")));
+    nameSpace.add(createIssuerSignedItem(6, "document_number", new Tstr("987654321")));
+    nameSpace.add(createIssuerSignedItem(7, "portrait", new Bstr(std::vector<uint8_t>(12000, 1))));
+    nameSpace.add(createIssuerSignedItem(
+            8, "driving_privileges",
+            new Array(Map("vehicle_category_code", "A", "issue_date", "2018-08-09"),
+                      Map("vehicle_category_code", "B", "issue_date", "2017-02-23"))));
+    nameSpace.add(createIssuerSignedItem(9, "age_over_21", new Bool(true)));
+
+    Array issuerAuth(std::vector<uint8_t>{0xa1, 0x01, 0x26},  //
+                     Map(33, std::vector<uint8_t>(900, 2)),   //
+                     std::vector<uint8_t>(1500, 3),           //
+                     std::vector<uint8_t>(64, 4));
+
+    Map issuerSigned("nameSpaces", Map("org.iso.18013.5.1", std::move(nameSpace)),  //
+                     "issuerAuth", std::move(issuerAuth));
+    Map deviceSigned("nameSpaces", Semantic(24, Map().encode()),  //
+                     "deviceAuth",
+                     Map("deviceMac", Array(std::vector<uint8_t>{0xa1, 0x01, 0x05}, Map(), Null(),
+                                            std::vector<uint8_t>(32, 5))));
+    Map document("docType", "org.iso.18013.5.1.mDL",        //
+                 "issuerSigned", std::move(issuerSigned),  //
+                 "deviceSigned", std::move(deviceSigned));
+    return Map("version", "1.0",                        //
+               "documents", Array(std::move(document)),  //
+               "status", 0);
+}
+
+void BM_EncodedSize(benchmark::State& state) {
+    const Map response = createDeviceResponse();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(response.encodedSize());
+    }
+}
+
+void BM_EncodeToVector(benchmark::State& state) {
+    const Map response = createDeviceResponse();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(response.encode());
+    }
+    state.SetBytesProcessed(state.iterations() * response.encodedSize());
+}
+
+void BM_EncodeWithCallback(benchmark::State& state) {
+    const Map response = createDeviceResponse();
+    for (auto _ : state) {
+        std::vector<uint8_t> encoded;
+        encoded.reserve(response.encodedSize());
+        response.encode(std::back_inserter(encoded));
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    state.SetBytesProcessed(state.iterations() * response.encodedSize());
+}
+
+void BM_Parse(benchmark::State& state) {
+    const std::vector<uint8_t> encoded = createDeviceResponse().encode();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parse(encoded));
+    }
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+
+void BM_ParseView(benchmark::State& state) {
+    const std::vector<uint8_t> encoded = createDeviceResponse().encode();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseView(encoded));
+    }
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+
+BENCHMARK(BM_EncodedSize);
+BENCHMARK(BM_EncodeToVector);
+BENCHMARK(BM_EncodeWithCallback);
+BENCHMARK(BM_Parse);
+BENCHMARK(BM_ParseView);
+
+}  // namespace
+
+}  // namespace cppbor
+
+BENCHMARK_MAIN();
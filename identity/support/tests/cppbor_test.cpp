@@ -1007,6 +1007,94 @@ TEST(FullParserTest, MapWithTruncatedEntry) {
     EXPECT_EQ(encoding.data() + 3, pos);
     EXPECT_EQ("Need 4 byte(s) for length field, have 3.", message);
 }
+TEST(ViewParserTest, Scalars) {
+    auto encoded = Array(10, -10, "Hello", Bstr("\x00\x01"s), true, Null()).encode();
+    auto [view, pos, message] = parseView(encoded);
+    ASSERT_TRUE(view.isValid());
+    EXPECT_EQ(pos, encoded.data() + encoded.size());
+    EXPECT_EQ("", message);
+
+    ASSERT_EQ(ARRAY, view.type());
+    ASSERT_EQ(6U, view.size());
+    EXPECT_EQ(10U, view[0].uintValue());
+    EXPECT_EQ(-10, view[1].intValue());
+    EXPECT_EQ("Hello", view[2].tstr());
+    ByteView bstr = view[3].bstr();
+    EXPECT_EQ(vector<uint8_t>({0x00, 0x01}), vector<uint8_t>(bstr.begin(), bstr.end()));
+    EXPECT_TRUE(view[4].boolValue());
+    EXPECT_TRUE(view[5].isNull());
+
+    // Strings refer to the encoded buffer.
+    EXPECT_GE(bstr.data, encoded.data());
+    EXPECT_LT(bstr.data, encoded.data() + encoded.size());
+}
+
+TEST(ViewParserTest, Complex) {
+    vector<uint8_t> vec = {0x01, 0x02, 0x08, 0x03};
+    Map val("Outer1",
+            Array(Map("Inner1", 99,  //
+                      "Inner2", vec),
+                  "foo"),
+            "Outer2", 10, -3, Semantic(1, 1000));
+
+    auto encoded = val.encode();
+    auto [view, pos, message] = parseView(encoded);
+    ASSERT_TRUE(view.isValid());
+    EXPECT_EQ(3U, view.size());
+
+    size_t entries = 0;
+    for (const ItemView& entry : view) {
+        EXPECT_TRUE(entry.isValid());
+        ++entries;
+    }
+    EXPECT_EQ(6U, entries);
+
+    ItemView outer1 = view.get("Outer1");
+    ASSERT_EQ(ARRAY, outer1.type());
+    EXPECT_EQ(99, outer1[0].get("Inner1").intValue());
+    ByteView inner2 = outer1[0].get("Inner2").bstr();
+    EXPECT_EQ(vec, vector<uint8_t>(inner2.begin(), inner2.end()));
+    EXPECT_EQ("foo", outer1[1].tstr());
+    EXPECT_EQ(10, view.get("Outer2").intValue());
+    EXPECT_EQ(1U, view.get(-3).semanticTag());
+    EXPECT_EQ(1000U, view.get(-3)[0].uintValue());
+    EXPECT_FALSE(view.get("Outer3").isValid());
+
+    ByteView outer1Encoding = outer1.encoded();
+    EXPECT_EQ(Array(Map("Inner1", 99, "Inner2", vec), "foo").encode(),
+              vector<uint8_t>(outer1Encoding.begin(), outer1Encoding.end()));
+    EXPECT_THAT(view.toItem(), MatchesItem(ByRef(val)));
+}
+
+TEST(ViewParserTest, ArrayWithInsufficientEntries) {
+    Array val(1, 2, 3, 4);
+
+    auto encoding = val.encode();
+    auto [view, pos, message] = parseView(encoding.data(), encoding.size() - 1);
+    EXPECT_FALSE(view.isValid());
+    EXPECT_EQ(encoding.data(), pos);
+    EXPECT_EQ("Not enough entries for array.", message);
+}
+
+TEST(ViewParserTest, ArrayWithTruncatedEntry) {
+    Array val(1, 2, 3, 400000);
+
+    auto encoding = val.encode();
+    auto [view, pos, message] = parseView(encoding.data(), encoding.size() - 1);
+    EXPECT_FALSE(view.isValid());
+    EXPECT_EQ(encoding.data() + encoding.size() - 5, pos);
+    EXPECT_EQ("Need 4 byte(s) for length field, have 3.", message);
+}
+
+TEST(ViewParserTest, NintOutOfRange) {
+    vector<uint8_t> outOfRangeNint = {0x3B, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    auto [view, pos, message] = parseView(outOfRangeNint);
+    EXPECT_FALSE(view.isValid());
+    EXPECT_EQ(pos, outOfRangeNint.data());
+    EXPECT_EQ(message, "NINT values that don't fit in int64_t are not supported.");
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
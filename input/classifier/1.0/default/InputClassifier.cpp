@@ -17,8 +17,10 @@
 #define LOG_TAG "InputClassifierHAL"
 
 #include "InputClassifier.h"
+#include <android-base/properties.h>
 #include <inttypes.h>
 #include <log/log.h>
+#include <cmath>
 #include <utils/Timers.h>
 
 using namespace android::hardware::input::common::V1_0;
@@ -30,25 +32,158 @@ namespace classifier {
 namespace V1_0 {
 namespace implementation {
 
+// Movement beyond this distance from the down position, in dp, makes a gesture a scroll.
+static constexpr float kTouchSlopDp = 8.0f;
+// Faster movement makes a gesture a swipe or fling, in dp per second.
+static constexpr float kMaxPressSpeedDp = 100.0f;
+// The density that a dp is a pixel at, and the one assumed if the display does not report any.
+static constexpr int32_t kBaseDensity = 160;
+// Pressure is only judged once the initial contact has settled.
+static constexpr int64_t kMinPressDuration = ms2ns(50);
+// Pressure or contact area growth over the down value for an ambiguous and a deep press.
+static constexpr float kAmbiguousPressRatio = 1.2f;
+static constexpr float kDeepPressRatio = 1.5f;
+
+static float getAxisValue(const PointerCoords& coords, Axis axis) {
+    const uint64_t bit = 1ULL << static_cast<uint64_t>(axis);
+    if (!(coords.bits & bit)) {
+        return 0;
+    }
+    const size_t index = __builtin_popcountll(coords.bits & (bit - 1));
+    return index < coords.values.size() ? coords.values[index] : 0;
+}
+
+void InputClassifier::DeviceState::add(const Sample& sample) {
+    historyHead = (historyHead + 1) % kHistorySize;
+    history[historyHead] = sample;
+    if (historyCount < kHistorySize) {
+        historyCount++;
+    }
+}
+
+const InputClassifier::Sample& InputClassifier::DeviceState::oldest() const {
+    return history[(historyHead + kHistorySize + 1 - historyCount) % kHistorySize];
+}
+
+static float getDensityScale() {
+    const int32_t density = android::base::GetIntProperty("ro.sf.lcd_density", kBaseDensity, 1);
+    return static_cast<float>(density) / kBaseDensity;
+}
+
+InputClassifier::InputClassifier()
+    : mTouchSlop(kTouchSlopDp * getDensityScale()),
+      mMaxPressSpeed(kMaxPressSpeedDp * getDensityScale()) {}
+
 // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
-Return<Classification> InputClassifier::classify(const MotionEvent& /*event*/) {
+Return<Classification> InputClassifier::classify(const MotionEvent& event) {
     /**
-     * The touchscreen data is highly device-dependent.
-     * As a result, the implementation of this method will likely be hardware-specific.
-     * Here we just report gesture as not having any classification, which means that the
-     * default action will be taken in the framework.
-     * This is equivalent to not having the InputClassifier HAL at all.
+     * The touchscreen data is highly device-dependent, so real implementations will likely be
+     * hardware-specific. This one only tells a finger resting on the screen with growing
+     * pressure (or contact area, without a pressure sensor) apart from taps and scrolls, which
+     * makes the framework shorten or lengthen the long press timeout.
      */
-    return Classification::NONE;
+    const uint32_t touchscreen = static_cast<uint32_t>(Source::TOUCHSCREEN);
+    if ((static_cast<uint32_t>(event.source) & touchscreen) != touchscreen ||
+        event.pointerCoords.size() == 0 || event.pointerProperties.size() == 0) {
+        return Classification::NONE;
+    }
+
+    std::scoped_lock lock(mLock);
+    DeviceState& state = mDevices[event.deviceId];
+    if (state.generation != mGeneration) {
+        state = DeviceState();
+        state.generation = mGeneration;
+    }
+    return classifyLocked(state, event);
+}
+
+Classification InputClassifier::classifyLocked(DeviceState& state, const MotionEvent& event) {
+    const PointerCoords& coords = event.pointerCoords[0];
+    const Sample sample = {
+            .eventTime = event.eventTime,
+            .x = getAxisValue(coords, Axis::X),
+            .y = getAxisValue(coords, Axis::Y),
+            .pressure = getAxisValue(coords, Axis::PRESSURE),
+            .touchMajor = getAxisValue(coords, Axis::TOUCH_MAJOR),
+    };
+
+    switch (event.action) {
+        case Action::DOWN:
+            state.active = true;
+            state.down = sample;
+            state.historyCount = 0;
+            state.classification = Classification::NONE;
+            state.settled = event.pointerProperties[0].toolType != ToolType::FINGER;
+            break;
+        case Action::UP:
+        case Action::CANCEL:
+            state.active = false;
+            return Classification::NONE;
+        case Action::MOVE:
+        case Action::POINTER_DOWN:
+        case Action::POINTER_UP:
+            if (!state.active) {
+                return Classification::NONE;
+            }
+            break;
+        default:
+            return Classification::NONE;
+    }
+
+    state.add(sample);
+    if (state.settled || state.classification == Classification::DEEP_PRESS) {
+        return state.classification;
+    }
+
+    const float dx = sample.x - state.down.x;
+    const float dy = sample.y - state.down.y;
+    const Sample& oldest = state.oldest();
+    const int64_t window = sample.eventTime - oldest.eventTime;
+    float speed = 0;
+    if (window > 0) {
+        const float wx = sample.x - oldest.x;
+        const float wy = sample.y - oldest.y;
+        speed = std::sqrt(wx * wx + wy * wy) * 1E9 / window;
+    }
+    if (event.pointerCoords.size() > 1 || dx * dx + dy * dy > mTouchSlop * mTouchSlop ||
+        speed > mMaxPressSpeed) {
+        state.settled = true;
+        state.classification = Classification::NONE;
+        return state.classification;
+    }
+
+    if (sample.eventTime - state.down.eventTime < kMinPressDuration) {
+        return state.classification;
+    }
+
+    // Compare whichever of pressure and contact area the device reports, as long as it has
+    // been growing over the samples kept.
+    float ratio = 0;
+    if (state.down.pressure > 0 && sample.pressure >= oldest.pressure) {
+        ratio = sample.pressure / state.down.pressure;
+    } else if (state.down.touchMajor > 0 && sample.touchMajor >= oldest.touchMajor) {
+        ratio = sample.touchMajor / state.down.touchMajor;
+    }
+    if (ratio >= kDeepPressRatio) {
+        state.classification = Classification::DEEP_PRESS;
+    } else if (ratio >= kAmbiguousPressRatio) {
+        state.classification = Classification::AMBIGUOUS_GESTURE;
+    } else {
+        state.classification = Classification::NONE;
+    }
+    return state.classification;
 }
 
 Return<void> InputClassifier::reset() {
-    // We don't have any internal state, so no work needed here.
+    std::scoped_lock lock(mLock);
+    // The state of each device is dropped the next time it is used.
+    mGeneration++;
     return Void();
 }
 
-Return<void> InputClassifier::resetDevice(int32_t /*deviceId*/) {
-    // We don't have any internal per-device state, so no work needed here.
+Return<void> InputClassifier::resetDevice(int32_t deviceId) {
+    std::scoped_lock lock(mLock);
+    mDevices.erase(deviceId);
     return Void();
 }
 
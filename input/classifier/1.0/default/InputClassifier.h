@@ -20,6 +20,10 @@
 #include <android/hardware/input/classifier/1.0/IInputClassifier.h>
 #include <hidl/Status.h>
 
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
 namespace android {
 namespace hardware {
 namespace input {
@@ -30,6 +34,8 @@ namespace implementation {
 using ::android::hardware::Return;
 
 struct InputClassifier : public IInputClassifier {
+    InputClassifier();
+
     // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
 
     Return<android::hardware::input::common::V1_0::Classification> classify(
@@ -37,6 +43,49 @@ struct InputClassifier : public IInputClassifier {
 
     Return<void> reset() override;
     Return<void> resetDevice(int32_t deviceId) override;
+
+  private:
+    // A sample of the single pointer of a touch gesture.
+    struct Sample {
+        int64_t eventTime;
+        float x;
+        float y;
+        float pressure;
+        float touchMajor;
+    };
+
+    // The gesture in progress on one device. Only the last kHistorySize samples are kept, so
+    // classifying an event costs the same however long the gesture lasts.
+    struct DeviceState {
+        static constexpr size_t kHistorySize = 16;
+
+        // States from before the last reset() have an older generation, and are ignored.
+        uint64_t generation = 0;
+        bool active = false;
+        Sample down;
+        std::array<Sample, kHistorySize> history;
+        size_t historyCount = 0;
+        size_t historyHead = 0;
+        android::hardware::input::common::V1_0::Classification classification =
+                android::hardware::input::common::V1_0::Classification::NONE;
+        // Once a gesture moves or gains a pointer it is never a press again.
+        bool settled = false;
+
+        void add(const Sample& sample);
+        const Sample& oldest() const;
+    };
+
+    android::hardware::input::common::V1_0::Classification classifyLocked(
+            DeviceState& state,
+            const android::hardware::input::common::V1_0::MotionEvent& event);
+
+    // The thresholds in pixels, scaled from density-independent pixels for this display.
+    const float mTouchSlop;
+    const float mMaxPressSpeed;
+
+    std::mutex mLock;
+    uint64_t mGeneration = 1;
+    std::unordered_map<int32_t, DeviceState> mDevices;
 };
 
 }  // namespace implementation
@@ -18,8 +18,19 @@
 
 #include <log/log.h>
 
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <android-base/parseint.h>
 #include <hardware/hardware.h>
 #include <hardware/consumerir.h>
+#include <hwbinder/IPCThreadState.h>
+#include <private/android_filesystem_config.h>
 
 #include "ConsumerIr.h"
 
@@ -35,33 +46,230 @@ ConsumerIr::ConsumerIr(consumerir_device_t *device) {
 
 // Methods from ::android::hardware::consumerir::V1_0::IConsumerIr follow.
 Return<bool> ConsumerIr::transmit(int32_t carrierFreq, const hidl_vec<int32_t>& pattern) {
-    return mDevice->transmit(mDevice, carrierFreq, pattern.data(), pattern.size()) == 0;
+    std::shared_ptr<const CompiledPattern> compiled =
+            compile(carrierFreq, pattern.data(), pattern.size());
+    if (compiled == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mTransmitLock);
+    return transmitLocked(*compiled);
 }
 
 Return<void> ConsumerIr::getCarrierFreqs(getCarrierFreqs_cb _hidl_cb) {
-    int32_t len = mDevice->get_num_carrier_freqs(mDevice);
-    if (len < 0) {
+    std::lock_guard<std::mutex> lock(mCarrierFreqsLock);
+    if (!loadCarrierFreqsLocked()) {
         _hidl_cb(false, {});
         return Void();
     }
+    _hidl_cb(true, mCarrierFreqs);
+    return Void();
+}
 
-    consumerir_freq_range_t *rangeAr = new consumerir_freq_range_t[len];
-    bool success = (mDevice->get_carrier_freqs(mDevice, len, rangeAr) >= 0);
-    if (!success) {
-        _hidl_cb(false, {});
+Return<void> ConsumerIr::debug(const hidl_handle& handle, const hidl_vec<hidl_string>& options) {
+    if (handle.getNativeHandle() == nullptr || handle->numFds == 0) {
+        ALOGE("Invalid parameters passed to debug()");
         return Void();
     }
+    int fd = handle->data[0];
 
-    hidl_vec<ConsumerIrFreqRange> rangeVec;
-    rangeVec.resize(len);
-    for (int32_t i = 0; i < len; i++) {
-        rangeVec[i].min = static_cast<uint32_t>(rangeAr[i].min);
-        rangeVec[i].max = static_cast<uint32_t>(rangeAr[i].max);
+    if (options.size() == 0) {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        dprintf(fd, "Cached patterns: %zu (max %zu), %" PRIu64 " hits, %" PRIu64 " misses\n",
+                mPatternCache.size(), kMaxCachedPatterns, mCacheHits, mCacheMisses);
+        return Void();
+    }
+    if (options[0] != "--transmit" || options.size() < 5) {
+        dprintf(fd, "Usage:\n\n");
+        dprintf(fd, "[no args]: dumps the pattern cache statistics\n");
+        dprintf(fd, "--transmit <CARRIER_HZ> <GAP_US> <COUNT> <DURATION_US>...: transmits the "
+                    "pattern COUNT times, GAP_US apart, COUNT being at most %d\n",
+                kMaxDebugTransmitCount);
+        return Void();
     }
-    _hidl_cb(true, rangeVec);
+    // Transmitting is a side effect, only allow it from root.
+    if (hardware::IPCThreadState::self()->getCallingUid() != AID_ROOT) {
+        dprintf(fd, "Must be root\n");
+        return Void();
+    }
+
+    int32_t carrierFreq;
+    int32_t gapUs;
+    int32_t count;
+    if (!base::ParseInt(std::string(options[1]), &carrierFreq, 1) ||
+        !base::ParseInt(std::string(options[2]), &gapUs, 0) ||
+        !base::ParseInt(std::string(options[3]), &count, 1, kMaxDebugTransmitCount)) {
+        dprintf(fd, "Invalid carrier, gap or count (at most %d)\n", kMaxDebugTransmitCount);
+        return Void();
+    }
+    std::vector<int32_t> pattern;
+    for (size_t i = 4; i < options.size(); i++) {
+        int32_t duration;
+        if (!base::ParseInt(std::string(options[i]), &duration, 0)) {
+            dprintf(fd, "Invalid duration: %s\n", options[i].c_str());
+            return Void();
+        }
+        pattern.push_back(duration);
+    }
+    std::shared_ptr<const CompiledPattern> compiled =
+            compile(carrierFreq, pattern.data(), pattern.size());
+    if (compiled == nullptr) {
+        dprintf(fd, "Invalid pattern\n");
+        return Void();
+    }
+    dprintf(fd, "Transmitted %d of %d patterns\n", transmitRepeated(*compiled, gapUs, count),
+            count);
     return Void();
 }
 
+int32_t ConsumerIr::transmitRepeated(const CompiledPattern& compiled, int32_t gapUs,
+                                     int32_t count) {
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < count; i++) {
+        if (i > 0) {
+            start += compiled.duration + std::chrono::microseconds(gapUs);
+            auto now = std::chrono::steady_clock::now();
+            if (now < start) {
+                std::this_thread::sleep_until(start);
+            } else {
+                start = now;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mTransmitLock);
+        if (!transmitLocked(compiled)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+size_t ConsumerIr::transmitBatch(const std::vector<Transmission>& transmissions) {
+    // Compile everything first, so that nothing but the module runs between two patterns.
+    std::vector<std::shared_ptr<const CompiledPattern>> compiled;
+    compiled.reserve(transmissions.size());
+    for (const Transmission& transmission : transmissions) {
+        auto pattern = compile(transmission.carrierFreq, transmission.pattern.data(),
+                               transmission.pattern.size());
+        if (pattern == nullptr || transmission.gapUs < 0) {
+            return 0;
+        }
+        compiled.push_back(std::move(pattern));
+    }
+
+    std::lock_guard<std::mutex> lock(mTransmitLock);
+    // Start times are derived from the previous start rather than from when the module returns,
+    // so that the module's latency does not add up over the batch.
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < compiled.size(); i++) {
+        if (i > 0) {
+            start += compiled[i - 1]->duration +
+                     std::chrono::microseconds(transmissions[i - 1].gapUs);
+            auto now = std::chrono::steady_clock::now();
+            if (now < start) {
+                std::this_thread::sleep_until(start);
+            } else {
+                // The module overran the gap, start the next pattern from here.
+                start = now;
+            }
+        }
+        if (!transmitLocked(*compiled[i])) {
+            return i;
+        }
+    }
+    return compiled.size();
+}
+
+std::shared_ptr<const ConsumerIr::CompiledPattern> ConsumerIr::compile(int32_t carrierFreq,
+                                                                      const int32_t* pattern,
+                                                                      size_t size) {
+    size_t hash = std::hash<int32_t>()(carrierFreq);
+    for (size_t i = 0; i < size; i++) {
+        hash = hash * 31 + std::hash<int32_t>()(pattern[i]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mCacheLock);
+        auto it = mPatternCache.find(hash);
+        if (it != mPatternCache.end() && it->second->carrierFreq == carrierFreq &&
+            std::equal(pattern, pattern + size, it->second->pattern.begin(),
+                       it->second->pattern.end())) {
+            mCacheHits++;
+            return it->second;
+        }
+        mCacheMisses++;
+    }
+
+    if (carrierFreq <= 0 || !isSupportedCarrierFreq(carrierFreq)) {
+        ALOGE("Unsupported carrier frequency: %d", carrierFreq);
+        return nullptr;
+    }
+    auto compiled = std::make_shared<CompiledPattern>();
+    compiled->carrierFreq = carrierFreq;
+    compiled->pattern.assign(pattern, pattern + size);
+    int64_t durationUs = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (pattern[i] < 0) {
+            ALOGE("Negative duration in pattern at %zu: %d", i, pattern[i]);
+            return nullptr;
+        }
+        durationUs += pattern[i];
+    }
+    compiled->duration = std::chrono::microseconds(durationUs);
+
+    std::lock_guard<std::mutex> lock(mCacheLock);
+    if (mPatternCache.count(hash) == 0) {
+        mPatternCacheOrder.push_back(hash);
+    }
+    mPatternCache[hash] = compiled;
+    if (mPatternCacheOrder.size() > kMaxCachedPatterns) {
+        mPatternCache.erase(mPatternCacheOrder.front());
+        mPatternCacheOrder.pop_front();
+    }
+    return compiled;
+}
+
+bool ConsumerIr::isSupportedCarrierFreq(int32_t carrierFreq) {
+    std::lock_guard<std::mutex> lock(mCarrierFreqsLock);
+    // Leave it to the module if it can't tell which frequencies it supports.
+    if (!loadCarrierFreqsLocked() || mCarrierFreqs.size() == 0) {
+        return true;
+    }
+    for (const ConsumerIrFreqRange& range : mCarrierFreqs) {
+        if (static_cast<uint32_t>(carrierFreq) >= range.min &&
+            static_cast<uint32_t>(carrierFreq) <= range.max) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ConsumerIr::loadCarrierFreqsLocked() {
+    if (mCarrierFreqsLoaded) {
+        return true;
+    }
+    int32_t len = mDevice->get_num_carrier_freqs(mDevice);
+    if (len < 0) {
+        return false;
+    }
+
+    std::vector<consumerir_freq_range_t> rangeAr(len);
+    if (mDevice->get_carrier_freqs(mDevice, len, rangeAr.data()) < 0) {
+        return false;
+    }
+
+    mCarrierFreqs.resize(len);
+    for (int32_t i = 0; i < len; i++) {
+        mCarrierFreqs[i].min = static_cast<uint32_t>(rangeAr[i].min);
+        mCarrierFreqs[i].max = static_cast<uint32_t>(rangeAr[i].max);
+    }
+    mCarrierFreqsLoaded = true;
+    return true;
+}
+
+bool ConsumerIr::transmitLocked(const CompiledPattern& compiled) {
+    return mDevice->transmit(mDevice, compiled.carrierFreq, compiled.pattern.data(),
+                             compiled.pattern.size()) == 0;
+}
+
 
 IConsumerIr* HIDL_FETCH_IConsumerIr(const char * /*name*/) {
     consumerir_device_t *dev;
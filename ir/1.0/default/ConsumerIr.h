@@ -22,6 +22,14 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace ir {
@@ -31,6 +39,7 @@ namespace implementation {
 using ::android::hardware::ir::V1_0::ConsumerIrFreqRange;
 using ::android::hardware::ir::V1_0::IConsumerIr;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
@@ -38,12 +47,64 @@ using ::android::hardware::Void;
 using ::android::sp;
 
 struct ConsumerIr : public IConsumerIr {
+    // A pattern of a batch, followed by gapUs of silence before the next one starts.
+    struct Transmission {
+        int32_t carrierFreq;
+        std::vector<int32_t> pattern;
+        int32_t gapUs;
+    };
+
     ConsumerIr(consumerir_device_t *device);
     // Methods from ::android::hardware::ir::V1_0::IConsumerIr follow.
     Return<bool> transmit(int32_t carrierFreq, const hidl_vec<int32_t>& pattern) override;
     Return<void> getCarrierFreqs(getCarrierFreqs_cb _hidl_cb) override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
+    // Transmits the patterns back to back. Every pattern starts its duration plus gap after the
+    // start of the one before it, whatever time the legacy module takes to return. All patterns
+    // are validated before the first is sent. Returns the number of patterns transmitted.
+    size_t transmitBatch(const std::vector<Transmission>& transmissions);
+
 private:
+    // A validated pattern and its total duration. Patterns are cached by their hash, so that
+    // repeating one, e.g. while a button is held, is a lookup.
+    struct CompiledPattern {
+        int32_t carrierFreq;
+        std::vector<int32_t> pattern;
+        std::chrono::microseconds duration;
+    };
+
+    static constexpr size_t kMaxCachedPatterns = 32;
+    // Cap of the repeats of a debug --transmit.
+    static constexpr int32_t kMaxDebugTransmitCount = 100;
+
+    // Returns nullptr if the pattern is invalid.
+    std::shared_ptr<const CompiledPattern> compile(int32_t carrierFreq, const int32_t* pattern,
+                                                   size_t size);
+    bool isSupportedCarrierFreq(int32_t carrierFreq);
+    bool loadCarrierFreqsLocked();
+    bool transmitLocked(const CompiledPattern& compiled);
+    // Transmits the pattern count times, gapUs apart like transmitBatch, but only holds
+    // mTransmitLock while each repeat is sent so that apps can transmit in between. Returns the
+    // number of repeats transmitted.
+    int32_t transmitRepeated(const CompiledPattern& compiled, int32_t gapUs, int32_t count);
+
     consumerir_device_t *mDevice;
+
+    // Serializes access to mDevice, so that batches are not interleaved.
+    std::mutex mTransmitLock;
+
+    std::mutex mCacheLock;
+    std::unordered_map<size_t, std::shared_ptr<const CompiledPattern>> mPatternCache;
+    std::deque<size_t> mPatternCacheOrder;  // Oldest first, for eviction.
+    uint64_t mCacheHits = 0;
+    uint64_t mCacheMisses = 0;
+
+    std::mutex mCarrierFreqsLock;
+    bool mCarrierFreqsLoaded = false;
+    std::vector<ConsumerIrFreqRange> mCarrierFreqs;
 };
 
 extern "C" IConsumerIr* HIDL_FETCH_IConsumerIr(const char* name);
@@ -84,37 +84,98 @@ bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
 }
 
 void AuthorizationSet::Sort() {
+    if (sorted_) return;
     std::sort(data_.begin(), data_.end(), keyParamLess);
+    sorted_ = true;
 }
 
 void AuthorizationSet::Deduplicate() {
     if (data_.empty()) return;
 
     Sort();
-    std::vector<KeyParameter> result;
 
+    // Compacts the kept entries towards the front in place.  |out| never overtakes |prev|.
+    auto out = data_.begin();
     auto curr = data_.begin();
     auto prev = curr++;
     for (; curr != data_.end(); ++prev, ++curr) {
         if (prev->tag == Tag::INVALID) continue;
 
         if (!keyParamEqual(*prev, *curr)) {
-            result.push_back(std::move(*prev));
+            if (out != prev) *out = std::move(*prev);
+            ++out;
         }
     }
-    result.push_back(std::move(*prev));
+    if (out != prev) *out = std::move(*prev);
+    ++out;
 
-    std::swap(data_, result);
+    data_.erase(out, data_.end());
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
+    // Deduplicate() only keeps an INVALID entry if there's nothing else in the set, which the merge
+    // below doesn't replicate.  Since INVALID sorts first, checking the front is enough.
+    if (other.sorted_ && (other.empty() || other.data_.front().tag != Tag::INVALID)) {
+        Deduplicate();
+        if (empty() || data_.front().tag != Tag::INVALID) {
+            MergeSorted(other);
+            return;
+        }
+    }
+
     data_.insert(data_.end(), other.data_.begin(), other.data_.end());
+    sorted_ = false;
     Deduplicate();
 }
 
+void AuthorizationSet::MergeSorted(const AuthorizationSet& other) {
+    // Count the distinct entries of |other| which are missing here.
+    size_t missing = 0;
+    auto i = data_.begin();
+    for (auto j = other.data_.begin(); j != other.data_.end(); ++j) {
+        if (j != other.data_.begin() && keyParamEqual(*(j - 1), *j)) continue;
+        while (i != data_.end() && keyParamLess(*i, *j)) ++i;
+        if (i == data_.end() || !keyParamEqual(*i, *j)) ++missing;
+    }
+
+    // Merge from the back, so that entries already here only ever move towards the end.  Once
+    // all missing entries are in, the remaining ones are in place.
+    size_t n = data_.size();
+    size_t m = other.size();
+    size_t k = n + missing;
+    data_.resize(k);
+    while (k > n) {
+        const KeyParameter& param = other.data_[m - 1];
+        if (m < other.size() && keyParamEqual(param, other.data_[m])) {
+            --m;
+        } else if (n > 0 && keyParamLess(param, data_[n - 1])) {
+            data_[--k] = std::move(data_[--n]);
+        } else if (n > 0 && keyParamEqual(param, data_[n - 1])) {
+            --m;
+        } else {
+            data_[--k] = param;
+            --m;
+        }
+    }
+    sorted_ = true;
+}
+
 void AuthorizationSet::Subtract(const AuthorizationSet& other) {
     Deduplicate();
 
+    if (other.sorted_) {
+        auto j = other.data_.begin();
+        auto out = data_.begin();
+        for (auto i = data_.begin(); i != data_.end(); ++i) {
+            while (j != other.data_.end() && keyParamLess(*j, *i)) ++j;
+            if (j != other.data_.end() && keyParamEqual(*i, *j)) continue;
+            if (out != i) *out = std::move(*i);
+            ++out;
+        }
+        data_.erase(out, data_.end());
+        return;
+    }
+
     auto i = other.begin();
     while (i != other.end()) {
         int pos = -1;
@@ -140,6 +201,7 @@ void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
 }
 
 KeyParameter& AuthorizationSet::operator[](int at) {
+    sorted_ = false;
     return data_[at];
 }
 
@@ -149,6 +211,7 @@ const KeyParameter& AuthorizationSet::operator[](int at) const {
 
 void AuthorizationSet::Clear() {
     data_.clear();
+    sorted_ = false;
 }
 
 size_t AuthorizationSet::GetTagCount(Tag tag) const {
@@ -160,9 +223,15 @@ size_t AuthorizationSet::GetTagCount(Tag tag) const {
 int AuthorizationSet::find(Tag tag, int begin) const {
     auto iter = data_.begin() + (1 + begin);
 
-    while (iter != data_.end() && iter->tag != tag) ++iter;
+    // Entries with the same tag are adjacent in a sorted set, so the scan can stop at the first
+    // entry with a larger tag.
+    if (sorted_) {
+        while (iter != data_.end() && iter->tag < tag) ++iter;
+    } else {
+        while (iter != data_.end() && iter->tag != tag) ++iter;
+    }
 
-    if (iter != data_.end()) return iter - data_.begin();
+    if (iter != data_.end() && iter->tag == tag) return iter - data_.begin();
     return -1;
 }
 
@@ -450,6 +519,225 @@ void AuthorizationSet::Serialize(std::ostream* out) const {
 
 void AuthorizationSet::Deserialize(std::istream* in) {
     deserialize(*in, &data_);
+    sorted_ = false;
+}
+
+/**
+ * Serialization into and views of flat buffers, in the persistent format described above.
+ */
+
+template <typename T>
+struct is_known_tag;
+template <TagType... tag_types, Tag... tags>
+struct is_known_tag<MetaList<TypedTag<tag_types, tags>...>> {
+    static bool check(Tag tag) { return ((tag == tags) || ...); }
+};
+
+// The stream serializer skips INVALID parameters and tags missing from all_tags_t.
+static bool isSerializable(Tag tag) {
+    return tag != Tag::INVALID && is_known_tag<all_tags_t>::check(tag);
+}
+
+// Returns the size of the value following the tag of an element, which is the size of the
+// corresponding KeyParameter field, or the blob length and indirect_offset.
+static size_t serializedValueSize(Tag tag) {
+    switch (typeFromTag(tag)) {
+        case TagType::INVALID:
+            return 0;
+        case TagType::ENUM:
+        case TagType::ENUM_REP:
+        case TagType::UINT:
+        case TagType::UINT_REP:
+            return sizeof(uint32_t);
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+        case TagType::DATE:
+            return sizeof(uint64_t);
+        case TagType::BOOL:
+            return sizeof(bool);
+        case TagType::BIGNUM:
+        case TagType::BYTES:
+            return 2 * sizeof(uint32_t);
+    }
+    return 0;
+}
+
+static bool isBlobTag(Tag tag) {
+    return typeFromTag(tag) == TagType::BIGNUM || typeFromTag(tag) == TagType::BYTES;
+}
+
+static uint8_t* writeUint32(uint8_t* out, uint32_t value) {
+    memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+static uint32_t readUint32(const uint8_t* in) {
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+size_t AuthorizationSet::SerializedSize() const {
+    size_t size = 3 * sizeof(uint32_t);
+    for (const auto& param : data_) {
+        if (!isSerializable(param.tag)) continue;
+        size += sizeof(uint32_t) + serializedValueSize(param.tag);
+        if (isBlobTag(param.tag)) size += param.blob.size();
+    }
+    return size;
+}
+
+bool AuthorizationSet::Serialize(uint8_t* buffer, size_t size) const {
+    size_t indirect_size = 0;
+    size_t elements_size = 0;
+    uint32_t element_count = 0;
+    for (const auto& param : data_) {
+        if (!isSerializable(param.tag)) {
+            if (param.tag != Tag::INVALID) {
+                LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag)
+                             << ". Did you forget to add it to all_tags_t?";
+            }
+            continue;
+        }
+        elements_size += sizeof(uint32_t) + serializedValueSize(param.tag);
+        if (isBlobTag(param.tag)) indirect_size += param.blob.size();
+        ++element_count;
+    }
+    if (indirect_size > std::numeric_limits<uint32_t>::max() ||
+        elements_size > std::numeric_limits<uint32_t>::max() ||
+        size < 3 * sizeof(uint32_t) + indirect_size + elements_size) {
+        return false;
+    }
+
+    uint8_t* indirect = writeUint32(buffer, indirect_size);
+    uint8_t* elements = writeUint32(indirect + indirect_size, element_count);
+    elements = writeUint32(elements, elements_size);
+    uint32_t indirect_offset = 0;
+    for (const auto& param : data_) {
+        if (!isSerializable(param.tag)) continue;
+        elements = writeUint32(elements, static_cast<uint32_t>(param.tag));
+        switch (typeFromTag(param.tag)) {
+            case TagType::BIGNUM:
+            case TagType::BYTES:
+                elements = writeUint32(elements, param.blob.size());
+                elements = writeUint32(elements, indirect_offset);
+                if (param.blob.size() > 0) {
+                    memcpy(indirect + indirect_offset, &param.blob[0], param.blob.size());
+                }
+                indirect_offset += param.blob.size();
+                break;
+            default:
+                // The integer members of the union all start at its beginning.
+                memcpy(elements, &param.f, serializedValueSize(param.tag));
+                elements += serializedValueSize(param.tag);
+                break;
+        }
+    }
+    return true;
+}
+
+bool AuthorizationSet::Deserialize(const uint8_t* data, size_t size) {
+    data_.clear();
+    sorted_ = false;
+    AuthorizationSetView view(data, size);
+    if (!view.isOk()) return false;
+
+    data_.reserve(view.size());
+    for (const KeyParameterView& param : view) {
+        data_.push_back(param.ToKeyParameter());
+    }
+    return true;
+}
+
+KeyParameter KeyParameterView::ToKeyParameter() const {
+    KeyParameter param;
+    param.tag = tag;
+    param.f = f;
+    if (blob_size > 0) {
+        param.blob.resize(blob_size);
+        memcpy(&param.blob[0], blob, blob_size);
+    }
+    return param;
+}
+
+AuthorizationSetView::const_iterator::const_iterator(const uint8_t* pos, const uint8_t* end,
+                                                      const uint8_t* indirect)
+    : pos_(pos), end_(end), indirect_(indirect) {
+    // INVALID parameters consist of just the tag.
+    while (pos_ != end_ && static_cast<Tag>(readUint32(pos_)) == Tag::INVALID) {
+        pos_ += sizeof(uint32_t);
+    }
+}
+
+KeyParameterView AuthorizationSetView::const_iterator::operator*() const {
+    KeyParameterView param = {};
+    param.tag = static_cast<Tag>(readUint32(pos_));
+    const uint8_t* value = pos_ + sizeof(uint32_t);
+    switch (typeFromTag(param.tag)) {
+        case TagType::BIGNUM:
+        case TagType::BYTES:
+            param.blob_size = readUint32(value);
+            param.blob = indirect_ + readUint32(value + sizeof(uint32_t));
+            break;
+        default:
+            memcpy(&param.f, value, serializedValueSize(param.tag));
+            break;
+    }
+    return param;
+}
+
+AuthorizationSetView::const_iterator& AuthorizationSetView::const_iterator::operator++() {
+    Tag tag = static_cast<Tag>(readUint32(pos_));
+    *this = const_iterator(pos_ + sizeof(uint32_t) + serializedValueSize(tag), end_, indirect_);
+    return *this;
+}
+
+AuthorizationSetView::AuthorizationSetView(const uint8_t* data, size_t size) {
+    if (size < sizeof(uint32_t)) return;
+    size_t indirect_size = readUint32(data);
+    if (size - sizeof(uint32_t) < indirect_size + 2 * sizeof(uint32_t)) return;
+    const uint8_t* indirect = data + sizeof(uint32_t);
+    const uint8_t* header = indirect + indirect_size;
+    uint32_t element_count = readUint32(header);
+    size_t elements_size = readUint32(header + sizeof(uint32_t));
+    const uint8_t* elements = header + 2 * sizeof(uint32_t);
+    if (static_cast<size_t>(data + size - elements) < elements_size) return;
+
+    // Check that all |element_count| elements are within |elements_size| and refer to blobs
+    // within the indirect data, so that the iterator doesn't need to.
+    size_t pos = 0;
+    size_t invalids = 0;
+    for (uint32_t i = 0; i < element_count; ++i) {
+        if (elements_size - pos < sizeof(uint32_t)) return;
+        Tag tag = static_cast<Tag>(readUint32(elements + pos));
+        pos += sizeof(uint32_t);
+        if (tag == Tag::INVALID) {
+            ++invalids;
+            continue;
+        }
+        if (!is_known_tag<all_tags_t>::check(tag)) return;
+        size_t value_size = serializedValueSize(tag);
+        if (elements_size - pos < value_size) return;
+        if (isBlobTag(tag)) {
+            size_t blob_length = readUint32(elements + pos);
+            size_t offset = readUint32(elements + pos + sizeof(uint32_t));
+            if (offset > indirect_size || indirect_size - offset < blob_length) return;
+        }
+        pos += value_size;
+    }
+
+    indirect_ = indirect;
+    elements_ = elements;
+    elements_size_ = pos;
+    size_ = element_count - invalids;
+    ok_ = true;
+}
+
+NullOr<KeyParameterView> AuthorizationSetView::GetEntry(Tag tag) const {
+    for (KeyParameterView param : *this) {
+        if (param.tag == tag) return param;
+    }
+    return {};
 }
 
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
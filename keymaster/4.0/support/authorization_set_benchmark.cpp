@@ -0,0 +1,213 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sstream>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <keymasterV4_0/authorization_set.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+
+namespace {
+
+const hidl_vec<uint8_t> kApplicationId(std::vector<uint8_t>(15, 'a'));
+const hidl_vec<uint8_t> kNonce(std::vector<uint8_t>(12, 0x42));
+
+// The hardware enforced characteristics of an AES key, roughly as returned by
+// getKeyCharacteristics.
+AuthorizationSet hardwareEnforced() {
+    return AuthorizationSetBuilder()
+            .AesEncryptionKey(256)
+            .BlockMode(BlockMode::ECB, BlockMode::CBC, BlockMode::CTR, BlockMode::GCM)
+            .Padding(PaddingMode::NONE, PaddingMode::PKCS7)
+            .Authorization(TAG_MIN_MAC_LENGTH, 128)
+            .Authorization(TAG_CALLER_NONCE)
+            .Authorization(TAG_NO_AUTH_REQUIRED)
+            .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+            .Authorization(TAG_OS_VERSION, 110000)
+            .Authorization(TAG_OS_PATCHLEVEL, 202009)
+            .Authorization(TAG_VENDOR_PATCHLEVEL, 20200905)
+            .Authorization(TAG_BOOT_PATCHLEVEL, 20200905);
+}
+
+AuthorizationSet softwareEnforced() {
+    return AuthorizationSetBuilder()
+            .Authorization(TAG_CREATION_DATETIME, 1600000000000)
+            .Authorization(TAG_USER_ID, 0)
+            .Authorization(TAG_APPLICATION_ID, kApplicationId)
+            .Authorization(TAG_ACTIVE_DATETIME, 1600000000000)
+            .Authorization(TAG_USAGE_EXPIRE_DATETIME, 1900000000000);
+}
+
+// The in-params of begin for a GCM encryption.
+AuthorizationSet beginParams() {
+    return AuthorizationSetBuilder()
+            .Authorization(TAG_PURPOSE, KeyPurpose::ENCRYPT)
+            .BlockMode(BlockMode::GCM)
+            .Padding(PaddingMode::NONE)
+            .Authorization(TAG_MAC_LENGTH, 128)
+            .Authorization(TAG_NONCE, kNonce)
+            .Authorization(TAG_APPLICATION_ID, kApplicationId);
+}
+
+// The lookups done on the key characteristics and the operation parameters over the course of a
+// begin/update/finish sequence.
+void queryOperationParams(const AuthorizationSet& characteristics,
+                          const AuthorizationSet& params) {
+    benchmark::DoNotOptimize(characteristics.GetTagValue(TAG_ALGORITHM));
+    benchmark::DoNotOptimize(characteristics.Contains(TAG_PURPOSE, KeyPurpose::ENCRYPT));
+    benchmark::DoNotOptimize(characteristics.GetTagValue(TAG_ACTIVE_DATETIME));
+    benchmark::DoNotOptimize(characteristics.GetTagValue(TAG_USAGE_EXPIRE_DATETIME));
+    benchmark::DoNotOptimize(characteristics.Contains(TAG_NO_AUTH_REQUIRED));
+    benchmark::DoNotOptimize(characteristics.GetTagCount(TAG_USER_SECURE_ID));
+    benchmark::DoNotOptimize(characteristics.GetTagValue(TAG_AUTH_TIMEOUT));
+    benchmark::DoNotOptimize(characteristics.Contains(TAG_CALLER_NONCE));
+    benchmark::DoNotOptimize(characteristics.GetTagValue(TAG_MIN_MAC_LENGTH));
+    benchmark::DoNotOptimize(characteristics.GetTagCount(TAG_BLOCK_MODE));
+    benchmark::DoNotOptimize(params.GetTagValue(TAG_BLOCK_MODE));
+    benchmark::DoNotOptimize(params.GetTagValue(TAG_PADDING));
+    benchmark::DoNotOptimize(params.GetTagValue(TAG_MAC_LENGTH));
+    benchmark::DoNotOptimize(params.GetTagValue(TAG_NONCE));
+    benchmark::DoNotOptimize(params.GetTagCount(TAG_ASSOCIATED_DATA));
+}
+
+void BM_QueryUnsorted(benchmark::State& state) {
+    AuthorizationSet characteristics = hardwareEnforced();
+    characteristics.push_back(softwareEnforced());
+    AuthorizationSet params = beginParams();
+    for (auto _ : state) {
+        queryOperationParams(characteristics, params);
+    }
+}
+
+void BM_QuerySorted(benchmark::State& state) {
+    AuthorizationSet characteristics = hardwareEnforced();
+    characteristics.push_back(softwareEnforced());
+    characteristics.Sort();
+    AuthorizationSet params = beginParams();
+    params.Sort();
+    for (auto _ : state) {
+        queryOperationParams(characteristics, params);
+    }
+}
+
+void BM_Union(benchmark::State& state) {
+    const AuthorizationSet hw = hardwareEnforced();
+    AuthorizationSet sw = softwareEnforced();
+    if (state.range(0)) sw.Deduplicate();
+    for (auto _ : state) {
+        AuthorizationSet characteristics = hw;
+        characteristics.Union(sw);
+        benchmark::DoNotOptimize(characteristics.data());
+    }
+}
+
+void BM_Subtract(benchmark::State& state) {
+    AuthorizationSet characteristics = hardwareEnforced();
+    characteristics.push_back(softwareEnforced());
+    characteristics.Deduplicate();
+    AuthorizationSet params = beginParams();
+    if (state.range(0)) params.Deduplicate();
+    for (auto _ : state) {
+        AuthorizationSet remaining = params;
+        remaining.Subtract(characteristics);
+        benchmark::DoNotOptimize(remaining.data());
+    }
+}
+
+// Key characteristics as keystore persists them.
+AuthorizationSet keyCharacteristics() {
+    AuthorizationSet characteristics = hardwareEnforced();
+    characteristics.push_back(softwareEnforced());
+    return characteristics;
+}
+
+void BM_SerializeToStream(benchmark::State& state) {
+    const AuthorizationSet characteristics = keyCharacteristics();
+    for (auto _ : state) {
+        std::stringstream out;
+        characteristics.Serialize(&out);
+        benchmark::DoNotOptimize(out.str());
+    }
+}
+
+void BM_SerializeToBuffer(benchmark::State& state) {
+    const AuthorizationSet characteristics = keyCharacteristics();
+    for (auto _ : state) {
+        std::vector<uint8_t> out(characteristics.SerializedSize());
+        characteristics.Serialize(out.data(), out.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_DeserializeFromStream(benchmark::State& state) {
+    std::stringstream serialized;
+    keyCharacteristics().Serialize(&serialized);
+    const std::string data = serialized.str();
+    for (auto _ : state) {
+        std::stringstream in(data);
+        AuthorizationSet characteristics;
+        characteristics.Deserialize(&in);
+        benchmark::DoNotOptimize(characteristics.data());
+    }
+}
+
+void BM_DeserializeFromBuffer(benchmark::State& state) {
+    const AuthorizationSet original = keyCharacteristics();
+    std::vector<uint8_t> data(original.SerializedSize());
+    original.Serialize(data.data(), data.size());
+    for (auto _ : state) {
+        AuthorizationSet characteristics;
+        characteristics.Deserialize(data.data(), data.size());
+        benchmark::DoNotOptimize(characteristics.data());
+    }
+}
+
+// Reading the algorithm and the application id of a key as loaded from disk.
+void BM_ViewLookup(benchmark::State& state) {
+    const AuthorizationSet original = keyCharacteristics();
+    std::vector<uint8_t> data(original.SerializedSize());
+    original.Serialize(data.data(), data.size());
+    for (auto _ : state) {
+        AuthorizationSetView characteristics(data.data(), data.size());
+        benchmark::DoNotOptimize(characteristics.GetEntry(Tag::ALGORITHM));
+        benchmark::DoNotOptimize(characteristics.GetEntry(Tag::APPLICATION_ID));
+    }
+}
+
+BENCHMARK(BM_QueryUnsorted);
+BENCHMARK(BM_QuerySorted);
+BENCHMARK(BM_Union)->Arg(0)->Arg(1);
+BENCHMARK(BM_Subtract)->Arg(0)->Arg(1);
+BENCHMARK(BM_SerializeToStream);
+BENCHMARK(BM_SerializeToBuffer);
+BENCHMARK(BM_DeserializeFromStream);
+BENCHMARK(BM_DeserializeFromBuffer);
+BENCHMARK(BM_ViewLookup);
+
+}  // namespace
+
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
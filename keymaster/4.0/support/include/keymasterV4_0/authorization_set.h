@@ -18,6 +18,7 @@
 #define SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 
 #include <functional>
+#include <iterator>
 #include <vector>
 
 #include <keymasterV4_0/keymaster_tags.h>
@@ -33,6 +34,10 @@ class AuthorizationSetBuilder;
  * An ordered collection of KeyParameters. It provides memory ownership and some convenient
  * functionality for sorting, deduplicating, joining, and subtracting sets of KeyParameters.
  * For serialization, wrap the backing store of this structure in a hidl_vec<KeyParameter>.
+ *
+ * After Sort() or Deduplicate() the set remembers that it's sorted until it is modified in a way
+ * that may break the order.  Lookups by tag in a sorted set stop at the first entry with a larger
+ * tag, and Union() and Subtract() of two sorted sets merge them in place.
  */
 class AuthorizationSet {
    public:
@@ -44,10 +49,11 @@ class AuthorizationSet {
     AuthorizationSet(){};
 
     // Copy constructor.
-    AuthorizationSet(const AuthorizationSet& other) : data_(other.data_) {}
+    AuthorizationSet(const AuthorizationSet& other) : data_(other.data_), sorted_(other.sorted_) {}
 
     // Move constructor.
-    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {}
+    AuthorizationSet(AuthorizationSet&& other) noexcept
+        : data_(std::move(other.data_)), sorted_(other.sorted_) {}
 
     // Constructor from hidl_vec<KeyParameter>
     AuthorizationSet(const hidl_vec<KeyParameter>& other) { *this = other; }
@@ -55,16 +61,19 @@ class AuthorizationSet {
     // Copy assignment.
     AuthorizationSet& operator=(const AuthorizationSet& other) {
         data_ = other.data_;
+        sorted_ = other.sorted_;
         return *this;
     }
 
     // Move assignment.
     AuthorizationSet& operator=(AuthorizationSet&& other) noexcept {
         data_ = std::move(other.data_);
+        sorted_ = other.sorted_;
         return *this;
     }
 
     AuthorizationSet& operator=(const hidl_vec<KeyParameter>& other) {
+        sorted_ = false;
         if (other.size() > 0) {
             data_.resize(other.size());
             for (size_t i = 0; i < data_.size(); ++i) {
@@ -99,10 +108,16 @@ class AuthorizationSet {
     const KeyParameter* data() const { return data_.data(); }
 
     /**
-     * Sorts the set
+     * Sorts the set. Does nothing if the set is already known to be sorted.
      */
     void Sort();
 
+    /**
+     * Returns true if the set is known to be sorted, i.e. Sort() or Deduplicate() was called and
+     * the set was not modified in an order-breaking way since.
+     */
+    bool sorted() const { return sorted_; }
+
     /**
      * Sorts the set and removes duplicates (inadvertently duplicating tags is easy to do with the
      * AuthorizationSetBuilder).
@@ -111,12 +126,15 @@ class AuthorizationSet {
 
     /**
      * Adds all elements from \p set that are not already present in this AuthorizationSet.  As a
-     * side-effect, if \p set is not null this AuthorizationSet will end up sorted.
+     * side-effect, this AuthorizationSet will end up deduplicated and sorted.  If \p set is
+     * sorted too, the elements are merged in place without allocating beyond growing the set.
      */
     void Union(const AuthorizationSet& set);
 
     /**
-     * Removes all elements in \p set from this AuthorizationSet.
+     * Removes all elements in \p set from this AuthorizationSet.  As a side-effect, this
+     * AuthorizationSet will end up deduplicated and sorted.  If \p set is sorted too, this takes
+     * a single pass over both sets and doesn't allocate.
      */
     void Subtract(const AuthorizationSet& set);
 
@@ -148,7 +166,8 @@ class AuthorizationSet {
      */
     void Filter(std::function<bool(const KeyParameter&)> doKeep);
     /**
-     * Returns the nth element of the set.
+     * Returns the nth element of the set.  Since the element may be modified, the set is no longer
+     * considered sorted afterwards.
      * Like for std::vector::operator[] there is no range check performed. Use of out of range
      * indices is undefined.
      */
@@ -187,8 +206,14 @@ class AuthorizationSet {
         return {};
     }
 
-    void push_back(const KeyParameter& param) { data_.push_back(param); }
-    void push_back(KeyParameter&& param) { data_.push_back(std::move(param)); }
+    void push_back(const KeyParameter& param) {
+        data_.push_back(param);
+        sorted_ = false;
+    }
+    void push_back(KeyParameter&& param) {
+        data_.push_back(std::move(param));
+        sorted_ = false;
+    }
     void push_back(const AuthorizationSet& set) {
         for (auto& entry : set) {
             push_back(entry);
@@ -224,10 +249,32 @@ class AuthorizationSet {
     void Serialize(std::ostream* out) const;
     void Deserialize(std::istream* in);
 
+    /**
+     * Returns the number of bytes Serialize(uint8_t*, size_t) writes.
+     */
+    size_t SerializedSize() const;
+
+    /**
+     * Serializes the set into \p buffer, in the same format as Serialize(std::ostream*).  Returns
+     * false if \p size is less than SerializedSize() or the set is too large for the format.
+     */
+    bool Serialize(uint8_t* buffer, size_t size) const;
+
+    /**
+     * Replaces the contents of the set with the set serialized in \p data.  Returns false, leaving
+     * the set empty, if \p data is malformed.  See also AuthorizationSetView.
+     */
+    bool Deserialize(const uint8_t* data, size_t size);
+
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
+    // Merges |set|, which must be sorted, into this set, which must be sorted, deduplicated and
+    // free of INVALID entries.
+    void MergeSorted(const AuthorizationSet& set);
+
     std::vector<KeyParameter> data_;
+    bool sorted_ = false;
 };
 
 class AuthorizationSetBuilder : public AuthorizationSet {
@@ -307,6 +354,86 @@ class AuthorizationSetBuilder : public AuthorizationSet {
     }
 };
 
+/**
+ * A parameter read from a serialized AuthorizationSet.  Like KeyParameter, except that the blob of
+ * a BIGNUM or BYTES parameter points into the serialized data.
+ */
+struct KeyParameterView {
+    Tag tag;
+    KeyParameter::IntegerParams f;
+    const uint8_t* blob;
+    size_t blob_size;
+
+    KeyParameter ToKeyParameter() const;
+};
+
+/**
+ * Read-only access to an AuthorizationSet serialized by AuthorizationSet::Serialize(), without
+ * deserializing it.  The serialized data is validated once, when the view is created, and must
+ * outlive the view.  As with AuthorizationSet::Deserialize(), INVALID parameters are skipped.
+ */
+class AuthorizationSetView {
+   public:
+    class const_iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = KeyParameterView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const KeyParameterView*;
+        using reference = KeyParameterView;
+
+        KeyParameterView operator*() const;
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const { return pos_ == other.pos_; }
+        bool operator!=(const const_iterator& other) const { return pos_ != other.pos_; }
+
+       private:
+        friend class AuthorizationSetView;
+
+        const_iterator(const uint8_t* pos, const uint8_t* end, const uint8_t* indirect);
+
+        const uint8_t* pos_;
+        const uint8_t* end_;
+        const uint8_t* indirect_;
+    };
+
+    /**
+     * Creates a view of the \p size bytes at \p data.  If they don't hold a well-formed serialized
+     * AuthorizationSet, isOk() returns false and the view is empty.
+     */
+    AuthorizationSetView(const uint8_t* data, size_t size);
+
+    bool isOk() const { return ok_; }
+
+    /**
+     * Returns the number of parameters in the view, not counting INVALID ones.
+     */
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    const_iterator begin() const {
+        return const_iterator(elements_, elements_ + elements_size_, indirect_);
+    }
+    const_iterator end() const {
+        return const_iterator(elements_ + elements_size_, elements_ + elements_size_, indirect_);
+    }
+
+    /**
+     * Returns the first parameter with \p tag, if any.
+     */
+    NullOr<KeyParameterView> GetEntry(Tag tag) const;
+
+    bool Contains(Tag tag) const { return GetEntry(tag).isOk(); }
+
+   private:
+    const uint8_t* indirect_ = nullptr;
+    const uint8_t* elements_ = nullptr;
+    size_t elements_size_ = 0;
+    size_t size_ = 0;
+    bool ok_ = false;
+};
+
 }  // namespace V4_0
 }  // namespace keymaster
 }  // namespace hardware
@@ -0,0 +1,124 @@
+/*
+ ** Copyright 2020, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "CachingKeymasterDevice.h"
+
+#include <algorithm>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+namespace android::hardware::keymaster::V4_1::implementation {
+
+namespace {
+
+// Keystore works with a handful of keys at a time; this comfortably covers them while keeping the
+// linear lookup cheap.
+constexpr size_t kMaxCachedKeys = 32;
+
+bool sameBytes(const std::vector<uint8_t>& a, const hidl_vec<uint8_t>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+}  // namespace
+
+Return<void> CachingKeymasterDevice::getKeyCharacteristics(const hidl_vec<uint8_t>& keyBlob,
+                                                           const hidl_vec<uint8_t>& clientId,
+                                                           const hidl_vec<uint8_t>& appData,
+                                                           getKeyCharacteristics_cb _hidl_cb) {
+    {
+        std::unique_lock<std::mutex> lock(cacheMutex_);
+        auto entry = std::find_if(cache_.begin(), cache_.end(), [&](const CacheEntry& cached) {
+            return sameBytes(cached.keyBlob, keyBlob) && sameBytes(cached.clientId, clientId) &&
+                   sameBytes(cached.appData, appData);
+        });
+        if (entry != cache_.end()) {
+            cache_.splice(cache_.begin(), cache_, entry);
+            cacheHits_++;
+            // Don't hold the lock while the client runs.
+            KeyCharacteristics characteristics = entry->characteristics;
+            lock.unlock();
+            _hidl_cb(V4_0::ErrorCode::OK, characteristics);
+            return Void();
+        }
+        cacheMisses_++;
+    }
+
+    KeyCharacteristics characteristics;
+    V4_0::ErrorCode error = V4_0::ErrorCode::UNKNOWN_ERROR;
+    auto rc = device_->getKeyCharacteristics(
+            keyBlob, clientId, appData,
+            [&](V4_0::ErrorCode hidlError, const KeyCharacteristics& hidlCharacteristics) {
+                error = hidlError;
+                characteristics = hidlCharacteristics;
+            });
+    if (!rc.isOk()) return rc;
+
+    // Errors aren't cached; e.g. a key requiring an upgrade is upgraded and then asked about again.
+    if (error == V4_0::ErrorCode::OK) {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        cache_.push_front({keyBlob, clientId, appData, characteristics});
+        if (cache_.size() > kMaxCachedKeys) cache_.pop_back();
+    }
+    _hidl_cb(error, characteristics);
+    return Void();
+}
+
+Return<void> CachingKeymasterDevice::upgradeKey(const hidl_vec<uint8_t>& keyBlobToUpgrade,
+                                                const hidl_vec<KeyParameter>& upgradeParams,
+                                                upgradeKey_cb _hidl_cb) {
+    // The old blob is superseded by the upgraded one, and is no longer worth keeping.
+    forgetKey(keyBlobToUpgrade);
+    return device_->upgradeKey(keyBlobToUpgrade, upgradeParams, _hidl_cb);
+}
+
+Return<V4_0::ErrorCode> CachingKeymasterDevice::deleteKey(const hidl_vec<uint8_t>& keyBlob) {
+    forgetKey(keyBlob);
+    return device_->deleteKey(keyBlob);
+}
+
+Return<V4_0::ErrorCode> CachingKeymasterDevice::deleteAllKeys() {
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        cache_.clear();
+    }
+    return device_->deleteAllKeys();
+}
+
+Return<void> CachingKeymasterDevice::debug(const hidl_handle& fd,
+                                           const hidl_vec<hidl_string>& /* options */) {
+    if (fd == nullptr || fd->numFds < 1) return Void();
+
+    std::string dump;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        dump = "Key characteristics cache: " + std::to_string(cache_.size()) + " keys, " +
+               std::to_string(cacheHits_) + " hits, " + std::to_string(cacheMisses_) +
+               " misses\n";
+    }
+    if (!android::base::WriteStringToFd(dump, fd->data[0])) {
+        LOG(ERROR) << "Failed to write debug dump";
+    }
+    return Void();
+}
+
+void CachingKeymasterDevice::forgetKey(const hidl_vec<uint8_t>& keyBlob) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    cache_.remove_if([&](const CacheEntry& entry) { return sameBytes(entry.keyBlob, keyBlob); });
+}
+
+}  // namespace android::hardware::keymaster::V4_1::implementation
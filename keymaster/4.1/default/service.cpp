@@ -20,11 +20,15 @@
 
 #include <AndroidKeymaster41Device.h>
 
+#include "CachingKeymasterDevice.h"
+
 using android::hardware::keymaster::V4_0::SecurityLevel;
 
 int main() {
     ::android::hardware::configureRpcThreadpool(1, true /* willJoinThreadpool */);
-    auto keymaster = ::keymaster::V4_1::CreateKeymasterDevice(SecurityLevel::SOFTWARE);
+    android::sp<android::hardware::keymaster::V4_1::IKeymasterDevice> keymaster =
+            new android::hardware::keymaster::V4_1::implementation::CachingKeymasterDevice(
+                    ::keymaster::V4_1::CreateKeymasterDevice(SecurityLevel::SOFTWARE));
     auto status = keymaster->registerAsService();
     if (status != android::OK) {
         LOG(FATAL) << "Could not register service for Keymaster 4.1 (" << status << ")";
@@ -16,6 +16,8 @@
 
 #include <keymasterV4_1/Keymaster.h>
 
+#include <chrono>
+#include <future>
 #include <iomanip>
 
 #include <android-base/logging.h>
@@ -81,29 +83,64 @@ std::ostream& operator<<(std::ostream& os, const Keymaster& keymaster) {
     return os;
 }
 
+using Clock = std::chrono::steady_clock;
+
+static int64_t millisSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Calls |f| on every element of |items|, each on its own thread, and returns the results in the
+ * order of |items|.  Talking to a keymaster, or waiting for it to start, can take a while, so this
+ * keeps the time to reach all of them close to that of the slowest one.
+ */
+template <typename Item, typename F>
+auto callConcurrently(const std::vector<Item>& items, F f) {
+    std::vector<std::future<decltype(f(items[0]))>> futures;
+    futures.reserve(items.size());
+    for (auto& item : items) futures.push_back(std::async(std::launch::async, f, std::cref(item)));
+
+    std::vector<decltype(f(items[0]))> results;
+    results.reserve(items.size());
+    for (auto& future : futures) results.push_back(future.get());
+    return results;
+}
+
 template <typename Wrapper>
 Keymaster::KeymasterSet enumerateDevices(const sp<IServiceManager>& serviceManager) {
-    Keymaster::KeymasterSet result;
-
+    std::vector<hidl_string> names;
     bool foundDefault = false;
     auto& descriptor = Wrapper::WrappedIKeymasterDevice::descriptor;
-    serviceManager->listManifestByInterface(descriptor, [&](const hidl_vec<hidl_string>& names) {
-        for (auto& name : names) {
+    serviceManager->listManifestByInterface(descriptor, [&](const hidl_vec<hidl_string>& list) {
+        for (auto& name : list) {
             if (name == "default") foundDefault = true;
-            auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
-            CHECK(device) << "Failed to get service for " << descriptor << " with interface name "
-                          << name;
-            result.push_back(new Wrapper(device, name));
+            names.push_back(name);
+        }
+    });
+    // If "default" wasn't provided by listManifestByInterface, maybe there's a passthrough
+    // implementation.
+    if (!foundDefault) names.push_back("default");
+
+    auto devices = callConcurrently(names, [&](const hidl_string& name) -> sp<Keymaster> {
+        auto start = Clock::now();
+        auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
+        if (!device) {
+            CHECK(!foundDefault && name == "default")
+                    << "Failed to get service for " << descriptor << " with interface name "
+                    << name;
+            return nullptr;
         }
+        sp<Keymaster> keymaster = new Wrapper(device, name);
+        // Fetch the version here too, it's needed for sorting the devices.
+        keymaster->halVersion();
+        LOG(INFO) << "Getting " << *keymaster << " took " << millisSince(start) << "ms";
+        return keymaster;
     });
 
-    if (!foundDefault) {
-        // "default" wasn't provided by listManifestByInterface.  Maybe there's a passthrough
-        // implementation.
-        auto device = Wrapper::WrappedIKeymasterDevice::getService("default");
-        if (device) result.push_back(new Wrapper(device, "default"));
+    Keymaster::KeymasterSet result;
+    for (auto& device : devices) {
+        if (device) result.push_back(std::move(device));
     }
-
     return result;
 }
 
@@ -124,8 +161,11 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     auto serviceManager = IServiceManager::getService();
     CHECK(serviceManager) << "Could not retrieve ServiceManager";
 
+    auto start = Clock::now();
+    auto km3sFuture =
+            std::async(std::launch::async, enumerateDevices<Keymaster3>, std::cref(serviceManager));
     auto km4s = enumerateDevices<Keymaster4>(serviceManager);
-    auto km3s = enumerateDevices<Keymaster3>(serviceManager);
+    auto km3s = km3sFuture.get();
 
     auto result = std::move(km4s);
     result.insert(result.end(), std::make_move_iterator(km3s.begin()),
@@ -135,26 +175,40 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
               [](auto& a, auto& b) { return a->halVersion() > b->halVersion(); });
 
     size_t i = 1;
-    LOG(INFO) << "List of Keymaster HALs found:";
+    LOG(INFO) << "List of Keymaster HALs found in " << millisSince(start) << "ms:";
     for (auto& hal : result) LOG(INFO) << "Keymaster HAL #" << i++ << ": " << *hal;
 
     return result;
 }
 
-static hidl_vec<HmacSharingParameters> getHmacParameters(
-        const Keymaster::KeymasterSet& keymasters) {
-    std::vector<HmacSharingParameters> params_vec;
-    params_vec.reserve(keymasters.size());
+// HMAC key agreement only involves keymaster 4 instances.
+static Keymaster::KeymasterSet keymaster4s(const Keymaster::KeymasterSet& keymasters) {
+    Keymaster::KeymasterSet km4s;
     for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
-        auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
-            CHECK(error == V4_0::ErrorCode::OK)
-                    << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-            params_vec.push_back(params);
-        });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
-                         << " error: " << rc.description();
+        if (keymaster->halVersion().majorVersion >= 4) km4s.push_back(keymaster);
     }
+    return km4s;
+}
+
+static hidl_vec<HmacSharingParameters> getHmacParameters(
+        const Keymaster::KeymasterSet& keymasters) {
+    Keymaster::KeymasterSet km4s = keymaster4s(keymasters);
+
+    std::vector<HmacSharingParameters> params_vec =
+            callConcurrently(km4s, [](const sp<Keymaster>& keymaster) {
+                auto start = Clock::now();
+                HmacSharingParameters result;
+                auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
+                    CHECK(error == V4_0::ErrorCode::OK) << "Failed to get HMAC parameters from "
+                                                        << *keymaster << " error " << error;
+                    result = params;
+                });
+                CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+                                 << " error: " << rc.description();
+                LOG(INFO) << "Getting HMAC parameters from " << *keymaster << " took "
+                          << millisSince(start) << "ms";
+                return result;
+            });
     std::sort(params_vec.begin(), params_vec.end());
 
     return params_vec;
@@ -164,27 +218,31 @@ static void computeHmac(const Keymaster::KeymasterSet& keymasters,
                         const hidl_vec<HmacSharingParameters>& params) {
     if (!params.size()) return;
 
-    hidl_vec<uint8_t> sharingCheck;
-    bool firstKeymaster = true;
+    Keymaster::KeymasterSet km4s = keymaster4s(keymasters);
+
     LOG(DEBUG) << "Computing HMAC with params " << params;
-    for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
+    auto sharingChecks = callConcurrently(km4s, [&](const sp<Keymaster>& keymaster) {
         LOG(DEBUG) << "Computing HMAC for " << *keymaster;
+        auto start = Clock::now();
+        hidl_vec<uint8_t> sharingCheck;
         auto rc = keymaster->computeSharedHmac(
                 params, [&](V4_0::ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
                     CHECK(error == V4_0::ErrorCode::OK) << "Failed to get HMAC parameters from "
                                                         << *keymaster << " error " << error;
-                    if (firstKeymaster) {
-                        sharingCheck = curSharingCheck;
-                        firstKeymaster = false;
-                    }
-                    if (curSharingCheck != sharingCheck)
-                        LOG(WARNING) << "HMAC computation failed for " << *keymaster  //
-                                     << " Expected: " << sharingCheck                 //
-                                     << " got: " << curSharingCheck;
+                    sharingCheck = curSharingCheck;
                 });
         CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
                          << " error: " << rc.description();
+        LOG(INFO) << "Computing HMAC for " << *keymaster << " took " << millisSince(start)
+                  << "ms";
+        return sharingCheck;
+    });
+
+    for (size_t i = 1; i < km4s.size(); ++i) {
+        if (sharingChecks[i] != sharingChecks[0])
+            LOG(WARNING) << "HMAC computation failed for " << *km4s[i]  //
+                         << " Expected: " << sharingChecks[0]           //
+                         << " got: " << sharingChecks[i];
     }
 }
 
@@ -77,7 +77,7 @@ class Keymaster : public IKeymasterDevice {
 
     /**
      * Returns all available Keymaster3 and Keymaster4 instances, in order of most secure to least
-     * secure (as defined by VersionResult::operator<).
+     * secure (as defined by VersionResult::operator<).  The devices are retrieved concurrently.
      */
     static KeymasterSet enumerateAvailableDevices();
 
@@ -86,6 +86,7 @@ class Keymaster : public IKeymasterDevice {
      * getHmacSharingParameters() and computeSharedHmac().  This computation is idempotent as long
      * as the same set of Keymaster instances is used each time (and if all of the instances work
      * correctly).  It must be performed once per boot, but should do no harm to be repeated.
+     * The instances are called concurrently in each of the two steps.
      *
      * If key agreement fails, this method will crash the process (with CHECK).
      */
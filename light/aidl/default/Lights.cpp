@@ -16,6 +16,9 @@
 
 #include "Lights.h"
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include <android-base/logging.h>
 
 namespace aidl {
@@ -23,16 +26,107 @@ namespace android {
 namespace hardware {
 namespace light {
 
+Lights::Lights() : Lights({}, [](const HwLight&, const HwLightState&) { return true; }) {}
+
+Lights::Lights(std::vector<HwLight> lights, ApplyFunction apply)
+    : mLights(std::move(lights)), mApply(std::move(apply)) {
+    for (const HwLight& light : mLights) {
+        mMailboxes[light.id].light = light;
+    }
+    mApplierThread = std::thread(&Lights::applierLoop, this);
+}
+
+Lights::~Lights() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mCondition.notify_one();
+    mApplierThread.join();
+}
+
 ndk::ScopedAStatus Lights::setLightState(int id, const HwLightState& state) {
-    LOG(INFO) << "Lights setting state for id=" << id << " to color " << std::hex << state.color;
-    return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    LOG(VERBOSE) << "Lights setting state for id=" << id << " to color " << std::hex
+                 << state.color;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mMailboxes.find(id);
+        if (it == mMailboxes.end()) {
+            return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+        }
+        Mailbox& mailbox = it->second;
+        mStats.requests++;
+        if (mailbox.pending) {
+            mStats.coalesced++;
+        } else {
+            mPendingIds.push_back(id);
+        }
+        mailbox.pending = state;
+    }
+    mCondition.notify_one();
+    return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Lights::getLights(std::vector<HwLight>* /*lights*/) {
+ndk::ScopedAStatus Lights::getLights(std::vector<HwLight>* lights) {
     LOG(INFO) << "Lights reporting supported lights";
+    *lights = mLights;
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Lights::dump(int fd, const char** /*args*/, uint32_t /*numArgs*/) {
+    std::lock_guard<std::mutex> lock(mLock);
+    dprintf(fd, "%zu light(s), %zu pending\n", mLights.size(), mPendingIds.size());
+    for (const auto& [id, mailbox] : mMailboxes) {
+        if (mailbox.applied) {
+            dprintf(fd, "  id %d: color 0x%08x\n", id, mailbox.applied->color);
+        } else {
+            dprintf(fd, "  id %d: not applied\n", id);
+        }
+    }
+    dprintf(fd,
+            "Requests: %" PRIu64 ", coalesced: %" PRIu64 ", unchanged: %" PRIu64
+            ", applied: %" PRIu64 ", failed: %" PRIu64 "\n",
+            mStats.requests, mStats.coalesced, mStats.unchanged, mStats.applied, mStats.failed);
+    return STATUS_OK;
+}
+
+bool Lights::isSameState(const HwLightState& a, const HwLightState& b) {
+    return a.color == b.color && a.flashMode == b.flashMode && a.flashOnMs == b.flashOnMs &&
+           a.flashOffMs == b.flashOffMs && a.brightnessMode == b.brightnessMode;
+}
+
+void Lights::applierLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this] { return mStopping || !mPendingIds.empty(); });
+        // Pending states are still applied when stopping, the last one requested must stick.
+        if (mPendingIds.empty()) return;
+
+        Mailbox& mailbox = mMailboxes[mPendingIds.front()];
+        mPendingIds.pop_front();
+        HwLightState state = *mailbox.pending;
+        mailbox.pending.reset();
+        if (mailbox.applied && isSameState(*mailbox.applied, state)) {
+            mStats.unchanged++;
+            continue;
+        }
+
+        // Requests for this light arriving meanwhile are coalesced in its mailbox.
+        lock.unlock();
+        bool success = mApply(mailbox.light, state);
+        lock.lock();
+        if (success) {
+            mailbox.applied = state;
+            mStats.applied++;
+        } else {
+            LOG(ERROR) << "Failed to apply state of light " << mailbox.light.id;
+            // The hardware state is unknown, don't skip the next request.
+            mailbox.applied.reset();
+            mStats.failed++;
+        }
+    }
+}
+
 }  // namespace light
 }  // namespace hardware
 }  // namespace android
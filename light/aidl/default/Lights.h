@@ -18,15 +18,72 @@
 
 #include <aidl/android/hardware/light/BnLights.h>
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace light {
 
 // Default implementation that reports no supported lights.
+//
+// States are applied asynchronously by a single applier thread. Every light has a mailbox that
+// only keeps the latest state requested, so updates that arrive while the hardware is still busy
+// with an earlier one are coalesced, and a state equal to the one last applied is not written
+// again.
 class Lights : public BnLights {
+  public:
+    // Writes the state to the hardware, e.g. to sysfs. Only called from the applier thread.
+    using ApplyFunction = std::function<bool(const HwLight& light, const HwLightState& state)>;
+
+    Lights();
+    Lights(std::vector<HwLight> lights, ApplyFunction apply);
+    ~Lights() override;
+
     ndk::ScopedAStatus setLightState(int id, const HwLightState& state) override;
     ndk::ScopedAStatus getLights(std::vector<HwLight>* types) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    struct Mailbox {
+        HwLight light;
+        std::optional<HwLightState> pending;
+        std::optional<HwLightState> applied;  // Unknown until the first successful write.
+    };
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t coalesced = 0;  // Replaced before being applied.
+        uint64_t unchanged = 0;  // Equal to the state already applied.
+        uint64_t applied = 0;
+        uint64_t failed = 0;
+    };
+
+    static bool isSameState(const HwLightState& a, const HwLightState& b);
+
+    void applierLoop();
+
+    const std::vector<HwLight> mLights;
+    const ApplyFunction mApply;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::map<int, Mailbox> mMailboxes;  // By light id, fixed at construction.
+    std::deque<int> mPendingIds;        // Lights with a pending state, in request order.
+    Stats mStats;
+    bool mStopping = false;
+
+    // Declared last, so that it starts after and stops before everything it uses.
+    std::thread mApplierThread;
 };
 
 }  // namespace light
@@ -18,6 +18,9 @@
 
 #include <log/log.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <hardware/hardware.h>
 #include <hardware/memtrack.h>
 
@@ -29,6 +32,8 @@ namespace memtrack {
 namespace V1_0 {
 namespace implementation {
 
+static constexpr size_t kInitialRecords = 8;
+
 Memtrack::Memtrack(const memtrack_module_t *module) : mModule(module) {
     if (mModule)
         mModule->init(mModule);
@@ -39,8 +44,6 @@ Memtrack::~Memtrack() {}
 Return<void> Memtrack::getMemory(int32_t pid, MemtrackType type,
         getMemory_cb _hidl_cb)  {
     hidl_vec<MemtrackRecord> records;
-    size_t temp = 0;
-    size_t *size = &temp;
     int ret = 0;
 
     if (mModule->getMemory == nullptr)
@@ -48,23 +51,37 @@ Return<void> Memtrack::getMemory(int32_t pid, MemtrackType type,
         _hidl_cb(MemtrackStatus::SUCCESS, records);
         return Void();
     }
+
+    // Each legacy call rereads the driver state, so rather than asking for the
+    // number of records first, try with the buffer left from the last query.
+    // The number of records per type rarely changes, and modules report the
+    // number available when the buffer is too small.
+    thread_local std::vector<memtrack_record> legacy_records(kInitialRecords);
+    size_t size = legacy_records.size();
     ret = mModule->getMemory(mModule, pid, static_cast<memtrack_type>(type),
-            NULL, size);
+            legacy_records.data(), &size);
+    if (ret != 0 || size > legacy_records.size())
+    {
+        size = 0;
+        ret = mModule->getMemory(mModule, pid, static_cast<memtrack_type>(type),
+                NULL, &size);
+        if (ret == 0 && size > 0)
+        {
+            legacy_records.resize(std::max(size, legacy_records.size()));
+            size = legacy_records.size();
+            ret = mModule->getMemory(mModule, pid,
+                    static_cast<memtrack_type>(type), legacy_records.data(), &size);
+        }
+    }
     if (ret == 0)
     {
-        memtrack_record *legacy_records = new memtrack_record[*size];
-        ret = mModule->getMemory(mModule, pid,
-                static_cast<memtrack_type>(type), legacy_records, size);
-        if (ret == 0)
+        size = std::min(size, legacy_records.size());
+        records.resize(size);
+        for(size_t i = 0; i < size; i++)
         {
-            records.resize(*size);
-            for(size_t i = 0; i < *size; i++)
-            {
-                records[i].sizeInBytes = legacy_records[i].size_in_bytes;
-                records[i].flags = legacy_records[i].flags;
-            }
+            records[i].sizeInBytes = legacy_records[i].size_in_bytes;
+            records[i].flags = legacy_records[i].flags;
         }
-        delete[] legacy_records;
     }
     _hidl_cb(MemtrackStatus::SUCCESS, records);
     return Void();
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the execution latency of the drivers through each execution path of IPreparedModel,
+// and the cost of the transfers to and from driver allocated memories (IBuffer).
+//
+// Runs every device on the models whose name matches --models=<regex>, and takes all of the
+// arguments of the Google microbenchmark library, e.g. --benchmark_filter=<regex> or
+// --benchmark_out_format={json|console|csv}. Besides the mean, each benchmark reports the
+// percentiles of the latencies of its iterations and the timing measured by the driver.
+
+#define LOG_TAG "neuralnetworks_hidl_hal_benchmark"
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <android/hardware/neuralnetworks/1.3/IBuffer.h>
+#include <android/hardware/neuralnetworks/1.3/IDevice.h>
+#include <android/hardware/neuralnetworks/1.3/IFencedExecutionCallback.h>
+#include <android/hardware/neuralnetworks/1.3/IPreparedModel.h>
+#include <android/hardware/neuralnetworks/1.3/types.h>
+#include <android/sync.h>
+#include <benchmark/benchmark.h>
+#include <halmetrics/Metrics.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "1.0/Utils.h"
+#include "ExecutionBurstController.h"
+#include "GeneratedTestHarness.h"
+#include "TestHarness.h"
+#include "Utils.h"
+#include "VtsHalNeuralnetworks.h"
+
+namespace android::hardware::neuralnetworks::V1_3::vts::functional {
+
+using namespace test_helper;
+using V1_2::MeasureTiming;
+using V1_2::OutputShape;
+using V1_2::Timing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Small single operation models, and a full network.
+constexpr char kDefaultModels[] =
+        "add|conv_float|depthwise_conv2d_float|fully_connected_float|"
+        "mobilenet_224_gender_basic_fixed";
+
+// A model prepared on a device, with the request that executes it.
+struct Subject {
+    sp<IDevice> device;
+    const TestModel* testModel = nullptr;
+    sp<IPreparedModel> preparedModel;
+    ExecutionContext context;
+    V1_0::Request request10;
+    Request request;
+};
+
+// Prepares the model of a benchmark the first time the benchmark runs, as the library runs each
+// benchmark several times to find its number of iterations. Returns nullptr and reports an error
+// if the model cannot be prepared.
+Subject* getSubject(benchmark::State& state, const NamedDevice& device, const NamedModel& model) {
+    static std::map<std::string, std::unique_ptr<Subject>> subjects;
+    const std::string key = getName(device) + "/" + getName(model);
+    auto it = subjects.find(key);
+    if (it == subjects.end()) {
+        auto subject = std::make_unique<Subject>();
+        subject->device = getData(device);
+        subject->testModel = getData(model);
+        createPreparedModel(subject->device, createModel(*subject->testModel),
+                            &subject->preparedModel, /*reportSkipping*/ false);
+        if (subject->preparedModel != nullptr) {
+            subject->request10 = subject->context.createRequest(*subject->testModel);
+            subject->request = nn::convertToV1_3(subject->request10);
+        }
+        it = subjects.emplace(key, std::move(subject)).first;
+    }
+    if (it->second->preparedModel == nullptr) {
+        state.SkipWithError("Cannot prepare model");
+        return nullptr;
+    }
+    return it->second.get();
+}
+
+// Collects the latency of each iteration of a benchmark, and the timing measured by the driver.
+class LatencyRecorder {
+  public:
+    explicit LatencyRecorder(benchmark::State& state) : mState(state) {}
+
+    void start() { mStart = Clock::now(); }
+
+    void stop() {
+        const Clock::duration latency = Clock::now() - mStart;
+        mState.SetIterationTime(std::chrono::duration<double>(latency).count());
+        mLatencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    }
+
+    // A timing of UINT64_MAX means the driver did not measure it.
+    void addDriverTiming(const Timing& timing) {
+        if (timing.timeOnDevice != UINT64_MAX) {
+            mTimeOnDevice += timing.timeOnDevice;
+            ++mTimesOnDevice;
+        }
+        if (timing.timeInDriver != UINT64_MAX) {
+            mTimeInDriver += timing.timeInDriver;
+            ++mTimesInDriver;
+        }
+    }
+
+    // Reports the percentiles of the latencies and the average timing of the driver, all in
+    // microseconds.
+    void report() {
+        if (mLatencies.count() == 0) return;
+        mState.counters["p50_us"] = mLatencies.percentile(50) / 1000.0;
+        mState.counters["p90_us"] = mLatencies.percentile(90) / 1000.0;
+        mState.counters["p99_us"] = mLatencies.percentile(99) / 1000.0;
+        mState.counters["max_us"] = mLatencies.max() / 1000.0;
+        if (mTimesOnDevice > 0) {
+            mState.counters["on_device_us"] = static_cast<double>(mTimeOnDevice) / mTimesOnDevice;
+        }
+        if (mTimesInDriver > 0) {
+            mState.counters["in_driver_us"] = static_cast<double>(mTimeInDriver) / mTimesInDriver;
+        }
+    }
+
+  private:
+    benchmark::State& mState;
+    Clock::time_point mStart;
+    metrics::Histogram mLatencies;
+    uint64_t mTimeOnDevice = 0;
+    uint64_t mTimesOnDevice = 0;
+    uint64_t mTimeInDriver = 0;
+    uint64_t mTimesInDriver = 0;
+};
+
+MeasureTiming getMeasureTiming(const benchmark::State& state) {
+    return state.range(0) ? MeasureTiming::YES : MeasureTiming::NO;
+}
+
+void BM_ExecuteSynchronously(benchmark::State& state, const NamedDevice& device,
+                             const NamedModel& model) {
+    Subject* subject = getSubject(state, device, model);
+    if (subject == nullptr) return;
+    const MeasureTiming measure = getMeasureTiming(state);
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        ErrorStatus status = ErrorStatus::GENERAL_FAILURE;
+        Timing timing;
+        recorder.start();
+        const Return<void> ret = subject->preparedModel->executeSynchronously_1_3(
+                subject->request, measure, {}, {},
+                [&status, &timing](ErrorStatus error, const hidl_vec<OutputShape>&,
+                                   const Timing& time) {
+                    status = error;
+                    timing = time;
+                });
+        recorder.stop();
+        if (!ret.isOk() || status != ErrorStatus::NONE) {
+            state.SkipWithError("executeSynchronously_1_3 failed");
+            return;
+        }
+        recorder.addDriverTiming(timing);
+    }
+    recorder.report();
+}
+
+void BM_ExecuteBurst(benchmark::State& state, const NamedDevice& device, const NamedModel& model) {
+    Subject* subject = getSubject(state, device, model);
+    if (subject == nullptr) return;
+    const MeasureTiming measure = getMeasureTiming(state);
+
+    const std::shared_ptr<nn::ExecutionBurstController> controller =
+            nn::ExecutionBurstController::create(subject->preparedModel,
+                                                 std::chrono::microseconds{0});
+    if (controller == nullptr) {
+        state.SkipWithError("configureExecutionBurst failed");
+        return;
+    }
+    std::vector<intptr_t> keys(subject->request10.pools.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = reinterpret_cast<intptr_t>(&subject->request10.pools[i]);
+    }
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        int n;
+        Timing timing;
+        recorder.start();
+        std::tie(n, std::ignore, timing, std::ignore) =
+                controller->compute(subject->request10, measure, keys);
+        recorder.stop();
+        if (nn::convertResultCodeToErrorStatus(n) != ErrorStatus::NONE) {
+            state.SkipWithError("Burst execution failed");
+            return;
+        }
+        recorder.addDriverTiming(timing);
+    }
+    recorder.report();
+}
+
+// Measures from the call to executeFenced to the signaling of the returned sync fence. Reports
+// the timing of the fenced part of the execution.
+void BM_ExecuteFenced(benchmark::State& state, const NamedDevice& device,
+                      const NamedModel& model) {
+    Subject* subject = getSubject(state, device, model);
+    if (subject == nullptr) return;
+    const MeasureTiming measure = getMeasureTiming(state);
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        ErrorStatus status = ErrorStatus::GENERAL_FAILURE;
+        hidl_handle syncFence;
+        sp<IFencedExecutionCallback> fencedCallback;
+        recorder.start();
+        const Return<void> ret = subject->preparedModel->executeFenced(
+                subject->request, {}, measure, {}, {}, {},
+                [&status, &syncFence, &fencedCallback](
+                        ErrorStatus error, const hidl_handle& handle,
+                        const sp<IFencedExecutionCallback>& callback) {
+                    status = error;
+                    syncFence = handle;
+                    fencedCallback = callback;
+                });
+        if (ret.isOk() && status == ErrorStatus::NONE && syncFence.getNativeHandle() != nullptr) {
+            constexpr int kInfiniteTimeout = -1;
+            if (sync_wait(syncFence.getNativeHandle()->data[0], kInfiniteTimeout) < 0) {
+                status = ErrorStatus::GENERAL_FAILURE;
+            }
+        }
+        recorder.stop();
+        if (!ret.isOk() || status != ErrorStatus::NONE || fencedCallback == nullptr) {
+            state.SkipWithError("executeFenced failed");
+            return;
+        }
+
+        Timing timingFenced;
+        const Return<void> infoRet = fencedCallback->getExecutionInfo(
+                [&status, &timingFenced](ErrorStatus error, const Timing&, const Timing& fenced) {
+                    status = error;
+                    timingFenced = fenced;
+                });
+        if (!infoRet.isOk() || status != ErrorStatus::NONE) {
+            state.SkipWithError("Fenced execution failed");
+            return;
+        }
+        recorder.addDriverTiming(timingFenced);
+    }
+    recorder.report();
+}
+
+// Allocates a driver memory for the first input of the model, along with a shared memory holding
+// that input. Reports an error and returns nullptr if the driver does not support it.
+sp<IBuffer> allocateInputBuffer(benchmark::State& state, const Subject& subject,
+                                std::unique_ptr<TestAshmem>* memory,
+                                hidl_vec<uint32_t>* dimensions) {
+    const TestSubgraph& main = subject.testModel->main;
+    const TestOperand& operand = main.operands[main.inputIndexes[0]];
+    if (operand.data.size() == 0) {
+        state.SkipWithError("The first input of the model is empty");
+        return nullptr;
+    }
+
+    ErrorStatus status = ErrorStatus::GENERAL_FAILURE;
+    sp<IBuffer> buffer;
+    const BufferRole role = {.modelIndex = 0, .ioIndex = 0, .frequency = 1.0f};
+    const Return<void> ret = subject.device->allocate(
+            {}, {subject.preparedModel}, {role}, {},
+            [&status, &buffer](ErrorStatus error, const sp<IBuffer>& allocated, uint32_t) {
+                status = error;
+                buffer = allocated;
+            });
+    if (!ret.isOk() || status != ErrorStatus::NONE || buffer == nullptr) {
+        state.SkipWithError("Device memory is not supported");
+        return nullptr;
+    }
+
+    *memory = TestAshmem::create(operand.data.size());
+    if (*memory == nullptr) {
+        state.SkipWithError("Cannot allocate shared memory");
+        return nullptr;
+    }
+    std::copy(operand.data.get<uint8_t>(), operand.data.get<uint8_t>() + operand.data.size(),
+              (*memory)->getPointer());
+    *dimensions = operand.dimensions;
+    state.SetLabel(std::to_string(operand.data.size()) + " bytes");
+    return buffer;
+}
+
+void BM_BufferCopyFrom(benchmark::State& state, const NamedDevice& device,
+                       const NamedModel& model) {
+    Subject* subject = getSubject(state, device, model);
+    if (subject == nullptr) return;
+    std::unique_ptr<TestAshmem> memory;
+    hidl_vec<uint32_t> dimensions;
+    const sp<IBuffer> buffer = allocateInputBuffer(state, *subject, &memory, &dimensions);
+    if (buffer == nullptr) return;
+    const hidl_memory source = memory->getHidlMemory();
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.start();
+        const Return<ErrorStatus> ret = buffer->copyFrom(source, dimensions);
+        recorder.stop();
+        if (!ret.isOk() || static_cast<ErrorStatus>(ret) != ErrorStatus::NONE) {
+            state.SkipWithError("IBuffer::copyFrom failed");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    recorder.report();
+}
+
+void BM_BufferCopyTo(benchmark::State& state, const NamedDevice& device, const NamedModel& model) {
+    Subject* subject = getSubject(state, device, model);
+    if (subject == nullptr) return;
+    std::unique_ptr<TestAshmem> memory;
+    hidl_vec<uint32_t> dimensions;
+    const sp<IBuffer> buffer = allocateInputBuffer(state, *subject, &memory, &dimensions);
+    if (buffer == nullptr) return;
+    const hidl_memory destination = memory->getHidlMemory();
+
+    // copyTo requires an initialized buffer.
+    const Return<ErrorStatus> initRet = buffer->copyFrom(destination, dimensions);
+    if (!initRet.isOk() || static_cast<ErrorStatus>(initRet) != ErrorStatus::NONE) {
+        state.SkipWithError("IBuffer::copyFrom failed");
+        return;
+    }
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.start();
+        const Return<ErrorStatus> ret = buffer->copyTo(destination);
+        recorder.stop();
+        if (!ret.isOk() || static_cast<ErrorStatus>(ret) != ErrorStatus::NONE) {
+            state.SkipWithError("IBuffer::copyTo failed");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * destination.size());
+    recorder.report();
+}
+
+using BenchmarkFn = void (*)(benchmark::State&, const NamedDevice&, const NamedModel&);
+
+void registerBenchmarks(const std::string& modelPattern) {
+    const std::regex pattern(modelPattern);
+    const std::vector<NamedModel> models =
+            getNamedModels([&pattern](const std::string& name) {
+                return std::regex_match(name, pattern);
+            });
+    // The execution paths are run with and without timing measurement by the driver.
+    const std::pair<const char*, BenchmarkFn> executions[] = {
+            {"BM_ExecuteSynchronously", BM_ExecuteSynchronously},
+            {"BM_ExecuteBurst", BM_ExecuteBurst},
+            {"BM_ExecuteFenced", BM_ExecuteFenced},
+    };
+    const std::pair<const char*, BenchmarkFn> transfers[] = {
+            {"BM_BufferCopyFrom", BM_BufferCopyFrom},
+            {"BM_BufferCopyTo", BM_BufferCopyTo},
+    };
+    for (const NamedDevice& device : getNamedDevices()) {
+        for (const NamedModel& model : models) {
+            const std::string suffix = "/" + getName(device) + "/" + getName(model);
+            for (const auto& [name, fn] : executions) {
+                benchmark::RegisterBenchmark((name + suffix).c_str(), fn, device, model)
+                        ->ArgName("measure")
+                        ->Arg(0)
+                        ->Arg(1)
+                        ->UseManualTime()
+                        ->Unit(benchmark::kMicrosecond);
+            }
+            for (const auto& [name, fn] : transfers) {
+                benchmark::RegisterBenchmark((name + suffix).c_str(), fn, device, model)
+                        ->UseManualTime()
+                        ->Unit(benchmark::kMicrosecond);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+}  // namespace android::hardware::neuralnetworks::V1_3::vts::functional
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    std::string models = android::hardware::neuralnetworks::V1_3::vts::functional::kDefaultModels;
+    static const std::string kModelsFlag = "--models=";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (android::base::StartsWith(arg, kModelsFlag)) {
+            models = arg.substr(kModelsFlag.size());
+        }
+    }
+    android::hardware::neuralnetworks::V1_3::vts::functional::registerBenchmarks(models);
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -41,7 +41,9 @@
 
 #include <algorithm>
 #include <chrono>
+#include <deque>
 #include <iostream>
+#include <map>
 #include <numeric>
 #include <vector>
 
@@ -877,6 +879,101 @@ void EvaluatePreparedCoupledModels(const sp<IDevice>& device,
     }
 }
 
+static bool isGeneratedTestModel(const TestModel& testModel) {
+    return !testModel.expectFailure;
+}
+
+// Prepared models of the GENERAL, MEMORY_DOMAIN and FENCED_COMPUTE tests, which all run the same
+// model. Preparations are launched ahead for the models of the tests that run next, so that up to
+// PrepareOptions::parallelism models are prepared concurrently, and completed preparations are
+// kept so that the other test kinds of a model reuse them. Only used from the test thread.
+class PreparedModelCache {
+  public:
+    static PreparedModelCache& get() {
+        static PreparedModelCache cache;
+        return cache;
+    }
+
+    void setOptions(const PrepareOptions& options) {
+        mOptions = options;
+        mOptions.parallelism = std::max<size_t>(mOptions.parallelism, 1);
+        mEntries.clear();
+        mOrder.clear();
+    }
+
+    bool enabled() const { return mOptions.parallelism > 1 || mOptions.cacheSize > 0; }
+
+    // Returns the callback of the preparation of testModel on device, launching it and the
+    // preparations of the models that follow it if needed. launchedEarlier is set if the
+    // preparation was launched before this call, ahead or for another test kind. Returns nullptr
+    // if the preparation could not be launched, in which case the caller should prepare the model
+    // itself.
+    sp<PreparedModelCallback> getOrLaunch(const sp<IDevice>& device, const TestModel& testModel,
+                                          const Model& model, bool* launchedEarlier) {
+        *launchedEarlier = mEntries.count({device.get(), &testModel}) > 0;
+        const sp<PreparedModelCallback> callback = findOrLaunch(device, testModel, model);
+
+        // Tests run in the order of getNamedModels for each device, so the models next in that
+        // order are the ones worth preparing ahead.
+        const std::vector<NamedModel>& models = generatedTestModels();
+        const auto it = std::find_if(models.begin(), models.end(), [&testModel](const auto& m) {
+            return getData(m) == &testModel;
+        });
+        if (it != models.end()) {
+            const size_t ahead = std::min<size_t>(mOptions.parallelism - 1, models.end() - it - 1);
+            std::for_each(it + 1, it + 1 + ahead, [this, &device](const NamedModel& next) {
+                const TestModel& nextTestModel = *getData(next);
+                findOrLaunch(device, nextTestModel, createModel(nextTestModel));
+            });
+        }
+        return callback;
+    }
+
+  private:
+    using Key = std::pair<const IDevice*, const TestModel*>;
+
+    static const std::vector<NamedModel>& generatedTestModels() {
+        static const std::vector<NamedModel> models = getNamedModels(isGeneratedTestModel);
+        return models;
+    }
+
+    sp<PreparedModelCallback> findOrLaunch(const sp<IDevice>& device, const TestModel& testModel,
+                                           const Model& model) {
+        const Key key = {device.get(), &testModel};
+        const auto it = mEntries.find(key);
+        if (it != mEntries.end()) return it->second;
+
+        sp<PreparedModelCallback> callback = launchPrepareModel(device, model);
+        if (callback == nullptr) return nullptr;
+        mEntries.emplace(key, callback);
+        mOrder.push_back(key);
+        // Keep room for the preparations launched ahead on top of the ones kept for reuse, so
+        // that launching ahead never evicts a model before its test runs.
+        while (mOrder.size() > mOptions.cacheSize + mOptions.parallelism) {
+            mEntries.erase(mOrder.front());
+            mOrder.pop_front();
+        }
+        return callback;
+    }
+
+    PrepareOptions mOptions;
+    std::map<Key, sp<PreparedModelCallback>> mEntries;
+    std::deque<Key> mOrder;
+};
+
+void setPrepareOptions(const PrepareOptions& options) {
+    PreparedModelCache::get().setOptions(options);
+}
+
+// Records the time since start, in microseconds, in the XML report of the current test, as a
+// baseline for the performance of the driver.
+static void recordDuration(const char* key, std::chrono::steady_clock::time_point start) {
+    const auto duration = std::chrono::steady_clock::now() - start;
+    testing::Test::RecordProperty(
+            key, static_cast<int>(
+                         std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+}
+
 void Execute(const sp<IDevice>& device, const TestModel& testModel, TestKind testKind) {
     Model model = createModel(testModel);
     if (testKind == TestKind::DYNAMIC_SHAPE) {
@@ -884,24 +981,51 @@ void Execute(const sp<IDevice>& device, const TestModel& testModel, TestKind tes
     }
 
     sp<IPreparedModel> preparedModel;
+    const auto prepareStart = std::chrono::steady_clock::now();
     switch (testKind) {
         case TestKind::GENERAL:
-        case TestKind::DYNAMIC_SHAPE:
         case TestKind::MEMORY_DOMAIN:
-        case TestKind::FENCED_COMPUTE:
+        case TestKind::FENCED_COMPUTE: {
+            PreparedModelCache& cache = PreparedModelCache::get();
+            sp<PreparedModelCallback> preparedModelCallback;
+            if (cache.enabled() && isGeneratedTestModel(testModel)) {
+                bool launchedEarlier = false;
+                preparedModelCallback =
+                        cache.getOrLaunch(device, testModel, model, &launchedEarlier);
+                testing::Test::RecordProperty("prepare_launched_earlier", launchedEarlier);
+            }
+            createPreparedModel(device, model, &preparedModel, /*reportSkipping*/ true,
+                                preparedModelCallback);
+            recordDuration("prepare_us", prepareStart);
+            if (preparedModel == nullptr) return;
+            const auto executeStart = std::chrono::steady_clock::now();
+            EvaluatePreparedModel(device, preparedModel, testModel, testKind);
+            recordDuration("execute_us", executeStart);
+        } break;
+        case TestKind::DYNAMIC_SHAPE:
         case TestKind::INTINITE_LOOP_TIMEOUT: {
             createPreparedModel(device, model, &preparedModel);
+            recordDuration("prepare_us", prepareStart);
             if (preparedModel == nullptr) return;
+            const auto executeStart = std::chrono::steady_clock::now();
             EvaluatePreparedModel(device, preparedModel, testModel, testKind);
+            recordDuration("execute_us", executeStart);
         } break;
         case TestKind::QUANTIZATION_COUPLING: {
             ASSERT_TRUE(testModel.hasQuant8CoupledOperands());
-            createPreparedModel(device, model, &preparedModel,
-                                /*reportSkipping*/ false);
             TestModel signedQuantizedModel = convertQuant8AsymmOperandsToSigned(testModel);
+            const Model coupledModel = createModel(signedQuantizedModel);
+            // Prepare both models concurrently.
+            const sp<PreparedModelCallback> preparedModelCallback =
+                    launchPrepareModel(device, model);
+            const sp<PreparedModelCallback> preparedCoupledModelCallback =
+                    launchPrepareModel(device, coupledModel);
+            createPreparedModel(device, model, &preparedModel,
+                                /*reportSkipping*/ false, preparedModelCallback);
             sp<IPreparedModel> preparedCoupledModel;
-            createPreparedModel(device, createModel(signedQuantizedModel), &preparedCoupledModel,
-                                /*reportSkipping*/ false);
+            createPreparedModel(device, coupledModel, &preparedCoupledModel,
+                                /*reportSkipping*/ false, preparedCoupledModelCallback);
+            recordDuration("prepare_us", prepareStart);
             // If we couldn't prepare a model with unsigned quantization, we must
             // fail to prepare a model with signed quantization as well.
             if (preparedModel == nullptr) {
@@ -917,8 +1041,10 @@ void Execute(const sp<IDevice>& device, const TestModel& testModel, TestKind tes
                 GTEST_SKIP();
             }
             ASSERT_NE(preparedCoupledModel, nullptr);
+            const auto executeStart = std::chrono::steady_clock::now();
             EvaluatePreparedCoupledModels(device, preparedModel, testModel, preparedCoupledModel,
                                           signedQuantizedModel);
+            recordDuration("execute_us", executeStart);
         } break;
     }
 }
@@ -983,18 +1109,15 @@ TEST_P(InfiniteLoopTimeoutTest, Test) {
     Execute(kDevice, kTestModel, TestKind::INTINITE_LOOP_TIMEOUT);
 }
 
-INSTANTIATE_GENERATED_TEST(GeneratedTest,
-                           [](const TestModel& testModel) { return !testModel.expectFailure; });
+INSTANTIATE_GENERATED_TEST(GeneratedTest, isGeneratedTestModel);
 
 INSTANTIATE_GENERATED_TEST(DynamicOutputShapeTest, [](const TestModel& testModel) {
     return !testModel.expectFailure && !testModel.hasScalarOutputs();
 });
 
-INSTANTIATE_GENERATED_TEST(MemoryDomainTest,
-                           [](const TestModel& testModel) { return !testModel.expectFailure; });
+INSTANTIATE_GENERATED_TEST(MemoryDomainTest, isGeneratedTestModel);
 
-INSTANTIATE_GENERATED_TEST(FencedComputeTest,
-                           [](const TestModel& testModel) { return !testModel.expectFailure; });
+INSTANTIATE_GENERATED_TEST(FencedComputeTest, isGeneratedTestModel);
 
 INSTANTIATE_GENERATED_TEST(QuantizationCouplingTest, [](const TestModel& testModel) {
     return !testModel.expectFailure && testModel.hasQuant8CoupledOperands() &&
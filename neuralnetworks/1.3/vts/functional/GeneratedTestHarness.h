@@ -82,6 +82,20 @@ void EvaluatePreparedModel(const sp<IDevice>& device, const sp<IPreparedModel>&
 
 void waitForSyncFence(int syncFd);
 
+// Options to shorten the generated tests on drivers that are slow to prepare models. The defaults
+// prepare each model when its test runs, and only then.
+struct PrepareOptions {
+    // How many models to have in preparation at once. When greater than 1, the preparations of the
+    // models of the next tests are launched before they run.
+    size_t parallelism = 1;
+    // How many prepared models to keep for the other tests that run the same model, e.g. the
+    // MemoryDomainTest and FencedComputeTest of a GeneratedTest model. These only reuse a model
+    // if the cache is large enough to hold the models of a whole test suite.
+    size_t cacheSize = 0;
+};
+
+void setPrepareOptions(const PrepareOptions& options);
+
 }  // namespace android::hardware::neuralnetworks::V1_3::vts::functional
 
 #endif  // ANDROID_HARDWARE_NEURALNETWORKS_V1_3_GENERATED_TEST_HARNESS_H
@@ -14,11 +14,40 @@
  * limitations under the License.
  */
 
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
 #include <gtest/gtest.h>
+#include <string>
 #include "1.0/LogTestCaseToLogcat.h"
+#include "GeneratedTestHarness.h"
+
+using android::hardware::neuralnetworks::V1_3::vts::functional::PrepareOptions;
+
+// Parses the options of the harness left over by InitGoogleTest:
+//   --prepare_parallelism=N    how many models to prepare concurrently
+//   --prepared_model_cache=N   how many prepared models to keep for reuse
+static PrepareOptions parsePrepareOptions(int argc, char** argv) {
+    static const std::string kParallelism = "--prepare_parallelism=";
+    static const std::string kCacheSize = "--prepared_model_cache=";
+    PrepareOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (android::base::StartsWith(arg, kParallelism)) {
+            CHECK(android::base::ParseUint(arg.substr(kParallelism.size()), &options.parallelism))
+                    << "Invalid " << arg;
+        } else if (android::base::StartsWith(arg, kCacheSize)) {
+            CHECK(android::base::ParseUint(arg.substr(kCacheSize.size()), &options.cacheSize))
+                    << "Invalid " << arg;
+        }
+    }
+    return options;
+}
 
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
+    android::hardware::neuralnetworks::V1_3::vts::functional::setPrepareOptions(
+            parsePrepareOptions(argc, argv));
     testing::UnitTest::GetInstance()->listeners().Append(
             new android::hardware::neuralnetworks::LogTestCaseToLogcat());
     return RUN_ALL_TESTS();
@@ -35,9 +35,22 @@ using HidlToken =
 using implementation::PreparedModelCallback;
 using V1_1::ExecutionPreference;
 
+sp<PreparedModelCallback> launchPrepareModel(const sp<IDevice>& device, const Model& model) {
+    const sp<PreparedModelCallback> preparedModelCallback = new PreparedModelCallback();
+    const Return<ErrorStatus> prepareLaunchStatus = device->prepareModel_1_3(
+            model, ExecutionPreference::FAST_SINGLE_ANSWER, kDefaultPriority, {},
+            hidl_vec<hidl_handle>(), hidl_vec<hidl_handle>(), HidlToken(), preparedModelCallback);
+    if (!prepareLaunchStatus.isOk() ||
+        static_cast<ErrorStatus>(prepareLaunchStatus) != ErrorStatus::NONE) {
+        return nullptr;
+    }
+    return preparedModelCallback;
+}
+
 // internal helper function
 void createPreparedModel(const sp<IDevice>& device, const Model& model,
-                         sp<IPreparedModel>* preparedModel, bool reportSkipping) {
+                         sp<IPreparedModel>* preparedModel, bool reportSkipping,
+                         sp<PreparedModelCallback> preparedModelCallback) {
     ASSERT_NE(nullptr, preparedModel);
     *preparedModel = nullptr;
 
@@ -52,13 +65,16 @@ void createPreparedModel(const sp<IDevice>& device, const Model& model,
             });
     ASSERT_TRUE(supportedCall.isOk());
 
-    // launch prepare model
-    const sp<PreparedModelCallback> preparedModelCallback = new PreparedModelCallback();
-    const Return<ErrorStatus> prepareLaunchStatus = device->prepareModel_1_3(
-            model, ExecutionPreference::FAST_SINGLE_ANSWER, kDefaultPriority, {},
-            hidl_vec<hidl_handle>(), hidl_vec<hidl_handle>(), HidlToken(), preparedModelCallback);
-    ASSERT_TRUE(prepareLaunchStatus.isOk());
-    ASSERT_EQ(ErrorStatus::NONE, static_cast<ErrorStatus>(prepareLaunchStatus));
+    // launch prepare model, unless the caller already did
+    if (preparedModelCallback == nullptr) {
+        preparedModelCallback = new PreparedModelCallback();
+        const Return<ErrorStatus> prepareLaunchStatus = device->prepareModel_1_3(
+                model, ExecutionPreference::FAST_SINGLE_ANSWER, kDefaultPriority, {},
+                hidl_vec<hidl_handle>(), hidl_vec<hidl_handle>(), HidlToken(),
+                preparedModelCallback);
+        ASSERT_TRUE(prepareLaunchStatus.isOk());
+        ASSERT_EQ(ErrorStatus::NONE, static_cast<ErrorStatus>(prepareLaunchStatus));
+    }
 
     // retrieve prepared model
     preparedModelCallback->wait();
@@ -45,10 +45,18 @@ std::string printNeuralnetworksHidlTest(
     INSTANTIATE_TEST_SUITE_P(PerInstance, TestSuite, testing::ValuesIn(getNamedDevices()), \
                              printNeuralnetworksHidlTest)
 
+// Launch the preparation of a model without waiting for it to complete. Returns the callback that
+// will hold the result, or nullptr if the preparation could not be launched.
+sp<implementation::PreparedModelCallback> launchPrepareModel(const sp<IDevice>& device,
+                                                             const Model& model);
+
 // Create an IPreparedModel object. If the model cannot be prepared,
-// "preparedModel" will be nullptr instead.
+// "preparedModel" will be nullptr instead. If "preparedModelCallback" is set, it must come from
+// launchPrepareModel for the same device and model, and its result is used instead of launching
+// another preparation.
 void createPreparedModel(const sp<IDevice>& device, const Model& model,
-                         sp<IPreparedModel>* preparedModel, bool reportSkipping = true);
+                         sp<IPreparedModel>* preparedModel, bool reportSkipping = true,
+                         sp<implementation::PreparedModelCallback> preparedModelCallback = nullptr);
 
 // Utility function to get PreparedModel from callback and downcast to V1_2.
 sp<IPreparedModel> getPreparedModel_1_3(const sp<implementation::PreparedModelCallback>& callback);
@@ -22,10 +22,17 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
 #include <algorithm>
 #include <exception>
+#include <future>
+#include <string_view>
 #include <thread>
 
 namespace android {
@@ -37,14 +44,24 @@ namespace implementation {
 
 #define MAX_FILE_PATH_LEN 128
 #define MAX_DEVICE_NAME_LEN 64
+// energy_value holds a timestamp and a line per rail.
+#define MAX_ENERGY_VALUE_LEN 4096
 #define MAX_QUEUE_SIZE 8192
 
 constexpr char kIioDirRoot[] = "/sys/bus/iio/devices/";
 constexpr char kDeviceName[] = "pm_device_name";
 constexpr char kDeviceType[] = "iio:device";
 constexpr uint32_t MAX_SAMPLING_RATE = 10;
+constexpr uint32_t MAX_STREAMS = 8;
+constexpr uint64_t NS_PER_SEC = 1000000000;
 constexpr uint64_t WRITE_TIMEOUT_NS = 1000000000;
 
+static uint64_t monotonicNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
 void PowerStats::findIioPowerMonitorNodes() {
     struct dirent* ent;
     int fd;
@@ -120,48 +137,104 @@ size_t PowerStats::parsePowerRails() {
             }
         }
     }
+
+    // Keep the energy nodes open and remember which rails each of them reports, so that sampling
+    // only needs to read and parse them.
+    for (const auto& path : mPm.devicePaths) {
+        IioEnergyNode node;
+        node.fileName = path + "/energy_value";
+        node.fd.reset(open(node.fileName.c_str(), O_RDONLY | O_CLOEXEC));
+        if (node.fd < 0) {
+            ALOGW("Error opening file: %s", node.fileName.c_str());
+        }
+        for (const auto& railData : mPm.railsInfo) {
+            if (railData.second.devicePath == path) {
+                node.rails.emplace_back(railData.first, railData.second.index);
+            }
+        }
+        mPm.energyNodes.push_back(std::move(node));
+    }
     return index;
 }
 
-int PowerStats::parseIioEnergyNode(std::string devName) {
-    int ret = 0;
-    std::string data;
-    std::string fileName = devName + "/energy_value";
-    if (!android::base::ReadFileToString(fileName, &data)) {
-        ALOGE("Error reading file: %s", fileName.c_str());
+// Parses a decimal number the way strtoull(str, NULL, 10) does: leading whitespace and a sign
+// are accepted, parsing stops at the first non-digit and values that overflow saturate to
+// ULLONG_MAX.
+static uint64_t parseUint64(const char* begin, const char* end) {
+    while (begin != end && isspace(*begin)) {
+        begin++;
+    }
+    bool negative = false;
+    if (begin != end && (*begin == '+' || *begin == '-')) {
+        negative = *begin == '-';
+        begin++;
+    }
+    uint64_t value = 0;
+    for (; begin != end && *begin >= '0' && *begin <= '9'; begin++) {
+        uint64_t digit = *begin - '0';
+        if (value > (ULLONG_MAX - digit) / 10) {
+            return ULLONG_MAX;
+        }
+        value = value * 10 + digit;
+    }
+    return negative ? -value : value;
+}
+
+int PowerStats::parseIioEnergyNode(const IioEnergyNode& node) {
+    // Sampling runs at up to MAX_SAMPLING_RATE while streaming, so this reads the node that
+    // parsePowerRails() opened and parses it in place, without allocating.
+    char data[MAX_ENERGY_VALUE_LEN];
+    ssize_t size = -1;
+    if (node.fd >= 0) {
+        size = TEMP_FAILURE_RETRY(pread(node.fd, data, sizeof(data), 0));
+    }
+    if (size < 0) {
+        ALOGE("Error reading file: %s", node.fileName.c_str());
+        return -1;
+    }
+    if (static_cast<size_t>(size) == sizeof(data)) {
+        ALOGE("File too large: %s", node.fileName.c_str());
         return -1;
     }
 
-    std::istringstream energyData(data);
-    std::string line;
+    int ret = 0;
     uint64_t timestamp = 0;
     bool timestampRead = false;
-    while (std::getline(energyData, line)) {
-        std::vector<std::string> words = android::base::Split(line, ",");
+    const char* end = data + size;
+    for (const char* line = data; line != end;) {
+        const char* lineEnd = std::find(line, end, '\n');
+        const char* comma = std::find(line, lineEnd, ',');
+        const bool oneWord = comma == lineEnd;
+        const bool twoWords = !oneWord && std::find(comma + 1, lineEnd, ',') == lineEnd;
         if (timestampRead == false) {
-            if (words.size() == 1) {
-                timestamp = strtoull(words[0].c_str(), NULL, 10);
+            if (oneWord) {
+                timestamp = parseUint64(line, lineEnd);
                 if (timestamp == 0 || timestamp == ULLONG_MAX) {
                     ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
                 }
                 timestampRead = true;
             }
-        } else if (words.size() == 2) {
-            std::string railName = words[0];
-            if (mPm.railsInfo.count(railName) != 0) {
-                size_t index = mPm.railsInfo[railName].index;
+        } else if (twoWords) {
+            std::string_view railName(line, comma - line);
+            for (const auto& rail : node.rails) {
+                if (rail.first != railName) {
+                    continue;
+                }
+                size_t index = rail.second;
                 mPm.reading[index].index = index;
                 mPm.reading[index].timestamp = timestamp;
-                mPm.reading[index].energy = strtoull(words[1].c_str(), NULL, 10);
+                mPm.reading[index].energy = parseUint64(comma + 1, lineEnd);
                 if (mPm.reading[index].energy == ULLONG_MAX) {
                     ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
                 }
+                break;
             }
         } else {
-            ALOGW("Unexpected format in file: %s", fileName.c_str());
+            ALOGW("Unexpected format in file: %s", node.fileName.c_str());
             ret = -1;
             break;
         }
+        line = lineEnd == end ? end : lineEnd + 1;
     }
     return ret;
 }
@@ -172,8 +245,8 @@ Status PowerStats::parseIioEnergyNodes() {
         return Status::NOT_SUPPORTED;
     }
 
-    for (const auto& devicePath : mPm.devicePaths) {
-        if (parseIioEnergyNode(devicePath) < 0) {
+    for (const auto& node : mPm.energyNodes) {
+        if (parseIioEnergyNode(node) < 0) {
             ALOGE("Error in parsing power stats");
             ret = Status::FILESYSTEM_ERROR;
             break;
@@ -249,47 +322,118 @@ Return<void> PowerStats::getEnergyData(const hidl_vec<uint32_t>& railIndices,
 Return<void> PowerStats::streamEnergyData(uint32_t timeMs, uint32_t samplingRate,
                                           streamEnergyData_cb _hidl_cb) {
     std::lock_guard<std::mutex> _lock(mPm.mLock);
-    if (mPm.fmqSynchronized != nullptr) {
+    if (mPm.streams.size() >= MAX_STREAMS || !startSampler()) {
         _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
         return Void();
     }
     uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
-    uint32_t numSamples = timeMs * sps / 1000;
-    mPm.fmqSynchronized.reset(new (std::nothrow) MessageQueueSync(MAX_QUEUE_SIZE, true));
-    if (mPm.fmqSynchronized == nullptr || mPm.fmqSynchronized->isValid() == false) {
-        mPm.fmqSynchronized = nullptr;
+    uint32_t numSamples = static_cast<uint64_t>(timeMs) * sps / 1000;
+    std::unique_ptr<MessageQueueSync> fmq(new (std::nothrow)
+                                                  MessageQueueSync(MAX_QUEUE_SIZE, true));
+    if (fmq == nullptr || fmq->isValid() == false) {
         _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
         return Void();
     }
-    std::thread pollThread = std::thread([this, sps, numSamples]() {
-        uint64_t sleepTimeUs = 1000000 / sps;
-        uint32_t currSamples = 0;
-        while (currSamples < numSamples) {
-            mPm.mLock.lock();
-            if (parseIioEnergyNodes() == Status::SUCCESS) {
-                mPm.fmqSynchronized->writeBlocking(&mPm.reading[0], mPm.reading.size(),
-                                                   WRITE_TIMEOUT_NS);
-                mPm.mLock.unlock();
-                currSamples++;
-                if (usleep(sleepTimeUs) < 0) {
-                    ALOGW("Sleep interrupted");
-                    break;
-                }
-            } else {
-                mPm.mLock.unlock();
-                break;
-            }
-        }
-        mPm.mLock.lock();
-        mPm.fmqSynchronized = nullptr;
-        mPm.mLock.unlock();
-        return;
-    });
-    pollThread.detach();
-    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
+    _hidl_cb(*fmq->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
+    if (numSamples > 0) {
+        // The first sample is taken right away.
+        mPm.streams.push_back({.fmq = std::move(fmq),
+                               .periodNs = NS_PER_SEC / sps,
+                               .nextSampleNs = monotonicNs(),
+                               .samplesLeft = numSamples});
+        armSamplerTimer();
+    }
     return Void();
 }
 
+// Starts the thread that samples the energy nodes for all streams, unless it is running already.
+// Must be called with mPm.mLock held.
+bool PowerStats::startSampler() {
+    if (mPm.samplerTimerFd >= 0) {
+        return true;
+    }
+    mPm.samplerTimerFd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    if (mPm.samplerTimerFd < 0) {
+        ALOGE("Failed to create sampler timer: %s", strerror(errno));
+        return false;
+    }
+    std::thread(&PowerStats::runSampler, this).detach();
+    return true;
+}
+
+void PowerStats::runSampler() {
+    while (true) {
+        uint64_t expirations;
+        if (TEMP_FAILURE_RETRY(read(mPm.samplerTimerFd, &expirations, sizeof(expirations))) < 0) {
+            ALOGE("Failed to wait for sampler timer: %s", strerror(errno));
+            std::lock_guard<std::mutex> _lock(mPm.mLock);
+            // Closing the timer lets the next stream start a new sampler.
+            mPm.streams.clear();
+            mPm.samplerTimerFd.reset();
+            return;
+        }
+        std::lock_guard<std::mutex> _lock(mPm.mLock);
+        sampleStreams();
+    }
+}
+
+// Sends a sample to every stream that is due. Must be called with mPm.mLock held.
+void PowerStats::sampleStreams() {
+    uint64_t now = monotonicNs();
+    bool sampled = false;
+    Status status = Status::SUCCESS;
+    for (auto& stream : mPm.streams) {
+        if (stream.nextSampleNs > now) {
+            continue;
+        }
+        // All streams that are due share one pass over the energy nodes.
+        if (!sampled) {
+            status = parseIioEnergyNodes();
+            sampled = true;
+        }
+        if (status != Status::SUCCESS) {
+            stream.samplesLeft = 0;
+            continue;
+        }
+        // Drop the sample, rather than hold up the other streams, if the client has fallen
+        // behind. There is room otherwise, so this doesn't block; it only wakes the client.
+        if (stream.fmq->availableToWrite() >= mPm.reading.size()) {
+            stream.fmq->writeBlocking(&mPm.reading[0], mPm.reading.size(), WRITE_TIMEOUT_NS);
+        }
+        stream.samplesLeft--;
+        // Deadlines advance by whole periods from the first sample, so they don't drift with the
+        // time spent sampling. Deadlines that have been missed altogether are skipped.
+        stream.nextSampleNs += stream.periodNs;
+        if (stream.nextSampleNs <= now) {
+            stream.nextSampleNs +=
+                    ((now - stream.nextSampleNs) / stream.periodNs + 1) * stream.periodNs;
+        }
+    }
+    mPm.streams.erase(std::remove_if(mPm.streams.begin(), mPm.streams.end(),
+                                     [](const auto& stream) { return stream.samplesLeft == 0; }),
+                      mPm.streams.end());
+    armSamplerTimer();
+}
+
+// Sets the sampler timer to the earliest deadline of the streams, or disarms it if there are none.
+// Must be called with mPm.mLock held.
+void PowerStats::armSamplerTimer() {
+    itimerspec deadline = {};
+    if (!mPm.streams.empty()) {
+        uint64_t nextSampleNs =
+                std::min_element(mPm.streams.begin(), mPm.streams.end(),
+                                 [](const auto& lhs, const auto& rhs) {
+                                     return lhs.nextSampleNs < rhs.nextSampleNs;
+                                 })
+                        ->nextSampleNs;
+        deadline.it_value.tv_sec = nextSampleNs / NS_PER_SEC;
+        deadline.it_value.tv_nsec = nextSampleNs % NS_PER_SEC;
+    }
+    if (timerfd_settime(mPm.samplerTimerFd, TFD_TIMER_ABSTIME, &deadline, nullptr) < 0) {
+        ALOGE("Failed to arm sampler timer: %s", strerror(errno));
+    }
+}
+
 uint32_t PowerStats::addPowerEntity(const std::string& name, PowerEntityType type) {
     uint32_t id = mPowerEntityInfos.size();
     mPowerEntityInfos.push_back({id, name, type});
@@ -368,13 +512,9 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
         return getPowerEntityStateResidencyData(ids, _hidl_cb);
     }
 
-    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> stateResidencies;
-    std::vector<PowerEntityStateResidencyResult> results;
-    results.reserve(powerEntityIds.size());
-
-    // return results for only the given powerEntityIds
+    // find the providers of the given powerEntityIds
     bool invalidInput = false;
-    bool filesystemError = false;
+    std::vector<std::shared_ptr<IStateResidencyDataProvider>> providers;
     for (auto id : powerEntityIds) {
         auto dataProvider = mStateResidencyDataProviders.find(id);
         // skip if the given powerEntityId does not have an associated StateResidencyDataProvider
@@ -382,15 +522,19 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
             invalidInput = true;
             continue;
         }
-
-        // get the results if we have not already done so.
-        if (stateResidencies.find(id) == stateResidencies.end()) {
-            if (!dataProvider->second->getResults(stateResidencies)) {
-                filesystemError = true;
-            }
+        if (std::find(providers.begin(), providers.end(), dataProvider->second) ==
+            providers.end()) {
+            providers.push_back(dataProvider->second);
         }
+    }
+
+    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> stateResidencies;
+    bool filesystemError = !getStateResidencies(providers, stateResidencies);
 
-        // append results
+    // return results for only the given powerEntityIds
+    std::vector<PowerEntityStateResidencyResult> results;
+    results.reserve(powerEntityIds.size());
+    for (auto id : powerEntityIds) {
         auto stateResidency = stateResidencies.find(id);
         if (stateResidency != stateResidencies.end()) {
             results.emplace_back(stateResidency->second);
@@ -408,6 +552,74 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
     return Void();
 }
 
+void PowerStats::setMaxResidencyStaleness(std::chrono::milliseconds maxStaleness) {
+    std::lock_guard<std::mutex> _lock(mResidencyLock);
+    mMaxResidencyStaleness = maxStaleness;
+}
+
+// Gets the results of the given providers, from their caches where those are still current.
+// The providers that need to be read are read in parallel. Returns false if any of them fails,
+// in which case the results of the others are still returned.
+bool PowerStats::getStateResidencies(
+        const std::vector<std::shared_ptr<IStateResidencyDataProvider>>& providers,
+        std::unordered_map<uint32_t, PowerEntityStateResidencyResult>& results) {
+    struct Poll {
+        IStateResidencyDataProvider* provider;
+        StateResidencyCache* cache;
+        bool hasGeneration;
+        uint64_t generation;
+        std::unordered_map<uint32_t, PowerEntityStateResidencyResult> results;
+        bool success;
+    };
+
+    std::lock_guard<std::mutex> _lock(mResidencyLock);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Poll> polls;
+    for (const auto& provider : providers) {
+        StateResidencyCache& cache = mResidencyCaches[provider.get()];
+        uint64_t generation = 0;
+        bool hasGeneration = provider->getGeneration(&generation);
+        bool unchanged = hasGeneration && cache.hasGeneration && generation == cache.generation;
+        if (cache.valid && (unchanged || now - cache.updated < mMaxResidencyStaleness)) {
+            results.insert(cache.results.begin(), cache.results.end());
+            continue;
+        }
+        polls.push_back({provider.get(), &cache, hasGeneration, generation, {}, false});
+    }
+
+    // Providers parse their own files, so they are read in parallel. The first is read on this
+    // thread.
+    std::vector<std::future<bool>> pending;
+    for (size_t i = 1; i < polls.size(); i++) {
+        pending.push_back(std::async(std::launch::async, [&poll = polls[i]]() {
+            return poll.provider->getResults(poll.results);
+        }));
+    }
+    if (!polls.empty()) {
+        polls[0].success = polls[0].provider->getResults(polls[0].results);
+    }
+    for (size_t i = 1; i < polls.size(); i++) {
+        polls[i].success = pending[i - 1].get();
+    }
+
+    bool success = true;
+    for (auto& poll : polls) {
+        results.insert(poll.results.begin(), poll.results.end());
+        // Partial results aren't cached.
+        if (!poll.success) {
+            poll.cache->valid = false;
+            success = false;
+            continue;
+        }
+        poll.cache->valid = true;
+        poll.cache->updated = now;
+        poll.cache->hasGeneration = poll.hasGeneration;
+        poll.cache->generation = poll.generation;
+        poll.cache->results = std::move(poll.results);
+    }
+    return success;
+}
+
 bool DumpResidencyDataToFd(const hidl_vec<PowerEntityInfo>& infos,
                            const hidl_vec<PowerEntityStateSpace>& stateSpaces,
                            const hidl_vec<PowerEntityStateResidencyResult>& results, int fd) {
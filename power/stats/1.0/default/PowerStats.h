@@ -17,10 +17,12 @@
 #ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 #define ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/power/stats/1.0/IPowerStats.h>
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <chrono>
 #include <unordered_map>
 
 namespace android {
@@ -52,13 +54,32 @@ struct RailData {
     uint32_t samplingRate;
 };
 
+// An IIO power monitor's energy_value node, kept open for sampling.
+struct IioEnergyNode {
+    std::string fileName;
+    android::base::unique_fd fd;
+    // The names of the rails this device reports, with their indices into the readings.
+    std::vector<std::pair<std::string, uint32_t>> rails;
+};
+
+// A streamEnergyData() client, sent a sample every periodNs until it has received all of them.
+struct EnergyStream {
+    std::unique_ptr<MessageQueueSync> fmq;
+    uint64_t periodNs;
+    uint64_t nextSampleNs;
+    uint32_t samplesLeft;
+};
+
 struct OnDeviceMmt {
     std::mutex mLock;
     bool hwEnabled;
     std::vector<std::string> devicePaths;
     std::map<std::string, RailData> railsInfo;
+    std::vector<IioEnergyNode> energyNodes;
     std::vector<EnergyData> reading;
-    std::unique_ptr<MessageQueueSync> fmqSynchronized;
+    std::vector<EnergyStream> streams;
+    // Expires at the earliest sample deadline of the streams, and wakes the sampler thread.
+    android::base::unique_fd samplerTimerFd;
 };
 
 class IStateResidencyDataProvider {
@@ -67,6 +88,20 @@ class IStateResidencyDataProvider {
     virtual bool getResults(
             std::unordered_map<uint32_t, PowerEntityStateResidencyResult>& results) = 0;
     virtual std::vector<PowerEntityStateSpace> getStateSpaces() = 0;
+    // Optional. A provider that can tell cheaply whether its data has changed, e.g. from the event
+    // counts of the wakeup sources it reports, returns a generation number that changes whenever
+    // getResults() would return different results. Its previous results are reused for as long
+    // as the generation stays the same.
+    virtual bool getGeneration(uint64_t* /* generation */) { return false; }
+};
+
+// The last results of a state residency data provider.
+struct StateResidencyCache {
+    bool valid = false;
+    std::chrono::steady_clock::time_point updated;
+    bool hasGeneration = false;
+    uint64_t generation = 0;
+    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> results;
 };
 
 struct PowerStats : public IPowerStats {
@@ -74,6 +109,9 @@ struct PowerStats : public IPowerStats {
     PowerStats();
     uint32_t addPowerEntity(const std::string& name, PowerEntityType type);
     void addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p);
+    // State residencies are read from the providers again once they are older than this. Defaults
+    // to zero, so that only providers that support generations are cached.
+    void setMaxResidencyStaleness(std::chrono::milliseconds maxStaleness);
     // Methods from ::android::hardware::power::stats::V1_0::IPowerStats follow.
     Return<void> getRailInfo(getRailInfo_cb _hidl_cb) override;
     Return<void> getEnergyData(const hidl_vec<uint32_t>& railIndices,
@@ -94,12 +132,22 @@ struct PowerStats : public IPowerStats {
     OnDeviceMmt mPm;
     void findIioPowerMonitorNodes();
     size_t parsePowerRails();
-    int parseIioEnergyNode(std::string devName);
+    int parseIioEnergyNode(const IioEnergyNode& node);
     Status parseIioEnergyNodes();
+    bool startSampler();
+    void runSampler();
+    void sampleStreams();
+    void armSamplerTimer();
     std::vector<PowerEntityInfo> mPowerEntityInfos;
     std::unordered_map<uint32_t, PowerEntityStateSpace> mPowerEntityStateSpaces;
     std::unordered_map<uint32_t, std::shared_ptr<IStateResidencyDataProvider>>
             mStateResidencyDataProviders;
+    bool getStateResidencies(
+            const std::vector<std::shared_ptr<IStateResidencyDataProvider>>& providers,
+            std::unordered_map<uint32_t, PowerEntityStateResidencyResult>& results);
+    std::mutex mResidencyLock;
+    std::chrono::steady_clock::duration mMaxResidencyStaleness{0};
+    std::unordered_map<const IStateResidencyDataProvider*, StateResidencyCache> mResidencyCaches;
 };
 
 }  // namespace implementation
@@ -65,6 +65,12 @@ class DefaultStateResidencyDataProvider : public IStateResidencyDataProvider {
         return true;
     }
 
+    // The fake numbers never change.
+    bool getGeneration(uint64_t* generation) {
+        *generation = 0;
+        return true;
+    }
+
     std::vector<PowerEntityStateSpace> getStateSpaces() {
         return {{
           .powerEntityId = mPowerEntityId,
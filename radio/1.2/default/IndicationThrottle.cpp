@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "IndicationThrottle.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace android {
+namespace hardware {
+namespace radio {
+namespace V1_2 {
+namespace implementation {
+
+using ::android::hardware::radio::V1_2::AccessNetwork;
+using ::android::hardware::radio::V1_2::CellInfo;
+using ::android::hardware::radio::V1_2::IndicationFilter;
+using ::android::hardware::radio::V1_2::SignalStrength;
+
+IndicationThrottle::IndicationThrottle() : mFilter(static_cast<int32_t>(IndicationFilter::ALL)) {}
+
+IndicationThrottle::Pending IndicationThrottle::setFilter(hidl_bitfield<IndicationFilter> filter) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mFilter = filter;
+    Pending pending;
+    if (isEnabledLocked(IndicationFilter::SIGNAL_STRENGTH)) {
+        std::swap(pending.signalStrength, mPending.signalStrength);
+    }
+    if (isEnabledLocked(IndicationFilter::FULL_NETWORK_STATE)) {
+        std::swap(pending.networkStateChanged, mPending.networkStateChanged);
+    }
+    if (pending.signalStrength) {
+        // Becomes the reference of the next reports.
+        const Clock::time_point now = Clock::now();
+        for (size_t i = 0; i < kNumAccessNetworks; ++i) {
+            mAccessNetworks[i].reportedDbm =
+                    measuredDbm(*pending.signalStrength, static_cast<AccessNetwork>(i));
+            mAccessNetworks[i].reportedTime = now;
+        }
+        mSignalStrengthReported = true;
+    }
+    return pending;
+}
+
+bool IndicationThrottle::setSignalStrengthCriteria(AccessNetwork accessNetwork,
+                                                   int32_t hysteresisMs, int32_t hysteresisDb,
+                                                   const hidl_vec<int32_t>& thresholdsDbm) {
+    const size_t index = static_cast<size_t>(accessNetwork);
+    if (index == 0 || index >= kNumAccessNetworks || hysteresisMs < 0 || hysteresisDb < 0) {
+        return false;
+    }
+    std::vector<int32_t> thresholds(thresholdsDbm.begin(), thresholdsDbm.end());
+    std::sort(thresholds.begin(), thresholds.end());
+    // hysteresisDb must be smaller than the smallest threshold delta.
+    for (size_t i = 1; i < thresholds.size(); ++i) {
+        if (hysteresisDb > 0 && thresholds[i] - thresholds[i - 1] <= hysteresisDb) return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    SignalStrengthCriteria& criteria = mAccessNetworks[index].criteria;
+    criteria.hysteresis = std::chrono::milliseconds(hysteresisMs);
+    criteria.hysteresisDb = hysteresisDb;
+    criteria.thresholdsDbm = std::move(thresholds);
+    return true;
+}
+
+void IndicationThrottle::setCellInfoListRate(int32_t rateMs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mCellInfoListRateMs = std::max(rateMs, 0);
+}
+
+bool IndicationThrottle::onSignalStrength(const SignalStrength& signalStrength,
+                                          Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!isEnabledLocked(IndicationFilter::SIGNAL_STRENGTH)) {
+        mPending.signalStrength = signalStrength;
+        return false;
+    }
+
+    // Reported if any of the networks measured meets its criteria. The others are only compared
+    // against the last report, so that a change held back by hysteresisMs is reported with the
+    // first update after it expires.
+    bool report = !mSignalStrengthReported;
+    for (size_t i = 1; i < kNumAccessNetworks && !report; ++i) {
+        const AccessNetworkState& state = mAccessNetworks[i];
+        const std::optional<int32_t> dbm =
+                measuredDbm(signalStrength, static_cast<AccessNetwork>(i));
+        if (!dbm || !state.reportedDbm) {
+            // Service gained or lost on this network.
+            report = dbm.has_value() != state.reportedDbm.has_value();
+            continue;
+        }
+        if (now - state.reportedTime < state.criteria.hysteresis) continue;
+        report = crossesCriteria(state.criteria, *state.reportedDbm, *dbm);
+    }
+    if (!report) return false;
+
+    for (size_t i = 0; i < kNumAccessNetworks; ++i) {
+        mAccessNetworks[i].reportedDbm = measuredDbm(signalStrength, static_cast<AccessNetwork>(i));
+        mAccessNetworks[i].reportedTime = now;
+    }
+    mSignalStrengthReported = true;
+    return true;
+}
+
+bool IndicationThrottle::onCellInfoList(const hidl_vec<CellInfo>& records, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mCellInfoListRateMs == INT_MAX) return false;
+    if (mReportedCellInfo) {
+        if (*mReportedCellInfo == records) return false;
+        if (now - mCellInfoReportedTime < std::chrono::milliseconds(mCellInfoListRateMs)) {
+            return false;
+        }
+    }
+    mReportedCellInfo = records;
+    mCellInfoReportedTime = now;
+    return true;
+}
+
+bool IndicationThrottle::onNetworkStateChanged() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!isEnabledLocked(IndicationFilter::FULL_NETWORK_STATE)) {
+        // Carries no state, so any number of them coalesce into one.
+        mPending.networkStateChanged = true;
+        return false;
+    }
+    return true;
+}
+
+bool IndicationThrottle::onLinkCapacityEstimate() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return isEnabledLocked(IndicationFilter::LINK_CAPACITY_ESTIMATE);
+}
+
+bool IndicationThrottle::onPhysicalChannelConfigs() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return isEnabledLocked(IndicationFilter::PHYSICAL_CHANNEL_CONFIG);
+}
+
+// The measured quantity the criteria of the network apply to, in dBm, if it is valid.
+std::optional<int32_t> IndicationThrottle::measuredDbm(const SignalStrength& signalStrength,
+                                                       AccessNetwork accessNetwork) {
+    switch (accessNetwork) {
+        case AccessNetwork::GERAN: {
+            // RSSI in ASU, as defined in TS 27.007 8.5.
+            const uint32_t asu = signalStrength.gsm.signalStrength;
+            if (asu <= 31) return -113 + 2 * static_cast<int32_t>(asu);
+            break;
+        }
+        case AccessNetwork::UTRAN: {
+            // RSCP as defined in TS 27.007 8.69.
+            const uint32_t rscp = signalStrength.wcdma.rscp;
+            if (rscp <= 96) return static_cast<int32_t>(rscp) - 120;
+            break;
+        }
+        case AccessNetwork::EUTRAN: {
+            // RSRP in dBm multiplied by -1.
+            const uint32_t rsrp = signalStrength.lte.rsrp;
+            if (rsrp >= 44 && rsrp <= 140) return -static_cast<int32_t>(rsrp);
+            break;
+        }
+        case AccessNetwork::CDMA2000: {
+            // RSSI in dBm multiplied by -1.
+            const uint32_t dbm = signalStrength.cdma.dbm;
+            if (dbm > 0 && dbm < INT_MAX) return -static_cast<int32_t>(dbm);
+            break;
+        }
+        default:
+            break;
+    }
+    return std::nullopt;
+}
+
+bool IndicationThrottle::crossesCriteria(const SignalStrengthCriteria& criteria,
+                                         int32_t reportedDbm, int32_t dbm) {
+    if (dbm == reportedDbm) return false;
+    if (criteria.hysteresisDb > 0 && std::abs(dbm - reportedDbm) < criteria.hysteresisDb) {
+        return false;
+    }
+    if (criteria.thresholdsDbm.empty()) return true;
+    // A threshold is crossed if it lies between the two values.
+    const auto [low, high] = std::minmax(reportedDbm, dbm);
+    const auto it =
+            std::upper_bound(criteria.thresholdsDbm.begin(), criteria.thresholdsDbm.end(), low);
+    return it != criteria.thresholdsDbm.end() && *it <= high;
+}
+
+bool IndicationThrottle::isEnabledLocked(IndicationFilter indication) const {
+    return (mFilter & static_cast<int32_t>(indication)) != 0;
+}
+
+}  // namespace implementation
+}  // namespace V1_2
+}  // namespace radio
+}  // namespace hardware
+}  // namespace android
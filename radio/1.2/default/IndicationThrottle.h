@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_RADIO_V1_2_INDICATIONTHROTTLE_H
+#define ANDROID_HARDWARE_RADIO_V1_2_INDICATIONTHROTTLE_H
+
+#include <android/hardware/radio/1.2/types.h>
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace radio {
+namespace V1_2 {
+namespace implementation {
+
+using ::android::hardware::hidl_bitfield;
+using ::android::hardware::hidl_vec;
+
+/**
+ * Decides which unsolicited indications of the modem are worth waking up the framework for,
+ * according to setIndicationFilter, setSignalStrengthReportingCriteria and setCellInfoListRate.
+ * Indications the framework is not interested in are dropped, or coalesced into the next one that
+ * is reported. This class does not deliver anything itself, and is safe to use from the binder
+ * threads and the thread reading the modem at the same time.
+ */
+class IndicationThrottle {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Indications held back by the filter, to deliver once it enables them again.
+    struct Pending {
+        std::optional<::android::hardware::radio::V1_2::SignalStrength> signalStrength;
+        bool networkStateChanged = false;
+    };
+
+    IndicationThrottle();
+
+    // Returns the indications to deliver now that the filter enables them.
+    Pending setFilter(hidl_bitfield<::android::hardware::radio::V1_2::IndicationFilter> filter);
+
+    // Returns false if the criteria are invalid.
+    bool setSignalStrengthCriteria(::android::hardware::radio::V1_2::AccessNetwork accessNetwork,
+                                   int32_t hysteresisMs, int32_t hysteresisDb,
+                                   const hidl_vec<int32_t>& thresholdsDbm);
+
+    // Minimum time in milliseconds between two cell info lists. 0 reports every list that differs
+    // from the previous one, and INT_MAX none.
+    void setCellInfoListRate(int32_t rateMs);
+
+    // Each returns true if the indication must be delivered now.
+    bool onSignalStrength(const ::android::hardware::radio::V1_2::SignalStrength& signalStrength,
+                          Clock::time_point now);
+    bool onCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records,
+                        Clock::time_point now);
+    bool onNetworkStateChanged();
+    bool onLinkCapacityEstimate();
+    bool onPhysicalChannelConfigs();
+
+  private:
+    // The access networks that setSignalStrengthReportingCriteria applies to, indexed by their
+    // value. IWLAN has no signal strength to report on.
+    static constexpr size_t kNumAccessNetworks =
+            static_cast<size_t>(::android::hardware::radio::V1_2::AccessNetwork::CDMA2000) + 1;
+
+    struct SignalStrengthCriteria {
+        Clock::duration hysteresis{0};
+        int32_t hysteresisDb = 0;
+        std::vector<int32_t> thresholdsDbm;  // sorted
+    };
+
+    struct AccessNetworkState {
+        SignalStrengthCriteria criteria;
+        // The measurement of the last signal strength reported, if it had one for this network.
+        std::optional<int32_t> reportedDbm;
+        Clock::time_point reportedTime;
+    };
+
+    static std::optional<int32_t> measuredDbm(
+            const ::android::hardware::radio::V1_2::SignalStrength& signalStrength,
+            ::android::hardware::radio::V1_2::AccessNetwork accessNetwork);
+    static bool crossesCriteria(const SignalStrengthCriteria& criteria, int32_t reportedDbm,
+                                int32_t dbm);
+
+    bool isEnabledLocked(::android::hardware::radio::V1_2::IndicationFilter indication) const;
+
+    std::mutex mLock;
+    hidl_bitfield<::android::hardware::radio::V1_2::IndicationFilter> mFilter;
+    Pending mPending;
+    std::array<AccessNetworkState, kNumAccessNetworks> mAccessNetworks;
+    bool mSignalStrengthReported = false;
+    int32_t mCellInfoListRateMs = 0;
+    std::optional<hidl_vec<::android::hardware::radio::V1_2::CellInfo>> mReportedCellInfo;
+    Clock::time_point mCellInfoReportedTime;
+};
+
+}  // namespace implementation
+}  // namespace V1_2
+}  // namespace radio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_RADIO_V1_2_INDICATIONTHROTTLE_H
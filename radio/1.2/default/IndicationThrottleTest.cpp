@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <climits>
+
+#include <gtest/gtest.h>
+
+#include "IndicationThrottle.h"
+
+using namespace android::hardware::radio::V1_2;
+using namespace android::hardware::radio::V1_2::implementation;
+using namespace std::chrono_literals;
+
+using android::hardware::hidl_vec;
+
+// A signal strength with only an LTE measurement, of the given RSRP in dBm.
+static SignalStrength lteSignalStrength(int32_t rsrpDbm) {
+    SignalStrength signalStrength = {};
+    signalStrength.gsm.signalStrength = INT_MAX;
+    signalStrength.wcdma.rscp = INT_MAX;
+    signalStrength.cdma.dbm = INT_MAX;
+    signalStrength.lte.rsrp = -rsrpDbm;
+    return signalStrength;
+}
+
+static hidl_vec<CellInfo> cellInfoList(uint64_t timeStamp) {
+    hidl_vec<CellInfo> records(1);
+    records[0].cellInfoType = android::hardware::radio::V1_0::CellInfoType::LTE;
+    records[0].registered = true;
+    records[0].timeStamp = timeStamp;
+    return records;
+}
+
+class IndicationThrottleTest : public testing::Test {
+  protected:
+    IndicationThrottle throttle;
+    const IndicationThrottle::Clock::time_point start = IndicationThrottle::Clock::now();
+};
+
+TEST_F(IndicationThrottleTest, FirstSignalStrengthIsReported) {
+    ASSERT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 0, {-100}));
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-90), start));
+}
+
+TEST_F(IndicationThrottleTest, InvalidCriteriaAreRejected) {
+    EXPECT_FALSE(throttle.setSignalStrengthCriteria(AccessNetwork::IWLAN, 0, 0, {-100}));
+    EXPECT_FALSE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, -1, 0, {-100}));
+    EXPECT_FALSE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, -1, {-100}));
+    // The hysteresis must be smaller than the distance between two thresholds.
+    EXPECT_FALSE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 5, {-100, -95}));
+    EXPECT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 4, {-95, -100}));
+}
+
+TEST_F(IndicationThrottleTest, ThresholdCrossings) {
+    ASSERT_TRUE(
+            throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 0, {-110, -100, -90}));
+    ASSERT_TRUE(throttle.onSignalStrength(lteSignalStrength(-105), start));
+
+    // Within the same band.
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-103), start + 1s));
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-109), start + 2s));
+    // Upwards, then downwards across -100.
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-98), start + 3s));
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-91), start + 4s));
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-101), start + 5s));
+    // Across two thresholds at once.
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-80), start + 6s));
+}
+
+TEST_F(IndicationThrottleTest, NoThresholdsReportsEveryChange) {
+    ASSERT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 0, {}));
+    ASSERT_TRUE(throttle.onSignalStrength(lteSignalStrength(-105), start));
+
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-105), start + 1s));
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-104), start + 2s));
+}
+
+TEST_F(IndicationThrottleTest, HysteresisDb) {
+    ASSERT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 0, 3, {-100}));
+    ASSERT_TRUE(throttle.onSignalStrength(lteSignalStrength(-101), start));
+
+    // Crosses the threshold, but by less than the hysteresis.
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-99), start + 1s));
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-98), start + 2s));
+    // Measured against the last report, not the last update.
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-100), start + 3s));
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-101), start + 4s));
+}
+
+TEST_F(IndicationThrottleTest, HysteresisMs) {
+    ASSERT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 1000, 0, {-100}));
+    ASSERT_TRUE(throttle.onSignalStrength(lteSignalStrength(-105), start));
+
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-95), start + 500ms));
+    // The crossing held back is reported with the first update after the hysteresis.
+    EXPECT_TRUE(throttle.onSignalStrength(lteSignalStrength(-95), start + 1000ms));
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-105), start + 1500ms));
+}
+
+TEST_F(IndicationThrottleTest, LostServiceIsReported) {
+    ASSERT_TRUE(throttle.setSignalStrengthCriteria(AccessNetwork::EUTRAN, 1000, 0, {-100}));
+    ASSERT_TRUE(throttle.onSignalStrength(lteSignalStrength(-105), start));
+
+    SignalStrength noService = lteSignalStrength(-105);
+    noService.lte.rsrp = INT_MAX;
+    EXPECT_TRUE(throttle.onSignalStrength(noService, start + 1ms));
+}
+
+TEST_F(IndicationThrottleTest, FilteredSignalStrengthIsDeliveredWhenEnabled) {
+    throttle.setFilter(static_cast<int32_t>(IndicationFilter::NONE));
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-105), start));
+    EXPECT_FALSE(throttle.onSignalStrength(lteSignalStrength(-95), start + 1s));
+
+    const IndicationThrottle::Pending pending =
+            throttle.setFilter(static_cast<int32_t>(IndicationFilter::SIGNAL_STRENGTH));
+    ASSERT_TRUE(pending.signalStrength.has_value());
+    EXPECT_EQ(95u, pending.signalStrength->lte.rsrp);
+    EXPECT_FALSE(pending.networkStateChanged);
+}
+
+TEST_F(IndicationThrottleTest, CellInfoListRate) {
+    throttle.setCellInfoListRate(1000);
+    EXPECT_TRUE(throttle.onCellInfoList(cellInfoList(1), start));
+
+    // Unchanged lists are never reported, changed ones at most once per rate.
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(1), start + 500ms));
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(2), start + 500ms));
+    EXPECT_TRUE(throttle.onCellInfoList(cellInfoList(2), start + 1000ms));
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(2), start + 5s));
+}
+
+TEST_F(IndicationThrottleTest, CellInfoListRateZeroReportsEveryChange) {
+    throttle.setCellInfoListRate(0);
+    EXPECT_TRUE(throttle.onCellInfoList(cellInfoList(1), start));
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(1), start));
+    EXPECT_TRUE(throttle.onCellInfoList(cellInfoList(2), start));
+}
+
+TEST_F(IndicationThrottleTest, CellInfoListRateMaxReportsNone) {
+    throttle.setCellInfoListRate(INT_MAX);
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(1), start));
+    EXPECT_FALSE(throttle.onCellInfoList(cellInfoList(2), start + 1h));
+}
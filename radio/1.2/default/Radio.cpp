@@ -21,6 +21,19 @@ namespace radio {
 namespace V1_2 {
 namespace implementation {
 
+using ::android::hardware::radio::V1_0::RadioError;
+using ::android::hardware::radio::V1_0::RadioIndicationType;
+using ::android::hardware::radio::V1_0::RadioResponseInfo;
+using ::android::hardware::radio::V1_0::RadioResponseType;
+
+static RadioResponseInfo makeResponseInfo(int32_t serial, RadioError error) {
+    RadioResponseInfo info;
+    info.serial = serial;
+    info.type = RadioResponseType::SOLICITED;
+    info.error = error;
+    return info;
+}
+
 // Methods from ::android::hardware::radio::V1_0::IRadio follow.
 Return<void> Radio::setResponseFunctions(
     const sp<::android::hardware::radio::V1_0::IRadioResponse>& radioResponse,
@@ -645,8 +658,11 @@ Return<void> Radio::getCellInfoList(int32_t /* serial */) {
     return Void();
 }
 
-Return<void> Radio::setCellInfoListRate(int32_t /* serial */, int32_t /*rate */) {
-    // TODO implement
+Return<void> Radio::setCellInfoListRate(int32_t serial, int32_t rate) {
+    mIndicationThrottle.setCellInfoListRate(rate);
+    if (mRadioResponse != nullptr) {
+        mRadioResponse->setCellInfoListRateResponse(makeResponseInfo(serial, RadioError::NONE));
+    }
     return Void();
 }
 
@@ -802,10 +818,10 @@ Return<void> Radio::sendDeviceState(
     return Void();
 }
 
-Return<void> Radio::setIndicationFilter(int32_t /* serial */,
-                                        hidl_bitfield<IndicationFilter> /* indicationFilter */) {
-    // TODO implement
-    return Void();
+Return<void> Radio::setIndicationFilter(int32_t serial,
+                                        hidl_bitfield<IndicationFilter> indicationFilter) {
+    // The bits of the 1.0 filter keep their meaning in 1.2.
+    return setIndicationFilter_1_2(serial, indicationFilter);
 }
 
 Return<void> Radio::setSimCardPower(int32_t /* serial */, bool /* powerUp */) {
@@ -864,17 +880,33 @@ Return<void> Radio::startNetworkScan_1_2(
     return Void();
 }
 
-Return<void> Radio::setIndicationFilter_1_2(
-    int32_t /* serial */, hidl_bitfield<IndicationFilter> /* indicationFilter */) {
-    // TODO implement
+Return<void> Radio::setIndicationFilter_1_2(int32_t serial,
+                                            hidl_bitfield<IndicationFilter> indicationFilter) {
+    // Indications held back while they were filtered out are now due.
+    const IndicationThrottle::Pending pending = mIndicationThrottle.setFilter(indicationFilter);
+    if (mRadioResponse != nullptr) {
+        mRadioResponse->setIndicationFilterResponse(makeResponseInfo(serial, RadioError::NONE));
+    }
+    if (pending.signalStrength && mRadioIndicationV1_2 != nullptr) {
+        mRadioIndicationV1_2->currentSignalStrength_1_2(RadioIndicationType::UNSOLICITED,
+                                                        *pending.signalStrength);
+    }
+    if (pending.networkStateChanged && mRadioIndication != nullptr) {
+        mRadioIndication->networkStateChanged(RadioIndicationType::UNSOLICITED);
+    }
     return Void();
 }
 
 Return<void> Radio::setSignalStrengthReportingCriteria(
-    int32_t /* serial */, int32_t /*hysteresisMs*/, int32_t /*hysteresisDb */,
-    const hidl_vec<int32_t>& /* thresholdsDbm */,
-    ::android::hardware::radio::V1_2::AccessNetwork /* accessNetwork */) {
-    // TODO implement
+    int32_t serial, int32_t hysteresisMs, int32_t hysteresisDb,
+    const hidl_vec<int32_t>& thresholdsDbm,
+    ::android::hardware::radio::V1_2::AccessNetwork accessNetwork) {
+    const bool valid = mIndicationThrottle.setSignalStrengthCriteria(accessNetwork, hysteresisMs,
+                                                                     hysteresisDb, thresholdsDbm);
+    if (mRadioResponseV1_2 != nullptr) {
+        mRadioResponseV1_2->setSignalStrengthReportingCriteriaResponse(makeResponseInfo(
+            serial, valid ? RadioError::NONE : RadioError::INVALID_ARGUMENTS));
+    }
     return Void();
 }
 
@@ -904,6 +936,43 @@ Return<void> Radio::deactivateDataCall_1_2(
     return Void();
 }
 
+void Radio::onSignalStrength(
+    const ::android::hardware::radio::V1_2::SignalStrength& signalStrength) {
+    if (mRadioIndicationV1_2 == nullptr ||
+        !mIndicationThrottle.onSignalStrength(signalStrength, IndicationThrottle::Clock::now())) {
+        return;
+    }
+    mRadioIndicationV1_2->currentSignalStrength_1_2(RadioIndicationType::UNSOLICITED,
+                                                    signalStrength);
+}
+
+void Radio::onCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records) {
+    if (mRadioIndicationV1_2 == nullptr ||
+        !mIndicationThrottle.onCellInfoList(records, IndicationThrottle::Clock::now())) {
+        return;
+    }
+    mRadioIndicationV1_2->cellInfoList_1_2(RadioIndicationType::UNSOLICITED, records);
+}
+
+void Radio::onNetworkStateChanged() {
+    if (mRadioIndication == nullptr || !mIndicationThrottle.onNetworkStateChanged()) return;
+    mRadioIndication->networkStateChanged(RadioIndicationType::UNSOLICITED);
+}
+
+void Radio::onLinkCapacityEstimate(
+    const ::android::hardware::radio::V1_2::LinkCapacityEstimate& lce) {
+    if (mRadioIndicationV1_2 == nullptr || !mIndicationThrottle.onLinkCapacityEstimate()) return;
+    mRadioIndicationV1_2->currentLinkCapacityEstimate(RadioIndicationType::UNSOLICITED, lce);
+}
+
+void Radio::onPhysicalChannelConfigs(
+    const hidl_vec<::android::hardware::radio::V1_2::PhysicalChannelConfig>& configs) {
+    if (mRadioIndicationV1_2 == nullptr || !mIndicationThrottle.onPhysicalChannelConfigs()) {
+        return;
+    }
+    mRadioIndicationV1_2->currentPhysicalChannelConfigs(RadioIndicationType::UNSOLICITED, configs);
+}
+
 }  // namespace implementation
 }  // namespace V1_2
 }  // namespace radio
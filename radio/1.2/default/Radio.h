@@ -23,6 +23,8 @@
 #include <hidl/Status.h>
 #include <log/log.h>
 
+#include "IndicationThrottle.h"
+
 namespace android {
 namespace hardware {
 namespace radio {
@@ -44,6 +46,20 @@ struct Radio : public IRadio {
     sp<::android::hardware::radio::V1_1::IRadioIndication> mRadioIndicationV1_1;
     sp<::android::hardware::radio::V1_2::IRadioResponse> mRadioResponseV1_2;
     sp<::android::hardware::radio::V1_2::IRadioIndication> mRadioIndicationV1_2;
+    IndicationThrottle mIndicationThrottle;
+
+    /**
+     * Unsolicited indications of the radio. Vendor code reading the modem calls these rather than
+     * mRadioIndication, so that the indications the framework has no use for, as set by
+     * setIndicationFilter, setSignalStrengthReportingCriteria and setCellInfoListRate, do not
+     * wake up the application processor.
+     */
+    void onSignalStrength(const ::android::hardware::radio::V1_2::SignalStrength& signalStrength);
+    void onCellInfoList(const hidl_vec<::android::hardware::radio::V1_2::CellInfo>& records);
+    void onNetworkStateChanged();
+    void onLinkCapacityEstimate(const ::android::hardware::radio::V1_2::LinkCapacityEstimate& lce);
+    void onPhysicalChannelConfigs(
+        const hidl_vec<::android::hardware::radio::V1_2::PhysicalChannelConfig>& configs);
 
     // Methods from ::android::hardware::radio::V1_0::IRadio follow.
     Return<void> setResponseFunctions(
@@ -64,6 +64,15 @@ static std::vector<RsType> hidl_to_rs(const hidl_vec<HidlType>& src, Operation o
     return dst;
 }
 
+// Kernel launches are issued every frame, so their input allocations are converted into a
+// per-thread array rather than a new vector per call.
+static const RsAllocation* hidl_to_rs_allocations(const hidl_vec<Allocation>& src) {
+    thread_local std::vector<RsAllocation> dst;
+    dst.resize(src.size());
+    std::transform(src.begin(), src.end(), dst.begin(), [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    return dst.data();
+}
+
 template<typename ReturnType, typename SourceType>
 static ReturnType rs_to_hidl(SourceType* src) {
     return static_cast<ReturnType>(reinterpret_cast<uintptr_t>(src));
@@ -663,24 +672,24 @@ Return<void> Context::scriptInvokeV(Script vs, uint32_t slot, const hidl_vec<uin
 Return<void> Context::scriptForEach(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, const hidl_vec<uint8_t>& params, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    const RsAllocation* _vains = hidl_to_rs_allocations(vains);
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const void* _paramsPtr = hidl_to_rs<const void*>(params.data());
     size_t _paramLen = params.size();
     const RsScriptCall* _sc = hidl_to_rs<const RsScriptCall*>(sc);
     size_t _scLen = _sc != nullptr ? sizeof(ScriptCall) : 0;
-    Device::getHal().ScriptForEachMulti(mContext, _vs, _slot, _vains.data(), _vains.size(), _vaout, _paramsPtr, _paramLen, _sc, _scLen);
+    Device::getHal().ScriptForEachMulti(mContext, _vs, _slot, _vains, vains.size(), _vaout, _paramsPtr, _paramLen, _sc, _scLen);
     return Void();
 }
 
 Return<void> Context::scriptReduce(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    const RsAllocation* _vains = hidl_to_rs_allocations(vains);
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const RsScriptCall* _sc = hidl_to_rs<const RsScriptCall*>(sc);
     size_t _scLen = _sc != nullptr ? sizeof(ScriptCall) : 0;
-    Device::getHal().ScriptReduce(mContext, _vs, _slot, _vains.data(), _vains.size(), _vaout, _sc, _scLen);
+    Device::getHal().ScriptReduce(mContext, _vs, _slot, _vains, vains.size(), _vaout, _sc, _scLen);
     return Void();
 }
 
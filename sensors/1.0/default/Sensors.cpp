@@ -224,7 +224,7 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     }
 
     out.resize(count);
-    convertFromSensorEvents(err, data.get(), &out);
+    convertFromSensorEvents(data.get(), count, out.data());
 
     _hidl_cb(Result::OK, out, dynamicSensorsAdded);
 
@@ -328,19 +328,6 @@ Return<void> Sensors::configDirectReport(
     return Void();
 }
 
-// static
-void Sensors::convertFromSensorEvents(
-        size_t count,
-        const sensors_event_t *srcArray,
-        hidl_vec<Event> *dstVec) {
-    for (size_t i = 0; i < count; ++i) {
-        const sensors_event_t &src = srcArray[i];
-        Event *dst = &(*dstVec)[i];
-
-        convertFromSensorEvent(src, dst);
-    }
-}
-
 ISensors *HIDL_FETCH_ISensors(const char * /* hal */) {
     Sensors *sensors = new Sensors;
     if (sensors->initCheck() != OK) {
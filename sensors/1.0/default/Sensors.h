@@ -71,9 +71,6 @@ private:
 
     int getHalDeviceVersion() const;
 
-    static void convertFromSensorEvents(
-            size_t count, const sensors_event_t *src, hidl_vec<Event> *dst);
-
     DISALLOW_COPY_AND_ASSIGN(Sensors);
 };
 
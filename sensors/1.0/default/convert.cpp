@@ -18,12 +18,76 @@
 
 #include <android-base/logging.h>
 
+#include <array>
+#include <cstddef>
+#include <cstring>
+
 namespace android {
 namespace hardware {
 namespace sensors {
 namespace V1_0 {
 namespace implementation {
 
+namespace {
+
+// The payloads below are laid out the same in Event and in sensors_event_t, up to their size.
+static_assert(offsetof(Vec3, status) == offsetof(sensors_vec_t, status),
+              "Vec3 must be laid out as sensors_vec_t");
+static_assert(offsetof(Uncal, x_bias) == offsetof(uncalibrated_event_t, x_bias),
+              "Uncal must be laid out as uncalibrated_event_t");
+static_assert(offsetof(HeartRate, status) == offsetof(heart_rate_event_t, status),
+              "HeartRate must be laid out as heart_rate_event_t");
+static_assert(offsetof(sensors_event_t, u64.step_counter) == offsetof(sensors_event_t, data),
+              "The step counter must be at the start of the payload");
+
+constexpr size_t kNumCopiedSensorTypes = 64;
+
+/**
+ * The number of payload bytes copied as is between Event and sensors_event_t, by sensor type, or 0
+ * for the types which are converted field by field.
+ */
+constexpr std::array<uint8_t, kNumCopiedSensorTypes> kCopiedPayloadSizes = [] {
+    std::array<uint8_t, kNumCopiedSensorTypes> sizes{};
+    for (SensorType type : {SensorType::ACCELEROMETER, SensorType::MAGNETIC_FIELD,
+                            SensorType::ORIENTATION, SensorType::GYROSCOPE, SensorType::GRAVITY,
+                            SensorType::LINEAR_ACCELERATION}) {
+        sizes[static_cast<size_t>(type)] = offsetof(Vec3, status) + sizeof(SensorStatus);
+    }
+    sizes[static_cast<size_t>(SensorType::GAME_ROTATION_VECTOR)] = 4 * sizeof(float);
+    sizes[static_cast<size_t>(SensorType::ROTATION_VECTOR)] = 5 * sizeof(float);
+    sizes[static_cast<size_t>(SensorType::GEOMAGNETIC_ROTATION_VECTOR)] = 5 * sizeof(float);
+    for (SensorType type : {SensorType::MAGNETIC_FIELD_UNCALIBRATED,
+                            SensorType::GYROSCOPE_UNCALIBRATED,
+                            SensorType::ACCELEROMETER_UNCALIBRATED}) {
+        sizes[static_cast<size_t>(type)] = sizeof(Uncal);
+    }
+    for (SensorType type :
+         {SensorType::DEVICE_ORIENTATION, SensorType::LIGHT, SensorType::PRESSURE,
+          SensorType::TEMPERATURE, SensorType::PROXIMITY, SensorType::RELATIVE_HUMIDITY,
+          SensorType::AMBIENT_TEMPERATURE, SensorType::SIGNIFICANT_MOTION,
+          SensorType::STEP_DETECTOR, SensorType::TILT_DETECTOR, SensorType::WAKE_GESTURE,
+          SensorType::GLANCE_GESTURE, SensorType::PICK_UP_GESTURE,
+          SensorType::WRIST_TILT_GESTURE, SensorType::STATIONARY_DETECT,
+          SensorType::MOTION_DETECT, SensorType::HEART_BEAT,
+          SensorType::LOW_LATENCY_OFFBODY_DETECT}) {
+        sizes[static_cast<size_t>(type)] = sizeof(float);
+    }
+    sizes[static_cast<size_t>(SensorType::STEP_COUNTER)] = sizeof(uint64_t);
+    sizes[static_cast<size_t>(SensorType::HEART_RATE)] =
+            offsetof(HeartRate, status) + sizeof(SensorStatus);
+    sizes[static_cast<size_t>(SensorType::POSE_6DOF)] = 15 * sizeof(float);
+    return sizes;
+}();
+
+size_t getCopiedPayloadSize(int32_t sensorType) {
+    if (sensorType < 0 || sensorType >= static_cast<int32_t>(kNumCopiedSensorTypes)) {
+        return 0;
+    }
+    return kCopiedPayloadSizes[sensorType];
+}
+
+}  // namespace
+
 void convertFromSensor(const sensor_t &src, SensorInfo *dst) {
     dst->name = src.name;
     dst->vendor = src.vendor;
@@ -339,6 +403,40 @@ void convertToSensorEvent(const Event &src, sensors_event_t *dst) {
     }
 }
 
+void convertFromSensorEvents(const sensors_event_t *src, size_t count, Event *dst) {
+    for (size_t i = 0; i < count; ++i) {
+        size_t payloadSize = getCopiedPayloadSize(src[i].type);
+        if (payloadSize == 0) {
+            convertFromSensorEvent(src[i], &dst[i]);
+            continue;
+        }
+
+        dst[i].timestamp = src[i].timestamp;
+        dst[i].sensorHandle = src[i].sensor;
+        dst[i].sensorType = (SensorType)src[i].type;
+        uint8_t *payload = reinterpret_cast<uint8_t *>(&dst[i].u);
+        memcpy(payload, src[i].data, payloadSize);
+        memset(payload + payloadSize, 0, sizeof(dst[i].u) - payloadSize);
+    }
+}
+
+void convertToSensorEvents(const Event *src, size_t count, sensors_event_t *dst) {
+    for (size_t i = 0; i < count; ++i) {
+        size_t payloadSize = getCopiedPayloadSize((int32_t)src[i].sensorType);
+        if (payloadSize == 0) {
+            convertToSensorEvent(src[i], &dst[i]);
+            continue;
+        }
+
+        dst[i] = {.version = sizeof(sensors_event_t),
+                  .sensor = src[i].sensorHandle,
+                  .type = (int32_t)src[i].sensorType,
+                  .reserved0 = 0,
+                  .timestamp = src[i].timestamp};
+        memcpy(dst[i].data, &src[i].u, payloadSize);
+    }
+}
+
 bool convertFromSharedMemInfo(const SharedMemInfo& memIn, sensors_direct_mem_t *memOut) {
     if (memOut == nullptr) {
         return false;
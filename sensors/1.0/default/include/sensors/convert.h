@@ -33,6 +33,11 @@ void convertToSensor(const SensorInfo &src, sensor_t *dst);
 void convertFromSensorEvent(const sensors_event_t &src, Event *dst);
 void convertToSensorEvent(const Event &src, sensors_event_t *dst);
 
+// Convert arrays of events, copying the payloads laid out the same in both types as is instead of
+// field by field.
+void convertFromSensorEvents(const sensors_event_t *src, size_t count, Event *dst);
+void convertToSensorEvents(const Event *src, size_t count, sensors_event_t *dst);
+
 bool convertFromSharedMemInfo(const SharedMemInfo& memIn, sensors_direct_mem_t *memOut);
 int convertFromRateLevel(RateLevel rate);
 
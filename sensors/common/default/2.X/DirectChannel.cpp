@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirectChannel.h"
+
+#include <cutils/ashmem.h>
+#include <log/log.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_X {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::SensorsEventFormatOffset;
+using ::android::hardware::sensors::V1_0::SharedMemFormat;
+using ::android::hardware::sensors::V1_0::SharedMemType;
+
+namespace {
+
+constexpr size_t kEventSize = static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+constexpr size_t kDataSize = static_cast<size_t>(SensorsEventFormatOffset::RESERVED) -
+                             static_cast<size_t>(SensorsEventFormatOffset::DATA);
+
+template <typename T>
+void writeField(uint8_t* event, SensorsEventFormatOffset offset, T value) {
+    memcpy(event + static_cast<size_t>(offset), &value, sizeof(value));
+}
+
+}  // namespace
+
+DirectChannel::DirectChannel(const SharedMemInfo& mem)
+    : mType(mem.type), mBuffer(nullptr), mSize(0), mWriteOffset(0), mCounter(0) {
+    const native_handle_t* handle = mem.memoryHandle.getNativeHandle();
+    if (mem.type != SharedMemType::ASHMEM || mem.format != SharedMemFormat::SENSORS_EVENT ||
+        mem.size < kEventSize || handle == nullptr || handle->numFds < 1) {
+        return;
+    }
+
+    int fd = handle->data[0];
+    int regionSize = ashmem_get_size_region(fd);
+    if (regionSize < 0 || static_cast<uint32_t>(regionSize) < mem.size) {
+        ALOGE("Direct channel memory of size %d is smaller than %" PRIu32, regionSize, mem.size);
+        return;
+    }
+
+    // The mapping outlives the handle, which is closed once the registration call returns
+    void* buffer = mmap(nullptr, mem.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        return;
+    }
+
+    mBuffer = static_cast<uint8_t*>(buffer);
+    mSize = mem.size;
+    memset(mBuffer, 0, mSize);
+}
+
+DirectChannel::~DirectChannel() {
+    if (mBuffer != nullptr) {
+        munmap(mBuffer, mSize);
+    }
+}
+
+bool DirectChannel::isValid() const {
+    return mBuffer != nullptr;
+}
+
+SharedMemType DirectChannel::getType() const {
+    return mType;
+}
+
+void DirectChannel::write(int32_t reportToken, const std::vector<Event>& events) {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    for (const Event& event : events) {
+        if (mWriteOffset + kEventSize > mSize) {
+            mWriteOffset = 0;
+        }
+        uint8_t* dest = mBuffer + mWriteOffset;
+        mWriteOffset += kEventSize;
+
+        // Zero the counter first, so that the reader doesn't take the event being overwritten
+        // for a complete one
+        uint32_t* counter = reinterpret_cast<uint32_t*>(
+                dest + static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER));
+        __atomic_store_n(counter, 0, __ATOMIC_RELEASE);
+
+        writeField(dest, SensorsEventFormatOffset::SIZE_FIELD, static_cast<int32_t>(kEventSize));
+        writeField(dest, SensorsEventFormatOffset::REPORT_TOKEN, reportToken);
+        writeField(dest, SensorsEventFormatOffset::SENSOR_TYPE,
+                   static_cast<int32_t>(event.sensorType));
+        writeField(dest, SensorsEventFormatOffset::TIMESTAMP, event.timestamp);
+        memset(dest + static_cast<size_t>(SensorsEventFormatOffset::DATA), 0,
+               kEventSize - static_cast<size_t>(SensorsEventFormatOffset::DATA));
+        memcpy(dest + static_cast<size_t>(SensorsEventFormatOffset::DATA), &event.u,
+               std::min(sizeof(event.u), kDataSize));
+
+        if (++mCounter == 0) {
+            mCounter = 1;
+        }
+        __atomic_store_n(counter, mCounter, __ATOMIC_RELEASE);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_X
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
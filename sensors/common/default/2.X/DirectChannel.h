@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_X_DIRECTCHANNEL_H
+#define ANDROID_HARDWARE_SENSORS_V2_X_DIRECTCHANNEL_H
+
+#include <android/hardware/sensors/1.0/types.h>
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_X {
+namespace implementation {
+
+/**
+ * A shared memory region registered by the framework, where sensors report their events directly
+ * in the sensors_event_t format, bypassing the Event FMQ.
+ *
+ * The region is used as a ring buffer of events. Each event is stamped with an atomic counter,
+ * written last, which tells the reader that the event is complete and which event is the newest.
+ */
+class DirectChannel {
+  public:
+    using Event = ::android::hardware::sensors::V2_1::Event;
+    using SharedMemInfo = ::android::hardware::sensors::V1_0::SharedMemInfo;
+    using SharedMemType = ::android::hardware::sensors::V1_0::SharedMemType;
+
+    /**
+     * Maps the memory described by the SharedMemInfo and zeroes it. Only ashmem memory in the
+     * sensors_event_t format is supported, check isValid() for whether the mapping succeeded.
+     */
+    DirectChannel(const SharedMemInfo& mem);
+    ~DirectChannel();
+    DirectChannel(const DirectChannel&) = delete;
+    DirectChannel& operator=(const DirectChannel&) = delete;
+
+    bool isValid() const;
+    SharedMemType getType() const;
+
+    /**
+     * Writes the events to the channel, reported with the given token in place of their sensor
+     * handle. Sensors sharing the channel may write from their own threads.
+     */
+    void write(int32_t reportToken, const std::vector<Event>& events);
+
+  private:
+    SharedMemType mType;
+    uint8_t* mBuffer;
+    size_t mSize;
+
+    std::mutex mWriteLock;
+
+    /**
+     * Offset of the next event to write
+     */
+    size_t mWriteOffset;
+
+    /**
+     * Counter of the last event written. Zero means no event, so it is skipped when wrapping.
+     */
+    uint32_t mCounter;
+};
+
+}  // namespace implementation
+}  // namespace V2_X
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_X_DIRECTCHANNEL_H
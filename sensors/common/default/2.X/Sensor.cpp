@@ -18,6 +18,7 @@
 
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cmath>
 
 namespace android {
@@ -29,104 +30,175 @@ namespace implementation {
 using ::android::hardware::sensors::V1_0::EventPayload;
 using ::android::hardware::sensors::V1_0::MetaDataEventType;
 using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
 using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorFlagShift;
 using ::android::hardware::sensors::V1_0::SensorStatus;
+using ::android::hardware::sensors::V1_0::SharedMemType;
 using ::android::hardware::sensors::V2_1::Event;
 using ::android::hardware::sensors::V2_1::SensorInfo;
 using ::android::hardware::sensors::V2_1::SensorType;
 
+// Sensors due this soon after a wakeup of the scheduler are sampled along
+static constexpr int64_t kSchedulingWindowNs = 1000 * 1000;
+
+// Direct report sampling periods, at the nominal rate of each rate level
+static int64_t getDirectReportPeriodNs(RateLevel rate) {
+    switch (rate) {
+        case RateLevel::NORMAL:
+            return 1000 * 1000 * 1000 / 50;
+        case RateLevel::FAST:
+            return 1000 * 1000 * 1000 / 200;
+        case RateLevel::VERY_FAST:
+            return 1000 * 1000 * 1000 / 800;
+        default:
+            return 0;
+    }
+}
+
+// Returns whether a sample is due, and if it is moves the last sample time to it.
+static bool takeSample(int64_t* lastSampleTimeNs, int64_t samplingPeriodNs, int64_t now) {
+    // Don't sample fast sensors so early that their rate visibly changes
+    int64_t nextSampleTime = *lastSampleTimeNs + samplingPeriodNs;
+    if (nextSampleTime > now + std::min(kSchedulingWindowNs, samplingPeriodNs / 4)) {
+        return false;
+    }
+
+    // Keep to the sampling period when sampling a bit early or late, so that the rate doesn't
+    // drift. Start over from now after a longer pause, like when the sensor was just enabled.
+    *lastSampleTimeNs = (now - nextSampleTime < samplingPeriodNs) ? nextSampleTime : now;
+    return true;
+}
+
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
       mLastSampleTimeNs(0),
+      mMaxReportLatencyNs(0),
+      mFifoStartTimeNs(0),
+      mPendingFlushCount(0),
       mCallback(callback),
       mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
+    SensorScheduler::getInstance().addSensor(this);
 }
 
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    SensorScheduler::getInstance().removeSensor(this);
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int32_t samplingPeriodNs) {
+void Sensor::batch(int32_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelay * 1000) {
         samplingPeriodNs = mSensorInfo.minDelay * 1000;
     } else if (samplingPeriodNs > mSensorInfo.maxDelay * 1000) {
         samplingPeriodNs = mSensorInfo.maxDelay * 1000;
     }
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
+    // Sensors without a FIFO report every sample right away
+    if (mSensorInfo.fifoMaxEventCount == 0 || maxReportLatencyNs < 0) {
+        maxReportLatencyNs = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mRunMutex);
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        mMaxReportLatencyNs = maxReportLatencyNs;
+        mFifo.reserve(mSensorInfo.fifoMaxEventCount);
     }
+    // Wake up the scheduler to check if a new event should be generated now, or the batched
+    // events are due with the new latency
+    SensorScheduler::getInstance().wake();
 }
 
 void Sensor::activate(bool enable) {
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
-        mIsEnabled = enable;
-        mWaitCV.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(mRunMutex);
+            mIsEnabled = enable;
+            // Samples batched before the sensor was disabled would be stale once it is enabled
+            // again
+            mFifo.clear();
+        }
+        SensorScheduler::getInstance().wake();
     }
 }
 
 Result Sensor::flush() {
-    // Only generate a flush complete event if the sensor is enabled and if the sensor is not a
-    // one-shot sensor.
-    if (!mIsEnabled || (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE))) {
-        return Result::BAD_VALUE;
-    }
+    {
+        std::lock_guard<std::mutex> lock(mRunMutex);
+        // Only generate a flush complete event if the sensor is enabled and if the sensor is not a
+        // one-shot sensor.
+        if (!mIsEnabled ||
+            (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE))) {
+            return Result::BAD_VALUE;
+        }
 
-    // Note: If a sensor supports batching, write all of the currently batched events for the sensor
-    // to the Event FMQ prior to writing the flush complete event.
-    Event ev;
-    ev.sensorHandle = mSensorInfo.sensorHandle;
-    ev.sensorType = SensorType::META_DATA;
-    ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
-    std::vector<Event> evs{ev};
-    mCallback->postEvents(evs, isWakeUpSensor());
+        // The scheduler writes the flush complete event, right after the batched events
+        mPendingFlushCount++;
+    }
+    SensorScheduler::getInstance().wake();
 
     return Result::OK;
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
-}
-
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
-
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_REALTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
+int64_t Sensor::sample(int64_t now, std::vector<Event>* events) {
+    std::lock_guard<std::mutex> lock(mRunMutex);
+    int64_t nextSampleTime = INT64_MAX;
+
+    if (mMode == OperationMode::NORMAL) {
+        if (mIsEnabled) {
+            if (takeSample(&mLastSampleTimeNs, mSamplingPeriodNs, now)) {
+                std::vector<Event> sampled = readEvents();
+                if (mFifo.empty()) {
+                    mFifoStartTimeNs = now;
+                }
+                mFifo.insert(mFifo.end(), sampled.begin(), sampled.end());
             }
+            nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
+        }
 
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+        // Direct reports run at their own rate, whether the sensor is enabled or not
+        for (auto& report : mDirectReports) {
+            DirectReport& directReport = report.second;
+            if (takeSample(&directReport.lastSampleTimeNs, directReport.samplingPeriodNs, now)) {
+                directReport.channel->write(mSensorInfo.sensorHandle, readEvents());
+            }
+            nextSampleTime = std::min(nextSampleTime, directReport.lastSampleTimeNs +
+                                                              directReport.samplingPeriodNs);
         }
     }
+
+    if (isFifoDue(now) || mPendingFlushCount > 0) {
+        events->insert(events->end(), mFifo.begin(), mFifo.end());
+        mFifo.clear();
+    }
+
+    for (; mPendingFlushCount > 0; mPendingFlushCount--) {
+        Event ev;
+        ev.sensorHandle = mSensorInfo.sensorHandle;
+        ev.sensorType = SensorType::META_DATA;
+        ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
+        events->push_back(ev);
+    }
+
+    // Wake up in time to deliver the batched samples, in case the sensor stops sampling
+    if (!mFifo.empty() && mMaxReportLatencyNs < INT64_MAX - mFifoStartTimeNs) {
+        nextSampleTime = std::min(nextSampleTime, mFifoStartTimeNs + mMaxReportLatencyNs);
+    }
+
+    return nextSampleTime;
+}
+
+bool Sensor::isFifoDue(int64_t now) const {
+    if (mFifo.empty()) {
+        return false;
+    }
+    return mMaxReportLatencyNs == 0 || mFifo.size() >= mSensorInfo.fifoMaxEventCount ||
+           now - mFifoStartTimeNs >= mMaxReportLatencyNs;
 }
 
 bool Sensor::isWakeUpSensor() {
@@ -147,9 +219,11 @@ std::vector<Event> Sensor::readEvents() {
 
 void Sensor::setOperationMode(OperationMode mode) {
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
-        mMode = mode;
-        mWaitCV.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(mRunMutex);
+            mMode = mode;
+        }
+        SensorScheduler::getInstance().wake();
     }
 }
 
@@ -172,6 +246,44 @@ Result Sensor::injectEvent(const Event& event) {
     return result;
 }
 
+bool Sensor::supportsDirectChannel(SharedMemType type) const {
+    switch (type) {
+        case SharedMemType::ASHMEM:
+            return mSensorInfo.flags &
+                   static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM);
+        case SharedMemType::GRALLOC:
+            return mSensorInfo.flags &
+                   static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_GRALLOC);
+        default:
+            return false;
+    }
+}
+
+Result Sensor::configDirectReport(int32_t channelHandle,
+                                  const std::shared_ptr<DirectChannel>& channel, RateLevel rate) {
+    int32_t maxRate =
+            (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT)) >>
+            static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT);
+    if (static_cast<int32_t>(rate) > maxRate) {
+        return Result::BAD_VALUE;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mRunMutex);
+        if (rate == RateLevel::STOP) {
+            mDirectReports.erase(channelHandle);
+        } else {
+            DirectReport& report = mDirectReports[channelHandle];
+            report.channel = channel;
+            report.samplingPeriodNs = getDirectReportPeriodNs(rate);
+            report.lastSampleTimeNs = 0;
+        }
+    }
+    // Wake up the scheduler to start, reschedule or stop the report
+    SensorScheduler::getInstance().wake();
+    return Result::OK;
+}
+
 OnChangeSensor::OnChangeSensor(ISensorsEventCallback* callback)
     : Sensor(callback), mPreviousEventSet(false) {}
 
@@ -209,10 +321,13 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.power = 0.001f;        // mA
     mSensorInfo.minDelay = 10 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = 300;  // 3 seconds at the fastest rate
+    mSensorInfo.fifoMaxEventCount = 300;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION) |
+                        static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) |
+                        (static_cast<uint32_t>(RateLevel::NORMAL)
+                         << static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
 };
 
 void AccelSensor::readEventPayload(EventPayload& payload) {
@@ -315,10 +430,12 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelay = 2.5f * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = 400;  // 1 second at the fastest rate
+    mSensorInfo.fifoMaxEventCount = 400;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) |
+                        (static_cast<uint32_t>(RateLevel::FAST)
+                         << static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
 };
 
 AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
@@ -17,13 +17,15 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_X_SENSOR_H
 #define ANDROID_HARDWARE_SENSORS_V2_X_SENSOR_H
 
+#include "DirectChannel.h"
+#include "SensorScheduler.h"
+
 #include <android/hardware/sensors/1.0/types.h>
 #include <android/hardware/sensors/2.1/types.h>
 
-#include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 namespace android {
@@ -45,17 +47,19 @@ class ISensorsEventCallback {
 class Sensor {
   public:
     using OperationMode = ::android::hardware::sensors::V1_0::OperationMode;
+    using RateLevel = ::android::hardware::sensors::V1_0::RateLevel;
     using Result = ::android::hardware::sensors::V1_0::Result;
     using Event = ::android::hardware::sensors::V2_1::Event;
     using EventPayload = ::android::hardware::sensors::V1_0::EventPayload;
     using SensorInfo = ::android::hardware::sensors::V2_1::SensorInfo;
     using SensorType = ::android::hardware::sensors::V2_1::SensorType;
+    using SharedMemType = ::android::hardware::sensors::V1_0::SharedMemType;
 
     Sensor(ISensorsEventCallback* callback);
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int32_t samplingPeriodNs);
+    void batch(int32_t samplingPeriodNs, int64_t maxReportLatencyNs);
     virtual void activate(bool enable);
     Result flush();
 
@@ -63,23 +67,60 @@ class Sensor {
     bool supportsDataInjection() const;
     Result injectEvent(const Event& event);
 
+    bool supportsDirectChannel(SharedMemType type) const;
+
+    /**
+     * Starts, changes the rate of, or with RateLevel::STOP stops reporting events directly to the
+     * channel. Returns BAD_VALUE if the sensor doesn't support the rate level.
+     */
+    Result configDirectReport(int32_t channelHandle, const std::shared_ptr<DirectChannel>& channel,
+                              RateLevel rate);
+
   protected:
-    void run();
+    struct DirectReport {
+        std::shared_ptr<DirectChannel> channel;
+        int64_t samplingPeriodNs;
+        int64_t lastSampleTimeNs;
+    };
+
+    friend class SensorScheduler;
+
+    /**
+     * Called by the scheduler to take the samples due around the given time. The events for the
+     * Event FMQ are appended to the list. Returns the time the next sample is due, or INT64_MAX
+     * if the sensor doesn't sample.
+     */
+    int64_t sample(int64_t now, std::vector<Event>* events);
+    bool isFifoDue(int64_t now) const;
     virtual std::vector<Event> readEvents();
     virtual void readEventPayload(EventPayload&) {}
-    static void startThread(Sensor* sensor);
 
     bool isWakeUpSensor();
 
     bool mIsEnabled;
     int64_t mSamplingPeriodNs;
     int64_t mLastSampleTimeNs;
+    int64_t mMaxReportLatencyNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
+    /**
+     * Emulates the hardware FIFO of the sensor, of fifoMaxEventCount events. Samples are batched
+     * in it while the report latency allows, oldest first. Guarded by mRunMutex.
+     */
+    std::vector<Event> mFifo;
+    int64_t mFifoStartTimeNs;  // When the oldest sample in the FIFO was taken
+
+    /**
+     * Number of flush complete events to write once the FIFO is emptied. Guarded by mRunMutex.
+     */
+    uint32_t mPendingFlushCount;
+
+    /**
+     * The channels the sensor reports to directly, by channel handle. Guarded by mRunMutex.
+     */
+    std::map<int32_t, DirectReport> mDirectReports;
+
     std::mutex mRunMutex;
-    std::thread mRunThread;
 
     ISensorsEventCallback* mCallback;
 
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorScheduler.h"
+#include "Sensor.h"
+
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_X {
+namespace implementation {
+
+SensorScheduler& SensorScheduler::getInstance() {
+    static SensorScheduler scheduler;
+    return scheduler;
+}
+
+SensorScheduler::SensorScheduler() : mStopThread(false) {
+    mThread = std::thread([this] { run(); });
+}
+
+SensorScheduler::~SensorScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+        mWaitCV.notify_all();
+    }
+    mThread.join();
+}
+
+void SensorScheduler::addSensor(Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSensors.push_back(sensor);
+}
+
+void SensorScheduler::removeSensor(Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSensors.erase(std::remove(mSensors.begin(), mSensors.end(), sensor), mSensors.end());
+}
+
+void SensorScheduler::wake() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mWaitCV.notify_all();
+}
+
+SensorScheduler::Batch& SensorScheduler::getBatch_Locked(ISensorsEventCallback* callback,
+                                                         bool wakeup) {
+    for (Batch& batch : mBatches) {
+        if (batch.callback == callback && batch.wakeup == wakeup) {
+            return batch;
+        }
+    }
+    mBatches.push_back({callback, wakeup, {}});
+    return mBatches.back();
+}
+
+void SensorScheduler::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (!mStopThread) {
+        int64_t now = ::android::elapsedRealtimeNano();
+        int64_t nextSampleTime = INT64_MAX;
+
+        for (Sensor* sensor : mSensors) {
+            Batch& batch = getBatch_Locked(sensor->mCallback, sensor->isWakeUpSensor());
+            nextSampleTime = std::min(nextSampleTime, sensor->sample(now, &batch.events));
+        }
+
+        for (Batch& batch : mBatches) {
+            if (!batch.events.empty()) {
+                batch.callback->postEvents(batch.events, batch.wakeup);
+                batch.events.clear();
+            }
+        }
+
+        if (nextSampleTime == INT64_MAX) {
+            mWaitCV.wait(lock);
+        } else {
+            mWaitCV.wait_for(lock, std::chrono::nanoseconds(nextSampleTime - now));
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_X
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_X_SENSORSCHEDULER_H
+#define ANDROID_HARDWARE_SENSORS_V2_X_SENSORSCHEDULER_H
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_X {
+namespace implementation {
+
+class ISensorsEventCallback;
+class Sensor;
+
+/**
+ * Generates the events of all the sensors from a single thread.
+ *
+ * The thread sleeps until the earliest sample time of the sensors, then samples every sensor
+ * which is due within a short window, so that sensors running at related rates share wakeups.
+ * The events sampled in one wakeup are posted in a single call per callback and wake up type.
+ */
+class SensorScheduler {
+  public:
+    using Event = ::android::hardware::sensors::V2_1::Event;
+
+    static SensorScheduler& getInstance();
+
+    ~SensorScheduler();
+    SensorScheduler(const SensorScheduler&) = delete;
+    SensorScheduler& operator=(const SensorScheduler&) = delete;
+
+    void addSensor(Sensor* sensor);
+
+    /**
+     * Stops scheduling the sensor. Returns once the sensor is not being sampled anymore.
+     */
+    void removeSensor(Sensor* sensor);
+
+    /**
+     * Makes the scheduler check the sensors again, after the state of one of them changed. Must
+     * not be called while holding the lock of a sensor.
+     */
+    void wake();
+
+  private:
+    struct Batch {
+        ISensorsEventCallback* callback;
+        bool wakeup;
+        std::vector<Event> events;
+    };
+
+    SensorScheduler();
+    void run();
+    Batch& getBatch_Locked(ISensorsEventCallback* callback, bool wakeup);
+
+    /**
+     * Lock to protect the sensors list. Held while the sensors are sampled and their events
+     * posted.
+     */
+    std::mutex mLock;
+    std::condition_variable mWaitCV;
+    std::vector<Sensor*> mSensors;
+
+    /**
+     * The events gathered in one wakeup. Kept across wakeups to reuse their storage.
+     */
+    std::vector<Batch> mBatches;
+
+    bool mStopThread;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_X
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_X_SENSORSCHEDULER_H
@@ -45,6 +45,7 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
     using RateLevel = ::android::hardware::sensors::V1_0::RateLevel;
     using Result = ::android::hardware::sensors::V1_0::Result;
     using SharedMemInfo = ::android::hardware::sensors::V1_0::SharedMemInfo;
+    using SharedMemType = ::android::hardware::sensors::V1_0::SharedMemType;
     using EventQueueFlagBits = ::android::hardware::sensors::V2_0::EventQueueFlagBits;
     using SensorTimeout = ::android::hardware::sensors::V2_0::SensorTimeout;
     using WakeLockQueueFlagBits = ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
@@ -57,6 +58,7 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
     Sensors()
         : mEventQueueFlag(nullptr),
           mNextHandle(1),
+          mNextChannelHandle(1),
           mOutstandingWakeUpEvents(0),
           mReadWakeLockQueueRun(false),
           mAutoReleaseWakeLockTime(0),
@@ -168,10 +170,10 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
     }
 
     Return<Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs,
-                         int64_t /* maxReportLatencyNs */) override {
+                         int64_t maxReportLatencyNs) override {
         auto sensor = mSensors.find(sensorHandle);
         if (sensor != mSensors.end()) {
-            sensor->second->batch(samplingPeriodNs);
+            sensor->second->batch(samplingPeriodNs, maxReportLatencyNs);
             return Result::OK;
         }
         return Result::BAD_VALUE;
@@ -194,20 +196,84 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
         return Result::BAD_VALUE;
     }
 
-    Return<void> registerDirectChannel(const SharedMemInfo& /* mem */,
+    Return<void> registerDirectChannel(const SharedMemInfo& mem,
                                        V2_0::ISensors::registerDirectChannel_cb _hidl_cb) override {
-        _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+        if (!supportsDirectChannel(SharedMemType::ASHMEM) &&
+            !supportsDirectChannel(SharedMemType::GRALLOC)) {
+            _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+            return Return<void>();
+        }
+
+        std::shared_ptr<DirectChannel> channel;
+        if (supportsDirectChannel(mem.type)) {
+            channel = std::make_shared<DirectChannel>(mem);
+        }
+        if (channel == nullptr || !channel->isValid()) {
+            _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+            return Return<void>();
+        }
+
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        int32_t channelHandle = mNextChannelHandle++;
+        mDirectChannels[channelHandle] = channel;
+        _hidl_cb(Result::OK, channelHandle);
         return Return<void>();
     }
 
-    Return<Result> unregisterDirectChannel(int32_t /* channelHandle */) override {
-        return Result::INVALID_OPERATION;
+    Return<Result> unregisterDirectChannel(int32_t channelHandle) override {
+        if (!supportsDirectChannel(SharedMemType::ASHMEM) &&
+            !supportsDirectChannel(SharedMemType::GRALLOC)) {
+            return Result::INVALID_OPERATION;
+        }
+
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        if (mDirectChannels.erase(channelHandle) > 0) {
+            // The channel memory is unmapped once the last sensor reporting to it lets go of it
+            for (const auto& sensor : mSensors) {
+                sensor.second->configDirectReport(channelHandle, nullptr, RateLevel::STOP);
+            }
+        }
+        return Result::OK;
     }
 
-    Return<void> configDirectReport(int32_t /* sensorHandle */, int32_t /* channelHandle */,
-                                    RateLevel /* rate */,
+    Return<void> configDirectReport(int32_t sensorHandle, int32_t channelHandle, RateLevel rate,
                                     V2_0::ISensors::configDirectReport_cb _hidl_cb) override {
-        _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+        if (!supportsDirectChannel(SharedMemType::ASHMEM) &&
+            !supportsDirectChannel(SharedMemType::GRALLOC)) {
+            _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+            return Return<void>();
+        }
+
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        auto channel = mDirectChannels.find(channelHandle);
+        if (channel == mDirectChannels.end()) {
+            _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+            return Return<void>();
+        }
+
+        // -1 denotes all sensors reporting to the channel, which may only be stopped
+        if (sensorHandle == -1) {
+            if (rate != RateLevel::STOP) {
+                _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+            } else {
+                for (const auto& sensor : mSensors) {
+                    sensor.second->configDirectReport(channelHandle, nullptr, RateLevel::STOP);
+                }
+                _hidl_cb(Result::OK, 0 /* reportToken */);
+            }
+            return Return<void>();
+        }
+
+        auto sensor = mSensors.find(sensorHandle);
+        if (sensor == mSensors.end() ||
+            !sensor->second->supportsDirectChannel(channel->second->getType())) {
+            _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+            return Return<void>();
+        }
+
+        // Sensor handles are unique within a channel, so they double as report tokens
+        Result result = sensor->second->configDirectReport(channelHandle, channel->second, rate);
+        _hidl_cb(result, (result == Result::OK && rate != RateLevel::STOP) ? sensorHandle : 0);
         return Return<void>();
     }
 
@@ -235,6 +301,18 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
         mSensors[sensor->getSensorInfo().sensorHandle] = sensor;
     }
 
+    /**
+     * Whether any sensor supports direct channels of the given memory type
+     */
+    bool supportsDirectChannel(SharedMemType type) const {
+        for (const auto& sensor : mSensors) {
+            if (sensor.second->supportsDirectChannel(type)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     /**
      * Utility function to delete the Event Flag
      */
@@ -332,6 +410,21 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
      */
     int32_t mNextHandle;
 
+    /**
+     * The registered direct channels, by channel handle
+     */
+    std::map<int32_t, std::shared_ptr<DirectChannel>> mDirectChannels;
+
+    /**
+     * The next available direct channel handle
+     */
+    int32_t mNextChannelHandle;
+
+    /**
+     * Lock to protect the direct channels
+     */
+    std::mutex mDirectChannelLock;
+
     /**
      * Lock to protect writes to the FMQs
      */
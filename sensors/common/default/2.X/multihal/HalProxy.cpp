@@ -19,12 +19,20 @@
 #include <android/hardware/sensors/2.0/types.h>
 
 #include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+#include <halmetrics/Metrics.h>
 #include "hardware_legacy/power.h"
 
 #include <dlfcn.h>
+#include <sched.h>
+#include <unistd.h>
 
+#include <cerrno>
 #include <cinttypes>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <thread>
@@ -207,11 +215,20 @@ Return<Result> HalProxy::initializeCommon(
     disableAllSensors();
 
     // Clears the queue if any events were pending write before.
-    mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
+    mPendingWriteEventsQueue = std::queue<PendingWrite>();
     mSizePendingWriteEventsQueue = 0;
+    mReorderQueues.assign(mSubHalList.size(), {});
+    mSizeReorderQueues = 0;
+    mLastReorderedTimestamp = 0;
 
     // Clears previously connected dynamic sensors
-    mDynamicSensors.clear();
+    {
+        std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
+        for (const auto& sensorEntry : mDynamicSensors) {
+            setSensorFlags_Locked(sensorEntry.first, 0 /* flags */);
+        }
+        mDynamicSensors.clear();
+    }
 
     mDynamicSensorsCallback = sensorsCallback;
 
@@ -325,6 +342,12 @@ Return<void> HalProxy::configDirectReport(int32_t sensorHandle, int32_t channelH
         _hidl_cb(Result::INVALID_OPERATION, -1 /* reportToken */);
     } else if (sensorHandle == -1 && rate != RateLevel::STOP) {
         _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
+    } else if (sensorHandle != -1 && (!isSubHalIndexValid(sensorHandle) ||
+                                      getSubHalForSensorHandle(sensorHandle) !=
+                                              mDirectChannelSubHal)) {
+        // Only the sensors of the direct channel subHal can report to its channels. Once the
+        // subHal index is cleared, the handle could name another sensor of that subHal.
+        _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
     } else {
         // -1 denotes all sensors should be disabled
         if (sensorHandle != -1) {
@@ -335,11 +358,14 @@ Return<void> HalProxy::configDirectReport(int32_t sensorHandle, int32_t channelH
     return Return<void>();
 }
 
-Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /*args*/) {
+Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) {
     if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
         ALOGE("%s: missing fd for writing", __FUNCTION__);
         return Void();
     }
+    if (metrics::dumpIfRequested(fd->data[0], args)) {
+        return Void();
+    }
 
     android::base::borrowed_fd writeFd = dup(fd->data[0]);
 
@@ -347,20 +373,42 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
     stream << "===HalProxy===" << std::endl;
     stream << "Internal values:" << std::endl;
     stream << "  Threads are running: " << (mThreadsRun.load() ? "true" : "false") << std::endl;
+    dumpThreadStats(stream, "Pending writes", mPendingWritesThreadConfig,
+                    mPendingWritesThreadId.load());
+    dumpThreadStats(stream, "Wakelock", mWakelockThreadConfig, mWakelockThreadId.load());
     int64_t now = getTimeNow();
-    stream << "  Wakelock timeout start time: " << msFromNs(now - mWakelockTimeoutStartTime)
-           << " ms ago" << std::endl;
-    stream << "  Wakelock timeout reset time: " << msFromNs(now - mWakelockTimeoutResetTime)
-           << " ms ago" << std::endl;
+    stream << "  Wakelock timeout start time: "
+           << msFromNs(now - mWakelockTimeoutStartTime.load()) << " ms ago" << std::endl;
+    stream << "  Wakelock timeout reset time: "
+           << msFromNs(now - mWakelockTimeoutResetTime.load()) << " ms ago" << std::endl;
     // TODO(b/142969448): Add logging for history of wakelock acquisition per subhal.
-    stream << "  Wakelock ref count: " << mWakelockRefCount << std::endl;
+    stream << "  Wakelock ref count: " << mWakelockRefCount.load() << std::endl;
     stream << "  # of events on pending write writes queue: " << mSizePendingWriteEventsQueue
            << std::endl;
     stream << " Most events seen on pending write events queue: "
            << mMostEventsObservedPendingWriteEventsQueue << std::endl;
     if (!mPendingWriteEventsQueue.empty()) {
+        const PendingWrite& pendingWrite = mPendingWriteEventsQueue.front();
         stream << "  Size of events list on front of pending writes queue: "
-               << mPendingWriteEventsQueue.front().first.size() << std::endl;
+               << pendingWrite.events.size() - pendingWrite.numWritten << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        if (mReorderWindowNs > 0) {
+            stream << "  Reorder window: " << mReorderWindowNs / 1000 << " us" << std::endl;
+            stream << "  # of events held in reorder queues: " << mSizeReorderQueues << std::endl;
+            stream << "  # of events reordered: " << mNumReorderedEvents << std::endl;
+            if (mNumReorderedEvents > 0) {
+                stream << "  Average reorder latency: "
+                       << mTotalReorderLatencyNs / static_cast<int64_t>(mNumReorderedEvents) /
+                                  1000
+                       << " us" << std::endl;
+            }
+            stream << "  Max reorder latency: " << mMaxReorderLatencyNs / 1000 << " us"
+                   << std::endl;
+            stream << "  # of late events written out of order: " << mNumLateEvents
+                   << std::endl;
+        }
     }
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
@@ -389,6 +437,7 @@ Return<void> HalProxy::onDynamicSensorsConnected(const hidl_vec<SensorInfo>& dyn
             } else {
                 sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
                 mDynamicSensors[sensor.sensorHandle] = sensor;
+                setSensorFlags_Locked(sensor.sensorHandle, sensor.flags);
                 sensors.push_back(sensor);
             }
         }
@@ -410,6 +459,7 @@ Return<void> HalProxy::onDynamicSensorsDisconnected(
                 sensorHandle = setSubHalIndex(sensorHandle, subHalIndex);
                 if (mDynamicSensors.find(sensorHandle) != mDynamicSensors.end()) {
                     mDynamicSensors.erase(sensorHandle);
+                    setSensorFlags_Locked(sensorHandle, 0 /* flags */);
                     sensorHandles.push_back(sensorHandle);
                 }
             }
@@ -426,6 +476,12 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
     } else {
         std::string subHalLibraryFile;
         while (subHalConfigStream >> subHalLibraryFile) {
+            if (subHalLibraryFile.find('=') != std::string::npos) {
+                if (!parseThreadConfigSetting(subHalLibraryFile)) {
+                    ALOGE("Invalid setting in config file: %s", subHalLibraryFile.c_str());
+                }
+                continue;
+            }
             void* handle = getHandleForSubHalSharedObject(subHalLibraryFile);
             if (handle == nullptr) {
                 ALOGE("dlopen failed for library: %s", subHalLibraryFile.c_str());
@@ -470,6 +526,106 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
     }
 }
 
+bool HalProxy::parseThreadConfigSetting(const std::string& setting) {
+    size_t separator = setting.find('=');
+    std::string key = setting.substr(0, separator);
+    std::string value = setting.substr(separator + 1);
+
+    WorkerThreadConfig* config;
+    if (android::base::StartsWith(key, "pending_writes_thread.")) {
+        config = &mPendingWritesThreadConfig;
+    } else if (android::base::StartsWith(key, "wakelock_thread.")) {
+        config = &mWakelockThreadConfig;
+    } else {
+        return false;
+    }
+
+    std::string field = key.substr(key.find('.') + 1);
+    if (field == "priority") {
+        return android::base::ParseInt(value, &config->priority, 0,
+                                       sched_get_priority_max(SCHED_FIFO));
+    } else if (field == "cpus") {
+        std::vector<int> cpus;
+        for (const std::string& range : android::base::Split(value, ",")) {
+            std::vector<std::string> bounds = android::base::Split(range, "-");
+            int first;
+            if (bounds.size() > 2 ||
+                !android::base::ParseInt(bounds[0], &first, 0, CPU_SETSIZE - 1)) {
+                return false;
+            }
+            int last = first;
+            if (bounds.size() == 2 &&
+                !android::base::ParseInt(bounds[1], &last, first, CPU_SETSIZE - 1)) {
+                return false;
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        config->cpus = std::move(cpus);
+        return true;
+    }
+    return false;
+}
+
+void HalProxy::applyThreadConfig(const WorkerThreadConfig& config, const char* threadName) {
+    if (!config.cpus.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : config.cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+        if (sched_setaffinity(0 /* calling thread */, sizeof(cpuSet), &cpuSet) != 0) {
+            ALOGE("Failed to set the cpus of the %s thread: %s", threadName, strerror(errno));
+        }
+    }
+    if (config.priority > 0) {
+        sched_param param = {.sched_priority = config.priority};
+        if (sched_setscheduler(0 /* calling thread */, SCHED_FIFO, &param) != 0) {
+            ALOGE("Failed to set the priority of the %s thread: %s", threadName, strerror(errno));
+        }
+    }
+}
+
+void HalProxy::dumpThreadStats(std::ostream& stream, const char* threadName,
+                               const WorkerThreadConfig& config, pid_t tid) {
+    stream << "  " << threadName << " thread: ";
+    if (config.priority > 0) {
+        stream << "SCHED_FIFO priority " << config.priority;
+    } else {
+        stream << "default priority";
+    }
+    if (!config.cpus.empty()) {
+        stream << ", cpus " << android::base::Join(config.cpus, ",");
+    }
+    stream << std::endl;
+    if (tid == 0) {
+        return;
+    }
+
+    // The run time, time spent waiting on a run queue, and number of time slices of the thread
+    std::string schedStat;
+    std::vector<std::string> fields;
+    if (android::base::ReadFileToString("/proc/self/task/" + std::to_string(tid) + "/schedstat",
+                                        &schedStat)) {
+        fields = android::base::Split(android::base::Trim(schedStat), " ");
+    }
+    int64_t runTimeNs;
+    int64_t waitTimeNs;
+    uint64_t numTimeSlices;
+    if (fields.size() == 3 && android::base::ParseInt(fields[0], &runTimeNs) &&
+        android::base::ParseInt(fields[1], &waitTimeNs) &&
+        android::base::ParseUint(fields[2], &numTimeSlices)) {
+        stream << "    Ran for " << msFromNs(runTimeNs) << " ms and waited to run for "
+               << msFromNs(waitTimeNs) << " ms in " << numTimeSlices << " time slices";
+        if (numTimeSlices > 0) {
+            stream << ", " << waitTimeNs / static_cast<int64_t>(numTimeSlices) / 1000
+                   << " us per time slice";
+        }
+        stream << std::endl;
+    }
+}
+
 void HalProxy::initializeSensorList() {
     for (size_t subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
         auto result = mSubHalList[subHalIndex]->getSensorsList([&](const auto& list) {
@@ -481,6 +637,7 @@ void HalProxy::initializeSensorList() {
                     sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
                     setDirectChannelFlags(&sensor, mSubHalList[subHalIndex]);
                     mSensors[sensor.sensorHandle] = sensor;
+                    setSensorFlags_Locked(sensor.sensorHandle, sensor.flags);
                 }
             }
         });
@@ -512,6 +669,12 @@ void* HalProxy::getHandleForSubHalSharedObject(const std::string& filename) {
 
 void HalProxy::init() {
     initializeSensorList();
+    constexpr int64_t kNanosecondsInAMicrosecond = 1000;
+    mReorderWindowNs = kNanosecondsInAMicrosecond *
+                       android::base::GetIntProperty<int64_t>(
+                               "vendor.sensors.multihal.reorder_window_us", 0 /* default */,
+                               0 /* min */);
+    mReorderQueues.resize(mSubHalList.size());
 }
 
 void HalProxy::stopThreads() {
@@ -527,7 +690,16 @@ void HalProxy::stopThreads() {
         mWakeLockQueue->write(&kZero);
         mWakelockQueueFlag->wake(static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
     }
+    {
+        // So that the wakelock thread can't miss the notification between checking whether the
+        // threads run and waiting
+        std::lock_guard<std::mutex> lock(mWakelockMutex);
+    }
     mWakelockCV.notify_one();
+    {
+        // The pending writes thread may wait without a predicate when reordering events
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    }
     mEventQueueWriteCV.notify_one();
     if (mPendingWritesThread.joinable()) {
         mPendingWritesThread.join();
@@ -550,7 +722,10 @@ void HalProxy::disableAllSensors() {
 }
 
 void HalProxy::startPendingWritesThread(HalProxy* halProxy) {
+    applyThreadConfig(halProxy->mPendingWritesThreadConfig, "pending writes");
+    halProxy->mPendingWritesThreadId.store(gettid());
     halProxy->handlePendingWrites();
+    halProxy->mPendingWritesThreadId.store(0);
 }
 
 void HalProxy::handlePendingWrites() {
@@ -558,62 +733,171 @@ void HalProxy::handlePendingWrites() {
     // one.
     std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
     while (mThreadsRun.load()) {
-        mEventQueueWriteCV.wait(
-                lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
+        if (mReorderWindowNs > 0) {
+            int64_t now = getTimeNow();
+            int64_t nextReleaseTime = releaseReorderedEvents_Locked(now);
+            if (mPendingWriteEventsQueue.empty()) {
+                // New events wake the thread up early, they may be due before the held ones
+                if (nextReleaseTime < 0) {
+                    mEventQueueWriteCV.wait(lock);
+                } else {
+                    mEventQueueWriteCV.wait_for(lock,
+                                                std::chrono::nanoseconds(nextReleaseTime - now));
+                }
+                continue;
+            }
+        } else {
+            mEventQueueWriteCV.wait(lock, [&] {
+                return !mPendingWriteEventsQueue.empty() || mReorderWindowNs > 0 ||
+                       !mThreadsRun.load();
+            });
+        }
         if (mThreadsRun.load()) {
-            std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-            size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
+            // Only this thread removes batches from the queue, so the front one stays in place
+            // while the lock is released.
+            PendingWrite& pendingWrite = mPendingWriteEventsQueue.front();
             size_t eventQueueSize = mEventQueue->getQuantumCount();
-            size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
+            size_t numToWrite =
+                    std::min(pendingWrite.events.size() - pendingWrite.numWritten, eventQueueSize);
+            const Event* pendingWriteEvents = pendingWrite.events.data() + pendingWrite.numWritten;
             lock.unlock();
+            HAL_METRICS_SCOPED_TIMER("sensors.HalProxy.pendingWrite");
             if (!mEventQueue->writeBlocking(
-                        pendingWriteEvents.data(), numToWrite,
+                        pendingWriteEvents, numToWrite,
                         static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
                         static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
                         kPendingWriteTimeoutNs, mEventQueueFlag)) {
                 ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
+                HAL_METRICS_ADD("sensors.HalProxy.eventsDropped", numToWrite);
+                size_t numWakeupEvents = countNumWakeupEvents(
+                        pendingWrite.events, pendingWrite.numWritten, numToWrite);
                 if (numWakeupEvents > 0) {
-                    if (pendingWriteEvents.size() > eventQueueSize) {
-                        decrementRefCountAndMaybeReleaseWakelock(
-                                countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-                    } else {
-                        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-                    }
+                    decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
                 }
             }
             lock.lock();
             mSizePendingWriteEventsQueue -= numToWrite;
-            if (pendingWriteEvents.size() > eventQueueSize) {
-                // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-                // all the events ahead of it down to fill gap off array at front after the erase.
-                pendingWriteEvents.erase(pendingWriteEvents.begin(),
-                                         pendingWriteEvents.begin() + eventQueueSize);
-            } else {
+            pendingWrite.numWritten += numToWrite;
+            if (pendingWrite.numWritten == pendingWrite.events.size()) {
                 mPendingWriteEventsQueue.pop();
             }
         }
     }
 }
 
+void HalProxy::queueReorderedEvents_Locked(std::vector<Event>&& events) {
+    int64_t now = getTimeNow();
+    for (Event& event : events) {
+        size_t subHalIndex = extractSubHalIndex(event.sensorHandle);
+        if (subHalIndex >= mReorderQueues.size()) {
+            subHalIndex = 0;
+        }
+        std::deque<ReorderedEvent>& queue = mReorderQueues[subHalIndex];
+        int64_t sortTimestamp = event.timestamp;
+        if (event.sensorType == V2_1::SensorType::META_DATA) {
+            // Flush complete events carry no timestamp, keep them after the events flushed
+            sortTimestamp = queue.empty() ? mLastReorderedTimestamp : queue.back().sortTimestamp;
+        }
+        // Subhals mostly post in timestamp order, so the position is searched from the back
+        auto it = queue.end();
+        while (it != queue.begin() && std::prev(it)->sortTimestamp > sortTimestamp) {
+            --it;
+        }
+        queue.insert(it, {std::move(event), sortTimestamp, now});
+    }
+    mSizeReorderQueues += events.size();
+}
+
+int64_t HalProxy::releaseReorderedEvents_Locked(int64_t now) {
+    if (mSizeReorderQueues == 0) {
+        return -1;
+    }
+
+    // Events are released up to the newest timestamp held for the window, so later events
+    // of the other subhals can't be older than the ones released anymore
+    bool release = false;
+    int64_t releaseUpTo = 0;
+    for (const auto& queue : mReorderQueues) {
+        for (const ReorderedEvent& held : queue) {
+            if (now - held.arrivalTimeNs >= mReorderWindowNs &&
+                (!release || held.sortTimestamp > releaseUpTo)) {
+                release = true;
+                releaseUpTo = held.sortTimestamp;
+            }
+        }
+    }
+
+    if (release) {
+        std::vector<Event> events;
+        while (true) {
+            std::deque<ReorderedEvent>* oldest = nullptr;
+            for (auto& queue : mReorderQueues) {
+                if (!queue.empty() && queue.front().sortTimestamp <= releaseUpTo &&
+                    (oldest == nullptr ||
+                     queue.front().sortTimestamp < oldest->front().sortTimestamp)) {
+                    oldest = &queue;
+                }
+            }
+            if (oldest == nullptr) {
+                break;
+            }
+            ReorderedEvent& held = oldest->front();
+            if (held.sortTimestamp < mLastReorderedTimestamp) {
+                mNumLateEvents++;
+            } else {
+                mLastReorderedTimestamp = held.sortTimestamp;
+            }
+            int64_t latency = now - held.arrivalTimeNs;
+            mNumReorderedEvents++;
+            mTotalReorderLatencyNs += latency;
+            mMaxReorderLatencyNs = std::max(mMaxReorderLatencyNs, latency);
+            events.push_back(std::move(held.event));
+            oldest->pop_front();
+        }
+        mSizeReorderQueues -= events.size();
+        if (mSizePendingWriteEventsQueue + events.size() <= kMaxSizePendingWriteEventsQueue) {
+            mSizePendingWriteEventsQueue += events.size();
+            mMostEventsObservedPendingWriteEventsQueue = std::max(
+                    mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
+            mPendingWriteEventsQueue.push({std::move(events), 0});
+        }
+    }
+
+    int64_t nextReleaseTime = -1;
+    for (const auto& queue : mReorderQueues) {
+        for (const ReorderedEvent& held : queue) {
+            int64_t releaseTime = held.arrivalTimeNs + mReorderWindowNs;
+            if (nextReleaseTime < 0 || releaseTime < nextReleaseTime) {
+                nextReleaseTime = releaseTime;
+            }
+        }
+    }
+    return nextReleaseTime;
+}
+
 void HalProxy::startWakelockThread(HalProxy* halProxy) {
+    applyThreadConfig(halProxy->mWakelockThreadConfig, "wakelock");
+    halProxy->mWakelockThreadId.store(gettid());
     halProxy->handleWakelocks();
+    halProxy->mWakelockThreadId.store(0);
 }
 
 void HalProxy::handleWakelocks() {
-    std::unique_lock<std::recursive_mutex> lock(mWakelockMutex);
     while (mThreadsRun.load()) {
-        mWakelockCV.wait(lock, [&] { return mWakelockRefCount > 0 || !mThreadsRun.load(); });
+        {
+            std::unique_lock<std::mutex> lock(mWakelockMutex);
+            mWakelockCV.wait(lock,
+                             [&] { return mWakelockRefCount.load() > 0 || !mThreadsRun.load(); });
+        }
         if (mThreadsRun.load()) {
             int64_t timeLeft;
             if (sharedWakelockDidTimeout(&timeLeft)) {
                 resetSharedWakelock();
             } else {
                 uint32_t numWakeLocksProcessed;
-                lock.unlock();
                 bool success = mWakeLockQueue->readBlocking(
                         &numWakeLocksProcessed, 1, 0,
                         static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN), timeLeft);
-                lock.lock();
                 if (success) {
                     decrementRefCountAndMaybeReleaseWakelock(
                             static_cast<size_t>(numWakeLocksProcessed));
@@ -626,7 +910,7 @@ void HalProxy::handleWakelocks() {
 
 bool HalProxy::sharedWakelockDidTimeout(int64_t* timeLeft) {
     bool didTimeout;
-    int64_t duration = getTimeNow() - mWakelockTimeoutStartTime;
+    int64_t duration = getTimeNow() - mWakelockTimeoutStartTime.load();
     if (duration > kWakelockTimeoutNs) {
         didTimeout = true;
     } else {
@@ -637,18 +921,32 @@ bool HalProxy::sharedWakelockDidTimeout(int64_t* timeLeft) {
 }
 
 void HalProxy::resetSharedWakelock() {
-    std::lock_guard<std::recursive_mutex> lockGuard(mWakelockMutex);
-    decrementRefCountAndMaybeReleaseWakelock(mWakelockRefCount);
-    mWakelockTimeoutResetTime = getTimeNow();
+    std::lock_guard<std::mutex> lock(mWakelockMutex);
+    if (mWakelockRefCount.exchange(0) > 0) {
+        release_wake_lock(kWakelockName);
+    }
+    // Taken after clearing the refcount, so that the increments it dropped are older
+    mWakelockTimeoutResetTime.store(getTimeNow());
 }
 
-void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+void HalProxy::postEventsToMessageQueue(std::vector<Event>&& events, size_t numWakeupEvents,
                                         V2_0::implementation::ScopedWakelock wakelock) {
+    HAL_METRICS_SCOPED_TIMER("sensors.HalProxy.postEvents");
+    HAL_METRICS_ADD("sensors.HalProxy.events", events.size());
     size_t numToWrite = 0;
     std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
     if (wakelock.isLocked()) {
         incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
     }
+    if (mReorderWindowNs > 0) {
+        if (mSizeReorderQueues + events.size() <= kMaxSizePendingWriteEventsQueue) {
+            queueReorderedEvents_Locked(std::move(events));
+            mEventQueueWriteCV.notify_one();
+        } else {
+            HAL_METRICS_ADD("sensors.HalProxy.eventsDropped", events.size());
+        }
+        return;
+    }
     if (mPendingWriteEventsQueue.empty()) {
         numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
         if (numToWrite > 0) {
@@ -664,27 +962,56 @@ void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t
     size_t numLeft = events.size() - numToWrite;
     if (numToWrite < events.size() &&
         mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
-        std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
-        mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
+        // Take over the events rather than copying the ones left
+        mPendingWriteEventsQueue.push({std::move(events), numToWrite});
         mSizePendingWriteEventsQueue += numLeft;
         mMostEventsObservedPendingWriteEventsQueue =
                 std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
         mEventQueueWriteCV.notify_one();
+    } else if (numToWrite < events.size()) {
+        HAL_METRICS_ADD("sensors.HalProxy.eventsDropped", numLeft);
     }
+    HAL_METRICS_ADD("sensors.HalProxy.eventsWrittenDirectly", numToWrite);
+}
+
+void HalProxy::setReorderWindowNs(int64_t reorderWindowNs) {
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    mReorderWindowNs = std::max(reorderWindowNs, INT64_C(0));
+    if (mReorderWindowNs == 0) {
+        // Every held event is due with no window, so none is left behind
+        releaseReorderedEvents_Locked(getTimeNow());
+    }
+    mEventQueueWriteCV.notify_one();
 }
 
 bool HalProxy::incrementRefCountAndMaybeAcquireWakelock(size_t delta,
                                                         int64_t* timeoutStart /* = nullptr */) {
     if (!mThreadsRun.load()) return false;
-    std::lock_guard<std::recursive_mutex> lockGuard(mWakelockMutex);
-    if (mWakelockRefCount == 0) {
-        acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakelockName);
-        mWakelockCV.notify_one();
+
+    // Taken before incrementing, so that a reset dropping this increment is newer
+    int64_t now = getTimeNow();
+
+    // Fast path: while the refcount is above 0, the wakelock is held and can't be released
+    size_t refCount = mWakelockRefCount.load();
+    bool incremented = false;
+    while (refCount > 0 && !incremented) {
+        incremented = mWakelockRefCount.compare_exchange_weak(refCount, refCount + delta);
+    }
+
+    if (!incremented) {
+        std::lock_guard<std::mutex> lock(mWakelockMutex);
+        // A reset may have happened while waiting for the lock
+        now = getTimeNow();
+        if (mWakelockRefCount.load() == 0) {
+            acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakelockName);
+            mWakelockCV.notify_one();
+        }
+        mWakelockRefCount += delta;
     }
-    mWakelockTimeoutStartTime = getTimeNow();
-    mWakelockRefCount += delta;
+
+    mWakelockTimeoutStartTime.store(now);
     if (timeoutStart != nullptr) {
-        *timeoutStart = mWakelockTimeoutStartTime;
+        *timeoutStart = now;
     }
     return true;
 }
@@ -692,15 +1019,23 @@ bool HalProxy::incrementRefCountAndMaybeAcquireWakelock(size_t delta,
 void HalProxy::decrementRefCountAndMaybeReleaseWakelock(size_t delta,
                                                         int64_t timeoutStart /* = -1 */) {
     if (!mThreadsRun.load()) return;
-    std::lock_guard<std::recursive_mutex> lockGuard(mWakelockMutex);
-    if (delta > mWakelockRefCount) {
-        ALOGE("Decrementing wakelock ref count by %zu when count is %zu",
-              delta, mWakelockRefCount);
-    }
-    if (timeoutStart == -1) timeoutStart = mWakelockTimeoutResetTime;
-    if (mWakelockRefCount == 0 || timeoutStart < mWakelockTimeoutResetTime) return;
-    mWakelockRefCount -= std::min(mWakelockRefCount, delta);
-    if (mWakelockRefCount == 0) {
+
+    // Checked under the lock, as a reset followed by new increments would otherwise let a stale
+    // decrement take away references of the new wakelock
+    std::lock_guard<std::mutex> lock(mWakelockMutex);
+    int64_t resetTime = mWakelockTimeoutResetTime.load();
+    if (timeoutStart != -1 && timeoutStart < resetTime) return;
+
+    size_t refCount = mWakelockRefCount.load();
+    size_t newRefCount;
+    do {
+        if (refCount == 0) return;
+        newRefCount = refCount - std::min(refCount, delta);
+    } while (!mWakelockRefCount.compare_exchange_weak(refCount, newRefCount));
+    if (delta > refCount) {
+        ALOGE("Decrementing wakelock ref count by %zu when count is %zu", delta, refCount);
+    }
+    if (newRefCount == 0) {
         release_wake_lock(kWakelockName);
     }
 }
@@ -728,17 +1063,89 @@ bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
     return extractSubHalIndex(sensorHandle) < mSubHalList.size();
 }
 
-size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t n) {
+uint32_t HalProxy::getSensorFlags(int32_t sensorHandle) {
+    size_t index = getSensorFlagsTableIndex(sensorHandle);
+    for (size_t i = 0; i < kSensorFlagsTableSize; i++) {
+        const SensorFlagsEntry& entry = mSensorFlagsTable[index];
+        int32_t entryHandle = entry.sensorHandle.load(std::memory_order_acquire);
+        if (entryHandle == sensorHandle) {
+            uint32_t flags = entry.flags.load(std::memory_order_acquire);
+            // The slot may have been freed and reused by another sensor in the meantime
+            if (entry.sensorHandle.load(std::memory_order_relaxed) == sensorHandle) {
+                return flags;
+            }
+            return 0;
+        }
+        if (entryHandle == kEmptySensorHandle) {
+            break;
+        }
+        index = (index + 1) & (kSensorFlagsTableSize - 1);
+    }
+    return 0;
+}
+
+void HalProxy::setSensorFlags_Locked(int32_t sensorHandle, uint32_t flags) {
+    if (sensorHandle == kEmptySensorHandle || sensorHandle == kFreedSensorHandle) {
+        ALOGE("Sensor handle %" PRId32 " can't be tracked", sensorHandle);
+        return;
+    }
+    size_t index = getSensorFlagsTableIndex(sensorHandle);
+    SensorFlagsEntry* freedEntry = nullptr;
+    for (size_t i = 0; i < kSensorFlagsTableSize; i++) {
+        SensorFlagsEntry& entry = mSensorFlagsTable[index];
+        int32_t entryHandle = entry.sensorHandle.load(std::memory_order_relaxed);
+        if (entryHandle == sensorHandle) {
+            if (flags != 0) {
+                entry.flags.store(flags, std::memory_order_relaxed);
+            } else {
+                entry.sensorHandle.store(kFreedSensorHandle, std::memory_order_release);
+                entry.flags.store(0, std::memory_order_relaxed);
+            }
+            return;
+        }
+        if (entryHandle == kFreedSensorHandle && freedEntry == nullptr) {
+            freedEntry = &entry;
+        } else if (entryHandle == kEmptySensorHandle) {
+            break;
+        }
+        index = (index + 1) & (kSensorFlagsTableSize - 1);
+    }
+    if (flags == 0) {
+        return;
+    }
+    SensorFlagsEntry* newEntry = freedEntry;
+    if (newEntry == nullptr && mSensorFlagsTable[index].sensorHandle.load(
+                                       std::memory_order_relaxed) == kEmptySensorHandle) {
+        newEntry = &mSensorFlagsTable[index];
+    }
+    if (newEntry == nullptr) {
+        ALOGE("No room left to track the flags of sensor %" PRId32, sensorHandle);
+        return;
+    }
+    // The flags are stored first, so that readers finding the handle find them too. Released, so
+    // that readers of the previous sensor of the slot seeing them see it was freed.
+    newEntry->flags.store(flags, std::memory_order_release);
+    newEntry->sensorHandle.store(sensorHandle, std::memory_order_release);
+}
+
+size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t start, size_t n) {
     size_t numWakeupEvents = 0;
-    for (size_t i = 0; i < n; i++) {
-        int32_t sensorHandle = events[i].sensorHandle;
-        if (mSensors[sensorHandle].flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
+    for (size_t i = start; i < start + n; i++) {
+        if (getSensorFlags(events[i].sensorHandle) &
+            static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
             numWakeupEvents++;
         }
     }
     return numWakeupEvents;
 }
 
+size_t HalProxy::getSensorFlagsTableIndex(int32_t sensorHandle) {
+    // Spreads the consecutive sensor handles of the subhals apart, to keep probe sequences short
+    constexpr uint32_t kGoldenRatio = 0x9E3779B9;
+    return static_cast<size_t>((static_cast<uint32_t>(sensorHandle) * kGoldenRatio) >>
+                               (32 - kSensorFlagsTableBits));
+}
+
 int32_t HalProxy::clearSubHalIndex(int32_t sensorHandle) {
     return sensorHandle & (~kSensorHandleSubHalIndexMask);
 }
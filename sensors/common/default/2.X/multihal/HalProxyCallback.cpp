@@ -54,7 +54,8 @@ void HalProxyCallbackBase::postEvents(const std::vector<V2_1::Event>& events,
                     " w/ index %" PRId32 ".",
                     mSubHalIndex);
     }
-    mCallback->postEventsToMessageQueue(processedEvents, numWakeupEvents, std::move(wakelock));
+    mCallback->postEventsToMessageQueue(std::move(processedEvents), numWakeupEvents,
+                                        std::move(wakelock));
 }
 
 ScopedWakelock HalProxyCallbackBase::createScopedWakelock(bool lock) {
@@ -66,11 +67,11 @@ std::vector<V2_1::Event> HalProxyCallbackBase::processEvents(const std::vector<V
                                                              size_t* numWakeupEvents) const {
     *numWakeupEvents = 0;
     std::vector<V2_1::Event> eventsOut;
+    eventsOut.reserve(events.size());
     for (V2_1::Event event : events) {
         event.sensorHandle = setSubHalIndex(event.sensorHandle, mSubHalIndex);
         eventsOut.push_back(event);
-        const V2_1::SensorInfo& sensor = mCallback->getSensorInfo(event.sensorHandle);
-        if ((sensor.flags & V1_0::SensorFlagBits::WAKE_UP) != 0) {
+        if ((mCallback->getSensorFlags(event.sensorHandle) & V1_0::SensorFlagBits::WAKE_UP) != 0) {
             (*numWakeupEvents)++;
         }
     }
@@ -31,11 +31,15 @@
 #include <hardware_legacy/power.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <sys/types.h>
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <ostream>
 #include <queue>
 #include <thread>
 #include <utility>
@@ -126,12 +130,10 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     Return<void> onDynamicSensorsDisconnected(const hidl_vec<int32_t>& dynamicSensorHandlesRemoved,
                                               int32_t subHalIndex) override;
 
-    void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+    void postEventsToMessageQueue(std::vector<Event>&& events, size_t numWakeupEvents,
                                   V2_0::implementation::ScopedWakelock wakelock) override;
 
-    const SensorInfo& getSensorInfo(int32_t sensorHandle) override {
-        return mSensors[sensorHandle];
-    }
+    uint32_t getSensorFlags(int32_t sensorHandle) override;
 
     bool areThreadsRunning() override { return mThreadsRun.load(); }
 
@@ -141,6 +143,16 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
 
     void decrementRefCountAndMaybeReleaseWakelock(size_t delta, int64_t timeoutStart = -1) override;
 
+    /**
+     * Sets how long events are held back to be merged with the events of the other subhals in
+     * timestamp order before being written to the event fmq. Zero, the default unless set by the
+     * vendor.sensors.multihal.reorder_window_us property, writes events in the order they are
+     * posted.
+     *
+     * @param reorderWindowNs The reorder window in nanoseconds.
+     */
+    void setReorderWindowNs(int64_t reorderWindowNs);
+
   private:
     using EventMessageQueueV2_1 = MessageQueue<V2_1::Event, kSynchronizedReadWrite>;
     using EventMessageQueueV2_0 = MessageQueue<V1_0::Event, kSynchronizedReadWrite>;
@@ -187,6 +199,34 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! Map of the dynamic sensors that have been added to halproxy.
     std::map<int32_t, SensorInfo> mDynamicSensors;
 
+    /**
+     * A slot of the sensor flags table, holding the flags of the sensor with its handle, or of no
+     * sensor while the handle is kEmptySensorHandle or kFreedSensorHandle.
+     */
+    struct SensorFlagsEntry {
+        std::atomic<int32_t> sensorHandle{kEmptySensorHandle};
+        std::atomic<uint32_t> flags{0};
+    };
+
+    //! The sensor handle of the never used slots of the sensor flags table, which end a probe.
+    static constexpr int32_t kEmptySensorHandle = -1;
+
+    //! The sensor handle of the slots freed by a disconnected sensor, which a probe goes past.
+    static constexpr int32_t kFreedSensorHandle = -2;
+
+    //! The number of slots of the sensor flags table, a power of two.
+    static constexpr int kSensorFlagsTableBits = 12;
+    static constexpr size_t kSensorFlagsTableSize = size_t(1) << kSensorFlagsTableBits;
+
+    /**
+     * Open addressing table of the flags of the static and dynamic sensors, read for every posted
+     * event without locking. Slots are only written under mDynamicSensorsMutex. A disconnected
+     * sensor frees its slot for the next sensor connected, readers check that the slot still
+     * holds their sensor after reading its flags.
+     */
+    std::unique_ptr<SensorFlagsEntry[]> mSensorFlagsTable =
+            std::make_unique<SensorFlagsEntry[]>(kSensorFlagsTableSize);
+
     //! The current operation mode for all subhals.
     OperationMode mCurrentOperationMode = OperationMode::NORMAL;
 
@@ -200,10 +240,20 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
 
     /**
-     * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
-     * which are waiting to be written to the events fmq in the background thread.
+     * A batch of events posted by a subhal, of which the first numWritten were written to the
+     * events fmq already.
+     */
+    struct PendingWrite {
+        std::vector<Event> events;
+        size_t numWritten;
+    };
+
+    /**
+     * A FIFO queue of the batches of events which are waiting to be written to the events fmq in
+     * the background thread. The batches are moved in as posted, so queuing them copies nothing,
+     * and they are written from where the previous write stopped.
      */
-    std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+    std::queue<PendingWrite> mPendingWriteEventsQueue;
 
     //! The most events observed on the pending write events queue for debug purposes.
     size_t mMostEventsObservedPendingWriteEventsQueue = 0;
@@ -217,6 +267,40 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! The mutex protecting writing to the fmq and the pending events queue
     std::mutex mEventQueueWriteMutex;
 
+    /**
+     * An event held back in a reorder queue, with the timestamp it is ordered by, which for
+     * META_DATA events is the one of the event posted before them, and the time it was posted at.
+     */
+    struct ReorderedEvent {
+        Event event;
+        int64_t sortTimestamp;
+        int64_t arrivalTimeNs;
+    };
+
+    //! The reorder window, 0 when events are not reordered. Guarded by mEventQueueWriteMutex.
+    int64_t mReorderWindowNs = 0;
+
+    /**
+     * The events held back for the reorder window, one queue per subhal, each sorted by
+     * timestamp. The pending writes thread merges them into the pending write events queue once
+     * they have been held for the window. Guarded by mEventQueueWriteMutex.
+     */
+    std::vector<std::deque<ReorderedEvent>> mReorderQueues;
+
+    //! The number of events held back in the reorder queues
+    size_t mSizeReorderQueues = 0;
+
+    //! The timestamp of the last event merged out of the reorder queues
+    int64_t mLastReorderedTimestamp = 0;
+
+    //! Reorder statistics for debug purposes
+    uint64_t mNumReorderedEvents = 0;
+    int64_t mTotalReorderLatencyNs = 0;
+    int64_t mMaxReorderLatencyNs = 0;
+
+    //! The number of events merged out with a timestamp older than an event merged before them
+    uint64_t mNumLateEvents = 0;
+
     //! The condition variable waiting on pending write events to stack up
     std::condition_variable mEventQueueWriteCV;
 
@@ -229,23 +313,47 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! The bool indicating whether to end the threads started in initialize
     std::atomic_bool mThreadsRun = true;
 
+    /**
+     * The scheduling of one of the threads started in initialize, set by settings of the config
+     * file of the form <thread>.priority=<SCHED_FIFO priority> and <thread>.cpus=<cpu list>, where
+     * thread is pending_writes_thread or wakelock_thread and the cpu list is like 4-7,2. The
+     * priority is limited by the rtprio rlimit of the service, and the cpus by its cpuset.
+     */
+    struct WorkerThreadConfig {
+        //! The SCHED_FIFO priority, or 0 to keep the default scheduling policy.
+        int priority = 0;
+
+        //! The CPUs the thread may run on, or empty to let it run on any.
+        std::vector<int> cpus;
+    };
+
+    WorkerThreadConfig mPendingWritesThreadConfig;
+
+    WorkerThreadConfig mWakelockThreadConfig;
+
+    //! The thread ids of the running threads, or 0, to dump their scheduling statistics.
+    std::atomic<pid_t> mPendingWritesThreadId = 0;
+    std::atomic<pid_t> mWakelockThreadId = 0;
+
     //! The mutex protecting access to the dynamic sensors added and removed methods.
     std::mutex mDynamicSensorsMutex;
 
     // WakelockRefCount membar vars below
 
-    //! The mutex protecting the wakelock refcount and subsequent wakelock releases and
-    //! acquisitions
-    std::recursive_mutex mWakelockMutex;
+    //! The mutex serializing the acquisitions and releases of the shared wakelock, and the
+    //! decrements of the refcount. The refcount is only incremented without it while it is above
+    //! 0, when the wakelock is held already.
+    std::mutex mWakelockMutex;
 
-    std::condition_variable_any mWakelockCV;
+    //! The condition variable the wakelock thread waits on for the wakelock to be acquired
+    std::condition_variable mWakelockCV;
 
     //! The refcount of how many ScopedWakelocks and pending wakeup events are active
-    size_t mWakelockRefCount = 0;
+    std::atomic<size_t> mWakelockRefCount = 0;
 
-    int64_t mWakelockTimeoutStartTime = V2_0::implementation::getTimeNow();
+    std::atomic<int64_t> mWakelockTimeoutStartTime = V2_0::implementation::getTimeNow();
 
-    int64_t mWakelockTimeoutResetTime = V2_0::implementation::getTimeNow();
+    std::atomic<int64_t> mWakelockTimeoutResetTime = V2_0::implementation::getTimeNow();
 
     const char* kWakelockName = "SensorsHAL_WAKEUP";
 
@@ -255,6 +363,35 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
      */
     void initializeSubHalListFromConfigFile(const char* configFileName);
 
+    /**
+     * Parse a thread scheduling setting of the config file.
+     *
+     * @param setting The setting, of the form key=value.
+     *
+     * @return true if the setting is valid.
+     */
+    bool parseThreadConfigSetting(const std::string& setting);
+
+    /**
+     * Apply a thread scheduling config to the calling thread.
+     *
+     * @param config The config to apply.
+     * @param threadName The name of the thread, for logging.
+     */
+    static void applyThreadConfig(const WorkerThreadConfig& config, const char* threadName);
+
+    /**
+     * Write the scheduling config of a thread and, while it runs, how long it ran and waited to
+     * run, from the scheduler statistics of the kernel.
+     *
+     * @param stream The stream to write to.
+     * @param threadName The name of the thread.
+     * @param config The scheduling config of the thread.
+     * @param tid The thread id of the thread, or 0 if it isn't running.
+     */
+    static void dumpThreadStats(std::ostream& stream, const char* threadName,
+                                const WorkerThreadConfig& config, pid_t tid);
+
     /**
      * Initialize the HalProxyCallback vector using the list of subhals.
      */
@@ -301,6 +438,26 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! Handles the pending writes on events to eventqueue.
     void handlePendingWrites();
 
+    /**
+     * Holds the events back in the reorder queue of the subhal that posted them, keeping it
+     * sorted by timestamp.
+     *
+     * @param events The events posted by a subhal.
+     */
+    void queueReorderedEvents_Locked(std::vector<Event>&& events);
+
+    /**
+     * Merges the events which have been held for the reorder window, and the events with older
+     * timestamps than them, out of the reorder queues into the pending write events queue in
+     * timestamp order.
+     *
+     * @param now The current time.
+     *
+     * @return The time the next held event will have been held for the window, or -1 if there is
+     *    no held event left.
+     */
+    int64_t releaseReorderedEvents_Locked(int64_t now);
+
     /**
      * Starts the thread that handles decrementing the ref count on wakeup events processed by the
      * framework and timing out wakelocks.
@@ -355,14 +512,33 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     bool isSubHalIndexValid(int32_t sensorHandle);
 
     /**
-     * Count the number of wakeup events in the first n events of the vector.
+     * Set the flags of a sensor in the sensor flags table, taking a slot for it if it has none.
+     * Must be called with mDynamicSensorsMutex held, or before the subhals are initialized.
+     *
+     * @param sensorHandle The sensor handle.
+     * @param flags The flags of the sensor, 0 once it is disconnected.
+     */
+    void setSensorFlags_Locked(int32_t sensorHandle, uint32_t flags);
+
+    /**
+     * Count the number of wakeup events in n events of the vector.
      *
      * @param events The vector of Event objects.
-     * @param n The end index not inclusive of events to consider.
+     * @param start The index of the first event to consider.
+     * @param n The number of events to consider.
      *
      * @return The number of wakeup events of the considered events.
      */
-    size_t countNumWakeupEvents(const std::vector<Event>& events, size_t n);
+    size_t countNumWakeupEvents(const std::vector<Event>& events, size_t start, size_t n);
+
+    /**
+     * Get the slot of the sensor flags table where the search for a sensor handle starts.
+     *
+     * @param sensorHandle The sensor handle.
+     *
+     * @return The index of the slot.
+     */
+    static size_t getSensorFlagsTableIndex(int32_t sensorHandle);
 
     /*
      * Clear out the subhal index bytes from a sensorHandle.
@@ -54,22 +54,24 @@ class ISubHalCallback {
      * remaining events to a background thread for a blocking write with a kPendingWriteTimeoutNs
      * timeout.
      *
-     * @param events The list of events to post to the message queue.
+     * @param events The list of events to post to the message queue. The events which can't be
+     *     written right away are moved to the background thread.
      * @param numWakeupEvents The number of wakeup events in events.
      * @param wakelock The wakelock associated with this post of events.
      */
-    virtual void postEventsToMessageQueue(const std::vector<V2_1::Event>& events,
+    virtual void postEventsToMessageQueue(std::vector<V2_1::Event>&& events,
                                           size_t numWakeupEvents,
                                           V2_0::implementation::ScopedWakelock wakelock) = 0;
 
     /**
-     * Get the sensor info associated with that sensorHandle.
+     * Get the flags of the sensor with that sensorHandle, static or dynamic. Called for every
+     * posted event, so it doesn't block on sensors being connected or disconnected.
      *
      * @param sensorHandle The sensor handle.
      *
-     * @return The sensor info object in the mapping.
+     * @return The flags of the sensor, or 0 if there is no such sensor.
      */
-    virtual const V2_1::SensorInfo& getSensorInfo(int32_t sensorHandle) = 0;
+    virtual uint32_t getSensorFlags(int32_t sensorHandle) = 0;
 
     virtual bool areThreadsRunning() = 0;
 };
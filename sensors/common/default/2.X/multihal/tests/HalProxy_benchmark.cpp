@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <android/hardware/sensors/1.0/types.h>
+#include <android/hardware/sensors/2.0/types.h>
+#include <android/hardware/sensors/2.1/types.h>
+#include <fmq/MessageQueue.h>
+#include <halmetrics/Metrics.h>
+
+#include "HalProxy.h"
+#include "SensorsSubHal.h"
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::Return;
+using ::android::hardware::metrics::Histogram;
+using ::android::hardware::sensors::V1_0::EventPayload;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+using ::android::hardware::sensors::V2_0::EventQueueFlagBits;
+using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
+using ::android::hardware::sensors::V2_0::implementation::ISensorsSubHal;
+using ::android::hardware::sensors::V2_1::SensorType;
+using ::android::hardware::sensors::V2_1::implementation::HalProxy;
+using ::android::hardware::sensors::V2_1::subhal::implementation::AllSensorsSubHal;
+using ::android::hardware::sensors::V2_1::subhal::implementation::SensorsSubHalV2_0;
+
+using ISensorsCallbackV2_0 = ::android::hardware::sensors::V2_0::ISensorsCallback;
+using EventV1_0 = ::android::hardware::sensors::V1_0::Event;
+using EventV2_1 = ::android::hardware::sensors::V2_1::Event;
+using EventMessageQueueV2_0 = MessageQueue<EventV1_0, ::android::hardware::kSynchronizedReadWrite>;
+using WakeupMessageQueue = MessageQueue<uint32_t, ::android::hardware::kSynchronizedReadWrite>;
+
+// Same as the size of the event queue created by the sensors framework
+constexpr size_t kEventQueueSize = 256;
+constexpr size_t kWakeLockQueueSize = 256;
+
+// The sensor handles of the accelerometer and of the proximity, which is wakeup type, in the fake
+// subhal
+constexpr int32_t kAccelerometerHandle = 0x00000001;
+constexpr int32_t kProximityHandle = 0x00000008;
+
+// How long each benchmark posts events for
+constexpr int64_t kRunDurationNs = INT64_C(1000000000);
+
+// Posting stops above this many events in flight, under the events the HalProxy drops beyond, so
+// that no event is lost when posting as fast as possible
+constexpr size_t kMaxEventsInFlight = 50000;
+
+constexpr int64_t kReadTimeoutNs = 10 * INT64_C(1000000);
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+// The barebones sensors callback class passed into halproxy initialize calls
+class SensorsCallback : public ISensorsCallbackV2_0 {
+  public:
+    Return<void> onDynamicSensorsConnected(
+            const hidl_vec<SensorInfo>& /*dynamicSensorsAdded*/) override {
+        return Return<void>();
+    }
+
+    Return<void> onDynamicSensorsDisconnected(
+            const hidl_vec<int32_t>& /*dynamicSensorHandlesRemoved*/) override {
+        return Return<void>();
+    }
+};
+
+/**
+ * Prints a one line summary of a histogram.
+ *
+ * @param name The name printed before the summary.
+ * @param unit The unit the values are printed in.
+ * @param divisor What recorded values are divided by to be in unit.
+ */
+void printHistogram(const char* name, const Histogram& histogram, const char* unit,
+                    double divisor) {
+    uint64_t count = histogram.count();
+    printf("%s: %" PRIu64 " samples", name, count);
+    if (count == 0) {
+        printf("\n");
+        return;
+    }
+    printf(", mean %.1f %s, p50 %.1f %s, p90 %.1f %s, p99 %.1f %s, max %.1f %s\n",
+           histogram.sum() / divisor / count, unit, histogram.percentile(50) / divisor, unit,
+           histogram.percentile(90) / divisor, unit, histogram.percentile(99) / divisor, unit,
+           histogram.max() / divisor, unit);
+}
+
+/**
+ * A HalProxy with fake subhals posting to it, and a reader of its event FMQ acknowledging the
+ * wakeup events it reads, like the sensors framework does.
+ *
+ * Events are posted with the time they are posted at as their timestamp, so that the reader can
+ * tell how long they took to go through the HalProxy.
+ */
+class HalProxyHarness {
+  public:
+    explicit HalProxyHarness(size_t numSubHals) {
+        std::vector<ISensorsSubHal*> subHals;
+        for (size_t i = 0; i < numSubHals; i++) {
+            mSubHals.push_back(std::make_unique<AllSensorsSubHal<SensorsSubHalV2_0>>());
+            subHals.push_back(mSubHals.back().get());
+        }
+        mProxy = std::make_unique<HalProxy>(subHals);
+
+        mEventQueue = std::make_unique<EventMessageQueueV2_0>(kEventQueueSize, true);
+        mWakeLockQueue = std::make_unique<WakeupMessageQueue>(kWakeLockQueueSize, true);
+        EventFlag::createEventFlag(mEventQueue->getEventFlagWord(), &mEventQueueFlag);
+        EventFlag::createEventFlag(mWakeLockQueue->getEventFlagWord(), &mWakeLockQueueFlag);
+        ::android::sp<ISensorsCallbackV2_0> callback = new SensorsCallback();
+        mProxy->initialize(*mEventQueue->getDesc(), *mWakeLockQueue->getDesc(), callback);
+
+        mReaderThread = std::thread([this] { readEvents(); });
+    }
+
+    ~HalProxyHarness() {
+        mStopReading = true;
+        mReaderThread.join();
+        mProxy.reset();
+        EventFlag::deleteEventFlag(&mEventQueueFlag);
+        EventFlag::deleteEventFlag(&mWakeLockQueueFlag);
+    }
+
+    /**
+     * Posts batches of events from every subhal, each from its own thread, for kRunDurationNs,
+     * then waits for the reader to read them all.
+     *
+     * @param rateHz The rate each subhal posts batches at, or 0 to post as fast as possible.
+     * @param batchSize The number of events per batch.
+     * @param wakeup Whether the events are of a wakeup sensor.
+     *
+     * @return The time it took to post all events and read them, in seconds.
+     */
+    double run(int64_t rateHz, size_t batchSize, bool wakeup) {
+        int64_t startTime = nowNs();
+        int64_t endTime = startTime + kRunDurationNs;
+        std::vector<std::thread> posters;
+        for (auto& subHal : mSubHals) {
+            posters.emplace_back([&, subHalPtr = subHal.get()] {
+                postEvents(subHalPtr, rateHz, batchSize, wakeup, endTime);
+            });
+        }
+        for (auto& poster : posters) {
+            poster.join();
+        }
+        while (mNumRead.load() < mNumPosted.load() && nowNs() < endTime + kRunDurationNs) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return static_cast<double>(nowNs() - startTime) / INT64_C(1000000000);
+    }
+
+    uint64_t getNumRead() const { return mNumRead.load(); }
+
+    uint64_t getNumPosted() const { return mNumPosted.load(); }
+
+    const Histogram& getLatency() const { return mLatency; }
+
+    void printHistograms() const {
+        printHistogram("Event latency", mLatency, "us", 1000);
+        printHistogram("postEvents duration", mPostDuration, "us", 1000);
+        printHistogram("Events in flight", mEventsInFlight, "events", 1);
+    }
+
+  private:
+    void postEvents(AllSensorsSubHal<SensorsSubHalV2_0>* subHal, int64_t rateHz, size_t batchSize,
+                    bool wakeup, int64_t endTime) {
+        EventV2_1 event;
+        event.sensorHandle = wakeup ? kProximityHandle : kAccelerometerHandle;
+        event.sensorType = wakeup ? SensorType::PROXIMITY : SensorType::ACCELEROMETER;
+        event.u = EventPayload();
+        std::vector<EventV2_1> events(batchSize, event);
+
+        int64_t nextPostTime = nowNs();
+        while (nextPostTime < endTime) {
+            if (mNumPosted.load() - mNumRead.load() + batchSize > kMaxEventsInFlight) {
+                std::this_thread::yield();
+                nextPostTime = nowNs();
+                continue;
+            }
+            int64_t postTime = nowNs();
+            for (auto& batchEvent : events) {
+                batchEvent.timestamp = postTime;
+            }
+            // Counted before posting, so that the reader never sees more events than posted
+            mNumPosted += batchSize;
+            subHal->postEvents(events, wakeup);
+            mPostDuration.record(nowNs() - postTime);
+
+            if (rateHz > 0) {
+                nextPostTime += INT64_C(1000000000) / rateHz;
+                std::this_thread::sleep_for(std::chrono::nanoseconds(nextPostTime - nowNs()));
+            } else {
+                nextPostTime = nowNs();
+            }
+        }
+    }
+
+    void readEvents() {
+        std::vector<EventV1_0> events(kEventQueueSize);
+        while (!mStopReading) {
+            size_t numToRead = mEventQueue->availableToRead();
+            if (numToRead == 0) {
+                uint32_t eventFlagState = 0;
+                mEventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                                      &eventFlagState, kReadTimeoutNs);
+                continue;
+            }
+            if (!mEventQueue->read(events.data(), numToRead)) {
+                continue;
+            }
+            mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ));
+
+            int64_t now = nowNs();
+            uint32_t numWakeupEvents = 0;
+            for (size_t i = 0; i < numToRead; i++) {
+                mLatency.record(now - events[i].timestamp);
+                if ((events[i].sensorHandle & 0x00FFFFFF) == kProximityHandle) {
+                    numWakeupEvents++;
+                }
+            }
+            mEventsInFlight.record(mNumPosted.load() - mNumRead.load());
+            mNumRead += numToRead;
+
+            if (numWakeupEvents > 0) {
+                mWakeLockQueue->write(&numWakeupEvents);
+                mWakeLockQueueFlag->wake(
+                        static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<AllSensorsSubHal<SensorsSubHalV2_0>>> mSubHals;
+    std::unique_ptr<HalProxy> mProxy;
+    std::unique_ptr<EventMessageQueueV2_0> mEventQueue;
+    std::unique_ptr<WakeupMessageQueue> mWakeLockQueue;
+    EventFlag* mEventQueueFlag = nullptr;
+    EventFlag* mWakeLockQueueFlag = nullptr;
+
+    std::thread mReaderThread;
+    std::atomic_bool mStopReading = false;
+    std::atomic<uint64_t> mNumPosted = 0;
+    std::atomic<uint64_t> mNumRead = 0;
+
+    //! From postEvents on a subhal until the event is read from the event FMQ
+    Histogram mLatency;
+    //! How long subhals are blocked in postEvents, which includes acquiring the wakelock
+    Histogram mPostDuration;
+    //! Events posted but not read yet, in the pending writes queue or the event FMQ, on each read
+    Histogram mEventsInFlight;
+};
+
+void runBenchmark(benchmark::State& state, size_t numSubHals, int64_t rateHz, size_t batchSize,
+                  bool wakeup) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        HalProxyHarness harness(numSubHals);
+        state.ResumeTiming();
+        double seconds = harness.run(rateHz, batchSize, wakeup);
+        state.SetIterationTime(seconds);
+
+        state.counters["events/s"] = harness.getNumRead() / seconds;
+        state.counters["lost"] = harness.getNumPosted() - harness.getNumRead();
+        state.counters["p50_us"] = harness.getLatency().percentile(50) / 1000.0;
+        state.counters["p99_us"] = harness.getLatency().percentile(99) / 1000.0;
+        printf("%s\n", state.name().c_str());
+        harness.printHistograms();
+    }
+}
+
+// Arguments are the number of subhals and the rate each of them posts single events at.
+void BM_EventLatency(benchmark::State& state) {
+    runBenchmark(state, state.range(0), state.range(1), 1 /* batchSize */, false /* wakeup */);
+}
+BENCHMARK(BM_EventLatency)
+        ->Args({1, 50})
+        ->Args({1, 200})
+        ->Args({1, 1000})
+        ->Args({4, 200})
+        ->Args({8, 200})
+        ->Args({8, 1000})
+        ->Iterations(1)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+
+// Arguments are the number of subhals and the number of events per batch, posted as fast as
+// the HalProxy takes them.
+void BM_SaturationThroughput(benchmark::State& state) {
+    runBenchmark(state, state.range(0), 0 /* rateHz */, state.range(1), false /* wakeup */);
+}
+BENCHMARK(BM_SaturationThroughput)
+        ->Args({1, 1})
+        ->Args({1, 64})
+        ->Args({4, 1})
+        ->Args({4, 64})
+        ->Iterations(1)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+
+// Argument is whether the events are of a wakeup sensor, so that comparing the postEvents
+// durations shows the cost of the shared wakelock.
+void BM_WakelockOverhead(benchmark::State& state) {
+    runBenchmark(state, 4 /* numSubHals */, 1000 /* rateHz */, 1 /* batchSize */, state.range(0));
+}
+BENCHMARK(BM_WakelockOverhead)
+        ->Arg(0)
+        ->Arg(1)
+        ->Iterations(1)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -37,6 +37,7 @@ using ::android::hardware::hidl_vec;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::Return;
 using ::android::hardware::sensors::V1_0::EventPayload;
+using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::SensorFlagBits;
 using ::android::hardware::sensors::V1_0::SensorInfo;
 using ::android::hardware::sensors::V1_0::SensorType;
@@ -310,6 +311,30 @@ TEST(HalProxyTest, InitDirectChannelThreeSubHalsUnitTest) {
     });
 }
 
+TEST(HalProxyTest, ConfigDirectReportOnlyRoutedToDirectChannelSubHal) {
+    DoesNotSupportDirectChannelSensorsSubHal subHal1;
+    AllSupportDirectChannelSensorsSubHal subHal2;
+    std::vector<ISensorsSubHal*> fakeSubHals{&subHal1, &subHal2};
+    HalProxy proxy(fakeSubHals);
+
+    // The direct channel subHal is reached, and rejects the call as the fake subHals don't
+    // implement direct channels
+    proxy.configDirectReport(0x00000001 | (1 << 24), 1 /* channelHandle */, RateLevel::NORMAL,
+                             [](Result result, int32_t /* reportToken */) {
+                                 EXPECT_EQ(result, Result::INVALID_OPERATION);
+                             });
+
+    // Sensors of other subHals can't report to the channel
+    proxy.configDirectReport(0x00000001, 1 /* channelHandle */, RateLevel::NORMAL,
+                             [](Result result, int32_t /* reportToken */) {
+                                 EXPECT_EQ(result, Result::BAD_VALUE);
+                             });
+    proxy.configDirectReport(0x00000001 | (2 << 24), 1 /* channelHandle */, RateLevel::NORMAL,
+                             [](Result result, int32_t /* reportToken */) {
+                                 EXPECT_EQ(result, Result::BAD_VALUE);
+                             });
+}
+
 TEST(HalProxyTest, PostSingleNonWakeupEvent) {
     constexpr size_t kQueueSize = 5;
     AllSensorsSubHal<SensorsSubHalV2_0> subHal;
@@ -698,6 +723,62 @@ TEST(HalProxyTest, DynamicSensorsDisconnectedTest) {
     }
 }
 
+TEST(HalProxyTest, DynamicSensorsFlagsTrackedAfterManyReconnections) {
+    // Many more than the sensor flags table holds, so that it would fill up if the slots of the
+    // disconnected sensors were not reused.
+    constexpr int32_t kNumReconnections = 10000;
+    AddAndRemoveDynamicSensorsSubHal subHal;
+    std::vector<ISensorsSubHal*> subHals{&subHal};
+    HalProxy proxy(subHals);
+    std::unique_ptr<EventMessageQueueV2_0> eventQueue = makeEventFMQ(0);
+    std::unique_ptr<WakeupMessageQueue> wakeLockQueue = makeWakelockFMQ(0);
+
+    TestSensorsCallback* callback = new TestSensorsCallback();
+    ::android::sp<ISensorsCallbackV2_0> callbackPtr = callback;
+    proxy.initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(), callbackPtr);
+
+    const uint32_t wakeUp = static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
+    for (int32_t sensorHandle = 100; sensorHandle < 100 + kNumReconnections; sensorHandle++) {
+        std::vector<SensorInfo> sensors;
+        std::vector<int32_t> sensorHandles;
+        makeSensorsAndSensorHandlesStartingAndOfSize(sensorHandle, 1, sensors, sensorHandles);
+        sensors[0].flags = wakeUp;
+        subHal.addDynamicSensors(convertToNewSensorInfos(sensors));
+        ASSERT_EQ(wakeUp, proxy.getSensorFlags(sensorHandle));
+        subHal.removeDynamicSensors(sensorHandles);
+        ASSERT_EQ(0u, proxy.getSensorFlags(sensorHandle));
+    }
+}
+
+TEST(HalProxyTest, DynamicSensorEventsDoNotChangeSensorsList) {
+    constexpr size_t kQueueSize = 5;
+    constexpr size_t kNumSensors = 3;
+    AddAndRemoveDynamicSensorsSubHal subHal;
+    std::vector<ISensorsSubHal*> subHals{&subHal};
+    HalProxy proxy(subHals);
+    std::unique_ptr<EventMessageQueueV2_0> eventQueue = makeEventFMQ(kQueueSize);
+    std::unique_ptr<WakeupMessageQueue> wakeLockQueue = makeWakelockFMQ(kQueueSize);
+
+    std::vector<SensorInfo> sensorsToConnect;
+    std::vector<int32_t> sensorHandlesToExpect;
+    makeSensorsAndSensorHandlesStartingAndOfSize(20, kNumSensors, sensorsToConnect,
+                                                 sensorHandlesToExpect);
+
+    ::android::sp<ISensorsCallbackV2_0> callback = new TestSensorsCallback();
+    proxy.initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(), callback);
+    size_t numStaticSensors = 0;
+    proxy.getSensorsList([&](const auto& list) { numStaticSensors = list.size(); });
+
+    subHal.addDynamicSensors(convertToNewSensorInfos(sensorsToConnect));
+    EventV1_0 event = makeAccelerometerEvent();
+    event.sensorHandle = sensorHandlesToExpect[0];
+    std::vector<EventV1_0> events{event};
+    subHal.postEvents(convertToNewEvents(events), false /* wakeup */);
+
+    EXPECT_EQ(eventQueue->availableToRead(), 1);
+    proxy.getSensorsList([&](const auto& list) { EXPECT_EQ(list.size(), numStaticSensors); });
+}
+
 TEST(HalProxyTest, InvalidSensorHandleSubHalIndexProxyCalls) {
     constexpr size_t kNumSubHals = 3;
     constexpr size_t kQueueSize = 5;
@@ -759,6 +840,46 @@ TEST(HalProxyTest, PostedEventSensorHandleSubHalIndexValid) {
     EXPECT_EQ(eventOut.sensorHandle, (subhal2Index << 24) | sensorHandleToPost);
 }
 
+TEST(HalProxyTest, EventsFromSubhalsMergedInTimestampOrder) {
+    constexpr size_t kQueueSize = 10;
+    constexpr int64_t kReorderWindowNs = 50 * 1000 * 1000;  // 50 ms
+    AllSensorsSubHal<SensorsSubHalV2_0> subhal1;
+    AllSensorsSubHal<SensorsSubHalV2_0> subhal2;
+    std::vector<ISensorsSubHal*> subHals{&subhal1, &subhal2};
+
+    std::unique_ptr<EventMessageQueueV2_0> eventQueue = makeEventFMQ(kQueueSize);
+    std::unique_ptr<WakeupMessageQueue> wakeLockQueue = makeWakelockFMQ(kQueueSize);
+    ::android::sp<ISensorsCallbackV2_0> callback = new SensorsCallback();
+    HalProxy proxy(subHals);
+    proxy.initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(), callback);
+    proxy.setReorderWindowNs(kReorderWindowNs);
+
+    EventV1_0 event = makeAccelerometerEvent();
+    event.sensorHandle = 0x00000001;
+    std::vector<EventV1_0> subhal1Events;
+    std::vector<EventV1_0> subhal2Events;
+    for (int64_t timestamp : {10, 30, 50}) {
+        event.timestamp = timestamp;
+        subhal1Events.push_back(event);
+    }
+    for (int64_t timestamp : {20, 40, 60}) {
+        event.timestamp = timestamp;
+        subhal2Events.push_back(event);
+    }
+    // The later events are posted first, and held back until the ones of subhal1 arrive
+    subhal2.postEvents(convertToNewEvents(subhal2Events), false);
+    subhal1.postEvents(convertToNewEvents(subhal1Events), false);
+
+    std::this_thread::sleep_for(std::chrono::nanoseconds(4 * kReorderWindowNs));
+
+    ASSERT_EQ(eventQueue->availableToRead(), subhal1Events.size() + subhal2Events.size());
+    std::vector<EventV1_0> eventsOut(eventQueue->availableToRead());
+    ASSERT_TRUE(eventQueue->read(eventsOut.data(), eventsOut.size()));
+    for (size_t i = 0; i < eventsOut.size(); i++) {
+        EXPECT_EQ(eventsOut[i].timestamp, static_cast<int64_t>(10 * (i + 1)));
+    }
+}
+
 TEST(HalProxyTest, FillAndDrainPendingQueueTest) {
     constexpr size_t kQueueSize = 5;
     // TODO: Make this constant linked to same limit in HalProxy.h
@@ -411,9 +411,10 @@ struct sound_trigger_sound_model* SoundTriggerHw::convertSoundModelToHal(
     convertUuidToHal(&halModel->uuid, &soundModel->uuid);
     convertUuidToHal(&halModel->vendor_uuid, &soundModel->vendorUuid);
     halModel->data_size = soundModel->data.size();
-    uint8_t* dst = reinterpret_cast<uint8_t*>(halModel) + halModel->data_offset;
-    const uint8_t* src = reinterpret_cast<const uint8_t*>(&soundModel->data[0]);
-    memcpy(dst, src, soundModel->data.size());
+    if (soundModel->data.size() != 0) {
+        uint8_t* dst = reinterpret_cast<uint8_t*>(halModel) + halModel->data_offset;
+        memcpy(dst, soundModel->data.data(), soundModel->data.size());
+    }
 
     return halModel;
 }
@@ -616,6 +617,22 @@ std::pair<bool, sp<IMemory>> memoryAsVector(const hidl_memory& m, hidl_vec<uint8
     return std::make_pair(false, memory);
 }
 
+// Returns the ashmem allocator service, looking it up only on first use so
+// that delivering an event's data does not cost a service manager round trip.
+// Pass reset after a failed transaction to have the service looked up again.
+sp<IAllocator> getAshmemAllocator(bool reset = false) {
+    static Mutex sLock;
+    static sp<IAllocator> sAshmem;
+    AutoMutex lock(sLock);
+    if (reset) {
+        sAshmem.clear();
+    }
+    if (sAshmem == 0) {
+        sAshmem = IAllocator::getService("ashmem");
+    }
+    return sAshmem;
+}
+
 // Moves the data from the vector into allocated shared memory,
 // emptying the vector.
 // It is assumed that the passed hidl_memory is a null object, so it's
@@ -627,16 +644,26 @@ std::pair<bool, sp<IMemory>> moveVectorToMemory(hidl_vec<uint8_t>* v, hidl_memor
     if (v->size() == 0) {
         return std::make_pair(true, memory);
     }
-    sp<IAllocator> ashmem = IAllocator::getService("ashmem");
+    sp<IAllocator> ashmem = getAshmemAllocator();
     if (ashmem == 0) {
         ALOGE("Failed to retrieve ashmem allocator service");
         return std::make_pair(false, memory);
     }
     bool success = false;
-    Return<void> r = ashmem->allocate(v->size(), [&](bool s, const hidl_memory& m) {
-        success = s;
-        if (success) *mem = m;
-    });
+    auto allocate = [&](const sp<IAllocator>& allocator) {
+        return allocator->allocate(v->size(), [&](bool s, const hidl_memory& m) {
+            success = s;
+            if (success) *mem = m;
+        });
+    };
+    Return<void> r = allocate(ashmem);
+    if (!r.isOk()) {
+        // The allocator service may have restarted since it was looked up.
+        ashmem = getAshmemAllocator(true /* reset */);
+        if (ashmem != 0) {
+            r = allocate(ashmem);
+        }
+    }
     if (r.isOk() && success) {
         memory = hardware::mapMemory(*mem);
         if (memory != 0) {
@@ -15,9 +15,15 @@
  */
 
 #include "BenchmarkMsgQ.h"
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
 #include <iostream>
 #include <thread>
+#include <vector>
 #include <fmq/MessageQueue.h>
+#include <halmetrics/Metrics.h>
 
 namespace android {
 namespace hardware {
@@ -29,10 +35,9 @@ namespace implementation {
 // Methods from ::android::hardware::tests::msgq::V1_0::IBenchmarkMsgQ follow.
 Return<void> BenchmarkMsgQ::configureClientInboxSyncReadWrite(
         configureClientInboxSyncReadWrite_cb _hidl_cb) {
-    static constexpr size_t kNumElementsInQueue = 16 * 1024;
     mFmqOutbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
-               kSynchronizedReadWrite>(kNumElementsInQueue);
-    if (mFmqOutbox == nullptr) {
+               kSynchronizedReadWrite>(kNumElementsInQueue, true /* configureEventFlagWord */);
+    if ((mFmqOutbox == nullptr) || (mFmqOutbox->isValid() == false)) {
         _hidl_cb(false /* ret */, android::hardware::MQDescriptorSync<uint8_t>(
                 std::vector<android::hardware::GrantorDescriptor>(),
                 nullptr /* nhandle */, 0 /* size */));
@@ -45,9 +50,8 @@ Return<void> BenchmarkMsgQ::configureClientInboxSyncReadWrite(
 
 Return<void> BenchmarkMsgQ::configureClientOutboxSyncReadWrite(
         configureClientOutboxSyncReadWrite_cb _hidl_cb) {
-    static constexpr size_t kNumElementsInQueue = 16 * 1024;
     mFmqInbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
-              kSynchronizedReadWrite>(kNumElementsInQueue);
+              kSynchronizedReadWrite>(kNumElementsInQueue, true /* configureEventFlagWord */);
     if ((mFmqInbox == nullptr) || (mFmqInbox->isValid() == false)) {
         _hidl_cb(false /* ret */, android::hardware::MQDescriptorSync<uint8_t>(
                 std::vector<android::hardware::GrantorDescriptor>(),
@@ -78,7 +82,7 @@ Return<bool> BenchmarkMsgQ::requestRead(int32_t count) {
 
 Return<void> BenchmarkMsgQ::benchmarkPingPong(uint32_t numIter) {
     std::thread(QueuePairReadWrite<kSynchronizedReadWrite>, mFmqInbox,
-                mFmqOutbox, numIter)
+                mFmqOutbox, numIter, mPacketSize, mCpu)
             .detach();
     return Void();
 }
@@ -87,11 +91,16 @@ Return<void> BenchmarkMsgQ::benchmarkServiceWriteClientRead(uint32_t numIter) {
     if (mTimeData) delete[] mTimeData;
     mTimeData = new (std::nothrow) int64_t[numIter];
     std::thread(QueueWriter<kSynchronizedReadWrite>, mFmqOutbox,
-                mTimeData, numIter).detach();
+                mTimeData, numIter, mPacketSize, mCpu).detach();
     return Void();
 }
 
 Return<void> BenchmarkMsgQ::sendTimeData(const hidl_vec<int64_t>& clientRcvTimeArray) {
+    if (clientRcvTimeArray.size() == 0) {
+        return Void();
+    }
+
+    metrics::Histogram delays;
     int64_t accumulatedTime = 0;
 
     for (uint32_t i = 0; i < clientRcvTimeArray.size(); i++) {
@@ -100,29 +109,103 @@ Return<void> BenchmarkMsgQ::sendTimeData(const hidl_vec<int64_t>& clientRcvTimeA
                         clientRcvTimeArray[i])));
         std::chrono::time_point<std::chrono::high_resolution_clock>serverSendTime(
                 (std::chrono::high_resolution_clock::duration(mTimeData[i])));
-        accumulatedTime += static_cast<int64_t>(
+        int64_t delay = static_cast<int64_t>(
                 std::chrono::duration_cast<std::chrono::nanoseconds>(clientRcvTime -
                                                                      serverSendTime).count());
+        delays.record(std::max<int64_t>(delay, 0));
+        accumulatedTime += delay;
     }
 
     accumulatedTime /= clientRcvTimeArray.size();
     std::cout << "Average service to client write to read delay::"
          << accumulatedTime << "ns" << std::endl;
+
+    // The tail matters more than the average to the HALs streaming through FMQs.
+    std::cout << "Service to client write to read delay percentiles::"
+         << " p50 " << delays.percentile(50) << "ns"
+         << " p90 " << delays.percentile(90) << "ns"
+         << " p99 " << delays.percentile(99) << "ns"
+         << " max " << delays.max() << "ns" << std::endl;
+    return Void();
+}
+
+Return<bool> BenchmarkMsgQ::setPacketSize(uint32_t packetSize) {
+    if (packetSize == 0 || packetSize > kNumElementsInQueue) {
+        return false;
+    }
+    mPacketSize = packetSize;
+    return true;
+}
+
+Return<bool> BenchmarkMsgQ::setServiceCpu(int32_t cpu) {
+    if (cpu < -1 || cpu >= sysconf(_SC_NPROCESSORS_CONF)) {
+        return false;
+    }
+    mCpu = cpu;
+    return true;
+}
+
+Return<void> BenchmarkMsgQ::configureClientInboxUnsync(configureClientInboxUnsync_cb _hidl_cb) {
+    mFmqUnsyncOutbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
+               kUnsynchronizedWrite>(kNumElementsInQueue);
+    if ((mFmqUnsyncOutbox == nullptr) || (mFmqUnsyncOutbox->isValid() == false)) {
+        _hidl_cb(false /* ret */, android::hardware::MQDescriptorUnsync<uint8_t>(
+                std::vector<android::hardware::GrantorDescriptor>(),
+                nullptr /* nhandle */, 0 /* size */));
+    } else {
+        _hidl_cb(true /* ret */, *mFmqUnsyncOutbox->getDesc());
+    }
+
+    return Void();
+}
+
+Return<void> BenchmarkMsgQ::benchmarkServiceWriteClientReadUnsync(uint32_t numIter) {
+    if (mTimeData) delete[] mTimeData;
+    mTimeData = new (std::nothrow) int64_t[numIter];
+    std::thread(QueueWriter<kUnsynchronizedWrite>, mFmqUnsyncOutbox,
+                mTimeData, numIter, mPacketSize, mCpu).detach();
     return Void();
 }
 
+Return<void> BenchmarkMsgQ::benchmarkPingPongBlocking(uint32_t numIter) {
+    std::thread(QueuePairReadWriteBlocking, mFmqInbox, mFmqOutbox, numIter, mPacketSize, mCpu)
+            .detach();
+    return Void();
+}
+
+Return<void> BenchmarkMsgQ::benchmarkPingPongZeroCopy(uint32_t numIter) {
+    std::thread(QueuePairReadWriteZeroCopy, mFmqInbox, mFmqOutbox, numIter, mPacketSize, mCpu)
+            .detach();
+    return Void();
+}
+
+void BenchmarkMsgQ::PinToCpu(int32_t cpu) {
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    if (sched_setaffinity(0 /* calling thread */, sizeof(cpuSet), &cpuSet) != 0) {
+        std::cerr << "Could not pin benchmark thread to CPU " << cpu << std::endl;
+    }
+}
+
 template <MQFlavor flavor>
 void BenchmarkMsgQ::QueueWriter(android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
                                 int64_t* mTimeData,
-                                uint32_t numIter) {
-    uint8_t data[kPacketSize64];
+                                uint32_t numIter,
+                                uint32_t packetSize,
+                                int32_t cpu) {
+    PinToCpu(cpu);
+    std::vector<uint8_t> data(packetSize);
     uint32_t numWrites = 0;
 
     while (numWrites < numIter) {
         do {
             mTimeData[numWrites] =
                     std::chrono::high_resolution_clock::now().time_since_epoch().count();
-        } while (mFmqOutbox->write(data, kPacketSize64) == false);
+        } while (mFmqOutbox->write(data.data(), packetSize) == false);
         numWrites++;
     }
 }
@@ -131,19 +214,93 @@ template <MQFlavor flavor>
 void BenchmarkMsgQ::QueuePairReadWrite(
         android::hardware::MessageQueue<uint8_t, flavor>* mFmqInbox,
         android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
-        uint32_t numIter) {
-    uint8_t data[kPacketSize64];
+        uint32_t numIter,
+        uint32_t packetSize,
+        int32_t cpu) {
+    PinToCpu(cpu);
+    std::vector<uint8_t> data(packetSize);
     uint32_t numRoundTrips = 0;
 
     while (numRoundTrips < numIter) {
-        while (mFmqInbox->read(data, kPacketSize64) == false)
+        while (mFmqInbox->read(data.data(), packetSize) == false)
             ;
-        while (mFmqOutbox->write(data, kPacketSize64) == false)
+        while (mFmqOutbox->write(data.data(), packetSize) == false)
             ;
         numRoundTrips++;
     }
 }
 
+void BenchmarkMsgQ::QueuePairReadWriteBlocking(
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+        uint32_t numIter,
+        uint32_t packetSize,
+        int32_t cpu) {
+    PinToCpu(cpu);
+    std::vector<uint8_t> data(packetSize);
+    uint32_t numRoundTrips = 0;
+
+    while (numRoundTrips < numIter) {
+        if (!mFmqInbox->readBlocking(data.data(), packetSize, kBlockingTimeoutNs) ||
+            !mFmqOutbox->writeBlocking(data.data(), packetSize, kBlockingTimeoutNs)) {
+            std::cerr << "Blocking ping pong timed out after " << numRoundTrips
+                      << " round trips" << std::endl;
+            return;
+        }
+        numRoundTrips++;
+    }
+}
+
+// Returns the address of element |index| of |tx|, and in |length| how many
+// elements follow it contiguously.
+static uint8_t* GetContiguous(
+        const android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>::MemTransaction& tx,
+        size_t index, size_t* length) {
+    const auto& first = tx.getFirstRegion();
+    if (index < first.getLength()) {
+        *length = first.getLength() - index;
+        return first.getAddress() + index;
+    }
+    const auto& second = tx.getSecondRegion();
+    index -= first.getLength();
+    *length = second.getLength() - index;
+    return second.getAddress() + index;
+}
+
+void BenchmarkMsgQ::QueuePairReadWriteZeroCopy(
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+        uint32_t numIter,
+        uint32_t packetSize,
+        int32_t cpu) {
+    PinToCpu(cpu);
+    uint32_t numRoundTrips = 0;
+
+    while (numRoundTrips < numIter) {
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>::MemTransaction readTx;
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>::MemTransaction writeTx;
+        while (mFmqInbox->beginRead(packetSize, &readTx) == false)
+            ;
+        while (mFmqOutbox->beginWrite(packetSize, &writeTx) == false)
+            ;
+
+        // Either side may wrap around the end of its ring buffer.
+        for (size_t copied = 0; copied < packetSize;) {
+            size_t readLength;
+            size_t writeLength;
+            const uint8_t* src = GetContiguous(readTx, copied, &readLength);
+            uint8_t* dst = GetContiguous(writeTx, copied, &writeLength);
+            size_t length = std::min({readLength, writeLength, packetSize - copied});
+            memcpy(dst, src, length);
+            copied += length;
+        }
+
+        mFmqInbox->commitRead(packetSize);
+        mFmqOutbox->commitWrite(packetSize);
+        numRoundTrips++;
+    }
+}
+
 IBenchmarkMsgQ* HIDL_FETCH_IBenchmarkMsgQ(const char* /* name */) {
     return new BenchmarkMsgQ();
 }
@@ -41,6 +41,7 @@ using ::android::hardware::Void;
 using ::android::sp;
 
 using android::hardware::kSynchronizedReadWrite;
+using android::hardware::kUnsynchronizedWrite;
 using android::hardware::MQFlavor;
 
 struct BenchmarkMsgQ : public IBenchmarkMsgQ {
@@ -54,6 +55,10 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
         kPacketSize512 = 512,
         kPacketSize1024 = 1024
     };
+    static constexpr size_t kNumElementsInQueue = 16 * 1024;
+    // How long the blocking benchmark waits for the client before giving up.
+    static constexpr int64_t kBlockingTimeoutNs = 5000000000;
+
     // Methods from ::android::hardware::tests::msgq::V1_0::IBenchmarkMsgQ follow.
     Return<void> configureClientInboxSyncReadWrite(configureClientInboxSyncReadWrite_cb _hidl_cb) override;
     Return<void> configureClientOutboxSyncReadWrite(configureClientOutboxSyncReadWrite_cb _hidl_cb) override;
@@ -62,6 +67,12 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
     Return<void> benchmarkPingPong(uint32_t numIter) override;
     Return<void> benchmarkServiceWriteClientRead(uint32_t numIter) override;
     Return<void> sendTimeData(const hidl_vec<int64_t>& timeData) override;
+    Return<bool> setPacketSize(uint32_t packetSize) override;
+    Return<bool> setServiceCpu(int32_t cpu) override;
+    Return<void> configureClientInboxUnsync(configureClientInboxUnsync_cb _hidl_cb) override;
+    Return<void> benchmarkServiceWriteClientReadUnsync(uint32_t numIter) override;
+    Return<void> benchmarkPingPongBlocking(uint32_t numIter) override;
+    Return<void> benchmarkPingPongZeroCopy(uint32_t numIter) override;
 
      /*
      * This method writes numIter packets into the mFmqOutbox queue
@@ -70,7 +81,8 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
      */
     template <MQFlavor flavor>
     static void QueueWriter(android::hardware::MessageQueue<uint8_t, flavor>*
-                     mFmqOutbox, int64_t* mTimeData, uint32_t numIter);
+                     mFmqOutbox, int64_t* mTimeData, uint32_t numIter,
+                     uint32_t packetSize, int32_t cpu);
     /*
      * The method reads a packet from the inbox queue and writes the same
      * into the outbox queue. The client will calculate the average time taken
@@ -80,12 +92,35 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
     static void QueuePairReadWrite(
             android::hardware::MessageQueue<uint8_t, flavor>* mFmqInbox,
             android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
-            uint32_t numIter);
+            uint32_t numIter, uint32_t packetSize, int32_t cpu);
+    /*
+     * Same as QueuePairReadWrite, but sleeps in readBlocking() until the
+     * client writes, and wakes it with writeBlocking().
+     */
+    static void QueuePairReadWriteBlocking(
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+            uint32_t numIter, uint32_t packetSize, int32_t cpu);
+    /*
+     * Same as QueuePairReadWrite, but copies each packet straight from the
+     * inbox queue into the outbox queue through beginRead()/beginWrite().
+     */
+    static void QueuePairReadWriteZeroCopy(
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+            uint32_t numIter, uint32_t packetSize, int32_t cpu);
+    /*
+     * Pins the calling thread to |cpu|, unless it is negative.
+     */
+    static void PinToCpu(int32_t cpu);
 
 private:
-    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox;
-    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox;
-    int64_t* mTimeData;
+    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox = nullptr;
+    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox = nullptr;
+    android::hardware::MessageQueue<uint8_t, kUnsynchronizedWrite>* mFmqUnsyncOutbox = nullptr;
+    int64_t* mTimeData = nullptr;
+    uint32_t mPacketSize = kPacketSize64;
+    int32_t mCpu = -1;
 };
 
 extern "C" IBenchmarkMsgQ* HIDL_FETCH_IBenchmarkMsgQ(const char* name);
@@ -81,6 +81,16 @@ static const CpuUsage kCpuUsage = {
         .isOnline = true,
 };
 
+constexpr char kThermalSysfsDir[] = "/sys/class/thermal";
+
+Thermal::Thermal()
+    : thermal_monitor_([this](const Temperature_2_0& temperature) {
+          sendThermalChangedCallback(temperature);
+      }) {
+    thermal_monitor_.addThermalZones(kThermalSysfsDir);
+    thermal_monitor_.start();
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
@@ -111,12 +121,13 @@ Return<void> Thermal::getCurrentTemperatures(bool filterType, TemperatureType ty
                                              getCurrentTemperatures_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<Temperature_2_0> temperatures;
-    if (filterType && type != kTemp_2_0.type) {
+    std::vector<Temperature_2_0> temperatures = thermal_monitor_.getTemperatures(filterType, type);
+    if (!filterType || type == kTemp_2_0.type) {
+        temperatures.push_back(kTemp_2_0);
+    }
+    if (temperatures.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperatures = {kTemp_2_0};
     }
     _hidl_cb(status, temperatures);
     return Void();
@@ -126,12 +137,14 @@ Return<void> Thermal::getTemperatureThresholds(bool filterType, TemperatureType
                                                getTemperatureThresholds_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<TemperatureThreshold> temperature_thresholds;
-    if (filterType && type != kTempThreshold.type) {
+    std::vector<TemperatureThreshold> temperature_thresholds =
+            thermal_monitor_.getThresholds(filterType, type);
+    if (!filterType || type == kTempThreshold.type) {
+        temperature_thresholds.push_back(kTempThreshold);
+    }
+    if (temperature_thresholds.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperature_thresholds = {kTempThreshold};
     }
     _hidl_cb(status, temperature_thresholds);
     return Void();
@@ -218,6 +231,17 @@ Return<void> Thermal::unregisterThermalChangedCallback(
     return Void();
 }
 
+void Thermal::sendThermalChangedCallback(const Temperature_2_0& temperature) {
+    std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+    for (const auto& c : callbacks_) {
+        if (c.is_filter_type && c.type != temperature.type) continue;
+        Return<void> ret = c.callback->notifyThrottling(temperature);
+        if (!ret.isOk()) {
+            LOG(ERROR) << "A callback of ThermalHAL is dead: " << ret.description();
+        }
+    }
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace thermal
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.thermal@2.0-service-mock"
+
+#include "ThermalMonitor.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <cutils/uevent.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::base::ReadFileToString;
+using ::android::base::Trim;
+using ::android::base::unique_fd;
+
+namespace {
+
+// Poll period while a zone is within kNearThresholdMargin of a severity change, and otherwise.
+constexpr std::chrono::milliseconds kFastPollPeriod{500};
+constexpr std::chrono::milliseconds kSlowPollPeriod{5000};
+constexpr float kNearThresholdMargin = 3.0;
+constexpr int kUeventBufferSize = 64 * 1024;
+constexpr size_t kUeventMsgLen = 2048;
+
+bool readMilliCelsius(const std::string& path, float* out) {
+    std::string buf;
+    int value;
+    if (!ReadFileToString(path, &buf) || !android::base::ParseInt(Trim(buf), &value)) {
+        return false;
+    }
+    *out = value / 1000.0f;
+    return true;
+}
+
+TemperatureType zoneTemperatureType(const std::string& zone_type) {
+    static const struct {
+        const char* substring;
+        TemperatureType type;
+    } kTypes[] = {
+            {"cpu", TemperatureType::CPU},         {"gpu", TemperatureType::GPU},
+            {"batt", TemperatureType::BATTERY},    {"skin", TemperatureType::SKIN},
+            {"usb", TemperatureType::USB_PORT},    {"npu", TemperatureType::NPU},
+            {"pmic", TemperatureType::POWER_AMPLIFIER},
+    };
+    std::string lower = zone_type;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for (const auto& entry : kTypes) {
+        if (lower.find(entry.substring) != std::string::npos) return entry.type;
+    }
+    return TemperatureType::UNKNOWN;
+}
+
+// The severity a kernel trip point type corresponds to, or NONE if it isn't used.
+ThrottlingSeverity tripSeverity(const std::string& trip_type) {
+    if (trip_type == "active") return ThrottlingSeverity::MODERATE;
+    if (trip_type == "passive") return ThrottlingSeverity::SEVERE;
+    if (trip_type == "hot") return ThrottlingSeverity::CRITICAL;
+    if (trip_type == "critical") return ThrottlingSeverity::SHUTDOWN;
+    return ThrottlingSeverity::NONE;
+}
+
+// Raises the severity as soon as a threshold is reached, but only lowers it once the temperature
+// is below the threshold by its hysteresis, so that a zone hovering around a threshold does not
+// flip back and forth.
+ThrottlingSeverity severityFor(float value, ThrottlingSeverity prev,
+                               const SeverityThresholds& thresholds,
+                               const SeverityThresholds& hysteresis) {
+    size_t up = 0;
+    size_t down = 0;
+    for (size_t i = 1; i < thresholds.size(); i++) {
+        if (std::isnan(thresholds[i])) continue;
+        if (value >= thresholds[i]) up = i;
+        if (value >= thresholds[i] - hysteresis[i]) down = i;
+    }
+    size_t prev_index = static_cast<size_t>(prev);
+    if (up > prev_index) return static_cast<ThrottlingSeverity>(up);
+    if (down < prev_index) return static_cast<ThrottlingSeverity>(down);
+    return prev;
+}
+
+}  // namespace
+
+ThermalMonitor::ThermalMonitor(ThrottlingCallback callback) : callback_(std::move(callback)) {}
+
+ThermalMonitor::~ThermalMonitor() {
+    if (!thread_.joinable()) return;
+    stopping_ = true;
+    wake();
+    thread_.join();
+}
+
+void ThermalMonitor::addThermalZones(const std::string& thermal_dir) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(thermal_dir.c_str()), closedir);
+    if (dir == nullptr) {
+        PLOG(INFO) << "No thermal zones in " << thermal_dir;
+        return;
+    }
+
+    std::lock_guard<std::mutex> _lock(zones_mutex_);
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (!android::base::StartsWith(entry->d_name, "thermal_zone")) continue;
+        std::string path = thermal_dir + "/" + entry->d_name;
+
+        Zone zone;
+        if (!ReadFileToString(path + "/type", &zone.name)) continue;
+        zone.name = Trim(zone.name);
+        zone.type = zoneTemperatureType(zone.name);
+        zone.hot_thresholds.fill(NAN);
+        zone.hot_hysteresis.fill(0);
+        for (int trip = 0;; trip++) {
+            std::string trip_path = path + "/trip_point_" + std::to_string(trip);
+            std::string trip_type;
+            float temp;
+            if (!ReadFileToString(trip_path + "_type", &trip_type) ||
+                !readMilliCelsius(trip_path + "_temp", &temp)) {
+                break;
+            }
+            size_t severity = static_cast<size_t>(tripSeverity(Trim(trip_type)));
+            if (severity == 0) continue;
+            // Keep the lowest trip point of each kind.
+            if (std::isnan(zone.hot_thresholds[severity]) || temp < zone.hot_thresholds[severity]) {
+                float hysteresis = 0;
+                readMilliCelsius(trip_path + "_hyst", &hysteresis);
+                zone.hot_thresholds[severity] = temp;
+                zone.hot_hysteresis[severity] = hysteresis;
+            }
+        }
+
+        std::string temp_path = path + "/temp";
+        zone.temp_fd.reset(TEMP_FAILURE_RETRY(open(temp_path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (zone.temp_fd == -1) {
+            PLOG(WARNING) << "Cannot open temperature of " << path;
+            continue;
+        }
+        LOG(INFO) << "Monitoring " << zone.name << " (" << entry->d_name << ")";
+        zones_.push_back(std::move(zone));
+    }
+}
+
+void ThermalMonitor::start() {
+    {
+        std::lock_guard<std::mutex> _lock(zones_mutex_);
+        if (zones_.empty()) return;
+        // Establish the initial severities; they are not changes to report.
+        sampleLocked();
+    }
+
+    wake_fd_.reset(eventfd(0, EFD_CLOEXEC));
+    if (wake_fd_ == -1) {
+        PLOG(ERROR) << "Cannot create eventfd; not monitoring thermal zones";
+        return;
+    }
+    uevent_fd_.reset(uevent_open_socket(kUeventBufferSize, true));
+    if (uevent_fd_ == -1) {
+        // Polling alone still catches every change, just not as quickly.
+        PLOG(WARNING) << "Cannot open uevent socket";
+    } else {
+        fcntl(uevent_fd_, F_SETFL, O_NONBLOCK);
+    }
+    thread_ = std::thread(&ThermalMonitor::run, this);
+}
+
+void ThermalMonitor::run() {
+    while (true) {
+        std::chrono::steady_clock::time_point next_sample;
+        {
+            std::lock_guard<std::mutex> _lock(zones_mutex_);
+            next_sample = last_sample_ + pollPeriodLocked();
+        }
+
+        struct pollfd fds[] = {
+                {.fd = wake_fd_, .events = POLLIN},
+                {.fd = uevent_fd_, .events = POLLIN},
+        };
+        int nfds = uevent_fd_ == -1 ? 1 : 2;
+        auto timeout = std::chrono::ceil<std::chrono::milliseconds>(
+                next_sample - std::chrono::steady_clock::now());
+        if (TEMP_FAILURE_RETRY(poll(fds, nfds, std::max<int64_t>(timeout.count(), 0))) < 0) {
+            PLOG(ERROR) << "poll failed; no longer monitoring thermal zones";
+            return;
+        }
+        bool sample = std::chrono::steady_clock::now() >= next_sample;
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            TEMP_FAILURE_RETRY(read(wake_fd_, &count, sizeof(count)));
+            if (stopping_) return;
+        }
+
+        if (nfds > 1 && (fds[1].revents & POLLIN)) {
+            // A thermal uevent, e.g. for a crossed trip point, calls for a read right away.
+            char msg[kUeventMsgLen + 2];
+            ssize_t n;
+            while ((n = uevent_kernel_multicast_recv(uevent_fd_, msg, kUeventMsgLen)) > 0) {
+                msg[n] = '\0';
+                msg[n + 1] = '\0';
+                for (char* cp = msg; *cp; cp += strlen(cp) + 1) {
+                    if (!strcmp(cp, "SUBSYSTEM=thermal")) sample = true;
+                }
+            }
+        }
+
+        if (!sample) continue;
+        std::vector<Temperature_2_0> changed;
+        {
+            std::lock_guard<std::mutex> _lock(zones_mutex_);
+            changed = sampleLocked();
+        }
+        notify(changed);
+    }
+}
+
+void ThermalMonitor::wake() {
+    uint64_t one = 1;
+    if (TEMP_FAILURE_RETRY(write(wake_fd_, &one, sizeof(one))) != sizeof(one)) {
+        PLOG(ERROR) << "Cannot wake up the thermal monitor";
+    }
+}
+
+std::vector<Temperature_2_0> ThermalMonitor::sampleLocked() {
+    last_sample_ = std::chrono::steady_clock::now();
+    std::vector<Temperature_2_0> changed;
+    for (auto& zone : zones_) {
+        char buf[32];
+        ssize_t len = TEMP_FAILURE_RETRY(pread(zone.temp_fd, buf, sizeof(buf) - 1, 0));
+        if (len <= 0) {
+            PLOG(WARNING) << "Cannot read temperature of " << zone.name;
+            continue;
+        }
+        buf[len] = '\0';
+        char* end;
+        long millicelsius = strtol(buf, &end, 10);
+        if (end == buf) {
+            LOG(WARNING) << "Bad temperature of " << zone.name << ": " << buf;
+            continue;
+        }
+        zone.value = millicelsius / 1000.0f;
+
+        ThrottlingSeverity severity = severityFor(zone.value, zone.severity, zone.hot_thresholds,
+                                                  zone.hot_hysteresis);
+        if (severity != zone.severity) {
+            LOG(INFO) << zone.name << " at " << zone.value << "C: " << toString(zone.severity)
+                      << " -> " << toString(severity);
+            zone.severity = severity;
+            changed.push_back({zone.type, zone.name, zone.value, zone.severity});
+        }
+    }
+    return changed;
+}
+
+std::chrono::milliseconds ThermalMonitor::pollPeriodLocked() const {
+    for (const auto& zone : zones_) {
+        // A zone that cannot be read has no trend to watch, and must not keep the others
+        // polling fast.
+        if (std::isnan(zone.value)) continue;
+        size_t current = static_cast<size_t>(zone.severity);
+        // Close to rising to any higher severity, or to dropping below the current one?
+        for (size_t i = current + 1; i < zone.hot_thresholds.size(); i++) {
+            if (zone.hot_thresholds[i] - zone.value < kNearThresholdMargin) return kFastPollPeriod;
+        }
+        if (current > 0 && zone.value - (zone.hot_thresholds[current] -
+                                         zone.hot_hysteresis[current]) < kNearThresholdMargin) {
+            return kFastPollPeriod;
+        }
+    }
+    return kSlowPollPeriod;
+}
+
+void ThermalMonitor::notify(const std::vector<Temperature_2_0>& changed) {
+    for (const auto& temperature : changed) {
+        callback_(temperature);
+    }
+}
+
+std::vector<Temperature_2_0> ThermalMonitor::getTemperatures(bool filterType,
+                                                             TemperatureType type) {
+    std::vector<Temperature_2_0> temperatures;
+    std::vector<Temperature_2_0> changed;
+    {
+        std::lock_guard<std::mutex> _lock(zones_mutex_);
+        changed = sampleLocked();
+        for (const auto& zone : zones_) {
+            if (filterType && zone.type != type) continue;
+            temperatures.push_back({zone.type, zone.name, zone.value, zone.severity});
+        }
+    }
+    // The new values may call for polling sooner.
+    if (thread_.joinable()) wake();
+    notify(changed);
+    return temperatures;
+}
+
+std::vector<TemperatureThreshold> ThermalMonitor::getThresholds(bool filterType,
+                                                               TemperatureType type) {
+    std::vector<TemperatureThreshold> thresholds;
+    std::lock_guard<std::mutex> _lock(zones_mutex_);
+    for (const auto& zone : zones_) {
+        if (filterType && zone.type != type) continue;
+        TemperatureThreshold threshold = {
+                .type = zone.type,
+                .name = zone.name,
+                .vrThrottlingThreshold = NAN,
+        };
+        for (size_t i = 0; i < kThrottlingSeverityCount; i++) {
+            threshold.hotThrottlingThresholds[i] = zone.hot_thresholds[i];
+            threshold.coldThrottlingThresholds[i] = NAN;
+        }
+        thresholds.push_back(threshold);
+    }
+    return thresholds;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
+#define ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/thermal/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
+using ::android::hardware::thermal::V2_0::TemperatureThreshold;
+using ::android::hardware::thermal::V2_0::TemperatureType;
+using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
+
+constexpr size_t kThrottlingSeverityCount = static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1;
+
+// Indexed by ThrottlingSeverity, in degrees Celsius; NAN where there is no threshold.
+using SeverityThresholds = std::array<float, kThrottlingSeverityCount>;
+
+// Watches the kernel thermal zones and reports throttling severity changes.
+//
+// Zones are read through descriptors kept open for the lifetime of the monitor. They are polled
+// quickly while any of them is close to a threshold and slowly otherwise, and read right away
+// when the kernel sends a thermal uevent, e.g. on crossing a trip point. Severities are derived
+// from the zone trip points with their hysteresis, and the callback only runs when the severity
+// of a zone changes.
+class ThermalMonitor {
+   public:
+    using ThrottlingCallback = std::function<void(const Temperature_2_0&)>;
+
+    explicit ThermalMonitor(ThrottlingCallback callback);
+    ~ThermalMonitor();
+
+    // Adds the thermal zones found in |thermal_dir|. Must be called before start().
+    void addThermalZones(const std::string& thermal_dir);
+    // Starts monitoring; does nothing if there are no zones.
+    void start();
+
+    // Reads every zone, running the callback for severity changes like the monitor thread would.
+    std::vector<Temperature_2_0> getTemperatures(bool filterType, TemperatureType type);
+    std::vector<TemperatureThreshold> getThresholds(bool filterType, TemperatureType type);
+
+   private:
+    struct Zone {
+        std::string name;
+        TemperatureType type;
+        SeverityThresholds hot_thresholds;
+        SeverityThresholds hot_hysteresis;
+        // Reads the temperature in millidegrees Celsius.
+        android::base::unique_fd temp_fd;
+        float value = NAN;
+        ThrottlingSeverity severity = ThrottlingSeverity::NONE;
+    };
+
+    void run();
+    void wake();
+    // Reads every zone and returns the ones whose severity changed.
+    std::vector<Temperature_2_0> sampleLocked();
+    std::chrono::milliseconds pollPeriodLocked() const;
+    void notify(const std::vector<Temperature_2_0>& changed);
+
+    ThrottlingCallback callback_;
+    std::mutex zones_mutex_;
+    std::vector<Zone> zones_;
+    std::chrono::steady_clock::time_point last_sample_;
+    android::base::unique_fd uevent_fd_;
+    // Wakes up the monitor thread to reschedule polling or to exit.
+    android::base::unique_fd wake_fd_;
+    std::atomic<bool> stopping_ = false;
+    std::thread thread_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
@@ -21,6 +21,13 @@
 #include <hardware/hdmi_cec.h>
 #include "HdmiCec.h"
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+
 namespace android {
 namespace hardware {
 namespace tv {
@@ -267,6 +274,114 @@ static_assert(HDMI_OPTION_SYSTEM_CEC_CONTROL == static_cast<int>(OptionKey::SYST
 
 sp<IHdmiCecCallback> HdmiCec::mCallback = nullptr;
 
+namespace {
+
+// Bounds the received events held for a client that stopped taking them.
+constexpr size_t kMaxPendingEvents = 256;
+
+struct PendingEvent {
+    bool isCecMessage;
+    CecMessage cecMessage;
+    HotplugEvent hotplugEvent;
+};
+
+std::mutex gEventLock;
+std::condition_variable gEventCond;
+// Received events not delivered yet, oldest first.
+std::deque<PendingEvent> gPendingEvents;
+std::once_flag gEventThreadStarted;
+
+// Status reports only the latest of which matters, so that a newer one replaces a pending one
+// between the same devices. Device discovery polls for these in bursts.
+bool isSupersededBy(const PendingEvent& pending, const PendingEvent& event) {
+    if (!pending.isCecMessage || !event.isCecMessage) return false;
+    auto& a = pending.cecMessage;
+    auto& b = event.cecMessage;
+    return a.body.size() > 0 && b.body.size() > 0 && a.body[0] == b.body[0] &&
+           a.body[0] == static_cast<uint8_t>(CecMessageType::REPORT_POWER_STATUS) &&
+           a.initiator == b.initiator && a.destination == b.destination;
+}
+
+void enqueueEvent(PendingEvent&& event) {
+    std::lock_guard<std::mutex> lock(gEventLock);
+    for (auto it = gPendingEvents.begin(); it != gPendingEvents.end(); ++it) {
+        if (isSupersededBy(*it, event)) {
+            gPendingEvents.erase(it);
+            break;
+        }
+    }
+    if (gPendingEvents.size() >= kMaxPendingEvents) {
+        LOG(WARNING) << "Too many pending CEC events, dropping the oldest one";
+        gPendingEvents.pop_front();
+    }
+    gPendingEvents.push_back(std::move(event));
+    gEventCond.notify_one();
+}
+
+// What the legacy HAL reported about the ports, kept until a hotplug event says it may have
+// changed. Only used once the event callback is registered, as hotplugs go unnoticed before.
+std::mutex gTopologyLock;
+bool gEventCallbackRegistered = false;
+std::optional<hidl_vec<HdmiPortInfo>> gPortInfos;
+std::map<HdmiPortId, bool> gPortConnected;
+// Bumped on every hotplug, so that a query racing with one isn't cached.
+uint64_t gTopologyGeneration = 0;
+
+void invalidateTopology(HdmiPortId portId) {
+    std::lock_guard<std::mutex> lock(gTopologyLock);
+    gTopologyGeneration++;
+    gPortInfos.reset();
+    gPortConnected.erase(portId);
+}
+
+}  // namespace
+
+void HdmiCec::eventCallback(const hdmi_event_t* event, void* /* arg */) {
+    if (event != nullptr && event->type == HDMI_EVENT_HOT_PLUG) {
+        invalidateTopology(static_cast<HdmiPortId>(event->hotplug.port_id));
+    }
+    if (mCallback == nullptr || event == nullptr) return;
+
+    PendingEvent pending = {};
+    if (event->type == HDMI_EVENT_CEC_MESSAGE) {
+        size_t length = std::min(event->cec.length, static_cast<size_t>(MaxLength::MESSAGE_BODY));
+        pending.isCecMessage = true;
+        pending.cecMessage.initiator = static_cast<CecLogicalAddress>(event->cec.initiator);
+        pending.cecMessage.destination = static_cast<CecLogicalAddress>(event->cec.destination);
+        pending.cecMessage.body.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            pending.cecMessage.body[i] = static_cast<uint8_t>(event->cec.body[i]);
+        }
+    } else if (event->type == HDMI_EVENT_HOT_PLUG) {
+        pending.isCecMessage = false;
+        pending.hotplugEvent = {.connected = event->hotplug.connected > 0,
+                                .portId = static_cast<HdmiPortId>(event->hotplug.port_id)};
+    } else {
+        return;
+    }
+    enqueueEvent(std::move(pending));
+}
+
+void HdmiCec::eventThreadLoop() {
+    std::unique_lock<std::mutex> lock(gEventLock);
+    while (true) {
+        gEventCond.wait(lock, [] { return !gPendingEvents.empty(); });
+        PendingEvent event = std::move(gPendingEvents.front());
+        gPendingEvents.pop_front();
+
+        lock.unlock();
+        sp<IHdmiCecCallback> callback = mCallback;
+        if (callback != nullptr) {
+            if (event.isCecMessage) {
+                callback->onCecMessage(event.cecMessage);
+            } else {
+                callback->onHotplugEvent(event.hotplugEvent);
+            }
+        }
+        lock.lock();
+    }
+}
+
 HdmiCec::HdmiCec(hdmi_cec_device_t* device) : mDevice(device) {}
 
 // Methods from ::android::hardware::tv::cec::V2_0::IHdmiCec follow.
@@ -341,12 +456,26 @@ Return<void> HdmiCec::setCallback(const sp<IHdmiCecCallback>& callback) {
     if (callback != nullptr) {
         mCallback = callback;
         mCallback->linkToDeath(this, 0 /*cookie*/);
+        std::call_once(gEventThreadStarted, [] { std::thread(eventThreadLoop).detach(); });
         mDevice->register_event_callback(mDevice, eventCallback, nullptr);
+        std::lock_guard<std::mutex> lock(gTopologyLock);
+        gEventCallbackRegistered = true;
     }
     return Void();
 }
 
 Return<void> HdmiCec::getPortInfo(getPortInfo_cb _hidl_cb) {
+    std::unique_lock<std::mutex> lock(gTopologyLock);
+    if (gPortInfos) {
+        hidl_vec<HdmiPortInfo> portInfos = *gPortInfos;
+        lock.unlock();
+        _hidl_cb(portInfos);
+        return Void();
+    }
+    const bool cacheable = gEventCallbackRegistered;
+    const uint64_t generation = gTopologyGeneration;
+    lock.unlock();
+
     struct hdmi_port_info* legacyPorts;
     int numPorts;
     hidl_vec<HdmiPortInfo> portInfos;
@@ -359,6 +488,9 @@ Return<void> HdmiCec::getPortInfo(getPortInfo_cb _hidl_cb) {
                         .arcSupported = legacyPorts[i].arc_supported != 0,
                         .physicalAddress = legacyPorts[i].physical_address};
     }
+    lock.lock();
+    if (cacheable && generation == gTopologyGeneration) gPortInfos = portInfos;
+    lock.unlock();
     _hidl_cb(portInfos);
     return Void();
 }
@@ -387,7 +519,17 @@ Return<void> HdmiCec::enableAudioReturnChannel(HdmiPortId portId, bool enable) {
 }
 
 Return<bool> HdmiCec::isConnected(HdmiPortId portId) {
-    return mDevice->is_connected(mDevice, portId) > 0;
+    std::unique_lock<std::mutex> lock(gTopologyLock);
+    auto it = gPortConnected.find(portId);
+    if (it != gPortConnected.end()) return it->second;
+    const bool cacheable = gEventCallbackRegistered;
+    const uint64_t generation = gTopologyGeneration;
+    lock.unlock();
+
+    bool connected = mDevice->is_connected(mDevice, portId) > 0;
+    lock.lock();
+    if (cacheable && generation == gTopologyGeneration) gPortConnected[portId] = connected;
+    return connected;
 }
 
 IHdmiCec* HIDL_FETCH_IHdmiCec(const char* hal) {
@@ -70,28 +70,9 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     Return<void> enableAudioReturnChannel(HdmiPortId portId, bool enable) override;
     Return<bool> isConnected(HdmiPortId portId) override;
 
-    static void eventCallback(const hdmi_event_t* event, void* /* arg */) {
-        if (mCallback != nullptr && event != nullptr) {
-            if (event->type == HDMI_EVENT_CEC_MESSAGE) {
-                size_t length =
-                        std::min(event->cec.length, static_cast<size_t>(MaxLength::MESSAGE_BODY));
-                CecMessage cecMessage{
-                        .initiator = static_cast<CecLogicalAddress>(event->cec.initiator),
-                        .destination = static_cast<CecLogicalAddress>(event->cec.destination),
-                };
-                cecMessage.body.resize(length);
-                for (size_t i = 0; i < length; ++i) {
-                    cecMessage.body[i] = static_cast<uint8_t>(event->cec.body[i]);
-                }
-                mCallback->onCecMessage(cecMessage);
-            } else if (event->type == HDMI_EVENT_HOT_PLUG) {
-                HotplugEvent hotplugEvent{
-                        .connected = event->hotplug.connected > 0,
-                        .portId = static_cast<HdmiPortId>(event->hotplug.port_id)};
-                mCallback->onHotplugEvent(hotplugEvent);
-            }
-        }
-    }
+    // Queues the event for the event thread, so that the legacy HAL is never blocked on the
+    // binder call delivering it.
+    static void eventCallback(const hdmi_event_t* event, void* /* arg */);
 
     virtual void serviceDied(uint64_t /*cookie*/,
                              const wp<::android::hidl::base::V1_0::IBase>& /*who*/) {
@@ -99,6 +80,8 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     }
 
    private:
+    static void eventThreadLoop();
+
     static sp<IHdmiCecCallback> mCallback;
     const hdmi_cec_device_t* mDevice;
 };
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.tuner@1.0-ClockRecovery"
+
+#include "ClockRecovery.h"
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+void ClockRecovery::updatePcr(uint64_t pcr, nsecs_t arrivalTime, bool isDiscontinuity) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mHasPcr) {
+        mHasPcr = true;
+        mLastPcr = pcr;
+        mPcrWrapCount = 0;
+        mAnchorPcr = pcr;
+        mAnchorTime = arrivalTime;
+        mRate = NOMINAL_RATE;
+        mStartPcr = pcr;
+        mLastSourceTime = 0;
+        return;
+    }
+
+    if (pcr < mLastPcr && mLastPcr - pcr > PCR_PERIOD / 2) {
+        mPcrWrapCount++;
+    }
+    mLastPcr = pcr;
+    double unwrappedPcr = pcr + static_cast<double>(mPcrWrapCount) * PCR_PERIOD;
+    nsecs_t elapsed = arrivalTime - mAnchorTime;
+    double predictedPcr = mAnchorPcr + mRate * elapsed;
+    double error = unwrappedPcr - predictedPcr;
+
+    if (isDiscontinuity || std::fabs(error) > MAX_PCR_ERROR) {
+        ALOGD("[ClockRecovery] restart the clock at a PCR %.0f off the prediction", error);
+        mStartPcr += error;
+        mAnchorPcr = unwrappedPcr;
+        mAnchorTime = arrivalTime;
+        mRate = NOMINAL_RATE;
+        mLastSourceTime = 0;
+        return;
+    }
+
+    mAnchorPcr = predictedPcr + PHASE_GAIN * error;
+    mAnchorTime = arrivalTime;
+    if (elapsed >= MIN_RATE_INTERVAL) {
+        mRate += RATE_GAIN * error / elapsed;
+        mRate = std::min(std::max(mRate, NOMINAL_RATE - MAX_RATE_OFFSET),
+                         NOMINAL_RATE + MAX_RATE_OFFSET);
+    }
+}
+
+bool ClockRecovery::getSourceTime(nsecs_t systemTime, uint64_t* sourceTime, uint64_t* startTime) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mHasPcr) {
+        return false;
+    }
+
+    double pcr = mAnchorPcr + mRate * (systemTime - mAnchorTime);
+    uint64_t time = pcr > 0 ? static_cast<uint64_t>(pcr / 300) : 0;
+    mLastSourceTime = std::max(mLastSourceTime, time);
+    *sourceTime = mLastSourceTime;
+    *startTime = mStartPcr > 0 ? static_cast<uint64_t>(mStartPcr / 300) : 0;
+    return true;
+}
+
+void ClockRecovery::reset() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mHasPcr = false;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
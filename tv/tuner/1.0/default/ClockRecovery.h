@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_TUNER_V1_0_CLOCKRECOVERY_H_
+#define ANDROID_HARDWARE_TV_TUNER_V1_0_CLOCKRECOVERY_H_
+
+#include <utils/Timers.h>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * Recovers the 27MHz system time clock of a TS program from its PCRs.
+ *
+ * The clock is modelled as a line through the last PCR with the source clock rate, which a
+ * second order loop corrects at each PCR by a fraction of the difference between the PCR and the
+ * time the line predicts, like the PLL of a hardware decoder. The arrival jitter of the PCRs is
+ * then smoothed out, and the source time between PCRs is interpolated from the system clock.
+ */
+class ClockRecovery {
+  public:
+    /**
+     * Feeds the PCR of a TS packet in 27MHz units, arrived at the given time of the monotonic
+     * system clock. The clock restarts from the PCR at a discontinuity, whether signalled by the
+     * adaptation field or found by the PCR being too far from the time predicted. The source time
+     * of the first PCR then moves along, so that the time elapsed since it goes on.
+     */
+    void updatePcr(uint64_t pcr, nsecs_t arrivalTime, bool isDiscontinuity);
+
+    /**
+     * Gets the source time at the given time of the monotonic system clock and the source time of
+     * the first PCR, in 90KHz units not wrapping around with the PCR. The source time does not go
+     * backwards until the clock restarts.
+     *
+     * Return false if no PCR was fed since the clock was reset.
+     */
+    bool getSourceTime(nsecs_t systemTime, uint64_t* sourceTime, uint64_t* startTime);
+
+    void reset();
+
+  private:
+    /**
+     * PCRs are 33 bits of 90KHz base and 9 bits of 27MHz extension.
+     */
+    static constexpr uint64_t PCR_PERIOD = (1ull << 33) * 300;
+    static constexpr double NOMINAL_RATE = 27e6 / 1e9;
+    // The source clock may be off by 30ppm, allow some more for the system clock
+    static constexpr double MAX_RATE_OFFSET = NOMINAL_RATE * 200e-6;
+    // A PCR further than 100ms from the prediction is a discontinuity
+    static constexpr double MAX_PCR_ERROR = 27e6 / 10;
+    // The rate is not corrected from PCRs arrived in the same burst of input
+    static constexpr nsecs_t MIN_RATE_INTERVAL = 1000000;
+    // Loop gains of the phase and of the rate
+    static constexpr double PHASE_GAIN = 1.0 / 8;
+    static constexpr double RATE_GAIN = 1.0 / 64;
+
+    std::mutex mLock;
+    bool mHasPcr = false;
+    // PCR of the last packet, to unwrap the following PCRs
+    uint64_t mLastPcr;
+    uint64_t mPcrWrapCount;
+    // Source time of the line at mAnchorTime, in 27MHz units of the unwrapped PCR
+    double mAnchorPcr;
+    nsecs_t mAnchorTime;
+    // Source clock rate in 27MHz units per nanosecond
+    double mRate;
+    double mStartPcr;
+    uint64_t mLastSourceTime;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_TUNER_V1_0_CLOCKRECOVERY_H_
@@ -17,8 +17,13 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Demux"
 
 #include "Demux.h"
+#include <halmetrics/Metrics.h>
+#include <system/thread_defs.h>
+#include <utils/AndroidThreads.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace tv {
@@ -33,7 +38,9 @@ Demux::Demux(uint32_t demuxId, sp<Tuner> tuner) {
     mTunerService = tuner;
 }
 
-Demux::~Demux() {}
+Demux::~Demux() {
+    stopFilterWorkers();
+}
 
 Return<Result> Demux::setFrontendDataSource(uint32_t frontendId) {
     ALOGV("%s", __FUNCTION__);
@@ -148,10 +155,23 @@ Return<void> Demux::getAvSyncTime(AvSyncHwId avSyncHwId, getAvSyncTime_cb _hidl_
         return Void();
     }
 
+    uint64_t sourceTime;
+    uint64_t startTime;
+    if (getAvSyncSourceTime(&sourceTime, &startTime)) {
+        // Wrap around like the 33 bits PTS
+        avSyncTime = sourceTime & ((1ull << 33) - 1);
+    }
     _hidl_cb(Result::SUCCESS, avSyncTime);
     return Void();
 }
 
+bool Demux::getAvSyncSourceTime(uint64_t* sourceTime, uint64_t* startTime) {
+    if (mPcrFilterIds.empty()) {
+        return false;
+    }
+    return mFilters[*mPcrFilterIds.begin()]->getPcrSourceTime(sourceTime, startTime);
+}
+
 Return<Result> Demux::close() {
     ALOGV("%s", __FUNCTION__);
 
@@ -161,8 +181,18 @@ Return<Result> Demux::close() {
     }
     mPlaybackFilterIds.clear();
     mRecordFilterIds.clear();
+    mPcrFilterIds.clear();
+    stopFilterWorkers();
     mFilters.clear();
     mLastUsedFilterId = -1;
+    {
+        std::lock_guard<std::mutex> lock(mFilterTpidLock);
+        for (auto& filterIds : mFilterIdsByTpid) {
+            filterIds.clear();
+        }
+        mTpidByFilterId.clear();
+        mFilterIdsWithInput.clear();
+    }
 
     return Result::SUCCESS;
 }
@@ -233,54 +263,102 @@ Result Demux::removeFilter(uint32_t filterId) {
     }
     mPlaybackFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
+    mPcrFilterIds.erase(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mFilterTpidLock);
+        clearFilterTpid(filterId);
+    }
+    releaseFilterFromWorkers(filterId);
     mFilters.erase(filterId);
 
     return Result::SUCCESS;
 }
 
-void Demux::startBroadcastTsFilter(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
+void Demux::setFilterTpid(uint32_t filterId, uint16_t tpid) {
+    std::lock_guard<std::mutex> lock(mFilterTpidLock);
+    clearFilterTpid(filterId);
+    if (tpid >= kTsPidCount || mPlaybackFilterIds.find(filterId) == mPlaybackFilterIds.end()) {
+        return;
+    }
+    mFilterIdsByTpid[tpid].push_back(filterId);
+    mTpidByFilterId[filterId] = tpid;
+}
+
+void Demux::clearFilterTpid(uint32_t filterId) {
+    auto it = mTpidByFilterId.find(filterId);
+    if (it == mTpidByFilterId.end()) {
+        return;
+    }
+    vector<uint32_t>& filterIds = mFilterIdsByTpid[it->second];
+    filterIds.erase(std::remove(filterIds.begin(), filterIds.end(), filterId), filterIds.end());
+    mTpidByFilterId.erase(it);
+    mFilterIdsWithInput.erase(filterId);
+}
+
+void Demux::startBroadcastTsFilter(const uint8_t* data, size_t size) {
+    HAL_METRICS_SCOPED_TIMER("tuner.Demux.dispatchTs");
+    HAL_METRICS_COUNT("tuner.Demux.tsPackets");
     uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] start ts filter pid: %d", pid);
     }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
-        }
+    std::lock_guard<std::mutex> lock(mFilterTpidLock);
+    for (uint32_t filterId : mFilterIdsByTpid[pid]) {
+        mFilters[filterId]->updateFilterOutput(data, size);
+        mFilterIdsWithInput.insert(filterId);
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
+void Demux::sendFrontendInputToRecord(const uint8_t* data, size_t size) {
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] update record filter output");
     }
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        mFilters[*it]->updateRecordOutput(data);
+    // Record the packet once for all the record filters of its PID, in the order of the input
+    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
+    bool isRecorded = false;
+    uint64_t byteNumber = 0;
+    for (uint32_t filterId : mRecordFilterIds) {
+        if (mFilters[filterId]->getTpid() != pid) {
+            continue;
+        }
+        if (!isRecorded) {
+            HAL_METRICS_COUNT("tuner.Demux.recordedPackets");
+            byteNumber = mDvrRecord->getRecordByteNumber();
+            mDvrRecord->updateRecordOutput(data, size);
+            isRecorded = true;
+        }
+        mFilters[filterId]->updateRecordIndex(data, size, byteNumber);
     }
 }
 
 bool Demux::startBroadcastFilterDispatcher() {
-    set<uint32_t>::iterator it;
+    std::lock_guard<std::mutex> lock(mFilterTpidLock);
+    startFilterWorkers();
 
     // Handle the output data per filter type
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (mFilters[*it]->startFilterHandler() != Result::SUCCESS) {
-            return false;
+    for (uint32_t filterId : mFilterIdsWithInput) {
+        auto filter = mFilters.find(filterId);
+        if (filter == mFilters.end()) {
+            continue;
         }
+        FilterWorker& worker =
+                *mFilterWorkers[filter->second->isMediaFilter() || filter->second->isPcrFilter()
+                                        ? AV_FILTER_WORKER
+                                        : DATA_FILTER_WORKER];
+        std::lock_guard<std::mutex> workerLock(worker.lock);
+        worker.pendingFilters[filterId] = filter->second;
+        worker.condition.notify_one();
     }
+    mFilterIdsWithInput.clear();
 
     return true;
 }
 
 bool Demux::startRecordFilterDispatcher() {
-    set<uint32_t>::iterator it;
-
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (mFilters[*it]->startRecordFilterHandler() != Result::SUCCESS) {
-            return false;
-        }
+    // The packets dropped on a record overflow are not indexed, the record goes on once flushed
+    bool isRecorded = mDvrRecord->writeRecordFMQ();
+    for (uint32_t filterId : mRecordFilterIds) {
+        mFilters[filterId]->startRecordFilterHandler(isRecorded);
     }
 
     return true;
@@ -290,8 +368,8 @@ Result Demux::startFilterHandler(uint32_t filterId) {
     return mFilters[filterId]->startFilterHandler();
 }
 
-void Demux::updateFilterOutput(uint16_t filterId, vector<uint8_t> data) {
-    mFilters[filterId]->updateFilterOutput(data);
+void Demux::updateFilterOutput(uint16_t filterId, const uint8_t* data, size_t size) {
+    mFilters[filterId]->updateFilterOutput(data, size);
 }
 
 uint16_t Demux::getFilterTpid(uint32_t filterId) {
@@ -335,6 +413,112 @@ void Demux::frontendInputThreadLoop() {
     ALOGW("[Demux] Frontend Input thread end.");
 }
 
+void Demux::startFilterWorkers() {
+    if (mFilterWorkersStarted) {
+        return;
+    }
+    for (int i = 0; i < FILTER_WORKER_COUNT; i++) {
+        // A new worker each time, the thread of a previous one may not have exited yet
+        std::shared_ptr<FilterWorker> worker = std::make_shared<FilterWorker>();
+        worker->type = static_cast<FilterWorkerType>(i);
+        worker->running = true;
+        pthread_create(&worker->thread, NULL, __threadLoopFilterWorker,
+                       new std::shared_ptr<FilterWorker>(worker));
+        pthread_setname_np(worker->thread,
+                           i == AV_FILTER_WORKER ? "av_filter_worker" : "data_filter_worker");
+        mFilterWorkers[i] = std::move(worker);
+    }
+    mFilterWorkersStarted = true;
+}
+
+void Demux::stopFilterWorkers() {
+    std::lock_guard<std::mutex> lock(mFilterTpidLock);
+    if (!mFilterWorkersStarted) {
+        return;
+    }
+    for (const auto& worker : mFilterWorkers) {
+        {
+            std::lock_guard<std::mutex> workerLock(worker->lock);
+            worker->running = false;
+        }
+        worker->condition.notify_all();
+    }
+    for (const auto& worker : mFilterWorkers) {
+        // The workers release their filters before the demux does, so it is not expected to be
+        // released on one of them. The thread keeps its worker alive if it is anyway.
+        if (pthread_equal(worker->thread, pthread_self())) {
+            pthread_detach(worker->thread);
+        } else {
+            pthread_join(worker->thread, NULL);
+        }
+        std::map<uint32_t, sp<Filter>> filters;
+        {
+            std::lock_guard<std::mutex> workerLock(worker->lock);
+            filters.swap(worker->pendingFilters);
+        }
+    }
+    mFilterWorkersStarted = false;
+}
+
+void Demux::releaseFilterFromWorkers(uint32_t filterId) {
+    std::vector<std::shared_ptr<FilterWorker>> workers;
+    {
+        std::lock_guard<std::mutex> lock(mFilterTpidLock);
+        if (!mFilterWorkersStarted) {
+            return;
+        }
+        workers.assign(std::begin(mFilterWorkers), std::end(mFilterWorkers));
+    }
+    for (const auto& worker : workers) {
+        sp<Filter> filter;
+        std::unique_lock<std::mutex> workerLock(worker->lock);
+        auto pending = worker->pendingFilters.find(filterId);
+        if (pending != worker->pendingFilters.end()) {
+            filter = std::move(pending->second);
+            worker->pendingFilters.erase(pending);
+        }
+        worker->idleCondition.wait(workerLock, [&worker] { return !worker->busy; });
+    }
+}
+
+void* Demux::__threadLoopFilterWorker(void* worker) {
+    std::unique_ptr<std::shared_ptr<FilterWorker>> self(
+            static_cast<std::shared_ptr<FilterWorker>*>(worker));
+    filterWorkerThreadLoop(*self);
+    return 0;
+}
+
+void Demux::filterWorkerThreadLoop(const std::shared_ptr<FilterWorker>& worker) {
+    // The data filters run in the background of the A/V filters, which keep the default priority
+    if (worker->type == DATA_FILTER_WORKER) {
+        androidSetThreadPriority(0 /*tid*/, ANDROID_PRIORITY_BACKGROUND);
+    }
+
+    std::unique_lock<std::mutex> lock(worker->lock);
+    while (true) {
+        worker->condition.wait(
+                lock, [&worker] { return !worker->running || !worker->pendingFilters.empty(); });
+        if (!worker->running) {
+            break;
+        }
+        std::map<uint32_t, sp<Filter>> filters;
+        filters.swap(worker->pendingFilters);
+        worker->busy = true;
+        lock.unlock();
+        for (auto& filter : filters) {
+            if (filter.second->startFilterHandler() != Result::SUCCESS) {
+                ALOGE("[Demux] filter %d failed to filter its data", filter.first);
+            }
+        }
+        // Released while busy, so removeFilter() still waits with the filters in mFilters and
+        // this is never the last reference to a filter, or through it to the demux.
+        filters.clear();
+        lock.lock();
+        worker->busy = false;
+        worker->idleCondition.notify_all();
+    }
+}
+
 void Demux::stopFrontendInput() {
     ALOGD("[Demux] stop frontend on demux");
     mKeepFetchingDataFromFrontend = false;
@@ -20,6 +20,8 @@
 #include <android/hardware/tv/tuner/1.0/IDemux.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <condition_variable>
+#include <memory>
 #include <set>
 #include "Dvr.h"
 #include "Filter.h"
@@ -86,20 +88,33 @@ class Demux : public IDemux {
     bool attachRecordFilter(int filterId);
     bool detachRecordFilter(int filterId);
     Result startFilterHandler(uint32_t filterId);
-    void updateFilterOutput(uint16_t filterId, vector<uint8_t> data);
+    void updateFilterOutput(uint16_t filterId, const uint8_t* data, size_t size);
     uint16_t getFilterTpid(uint32_t filterId);
+    /**
+     * Route the TS packets of the given PID to a configured playback filter, replacing the PID
+     * it was configured with before.
+     */
+    void setFilterTpid(uint32_t filterId, uint16_t tpid);
     void setIsRecording(bool isRecording);
+    /**
+     * Gets the source time recovered from the PCRs of the A/V sync PCR filter, and the source time
+     * of its first PCR, in 90KHz units.
+     *
+     * Return false if there is no PCR filter or it got no PCR yet.
+     */
+    bool getAvSyncSourceTime(uint64_t* sourceTime, uint64_t* startTime);
     void startFrontendInputLoop();
 
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * A dispatcher to hand the filters which got input data since the last dispatch to their
+     * filter worker. Each filter handler handles the data filtering/output writing/filterEvent
+     * updating on the worker.
      * Note that recording filters are not included.
      */
     bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<uint8_t> data);
+    void startBroadcastTsFilter(const uint8_t* data, size_t size);
 
-    void sendFrontendInputToRecord(vector<uint8_t> data);
+    void sendFrontendInputToRecord(const uint8_t* data, size_t size);
     bool startRecordFilterDispatcher();
 
   private:
@@ -115,8 +130,51 @@ class Demux : public IDemux {
         uint32_t filterId;
     };
 
+    /**
+     * The filter handlers run on workers by type of filter, so that slow section or PES filters
+     * do not hold back the A/V filters, and the input threads only hand the packets to the
+     * filters of their PID.
+     */
+    enum FilterWorkerType {
+        AV_FILTER_WORKER = 0,
+        DATA_FILTER_WORKER,
+        FILTER_WORKER_COUNT,
+    };
+    /**
+     * Shared with the thread of the worker, so that it stays valid if the demux is released
+     * while the thread is still running.
+     */
+    struct FilterWorker {
+        FilterWorkerType type;
+        pthread_t thread;
+        bool running = false;
+        /**
+         * Whether the worker holds filters outside of the lock, signaled by idleCondition.
+         */
+        bool busy = false;
+        std::mutex lock;
+        std::condition_variable condition;
+        std::condition_variable idleCondition;
+        /**
+         * The filters with input data to handle, keeping them alive until they are handled.
+         */
+        std::map<uint32_t, sp<Filter>> pendingFilters;
+    };
+
     static void* __threadLoopFrontend(void* user);
     void frontendInputThreadLoop();
+    static void* __threadLoopFilterWorker(void* worker);
+    static void filterWorkerThreadLoop(const std::shared_ptr<FilterWorker>& worker);
+    /**
+     * Takes the filter out of the workers, waiting until none of them holds it, so that the
+     * demux always releases its filters after the workers do.
+     */
+    void releaseFilterFromWorkers(uint32_t filterId);
+    /**
+     * Start the filter workers if they are not running. Expects mFilterTpidLock to be held.
+     */
+    void startFilterWorkers();
+    void stopFilterWorkers();
 
     /**
      * To create a FilterMQ with the the next available Filter ID.
@@ -127,6 +185,7 @@ class Demux : public IDemux {
      */
     void deleteEventFlag();
     bool readDataFromMQ();
+    void clearFilterTpid(uint32_t filterId);
 
     uint32_t mDemuxId;
     uint32_t mCiCamId;
@@ -152,6 +211,31 @@ class Demux : public IDemux {
      */
     std::map<uint32_t, sp<Filter>> mFilters;
 
+    /**
+     * The number of TS PIDs, which are 13 bits long.
+     */
+    static constexpr size_t kTsPidCount = 0x2000;
+    /**
+     * The ids of the configured playback filters of each TS PID, so that each packet is only
+     * handed to the filters of its PID. Updated when filters are configured or removed.
+     */
+    vector<vector<uint32_t>> mFilterIdsByTpid = vector<vector<uint32_t>>(kTsPidCount);
+    /**
+     * The PID each filter of mFilterIdsByTpid is listed under.
+     */
+    std::map<uint32_t, uint16_t> mTpidByFilterId;
+    /**
+     * The playback filters handed packets since the last dispatch to the filter workers.
+     */
+    set<uint32_t> mFilterIdsWithInput;
+    /**
+     * Lock to protect the PID dispatch table from filters configured during dispatching
+     */
+    std::mutex mFilterTpidLock;
+
+    std::shared_ptr<FilterWorker> mFilterWorkers[FILTER_WORKER_COUNT];
+    bool mFilterWorkersStarted = false;
+
     /**
      * Local reference to the opened Timer Filter instance.
      */
@@ -18,6 +18,7 @@
 
 #include "Dvr.h"
 #include <utils/Log.h>
+#include <string.h>
 
 namespace android {
 namespace hardware {
@@ -116,6 +117,8 @@ Return<Result> Dvr::start() {
         pthread_setname_np(mDvrThread, "playback_waiting_loop");
     } else if (mType == DvrType::RECORD) {
         mRecordStatus = RecordStatus::DATA_READY;
+        mRecordOutput.clear();
+        mRecordByteCount = 0;
         mDemux->setIsRecording(mType == DvrType::RECORD);
     }
 
@@ -128,6 +131,10 @@ Return<Result> Dvr::stop() {
     ALOGV("%s", __FUNCTION__);
 
     mDvrThreadRunning = false;
+    if (mType == DvrType::PLAYBACK) {
+        // Wake up the playback thread waiting for data so that it ends now
+        mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+    }
 
     std::lock_guard<std::mutex> lock(mDvrThreadLock);
 
@@ -211,7 +218,6 @@ void Dvr::playbackThreadLoop() {
 }
 
 void Dvr::maySendPlaybackStatusCallback() {
-    std::lock_guard<std::mutex> lock(mPlaybackStatusLock);
     int availableToRead = mDvrMQ->availableToRead();
     int availableToWrite = mDvrMQ->availableToWrite();
 
@@ -219,8 +225,8 @@ void Dvr::maySendPlaybackStatusCallback() {
                                                          mDvrSettings.playback().highThreshold,
                                                          mDvrSettings.playback().lowThreshold);
     if (mPlaybackStatus != newStatus) {
-        mCallback->onPlaybackStatus(newStatus);
         mPlaybackStatus = newStatus;
+        mCallback->onPlaybackStatus(newStatus);
     }
 }
 
@@ -239,43 +245,73 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 }
 
 bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
-    // Read playback data from the input FMQ
-    int size = mDvrMQ->availableToRead();
-    int playbackPacketSize = mDvrSettings.playback().packetSize;
-    vector<uint8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
+    // Read all the whole playback packets of the input FMQ in place
+    size_t playbackPacketSize = mDvrSettings.playback().packetSize;
+    if (playbackPacketSize == 0) {
+        return false;
+    }
+    size_t size = mDvrMQ->availableToRead() / playbackPacketSize * playbackPacketSize;
+    if (size == 0) {
+        return true;
+    }
+    DvrMQ::MemTransaction tx;
+    if (!mDvrMQ->beginRead(size, &tx)) {
+        return false;
+    }
+
+    // Dispatch the packets to the PID matching filter output buffer. The data may wrap around the
+    // end of the FMQ, only the packet across the end is copied to be contiguous.
+    const DvrMQ::MemRegion& first = tx.getFirstRegion();
+    const DvrMQ::MemRegion& second = tx.getSecondRegion();
+    size_t firstLength = first.getLength();
+    size_t offset = 0;
+    while (offset + playbackPacketSize <= firstLength) {
+        dispatchPlaybackPacket(first.getAddress() + offset, playbackPacketSize, isVirtualFrontend,
+                               isRecording);
+        offset += playbackPacketSize;
+    }
+    if (offset < size) {
+        size_t secondOffset = 0;
+        if (offset < firstLength) {
+            size_t firstPart = firstLength - offset;
+            mWrappedPacket.resize(playbackPacketSize);
+            memcpy(mWrappedPacket.data(), first.getAddress() + offset, firstPart);
+            memcpy(mWrappedPacket.data() + firstPart, second.getAddress(),
+                   playbackPacketSize - firstPart);
+            dispatchPlaybackPacket(mWrappedPacket.data(), playbackPacketSize, isVirtualFrontend,
+                                   isRecording);
+            secondOffset = playbackPacketSize - firstPart;
+            offset += playbackPacketSize;
         }
-        if (isVirtualFrontend) {
-            if (isRecording) {
-                mDemux->sendFrontendInputToRecord(dataOutputBuffer);
-            } else {
-                mDemux->startBroadcastTsFilter(dataOutputBuffer);
-            }
-        } else {
-            startTpidFilter(dataOutputBuffer);
+        while (offset < size) {
+            dispatchPlaybackPacket(second.getAddress() + secondOffset, playbackPacketSize,
+                                   isVirtualFrontend, isRecording);
+            secondOffset += playbackPacketSize;
+            offset += playbackPacketSize;
         }
     }
 
-    return true;
+    return mDvrMQ->commitRead(size);
 }
 
-void Dvr::startTpidFilter(vector<uint8_t> data) {
-    std::map<uint32_t, sp<IFilter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
+void Dvr::dispatchPlaybackPacket(const uint8_t* packet, size_t size, bool isVirtualFrontend,
+                                 bool isRecording) {
+    if (isVirtualFrontend) {
+        if (isRecording) {
+            mDemux->sendFrontendInputToRecord(packet, size);
+        } else {
+            mDemux->startBroadcastTsFilter(packet, size);
         }
+    } else {
+        startTpidFilter(packet, size);
     }
 }
 
+void Dvr::startTpidFilter(const uint8_t* data, size_t size) {
+    // The playback filters of the DVR are the ones of the demux, which keeps them by PID
+    mDemux->startBroadcastTsFilter(data, size);
+}
+
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
     if (isVirtualFrontend) {
         if (isRecording) {
@@ -285,44 +321,52 @@ bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
         }
     }
 
-    std::map<uint32_t, sp<IFilter>>::iterator it;
-    // Handle the output data per filter type
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        if (mDemux->startFilterHandler(it->first) != Result::SUCCESS) {
-            return false;
-        }
-    }
+    // The playback filters of the DVR are the ones of the demux, handled on its filter workers
+    return mDemux->startBroadcastFilterDispatcher();
+}
 
-    return true;
+void Dvr::updateRecordOutput(const uint8_t* data, size_t size) {
+    mRecordOutput.insert(mRecordOutput.end(), data, data + size);
+}
+
+uint64_t Dvr::getRecordByteNumber() {
+    return mRecordByteCount + mRecordOutput.size();
 }
 
-bool Dvr::writeRecordFMQ(const std::vector<uint8_t>& data) {
+bool Dvr::writeRecordFMQ() {
+    if (mRecordOutput.empty()) {
+        return true;
+    }
     std::lock_guard<std::mutex> lock(mWriteLock);
     if (mRecordStatus == RecordStatus::OVERFLOW) {
         ALOGW("[Dvr] stops writing and wait for the client side flushing.");
-        return true;
+        mRecordOutput.clear();
+        return false;
     }
-    if (mDvrMQ->write(data.data(), data.size())) {
+    bool isWritten = mDvrMQ->write(mRecordOutput.data(), mRecordOutput.size());
+    if (isWritten) {
+        mRecordByteCount += mRecordOutput.size();
         mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
-        maySendRecordStatusCallback();
-        return true;
+    } else {
+        ALOGW("[Dvr] dropping %zu bytes of record data", mRecordOutput.size());
     }
+    mRecordOutput.clear();
 
     maySendRecordStatusCallback();
-    return false;
+    return isWritten;
 }
 
 void Dvr::maySendRecordStatusCallback() {
-    std::lock_guard<std::mutex> lock(mRecordStatusLock);
     int availableToRead = mDvrMQ->availableToRead();
     int availableToWrite = mDvrMQ->availableToWrite();
 
+    RecordStatus status = mRecordStatus;
     RecordStatus newStatus = checkRecordStatusChange(availableToWrite, availableToRead,
                                                      mDvrSettings.record().highThreshold,
                                                      mDvrSettings.record().lowThreshold);
-    if (mRecordStatus != newStatus) {
+    // Not switched over a status reset by a flush of the client meanwhile
+    if (newStatus != status && mRecordStatus.compare_exchange_strong(status, newStatus)) {
         mCallback->onRecordStatus(newStatus);
-        mRecordStatus = newStatus;
     }
 }
 
@@ -20,6 +20,7 @@
 #include <android/hardware/tv/tuner/1.0/IDvr.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <atomic>
 #include <set>
 #include "Demux.h"
 #include "Frontend.h"
@@ -80,7 +81,20 @@ class Dvr : public IDvr {
      */
     bool createDvrMQ();
     void sendBroadcastInputToDvrRecord(vector<uint8_t> byteBuffer);
-    bool writeRecordFMQ(const std::vector<uint8_t>& data);
+    /**
+     * Adds a packet of a record filter PID to the packets written on the next dispatch.
+     */
+    void updateRecordOutput(const uint8_t* data, size_t size);
+    /**
+     * Return the byte number in the DVR output of the next packet added to the record output.
+     */
+    uint64_t getRecordByteNumber();
+    /**
+     * Writes the packets recorded since the last dispatch into the DVR FMQ with a single write.
+     *
+     * Return false if the packets are dropped, on overflow or when the FMQ has no room for them.
+     */
+    bool writeRecordFMQ();
     bool addPlaybackFilter(uint32_t filterId, sp<IFilter> filter);
     bool removePlaybackFilter(uint32_t filterId);
     bool readPlaybackFMQ(bool isVirtualFrontend, bool isRecording);
@@ -108,7 +122,13 @@ class Dvr : public IDvr {
      * A dispatcher to read and dispatch input data to all the started filters.
      * Each filter handler handles the data filtering/output writing/filterEvent updating.
      */
-    void startTpidFilter(vector<uint8_t> data);
+    void startTpidFilter(const uint8_t* data, size_t size);
+    /**
+     * Hand one playback packet to the filters it is for, or to the record filters when recording
+     * from the virtual frontend.
+     */
+    void dispatchPlaybackPacket(const uint8_t* packet, size_t size, bool isVirtualFrontend,
+                                bool isRecording);
     static void* __threadLoopPlayback(void* user);
     static void* __threadLoopRecord(void* user);
     void playbackThreadLoop();
@@ -121,13 +141,29 @@ class Dvr : public IDvr {
      */
     bool mDvrConfigured = false;
     DvrSettings mDvrSettings;
+    /**
+     * Reused to make contiguous the playback packet across the end of the FMQ
+     */
+    vector<uint8_t> mWrappedPacket;
+    /**
+     * Packets of the record filters kept in the order of the input until the next dispatch
+     */
+    vector<uint8_t> mRecordOutput;
+    /**
+     * Bytes written into the DVR FMQ since the record started
+     */
+    uint64_t mRecordByteCount = 0;
 
     // Thread handlers
     pthread_t mDvrThread;
 
-    // FMQ status local records
-    PlaybackStatus mPlaybackStatus;
-    RecordStatus mRecordStatus;
+    /**
+     * FMQ status last sent. The playback status is only switched by the playback thread and the
+     * record status by the thread writing the record, they are atomic to be reset on start and
+     * flush without a lock.
+     */
+    std::atomic<PlaybackStatus> mPlaybackStatus{PlaybackStatus::SPACE_EMPTY};
+    std::atomic<RecordStatus> mRecordStatus{RecordStatus::DATA_READY};
     /**
      * If a specific filter's writing loop is still running
      */
@@ -137,11 +173,6 @@ class Dvr : public IDvr {
      * Lock to protect writes to the FMQs
      */
     std::mutex mWriteLock;
-    /**
-     * Lock to protect writes to the input status
-     */
-    std::mutex mPlaybackStatusLock;
-    std::mutex mRecordStatusLock;
     std::mutex mDvrThreadLock;
 
     const bool DEBUG_DVR = false;
@@ -17,6 +17,7 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Filter"
 
 #include "Filter.h"
+#include <halmetrics/Metrics.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -37,6 +38,7 @@ Filter::Filter(DemuxFilterType type, uint32_t filterId, uint32_t bufferSize,
     mBufferSize = bufferSize;
     mCallback = cb;
     mDemux = demux;
+    mFilterEvents.reserve(FILTER_EVENTS_RESERVED);
 
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
@@ -69,9 +71,25 @@ Filter::Filter(DemuxFilterType type, uint32_t filterId, uint32_t bufferSize,
         default:
             break;
     }
+
+    if (mType.mainType == DemuxFilterMainType::TS &&
+        (mIsMediaFilter || mType.subType.tsFilterType() == DemuxTsFilterType::PES)) {
+        mPesOutput.reserve(MAX_PES_SIZE);
+    }
+    if (mType.mainType == DemuxFilterMainType::TS &&
+        mType.subType.tsFilterType() == DemuxTsFilterType::SECTION) {
+        mSectionOutput.reserve(MAX_SECTION_SIZE);
+    }
 }
 
-Filter::~Filter() {}
+Filter::~Filter() {
+    if (mAvPoolBuffer != nullptr) {
+        munmap(mAvPoolBuffer, AV_BLOCK_SIZE * AV_BLOCK_COUNT);
+    }
+    if (mAvPoolFd != -1) {
+        ::close(mAvPoolFd);
+    }
+}
 
 Return<void> Filter::getId(getId_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
@@ -101,10 +119,18 @@ Return<void> Filter::getQueueDesc(getQueueDesc_cb _hidl_cb) {
 Return<Result> Filter::configure(const DemuxFilterSettings& settings) {
     ALOGV("%s", __FUNCTION__);
 
-    mFilterSettings = settings;
+    {
+        // Send the sections again under the new settings
+        std::lock_guard<std::mutex> lock(mFilterOutputLock);
+        mFilterSettings = settings;
+        mSectionVersions.clear();
+    }
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             mTpid = settings.ts().tpid;
+            if (mDemux != nullptr) {
+                mDemux->setFilterTpid(mFilterId, mTpid);
+            }
             break;
         case DemuxFilterMainType::MMTP:
             break;
@@ -124,13 +150,38 @@ Return<Result> Filter::configure(const DemuxFilterSettings& settings) {
 Return<Result> Filter::start() {
     ALOGV("%s", __FUNCTION__);
 
+    {
+        std::lock_guard<std::mutex> lock(mFilterOutputLock);
+        mSectionVersions.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mFilterInputLock);
+        mPcrInput.clear();
+    }
+    mPcrClock.reset();
+    {
+        std::lock_guard<std::mutex> lock(mRecordEventsLock);
+        mIsFirstRecordPacket = true;
+        mLastScramblingControl = -1;
+        mStartCodeWindow = 0xffffffff;
+        mPictureHeaderBytesLeft = 0;
+    }
+
     return startFilterLoop();
 }
 
 Return<Result> Filter::stop() {
     ALOGV("%s", __FUNCTION__);
 
-    mFilterThreadRunning = false;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mFilterThreadRunning = false;
+    }
+    // Wake up the filter thread whether it waits for filter data or for the data to be consumed
+    mFilterEventCondition.notify_all();
+    if (mIsUsingFMQ) {
+        mFilterEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+    }
 
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
 
@@ -152,11 +203,21 @@ Return<Result> Filter::flush() {
 
 Return<Result> Filter::releaseAvHandle(const hidl_handle& /*avMemory*/, uint64_t avDataId) {
     ALOGV("%s", __FUNCTION__);
-    if (mDataId2Avfd.find(avDataId) == mDataId2Avfd.end()) {
+    std::lock_guard<std::mutex> lock(mAvPoolLock);
+    auto block = mDataId2AvBlock.find(avDataId);
+    if (block != mDataId2AvBlock.end()) {
+        mFreeAvBlocks.push_back(block->second);
+        mDataId2AvBlock.erase(block);
+        return Result::SUCCESS;
+    }
+
+    auto avFd = mDataId2Avfd.find(avDataId);
+    if (avFd == mDataId2Avfd.end()) {
         return Result::INVALID_ARGUMENT;
     }
 
-    ::close(mDataId2Avfd[avDataId]);
+    ::close(avFd->second);
+    mDataId2Avfd.erase(avFd);
     return Result::SUCCESS;
 }
 
@@ -178,6 +239,9 @@ bool Filter::createFilterMQ() {
     }
 
     mFilterMQ = std::move(tmpFilterMQ);
+    uint32_t fmqSize = mFilterMQ->getQuantumCount();
+    mHighThreshold = ceil(fmqSize * 0.75);
+    mLowThreshold = ceil(fmqSize * 0.25);
 
     if (EventFlag::createEventFlag(mFilterMQ->getEventFlagWord(), &mFilterEventFlag) != OK) {
         return false;
@@ -187,6 +251,10 @@ bool Filter::createFilterMQ() {
 }
 
 Result Filter::startFilterLoop() {
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mFilterThreadRunning = true;
+    }
     pthread_create(&mFilterThread, NULL, __threadLoopFilter, this);
     pthread_setname_np(mFilterThread, "filter_waiting_loop");
 
@@ -202,96 +270,78 @@ void* Filter::__threadLoopFilter(void* user) {
 void Filter::filterThreadLoop() {
     ALOGD("[Filter] filter %d threadLoop start.", mFilterId);
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
-    mFilterThreadRunning = true;
+    if (mCallback == nullptr) {
+        ALOGD("[Filter] filter %d does not hava callback. Ending thread", mFilterId);
+        return;
+    }
 
     // For the first time of filter output, implementation needs to send the filter
     // Event Callback without waiting for the DATA_CONSUMED to init the process.
-    while (mFilterThreadRunning) {
-        if (mFilterEvent.events.size() == 0) {
-            if (DEBUG_FILTER) {
+    bool isFirstEvent = true;
+    DemuxFilterEvent filterEvent;
+    vector<DemuxFilterEvent::Event> pendingEvents;
+    pendingEvents.reserve(FILTER_EVENTS_RESERVED);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> eventLock(mFilterEventLock);
+            if (DEBUG_FILTER && mFilterEvents.empty()) {
                 ALOGD("[Filter] wait for filter data output.");
             }
-            usleep(1000 * 1000);
-            continue;
-        }
-        // After successfully write, send a callback and wait for the read to be done
-        mCallback->onFilterEvent(mFilterEvent);
-        freeAvHandle();
-        mFilterEvent.events.resize(0);
-        mFilterStatus = DemuxFilterStatus::DATA_READY;
-        if (mCallback == nullptr) {
-            ALOGD("[Filter] filter %d does not hava callback. Ending thread", mFilterId);
-            break;
-        }
-        mCallback->onFilterStatus(mFilterStatus);
-        break;
-    }
-
-    while (mFilterThreadRunning) {
-        uint32_t efState = 0;
-        // We do not wait for the last round of written data to be read to finish the thread
-        // because the VTS can verify the reading itself.
-        for (int i = 0; i < SECTION_WRITE_COUNT; i++) {
-            while (mFilterThreadRunning && mIsUsingFMQ) {
-                status_t status = mFilterEventFlag->wait(
-                        static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
-                        WAIT_TIMEOUT, true /* retry on spurious wake */);
-                if (status != OK) {
-                    ALOGD("[Filter] wait for data consumed");
-                    continue;
-                }
+            mFilterEventCondition.wait(eventLock, [this] {
+                return !mFilterThreadRunning || !mFilterEvents.empty();
+            });
+            if (!mFilterThreadRunning) {
                 break;
             }
+            // Take the events so that the handlers can keep filtering during the callback
+            pendingEvents.swap(mFilterEvents);
+        }
 
-            maySendFilterStatusCallback();
+        filterEvent.events.resize(pendingEvents.size());
+        for (size_t i = 0; i < pendingEvents.size(); i++) {
+            filterEvent.events[i] = std::move(pendingEvents[i]);
+        }
+        pendingEvents.clear();
+
+        mCallback->onFilterEvent(filterEvent);
+        // The AV handles of the events own their fds, which the client has dup'ed
+        filterEvent.events.resize(0);
+        if (isFirstEvent) {
+            mFilterStatus = DemuxFilterStatus::DATA_READY;
+            mCallback->onFilterStatus(DemuxFilterStatus::DATA_READY);
+            isFirstEvent = false;
+        }
 
-            while (mFilterThreadRunning) {
-                std::lock_guard<std::mutex> lock(mFilterEventLock);
-                if (mFilterEvent.events.size() == 0) {
-                    continue;
-                }
-                // After successfully write, send a callback and wait for the read to be done
-                mCallback->onFilterEvent(mFilterEvent);
-                mFilterEvent.events.resize(0);
-                break;
-            }
-            // We do not wait for the last read to be done
-            // VTS can verify the read result itself.
-            if (i == SECTION_WRITE_COUNT - 1) {
-                ALOGD("[Filter] filter %d writing done. Ending thread", mFilterId);
-                break;
+        // Wait for the client to read the data before sending the next events
+        while (mFilterThreadRunning && mIsUsingFMQ) {
+            uint32_t efState = 0;
+            status_t status = mFilterEventFlag->wait(
+                    static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
+                    WAIT_TIMEOUT, true /* retry on spurious wake */);
+            if (status != OK) {
+                ALOGD("[Filter] wait for data consumed");
+                continue;
             }
+            break;
         }
-        mFilterThreadRunning = false;
+
+        maySendFilterStatusCallback();
     }
 
     ALOGD("[Filter] filter thread ended.");
 }
 
-void Filter::freeAvHandle() {
-    if (!mIsMediaFilter) {
-        return;
-    }
-    for (int i = 0; i < mFilterEvent.events.size(); i++) {
-        ::close(mFilterEvent.events[i].media().avMemory.getNativeHandle()->data[0]);
-        native_handle_close(mFilterEvent.events[i].media().avMemory.getNativeHandle());
-    }
-}
-
 void Filter::maySendFilterStatusCallback() {
     if (!mIsUsingFMQ) {
         return;
     }
-    std::lock_guard<std::mutex> lock(mFilterStatusLock);
-    int availableToRead = mFilterMQ->availableToRead();
-    int availableToWrite = mFilterMQ->availableToWrite();
-    int fmqSize = mFilterMQ->getQuantumCount();
-
-    DemuxFilterStatus newStatus = checkFilterStatusChange(
-            availableToWrite, availableToRead, ceil(fmqSize * 0.75), ceil(fmqSize * 0.25));
-    if (mFilterStatus != newStatus) {
+    // The FMQ keeps its read and write counters in atomics, the occupancy is read without a lock
+    DemuxFilterStatus status = mFilterStatus;
+    DemuxFilterStatus newStatus =
+            checkFilterStatusChange(mFilterMQ->availableToWrite(), mFilterMQ->availableToRead(),
+                                    mHighThreshold, mLowThreshold);
+    if (newStatus != status && mFilterStatus.compare_exchange_strong(status, newStatus)) {
         mCallback->onFilterStatus(newStatus);
-        mFilterStatus = newStatus;
     }
 }
 
@@ -312,18 +362,199 @@ uint16_t Filter::getTpid() {
     return mTpid;
 }
 
-void Filter::updateFilterOutput(vector<uint8_t> data) {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
+void Filter::updateFilterOutput(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mFilterInputLock);
+    if (!mIsPcrFilter) {
+        mFilterInput.insert(mFilterInput.end(), data, data + size);
+        return;
+    }
+    nsecs_t arrivalTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i + TS_PACKET_SIZE <= size; i += TS_PACKET_SIZE) {
+        const uint8_t* packet = data + i;
+        // An adaptation field long enough for its flags and a PCR, with the PCR flag set
+        if ((packet[3] & 0x20) == 0 || packet[4] < 7 || (packet[5] & 0x10) == 0) {
+            continue;
+        }
+        uint64_t pcrBase = (static_cast<uint64_t>(packet[6]) << 25) | (packet[7] << 17) |
+                           (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+        uint32_t pcrExtension = ((packet[10] & 0x01) << 8) | packet[11];
+        mPcrInput.push_back({
+                .pcr = pcrBase * 300 + pcrExtension,
+                .arrivalTime = arrivalTime,
+                .isDiscontinuity = (packet[5] & 0x80) != 0,
+        });
+    }
 }
 
-void Filter::updateRecordOutput(vector<uint8_t> data) {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+void Filter::updateRecordIndex(const uint8_t* packet, size_t size, uint64_t byteNumber) {
+    if (size < TS_PACKET_SIZE ||
+        mFilterSettings.getDiscriminator() != DemuxFilterSettings::hidl_discriminator::ts ||
+        mFilterSettings.ts().filterSettings.getDiscriminator() !=
+                DemuxTsFilterSettings::FilterSettings::hidl_discriminator::record) {
+        return;
+    }
+    const DemuxFilterRecordSettings& settings = mFilterSettings.ts().filterSettings.record();
+    std::lock_guard<std::mutex> lock(mRecordEventsLock);
+
+    uint32_t tsIndexMask = 0;
+    if (mIsFirstRecordPacket) {
+        tsIndexMask |= static_cast<uint32_t>(DemuxTsIndex::FIRST_PACKET);
+        mIsFirstRecordPacket = false;
+    }
+    if (packet[1] & 0x40) {
+        tsIndexMask |= static_cast<uint32_t>(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR);
+    }
+    int scramblingControl = (packet[3] >> 6) & 0x3;
+    if (mLastScramblingControl != -1 && scramblingControl != mLastScramblingControl) {
+        switch (scramblingControl) {
+            case 0:
+                tsIndexMask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_NOT_SCRAMBLED);
+                break;
+            case 2:
+                tsIndexMask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_EVEN_SCRAMBLED);
+                break;
+            case 3:
+                tsIndexMask |= static_cast<uint32_t>(DemuxTsIndex::CHANGE_TO_ODD_SCRAMBLED);
+                break;
+            default:
+                break;
+        }
+    }
+    mLastScramblingControl = scramblingControl;
+
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    size_t payloadOffset = TS_HEADER_SIZE;
+    if (adaptationFieldControl & 0x2) {
+        uint8_t adaptationFieldLength = packet[TS_HEADER_SIZE];
+        if (adaptationFieldLength > 0) {
+            // The flags of the adaptation field are in the order of the TS indexes from the
+            // discontinuity indicator
+            uint8_t flags = packet[TS_HEADER_SIZE + 1];
+            for (int bit = 0; bit < 8; bit++) {
+                if (flags & (0x80 >> bit)) {
+                    tsIndexMask |=
+                            static_cast<uint32_t>(DemuxTsIndex::DISCONTINUITY_INDICATOR) << bit;
+                }
+            }
+        }
+        payloadOffset += 1 + adaptationFieldLength;
+    }
+    tsIndexMask &= settings.tsIndexMask;
+
+    // The start codes can only be found in the payloads which are not scrambled
+    uint32_t scIndexMask = 0;
+    if ((adaptationFieldControl & 0x1) && payloadOffset < TS_PACKET_SIZE &&
+        scramblingControl == 0 && settings.scIndexType != DemuxRecordScIndexType::NONE) {
+        scIndexMask = getScIndexMask(packet + payloadOffset, TS_PACKET_SIZE - payloadOffset,
+                                     settings.scIndexType);
+        if (settings.scIndexType == DemuxRecordScIndexType::SC &&
+            settings.scIndexMask.getDiscriminator() ==
+                    DemuxFilterRecordSettings::ScIndexMask::hidl_discriminator::sc) {
+            scIndexMask &= settings.scIndexMask.sc();
+        } else if (settings.scIndexType == DemuxRecordScIndexType::SC_HEVC &&
+                   settings.scIndexMask.getDiscriminator() ==
+                           DemuxFilterRecordSettings::ScIndexMask::hidl_discriminator::scHevc) {
+            scIndexMask &= settings.scIndexMask.scHevc();
+        } else {
+            scIndexMask = 0;
+        }
+    }
+
+    if (tsIndexMask == 0 && scIndexMask == 0) {
+        return;
+    }
+    DemuxFilterTsRecordEvent recordEvent;
+    recordEvent.pid.tPid(mTpid);
+    recordEvent.tsIndexMask = tsIndexMask;
+    if (settings.scIndexType == DemuxRecordScIndexType::SC_HEVC) {
+        recordEvent.scIndexMask.scHevc(scIndexMask);
+    } else {
+        recordEvent.scIndexMask.sc(scIndexMask);
+    }
+    recordEvent.byteNumber = byteNumber;
+    mRecordEvents.emplace_back();
+    mRecordEvents.back().tsRecord(recordEvent);
+}
+
+uint32_t Filter::getScIndexMask(const uint8_t* payload, size_t size,
+                                DemuxRecordScIndexType type) {
+    uint32_t scIndexMask = 0;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t byte = payload[i];
+        if (mPictureHeaderBytesLeft > 0 && --mPictureHeaderBytesLeft == 0) {
+            switch ((byte >> 3) & 0x7) {
+                case 1:
+                    scIndexMask |= static_cast<uint32_t>(DemuxScIndex::I_FRAME);
+                    break;
+                case 2:
+                    scIndexMask |= static_cast<uint32_t>(DemuxScIndex::P_FRAME);
+                    break;
+                case 3:
+                    scIndexMask |= static_cast<uint32_t>(DemuxScIndex::B_FRAME);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if ((mStartCodeWindow & 0xffffff) == 0x000001) {
+            if (type == DemuxRecordScIndexType::SC) {
+                // MPEG-2 video start codes, the picture coding type is in the second byte after
+                // the picture start code
+                if (byte == 0x00) {
+                    mPictureHeaderBytesLeft = 2;
+                } else if (byte == 0xb3) {
+                    scIndexMask |= static_cast<uint32_t>(DemuxScIndex::SEQUENCE);
+                }
+            } else {
+                // HEVC NAL unit type of the NAL unit header
+                switch ((byte >> 1) & 0x3f) {
+                    case 16:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_CE_BLA_W_LP);
+                        break;
+                    case 17:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_BLA_W_RADL);
+                        break;
+                    case 18:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_BLA_N_LP);
+                        break;
+                    case 19:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_IDR_W_RADL);
+                        break;
+                    case 20:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_IDR_N_LP);
+                        break;
+                    case 21:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SLICE_TRAIL_CRA);
+                        break;
+                    case 33:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::SPS);
+                        break;
+                    case 35:
+                        scIndexMask |= static_cast<uint32_t>(DemuxScHevcIndex::AUD);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        mStartCodeWindow = (mStartCodeWindow << 8) | byte;
+    }
+    return scIndexMask;
 }
 
 Result Filter::startFilterHandler() {
+    HAL_METRICS_SCOPED_TIMER("tuner.Filter.handle");
     std::lock_guard<std::mutex> lock(mFilterOutputLock);
+    {
+        std::lock_guard<std::mutex> inputLock(mFilterInputLock);
+        HAL_METRICS_ADD("tuner.Filter.inputBytes", mFilterInput.size());
+        if (mFilterOutput.empty()) {
+            mFilterOutput.swap(mFilterInput);
+        } else {
+            mFilterOutput.insert(mFilterOutput.end(), mFilterInput.begin(), mFilterInput.end());
+        }
+        mFilterInput.clear();
+    }
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             switch (mType.subType.tsFilterType()) {
@@ -371,12 +602,13 @@ Result Filter::startFilterHandler() {
 }
 
 Result Filter::startSectionFilterHandler() {
+    std::lock_guard<std::mutex> lock(mFilterEventLock);
     if (mFilterOutput.empty()) {
         return Result::SUCCESS;
     }
-    if (!writeSectionsAndCreateEvent(mFilterOutput)) {
-        ALOGD("[Filter] filter %d fails to write into FMQ. Ending thread", mFilterId);
-        return Result::UNKNOWN_ERROR;
+
+    for (size_t i = 0; i + TS_PACKET_SIZE <= mFilterOutput.size(); i += TS_PACKET_SIZE) {
+        reassembleSections(&mFilterOutput[i]);
     }
 
     mFilterOutput.clear();
@@ -390,42 +622,16 @@ Result Filter::startPesFilterHandler() {
         return Result::SUCCESS;
     }
 
-    for (int i = 0; i < mFilterOutput.size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutput[i + 4] << 16) | (mFilterOutput[i + 5] << 8) |
-                              mFilterOutput[i + 6];
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] prefix %d", prefix);
-            }
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft = (mFilterOutput[i + 8] << 8) | mFilterOutput[i + 9];
-                mPesSizeLeft += 6;
-                if (DEBUG_FILTER) {
-                    ALOGD("[Filter] pes data length %d", mPesSizeLeft);
-                }
-            } else {
-                continue;
-            }
-        }
-
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutput.begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutput.begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] pes data left %d", mPesSizeLeft);
-        }
-        if (mPesSizeLeft > 0) {
+    for (size_t i = 0; i + TS_PACKET_SIZE <= mFilterOutput.size(); i += TS_PACKET_SIZE) {
+        if (!reassemblePesPacket(&mFilterOutput[i])) {
             continue;
         }
         // size match then create event
         if (!writeDataToFilterMQ(mPesOutput)) {
             ALOGD("[Filter] pes data write failed");
             mFilterOutput.clear();
+            mPesOutput.clear();
+            mPesStart = 0;
             return Result::INVALID_STATE;
         }
         maySendFilterStatusCallback();
@@ -439,10 +645,11 @@ Result Filter::startPesFilterHandler() {
             ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
         }
 
-        int size = mFilterEvent.events.size();
-        mFilterEvent.events.resize(size + 1);
-        mFilterEvent.events[size].pes(pesEvent);
+        mFilterEvents.emplace_back();
+        mFilterEvents.back().pes(pesEvent);
+        mFilterEventCondition.notify_one();
         mPesOutput.clear();
+        mPesStart = 0;
     }
 
     mFilterOutput.clear();
@@ -460,76 +667,64 @@ Result Filter::startMediaFilterHandler() {
     if (mFilterOutput.empty()) {
         return Result::SUCCESS;
     }
-    for (int i = 0; i < mFilterOutput.size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutput[i + 4] << 16) | (mFilterOutput[i + 5] << 8) |
-                              mFilterOutput[i + 6];
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] prefix %d", prefix);
-            }
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft = (mFilterOutput[i + 8] << 8) | mFilterOutput[i + 9];
-                mPesSizeLeft += 6;
-                if (DEBUG_FILTER) {
-                    ALOGD("[Filter] pes data length %d", mPesSizeLeft);
-                }
-            } else {
-                continue;
-            }
-        }
-
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutput.begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutput.begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] pes data left %d", mPesSizeLeft);
-        }
-        if (mPesSizeLeft > 0 || mAvBufferCopyCount++ < 10) {
+    for (size_t i = 0; i + TS_PACKET_SIZE <= mFilterOutput.size(); i += TS_PACKET_SIZE) {
+        if (!reassemblePesPacket(&mFilterOutput[i]) || mAvBufferCopyCount++ < 10) {
             continue;
         }
 
-        int av_fd = createAvIonFd(mPesOutput.size());
-        if (av_fd == -1) {
-            return Result::UNKNOWN_ERROR;
-        }
-        // copy the filtered data to the buffer
-        uint8_t* avBuffer = getIonBuffer(av_fd, mPesOutput.size());
-        if (avBuffer == NULL) {
-            return Result::UNKNOWN_ERROR;
+        // Copy the filtered data to a block of the AV memory pool, or to a buffer of its own when
+        // all the blocks are still held by the client.
+        uint64_t dataId = mLastUsedDataId++ /*createdUID*/;
+        uint32_t offset = 0;
+        native_handle_t* nativeHandle = NULL;
+        int block = mPesOutput.size() <= AV_BLOCK_SIZE ? allocateAvBlock(dataId) : -1;
+        if (block != -1) {
+            offset = block * AV_BLOCK_SIZE;
+            memcpy(mAvPoolBuffer + offset, mPesOutput.data(), mPesOutput.size() * sizeof(uint8_t));
+            nativeHandle = createNativeHandle(mAvPoolFd);
+        } else {
+            int av_fd = createAvIonFd(mPesOutput.size());
+            if (av_fd == -1) {
+                return Result::UNKNOWN_ERROR;
+            }
+            uint8_t* avBuffer = getIonBuffer(av_fd, mPesOutput.size());
+            if (avBuffer == NULL) {
+                ::close(av_fd);
+                return Result::UNKNOWN_ERROR;
+            }
+            memcpy(avBuffer, mPesOutput.data(), mPesOutput.size() * sizeof(uint8_t));
+            munmap(avBuffer, mPesOutput.size());
+            nativeHandle = createNativeHandle(av_fd);
+            if (nativeHandle != NULL) {
+                // Add a <dataId, av_fd> pair into the dataId2Avfd map
+                std::lock_guard<std::mutex> lock(mAvPoolLock);
+                mDataId2Avfd[dataId] = dup(av_fd);
+            }
+            ::close(av_fd);
         }
-        memcpy(avBuffer, mPesOutput.data(), mPesOutput.size() * sizeof(uint8_t));
-
-        native_handle_t* nativeHandle = createNativeHandle(av_fd);
         if (nativeHandle == NULL) {
+            releaseAvHandle(hidl_handle(), dataId);
             return Result::UNKNOWN_ERROR;
         }
         hidl_handle handle;
         handle.setTo(nativeHandle, /*shouldOwn=*/true);
 
-        // Create a dataId and add a <dataId, av_fd> pair into the dataId2Avfd map
-        uint64_t dataId = mLastUsedDataId++ /*createdUID*/;
-        mDataId2Avfd[dataId] = dup(av_fd);
-
         // Create mediaEvent and send callback
         DemuxFilterMediaEvent mediaEvent;
         mediaEvent = {
                 .avMemory = std::move(handle),
                 .dataLength = static_cast<uint32_t>(mPesOutput.size()),
+                .offset = offset,
                 .avDataId = dataId,
         };
-        int size = mFilterEvent.events.size();
-        mFilterEvent.events.resize(size + 1);
-        mFilterEvent.events[size].media(mediaEvent);
+        mFilterEvents.emplace_back();
+        mFilterEvents.back().media(mediaEvent);
+        mFilterEventCondition.notify_one();
 
         // Clear and log
         mPesOutput.clear();
+        mPesStart = 0;
         mAvBufferCopyCount = 0;
-        ::close(av_fd);
         if (DEBUG_FILTER) {
             ALOGD("[Filter] assembled av data length %d", mediaEvent.dataLength);
         }
@@ -540,57 +735,304 @@ Result Filter::startMediaFilterHandler() {
     return Result::SUCCESS;
 }
 
-Result Filter::startRecordFilterHandler() {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    if (mRecordFilterOutput.empty()) {
+Result Filter::startRecordFilterHandler(bool isRecorded) {
+    std::lock_guard<std::mutex> lock(mRecordEventsLock);
+    if (mRecordEvents.empty()) {
         return Result::SUCCESS;
     }
 
-    if (mDvr == nullptr || !mDvr->writeRecordFMQ(mRecordFilterOutput)) {
-        ALOGD("[Filter] dvr fails to write into record FMQ.");
-        return Result::UNKNOWN_ERROR;
+    if (isRecorded) {
+        std::lock_guard<std::mutex> eventLock(mFilterEventLock);
+        for (auto& recordEvent : mRecordEvents) {
+            mFilterEvents.push_back(std::move(recordEvent));
+        }
+        mFilterEventCondition.notify_one();
     }
 
-    mRecordFilterOutput.clear();
+    mRecordEvents.clear();
     return Result::SUCCESS;
 }
 
 Result Filter::startPcrFilterHandler() {
-    // TODO handle starting PCR filter
+    vector<PcrSample> pcrSamples;
+    {
+        std::lock_guard<std::mutex> lock(mFilterInputLock);
+        pcrSamples.swap(mPcrInput);
+    }
+    for (const PcrSample& sample : pcrSamples) {
+        mPcrClock.updatePcr(sample.pcr, sample.arrivalTime, sample.isDiscontinuity);
+    }
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] %zu pcr fed to the clock", pcrSamples.size());
+    }
     return Result::SUCCESS;
 }
 
+bool Filter::getPcrSourceTime(uint64_t* sourceTime, uint64_t* startTime) {
+    return mPcrClock.getSourceTime(systemTime(SYSTEM_TIME_MONOTONIC), sourceTime, startTime);
+}
+
 Result Filter::startTemiFilterHandler() {
     // TODO handle starting TEMI filter
     return Result::SUCCESS;
 }
 
-bool Filter::writeSectionsAndCreateEvent(vector<uint8_t> data) {
-    // TODO check how many sections has been read
-    ALOGD("[Filter] section handler");
-    std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (!writeDataToFilterMQ(data)) {
+bool Filter::writeSectionAndCreateEvent(const vector<uint8_t>& section) {
+    if (!writeDataToFilterMQ(section)) {
         return false;
     }
-    int size = mFilterEvent.events.size();
-    mFilterEvent.events.resize(size + 1);
+    maySendFilterStatusCallback();
+    // The version and section number are only in the sections with the long syntax
+    bool isLongSection = (section[1] & 0x80) != 0 && section.size() >= 8;
     DemuxFilterSectionEvent secEvent;
     secEvent = {
-            // temp dump meta data
-            .tableId = 0,
-            .version = 1,
-            .sectionNum = 1,
-            .dataLength = static_cast<uint16_t>(data.size()),
+            .tableId = section[0],
+            .version = static_cast<uint16_t>(isLongSection ? (section[5] >> 1) & 0x1f : 0),
+            .sectionNum = static_cast<uint16_t>(isLongSection ? section[6] : 0),
+            .dataLength = static_cast<uint16_t>(section.size()),
     };
-    mFilterEvent.events[size].section(secEvent);
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] section table id %d length %d", secEvent.tableId, secEvent.dataLength);
+    }
+    mFilterEvents.emplace_back();
+    mFilterEvents.back().section(secEvent);
+    mFilterEventCondition.notify_one();
     return true;
 }
 
+void Filter::reassembleSections(const uint8_t* packet) {
+    bool payloadUnitStart = (packet[1] & 0x40) != 0;
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    int continuityCounter = packet[3] & 0xf;
+    if ((adaptationFieldControl & 0x1) == 0 || continuityCounter == mLastContinuityCounter) {
+        // No payload or duplicate packet
+        return;
+    }
+    if (mIsSectionStarted && continuityCounter != ((mLastContinuityCounter + 1) & 0xf)) {
+        ALOGD("[Filter] filter %d lost ts packets, dropping section data", mFilterId);
+        mSectionOutput.clear();
+        mIsSectionStarted = false;
+    }
+    mLastContinuityCounter = continuityCounter;
+
+    size_t payloadOffset = TS_HEADER_SIZE;
+    if (adaptationFieldControl & 0x2) {
+        payloadOffset += 1 + packet[TS_HEADER_SIZE];
+    }
+    if (payloadOffset >= TS_PACKET_SIZE) {
+        return;
+    }
+    const uint8_t* payload = packet + payloadOffset;
+    size_t payloadSize = TS_PACKET_SIZE - payloadOffset;
+
+    if (!payloadUnitStart) {
+        if (mIsSectionStarted) {
+            appendSectionData(payload, payloadSize);
+        }
+        return;
+    }
+
+    // The pointer field gives the end of the section started in the previous packets
+    size_t pointerField = payload[0];
+    if (mIsSectionStarted) {
+        appendSectionData(payload + 1, min(pointerField, payloadSize - 1));
+        if (mIsSectionStarted) {
+            ALOGD("[Filter] filter %d section data cut short, dropping it", mFilterId);
+            mSectionOutput.clear();
+            mIsSectionStarted = false;
+        }
+    }
+    // The sections follow each other up to the stuffing bytes
+    size_t offset = 1 + pointerField;
+    while (offset < payloadSize && payload[offset] != 0xff) {
+        mIsSectionStarted = true;
+        offset += appendSectionData(payload + offset, payloadSize - offset);
+    }
+}
+
+size_t Filter::appendSectionData(const uint8_t* data, size_t size) {
+    size_t appended = 0;
+    while (appended < size) {
+        size_t sectionSize = SECTION_HEADER_SIZE;
+        if (mSectionOutput.size() >= SECTION_HEADER_SIZE) {
+            sectionSize += ((mSectionOutput[1] & 0xf) << 8) | mSectionOutput[2];
+        }
+        size_t length = min(size - appended, sectionSize - mSectionOutput.size());
+        mSectionOutput.insert(mSectionOutput.end(), data + appended, data + appended + length);
+        appended += length;
+        if (mSectionOutput.size() < SECTION_HEADER_SIZE) {
+            continue;
+        }
+        sectionSize = SECTION_HEADER_SIZE + (((mSectionOutput[1] & 0xf) << 8) | mSectionOutput[2]);
+        if (mSectionOutput.size() < sectionSize) {
+            continue;
+        }
+
+        if (isSectionMatched(mSectionOutput) && !writeSectionAndCreateEvent(mSectionOutput)) {
+            ALOGD("[Filter] filter %d section data write failed", mFilterId);
+        }
+        mSectionOutput.clear();
+        mIsSectionStarted = false;
+        break;
+    }
+    return appended;
+}
+
+bool Filter::isSectionMatched(const vector<uint8_t>& section) {
+    if (mFilterSettings.getDiscriminator() != DemuxFilterSettings::hidl_discriminator::ts ||
+        mFilterSettings.ts().filterSettings.getDiscriminator() !=
+                DemuxTsFilterSettings::FilterSettings::hidl_discriminator::section) {
+        // Not configured yet
+        return true;
+    }
+    const DemuxFilterSectionSettings& settings = mFilterSettings.ts().filterSettings.section();
+    bool isLongSection = (section[1] & 0x80) != 0 && section.size() >= 8;
+    uint8_t version = isLongSection ? (section[5] >> 1) & 0x1f : 0;
+
+    switch (settings.condition.getDiscriminator()) {
+        case DemuxFilterSectionSettings::Condition::hidl_discriminator::sectionBits: {
+            // As in the hardware section filters, the first byte of the filter matches the table
+            // ID and the next ones match the section from the byte after the section length.
+            const DemuxFilterSectionBits& bits = settings.condition.sectionBits();
+            size_t filterSize = min(bits.filter.size(), bits.mask.size());
+            uint8_t negativeMismatch = 0;
+            uint8_t negativeMask = 0;
+            for (size_t i = 0; i < filterSize; i++) {
+                size_t position = i == 0 ? 0 : i + SECTION_HEADER_SIZE - 1;
+                if (position >= section.size()) {
+                    return false;
+                }
+                uint8_t mode = i < bits.mode.size() ? bits.mode[i] : 0;
+                uint8_t mismatch = (section[position] ^ bits.filter[i]) & bits.mask[i];
+                if (mismatch & ~mode) {
+                    return false;
+                }
+                negativeMismatch |= mismatch & mode;
+                negativeMask |= bits.mask[i] & mode;
+            }
+            // A negative match needs any of its bits to differ
+            if (negativeMask != 0 && negativeMismatch == 0) {
+                return false;
+            }
+            break;
+        }
+        case DemuxFilterSectionSettings::Condition::hidl_discriminator::tableInfo:
+            if (section[0] != settings.condition.tableInfo().tableId ||
+                (isLongSection && version != settings.condition.tableInfo().version)) {
+                return false;
+            }
+            break;
+    }
+
+    if (settings.isCheckCrc && isLongSection) {
+        // The CRC_32 of ISO/IEC 13818-1 over the whole section including its CRC is zero
+        static const vector<uint32_t> crcTable = [] {
+            vector<uint32_t> table(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i << 24;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+                }
+                table[i] = crc;
+            }
+            return table;
+        }();
+        uint32_t crc = 0xffffffff;
+        for (uint8_t byte : section) {
+            crc = (crc << 8) ^ crcTable[(crc >> 24) ^ byte];
+        }
+        if (crc != 0) {
+            if (DEBUG_FILTER) {
+                ALOGD("[Filter] filter %d dropping section with wrong crc", mFilterId);
+            }
+            return false;
+        }
+    }
+
+    if (!settings.isRepeat && isLongSection) {
+        // Key the section by its table ID, table ID extension and section number
+        uint32_t key = (static_cast<uint32_t>(section[0]) << 24) | (section[3] << 16) |
+                       (section[4] << 8) | section[6];
+        auto lastVersion = mSectionVersions.find(key);
+        if (lastVersion != mSectionVersions.end() && lastVersion->second == version) {
+            return false;
+        }
+        mSectionVersions[key] = version;
+    }
+    return true;
+}
+
+bool Filter::reassemblePesPacket(const uint8_t* packet) {
+    bool payloadUnitStart = (packet[1] & 0x40) != 0;
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    int continuityCounter = packet[3] & 0xf;
+    if ((adaptationFieldControl & 0x1) == 0) {
+        // No payload, the continuity counter does not move either
+        return false;
+    }
+    if (continuityCounter == mLastContinuityCounter) {
+        // Duplicate packet
+        return false;
+    }
+    if (mPesSizeLeft > 0 && continuityCounter != ((mLastContinuityCounter + 1) & 0xf)) {
+        ALOGD("[Filter] filter %d lost ts packets, dropping pes data", mFilterId);
+        mPesOutput.resize(mPesStart);
+        mPesSizeLeft = 0;
+    }
+    mLastContinuityCounter = continuityCounter;
+
+    int payloadOffset = TS_HEADER_SIZE;
+    if (adaptationFieldControl & 0x2) {
+        payloadOffset += 1 + packet[TS_HEADER_SIZE];
+    }
+    if (payloadOffset >= TS_PACKET_SIZE) {
+        return false;
+    }
+    const uint8_t* payload = packet + payloadOffset;
+    int payloadSize = TS_PACKET_SIZE - payloadOffset;
+
+    if (payloadUnitStart) {
+        if (mPesSizeLeft > 0) {
+            ALOGD("[Filter] filter %d pes data cut short, dropping it", mFilterId);
+            mPesOutput.resize(mPesStart);
+            mPesSizeLeft = 0;
+        }
+        if (payloadSize < 6) {
+            return false;
+        }
+        uint32_t prefix = (payload[0] << 16) | (payload[1] << 8) | payload[2];
+        if (DEBUG_FILTER) {
+            ALOGD("[Filter] prefix %d", prefix);
+        }
+        if (prefix != 0x000001) {
+            return false;
+        }
+        mPesStart = mPesOutput.size();
+        mPesSizeLeft = ((payload[4] << 8) | payload[5]) + 6;
+        if (DEBUG_FILTER) {
+            ALOGD("[Filter] pes data length %d", mPesSizeLeft);
+        }
+    } else if (mPesSizeLeft == 0) {
+        // Wait for the start of the next PES packet
+        return false;
+    }
+
+    int length = min(payloadSize, mPesSizeLeft);
+    mPesOutput.insert(mPesOutput.end(), payload, payload + length);
+    mPesSizeLeft -= length;
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] pes data left %d", mPesSizeLeft);
+    }
+    return mPesSizeLeft == 0;
+}
+
 bool Filter::writeDataToFilterMQ(const std::vector<uint8_t>& data) {
     std::lock_guard<std::mutex> lock(mWriteLock);
     if (mFilterMQ->write(data.data(), data.size())) {
+        HAL_METRICS_ADD("tuner.Filter.mqBytes", data.size());
         return true;
     }
+    HAL_METRICS_COUNT("tuner.Filter.mqWriteFailures");
     return false;
 }
 
@@ -628,6 +1070,38 @@ uint8_t* Filter::getIonBuffer(int fd, int size) {
     return avBuf;
 }
 
+int Filter::allocateAvBlock(uint64_t dataId) {
+    std::lock_guard<std::mutex> lock(mAvPoolLock);
+    if (mAvPoolBuffer == nullptr) {
+        if (mAvPoolFd == -1) {
+            mAvPoolFd = createAvIonFd(AV_BLOCK_SIZE * AV_BLOCK_COUNT);
+            if (mAvPoolFd == -1) {
+                return -1;
+            }
+        }
+        mAvPoolBuffer = getIonBuffer(mAvPoolFd, AV_BLOCK_SIZE * AV_BLOCK_COUNT);
+        if (mAvPoolBuffer == NULL) {
+            ::close(mAvPoolFd);
+            mAvPoolFd = -1;
+            return -1;
+        }
+        for (uint16_t i = 0; i < AV_BLOCK_COUNT; i++) {
+            mFreeAvBlocks.push_back(AV_BLOCK_COUNT - 1 - i);
+        }
+    }
+    if (mFreeAvBlocks.empty()) {
+        if (DEBUG_FILTER) {
+            ALOGD("[Filter] filter %d av memory pool exhausted", mFilterId);
+        }
+        return -1;
+    }
+
+    uint16_t block = mFreeAvBlocks.back();
+    mFreeAvBlocks.pop_back();
+    mDataId2AvBlock[dataId] = block;
+    return block;
+}
+
 native_handle_t* Filter::createNativeHandle(int fd) {
     // Create a native handle to pass the av fd via the callback event.
     native_handle_t* nativeHandle = native_handle_create(/*numFd*/ 1, 0);
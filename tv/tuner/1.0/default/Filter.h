@@ -21,7 +21,10 @@
 #include <fmq/MessageQueue.h>
 #include <ion/ion.h>
 #include <math.h>
+#include <atomic>
+#include <condition_variable>
 #include <set>
+#include "ClockRecovery.h"
 #include "Demux.h"
 #include "Dvr.h"
 #include "Frontend.h"
@@ -82,16 +85,30 @@ class Filter : public IFilter {
      */
     bool createFilterMQ();
     uint16_t getTpid();
-    void updateFilterOutput(vector<uint8_t> data);
-    void updateRecordOutput(vector<uint8_t> data);
+    void updateFilterOutput(const uint8_t* data, size_t size);
+    /**
+     * Indexes a TS packet of the filter PID recorded at the given byte number of the DVR output,
+     * keeping the TS and start code indexes enabled in the record settings for the next dispatch.
+     */
+    void updateRecordIndex(const uint8_t* packet, size_t size, uint64_t byteNumber);
     Result startFilterHandler();
-    Result startRecordFilterHandler();
+    /**
+     * Sends the record events of the packets indexed since the last dispatch, or drops them when
+     * the DVR could not write the packets.
+     */
+    Result startRecordFilterHandler(bool isRecorded);
     void attachFilterToRecord(const sp<Dvr> dvr);
     void detachFilterFromRecord();
-    void freeAvHandle();
     bool isMediaFilter() { return mIsMediaFilter; };
     bool isPcrFilter() { return mIsPcrFilter; };
     bool isRecordFilter() { return mIsRecordFilter; };
+    /**
+     * Gets the source time recovered from the PCRs of a PCR filter, and the source time of its
+     * first PCR, in 90KHz units.
+     *
+     * Return false if the filter got no PCR since it was started.
+     */
+    bool getPcrSourceTime(uint64_t* sourceTime, uint64_t* startTime);
 
   private:
     // Tuner service
@@ -111,32 +128,79 @@ class Filter : public IFilter {
     bool mIsRecordFilter = false;
     DemuxFilterSettings mFilterSettings;
 
-    uint16_t mTpid;
+    uint16_t mTpid = 0xffff;
     sp<IFilter> mDataSource;
     bool mIsDataSourceDemux = true;
+    /**
+     * Packets handed to the filter by the input thread, moved to mFilterOutput by
+     * startFilterHandler so that the input thread does not wait for the filter handlers.
+     */
+    vector<uint8_t> mFilterInput;
     vector<uint8_t> mFilterOutput;
-    vector<uint8_t> mRecordFilterOutput;
+    /**
+     * PCRs handed to a PCR filter by the input thread instead of their packets, with the time
+     * they arrived at, fed to mPcrClock by the filter handler.
+     */
+    struct PcrSample {
+        uint64_t pcr;
+        nsecs_t arrivalTime;
+        bool isDiscontinuity;
+    };
+    vector<PcrSample> mPcrInput;
+    ClockRecovery mPcrClock;
+    /**
+     * Record events of the packets indexed since the last dispatch
+     */
+    vector<DemuxFilterEvent::Event> mRecordEvents;
     unique_ptr<FilterMQ> mFilterMQ;
     bool mIsUsingFMQ = false;
     EventFlag* mFilterEventFlag;
-    DemuxFilterEvent mFilterEvent;
+    /**
+     * Events added by the filter handlers and not sent yet, swapped with a vector of the same
+     * capacity by the filter thread so that adding events does not allocate.
+     */
+    vector<DemuxFilterEvent::Event> mFilterEvents;
 
     // Thread handlers
     pthread_t mFilterThread;
 
-    // FMQ status local records
-    DemuxFilterStatus mFilterStatus;
+    /**
+     * FMQ status last sent, switched without a lock by the caller seeing the FMQ occupancy cross
+     * the thresholds, which is then the only one to send the new status.
+     */
+    std::atomic<DemuxFilterStatus> mFilterStatus{DemuxFilterStatus::DATA_READY};
+    // FMQ occupancy thresholds of the HIGH_WATER and LOW_WATER status
+    uint32_t mHighThreshold = 0;
+    uint32_t mLowThreshold = 0;
     /**
      * If a specific filter's writing loop is still running
      */
-    bool mFilterThreadRunning;
+    bool mFilterThreadRunning = false;
     bool mKeepFetchingDataFromFrontend;
 
     /**
-     * How many times a filter should write
-     * TODO make this dynamic/random/can take as a parameter
+     * Capacity reserved for the events sent with a single filter event callback
+     */
+    const uint16_t FILTER_EVENTS_RESERVED = 64;
+
+    const uint16_t TS_PACKET_SIZE = 188;
+    const uint16_t TS_HEADER_SIZE = 4;
+    /**
+     * Largest PES packet, the 16 bits PES_packet_length plus the 6 bytes before the payload
+     */
+    const uint32_t MAX_PES_SIZE = 0xffff + 6;
+    /**
+     * Section header up to and including the 12 bits section_length, and the largest section
+     */
+    const uint16_t SECTION_HEADER_SIZE = 3;
+    const uint16_t MAX_SECTION_SIZE = 0xfff + 3;
+
+    /**
+     * Blocks of the AV memory pool of the media filters, one for each AV buffer of the media
+     * events the client has not released yet.
      */
-    const uint16_t SECTION_WRITE_COUNT = 10;
+    const uint32_t AV_BLOCK_SIZE = 1024 * 1024;
+    const uint16_t AV_BLOCK_COUNT = 8;
 
     bool DEBUG_FILTER = false;
 
@@ -156,7 +220,37 @@ class Filter : public IFilter {
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<uint8_t>& data);
     bool readDataFromMQ();
-    bool writeSectionsAndCreateEvent(vector<uint8_t> data);
+    bool writeSectionAndCreateEvent(const vector<uint8_t>& section);
+    /**
+     * Adds the payload of the TS packet to the sections being reassembled in mSectionOutput,
+     * writing each completed section matching the section settings into the filter FMQ.
+     */
+    void reassembleSections(const uint8_t* packet);
+    /**
+     * Adds up to size bytes to the section being reassembled, stopping at the end of the section.
+     *
+     * Return the number of bytes added.
+     */
+    size_t appendSectionData(const uint8_t* data, size_t size);
+    /**
+     * Checks the section against the condition, CRC and repeat settings of the filter, recording
+     * its version when the filter does not repeat the sections.
+     */
+    bool isSectionMatched(const vector<uint8_t>& section);
+    /**
+     * Finds the start codes in the payload of a recorded TS packet.
+     *
+     * Return the start code indexes found, of the given index type.
+     */
+    uint32_t getScIndexMask(const uint8_t* payload, size_t size, DemuxRecordScIndexType type);
+    /**
+     * Adds the payload of the TS packet to the PES packet being reassembled at the end of
+     * mPesOutput, following the payload unit start and continuity counter of the packets of the
+     * filter PID across dispatches. A PES packet missing any payload is dropped.
+     *
+     * Return true when the TS packet completes the PES packet.
+     */
+    bool reassemblePesPacket(const uint8_t* packet);
     void maySendFilterStatusCallback();
     DemuxFilterStatus checkFilterStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
                                               uint32_t highThreshold, uint32_t lowThreshold);
@@ -172,6 +266,12 @@ class Filter : public IFilter {
     int createAvIonFd(int size);
     uint8_t* getIonBuffer(int fd, int size);
     native_handle_t* createNativeHandle(int fd);
+    /**
+     * Takes a free block of the AV memory pool, creating the pool the first time.
+     *
+     * Return the index of the block, or -1 if none is free or the pool cannot be created.
+     */
+    int allocateAvBlock(uint64_t dataId);
 
     /**
      * Lock to protect writes to the FMQs
@@ -183,20 +283,62 @@ class Filter : public IFilter {
     // TODO make each filter separate event lock
     std::mutex mFilterEventLock;
     /**
-     * Lock to protect writes to the input status
+     * Signaled by the filter handlers when they add to the filter event, and on stop
      */
-    std::mutex mFilterStatusLock;
+    std::condition_variable mFilterEventCondition;
     std::mutex mFilterThreadLock;
+    std::mutex mFilterInputLock;
     std::mutex mFilterOutputLock;
-    std::mutex mRecordFilterOutputLock;
+    std::mutex mRecordEventsLock;
 
-    // temp handle single PES filter
-    // TODO handle mulptiple Pes filters
+    // PES reassembly state of the filter PID
     int mPesSizeLeft = 0;
+    /**
+     * Offset in mPesOutput of the PES packet being reassembled, the media filters keep several
+     * PES packets in a single AV buffer.
+     */
+    size_t mPesStart = 0;
+    /**
+     * Continuity counter of the last TS packet carrying payload, -1 before the first one
+     */
+    int mLastContinuityCounter = -1;
     vector<uint8_t> mPesOutput;
 
-    // A map from data id to ion handle
+    // Section reassembly state of the filter PID
+    bool mIsSectionStarted = false;
+    vector<uint8_t> mSectionOutput;
+    /**
+     * Version of the last section sent for each table ID, table ID extension and section number,
+     * used to drop the unchanged sections when the filter does not repeat them.
+     */
+    std::map<uint32_t, uint8_t> mSectionVersions;
+
+    // Record index state of the filter PID
+    bool mIsFirstRecordPacket = true;
+    int mLastScramblingControl = -1;
+    /**
+     * Last bytes of the payloads, to find the start codes across the TS packets
+     */
+    uint32_t mStartCodeWindow = 0xffffffff;
+    /**
+     * Bytes left up to the picture coding type of the MPEG-2 picture header being indexed
+     */
+    int mPictureHeaderBytesLeft = 0;
+
+    // A map from data id to ion handle, for the AV buffers allocated out of the pool
     std::map<uint64_t, int> mDataId2Avfd;
+    /**
+     * AV memory pool, mapped once and shared by the media events at the offset of their block
+     */
+    int mAvPoolFd = -1;
+    uint8_t* mAvPoolBuffer = nullptr;
+    vector<uint16_t> mFreeAvBlocks;
+    // A map from data id to the block of the pool holding its AV buffer
+    std::map<uint64_t, uint16_t> mDataId2AvBlock;
+    /**
+     * Lock to protect the AV memory pool, released from the client
+     */
+    std::mutex mAvPoolLock;
     uint64_t mLastUsedDataId = 1;
     int mAvBufferCopyCount = 0;
 };
@@ -39,6 +39,7 @@ Frontend::~Frontend() {}
 
 Return<Result> Frontend::close() {
     ALOGV("%s", __FUNCTION__);
+    mTunerService->frontendStopScan(mId);
     // Reset callback
     mCallback = nullptr;
     mIsLocked = false;
@@ -81,42 +82,18 @@ Return<Result> Frontend::stopTune() {
 
 Return<Result> Frontend::scan(const FrontendSettings& settings, FrontendScanType type) {
     ALOGV("%s", __FUNCTION__);
-
-    if (mType == FrontendType::ATSC) {
-        FrontendScanMessage msg;
-        msg.isLocked(true);
-        mCallback->onScanMessage(FrontendScanMessageType::LOCKED, msg);
-        mIsLocked = true;
-        return Result::SUCCESS;
-    }
-    if (mType != FrontendType::DVBT) {
-        return Result::UNAVAILABLE;
-    }
-
-    FrontendScanMessage msg;
-
-    if (mIsLocked) {
-        msg.isEnd(true);
-        mCallback->onScanMessage(FrontendScanMessageType::END, msg);
-        return Result::SUCCESS;
-    }
-
-    uint32_t frequency = settings.dvbt().frequency;
-    if (type == FrontendScanType::SCAN_BLIND) {
-        frequency += 100;
+    if (mCallback == nullptr) {
+        ALOGW("[   WARN   ] Frontend callback is not set when scan");
+        return Result::INVALID_STATE;
     }
-    msg.frequencies({frequency});
-    mCallback->onScanMessage(FrontendScanMessageType::FREQUENCY, msg);
-    msg.isLocked(true);
-    mCallback->onScanMessage(FrontendScanMessageType::LOCKED, msg);
-    mIsLocked = true;
 
-    return Result::SUCCESS;
+    return mTunerService->frontendScan(mId, settings, type);
 }
 
 Return<Result> Frontend::stopScan() {
     ALOGV("%s", __FUNCTION__);
 
+    mTunerService->frontendStopScan(mId);
     mIsLocked = false;
     return Result::SUCCESS;
 }
@@ -276,6 +253,14 @@ bool Frontend::supportsSatellite() {
 bool Frontend::isLocked() {
     return mIsLocked;
 }
+
+void Frontend::setLocked(bool isLocked) {
+    mIsLocked = isLocked;
+}
+
+sp<IFrontendCallback> Frontend::getCallback() {
+    return mCallback;
+}
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace tuner
@@ -70,6 +70,10 @@ class Frontend : public IFrontend {
 
     bool isLocked();
 
+    void setLocked(bool isLocked);
+
+    sp<IFrontendCallback> getCallback();
+
   private:
     virtual ~Frontend();
     bool supportsSatellite();
@@ -40,7 +40,10 @@ Return<Result> TimeFilter::setTimeStamp(uint64_t timeStamp) {
         return Result::INVALID_ARGUMENT;
     }
     mTimeStamp = timeStamp;
-    mBeginTime = time(NULL);
+    mBeginTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint64_t startTime;
+    mIsSourceTimeBased =
+            mDemux != nullptr && mDemux->getAvSyncSourceTime(&mBeginSourceTime, &startTime);
 
     return Result::SUCCESS;
 }
@@ -56,9 +59,20 @@ Return<void> TimeFilter::getTimeStamp(getTimeStamp_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
     if (mTimeStamp == INVALID_TIME_STAMP) {
         _hidl_cb(Result::INVALID_STATE, mTimeStamp);
+        return Void();
     }
 
-    uint64_t currentTimeStamp = mTimeStamp + difftime(time(NULL), mBeginTime) * 900000;
+    uint64_t currentTimeStamp;
+    uint64_t sourceTime;
+    uint64_t startTime;
+    if (mIsSourceTimeBased && mDemux->getAvSyncSourceTime(&sourceTime, &startTime) &&
+        sourceTime >= mBeginSourceTime) {
+        currentTimeStamp = mTimeStamp + sourceTime - mBeginSourceTime;
+    } else {
+        // 90KHz ticks of the system clock
+        currentTimeStamp =
+                mTimeStamp + (systemTime(SYSTEM_TIME_MONOTONIC) - mBeginTime) * 9 / 100000;
+    }
     _hidl_cb(Result::SUCCESS, currentTimeStamp);
     return Void();
 }
@@ -67,6 +81,12 @@ Return<void> TimeFilter::getSourceTime(getSourceTime_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
 
     uint64_t time = 0;
+    uint64_t sourceTime;
+    uint64_t startTime;
+    if (mDemux != nullptr && mDemux->getAvSyncSourceTime(&sourceTime, &startTime) &&
+        sourceTime > startTime) {
+        time = sourceTime - startTime;
+    }
 
     _hidl_cb(Result::SUCCESS, time);
     return Void();
@@ -19,7 +19,7 @@
 
 #include <android/hardware/tv/tuner/1.0/ITimeFilter.h>
 #include "Demux.h"
-#include "time.h"
+#include <utils/Timers.h>
 
 using namespace std;
 
@@ -61,7 +61,13 @@ class TimeFilter : public ITimeFilter {
   private:
     sp<Demux> mDemux;
     uint64_t mTimeStamp = INVALID_TIME_STAMP;
-    time_t mBeginTime;
+    /**
+     * The time stamp advances with the source time recovered from the PCRs when there was one
+     * when it was set, or else with the system clock.
+     */
+    bool mIsSourceTimeBased = false;
+    uint64_t mBeginSourceTime;
+    nsecs_t mBeginTime;
 };
 
 }  // namespace implementation
@@ -18,6 +18,7 @@
 
 #include "Tuner.h"
 #include <android/hardware/tv/tuner/1.0/IFrontendCallback.h>
+#include <halmetrics/Metrics.h>
 #include <utils/Log.h>
 #include "Demux.h"
 #include "Descrambler.h"
@@ -33,6 +34,31 @@ namespace implementation {
 
 using ::android::hardware::tv::tuner::V1_0::DemuxId;
 
+// The frequency of the settings if they are of the given type of frontend, or 0
+static uint32_t getFrontendFrequency(FrontendType type, const FrontendSettings& settings) {
+    switch (settings.getDiscriminator()) {
+        case FrontendSettings::hidl_discriminator::analog:
+            return type == FrontendType::ANALOG ? settings.analog().frequency : 0;
+        case FrontendSettings::hidl_discriminator::atsc:
+            return type == FrontendType::ATSC ? settings.atsc().frequency : 0;
+        case FrontendSettings::hidl_discriminator::atsc3:
+            return type == FrontendType::ATSC3 ? settings.atsc3().frequency : 0;
+        case FrontendSettings::hidl_discriminator::dvbs:
+            return type == FrontendType::DVBS ? settings.dvbs().frequency : 0;
+        case FrontendSettings::hidl_discriminator::dvbc:
+            return type == FrontendType::DVBC ? settings.dvbc().frequency : 0;
+        case FrontendSettings::hidl_discriminator::dvbt:
+            return type == FrontendType::DVBT ? settings.dvbt().frequency : 0;
+        case FrontendSettings::hidl_discriminator::isdbs:
+            return type == FrontendType::ISDBS ? settings.isdbs().frequency : 0;
+        case FrontendSettings::hidl_discriminator::isdbs3:
+            return type == FrontendType::ISDBS3 ? settings.isdbs3().frequency : 0;
+        case FrontendSettings::hidl_discriminator::isdbt:
+            return type == FrontendType::ISDBT ? settings.isdbt().frequency : 0;
+    }
+    return 0;
+}
+
 Tuner::Tuner() {
     // Static Frontends array to maintain local frontends information
     // Array index matches their FrontendId in the default impl
@@ -94,7 +120,11 @@ Tuner::Tuner() {
     mLnbs[1] = new Lnb(1);
 }
 
-Tuner::~Tuner() {}
+Tuner::~Tuner() {
+    for (int i = 0; i < mFrontendSize; i++) {
+        frontendStopScan(i);
+    }
+}
 
 Return<void> Tuner::getFrontendIds(getFrontendIds_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
@@ -229,6 +259,18 @@ Return<void> Tuner::openLnbByName(const hidl_string& /*lnbName*/, openLnbByName_
     return Void();
 }
 
+Return<void> Tuner::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds == 0) {
+        ALOGE("Invalid parameters passed to debug()");
+        return Void();
+    }
+    if (!metrics::dumpIfRequested(fd->data[0], options)) {
+        dprintf(fd->data[0], "%s: dumps the demux and filter counters and latencies\n",
+                metrics::kDebugOption);
+    }
+    return Void();
+}
+
 void Tuner::setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId) {
     mFrontendToDemux[frontendId] = demuxId;
     if (mFrontends[frontendId] != nullptr && mFrontends[frontendId]->isLocked()) {
@@ -254,6 +296,158 @@ void Tuner::frontendStartTune(uint32_t frontendId) {
     }
 }
 
+Result Tuner::frontendScan(uint32_t frontendId, const FrontendSettings& settings,
+                           FrontendScanType type) {
+    if (frontendId >= mFrontendSize) {
+        return Result::INVALID_ARGUMENT;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mScanLock);
+        auto it = mScanJobs.find(frontendId);
+        if (it != mScanJobs.end() && it->second->isWaitingForContinue) {
+            // Go on with the frequencies after the one reported locked
+            it->second->isWaitingForContinue = false;
+            reportScanLocked(*it->second);
+            return Result::SUCCESS;
+        }
+    }
+    frontendStopScan(frontendId);
+
+    FrontendType frontendType = mFrontends[frontendId]->getFrontendType();
+    uint32_t frequency = getFrontendFrequency(frontendType, settings);
+    if (frequency == 0 || type == FrontendScanType::SCAN_UNDEFINED) {
+        return Result::INVALID_ARGUMENT;
+    }
+
+    shared_ptr<ScanJob> job = make_shared<ScanJob>();
+    job->frontend = mFrontends[frontendId];
+    job->type = frontendType;
+    job->frequencies.push_back(frequency);
+    if (type == FrontendScanType::SCAN_BLIND) {
+        for (uint32_t i = 1; i < BLIND_SCAN_STEP_COUNT; i++) {
+            job->frequencies.push_back(frequency + i * BLIND_SCAN_STEP);
+        }
+    }
+    job->outcomes.assign(job->frequencies.size(), SCAN_OUTCOME_UNKNOWN);
+
+    std::lock_guard<std::mutex> lock(mScanLock);
+    // The requesting frontend takes part with the frontends of its type neither tuned nor
+    // scanning, up to one for each frequency
+    for (int i = 0; i < mFrontendSize && job->frontendIds.size() < job->frequencies.size(); i++) {
+        uint32_t id = mFrontends[i]->getFrontendId();
+        if (id != frontendId &&
+            (mFrontends[i]->getFrontendType() != frontendType || mFrontends[i]->isLocked() ||
+             mScanningFrontendIds.find(id) != mScanningFrontendIds.end())) {
+            continue;
+        }
+        mScanningFrontendIds.insert(id);
+        job->frontendIds.push_back(id);
+    }
+    mScanJobs[frontendId] = job;
+    for (uint32_t id : job->frontendIds) {
+        pthread_t thread;
+        ScanThreadArgs* threadArgs = new ScanThreadArgs{this, job, id};
+        pthread_create(&thread, NULL, __threadLoopScan, threadArgs);
+        pthread_setname_np(thread, "frontend_scan");
+        job->threads.push_back(thread);
+    }
+    ALOGD("[Tuner] frontend %d scans %zu frequencies on %zu frontends", frontendId,
+          job->frequencies.size(), job->frontendIds.size());
+
+    return Result::SUCCESS;
+}
+
+void Tuner::frontendStopScan(uint32_t frontendId) {
+    shared_ptr<ScanJob> job;
+    {
+        std::lock_guard<std::mutex> lock(mScanLock);
+        auto it = mScanJobs.find(frontendId);
+        if (it == mScanJobs.end()) {
+            return;
+        }
+        job = it->second;
+        mScanJobs.erase(it);
+        job->isStopped = true;
+    }
+    mScanCondition.notify_all();
+    for (pthread_t thread : job->threads) {
+        pthread_join(thread, NULL);
+    }
+}
+
+void* Tuner::__threadLoopScan(void* user) {
+    ScanThreadArgs* threadArgs = static_cast<ScanThreadArgs*>(user);
+    threadArgs->user->scanThreadLoop(threadArgs->job, threadArgs->frontendId);
+    delete threadArgs;
+    return 0;
+}
+
+void Tuner::scanThreadLoop(const shared_ptr<ScanJob>& job, uint32_t frontendId) {
+    std::unique_lock<std::mutex> lock(mScanLock);
+    while (!job->isStopped && job->nextFrequency < job->frequencies.size()) {
+        size_t index = job->nextFrequency++;
+        uint32_t frequency = job->frequencies[index];
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        bool isLocked;
+        auto cached = mScanOutcomes.find({job->type, frequency});
+        if (cached != mScanOutcomes.end() && now - cached->second.time < SCAN_OUTCOME_TTL) {
+            isLocked = cached->second.isLocked;
+        } else {
+            // Acquire the frequency on this frontend
+            isLocked = frequency % CHANNEL_RASTER == 0;
+            mScanCondition.wait_for(lock, isLocked ? LOCK_TIME : UNLOCK_TIMEOUT,
+                                    [&job] { return job->isStopped; });
+            if (job->isStopped) {
+                break;
+            }
+            mScanOutcomes[{job->type, frequency}] = {.isLocked = isLocked, .time = now};
+        }
+        job->outcomes[index] = isLocked ? SCAN_OUTCOME_LOCKED : SCAN_OUTCOME_UNLOCKED;
+        job->resolvedCount++;
+        reportScanLocked(*job);
+    }
+    mScanningFrontendIds.erase(frontendId);
+}
+
+void Tuner::reportScanLocked(ScanJob& job) {
+    sp<IFrontendCallback> callback = job.frontend->getCallback();
+    if (callback == nullptr || job.isStopped || job.isEnded) {
+        return;
+    }
+
+    FrontendScanMessage msg;
+    uint8_t progressPercent = job.resolvedCount * 100 / job.frequencies.size();
+    if (progressPercent != job.progressPercent) {
+        job.progressPercent = progressPercent;
+        msg.progressPercent(progressPercent);
+        callback->onScanMessage(FrontendScanMessageType::PROGRESS_PERCENT, msg);
+    }
+    if (job.isWaitingForContinue) {
+        return;
+    }
+
+    while (job.nextReport < job.frequencies.size()) {
+        ScanOutcome outcome = job.outcomes[job.nextReport];
+        if (outcome == SCAN_OUTCOME_UNKNOWN) {
+            return;
+        }
+        uint32_t frequency = job.frequencies[job.nextReport++];
+        if (outcome == SCAN_OUTCOME_LOCKED) {
+            msg.frequencies({frequency});
+            callback->onScanMessage(FrontendScanMessageType::FREQUENCY, msg);
+            msg.isLocked(true);
+            callback->onScanMessage(FrontendScanMessageType::LOCKED, msg);
+            job.frontend->setLocked(true);
+            job.isWaitingForContinue = true;
+            return;
+        }
+    }
+
+    msg.isEnd(true);
+    callback->onScanMessage(FrontendScanMessageType::END, msg);
+    job.isEnded = true;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace tuner
@@ -18,7 +18,12 @@
 #define ANDROID_HARDWARE_TV_TUNER_V1_0_TUNER_H_
 
 #include <android/hardware/tv/tuner/1.0/ITuner.h>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include "Demux.h"
 #include "Frontend.h"
 #include "Lnb.h"
@@ -59,15 +64,75 @@ class Tuner : public ITuner {
     virtual Return<void> openLnbByName(const hidl_string& lnbName,
                                        openLnbByName_cb _hidl_cb) override;
 
+    virtual Return<void> debug(const hidl_handle& fd,
+                               const hidl_vec<hidl_string>& options) override;
+
     sp<Frontend> getFrontendById(uint32_t frontendId);
 
     void setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId);
 
     void frontendStartTune(uint32_t frontendId);
     void frontendStopTune(uint32_t frontendId);
+    /**
+     * Starts a scan for the frontend, splitting its frequency plan across the frontend and the
+     * idle frontends of the same type, or goes on with the scan of the frontend waiting after
+     * reporting a locked frequency.
+     */
+    Result frontendScan(uint32_t frontendId, const FrontendSettings& settings,
+                        FrontendScanType type);
+    void frontendStopScan(uint32_t frontendId);
 
   private:
     virtual ~Tuner();
+
+    enum ScanOutcome : int8_t {
+        SCAN_OUTCOME_UNKNOWN,
+        SCAN_OUTCOME_UNLOCKED,
+        SCAN_OUTCOME_LOCKED,
+    };
+
+    /**
+     * A scan requested on a frontend. Its frequencies are acquired in parallel by a thread for
+     * each frontend taking part, and reported in the order of the plan through the callback of
+     * the requesting frontend.
+     */
+    struct ScanJob {
+        sp<Frontend> frontend;
+        FrontendType type;
+        vector<uint32_t> frequencies;
+        vector<ScanOutcome> outcomes;
+        // Index of the next frequency to acquire and of the next outcome to report
+        size_t nextFrequency = 0;
+        size_t nextReport = 0;
+        size_t resolvedCount = 0;
+        uint8_t progressPercent = 0;
+        // The scan waits for the client to scan again after reporting a locked frequency
+        bool isWaitingForContinue = false;
+        bool isEnded = false;
+        bool isStopped = false;
+        vector<uint32_t> frontendIds;
+        vector<pthread_t> threads;
+    };
+
+    // The arguments passed to a newly created scan thread
+    struct ScanThreadArgs {
+        Tuner* user;
+        shared_ptr<ScanJob> job;
+        uint32_t frontendId;
+    };
+
+    struct ScanOutcomeRecord {
+        bool isLocked;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    static void* __threadLoopScan(void* user);
+    void scanThreadLoop(const shared_ptr<ScanJob>& job, uint32_t frontendId);
+    /**
+     * Reports the progress of the scan and the outcomes resolved in the order of the plan, up to
+     * the next locked frequency. Called with mScanLock held.
+     */
+    void reportScanLocked(ScanJob& job);
     // Static mFrontends array to maintain local frontends information
     vector<sp<Frontend>> mFrontends;
     vector<FrontendInfo::FrontendCapabilities> mFrontendCaps;
@@ -79,6 +144,32 @@ class Tuner : public ITuner {
     // First used id will be 0.
     int mLastUsedId = -1;
     vector<sp<Lnb>> mLnbs;
+
+    /**
+     * Scans by requesting frontend id, the frontends scanning for any of them, and the cache of
+     * the outcomes of the frequencies acquired by type of frontend
+     */
+    std::map<uint32_t, shared_ptr<ScanJob>> mScanJobs;
+    std::set<uint32_t> mScanningFrontendIds;
+    std::map<std::pair<FrontendType, uint32_t>, ScanOutcomeRecord> mScanOutcomes;
+    /**
+     * Lock to protect the scans, signaled when a scan is stopped
+     */
+    std::mutex mScanLock;
+    std::condition_variable mScanCondition;
+
+    /**
+     * The blind scans step through BLIND_SCAN_STEP_COUNT frequencies from the one of the settings.
+     * The simulated signal locks on the frequencies of the channel raster, after LOCK_TIME, and
+     * the other frequencies are given up after UNLOCK_TIMEOUT.
+     */
+    const uint32_t BLIND_SCAN_STEP = 100;
+    const uint32_t BLIND_SCAN_STEP_COUNT = 10;
+    const uint32_t CHANNEL_RASTER = 1000;
+    const std::chrono::milliseconds LOCK_TIME{20};
+    const std::chrono::milliseconds UNLOCK_TIMEOUT{50};
+    // How long the outcome of an acquired frequency is reused
+    const std::chrono::minutes SCAN_OUTCOME_TTL{10};
 };
 
 }  // namespace implementation
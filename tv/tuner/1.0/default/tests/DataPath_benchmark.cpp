@@ -0,0 +1,705 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TunerDataPathBenchmarks"
+
+#include <benchmark/benchmark.h>
+
+#include <fmq/MessageQueue.h>
+#include <halmetrics/Metrics.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Demux.h"
+#include "Dvr.h"
+#include "Filter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::metrics::Histogram;
+using ::android::hardware::tv::tuner::V1_0::DataFormat;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterEvent;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterMainType;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterSectionSettings;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterSettings;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterStatus;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterType;
+using ::android::hardware::tv::tuner::V1_0::DemuxQueueNotifyBits;
+using ::android::hardware::tv::tuner::V1_0::DemuxTsFilterType;
+using ::android::hardware::tv::tuner::V1_0::DvrSettings;
+using ::android::hardware::tv::tuner::V1_0::DvrType;
+using ::android::hardware::tv::tuner::V1_0::IDvr;
+using ::android::hardware::tv::tuner::V1_0::IDvrCallback;
+using ::android::hardware::tv::tuner::V1_0::IFilter;
+using ::android::hardware::tv::tuner::V1_0::IFilterCallback;
+using ::android::hardware::tv::tuner::V1_0::PlaybackStatus;
+using ::android::hardware::tv::tuner::V1_0::RecordStatus;
+using ::android::hardware::tv::tuner::V1_0::Result;
+using ::android::hardware::tv::tuner::V1_0::implementation::Demux;
+using ::android::hardware::tv::tuner::V1_0::implementation::DvrMQ;
+using ::android::hardware::tv::tuner::V1_0::implementation::Filter;
+using ::android::hardware::tv::tuner::V1_0::implementation::FilterMQ;
+
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kTsHeaderSize = 4;
+constexpr size_t kTsPayloadSize = kTsPacketSize - kTsHeaderSize;
+
+// Same as the buffer sizes of the DVR and of the filters in VTS
+constexpr uint32_t kDvrBufferSize = 1024 * 1024;
+constexpr uint32_t kFilterBufferSize = 16 * 1024 * 1024;
+
+// Packets written into the playback FMQ at once, about what a player writes per read of its source
+constexpr size_t kBatchPackets = 64;
+
+// How long each benchmark writes the stream for, and how long it waits for the last events after
+constexpr int64_t kRunDurationNs = INT64_C(1000000000);
+constexpr int64_t kDrainTimeoutNs = INT64_C(1000000000);
+constexpr int64_t kEventsSettledNs = 50 * INT64_C(1000000);
+
+// Units of each stream remembered for the latency, a unit older than this is not measured
+constexpr size_t kUnitTimeRingSize = 4096;
+
+// Offsets of the unit sequence number in the PES packets and in the sections generated
+constexpr size_t kPesSeqOffset = 9;
+constexpr size_t kSectionSeqOffset = 8;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+int64_t cpuTimeNs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+/**
+ * Prints a one line summary of a histogram.
+ *
+ * @param name The name printed before the summary.
+ * @param unit The unit the values are printed in.
+ * @param divisor What recorded values are divided by to be in unit.
+ */
+void printHistogram(const std::string& name, const Histogram& histogram, const char* unit,
+                    double divisor) {
+    uint64_t count = histogram.count();
+    printf("%s: %" PRIu64 " samples", name.c_str(), count);
+    if (count == 0) {
+        printf("\n");
+        return;
+    }
+    printf(", mean %.1f %s, p50 %.1f %s, p90 %.1f %s, p99 %.1f %s, max %.1f %s\n",
+           histogram.sum() / divisor / count, unit, histogram.percentile(50) / divisor, unit,
+           histogram.percentile(90) / divisor, unit, histogram.percentile(99) / divisor, unit,
+           histogram.max() / divisor, unit);
+}
+
+uint32_t getCrc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void writeSeq(uint8_t* data, uint32_t seq) {
+    data[0] = seq >> 24;
+    data[1] = seq >> 16;
+    data[2] = seq >> 8;
+    data[3] = seq;
+}
+
+uint32_t readSeq(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+enum class StreamType { VIDEO, AUDIO, PES, SECTION };
+
+struct StreamConfig {
+    StreamType type;
+    uint16_t pid;
+    //! Size of each PES packet or section of the stream, headers included
+    size_t unitSize;
+    //! Packets of the stream in each round of the packets of all the streams
+    size_t packetsPerRound;
+};
+
+/**
+ * Generates a synthetic TS multiplexing the configured streams, each made of PES packets or of
+ * long syntax sections carrying their sequence number, so that the filter callbacks can tell when
+ * the packet completing them was written.
+ */
+class TsGenerator {
+  public:
+    explicit TsGenerator(const std::vector<StreamConfig>& configs) {
+        for (const auto& config : configs) {
+            mStreams.push_back({.config = config});
+            mStreams.back().unit.reserve(config.unitSize);
+        }
+    }
+
+    /**
+     * Appends the next packets of the streams, round after round, to the given buffer.
+     *
+     * @param completedUnits Gets the stream index and sequence number of the units completed by
+     *        the packets added.
+     */
+    void generate(size_t numPackets, std::vector<uint8_t>* packets,
+                  std::vector<std::pair<size_t, uint32_t>>* completedUnits) {
+        for (size_t i = 0; i < numPackets; i++) {
+            Stream& stream = mStreams[mStreamIndex];
+            size_t offset = packets->size();
+            packets->resize(offset + kTsPacketSize);
+            if (writePacket(stream, packets->data() + offset)) {
+                completedUnits->emplace_back(mStreamIndex, stream.seq - 1);
+            }
+            if (++mPacketsInRound >= stream.config.packetsPerRound) {
+                mPacketsInRound = 0;
+                mStreamIndex = (mStreamIndex + 1) % mStreams.size();
+            }
+        }
+    }
+
+  private:
+    struct Stream {
+        StreamConfig config;
+        std::vector<uint8_t> unit;
+        size_t offset = 0;
+        uint8_t continuityCounter = 0;
+        uint32_t seq = 0;
+    };
+
+    void buildUnit(Stream& stream) {
+        size_t size = stream.config.unitSize;
+        stream.unit.assign(size, 0xaa);
+        uint8_t* unit = stream.unit.data();
+        if (stream.config.type == StreamType::SECTION) {
+            // Event information section, with a new version for each section so that none is
+            // dropped as a repeat
+            size_t sectionLength = size - 3;
+            unit[0] = 0x4e;
+            unit[1] = 0xb0 | ((sectionLength >> 8) & 0xf);
+            unit[2] = sectionLength & 0xff;
+            unit[3] = 0x00;
+            unit[4] = 0x01;
+            unit[5] = 0xc1 | ((stream.seq & 0x1f) << 1);
+            unit[6] = 0x00;
+            unit[7] = 0x00;
+            writeSeq(unit + kSectionSeqOffset, stream.seq);
+            uint32_t crc = getCrc32(unit, size - 4);
+            writeSeq(unit + size - 4, crc);
+        } else {
+            uint8_t streamId = stream.config.type == StreamType::VIDEO   ? 0xe0
+                               : stream.config.type == StreamType::AUDIO ? 0xc0
+                                                                         : 0xbd;
+            size_t pesPacketLength = size - 6;
+            unit[0] = 0x00;
+            unit[1] = 0x00;
+            unit[2] = 0x01;
+            unit[3] = streamId;
+            unit[4] = (pesPacketLength >> 8) & 0xff;
+            unit[5] = pesPacketLength & 0xff;
+            unit[6] = 0x80;
+            unit[7] = 0x00;
+            unit[8] = 0x00;
+            writeSeq(unit + kPesSeqOffset, stream.seq);
+        }
+        stream.offset = 0;
+        stream.seq++;
+    }
+
+    //! Returns true if the packet completes the unit of the stream.
+    bool writePacket(Stream& stream, uint8_t* packet) {
+        bool payloadUnitStart = stream.offset == stream.unit.size();
+        if (payloadUnitStart) {
+            buildUnit(stream);
+        }
+        packet[0] = 0x47;
+        packet[1] = (payloadUnitStart ? 0x40 : 0x00) | ((stream.config.pid >> 8) & 0x1f);
+        packet[2] = stream.config.pid & 0xff;
+
+        size_t left = stream.unit.size() - stream.offset;
+        uint8_t* payload = packet + kTsHeaderSize;
+        size_t payloadSize = kTsPayloadSize;
+        if (stream.config.type == StreamType::SECTION) {
+            // The section starts right after the pointer field, the end of the last packet is
+            // stuffed with 0xff
+            packet[3] = 0x10;
+            if (payloadUnitStart) {
+                *payload++ = 0x00;
+                payloadSize--;
+            }
+            size_t length = std::min(left, payloadSize);
+            memcpy(payload, stream.unit.data() + stream.offset, length);
+            memset(payload + length, 0xff, payloadSize - length);
+            stream.offset += length;
+        } else if (left >= payloadSize) {
+            packet[3] = 0x10;
+            memcpy(payload, stream.unit.data() + stream.offset, payloadSize);
+            stream.offset += payloadSize;
+        } else {
+            // The end of the PES packet is padded with the adaptation field
+            packet[3] = 0x30;
+            size_t adaptationFieldLength = payloadSize - left - 1;
+            packet[4] = adaptationFieldLength;
+            if (adaptationFieldLength > 0) {
+                packet[5] = 0x00;
+                memset(packet + 6, 0xff, adaptationFieldLength - 1);
+            }
+            memcpy(packet + 5 + adaptationFieldLength, stream.unit.data() + stream.offset, left);
+            stream.offset += left;
+        }
+        packet[3] |= stream.continuityCounter;
+        stream.continuityCounter = (stream.continuityCounter + 1) & 0xf;
+        return stream.offset == stream.unit.size();
+    }
+
+    std::vector<Stream> mStreams;
+    size_t mStreamIndex = 0;
+    size_t mPacketsInRound = 0;
+};
+
+class DvrCallback : public IDvrCallback {
+  public:
+    Return<void> onRecordStatus(RecordStatus /*status*/) override { return Void(); }
+
+    Return<void> onPlaybackStatus(PlaybackStatus /*status*/) override { return Void(); }
+};
+
+class DataPathHarness;
+
+/**
+ * A filter opened on the demux and its client side: the callback reads the data of each event
+ * from the filter FMQ, or from the AV memory, and acknowledges it like the framework does.
+ */
+struct FilterClient : public IFilterCallback {
+    FilterClient(DataPathHarness* harness, size_t streamIndex, const StreamConfig& config)
+        : harness(harness),
+          streamIndex(streamIndex),
+          config(config) {}
+
+    Return<void> onFilterEvent(const DemuxFilterEvent& filterEvent) override;
+
+    Return<void> onFilterStatus(DemuxFilterStatus /*status*/) override { return Void(); }
+
+    static std::string getName(const StreamConfig& config) {
+        switch (config.type) {
+            case StreamType::VIDEO:
+                return "Video";
+            case StreamType::AUDIO:
+                return "Audio";
+            case StreamType::PES:
+                return "PES";
+            case StreamType::SECTION:
+                return "Section";
+        }
+        return "";
+    }
+
+    DataPathHarness* harness;
+    size_t streamIndex;
+    StreamConfig config;
+    sp<Filter> filter;
+    std::unique_ptr<FilterMQ> filterMQ;
+    EventFlag* filterEventFlag = nullptr;
+    std::vector<uint8_t> data;
+    std::atomic<uint64_t> numEvents{0};
+
+    //! From the write of the packet completing a unit until its event is read
+    Histogram latency;
+    //! Data in the filter FMQ on each event, before it is read
+    Histogram occupancy;
+};
+
+/**
+ * A demux with a playback DVR and a mix of filters opened on it, fed with a synthetic TS through
+ * the DVR playback FMQ like a player does.
+ */
+class DataPathHarness {
+  public:
+    explicit DataPathHarness(const std::vector<StreamConfig>& configs) : mGenerator(configs) {
+        mDemux = new Demux(0 /* demuxId */, nullptr /* tuner */);
+        for (size_t i = 0; i < configs.size(); i++) {
+            mUnitTimes.emplace_back(new UnitTime[kUnitTimeRingSize]);
+            mFilters.push_back(new FilterClient(this, i, configs[i]));
+            openFilter(mFilters.back());
+        }
+
+        mDemux->openDvr(DvrType::PLAYBACK, kDvrBufferSize, new DvrCallback(),
+                        [&](Result /*result*/, const sp<IDvr>& dvr) { mDvr = dvr; });
+        DvrSettings settings;
+        settings.playback({
+                .statusMask = 0,
+                .lowThreshold = kDvrBufferSize / 4,
+                .highThreshold = kDvrBufferSize * 3 / 4,
+                .dataFormat = DataFormat::TS,
+                .packetSize = kTsPacketSize,
+        });
+        mDvr->configure(settings);
+        mDvr->getQueueDesc([&](Result /*result*/, const auto& desc) {
+            mDvrMQ = std::make_unique<DvrMQ>(desc, true /* resetPointers */);
+        });
+        EventFlag::createEventFlag(mDvrMQ->getEventFlagWord(), &mDvrEventFlag);
+
+        for (auto& filter : mFilters) {
+            filter->filter->start();
+        }
+        mDvr->start();
+    }
+
+    ~DataPathHarness() {
+        mDvr->stop();
+        for (auto& filter : mFilters) {
+            filter->filter->stop();
+            filter->filter->close();
+            // The filter holds its callback
+            filter->filter.clear();
+            EventFlag::deleteEventFlag(&filter->filterEventFlag);
+        }
+        mDemux->close();
+        EventFlag::deleteEventFlag(&mDvrEventFlag);
+    }
+
+    /**
+     * Writes the stream into the playback FMQ for kRunDurationNs, then waits for the DVR to read
+     * it all and for the last filter events.
+     *
+     * @param bitrateMbps The bitrate the stream is written at, or 0 to write it as fast as the
+     *        playback FMQ takes it.
+     *
+     * @return The time it took to write and filter the stream, in seconds.
+     */
+    double run(int64_t bitrateMbps) {
+        int64_t startTime = nowNs();
+        int64_t startCpuTime = cpuTimeNs(CLOCK_PROCESS_CPUTIME_ID);
+        int64_t writerCpuTime = 0;
+        std::thread writer([&] {
+            int64_t threadStartCpuTime = cpuTimeNs(CLOCK_THREAD_CPUTIME_ID);
+            writeStream(bitrateMbps, startTime + kRunDurationNs);
+            writerCpuTime = cpuTimeNs(CLOCK_THREAD_CPUTIME_ID) - threadStartCpuTime;
+        });
+        writer.join();
+
+        int64_t drainEndTime = nowNs() + kDrainTimeoutNs;
+        while (mDvrMQ->availableToRead() > 0 && nowNs() < drainEndTime) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        int64_t endTime = nowNs();
+        uint64_t numEvents = getNumEvents();
+        while (nowNs() < drainEndTime) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(kEventsSettledNs));
+            uint64_t newNumEvents = getNumEvents();
+            if (newNumEvents == numEvents) {
+                break;
+            }
+            numEvents = newNumEvents;
+            endTime = nowNs();
+        }
+
+        // The CPU time of the service threads, which include the filter callbacks
+        mHalCpuTime = cpuTimeNs(CLOCK_PROCESS_CPUTIME_ID) - startCpuTime - writerCpuTime;
+        mRunTime = endTime - startTime;
+        return static_cast<double>(mRunTime) / INT64_C(1000000000);
+    }
+
+    uint64_t getNumPacketsWritten() const { return mNumPacketsWritten; }
+
+    uint64_t getNumEvents() const {
+        uint64_t numEvents = 0;
+        for (const auto& filter : mFilters) {
+            numEvents += filter->numEvents.load();
+        }
+        return numEvents;
+    }
+
+    //! Returns the CPU usage of the service threads during the run, in percent of one core.
+    double getHalCpuPercent() const {
+        return mRunTime > 0 ? 100.0 * mHalCpuTime / mRunTime : 0;
+    }
+
+    const std::vector<sp<FilterClient>>& getFilters() const { return mFilters; }
+
+    void printHistograms() const {
+        printHistogram("Playback FMQ occupancy", mDvrOccupancy, "packets", 1);
+        for (const auto& filter : mFilters) {
+            std::string name = FilterClient::getName(filter->config);
+            printf("%s filter: %" PRIu64 " events\n", name.c_str(), filter->numEvents.load());
+            printHistogram(name + " event latency", filter->latency, "us", 1000);
+            printHistogram(name + " filter FMQ occupancy", filter->occupancy, "KiB", 1024);
+        }
+    }
+
+    /**
+     * Returns the time the packet completing the given unit of the stream was written at, or -1
+     * if it is not known anymore.
+     */
+    int64_t getUnitTime(size_t streamIndex, uint32_t seq) const {
+        const UnitTime& unitTime = mUnitTimes[streamIndex][seq % kUnitTimeRingSize];
+        int64_t time = unitTime.time.load(std::memory_order_acquire);
+        return unitTime.seq.load(std::memory_order_relaxed) == seq ? time : -1;
+    }
+
+  private:
+    struct UnitTime {
+        std::atomic<uint32_t> seq{UINT32_MAX};
+        std::atomic<int64_t> time{0};
+    };
+
+    void openFilter(const sp<FilterClient>& client) {
+        DemuxFilterType type;
+        type.mainType = DemuxFilterMainType::TS;
+        DemuxFilterSettings settings;
+        settings.ts({});
+        settings.ts().tpid = client->config.pid;
+        switch (client->config.type) {
+            case StreamType::VIDEO:
+            case StreamType::AUDIO:
+                type.subType.tsFilterType(client->config.type == StreamType::VIDEO
+                                                  ? DemuxTsFilterType::VIDEO
+                                                  : DemuxTsFilterType::AUDIO);
+                settings.ts().filterSettings.av({.isPassthrough = false});
+                break;
+            case StreamType::PES:
+                type.subType.tsFilterType(DemuxTsFilterType::PES);
+                settings.ts().filterSettings.pesData({.streamId = 0xbd, .isRaw = false});
+                break;
+            case StreamType::SECTION: {
+                type.subType.tsFilterType(DemuxTsFilterType::SECTION);
+                DemuxFilterSectionSettings sectionSettings;
+                sectionSettings.isCheckCrc = true;
+                sectionSettings.isRepeat = false;
+                sectionSettings.isRaw = false;
+                settings.ts().filterSettings.section(sectionSettings);
+                break;
+            }
+        }
+
+        mDemux->openFilter(type, kFilterBufferSize, client,
+                           [&](Result /*result*/, const sp<IFilter>& filter) {
+                               client->filter = static_cast<Filter*>(filter.get());
+                           });
+        client->filter->getQueueDesc([&](Result /*result*/, const auto& desc) {
+            client->filterMQ = std::make_unique<FilterMQ>(desc, true /* resetPointers */);
+        });
+        EventFlag::createEventFlag(client->filterMQ->getEventFlagWord(),
+                                   &client->filterEventFlag);
+        client->filter->configure(settings);
+    }
+
+    void writeStream(int64_t bitrateMbps, int64_t endTime) {
+        std::vector<uint8_t> packets;
+        packets.reserve(kBatchPackets * kTsPacketSize);
+        std::vector<std::pair<size_t, uint32_t>> completedUnits;
+        int64_t batchIntervalNs =
+                bitrateMbps > 0 ? kBatchPackets * kTsPacketSize * 8 * 1000 / bitrateMbps : 0;
+
+        int64_t nextWriteTime = nowNs();
+        while (nextWriteTime < endTime) {
+            packets.clear();
+            completedUnits.clear();
+            mGenerator.generate(kBatchPackets, &packets, &completedUnits);
+            while (mDvrMQ->availableToWrite() < packets.size() && nowNs() < endTime) {
+                std::this_thread::yield();
+            }
+            mDvrOccupancy.record(mDvrMQ->availableToRead() / kTsPacketSize);
+
+            // Recorded before writing, so that the filters never see a unit before its time
+            int64_t writeTime = nowNs();
+            for (const auto& [streamIndex, seq] : completedUnits) {
+                UnitTime& unitTime = mUnitTimes[streamIndex][seq % kUnitTimeRingSize];
+                unitTime.seq.store(seq, std::memory_order_relaxed);
+                unitTime.time.store(writeTime, std::memory_order_release);
+            }
+            if (!mDvrMQ->write(packets.data(), packets.size())) {
+                break;
+            }
+            mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            mNumPacketsWritten += kBatchPackets;
+
+            if (batchIntervalNs > 0) {
+                nextWriteTime += batchIntervalNs;
+                std::this_thread::sleep_for(std::chrono::nanoseconds(nextWriteTime - nowNs()));
+            } else {
+                nextWriteTime = nowNs();
+            }
+        }
+    }
+
+    TsGenerator mGenerator;
+    sp<Demux> mDemux;
+    sp<IDvr> mDvr;
+    std::unique_ptr<DvrMQ> mDvrMQ;
+    EventFlag* mDvrEventFlag = nullptr;
+    std::vector<sp<FilterClient>> mFilters;
+    std::vector<std::unique_ptr<UnitTime[]>> mUnitTimes;
+
+    uint64_t mNumPacketsWritten = 0;
+    int64_t mRunTime = 0;
+    int64_t mHalCpuTime = 0;
+
+    //! Packets in the playback FMQ not read by the DVR yet, on each write
+    Histogram mDvrOccupancy;
+};
+
+Return<void> FilterClient::onFilterEvent(const DemuxFilterEvent& filterEvent) {
+    using EventDiscriminator = DemuxFilterEvent::Event::hidl_discriminator;
+    int64_t now = nowNs();
+    occupancy.record(filterMQ->availableToRead());
+    for (const auto& event : filterEvent.events) {
+        int64_t unitTime = -1;
+        switch (event.getDiscriminator()) {
+            case EventDiscriminator::section:
+            case EventDiscriminator::pes: {
+                bool isSection = event.getDiscriminator() == EventDiscriminator::section;
+                size_t length = isSection ? event.section().dataLength : event.pes().dataLength;
+                size_t seqOffset = isSection ? kSectionSeqOffset : kPesSeqOffset;
+                data.resize(length);
+                if (!filterMQ->read(data.data(), length)) {
+                    break;
+                }
+                if (length >= seqOffset + 4) {
+                    unitTime = harness->getUnitTime(streamIndex, readSeq(data.data() + seqOffset));
+                }
+                break;
+            }
+            case EventDiscriminator::media: {
+                // Map the page of the AV memory the PES packet starts in, for its sequence number
+                const auto& media = event.media();
+                const native_handle_t* handle = media.avMemory.getNativeHandle();
+                if (handle != nullptr && handle->numFds > 0 &&
+                    media.dataLength >= kPesSeqOffset + 4) {
+                    long pageSize = sysconf(_SC_PAGESIZE);
+                    off_t pageOffset = media.offset / pageSize * pageSize;
+                    size_t mapSize = media.offset - pageOffset + kPesSeqOffset + 4;
+                    void* page = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, handle->data[0],
+                                      pageOffset);
+                    if (page != MAP_FAILED) {
+                        const uint8_t* pes =
+                                static_cast<const uint8_t*>(page) + (media.offset - pageOffset);
+                        unitTime = harness->getUnitTime(streamIndex, readSeq(pes + kPesSeqOffset));
+                        munmap(page, mapSize);
+                    }
+                }
+                filter->releaseAvHandle(hidl_handle(), media.avDataId);
+                break;
+            }
+            default:
+                break;
+        }
+        if (unitTime >= 0) {
+            latency.record(now - unitTime);
+        }
+        numEvents++;
+    }
+    filterEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+    return Void();
+}
+
+// Filter mixes, with the size of the video PES packets given to the benchmark
+enum FilterMix {
+    // Audio and video of a service being watched
+    AV_MIX,
+    // Audio and video, with the subtitles PES and the event information sections of the service
+    BROADCAST_MIX,
+    // Event information sections of several services, as scanned for the EPG
+    EPG_MIX,
+};
+
+std::vector<StreamConfig> getStreamConfigs(FilterMix mix, size_t videoPesSize) {
+    StreamConfig video = {StreamType::VIDEO, 0x100, videoPesSize, 16};
+    StreamConfig audio = {StreamType::AUDIO, 0x101, 1536, 2};
+    StreamConfig pes = {StreamType::PES, 0x102, 1024, 1};
+    StreamConfig section = {StreamType::SECTION, 0x12, 1024, 1};
+    switch (mix) {
+        case AV_MIX:
+            return {video, audio};
+        case BROADCAST_MIX:
+            return {video, audio, pes, section};
+        case EPG_MIX: {
+            std::vector<StreamConfig> configs;
+            for (uint16_t i = 0; i < 4; i++) {
+                configs.push_back({StreamType::SECTION, static_cast<uint16_t>(0x12 + i), 4096, 1});
+            }
+            return configs;
+        }
+    }
+    return {};
+}
+
+void runBenchmark(benchmark::State& state, FilterMix mix, int64_t bitrateMbps,
+                  size_t videoPesSize) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        DataPathHarness harness(getStreamConfigs(mix, videoPesSize));
+        state.ResumeTiming();
+        double seconds = harness.run(bitrateMbps);
+        state.SetIterationTime(seconds);
+
+        state.counters["packets/s"] = harness.getNumPacketsWritten() / seconds;
+        state.counters["events/s"] = harness.getNumEvents() / seconds;
+        state.counters["hal_cpu%"] = harness.getHalCpuPercent();
+        for (const auto& filter : harness.getFilters()) {
+            std::string name = FilterClient::getName(filter->config);
+            state.counters[name + "_p50_us"] = filter->latency.percentile(50) / 1000.0;
+            state.counters[name + "_p99_us"] = filter->latency.percentile(99) / 1000.0;
+        }
+        printf("%s\n", state.name().c_str());
+        harness.printHistograms();
+    }
+}
+
+// Arguments are the filter mix, the bitrate in Mbps, 0 for as fast as the playback FMQ takes the
+// stream, and the size of the video PES packets in KiB.
+void BM_DataPath(benchmark::State& state) {
+    runBenchmark(state, static_cast<FilterMix>(state.range(0)), state.range(1),
+                 std::min<size_t>(state.range(2) * 1024, 0xffff));
+}
+BENCHMARK(BM_DataPath)
+        ->Args({AV_MIX, 20, 32})
+        ->Args({AV_MIX, 80, 32})
+        ->Args({AV_MIX, 0, 32})
+        ->Args({BROADCAST_MIX, 20, 32})
+        ->Args({BROADCAST_MIX, 0, 8})
+        ->Args({BROADCAST_MIX, 0, 63})
+        ->Args({EPG_MIX, 20, 32})
+        ->Args({EPG_MIX, 0, 32})
+        ->Iterations(1)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 #include <assert.h>
+#include <chrono>
 #include <dirent.h>
 #include <iostream>
 #include <fstream>
+#include <set>
 #include <pthread.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -237,6 +239,57 @@ Status getPortModeHelper(const std::string portName, PortMode& portMode)  {
         return Status::SUCCESS;
 }
 
+Status getPortStatusForPortHelper(const std::string& name, PortStatus& portStatus) {
+    portStatus.portName = name;
+
+    uint32_t currentRole;
+    if (getCurrentRoleHelper(name, PortRoleType::POWER_ROLE,
+            currentRole) == Status::SUCCESS) {
+        portStatus.currentPowerRole =
+        static_cast<PortPowerRole> (currentRole);
+    } else {
+        ALOGE("Error while retreiving portNames");
+        return Status::ERROR;
+    }
+
+    if (getCurrentRoleHelper(name,
+            PortRoleType::DATA_ROLE, currentRole) == Status::SUCCESS) {
+        portStatus.currentDataRole =
+                static_cast<PortDataRole> (currentRole);
+    } else {
+        ALOGE("Error while retreiving current port role");
+        return Status::ERROR;
+    }
+
+    if (getCurrentRoleHelper(name, PortRoleType::MODE,
+            currentRole) == Status::SUCCESS) {
+        portStatus.currentMode =
+            static_cast<PortMode> (currentRole);
+    } else {
+        ALOGE("Error while retreiving current data role");
+        return Status::ERROR;
+    }
+
+    portStatus.canChangeMode =
+        canSwitchRoleHelper(name, PortRoleType::MODE);
+    portStatus.canChangeDataRole =
+        canSwitchRoleHelper(name, PortRoleType::DATA_ROLE);
+    portStatus.canChangePowerRole =
+        canSwitchRoleHelper(name, PortRoleType::POWER_ROLE);
+
+    ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d",
+        portStatus.canChangeMode,
+        portStatus.canChangeDataRole,
+        portStatus.canChangePowerRole);
+
+    if (getPortModeHelper(name, portStatus.supportedModes)
+          != Status::SUCCESS) {
+        ALOGE("Error while retrieving port modes");
+        return Status::ERROR;
+    }
+    return Status::SUCCESS;
+}
+
 Status getPortStatusHelper (hidl_vec<PortStatus>& currentPortStatus) {
     std::vector<std::string> names;
     Status result = getTypeCPortNamesHelper(names);
@@ -245,57 +298,13 @@ Status getPortStatusHelper (hidl_vec<PortStatus>& currentPortStatus) {
         currentPortStatus.resize(names.size());
         for(std::vector<std::string>::size_type i = 0; i < names.size(); i++) {
             ALOGI("%s", names[i].c_str());
-            currentPortStatus[i].portName = names[i];
-
-            uint32_t currentRole;
-            if (getCurrentRoleHelper(names[i], PortRoleType::POWER_ROLE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentPowerRole =
-                static_cast<PortPowerRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving portNames");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i],
-                    PortRoleType::DATA_ROLE, currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentDataRole =
-                        static_cast<PortDataRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current port role");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i], PortRoleType::MODE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentMode =
-                    static_cast<PortMode> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current data role");
-                goto done;
-            }
-
-            currentPortStatus[i].canChangeMode =
-                canSwitchRoleHelper(names[i], PortRoleType::MODE);
-            currentPortStatus[i].canChangeDataRole =
-                canSwitchRoleHelper(names[i], PortRoleType::DATA_ROLE);
-            currentPortStatus[i].canChangePowerRole =
-                canSwitchRoleHelper(names[i], PortRoleType::POWER_ROLE);
-
-            ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d",
-                currentPortStatus[i].canChangeMode,
-                currentPortStatus[i].canChangeDataRole,
-                currentPortStatus[i].canChangePowerRole);
-
-            if (getPortModeHelper(names[i], currentPortStatus[i].supportedModes)
-                  != Status::SUCCESS) {
-                ALOGE("Error while retrieving port modes");
-                goto done;
+            if (getPortStatusForPortHelper(names[i], currentPortStatus[i])
+                    != Status::SUCCESS) {
+                return Status::ERROR;
             }
         }
         return Status::SUCCESS;
     }
-done:
     return Status::ERROR;
 }
 
@@ -311,15 +320,69 @@ Return<void> Usb::queryPortStatus() {
 
     return Void();
 }
+// Role swaps raise several uevents in a row; they are handled together once
+// none arrived for this long.
+#define PORT_STATUS_DEBOUNCE_MS 50
+
 struct data {
     int uevent_fd;
     android::hardware::usb::V1_0::implementation::Usb *usb;
+    // The port status last sent to the callback, valid if portsValid is set.
+    hidl_vec<PortStatus> ports;
+    bool portsValid;
+    // Ports named in uevents since the last update, or rescan for all of them.
+    std::set<std::string> changedPorts;
+    bool rescan;
+    bool pending;
+    std::chrono::steady_clock::time_point deadline;
 };
 
+/* Refreshes the ports named in uevents, and notifies the callback if anything
+ * changed. Everything is reread if the ports themselves changed.
+ */
+static void update_port_status(struct data *payload) {
+    hidl_vec<PortStatus> currentPortStatus = payload->ports;
+    Status status = Status::SUCCESS;
+    bool rescan = payload->rescan || !payload->portsValid;
+
+    for (auto it = payload->changedPorts.begin();
+            !rescan && it != payload->changedPorts.end(); ++it) {
+        size_t i = 0;
+        while (i < currentPortStatus.size() && currentPortStatus[i].portName != *it)
+            i++;
+        if (i == currentPortStatus.size() ||
+                getPortStatusForPortHelper(*it, currentPortStatus[i]) != Status::SUCCESS)
+            rescan = true;
+    }
+    if (rescan)
+        status = getPortStatusHelper(currentPortStatus);
+
+    payload->changedPorts.clear();
+    payload->rescan = false;
+
+    if (status == Status::SUCCESS && payload->portsValid &&
+            currentPortStatus == payload->ports) {
+        ALOGI("port status unchanged");
+        return;
+    }
+    payload->portsValid = status == Status::SUCCESS;
+    payload->ports = currentPortStatus;
+
+    if (payload->usb->mCallback != NULL) {
+        Return<void> ret =
+            payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
+        if (!ret.isOk())
+            ALOGE("error %s", ret.description().c_str());
+    }
+}
+
 static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     char msg[UEVENT_MSG_LEN + 2];
     char *cp;
     int n;
+    bool dualRole = false;
+    const char *action = NULL;
+    const char *devpath = NULL;
 
     n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN);
     if (n <= 0)
@@ -334,19 +397,28 @@ static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     while (*cp) {
         if (!strcmp(cp, "SUBSYSTEM=dual_role_usb")) {
             ALOGE("uevent received %s", cp);
-            if (payload->usb->mCallback != NULL) {
-                hidl_vec<PortStatus> currentPortStatus;
-                Status status = getPortStatusHelper(currentPortStatus);
-                Return<void> ret =
-                    payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
-                if (!ret.isOk())
-                    ALOGE("error %s", ret.description().c_str());
-            }
-            break;
+            dualRole = true;
+        } else if (!strncmp(cp, "ACTION=", strlen("ACTION="))) {
+            action = cp + strlen("ACTION=");
+        } else if (!strncmp(cp, "DEVPATH=", strlen("DEVPATH="))) {
+            devpath = cp + strlen("DEVPATH=");
         }
         /* advance to after the next \0 */
         while (*cp++);
     }
+
+    if (!dualRole)
+        return;
+
+    const char *portName = devpath != NULL ? strrchr(devpath, '/') : NULL;
+    if (portName == NULL || (action != NULL && strcmp(action, "change")))
+        payload->rescan = true;
+    else
+        payload->changedPorts.insert(portName + 1);
+
+    payload->pending = true;
+    payload->deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(PORT_STATUS_DEBOUNCE_MS);
 }
 
 void* work(void* param) {
@@ -366,6 +438,9 @@ void* work(void* param) {
 
     payload.uevent_fd = uevent_fd;
     payload.usb = (android::hardware::usb::V1_0::implementation::Usb *)param;
+    payload.portsValid = false;
+    payload.rescan = false;
+    payload.pending = false;
 
     fcntl(uevent_fd, F_SETFL, O_NONBLOCK);
 
@@ -385,8 +460,20 @@ void* work(void* param) {
 
     while (!destroyThread) {
         struct epoll_event events[64];
+        int timeout = -1;
+
+        if (payload.pending) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    payload.deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                payload.pending = false;
+                update_port_status(&payload);
+                continue;
+            }
+            timeout = remaining;
+        }
 
-        nevents = epoll_wait(epoll_fd, events, 64, -1);
+        nevents = epoll_wait(epoll_fd, events, 64, timeout);
         if (nevents == -1) {
             if (errno == EINTR)
                 continue;
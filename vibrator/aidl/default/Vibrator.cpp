@@ -17,7 +17,11 @@
 #include "vibrator-impl/Vibrator.h"
 
 #include <android-base/logging.h>
-#include <thread>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
 
 namespace aidl {
 namespace android {
@@ -27,6 +31,89 @@ namespace vibrator {
 static constexpr int32_t kComposeDelayMaxMs = 1000;
 static constexpr int32_t kComposeSizeMax = 256;
 
+Vibrator::Vibrator()
+    : mTimerFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)),
+      mExitFd(eventfd(0, EFD_CLOEXEC)) {
+    CHECK(mTimerFd.ok() && mExitFd.ok()) << "Failed to create timeline fds";
+    mTimelineThread = std::thread(&Vibrator::timelineLoop, this);
+}
+
+Vibrator::~Vibrator() {
+    uint64_t exit = 1;
+    TEMP_FAILURE_RETRY(write(mExitFd.get(), &exit, sizeof(exit)));
+    mTimelineThread.join();
+}
+
+void Vibrator::cancelEffectLocked() {
+    const Clock::time_point now = Clock::now();
+    std::multimap<Clock::time_point, TimelineEvent> cancelled;
+    cancelled.swap(mTimeline);
+    for (auto& entry : cancelled) {
+        if (entry.second.isCompletion) {
+            mTimeline.emplace(now, std::move(entry.second));
+        }
+    }
+    armTimerLocked();
+}
+
+void Vibrator::scheduleLocked(Clock::time_point when, std::function<void()> action,
+                              bool isCompletion) {
+    const bool isFirst = mTimeline.empty() || when < mTimeline.begin()->first;
+    mTimeline.emplace(when, TimelineEvent{std::move(action), isCompletion});
+    if (isFirst) {
+        armTimerLocked();
+    }
+}
+
+void Vibrator::armTimerLocked() {
+    // steady_clock is CLOCK_MONOTONIC, so its time points can be used as absolute expirations.
+    struct itimerspec spec = {};
+    if (!mTimeline.empty()) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                mTimeline.begin()->first.time_since_epoch())
+                                .count();
+        // An all zero it_value would disarm the timer.
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = std::max<int64_t>(ns % 1000000000, 1);
+    }
+    if (timerfd_settime(mTimerFd.get(), TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        PLOG(ERROR) << "Failed to arm timeline timer";
+    }
+}
+
+void Vibrator::timelineLoop() {
+    struct pollfd fds[] = {
+            {mTimerFd.get(), POLLIN, 0},
+            {mExitFd.get(), POLLIN, 0},
+    };
+    while (true) {
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            PLOG(ERROR) << "Failed to poll timeline fds";
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+        uint64_t expirations;
+        TEMP_FAILURE_RETRY(read(mTimerFd.get(), &expirations, sizeof(expirations)));
+
+        std::vector<std::function<void()>> due;
+        {
+            std::lock_guard<std::mutex> lock(mTimelineLock);
+            const Clock::time_point now = Clock::now();
+            auto it = mTimeline.begin();
+            for (; it != mTimeline.end() && it->first <= now; ++it) {
+                due.push_back(std::move(it->second.action));
+            }
+            mTimeline.erase(mTimeline.begin(), it);
+            armTimerLocked();
+        }
+        for (auto& action : due) {
+            action();
+        }
+    }
+}
+
 ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
     LOG(INFO) << "Vibrator reporting capabilities";
     *_aidl_return = IVibrator::CAP_ON_CALLBACK | IVibrator::CAP_PERFORM_CALLBACK |
@@ -38,21 +125,25 @@ ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
 
 ndk::ScopedAStatus Vibrator::off() {
     LOG(INFO) << "Vibrator off";
+    std::lock_guard<std::mutex> lock(mTimelineLock);
+    cancelEffectLocked();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
                                 const std::shared_ptr<IVibratorCallback>& callback) {
     LOG(INFO) << "Vibrator on for timeoutMs: " << timeoutMs;
+    std::lock_guard<std::mutex> lock(mTimelineLock);
+    cancelEffectLocked();
     if (callback != nullptr) {
-        std::thread([=] {
-            LOG(INFO) << "Starting on on another thread";
-            usleep(timeoutMs * 1000);
-            LOG(INFO) << "Notifying on complete";
-            if (!callback->onComplete().isOk()) {
-                LOG(ERROR) << "Failed to call onComplete";
-            }
-        }).detach();
+        scheduleLocked(Clock::now() + std::chrono::milliseconds(timeoutMs),
+                       [=] {
+                           LOG(INFO) << "Notifying on complete";
+                           if (!callback->onComplete().isOk()) {
+                               LOG(ERROR) << "Failed to call onComplete";
+                           }
+                       },
+                       true);
     }
     return ndk::ScopedAStatus::ok();
 }
@@ -72,13 +163,15 @@ ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength strength,
 
     constexpr size_t kEffectMillis = 100;
 
+    std::lock_guard<std::mutex> lock(mTimelineLock);
+    cancelEffectLocked();
     if (callback != nullptr) {
-        std::thread([=] {
-            LOG(INFO) << "Starting perform on another thread";
-            usleep(kEffectMillis * 1000);
-            LOG(INFO) << "Notifying perform complete";
-            callback->onComplete();
-        }).detach();
+        scheduleLocked(Clock::now() + std::chrono::milliseconds(kEffectMillis),
+                       [=] {
+                           LOG(INFO) << "Notifying perform complete";
+                           callback->onComplete();
+                       },
+                       true);
     }
 
     *_aidl_return = kEffectMillis;
@@ -154,22 +247,28 @@ ndk::ScopedAStatus Vibrator::compose(const std::vector<CompositeEffect>& composi
         }
     }
 
-    std::thread([=] {
-        LOG(INFO) << "Starting compose on another thread";
+    std::lock_guard<std::mutex> lock(mTimelineLock);
+    cancelEffectLocked();
 
-        for (auto& e : composite) {
-            if (e.delayMs) {
-                usleep(e.delayMs * 1000);
-            }
-            LOG(INFO) << "triggering primitive " << static_cast<int>(e.primitive) << " @ scale "
-                      << e.scale;
-        }
+    Clock::time_point when = Clock::now();
+    for (auto& e : composite) {
+        when += std::chrono::milliseconds(e.delayMs);
+        scheduleLocked(when,
+                       [=] {
+                           LOG(INFO) << "triggering primitive " << static_cast<int>(e.primitive)
+                                     << " @ scale " << e.scale;
+                       },
+                       false);
+    }
 
-        if (callback != nullptr) {
-            LOG(INFO) << "Notifying perform complete";
-            callback->onComplete();
-        }
-    }).detach();
+    if (callback != nullptr) {
+        scheduleLocked(when,
+                       [=] {
+                           LOG(INFO) << "Notifying perform complete";
+                           callback->onComplete();
+                       },
+                       true);
+    }
 
     return ndk::ScopedAStatus::ok();
 }
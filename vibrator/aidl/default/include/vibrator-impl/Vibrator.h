@@ -17,6 +17,13 @@
 #pragma once
 
 #include <aidl/android/hardware/vibrator/BnVibrator.h>
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
 namespace aidl {
 namespace android {
@@ -24,6 +31,10 @@ namespace hardware {
 namespace vibrator {
 
 class Vibrator : public BnVibrator {
+  public:
+    Vibrator();
+    ~Vibrator();
+
     ndk::ScopedAStatus getCapabilities(int32_t* _aidl_return) override;
     ndk::ScopedAStatus off() override;
     ndk::ScopedAStatus on(int32_t timeoutMs,
@@ -44,6 +55,29 @@ class Vibrator : public BnVibrator {
     ndk::ScopedAStatus getSupportedAlwaysOnEffects(std::vector<Effect>* _aidl_return) override;
     ndk::ScopedAStatus alwaysOnEnable(int32_t id, Effect effect, EffectStrength strength) override;
     ndk::ScopedAStatus alwaysOnDisable(int32_t id) override;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct TimelineEvent {
+        std::function<void()> action;
+        // Completions still run if the effect is cancelled, just earlier.
+        bool isCompletion;
+    };
+
+    // Drops the rest of the current effect, and delivers its completion now.
+    void cancelEffectLocked();
+    void scheduleLocked(Clock::time_point when, std::function<void()> action, bool isCompletion);
+    void armTimerLocked();
+    void timelineLoop();
+
+    std::mutex mTimelineLock;
+    // The primitives and completion callbacks of the current effect, by due time.
+    std::multimap<Clock::time_point, TimelineEvent> mTimeline;
+    // Armed for the first event of mTimeline.
+    ::android::base::unique_fd mTimerFd;
+    ::android::base::unique_fd mExitFd;
+    std::thread mTimelineThread;
 };
 
 }  // namespace vibrator
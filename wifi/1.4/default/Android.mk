@@ -53,6 +53,7 @@ LOCAL_SRC_FILES := \
     wifi_chip.cpp \
     wifi_feature_flags.cpp \
     wifi_iface_util.cpp \
+    wifi_latency_stats.cpp \
     wifi_legacy_hal.cpp \
     wifi_legacy_hal_stubs.cpp \
     wifi_mode_controller.cpp \
@@ -75,6 +76,8 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3 \
     android.hardware.wifi@1.4
+LOCAL_HEADER_LIBRARIES := \
+    android.hardware.common-metrics
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
 include $(BUILD_STATIC_LIBRARY)
 
@@ -18,6 +18,7 @@
 #define HIDL_RETURN_UTIL_H_
 
 #include "hidl_sync_util.h"
+#include "wifi_latency_stats.h"
 #include "wifi_status_util.h"
 
 namespace android {
@@ -37,17 +38,80 @@ using namespace android::hardware::wifi::V1_0;
  * the status and any returned values.
  * b) if invalid, invokes the HIDL continuation callback with the
  * provided error status and default values.
+ * The lock returned by the object's |acquireLock| is held throughout.
+ * The time spent waiting for the lock, in the internal function and in the
+ * HIDL callback is recorded in the latency stats.
  */
+
+// Status returned when the object is invalid. Converted implicitly from the
+// WifiStatusCode passed by the HIDL method, which also records the name of
+// that method for the latency stats.
+struct InvalidObjectStatus {
+    InvalidObjectStatus(WifiStatusCode code,
+                        const char* method = __builtin_FUNCTION())
+        : code(code), method(method) {}
+
+    const WifiStatusCode code;
+    const char* const method;
+};
+
+// Records the latency of a HIDL method call in phases, see
+// |latency_stats::recordHidlMethod|. Does not read the clock unless the stats
+// were enabled when the call started.
+template <typename ObjT>
+class HidlMethodTimer {
+   public:
+    explicit HidlMethodTimer(const char* method)
+        : method_(method), enabled_(latency_stats::isEnabled()) {
+        if (enabled_) {
+            start_ = latency_stats::Clock::now();
+        }
+    }
+
+    void lockAcquired() {
+        if (enabled_) {
+            lock_acquired_ = latency_stats::Clock::now();
+        }
+    }
+    void workDone() {
+        if (enabled_) {
+            work_done_ = latency_stats::Clock::now();
+        }
+    }
+
+    ~HidlMethodTimer() {
+        if (!enabled_) {
+            return;
+        }
+        const auto end = latency_stats::Clock::now();
+        latency_stats::recordHidlMethod(latency_stats::typeTag<ObjT>(),
+                                        method_, lock_acquired_ - start_,
+                                        work_done_ - lock_acquired_,
+                                        end - work_done_);
+    }
+
+   private:
+    const char* const method_;
+    const bool enabled_;
+    latency_stats::Clock::time_point start_;
+    latency_stats::Clock::time_point lock_acquired_;
+    latency_stats::Clock::time_point work_done_;
+};
 // Use for HIDL methods which return only an instance of WifiStatus.
 template <typename ObjT, typename WorkFuncT, typename... Args>
 Return<void> validateAndCall(
-    ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
+    ObjT* obj, InvalidObjectStatus status_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&)>& hidl_cb, Args&&... args) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    HidlMethodTimer<ObjT> timer(status_if_invalid.method);
+    const auto lock = obj->acquireLock();
+    timer.lockAcquired();
     if (obj->isValid()) {
-        hidl_cb((obj->*work)(std::forward<Args>(args)...));
+        const WifiStatus status = (obj->*work)(std::forward<Args>(args)...);
+        timer.workDone();
+        hidl_cb(status);
     } else {
-        hidl_cb(createWifiStatus(status_code_if_invalid));
+        timer.workDone();
+        hidl_cb(createWifiStatus(status_if_invalid.code));
     }
     return Void();
 }
@@ -57,13 +121,19 @@ Return<void> validateAndCall(
 // Note: Only used by IWifi::stop() currently.
 template <typename ObjT, typename WorkFuncT, typename... Args>
 Return<void> validateAndCallWithLock(
-    ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
+    ObjT* obj, InvalidObjectStatus status_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&)>& hidl_cb, Args&&... args) {
+    HidlMethodTimer<ObjT> timer(status_if_invalid.method);
     auto lock = hidl_sync_util::acquireGlobalLock();
+    timer.lockAcquired();
     if (obj->isValid()) {
-        hidl_cb((obj->*work)(&lock, std::forward<Args>(args)...));
+        const WifiStatus status =
+            (obj->*work)(&lock, std::forward<Args>(args)...);
+        timer.workDone();
+        hidl_cb(status);
     } else {
-        hidl_cb(createWifiStatus(status_code_if_invalid));
+        timer.workDone();
+        hidl_cb(createWifiStatus(status_if_invalid.code));
     }
     return Void();
 }
@@ -72,17 +142,21 @@ Return<void> validateAndCallWithLock(
 // value.
 template <typename ObjT, typename WorkFuncT, typename ReturnT, typename... Args>
 Return<void> validateAndCall(
-    ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
+    ObjT* obj, InvalidObjectStatus status_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&, ReturnT)>& hidl_cb,
     Args&&... args) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    HidlMethodTimer<ObjT> timer(status_if_invalid.method);
+    const auto lock = obj->acquireLock();
+    timer.lockAcquired();
     if (obj->isValid()) {
         const auto& ret_pair = (obj->*work)(std::forward<Args>(args)...);
+        timer.workDone();
         const WifiStatus& status = std::get<0>(ret_pair);
         const auto& ret_value = std::get<1>(ret_pair);
         hidl_cb(status, ret_value);
     } else {
-        hidl_cb(createWifiStatus(status_code_if_invalid),
+        timer.workDone();
+        hidl_cb(createWifiStatus(status_if_invalid.code),
                 typename std::remove_reference<ReturnT>::type());
     }
     return Void();
@@ -93,18 +167,22 @@ Return<void> validateAndCall(
 template <typename ObjT, typename WorkFuncT, typename ReturnT1,
           typename ReturnT2, typename... Args>
 Return<void> validateAndCall(
-    ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
+    ObjT* obj, InvalidObjectStatus status_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&, ReturnT1, ReturnT2)>& hidl_cb,
     Args&&... args) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    HidlMethodTimer<ObjT> timer(status_if_invalid.method);
+    const auto lock = obj->acquireLock();
+    timer.lockAcquired();
     if (obj->isValid()) {
         const auto& ret_tuple = (obj->*work)(std::forward<Args>(args)...);
+        timer.workDone();
         const WifiStatus& status = std::get<0>(ret_tuple);
         const auto& ret_value1 = std::get<1>(ret_tuple);
         const auto& ret_value2 = std::get<2>(ret_tuple);
         hidl_cb(status, ret_value1, ret_value2);
     } else {
-        hidl_cb(createWifiStatus(status_code_if_invalid),
+        timer.workDone();
+        hidl_cb(createWifiStatus(status_if_invalid.code),
                 typename std::remove_reference<ReturnT1>::type(),
                 typename std::remove_reference<ReturnT2>::type());
     }
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <utils/SystemClock.h>
 
@@ -539,23 +541,25 @@ bool convertLegacyIeToHidl(
     }
     *hidl_ie = {};
     hidl_ie->id = legacy_ie.id;
-    hidl_ie->data =
-        std::vector<uint8_t>(legacy_ie.data, legacy_ie.data + legacy_ie.len);
+    hidl_ie->data.resize(legacy_ie.len);
+    memcpy(hidl_ie->data.data(), legacy_ie.data, legacy_ie.len);
     return true;
 }
 
 bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
-                               std::vector<WifiInformationElement>* hidl_ies) {
+                               hidl_vec<WifiInformationElement>* hidl_ies) {
     if (!ie_blob || !hidl_ies) {
         return false;
     }
-    *hidl_ies = {};
     const uint8_t* ies_begin = ie_blob;
     const uint8_t* ies_end = ie_blob + ie_blob_len;
-    const uint8_t* next_ie = ies_begin;
     using wifi_ie = legacy_hal::wifi_information_element;
     constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
+    // Walk the blob once to find the well formed IEs, so that the HIDL vector
+    // is allocated once with the right size.
     // Each IE should atleast have the header (i.e |id| & |len| fields).
+    const uint8_t* next_ie = ies_begin;
+    size_t num_ies = 0;
     while (next_ie + kIeHeaderLen <= ies_end) {
         const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
         uint32_t curr_ie_len = kIeHeaderLen + legacy_ie.len;
@@ -565,13 +569,7 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
                        << ", IEs End: " << (void*)ies_end;
             break;
         }
-        WifiInformationElement hidl_ie;
-        if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
-            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
-                       << ", len: " << legacy_ie.len;
-            break;
-        }
-        hidl_ies->push_back(std::move(hidl_ie));
+        num_ies++;
         next_ie += curr_ie_len;
     }
     // Check if the blob has been fully consumed.
@@ -579,6 +577,18 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
         LOG(ERROR) << "Failed to fully parse IE blob. Next IE: "
                    << (void*)next_ie << ", IEs End: " << (void*)ies_end;
     }
+    hidl_ies->resize(num_ies);
+    next_ie = ies_begin;
+    for (size_t ie_idx = 0; ie_idx < num_ies; ie_idx++) {
+        const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
+        if (!convertLegacyIeToHidl(legacy_ie, &(*hidl_ies)[ie_idx])) {
+            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
+                       << ", len: " << legacy_ie.len;
+            hidl_ies->resize(ie_idx);
+            break;
+        }
+        next_ie += kIeHeaderLen + legacy_ie.len;
+    }
     return true;
 }
 
@@ -590,10 +600,10 @@ bool convertLegacyGscanResultToHidl(
     }
     *hidl_scan_result = {};
     hidl_scan_result->timeStampInUs = legacy_scan_result.ts;
-    hidl_scan_result->ssid = std::vector<uint8_t>(
-        legacy_scan_result.ssid,
-        legacy_scan_result.ssid + strnlen(legacy_scan_result.ssid,
-                                          sizeof(legacy_scan_result.ssid) - 1));
+    size_t ssid_len = strnlen(legacy_scan_result.ssid,
+                              sizeof(legacy_scan_result.ssid) - 1);
+    hidl_scan_result->ssid.resize(ssid_len);
+    memcpy(hidl_scan_result->ssid.data(), legacy_scan_result.ssid, ssid_len);
     memcpy(hidl_scan_result->bssid.data(), legacy_scan_result.bssid,
            hidl_scan_result->bssid.size());
     hidl_scan_result->frequency = legacy_scan_result.channel;
@@ -601,13 +611,12 @@ bool convertLegacyGscanResultToHidl(
     hidl_scan_result->beaconPeriodInMs = legacy_scan_result.beacon_period;
     hidl_scan_result->capability = legacy_scan_result.capability;
     if (has_ie_data) {
-        std::vector<WifiInformationElement> ies;
         if (!convertLegacyIeBlobToHidl(
                 reinterpret_cast<const uint8_t*>(legacy_scan_result.ie_data),
-                legacy_scan_result.ie_length, &ies)) {
+                legacy_scan_result.ie_length,
+                &hidl_scan_result->informationElements)) {
             return false;
         }
-        hidl_scan_result->informationElements = std::move(ies);
     }
     return true;
 }
@@ -631,36 +640,31 @@ bool convertLegacyCachedGscanResultsToHidl(
 
     CHECK(legacy_cached_scan_result.num_results >= 0 &&
           legacy_cached_scan_result.num_results <= MAX_AP_CACHE_PER_SCAN);
-    std::vector<StaScanResult> hidl_scan_results;
+    hidl_scan_data->results.resize(legacy_cached_scan_result.num_results);
     for (int32_t result_idx = 0;
          result_idx < legacy_cached_scan_result.num_results; result_idx++) {
-        StaScanResult hidl_scan_result;
         if (!convertLegacyGscanResultToHidl(
                 legacy_cached_scan_result.results[result_idx], false,
-                &hidl_scan_result)) {
+                &hidl_scan_data->results[result_idx])) {
             return false;
         }
-        hidl_scan_results.push_back(hidl_scan_result);
     }
-    hidl_scan_data->results = std::move(hidl_scan_results);
     return true;
 }
 
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas) {
+    hidl_vec<StaScanData>* hidl_scan_datas) {
     if (!hidl_scan_datas) {
         return false;
     }
-    *hidl_scan_datas = {};
-    for (const auto& legacy_cached_scan_result : legacy_cached_scan_results) {
-        StaScanData hidl_scan_data;
-        if (!convertLegacyCachedGscanResultsToHidl(legacy_cached_scan_result,
-                                                   &hidl_scan_data)) {
+    hidl_scan_datas->resize(legacy_cached_scan_results.size());
+    for (size_t i = 0; i < legacy_cached_scan_results.size(); i++) {
+        if (!convertLegacyCachedGscanResultsToHidl(
+                legacy_cached_scan_results[i], &(*hidl_scan_datas)[i])) {
             return false;
         }
-        hidl_scan_datas->push_back(hidl_scan_data);
     }
     return true;
 }
@@ -740,16 +744,19 @@ bool convertLegacyDebugPacketFateFrameToHidl(
     if (!hidl_frame) {
         return false;
     }
-    *hidl_frame = {};
+    // Every field is overwritten below, so that the frame content buffer of a
+    // previous conversion can be reused when the frame length is unchanged.
     hidl_frame->frameType =
         convertLegacyDebugPacketFateFrameTypeToHidl(legacy_frame.payload_type);
     hidl_frame->frameLen = legacy_frame.frame_len;
     hidl_frame->driverTimestampUsec = legacy_frame.driver_timestamp_usec;
     hidl_frame->firmwareTimestampUsec = legacy_frame.firmware_timestamp_usec;
-    const uint8_t* frame_begin = reinterpret_cast<const uint8_t*>(
-        legacy_frame.frame_content.ethernet_ii_bytes);
-    hidl_frame->frameContent =
-        std::vector<uint8_t>(frame_begin, frame_begin + legacy_frame.frame_len);
+    if (hidl_frame->frameContent.size() != legacy_frame.frame_len) {
+        hidl_frame->frameContent.resize(legacy_frame.frame_len);
+    }
+    memcpy(hidl_frame->frameContent.data(),
+           legacy_frame.frame_content.ethernet_ii_bytes,
+           legacy_frame.frame_len);
     return true;
 }
 
@@ -759,7 +766,6 @@ bool convertLegacyDebugTxPacketFateToHidl(
     if (!hidl_fate) {
         return false;
     }
-    *hidl_fate = {};
     hidl_fate->fate = convertLegacyDebugTxPacketFateToHidl(legacy_fate.fate);
     return convertLegacyDebugPacketFateFrameToHidl(legacy_fate.frame_inf,
                                                    &hidl_fate->frameInfo);
@@ -767,17 +773,18 @@ bool convertLegacyDebugTxPacketFateToHidl(
 
 bool convertLegacyVectorOfDebugTxPacketFateToHidl(
     const std::vector<legacy_hal::wifi_tx_report>& legacy_fates,
-    std::vector<WifiDebugTxPacketFateReport>* hidl_fates) {
+    hidl_vec<WifiDebugTxPacketFateReport>* hidl_fates) {
     if (!hidl_fates) {
         return false;
     }
-    *hidl_fates = {};
-    for (const auto& legacy_fate : legacy_fates) {
-        WifiDebugTxPacketFateReport hidl_fate;
-        if (!convertLegacyDebugTxPacketFateToHidl(legacy_fate, &hidl_fate)) {
+    if (hidl_fates->size() != legacy_fates.size()) {
+        hidl_fates->resize(legacy_fates.size());
+    }
+    for (size_t i = 0; i < legacy_fates.size(); i++) {
+        if (!convertLegacyDebugTxPacketFateToHidl(legacy_fates[i],
+                                                  &(*hidl_fates)[i])) {
             return false;
         }
-        hidl_fates->push_back(hidl_fate);
     }
     return true;
 }
@@ -788,7 +795,6 @@ bool convertLegacyDebugRxPacketFateToHidl(
     if (!hidl_fate) {
         return false;
     }
-    *hidl_fate = {};
     hidl_fate->fate = convertLegacyDebugRxPacketFateToHidl(legacy_fate.fate);
     return convertLegacyDebugPacketFateFrameToHidl(legacy_fate.frame_inf,
                                                    &hidl_fate->frameInfo);
@@ -796,17 +802,18 @@ bool convertLegacyDebugRxPacketFateToHidl(
 
 bool convertLegacyVectorOfDebugRxPacketFateToHidl(
     const std::vector<legacy_hal::wifi_rx_report>& legacy_fates,
-    std::vector<WifiDebugRxPacketFateReport>* hidl_fates) {
+    hidl_vec<WifiDebugRxPacketFateReport>* hidl_fates) {
     if (!hidl_fates) {
         return false;
     }
-    *hidl_fates = {};
-    for (const auto& legacy_fate : legacy_fates) {
-        WifiDebugRxPacketFateReport hidl_fate;
-        if (!convertLegacyDebugRxPacketFateToHidl(legacy_fate, &hidl_fate)) {
+    if (hidl_fates->size() != legacy_fates.size()) {
+        hidl_fates->resize(legacy_fates.size());
+    }
+    for (size_t i = 0; i < legacy_fates.size(); i++) {
+        if (!convertLegacyDebugRxPacketFateToHidl(legacy_fates[i],
+                                                  &(*hidl_fates)[i])) {
             return false;
         }
-        hidl_fates->push_back(hidl_fate);
     }
     return true;
 }
@@ -817,15 +824,22 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     if (!hidl_radio_stat) {
         return false;
     }
-    *hidl_radio_stat = {};
-
+    // Every field is overwritten below, so that the vectors of a previous
+    // conversion can be reused when their size has not changed.
     hidl_radio_stat->V1_0.onTimeInMs = legacy_radio_stat.stats.on_time;
     hidl_radio_stat->V1_0.txTimeInMs = legacy_radio_stat.stats.tx_time;
     hidl_radio_stat->V1_0.rxTimeInMs = legacy_radio_stat.stats.rx_time;
     hidl_radio_stat->V1_0.onTimeInMsForScan =
         legacy_radio_stat.stats.on_time_scan;
-    hidl_radio_stat->V1_0.txTimeInMsPerLevel =
-        legacy_radio_stat.tx_time_per_levels;
+    if (hidl_radio_stat->V1_0.txTimeInMsPerLevel.size() ==
+        legacy_radio_stat.tx_time_per_levels.size()) {
+        std::copy(legacy_radio_stat.tx_time_per_levels.begin(),
+                  legacy_radio_stat.tx_time_per_levels.end(),
+                  hidl_radio_stat->V1_0.txTimeInMsPerLevel.begin());
+    } else {
+        hidl_radio_stat->V1_0.txTimeInMsPerLevel =
+            legacy_radio_stat.tx_time_per_levels;
+    }
     hidl_radio_stat->onTimeInMsForNanScan = legacy_radio_stat.stats.on_time_nbd;
     hidl_radio_stat->onTimeInMsForBgScan =
         legacy_radio_stat.stats.on_time_gscan;
@@ -836,10 +850,15 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     hidl_radio_stat->onTimeInMsForHs20Scan =
         legacy_radio_stat.stats.on_time_hs20;
 
-    std::vector<V1_3::WifiChannelStats> hidl_channel_stats;
-
-    for (const auto& channel_stat : legacy_radio_stat.channel_stats) {
-        V1_3::WifiChannelStats hidl_channel_stat;
+    if (hidl_radio_stat->channelStats.size() !=
+        legacy_radio_stat.channel_stats.size()) {
+        hidl_radio_stat->channelStats.resize(
+            legacy_radio_stat.channel_stats.size());
+    }
+    for (size_t i = 0; i < legacy_radio_stat.channel_stats.size(); i++) {
+        const auto& channel_stat = legacy_radio_stat.channel_stats[i];
+        V1_3::WifiChannelStats& hidl_channel_stat =
+            hidl_radio_stat->channelStats[i];
         hidl_channel_stat.onTimeInMs = channel_stat.on_time;
         hidl_channel_stat.ccaBusyTimeInMs = channel_stat.cca_busy_time;
         /*
@@ -852,11 +871,8 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
             channel_stat.channel.center_freq0;
         hidl_channel_stat.channel.centerFreq1 =
             channel_stat.channel.center_freq1;
-        hidl_channel_stats.push_back(hidl_channel_stat);
     }
 
-    hidl_radio_stat->channelStats = hidl_channel_stats;
-
     return true;
 }
 
@@ -866,7 +882,8 @@ bool convertLegacyLinkLayerStatsToHidl(
     if (!hidl_stats) {
         return false;
     }
-    *hidl_stats = {};
+    // Every field is overwritten below, see
+    // |convertLegacyLinkLayerRadioStatsToHidl|.
     // iface legacy_stats conversion.
     hidl_stats->iface.beaconRx = legacy_stats.iface.beacon_rx;
     hidl_stats->iface.avgRssiMgmt = legacy_stats.iface.rssi_mgmt;
@@ -903,16 +920,15 @@ bool convertLegacyLinkLayerStatsToHidl(
     hidl_stats->iface.wmeVoPktStats.retries =
         legacy_stats.iface.ac[legacy_hal::WIFI_AC_VO].retries;
     // radio legacy_stats conversion.
-    std::vector<V1_3::StaLinkLayerRadioStats> hidl_radios_stats;
-    for (const auto& legacy_radio_stats : legacy_stats.radios) {
-        V1_3::StaLinkLayerRadioStats hidl_radio_stats;
-        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_radio_stats,
-                                                    &hidl_radio_stats)) {
+    if (hidl_stats->radios.size() != legacy_stats.radios.size()) {
+        hidl_stats->radios.resize(legacy_stats.radios.size());
+    }
+    for (size_t i = 0; i < legacy_stats.radios.size(); i++) {
+        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_stats.radios[i],
+                                                    &hidl_stats->radios[i])) {
             return false;
         }
-        hidl_radios_stats.push_back(hidl_radio_stats);
     }
-    hidl_stats->radios = hidl_radios_stats;
     // Timestamp in the HAL wrapper here since it's not provided in the legacy
     // HAL API.
     hidl_stats->timeStampInMs = uptimeMillis();
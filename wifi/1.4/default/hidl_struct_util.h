@@ -91,7 +91,7 @@ bool convertLegacyGscanResultToHidl(
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
         legacy_cached_scan_results,
-    std::vector<StaScanData>* hidl_scan_datas);
+    hidl_vec<StaScanData>* hidl_scan_datas);
 bool convertLegacyLinkLayerStatsToHidl(
     const legacy_hal::LinkLayerStats& legacy_stats,
     V1_3::StaLinkLayerStats* hidl_stats);
@@ -103,12 +103,14 @@ bool convertHidlRoamingConfigToLegacy(
     legacy_hal::wifi_roaming_config* legacy_config);
 legacy_hal::fw_roaming_state_t convertHidlRoamingStateToLegacy(
     StaRoamingState state);
+// The packet fate conversions reuse the frame buffers already held by
+// |hidl_fates| when their sizes match.
 bool convertLegacyVectorOfDebugTxPacketFateToHidl(
     const std::vector<legacy_hal::wifi_tx_report>& legacy_fates,
-    std::vector<WifiDebugTxPacketFateReport>* hidl_fates);
+    hidl_vec<WifiDebugTxPacketFateReport>* hidl_fates);
 bool convertLegacyVectorOfDebugRxPacketFateToHidl(
     const std::vector<legacy_hal::wifi_rx_report>& legacy_fates,
-    std::vector<WifiDebugRxPacketFateReport>* hidl_fates);
+    hidl_vec<WifiDebugRxPacketFateReport>* hidl_fates);
 
 // NAN iface conversion methods.
 void convertToWifiNanStatus(legacy_hal::NanStatusType type, const char* str,
@@ -15,9 +15,29 @@
  */
 
 #include "hidl_sync_util.h"
+#include "wifi_latency_stats.h"
 
 namespace {
+using android::hardware::wifi::V1_4::implementation::latency_stats::Clock;
+
 std::recursive_mutex g_mutex;
+std::recursive_mutex g_sta_iface_mutex;
+std::recursive_mutex g_ap_iface_mutex;
+std::recursive_mutex g_nan_iface_mutex;
+std::recursive_mutex g_rtt_controller_mutex;
+
+std::unique_lock<std::recursive_mutex> acquireAndRecordWait(
+    std::recursive_mutex* mutex, const char* lock_name) {
+    namespace latency_stats =
+        android::hardware::wifi::V1_4::implementation::latency_stats;
+    if (!latency_stats::isEnabled()) {
+        return std::unique_lock<std::recursive_mutex>{*mutex};
+    }
+    const auto start = Clock::now();
+    std::unique_lock<std::recursive_mutex> lock{*mutex};
+    latency_stats::recordLockWait(lock_name, Clock::now() - start);
+    return lock;
+}
 }  // namespace
 
 namespace android {
@@ -28,7 +48,23 @@ namespace implementation {
 namespace hidl_sync_util {
 
 std::unique_lock<std::recursive_mutex> acquireGlobalLock() {
-    return std::unique_lock<std::recursive_mutex>{g_mutex};
+    return acquireAndRecordWait(&g_mutex, "global");
+}
+
+std::unique_lock<std::recursive_mutex> acquireStaIfaceLock() {
+    return acquireAndRecordWait(&g_sta_iface_mutex, "STA iface");
+}
+
+std::unique_lock<std::recursive_mutex> acquireApIfaceLock() {
+    return acquireAndRecordWait(&g_ap_iface_mutex, "AP iface");
+}
+
+std::unique_lock<std::recursive_mutex> acquireNanIfaceLock() {
+    return acquireAndRecordWait(&g_nan_iface_mutex, "NAN iface");
+}
+
+std::unique_lock<std::recursive_mutex> acquireRttControllerLock() {
+    return acquireAndRecordWait(&g_rtt_controller_mutex, "RTT controller");
 }
 
 }  // namespace hidl_sync_util
@@ -27,7 +27,15 @@ namespace wifi {
 namespace V1_4 {
 namespace implementation {
 namespace hidl_sync_util {
+// Guards |Wifi|, |WifiChip|, |WifiP2pIface| and the legacy HAL itself.
 std::unique_lock<std::recursive_mutex> acquireGlobalLock();
+// Each of these guards all objects of one interface type, along with the
+// legacy HAL callbacks delivered to it. See THREADING.README for the order in
+// which they may be acquired.
+std::unique_lock<std::recursive_mutex> acquireStaIfaceLock();
+std::unique_lock<std::recursive_mutex> acquireApIfaceLock();
+std::unique_lock<std::recursive_mutex> acquireNanIfaceLock();
+std::unique_lock<std::recursive_mutex> acquireRttControllerLock();
 }  // namespace hidl_sync_util
 }  // namespace implementation
 }  // namespace V1_4
@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "ringbuffer.h"
@@ -24,7 +28,8 @@ namespace wifi {
 namespace V1_4 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+Ringbuffer::Ringbuffer(size_t maxSize)
+    : head_(0), size_(0), maxSize_(maxSize) {}
 
 void Ringbuffer::append(const std::vector<uint8_t>& input) {
     if (input.size() == 0) {
@@ -35,16 +40,52 @@ void Ringbuffer::append(const std::vector<uint8_t>& input) {
                   << " bytes is dropped";
         return;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+    if (data_.empty()) {
+        data_.resize(maxSize_);
+    }
+    while (size_ + input.size() > maxSize_) {
+        head_ = (head_ + record_sizes_.front()) % maxSize_;
+        size_ -= record_sizes_.front();
+        record_sizes_.pop_front();
+    }
+    // Copy in place, wrapping around the end of the storage if needed.
+    size_t tail = (head_ + size_) % maxSize_;
+    size_t first = std::min(input.size(), maxSize_ - tail);
+    memcpy(&data_[tail], input.data(), first);
+    memcpy(&data_[0], input.data() + first, input.size() - first);
+    size_ += input.size();
+    record_sizes_.push_back(input.size());
+}
+
+bool Ringbuffer::empty() const { return record_sizes_.empty(); }
+
+size_t Ringbuffer::getNumRecords() const { return record_sizes_.size(); }
+
+std::vector<uint8_t> Ringbuffer::getRecord(size_t index) const {
+    size_t offset = head_;
+    for (size_t i = 0; i < index; i++) {
+        offset = (offset + record_sizes_[i]) % maxSize_;
     }
+    std::vector<uint8_t> record(record_sizes_[index]);
+    size_t first = std::min(record.size(), maxSize_ - offset);
+    memcpy(record.data(), &data_[offset], first);
+    memcpy(record.data() + first, &data_[0], record.size() - first);
+    return record;
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+size_t Ringbuffer::getSegments(struct iovec segments[2]) const {
+    if (size_ == 0) {
+        return 0;
+    }
+    size_t first = std::min(size_, maxSize_ - head_);
+    segments[0].iov_base = const_cast<uint8_t*>(&data_[head_]);
+    segments[0].iov_len = first;
+    if (first == size_) {
+        return 1;
+    }
+    segments[1].iov_base = const_cast<uint8_t*>(&data_[0]);
+    segments[1].iov_len = size_ - first;
+    return 2;
 }
 
 }  // namespace implementation
@@ -17,7 +17,9 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
-#include <list>
+#include <sys/uio.h>
+
+#include <deque>
 #include <vector>
 
 namespace android {
@@ -36,12 +38,24 @@ class Ringbuffer {
     // Appends the data buffer and deletes from the front until buffer is
     // within |maxSize_|.
     void append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    bool empty() const;
+    size_t getNumRecords() const;
+    // Returns a copy of the record at |index|, oldest first.
+    std::vector<uint8_t> getRecord(size_t index) const;
+    // Fills |segments| with the buffered bytes, oldest first, without
+    // copying them. Returns the number of segments used, at most 2. They
+    // stay valid until the next call to append().
+    size_t getSegments(struct iovec segments[2]) const;
 
    private:
-    std::list<std::vector<uint8_t>> data_;
+    // Circular storage of |maxSize_| bytes, allocated on first append.
+    std::vector<uint8_t> data_;
+    // Offset of the oldest byte in |data_|.
+    size_t head_;
     size_t size_;
     size_t maxSize_;
+    // Size of each record stored in |data_|, oldest first.
+    std::deque<size_t> record_sizes_;
 };
 
 }  // namespace implementation
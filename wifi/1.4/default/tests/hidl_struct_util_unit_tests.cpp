@@ -267,6 +267,115 @@ TEST_F(HidlStructUtilTest, canConvertLegacyLinkLayerStatsToHidl) {
     }
 }
 
+TEST_F(HidlStructUtilTest, canConvertLegacyLinkLayerStatsIntoReusedHidlStats) {
+    legacy_hal::LinkLayerStats legacy_stats{};
+    legacy_stats.radios.resize(2);
+    for (auto& radio : legacy_stats.radios) {
+        radio.stats.on_time = rand();
+        radio.tx_time_per_levels = {1, 2, 3};
+        radio.channel_stats.resize(2);
+    }
+    V1_3::StaLinkLayerStats converted{};
+    ASSERT_TRUE(hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+        legacy_stats, &converted));
+    ASSERT_EQ(2u, converted.radios.size());
+
+    // Converting again must not leave anything of the previous result behind.
+    legacy_stats.radios.resize(1);
+    legacy_stats.radios[0].stats.on_time = rand();
+    legacy_stats.radios[0].tx_time_per_levels = {4, 5, 6};
+    legacy_stats.radios[0].channel_stats.resize(1);
+    legacy_stats.radios[0].channel_stats[0].on_time = 0x3333;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+        legacy_stats, &converted));
+    ASSERT_EQ(1u, converted.radios.size());
+    EXPECT_EQ(legacy_stats.radios[0].stats.on_time,
+              converted.radios[0].V1_0.onTimeInMs);
+    EXPECT_EQ(legacy_stats.radios[0].tx_time_per_levels,
+              std::vector<uint32_t>(
+                  converted.radios[0].V1_0.txTimeInMsPerLevel.begin(),
+                  converted.radios[0].V1_0.txTimeInMsPerLevel.end()));
+    ASSERT_EQ(1u, converted.radios[0].channelStats.size());
+    EXPECT_EQ(0x3333u, converted.radios[0].channelStats[0].onTimeInMs);
+}
+
+TEST_F(HidlStructUtilTest, CanConvertLegacyTxPacketFatesIntoReusedHidlFates) {
+    std::vector<legacy_hal::wifi_tx_report> legacy_fates(2);
+    for (auto& legacy_fate : legacy_fates) {
+        legacy_fate.fate = legacy_hal::TX_PKT_FATE_ACKED;
+        legacy_fate.frame_inf.payload_type = legacy_hal::FRAME_TYPE_ETHERNET_II;
+        legacy_fate.frame_inf.frame_len = 4;
+        memset(legacy_fate.frame_inf.frame_content.ethernet_ii_bytes, 0x11, 4);
+    }
+    hidl_vec<WifiDebugTxPacketFateReport> converted;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfDebugTxPacketFateToHidl(
+        legacy_fates, &converted));
+    ASSERT_EQ(2u, converted.size());
+
+    legacy_fates.resize(1);
+    legacy_fates[0].fate = legacy_hal::TX_PKT_FATE_SENT;
+    legacy_fates[0].frame_inf.frame_len = 2;
+    legacy_fates[0].frame_inf.frame_content.ethernet_ii_bytes[0] = 0x22;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfDebugTxPacketFateToHidl(
+        legacy_fates, &converted));
+    ASSERT_EQ(1u, converted.size());
+    EXPECT_EQ(WifiDebugTxPacketFate::SENT, converted[0].fate);
+    EXPECT_EQ(2u, converted[0].frameInfo.frameLen);
+    EXPECT_EQ(std::vector<uint8_t>({0x22, 0x11}),
+              std::vector<uint8_t>(converted[0].frameInfo.frameContent));
+}
+
+TEST_F(HidlStructUtilTest, CanConvertLegacyGscanResultWithIesToHidl) {
+    // Two well formed IEs followed by a truncated one.
+    const uint8_t kIes[] = {0x00, 0x03, 'a', 'b', 'c', 0xdd,
+                            0x01, 0x42, 0x30, 0x05, 0x01};
+    std::vector<uint8_t> buffer(sizeof(legacy_hal::wifi_scan_result) +
+                                sizeof(kIes));
+    auto* legacy_result =
+        reinterpret_cast<legacy_hal::wifi_scan_result*>(buffer.data());
+    strcpy(legacy_result->ssid, "ssid");
+    legacy_result->rssi = -50;
+    legacy_result->ie_length = sizeof(kIes);
+    memcpy(legacy_result->ie_data, kIes, sizeof(kIes));
+
+    StaScanResult converted;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_result, true, &converted));
+    EXPECT_EQ(std::vector<uint8_t>({'s', 's', 'i', 'd'}),
+              std::vector<uint8_t>(converted.ssid));
+    EXPECT_EQ(-50, converted.rssi);
+    ASSERT_EQ(2u, converted.informationElements.size());
+    EXPECT_EQ(0x00, converted.informationElements[0].id);
+    EXPECT_EQ(std::vector<uint8_t>({'a', 'b', 'c'}),
+              std::vector<uint8_t>(converted.informationElements[0].data));
+    EXPECT_EQ(0xdd, converted.informationElements[1].id);
+    EXPECT_EQ(std::vector<uint8_t>({0x42}),
+              std::vector<uint8_t>(converted.informationElements[1].data));
+}
+
+TEST_F(HidlStructUtilTest, CanConvertLegacyCachedGscanResultsToHidl) {
+    std::vector<legacy_hal::wifi_cached_scan_results> legacy_results(2);
+    legacy_results[0].flags = legacy_hal::WIFI_SCAN_FLAG_INTERRUPTED;
+    legacy_results[0].buckets_scanned = 0x3;
+    legacy_results[0].num_results = 2;
+    legacy_results[0].results[0].rssi = -40;
+    legacy_results[0].results[1].rssi = -60;
+    legacy_results[1].num_results = 0;
+
+    hidl_vec<StaScanData> converted;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfCachedGscanResultsToHidl(
+        legacy_results, &converted));
+    ASSERT_EQ(2u, converted.size());
+    EXPECT_EQ(static_cast<uint32_t>(StaScanDataFlagMask::INTERRUPTED),
+              converted[0].flags);
+    EXPECT_EQ(0x3u, converted[0].bucketsScanned);
+    ASSERT_EQ(2u, converted[0].results.size());
+    EXPECT_EQ(-40, converted[0].results[0].rssi);
+    EXPECT_EQ(-60, converted[0].results[1].rssi);
+    EXPECT_EQ(0u, converted[0].results[0].informationElements.size());
+    EXPECT_EQ(0u, converted[1].results.size());
+}
+
 TEST_F(HidlStructUtilTest, CanConvertLegacyFeaturesToHidl) {
     using HidlChipCaps = V1_3::IWifiChip::ChipCapabilityMask;
 
@@ -34,7 +34,7 @@ class RingbufferTest : public Test {
 };
 
 TEST_F(RingbufferTest, CreateEmptyBuffer) {
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
 }
 
 TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
@@ -42,9 +42,9 @@ TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
     const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
     buffer_.append(input);
     buffer_.append(input2);
-    ASSERT_EQ(2u, buffer_.getData().size());
-    EXPECT_EQ(input, buffer_.getData().front());
-    EXPECT_EQ(input2, buffer_.getData().back());
+    ASSERT_EQ(2u, buffer_.getNumRecords());
+    EXPECT_EQ(input, buffer_.getRecord(0));
+    EXPECT_EQ(input2, buffer_.getRecord(1));
 }
 
 TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
@@ -54,9 +54,9 @@ TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
     buffer_.append(input);
     buffer_.append(input2);
     buffer_.append(input3);
-    ASSERT_EQ(2u, buffer_.getData().size());
-    EXPECT_EQ(input2, buffer_.getData().front());
-    EXPECT_EQ(input3, buffer_.getData().back());
+    ASSERT_EQ(2u, buffer_.getNumRecords());
+    EXPECT_EQ(input2, buffer_.getRecord(0));
+    EXPECT_EQ(input3, buffer_.getRecord(1));
 }
 
 TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
@@ -66,20 +66,20 @@ TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
     buffer_.append(input);
     buffer_.append(input2);
     buffer_.append(input3);
-    ASSERT_EQ(1u, buffer_.getData().size());
-    EXPECT_EQ(input3, buffer_.getData().front());
+    ASSERT_EQ(1u, buffer_.getNumRecords());
+    EXPECT_EQ(input3, buffer_.getRecord(0));
 }
 
 TEST_F(RingbufferTest, AppendingEmptyBufferDoesNotAddGarbage) {
     const std::vector<uint8_t> input = {};
     buffer_.append(input);
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
 }
 
 TEST_F(RingbufferTest, OversizedAppendIsDropped) {
     const std::vector<uint8_t> input(maxBufferSize_ + 1, '0');
     buffer_.append(input);
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
 }
 
 TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
@@ -87,8 +87,32 @@ TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
     const std::vector<uint8_t> input2(maxBufferSize_ + 1, '1');
     buffer_.append(input);
     buffer_.append(input2);
-    ASSERT_EQ(1u, buffer_.getData().size());
-    EXPECT_EQ(input, buffer_.getData().front());
+    ASSERT_EQ(1u, buffer_.getNumRecords());
+    EXPECT_EQ(input, buffer_.getRecord(0));
+}
+
+TEST_F(RingbufferTest, RecordWrapsAroundStorage) {
+    const std::vector<uint8_t> input(maxBufferSize_ / 2 + 1, '0');
+    const std::vector<uint8_t> input2(maxBufferSize_ / 2 - 1, '1');
+    const std::vector<uint8_t> input3 = {'2', '3', '4'};
+    buffer_.append(input);
+    buffer_.append(input2);
+    buffer_.append(input3);
+    ASSERT_EQ(2u, buffer_.getNumRecords());
+    EXPECT_EQ(input2, buffer_.getRecord(0));
+    EXPECT_EQ(input3, buffer_.getRecord(1));
+
+    struct iovec segments[2];
+    ASSERT_EQ(2u, buffer_.getSegments(segments));
+    std::vector<uint8_t> contents(
+        static_cast<uint8_t*>(segments[0].iov_base),
+        static_cast<uint8_t*>(segments[0].iov_base) + segments[0].iov_len);
+    contents.insert(
+        contents.end(), static_cast<uint8_t*>(segments[1].iov_base),
+        static_cast<uint8_t*>(segments[1].iov_base) + segments[1].iov_len);
+    std::vector<uint8_t> expected = input2;
+    expected.insert(expected.end(), input3.begin(), input3.end());
+    EXPECT_EQ(expected, contents);
 }
 }  // namespace implementation
 }  // namespace V1_4
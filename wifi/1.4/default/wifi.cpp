@@ -14,15 +14,21 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 
 #include "hidl_return_util.h"
 #include "wifi.h"
+#include "wifi_latency_stats.h"
 #include "wifi_status_util.h"
 
 namespace {
 // Chip ID to use for the only supported chip.
 static constexpr android::hardware::wifi::V1_0::ChipId kChipId = 0;
+// Option of |debug| dumping the latency stats instead of the default dump.
+static constexpr char kLatencyStatsDebugOption[] = "--latency";
+static constexpr char kLatencyStatsEnableOption[] = "enable";
+static constexpr char kLatencyStatsDisableOption[] = "disable";
 }  // namespace
 
 namespace android {
@@ -51,6 +57,10 @@ bool Wifi::isValid() {
     return true;
 }
 
+std::unique_lock<std::recursive_mutex> Wifi::acquireLock() {
+    return hidl_sync_util::acquireGlobalLock();
+}
+
 Return<void> Wifi::registerEventCallback(
     const sp<IWifiEventCallback>& event_callback,
     registerEventCallback_cb hidl_status_cb) {
@@ -82,8 +92,25 @@ Return<void> Wifi::getChip(ChipId chip_id, getChip_cb hidl_status_cb) {
 }
 
 Return<void> Wifi::debug(const hidl_handle& handle,
-                         const hidl_vec<hidl_string>&) {
+                         const hidl_vec<hidl_string>& options) {
     LOG(INFO) << "-----------Debug is called----------------";
+    // The default dump is a cpio archive, so the latency stats are only
+    // written on their own when requested.
+    if (options.size() == 2 && options[0] == kLatencyStatsDebugOption &&
+        (options[1] == kLatencyStatsEnableOption ||
+         options[1] == kLatencyStatsDisableOption)) {
+        latency_stats::setEnabled(options[1] == kLatencyStatsEnableOption);
+        return Void();
+    }
+    if (options.size() == 1 && options[0] == kLatencyStatsDebugOption) {
+        if (handle != nullptr && handle->numFds >= 1) {
+            const std::string stats = latency_stats::dump();
+            if (!android::base::WriteStringToFd(stats, handle->data[0])) {
+                LOG(ERROR) << "Failed to write latency stats";
+            }
+        }
+        return Void();
+    }
     if (!chip_.get()) {
         return Void();
     }
@@ -48,6 +48,8 @@ class Wifi : public V1_4::IWifi {
          const std::shared_ptr<feature_flags::WifiFeatureFlags> feature_flags);
 
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
 
     // HIDL methods exposed.
     Return<void> registerEventCallback(
@@ -38,12 +38,17 @@ WifiApIface::WifiApIface(
       is_valid_(true) {}
 
 void WifiApIface::invalidate() {
+    const auto lock = acquireLock();
     legacy_hal_.reset();
     is_valid_ = false;
 }
 
 bool WifiApIface::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiApIface::acquireLock() {
+    return hidl_sync_util::acquireApIfaceLock();
+}
+
 std::string WifiApIface::getName() { return ifname_; }
 
 Return<void> WifiApIface::getName(getName_cb hidl_status_cb) {
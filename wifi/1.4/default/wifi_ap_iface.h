@@ -41,6 +41,8 @@ class WifiApIface : public V1_4::IWifiApIface {
     // Refer to |WifiChip::invalidate()|.
     void invalidate();
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::string getName();
 
     // HIDL methods exposed.
@@ -16,6 +16,12 @@
 
 #include <fcntl.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <thread>
+
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <cutils/properties.h>
@@ -36,6 +42,7 @@ using android::hardware::hidl_vec;
 using android::hardware::wifi::V1_0::ChipModeId;
 using android::hardware::wifi::V1_0::IfaceType;
 using android::hardware::wifi::V1_0::IWifiChip;
+using android::hardware::wifi::V1_4::implementation::Ringbuffer;
 
 constexpr char kCpioMagic[] = "070701";
 constexpr size_t kMaxBufferSizeBytes = 1024 * 1024 * 3;
@@ -44,8 +51,40 @@ constexpr uint32_t kMaxRingBufferFileNum = 20;
 constexpr char kTombstoneFolderPath[] = "/data/vendor/tombstones/wifi/";
 constexpr char kActiveWlanIfaceNameProperty[] = "wifi.active.interface";
 constexpr char kNoActiveWlanIfaceNamePropertyValue[] = "";
+constexpr char kFirmwareVersionProperty[] = "vendor.wlan.firmware.version";
+constexpr char kDriverVersionProperty[] = "vendor.wlan.driver.version";
 constexpr unsigned kMaxWlanIfaces = 5;
 
+// Records the duration of each step of a chip mode switch, so that the
+// latency of the switch can be tracked from the logs.
+class ModeSwitchTimer {
+   public:
+    ModeSwitchTimer()
+        : start_(std::chrono::steady_clock::now()), step_start_(start_) {}
+
+    void endStep(const char* step) {
+        const auto now = std::chrono::steady_clock::now();
+        steps_ += std::string(steps_.empty() ? "" : ", ") + step + ": " +
+                  std::to_string(toMs(now - step_start_)) + " ms";
+        step_start_ = now;
+    }
+
+    std::string toString() const {
+        return std::to_string(toMs(step_start_ - start_)) + " ms (" + steps_ +
+               ")";
+    }
+
+   private:
+    static int64_t toMs(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+            .count();
+    }
+
+    const std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point step_start_;
+    std::string steps_;
+};
+
 template <typename Iface>
 void invalidateAndClear(std::vector<sp<Iface>>& ifaces, sp<Iface> iface) {
     iface->invalidate();
@@ -322,6 +361,88 @@ std::vector<char> makeCharVec(const std::string& str) {
     return vec;
 }
 
+// Writes each ring of |snapshot| to a new file in the tombstone dir.
+bool writeRingbufferFiles(
+    const std::vector<std::pair<std::string, Ringbuffer>>& snapshot) {
+    if (!removeOldFilesInternal()) {
+        LOG(ERROR) << "Error occurred while deleting old tombstone files";
+        return false;
+    }
+    for (const auto& item : snapshot) {
+        const Ringbuffer& cur_buffer = item.second;
+        struct iovec segments[2];
+        const size_t num_segments = cur_buffer.getSegments(segments);
+        if (num_segments == 0) {
+            continue;
+        }
+        const std::string file_path_raw =
+            kTombstoneFolderPath + item.first + "XXXXXXXXXX";
+        const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
+        if (dump_fd == -1) {
+            PLOG(ERROR) << "create file failed";
+            return false;
+        }
+        unique_fd file_auto_closer(dump_fd);
+        if (TEMP_FAILURE_RETRY(writev(dump_fd, segments, num_segments)) ==
+            -1) {
+            PLOG(ERROR) << "Error writing to file";
+        }
+    }
+    return true;
+}
+
+// Runs the tombstone file I/O in submission order on a thread of its own, so
+// that neither the HIDL thread nor the legacy HAL event loop (which appends
+// to the rings) waits on flash.
+class RingbufferFileWorker {
+   public:
+    static RingbufferFileWorker& get() {
+        // Leaked, so that a flush posted during shutdown never finds the
+        // worker destroyed under it.
+        static RingbufferFileWorker* worker = new RingbufferFileWorker();
+        return *worker;
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lk(lock_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+   private:
+    RingbufferFileWorker() {
+        std::thread(&RingbufferFileWorker::run, this).detach();
+    }
+
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lk(lock_);
+                cv_.wait(lk, [this] { return !tasks_.empty(); });
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+};
+
+void postRingbufferFilesWrite(
+    std::vector<std::pair<std::string, Ringbuffer>> snapshot) {
+    RingbufferFileWorker::get().post([snapshot = std::move(snapshot)]() {
+        if (!writeRingbufferFiles(snapshot)) {
+            LOG(ERROR) << "Error writing files to flash";
+        }
+    });
+}
+
 }  // namespace
 
 namespace android {
@@ -349,9 +470,10 @@ WifiChip::WifiChip(
 }
 
 void WifiChip::invalidate() {
-    if (!writeRingbufferFilesInternal()) {
-        LOG(ERROR) << "Error writing files to flash";
-    }
+    postRingbufferFilesWrite(snapshotRingbuffers());
+    // The legacy HAL is about to stop, the firmware may differ once started.
+    chip_debug_info_.reset();
+    chip_capabilities_.reset();
     invalidateAndRemoveAllIfaces();
     setActiveWlanIfaceNameProperty(kNoActiveWlanIfaceNamePropertyValue);
     legacy_hal_.reset();
@@ -361,6 +483,10 @@ void WifiChip::invalidate() {
 
 bool WifiChip::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiChip::acquireLock() {
+    return hidl_sync_util::acquireGlobalLock();
+}
+
 std::set<sp<IWifiChipEventCallback>> WifiChip::getEventCallbacks() {
     return event_cb_handler_.getCallbacks();
 }
@@ -635,14 +761,22 @@ Return<void> WifiChip::debug(const hidl_handle& handle,
         usleep(100 * 1000);  // sleep for 100 milliseconds to wait for
                              // ringbuffer updates.
         int fd = handle->data[0];
-        if (!writeRingbufferFilesInternal()) {
-            LOG(ERROR) << "Error writing files to flash";
-        }
-        uint32_t n_error = cpioArchiveFilesInDir(fd, kTombstoneFolderPath);
-        if (n_error != 0) {
-            LOG(ERROR) << n_error << " errors occured in cpio function";
-        }
-        fsync(fd);
+        const auto snapshot = snapshotRingbuffers();
+        // |fd| is only valid for the duration of this call, so wait for the
+        // worker. Queuing behind it also gets any earlier flush archived.
+        std::promise<void> archived;
+        RingbufferFileWorker::get().post([&snapshot, &archived, fd]() {
+            if (!writeRingbufferFiles(snapshot)) {
+                LOG(ERROR) << "Error writing files to flash";
+            }
+            uint32_t n_error = cpioArchiveFilesInDir(fd, kTombstoneFolderPath);
+            if (n_error != 0) {
+                LOG(ERROR) << n_error << " errors occured in cpio function";
+            }
+            fsync(fd);
+            archived.set_value();
+        });
+        archived.get_future().wait();
     } else {
         LOG(ERROR) << "File handle error";
     }
@@ -789,6 +923,9 @@ std::pair<WifiStatus, uint32_t> WifiChip::getModeInternal() {
 
 std::pair<WifiStatus, IWifiChip::ChipDebugInfo>
 WifiChip::requestChipDebugInfoInternal() {
+    if (chip_debug_info_) {
+        return {createWifiStatus(WifiStatusCode::SUCCESS), *chip_debug_info_};
+    }
     IWifiChip::ChipDebugInfo result;
     legacy_hal::wifi_error legacy_status;
     std::string driver_desc;
@@ -816,6 +953,7 @@ WifiChip::requestChipDebugInfoInternal() {
     }
     result.firmwareDescription = firmware_desc.c_str();
 
+    chip_debug_info_ = std::make_unique<IWifiChip::ChipDebugInfo>(result);
     return {createWifiStatus(WifiStatusCode::SUCCESS), result};
 }
 
@@ -1168,10 +1306,9 @@ WifiStatus WifiChip::forceDumpToDebugRingBufferInternal(
 }
 
 WifiStatus WifiChip::flushRingBufferToFileInternal() {
-    if (!writeRingbufferFilesInternal()) {
-        LOG(ERROR) << "Error writing files to flash";
-        return createWifiStatus(WifiStatusCode::ERROR_UNKNOWN);
-    }
+    // Errors writing the files are only logged, since the write completes
+    // after this returns.
+    postRingbufferFilesWrite(snapshotRingbuffers());
     return createWifiStatus(WifiStatusCode::SUCCESS);
 }
 
@@ -1266,6 +1403,9 @@ WifiStatus WifiChip::selectTxPowerScenarioInternal_1_2(
 }
 
 std::pair<WifiStatus, uint32_t> WifiChip::getCapabilitiesInternal_1_3() {
+    if (chip_capabilities_) {
+        return {createWifiStatus(WifiStatusCode::SUCCESS), *chip_capabilities_};
+    }
     legacy_hal::wifi_error legacy_status;
     uint32_t legacy_feature_set;
     uint32_t legacy_logger_feature_set;
@@ -1286,6 +1426,7 @@ std::pair<WifiStatus, uint32_t> WifiChip::getCapabilitiesInternal_1_3() {
             legacy_feature_set, legacy_logger_feature_set, &hidl_caps)) {
         return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), 0};
     }
+    chip_capabilities_ = std::make_unique<uint32_t>(hidl_caps);
     return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_caps};
 }
 
@@ -1315,12 +1456,17 @@ WifiStatus WifiChip::registerEventCallbackInternal_1_4(
 WifiStatus WifiChip::handleChipConfiguration(
     /* NONNULL */ std::unique_lock<std::recursive_mutex>* lock,
     ChipModeId mode_id) {
+    ModeSwitchTimer timer;
+    // The firmware may change, so query the chip information again.
+    chip_debug_info_.reset();
+    chip_capabilities_.reset();
     // If the chip is already configured in a different mode, stop
     // the legacy HAL and then start it after firmware mode change.
     if (isValidModeId(current_mode_id_)) {
         LOG(INFO) << "Reconfiguring chip from mode " << current_mode_id_
                   << " to mode " << mode_id;
         invalidateAndRemoveAllIfaces();
+        timer.endStep("remove ifaces");
         legacy_hal::wifi_error legacy_status =
             legacy_hal_.lock()->stop(lock, []() {});
         if (legacy_status != legacy_hal::WIFI_SUCCESS) {
@@ -1328,6 +1474,7 @@ WifiStatus WifiChip::handleChipConfiguration(
                        << legacyErrorToString(legacy_status);
             return createWifiStatusFromLegacyError(legacy_status);
         }
+        timer.endStep("stop legacy HAL");
     }
     // Firmware mode change not needed for V2 devices.
     bool success = true;
@@ -1339,12 +1486,14 @@ WifiStatus WifiChip::handleChipConfiguration(
     if (!success) {
         return createWifiStatus(WifiStatusCode::ERROR_UNKNOWN);
     }
+    timer.endStep("firmware mode change");
     legacy_hal::wifi_error legacy_status = legacy_hal_.lock()->start();
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
         LOG(ERROR) << "Failed to start legacy HAL: "
                    << legacyErrorToString(legacy_status);
         return createWifiStatusFromLegacyError(legacy_status);
     }
+    timer.endStep("start legacy HAL");
     // Every time the HAL is restarted, we need to register the
     // radio mode change callback.
     WifiStatus status = registerRadioModeChangeCallback();
@@ -1356,11 +1505,14 @@ WifiStatus WifiChip::handleChipConfiguration(
     std::pair<WifiStatus, IWifiChip::ChipDebugInfo> version_info;
     version_info = WifiChip::requestChipDebugInfoInternal();
     if (WifiStatusCode::SUCCESS == version_info.first.code) {
-        property_set("vendor.wlan.firmware.version",
+        property_set(kFirmwareVersionProperty,
                      version_info.second.firmwareDescription.c_str());
-        property_set("vendor.wlan.driver.version",
+        property_set(kDriverVersionProperty,
                      version_info.second.driverDescription.c_str());
     }
+    timer.endStep("post start setup");
+    LOG(INFO) << "Chip mode switch to mode " << mode_id << " took "
+              << timer.toString();
 
     return createWifiStatus(WifiStatusCode::SUCCESS);
 }
@@ -1662,37 +1814,19 @@ std::string WifiChip::allocateStaIfaceName() {
     return allocateApOrStaIfaceName(0);
 }
 
-bool WifiChip::writeRingbufferFilesInternal() {
-    if (!removeOldFilesInternal()) {
-        LOG(ERROR) << "Error occurred while deleting old tombstone files";
-        return false;
-    }
-    // write ringbuffers to file
-    {
-        std::unique_lock<std::mutex> lk(lock_t);
-        for (const auto& item : ringbuffer_map_) {
-            const Ringbuffer& cur_buffer = item.second;
-            if (cur_buffer.getData().empty()) {
-                continue;
-            }
-            const std::string file_path_raw =
-                kTombstoneFolderPath + item.first + "XXXXXXXXXX";
-            const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
-            if (dump_fd == -1) {
-                PLOG(ERROR) << "create file failed";
-                return false;
-            }
-            unique_fd file_auto_closer(dump_fd);
-            for (const auto& cur_block : cur_buffer.getData()) {
-                if (write(dump_fd, cur_block.data(),
-                          sizeof(cur_block[0]) * cur_block.size()) == -1) {
-                    PLOG(ERROR) << "Error writing to file";
-                }
-            }
+std::vector<std::pair<std::string, Ringbuffer>>
+WifiChip::snapshotRingbuffers() {
+    std::vector<std::pair<std::string, Ringbuffer>> snapshot;
+    std::unique_lock<std::mutex> lk(lock_t);
+    for (auto& item : ringbuffer_map_) {
+        if (item.second.empty()) {
+            continue;
         }
-        // unique_lock unlocked here
+        // Copied rather than taken, so that the rings keep their history
+        // for the next bug report.
+        snapshot.emplace_back(item.first, item.second);
     }
-    return true;
+    return snapshot;
 }
 
 }  // namespace implementation
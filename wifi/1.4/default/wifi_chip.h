@@ -72,6 +72,9 @@ class WifiChip : public V1_4::IWifiChip {
     // marked valid before processing them.
     void invalidate();
     bool isValid();
+    // Lock held while processing HIDL methods and legacy HAL callbacks on
+    // this object, see THREADING.README.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::set<sp<IWifiChipEventCallback>> getEventCallbacks();
 
     // HIDL methods exposed.
@@ -257,7 +260,10 @@ class WifiChip : public V1_4::IWifiChip {
     std::string allocateApOrStaIfaceName(uint32_t start_idx);
     std::string allocateApIfaceName();
     std::string allocateStaIfaceName();
-    bool writeRingbufferFilesInternal();
+    // Copies the contents of all the rings out while holding |lock_t|, so
+    // that they can be written to files without blocking ring buffer
+    // callbacks. The rings keep their contents.
+    std::vector<std::pair<std::string, Ringbuffer>> snapshotRingbuffers();
     void QcRemoveAndClearDynamicIfaces();
 
     ChipId chip_id_;
@@ -275,6 +281,9 @@ class WifiChip : public V1_4::IWifiChip {
     uint32_t current_mode_id_;
     std::mutex lock_t;
     std::vector<IWifiChip::ChipMode> modes_;
+    // Chip information which does not change until the chip is reconfigured.
+    std::unique_ptr<IWifiChip::ChipDebugInfo> chip_debug_info_;
+    std::unique_ptr<uint32_t> chip_capabilities_;
     // The legacy ring buffer callback API has only a global callback
     // registration mechanism. Use this to check if we have already
     // registered a callback.
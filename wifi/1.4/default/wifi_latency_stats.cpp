@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include <halmetrics/Metrics.h>
+
+#include "wifi_latency_stats.h"
+
+namespace {
+using android::hardware::wifi::V1_4::implementation::latency_stats::Clock;
+
+using android::hardware::metrics::Histogram;
+
+void record(Histogram* histogram, Clock::duration duration) {
+    histogram->record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+std::string toString(const Histogram& histogram) {
+    const uint64_t count = histogram.count();
+    if (count == 0) {
+        return "none";
+    }
+    return "avg " + std::to_string(histogram.sum() / count / 1000) +
+           "us, p50 " + std::to_string(histogram.percentile(50) / 1000) +
+           "us, p99 " + std::to_string(histogram.percentile(99) / 1000) +
+           "us, max " + std::to_string(histogram.max() / 1000) + "us";
+}
+
+struct HidlMethodStats {
+    Histogram lock_wait;
+    Histogram work;
+    Histogram callback;
+};
+
+// Turns a |typeTag| string, e.g. "const char *typeTag() [T =
+// android::hardware::wifi::V1_4::implementation::WifiChip]", into "WifiChip".
+std::string typeNameFromTag(const std::string& tag) {
+    size_t begin = tag.find("T = ");
+    if (begin == std::string::npos) {
+        return tag;
+    }
+    begin += 4;
+    const size_t end = tag.find_first_of(";]", begin);
+    const std::string name = tag.substr(begin, end - begin);
+    const size_t last_scope = name.rfind("::");
+    return last_scope == std::string::npos ? name
+                                           : name.substr(last_scope + 2);
+}
+
+std::atomic<bool> g_enabled{false};
+
+// The keys are string literals (or |typeTag| strings), so they are compared
+// by address. The mutex only guards the maps, the histograms are recorded
+// without it.
+std::mutex g_stats_mutex;
+std::map<std::pair<const char*, const char*>, HidlMethodStats>
+    g_hidl_method_stats;
+std::map<const char*, Histogram> g_legacy_callback_stats;
+std::map<const char*, Histogram> g_lock_wait_stats;
+}  // namespace
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace latency_stats {
+
+bool isEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+void setEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void recordLockWait(const char* lock_name, Clock::duration wait) {
+    if (!isEnabled()) {
+        return;
+    }
+    Histogram* histogram;
+    {
+        std::lock_guard<std::mutex> lock(g_stats_mutex);
+        histogram = &g_lock_wait_stats[lock_name];
+    }
+    record(histogram, wait);
+}
+
+void recordHidlMethod(const char* type_tag, const char* method,
+                      Clock::duration lock_wait, Clock::duration work,
+                      Clock::duration callback) {
+    if (!isEnabled()) {
+        return;
+    }
+    HidlMethodStats* stats;
+    {
+        std::lock_guard<std::mutex> lock(g_stats_mutex);
+        stats = &g_hidl_method_stats[{type_tag, method}];
+    }
+    record(&stats->lock_wait, lock_wait);
+    record(&stats->work, work);
+    record(&stats->callback, callback);
+}
+
+void recordLegacyCallback(const char* callback, Clock::duration duration) {
+    if (!isEnabled()) {
+        return;
+    }
+    Histogram* histogram;
+    {
+        std::lock_guard<std::mutex> lock(g_stats_mutex);
+        histogram = &g_legacy_callback_stats[callback];
+    }
+    record(histogram, duration);
+}
+
+std::string dump() {
+    std::lock_guard<std::mutex> lock(g_stats_mutex);
+    // Sort by name, since the maps are ordered by address.
+    std::map<std::string, const HidlMethodStats*> hidl_methods;
+    for (const auto& item : g_hidl_method_stats) {
+        hidl_methods[typeNameFromTag(item.first.first) +
+                     "::" + item.first.second] = &item.second;
+    }
+    std::string result = std::string("Recording ") +
+                         (isEnabled() ? "enabled" : "disabled") + "\n";
+    result += "HIDL methods:\n";
+    for (const auto& item : hidl_methods) {
+        result += "  " + item.first + ": " +
+                  std::to_string(item.second->work.count()) + " calls\n";
+        result += "    lock wait: " + toString(item.second->lock_wait) + "\n";
+        result += "    work: " + toString(item.second->work) + "\n";
+        result += "    callback: " + toString(item.second->callback) + "\n";
+    }
+    std::map<std::string, const Histogram*> legacy_callbacks;
+    for (const auto& item : g_legacy_callback_stats) {
+        legacy_callbacks[item.first] = &item.second;
+    }
+    result += "Legacy HAL callbacks:\n";
+    for (const auto& item : legacy_callbacks) {
+        result += "  " + item.first + ": " +
+                  std::to_string(item.second->count()) + " calls, " +
+                  toString(*item.second) + "\n";
+    }
+    result += "Lock waits:\n";
+    for (const auto& item : g_lock_wait_stats) {
+        result += "  " + std::string(item.first) + ": " +
+                  std::to_string(item.second.count()) + " acquisitions, " +
+                  toString(item.second) + "\n";
+    }
+    return result;
+}
+
+}  // namespace latency_stats
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WIFI_LATENCY_STATS_H_
+#define WIFI_LATENCY_STATS_H_
+
+#include <chrono>
+#include <string>
+
+// Latency histograms of the HIDL methods, the legacy HAL callbacks and the
+// locks synchronizing them, to correlate latency regressions with HAL
+// overhead. Recording is off by default, since it serializes the otherwise
+// independent per-interface locks on the stats; it is toggled with
+// "lshal debug <IWifi instance> --latency enable|disable" and the stats are
+// dumped with "lshal debug <IWifi instance> --latency".
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace latency_stats {
+using Clock = std::chrono::steady_clock;
+
+// Whether the record functions below keep the samples. Callers should check
+// this before reading the clock, the record functions drop the samples
+// otherwise.
+bool isEnabled();
+void setEnabled(bool enabled);
+
+// Time spent waiting for the lock named |lock_name|, by any thread.
+void recordLockWait(const char* lock_name, Clock::duration wait);
+// Phases of a HIDL method call on an object of type |type_tag| (see
+// |typeTag|): waiting for the object's lock, running the internal method
+// (legacy HAL call and struct conversion) and invoking the HIDL callback.
+void recordHidlMethod(const char* type_tag, const char* method,
+                      Clock::duration lock_wait, Clock::duration work,
+                      Clock::duration callback);
+// Time spent in a legacy HAL callback on the event loop thread, including the
+// struct conversion and the HIDL callbacks to the framework.
+void recordLegacyCallback(const char* callback, Clock::duration duration);
+
+std::string dump();
+
+// Returns a string identifying |T| which |dump| can turn back into the type's
+// name, without relying on RTTI.
+template <typename T>
+const char* typeTag() {
+    return __PRETTY_FUNCTION__;
+}
+}  // namespace latency_stats
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+#endif  // WIFI_LATENCY_STATS_H_
@@ -16,12 +16,19 @@
 
 #include <array>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <android-base/logging.h>
+#include <android-base/macros.h>
 #include <cutils/properties.h>
 #include <net/if.h>
 
 #include "hidl_sync_util.h"
+#include "wifi_latency_stats.h"
 #include "wifi_legacy_hal.h"
 #include "wifi_legacy_hal_stubs.h"
 
@@ -54,12 +61,61 @@ namespace wifi {
 namespace V1_4 {
 namespace implementation {
 namespace legacy_hal {
+// Holds one of the std::function callback variables below. These are set and
+// reset from the HIDL thread while the event loop thread invokes them, and the
+// two sides do not necessarily hold the same lock (see THREADING.README). So
+// the callback is swapped atomically instead of being assigned in place.
+template <typename Signature>
+class AtomicCallback;
+
+template <typename... Args>
+class AtomicCallback<void(Args...)> {
+   public:
+    AtomicCallback() = default;
+
+    AtomicCallback& operator=(const std::function<void(Args...)>& callback) {
+        std::atomic_store(
+            &callback_,
+            callback ? std::make_shared<const std::function<void(Args...)>>(
+                           callback)
+                     : nullptr);
+        return *this;
+    }
+
+    explicit operator bool() const {
+        return std::atomic_load(&callback_) != nullptr;
+    }
+
+    // Invokes the callback currently set, if any. |caller| names the "C"
+    // callback in the latency stats.
+    void operator()(Args... args,
+                    const char* caller = __builtin_FUNCTION()) const {
+        const auto callback = std::atomic_load(&callback_);
+        if (!callback) {
+            return;
+        }
+        if (!latency_stats::isEnabled()) {
+            (*callback)(args...);
+            return;
+        }
+        const auto start = latency_stats::Clock::now();
+        (*callback)(args...);
+        latency_stats::recordLegacyCallback(
+            caller, latency_stats::Clock::now() - start);
+    }
+
+   private:
+    std::shared_ptr<const std::function<void(Args...)>> callback_;
+
+    DISALLOW_COPY_AND_ASSIGN(AtomicCallback);
+};
+
 // Legacy HAL functions accept "C" style function pointers, so use global
 // functions to pass to the legacy HAL function and store the corresponding
 // std::function methods to be invoked.
 //
 // Callback to be invoked once |stop| is complete
-std::function<void(wifi_handle handle)> on_stop_complete_internal_callback;
+AtomicCallback<void(wifi_handle handle)> on_stop_complete_internal_callback;
 void onAsyncStopComplete(wifi_handle handle) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
     if (on_stop_complete_internal_callback) {
@@ -70,7 +126,7 @@ void onAsyncStopComplete(wifi_handle handle) {
 }
 
 // Callback to be invoked for driver dump.
-std::function<void(char*, int)> on_driver_memory_dump_internal_callback;
+AtomicCallback<void(char*, int)> on_driver_memory_dump_internal_callback;
 void onSyncDriverMemoryDump(char* buffer, int buffer_size) {
     if (on_driver_memory_dump_internal_callback) {
         on_driver_memory_dump_internal_callback(buffer, buffer_size);
@@ -78,7 +134,7 @@ void onSyncDriverMemoryDump(char* buffer, int buffer_size) {
 }
 
 // Callback to be invoked for firmware dump.
-std::function<void(char*, int)> on_firmware_memory_dump_internal_callback;
+AtomicCallback<void(char*, int)> on_firmware_memory_dump_internal_callback;
 void onSyncFirmwareMemoryDump(char* buffer, int buffer_size) {
     if (on_firmware_memory_dump_internal_callback) {
         on_firmware_memory_dump_internal_callback(buffer, buffer_size);
@@ -86,28 +142,28 @@ void onSyncFirmwareMemoryDump(char* buffer, int buffer_size) {
 }
 
 // Callback to be invoked for Gscan events.
-std::function<void(wifi_request_id, wifi_scan_event)>
+AtomicCallback<void(wifi_request_id, wifi_scan_event)>
     on_gscan_event_internal_callback;
 void onAsyncGscanEvent(wifi_request_id id, wifi_scan_event event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    const auto lock = hidl_sync_util::acquireStaIfaceLock();
     if (on_gscan_event_internal_callback) {
         on_gscan_event_internal_callback(id, event);
     }
 }
 
 // Callback to be invoked for Gscan full results.
-std::function<void(wifi_request_id, wifi_scan_result*, uint32_t)>
+AtomicCallback<void(wifi_request_id, wifi_scan_result*, uint32_t)>
     on_gscan_full_result_internal_callback;
 void onAsyncGscanFullResult(wifi_request_id id, wifi_scan_result* result,
                             uint32_t buckets_scanned) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    const auto lock = hidl_sync_util::acquireStaIfaceLock();
     if (on_gscan_full_result_internal_callback) {
         on_gscan_full_result_internal_callback(id, result, buckets_scanned);
     }
 }
 
 // Callback to be invoked for link layer stats results.
-std::function<void((wifi_request_id, wifi_iface_stat*, int, wifi_radio_stat*))>
+AtomicCallback<void((wifi_request_id, wifi_iface_stat*, int, wifi_radio_stat*))>
     on_link_layer_stats_result_internal_callback;
 void onSyncLinkLayerStatsResult(wifi_request_id id, wifi_iface_stat* iface_stat,
                                 int num_radios, wifi_radio_stat* radio_stat) {
@@ -118,18 +174,18 @@ void onSyncLinkLayerStatsResult(wifi_request_id id, wifi_iface_stat* iface_stat,
 }
 
 // Callback to be invoked for rssi threshold breach.
-std::function<void((wifi_request_id, uint8_t*, int8_t))>
+AtomicCallback<void((wifi_request_id, uint8_t*, int8_t))>
     on_rssi_threshold_breached_internal_callback;
 void onAsyncRssiThresholdBreached(wifi_request_id id, uint8_t* bssid,
                                   int8_t rssi) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    const auto lock = hidl_sync_util::acquireStaIfaceLock();
     if (on_rssi_threshold_breached_internal_callback) {
         on_rssi_threshold_breached_internal_callback(id, bssid, rssi);
     }
 }
 
 // Callback to be invoked for ring buffer data indication.
-std::function<void(char*, char*, int, wifi_ring_buffer_status*)>
+AtomicCallback<void(char*, char*, int, wifi_ring_buffer_status*)>
     on_ring_buffer_data_internal_callback;
 void onAsyncRingBufferData(char* ring_name, char* buffer, int buffer_size,
                            wifi_ring_buffer_status* status) {
@@ -141,7 +197,7 @@ void onAsyncRingBufferData(char* ring_name, char* buffer, int buffer_size,
 }
 
 // Callback to be invoked for error alert indication.
-std::function<void(wifi_request_id, char*, int, int)>
+AtomicCallback<void(wifi_request_id, char*, int, int)>
     on_error_alert_internal_callback;
 void onAsyncErrorAlert(wifi_request_id id, char* buffer, int buffer_size,
                        int err_code) {
@@ -152,7 +208,7 @@ void onAsyncErrorAlert(wifi_request_id id, char* buffer, int buffer_size,
 }
 
 // Callback to be invoked for radio mode change indication.
-std::function<void(wifi_request_id, uint32_t, wifi_mac_info*)>
+AtomicCallback<void(wifi_request_id, uint32_t, wifi_mac_info*)>
     on_radio_mode_change_internal_callback;
 void onAsyncRadioModeChange(wifi_request_id id, uint32_t num_macs,
                             wifi_mac_info* mac_infos) {
@@ -163,174 +219,343 @@ void onAsyncRadioModeChange(wifi_request_id id, uint32_t num_macs,
 }
 
 // Callback to be invoked for rtt results results.
-std::function<void(wifi_request_id, unsigned num_results,
+AtomicCallback<void(wifi_request_id, unsigned num_results,
                    wifi_rtt_result* rtt_results[])>
     on_rtt_results_internal_callback;
 void onAsyncRttResults(wifi_request_id id, unsigned num_results,
                        wifi_rtt_result* rtt_results[]) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
+    const auto lock = hidl_sync_util::acquireRttControllerLock();
     if (on_rtt_results_internal_callback) {
         on_rtt_results_internal_callback(id, num_results, rtt_results);
         on_rtt_results_internal_callback = nullptr;
     }
 }
 
+// Delivers the NAN discovery indications (matches and followups) off the
+// event loop thread. Dense NAN discovery produces bursts of these, and invoking
+// the HIDL callbacks for each of them on the event loop delays the other
+// netlink events. Queued events are delivered in batches, each taking the NAN
+// iface lock once.
+// All the events are posted from the legacy HAL event loop thread only.
+class NanEventDispatcher {
+   public:
+    static NanEventDispatcher& get() {
+        // Leaked, as the legacy HAL may still post NAN events from its event
+        // loop while static destructors run.
+        static NanEventDispatcher* dispatcher = new NanEventDispatcher();
+        return *dispatcher;
+    }
+
+    // Queues |event| for the dispatcher thread.
+    void post(std::function<void()> event) {
+        {
+            std::unique_lock<std::mutex> lk(lock_);
+            events_.push_back({generation_, std::move(event)});
+        }
+        cv_.notify_all();
+    }
+
+    // Delivers |event| right away if nothing is queued, or queues it behind
+    // the pending events otherwise, so that the framework sees the events in
+    // the order the legacy HAL reported them without the event loop waiting
+    // for the backlog.
+    void deliver(std::function<void()> event) {
+        {
+            std::unique_lock<std::mutex> lk(lock_);
+            if (!events_.empty() || delivering_) {
+                events_.push_back({generation_, std::move(event)});
+                lk.unlock();
+                cv_.notify_all();
+                return;
+            }
+        }
+        // Nothing can be queued meanwhile, as this is the only thread posting.
+        const auto lock = hidl_sync_util::acquireNanIfaceLock();
+        event();
+    }
+
+    // Drops the queued events, which are meant for the NAN iface whose
+    // callbacks are being replaced or removed.
+    void invalidate() {
+        std::unique_lock<std::mutex> lk(lock_);
+        generation_++;
+        events_.clear();
+    }
+
+   private:
+    struct Event {
+        uint64_t generation;
+        std::function<void()> callback;
+    };
+
+    NanEventDispatcher() {
+        std::thread(&NanEventDispatcher::run, this).detach();
+    }
+
+    void run() {
+        std::deque<Event> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(lock_);
+                cv_.wait(lk, [this] { return !events_.empty(); });
+                batch.swap(events_);
+                delivering_ = true;
+            }
+            {
+                const auto lock = hidl_sync_util::acquireNanIfaceLock();
+                for (const auto& event : batch) {
+                    if (event.generation != currentGeneration()) {
+                        continue;
+                    }
+                    event.callback();
+                }
+            }
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lk(lock_);
+                delivering_ = false;
+            }
+        }
+    }
+
+    uint64_t currentGeneration() {
+        std::unique_lock<std::mutex> lk(lock_);
+        return generation_;
+    }
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::deque<Event> events_;
+    bool delivering_ = false;
+    uint64_t generation_ = 0;
+};
+
 // Callbacks for the various NAN operations.
 // NOTE: These have very little conversions to perform before invoking the user
 // callbacks.
 // So, handle all of them here directly to avoid adding an unnecessary layer.
-std::function<void(transaction_id, const NanResponseMsg&)>
+// Matches and followups are queued to the |NanEventDispatcher|, the other
+// events go through it too to keep the order.
+AtomicCallback<void(transaction_id, const NanResponseMsg&)>
     on_nan_notify_response_user_callback;
 void onAysncNanNotifyResponse(transaction_id id, NanResponseMsg* msg) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_notify_response_user_callback && msg) {
-        on_nan_notify_response_user_callback(id, *msg);
+    if (!msg) {
+        return;
     }
+    NanEventDispatcher::get().deliver([id, msg = *msg, caller = __func__]() {
+        if (on_nan_notify_response_user_callback) {
+            on_nan_notify_response_user_callback(id, msg, caller);
+        }
+    });
 }
 
-std::function<void(const NanPublishRepliedInd&)>
+AtomicCallback<void(const NanPublishRepliedInd&)>
     on_nan_event_publish_replied_user_callback;
 void onAysncNanEventPublishReplied(NanPublishRepliedInd* /* event */) {
     LOG(ERROR) << "onAysncNanEventPublishReplied triggered";
 }
 
-std::function<void(const NanPublishTerminatedInd&)>
+AtomicCallback<void(const NanPublishTerminatedInd&)>
     on_nan_event_publish_terminated_user_callback;
 void onAysncNanEventPublishTerminated(NanPublishTerminatedInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_publish_terminated_user_callback && event) {
-        on_nan_event_publish_terminated_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_publish_terminated_user_callback) {
+            on_nan_event_publish_terminated_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanMatchInd&)> on_nan_event_match_user_callback;
+AtomicCallback<void(const NanMatchInd&)> on_nan_event_match_user_callback;
 void onAysncNanEventMatch(NanMatchInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_match_user_callback && event) {
-        on_nan_event_match_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().post([ind = *event, caller = __func__]() {
+        if (on_nan_event_match_user_callback) {
+            on_nan_event_match_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanMatchExpiredInd&)>
+AtomicCallback<void(const NanMatchExpiredInd&)>
     on_nan_event_match_expired_user_callback;
 void onAysncNanEventMatchExpired(NanMatchExpiredInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_match_expired_user_callback && event) {
-        on_nan_event_match_expired_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().post([ind = *event, caller = __func__]() {
+        if (on_nan_event_match_expired_user_callback) {
+            on_nan_event_match_expired_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanSubscribeTerminatedInd&)>
+AtomicCallback<void(const NanSubscribeTerminatedInd&)>
     on_nan_event_subscribe_terminated_user_callback;
 void onAysncNanEventSubscribeTerminated(NanSubscribeTerminatedInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_subscribe_terminated_user_callback && event) {
-        on_nan_event_subscribe_terminated_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_subscribe_terminated_user_callback) {
+            on_nan_event_subscribe_terminated_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanFollowupInd&)> on_nan_event_followup_user_callback;
+AtomicCallback<void(const NanFollowupInd&)> on_nan_event_followup_user_callback;
 void onAysncNanEventFollowup(NanFollowupInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_followup_user_callback && event) {
-        on_nan_event_followup_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().post([ind = *event, caller = __func__]() {
+        if (on_nan_event_followup_user_callback) {
+            on_nan_event_followup_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanDiscEngEventInd&)>
+AtomicCallback<void(const NanDiscEngEventInd&)>
     on_nan_event_disc_eng_event_user_callback;
 void onAysncNanEventDiscEngEvent(NanDiscEngEventInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_disc_eng_event_user_callback && event) {
-        on_nan_event_disc_eng_event_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_disc_eng_event_user_callback) {
+            on_nan_event_disc_eng_event_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanDisabledInd&)> on_nan_event_disabled_user_callback;
+AtomicCallback<void(const NanDisabledInd&)> on_nan_event_disabled_user_callback;
 void onAysncNanEventDisabled(NanDisabledInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_disabled_user_callback && event) {
-        on_nan_event_disabled_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_disabled_user_callback) {
+            on_nan_event_disabled_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanTCAInd&)> on_nan_event_tca_user_callback;
+AtomicCallback<void(const NanTCAInd&)> on_nan_event_tca_user_callback;
 void onAysncNanEventTca(NanTCAInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_tca_user_callback && event) {
-        on_nan_event_tca_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_tca_user_callback) {
+            on_nan_event_tca_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanBeaconSdfPayloadInd&)>
+AtomicCallback<void(const NanBeaconSdfPayloadInd&)>
     on_nan_event_beacon_sdf_payload_user_callback;
 void onAysncNanEventBeaconSdfPayload(NanBeaconSdfPayloadInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_beacon_sdf_payload_user_callback && event) {
-        on_nan_event_beacon_sdf_payload_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_beacon_sdf_payload_user_callback) {
+            on_nan_event_beacon_sdf_payload_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanDataPathRequestInd&)>
+AtomicCallback<void(const NanDataPathRequestInd&)>
     on_nan_event_data_path_request_user_callback;
 void onAysncNanEventDataPathRequest(NanDataPathRequestInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_request_user_callback && event) {
-        on_nan_event_data_path_request_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_data_path_request_user_callback) {
+            on_nan_event_data_path_request_user_callback(ind, caller);
+        }
+    });
 }
-std::function<void(const NanDataPathConfirmInd&)>
+AtomicCallback<void(const NanDataPathConfirmInd&)>
     on_nan_event_data_path_confirm_user_callback;
 void onAysncNanEventDataPathConfirm(NanDataPathConfirmInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_confirm_user_callback && event) {
-        on_nan_event_data_path_confirm_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_data_path_confirm_user_callback) {
+            on_nan_event_data_path_confirm_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanDataPathEndInd&)>
+AtomicCallback<void(const NanDataPathEndInd&)>
     on_nan_event_data_path_end_user_callback;
 void onAysncNanEventDataPathEnd(NanDataPathEndInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_end_user_callback && event) {
-        on_nan_event_data_path_end_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_data_path_end_user_callback) {
+            on_nan_event_data_path_end_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanTransmitFollowupInd&)>
+AtomicCallback<void(const NanTransmitFollowupInd&)>
     on_nan_event_transmit_follow_up_user_callback;
 void onAysncNanEventTransmitFollowUp(NanTransmitFollowupInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_transmit_follow_up_user_callback && event) {
-        on_nan_event_transmit_follow_up_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_transmit_follow_up_user_callback) {
+            on_nan_event_transmit_follow_up_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanRangeRequestInd&)>
+AtomicCallback<void(const NanRangeRequestInd&)>
     on_nan_event_range_request_user_callback;
 void onAysncNanEventRangeRequest(NanRangeRequestInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_range_request_user_callback && event) {
-        on_nan_event_range_request_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_range_request_user_callback) {
+            on_nan_event_range_request_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanRangeReportInd&)>
+AtomicCallback<void(const NanRangeReportInd&)>
     on_nan_event_range_report_user_callback;
 void onAysncNanEventRangeReport(NanRangeReportInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_range_report_user_callback && event) {
-        on_nan_event_range_report_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_range_report_user_callback) {
+            on_nan_event_range_report_user_callback(ind, caller);
+        }
+    });
 }
 
-std::function<void(const NanDataPathScheduleUpdateInd&)>
+AtomicCallback<void(const NanDataPathScheduleUpdateInd&)>
     on_nan_event_schedule_update_user_callback;
 void onAsyncNanEventScheduleUpdate(NanDataPathScheduleUpdateInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_schedule_update_user_callback && event) {
-        on_nan_event_schedule_update_user_callback(*event);
+    if (!event) {
+        return;
     }
+    NanEventDispatcher::get().deliver([ind = *event, caller = __func__]() {
+        if (on_nan_event_schedule_update_user_callback) {
+            on_nan_event_schedule_update_user_callback(ind, caller);
+        }
+    });
 }
 // End of the free-standing "C" style callbacks.
 
@@ -649,20 +874,22 @@ wifi_error WifiLegacyHal::disableLinkLayerStats(const std::string& iface_name) {
         getIfaceHandle(iface_name), 0xFFFFFFFF, &clear_mask_rsp, 1, &stop_rsp);
 }
 
-std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
-    const std::string& iface_name) {
-    LinkLayerStats link_stats{};
-    LinkLayerStats* link_stats_ptr = &link_stats;
+wifi_error WifiLegacyHal::getLinkLayerStats(const std::string& iface_name,
+                                            LinkLayerStats* link_stats) {
+    // |link_stats| may hold the result of a previous call. Its radios are
+    // resized rather than cleared, to reuse the vectors they allocated.
+    link_stats->iface = {};
+    bool radios_reported = false;
 
     on_link_layer_stats_result_internal_callback =
-        [&link_stats_ptr](wifi_request_id /* id */,
-                          wifi_iface_stat* iface_stats_ptr, int num_radios,
-                          wifi_radio_stat* radio_stats_ptr) {
+        [link_stats, &radios_reported](
+            wifi_request_id /* id */, wifi_iface_stat* iface_stats_ptr,
+            int num_radios, wifi_radio_stat* radio_stats_ptr) {
             wifi_radio_stat* l_radio_stats_ptr;
 
             if (iface_stats_ptr != nullptr) {
-                link_stats_ptr->iface = *iface_stats_ptr;
-                link_stats_ptr->iface.num_peers = 0;
+                link_stats->iface = *iface_stats_ptr;
+                link_stats->iface.num_peers = 0;
             } else {
                 LOG(ERROR) << "Invalid iface stats in link layer stats";
             }
@@ -670,9 +897,11 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
                 LOG(ERROR) << "Invalid radio stats in link layer stats";
                 return;
             }
+            link_stats->radios.resize(num_radios);
+            radios_reported = true;
             l_radio_stats_ptr = radio_stats_ptr;
             for (int i = 0; i < num_radios; i++) {
-                LinkLayerRadioStats radio;
+                LinkLayerRadioStats& radio = link_stats->radios[i];
 
                 radio.stats = *l_radio_stats_ptr;
                 // Copy over the tx level array to the separate vector.
@@ -682,6 +911,8 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
                         l_radio_stats_ptr->tx_time_per_levels,
                         l_radio_stats_ptr->tx_time_per_levels +
                             l_radio_stats_ptr->num_tx_levels);
+                } else {
+                    radio.tx_time_per_levels.clear();
                 }
                 radio.stats.num_tx_levels = 0;
                 radio.stats.tx_time_per_levels = nullptr;
@@ -692,8 +923,9 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
                         l_radio_stats_ptr->channels,
                         l_radio_stats_ptr->channels +
                             l_radio_stats_ptr->num_channels);
+                } else {
+                    radio.channel_stats.clear();
                 }
-                link_stats_ptr->radios.push_back(radio);
                 l_radio_stats_ptr =
                     (wifi_radio_stat*)((u8*)l_radio_stats_ptr +
                                        sizeof(wifi_radio_stat) +
@@ -705,7 +937,10 @@ std::pair<wifi_error, LinkLayerStats> WifiLegacyHal::getLinkLayerStats(
     wifi_error status = global_func_table_.wifi_get_link_stats(
         0, getIfaceHandle(iface_name), {onSyncLinkLayerStatsResult});
     on_link_layer_stats_result_internal_callback = nullptr;
-    return {status, link_stats};
+    if (!radios_reported) {
+        link_stats->radios.clear();
+    }
+    return status;
 }
 
 wifi_error WifiLegacyHal::startRssiMonitoring(
@@ -849,30 +1084,28 @@ wifi_error WifiLegacyHal::startPktFateMonitoring(
         getIfaceHandle(iface_name));
 }
 
-std::pair<wifi_error, std::vector<wifi_tx_report>> WifiLegacyHal::getTxPktFates(
-    const std::string& iface_name) {
-    std::vector<wifi_tx_report> tx_pkt_fates;
-    tx_pkt_fates.resize(MAX_FATE_LOG_LEN);
+wifi_error WifiLegacyHal::getTxPktFates(
+    const std::string& iface_name, std::vector<wifi_tx_report>* tx_pkt_fates) {
+    tx_pkt_fates->resize(MAX_FATE_LOG_LEN);
     size_t num_fates = 0;
     wifi_error status = global_func_table_.wifi_get_tx_pkt_fates(
-        getIfaceHandle(iface_name), tx_pkt_fates.data(), tx_pkt_fates.size(),
-        &num_fates);
+        getIfaceHandle(iface_name), tx_pkt_fates->data(),
+        tx_pkt_fates->size(), &num_fates);
     CHECK(num_fates <= MAX_FATE_LOG_LEN);
-    tx_pkt_fates.resize(num_fates);
-    return {status, std::move(tx_pkt_fates)};
+    tx_pkt_fates->resize(num_fates);
+    return status;
 }
 
-std::pair<wifi_error, std::vector<wifi_rx_report>> WifiLegacyHal::getRxPktFates(
-    const std::string& iface_name) {
-    std::vector<wifi_rx_report> rx_pkt_fates;
-    rx_pkt_fates.resize(MAX_FATE_LOG_LEN);
+wifi_error WifiLegacyHal::getRxPktFates(
+    const std::string& iface_name, std::vector<wifi_rx_report>* rx_pkt_fates) {
+    rx_pkt_fates->resize(MAX_FATE_LOG_LEN);
     size_t num_fates = 0;
     wifi_error status = global_func_table_.wifi_get_rx_pkt_fates(
-        getIfaceHandle(iface_name), rx_pkt_fates.data(), rx_pkt_fates.size(),
-        &num_fates);
+        getIfaceHandle(iface_name), rx_pkt_fates->data(),
+        rx_pkt_fates->size(), &num_fates);
     CHECK(num_fates <= MAX_FATE_LOG_LEN);
-    rx_pkt_fates.resize(num_fates);
-    return {status, std::move(rx_pkt_fates)};
+    rx_pkt_fates->resize(num_fates);
+    return status;
 }
 
 std::pair<wifi_error, WakeReasonStats> WifiLegacyHal::getWakeReasonStats(
@@ -1155,6 +1388,7 @@ wifi_error WifiLegacyHal::setRttLcr(const std::string& iface_name,
 
 wifi_error WifiLegacyHal::nanRegisterCallbackHandlers(
     const std::string& iface_name, const NanCallbackHandlers& user_callbacks) {
+    NanEventDispatcher::get().invalidate();
     on_nan_notify_response_user_callback = user_callbacks.on_notify_response;
     on_nan_event_publish_terminated_user_callback =
         user_callbacks.on_event_publish_terminated;
@@ -1472,6 +1706,7 @@ void WifiLegacyHal::invalidate() {
     on_error_alert_internal_callback = nullptr;
     on_radio_mode_change_internal_callback = nullptr;
     on_rtt_results_internal_callback = nullptr;
+    NanEventDispatcher::get().invalidate();
     on_nan_notify_response_user_callback = nullptr;
     on_nan_event_publish_terminated_user_callback = nullptr;
     on_nan_event_match_user_callback = nullptr;
@@ -228,8 +228,9 @@ class WifiLegacyHal {
     // Link layer stats functions.
     wifi_error enableLinkLayerStats(const std::string& iface_name, bool debug);
     wifi_error disableLinkLayerStats(const std::string& iface_name);
-    std::pair<wifi_error, LinkLayerStats> getLinkLayerStats(
-        const std::string& iface_name);
+    // Fills |link_stats|, reusing the buffers it holds from previous calls.
+    wifi_error getLinkLayerStats(const std::string& iface_name,
+                                 LinkLayerStats* link_stats);
     // RSSI monitor functions.
     wifi_error startRssiMonitoring(const std::string& iface_name,
                                    wifi_request_id id, int8_t max_rssi,
@@ -266,10 +267,12 @@ class WifiLegacyHal {
     std::pair<wifi_error, uint32_t> getLoggerSupportedFeatureSet(
         const std::string& iface_name);
     wifi_error startPktFateMonitoring(const std::string& iface_name);
-    std::pair<wifi_error, std::vector<wifi_tx_report>> getTxPktFates(
-        const std::string& iface_name);
-    std::pair<wifi_error, std::vector<wifi_rx_report>> getRxPktFates(
-        const std::string& iface_name);
+    // Fill |tx_pkt_fates| / |rx_pkt_fates|. The vectors keep their capacity
+    // across calls, so passing the same ones again does not allocate.
+    wifi_error getTxPktFates(const std::string& iface_name,
+                             std::vector<wifi_tx_report>* tx_pkt_fates);
+    wifi_error getRxPktFates(const std::string& iface_name,
+                             std::vector<wifi_rx_report>* rx_pkt_fates);
     std::pair<wifi_error, WakeReasonStats> getWakeReasonStats(
         const std::string& iface_name);
     wifi_error registerRingBufferCallbackHandler(
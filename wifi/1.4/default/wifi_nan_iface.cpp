@@ -516,6 +516,8 @@ WifiNanIface::WifiNanIface(
     iface_util::IfaceEventHandlers event_handlers = {};
     event_handlers.on_state_toggle_off_on =
         [weak_ptr_this](const std::string& /* iface_name */) {
+            // Invoked from the HIDL methods of other interfaces.
+            const auto lock = acquireLock();
             const auto shared_ptr_this = weak_ptr_this.promote();
             if (!shared_ptr_this.get() || !shared_ptr_this->isValid()) {
                 LOG(ERROR) << "Callback invoked on an invalid object";
@@ -534,6 +536,7 @@ WifiNanIface::WifiNanIface(
 }
 
 void WifiNanIface::invalidate() {
+    const auto lock = acquireLock();
     if (!isValid()) {
         return;
     }
@@ -554,6 +557,10 @@ void WifiNanIface::invalidate() {
 
 bool WifiNanIface::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiNanIface::acquireLock() {
+    return hidl_sync_util::acquireNanIfaceLock();
+}
+
 std::string WifiNanIface::getName() { return ifname_; }
 
 std::set<sp<V1_0::IWifiNanIfaceEventCallback>>
@@ -44,6 +44,8 @@ class WifiNanIface : public V1_4::IWifiNanIface {
     // Refer to |WifiChip::invalidate()|.
     void invalidate();
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::string getName();
 
     // HIDL methods exposed.
@@ -39,6 +39,10 @@ void WifiP2pIface::invalidate() {
 
 bool WifiP2pIface::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiP2pIface::acquireLock() {
+    return hidl_sync_util::acquireGlobalLock();
+}
+
 std::string WifiP2pIface::getName() { return ifname_; }
 
 Return<void> WifiP2pIface::getName(getName_cb hidl_status_cb) {
@@ -39,6 +39,8 @@ class WifiP2pIface : public V1_0::IWifiP2pIface {
     // Refer to |WifiChip::invalidate()|.
     void invalidate();
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::string getName();
 
     // HIDL methods exposed.
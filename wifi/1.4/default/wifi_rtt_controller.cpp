@@ -37,6 +37,7 @@ WifiRttController::WifiRttController(
       is_valid_(true) {}
 
 void WifiRttController::invalidate() {
+    const auto lock = acquireLock();
     legacy_hal_.reset();
     event_callbacks_.clear();
     is_valid_ = false;
@@ -44,6 +45,10 @@ void WifiRttController::invalidate() {
 
 bool WifiRttController::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiRttController::acquireLock() {
+    return hidl_sync_util::acquireRttControllerLock();
+}
+
 std::vector<sp<IWifiRttControllerEventCallback>>
 WifiRttController::getEventCallbacks() {
     return event_callbacks_;
@@ -41,6 +41,8 @@ class WifiRttController : public V1_4::IWifiRttController {
     // Refer to |WifiChip::invalidate()|.
     void invalidate();
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::vector<sp<IWifiRttControllerEventCallback>> getEventCallbacks();
     std::string getIfaceName();
 
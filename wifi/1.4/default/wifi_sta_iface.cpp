@@ -46,6 +46,7 @@ WifiStaIface::WifiStaIface(
 }
 
 void WifiStaIface::invalidate() {
+    const auto lock = acquireLock();
     legacy_hal_.reset();
     event_cb_handler_.invalidate();
     is_valid_ = false;
@@ -53,6 +54,10 @@ void WifiStaIface::invalidate() {
 
 bool WifiStaIface::isValid() { return is_valid_; }
 
+std::unique_lock<std::recursive_mutex> WifiStaIface::acquireLock() {
+    return hidl_sync_util::acquireStaIfaceLock();
+}
+
 std::string WifiStaIface::getName() { return ifname_; }
 
 std::set<sp<IWifiStaIfaceEventCallback>> WifiStaIface::getEventCallbacks() {
@@ -398,7 +403,7 @@ WifiStatus WifiStaIface::startBackgroundScanInternal(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            std::vector<StaScanData> hidl_scan_datas;
+            hidl_vec<StaScanData> hidl_scan_datas;
             if (!hidl_struct_util::
                     convertLegacyVectorOfCachedGscanResultsToHidl(
                         results, &hidl_scan_datas)) {
@@ -468,21 +473,22 @@ WifiStaIface::getLinkLayerStatsInternal() {
     return {createWifiStatus(WifiStatusCode::ERROR_NOT_SUPPORTED), {}};
 }
 
-std::pair<WifiStatus, V1_3::StaLinkLayerStats>
+std::pair<WifiStatus, const V1_3::StaLinkLayerStats&>
 WifiStaIface::getLinkLayerStatsInternal_1_3() {
-    legacy_hal::wifi_error legacy_status;
-    legacy_hal::LinkLayerStats legacy_stats;
-    std::tie(legacy_status, legacy_stats) =
-        legacy_hal_.lock()->getLinkLayerStats(ifname_);
+    // The stats are polled periodically, so convert them into buffers kept
+    // across calls. They are returned by reference, which stays valid until
+    // |validateAndCall| has invoked the HIDL callback.
+    static const V1_3::StaLinkLayerStats kEmptyStats{};
+    legacy_hal::wifi_error legacy_status =
+        legacy_hal_.lock()->getLinkLayerStats(ifname_, &legacy_link_stats_);
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
-        return {createWifiStatusFromLegacyError(legacy_status), {}};
+        return {createWifiStatusFromLegacyError(legacy_status), kEmptyStats};
     }
-    V1_3::StaLinkLayerStats hidl_stats;
-    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(legacy_stats,
-                                                             &hidl_stats)) {
-        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
+    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+            legacy_link_stats_, &hidl_link_stats_)) {
+        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), kEmptyStats};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_stats};
+    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_link_stats_};
 }
 
 WifiStatus WifiStaIface::startRssiMonitoringInternal(uint32_t cmd_id,
@@ -589,38 +595,34 @@ WifiStatus WifiStaIface::startDebugPacketFateMonitoringInternal() {
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
-std::pair<WifiStatus, std::vector<WifiDebugTxPacketFateReport>>
+std::pair<WifiStatus, const hidl_vec<WifiDebugTxPacketFateReport>&>
 WifiStaIface::getDebugTxPacketFatesInternal() {
-    legacy_hal::wifi_error legacy_status;
-    std::vector<legacy_hal::wifi_tx_report> legacy_fates;
-    std::tie(legacy_status, legacy_fates) =
-        legacy_hal_.lock()->getTxPktFates(ifname_);
+    static const hidl_vec<WifiDebugTxPacketFateReport> kNoFates;
+    legacy_hal::wifi_error legacy_status = legacy_hal_.lock()->getTxPktFates(
+        ifname_, &legacy_tx_pkt_fates_);
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
-        return {createWifiStatusFromLegacyError(legacy_status), {}};
+        return {createWifiStatusFromLegacyError(legacy_status), kNoFates};
     }
-    std::vector<WifiDebugTxPacketFateReport> hidl_fates;
     if (!hidl_struct_util::convertLegacyVectorOfDebugTxPacketFateToHidl(
-            legacy_fates, &hidl_fates)) {
-        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
+            legacy_tx_pkt_fates_, &hidl_tx_pkt_fates_)) {
+        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), kNoFates};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_fates};
+    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_tx_pkt_fates_};
 }
 
-std::pair<WifiStatus, std::vector<WifiDebugRxPacketFateReport>>
+std::pair<WifiStatus, const hidl_vec<WifiDebugRxPacketFateReport>&>
 WifiStaIface::getDebugRxPacketFatesInternal() {
-    legacy_hal::wifi_error legacy_status;
-    std::vector<legacy_hal::wifi_rx_report> legacy_fates;
-    std::tie(legacy_status, legacy_fates) =
-        legacy_hal_.lock()->getRxPktFates(ifname_);
+    static const hidl_vec<WifiDebugRxPacketFateReport> kNoFates;
+    legacy_hal::wifi_error legacy_status = legacy_hal_.lock()->getRxPktFates(
+        ifname_, &legacy_rx_pkt_fates_);
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
-        return {createWifiStatusFromLegacyError(legacy_status), {}};
+        return {createWifiStatusFromLegacyError(legacy_status), kNoFates};
     }
-    std::vector<WifiDebugRxPacketFateReport> hidl_fates;
     if (!hidl_struct_util::convertLegacyVectorOfDebugRxPacketFateToHidl(
-            legacy_fates, &hidl_fates)) {
-        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
+            legacy_rx_pkt_fates_, &hidl_rx_pkt_fates_)) {
+        return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), kNoFates};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_fates};
+    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_rx_pkt_fates_};
 }
 
 WifiStatus WifiStaIface::setMacAddressInternal(
@@ -43,6 +43,8 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     // Refer to |WifiChip::invalidate()|.
     void invalidate();
     bool isValid();
+    // Refer to |WifiChip::acquireLock()|.
+    static std::unique_lock<std::recursive_mutex> acquireLock();
     std::set<sp<IWifiStaIfaceEventCallback>> getEventCallbacks();
     std::string getName();
 
@@ -136,7 +138,7 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     WifiStatus enableLinkLayerStatsCollectionInternal(bool debug);
     WifiStatus disableLinkLayerStatsCollectionInternal();
     std::pair<WifiStatus, V1_0::StaLinkLayerStats> getLinkLayerStatsInternal();
-    std::pair<WifiStatus, V1_3::StaLinkLayerStats>
+    std::pair<WifiStatus, const V1_3::StaLinkLayerStats&>
     getLinkLayerStatsInternal_1_3();
     WifiStatus startRssiMonitoringInternal(uint32_t cmd_id, int32_t max_rssi,
                                            int32_t min_rssi);
@@ -153,9 +155,9 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     WifiStatus stopSendingKeepAlivePacketsInternal(uint32_t cmd_id);
     WifiStatus setScanningMacOuiInternal(const std::array<uint8_t, 3>& oui);
     WifiStatus startDebugPacketFateMonitoringInternal();
-    std::pair<WifiStatus, std::vector<WifiDebugTxPacketFateReport>>
+    std::pair<WifiStatus, const hidl_vec<WifiDebugTxPacketFateReport>&>
     getDebugTxPacketFatesInternal();
-    std::pair<WifiStatus, std::vector<WifiDebugRxPacketFateReport>>
+    std::pair<WifiStatus, const hidl_vec<WifiDebugRxPacketFateReport>&>
     getDebugRxPacketFatesInternal();
     WifiStatus setMacAddressInternal(const std::array<uint8_t, 6>& mac);
     std::pair<WifiStatus, std::array<uint8_t, 6>>
@@ -167,6 +169,16 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     bool is_valid_;
     hidl_callback_util::HidlCallbackHandler<IWifiStaIfaceEventCallback>
         event_cb_handler_;
+    // Reused by |getLinkLayerStatsInternal_1_3| to avoid reallocating the
+    // radio and channel stats on every poll.
+    legacy_hal::LinkLayerStats legacy_link_stats_;
+    V1_3::StaLinkLayerStats hidl_link_stats_;
+    // Reused by the packet fate getters, so that reading the fates at bug
+    // report time does not allocate the full fate logs again.
+    std::vector<legacy_hal::wifi_tx_report> legacy_tx_pkt_fates_;
+    std::vector<legacy_hal::wifi_rx_report> legacy_rx_pkt_fates_;
+    hidl_vec<WifiDebugTxPacketFateReport> hidl_tx_pkt_fates_;
+    hidl_vec<WifiDebugRxPacketFateReport> hidl_rx_pkt_fates_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiStaIface);
 };